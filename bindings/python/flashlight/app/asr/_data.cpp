@@ -0,0 +1,407 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <arrayfire.h>
+#include <gflags/gflags.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include "flashlight/app/asr/augmentation/SoundEffectConfig.h"
+#include "flashlight/app/asr/common/Defines.h"
+#include "flashlight/app/asr/common/Flags.h"
+#include "flashlight/app/asr/data/FeatureTransforms.h"
+#include "flashlight/app/asr/data/Utils.h"
+#include "flashlight/app/asr/runtime/runtime.h"
+#include "flashlight/fl/flashlight.h"
+#include "flashlight/lib/common/String.h"
+#include "flashlight/lib/text/dictionary/Dictionary.h"
+#include "flashlight/lib/text/dictionary/Utils.h"
+
+namespace py = pybind11;
+using namespace pybind11::literals;
+using namespace fl::app::asr;
+
+namespace {
+
+// The ABI of DLPack (https://github.com/dmlc/dlpack), with which the batches
+// are handed to PyTorch and the other frameworks without copies
+struct DLDevice {
+  int32_t device_type;
+  int32_t device_id;
+};
+
+struct DLDataType {
+  uint8_t code;
+  uint8_t bits;
+  uint16_t lanes;
+};
+
+struct DLTensor {
+  void* data;
+  DLDevice device;
+  int32_t ndim;
+  DLDataType dtype;
+  int64_t* shape;
+  int64_t* strides;
+  uint64_t byte_offset;
+};
+
+struct DLManagedTensor {
+  DLTensor dl_tensor;
+  void* manager_ctx;
+  void (*deleter)(DLManagedTensor* self);
+};
+
+constexpr int32_t kDLCPU = 1;
+constexpr int32_t kDLCUDA = 2;
+constexpr uint8_t kDLInt = 0;
+constexpr uint8_t kDLUInt = 1;
+constexpr uint8_t kDLFloat = 2;
+
+// The array whose memory a DLPack tensor points to, locked until the tensor
+// is deleted by its consumer
+struct ArrayTensor {
+  af::array array;
+  bool locked{false};
+  std::vector<int64_t> shape;
+  DLManagedTensor tensor;
+};
+
+void deleteArrayTensor(DLManagedTensor* self) {
+  auto owner = static_cast<ArrayTensor*>(self->manager_ctx);
+  if (owner->locked) {
+    owner->array.unlock();
+  }
+  delete owner;
+}
+
+DLDataType toDLDataType(af::dtype type) {
+  switch (type) {
+    case f32:
+      return {kDLFloat, 32, 1};
+    case f64:
+      return {kDLFloat, 64, 1};
+    case f16:
+      return {kDLFloat, 16, 1};
+    case s32:
+      return {kDLInt, 32, 1};
+    case s64:
+      return {kDLInt, 64, 1};
+    case s16:
+      return {kDLInt, 16, 1};
+    case u8:
+    case b8:
+      return {kDLUInt, 8, 1};
+    case u16:
+      return {kDLUInt, 16, 1};
+    case u32:
+      return {kDLUInt, 32, 1};
+    case u64:
+      return {kDLUInt, 64, 1};
+    default:
+      throw std::invalid_argument("toDLPack - unsupported array type");
+  }
+}
+
+/**
+ * Returns the memory of an array as a DLPack capsule ("dltensor"), without
+ * copying. The dimensions of ArrayFire are column major: the tensor has the
+ * `ndim` first of them reversed, e.g. B x C x F x T for a batch of inputs.
+ * Device arrays are handed out as CUDA tensors of the active device.
+ */
+py::capsule toDLPack(const af::array& arr, int ndim) {
+  int32_t deviceType;
+  int32_t deviceId = 0;
+  switch (af::getActiveBackend()) {
+    case AF_BACKEND_CPU:
+      deviceType = kDLCPU;
+      break;
+    case AF_BACKEND_CUDA:
+      deviceType = kDLCUDA;
+      deviceId = af::getDevice();
+      break;
+    default:
+      throw std::invalid_argument(
+          "toDLPack - only the CPU and CUDA backends are supported");
+  }
+  auto owner = new ArrayTensor();
+  owner->array = arr;
+  for (int i = ndim - 1; i >= 0; --i) {
+    owner->shape.push_back(arr.dims(i));
+  }
+  // E.g. the words of a pipeline without lexicon
+  void* data = nullptr;
+  if (!arr.isempty()) {
+    // Locks the array, so that its memory isn't reused by ArrayFire
+    if (af_get_device_ptr(&data, owner->array.get()) != AF_SUCCESS) {
+      delete owner;
+      throw std::runtime_error("toDLPack - unable to get the array memory");
+    }
+    owner->locked = true;
+  }
+  auto& tensor = owner->tensor.dl_tensor;
+  tensor.data = data;
+  tensor.device = {deviceType, deviceId};
+  tensor.ndim = ndim;
+  tensor.dtype = toDLDataType(arr.type());
+  tensor.shape = owner->shape.data();
+  tensor.strides = nullptr; // compact, row major
+  tensor.byte_offset = 0;
+  owner->tensor.manager_ctx = owner;
+  owner->tensor.deleter = deleteArrayTensor;
+  // Consumers rename the capsule to "used_dltensor" and delete the tensor
+  return py::capsule(&owner->tensor, "dltensor", [](PyObject* capsule) {
+    if (PyCapsule_IsValid(capsule, "dltensor")) {
+      auto tensor = static_cast<DLManagedTensor*>(
+          PyCapsule_GetPointer(capsule, "dltensor"));
+      tensor->deleter(tensor);
+    }
+  });
+}
+
+void setFlag(const std::string& name, const std::string& value) {
+  if (gflags::SetCommandLineOption(name.c_str(), value.c_str()).empty()) {
+    throw std::invalid_argument(
+        "DataPipeline - unknown flag or invalid value: --" + name + "=" +
+        value);
+  }
+}
+
+/**
+ * The batches of an epoch of a `DataPipeline`, read, featurized, augmented
+ * and batched by the threads of a `PrefetchDataset` while Python consumes the
+ * previous ones.
+ */
+class EpochIterator {
+ public:
+  explicit EpochIterator(std::shared_ptr<fl::Dataset> dataset)
+      : dataset_(std::move(dataset)) {}
+
+  py::dict next() {
+    if (index_ >= dataset_->size()) {
+      throw py::stop_iteration();
+    }
+    std::vector<af::array> sample;
+    {
+      py::gil_scoped_release release;
+      sample = dataset_->get(index_++);
+      for (auto& arr : sample) {
+        arr.eval();
+      }
+      // Consumers read the memory on their own streams
+      af::sync();
+    }
+    std::vector<std::string> sampleIds;
+    if (!sample[kSampleIdx].isempty()) {
+      sampleIds = readSampleIds(sample[kSampleIdx]);
+    }
+    return py::dict(
+        "input"_a = toDLPack(sample[kInputIdx], 4),
+        "target"_a = toDLPack(sample[kTargetIdx], 2),
+        "word"_a = toDLPack(sample[kWordIdx], 2),
+        "duration"_a = toDLPack(af::flat(sample[kDurationIdx]), 1),
+        "target_size"_a = toDLPack(af::flat(sample[kTargetSizeIdx]), 1),
+        "sample_id"_a = sampleIds);
+  }
+
+  int64_t size() const {
+    return dataset_->size();
+  }
+
+ private:
+  std::shared_ptr<fl::Dataset> dataset_;
+  int64_t index_{0};
+};
+
+/**
+ * The input pipeline of fl_asr_train, configured by the same flags: the lists
+ * (or the manifests of packed feature shards) of --train are read with
+ * --datadir, featurized with --features_type, augmented with --sfx_config and
+ * batched with --batchsize and --batching_strategy. The flags of the process
+ * are set from `flagsfile`, then from `flags`.
+ */
+class DataPipeline {
+ public:
+  DataPipeline(
+      const std::string& flagsfile,
+      const std::map<std::string, std::string>& flags,
+      const std::string& lists,
+      int nthreads,
+      bool shuffle,
+      int worldRank,
+      int worldSize)
+      : nthreads_(nthreads), shuffle_(shuffle) {
+    if (!flagsfile.empty() &&
+        !gflags::ReadFromFlagsFile(flagsfile, "flashlight", false)) {
+      throw std::invalid_argument(
+          "DataPipeline - unable to read the flags file " + flagsfile);
+    }
+    for (const auto& flag : flags) {
+      setFlag(flag.first, flag.second);
+    }
+    if (FLAGS_tokens.empty()) {
+      throw std::invalid_argument("DataPipeline - --tokens is required");
+    }
+    fl::init();
+
+    fl::lib::text::Dictionary tokenDict(FLAGS_tokens);
+    for (int64_t r = 1; r <= FLAGS_replabel; ++r) {
+      tokenDict.addEntry("<" + std::to_string(r) + ">");
+    }
+    if (FLAGS_criterion == kCtcCriterion) {
+      tokenDict.addEntry(kBlankToken);
+    }
+    bool isSeq2seqCrit = FLAGS_criterion == kSeq2SeqTransformerCriterion ||
+        FLAGS_criterion == kSeq2SeqRNNCriterion;
+    if (isSeq2seqCrit) {
+      tokenDict.addEntry(kEosToken);
+      tokenDict.addEntry(fl::lib::text::kPadToken);
+    }
+    fl::lib::text::Dictionary wordDict;
+    fl::lib::text::LexiconMap lexicon;
+    if (!FLAGS_lexicon.empty()) {
+      lexicon = fl::lib::text::loadWords(FLAGS_lexicon, FLAGS_maxword);
+      wordDict = fl::lib::text::createWordDict(lexicon);
+    }
+
+    fl::lib::audio::FeatureParams featParams(
+        FLAGS_samplerate,
+        FLAGS_framesizems,
+        FLAGS_framestridems,
+        FLAGS_filterbanks,
+        FLAGS_lowfreqfilterbank,
+        FLAGS_highfreqfilterbank,
+        FLAGS_mfcccoeffs,
+        kLifterParam /* lifterparam */,
+        FLAGS_devwin /* delta window */,
+        FLAGS_devwin /* delta-delta window */);
+    featParams.useEnergy = false;
+    featParams.usePower = false;
+    featParams.zeroMeanFrame = false;
+    auto featureRes =
+        getFeatureType(FLAGS_features_type, FLAGS_channels, featParams);
+    numFeatures_ = featureRes.first;
+    numClasses_ = tokenDict.indexSize();
+    TargetGenerationConfig targetGenConfig(
+        FLAGS_wordseparator,
+        FLAGS_sampletarget,
+        FLAGS_criterion,
+        FLAGS_surround,
+        isSeq2seqCrit,
+        FLAGS_replabel,
+        true /* skip unk */,
+        FLAGS_usewordpiece /* fallback2LetterWordSepLeft */,
+        !FLAGS_usewordpiece /* fallback2LetterWordSepLeft */);
+    const auto sfxConf = (FLAGS_sfx_config.empty())
+        ? std::vector<sfx::SoundEffectConfig>()
+        : sfx::readSoundEffectConfigFile(FLAGS_sfx_config);
+    auto inputTransform = inputFeatures(
+        featParams,
+        featureRes.second,
+        {FLAGS_localnrmlleftctx, FLAGS_localnrmlrightctx},
+        sfxConf,
+        0 /* sfxStartUpdate */,
+        FLAGS_features_on_device);
+    int targetpadVal = isSeq2seqCrit
+        ? tokenDict.getIndex(fl::lib::text::kPadToken)
+        : kTargetPadValue;
+
+    dataset_ = createDataset(
+        fl::lib::split(",", lists.empty() ? FLAGS_train : lists, true),
+        FLAGS_datadir,
+        FLAGS_batchsize,
+        inputTransform,
+        targetFeatures(tokenDict, lexicon, targetGenConfig),
+        wordFeatures(wordDict),
+        std::make_tuple(0, targetpadVal, kTargetPadValue),
+        worldRank,
+        worldSize,
+        false /* allowEmpty */,
+        FLAGS_batching_strategy,
+        FLAGS_batching_max_duration,
+        FLAGS_batching_num_buckets);
+  }
+
+  /**
+   * Returns the batches of an epoch, shuffled with `epoch` as seed as in
+   * fl_asr_train. The buckets of --batching_strategy=bucket are resampled, so
+   * the iterator of the previous epoch shouldn't be used anymore.
+   */
+  EpochIterator epoch(int64_t epoch) {
+    py::gil_scoped_release release;
+    if (auto bucketed =
+            std::dynamic_pointer_cast<fl::BucketBatchDataset>(dataset_)) {
+      bucketed->setSeed(epoch);
+      bucketed->resample();
+    }
+    return EpochIterator(loadPrefetchDataset(
+        dataset_,
+        nthreads_,
+        shuffle_,
+        epoch /* seed */,
+        FLAGS_prefetch_reorder_window));
+  }
+
+  int64_t size() const {
+    return dataset_->size();
+  }
+
+  int numFeatures() const {
+    return numFeatures_;
+  }
+
+  int numClasses() const {
+    return numClasses_;
+  }
+
+ private:
+  std::shared_ptr<fl::Dataset> dataset_;
+  int nthreads_;
+  bool shuffle_;
+  int numFeatures_;
+  int numClasses_;
+};
+
+} // namespace
+
+PYBIND11_MODULE(flashlight_app_asr_data, m) {
+  py::class_<EpochIterator>(m, "EpochIterator")
+      .def("__iter__", [](EpochIterator& it) -> EpochIterator& { return it; })
+      .def("__next__", &EpochIterator::next)
+      .def("__len__", &EpochIterator::size);
+
+  py::class_<DataPipeline>(m, "DataPipeline")
+      .def(
+          py::init<
+              const std::string&,
+              const std::map<std::string, std::string>&,
+              const std::string&,
+              int,
+              bool,
+              int,
+              int>(),
+          "flagsfile"_a = "",
+          "flags"_a = std::map<std::string, std::string>(),
+          "lists"_a = "",
+          "nthreads"_a = 4,
+          "shuffle"_a = true,
+          "world_rank"_a = 0,
+          "world_size"_a = 1,
+          py::call_guard<py::gil_scoped_release>())
+      .def("epoch", &DataPipeline::epoch, "epoch"_a = 0)
+      .def("__len__", &DataPipeline::size)
+      .def_property_readonly("num_features", &DataPipeline::numFeatures)
+      .def_property_readonly("num_classes", &DataPipeline::numClasses);
+}
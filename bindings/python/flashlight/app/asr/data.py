@@ -0,0 +1,22 @@
+#!/usr/bin/env python3
+"""
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+"""
+
+from .flashlight_app_asr_data import DataPipeline, EpochIterator
+
+
+def to_torch(batch):
+    """
+    Returns the tensors of a batch of a `DataPipeline` as torch tensors,
+    which share the memory of the pipeline (no copy).
+    """
+    from torch.utils.dlpack import from_dlpack
+
+    return {
+        key: value if key == "sample_id" else from_dlpack(value)
+        for key, value in batch.items()
+    }
@@ -5,6 +5,13 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+
+#include <pybind11/numpy.h>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 
@@ -39,6 +46,127 @@ using PreEmphasis = fl::lib::audio::PreEmphasis;
 using TriFilterbank = fl::lib::audio::TriFilterbank;
 using Windowing = fl::lib::audio::Windowing;
 
+namespace {
+
+using Signals = py::array_t<float, py::array::c_style>;
+
+// Returns `feat` as a NumPy array which owns it, without copying
+py::array_t<float> toArray(
+    std::vector<float>&& feat,
+    const std::vector<py::ssize_t>& shape) {
+  auto owner = new std::vector<float>(std::move(feat));
+  py::capsule capsule(owner, [](void* ptr) {
+    delete static_cast<std::vector<float>*>(ptr);
+  });
+  return py::array_t<float>(shape, owner->data(), capsule);
+}
+
+/**
+ * Featurizes a signal (T) given as a float32 NumPy array, into a NumPy array
+ * of FRAMESZ x FEAT, without holding the GIL.
+ */
+template <class F>
+py::array_t<float> applyArray(F& featurizer, const Signals& input) {
+  if (input.ndim() != 1) {
+    throw std::invalid_argument("apply: input must be of size T");
+  }
+  int T = input.shape(0);
+  int numFrames = featurizer.getFeatureParams().numFrames(T);
+  std::vector<float> feat;
+  {
+    py::gil_scoped_release release;
+    feat = featurizer.apply(std::vector<float>(input.data(), input.data() + T));
+  }
+  int featSz = numFrames > 0 ? feat.size() / numFrames : 0;
+  return toArray(std::move(feat), {numFrames, featSz});
+}
+
+/**
+ * Featurizes the signals of a B x T float32 NumPy array into a NumPy array of
+ * B x FRAMESZ x FEAT, with `batchApply()`. With `numThreads` > 1, the batch is
+ * split between threads, the first one using `featurizer`, the others their
+ * own featurizer: featurizers hold buffers and can't be shared by threads.
+ */
+template <class F>
+py::array_t<float>
+batchApplyArray(F& featurizer, const Signals& input, int numThreads) {
+  if (input.ndim() != 2) {
+    throw std::invalid_argument("batch_apply: input must be of size B x T");
+  }
+  int B = input.shape(0);
+  int T = input.shape(1);
+  auto params = featurizer.getFeatureParams();
+  int numFrames = params.numFrames(T);
+  int featSz = numFrames > 0 ? featurizer.outputSize(T) / numFrames : 0;
+  py::array_t<float> output({B, numFrames, featSz});
+  if (B == 0 || numFrames == 0) {
+    return output;
+  }
+  const float* in = input.data();
+  float* out = output.mutable_data();
+
+  py::gil_scoped_release release;
+  numThreads = std::max(1, std::min(numThreads, B));
+  int chunkSz = (B + numThreads - 1) / numThreads;
+  auto run = [&](F& chunkFeaturizer, int begin, int end) {
+    std::vector<float> signals(
+        in + static_cast<size_t>(begin) * T, in + static_cast<size_t>(end) * T);
+    auto feat = chunkFeaturizer.batchApply(signals, end - begin);
+    std::memcpy(
+        out + static_cast<size_t>(begin) * numFrames * featSz,
+        feat.data(),
+        feat.size() * sizeof(float));
+  };
+  if (numThreads == 1) {
+    run(featurizer, 0, B);
+    return output;
+  }
+  std::vector<std::exception_ptr> errors(numThreads);
+  std::vector<std::thread> threads;
+  for (int t = 1; t < numThreads && t * chunkSz < B; ++t) {
+    threads.emplace_back([&, t]() {
+      try {
+        F chunkFeaturizer(params);
+        run(chunkFeaturizer, t * chunkSz, std::min(B, (t + 1) * chunkSz));
+      } catch (...) {
+        errors[t] = std::current_exception();
+      }
+    });
+  }
+  try {
+    run(featurizer, 0, chunkSz);
+  } catch (...) {
+    errors[0] = std::current_exception();
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (const auto& error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+  return output;
+}
+
+// NumPy overloads go first to be chosen over the conversion to a list
+template <class F>
+void bindFeaturizer(py::class_<F>& featurizer) {
+  featurizer.def(py::init<const FeatureParams&>(), "params"_a)
+      .def("apply", &applyArray<F>, "input"_a)
+      .def("apply", &F::apply, "input"_a)
+      .def(
+          "batch_apply",
+          &batchApplyArray<F>,
+          "input"_a,
+          "num_threads"_a = 1)
+      .def("batch_apply", &F::batchApply, "input"_a, "batch_sz"_a)
+      .def("output_size", &F::outputSize, "input_sz"_a)
+      .def("get_feature_params", &F::getFeatureParams);
+}
+
+} // namespace
+
 PYBIND11_MODULE(flashlight_lib_audio_feature, m) {
   py::enum_<WindowType>(m, "WindowType")
       .value("HAMMING", WindowType::HAMMING)
@@ -127,24 +255,12 @@ PYBIND11_MODULE(flashlight_lib_audio_feature, m) {
       .def(py::init<float>(), "dither_val"_a)
       .def("apply", &Dither::apply, "input"_a)
       .def("apply_in_place", &Dither::applyInPlace, "input"_a);
-  py::class_<Mfcc>(m, "Mfcc")
-      .def(py::init<const FeatureParams&>(), "params"_a)
-      .def("apply", &Mfcc::apply, "input"_a)
-      .def("batch_apply", &Mfcc::batchApply, "input"_a, "batch_sz"_a)
-      .def("output_size", &Mfcc::outputSize, "input_sz"_a)
-      .def("get_feature_params", &Mfcc::getFeatureParams);
-  py::class_<Mfsc>(m, "Mfsc")
-      .def(py::init<const FeatureParams&>(), "params"_a)
-      .def("apply", &Mfsc::apply, "input"_a)
-      .def("batch_apply", &Mfsc::batchApply, "input"_a, "batch_sz"_a)
-      .def("output_size", &Mfsc::outputSize, "input_sz"_a)
-      .def("get_feature_params", &Mfsc::getFeatureParams);
-  py::class_<PowerSpectrum>(m, "PowerSpectrum")
-      .def(py::init<const FeatureParams&>(), "params"_a)
-      .def("apply", &PowerSpectrum::apply, "input"_a)
-      .def("batch_apply", &PowerSpectrum::batchApply, "input"_a, "batch_sz"_a)
-      .def("output_size", &PowerSpectrum::outputSize, "input_sz"_a)
-      .def("get_feature_params", &PowerSpectrum::getFeatureParams);
+  py::class_<Mfcc> mfcc(m, "Mfcc");
+  bindFeaturizer(mfcc);
+  py::class_<Mfsc> mfsc(m, "Mfsc");
+  bindFeaturizer(mfsc);
+  py::class_<PowerSpectrum> powerSpectrum(m, "PowerSpectrum");
+  bindFeaturizer(powerSpectrum);
   py::class_<PreEmphasis>(m, "PreEmphasis")
       .def(py::init<float, int64_t>(), "alpha"_a, "N"_a)
       .def("apply", &PreEmphasis::apply, "input"_a)
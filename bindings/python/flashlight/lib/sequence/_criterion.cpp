@@ -12,6 +12,7 @@
 #include "flashlight/lib/sequence/criterion/cpu/ViterbiPath.h"
 
 #ifdef FL_LIBRARIES_USE_CUDA
+#include "flashlight/lib/sequence/criterion/cuda/ConnectionistTemporalClassificationCriterion.cuh"
 #include "flashlight/lib/sequence/criterion/cuda/ForceAlignmentCriterion.cuh"
 #include "flashlight/lib/sequence/criterion/cuda/FullConnectionCriterion.cuh"
 #include "flashlight/lib/sequence/criterion/cuda/ViterbiPath.cuh"
@@ -149,6 +150,10 @@ static void CpuViterbi_compute(
 #ifdef FL_LIBRARIES_USE_CUDA
 
 using CudaFAC = fl::lib::cuda::ForceAlignmentCriterion<float>;
+using CudaCTC =
+    fl::lib::cuda::ConnectionistTemporalClassificationCriterion<float>;
+using CudaHalfCTC =
+    fl::lib::cuda::ConnectionistTemporalClassificationCriterion<__half>;
 using CudaFCC = fl::lib::cuda::FullConnectionCriterion<float>;
 using CudaViterbi = fl::lib::cuda::ViterbiPath<float>;
 
@@ -206,6 +211,60 @@ static void CudaFAC_backward(
       castBytes<cudaStream_t>(stream));
 }
 
+template <class CTC, class Float>
+static void CudaCTC_forward(
+    int B,
+    int T,
+    int N,
+    int L,
+    CriterionScaleMode scaleMode,
+    py::bytes input,
+    py::bytes target,
+    py::bytes targetSize,
+    py::bytes loss,
+    py::bytes workspace,
+    py::bytes stream) {
+  CTC::forward(
+      B,
+      T,
+      N,
+      L,
+      scaleMode,
+      castBytes<const Float*>(input),
+      castBytes<const int*>(target),
+      castBytes<const int*>(targetSize),
+      castBytes<float*>(loss),
+      castBytes<void*>(workspace),
+      castBytes<cudaStream_t>(stream));
+}
+
+template <class CTC, class Float>
+static void CudaCTC_backward(
+    int B,
+    int T,
+    int N,
+    int L,
+    py::bytes input,
+    py::bytes target,
+    py::bytes targetSize,
+    py::bytes grad,
+    py::bytes inputGrad,
+    py::bytes workspace,
+    py::bytes stream) {
+  CTC::backward(
+      B,
+      T,
+      N,
+      L,
+      castBytes<const Float*>(input),
+      castBytes<const int*>(target),
+      castBytes<const int*>(targetSize),
+      castBytes<const float*>(grad),
+      castBytes<Float*>(inputGrad),
+      castBytes<void*>(workspace),
+      castBytes<cudaStream_t>(stream));
+}
+
 static void CudaFCC_forward(
     int B,
     int T,
@@ -304,6 +363,17 @@ PYBIND11_MODULE(flashlight_lib_sequence_criterion, m) {
       .def("forward", &CudaFAC_forward)
       .def("backward", &CudaFAC_backward);
 
+  py::class_<CudaCTC>(m, "CudaConnectionistTemporalClassificationCriterion")
+      .def("get_workspace_size", &CudaCTC::getWorkspaceSize)
+      .def("forward", &CudaCTC_forward<CudaCTC, float>)
+      .def("backward", &CudaCTC_backward<CudaCTC, float>);
+
+  py::class_<CudaHalfCTC>(
+      m, "CudaHalfConnectionistTemporalClassificationCriterion")
+      .def("get_workspace_size", &CudaHalfCTC::getWorkspaceSize)
+      .def("forward", &CudaCTC_forward<CudaHalfCTC, __half>)
+      .def("backward", &CudaCTC_backward<CudaHalfCTC, __half>);
+
   py::class_<CudaFCC>(m, "CudaFullConnectionCriterion")
       .def("get_workspace_size", &CudaFCC::getWorkspaceSize)
       .def("forward", &CudaFCC_forward)
@@ -25,6 +25,8 @@ except ImportError:
 if have_torch:
     from flashlight.lib.sequence.criterion_torch import (
         ASGLoss,
+        CTCFunction,
+        CTCLoss,
         FCCFunction,
         FACFunction,
         check_tensor,
@@ -24,9 +24,21 @@ def get_cuda_stream_as_bytes():
 
 
 def check_tensor(tensor, size, dtype, device):
+    """
+    Returns `tensor` as a contiguous tensor of `dtype` on `device`.
+    CPU tensors (e.g. the targets) are copied to CUDA devices from pinned
+    memory, asynchronously on the current stream: a copy from pageable memory
+    would synchronize the host with the device.
+    """
     shape = torch.Size(size)
     if tensor.shape != shape:
         raise ValueError(f"wrong tensor size: expected {shape}, got {tensor.shape}")
+    device = torch.device(device)
+    if device.type == "cuda" and tensor.device.type == "cpu":
+        tensor = tensor.to(dtype=dtype).contiguous()
+        if not tensor.is_pinned():
+            tensor = tensor.pin_memory()
+        return tensor.to(device=device, non_blocking=True)
     return tensor.to(dtype=dtype, device=device).contiguous()
 
 
@@ -249,7 +261,8 @@ class FCCFunction(torch.autograd.Function):
             get_data_ptr_as_bytes(loss),
             get_data_ptr_as_bytes(workspace),
         )
-        ctx.save_for_backward(input, transitions, workspace)
+        ctx.save_for_backward(input, transitions_float, workspace)
+        ctx.transitions_dtype = transitions.dtype
         return loss.to(input)
 
     @classmethod
@@ -276,7 +289,137 @@ class FCCFunction(torch.autograd.Function):
             get_data_ptr_as_bytes(transitions_grad),
             get_data_ptr_as_bytes(workspace),
         )
-        return input_grad.to(input), None, transitions_grad.to(transitions), None
+        return (
+            input_grad.to(input),
+            None,
+            transitions_grad.to(ctx.transitions_dtype),
+            None,
+        )
+
+
+class CTCFunction(torch.autograd.Function):
+    """
+    torch.autograd.Function for ConnectionistTemporalClassificationCriterion
+    Supports the CUDA backend, with float and half inputs, compute the
+    negative log probability of the target over all the CTC alignments
+    """
+
+    @staticmethod
+    def cuda_impl(dtype):
+        """
+        Get CUDA implementation of forward/backward for the criterion
+        """
+        if dtype == torch.half:
+            return _C.CudaHalfConnectionistTemporalClassificationCriterion
+        return _C.CudaConnectionistTemporalClassificationCriterion
+
+    @classmethod
+    def forward(cls, ctx, input, target, target_size, scale_mode):
+        """
+        Forward pass of the criterion.
+
+        Parameters:
+        -----------
+        input: float or half torch.tensor of the size [Batch, Time, Ntokens]
+               (output of the network with unnormalized scores for all frames
+                and all tokens, the last token being the blank)
+        target: int torch.tensor of the size [Batch, Length]
+               (padded target transcription encoded with indices of tokens)
+        target_size: int torch.tensor of the size [Batch]
+               (length of each target transcription in the batch, at most
+                Time minus the number of repeated tokens)
+        scale_mode: int, scaling factor of the output, possible values
+                  NONE = 0,
+                  INPUT_SZ = 1,
+                  INPUT_SZ_SQRT = 2,
+                  TARGET_SZ = 3,
+                  TARGET_SZ_SQRT = 4,
+        """
+        B = input.size(0)
+        T = input.size(1)
+        N = input.size(2)
+        L = target.size(1)
+        device = torch.device(input.device)
+        if device.type != "cuda":
+            raise ValueError("CTCFunction is only implemented for CUDA")
+
+        dtype = torch.half if input.dtype == torch.half else torch.float
+        impl = cls.cuda_impl(dtype)
+        input = check_tensor(input, [B, T, N], dtype, device)
+        target = check_tensor(target, [B, L], torch.int, device)
+        target_size = check_tensor(target_size, [B], torch.int, device)
+
+        loss = torch.empty(B, dtype=torch.float, device=device)
+        with torch.cuda.device(device):
+            workspace_size = impl.get_workspace_size(B, T, N, L)
+            workspace = torch.empty(workspace_size, dtype=torch.uint8, device=device)
+            impl.forward(
+                B,
+                T,
+                N,
+                L,
+                scale_mode,
+                get_data_ptr_as_bytes(input),
+                get_data_ptr_as_bytes(target),
+                get_data_ptr_as_bytes(target_size),
+                get_data_ptr_as_bytes(loss),
+                get_data_ptr_as_bytes(workspace),
+                get_cuda_stream_as_bytes(),
+            )
+        ctx.save_for_backward(input, target, target_size, workspace)
+        return loss
+
+    @classmethod
+    def backward(cls, ctx, grad):
+        input, target, target_size, workspace = ctx.saved_tensors
+        B = input.size(0)
+        T = input.size(1)
+        N = input.size(2)
+        L = target.size(1)
+        device = input.device
+
+        grad = check_tensor(grad, [B], torch.float, device)
+
+        input_grad = torch.empty(B, T, N, dtype=input.dtype, device=device)
+        with torch.cuda.device(device):
+            cls.cuda_impl(input.dtype).backward(
+                B,
+                T,
+                N,
+                L,
+                get_data_ptr_as_bytes(input),
+                get_data_ptr_as_bytes(target),
+                get_data_ptr_as_bytes(target_size),
+                get_data_ptr_as_bytes(grad),
+                get_data_ptr_as_bytes(input_grad),
+                get_data_ptr_as_bytes(workspace),
+                get_cuda_stream_as_bytes(),
+            )
+        return input_grad, None, None, None
+
+
+class CTCLoss(nn.Module):
+    def __init__(self, scale_mode=_C.CriterionScaleMode.NONE):
+        """
+        CTC loss implementation, with the blank as the last token.
+
+        Parameters:
+        -----------
+        scale_mode: int, scaling factor of the loss function, possible values
+                  NONE = 0,
+                  INPUT_SZ = 1,
+                  INPUT_SZ_SQRT = 2,
+                  TARGET_SZ = 3,
+                  TARGET_SZ_SQRT = 4,
+        """
+        super().__init__()
+        self.scale_mode = scale_mode
+
+    def forward(self, input, target, target_size):
+        """
+        Forward pass of the CTC loss. See CTCFunction.forward.
+        """
+        return CTCFunction.apply(input, target, target_size, self.scale_mode)
 
 
 class ASGLoss(nn.Module):
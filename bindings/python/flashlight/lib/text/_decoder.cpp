@@ -5,11 +5,18 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <algorithm>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 
 #include "flashlight/lib/text/decoder/LexiconDecoder.h"
 #include "flashlight/lib/text/decoder/LexiconFreeDecoder.h"
+#include "flashlight/lib/text/decoder/lm/LMScoreCache.h"
 
 #ifdef FL_LIBRARIES_USE_KENLM
 #include "flashlight/lib/text/decoder/lm/KenLM.h"
@@ -96,36 +103,212 @@ class PyLM : public LM {
  *          return (outstate, -1)
  *```
  */
-void LexiconDecoder_decodeStep(
-    LexiconDecoder& decoder,
-    uintptr_t emissions,
-    int T,
-    int N) {
+
+/**
+ * The float32 emissions of a NumPy array (or of any object supporting the
+ * buffer protocol), or of a CPU torch tensor, of size T x N or B x T x N,
+ * without copy. Keeps the memory alive until destroyed.
+ */
+struct EmissionsView {
+  explicit EmissionsView(const py::object& emissions) {
+    py::buffer buffer;
+    if (py::isinstance<py::buffer>(emissions)) {
+      buffer = py::reinterpret_borrow<py::buffer>(emissions);
+    } else if (
+        py::hasattr(emissions, "detach") && py::hasattr(emissions, "numpy")) {
+      // torch.Tensor: the NumPy array shares the memory of CPU tensors
+      buffer = emissions.attr("detach")().attr("numpy")();
+    } else {
+      throw std::invalid_argument(
+          "emissions must be a NumPy array or a CPU torch tensor");
+    }
+    info = buffer.request();
+    if (info.format != py::format_descriptor<float>::format()) {
+      throw std::invalid_argument("emissions must be float32");
+    }
+    if (info.ndim != 2 && info.ndim != 3) {
+      throw std::invalid_argument("emissions must be of size [B x] T x N");
+    }
+    B = info.ndim == 3 ? info.shape[0] : 1;
+    T = info.shape[info.ndim - 2];
+    N = info.shape[info.ndim - 1];
+    const auto itemsize = static_cast<py::ssize_t>(sizeof(float));
+    if (info.strides[info.ndim - 1] != itemsize ||
+        info.strides[info.ndim - 2] != N * itemsize ||
+        (info.ndim == 3 && info.strides[0] != T * N * itemsize)) {
+      throw std::invalid_argument("emissions must be C-contiguous");
+    }
+    data = static_cast<const float*>(info.ptr);
+  }
+
+  py::buffer_info info;
+  const float* data;
+  int B;
+  int T;
+  int N;
+};
+
+/**
+ * Decodes the utterances of a batch with `decoder.decodeBatch()`, or with
+ * `numThreads` copies of `decoder`, each decoding a part of the batch.
+ * Decoders are copied before their first call, but an LM is shared: KenLM and
+ * ZeroLM can be, LMs written in Python hold the GIL while scoring.
+ */
+template <class D>
+std::vector<std::vector<DecodeResult>> decodeBatch(
+    D& decoder,
+    const std::vector<const float*>& emissions,
+    const std::vector<int>& T,
+    int N,
+    int numThreads) {
+  if (emissions.size() != T.size()) {
+    throw std::invalid_argument("decode_batch: one size expected by emission");
+  }
+  py::gil_scoped_release release;
+  numThreads = std::min<int>(numThreads, emissions.size());
+  if (numThreads <= 1) {
+    return decoder.decodeBatch(emissions, T, N);
+  }
+  std::vector<std::vector<DecodeResult>> results(emissions.size());
+  std::exception_ptr error;
+  std::mutex errorMutex;
+  std::vector<std::thread> threads;
+  for (int tid = 0; tid < numThreads; ++tid) {
+    threads.emplace_back([&, tid]() {
+      try {
+        D localDecoder(decoder);
+        for (size_t b = tid; b < emissions.size(); b += numThreads) {
+          results[b] = localDecoder.decode(emissions[b], T[b], N);
+        }
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        error = std::current_exception();
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  return results;
+}
+
+template <class D>
+void decodeStep(D& decoder, uintptr_t emissions, int T, int N) {
+  py::gil_scoped_release release;
   decoder.decodeStep(reinterpret_cast<const float*>(emissions), T, N);
 }
 
-std::vector<DecodeResult> LexiconDecoder_decode(
-    LexiconDecoder& decoder,
-    uintptr_t emissions,
-    int T,
-    int N) {
+template <class D>
+void decodeStepArray(D& decoder, const py::object& emissions) {
+  EmissionsView view(emissions);
+  if (view.B != 1) {
+    throw std::invalid_argument("decode_step: emissions of a single utterance");
+  }
+  py::gil_scoped_release release;
+  decoder.decodeStep(view.data, view.T, view.N);
+}
+
+template <class D>
+std::vector<DecodeResult>
+decode(D& decoder, uintptr_t emissions, int T, int N) {
+  py::gil_scoped_release release;
   return decoder.decode(reinterpret_cast<const float*>(emissions), T, N);
 }
 
-void LexiconFreeDecoder_decodeStep(
-    LexiconFreeDecoder& decoder,
-    uintptr_t emissions,
-    int T,
-    int N) {
-  decoder.decodeStep(reinterpret_cast<const float*>(emissions), T, N);
+template <class D>
+std::vector<DecodeResult> decodeArray(D& decoder, const py::object& emissions) {
+  EmissionsView view(emissions);
+  if (view.B != 1) {
+    throw std::invalid_argument("decode: emissions of a single utterance");
+  }
+  py::gil_scoped_release release;
+  return decoder.decode(view.data, view.T, view.N);
 }
 
-std::vector<DecodeResult> LexiconFreeDecoder_decode(
-    LexiconFreeDecoder& decoder,
-    uintptr_t emissions,
-    int T,
-    int N) {
-  return decoder.decode(reinterpret_cast<const float*>(emissions), T, N);
+template <class D>
+DecodeResult
+decodeChunk(D& decoder, uintptr_t emissions, int T, int N, int maxDelay) {
+  py::gil_scoped_release release;
+  return decoder.decodeChunk(
+      reinterpret_cast<const float*>(emissions), T, N, maxDelay);
+}
+
+template <class D>
+std::vector<std::vector<DecodeResult>> decodeBatchPtrs(
+    D& decoder,
+    const std::vector<uintptr_t>& emissions,
+    const std::vector<int>& T,
+    int N,
+    int numThreads) {
+  std::vector<const float*> emissionPtrs;
+  for (auto emission : emissions) {
+    emissionPtrs.push_back(reinterpret_cast<const float*>(emission));
+  }
+  return decodeBatch(decoder, emissionPtrs, T, N, numThreads);
+}
+
+// B x T x N emissions, of `lengths` frames if not empty
+template <class D>
+std::vector<std::vector<DecodeResult>> decodeBatchArray(
+    D& decoder,
+    const py::object& emissions,
+    std::vector<int> lengths,
+    int numThreads) {
+  EmissionsView view(emissions);
+  if (lengths.empty()) {
+    lengths.assign(view.B, view.T);
+  }
+  std::vector<const float*> emissionPtrs;
+  for (int b = 0; b < view.B; ++b) {
+    emissionPtrs.push_back(view.data + b * view.T * view.N);
+  }
+  for (auto length : lengths) {
+    if (length < 0 || length > view.T) {
+      throw std::invalid_argument("decode_batch: lengths out of range");
+    }
+  }
+  return decodeBatch(decoder, emissionPtrs, lengths, view.N, numThreads);
+}
+
+/**
+ * Binds the decoding methods of `D`, shared by the lexicon and lexicon-free
+ * decoders. The GIL is released while decoding.
+ */
+template <class D>
+void bindDecode(py::class_<D>& cls) {
+  cls.def("decode_begin", &D::decodeBegin)
+      .def("decode_step", &decodeStep<D>, "emissions"_a, "T"_a, "N"_a)
+      .def("decode_step", &decodeStepArray<D>, "emissions"_a)
+      .def("decode_end", &D::decodeEnd)
+      .def("decode", &decode<D>, "emissions"_a, "T"_a, "N"_a)
+      .def("decode", &decodeArray<D>, "emissions"_a)
+      .def(
+          "decode_batch",
+          &decodeBatchPtrs<D>,
+          "emissions"_a,
+          "T"_a,
+          "N"_a,
+          "num_threads"_a = 1)
+      .def(
+          "decode_batch",
+          &decodeBatchArray<D>,
+          "emissions"_a,
+          "lengths"_a = std::vector<int>(),
+          "num_threads"_a = 1)
+      .def(
+          "decode_chunk",
+          &decodeChunk<D>,
+          "emissions"_a,
+          "T"_a,
+          "N"_a,
+          "max_delay"_a = -1)
+      .def("decode_stream_end", &D::decodeStreamEnd)
+      .def("prune", &D::prune, "look_back"_a = 0)
+      .def("get_best_hypothesis", &D::getBestHypothesis, "look_back"_a = 0)
+      .def("get_all_final_hypothesis", &D::getAllFinalHypothesis);
 }
 
 } // namespace
@@ -151,6 +334,13 @@ PYBIND11_MODULE(flashlight_lib_text_decoder, m) {
       .def("search", &Trie::search, "indices"_a)
       .def("smear", &Trie::smear, "smear_mode"_a);
 
+  py::class_<FlatTrie, FlatTriePtr>(m, "FlatTrie")
+      .def(py::init<const Trie&>(), "trie"_a)
+      .def_static("load", &FlatTrie::load, "path"_a)
+      .def("save", &FlatTrie::save, "path"_a)
+      .def("n_nodes", &FlatTrie::nNodes)
+      .def("n_labels", &FlatTrie::nLabels);
+
   py::class_<LM, LMPtr, PyLM>(m, "LM")
       .def(py::init<>())
       .def("start", &LM::start, "start_with_nothing"_a)
@@ -163,12 +353,23 @@ PYBIND11_MODULE(flashlight_lib_text_decoder, m) {
       .def("compare", &LMState::compare, "state"_a)
       .def("child", &LMState::child<LMState>, "usr_index"_a);
 
+  py::class_<LMScoreCache, LMScoreCachePtr>(m, "LMScoreCache")
+      .def("capacity", &LMScoreCache::capacity)
+      .def("size", &LMScoreCache::size)
+      .def("n_hits", &LMScoreCache::nHits)
+      .def("n_misses", &LMScoreCache::nMisses)
+      .def("reset_counters", &LMScoreCache::resetCounters);
+
 #ifdef FL_LIBRARIES_USE_KENLM
   py::class_<KenLM, KenLMPtr, LM>(m, "KenLM")
       .def(
           py::init<const std::string&, const Dictionary&>(),
           "path"_a,
-          "usr_token_dict"_a);
+          "usr_token_dict"_a)
+      .def_static(
+          "create_score_cache", &KenLM::createScoreCache, "capacity"_a)
+      .def("set_score_cache", &KenLM::setScoreCache, "cache"_a)
+      .def("get_score_cache", &KenLM::getScoreCache);
 #endif
 
   py::enum_<CriterionType>(m, "CriterionType")
@@ -204,6 +405,7 @@ PYBIND11_MODULE(flashlight_lib_text_decoder, m) {
       .def_readwrite("unk_score", &LexiconDecoderOptions::unkScore)
       .def_readwrite("sil_score", &LexiconDecoderOptions::silScore)
       .def_readwrite("log_add", &LexiconDecoderOptions::logAdd)
+      .def_readwrite("hash_merge", &LexiconDecoderOptions::hashMerge)
       .def_readwrite("criterion_type", &LexiconDecoderOptions::criterionType);
 
   py::class_<LexiconFreeDecoderOptions>(m, "LexiconFreeDecoderOptions")
@@ -229,6 +431,7 @@ PYBIND11_MODULE(flashlight_lib_text_decoder, m) {
       .def_readwrite("lm_weight", &LexiconFreeDecoderOptions::lmWeight)
       .def_readwrite("sil_score", &LexiconFreeDecoderOptions::silScore)
       .def_readwrite("log_add", &LexiconFreeDecoderOptions::logAdd)
+      .def_readwrite("hash_merge", &LexiconFreeDecoderOptions::hashMerge)
       .def_readwrite("criterion_type", &LexiconFreeDecoderOptions::criterionType);
 
   py::class_<DecodeResult>(m, "DecodeResult")
@@ -239,8 +442,10 @@ PYBIND11_MODULE(flashlight_lib_text_decoder, m) {
       .def_readwrite("words", &DecodeResult::words)
       .def_readwrite("tokens", &DecodeResult::tokens);
 
-  // NB: `decode` and `decodeStep` expect raw emissions pointers.
-  py::class_<LexiconDecoder>(m, "LexiconDecoder")
+  // `decode`, `decode_batch` and `decode_step` take either raw emissions
+  // pointers, or NumPy arrays / CPU torch tensors which aren't copied.
+  py::class_<LexiconDecoder> lexiconDecoder(m, "LexiconDecoder");
+  lexiconDecoder
       .def(py::init<
            LexiconDecoderOptions,
            const TriePtr,
@@ -250,44 +455,23 @@ PYBIND11_MODULE(flashlight_lib_text_decoder, m) {
            const int,
            const std::vector<float>&,
            const bool>())
-      .def("decode_begin", &LexiconDecoder::decodeBegin)
-      .def(
-          "decode_step",
-          &LexiconDecoder_decodeStep,
-          "emissions"_a,
-          "T"_a,
-          "N"_a)
-      .def("decode_end", &LexiconDecoder::decodeEnd)
-      .def("decode", &LexiconDecoder_decode, "emissions"_a, "T"_a, "N"_a)
-      .def("prune", &LexiconDecoder::prune, "look_back"_a = 0)
-      .def(
-          "get_best_hypothesis",
-          &LexiconDecoder::getBestHypothesis,
-          "look_back"_a = 0)
-      .def("get_all_final_hypothesis", &LexiconDecoder::getAllFinalHypothesis);
-
-  py::class_<LexiconFreeDecoder>(m, "LexiconFreeDecoder")
       .def(py::init<
-           LexiconFreeDecoderOptions,
+           LexiconDecoderOptions,
+           const FlatTriePtr,
            const LMPtr,
            const int,
            const int,
-           const std::vector<float>&>())
-      .def("decode_begin", &LexiconFreeDecoder::decodeBegin)
-      .def(
-          "decode_step",
-          &LexiconFreeDecoder_decodeStep,
-          "emissions"_a,
-          "T"_a,
-          "N"_a)
-      .def("decode_end", &LexiconFreeDecoder::decodeEnd)
-      .def("decode", &LexiconFreeDecoder_decode, "emissions"_a, "T"_a, "N"_a)
-      .def("prune", &LexiconFreeDecoder::prune, "look_back"_a = 0)
-      .def(
-          "get_best_hypothesis",
-          &LexiconFreeDecoder::getBestHypothesis,
-          "look_back"_a = 0)
-      .def(
-          "get_all_final_hypothesis",
-          &LexiconFreeDecoder::getAllFinalHypothesis);
+           const int,
+           const std::vector<float>&,
+           const bool>());
+  bindDecode(lexiconDecoder);
+
+  py::class_<LexiconFreeDecoder> lexiconFreeDecoder(m, "LexiconFreeDecoder");
+  lexiconFreeDecoder.def(py::init<
+                         LexiconFreeDecoderOptions,
+                         const LMPtr,
+                         const int,
+                         const int,
+                         const std::vector<float>&>());
+  bindDecode(lexiconFreeDecoder);
 }
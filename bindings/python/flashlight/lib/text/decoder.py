@@ -10,11 +10,13 @@ from .flashlight_lib_text_decoder import (
     LM,
     CriterionType,
     DecodeResult,
+    FlatTrie,
     LexiconDecoderOptions,
     LexiconFreeDecoderOptions,
     KenLM,
     LexiconDecoder,
     LexiconFreeDecoder,
+    LMScoreCache,
     LMState,
     SmearingMode,
     Trie,
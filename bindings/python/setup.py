@@ -21,7 +21,9 @@ from pathlib import Path
 # - `USE_CUDA=0` disables building CUDA components
 # - `USE_KENLM=0` disables building KenLM
 # - `USE_MKL=1` enables MKL (may cause errors)
-# By default build with USE_CUDA=1, USE_KENLM=1, USE_MKL=0
+# - `USE_APP_ASR=1` builds flashlight core and the ASR app for the ASR data
+#   pipeline (requires the dependencies of flashlight)
+# By default build with USE_CUDA=1, USE_KENLM=1, USE_MKL=0, USE_APP_ASR=0
 
 
 def check_env_flag(name, default=""):
@@ -65,13 +67,21 @@ class CMakeBuild(build_ext):
         use_kenlm = "OFF" if check_negative_env_flag("USE_KENLM") else "ON"
         use_mkl = "OFF" if check_negative_env_flag("USE_MKL") else "ON"
         backend = "CPU" if check_negative_env_flag("USE_CUDA") else "CUDA"
+        use_app_asr = "ON" if check_env_flag("USE_APP_ASR") else "OFF"
         cmake_args = [
             "-DCMAKE_LIBRARY_OUTPUT_DIRECTORY=" + ext_dir,
             "-DPYTHON_EXECUTABLE=" + sys.executable,
             "-DFL_BUILD_STANDALONE=OFF",
             "-DBUILD_SHARED_LIBS=ON",
             "-DFL_BUILD_LIBRARIES=ON",
-            "-DFL_BUILD_CORE=OFF",
+            "-DFL_BUILD_CORE=" + use_app_asr,
+            "-DFL_BUILD_APPS=" + use_app_asr,
+            "-DFL_BUILD_APP_ASR=" + use_app_asr,
+            "-DFL_BUILD_APP_ASR_TOOLS=OFF",
+            "-DFL_BUILD_APP_ASR_SERVER=OFF",
+            "-DFL_BUILD_APP_IMGCLASS=OFF",
+            "-DFL_BUILD_APP_LM=OFF",
+            "-DFL_BUILD_RECIPES=OFF",
             "-DFL_BUILD_TESTS=OFF",
             "-DFL_BUILD_EXAMPLES=OFF",
             "-DFL_BACKEND=" + backend,
@@ -108,6 +118,23 @@ class CMakeBuild(build_ext):
         subprocess.check_call(
             ["cmake", "--build", "."] + build_args, cwd=self.build_temp
         )
+packages = [
+    "flashlight",
+    "flashlight.lib",
+    "flashlight.lib.audio",
+    "flashlight.lib.sequence",
+    "flashlight.lib.text",
+]
+ext_modules = [
+    CMakeExtension("flashlight.lib.audio.feature"),
+    CMakeExtension("flashlight.lib.sequence.criterion"),
+    CMakeExtension("flashlight.lib.text.decoder"),
+    CMakeExtension("flashlight.lib.text.dictionary"),
+]
+if check_env_flag("USE_APP_ASR"):
+    packages += ["flashlight.app", "flashlight.app.asr"]
+    ext_modules += [CMakeExtension("flashlight.app.asr.data")]
+
 setup(
     name="flashlight",
     version="1.0.0",
@@ -115,19 +142,8 @@ setup(
     author_email="oncall+fair_speech@xmail.facebook.com",
     description="Flashlight bindings for python",
     long_description="",
-    packages=[
-        "flashlight",
-        "flashlight.lib",
-        "flashlight.lib.audio",
-        "flashlight.lib.sequence",
-        "flashlight.lib.text"
-        ],
-    ext_modules=[
-        CMakeExtension("flashlight.lib.audio.feature"),
-        CMakeExtension("flashlight.lib.sequence.criterion"),
-        CMakeExtension("flashlight.lib.text.decoder"),
-        CMakeExtension("flashlight.lib.text.dictionary"),
-    ],
+    packages=packages,
+    ext_modules=ext_modules,
     cmdclass={"build_ext": CMakeBuild},
     zip_safe=False,
     license="BSD licensed, as found in the LICENSE file",
@@ -21,3 +21,8 @@ def test_import_lib_text():
 
     if os.getenv("USE_KENLM", "").upper() not in ["OFF", "0", "NO", "FALSE", "N"]:
         from flashlight.lib.text import decoder as fl_decoder
+
+
+def test_import_app_asr():
+    if os.getenv("USE_APP_ASR", "").upper() in ["ON", "1", "YES", "TRUE", "Y"]:
+        from flashlight.app.asr import data as fl_data
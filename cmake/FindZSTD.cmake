@@ -0,0 +1,63 @@
+# - Find ZSTD
+# Find the native zstd includes and libraries
+#
+# Sets the following imported targets if zstd is found:
+# ZSTD::ZSTD
+#
+# Sets the following legacy CMake variables:
+#  ZSTD_INCLUDE_DIRS - where to find zstd.h.
+#  ZSTD_LIBRARIES    - List of libraries when using zstd.
+#  ZSTD_FOUND        - True if zstd found.
+
+if (ZSTD_INCLUDE_DIR)
+    # Already in cache, be silent
+    set (ZSTD_FIND_QUIETLY TRUE)
+endif ()
+
+find_package (PkgConfig QUIET)
+pkg_check_modules(PC_ZSTD QUIET libzstd)
+
+set(ZSTD_VERSION ${PC_ZSTD_VERSION})
+
+find_path (ZSTD_INCLUDE_DIR zstd.h
+	HINTS
+		${PC_ZSTD_INCLUDEDIR}
+		${PC_ZSTD_INCLUDE_DIRS}
+		${ZSTD_ROOT}
+	)
+
+find_library (ZSTD_LIBRARY
+	NAMES
+		zstd
+		libzstd
+		zstd_static
+	HINTS
+		${PC_ZSTD_LIBDIR}
+		${PC_ZSTD_LIBRARY_DIRS}
+		${ZSTD_ROOT}
+	)
+
+# Handle the QUIETLY and REQUIRED arguments and set ZSTD_FOUND to TRUE if
+# all listed variables are TRUE.
+include (FindPackageHandleStandardArgs)
+find_package_handle_standard_args (ZSTD
+	REQUIRED_VARS
+		ZSTD_LIBRARY
+		ZSTD_INCLUDE_DIR
+	VERSION_VAR
+		ZSTD_VERSION
+	)
+
+if (ZSTD_FOUND)
+	set (ZSTD_INCLUDE_DIRS ${ZSTD_INCLUDE_DIR})
+	set (ZSTD_LIBRARIES ${ZSTD_LIBRARY})
+	if (NOT TARGET ZSTD::ZSTD)
+		add_library(ZSTD::ZSTD UNKNOWN IMPORTED)
+		set_target_properties(ZSTD::ZSTD PROPERTIES
+			INTERFACE_INCLUDE_DIRECTORIES "${ZSTD_INCLUDE_DIR}"
+			IMPORTED_LOCATION "${ZSTD_LIBRARY}"
+			)
+	endif ()
+endif ()
+
+mark_as_advanced(ZSTD_INCLUDE_DIR ZSTD_LIBRARY)
@@ -5,12 +5,17 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <future>
 #include <iomanip>
+#include <iterator>
 #include <mutex>
+#include <numeric>
 #include <string>
 #include <thread>
 #include <vector>
@@ -26,22 +31,30 @@
 #include "flashlight/app/asr/data/Utils.h"
 #include "flashlight/app/asr/decoder/ConvLmModule.h"
 #include "flashlight/app/asr/decoder/DecodeUtils.h"
+#include "flashlight/app/asr/decoder/EmissionCache.h"
 #include "flashlight/app/asr/decoder/Defines.h"
+#include "flashlight/app/asr/decoder/Seq2SeqAmBatcher.h"
 #include "flashlight/app/asr/decoder/TranscriptionUtils.h"
+#include "flashlight/app/asr/decoder/TransformerLmModule.h"
 #include "flashlight/app/asr/runtime/runtime.h"
+#include "flashlight/ext/common/MetricsExporters.h"
 #include "flashlight/ext/common/SequentialBuilder.h"
 #include "flashlight/ext/common/Serializer.h"
 #include "flashlight/ext/plugin/ModulePlugin.h"
-#include "flashlight/lib/common/ProducerConsumerQueue.h"
+#include "flashlight/lib/common/LockFreeProducerConsumerQueue.h"
+#include "flashlight/lib/common/System.h"
+#include "flashlight/lib/text/decoder/CompiledLexicon.h"
 #include "flashlight/lib/text/decoder/LexiconDecoder.h"
 #include "flashlight/lib/text/decoder/LexiconFreeDecoder.h"
 #include "flashlight/lib/text/decoder/LexiconFreeSeq2SeqDecoder.h"
 #include "flashlight/lib/text/decoder/LexiconSeq2SeqDecoder.h"
 #include "flashlight/lib/text/decoder/lm/ConvLM.h"
 #include "flashlight/lib/text/decoder/lm/KenLM.h"
+#include "flashlight/lib/text/decoder/lm/TransformerLM.h"
 #include "flashlight/lib/text/decoder/lm/ZeroLM.h"
 
 using fl::ext::afToVector;
+using fl::ext::afToVectorPinned;
 using fl::ext::Serializer;
 using fl::lib::join;
 using fl::lib::pathsConcat;
@@ -51,6 +64,59 @@ using fl::lib::text::SmearingMode;
 
 using namespace fl::app::asr;
 
+namespace {
+
+// Loads the 'transformer' LM (a model trained with fl/app/lm) on the current
+// device
+std::shared_ptr<fl::lib::text::LM> loadTransformerLm(
+    const fl::lib::text::Dictionary& usrDict) {
+  LOG(INFO) << "[TransformerLM]: Loading LM from " << FLAGS_lm;
+  if (!FLAGS_lm_arch.empty()) {
+    (void)fl::ext::ModulePlugin(FLAGS_lm_arch);
+  }
+  std::shared_ptr<fl::Module> lmNetwork, lmCriterion;
+  std::string lmVersion;
+  Serializer::load(FLAGS_lm, lmVersion, lmNetwork, lmCriterion);
+  lmNetwork->eval();
+  lmCriterion->eval();
+  return std::make_shared<fl::lib::text::TransformerLM>(
+      buildTransformerLmScoreFunction(lmNetwork, lmCriterion),
+      FLAGS_lm_vocab,
+      usrDict);
+}
+
+// Loads the n-best rescoring LM (a model trained with fl/app/lm) on the
+// current device
+TransformerLmSentenceScoreFunc loadRescoringLm(
+    const fl::lib::text::Dictionary& vocab) {
+  LOG(INFO) << "[Rescoring LM]: Loading LM from " << FLAGS_rescore_lm;
+  if (!FLAGS_rescore_lm_arch.empty()) {
+    (void)fl::ext::ModulePlugin(FLAGS_rescore_lm_arch);
+  }
+  std::shared_ptr<fl::Module> lmNetwork, lmCriterion;
+  std::string lmVersion;
+  Serializer::load(FLAGS_rescore_lm, lmVersion, lmNetwork, lmCriterion);
+  lmNetwork->eval();
+  lmCriterion->eval();
+  return buildTransformerLmSentenceScoreFunction(
+      lmNetwork,
+      lmCriterion,
+      vocab.getIndex(fl::lib::text::kEosToken),
+      vocab.getIndex(fl::lib::text::kPadToken),
+      FLAGS_rescore_batch_tokens);
+}
+
+// The results of the decoder for a batch, waiting to be rescored
+struct DecodedBatch {
+  std::vector<EmissionTargetPair> batch;
+  std::vector<std::vector<fl::lib::text::DecodeResult>> results;
+  double decodeTime;
+};
+
+using DecodedBatchQueue = fl::lib::LockFreeProducerConsumerQueue<DecodedBatch>;
+
+} // namespace
+
 int main(int argc, char** argv) {
   fl::init();
   google::InitGoogleLogging(argv[0]);
@@ -82,7 +148,10 @@ int main(int argc, char** argv) {
   fl::VerboseLogging::setMaxLoggingLevel(FLAGS_fl_vlog_level);
 
   /* ===================== Create Network ===================== */
-  if (FLAGS_emission_dir.empty() && FLAGS_am.empty()) {
+  // An existing emission cache replaces the AM
+  bool readEmissionCache = !FLAGS_emission_cache.empty() &&
+      fl::lib::fileExists(FLAGS_emission_cache);
+  if (FLAGS_emission_dir.empty() && FLAGS_am.empty() && !readEmissionCache) {
     LOG(FATAL) << "Both flags are empty: `-emission_dir` and `-am`";
   }
 
@@ -135,6 +204,38 @@ int main(int argc, char** argv) {
 
   LOG(INFO) << "Gflags after parsing \n" << serializeGflags("; ");
 
+  // The AM forward threads run the computation, each prefetching its samples
+  if (FLAGS_thread_budget) {
+    auto budget = fl::partitionCpus(
+        FLAGS_nthread * FLAGS_nthread_decoder_am_forward,
+        FLAGS_nthread_decoder,
+        FLAGS_thread_budget_compute);
+    fl::setThreadBudget(budget);
+    LOG(INFO) << "Thread budget: " << budget.prettyString();
+  }
+
+  /* ===================== Metrics ===================== */
+  fl::ext::MetricsExporters metricsExporters(
+      FLAGS_fl_metrics_port,
+      FLAGS_fl_metrics_statsd,
+      FLAGS_fl_metrics_statsd_interval,
+      0 /* rank */);
+  auto& metrics = fl::MetricsRegistry::global();
+  // The real time factor of the decoders, with the time of all the threads
+  auto& audioMetric = metrics.counter(
+      "fl_decode_audio_seconds_total", "Seconds of audio forwarded by the AM");
+  auto& decodeTimeMetric = metrics.counter(
+      "fl_decode_seconds_total", "Time spent decoding, by all the decoders");
+  auto& rtfMetric = metrics.gauge(
+      "fl_decode_rtf",
+      "Real time factor of the decoders: time spent decoding by all the "
+      "decoders per second of audio");
+  metrics.addCollector([&audioMetric, &decodeTimeMetric, &rtfMetric]() {
+    if (audioMetric.value() > 0) {
+      rtfMetric.set(decodeTimeMetric.value() / audioMetric.value());
+    }
+  });
+
   /* ===================== Create Dictionary ===================== */
   auto dictPath = FLAGS_tokens;
   if (dictPath.empty() || !fl::lib::fileExists(dictPath)) {
@@ -161,7 +262,37 @@ int main(int argc, char** argv) {
 
   fl::lib::text::Dictionary wordDict;
   fl::lib::text::LexiconMap lexicon;
-  if (!FLAGS_lexicon.empty()) {
+  // The compiled lexicon replaces parsing the lexicon and building the trie
+  // when it was built from the same inputs: the lexicon, the tokens, the
+  // trie options and, for word LMs whose unigrams score the trie, the LM
+  fl::lib::text::CompiledLexicon compiledLexicon;
+  uint64_t lexiconHash = 0;
+  bool isLexiconCompiled = false;
+  if (!FLAGS_lexicon_cache.empty() && !FLAGS_lexicon.empty()) {
+    lexiconHash = fl::lib::text::hashFile(FLAGS_lexicon);
+    lexiconHash = fl::lib::text::hashDictionary(tokenDict, lexiconHash);
+    for (const auto& option :
+         {std::to_string(FLAGS_maxword),
+          FLAGS_decodertype,
+          std::to_string(FLAGS_uselexicon),
+          FLAGS_smearing,
+          FLAGS_wordseparator,
+          std::to_string(FLAGS_replabel)}) {
+      lexiconHash = fl::lib::text::hashString(option, lexiconHash);
+    }
+    if (FLAGS_decodertype == "wrd" && !FLAGS_lm.empty()) {
+      lexiconHash = fl::lib::text::hashString(FLAGS_lmtype, lexiconHash);
+      lexiconHash = fl::lib::text::hashString(FLAGS_lm, lexiconHash);
+      lexiconHash = fl::lib::text::hashFileStat(FLAGS_lm, lexiconHash);
+    }
+    isLexiconCompiled = compiledLexicon.load(FLAGS_lexicon_cache, lexiconHash);
+  }
+  if (isLexiconCompiled) {
+    wordDict = compiledLexicon.wordDict;
+    lexicon = std::move(compiledLexicon.lexicon);
+    LOG(INFO) << "Loaded the compiled lexicon " << FLAGS_lexicon_cache;
+    LOG(INFO) << "Number of words: " << wordDict.indexSize();
+  } else if (!FLAGS_lexicon.empty()) {
     lexicon = fl::lib::text::loadWords(FLAGS_lexicon, FLAGS_maxword);
     wordDict = fl::lib::text::createWordDict(lexicon);
     LOG(INFO) << "Number of words: " << wordDict.indexSize();
@@ -180,6 +311,36 @@ int main(int argc, char** argv) {
   std::vector<int> sliceNumTokens(FLAGS_nthread_decoder, 0);
   std::vector<int> sliceNumSamples(FLAGS_nthread_decoder, 0);
   std::vector<double> sliceTime(FLAGS_nthread_decoder, 0);
+  // Time to decode the batch of each sample, recorded by all the threads
+  fl::LatencyMeter decodeLatency;
+
+  // Decoder parameters also decoded for each emission, as (LM weight, word
+  // score) pairs
+  std::vector<std::pair<double, double>> sweepParams;
+  {
+    auto toDoubles = [](const std::string& list, double defaultValue) {
+      std::vector<double> values;
+      for (const auto& value : fl::lib::split(",", list, true)) {
+        values.push_back(std::stod(value));
+      }
+      if (values.empty()) {
+        values.push_back(defaultValue);
+      }
+      return values;
+    };
+    if (!FLAGS_decoder_sweep_lmweight.empty() ||
+        !FLAGS_decoder_sweep_wordscore.empty()) {
+      for (auto lmWeight :
+           toDoubles(FLAGS_decoder_sweep_lmweight, FLAGS_lmweight)) {
+        for (auto wordScore :
+             toDoubles(FLAGS_decoder_sweep_wordscore, FLAGS_wordscore)) {
+          sweepParams.emplace_back(lmWeight, wordScore);
+        }
+      }
+    }
+  }
+  std::vector<std::vector<double>> sweepWrdDst(
+      FLAGS_nthread_decoder, std::vector<double>(sweepParams.size(), 0));
 
   // Prepare criterion
   CriterionType criterionType = CriterionType::ASG;
@@ -198,6 +359,10 @@ int main(int argc, char** argv) {
     transition = afToVector<float>(criterion->param(0).array());
   }
 
+  if (!FLAGS_lattice_dir.empty()) {
+    fl::lib::dirCreateRecursive(FLAGS_lattice_dir);
+  }
+
   // Prepare log writer
   std::mutex hypMutex, refMutex, logMutex;
   std::ofstream hypStream, refStream, logStream;
@@ -244,12 +409,23 @@ int main(int argc, char** argv) {
 
   std::shared_ptr<fl::lib::text::LM> lm =
       std::make_shared<fl::lib::text::ZeroLM>();
+  fl::lib::text::LMScoreCachePtr lmScoreCache;
   if (!FLAGS_lm.empty()) {
     if (FLAGS_lmtype == "kenlm") {
-      lm = std::make_shared<fl::lib::text::KenLM>(FLAGS_lm, usrDict);
-      if (!lm) {
+      auto kenLm = std::make_shared<fl::lib::text::KenLM>(
+          FLAGS_lm,
+          usrDict,
+          kenLMOptions(FLAGS_lm_load_method, FLAGS_lm_prefetch_mb));
+      if (!kenLm) {
         LOG(FATAL) << "[LM constructing] Failed to load LM: " << FLAGS_lm;
       }
+      if (FLAGS_lm_cache_size > 0) {
+        // The LM is shared by all the decoder threads, and so is the cache
+        lmScoreCache =
+            fl::lib::text::KenLM::createScoreCache(FLAGS_lm_cache_size);
+        kenLm->setScoreCache(lmScoreCache);
+      }
+      lm = kenLm;
     } else if (FLAGS_lmtype == "convlm") {
       af::setDevice(0);
       LOG(INFO) << "[ConvLM]: Loading LM from " << FLAGS_lm;
@@ -262,19 +438,37 @@ int main(int argc, char** argv) {
       }
       convLmModel->eval();
 
-      auto getConvLmScoreFunc = buildGetConvLmScoreFunction(convLmModel);
-      lm = std::make_shared<fl::lib::text::ConvLM>(
-          getConvLmScoreFunc,
-          FLAGS_lm_vocab,
-          usrDict,
-          FLAGS_lm_memory,
-          FLAGS_beamsize);
+      if (FLAGS_lm_incremental) {
+        lm = std::make_shared<fl::lib::text::ConvLM>(
+            buildIncrementalConvLmScoreFunction(convLmModel),
+            FLAGS_lm_vocab,
+            usrDict,
+            FLAGS_lm_memory,
+            FLAGS_beamsize * FLAGS_decoder_batchsize);
+      } else {
+        auto getConvLmScoreFunc = buildGetConvLmScoreFunction(convLmModel);
+        lm = std::make_shared<fl::lib::text::ConvLM>(
+            getConvLmScoreFunc,
+            FLAGS_lm_vocab,
+            usrDict,
+            FLAGS_lm_memory,
+            FLAGS_beamsize * FLAGS_decoder_batchsize);
+      }
+    } else if (FLAGS_lmtype == "transformer") {
+      af::setDevice(0);
+      lm = loadTransformerLm(usrDict);
     } else {
       LOG(FATAL) << "[LM constructing] Invalid LM Type: " << FLAGS_lmtype;
     }
   }
   LOG(INFO) << "[Decoder] LM constructed.";
 
+  fl::lib::text::Dictionary rescoreVocab;
+  if (!FLAGS_rescore_lm.empty()) {
+    rescoreVocab = fl::lib::text::Dictionary(FLAGS_rescore_lm_vocab);
+    rescoreVocab.setDefaultIndex(rescoreVocab.getIndex(kUnkToken));
+  }
+
   // Build Trie
   int blankIdx =
       FLAGS_criterion == kCtcCriterion ? tokenDict.getIndex(kBlankToken) : -1;
@@ -282,17 +476,35 @@ int main(int argc, char** argv) {
   if (FLAGS_wordseparator != "") {
     silIdx = tokenDict.getIndex(FLAGS_wordseparator);
   }
-  std::shared_ptr<fl::lib::text::Trie> trie = buildTrie(
-      FLAGS_decodertype,
-      FLAGS_uselexicon,
-      lm,
-      FLAGS_smearing,
-      tokenDict,
-      lexicon,
-      wordDict,
-      silIdx,
-      FLAGS_replabel);
-  LOG(INFO) << "[Decoder] Trie smeared.\n";
+  std::shared_ptr<fl::lib::text::FlatTrie> flatTrie;
+  if (isLexiconCompiled) {
+    flatTrie = compiledLexicon.trie;
+    compiledLexicon = fl::lib::text::CompiledLexicon();
+  } else {
+    std::shared_ptr<fl::lib::text::Trie> trie = buildTrie(
+        FLAGS_decodertype,
+        FLAGS_uselexicon,
+        lm,
+        FLAGS_smearing,
+        tokenDict,
+        lexicon,
+        wordDict,
+        silIdx,
+        FLAGS_replabel);
+    LOG(INFO) << "[Decoder] Trie smeared.\n";
+    // Freeze the trie once so that all the decoder threads share it
+    flatTrie =
+        trie ? std::make_shared<fl::lib::text::FlatTrie>(*trie) : nullptr;
+    trie.reset();
+    if (!FLAGS_lexicon_cache.empty() && !FLAGS_lexicon.empty()) {
+      compiledLexicon.wordDict = wordDict;
+      compiledLexicon.lexicon = lexicon;
+      compiledLexicon.trie = flatTrie;
+      compiledLexicon.save(FLAGS_lexicon_cache, lexiconHash);
+      compiledLexicon = fl::lib::text::CompiledLexicon();
+      LOG(INFO) << "Saved the compiled lexicon " << FLAGS_lexicon_cache;
+    }
+  }
 
   /* ===================== Create Dataset ===================== */
   fl::lib::audio::FeatureParams featParams(
@@ -327,46 +539,136 @@ int main(int argc, char** argv) {
       featParams,
       featType,
       {FLAGS_localnrmlleftctx, FLAGS_localnrmlrightctx},
-      /*sfxConf=*/{});
+      /*sfxConf=*/{},
+      /*sfxStartUpdate=*/0,
+      FLAGS_features_on_device);
   auto targetTransform = targetFeatures(tokenDict, lexicon, targetGenConfig);
   auto wordTransform = wordFeatures(wordDict);
   int targetpadVal =
       isSeq2seqCrit ? tokenDict.getIndex(fl::lib::text::kPadToken) : kTargetPadValue;
-  int wordpadVal = wordDict.getIndex(kUnkToken);
+  if (FLAGS_decoder_am_batchsize <= 0) {
+    LOG(FATAL) << "FLAGS_decoder_am_batchsize (" << FLAGS_decoder_am_batchsize
+               << ") need to be positive ";
+  }
+  // Word targets of batched samples are padded with a value which is not a
+  // word index, to be told apart from unknown words
+  int wordpadVal =
+      FLAGS_decoder_am_batchsize > 1 ? -1 : wordDict.getIndex(kUnkToken);
 
   std::vector<std::string> testSplits = fl::lib::split(",", FLAGS_test, true);
-  auto ds = createDataset(
-      testSplits,
-      FLAGS_datadir,
-      1 /* batchsize */,
-      inputTransform,
-      targetTransform,
-      wordTransform,
-      std::make_tuple(0, targetpadVal, wordpadVal),
-      0 /* worldrank */,
-      1 /* worldsize */);
-
-  int nSamples = ds->size();
+  std::shared_ptr<fl::Dataset> ds;
+  if (!readEmissionCache) {
+    ds = createDataset(
+        testSplits,
+        FLAGS_datadir,
+        FLAGS_decoder_am_batchsize,
+        inputTransform,
+        targetTransform,
+        wordTransform,
+        std::make_tuple(0, targetpadVal, wordpadVal),
+        0 /* worldrank */,
+        1 /* worldsize */);
+  }
+
+  // The dataset holds batches of FLAGS_decoder_am_batchsize samples
+  int nBatches = ds ? ds->size() : 0;
   if (FLAGS_maxload > 0) {
-    nSamples = std::min(nSamples, FLAGS_maxload);
+    nBatches = std::min(
+        nBatches,
+        (FLAGS_maxload + FLAGS_decoder_am_batchsize - 1) /
+            FLAGS_decoder_am_batchsize);
   }
-  LOG(INFO) << "[Dataset] Dataset loaded, with " << nSamples << " samples.";
+  LOG(INFO) << "[Dataset] Dataset loaded, with " << nBatches
+            << " batches of up to " << FLAGS_decoder_am_batchsize
+            << " samples.";
 
   /* ===================== AM Forwarding ===================== */
-  using EmissionQueue = fl::lib::ProducerConsumerQueue<EmissionTargetPair>;
+  using EmissionQueue =
+      fl::lib::LockFreeProducerConsumerQueue<EmissionTargetPair>;
   EmissionQueue emissionQueue(FLAGS_emission_queue_size);
 
+  // The emissions are either read from the cache by the decoder threads, or
+  // written to it by the AM forward threads
+  std::unique_ptr<EmissionCacheReader> emissionCacheReader;
+  std::unique_ptr<EmissionCacheWriter> emissionCacheWriter;
+  if (readEmissionCache) {
+    emissionCacheReader =
+        std::make_unique<EmissionCacheReader>(FLAGS_emission_cache);
+    LOG(INFO) << "[Emission cache] Reading " << emissionCacheReader->size()
+              << " emissions from " << FLAGS_emission_cache;
+  } else if (!FLAGS_emission_cache.empty()) {
+    EmissionCacheType cacheType;
+    if (FLAGS_emission_cache_type == "f32") {
+      cacheType = EmissionCacheType::F32;
+    } else if (FLAGS_emission_cache_type == "f16") {
+      cacheType = EmissionCacheType::F16;
+    } else if (FLAGS_emission_cache_type == "topk") {
+      cacheType = EmissionCacheType::TOPK;
+    } else {
+      LOG(FATAL) << "Unsupported emission cache type: "
+                 << FLAGS_emission_cache_type;
+    }
+    emissionCacheWriter = std::make_unique<EmissionCacheWriter>(
+        FLAGS_emission_cache, cacheType, FLAGS_emission_cache_topk);
+    LOG(INFO) << "[Emission cache] Writing emissions to "
+              << FLAGS_emission_cache;
+  }
+  std::atomic<int64_t> nextCachedEmission{0};
+  auto getEmission = [&emissionQueue,
+                      &emissionCacheReader,
+                      &nextCachedEmission](EmissionTargetPair& pair) {
+    if (!emissionCacheReader) {
+      return emissionQueue.get(pair);
+    }
+    int64_t nEmissions = emissionCacheReader->size();
+    if (FLAGS_maxload > 0) {
+      nEmissions = std::min<int64_t>(nEmissions, FLAGS_maxload);
+    }
+    int64_t idx = nextCachedEmission++;
+    if (idx >= nEmissions) {
+      return false;
+    }
+    pair = emissionCacheReader->get(idx);
+    return true;
+  };
+
+  const auto threadAffinity =
+      fl::threadAffinityFromString(FLAGS_thread_affinity);
+
+  // Throughput of each AM forward thread
+  std::vector<int> amNumSamples(FLAGS_nthread_decoder_am_forward, 0);
+  std::vector<int64_t> amNumFrames(FLAGS_nthread_decoder_am_forward, 0);
+  std::vector<double> amTime(FLAGS_nthread_decoder_am_forward, 0);
+
   auto runAmForward = [&network,
                        &usePlugin,
                        &criterion,
-                       &nSamples,
+                       &nBatches,
                        &ds,
                        &tokenDict,
                        &wordDict,
                        &emissionQueue,
-                       &isSeq2seqCrit](int tid) {
+                       &isSeq2seqCrit,
+                       &targetpadVal,
+                       &wordpadVal,
+                       &emissionCacheWriter,
+                       &amNumSamples,
+                       &amNumFrames,
+                       &amTime,
+                       &threadAffinity](int tid) {
     // Initialize AM
     af::setDevice(tid);
+    fl::Tracer::setThreadName("am forward " + std::to_string(tid));
+    auto& metrics = fl::MetricsRegistry::global();
+    auto& audioMetric = metrics.counter(
+        "fl_decode_audio_seconds_total",
+        "Seconds of audio forwarded by the AM");
+    auto& amSamplesMetric = metrics.counter(
+        "fl_decode_am_samples_total", "Samples forwarded by the AM");
+    auto& amFramesMetric = metrics.counter(
+        "fl_decode_am_frames_total", "Frames of emissions of the AM");
+    // Inference only, no computation graph is recorded
+    fl::NoGradGuard noGrad;
     std::shared_ptr<fl::Module> localNetwork = network;
     std::shared_ptr<SequenceCriterion> localCriterion = criterion;
     if (tid != 0) {
@@ -379,44 +681,38 @@ int main(int argc, char** argv) {
     }
 
     std::vector<int64_t> selectedIds;
-    for (int64_t i = tid; i < nSamples; i += FLAGS_nthread_decoder_am_forward) {
+    for (int64_t i = tid; i < nBatches; i += FLAGS_nthread_decoder_am_forward) {
       selectedIds.emplace_back(i);
     }
     std::shared_ptr<fl::Dataset> localDs =
         std::make_shared<fl::ResampleDataset>(ds, selectedIds);
     localDs = std::make_shared<fl::PrefetchDataset>(
-        localDs, FLAGS_nthread, FLAGS_nthread);
-
-    for (auto& sample : *localDs) {
-      auto sampleId = readSampleIds(sample[kSampleIdx]).front();
-
-      /* 2. Load Targets */
-      TargetUnit targetUnit;
-      auto tokenTarget = afToVector<int>(sample[kTargetIdx]);
-      auto wordTarget = afToVector<int>(sample[kWordIdx]);
-      // TODO: we will reform the dataset so that the loaded word
-      // targets are strings already
-      std::vector<std::string> wordTargetStr;
-      if (FLAGS_uselexicon) {
-        wordTargetStr = wrdIdx2Wrd(wordTarget, wordDict);
-      } else {
-        auto letterTarget = tknTarget2Ltr(
-            tokenTarget,
-            tokenDict,
-            FLAGS_criterion,
-            FLAGS_surround,
-            isSeq2seqCrit,
-            FLAGS_replabel,
-            FLAGS_usewordpiece,
-            FLAGS_wordseparator);
-        wordTargetStr = tkn2Wrd(letterTarget, FLAGS_wordseparator);
+        localDs,
+        FLAGS_nthread,
+        FLAGS_nthread,
+        false /* deviceStaging */,
+        0 /* reorderWindow */,
+        threadAffinity);
+
+    // Removes the padding of the targets of a sample of a batch
+    auto unpad = [](std::vector<int> target, int padVal) {
+      while (FLAGS_decoder_am_batchsize > 1 && !target.empty() &&
+             target.back() == padVal) {
+        target.pop_back();
       }
+      return target;
+    };
 
-      targetUnit.wordTargetStr = wordTargetStr;
-      targetUnit.tokenTarget = tokenTarget;
-
-      /* 3. Load Emissions */
-      EmissionUnit emissionUnit;
+    fl::TimeMeter meter;
+    for (auto& sample : *localDs) {
+      FL_TRACE(DECODER, "amForward");
+      meter.resume();
+      auto sampleIds = readSampleIds(sample[kSampleIdx]);
+      int batchSize = sampleIds.size();
+
+      /* 1. Forward the batch */
+      af::array emissions;
+      std::vector<int> nFrames(batchSize);
       if (FLAGS_emission_dir.empty()) {
         fl::Variable rawEmission;
         if (usePlugin) {
@@ -428,22 +724,95 @@ int main(int argc, char** argv) {
           rawEmission = fl::ext::forwardSequentialModuleWithPadMask(
               fl::input(sample[kInputIdx]), localNetwork, sample[kDurationIdx]);
         }
-        emissionUnit = EmissionUnit(
-            afToVector<float>(rawEmission),
-            sampleId,
-            rawEmission.dims(1),
-            rawEmission.dims(0));
-      } else {
-        auto cleanTestPath = cleanFilepath(FLAGS_test);
-        std::string emissionDir =
-            pathsConcat(FLAGS_emission_dir, cleanTestPath);
-        std::string savePath = pathsConcat(emissionDir, sampleId + ".bin");
-        std::string eVersion;
-        Serializer::load(savePath, eVersion, emissionUnit);
+        emissions = rawEmission.array();
+        // Frames of each sample, in proportion to its number of input frames
+        // as for the padding mask of the forward
+        auto durations = afToVector<float>(sample[kDurationIdx].as(f32));
+        float maxDuration =
+            *std::max_element(durations.begin(), durations.end());
+        // Durations are in ms
+        audioMetric.add(
+            std::accumulate(durations.begin(), durations.end(), 0.) / 1000);
+        for (int b = 0; b < batchSize; b++) {
+          nFrames[b] = maxDuration > 0
+              ? std::ceil(emissions.dims(1) * durations[b] / maxDuration)
+              : emissions.dims(1);
+        }
       }
 
-      emissionQueue.add({emissionUnit, targetUnit});
+      auto tokenTargets = sample[kTargetIdx];
+      auto wordTargets = sample[kWordIdx];
+      for (int b = 0; b < batchSize; b++) {
+        auto& sampleId = sampleIds[b];
+
+        /* 2. Load Targets */
+        TargetUnit targetUnit;
+        auto tokenTarget = unpad(
+            afToVector<int>(tokenTargets(af::span, b)), targetpadVal);
+        auto wordTarget =
+            unpad(afToVector<int>(wordTargets(af::span, b)), wordpadVal);
+        // TODO: we will reform the dataset so that the loaded word
+        // targets are strings already
+        std::vector<std::string> wordTargetStr;
+        if (FLAGS_uselexicon) {
+          wordTargetStr = wrdIdx2Wrd(wordTarget, wordDict);
+        } else {
+          auto letterTarget = tknTarget2Ltr(
+              tokenTarget,
+              tokenDict,
+              FLAGS_criterion,
+              FLAGS_surround,
+              isSeq2seqCrit,
+              FLAGS_replabel,
+              FLAGS_usewordpiece,
+              FLAGS_wordseparator);
+          wordTargetStr = tkn2Wrd(letterTarget, FLAGS_wordseparator);
+        }
+
+        targetUnit.wordTargetStr = wordTargetStr;
+        targetUnit.tokenTarget = tokenTarget;
+
+        /* 3. Load Emissions */
+        EmissionUnit emissionUnit;
+        if (FLAGS_emission_dir.empty()) {
+          af::array emission = batchSize > 1
+              ? emissions(af::span, af::seq(nFrames[b]), b)
+              : emissions;
+          emissionUnit = EmissionUnit(
+              afToVectorPinned<float>(emission),
+              sampleId,
+              emission.dims(1),
+              emission.dims(0));
+        } else {
+          auto cleanTestPath = cleanFilepath(FLAGS_test);
+          std::string emissionDir =
+              pathsConcat(FLAGS_emission_dir, cleanTestPath);
+          std::string savePath = pathsConcat(emissionDir, sampleId + ".bin");
+          std::string eVersion;
+          Serializer::load(savePath, eVersion, emissionUnit);
+        }
+        if (emissionCacheWriter) {
+          emissionCacheWriter->add(emissionUnit, targetUnit);
+        }
+        amNumFrames[tid] += emissionUnit.nFrames;
+        amNumSamples[tid]++;
+        amFramesMetric.add(emissionUnit.nFrames);
+        amSamplesMetric.add();
+
+        // Blocks while the queue is full: emissions are buffered at constant
+        // memory while the decoders consume them
+        meter.stop();
+        emissionQueue.add({emissionUnit, targetUnit});
+        meter.resume();
+      }
+      meter.stop();
     }
+    amTime[tid] = meter.value();
+    LOG(INFO) << "[AM forward] Thread " << tid << ": " << amNumSamples[tid]
+              << " samples, " << amNumFrames[tid] << " frames in "
+              << amTime[tid] << "s ("
+              << (amTime[tid] > 0 ? amNumSamples[tid] / amTime[tid] : 0)
+              << " samples/s, excluding waits on the emission queue)";
 
     localNetwork.reset(); // AM is only used in running forward pass. So we will
     // free the space of it on GPU or memory.
@@ -453,10 +822,21 @@ int main(int argc, char** argv) {
   };
 
   /* ===================== Decode ===================== */
+  // With FLAGS_decoder_am_batch_hypotheses, the decoder threads of a device
+  // share its batcher, created with the criterion of the first one
+  const bool amBatching = FLAGS_decoder_am_batch_hypotheses > 0 &&
+      criterionType == CriterionType::S2S &&
+      FLAGS_criterion == kSeq2SeqRNNCriterion;
+  std::unordered_map<int, std::shared_ptr<Seq2SeqAmBatcher>> amBatchers;
+  std::mutex amBatchersMutex;
+
   auto runDecoder = [&criterion,
+                     amBatching,
+                     &amBatchers,
+                     &amBatchersMutex,
                      &isSeq2seqCrit,
                      &lm,
-                     &trie,
+                     &flatTrie,
                      &silIdx,
                      &blankIdx,
                      &unkWordIdx,
@@ -465,7 +845,10 @@ int main(int argc, char** argv) {
                      &usrDict,
                      &tokenDict,
                      &wordDict,
-                     &emissionQueue,
+                     &rescoreVocab,
+                     &getEmission,
+                     &sweepParams,
+                     &sweepWrdDst,
                      &writeHyp,
                      &writeRef,
                      &writeLog,
@@ -474,7 +857,16 @@ int main(int argc, char** argv) {
                      &sliceNumWords,
                      &sliceNumTokens,
                      &sliceNumSamples,
-                     &sliceTime](int tid) {
+                     &sliceTime,
+                     &decodeLatency](int tid) {
+    // Inference only, no computation graph is recorded
+    fl::NoGradGuard noGrad;
+    fl::Tracer::setThreadName("decoder " + std::to_string(tid));
+    auto& metrics = fl::MetricsRegistry::global();
+    auto& decodeTimeMetric = metrics.counter(
+        "fl_decode_seconds_total", "Time spent decoding, by all the decoders");
+    auto& decodedMetric =
+        metrics.counter("fl_decode_samples_total", "Samples decoded");
     /* 1. Prepare GPU-dependent resources */
     // Note: These 2 GPU-dependent models should be placed on different
     // cards
@@ -483,12 +875,17 @@ int main(int argc, char** argv) {
     // the number of GPUs.
     std::shared_ptr<SequenceCriterion> localCriterion = criterion;
     std::shared_ptr<fl::lib::text::LM> localLm = lm;
-    if (FLAGS_lmtype == "convlm" || criterionType == CriterionType::S2S) {
-      if (tid >= af::getDeviceCount()) {
+    if (FLAGS_lmtype == "convlm" || FLAGS_lmtype == "transformer" ||
+        criterionType == CriterionType::S2S) {
+      if (tid >= af::getDeviceCount() && !amBatching) {
         LOG(FATAL)
             << "FLAGS_nthread_decoder exceeds the number of visible GPUs";
       }
-      af::setDevice(tid);
+      // With FLAGS_decoder_lm_device_offset, the decoders can use other
+      // devices than the AM threads, so that each net has a device to itself
+      int device =
+          (FLAGS_decoder_lm_device_offset + tid) % af::getDeviceCount();
+      af::setDevice(device);
     }
 
     // Make a copy for non-main threads.
@@ -500,16 +897,27 @@ int main(int argc, char** argv) {
         Serializer::load(FLAGS_lm, convlmVersion, convLmModel);
         convLmModel->eval();
 
-        auto getConvLmScoreFunc = buildGetConvLmScoreFunction(convLmModel);
-        localLm = std::make_shared<fl::lib::text::ConvLM>(
-            getConvLmScoreFunc,
-            FLAGS_lm_vocab,
-            usrDict,
-            FLAGS_lm_memory,
-            FLAGS_beamsize);
+        if (FLAGS_lm_incremental) {
+          localLm = std::make_shared<fl::lib::text::ConvLM>(
+              buildIncrementalConvLmScoreFunction(convLmModel),
+              FLAGS_lm_vocab,
+              usrDict,
+              FLAGS_lm_memory,
+              FLAGS_beamsize * FLAGS_decoder_batchsize);
+        } else {
+          auto getConvLmScoreFunc = buildGetConvLmScoreFunction(convLmModel);
+          localLm = std::make_shared<fl::lib::text::ConvLM>(
+              getConvLmScoreFunc,
+              FLAGS_lm_vocab,
+              usrDict,
+              FLAGS_lm_memory,
+              FLAGS_beamsize * FLAGS_decoder_batchsize);
+        }
+      } else if (FLAGS_lmtype == "transformer") {
+        localLm = loadTransformerLm(usrDict);
       }
 
-      if (criterionType == CriterionType::S2S) {
+      if (criterionType == CriterionType::S2S && !amBatching) {
         std::shared_ptr<fl::Module> dummyNetwork;
         std::unordered_map<std::string, std::string> dummyCfg;
         Serializer::load(FLAGS_am, dummyCfg, dummyNetwork, localCriterion);
@@ -517,139 +925,295 @@ int main(int argc, char** argv) {
       }
     }
 
+    std::shared_ptr<Seq2SeqAmBatcher> amBatcher;
+    if (amBatching) {
+      int device = af::getDevice();
+      std::lock_guard<std::mutex> lock(amBatchersMutex);
+      auto& batcher = amBatchers[device];
+      if (!batcher) {
+        if (tid != 0) {
+          std::shared_ptr<fl::Module> dummyNetwork;
+          std::unordered_map<std::string, std::string> dummyCfg;
+          Serializer::load(FLAGS_am, dummyCfg, dummyNetwork, localCriterion);
+          localCriterion->eval();
+        }
+        batcher = std::make_shared<Seq2SeqAmBatcher>(
+            localCriterion,
+            device,
+            FLAGS_decoderattnround,
+            FLAGS_attentionthreshold,
+            FLAGS_smoothingtemperature,
+            FLAGS_decoder_am_batch_hypotheses,
+            std::chrono::microseconds(FLAGS_decoder_am_batch_wait_us));
+        LOG(INFO) << "[Decoder] Batching the seq2seq steps on device "
+                  << device;
+      }
+      amBatcher = batcher;
+    }
+
     /* 2. Build Decoder */
-    std::unique_ptr<fl::lib::text::Decoder> decoder;
     if (FLAGS_decodertype != "wrd" && FLAGS_decodertype != "tkn") {
       LOG(FATAL) << "Unsupported decoder type: " << FLAGS_decodertype;
     }
 
-    if (criterionType == CriterionType::S2S) {
-      auto amUpdateFunc = FLAGS_criterion == kSeq2SeqRNNCriterion
-          ? buildSeq2SeqRnnAmUpdateFunction(
-                localCriterion,
-                FLAGS_decoderattnround,
-                FLAGS_beamsize,
-                FLAGS_attentionthreshold,
-                FLAGS_smoothingtemperature)
-          : buildSeq2SeqTransformerAmUpdateFunction(
-                localCriterion,
-                FLAGS_beamsize,
-                FLAGS_attentionthreshold,
-                FLAGS_smoothingtemperature);
-      int eosIdx = tokenDict.getIndex(fl::app::asr::kEosToken);
-
-      if (FLAGS_decodertype == "wrd" || FLAGS_uselexicon) {
-        decoder.reset(new fl::lib::text::LexiconSeq2SeqDecoder(
-            {
-                .beamSize = FLAGS_beamsize,
-                .beamSizeToken = FLAGS_beamsizetoken,
-                .beamThreshold = FLAGS_beamthreshold,
-                .lmWeight = FLAGS_lmweight,
-                .wordScore = FLAGS_wordscore,
-                .eosScore = FLAGS_eosscore,
-                .logAdd = FLAGS_logadd,
-            },
-            trie,
-            localLm,
-            eosIdx,
-            amUpdateFunc,
-            FLAGS_maxdecoderoutputlen,
-            FLAGS_decodertype == "tkn"));
-        LOG(INFO) << "[Decoder] LexiconSeq2Seq decoder with "
-                  << FLAGS_decodertype << "-LM loaded in thread: " << tid;
-      } else {
-        decoder.reset(new fl::lib::text::LexiconFreeSeq2SeqDecoder(
-            {
-                .beamSize = FLAGS_beamsize,
-                .beamSizeToken = FLAGS_beamsizetoken,
-                .beamThreshold = FLAGS_beamthreshold,
-                .lmWeight = FLAGS_lmweight,
-                .eosScore = FLAGS_eosscore,
-                .logAdd = FLAGS_logadd,
-            },
-            localLm,
-            eosIdx,
-            amUpdateFunc,
-            FLAGS_maxdecoderoutputlen));
-        LOG(INFO)
-            << "[Decoder] LexiconFreeSeq2Seq decoder with token-LM loaded in thread: "
-            << tid;
-      }
-    } else {
-      if (FLAGS_decodertype == "wrd" || FLAGS_uselexicon) {
-        decoder.reset(new fl::lib::text::LexiconDecoder(
-            {.beamSize = FLAGS_beamsize,
-             .beamSizeToken = FLAGS_beamsizetoken,
-             .beamThreshold = FLAGS_beamthreshold,
-             .lmWeight = FLAGS_lmweight,
-             .wordScore = FLAGS_wordscore,
-             .unkScore = FLAGS_unkscore,
-             .silScore = FLAGS_silscore,
-             .logAdd = FLAGS_logadd,
-             .criterionType = criterionType},
-            trie,
-            localLm,
-            silIdx,
-            blankIdx,
-            unkWordIdx,
-            transition,
-            FLAGS_decodertype == "tkn"));
-        LOG(INFO) << "[Decoder] Lexicon decoder with " << FLAGS_decodertype
-                  << "-LM loaded in thread: " << tid;
+    auto buildDecoder = [&](double lmWeight, double wordScore) {
+      std::unique_ptr<fl::lib::text::Decoder> decoder;
+      if (criterionType == CriterionType::S2S) {
+        auto amUpdateFunc = amBatcher ? amBatcher->amUpdateFunc()
+            : FLAGS_criterion == kSeq2SeqRNNCriterion
+            ? buildSeq2SeqRnnAmUpdateFunction(
+                  localCriterion,
+                  FLAGS_decoderattnround,
+                  FLAGS_beamsize,
+                  FLAGS_attentionthreshold,
+                  FLAGS_smoothingtemperature)
+            : buildSeq2SeqTransformerAmUpdateFunction(
+                  localCriterion,
+                  FLAGS_beamsize,
+                  FLAGS_attentionthreshold,
+                  FLAGS_smoothingtemperature);
+        int eosIdx = tokenDict.getIndex(fl::app::asr::kEosToken);
+
+        if (FLAGS_decodertype == "wrd" || FLAGS_uselexicon) {
+          decoder.reset(new fl::lib::text::LexiconSeq2SeqDecoder(
+              {
+                  .beamSize = FLAGS_beamsize,
+                  .beamSizeToken = FLAGS_beamsizetoken,
+                  .beamThreshold = FLAGS_beamthreshold,
+                  .lmWeight = lmWeight,
+                  .wordScore = wordScore,
+                  .eosScore = FLAGS_eosscore,
+                  .logAdd = FLAGS_logadd,
+                  .hashMerge = FLAGS_hashmerge,
+              },
+              flatTrie,
+              localLm,
+              eosIdx,
+              amUpdateFunc,
+              FLAGS_maxdecoderoutputlen,
+              FLAGS_decodertype == "tkn"));
+          LOG(INFO) << "[Decoder] LexiconSeq2Seq decoder with "
+                    << FLAGS_decodertype << "-LM loaded in thread: " << tid;
+        } else {
+          decoder.reset(new fl::lib::text::LexiconFreeSeq2SeqDecoder(
+              {
+                  .beamSize = FLAGS_beamsize,
+                  .beamSizeToken = FLAGS_beamsizetoken,
+                  .beamThreshold = FLAGS_beamthreshold,
+                  .lmWeight = lmWeight,
+                  .eosScore = FLAGS_eosscore,
+                  .logAdd = FLAGS_logadd,
+                  .hashMerge = FLAGS_hashmerge,
+              },
+              localLm,
+              eosIdx,
+              amUpdateFunc,
+              FLAGS_maxdecoderoutputlen));
+          LOG(INFO)
+              << "[Decoder] LexiconFreeSeq2Seq decoder with token-LM loaded in thread: "
+              << tid;
+        }
       } else {
-        decoder.reset(new fl::lib::text::LexiconFreeDecoder(
-            {.beamSize = FLAGS_beamsize,
-             .beamSizeToken = FLAGS_beamsizetoken,
-             .beamThreshold = FLAGS_beamthreshold,
-             .lmWeight = FLAGS_lmweight,
-             .silScore = FLAGS_silscore,
-             .logAdd = FLAGS_logadd,
-             .criterionType = criterionType},
-            localLm,
-            silIdx,
-            blankIdx,
-            transition));
-        LOG(INFO)
-            << "[Decoder] Lexicon-free decoder with token-LM loaded in thread: "
-            << tid;
+        if (FLAGS_decodertype == "wrd" || FLAGS_uselexicon) {
+          decoder.reset(new fl::lib::text::LexiconDecoder(
+              {.beamSize = FLAGS_beamsize,
+               .beamSizeToken = FLAGS_beamsizetoken,
+               .beamThreshold = FLAGS_beamthreshold,
+               .lmWeight = lmWeight,
+               .wordScore = wordScore,
+               .unkScore = FLAGS_unkscore,
+               .silScore = FLAGS_silscore,
+               .logAdd = FLAGS_logadd,
+               .criterionType = criterionType,
+               .hashMerge = FLAGS_hashmerge,
+               .blankSkipThreshold = FLAGS_blankskipthreshold,
+               .lmLookaheadWords = FLAGS_lmlookaheadwords,
+               .lmLookaheadCacheSize = FLAGS_lmlookaheadcache,
+               .adaptiveBeam =
+                   {.targetCandidates = FLAGS_adaptivebeamcandidates,
+                    .frameTimeBudget = FLAGS_adaptivebeamframetime / 1000,
+                    .minThreshold = FLAGS_adaptivebeamminthreshold}},
+              flatTrie,
+              localLm,
+              silIdx,
+              blankIdx,
+              unkWordIdx,
+              transition,
+              FLAGS_decodertype == "tkn"));
+          LOG(INFO) << "[Decoder] Lexicon decoder with " << FLAGS_decodertype
+                    << "-LM loaded in thread: " << tid;
+        } else {
+          decoder.reset(new fl::lib::text::LexiconFreeDecoder(
+              {.beamSize = FLAGS_beamsize,
+               .beamSizeToken = FLAGS_beamsizetoken,
+               .beamThreshold = FLAGS_beamthreshold,
+               .lmWeight = lmWeight,
+               .silScore = FLAGS_silscore,
+               .logAdd = FLAGS_logadd,
+               .criterionType = criterionType,
+               .hashMerge = FLAGS_hashmerge},
+              localLm,
+              silIdx,
+              blankIdx,
+              transition));
+          LOG(INFO)
+              << "[Decoder] Lexicon-free decoder with token-LM loaded in thread: "
+              << tid;
+        }
       }
+      return decoder;
+    };
+    auto decoder = buildDecoder(FLAGS_lmweight, FLAGS_wordscore);
+    auto lexiconDecoder =
+        dynamic_cast<fl::lib::text::LexiconDecoder*>(decoder.get());
+    if (!FLAGS_lattice_dir.empty() && !lexiconDecoder) {
+      LOG(FATAL) << "[Decoder] lattice_dir needs the lexicon decoder";
+    }
+    bool adaptiveBeam =
+        FLAGS_adaptivebeamcandidates > 0 || FLAGS_adaptivebeamframetime > 0;
+    if (adaptiveBeam && !lexiconDecoder) {
+      LOG(FATAL) << "[Decoder] The adaptive beam needs the lexicon decoder";
+    }
+    std::vector<std::unique_ptr<fl::lib::text::Decoder>> sweepDecoders;
+    for (const auto& params : sweepParams) {
+      sweepDecoders.push_back(buildDecoder(params.first, params.second));
     }
+    std::vector<fl::EditDistanceMeter> sweepMeters(sweepParams.size());
     /* 3. Get data and run decoder */
     TestMeters meters;
-    EmissionTargetPair emissionTargetPair;
-    while (emissionQueue.get(emissionTargetPair)) {
-      const auto& emissionUnit = emissionTargetPair.first;
-      const auto& targetUnit = emissionTargetPair.second;
-
-      const auto& nFrames = emissionUnit.nFrames;
-      const auto& nTokens = emissionUnit.nTokens;
-      const auto& emission = emissionUnit.emission;
-      const auto& sampleId = emissionUnit.sampleId;
-      const auto& wordTarget = targetUnit.wordTargetStr;
-      const auto& tokenTarget = targetUnit.tokenTarget;
-      // DecodeResult
-      meters.timer.reset();
-      meters.timer.resume();
-      const auto& results = decoder->decode(emission.data(), nFrames, nTokens);
-      meters.timer.stop();
+    // Writes the results of a batch decoded in `decodeTime`, and updates the
+    // meters
+    auto writeResults =
+        [&](const std::vector<EmissionTargetPair>& batch,
+            const std::vector<std::vector<fl::lib::text::DecodeResult>>&
+                batchResults,
+            double decodeTime) {
+      for (int b = 0; b < batch.size(); b++) {
+        const auto& emissionUnit = batch[b].first;
+        const auto& targetUnit = batch[b].second;
+
+        const auto& sampleId = emissionUnit.sampleId;
+        const auto& wordTarget = targetUnit.wordTargetStr;
+        const auto& tokenTarget = targetUnit.tokenTarget;
+        const auto& results = batchResults[b];
+
+        int nTopHyps = FLAGS_isbeamdump ? results.size() : 1;
+        for (int i = 0; i < nTopHyps; i++) {
+          // Cleanup predictions
+          auto rawWordPrediction = results[i].words;
+          auto rawTokenPrediction = results[i].tokens;
+
+          auto letterTarget = tknTarget2Ltr(
+              tokenTarget,
+              tokenDict,
+              FLAGS_criterion,
+              FLAGS_surround,
+              isSeq2seqCrit,
+              FLAGS_replabel,
+              FLAGS_usewordpiece,
+              FLAGS_wordseparator);
+          auto letterPrediction = tknPrediction2Ltr(
+              rawTokenPrediction,
+              tokenDict,
+              FLAGS_criterion,
+              FLAGS_surround,
+              isSeq2seqCrit,
+              FLAGS_replabel,
+              FLAGS_usewordpiece,
+              FLAGS_wordseparator);
+          std::vector<std::string> wordPrediction;
+          if (FLAGS_uselexicon) {
+            rawWordPrediction =
+                validateIdx(rawWordPrediction, wordDict.getIndex(kUnkToken));
+            wordPrediction = wrdIdx2Wrd(rawWordPrediction, wordDict);
+          } else {
+            wordPrediction = tkn2Wrd(letterPrediction, FLAGS_wordseparator);
+          }
+          auto wordTargetStr = join(" ", wordTarget);
+          auto wordPredictionStr = join(" ", wordPrediction);
 
-      int nTopHyps = FLAGS_isbeamdump ? results.size() : 1;
-      for (int i = 0; i < nTopHyps; i++) {
-        // Cleanup predictions
-        auto rawWordPrediction = results[i].words;
-        auto rawTokenPrediction = results[i].tokens;
+          // Normal decoding and computing WER
+          if (!FLAGS_isbeamdump) {
+            meters.wrdDstSlice.add(wordPrediction, wordTarget);
+            meters.tknDstSlice.add(letterPrediction, letterTarget);
 
-        auto letterTarget = tknTarget2Ltr(
-            tokenTarget,
-            tokenDict,
-            FLAGS_criterion,
-            FLAGS_surround,
-            isSeq2seqCrit,
-            FLAGS_replabel,
-            FLAGS_usewordpiece,
-            FLAGS_wordseparator);
+            if (!FLAGS_sclite.empty()) {
+              std::string suffix = " (" + sampleId + ")\n";
+              writeHyp(wordPredictionStr + suffix);
+              writeRef(wordTargetStr + suffix);
+            }
+
+            if (FLAGS_show) {
+              meters.wrdDst.reset();
+              meters.tknDst.reset();
+              meters.wrdDst.add(wordPrediction, wordTarget);
+              meters.tknDst.add(letterPrediction, letterTarget);
+
+              std::stringstream buffer;
+              buffer << "|T|: " << wordTargetStr << std::endl;
+              buffer << "|P|: " << wordPredictionStr << std::endl;
+              if (FLAGS_showletters) {
+                buffer << "|t|: " << join(" ", letterTarget) << std::endl;
+                buffer << "|p|: " << join(" ", letterPrediction) << std::endl;
+              }
+              buffer << "[sample: " << sampleId
+                     << ", WER: " << meters.wrdDst.errorRate()[0]
+                     << "\%, TER: " << meters.tknDst.errorRate()[0]
+                     << "\%, slice WER: " << meters.wrdDstSlice.errorRate()[0]
+                     << "\%, slice TER: " << meters.tknDstSlice.errorRate()[0]
+                     << "\%, decoded samples (thread " << tid
+                     << "): " << sliceNumSamples[tid] + 1 << "]" << std::endl;
+
+              std::cout << buffer.str();
+              if (!FLAGS_sclite.empty()) {
+                writeLog(buffer.str());
+              }
+            }
+
+            // Update conters
+            sliceNumWords[tid] += wordTarget.size();
+            sliceNumTokens[tid] += letterTarget.size();
+            sliceTime[tid] += decodeTime / batch.size();
+            sliceNumSamples[tid] += 1;
+          }
+          // Beam Dump
+          else {
+            meters.wrdDst.reset();
+            meters.wrdDst.add(wordPrediction, wordTarget);
+            auto wer = meters.wrdDst.errorRate()[0];
+
+            if (FLAGS_sclite.empty()) {
+              LOG(FATAL) << "FLAGS_sclite is empty, nowhere to dump the beam.";
+            }
+
+            auto score = results[i].score;
+            auto amScore = results[i].amScore;
+            auto lmScore = results[i].lmScore;
+            auto outString = sampleId + " | " + std::to_string(score) + " | " +
+                std::to_string(amScore) + " | " + std::to_string(lmScore) +
+                " | " + std::to_string(wer) + " | " + wordPredictionStr + "\n";
+            writeHyp(outString);
+          }
+        }
+      }
+    };
+
+    // With a rescoring LM, the n-best lists of the decoded batches are
+    // rescored and written by a thread of their own, while the decoder runs on
+    // the next batches
+    std::unique_ptr<DecodedBatchQueue> rescoreQueue;
+    std::thread rescoreThread;
+    if (!FLAGS_rescore_lm.empty()) {
+      auto rescoreLm = loadRescoringLm(rescoreVocab);
+      // The words of a hypothesis
+      auto getWordPrediction = [&](const fl::lib::text::DecodeResult& result) {
+        if (FLAGS_uselexicon) {
+          return wrdIdx2Wrd(
+              validateIdx(result.words, wordDict.getIndex(kUnkToken)),
+              wordDict);
+        }
         auto letterPrediction = tknPrediction2Ltr(
-            rawTokenPrediction,
+            result.tokens,
             tokenDict,
             FLAGS_criterion,
             FLAGS_surround,
@@ -657,82 +1221,164 @@ int main(int argc, char** argv) {
             FLAGS_replabel,
             FLAGS_usewordpiece,
             FLAGS_wordseparator);
-        std::vector<std::string> wordPrediction;
-        if (FLAGS_uselexicon) {
-          rawWordPrediction =
-              validateIdx(rawWordPrediction, wordDict.getIndex(kUnkToken));
-          wordPrediction = wrdIdx2Wrd(rawWordPrediction, wordDict);
-        } else {
-          wordPrediction = tkn2Wrd(letterPrediction, FLAGS_wordseparator);
-        }
-        auto wordTargetStr = join(" ", wordTarget);
-        auto wordPredictionStr = join(" ", wordPrediction);
-
-        // Normal decoding and computing WER
-        if (!FLAGS_isbeamdump) {
-          meters.wrdDstSlice.add(wordPrediction, wordTarget);
-          meters.tknDstSlice.add(letterPrediction, letterTarget);
-
-          if (!FLAGS_sclite.empty()) {
-            std::string suffix = " (" + sampleId + ")\n";
-            writeHyp(wordPredictionStr + suffix);
-            writeRef(wordTargetStr + suffix);
+        return tkn2Wrd(letterPrediction, FLAGS_wordseparator);
+      };
+      // The n-best lists of all the samples of a batch are scored together,
+      // then sorted by their interpolated scores
+      auto rescore = [&, rescoreLm, getWordPrediction](
+                         std::vector<std::vector<fl::lib::text::DecodeResult>>&
+                             batchResults) {
+        std::vector<std::vector<int>> sentences;
+        for (auto& results : batchResults) {
+          if (FLAGS_rescore_nbest > 0 &&
+              results.size() > FLAGS_rescore_nbest) {
+            results.resize(FLAGS_rescore_nbest);
           }
-
-          if (FLAGS_show) {
-            meters.wrdDst.reset();
-            meters.tknDst.reset();
-            meters.wrdDst.add(wordPrediction, wordTarget);
-            meters.tknDst.add(letterPrediction, letterTarget);
-
-            std::stringstream buffer;
-            buffer << "|T|: " << wordTargetStr << std::endl;
-            buffer << "|P|: " << wordPredictionStr << std::endl;
-            if (FLAGS_showletters) {
-              buffer << "|t|: " << join(" ", letterTarget) << std::endl;
-              buffer << "|p|: " << join(" ", letterPrediction) << std::endl;
-            }
-            buffer << "[sample: " << sampleId
-                   << ", WER: " << meters.wrdDst.errorRate()[0]
-                   << "\%, TER: " << meters.tknDst.errorRate()[0]
-                   << "\%, slice WER: " << meters.wrdDstSlice.errorRate()[0]
-                   << "\%, slice TER: " << meters.tknDstSlice.errorRate()[0]
-                   << "\%, decoded samples (thread " << tid
-                   << "): " << sliceNumSamples[tid] + 1 << "]" << std::endl;
-
-            std::cout << buffer.str();
-            if (!FLAGS_sclite.empty()) {
-              writeLog(buffer.str());
+          for (const auto& result : results) {
+            std::vector<int> sentence;
+            for (const auto& word : getWordPrediction(result)) {
+              sentence.push_back(rescoreVocab.getIndex(word));
             }
+            sentences.push_back(std::move(sentence));
+          }
+        }
+        auto lmScores = rescoreLm(sentences);
+        size_t i = 0;
+        for (auto& results : batchResults) {
+          for (auto& result : results) {
+            result.score += FLAGS_rescore_lmweight * lmScores[i] +
+                FLAGS_rescore_wordscore * sentences[i].size();
+            ++i;
           }
+          std::stable_sort(
+              results.begin(),
+              results.end(),
+              [](const fl::lib::text::DecodeResult& a,
+                 const fl::lib::text::DecodeResult& b) {
+                return a.score > b.score;
+              });
+        }
+      };
+      rescoreQueue =
+          std::make_unique<DecodedBatchQueue>(FLAGS_rescore_queue_size);
+      int device = af::getDevice();
+      rescoreThread = std::thread([&, rescore, device]() {
+        af::setDevice(device);
+        fl::NoGradGuard noGrad;
+        fl::Tracer::setThreadName("rescorer " + std::to_string(tid));
+        DecodedBatch decoded;
+        while (rescoreQueue->get(decoded)) {
+          FL_TRACE(DECODER, "rescoreBatch");
+          rescore(decoded.results);
+          writeResults(decoded.batch, decoded.results, decoded.decodeTime);
+        }
+      });
+    }
+
+    EmissionTargetPair emissionTargetPair;
+    std::vector<EmissionTargetPair> batch;
+    bool hasData = true;
+    while (hasData) {
+      batch.clear();
+      while (batch.size() < FLAGS_decoder_batchsize &&
+             (hasData = getEmission(emissionTargetPair))) {
+        batch.emplace_back(std::move(emissionTargetPair));
+      }
+      if (batch.empty()) {
+        break;
+      }
+      FL_TRACE(DECODER, "decodeBatch");
 
-          // Update conters
-          sliceNumWords[tid] += wordTarget.size();
-          sliceNumTokens[tid] += letterTarget.size();
-          sliceTime[tid] += meters.timer.value();
-          sliceNumSamples[tid] += 1;
+      std::vector<const float*> batchEmissions;
+      std::vector<int> batchFrames;
+      for (const auto& pair : batch) {
+        batchEmissions.push_back(pair.first.emission.data());
+        batchFrames.push_back(pair.first.nFrames);
+      }
+      // DecodeResult
+      meters.timer.reset();
+      meters.timer.resume();
+      const auto& batchResults = decoder->decodeBatch(
+          batchEmissions, batchFrames, batch.front().first.nTokens);
+      meters.timer.stop();
+      decodeTimeMetric.add(meters.timer.value());
+      decodedMetric.add(batch.size());
+      decodeLatency.add(meters.timer.value(), batch.size());
+
+      if (!FLAGS_lattice_dir.empty()) {
+        for (int b = 0; b < batch.size(); b++) {
+          auto path = pathsConcat(
+              FLAGS_lattice_dir, batch[b].first.sampleId + ".lat");
+          std::ofstream latticeStream(path, std::ios::binary);
+          if (!latticeStream) {
+            LOG(FATAL) << "Error opening lattice file: " << path;
+          }
+          lexiconDecoder->getBatchLattice(b).save(latticeStream);
         }
-        // Beam Dump
-        else {
-          meters.wrdDst.reset();
-          meters.wrdDst.add(wordPrediction, wordTarget);
-          auto wer = meters.wrdDst.errorRate()[0];
-
-          if (FLAGS_sclite.empty()) {
-            LOG(FATAL) << "FLAGS_sclite is empty, nowhere to dump the beam.";
+      }
+      if (adaptiveBeam) {
+        for (int b = 0; b < batch.size(); b++) {
+          const auto& beam = lexiconDecoder->getBatchBeamTelemetry(b);
+          LOG(INFO) << "[Decoder] Beam of " << batch[b].first.sampleId << ": "
+                    << beam.nFrames << " frames, " << beam.meanCandidates
+                    << " candidates per frame (max " << beam.maxCandidates
+                    << "), " << beam.meanHypothesis
+                    << " hypothesis per frame, threshold "
+                    << beam.meanThreshold << " [" << beam.minThreshold << ", "
+                    << beam.maxThreshold << "], " << beam.decodeTime * 1000
+                    << " ms";
+        }
+      }
+
+      // Only the WER of the swept parameters is reported
+      for (int g = 0; g < sweepDecoders.size(); g++) {
+        auto sweepResults = sweepDecoders[g]->decodeBatch(
+            batchEmissions, batchFrames, batch.front().first.nTokens);
+        for (int b = 0; b < batch.size(); b++) {
+          if (sweepResults[b].empty()) {
+            continue;
           }
+          const auto& result = sweepResults[b].front();
+          auto letterPrediction = tknPrediction2Ltr(
+              result.tokens,
+              tokenDict,
+              FLAGS_criterion,
+              FLAGS_surround,
+              isSeq2seqCrit,
+              FLAGS_replabel,
+              FLAGS_usewordpiece,
+              FLAGS_wordseparator);
+          std::vector<std::string> wordPrediction;
+          if (FLAGS_uselexicon) {
+            wordPrediction = wrdIdx2Wrd(
+                validateIdx(result.words, wordDict.getIndex(kUnkToken)),
+                wordDict);
+          } else {
+            wordPrediction = tkn2Wrd(letterPrediction, FLAGS_wordseparator);
+          }
+          sweepMeters[g].add(wordPrediction, batch[b].second.wordTargetStr);
+        }
+      }
 
-          auto score = results[i].score;
-          auto amScore = results[i].amScore;
-          auto lmScore = results[i].lmScore;
-          auto outString = sampleId + " | " + std::to_string(score) + " | " +
-              std::to_string(amScore) + " | " + std::to_string(lmScore) +
-              " | " + std::to_string(wer) + " | " + wordPredictionStr + "\n";
-          writeHyp(outString);
+      if (rescoreQueue) {
+        // The emissions aren't needed anymore
+        for (auto& pair : batch) {
+          std::vector<float>().swap(pair.first.emission);
         }
+        rescoreQueue->add(
+            {std::move(batch), batchResults, meters.timer.value()});
+      } else {
+        writeResults(batch, batchResults, meters.timer.value());
       }
     }
+    if (rescoreQueue) {
+      rescoreQueue->finishAdding();
+      rescoreThread.join();
+    }
     sliceWrdDst[tid] = meters.wrdDstSlice.value()[0];
+    for (int g = 0; g < sweepMeters.size(); g++) {
+      sweepWrdDst[tid][g] = sweepMeters[g].value()[0];
+    }
     sliceTknDst[tid] = meters.tknDstSlice.value()[0];
   };
 
@@ -745,22 +1391,33 @@ int main(int argc, char** argv) {
     LOG(FATAL) << "FLAGS_nthread_decoder (" << FLAGS_nthread_decoder
                << ") need to be positive ";
   }
+  if (FLAGS_decoder_batchsize <= 0) {
+    LOG(FATAL) << "FLAGS_decoder_batchsize (" << FLAGS_decoder_batchsize
+               << ") need to be positive ";
+  }
 
-  auto startThreadsAndJoin = [&runAmForward, &runDecoder, &emissionQueue](
+  const auto threadBudget = fl::getThreadBudget();
+  auto startThreadsAndJoin = [&runAmForward,
+                              &runDecoder,
+                              &emissionQueue,
+                              &threadAffinity,
+                              &threadBudget](
                                  int nAmThreads, int nDecoderThreads) {
     // TODO possibly try catch for futures to proper logging of all errors
     // https://github.com/facebookresearch/gtn/blob/master/gtn/parallel/parallel_map.h#L154
 
     // We have to run AM forwarding and decoding in sequential to avoid GPU
-    // OOM with two large neural nets.
-    if (FLAGS_lmtype == "convlm") {
+    // OOM with two large neural nets, unless they are pipelined: the bounded
+    // emission queue then keeps the emissions at constant memory, and the
+    // nets share the devices (or use separate ones, see
+    // FLAGS_decoder_lm_device_offset).
+    if ((FLAGS_lmtype == "convlm" || FLAGS_lmtype == "transformer") &&
+        !FLAGS_decoder_pipeline && nAmThreads > 0) {
       // 1. AM forwarding
       {
-        std::vector<std::future<void>> futs(nAmThreads);
-        fl::ThreadPool threadPool(nAmThreads);
-        for (int i = 0; i < nAmThreads; i++) {
-          futs[i] = threadPool.enqueue(runAmForward, i);
-        }
+        fl::WorkStealingThreadPool threadPool(
+            nAmThreads, nullptr, threadAffinity, threadBudget.computeCpus);
+        auto futs = threadPool.enqueueBulk(nAmThreads, runAmForward);
         for (int i = 0; i < nAmThreads; i++) {
           futs[i].get();
         }
@@ -768,28 +1425,34 @@ int main(int argc, char** argv) {
       }
       // 2. Decoding
       {
-        std::vector<std::future<void>> futs(nDecoderThreads);
-        fl::ThreadPool threadPool(nDecoderThreads);
-        for (int i = 0; i < nDecoderThreads; i++) {
-          futs[i] = threadPool.enqueue(runDecoder, i);
-        }
+        fl::WorkStealingThreadPool threadPool(
+            nDecoderThreads, nullptr, threadAffinity, threadBudget.decoderCpus);
+        auto futs = threadPool.enqueueBulk(nDecoderThreads, runDecoder);
         for (int i = 0; i < nDecoderThreads; i++) {
           futs[i].get();
         }
       }
     }
-    // Non-convLM decoding. AM forwarding and decoding can be run in parallel.
+    // Non-convLM or pipelined decoding. AM forwarding and decoding can be run
+    // in parallel.
     else {
-      std::vector<std::future<void>> futs(nAmThreads + nDecoderThreads);
-      fl::ThreadPool threadPool(nAmThreads + nDecoderThreads);
+      // A worker for each task, the decoders wait for the emissions. The
+      // workers share the CPUs of the computation and of the decoders.
+      auto cpus = threadBudget.computeCpus;
+      cpus.insert(
+          cpus.end(),
+          threadBudget.decoderCpus.begin(),
+          threadBudget.decoderCpus.end());
+      fl::WorkStealingThreadPool threadPool(
+          nAmThreads + nDecoderThreads, nullptr, threadAffinity, cpus);
       // AM forwarding threads
-      for (int i = 0; i < nAmThreads; i++) {
-        futs[i] = threadPool.enqueue(runAmForward, i);
-      }
+      auto futs = threadPool.enqueueBulk(nAmThreads, runAmForward);
       // Decoding threads
-      for (int i = 0; i < nDecoderThreads; i++) {
-        futs[i + nAmThreads] = threadPool.enqueue(runDecoder, i);
-      }
+      auto decoderFuts = threadPool.enqueueBulk(nDecoderThreads, runDecoder);
+      futs.insert(
+          futs.end(),
+          std::make_move_iterator(decoderFuts.begin()),
+          std::make_move_iterator(decoderFuts.end()));
 
       for (int i = 0; i < nAmThreads; i++) {
         futs[i].get();
@@ -802,7 +1465,22 @@ int main(int argc, char** argv) {
   };
   auto timer = fl::TimeMeter();
   timer.resume();
-  startThreadsAndJoin(FLAGS_nthread_decoder_am_forward, FLAGS_nthread_decoder);
+  if (!FLAGS_fl_trace_file.empty()) {
+    fl::TraceOptions traceOptions;
+    traceOptions.device = FLAGS_fl_trace_device;
+    fl::Tracer::start(traceOptions);
+  }
+  // No AM forward threads when the decoder threads read the emission cache
+  startThreadsAndJoin(
+      emissionCacheReader ? 0 : FLAGS_nthread_decoder_am_forward,
+      FLAGS_nthread_decoder);
+  if (!FLAGS_fl_trace_file.empty()) {
+    fl::Tracer::stop();
+    fl::Tracer::dump(FLAGS_fl_trace_file);
+  }
+  if (emissionCacheWriter) {
+    emissionCacheWriter->close();
+  }
   timer.stop();
 
   /* Compute statistics */
@@ -835,6 +1513,43 @@ int main(int argc, char** argv) {
          << totalTime / totalSamples
          << "s/sample) -- WER: " << std::setprecision(6) << totalWer
          << "\%, TER: " << totalTkn << "\%]" << std::endl;
+  int amSamples = 0;
+  int64_t amFrames = 0;
+  double amMaxTime = 0;
+  for (int i = 0; i < FLAGS_nthread_decoder_am_forward; i++) {
+    amSamples += amNumSamples[i];
+    amFrames += amNumFrames[i];
+    amMaxTime = std::max(amMaxTime, amTime[i]);
+  }
+  if (amMaxTime > 0) {
+    buffer << "[AM forward: " << amSamples / amMaxTime << " samples/s, "
+           << amFrames / amMaxTime << " frames/s]" << std::endl;
+  }
+  if (totalTime > 0) {
+    buffer << "[Decoding: " << totalSamples / totalTime * FLAGS_nthread_decoder
+           << " samples/s]" << std::endl;
+  }
+  if (decodeLatency.count() > 0) {
+    auto latency = decodeLatency.value();
+    buffer << "[Decoding latency p50/p90/p99/p999: " << latency[0] * 1000
+           << "/" << latency[1] * 1000 << "/" << latency[2] * 1000 << "/"
+           << latency[3] * 1000 << " ms]" << std::endl;
+  }
+  for (int g = 0; g < sweepParams.size(); g++) {
+    double sweepWer = 0;
+    for (int i = 0; i < FLAGS_nthread_decoder; i++) {
+      sweepWer += sweepWrdDst[i][g];
+    }
+    sweepWer = totalWords > 0 ? sweepWer / totalWords * 100. : 0.0;
+    buffer << "[Sweep lmweight " << sweepParams[g].first << ", wordscore "
+           << sweepParams[g].second << " -- WER: " << sweepWer << "\%]"
+           << std::endl;
+  }
+  if (lmScoreCache) {
+    buffer << "[LM score cache: " << lmScoreCache->nHits() << " hits, "
+           << lmScoreCache->nMisses() << " misses, " << lmScoreCache->size()
+           << "/" << lmScoreCache->capacity() << " entries]" << std::endl;
+  }
   LOG(INFO) << buffer.str();
   if (!FLAGS_sclite.empty()) {
     writeLog(buffer.str());
@@ -6,6 +6,8 @@
  */
 
 #include <stdlib.h>
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 #include <iomanip>
 #include <mutex>
@@ -33,6 +35,7 @@
 #include "flashlight/lib/text/dictionary/Utils.h"
 
 using fl::ext::afToVector;
+using fl::ext::afToVectorPinned;
 using fl::ext::Serializer;
 using fl::lib::join;
 using fl::lib::pathsConcat;
@@ -110,6 +113,16 @@ int main(int argc, char** argv) {
 
   LOG(INFO) << "Gflags after parsing \n" << serializeGflags("; ");
 
+  // The test threads run the computation, each prefetching its samples
+  if (FLAGS_thread_budget) {
+    auto budget = fl::partitionCpus(
+        FLAGS_nthread * FLAGS_nthread_decoder_am_forward,
+        0,
+        FLAGS_thread_budget_compute);
+    fl::setThreadBudget(budget);
+    LOG(INFO) << "Thread budget: " << budget.prettyString();
+  }
+
   /* ===================== Create Dictionary ===================== */
   auto dictPath = FLAGS_tokens;
   if (dictPath.empty() || !fl::lib::fileExists(dictPath)) {
@@ -179,18 +192,34 @@ int main(int argc, char** argv) {
       featParams,
       featType,
       {FLAGS_localnrmlleftctx, FLAGS_localnrmlrightctx},
-      /*sfxConf=*/{});
+      /*sfxConf=*/{},
+      /*sfxStartUpdate=*/0,
+      FLAGS_features_on_device);
   auto targetTransform = targetFeatures(tokenDict, lexicon, targetGenConfig);
   auto wordTransform = wordFeatures(wordDict);
   int targetpadVal =
       isSeq2seqCrit ? tokenDict.getIndex(fl::lib::text::kPadToken) : kTargetPadValue;
-  int wordpadVal = wordDict.getIndex(fl::lib::text::kUnkToken);
+  if (FLAGS_decoder_am_batchsize <= 0) {
+    LOG(FATAL) << "FLAGS_decoder_am_batchsize (" << FLAGS_decoder_am_batchsize
+               << ") need to be positive ";
+  }
+  if (FLAGS_decoder_am_batchsize > 1 && FLAGS_criterion != kCtcCriterion &&
+      FLAGS_criterion != kAsgCriterion) {
+    LOG(FATAL) << "FLAGS_decoder_am_batchsize > 1 is only supported for "
+               << kCtcCriterion << " and " << kAsgCriterion << " criterions";
+  }
+  // Word targets of batched samples are padded with a value which is not a
+  // word index, to be told apart from unknown words
+  int wordpadVal = FLAGS_decoder_am_batchsize > 1
+      ? -1
+      : wordDict.getIndex(fl::lib::text::kUnkToken);
 
+  // Samples are sorted by length, so that the batches have little padding
   std::vector<std::string> testSplits = fl::lib::split(",", FLAGS_test, true);
   auto ds = createDataset(
       testSplits,
       FLAGS_datadir,
-      1 /* batchsize */,
+      FLAGS_decoder_am_batchsize,
       inputTransform,
       targetTransform,
       wordTransform,
@@ -198,11 +227,17 @@ int main(int argc, char** argv) {
       0 /* worldrank */,
       1 /* worldsize */);
 
-  int nSamples = ds->size();
+  // The dataset holds batches of FLAGS_decoder_am_batchsize samples
+  int nBatches = ds->size();
   if (FLAGS_maxload > 0) {
-    nSamples = std::min(nSamples, FLAGS_maxload);
+    nBatches = std::min(
+        nBatches,
+        (FLAGS_maxload + FLAGS_decoder_am_batchsize - 1) /
+            FLAGS_decoder_am_batchsize);
   }
-  LOG(INFO) << "[Dataset] Dataset loaded, with " << nSamples << " samples.";
+  LOG(INFO) << "[Dataset] Dataset loaded, with " << nBatches
+            << " batches of up to " << FLAGS_decoder_am_batchsize
+            << " samples.";
 
   /* ===================== Test ===================== */
   std::vector<double> sliceWrdDst(FLAGS_nthread_decoder_am_forward);
@@ -244,11 +279,14 @@ int main(int argc, char** argv) {
     refStream << refStr;
   };
 
+  const auto threadAffinity =
+      fl::threadAffinityFromString(FLAGS_thread_affinity);
+
   // Run test
   auto run = [&network,
               &usePlugin,
               &criterion,
-              &nSamples,
+              &nBatches,
               &ds,
               &tokenDict,
               &wordDict,
@@ -261,9 +299,14 @@ int main(int argc, char** argv) {
               &sliceNumTokens,
               &sliceNumSamples,
               &sliceTime,
-              &isSeq2seqCrit](int tid) {
+              &isSeq2seqCrit,
+              &targetpadVal,
+              &wordpadVal,
+              &threadAffinity](int tid) {
     // Initialize AM
     af::setDevice(tid);
+    // Inference only, no computation graph is recorded
+    fl::NoGradGuard noGrad;
     std::shared_ptr<fl::Module> localNetwork = network;
     std::shared_ptr<SequenceCriterion> localCriterion = criterion;
     if (tid != 0) {
@@ -276,13 +319,34 @@ int main(int argc, char** argv) {
     }
 
     std::vector<int64_t> selectedIds;
-    for (int64_t i = tid; i < nSamples; i += FLAGS_nthread_decoder_am_forward) {
+    for (int64_t i = tid; i < nBatches; i += FLAGS_nthread_decoder_am_forward) {
       selectedIds.emplace_back(i);
     }
     std::shared_ptr<fl::Dataset> localDs =
         std::make_shared<fl::ResampleDataset>(ds, selectedIds);
     localDs = std::make_shared<fl::PrefetchDataset>(
-        localDs, FLAGS_nthread, FLAGS_nthread);
+        localDs,
+        FLAGS_nthread,
+        FLAGS_nthread,
+        false /* deviceStaging */,
+        0 /* reorderWindow */,
+        threadAffinity);
+
+    // Removes the padding of the targets of a sample of a batch
+    auto unpad = [](std::vector<int> target, int padVal) {
+      while (FLAGS_decoder_am_batchsize > 1 && !target.empty() &&
+             target.back() == padVal) {
+        target.pop_back();
+      }
+      return target;
+    };
+    // Viterbi paths of CTC and ASG are deduplicated on the device, so that
+    // only the final tokens are copied to the host
+    bool compactOnDevice =
+        FLAGS_criterion == kCtcCriterion || FLAGS_criterion == kAsgCriterion;
+    int blankIdx = FLAGS_criterion == kCtcCriterion
+        ? tokenDict.getIndex(kBlankToken)
+        : -1;
 
     TestMeters meters;
     meters.timer.resume();
@@ -298,83 +362,148 @@ int main(int argc, char** argv) {
         rawEmission = fl::ext::forwardSequentialModuleWithPadMask(
             fl::input(sample[kInputIdx]), localNetwork, sample[kDurationIdx]);
       }
-      auto emission = afToVector<float>(rawEmission);
-      auto tokenTarget = afToVector<int>(sample[kTargetIdx]);
-      auto wordTarget = afToVector<int>(sample[kWordIdx]);
-      auto sampleId = readSampleIds(sample[kSampleIdx]).front();
-
-      auto letterTarget = tknTarget2Ltr(
-          tokenTarget,
-          tokenDict,
-          FLAGS_criterion,
-          FLAGS_surround,
-          isSeq2seqCrit,
-          FLAGS_replabel,
-          FLAGS_usewordpiece,
-          FLAGS_wordseparator);
-      std::vector<std::string> wordTargetStr;
-      if (FLAGS_uselexicon) {
-        wordTargetStr = wrdIdx2Wrd(wordTarget, wordDict);
-      } else {
-        wordTargetStr = tkn2Wrd(letterTarget, FLAGS_wordseparator);
+      auto sampleIds = readSampleIds(sample[kSampleIdx]);
+      int batchSize = sampleIds.size();
+      const af::array& emissions = rawEmission.array();
+      int nTokens = emissions.dims(0);
+      int T = emissions.dims(1);
+
+      // Frames of each sample, in proportion to its number of input frames
+      // as for the padding mask of the forward
+      std::vector<int> nFrames(batchSize, T);
+      if (batchSize > 1) {
+        auto durations = afToVector<float>(sample[kDurationIdx].as(f32));
+        float maxDuration =
+            *std::max_element(durations.begin(), durations.end());
+        for (int b = 0; b < batchSize && maxDuration > 0; b++) {
+          nFrames[b] =
+              std::min<int>(T, std::ceil(T * durations[b] / maxDuration));
+        }
       }
 
       // Tokens
-      auto tokenPrediction =
-          afToVector<int>(localCriterion->viterbiPath(rawEmission.array()));
-      auto letterPrediction = tknPrediction2Ltr(
-          tokenPrediction,
-          tokenDict,
-          FLAGS_criterion,
-          FLAGS_surround,
-          isSeq2seqCrit,
-          FLAGS_replabel,
-          FLAGS_usewordpiece,
-          FLAGS_wordseparator);
-
-      meters.tknDstSlice.add(letterPrediction, letterTarget);
-
-      // Words
-      std::vector<std::string> wrdPredictionStr =
-          tkn2Wrd(letterPrediction, FLAGS_wordseparator);
-      meters.wrdDstSlice.add(wrdPredictionStr, wordTargetStr);
-
-      if (!FLAGS_sclite.empty()) {
-        writeRef(join(" ", wordTargetStr) + " (" + sampleId + ")\n");
-        writeHyp(join(" ", wrdPredictionStr) + " (" + sampleId + ")\n");
+      std::vector<int> tokenPredictions;
+      std::vector<int> predictionSizes(1);
+      if (!compactOnDevice) {
+        tokenPredictions =
+            afToVector<int>(localCriterion->viterbiPath(emissions));
+        predictionSizes[0] = tokenPredictions.size();
+      } else {
+        af::array paths;
+        if (FLAGS_criterion == kCtcCriterion || batchSize == 1) {
+          paths = localCriterion->viterbiPath(emissions);
+        } else {
+          // The Viterbi of ASG goes through the whole input: padding frames
+          // would change the path of the shorter samples
+          paths = af::constant(-1, T, batchSize, s32);
+          for (int b = 0; b < batchSize; b++) {
+            paths(af::seq(nFrames[b]), b) = localCriterion->viterbiPath(
+                emissions(af::span, af::seq(nFrames[b]), b));
+          }
+        }
+        af::array sizes;
+        auto tokens = compactViterbiPath(
+            paths,
+            af::array(batchSize, nFrames.data()),
+            blankIdx,
+            sizes);
+        tokenPredictions = afToVector<int>(tokens);
+        predictionSizes = afToVector<int>(sizes);
       }
 
-      if (FLAGS_show) {
-        meters.tknDst.reset();
-        meters.wrdDst.reset();
-        meters.tknDst.add(letterPrediction, letterTarget);
-        meters.wrdDst.add(wrdPredictionStr, wordTargetStr);
-
-        std::cout << "|T|: " << join(" ", letterTarget) << std::endl;
-        std::cout << "|P|: " << join(" ", letterPrediction) << std::endl;
-        std::cout << "[sample: " << sampleId
-                  << ", WER: " << meters.wrdDst.errorRate()[0]
-                  << "\%, TER: " << meters.tknDst.errorRate()[0]
-                  << "\%, total WER: " << meters.wrdDstSlice.errorRate()[0]
-                  << "\%, total TER: " << meters.tknDstSlice.errorRate()[0]
-                  << "\%, progress (thread " << tid << "): "
-                  << static_cast<float>(++cnt) / selectedIds.size() * 100
-                  << "\%]" << std::endl;
-      }
-
-      /* Save emission and targets */
-      int nTokens = rawEmission.dims(0);
-      int nFrames = rawEmission.dims(1);
-      EmissionUnit emissionUnit(emission, sampleId, nFrames, nTokens);
-
-      // Update counters
-      sliceNumWords[tid] += wordTarget.size();
-      sliceNumTokens[tid] += letterTarget.size();
-      sliceNumSamples[tid]++;
-
-      if (!emissionDir.empty()) {
-        std::string savePath = pathsConcat(emissionDir, sampleId + ".bin");
-        Serializer::save(savePath, FL_APP_ASR_VERSION, emissionUnit);
+      auto tokenTargets = afToVector<int>(sample[kTargetIdx]);
+      auto wordTargets = afToVector<int>(sample[kWordIdx]);
+      int tokenTargetLen = sample[kTargetIdx].dims(0);
+      int wordTargetLen = sample[kWordIdx].dims(0);
+      int predictionOffset = 0;
+      for (int b = 0; b < batchSize; b++) {
+        const auto& sampleId = sampleIds[b];
+        auto tokenTarget = unpad(
+            std::vector<int>(
+                tokenTargets.begin() + b * tokenTargetLen,
+                tokenTargets.begin() + (b + 1) * tokenTargetLen),
+            targetpadVal);
+        auto wordTarget = unpad(
+            std::vector<int>(
+                wordTargets.begin() + b * wordTargetLen,
+                wordTargets.begin() + (b + 1) * wordTargetLen),
+            wordpadVal);
+
+        auto letterTarget = tknTarget2Ltr(
+            tokenTarget,
+            tokenDict,
+            FLAGS_criterion,
+            FLAGS_surround,
+            isSeq2seqCrit,
+            FLAGS_replabel,
+            FLAGS_usewordpiece,
+            FLAGS_wordseparator);
+        std::vector<std::string> wordTargetStr;
+        if (FLAGS_uselexicon) {
+          wordTargetStr = wrdIdx2Wrd(wordTarget, wordDict);
+        } else {
+          wordTargetStr = tkn2Wrd(letterTarget, FLAGS_wordseparator);
+        }
+
+        std::vector<int> tokenPrediction(
+            tokenPredictions.begin() + predictionOffset,
+            tokenPredictions.begin() + predictionOffset + predictionSizes[b]);
+        predictionOffset += predictionSizes[b];
+        auto letterPrediction = tknPrediction2Ltr(
+            tokenPrediction,
+            tokenDict,
+            FLAGS_criterion,
+            FLAGS_surround,
+            isSeq2seqCrit,
+            FLAGS_replabel,
+            FLAGS_usewordpiece,
+            FLAGS_wordseparator,
+            compactOnDevice);
+
+        meters.tknDstSlice.add(letterPrediction, letterTarget);
+
+        // Words
+        std::vector<std::string> wrdPredictionStr =
+            tkn2Wrd(letterPrediction, FLAGS_wordseparator);
+        meters.wrdDstSlice.add(wrdPredictionStr, wordTargetStr);
+
+        if (!FLAGS_sclite.empty()) {
+          writeRef(join(" ", wordTargetStr) + " (" + sampleId + ")\n");
+          writeHyp(join(" ", wrdPredictionStr) + " (" + sampleId + ")\n");
+        }
+
+        if (FLAGS_show) {
+          meters.tknDst.reset();
+          meters.wrdDst.reset();
+          meters.tknDst.add(letterPrediction, letterTarget);
+          meters.wrdDst.add(wrdPredictionStr, wordTargetStr);
+
+          std::cout << "|T|: " << join(" ", letterTarget) << std::endl;
+          std::cout << "|P|: " << join(" ", letterPrediction) << std::endl;
+          std::cout << "[sample: " << sampleId
+                    << ", WER: " << meters.wrdDst.errorRate()[0]
+                    << "\%, TER: " << meters.tknDst.errorRate()[0]
+                    << "\%, total WER: " << meters.wrdDstSlice.errorRate()[0]
+                    << "\%, total TER: " << meters.tknDstSlice.errorRate()[0]
+                    << "\%, progress (thread " << tid << "): "
+                    << static_cast<float>(++cnt) / selectedIds.size() /
+                    FLAGS_decoder_am_batchsize * 100
+                    << "\%]" << std::endl;
+        }
+
+        // Update counters
+        sliceNumWords[tid] += wordTarget.size();
+        sliceNumTokens[tid] += letterTarget.size();
+        sliceNumSamples[tid]++;
+
+        /* Save emission and targets */
+        if (!emissionDir.empty()) {
+          auto emission = afToVectorPinned<float>(
+              emissions(af::span, af::seq(nFrames[b]), b));
+          EmissionUnit emissionUnit(emission, sampleId, nFrames[b], nTokens);
+          std::string savePath = pathsConcat(emissionDir, sampleId + ".bin");
+          Serializer::save(savePath, FL_APP_ASR_VERSION, emissionUnit);
+        }
       }
     }
 
@@ -388,15 +517,16 @@ int main(int argc, char** argv) {
   /* Spread threades */
   // TODO possibly try catch for futures to proper logging of all errors
   // https://github.com/facebookresearch/gtn/blob/master/gtn/parallel/parallel_map.h#L154
-  auto startThreadsAndJoin = [&run](int nThreads) {
+  auto startThreadsAndJoin = [&run, &threadAffinity](int nThreads) {
     if (nThreads == 1) {
       run(0);
     } else if (nThreads > 1) {
-      std::vector<std::future<void>> futs(nThreads);
-      fl::ThreadPool threadPool(nThreads);
-      for (int i = 0; i < nThreads; i++) {
-        futs[i] = threadPool.enqueue(run, i);
-      }
+      fl::WorkStealingThreadPool threadPool(
+          nThreads,
+          nullptr,
+          threadAffinity,
+          fl::getThreadBudget().computeCpus);
+      auto futs = threadPool.enqueueBulk(nThreads, run);
       for (int i = 0; i < nThreads; i++) {
         futs[i].get();
       }
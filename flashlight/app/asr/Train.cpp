@@ -5,10 +5,15 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <algorithm>
+#include <chrono>
 #include <cstdlib>
+#include <deque>
 #include <fstream>
 #include <functional>
+#include <future>
 #include <random>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -27,18 +32,23 @@
 #include "flashlight/app/asr/decoder/PlGenerator.h"
 #include "flashlight/app/asr/decoder/TranscriptionUtils.h"
 #include "flashlight/app/asr/runtime/runtime.h"
+#include "flashlight/ext/common/AsyncCheckpointer.h"
+#include "flashlight/ext/common/BatchBudgetProbe.h"
 #include "flashlight/ext/common/DistributedUtils.h"
+#include "flashlight/ext/common/MetricsExporters.h"
 #include "flashlight/ext/common/SequentialBuilder.h"
 #include "flashlight/ext/common/Serializer.h"
 #include "flashlight/ext/plugin/ModulePlugin.h"
 #include "flashlight/fl/contrib/contrib.h"
 #include "flashlight/fl/flashlight.h"
 #include "flashlight/lib/common/System.h"
+#include "flashlight/lib/sequence/criterion/cpu/CriterionUtils.h"
 #include "flashlight/lib/text/decoder/lm/KenLM.h"
 #include "flashlight/lib/text/dictionary/Dictionary.h"
 #include "flashlight/lib/text/dictionary/Utils.h"
 
 using fl::ext::afToVector;
+using fl::ext::AsyncCheckpointer;
 using fl::ext::Serializer;
 using fl::lib::fileExists;
 using fl::lib::format;
@@ -64,6 +74,23 @@ void parseCmdLineFlagsWrapper(int argc, char** argv) {
   handleDeprecatedFlags();
 }
 
+// Samples [begin, end) of a batch
+std::vector<af::array> sliceBatch(
+    const std::vector<af::array>& batch,
+    int64_t begin,
+    int64_t end) {
+  std::vector<af::array> part(batch.size());
+  for (size_t i = 0; i < batch.size(); ++i) {
+    if (batch[i].isempty()) {
+      continue;
+    }
+    auto range = af::seq(begin, end - 1);
+    part[i] = i == kInputIdx ? batch[i](af::span, af::span, af::span, range)
+                             : batch[i](af::span, range);
+  }
+  return part;
+}
+
 // Extra flags for IPL
 DEFINE_string(unsup_datadir, "", "datadir for unsupervised lists");
 DEFINE_string(
@@ -90,6 +117,14 @@ DEFINE_int64(
     ipl_maxtsz,
     std::numeric_limits<int64_t>::max(),
     "maximum length of targets in words");
+DEFINE_int64(
+    ipl_shard_size,
+    0,
+    "number of samples per PL list file generated in the background while training continues, 0 to generate PL synchronously");
+DEFINE_int64(
+    ipl_device,
+    -1,
+    "device of the background PL generation, -1 for the training device");
 
 } // namespace
 
@@ -115,12 +150,16 @@ int main(int argc, char** argv) {
   int64_t startEpoch = 0;
   int64_t startUpdate = 0;
   double scaleFactor = 1.; // for AMP
+  // Set when the model to continue was saved mid-epoch
+  std::string startDataState;
   if (argc <= 1) {
     LOG(FATAL) << gflags::ProgramUsage();
   }
   if (runStatus == kTrainMode) {
     parseCmdLineFlagsWrapper(argc, argv);
     runPath = FLAGS_rundir;
+    scaleFactor =
+        FLAGS_fl_amp_use_mixed_precision ? FLAGS_fl_amp_scale_factor : 1.;
   } else if (runStatus == kContinueMode) {
     runPath = argv[2];
     while (fileExists(getRunFile("model_last.bin", runIdx, runPath))) {
@@ -150,6 +189,10 @@ int main(int argc, char** argv) {
     } else {
       startUpdate = std::stoi(nbupdates->second);
     }
+    auto dataState = cfg.find(kDataState);
+    if (dataState != cfg.end()) {
+      startDataState = dataState->second;
+    }
 
     scaleFactor = getScaleFactor(cfg);
   } else if (runStatus == kForkMode) {
@@ -178,16 +221,41 @@ int main(int argc, char** argv) {
   }
 
   af::setSeed(FLAGS_seed);
+  if (FLAGS_thread_budget) {
+    auto budget =
+        fl::partitionCpus(FLAGS_nthread, 0, FLAGS_thread_budget_compute);
+    fl::setThreadBudget(budget);
+    LOG(INFO) << "Thread budget: " << budget.prettyString();
+    if (FLAGS_nthread_criterion == 0) {
+      FLAGS_nthread_criterion = budget.computeThreads;
+    }
+  }
+  fl::lib::cpu::setCriterionNumThreads(FLAGS_nthread_criterion);
   fl::DynamicBenchmark::setBenchmarkMode(FLAGS_fl_benchmark_mode);
+  fl::DynamicBenchmark::setCacheFile(FLAGS_fl_benchmark_cache);
 
-  std::shared_ptr<fl::Reducer> reducer = nullptr;
+  // Only reduces the gradients of the last batch of an update, see
+  // '--accumulate_batches'
+  std::shared_ptr<fl::DeferredReducer> reducer = nullptr;
   if (FLAGS_enable_distributed) {
     fl::ext::initDistributed(
         FLAGS_world_rank,
         FLAGS_world_size,
         FLAGS_max_devices_per_node,
         FLAGS_rndv_filepath);
-    reducer = std::make_shared<fl::CoalescingReducer>(1.0, true, true);
+    if (FLAGS_distributed_compression != "" &&
+        FLAGS_distributed_compression != "fp16" &&
+        FLAGS_distributed_compression != "fp16_ef") {
+      LOG(FATAL) << "Invalid distributed_compression: "
+                 << FLAGS_distributed_compression;
+    }
+    reducer = std::make_shared<fl::DeferredReducer>(
+        std::make_shared<fl::BucketedReducer>(
+            1.0,
+            true,
+            fl::DistributedConstants::kCoalesceCacheSize,
+            /* compress = */ !FLAGS_distributed_compression.empty(),
+            /* errorFeedback = */ FLAGS_distributed_compression == "fp16_ef"));
   }
 
   int worldRank = fl::getWorldRank();
@@ -215,6 +283,23 @@ int main(int argc, char** argv) {
     }
   }
 
+  // warm start the memory manager and record its allocation profile
+  auto* cachingMemMgr = dynamic_cast<fl::CachingMemoryManager*>(
+      fl::MemoryManagerInstaller::currentlyInstalledMemoryManager());
+  if (!FLAGS_fl_mem_profile_load.empty() ||
+      !FLAGS_fl_mem_profile_save.empty()) {
+    if (!cachingMemMgr) {
+      LOG(FATAL) << "--fl_mem_profile_load and --fl_mem_profile_save "
+                 << "require the CachingMemoryManager";
+    }
+    if (!FLAGS_fl_mem_profile_load.empty()) {
+      cachingMemMgr->warmStart(
+          fl::CachingMemoryManager::AllocationProfile::load(
+              FLAGS_fl_mem_profile_load));
+    }
+    cachingMemMgr->setProfilingEnabled(!FLAGS_fl_mem_profile_save.empty());
+  }
+
   // flashlight optim mode
   auto flOptimLevel = FLAGS_fl_optim_mode.empty()
       ? fl::OptimLevel::DEFAULT
@@ -319,7 +404,8 @@ int main(int argc, char** argv) {
       featType,
       {FLAGS_localnrmlleftctx, FLAGS_localnrmlrightctx},
       sfxConf,
-      std::max(0L, FLAGS_sfx_start_update - startUpdate));
+      std::max(0L, FLAGS_sfx_start_update - startUpdate),
+      FLAGS_features_on_device);
   auto targetTransform = targetFeatures(tokenDict, lexicon, targetGenConfig);
   auto wordTransform = wordFeatures(wordDict);
   int targetpadVal = isSeq2seqCrit
@@ -329,25 +415,45 @@ int main(int argc, char** argv) {
   auto padVal = std::make_tuple(0, targetpadVal, wordpadVal);
 
   std::vector<std::string> trainSplits = fl::lib::split(",", FLAGS_train, true);
-  auto trainds = createDataset(
-      trainSplits,
-      FLAGS_datadir,
-      FLAGS_batchsize,
-      inputTransform,
-      targetTransform,
-      wordTransform,
-      padVal,
-      worldRank,
-      worldSize,
-      false, // allowEmpty
-      FLAGS_batching_strategy,
-      FLAGS_batching_max_duration);
+  // Created again if the batch budget is probed
+  auto createTrainDataset = [&]() {
+    return createDataset(
+        trainSplits,
+        FLAGS_datadir,
+        FLAGS_batchsize,
+        inputTransform,
+        targetTransform,
+        wordTransform,
+        padVal,
+        worldRank,
+        worldSize,
+        false, // allowEmpty
+        FLAGS_batching_strategy,
+        FLAGS_batching_max_duration,
+        FLAGS_batching_num_buckets);
+  };
+  auto trainds = createTrainDataset();
+  // Weights the token budget of the batches of each process by its
+  // throughput, measured on the forward passes
+  std::shared_ptr<WorkBalancer> balancer;
+  if (FLAGS_batching_balance_ranks) {
+    if (FLAGS_batching_strategy != kBatchStrategyBucket) {
+      LOG(FATAL) << "'--batching_balance_ranks' needs "
+                    "'--batching_strategy=bucket'";
+    }
+    balancer = std::make_shared<WorkBalancer>(worldRank, worldSize);
+  }
 
   std::map<std::string, std::shared_ptr<fl::Dataset>> validds;
   int64_t validBatchSize =
       FLAGS_validbatchsize == -1 ? FLAGS_batchsize : FLAGS_validbatchsize;
   auto validInputTransform = inputFeatures(
-      featParams, featType, {FLAGS_localnrmlleftctx, FLAGS_localnrmlrightctx});
+      featParams,
+      featType,
+      {FLAGS_localnrmlleftctx, FLAGS_localnrmlrightctx},
+      /*sfxConf=*/{},
+      /*sfxStartUpdate=*/0,
+      FLAGS_features_on_device);
   for (const auto& s : validTagSets) {
     validds[s.first] = createDataset(
         {s.second},
@@ -480,10 +586,41 @@ int main(int argc, char** argv) {
   }
 
   if (runStatus == kTrainMode || runStatus == kForkMode) {
-    netoptim = initOptimizer(
-        {network}, FLAGS_netoptim, FLAGS_lr, FLAGS_momentum, FLAGS_weightdecay);
-    critoptim =
-        initOptimizer({criterion}, FLAGS_critoptim, FLAGS_lrcrit, 0.0, 0.0);
+    if (FLAGS_enable_distributed && FLAGS_distributed_pipelined_optimizer) {
+      // One optimizer per parameter, the gradients being reduced by the
+      // pipelined optimizers instead of the reducer
+      auto initPipelined = [](const std::vector<fl::Variable>& params,
+                              const std::string& optim,
+                              double lr,
+                              double momentum,
+                              double weightdecay)
+          -> std::shared_ptr<fl::FirstOrderOptimizer> {
+        if (params.empty()) {
+          return initOptimizer(params, optim, lr, momentum, weightdecay);
+        }
+        return std::make_shared<fl::PipelinedOptimizer>(
+            params, [&](const std::vector<fl::Variable>& param) {
+              return initOptimizer(param, optim, lr, momentum, weightdecay);
+            });
+      };
+      netoptim = initPipelined(
+          network->params(),
+          FLAGS_netoptim,
+          FLAGS_lr,
+          FLAGS_momentum,
+          FLAGS_weightdecay);
+      critoptim = initPipelined(
+          criterion->params(), FLAGS_critoptim, FLAGS_lrcrit, 0.0, 0.0);
+    } else {
+      netoptim = initOptimizer(
+          {network},
+          FLAGS_netoptim,
+          FLAGS_lr,
+          FLAGS_momentum,
+          FLAGS_weightdecay);
+      critoptim =
+          initOptimizer({criterion}, FLAGS_critoptim, FLAGS_lrcrit, 0.0, 0.0);
+    }
   }
   FL_LOG_MASTER(INFO) << "[Network Optimizer] " << netoptim->prettyString();
   FL_LOG_MASTER(INFO) << "[Criterion Optimizer] " << critoptim->prettyString();
@@ -521,6 +658,66 @@ int main(int argc, char** argv) {
                         << FLAGS_linseg - startUpdate << " updates)";
   }
 
+  /* ===================== Probe Batch Budget ===================== */
+  // Before the gradients are distributed: the processes probe alone
+  if (FLAGS_batching_probe_max_duration) {
+    if (FLAGS_batching_strategy != kBatchStrategyDynamic &&
+        FLAGS_batching_strategy != kBatchStrategyRandDynamic &&
+        FLAGS_batching_strategy != kBatchStrategyBucket) {
+      LOG(FATAL) << "'--batching_probe_max_duration' needs "
+                    "'--batching_strategy' 'dynamic', 'randdynamic' or "
+                    "'bucket'";
+    }
+    // Samples are sorted by decreasing size: the first one is the longest
+    auto longestds = createDataset(
+        trainSplits,
+        FLAGS_datadir,
+        1,
+        inputTransform,
+        targetTransform,
+        wordTransform,
+        padVal);
+    auto longest = longestds->get(0);
+    const float maxDuration = longest[kDurationIdx].scalar<float>();
+    // Batches of `n` copies of the longest sample
+    auto probeStep = [&](int64_t n) {
+      network->train();
+      criterion->train();
+      auto input = fl::input(af::tile(longest[kInputIdx], 1, 1, 1, n));
+      auto durations = af::tile(longest[kDurationIdx], 1, n);
+      fl::Variable output;
+      if (usePlugin) {
+        output = network->forward({input, fl::noGrad(durations)}).front();
+      } else {
+        output = fl::ext::forwardSequentialModuleWithPadMask(
+            input, network, durations);
+      }
+      std::vector<fl::Variable> critArgs = {
+          output, fl::noGrad(af::tile(longest[kTargetIdx], 1, n))};
+      if (isSeq2seqCrit) {
+        critArgs.push_back(fl::noGrad(durations));
+        critArgs.push_back(
+            fl::noGrad(af::tile(longest[kTargetSizeIdx], 1, n)));
+      }
+      criterion->forward(critArgs).front().backward();
+      network->zeroGrad();
+      criterion->zeroGrad();
+    };
+    int64_t numSamples = fl::ext::findMaxBatchBudget(
+        probeStep, 1, longestds->size(), FLAGS_batching_probe_margin);
+    if (numSamples == 0) {
+      LOG(FATAL) << "The longest training sample (" << maxDuration
+                 << ") doesn't fit in the memory of the device";
+    }
+    FLAGS_batching_max_duration = numSamples * maxDuration;
+    FLAGS_batching_probe_max_duration = false;
+    config[kGflags] = serializeGflags();
+    FL_LOG_MASTER(INFO) << "Probed batching_max_duration: "
+                        << FLAGS_batching_max_duration << " (" << numSamples
+                        << " longest samples)";
+    trainds = createTrainDataset();
+  }
+
   /* ===================== Meters ===================== */
   TrainMeters meters;
   for (const auto& s : validTagSets) {
@@ -542,6 +739,24 @@ int main(int argc, char** argv) {
     }
   }
 
+  /* ===================== Tracing ===================== */
+  std::string traceFile = FLAGS_fl_trace_file;
+  if (!traceFile.empty()) {
+    if (worldSize > 1) {
+      traceFile += "." + std::to_string(worldRank);
+    }
+    fl::TraceOptions traceOptions;
+    traceOptions.device = FLAGS_fl_trace_device;
+    fl::Tracer::start(traceOptions);
+  }
+
+  /* ===================== Metrics ===================== */
+  fl::ext::MetricsExporters metricsExporters(
+      FLAGS_fl_metrics_port,
+      FLAGS_fl_metrics_statsd,
+      FLAGS_fl_metrics_statsd_interval,
+      worldRank);
+
   /* ===================== Logging ===================== */
   std::ofstream logFile;
   if (isMaster) {
@@ -610,7 +825,9 @@ int main(int argc, char** argv) {
       inputTransform,
       targetTransform,
       wordTransform,
-      tokenToWord);
+      tokenToWord,
+      FLAGS_ipl_shard_size,
+      FLAGS_ipl_device);
 
   /* ===================== Hooks ===================== */
   auto logStatus = [&logFile, &validTagSets, &plGenerator, isMaster](
@@ -623,6 +840,7 @@ int main(int argc, char** argv) {
                        double lrcrit,
                        double scaleFactor) {
     syncMeter(mtrs);
+    setTrainMetrics(mtrs);
     plGenerator.setModelWER(
         mtrs.valid[validTagSets.front().first].wrdEdit.errorRate()[0]);
 
@@ -630,98 +848,128 @@ int main(int argc, char** argv) {
       auto logMsg = getLogString(
           mtrs, validWerWithDecoder, epoch, nupdates, lr, lrcrit, scaleFactor);
       FL_LOG_MASTER(INFO) << logMsg;
+      FL_LOG_MASTER(INFO)
+          << "Step profile (mean/p99 of the phases, p50/p90/p99/p999 "
+          << "of the steps and waits): " << getStepProfileString(mtrs);
       appendToLog(logFile, logMsg);
     }
   };
 
-  auto saveModels = [&](int iter, int totalUpdates, double scaleFactor) {
-    if (isMaster) {
-      // Save last epoch
-      config[kEpoch] = std::to_string(iter);
-      config[kUpdates] = std::to_string(totalUpdates);
-      config[kScaleFactor] = std::to_string(scaleFactor);
-
-      std::string filename;
-      if (FLAGS_itersave) {
-        filename =
-            getRunFile(format("model_iter_%03d.bin", iter), runIdx, runPath);
-        Serializer::save(
-            filename,
-            FL_APP_ASR_VERSION,
-            config,
-            network,
-            criterion,
-            netoptim,
-            critoptim);
-      }
+  // The models are snapshotted once per save, and written in the background
+  AsyncCheckpointer checkpointer(/* async = */ FLAGS_async_checkpoint);
+  auto snapshotModels = [&](int iter, int totalUpdates, double scaleFactor) {
+    // Save last epoch
+    config[kEpoch] = std::to_string(iter);
+    config[kUpdates] = std::to_string(totalUpdates);
+    config[kScaleFactor] = std::to_string(scaleFactor);
+    return AsyncCheckpointer::snapshot(
+        FL_APP_ASR_VERSION, config, network, criterion, netoptim, critoptim);
+  };
+  auto lastModelFiles = [&](int iter) {
+    std::vector<std::string> filenames;
+    if (FLAGS_itersave) {
+      filenames.push_back(
+          getRunFile(format("model_iter_%03d.bin", iter), runIdx, runPath));
+    }
 
-      // save last model
-      filename = getRunFile("model_last.bin", runIdx, runPath);
-      Serializer::save(
-          filename,
-          FL_APP_ASR_VERSION,
-          config,
-          network,
-          criterion,
-          netoptim,
-          critoptim);
-
-      // save if better than ever for one valid
-      for (const auto& v : validminerrs) {
-        double verr = meters.valid[v.first].wrdEdit.errorRate()[0];
-        if (verr < validminerrs[v.first]) {
-          validminerrs[v.first] = verr;
-          std::string cleaned_v = cleanFilepath(v.first);
-          std::string vfname =
-              getRunFile("model_" + cleaned_v + ".bin", runIdx, runPath);
-          Serializer::save(
-              vfname,
-              FL_APP_ASR_VERSION,
-              config,
-              network,
-              criterion,
-              netoptim,
-              critoptim);
-        }
+    // save last model
+    filenames.push_back(getRunFile("model_last.bin", runIdx, runPath));
+    return filenames;
+  };
+  // Models better than ever for the validation results of `mtrs`
+  auto bestModelFiles = [&](TrainMeters& mtrs,
+                            std::unordered_map<std::string, double>&
+                                werWithDecoder) {
+    std::vector<std::string> filenames;
+    // save if better than ever for one valid
+    for (const auto& v : validminerrs) {
+      double verr = mtrs.valid[v.first].wrdEdit.errorRate()[0];
+      if (verr < validminerrs[v.first]) {
+        validminerrs[v.first] = verr;
+        std::string cleaned_v = cleanFilepath(v.first);
+        filenames.push_back(
+            getRunFile("model_" + cleaned_v + ".bin", runIdx, runPath));
       }
+    }
 
-      // save if better than ever for one valid with lm decoding
-      for (const auto& v : validMinWerWithDecoder) {
-        double verr = validWerWithDecoder[v.first];
-        if (verr < validMinWerWithDecoder[v.first]) {
-          validMinWerWithDecoder[v.first] = verr;
-          std::string cleaned_v = cleanFilepath(v.first);
-          std::string vfname = getRunFile(
-              "model_" + cleaned_v + "_decoder.bin", runIdx, runPath);
-          Serializer::save(
-              vfname,
-              FL_APP_ASR_VERSION,
-              config,
-              network,
-              criterion,
-              netoptim,
-              critoptim);
-        }
-      }
-      // print brief stats on memory allocation (so far)
-      auto* curMemMgr =
-          fl::MemoryManagerInstaller::currentlyInstalledMemoryManager();
-      if (curMemMgr) {
-        curMemMgr->printInfo("Memory Manager Stats", 0 /* device id */);
+    // save if better than ever for one valid with lm decoding
+    for (const auto& v : validMinWerWithDecoder) {
+      double verr = werWithDecoder[v.first];
+      if (verr < validMinWerWithDecoder[v.first]) {
+        validMinWerWithDecoder[v.first] = verr;
+        std::string cleaned_v = cleanFilepath(v.first);
+        filenames.push_back(getRunFile(
+            "model_" + cleaned_v + "_decoder.bin", runIdx, runPath));
       }
     }
+    return filenames;
+  };
+  auto logMemoryStats = [&]() {
+    // print brief stats on memory allocation (so far)
+    auto* curMemMgr =
+        fl::MemoryManagerInstaller::currentlyInstalledMemoryManager();
+    if (curMemMgr) {
+      curMemMgr->printInfo("Memory Manager Stats", 0 /* device id */);
+    }
+    if (!FLAGS_fl_mem_profile_save.empty()) {
+      cachingMemMgr->getAllocationProfile().save(FLAGS_fl_mem_profile_save);
+    }
+  };
+  auto saveModels = [&](int iter, int totalUpdates, double scaleFactor) {
+    if (isMaster) {
+      auto filenames = lastModelFiles(iter);
+      auto bestFilenames = bestModelFiles(meters, validWerWithDecoder);
+      filenames.insert(
+          filenames.end(), bestFilenames.begin(), bestFilenames.end());
+      checkpointer.write(
+          filenames, snapshotModels(iter, totalUpdates, scaleFactor));
+      logMemoryStats();
+    }
   };
 
-  auto evalOutput = [&tokenDict, &criterion, &isSeq2seqCrit](
+  auto evalOutput = [&tokenDict, &isSeq2seqCrit](
+                        const std::shared_ptr<SequenceCriterion>& criterion,
                         const af::array& op,
                         const af::array& target,
                         const af::array& inputSizes,
                         DatasetMeters& mtr) {
     auto batchsz = op.dims(2);
+    // When tokens are letters, the error rates of CTC and ASG are computed on
+    // the device for the whole batch, without copying the paths to the host
+    bool isCtc = FLAGS_criterion == kCtcCriterion;
+    if ((isCtc || FLAGS_criterion == kAsgCriterion) && FLAGS_replabel == 0 &&
+        !FLAGS_usewordpiece && FLAGS_surround.empty() &&
+        !tokenDict.contains(kSilToken) &&
+        tokenDict.contains(FLAGS_wordseparator)) {
+      int wordSepIdx = tokenDict.getIndex(FLAGS_wordseparator);
+      auto paths = criterion->viterbiPath(op);
+      auto keep = viterbiPathMask(
+          paths,
+          af::constant(paths.dims(0), batchsz, s32),
+          isCtc ? tokenDict.getIndex(kBlankToken) : -1);
+      af::array ltrPredSizes, ltrTgtSizes, wrdPredSizes, wrdTgtSizes;
+      auto ltrPred = packTokens(paths, keep, wordSepIdx, ltrPredSizes);
+      auto ltrTgt = packTokens(target, target >= 0, wordSepIdx, ltrTgtSizes);
+      mtr.tknEdit.addBatch(ltrPred, ltrTgt, ltrPredSizes, ltrTgtSizes);
+      auto wrdPred = lettersToWords(ltrPred, wordSepIdx, wrdPredSizes);
+      auto wrdTgt = lettersToWords(ltrTgt, wordSepIdx, wrdTgtSizes);
+      mtr.wrdEdit.addBatch(wrdPred, wrdTgt, wrdPredSizes, wrdTgtSizes);
+      return;
+    }
+
+    // Seq2seq models decode the whole batch at once on the device
+    std::vector<std::vector<int>> batchPaths;
+    auto s2sCriterion = std::dynamic_pointer_cast<Seq2SeqCriterion>(criterion);
+    if (s2sCriterion) {
+      batchPaths =
+          s2sCriterion->batchedBeamPath(op, inputSizes, FLAGS_validbeamsize);
+    }
     for (int b = 0; b < batchsz; ++b) {
       auto tgt = target(af::span, b);
-      auto viterbipath = afToVector<int>(
-          criterion->viterbiPath(op(af::span, af::span, b), inputSizes.col(b)));
+      auto viterbipath = s2sCriterion
+          ? batchPaths[b]
+          : afToVector<int>(criterion->viterbiPath(
+                op(af::span, af::span, b), inputSizes.col(b)));
       auto tgtraw = afToVector<int>(tgt);
 
       // Remove `-1`s appended to the target for batching (if any)
@@ -776,7 +1024,7 @@ int main(int argc, char** argv) {
       fl::TimeMeter timer;
       timer.resume();
       FL_LOG_MASTER(INFO) << "[Beam-search decoder]   * DM: compute emissions";
-      auto eds = dm->forward(curValidset);
+      auto eds = dm->forward(curValidset, ntwrk);
       FL_LOG_MASTER(INFO) << "[Beam-search decoder]   * DM: decode";
       std::vector<double> lmweights;
       for (double lmweight = FLAGS_lmweight_low;
@@ -784,35 +1032,35 @@ int main(int argc, char** argv) {
            lmweight += FLAGS_lmweight_step) {
         lmweights.push_back(lmweight);
       }
-      std::vector<std::vector<int64_t>> wordEditDst(lmweights.size());
-      std::vector<std::thread> threads;
-      for (int i = 0; i < lmweights.size(); i++) {
-        threads.push_back(
-            std::thread([&lmweights, &wordEditDst, dm, eds, &lexicon, i]() {
-              double lmweight = lmweights[i];
-              DecodeMasterLexiconOptions opt = {
-                  .beamSize = FLAGS_beamsize,
-                  .beamSizeToken = FLAGS_beamsizetoken,
-                  .beamThreshold = FLAGS_beamthreshold,
-                  .lmWeight = lmweight,
-                  .silScore = FLAGS_silscore,
-                  .wordScore = FLAGS_wordscore,
-                  .unkScore = FLAGS_unkscore,
-                  .logAdd = FLAGS_logadd,
-                  .silToken = FLAGS_wordseparator,
-                  .blankToken = kBlankToken,
-                  .unkToken = fl::lib::text::kUnkToken,
-                  .smearMode =
-                      (FLAGS_smearing == "max"
-                           ? fl::lib::text::SmearingMode::MAX
-                           : fl::lib::text::SmearingMode::NONE)};
-              auto pds = dm->decode(eds, lexicon, opt);
-              // return token distance and word distance stats
-              wordEditDst[i] = dm->computeMetrics(pds).second;
-            }));
+      auto smearMode =
+          (FLAGS_smearing == "max" ? fl::lib::text::SmearingMode::MAX
+                                   : fl::lib::text::SmearingMode::NONE);
+      std::vector<DecodeMasterLexiconOptions> opts;
+      for (double lmweight : lmweights) {
+        opts.push_back(
+            {.beamSize = FLAGS_beamsize,
+             .beamSizeToken = FLAGS_beamsizetoken,
+             .beamThreshold = FLAGS_beamthreshold,
+             .lmWeight = lmweight,
+             .silScore = FLAGS_silscore,
+             .wordScore = FLAGS_wordscore,
+             .unkScore = FLAGS_unkscore,
+             .logAdd = FLAGS_logadd,
+             .silToken = FLAGS_wordseparator,
+             .blankToken = kBlankToken,
+             .unkToken = fl::lib::text::kUnkToken,
+             .smearMode = smearMode});
       }
-      for (auto& thread : threads) {
-        thread.join();
+      // All the lmweights are decoded from one emission pass, sharing the
+      // lexicon and the LM states
+      std::vector<std::shared_ptr<fl::Dataset>> pdss;
+      if (!opts.empty()) {
+        pdss = dm->decode(eds, lexicon, opts);
+      }
+      std::vector<std::vector<int64_t>> wordEditDst;
+      for (const auto& pds : pdss) {
+        // return token distance and word distance stats
+        wordEditDst.push_back(dm->computeMetrics(pds).second);
       }
       dmErr = DBL_MAX;
       for (int i = 0; i < lmweights.size(); i++) {
@@ -859,7 +1107,119 @@ int main(int argc, char** argv) {
       }
       auto loss = crit->forward(critArgs).front();
       mtrs.loss.add(loss.array());
-      evalOutput(output.array(), batch[kTargetIdx], batch[kDurationIdx], mtrs);
+      evalOutput(
+          crit, output.array(), batch[kTargetIdx], batch[kDurationIdx], mtrs);
+    }
+  };
+
+  // With '--async_valid', a copy of the models is validated in the background
+  // while training continues, and the results are reported when it finishes:
+  // at the latest at the next validation
+  struct AsyncValidation {
+    std::future<void> done;
+    // Meters of the reported updates, with the validation results
+    TrainMeters meters;
+    std::unordered_map<std::string, double> werWithDecoder;
+    int64_t epoch;
+    int64_t updates;
+    double lr;
+    double lrcrit;
+    double scaleFactor;
+    // Snapshot of the models, saved again if they are the best ones
+    std::shared_ptr<const std::string> checkpoint;
+  };
+  std::unique_ptr<AsyncValidation> pendingValidation;
+  if (FLAGS_async_valid && dm && FLAGS_enable_distributed) {
+    // The decoder reduces its results across processes
+    LOG(FATAL) << "'--async_valid' doesn't support decoding with '--lm' "
+                  "in distributed training";
+  }
+  auto startValidation = [&](std::shared_ptr<fl::Module> ntwrk,
+                             std::shared_ptr<SequenceCriterion> crit,
+                             int64_t epoch,
+                             int64_t updates,
+                             double lr,
+                             double lrcrit,
+                             double saveScaleFactor) {
+    auto validation = std::make_unique<AsyncValidation>();
+    validation->epoch = epoch;
+    validation->updates = updates;
+    validation->lr = lr;
+    validation->lrcrit = lrcrit;
+    validation->scaleFactor = saveScaleFactor;
+    // The last models are saved right away
+    if (isMaster) {
+      validation->checkpoint = snapshotModels(epoch, updates, saveScaleFactor);
+      checkpointer.write(lastModelFiles(epoch), validation->checkpoint);
+      logMemoryStats();
+    }
+    std::ostringstream models;
+    fl::save(models, ntwrk, crit);
+
+    validation->meters = std::move(meters);
+    meters = TrainMeters();
+    for (const auto& v : validation->meters.valid) {
+      meters.valid[v.first] = DatasetMeters();
+    }
+    validation->werWithDecoder = validWerWithDecoder;
+
+    auto* v = validation.get();
+    int device = af::getDevice();
+    v->done = std::async(
+        std::launch::async,
+        [&test, &validds, v, device, models = models.str()]() {
+          af::setDevice(device);
+          std::shared_ptr<fl::Module> validNtwrk;
+          std::shared_ptr<SequenceCriterion> validCrit;
+          {
+            std::istringstream stream(models);
+            fl::load(stream, validNtwrk, validCrit);
+          }
+          for (auto& vds : validds) {
+            double decodedWer;
+            test(
+                validNtwrk,
+                validCrit,
+                vds.second,
+                v->meters.valid[vds.first],
+                decodedWer);
+            if (v->werWithDecoder.find(vds.first) != v->werWithDecoder.end()) {
+              v->werWithDecoder[vds.first] = decodedWer;
+            }
+          }
+        });
+    pendingValidation = std::move(validation);
+  };
+  // Waits for the pending validation and reports it
+  auto finishValidation = [&]() {
+    if (!pendingValidation) {
+      return;
+    }
+    auto validation = std::move(pendingValidation);
+    validation->done.get();
+    try {
+      logStatus(
+          validation->meters,
+          validation->werWithDecoder,
+          validation->epoch,
+          validation->updates,
+          validation->lr,
+          validation->lrcrit,
+          validation->scaleFactor);
+    } catch (const std::exception& ex) {
+      LOG(ERROR) << "Error while writing logs: " << ex.what();
+    }
+    validWerWithDecoder = validation->werWithDecoder;
+    if (isMaster) {
+      auto filenames =
+          bestModelFiles(validation->meters, validation->werWithDecoder);
+      try {
+        if (!filenames.empty()) {
+          checkpointer.write(filenames, validation->checkpoint);
+        }
+      } catch (const std::exception& ex) {
+        LOG(FATAL) << "Error while saving models: " << ex.what();
+      }
     }
   };
 
@@ -878,7 +1238,8 @@ int main(int argc, char** argv) {
         FLAGS_train,
         unsupDataDir,
         FLAGS_batching_strategy,
-        FLAGS_batching_max_duration);
+        FLAGS_batching_max_duration,
+        FLAGS_batching_num_buckets);
   }
 
   auto train = [&meters,
@@ -886,14 +1247,21 @@ int main(int argc, char** argv) {
                 &test,
                 &logStatus,
                 &saveModels,
+                &startValidation,
+                &finishValidation,
+                &pendingValidation,
                 &evalOutput,
                 &validds,
                 &curEpoch,
                 &startUpdate,
+                &startDataState,
+                &config,
                 &scaleFactor,
                 &plGenerator,
                 &usePlugin,
                 &isSeq2seqCrit,
+                &traceFile,
+                balancer,
                 reducer](
                    std::shared_ptr<fl::Module> ntwrk,
                    std::shared_ptr<SequenceCriterion> crit,
@@ -904,7 +1272,38 @@ int main(int argc, char** argv) {
                    double initcritlr,
                    bool clampCrit,
                    int64_t nbatches) {
-    if (reducer) {
+    // With '--distributed_pipelined_optimizer' (or continued from such a
+    // run), the optimizers reduce the gradients themselves
+    auto netPipelined =
+        std::dynamic_pointer_cast<fl::PipelinedOptimizer>(netopt);
+    auto critPipelined =
+        std::dynamic_pointer_cast<fl::PipelinedOptimizer>(critopt);
+    const bool pipelined = netPipelined || critPipelined;
+    if (pipelined &&
+        (FLAGS_fl_amp_use_mixed_precision || FLAGS_maxgradnorm > 0 ||
+         FLAGS_accumulate_batches > 1 ||
+         FLAGS_distributed_local_sgd_period > 0 ||
+         !FLAGS_distributed_compression.empty())) {
+      LOG(FATAL) << "The pipelined optimizer doesn't support mixed precision, "
+                 << "maxgradnorm, accumulate_batches, local SGD or "
+                 << "compression";
+    }
+    if (netPipelined) {
+      netPipelined->registerGradHooks();
+    }
+    if (critPipelined) {
+      critPipelined->registerGradHooks();
+    }
+    // Applies the updates still pending, before the parameters are read
+    auto awaitUpdates = [netPipelined, critPipelined]() {
+      if (netPipelined) {
+        netPipelined->awaitAll();
+      }
+      if (critPipelined) {
+        critPipelined->awaitAll();
+      }
+    };
+    if (reducer && !pipelined) {
       fl::distributeModuleGrads(ntwrk, reducer);
       fl::distributeModuleGrads(crit, reducer);
     }
@@ -938,8 +1337,28 @@ int main(int argc, char** argv) {
       }
     }
 
-    fl::allReduceParameters(ntwrk);
-    fl::allReduceParameters(crit);
+    fl::broadcastParameters(ntwrk);
+    fl::broadcastParameters(crit);
+
+    // With '--distributed_local_sgd_period', the processes update their
+    // parameters independently, and average them periodically
+    std::unique_ptr<fl::ModelAverager> averager;
+    if (reducer && FLAGS_distributed_local_sgd_period > 0) {
+      auto averaged = ntwrk->params();
+      auto critParams = crit->params();
+      averaged.insert(averaged.end(), critParams.begin(), critParams.end());
+      std::vector<std::shared_ptr<fl::FirstOrderOptimizer>> optimizers;
+      if (FLAGS_distributed_local_sgd_optim_state) {
+        optimizers = {netopt, critopt};
+      }
+      averager = std::make_unique<fl::ModelAverager>(
+          averaged,
+          FLAGS_distributed_local_sgd_period,
+          FLAGS_distributed_local_sgd_warmup,
+          FLAGS_distributed_local_sgd_momentum,
+          FLAGS_distributed_local_sgd_lr,
+          optimizers);
+    }
 
     auto resetTimeStatMeters = [&meters]() {
       meters.runtime.reset();
@@ -950,6 +1369,8 @@ int main(int argc, char** argv) {
       meters.bwdtimer.reset();
       meters.optimtimer.reset();
       meters.timer.reset();
+      meters.steplatency.reset();
+      meters.samplelatency.reset();
     };
     auto runValAndSaveModel = [&](int64_t totalEpochs,
                                   int64_t totalUpdates,
@@ -964,33 +1385,63 @@ int main(int argc, char** argv) {
       meters.bwdtimer.stop();
       meters.optimtimer.stop();
 
-      // valid
-      for (auto& vds : validds) {
-        double decodedWer;
-        test(ntwrk, crit, vds.second, meters.valid[vds.first], decodedWer);
-        if (validWerWithDecoder.find(vds.first) != validWerWithDecoder.end()) {
-          validWerWithDecoder[vds.first] = decodedWer;
-        }
+      // The average of the models of the processes is validated and saved
+      if (averager && averager->isLocal(totalUpdates)) {
+        averager->average();
       }
 
-      // print status
-      try {
-        logStatus(
-            meters,
-            validWerWithDecoder,
-            totalEpochs,
-            totalUpdates,
-            lr,
-            lrcrit,
-            saveScaleFactor);
-      } catch (const std::exception& ex) {
-        LOG(ERROR) << "Error while writing logs: " << ex.what();
+      if (FLAGS_async_valid) {
+        finishValidation();
+        try {
+          startValidation(
+              ntwrk,
+              crit,
+              totalEpochs,
+              totalUpdates,
+              lr,
+              lrcrit,
+              saveScaleFactor);
+        } catch (const std::exception& ex) {
+          LOG(FATAL) << "Error while saving models: " << ex.what();
+        }
+      } else {
+        // valid
+        for (auto& vds : validds) {
+          double decodedWer;
+          test(ntwrk, crit, vds.second, meters.valid[vds.first], decodedWer);
+          if (validWerWithDecoder.find(vds.first) !=
+              validWerWithDecoder.end()) {
+            validWerWithDecoder[vds.first] = decodedWer;
+          }
+        }
+
+        // print status
+        try {
+          logStatus(
+              meters,
+              validWerWithDecoder,
+              totalEpochs,
+              totalUpdates,
+              lr,
+              lrcrit,
+              saveScaleFactor);
+        } catch (const std::exception& ex) {
+          LOG(ERROR) << "Error while writing logs: " << ex.what();
+        }
+        // save last and best models
+        try {
+          saveModels(totalEpochs, totalUpdates, saveScaleFactor);
+        } catch (const std::exception& ex) {
+          LOG(FATAL) << "Error while saving models: " << ex.what();
+        }
       }
-      // save last and best models
-      try {
-        saveModels(totalEpochs, totalUpdates, saveScaleFactor);
-      } catch (const std::exception& ex) {
-        LOG(FATAL) << "Error while saving models: " << ex.what();
+      // Latest scopes of each thread
+      if (!traceFile.empty()) {
+        try {
+          fl::Tracer::dump(traceFile);
+        } catch (const std::exception& ex) {
+          LOG(ERROR) << "Error while writing the trace: " << ex.what();
+        }
       }
       // reset meters for next readings
       meters.train.loss.reset();
@@ -1002,11 +1453,43 @@ int main(int argc, char** argv) {
     auto critparams = crit->params();
     params.insert(params.end(), critparams.begin(), critparams.end());
 
+    // Counts the updates: with '--accumulate_batches', the gradients of
+    // several batches are summed before each update
     int64_t curBatch = startUpdate;
-    unsigned int kScaleFactorUpdateInterval =
-        FLAGS_fl_amp_scale_factor_update_interval;
-    unsigned int kMaxScaleFactor = FLAGS_fl_amp_max_scale_factor;
-    unsigned short scaleCounter = 1;
+    const int64_t accumulateBatches =
+        std::max<int64_t>(1, FLAGS_accumulate_batches);
+    // Only used with mixed precision
+    fl::DynamicScaler scaler(
+        scaleFactor,
+        std::max<double>(scaleFactor, FLAGS_fl_amp_max_scale_factor),
+        std::max<unsigned int>(1, FLAGS_fl_amp_scale_factor_update_interval));
+    auto& metrics = fl::MetricsRegistry::global();
+    auto& samplesMetric =
+        metrics.counter("fl_train_samples_total", "Samples trained on");
+    auto& audioMetric = metrics.counter(
+        "fl_train_audio_seconds_total", "Seconds of audio trained on");
+    auto& framesMetric = metrics.counter(
+        "fl_train_input_frames_total",
+        "Input frames trained on, padding included");
+    auto& updatesMetric =
+        metrics.counter("fl_train_updates_total", "Updates of the models");
+    auto& updateTimeMetric = metrics.histogram(
+        "fl_train_update_seconds",
+        "Time of the updates, from the end of the previous one");
+    auto& oomMetric = metrics.counter(
+        "fl_train_oom_total",
+        "Batch parts out of device memory, retried in smaller parts");
+    auto lastUpdate = std::chrono::steady_clock::now();
+    // Resumes the epoch of a model saved mid-epoch from its next batch,
+    // without reading the batches before
+    bool resumeEpoch = !startDataState.empty();
+    fl::PrefetchDataset::State resumeState;
+    if (resumeEpoch) {
+      std::istringstream stateStream(startDataState);
+      fl::load(stateStream, resumeState);
+      startDataState.clear();
+      --curEpoch;
+    }
     while (curBatch < nbatches) {
       ++curEpoch; // counts partial epochs too!
       int64_t epochsAfterDecay = curEpoch - FLAGS_lr_decay;
@@ -1021,34 +1504,194 @@ int main(int argc, char** argv) {
       }
       std::hash<std::string> hasher;
       FL_LOG_MASTER(INFO) << "Shuffling trainset";
+      if (auto bucketed =
+              std::dynamic_pointer_cast<fl::BucketBatchDataset>(trainset)) {
+        // Same seed on all the processes, so that batches stay aligned
+        bucketed->setSeed(curEpoch);
+        if (balancer) {
+          auto weights = balancer->rebalance();
+          std::ostringstream weightsStr;
+          for (auto weight : weights) {
+            weightsStr << " " << weight;
+          }
+          FL_LOG_MASTER(INFO) << "Batch weights of the processes:"
+                              << weightsStr.str();
+          bucketed->setPartitionWeights(std::move(weights));
+        }
+        bucketed->resample();
+      }
       auto curTrainset = loadPrefetchDataset(
-          trainset, FLAGS_nthread, true /* shuffle */, curEpoch /* seed */);
+          trainset,
+          FLAGS_nthread,
+          true /* shuffle */,
+          curEpoch /* seed */,
+          FLAGS_prefetch_reorder_window);
       af::sync();
       meters.sampletimer.resume();
       meters.runtime.resume();
       meters.timer.resume();
+      lastUpdate = std::chrono::steady_clock::now();
       FL_LOG_MASTER(INFO) << "Epoch " << curEpoch << " started!";
-      for (auto& batch : *curTrainset) {
-        ++curBatch;
-        double lrScheduleScale;
-        if (FLAGS_lrcosine) {
-          const double pi = std::acos(-1);
-          lrScheduleScale =
-              std::cos(((double)curBatch) / ((double)nbatches) * pi / 2.0);
+      // The last update of the epoch may accumulate fewer batches
+      const int64_t epochBatches = curTrainset->size();
+      int64_t epochBatch = 0;
+      auto prefetchTrainset =
+          std::dynamic_pointer_cast<fl::PrefetchDataset>(curTrainset);
+      if (resumeEpoch) {
+        if (prefetchTrainset) {
+          prefetchTrainset->setState(resumeState);
+        }
+        epochBatch = resumeState.cursor;
+        resumeEpoch = false;
+        FL_LOG_MASTER(INFO) << "Resuming epoch at batch " << epochBatch;
+      }
+      int64_t microBatch = 0;
+      // Summed over the accumulated batches
+      float accumulatedBatchSize = 0;
+      // Forward and backward of (a part of) a batch, scaled for mixed
+      // precision. Returns the unscaled loss summed over the samples; sets
+      // `inBackward` once the forward is done, for out of memory errors.
+      auto forwardBackward = [&](const std::vector<af::array>& part,
+                                 double stepScaleFactor,
+                                 bool eval,
+                                 bool synchronize,
+                                 bool& inBackward) {
+        inBackward = false;
+        // forward
+        meters.fwdtimer.resume();
+        auto fwdStart = std::chrono::steady_clock::now();
+        auto input = fl::input(part[kInputIdx]);
+        if (FLAGS_saug_start_update >= 0 &&
+            curBatch >= FLAGS_saug_start_update) {
+          input =
+              saug->forward({input, fl::noGrad(part[kDurationIdx])}).front();
+        }
+        fl::Variable output;
+        if (usePlugin) {
+          if (netPipelined) {
+            netPipelined->awaitAll();
+          }
+          output =
+              ntwrk->forward({input, fl::noGrad(part[kDurationIdx])}).front();
         } else {
-          lrScheduleScale =
-              std::pow(FLAGS_gamma, (double)curBatch / (double)FLAGS_stepsize);
+          // The pending updates of each module are applied as the forward
+          // reaches it
+          fl::ModuleForwardHook prevHook;
+          if (netPipelined) {
+            prevHook =
+                fl::setModuleForwardHook(fl::awaitModuleParams(*netPipelined));
+          }
+          output = fl::ext::forwardSequentialModuleWithPadMask(
+              input, ntwrk, part[kDurationIdx]);
+          if (netPipelined) {
+            fl::setModuleForwardHook(prevHook);
+            netPipelined->awaitAll();
+          }
+        }
+        if (critPipelined) {
+          critPipelined->awaitAll();
+        }
+        meters.critfwdtimer.resume();
+        std::vector<fl::Variable> critArgs = {
+            output, fl::Variable(part[kTargetIdx], false)};
+        if (isSeq2seqCrit) {
+          critArgs.push_back(fl::Variable(part[kDurationIdx], false));
+          critArgs.push_back(fl::Variable(part[kTargetSizeIdx], false));
+        }
+        auto loss = crit->forward(critArgs).front();
+        if (balancer) {
+          // The forward pass has no communication: its time measures the
+          // speed of the process alone
+          af::sync();
+          balancer->add(
+              part[kInputIdx].dims(0) * part[kInputIdx].dims(3),
+              std::chrono::duration<double>(
+                  std::chrono::steady_clock::now() - fwdStart)
+                  .count());
+        }
+        meters.fwdtimer.stopAndIncUnit();
+        meters.critfwdtimer.stopAndIncUnit();
+
+        if (FLAGS_fl_amp_use_mixed_precision) {
+          loss = scaler.scale(loss);
+        }
+
+        if (af::anyTrue<bool>(af::isNaN(loss.array())) ||
+            af::anyTrue<bool>(af::isInf(loss.array()))) {
+          LOG(FATAL) << "Loss has NaN values. Samples - "
+                     << join(",", readSampleIds(part[kSampleIdx]));
+        }
+
+        // backward
+        // The loss is summed over the samples, so the gradients of the
+        // batches add up until they are scaled down by the total batch size
+        inBackward = true;
+        meters.bwdtimer.resume();
+        if (pipelined) {
+          // Reduced in the backward, before the buckets
+          auto count = af::constant(part[kInputIdx].dims(3), 1, f32);
+          if (netPipelined) {
+            netPipelined->setGradNormalizer(count);
+          }
+          if (critPipelined) {
+            critPipelined->setGradNormalizer(count);
+          }
+        } else if (reducer) {
+          reducer->setSynchronize(synchronize);
+        }
+        loss.backward();
+        if (reducer && !pipelined) {
+          reducer->finalize();
+        }
+        meters.bwdtimer.stopAndIncUnit();
+        // After the backward, which may run out of memory and be retried
+        if (eval) {
+          evalOutput(
+              crit,
+              output.array(),
+              part[kTargetIdx],
+              part[kDurationIdx],
+              meters.train);
+        }
+        return (loss / stepScaleFactor).array();
+      };
+      while (epochBatch < epochBatches) {
+        auto fetchStart = std::chrono::steady_clock::now();
+        auto batch = curTrainset->get(epochBatch);
+        std::chrono::duration<double> fetchTime =
+            std::chrono::steady_clock::now() - fetchStart;
+        meters.samplelatency.add(fetchTime.count());
+        FL_TRACE(USER, "step");
+        ++epochBatch;
+        const bool firstMicroBatch = microBatch == 0;
+        const bool lastMicroBatch = microBatch + 1 == accumulateBatches ||
+            epochBatch == epochBatches;
+        if (firstMicroBatch) {
+          ++curBatch;
+          double lrScheduleScale;
+          if (FLAGS_lrcosine) {
+            const double pi = std::acos(-1);
+            lrScheduleScale =
+                std::cos(((double)curBatch) / ((double)nbatches) * pi / 2.0);
+          } else {
+            lrScheduleScale = std::pow(
+                FLAGS_gamma, (double)curBatch / (double)FLAGS_stepsize);
+          }
+          netopt->setLr(
+              initlr * lrDecayScale * lrScheduleScale *
+              std::min(curBatch / double(FLAGS_warmup), 1.0));
+          critopt->setLr(
+              initcritlr * lrDecayScale * lrScheduleScale *
+              std::min(curBatch / double(FLAGS_warmup), 1.0));
         }
-        netopt->setLr(
-            initlr * lrDecayScale * lrScheduleScale *
-            std::min(curBatch / double(FLAGS_warmup), 1.0));
-        critopt->setLr(
-            initcritlr * lrDecayScale * lrScheduleScale *
-            std::min(curBatch / double(FLAGS_warmup), 1.0));
-        af::sync();
         meters.timer.incUnit();
         meters.sampletimer.stopAndIncUnit();
+        // Durations are in ms
+        auto audioMs = meters.stats.value()[0];
         meters.stats.add(batch[kDurationIdx], batch[kTargetSizeIdx]);
+        audioMetric.add((meters.stats.value()[0] - audioMs) / 1000.);
+        samplesMetric.add(batch[kInputIdx].dims(3));
+        framesMetric.add(batch[kInputIdx].dims(0) * batch[kInputIdx].dims(3));
         if (af::anyTrue<bool>(af::isNaN(batch[kInputIdx])) ||
             af::anyTrue<bool>(af::isNaN(batch[kTargetIdx]))) {
           LOG(FATAL) << "Sample has NaN values - "
@@ -1056,167 +1699,217 @@ int main(int argc, char** argv) {
         }
 
         // Ensure no samples are skipped while adjusting the loss scale factor.
-        // When gradient values are Inf/NaN, the model update is skipped and the
-        // scale factor is adjusted accordingly for determinism.
+        // When gradient values are Inf/NaN, the sample is retried with a
+        // smaller scale factor for determinism. The earlier batches of an
+        // accumulated update can't be replayed: the update is skipped instead.
         // The AMP algorithm implemented here mirrors:
         // - https://arxiv.org/abs/1710.03740
         // - https://bit.ly/35F5GqX
         // - https://bit.ly/3mn2qr0
+        accumulatedBatchSize += batch[kInputIdx].dims(3);
         bool retrySample = false;
+        bool skipUpdate = false;
+        int64_t partSize = batch[kInputIdx].dims(3);
         do {
           retrySample = false;
-          // forward
-          meters.fwdtimer.resume();
-          auto input = fl::input(batch[kInputIdx]);
-          if (FLAGS_saug_start_update >= 0 &&
-              curBatch >= FLAGS_saug_start_update) {
-            input = saug->forward({input}).front();
-          }
-          fl::Variable output;
-          if (usePlugin) {
-            output = ntwrk->forward({input, fl::noGrad(batch[kDurationIdx])})
-                         .front();
-          } else {
-            output = fl::ext::forwardSequentialModuleWithPadMask(
-                input, ntwrk, batch[kDurationIdx]);
-          }
-          af::sync();
-          meters.critfwdtimer.resume();
-          std::vector<fl::Variable> critArgs = {
-              output, fl::Variable(batch[kTargetIdx], false)};
-          if (isSeq2seqCrit) {
-            critArgs.push_back(fl::Variable(batch[kDurationIdx], false));
-            critArgs.push_back(fl::Variable(batch[kTargetSizeIdx], false));
-          }
-          auto loss = crit->forward(critArgs).front();
-          af::sync();
-          meters.fwdtimer.stopAndIncUnit();
-          meters.critfwdtimer.stopAndIncUnit();
-
+          double stepScaleFactor = 1.;
           if (FLAGS_fl_amp_use_mixed_precision) {
-            ++scaleCounter;
-            loss = loss * scaleFactor;
+            stepScaleFactor = scaler.getScaleFactor();
           }
-
-          if (af::anyTrue<bool>(af::isNaN(loss.array())) ||
-              af::anyTrue<bool>(af::isInf(loss.array()))) {
-            LOG(FATAL) << "Loss has NaN values. Samples - "
-                       << join(",", readSampleIds(batch[kSampleIdx]));
+          if (firstMicroBatch) {
+            netopt->zeroGrad();
+            critopt->zeroGrad();
           }
-
-          if (hasher(join(",", readSampleIds(batch[kSampleIdx]))) % 100 <=
-              FLAGS_pcttraineval) {
-            evalOutput(
-                output.array(),
-                batch[kTargetIdx],
-                batch[kDurationIdx],
-                meters.train);
+          const bool localUpdate = averager && averager->isLocal(curBatch);
+          const bool synchronize = lastMicroBatch && !localUpdate;
+          const bool eval =
+              hasher(join(",", readSampleIds(batch[kSampleIdx]))) % 100 <=
+              FLAGS_pcttraineval;
+
+          // The batch runs in parts of at most `partSize` samples, halved
+          // when a part runs out of device memory
+          const int64_t batchSize = batch[kInputIdx].dims(3);
+          std::deque<std::pair<int64_t, int64_t>> parts;
+          for (int64_t begin = 0; begin < batchSize; begin += partSize) {
+            parts.emplace_back(begin, std::min(begin + partSize, batchSize));
           }
-
-          // backward
-          meters.bwdtimer.resume();
-          netopt->zeroGrad();
-          critopt->zeroGrad();
-          loss.backward();
-          if (reducer) {
-            reducer->finalize();
+          af::array loss;
+          bool hasGrads = !firstMicroBatch;
+          while (!parts.empty()) {
+            auto range = parts.front();
+            bool inBackward = false;
+            try {
+              // Only the last part synchronizes the gradients
+              auto partLoss = forwardBackward(
+                  range.first == 0 && range.second == batchSize
+                      ? batch
+                      : sliceBatch(batch, range.first, range.second),
+                  stepScaleFactor,
+                  eval,
+                  synchronize && parts.size() == 1,
+                  inBackward);
+              loss = loss.isempty() ? partLoss : loss + partLoss;
+              hasGrads = true;
+              parts.pop_front();
+            } catch (const af::exception& ex) {
+              if (ex.err() != AF_ERR_NO_MEM) {
+                throw;
+              }
+              meters.fwdtimer.stop();
+              meters.critfwdtimer.stop();
+              meters.bwdtimer.stop();
+              auto sampleIds = readSampleIds(
+                  sliceBatch(batch, range.first, range.second)[kSampleIdx]);
+              // A failed backward leaves some gradients accumulated. Other
+              // processes may wait for the synchronization of the gradients.
+              // The pipelined optimizers reduce the gradients of each backward.
+              if (range.second - range.first == 1 ||
+                  (inBackward && hasGrads) ||
+                  (inBackward && synchronize && parts.size() == 1 &&
+                   reducer) ||
+                  pipelined) {
+                LOG(ERROR) << "Out of device memory, can't recover. Samples - "
+                           << join(",", sampleIds);
+                throw;
+              }
+              if (inBackward) {
+                netopt->zeroGrad();
+                critopt->zeroGrad();
+              }
+              // The graph of the part is freed: release the cache
+              af::deviceGC();
+              const int64_t half = (range.second - range.first + 1) / 2;
+              partSize = std::min(partSize, half);
+              parts.pop_front();
+              parts.emplace_front(range.first + half, range.second);
+              parts.emplace_front(range.first, range.first + half);
+              oomMetric.add();
+              LOG(WARNING) << "Out of device memory in the "
+                           << (inBackward ? "backward" : "forward")
+                           << " of " << sampleIds.size()
+                           << " samples, retrying in parts of " << half
+                           << ". Samples - " << join(",", sampleIds);
+            }
+          }
+          if (!lastMicroBatch) {
+            meters.train.loss.add(loss);
+            break;
           }
-          af::sync();
-          meters.bwdtimer.stopAndIncUnit();
 
           // optimizer
           meters.optimtimer.resume();
 
-          // scale down gradients by batchsize * scale factor
+          // scale down gradients by batchsize * scale factor, which the
+          // pipelined optimizers do with the reduced gradients
+          if (pipelined) {
+            meters.train.loss.add(loss);
+            break;
+          }
           af::array totalBatchSizeArr =
-              af::constant(batch[kInputIdx].dims(3), 1, f32);
-          if (reducer) {
+              af::constant(accumulatedBatchSize, 1, f32);
+          if (reducer && !localUpdate) {
             fl::allReduce(totalBatchSizeArr);
           }
           float totalBatchSize = totalBatchSizeArr.scalar<float>();
-          for (const auto& p : params) {
-            if (!p.isGradAvailable()) {
+          if (FLAGS_fl_amp_use_mixed_precision) {
+            // Unscaled and checked for Inf/NaN values with one
+            // synchronization; the scale factor is adjusted by the scaler
+            retrySample = !scaler.unscale(params, totalBatchSize);
+            scaleFactor = scaler.getScaleFactor();
+            if (retrySample) {
+              FL_VLOG(2) << "AMP: Scale factor decreased. New value:\t"
+                         << scaleFactor;
+              meters.optimtimer.stop();
+              if (!firstMicroBatch) {
+                retrySample = false;
+                skipUpdate = true;
+              }
               continue;
             }
-            p.grad() = p.grad() / (totalBatchSize * scaleFactor);
-            if (FLAGS_fl_amp_use_mixed_precision) {
-              if (af::anyTrue<bool>(af::isNaN(p.grad().array())) ||
-                  af::anyTrue<bool>(af::isInf(p.grad().array()))) {
-                if (scaleFactor >= fl::kAmpMinimumScaleFactorValue) {
-                  scaleFactor = scaleFactor / 2.0f;
-                  FL_VLOG(2) << "AMP: Scale factor decreased. New value:\t"
-                             << scaleFactor;
-                  retrySample = true;
-                } else {
-                  LOG(FATAL)
-                      << "Minimum loss scale reached: "
-                      << fl::kAmpMinimumScaleFactorValue
-                      << " with over/underflowing gradients. Lowering the "
-                      << "learning rate, using gradient clipping, or "
-                      << "increasing the batch size can help resolve "
-                      << "loss explosion.";
-                }
-                scaleCounter = 1;
-                break;
+          } else {
+            for (const auto& p : params) {
+              if (!p.isGradAvailable()) {
+                continue;
               }
+              p.grad() = p.grad() / totalBatchSize;
             }
           }
-          if (retrySample) {
-            meters.optimtimer.stop();
-            continue;
-          }
 
-          meters.train.loss.add((loss / scaleFactor).array());
+          meters.train.loss.add(loss);
         } while (retrySample);
-
-        // clamp gradients
-        if (FLAGS_maxgradnorm > 0) {
-          if (clampCrit) {
-            fl::clipGradNorm(params, FLAGS_maxgradnorm);
-          } else {
-            fl::clipGradNorm(ntwrk->params(), FLAGS_maxgradnorm);
-          }
+        if (!lastMicroBatch) {
+          ++microBatch;
+          meters.sampletimer.resume();
+          continue;
         }
-
-        // update weights
-        critopt->step();
-        netopt->step();
-        af::sync();
-        meters.optimtimer.stopAndIncUnit();
-
-        // update scale factor
-        if (FLAGS_fl_amp_use_mixed_precision && scaleFactor < kMaxScaleFactor) {
-          if (scaleCounter % kScaleFactorUpdateInterval == 0) {
-            scaleFactor *= 2;
-            FL_VLOG(2) << "AMP: Scale factor doubled. New value:\t"
-                       << scaleFactor;
-          } else {
-            scaleFactor += 2;
-            FL_VLOG(3) << "AMP: Scale factor incremented. New value\t"
-                       << scaleFactor;
+        microBatch = 0;
+        accumulatedBatchSize = 0;
+        if (!skipUpdate) {
+          // clamp gradients
+          if (FLAGS_maxgradnorm > 0) {
+            if (clampCrit) {
+              fl::clipGradNormAsync(params, FLAGS_maxgradnorm);
+            } else {
+              fl::clipGradNormAsync(ntwrk->params(), FLAGS_maxgradnorm);
+            }
           }
+
+          // update weights
+          critopt->step();
+          netopt->step();
+          meters.optimtimer.stopAndIncUnit();
         }
+        if (averager) {
+          averager->step(curBatch);
+        }
+        auto updateEnd = std::chrono::steady_clock::now();
+        std::chrono::duration<double> updateTime = updateEnd - lastUpdate;
+        updateTimeMetric.observe(updateTime.count());
+        meters.steplatency.add(updateTime.count());
+        lastUpdate = updateEnd;
+        updatesMetric.add();
 
         meters.sampletimer.resume();
 
+        // Processes must report at the same updates: they do at the next
+        // validation in distributed training
+        if (pendingValidation && !reducer &&
+            pendingValidation->done.wait_for(std::chrono::seconds(0)) ==
+                std::future_status::ready) {
+          finishValidation();
+        }
         if (FLAGS_reportiters > 0 && curBatch % FLAGS_reportiters == 0) {
+          // Continuing from the model resumes the epoch
+          fl::PrefetchDataset::State dataState;
+          if (prefetchTrainset) {
+            dataState = prefetchTrainset->getState();
+          } else {
+            dataState.cursor = dataState.nextFetch = epochBatch;
+          }
+          std::ostringstream stateStream;
+          fl::save(stateStream, dataState);
+          config[kDataState] = stateStream.str();
+          awaitUpdates();
           runValAndSaveModel(
               curEpoch,
               curBatch,
               netopt->getLr(),
               critopt->getLr(),
               scaleFactor);
+          config.erase(kDataState);
           resetTimeStatMeters();
           ntwrk->train();
           crit->train();
           meters.sampletimer.resume();
           meters.runtime.resume();
           meters.timer.resume();
+          lastUpdate = std::chrono::steady_clock::now();
         }
         if (curBatch > nbatches) {
           break;
         }
       }
+      awaitUpdates();
       af::sync();
       if (FLAGS_reportiters == 0) {
         runValAndSaveModel(
@@ -1226,13 +1919,18 @@ int main(int argc, char** argv) {
       // Try regenerate PL
       auto newUnsupDataDir =
           plGenerator.regeneratePl(curEpoch, ntwrk, crit, usePlugin);
+      // Or pick up the PL shards generated in the background since
+      if (newUnsupDataDir.empty()) {
+        newUnsupDataDir = plGenerator.pendingPl();
+      }
       if (!newUnsupDataDir.empty()) {
         trainset = plGenerator.createTrainSet(
             FLAGS_datadir,
             FLAGS_train,
             newUnsupDataDir,
             FLAGS_batching_strategy,
-            FLAGS_batching_max_duration);
+            FLAGS_batching_max_duration,
+            FLAGS_batching_num_buckets);
       }
     }
   };
@@ -1289,6 +1987,7 @@ int main(int argc, char** argv) {
       FLAGS_lrcrit,
       true /* clampCrit */,
       FLAGS_iter);
+  finishValidation();
 
   FL_LOG_MASTER(INFO) << "Finished training";
   return 0;
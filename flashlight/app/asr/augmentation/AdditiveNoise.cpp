@@ -60,6 +60,13 @@ AdditiveNoise::AdditiveNoise(
 }
 
 void AdditiveNoise::apply(std::vector<float>& signal) {
+  std::vector<float> scratch;
+  apply(signal, scratch);
+}
+
+void AdditiveNoise::apply(
+    std::vector<float>& signal,
+    std::vector<float>& scratch) {
   if (rng_.random() >= conf_.proba_) {
     return;
   }
@@ -73,14 +80,26 @@ void AdditiveNoise::apply(std::vector<float>& signal) {
   // overflow implies we start at the beginning again.
   int augEnd = augStart + conf_.ratio_ * signal.size();
 
-  std::vector<float> mixedNoise(signal.size(), 0.0f);
+  auto& mixedNoise = scratch;
+  mixedNoise.assign(signal.size(), 0.0f);
   for (int i = 0; i < nClips; ++i) {
     auto curNoiseFileIdx = rng_.randInt(0, noiseFiles_.size() - 1);
     auto curNoise = loadSound<float>(noiseFiles_[curNoiseFileIdx]);
     int shift = rng_.randInt(0, curNoise.size() - 1);
-    for (int j = augStart; j < augEnd; ++j) {
-      mixedNoise[j % mixedNoise.size()] +=
-          curNoise[(shift + j) % curNoise.size()];
+    // Add the noise by runs where neither the signal nor the noise wraps
+    for (int j = augStart; j < augEnd;) {
+      size_t dst = j % mixedNoise.size();
+      size_t src = (shift + j) % curNoise.size();
+      size_t len = std::min<size_t>(
+          {static_cast<size_t>(augEnd - j),
+           mixedNoise.size() - dst,
+           curNoise.size() - src});
+      float* out = mixedNoise.data() + dst;
+      const float* noise = curNoise.data() + src;
+      for (size_t k = 0; k < len; ++k) {
+        out[k] += noise[k];
+      }
+      j += len;
     }
   }
 
@@ -88,7 +107,7 @@ void AdditiveNoise::apply(std::vector<float>& signal) {
   if (noiseRms > 0) {
     // https://en.wikipedia.org/wiki/Signal-to-noise_ratio
     const float noiseMult = (signalRms / (noiseRms * std::pow(10, snr / 20.0)));
-    for (int i = 0; i < signal.size(); ++i) {
+    for (size_t i = 0; i < signal.size(); ++i) {
       signal[i] += mixedNoise[i] * noiseMult;
     }
   } else {
@@ -57,6 +57,7 @@ class AdditiveNoise : public SoundEffect {
       unsigned int seed = 0);
   ~AdditiveNoise() override = default;
   void apply(std::vector<float>& signal) override;
+  void apply(std::vector<float>& signal, std::vector<float>& scratch) override;
   std::string prettyString() const override;
 
  private:
@@ -23,19 +23,16 @@ ReverbEcho::ReverbEcho(
 
 void ReverbEcho::applyReverb(
     std::vector<float>& source,
+    std::vector<float>& reverb,
     float initial,
     float firstDelay,
     float rt60) {
   size_t length = source.size();
-  std::vector<float> reverb(length, 0);
+  // The echo trains are the taps of an impulse response: echos of all the
+  // trains with the same delay are added up, and the source is convolved once
+  std::vector<float> ir;
   for (int i = 0; i < conf_.repeat_; ++i) {
     float frac = 1;
-    // echo = initial * source
-    std::vector<float> echo = source;
-    std::transform(
-        echo.begin(), echo.end(), echo.begin(), [initial](float x) -> float {
-          return x * initial;
-        });
     while (frac > 1e-3) {
       // Add jitter noise for the delay
       float jitter = 1 + rng_.uniform(-conf_.jitter_, conf_.jitter_);
@@ -43,9 +40,11 @@ void ReverbEcho::applyReverb(
       if (delay > length - 1) {
         break;
       }
-      for (int j = 0; j < length - delay - 1; ++j) {
-        reverb[delay + j] += echo[j] * frac;
+      if (delay >= ir.size()) {
+        ir.resize(delay + 1, 0);
       }
+      // echo = initial * source
+      ir[delay] += initial * frac;
 
       // Add jitter noise for the attenuation
       jitter = 1 + rng_.uniform(-conf_.jitter_, conf_.jitter_);
@@ -54,12 +53,21 @@ void ReverbEcho::applyReverb(
       frac *= attenuation;
     }
   }
-  for (int i = 0; i < length; ++i) {
+  convolve(source, ir, reverb);
+  // The echos do not reach the last sample
+  for (size_t i = 0; i + 1 < length; ++i) {
     source[i] += reverb[i];
   }
 }
 
 void ReverbEcho::apply(std::vector<float>& sound) {
+  std::vector<float> scratch;
+  apply(sound, scratch);
+}
+
+void ReverbEcho::apply(
+    std::vector<float>& sound,
+    std::vector<float>& scratch) {
   if (rng_.random() >= conf_.proba_) {
     return;
   }
@@ -68,7 +76,7 @@ void ReverbEcho::apply(std::vector<float>& sound) {
   float firstDelay = rng_.uniform(conf_.firstDelayMin_, conf_.firstDelayMax_);
   float rt60 = rng_.uniform(conf_.rt60Min_, conf_.rt60Max_);
 
-  applyReverb(sound, initial, firstDelay, rt60);
+  applyReverb(sound, scratch, initial, firstDelay, rt60);
 }
 
 std::string ReverbEcho::prettyString() const {
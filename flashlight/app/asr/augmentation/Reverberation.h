@@ -81,12 +81,14 @@ class ReverbEcho : public SoundEffect {
   explicit ReverbEcho(const ReverbEcho::Config& config, unsigned int seed = 0);
   ~ReverbEcho() override = default;
   void apply(std::vector<float>& sound) override;
+  void apply(std::vector<float>& sound, std::vector<float>& scratch) override;
   std::string prettyString() const override;
 
  private:
-  // augments source with reverberation noise
+  // augments source with reverberation noise, computed into `reverb`
   void applyReverb(
       std::vector<float>& source,
+      std::vector<float>& reverb,
       float initial,
       float firstDelay,
       float rt60);
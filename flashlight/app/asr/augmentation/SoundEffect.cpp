@@ -32,7 +32,7 @@ void SoundEffectChain::add(std::shared_ptr<SoundEffect> SoundEffect) {
 
 void SoundEffectChain::apply(std::vector<float>& sound) {
   for (std::shared_ptr<SoundEffect>& effect : soundEffects_) {
-    effect->apply(sound);
+    effect->apply(sound, scratch_);
   }
 }
 
@@ -27,6 +27,14 @@ class SoundEffect {
   SoundEffect() = default;
   virtual ~SoundEffect() = default;
   virtual void apply(std::vector<float>& sound) = 0;
+  /**
+   * Same as apply(sound), with a buffer the effect may use for its
+   * intermediate results, whose content is unspecified before and after the
+   * call. Reusing the buffer across calls saves allocating it for every sound.
+   */
+  virtual void apply(std::vector<float>& sound, std::vector<float>& scratch) {
+    apply(sound);
+  }
   virtual std::string prettyString() const = 0;
 };
 
@@ -45,6 +53,8 @@ class SoundEffectChain : public SoundEffect {
 
  protected:
   std::vector<std::shared_ptr<SoundEffect>> soundEffects_;
+  // Shared by the effects of the chain
+  std::vector<float> scratch_;
 };
 
 /**
@@ -9,8 +9,11 @@
 
 #include <algorithm>
 #include <cmath>
+#include <numeric>
 #include <sstream>
 
+#include "flashlight/lib/audio/feature/SpeechUtils.h"
+
 namespace fl {
 namespace app {
 namespace asr {
@@ -39,10 +42,8 @@ float RandomNumberGenerator::gaussian(float mean, float sigma) {
 }
 
 float rootMeanSquare(const std::vector<float>& signal) {
-  float sumSquares = 0;
-  for (int i = 0; i < signal.size(); ++i) {
-    sumSquares += signal[i] * signal[i];
-  }
+  double sumSquares =
+      std::inner_product(signal.begin(), signal.end(), signal.begin(), 0.0);
   return std::sqrt(sumSquares / signal.size());
 }
 
@@ -54,6 +55,34 @@ float signalToNoiseRatio(
   return 20 * std::log10(singalRms / noiseRms);
 }
 
+void convolve(
+    const std::vector<float>& signal,
+    const std::vector<float>& ir,
+    std::vector<float>& output) {
+  size_t length = signal.size();
+  size_t irLen = std::min(ir.size(), length);
+  size_t numTaps = std::count_if(
+      ir.begin(), ir.begin() + irLen, [](float x) { return x != 0; });
+  // Rough costs per output sample: one multiply-add per tap, or the forward
+  // and inverse FFTs of blocks of at least half of the FFT size
+  double fftSize = std::max(64.0, std::exp2(std::ceil(std::log2(2 * irLen))));
+  double fftCost = 4 * std::log2(fftSize) * fftSize / (fftSize - irLen + 1);
+  if (numTaps > fftCost) {
+    output = fl::lib::audio::overlapAddConvolve(signal, ir);
+    return;
+  }
+  output.assign(length, 0.0);
+  for (size_t k = 0; k < irLen; ++k) {
+    const float tap = ir[k];
+    if (tap == 0) {
+      continue;
+    }
+    for (size_t i = k; i < length; ++i) {
+      output[i] += tap * signal[i - k];
+    }
+  }
+}
+
 } // namespace sfx
 } // namespace asr
 } // namespace app
@@ -47,6 +47,17 @@ float signalToNoiseRatio(
     const std::vector<float>& signal,
     const std::vector<float>& noise);
 
+/**
+ * Convolves `signal` with the impulse response `ir` into `output`, which is
+ * resized to the size of `signal`: the tail of the convolution is dropped.
+ * Impulse responses with few non-zero taps are applied in the time domain,
+ * others with an overlap-add FFT convolution, whichever costs less.
+ */
+void convolve(
+    const std::vector<float>& signal,
+    const std::vector<float>& ir,
+    std::vector<float>& output);
+
 } // namespace sfx
 } // namespace asr
 } // namespace app
@@ -42,6 +42,8 @@ constexpr const char* kProgramName = "programname";
 constexpr const char* kEpoch = "epoch";
 constexpr const char* kUpdates = "updates";
 constexpr const char* kScaleFactor = "scalefactor";
+// Position in the epoch of a checkpoint saved mid-epoch
+constexpr const char* kDataState = "datastate";
 constexpr const char* kSGDOptimizer = "sgd";
 constexpr const char* kAdamOptimizer = "adam";
 constexpr const char* kRMSPropOptimizer = "rmsprop";
@@ -57,6 +59,7 @@ constexpr const char* kBatchStrategyNone = "none";
 constexpr const char* kBatchStrategyDynamic = "dynamic";
 constexpr const char* kBatchStrategyRandDynamic = "randdynamic";
 constexpr const char* kBatchStrategyRand = "rand";
+constexpr const char* kBatchStrategyBucket = "bucket";
 constexpr const char* kFeaturesMFSC = "mfsc";
 constexpr const char* kFeaturesMFCC = "mfcc";
 constexpr const char* kFeaturesPow = "pow";
@@ -62,18 +62,63 @@ DEFINE_string(
 DEFINE_string(
     batching_strategy,
     "none",
-    "Batching strategy to use, supports {'none', 'dynamic', 'rand', 'randdynamic'}. "
+    "Batching strategy to use, supports {'none', 'dynamic', 'rand', 'randdynamic', 'bucket'}. "
     "When using 'none' strategy then batches of size 'batchsize' are created. "
     "When using 'dynamic' batching for training, 'batchsize' will be ignored "
     "and 'max_tokens' will be used to compute the effective batch size. "
     "To use unordered input data to pack batches, use either 'rand' "
     "or 'randdynamic' which shuffles data before packing, "
-    " then follows the same packing strategies as 'none' or 'dynamic', respectively.");
+    " then follows the same packing strategies as 'none' or 'dynamic', respectively. "
+    "'bucket' packs 'dynamic' batches of samples of similar lengths, drawn "
+    "from 'batching_num_buckets' length buckets which are reshuffled every epoch.");
 DEFINE_int64(
     batching_max_duration,
     0,
-    "Maximum number of tokens/frames in the batch when using 'dynamic' batching strategy. "
+    "Maximum number of tokens/frames in the batch when using 'dynamic' or 'bucket' batching strategy. "
     "Measured with the same unit as input sizes are specified in data list files");
+DEFINE_bool(
+    batching_probe_max_duration,
+    false,
+    "[train] With 'dynamic', 'randdynamic' or 'bucket' batching strategy, set "
+    "'batching_max_duration' before training to the largest one whose worst-case "
+    "batches, of the longest training sample repeated, fit in the memory of the "
+    "device with 'batching_probe_margin' of headroom, measured with a forward "
+    "and backward of the network and criterion. The probed value is saved in the "
+    "flags of the model, which does not probe again when continued");
+DEFINE_double(
+    batching_probe_margin,
+    0.1,
+    "[train] Share of the memory of the device left free by 'batching_probe_max_duration'");
+DEFINE_int64(
+    batching_num_buckets,
+    10,
+    "Number of length buckets when using 'bucket' batching strategy");
+DEFINE_bool(
+    batching_balance_ranks,
+    false,
+    "[train] With 'bucket' batching strategy in distributed training, measure the "
+    "throughput of each process during an epoch and give the slower ones batches "
+    "with proportionally fewer tokens at the next one, so that they don't hold "
+    "the others back");
+DEFINE_int64(
+    async_read_inflight,
+    0,
+    "Number of requests in flight to read audio files asynchronously, with "
+    "'async_read_lookahead' samples prefetched; 0 to read them synchronously");
+DEFINE_int64(
+    async_read_batch,
+    16,
+    "Max number of audio files fetched in a single request of asynchronous reads");
+DEFINE_int64(
+    async_read_lookahead,
+    256,
+    "Number of samples, in the order they are read, of which audio files are "
+    "prefetched with asynchronous reads");
+DEFINE_string(
+    async_read_store,
+    "file",
+    "Storage of audio files for asynchronous reads, as registered with "
+    "registerBlobStore() (e.g. by a plugin); audio paths are its keys");
 DEFINE_bool(
     usewordpiece,
     false,
@@ -130,7 +175,22 @@ DEFINE_int64(
     iter,
     std::numeric_limits<int64_t>::max(),
     "[train] Total number of updates for training");
+DEFINE_int64(
+    accumulate_batches,
+    1,
+    "[train] Number of batches whose gradients are accumulated, and reduced "
+    "once in distributed training, per update");
 DEFINE_bool(itersave, false, "Save model or not at each update");
+DEFINE_bool(
+    async_checkpoint,
+    true,
+    "[train] Write models in a background thread, from a snapshot taken in "
+    "host memory, instead of blocking training until they are written");
+DEFINE_bool(
+    async_valid,
+    false,
+    "[train] Validate a copy of the models in a background thread while "
+    "training continues, and report the results once it is done");
 DEFINE_double(lr, 1.0, "[train] Learning rate for the network parameters");
 DEFINE_double(
     momentum,
@@ -182,6 +242,10 @@ DEFINE_double(
     optimepsilon,
     1e-8,
     "[train] Epsilon parameter in the Adam, AMSGrad, NovoGrad, Adadelta, RMSProp and Adagrad optimizers");
+DEFINE_bool(
+    optim8bitstates,
+    false,
+    "[train] Store the moments of the Adam and AMSGrad optimizers in 8 bits");
 
 // LR-SCHEDULER OPTIONS
 DEFINE_int64(
@@ -240,6 +304,11 @@ DEFINE_int64(
     -1,
     "High freq filter bank (Hz). "
     "Is used also in RawSpecAugment to define the highest frequecny bound for augmentation");
+DEFINE_bool(
+    features_on_device,
+    false,
+    "Compute 'pow', 'mfsc' or 'mfcc' features with ArrayFire on the device "
+    "instead of on the CPU: only the raw audio is copied to the device");
 
 // SPECAUGMENT OPTIONS
 DEFINE_int64(
@@ -290,6 +359,36 @@ DEFINE_int64(
     nthread,
     1,
     "[train] Number of threads for data parallelization (prefetching the data)");
+DEFINE_int64(
+    nthread_criterion,
+    0,
+    "[train] Maximum number of threads the CPU criterions split the batch over, 0 uses all the cores");
+DEFINE_int64(
+    prefetch_reorder_window,
+    0,
+    "[train] If positive, prefetched train batches can be used out of order, at most this many batches late, so that a slow batch does not stall training");
+DEFINE_string(
+    thread_affinity,
+    "none",
+    "[test, decode] Pins the prefetching, acoustic model and decoder threads: 'none', 'cpu' (a CPU each) or 'numa' (the CPUs of a NUMA node each, spread over the nodes)");
+DEFINE_bool(
+    thread_budget,
+    false,
+    "Partitions the CPUs of the process among the computation (OpenMP, DNNL, the BLAS of the ArrayFire CPU backend and the CPU criterions), the prefetching threads and the decoder threads, each pool pinned to its CPUs. With several processes per host, give each its CPUs (e.g. with numactl)");
+DEFINE_int64(
+    thread_budget_compute,
+    0,
+    "Threads of the computation with --thread_budget, 0 for the CPUs left by the prefetching and decoder threads");
+DEFINE_int64(
+    dataset_cache_mb,
+    0,
+    "[train] Megabytes of the (featurized) training batches cached in memory "
+    "across epochs, 0 disables the cache. Sound effects are then applied once");
+DEFINE_string(
+    dataset_cache_spill_path,
+    "",
+    "[train] File on local storage receiving the batches evicted from the "
+    "dataset cache");
 DEFINE_int64(
     seed,
     0,
@@ -309,6 +408,13 @@ DEFINE_bool(
     "[train] Sets flashlight benchmark mode, which dynamically "
     "benchmarks various operations based on their empirical performance on "
     "current hardware throughout training");
+DEFINE_string(
+    fl_benchmark_cache,
+    "",
+    "[train] File in which the results of benchmark mode are cached across "
+    "runs and processes, if nonempty. Benchmark results are only valid for "
+    "the hardware and library versions with which they were obtained, "
+    "which are part of the cache keys");
 DEFINE_string(
     fl_optim_mode,
     "",
@@ -327,6 +433,43 @@ DEFINE_int64(
     "Flushes memory manager logs after a specified "
     "number of log entries. 1000000 is a reasonable "
     "value which will reduce overhead.");
+DEFINE_string(
+    fl_mem_profile_save,
+    "",
+    "Records the peak number of blocks of each size allocated by the "
+    "memory manager and saves them to this file with the models, to warm "
+    "start the memory manager of later runs with --fl_mem_profile_load");
+DEFINE_string(
+    fl_mem_profile_load,
+    "",
+    "Preallocates the cache of the memory manager from a profile saved "
+    "with --fl_mem_profile_save");
+DEFINE_string(
+    fl_trace_file,
+    "",
+    "[train, decode] Records the scopes of all the threads (data loading, "
+    "forward and backward, communication, decoding) and writes them to this "
+    "file as a Chrome trace, at each checkpoint and at the end of decoding. "
+    "With several processes, the file of each is suffixed by its rank.");
+DEFINE_bool(
+    fl_trace_device,
+    false,
+    "With --fl_trace_file, also times the scopes on the device (CUDA)");
+DEFINE_int64(
+    fl_metrics_port,
+    0,
+    "[train, decode] If positive, serves metrics (throughput, step times, "
+    "memory usage, all-reduced bytes, decoding speed) to Prometheus over HTTP "
+    "at /metrics, on this port plus the rank of the process");
+DEFINE_string(
+    fl_metrics_statsd,
+    "",
+    "[train, decode] host:port of a StatsD server to push the metrics of "
+    "--fl_metrics_port to, with the rank of the process as a tag");
+DEFINE_int64(
+    fl_metrics_statsd_interval,
+    10000,
+    "[train, decode] Interval between the pushes to --fl_metrics_statsd, in ms");
 
 // MIXED PRECISION OPTIONS
 DEFINE_bool(
@@ -391,6 +534,34 @@ DEFINE_bool(
     logadd,
     false,
     "[decode] Use logadd operation when merging decoder nodes");
+DEFINE_bool(
+    hashmerge,
+    false,
+    "[decode] Merge decoder nodes with a hash table instead of sorting them");
+DEFINE_double(
+    blankskipthreshold,
+    1.0,
+    "[decode] CTC lexicon decoder: frames with a blank probability above it only extend the blank and repeated tokens (1 to never skip)");
+DEFINE_int32(
+    lmlookaheadwords,
+    0,
+    "[decode] Lexicon decoder with a word LM: score the partial words with the best LM score of the words they may complete to, if there are at most this many (0 to use the smeared lexicon scores)");
+DEFINE_int32(
+    adaptivebeamcandidates,
+    0,
+    "[decode] Lexicon decoder: adapt the beam threshold of each frame to keep about this many candidates per frame (0 to keep beamthreshold)");
+DEFINE_double(
+    adaptivebeamframetime,
+    0,
+    "[decode] Lexicon decoder: adapt the beam threshold of each frame to decode a frame in about this many milliseconds (0 to keep beamthreshold)");
+DEFINE_double(
+    adaptivebeamminthreshold,
+    1.0,
+    "[decode] Lowest beam threshold of the adaptive beam");
+DEFINE_int32(
+    lmlookaheadcache,
+    100000,
+    "[decode] Maximum number of LM look-ahead scores cached by each decoder");
 DEFINE_bool(
     uselexicon,
     true,
@@ -405,7 +576,7 @@ DEFINE_string(
 DEFINE_string(
     lmtype,
     "kenlm",
-    "[decode] Language model type used along with acoustic model: 'kenlm', 'convlm'");
+    "[decode] Language model type used along with acoustic model: 'kenlm', 'convlm', 'transformer' (for a model trained with fl/app/lm)");
 DEFINE_string(
     lexicon,
     "",
@@ -413,11 +584,27 @@ DEFINE_string(
 DEFINE_string(
     lm_vocab,
     "",
-    "[decode] path/to/lm_vocab.txt for the 'convlm' language model: each token is mapped to its file row index");
+    "[decode] path/to/lm_vocab.txt for the 'convlm' and 'transformer' language models: each token is mapped to its file row index");
+DEFINE_string(
+    lm_arch,
+    "",
+    "[decode] path/to/plugin.so of the architecture of the 'transformer' language model");
 DEFINE_string(
     emission_dir,
     "",
     "path/to/emission_dir/ where emissions data will be stored");
+DEFINE_string(
+    emission_cache,
+    "",
+    "[decode] path/to/emission_cache written by the acoustic model forward if it does not exist, else read by the decoder threads instead of running the acoustic model");
+DEFINE_string(
+    emission_cache_type,
+    "f16",
+    "[decode] Storage of the emissions written to emission_cache: f32, f16 or topk");
+DEFINE_int32(
+    emission_cache_topk,
+    32,
+    "[decode] Number of scores kept per frame by the 'topk' emission cache");
 DEFINE_string(lm, "", "[decode] path/to/language_model");
 DEFINE_string(
     am,
@@ -468,19 +655,107 @@ DEFINE_int32(
     nthread_decoder_am_forward,
     1,
     "[test, decoder] Number of threads for acoustic model forward");
+DEFINE_int32(
+    decoder_am_batchsize,
+    1,
+    "[test, decode] Number of samples forwarded together by each acoustic model thread");
 DEFINE_int32(
     nthread_decoder,
     1,
     "[decode] Number of threads for beam-search decoding");
+DEFINE_int32(
+    decoder_batchsize,
+    1,
+    "[decode] Number of samples decoded together by each decoder thread");
 DEFINE_int32(
     lm_memory,
     5000,
     "[decode] Total memory size for batch forming for 'convlm' LM forward pass");
+DEFINE_bool(
+    lm_incremental,
+    false,
+    "[decode] Forward the 'convlm' LM on the new token of each state only, from the cached activations of its convolutions");
+DEFINE_string(
+    rescore_lm,
+    "",
+    "[decode] path/to/lm.bin of a transformer language model trained with fl/app/lm, with which the n-best lists of the decoder are rescored");
+DEFINE_string(
+    rescore_lm_arch,
+    "",
+    "[decode] path/to/plugin.so of the architecture of the rescoring language model");
+DEFINE_string(
+    rescore_lm_vocab,
+    "",
+    "[decode] path/to/lm_vocab.txt of the rescoring language model: each word is mapped to its file row index");
+DEFINE_int32(
+    rescore_nbest,
+    10,
+    "[decode] Number of hypotheses of the first pass rescored for each sample");
+DEFINE_double(
+    rescore_lmweight,
+    0.0,
+    "[decode] Weight of the rescoring language model, added to the scores of the first pass");
+DEFINE_double(
+    rescore_wordscore,
+    0.0,
+    "[decode] Score of each word for the rescoring, added to the scores of the first pass");
+DEFINE_int32(
+    rescore_batch_tokens,
+    4096,
+    "[decode] Maximum number of tokens of a forward pass of the rescoring language model");
+DEFINE_int32(
+    rescore_queue_size,
+    16,
+    "[decode] Maximum number of batches decoded by each decoder thread and waiting to be rescored");
+DEFINE_string(
+    lexicon_cache,
+    "",
+    "[decode] Path of the compiled lexicon (word dictionary, spellings and trie), loaded instead of parsing the lexicon if it was built from the same inputs, else built and saved there");
+DEFINE_string(
+    lattice_dir,
+    "",
+    "[decode] Directory where the word lattice of each sample is written, as <sample id>.lat (lexicon decoder only)");
+DEFINE_string(
+    decoder_sweep_lmweight,
+    "",
+    "[decode] Comma-separated LM weights also decoded with each emission, together with decoder_sweep_wordscore, to report their WER in the same pass");
+DEFINE_string(
+    decoder_sweep_wordscore,
+    "",
+    "[decode] Comma-separated word scores also decoded with each emission, see decoder_sweep_lmweight");
+DEFINE_int64(
+    lm_cache_size,
+    0,
+    "[decode] Maximum number of scores in the 'kenlm' LM cache shared by all the decoder threads, 0 to disable it");
+DEFINE_string(
+    lm_load_method,
+    "populate_or_read",
+    "[decode] How the 'kenlm' LM is loaded: lazy, populate_or_lazy, populate_or_read, read or parallel_read. With mmap (lazy, populate_or_*), the processes of a host share the page cache copy of a binary LM");
+DEFINE_int64(
+    lm_prefetch_mb,
+    0,
+    "[decode] MB of the head of the 'kenlm' LM file, which holds the vocabulary and the lowest order n-grams of binary LMs, read ahead after loading");
 
 DEFINE_int32(
     emission_queue_size,
     3000,
     "[test, decode] Maximum size of emission queue for acoustic model forward pass");
+DEFINE_bool(
+    decoder_pipeline,
+    false,
+    "[decode] With 'convlm' LM, run acoustic model forward and decoding concurrently through the bounded emission queue instead of one after the other");
+DEFINE_int32(
+    decoder_lm_device_offset,
+    0,
+    "[decode] Device of the first decoder thread using a GPU, decoder thread i uses device (offset + i) modulo the number of devices. Acoustic model thread i uses device i");
+DEFINE_int32(
+    decoder_am_batch_hypotheses,
+    0,
+    "[decode] If > 0, the attention decoder of the seq2seq RNN criterion runs the steps of the decoder threads of a device in batches of up to this many hypotheses of several utterances, and 'nthread_decoder' may exceed the number of devices");
+DEFINE_int64(
+    decoder_am_batch_wait_us,
+    2000,
+    "[decode] With 'decoder_am_batch_hypotheses', the longest a step waits for the steps of other decoder threads before running, in microseconds");
 
 DEFINE_double(
     smoothingtemperature,
@@ -502,6 +777,12 @@ DEFINE_double(
     "language model weight (high boundary, search)");
 DEFINE_double(lmweight_step, 0.2, "language model weight (step, search)");
 
+// ALIGNMENT OPTIONS
+DEFINE_int32(
+    align_batchsize,
+    1,
+    "[align] Number of utterances forwarded and aligned together");
+
 // ASG OPTIONS
 DEFINE_int64(
     linseg,
@@ -526,6 +807,11 @@ DEFINE_int64(
     200,
     "'seq2seq'/'transformer' criterion: max decoder steps during inference; "
     "(for 'transformer' cannot be changed after initialization)");
+DEFINE_int64(
+    validbeamsize,
+    1,
+    "[train] 'seq2seq' criterion: beam size of the batched beam search "
+    "decoding the validation sets; 1 for greedy decoding");
 DEFINE_int64(
     pctteacherforcing,
     100,
@@ -658,8 +944,45 @@ DEFINE_int64(
 DEFINE_string(
     rndv_filepath,
     "",
-    "[train] Shared file path used for setting up rendezvous."
+    "[train] Shared file path used for setting up rendezvous, or "
+    "'tcp://host:port' of a TCP store served by rank 0. "
     "If empty, uses MPI to initialize.");
+DEFINE_string(
+    distributed_compression,
+    "",
+    "[train] Compression of the gradients for allreduce: '' (none), 'fp16', "
+    "or 'fp16_ef' (fp16 with error feedback)");
+DEFINE_int64(
+    distributed_local_sgd_period,
+    0,
+    "[train] Local SGD: update the parameters of each process independently, "
+    "and average them every that many updates instead of reducing the "
+    "gradients at every update; 0 to reduce the gradients");
+DEFINE_int64(
+    distributed_local_sgd_warmup,
+    0,
+    "[train] Local SGD: number of first updates whose gradients are still "
+    "reduced (post-local SGD)");
+DEFINE_double(
+    distributed_local_sgd_momentum,
+    0.0,
+    "[train] Local SGD: momentum of the outer updates moving the parameters "
+    "to their averages (SlowMo)");
+DEFINE_double(
+    distributed_local_sgd_lr,
+    1.0,
+    "[train] Local SGD: learning rate of the outer updates (SlowMo)");
+DEFINE_bool(
+    distributed_local_sgd_optim_state,
+    false,
+    "[train] Local SGD: average the optimizer states (e.g. momentums) too");
+DEFINE_bool(
+    distributed_pipelined_optimizer,
+    false,
+    "[train] Reduce the gradients in buckets during the backward pass, and "
+    "update each layer when the next forward pass reaches it, so that it "
+    "overlaps the last reductions. Not with mixed precision, maxgradnorm, "
+    "accumulate_batches, local SGD or compression");
 
 // FB SPECIFIC
 DEFINE_bool(everstoredb, false, "use Everstore db for reading data");
@@ -77,6 +77,14 @@ DECLARE_int64(channels);
 DECLARE_string(tokens);
 DECLARE_string(batching_strategy);
 DECLARE_int64(batching_max_duration);
+DECLARE_bool(batching_probe_max_duration);
+DECLARE_double(batching_probe_margin);
+DECLARE_int64(batching_num_buckets);
+DECLARE_bool(batching_balance_ranks);
+DECLARE_int64(async_read_inflight);
+DECLARE_int64(async_read_batch);
+DECLARE_int64(async_read_lookahead);
+DECLARE_string(async_read_store);
 DECLARE_bool(usewordpiece);
 DECLARE_int64(replabel);
 DECLARE_string(surround);
@@ -94,7 +102,10 @@ DECLARE_bool(lrcosine);
 /* ========== LEARNING HYPER-PARAMETER OPTIONS ========== */
 
 DECLARE_int64(iter);
+DECLARE_int64(accumulate_batches);
 DECLARE_bool(itersave);
+DECLARE_bool(async_checkpoint);
+DECLARE_bool(async_valid);
 DECLARE_double(lr);
 DECLARE_double(momentum);
 DECLARE_double(weightdecay);
@@ -109,6 +120,7 @@ DECLARE_double(adambeta1); // TODO rename into optim beta1
 DECLARE_double(adambeta2); // TODO rename into optim beta2
 DECLARE_double(optimrho);
 DECLARE_double(optimepsilon);
+DECLARE_bool(optim8bitstates);
 
 /* ========== LR-SCHEDULER OPTIONS ========== */
 
@@ -131,6 +143,7 @@ DECLARE_int64(framesizems);
 DECLARE_int64(framestridems);
 DECLARE_int64(lowfreqfilterbank);
 DECLARE_int64(highfreqfilterbank);
+DECLARE_bool(features_on_device);
 
 /* ========== SPECAUGMENT OPTIONS ========== */
 
@@ -151,15 +164,30 @@ DECLARE_string(datadir);
 DECLARE_string(rundir);
 DECLARE_string(flagsfile);
 DECLARE_int64(nthread);
+DECLARE_int64(nthread_criterion);
+DECLARE_int64(prefetch_reorder_window);
+DECLARE_string(thread_affinity);
+DECLARE_bool(thread_budget);
+DECLARE_int64(thread_budget_compute);
+DECLARE_int64(dataset_cache_mb);
+DECLARE_string(dataset_cache_spill_path);
 DECLARE_int64(seed);
 DECLARE_int64(memstepsize);
 DECLARE_int64(reportiters);
 DECLARE_double(pcttraineval);
 DECLARE_bool(fl_benchmark_mode);
+DECLARE_string(fl_benchmark_cache);
 DECLARE_string(fl_optim_mode);
 DECLARE_string(fl_log_level);
 DECLARE_int64(fl_vlog_level);
 DECLARE_int64(fl_log_mem_ops_interval);
+DECLARE_string(fl_mem_profile_save);
+DECLARE_string(fl_mem_profile_load);
+DECLARE_string(fl_trace_file);
+DECLARE_bool(fl_trace_device);
+DECLARE_int64(fl_metrics_port);
+DECLARE_string(fl_metrics_statsd);
+DECLARE_int64(fl_metrics_statsd_interval);
 
 /* ========== MIXED PRECISION OPTIONS ========== */
 
@@ -184,6 +212,13 @@ DECLARE_double(am_decoder_tr_layerdrop);
 DECLARE_bool(show);
 DECLARE_bool(showletters);
 DECLARE_bool(logadd);
+DECLARE_bool(hashmerge);
+DECLARE_double(blankskipthreshold);
+DECLARE_int32(lmlookaheadwords);
+DECLARE_int32(lmlookaheadcache);
+DECLARE_int32(adaptivebeamcandidates);
+DECLARE_double(adaptivebeamframetime);
+DECLARE_double(adaptivebeamminthreshold);
 DECLARE_bool(uselexicon);
 DECLARE_bool(isbeamdump);
 
@@ -191,7 +226,11 @@ DECLARE_string(smearing);
 DECLARE_string(lmtype);
 DECLARE_string(lexicon);
 DECLARE_string(lm_vocab);
+DECLARE_string(lm_arch);
 DECLARE_string(emission_dir);
+DECLARE_string(emission_cache);
+DECLARE_string(emission_cache_type);
+DECLARE_int32(emission_cache_topk);
 DECLARE_string(lm);
 DECLARE_string(am);
 DECLARE_string(sclite);
@@ -209,10 +248,32 @@ DECLARE_int32(maxword);
 DECLARE_int32(beamsize);
 DECLARE_int32(beamsizetoken);
 DECLARE_int32(nthread_decoder_am_forward);
+DECLARE_int32(decoder_am_batchsize);
 DECLARE_int32(nthread_decoder);
+DECLARE_int32(decoder_batchsize);
 DECLARE_int32(lm_memory);
+DECLARE_bool(lm_incremental);
+DECLARE_string(rescore_lm);
+DECLARE_string(rescore_lm_arch);
+DECLARE_string(rescore_lm_vocab);
+DECLARE_int32(rescore_nbest);
+DECLARE_double(rescore_lmweight);
+DECLARE_double(rescore_wordscore);
+DECLARE_int32(rescore_batch_tokens);
+DECLARE_int32(rescore_queue_size);
+DECLARE_string(lexicon_cache);
+DECLARE_string(lattice_dir);
+DECLARE_string(decoder_sweep_lmweight);
+DECLARE_string(decoder_sweep_wordscore);
+DECLARE_int64(lm_cache_size);
+DECLARE_string(lm_load_method);
+DECLARE_int64(lm_prefetch_mb);
 
 DECLARE_int32(emission_queue_size);
+DECLARE_bool(decoder_pipeline);
+DECLARE_int32(decoder_lm_device_offset);
+DECLARE_int32(decoder_am_batch_hypotheses);
+DECLARE_int64(decoder_am_batch_wait_us);
 
 DECLARE_double(lmweight_low);
 DECLARE_double(lmweight_high);
@@ -222,6 +283,10 @@ DECLARE_double(lmweight_step);
 DECLARE_double(smoothingtemperature);
 DECLARE_int32(attentionthreshold);
 
+/* ========== ALIGNMENT OPTIONS ========== */
+
+DECLARE_int32(align_batchsize);
+
 /* ========== ASG OPTIONS ========== */
 
 DECLARE_int64(linseg);
@@ -232,6 +297,7 @@ DECLARE_double(transdiag);
 /* ========== SEQ2SEQ OPTIONS ========== */
 
 DECLARE_int64(maxdecoderoutputlen);
+DECLARE_int64(validbeamsize);
 DECLARE_int64(pctteacherforcing);
 DECLARE_string(samplingstrategy);
 DECLARE_double(labelsmooth);
@@ -264,6 +330,13 @@ DECLARE_int64(world_rank);
 DECLARE_int64(world_size);
 DECLARE_int64(max_devices_per_node);
 DECLARE_string(rndv_filepath);
+DECLARE_string(distributed_compression);
+DECLARE_int64(distributed_local_sgd_period);
+DECLARE_int64(distributed_local_sgd_warmup);
+DECLARE_double(distributed_local_sgd_momentum);
+DECLARE_double(distributed_local_sgd_lr);
+DECLARE_bool(distributed_local_sgd_optim_state);
+DECLARE_bool(distributed_pipelined_optimizer);
 
 /* ========== FB SPECIFIC ========== */
 DECLARE_bool(everstoredb);
@@ -49,6 +49,96 @@ CriterionScaleMode getCriterionScaleMode(
   }
 }
 
+af::array viterbiPathMask(
+    const af::array& path,
+    const af::array& frames,
+    int blankIdx) {
+  int T = path.dims(0);
+  int B = path.dims(1);
+  auto time = af::range(af::dim4(T, B), 0, s32);
+  auto keep =
+      time < af::tile(af::moddims(frames.as(s32), af::dim4(1, B)), T, 1);
+  // Keep the first frame of each run of a token
+  af::array previous = af::shift(path, 1);
+  previous(0, af::span) = -1;
+  keep = keep && (path != previous);
+  if (blankIdx >= 0) {
+    keep = keep && (path != blankIdx);
+  }
+  return keep;
+}
+
+af::array compactViterbiPath(
+    const af::array& path,
+    const af::array& frames,
+    int blankIdx,
+    af::array& sizes) {
+  auto keep = viterbiPathMask(path, frames, blankIdx);
+  sizes = af::sum(keep.as(s32), 0);
+  auto ids = af::where(af::flat(keep));
+  if (ids.isempty()) {
+    return af::array(0, s32);
+  }
+  return af::flat(path)(ids);
+}
+
+af::array packTokens(
+    const af::array& tokens,
+    const af::array& keep,
+    int trimIdx,
+    af::array& sizes) {
+  int T = tokens.dims(0);
+  int B = tokens.dims(1);
+  af::array kept = keep;
+  if (trimIdx >= 0) {
+    auto rank = af::accum(kept.as(s32), 0);
+    auto size = af::tile(af::sum(kept.as(s32), 0), T);
+    kept = kept && !((tokens == trimIdx) && (rank == 1 || rank == size));
+  }
+  auto position = af::accum(kept.as(s32), 0) - 1;
+  sizes = af::sum(kept.as(s32), 0);
+  int L = std::max(1, af::max<int>(sizes));
+  af::array packed = af::constant(-1, L, B, s32);
+  auto ids = af::where(af::flat(kept)).as(s32);
+  if (!ids.isempty()) {
+    packed(position(ids) + (ids / T) * L) = af::flat(tokens)(ids);
+  }
+  return packed;
+}
+
+af::array lettersToWords(
+    const af::array& letters,
+    int wordSepIdx,
+    af::array& sizes) {
+  int L = letters.dims(0);
+  int B = letters.dims(1);
+  auto isLetter = letters >= 0 && letters != wordSepIdx;
+  af::array previous = af::shift(isLetter, 1);
+  previous(0, af::span) = 0;
+  auto isStart = isLetter && !previous;
+  auto word = af::accum(isStart.as(s32), 0) - 1;
+  sizes = af::sum(isStart.as(s32), 0);
+  // Position of each letter in its word, from the row of the word start
+  auto row = af::range(af::dim4(L, B), 0, s32);
+  auto start = af::scan(af::select(isStart, row, 0), 0, AF_BINARY_MAX);
+  auto position = row - start;
+  auto maxDims = af::join(
+      0,
+      af::max(af::flat(sizes)),
+      af::max(af::flat(af::select(isLetter, position, 0))) + 1);
+  int dims[2];
+  maxDims.as(s32).host(dims);
+  int W = std::max(1, dims[0]);
+  int K = dims[1];
+  af::array words = af::constant(-1, W, K, B, s32);
+  auto ids = af::where(af::flat(isLetter)).as(s32);
+  if (!ids.isempty()) {
+    words(word(ids) + position(ids) * W + (ids / L) * (W * K)) =
+        af::flat(letters)(ids);
+  }
+  return words;
+}
+
 Variable getLinearTarget(const Variable& targetVar, int T) {
   int L = targetVar.dims(0);
   int B = targetVar.dims(1);
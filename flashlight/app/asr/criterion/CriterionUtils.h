@@ -9,7 +9,10 @@
 
 #include <float.h>
 #include <stdint.h>
+#include <algorithm>
 #include <limits>
+#include <memory>
+#include <vector>
 
 #include "flashlight/fl/flashlight.h"
 
@@ -92,6 +95,121 @@ lib::seq::CriterionScaleMode getCriterionScaleMode(
 // Input: N x T x B (type: float), Output: T x B (type: int)
 af::array viterbiPath(const af::array& input, const af::array& trans);
 
+// Frees the workspace kept by `viterbiPath()` in the calling thread
+void releaseViterbiPathWorkspace();
+
+inline void allocateWorkspaceBuffer(size_t size, af::array& buffer) {
+  buffer = af::array(size, u8);
+}
+
+inline void allocateWorkspaceBuffer(size_t size, std::vector<uint8_t>& buffer) {
+  buffer.resize(size);
+}
+
+/**
+ * CriterionWorkspace keeps the workspace of the `lib/sequence` kernels of a
+ * criterion across its calls, instead of allocating one at each forward. The
+ * buffer (an `af::array` with the CUDA kernels, a `std::vector<uint8_t>` with
+ * the CPU ones) grows geometrically, by at least `kGrowth`, when a call needs
+ * more than its capacity.
+ *
+ * A forward hands its buffer to its backward: while the buffer is held
+ * elsewhere, a call gets a new one, which then becomes the workspace. If
+ * allocating fails, the workspace is freed and the allocation retried at the
+ * exact size. `release()` frees it explicitly, e.g. on memory pressure.
+ */
+class CriterionWorkspace {
+ public:
+  static constexpr size_t kGrowth = 2;
+
+  /* A buffer of at least `size` bytes, held by the caller only */
+  template <typename Buffer>
+  std::shared_ptr<Buffer> get(size_t size) {
+    auto buffer = std::static_pointer_cast<Buffer>(buffer_);
+    // Held by buffer_ and buffer only
+    if (buffer && buffer.use_count() == 2 && capacity_ >= size) {
+      return buffer;
+    }
+    size_t capacity =
+        size > capacity_ ? std::max(size, capacity_ * kGrowth) : capacity_;
+    buffer = std::make_shared<Buffer>();
+    try {
+      allocateWorkspaceBuffer(capacity, *buffer);
+    } catch (const std::exception&) {
+      release();
+      capacity = size;
+      allocateWorkspaceBuffer(capacity, *buffer);
+    }
+    buffer_ = buffer;
+    capacity_ = capacity;
+    return buffer;
+  }
+
+  size_t capacity() const {
+    return capacity_;
+  }
+
+  void release() {
+    buffer_.reset();
+    capacity_ = 0;
+  }
+
+ private:
+  std::shared_ptr<void> buffer_;
+  size_t capacity_{0};
+};
+
+/**
+ * Frames of Viterbi paths of CTC or ASG (T x B, type: int) whose token is
+ * kept by `tknPrediction2Ltr()`: the first frame of each run of a token,
+ * except blanks (if `blankIdx` >= 0) and frames from `frames[b]` on (B, type:
+ * int). Returns a T x B mask (type: bool).
+ */
+af::array viterbiPathMask(
+    const af::array& path,
+    const af::array& frames,
+    int blankIdx);
+
+/**
+ * Compacts Viterbi paths of CTC or ASG on the device, as
+ * `tknPrediction2Ltr()` does on the host: repeated tokens are merged, blanks
+ * are removed (if `blankIdx` >= 0) and frames from `frames[b]` on are
+ * ignored. Input path: T x B (type: int), frames: B (type: int).
+ * Returns the tokens of all the paths concatenated (type: int), and the
+ * number of tokens of each path in `sizes` (1 x B, type: int).
+ */
+af::array compactViterbiPath(
+    const af::array& path,
+    const af::array& frames,
+    int blankIdx,
+    af::array& sizes);
+
+/**
+ * Keeps the tokens of `tokens` (T x B, type: int) selected by `keep` (T x B,
+ * type: bool) in each column, with `trimIdx` dropped at the start and the end
+ * of the columns as `tknIdx2Ltr()` does for the word separator (if
+ * `trimIdx` >= 0). Returns them in L x B (type: int) padded with -1, where L
+ * is the largest number of tokens kept (at least 1), and their number in
+ * `sizes` (1 x B, type: int).
+ */
+af::array packTokens(
+    const af::array& tokens,
+    const af::array& keep,
+    int trimIdx,
+    af::array& sizes);
+
+/**
+ * Splits letters (L x B, type: int, padded with -1) into words on
+ * `wordSepIdx` as `tkn2Wrd()` does. Returns W x K x B (type: int): the K
+ * letters of each word padded with -1, where W (K) is the largest number of
+ * words (letters in a word), at least 1. The number of words is set in
+ * `sizes` (1 x B, type: int).
+ */
+af::array lettersToWords(
+    const af::array& letters,
+    int wordSepIdx,
+    af::array& sizes);
+
 fl::Variable getLinearTarget(const fl::Variable& target, int T);
 
 // workaround for https://github.com/arrayfire/arrayfire/issues/2273
@@ -31,6 +31,11 @@ class ForceAlignmentCriterion : public fl::BinaryModule {
 
   std::string prettyString() const override;
 
+  // Frees the workspace kept across the calls
+  void releaseWorkspace() {
+    workspace_.release();
+  }
+
  private:
   friend class AutoSegmentationCriterion;
   ForceAlignmentCriterion() = default;
@@ -38,6 +43,8 @@ class ForceAlignmentCriterion : public fl::BinaryModule {
   int N_;
   CriterionScaleMode scaleMode_;
 
+  CriterionWorkspace workspace_;
+
   FL_SAVE_LOAD_WITH_BASE(
       fl::BinaryModule,
       fl::serializeAs<int64_t>(N_),
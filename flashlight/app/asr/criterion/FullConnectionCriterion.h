@@ -27,6 +27,11 @@ class FullConnectionCriterion : public fl::BinaryModule {
 
   std::string prettyString() const override;
 
+  // Frees the workspace kept across the calls
+  void releaseWorkspace() {
+    workspace_.release();
+  }
+
  private:
   friend class AutoSegmentationCriterion;
   FullConnectionCriterion() = default;
@@ -34,6 +39,8 @@ class FullConnectionCriterion : public fl::BinaryModule {
   int N_;
   fl::lib::seq::CriterionScaleMode scaleMode_;
 
+  CriterionWorkspace workspace_;
+
   FL_SAVE_LOAD_WITH_BASE(
       fl::BinaryModule,
       fl::serializeAs<int64_t>(N_),
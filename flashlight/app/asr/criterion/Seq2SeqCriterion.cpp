@@ -8,6 +8,7 @@
 #include "flashlight/app/asr/criterion/Seq2SeqCriterion.h"
 
 #include <algorithm>
+#include <limits>
 #include <numeric>
 #include <queue>
 
@@ -68,6 +69,25 @@ Seq2SeqState selectState(Seq2SeqState& state, int batchIdx) {
   }
   return newState;
 }
+
+// State of the hypotheses `index` (s32) of a batched state
+Seq2SeqState gatherState(const Seq2SeqState& state, const af::array& index) {
+  int nAttnRound = state.hidden.size();
+  Seq2SeqState newState(nAttnRound);
+  newState.step = state.step;
+  newState.peakAttnPos = state.peakAttnPos;
+  newState.isValid = state.isValid;
+  auto gather = [&index](const Variable& var, int dim) {
+    return var.isempty() ? Variable()
+                         : Variable(af::lookup(var.array(), index, dim), false);
+  };
+  newState.alpha = gather(state.alpha, 2);
+  newState.summary = gather(state.summary, 2);
+  for (int i = 0; i < nAttnRound; i++) {
+    newState.hidden[i] = gather(state.hidden[i], 1);
+  }
+  return newState;
+}
 } // namespace detail
 
 Seq2SeqCriterion::Seq2SeqCriterion(
@@ -146,8 +166,20 @@ std::vector<Variable> Seq2SeqCriterion::forward(
       inputs.size() == 3 ? af::array() : inputs[3].array(); // 1 x B
 
   Variable out, alpha;
-  if (useSequentialDecoder_) {
-    std::tie(out, alpha) = decoder(input, target, inputSizes, targetSizes);
+  // Windows depending on the previous attention can't be vectorized
+  bool useWindow = window_ && (!train_ || trainWithWindow_);
+  if (useSequentialDecoder_ || (useWindow && !window_->isVectorizable())) {
+    // Without feedback of the outputs into the RNN input, only the attention
+    // has to be stepped
+    bool teacherForced = !train_ ||
+        (pctTeacherForcing_ >= 100 &&
+         samplingStrategy_ != fl::app::asr::kGumbelSampling);
+    if (teacherForced && !inputFeeding_ && nAttnRound_ == 1) {
+      std::tie(out, alpha) =
+          vectorizedRNNDecoder(input, target, inputSizes, targetSizes);
+    } else {
+      std::tie(out, alpha) = decoder(input, target, inputSizes, targetSizes);
+    }
   } else {
     std::tie(out, alpha) =
         vectorizedDecoder(input, target, inputSizes, targetSizes);
@@ -172,14 +204,9 @@ std::vector<Variable> Seq2SeqCriterion::forward(
   return {losses, out};
 }
 
-std::pair<Variable, Variable> Seq2SeqCriterion::vectorizedDecoder(
-    const Variable& input,
-    const Variable& target,
-    const af::array& inputSizes,
-    const af::array& targetSizes) {
+Variable Seq2SeqCriterion::vectorizedDecoderInput(const Variable& target) {
   int U = target.dims(0);
   int B = target.dims(1);
-  int T = input.dims(1);
 
   auto hy = tile(startEmbedding(), {1, 1, B}); // H x 1 x B
 
@@ -204,6 +231,19 @@ std::pair<Variable, Variable> Seq2SeqCriterion::vectorizedDecoder(
     auto yEmbed = embedding()->forward(y);
     hy = concatenate({hy, yEmbed}, 1); // H x U x B
   }
+  return hy;
+}
+
+std::pair<Variable, Variable> Seq2SeqCriterion::vectorizedDecoder(
+    const Variable& input,
+    const Variable& target,
+    const af::array& inputSizes,
+    const af::array& targetSizes) {
+  int U = target.dims(0);
+  int B = target.dims(1);
+  int T = input.dims(1);
+
+  auto hy = vectorizedDecoderInput(target); // H x U x B
 
   Variable alpha, summaries;
   for (int i = 0; i < nAttnRound_; i++) {
@@ -230,6 +270,44 @@ std::pair<Variable, Variable> Seq2SeqCriterion::vectorizedDecoder(
   return std::make_pair(out, alpha);
 }
 
+std::pair<Variable, Variable> Seq2SeqCriterion::vectorizedRNNDecoder(
+    const Variable& input,
+    const Variable& target,
+    const af::array& inputSizes,
+    const af::array& targetSizes) {
+  int U = target.dims(0);
+  int B = target.dims(1);
+  int T = input.dims(1);
+
+  auto hy = vectorizedDecoderInput(target); // H x U x B
+  hy = reorder(hy, 0, 2, 1); // H x U x B -> H x B x U
+  hy = decodeRNN(0)->forward(hy);
+  hy = reorder(hy, 0, 2, 1); // H x B x U ->  H x U x B
+
+  // The attention and the window depend on the attention of the previous step
+  std::vector<Variable> summaryVec(U);
+  std::vector<Variable> alphaVec(U);
+  Variable alpha;
+  for (int u = 0; u < U; u++) {
+    Variable windowWeight;
+    if (window_ && (!train_ || trainWithWindow_)) {
+      windowWeight =
+          window_->computeWindow(alpha, u, U, T, B, inputSizes, targetSizes);
+    }
+    std::tie(alpha, summaryVec[u]) = attention(0)->forward(
+        hy(af::span, af::seq(u, u), af::span), // H x 1 x B
+        input,
+        alpha,
+        windowWeight,
+        fl::noGrad(inputSizes));
+    alphaVec[u] = alpha;
+  }
+  hy = hy + concatenate(summaryVec, 1);
+
+  auto out = linearOut()->forward(hy); // C x U x B
+  return std::make_pair(out, concatenate(alphaVec, 0)); // U x T x B
+}
+
 std::pair<Variable, Variable> Seq2SeqCriterion::decoder(
     const Variable& input,
     const Variable& target,
@@ -341,6 +419,99 @@ std::vector<int> Seq2SeqCriterion::beamPath(
   return beamPaths[0].path;
 }
 
+std::vector<std::vector<int>> Seq2SeqCriterion::batchedBeamPath(
+    const af::array& input,
+    const af::array& inputSizes,
+    int beamSize /* = 10 */) {
+  bool wasTrain = train_;
+  eval();
+  fl::NoGradGuard noGrad;
+
+  const float kNegInf = -std::numeric_limits<float>::infinity();
+  int H = input.dims(0), T = input.dims(1), N = input.dims(2), K = beamSize;
+  // Hypothesis k of utterance n is the hypothesis k + K * n of the batch
+  auto hypoInput = Variable(
+      af::moddims(
+          af::tile(af::moddims(input, H, T, 1, N), 1, 1, K), H, T, K * N),
+      false);
+  af::array hypoInputSizes;
+  if (!inputSizes.isempty()) {
+    hypoInputSizes = af::moddims(
+        af::tile(af::moddims(inputSizes, 1, 1, N), 1, K), 1, K * N);
+  }
+  auto hypoOffsets = af::tile(af::range(af::dim4(1, N), 1, s32) * K, K);
+
+  // Only the first hypothesis of each utterance is extended at the first step
+  auto scores = af::constant(kNegInf, K, N);
+  scores(0, af::span) = 0;
+  auto finished = af::constant(0, K, N, b8);
+  af::array paths; // steps x K * N
+  Seq2SeqState state(nAttnRound_);
+  Variable y, ox;
+  for (int l = 0; l < maxDecoderOutputLen_; l++) {
+    std::tie(ox, state) =
+        decodeStep(hypoInput, y, state, hypoInputSizes, af::array(), T);
+    auto logProbs = logSoftmax(ox, 0).array();
+    int C = logProbs.dims(0);
+    logProbs = af::moddims(logProbs, C, K, N);
+    // Finished hypotheses are only continued by eos, keeping their score
+    auto eosOnly = af::constant(kNegInf, C);
+    eosOnly(eos_) = 0;
+    logProbs = af::select(
+        af::tile(af::moddims(finished, 1, K, N), C),
+        af::tile(eosOnly, 1, K, N),
+        logProbs);
+    auto candidates = af::moddims(
+        logProbs + af::tile(af::moddims(scores, 1, K, N), C), C * K, N);
+
+    af::array topIdx;
+    af::topk(scores, topIdx, candidates, K, 0, AF_TOPK_MAX);
+    topIdx = topIdx.as(s32);
+    auto tokens = topIdx % C;
+    auto parents = af::flat(topIdx / C + hypoOffsets);
+    // Hypotheses without a finite score can't be extended
+    finished = af::moddims(af::lookup(af::flat(finished), parents), K, N) ||
+        tokens == eos_ || scores == kNegInf;
+
+    auto newTokens = af::moddims(tokens, 1, K * N);
+    paths = paths.isempty()
+        ? newTokens
+        : af::join(0, af::lookup(paths, parents, 1), newTokens);
+    state = detail::gatherState(state, parents);
+    y = Variable(newTokens, false);
+    if (af::allTrue<bool>(finished)) {
+      break;
+    }
+  }
+
+  auto hostScores = afToVector<float>(scores);
+  auto hostPaths = afToVector<int>(paths);
+  int nSteps = paths.dims(0);
+  std::vector<std::vector<int>> result(N);
+  for (int n = 0; n < N; n++) {
+    // The best hypothesis ended by eos, or the best one if none is
+    int best = -1;
+    bool bestEnded = false;
+    for (int k = 0; k < K; k++) {
+      int h = k + K * n;
+      const int* path = hostPaths.data() + h * nSteps;
+      bool ended = std::find(path, path + nSteps, eos_) != path + nSteps;
+      if (best < 0 || (ended && !bestEnded) ||
+          (ended == bestEnded && hostScores[h] > hostScores[best])) {
+        best = h;
+        bestEnded = ended;
+      }
+    }
+    const int* path = hostPaths.data() + best * nSteps;
+    result[n].assign(path, std::find(path, path + nSteps, eos_));
+  }
+
+  if (wasTrain) {
+    train();
+  }
+  return result;
+}
+
 // beam are candidates that need to be extended
 std::vector<Seq2SeqCriterion::CandidateHypo> Seq2SeqCriterion::beamSearch(
     const af::array& input, // H x T x 1
@@ -518,7 +689,30 @@ Seq2SeqCriterion::decodeBatchStep(
     const int attentionThreshold,
     const float smoothingTemperature) const {
   // NB: xEncoded has to be with batchsize 1
+  return decodeBatchStep(
+      std::vector<fl::Variable>{xEncoded},
+      std::vector<int>{static_cast<int>(ys.size())},
+      ys,
+      inStates,
+      attentionThreshold,
+      smoothingTemperature);
+}
+
+std::pair<std::vector<std::vector<float>>, std::vector<Seq2SeqStatePtr>>
+Seq2SeqCriterion::decodeBatchStep(
+    const std::vector<fl::Variable>& xEncoded,
+    const std::vector<int>& numHypotheses,
+    std::vector<fl::Variable>& ys,
+    const std::vector<Seq2SeqState*>& inStates,
+    const int attentionThreshold,
+    const float smoothingTemperature) const {
   int batchSize = ys.size();
+  if (xEncoded.size() != numHypotheses.size() ||
+      std::accumulate(numHypotheses.begin(), numHypotheses.end(), 0) !=
+          batchSize) {
+    throw std::invalid_argument(
+        "Seq2SeqCriterion::decodeBatchStep: invalid numbers of hypotheses");
+  }
   std::vector<Variable> statesVector(batchSize);
 
   // Batch Ys
@@ -544,12 +738,20 @@ Seq2SeqCriterion::decodeBatchStep(
 
   for (int n = 0; n < nAttnRound_; n++) {
     /* (1) RNN forward */
-    if (inStates[0]->hidden[n].isempty()) {
+    // Utterances at their first step have no hidden state yet: zeros, as
+    // when the RNN isn't given any, if others have one
+    Variable hiddenLike;
+    for (int i = 0; i < batchSize && hiddenLike.isempty(); i++) {
+      hiddenLike = inStates[i]->hidden[n];
+    }
+    if (hiddenLike.isempty()) {
       std::tie(yBatched, outStateBatched) =
           decodeRNN(n)->forward(yBatched, Variable());
     } else {
       for (int i = 0; i < batchSize; i++) {
-        statesVector[i] = inStates[i]->hidden[n];
+        statesVector[i] = inStates[i]->hidden[n].isempty()
+            ? fl::constant(0, hiddenLike.dims(), hiddenLike.type(), false)
+            : inStates[i]->hidden[n];
       }
       Variable inStateHiddenBatched = concatenate(statesVector, 1).linear();
       std::tie(yBatched, outStateBatched) =
@@ -560,31 +762,72 @@ Seq2SeqCriterion::decodeBatchStep(
       outstates[i]->hidden[n] = outStateBatched.col(i);
     }
 
-    /* (2) Attention forward */
-    if (window_ && (!train_ || trainWithWindow_)) {
-      throw std::runtime_error(
-          "Batched decoding does not support models with window");
-    }
+    /* (2) Attention forward, over the encoding of each utterance */
+    std::vector<Variable> summaries(xEncoded.size());
+    for (int u = 0, begin = 0; u < xEncoded.size();
+         begin += numHypotheses[u], u++) {
+      const int uttSize = numHypotheses[u];
+      if (uttSize == 0) {
+        continue;
+      }
+      const int end = begin + uttSize;
+      Variable yUtt = xEncoded.size() == 1
+          ? yBatched
+          : yBatched(af::span, af::seq(begin, end - 1));
+
+      Variable windowWeight;
+      if (window_ && (!train_ || trainWithWindow_)) {
+        // The windows of all the hypotheses, each at its own step, at once
+        int T = xEncoded[u].dims(1);
+        std::vector<int> steps(uttSize);
+        std::vector<Variable> prevAttns;
+        for (int i = begin; i < end; i++) {
+          steps[i - begin] = inStates[i]->step;
+          if (!inStates[i]->alpha.isempty()) {
+            prevAttns.push_back(inStates[i]->alpha);
+          }
+        }
+        Variable prevAttn;
+        if (prevAttns.size() == uttSize) {
+          prevAttn = moddims(concatenate(prevAttns, 1), {1, T, uttSize});
+        }
+        // TODO same as decodeStep(), the target size is forced to T
+        windowWeight = window_->computeBatchedWindow(prevAttn, steps, T, T);
+        // [1, T, B] -> [B, T, 1]: hypotheses are the decoder steps of the
+        // single utterance of xEncoded
+        windowWeight = reorder(windowWeight, 2, 1, 0);
+      }
 
-    Variable summaries, alphaBatched;
-    // NB:
-    // - Third Variable is set to empty since no attention use it.
-    // - Only ContentAttention is supported
-    std::tie(alphaBatched, summaries) =
-        attention(n)->forward(yBatched, xEncoded, Variable(), Variable());
-    alphaBatched = reorder(alphaBatched, 1, 0); // B x T -> T x B
-    yBatched = yBatched + summaries; // H x B
-
-    af::array bestpath, maxvalues;
-    af::max(maxvalues, bestpath, alphaBatched.array(), 0);
-    std::vector<int> maxIdx = afToVector<int>(bestpath);
+      Variable alphaBatched;
+      // NB:
+      // - Third Variable is set to empty since no attention use it.
+      // - Only ContentAttention is supported
+      std::tie(alphaBatched, summaries[u]) =
+          attention(n)->forward(yUtt, xEncoded[u], Variable(), windowWeight);
+      alphaBatched = reorder(alphaBatched, 1, 0); // B x T -> T x B
+
+      af::array bestpath, maxvalues;
+      af::max(maxvalues, bestpath, alphaBatched.array(), 0);
+      std::vector<int> maxIdx = afToVector<int>(bestpath);
+      for (int i = begin; i < end; i++) {
+        outstates[i]->peakAttnPos = maxIdx[i - begin];
+        // TODO: std::abs maybe unnecessary
+        outstates[i]->isValid =
+            std::abs(outstates[i]->peakAttnPos - inStates[i]->peakAttnPos) <=
+            attentionThreshold;
+        outstates[i]->alpha = alphaBatched.col(i - begin);
+      }
+    }
+    summaries.erase(
+        std::remove_if(
+            summaries.begin(),
+            summaries.end(),
+            [](const Variable& v) { return v.isempty(); }),
+        summaries.end());
+    yBatched = yBatched +
+        (summaries.size() == 1 ? summaries[0]
+                               : concatenate(summaries, 1)); // H x B
     for (int i = 0; i < batchSize; i++) {
-      outstates[i]->peakAttnPos = maxIdx[i];
-      // TODO: std::abs maybe unnecessary
-      outstates[i]->isValid =
-          std::abs(outstates[i]->peakAttnPos - inStates[i]->peakAttnPos) <=
-          attentionThreshold;
-      outstates[i]->alpha = alphaBatched.col(i);
       outstates[i]->summary = yBatched.col(i);
     }
   }
@@ -85,6 +85,19 @@ class Seq2SeqCriterion : public SequenceCriterion {
       const af::array& inputSizes,
       const af::array& targetSizes);
 
+  /**
+   * Teacher-forced decoder for attentions and windows depending on the
+   * previous attention, with a single round of attention and no input
+   * feeding: the attention doesn't feed back into the RNN input, so the RNN
+   * runs over the whole target sequence in one call and only the attention is
+   * stepped. Gives the same result as `decoder()`.
+   */
+  std::pair<fl::Variable, fl::Variable> vectorizedRNNDecoder(
+      const fl::Variable& input,
+      const fl::Variable& target,
+      const af::array& inputSizes,
+      const af::array& targetSizes);
+
   af::array viterbiPath(
       const af::array& input,
       const af::array& inputSizes = af::array()) override;
@@ -106,6 +119,23 @@ class Seq2SeqCriterion : public SequenceCriterion {
       const af::array& inputSizes,
       int beamSize = 10);
 
+  /**
+   * Beam search of a batch of utterances run on the device: the hypotheses of
+   * all utterances are decoded together as a beam x batch batch, the best
+   * continuations are selected with a top-k on the device and the decoder
+   * state is reordered by gathering the parents of the hypotheses. Finished
+   * hypotheses (ended by eos) stay in the beam with their final score.
+   *
+   * @param input encoded utterances of size H x T x B
+   * @param inputSizes sizes of the utterances of size 1 x B (optional)
+   * @param beamSize number of hypotheses per utterance, 1 for greedy decoding
+   * @return the best path of each utterance, without eos
+   */
+  std::vector<std::vector<int>> batchedBeamPath(
+      const af::array& input,
+      const af::array& inputSizes,
+      int beamSize = 10);
+
   std::string prettyString() const override;
 
   std::shared_ptr<fl::Embedding> embedding() const {
@@ -136,6 +166,21 @@ class Seq2SeqCriterion : public SequenceCriterion {
       const int attentionThreshold = std::numeric_limits<int>::infinity(),
       const float smoothingTemperature = 1.0) const;
 
+  /**
+   * Same as the decodeBatchStep() above for the hypotheses of several
+   * utterances: the first `numHypotheses[0]` ones attend to `xEncoded[0]`,
+   * the next `numHypotheses[1]` ones to `xEncoded[1]`... The RNN and linear
+   * layers run on all of them at once.
+   */
+  std::pair<std::vector<std::vector<float>>, std::vector<Seq2SeqStatePtr>>
+  decodeBatchStep(
+      const std::vector<fl::Variable>& xEncoded,
+      const std::vector<int>& numHypotheses,
+      std::vector<fl::Variable>& ys,
+      const std::vector<Seq2SeqState*>& inStates,
+      const int attentionThreshold = std::numeric_limits<int>::infinity(),
+      const float smoothingTemperature = 1.0) const;
+
   std::pair<fl::Variable, Seq2SeqState> decodeStep(
       const fl::Variable& xEncoded,
       const fl::Variable& y,
@@ -164,6 +209,9 @@ class Seq2SeqCriterion : public SequenceCriterion {
   }
 
  private:
+  // Start embedding and embeddings of the target (without eos), H x U x B
+  fl::Variable vectorizedDecoderInput(const fl::Variable& target);
+
   int eos_;
   int pad_;
   int maxDecoderOutputLen_;
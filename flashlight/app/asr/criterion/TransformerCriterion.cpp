@@ -19,6 +19,52 @@ namespace fl {
 namespace app {
 namespace asr {
 
+namespace {
+
+// Batched cache of the layer `layer` for the hypotheses continuing `states`:
+// a gather by parent index when the states were decoded in the same batch
+fl::TransformerKVCache gatherCache(
+    const std::vector<TS2SState*>& states,
+    int layer) {
+  if (states.empty() || !states[0]->cache) {
+    return fl::TransformerKVCache();
+  }
+  bool sameBatch = true;
+  std::vector<int> index;
+  for (const auto* state : states) {
+    sameBatch = sameBatch && state->cache == states[0]->cache;
+    index.push_back(state->cacheIndex);
+  }
+  if (sameBatch) {
+    return (*states[0]->cache)[layer].gather(
+        af::array(index.size(), index.data()));
+  }
+  std::vector<fl::TransformerKVCache> slices;
+  for (const auto* state : states) {
+    slices.push_back((*state->cache)[layer].slice(state->cacheIndex));
+  }
+  std::vector<const fl::TransformerKVCache*> slicePtrs;
+  for (const auto& slice : slices) {
+    slicePtrs.push_back(&slice);
+  }
+  return fl::TransformerKVCache::batch(slicePtrs);
+}
+
+// Precomputed encoder output of `states`, or of `xEncoded` if they have none
+std::shared_ptr<fl::Variable> precomputedEncoder(
+    const std::vector<const TS2SState*>& states,
+    const fl::Variable& xEncoded,
+    AttentionBase& attention) {
+  for (const auto* state : states) {
+    if (state->encoded) {
+      return state->encoded;
+    }
+  }
+  return std::make_shared<fl::Variable>(attention.precomputeEncoded(xEncoded));
+}
+
+} // namespace
+
 TransformerCriterion::TransformerCriterion(
     int nClass,
     int hiddenDim,
@@ -210,20 +256,13 @@ std::pair<Variable, TS2SState> TransformerCriterion::decodeStep(
 
   TS2SState outState;
   outState.step = inState.step + 1;
-  af::array padMask; // no mask because we are doing step by step decoding here,
-                     // no look in the future
+  // Decodes step by step, attending to the cached keys and values of the
+  // previous steps
+  outState.cache = inState.cache
+      ? std::make_shared<std::vector<fl::TransformerKVCache>>(*inState.cache)
+      : std::make_shared<std::vector<fl::TransformerKVCache>>(nLayer_);
   for (int i = 0; i < nLayer_; i++) {
-    if (inState.step == 0) {
-      outState.hidden.push_back(hy);
-      hy = layer(i)
-               ->forward(std::vector<Variable>({hy, fl::noGrad(padMask)}))
-               .front();
-    } else {
-      outState.hidden.push_back(concatenate({inState.hidden[i], hy}, 1));
-      hy = layer(i)
-               ->forward({inState.hidden[i], hy, fl::noGrad(padMask)})
-               .front();
-    }
+    hy = layer(i)->forwardIncremental(hy, (*outState.cache)[i]);
   }
 
   Variable windowWeight, alpha, summary;
@@ -240,8 +279,13 @@ std::pair<Variable, TS2SState> TransformerCriterion::decodeStep(
         af::array());
   }
 
-  std::tie(alpha, summary) = attention()->forward(
-      hy, xEncoded, Variable(), windowWeight, fl::noGrad(inputSizes));
+  outState.encoded = precomputedEncoder({&inState}, xEncoded, *attention());
+  std::tie(alpha, summary) = attention()->forwardPrecomputed(
+      hy,
+      *outState.encoded,
+      Variable(),
+      windowWeight,
+      fl::noGrad(inputSizes));
 
   hy = hy + summary;
 
@@ -275,32 +319,27 @@ TransformerCriterion::decodeBatchStep(
     outstates[i]->step = inStates[i]->step + 1;
   }
 
-  Variable outStateBatched;
+  auto cache = std::make_shared<std::vector<fl::TransformerKVCache>>();
   for (int i = 0; i < nLayer_; i++) {
-    if (inStates[0]->step == 0) {
-      for (int j = 0; j < B; j++) {
-        outstates[j]->hidden.push_back(yBatched.slice(j));
-      }
-      yBatched = layer(i)->forward(std::vector<Variable>({yBatched})).front();
-    } else {
-      std::vector<Variable> statesVector(B);
-      for (int j = 0; j < B; j++) {
-        statesVector[j] = inStates[j]->hidden[i];
-      }
-      Variable inStateHiddenBatched = concatenate(statesVector, 2);
-      auto tmp = std::vector<Variable>({inStateHiddenBatched, yBatched});
-      auto tmp2 = concatenate(tmp, 1);
-      for (int j = 0; j < B; j++) {
-        outstates[j]->hidden.push_back(tmp2.slice(j));
-      }
-      yBatched = layer(i)->forward(tmp).front();
-    }
+    cache->push_back(gatherCache(inStates, i));
+    yBatched = layer(i)->forwardIncremental(yBatched, cache->back());
+  }
+  // The hypotheses are the queries of a single attention to the encoder
+  // output, projected once per utterance
+  auto encoded = precomputedEncoder(
+      std::vector<const TS2SState*>(inStates.begin(), inStates.end()),
+      xEncoded,
+      *attention());
+  for (int i = 0; i < B; i++) {
+    outstates[i]->cache = cache;
+    outstates[i]->cacheIndex = i;
+    outstates[i]->encoded = encoded;
   }
 
   Variable alpha, summary;
   yBatched = moddims(yBatched, {yBatched.dims(0), -1});
-  std::tie(alpha, summary) =
-      attention()->forward(yBatched, xEncoded, Variable(), Variable());
+  std::tie(alpha, summary) = attention()->forwardPrecomputed(
+      yBatched, *encoded, Variable(), Variable(), Variable());
   alpha = reorder(alpha, 1, 0);
   yBatched = yBatched + summary;
 
@@ -387,7 +426,7 @@ AMUpdateFunc buildSeq2SeqTransformerAmUpdateFunction(
         if (prevState &&
             (lastIndexOfStatePtr.find(prevState) == lastIndexOfStatePtr.end() ||
              lastIndexOfStatePtr.find(prevState)->second == i)) {
-          prevState->hidden.clear();
+          prevState->cache.reset();
         }
       }
       start += step;
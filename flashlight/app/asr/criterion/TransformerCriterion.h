@@ -23,11 +23,19 @@ namespace asr {
 
 struct TS2SState {
   fl::Variable alpha;
-  std::vector<fl::Variable> hidden;
+  // Keys and values of the decoder layers for the decoded positions, shared by
+  // the hypotheses decoded in the same batch; the hypothesis is the element
+  // `cacheIndex` of this batch
+  std::shared_ptr<std::vector<fl::TransformerKVCache>> cache;
+  int cacheIndex;
+  // Encoder output as precomputed by the attention (e.g. its projected keys
+  // and values, see AttentionBase::precomputeEncoded()), computed at the
+  // first step and shared by all the hypotheses of the utterance
+  std::shared_ptr<fl::Variable> encoded;
   fl::Variable summary;
   int step;
 
-  TS2SState() : step(0) {}
+  TS2SState() : cacheIndex(0), step(0) {}
 };
 
 typedef std::shared_ptr<TS2SState> TS2SStatePtr;
@@ -73,6 +81,12 @@ class TransformerCriterion : public SequenceCriterion {
       const TS2SState& inState,
       const af::array& inputSizes) const;
 
+  /**
+   * Decodes the next step of the hypotheses `ys` continuing `inStates`, all
+   * of them from the encoder output `xEncoded` of batch 1. The encoder output
+   * is only projected by the attention at the first step: the states keep it
+   * for the next ones.
+   */
   std::pair<std::vector<std::vector<float>>, std::vector<TS2SStatePtr>>
   decodeBatchStep(
       const fl::Variable& xEncoded,
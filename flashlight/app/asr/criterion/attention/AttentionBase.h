@@ -68,6 +68,30 @@ class AttentionBase : public fl::Container {
     return forwardBase(state, xEncoded, prevAttn, logAttnWeight, xEncodedSizes);
   }
 
+  /**
+   * Precomputes what the attention derives from the encoder output alone,
+   * e.g. the projections of its keys and values, to attend to the same
+   * `xEncoded` at every decoding step with `forwardPrecomputed()`. By
+   * default, returns `xEncoded`.
+   */
+  virtual Variable precomputeEncoded(const Variable& xEncoded) {
+    return xEncoded;
+  }
+
+  /**
+   * Same as `forward()`, given `precomputeEncoded(xEncoded)` instead of
+   * `xEncoded`.
+   */
+  virtual std::pair<Variable, Variable> forwardPrecomputed(
+      const Variable& state,
+      const Variable& precomputed,
+      const Variable& prevAttn,
+      const Variable& logAttnWeight,
+      const Variable& xEncodedSizes) {
+    return forwardBase(
+        state, precomputed, prevAttn, logAttnWeight, xEncodedSizes);
+  }
+
  protected:
   /**
    * Forward pass
@@ -28,17 +28,12 @@ std::pair<Variable, Variable> ContentAttention::forwardBase(
   auto values = keyValue_ ? xEncoded(af::seq(dim / 2, dim - 1)) : xEncoded;
   // [targetlen, seqlen, batchsize]
   auto innerProd = matmulTN(state, keys) / std::sqrt(state.dims(0));
-  if (!logAttnWeight.isempty()) {
-    if (logAttnWeight.dims() != innerProd.dims()) {
-      throw std::invalid_argument(
-          "ContentAttention: logAttnWeight has wong dimentions");
-    }
-    innerProd = innerProd + logAttnWeight;
-  }
-  af::array padMask;
-  if (!xEncodedSizes.isempty()) {
-    innerProd = maskAttention(innerProd, xEncodedSizes);
+  if (!logAttnWeight.isempty() && logAttnWeight.dims() != innerProd.dims()) {
+    throw std::invalid_argument(
+        "ContentAttention: logAttnWeight has wong dimentions");
   }
+  // The window and the padding mask are applied at once
+  innerProd = maskAttention(innerProd, logAttnWeight, xEncodedSizes);
   // [targetlen, seqlen, batchsize]
   auto attention = softmax(innerProd, 1);
   // [hiddendim, targetlen, batchsize]
@@ -78,17 +73,12 @@ std::pair<Variable, Variable> NeuralContentAttention::forwardBase(
   auto hidden = tileHx + tileHy;
   // [targetlen, seqlen, batchsize]
   auto nnOut = moddims(module(0)->forward({hidden}).front(), {U, T, B});
-  if (!logAttnWeight.isempty()) {
-    if (logAttnWeight.dims() != nnOut.dims()) {
-      throw std::invalid_argument(
-          "ContentAttention: logAttnWeight has wong dimentions");
-    }
-    nnOut = nnOut + logAttnWeight;
-  }
-
-  if (!xEncodedSizes.isempty()) {
-    nnOut = maskAttention(nnOut, xEncodedSizes);
+  if (!logAttnWeight.isempty() && logAttnWeight.dims() != nnOut.dims()) {
+    throw std::invalid_argument(
+        "ContentAttention: logAttnWeight has wong dimentions");
   }
+  // The window and the padding mask are applied at once
+  nnOut = maskAttention(nnOut, logAttnWeight, xEncodedSizes);
   // [targetlen, seqlen, batchsize]
   auto attention = softmax(nnOut, 1);
   // [hiddendim, targetlen, batchsize]
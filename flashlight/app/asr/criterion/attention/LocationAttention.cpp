@@ -45,16 +45,12 @@ std::pair<Variable, Variable> SimpleLocationAttention::forwardBase(
     innerProd = innerProd + addAttn;
   }
 
-  if (!logAttnWeight.isempty()) {
-    if (logAttnWeight.dims() != innerProd.dims()) {
-      throw std::invalid_argument(
-          "SimpleLocationAttention: logAttnWeight has wong dimentions");
-    }
-    innerProd = innerProd + logAttnWeight;
-  }
-  if (!xEncodedSizes.isempty()) {
-    innerProd = maskAttention(innerProd, xEncodedSizes);
+  if (!logAttnWeight.isempty() && logAttnWeight.dims() != innerProd.dims()) {
+    throw std::invalid_argument(
+        "SimpleLocationAttention: logAttnWeight has wong dimentions");
   }
+  // The window and the padding mask are applied at once
+  innerProd = maskAttention(innerProd, logAttnWeight, xEncodedSizes);
   // [1, seqlen, batchsize]
   auto attention = softmax(innerProd, 1);
   // [hiddendim, 1, batchsize]
@@ -99,16 +95,12 @@ std::pair<Variable, Variable> LocationAttention::forwardBase(
     innerProd = innerProd + matmulTN(state, addAttn);
   }
 
-  if (!logAttnWeight.isempty()) {
-    if (logAttnWeight.dims() != innerProd.dims()) {
-      throw std::invalid_argument(
-          "LocationAttention: logAttnWeight has wong dimentions");
-    }
-    innerProd = innerProd + logAttnWeight;
-  }
-  if (!xEncodedSizes.isempty()) {
-    innerProd = maskAttention(innerProd, xEncodedSizes);
+  if (!logAttnWeight.isempty() && logAttnWeight.dims() != innerProd.dims()) {
+    throw std::invalid_argument(
+        "LocationAttention: logAttnWeight has wong dimentions");
   }
+  // The window and the padding mask are applied at once
+  innerProd = maskAttention(innerProd, logAttnWeight, xEncodedSizes);
   // [1, seqlen, batchsize]
   auto attention = softmax(innerProd, 1);
   // [hiddendim, 1, batchsize]
@@ -165,17 +157,12 @@ std::pair<Variable, Variable> NeuralLocationAttention::forwardBase(
   hidden = module(3)->forward({hidden}).front();
   auto nnOut = module(4)->forward({hidden}).front();
 
-  if (!logAttnWeight.isempty()) {
-    if (logAttnWeight.dims() != nnOut.dims()) {
-      throw std::invalid_argument(
-          "NeuralLocationAttention: logAttnWeight has wong dimentions");
-    }
-    nnOut = nnOut + logAttnWeight;
-  }
-
-  if (!xEncodedSizes.isempty()) {
-    nnOut = maskAttention(nnOut, xEncodedSizes);
+  if (!logAttnWeight.isempty() && logAttnWeight.dims() != nnOut.dims()) {
+    throw std::invalid_argument(
+        "NeuralLocationAttention: logAttnWeight has wong dimentions");
   }
+  // The window and the padding mask are applied at once
+  nnOut = maskAttention(nnOut, logAttnWeight, xEncodedSizes);
   // [1, seqlen, batchsize]
   auto attention = softmax(nnOut, 1);
   // [hiddendim, 1, batchsize]
@@ -34,6 +34,11 @@ class MedianWindow : public WindowBase {
       const af::array& inputSizes = af::array(),
       const af::array& targetSizes = af::array()) const override;
 
+  /* The window of a step depends on the attention of the previous one */
+  bool isVectorizable() const override {
+    return false;
+  }
+
  private:
   int wL_;
   int wR_;
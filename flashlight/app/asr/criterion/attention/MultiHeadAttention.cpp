@@ -9,6 +9,7 @@
 #include "flashlight/app/asr/criterion/attention/Utils.h"
 
 #include <cmath>
+#include <tuple>
 
 namespace fl {
 namespace app {
@@ -38,29 +39,77 @@ std::pair<Variable, Variable> MultiHeadContentAttention::forwardBase(
     const Variable& /* unused */,
     const Variable& logAttnWeight,
     const Variable& xEncodedSizes) {
-  int hEncode = xEncoded.dims(0);
-  int T = xEncoded.dims(1);
-  int hState = state.dims(0);
-  int U = state.dims(1);
-  int B = state.dims(2);
-  auto hiddenDim = hState / numHeads_;
-  if (hEncode != (1 + keyValue_) * hState) {
+  if (xEncoded.dims(0) != (1 + keyValue_) * state.dims(0)) {
     throw std::invalid_argument("Invalid input encoder dimension");
   }
+  Variable key, value;
+  std::tie(key, value) = keyValue(xEncoded);
+  return attend(state, key, value, logAttnWeight, xEncodedSizes);
+}
 
+Variable MultiHeadContentAttention::precomputeEncoded(
+    const Variable& xEncoded) {
+  if (splitInput_ && !keyValue_) {
+    return reorder(xEncoded, 1, 0, 2);
+  }
+  Variable key, value;
+  std::tie(key, value) = keyValue(xEncoded);
+  return concatenate({key, value}, 3);
+}
+
+std::pair<Variable, Variable> MultiHeadContentAttention::forwardPrecomputed(
+    const Variable& state,
+    const Variable& precomputed,
+    const Variable& /* unused */,
+    const Variable& logAttnWeight,
+    const Variable& xEncodedSizes) {
+  if (precomputed.dims(1) != state.dims(0) ||
+      precomputed.dims(2) != state.dims(2)) {
+    throw std::invalid_argument(
+        "MultiHeadContentAttention: invalid precomputed encoder dimensions");
+  }
+  if (precomputed.dims(3) == 1) {
+    return attend(
+        state, precomputed, precomputed, logAttnWeight, xEncodedSizes);
+  }
+  return attend(
+      state,
+      precomputed(af::span, af::span, af::span, 0),
+      precomputed(af::span, af::span, af::span, 1),
+      logAttnWeight,
+      xEncodedSizes);
+}
+
+std::pair<Variable, Variable> MultiHeadContentAttention::keyValue(
+    const Variable& xEncoded) {
+  int hEncode = xEncoded.dims(0);
   auto xEncodedKey =
       keyValue_ ? xEncoded(af::seq(0, hEncode / 2 - 1)) : xEncoded;
   auto xEncodedValue =
       keyValue_ ? xEncoded(af::seq(hEncode / 2, hEncode - 1)) : xEncoded;
 
-  auto query = splitInput_ ? state : module(0)->forward({state})[0];
   auto key = splitInput_ ? xEncodedKey : module(1)->forward({xEncodedKey})[0];
   auto value =
       splitInput_ ? xEncodedValue : module(2)->forward({xEncodedValue})[0];
+  return {reorder(key, 1, 0, 2), reorder(value, 1, 0, 2)};
+}
+
+std::pair<Variable, Variable> MultiHeadContentAttention::attend(
+    const Variable& state,
+    const Variable& keys,
+    const Variable& values,
+    const Variable& logAttnWeight,
+    const Variable& xEncodedSizes) {
+  int T = keys.dims(0);
+  int hState = state.dims(0);
+  int U = state.dims(1);
+  int B = state.dims(2);
+  auto hiddenDim = hState / numHeads_;
 
+  auto query = splitInput_ ? state : module(0)->forward({state})[0];
   query = moddims(reorder(query, 1, 0, 2), {U, hiddenDim, B * numHeads_});
-  key = moddims(reorder(key, 1, 0, 2), {T, hiddenDim, B * numHeads_});
-  value = moddims(reorder(value, 1, 0, 2), {T, hiddenDim, B * numHeads_});
+  auto key = moddims(keys, {T, hiddenDim, B * numHeads_});
+  auto value = moddims(values, {T, hiddenDim, B * numHeads_});
 
   // [U, T, B * numHeads_]
   auto innerProd =
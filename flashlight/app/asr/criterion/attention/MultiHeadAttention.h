@@ -29,12 +29,35 @@ class MultiHeadContentAttention : public AttentionBase {
       const Variable& logAttnWeight,
       const Variable& xEncodedSizes) override;
 
+  /**
+   * Keys and values of `xEncoded` (projected unless the input is split),
+   * of size T x dim x B x 2, or T x dim x B if they are the same.
+   */
+  Variable precomputeEncoded(const Variable& xEncoded) override;
+
+  std::pair<Variable, Variable> forwardPrecomputed(
+      const Variable& state,
+      const Variable& precomputed,
+      const Variable& prevAttn,
+      const Variable& logAttnWeight,
+      const Variable& xEncodedSizes) override;
+
   std::string prettyString() const override;
 
  private:
   int numHeads_;
   bool keyValue_;
   bool splitInput_;
+
+  // Keys and values of xEncoded, of size T x dim x B
+  std::pair<Variable, Variable> keyValue(const Variable& xEncoded);
+  std::pair<Variable, Variable> attend(
+      const Variable& state,
+      const Variable& keys,
+      const Variable& values,
+      const Variable& logAttnWeight,
+      const Variable& xEncodedSizes);
+
   FL_SAVE_LOAD_WITH_BASE(AttentionBase, numHeads_, keyValue_, splitInput_)
 };
 } // namespace asr
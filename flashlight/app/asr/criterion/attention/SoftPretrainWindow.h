@@ -33,6 +33,14 @@ class SoftPretrainWindow : public WindowBase {
       const af::array& inputSizes = af::array(),
       const af::array& targetSizes = af::array()) const override;
 
+  Variable computeBatchedWindow(
+      const Variable& prevAttn,
+      const std::vector<int>& steps,
+      int targetLen,
+      int inputSteps,
+      const af::array& inputSizes = af::array(),
+      const af::array& targetSizes = af::array()) const override;
+
  private:
   SoftPretrainWindow() = default;
 
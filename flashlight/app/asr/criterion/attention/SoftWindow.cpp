@@ -67,6 +67,24 @@ Variable SoftWindow::computeVectorizedWindow(
   return compute(
       targetLen, inputSteps, batchSize, inputSizes, targetSizes, decoderSteps);
 }
+
+Variable SoftWindow::computeBatchedWindow(
+    const Variable& /* unused */,
+    const std::vector<int>& steps,
+    int targetLen,
+    int inputSteps,
+    const af::array& inputSizes,
+    const af::array& targetSizes) const {
+  // Each hypothesis has its own decoder step
+  af::array decoderSteps = computeBatchedDecoderSteps(steps, inputSteps);
+  return compute(
+      targetLen,
+      inputSteps,
+      steps.size(),
+      inputSizes,
+      targetSizes,
+      decoderSteps);
+}
 } // namespace asr
 } // namespace app
 } // namespace fl
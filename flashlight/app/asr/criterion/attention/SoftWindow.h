@@ -34,6 +34,14 @@ class SoftWindow : public WindowBase {
       const af::array& inputSizes = af::array(),
       const af::array& targetSizes = af::array()) const override;
 
+  Variable computeBatchedWindow(
+      const Variable& prevAttn,
+      const std::vector<int>& steps,
+      int targetLen,
+      int inputSteps,
+      const af::array& inputSizes = af::array(),
+      const af::array& targetSizes = af::array()) const override;
+
  private:
   Variable compute(
       int targetLen,
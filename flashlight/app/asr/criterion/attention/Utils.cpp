@@ -15,27 +15,56 @@ namespace app {
 namespace asr {
 
 Variable maskAttention(const Variable& input, const Variable& sizes) {
+  return maskAttention(input, Variable(), sizes);
+}
+
+Variable maskAttention(
+    const Variable& input,
+    const Variable& logAttnWeight,
+    const Variable& sizes) {
+  if (!logAttnWeight.isempty() && logAttnWeight.dims() != input.dims()) {
+    throw std::invalid_argument(
+        "maskAttention: logAttnWeight has wrong dimensions");
+  }
+  if (logAttnWeight.isempty() && sizes.isempty()) {
+    return input;
+  }
   int B = input.dims(2);
   int T = input.dims(1);
-  // xEncodedSizes is (1, B) size
-  af::array inputNotPaddedSize =
-      af::ceil(sizes.array() / af::max<float>(sizes.array()) * T);
-  auto padMask = af::iota(af::dim4(T, 1), af::dim4(1, B)) >=
-      af::tile(inputNotPaddedSize, T, 1);
-  padMask =
-      af::tile(af::moddims(padMask, af::dim4(1, T, B)), input.dims(0), 1, 1);
 
   af::array output = input.array();
-  output(padMask) = kAttentionMaskValue;
+  if (!logAttnWeight.isempty()) {
+    output = output + logAttnWeight.array();
+  }
+  af::array padMask;
+  if (!sizes.isempty()) {
+    // xEncodedSizes is (1, B) size
+    af::array inputNotPaddedSize =
+        af::ceil(sizes.array() / af::max<float>(sizes.array()) * T);
+    padMask = af::iota(af::dim4(T, 1), af::dim4(1, B)) >=
+        af::tile(inputNotPaddedSize, T, 1);
+    padMask =
+        af::tile(af::moddims(padMask, af::dim4(1, T, B)), input.dims(0), 1, 1);
+    output = af::select(
+        padMask, static_cast<double>(kAttentionMaskValue), output);
+  }
 
+  std::vector<Variable> inputs = {input.withoutData()};
+  if (!logAttnWeight.isempty() && logAttnWeight.isCalcGrad()) {
+    inputs.push_back(logAttnWeight.withoutData());
+  }
   auto gradFunc = [padMask](
                       std::vector<Variable>& inputs,
                       const Variable& gradOutput) {
     af::array gradArray = gradOutput.array();
-    gradArray(padMask) = 0.;
-    inputs[0].addGrad(Variable(gradArray, false));
+    if (!padMask.isempty()) {
+      gradArray = af::select(padMask, 0.0, gradArray);
+    }
+    for (auto& in : inputs) {
+      in.addGrad(Variable(gradArray, false));
+    }
   };
-  return Variable(output, {input.withoutData()}, gradFunc);
+  return Variable(output, inputs, gradFunc);
 }
 } // namespace asr
 } // namespace app
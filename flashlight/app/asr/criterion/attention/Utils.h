@@ -16,6 +16,18 @@ namespace asr {
 fl::Variable maskAttention(
     const fl::Variable& input,
     const fl::Variable& sizes);
+
+/**
+ * Add the window `logAttnWeight` to the attention `input`
+ * [targetlen, seqlen, batchsize] and mask the padded steps given by `sizes`
+ * in a single op: no intermediate sum is stored for the backward pass and the
+ * padding is selected instead of scattered. Both `logAttnWeight` and `sizes`
+ * can be empty.
+ */
+fl::Variable maskAttention(
+    const fl::Variable& input,
+    const fl::Variable& logAttnWeight,
+    const fl::Variable& sizes);
 } // namespace asr
 } // namespace app
 } // namespace fl
@@ -7,6 +7,8 @@
 
 #include "flashlight/app/asr/criterion/attention/WindowBase.h"
 
+#include <algorithm>
+
 namespace fl {
 namespace app {
 namespace asr {
@@ -67,6 +69,48 @@ af::array WindowBase::computeTargetNotPaddedSize(
   return targetNotPaddedSize;
 }
 
+Variable WindowBase::computeBatchedWindow(
+    const Variable& prevAttn,
+    const std::vector<int>& steps,
+    int targetLen,
+    int inputSteps,
+    const af::array& inputSizes,
+    const af::array& targetSizes) const {
+  int batchSize = steps.size();
+  if (std::all_of(steps.begin(), steps.end(), [&steps](int step) {
+        return step == steps[0];
+      })) {
+    return computeWindow(
+        prevAttn,
+        steps[0],
+        targetLen,
+        inputSteps,
+        batchSize,
+        inputSizes,
+        targetSizes);
+  }
+  std::vector<Variable> windows(batchSize);
+  for (int b = 0; b < batchSize; b++) {
+    windows[b] = computeWindow(
+        prevAttn.isempty() ? Variable() : prevAttn(af::span, af::span, b),
+        steps[b],
+        targetLen,
+        inputSteps,
+        1,
+        inputSizes.isempty() ? af::array() : inputSizes(b),
+        targetSizes.isempty() ? af::array() : targetSizes(b));
+  }
+  return concatenate(windows, 2);
+}
+
+af::array WindowBase::computeBatchedDecoderSteps(
+    const std::vector<int>& steps,
+    int inputSteps) const {
+  af::array decoderSteps =
+      af::array(af::dim4(1, 1, steps.size()), steps.data()).as(f32);
+  return af::tile(decoderSteps, af::dim4(1, inputSteps, 1));
+}
+
 } // namespace asr
 } // namespace app
 } // namespace fl
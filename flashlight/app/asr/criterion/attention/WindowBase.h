@@ -62,6 +62,32 @@ class WindowBase {
       const af::array& inputSizes = af::array(),
       const af::array& targetSizes = af::array()) const = 0;
 
+  /**
+   * Compute window for a batch of hypotheses of the same utterance, each at
+   * its own decoder step (e.g. the hypotheses of a beam search), at once
+   * @param prevAttn previous step attention of the hypotheses, size is
+   * [1, inputSteps, batchSize]; can be empty at the first step
+   * @param steps decoder step of each hypothesis, batchSize values
+   * @param targetLen target size (max in the batch)
+   * @param inputSteps encoder output / decoder input length
+   * @param inputSizes same as in computeWindow(), for each hypothesis
+   * @param targetSizes same as in computeWindow(), for each hypothesis
+   * By default, hypotheses at the same step are computed with
+   * computeWindow() and the others one by one.
+   */
+  virtual Variable computeBatchedWindow(
+      const Variable& prevAttn,
+      const std::vector<int>& steps,
+      int targetLen,
+      int inputSteps,
+      const af::array& inputSizes = af::array(),
+      const af::array& targetSizes = af::array()) const;
+
+  /* If false, computeVectorizedWindow() isn't supported */
+  virtual bool isVectorizable() const {
+    return true;
+  }
+
   virtual ~WindowBase() {}
 
  protected:
@@ -99,6 +125,14 @@ class WindowBase {
       int batchSize,
       int decoderStepsDim) const;
 
+  /**
+   * Decoder steps of computeBatchedWindow() as the `decoderSteps` array of
+   * the windows, size is [1, inputSteps, batchSize]
+   */
+  af::array computeBatchedDecoderSteps(
+      const std::vector<int>& steps,
+      int inputSteps) const;
+
  private:
   FL_SAVE_LOAD()
 };
@@ -12,6 +12,7 @@
 using namespace fl;
 
 using CriterionUtils = fl::lib::cpu::CriterionUtils<float>;
+using fl::lib::cpu::criterionNumThreads;
 
 namespace fl {
 namespace app {
@@ -55,7 +56,7 @@ std::vector<Variable> ConnectionistTemporalClassificationCriterion::forward(
     CriterionUtils::computeScale(
         B, T, N, scaleMode_, batchTargetSizes.data(), batchScales.data());
 
-#pragma omp parallel for num_threads(B)
+#pragma omp parallel for num_threads(criterionNumThreads(B)) schedule(dynamic)
     for (int64_t b = 0; b < B; ++b) {
       const float* inputVec = batchInputVec.data() + b * N * T;
       const int* targetVec = batchTargetVec.data() + b * batchL;
@@ -138,7 +139,7 @@ std::vector<Variable> ConnectionistTemporalClassificationCriterion::forward(
     std::vector<float> batchOutGrad(gradOutput.elements());
     gradOutput.host(batchOutGrad.data());
 
-#pragma omp parallel for num_threads(B)
+#pragma omp parallel for num_threads(criterionNumThreads(B)) schedule(dynamic)
     for (int64_t b = 0; b < B; ++b) {
       const int* targetVec = batchTargetVec.data() + b * batchL;
       float* grad = batchInGrad.data() + b * N * T;
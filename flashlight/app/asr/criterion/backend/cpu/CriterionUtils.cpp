@@ -18,6 +18,10 @@ namespace fl {
 namespace app {
 namespace asr {
 
+namespace {
+thread_local CriterionWorkspace viterbiPathWorkspace;
+} // namespace
+
 af::array viterbiPath(const af::array& input, const af::array& trans) {
   auto B = input.dims(2);
   auto T = input.dims(1);
@@ -34,7 +38,8 @@ af::array viterbiPath(const af::array& input, const af::array& trans) {
   auto inputVec = fl::ext::afToVector<float>(input);
   auto transVec = fl::ext::afToVector<float>(trans);
   std::vector<int> pathVec(B * T);
-  std::vector<uint8_t> workspaceVec(ViterbiPath::getWorkspaceSize(B, T, N));
+  auto workspace = viterbiPathWorkspace.get<std::vector<uint8_t>>(
+      ViterbiPath::getWorkspaceSize(B, T, N));
 
   ViterbiPath::compute(
       B,
@@ -43,11 +48,15 @@ af::array viterbiPath(const af::array& input, const af::array& trans) {
       inputVec.data(),
       transVec.data(),
       pathVec.data(),
-      workspaceVec.data());
+      workspace->data());
 
   return af::array(T, B, pathVec.data());
 }
 
+void releaseViterbiPathWorkspace() {
+  viterbiPathWorkspace.release();
+}
+
 af::array getTargetSizeArray(const af::array& target, int maxSize) {
   int B = target.dims(1);
   int L = target.dims(0);
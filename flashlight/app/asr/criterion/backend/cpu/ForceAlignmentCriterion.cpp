@@ -19,7 +19,7 @@ namespace {
 struct Context {
   std::vector<int> targetVec;
   std::vector<int> targetSizeVec;
-  std::vector<uint8_t> workspaceVec;
+  std::shared_ptr<std::vector<uint8_t>> workspace;
 };
 } // namespace
 
@@ -53,7 +53,7 @@ static void backward(
       gradVec.data(),
       inputGradVec.data(),
       transGradVec.data(),
-      ctx->workspaceVec.data());
+      ctx->workspace->data());
 
   af::array inputGrad(N, T, B, inputGradVec.data());
   af::array transGrad(N, N, transGradVec.data());
@@ -89,7 +89,8 @@ Variable ForceAlignmentCriterion::forward(
   ctx->targetSizeVec = fl::ext::afToVector<int>(targetSize);
   auto transVec = fl::ext::afToVector<float>(transVar);
   std::vector<float> lossVec(B);
-  ctx->workspaceVec.assign(FAC::getWorkspaceSize(B, T, N, L), 0);
+  ctx->workspace =
+      workspace_.get<std::vector<uint8_t>>(FAC::getWorkspaceSize(B, T, N, L));
 
   FAC::forward(
       B,
@@ -102,7 +103,7 @@ Variable ForceAlignmentCriterion::forward(
       ctx->targetSizeVec.data(),
       transVec.data(),
       lossVec.data(),
-      ctx->workspaceVec.data());
+      ctx->workspace->data());
 
   return Variable(
       af::array(B, lossVec.data()),
@@ -135,7 +136,8 @@ af::array ForceAlignmentCriterion::viterbiPath(
   ctx->targetSizeVec = fl::ext::afToVector<int>(targetSize);
   std::vector<float> transVec = fl::ext::afToVector<float>(transVar);
   std::vector<float> lossVec(B);
-  ctx->workspaceVec.assign(FAC::getWorkspaceSize(B, T, N, L), 0);
+  ctx->workspace =
+      workspace_.get<std::vector<uint8_t>>(FAC::getWorkspaceSize(B, T, N, L));
   std::vector<int> bestPaths(B * T);
   FAC::viterbi(
       B,
@@ -147,7 +149,7 @@ af::array ForceAlignmentCriterion::viterbiPath(
       ctx->targetSizeVec.data(),
       transVec.data(),
       bestPaths.data(),
-      ctx->workspaceVec.data());
+      ctx->workspace->data());
   return af::array(T, B, bestPaths.data());
 }
 } // namespace asr
@@ -18,7 +18,7 @@ namespace {
 // By passing shared_ptr<Context> we avoid copies from forward to backward.
 struct Context {
   std::vector<float> transVec;
-  std::vector<uint8_t> workspaceVec;
+  std::shared_ptr<std::vector<uint8_t>> workspace;
 };
 } // namespace
 
@@ -49,7 +49,7 @@ static void backward(
       gradVec.data(),
       inputGradVec.data(),
       transGradVec.data(),
-      ctx->workspaceVec.data());
+      ctx->workspace->data());
 
   af::array inputGrad(N, T, B, inputGradVec.data());
   af::array transGrad(N, N, transGradVec.data());
@@ -81,7 +81,8 @@ Variable FullConnectionCriterion::forward(
   auto targetSizeVec = fl::ext::afToVector<int>(targetSize);
   ctx->transVec = fl::ext::afToVector<float>(transVar);
   std::vector<float> lossVec(B);
-  ctx->workspaceVec.assign(FCC::getWorkspaceSize(B, T, N), 0);
+  ctx->workspace =
+      workspace_.get<std::vector<uint8_t>>(FCC::getWorkspaceSize(B, T, N));
 
   FCC::forward(
       B,
@@ -92,7 +93,7 @@ Variable FullConnectionCriterion::forward(
       targetSizeVec.data(),
       ctx->transVec.data(),
       lossVec.data(),
-      ctx->workspaceVec.data());
+      ctx->workspace->data());
 
   return Variable(
       af::array(B, lossVec.data()),
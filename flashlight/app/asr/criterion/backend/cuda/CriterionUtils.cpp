@@ -19,6 +19,10 @@ namespace fl {
 namespace app {
 namespace asr {
 
+namespace {
+thread_local CriterionWorkspace viterbiPathWorkspace;
+} // namespace
+
 af::array viterbiPath(const af::array& input, const af::array& trans) {
   auto B = input.dims(2);
   auto T = input.dims(1);
@@ -33,13 +37,14 @@ af::array viterbiPath(const af::array& input, const af::array& trans) {
   }
 
   af::array path(T, B, s32);
-  af::array workspace(ViterbiPath::getWorkspaceSize(B, T, N), u8);
+  auto workspace = viterbiPathWorkspace.get<af::array>(
+      ViterbiPath::getWorkspaceSize(B, T, N));
 
   {
     fl::DevicePtr inputRaw(input);
     fl::DevicePtr transRaw(trans);
     fl::DevicePtr pathRaw(path);
-    fl::DevicePtr workspaceRaw(workspace);
+    fl::DevicePtr workspaceRaw(*workspace);
 
     ViterbiPath::compute(
         B,
@@ -55,6 +60,10 @@ af::array viterbiPath(const af::array& input, const af::array& trans) {
   return path;
 }
 
+void releaseViterbiPathWorkspace() {
+  viterbiPathWorkspace.release();
+}
+
 af::array getTargetSizeArray(const af::array& target, int maxSize) {
   int B = target.dims(1);
   int L = target.dims(0);
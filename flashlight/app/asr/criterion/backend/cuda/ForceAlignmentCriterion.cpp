@@ -83,7 +83,7 @@ Variable ForceAlignmentCriterion::forward(
   const auto& targetSize = getTargetSizeArray(target, T);
   const auto& trans = transVar.array();
   af::array loss(B, f32);
-  af::array workspace(FAC::getWorkspaceSize(B, T, N, L), u8);
+  auto workspace = workspace_.get<af::array>(FAC::getWorkspaceSize(B, T, N, L));
 
   {
     fl::DevicePtr inputRaw(input);
@@ -91,7 +91,7 @@ Variable ForceAlignmentCriterion::forward(
     fl::DevicePtr targetSizeRaw(targetSize);
     fl::DevicePtr transRaw(trans);
     fl::DevicePtr lossRaw(loss);
-    fl::DevicePtr workspaceRaw(workspace);
+    fl::DevicePtr workspaceRaw(*workspace);
 
     FAC::forward(
         B,
@@ -112,7 +112,7 @@ Variable ForceAlignmentCriterion::forward(
       loss,
       {inputVar.withoutData(), transVar.withoutData()},
       [=](std::vector<Variable>& inputs, const Variable& gradVar) mutable {
-        backward(inputs, gradVar, B, T, N, L, target, targetSize, workspace);
+        backward(inputs, gradVar, B, T, N, L, target, targetSize, *workspace);
       });
 }
 
@@ -138,7 +138,7 @@ af::array ForceAlignmentCriterion::viterbiPath(
   const auto& targetSize = getTargetSizeArray(target, T);
   const auto& trans = transVar.array();
   af::array bestPathsVar(T, B, s32);
-  af::array workspace(FAC::getWorkspaceSize(B, T, N, L), u8);
+  auto workspace = workspace_.get<af::array>(FAC::getWorkspaceSize(B, T, N, L));
 
   {
     fl::DevicePtr inputRaw(input);
@@ -147,7 +147,7 @@ af::array ForceAlignmentCriterion::viterbiPath(
     fl::DevicePtr transRaw(trans);
     fl::DevicePtr bestPathsRaw(bestPathsVar);
     ;
-    fl::DevicePtr workspaceRaw(workspace);
+    fl::DevicePtr workspaceRaw(*workspace);
 
     FAC::viterbiPath(
         B,
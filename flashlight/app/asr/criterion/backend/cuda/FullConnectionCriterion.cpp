@@ -77,14 +77,14 @@ Variable FullConnectionCriterion::forward(
   const auto& targetSize = getTargetSizeArray(target, T);
   const auto& trans = transVar.array();
   af::array loss(B, f32);
-  af::array workspace(FCC::getWorkspaceSize(B, T, N), u8);
+  auto workspace = workspace_.get<af::array>(FCC::getWorkspaceSize(B, T, N));
 
   {
     fl::DevicePtr inputRaw(input);
     fl::DevicePtr targetSizeRaw(targetSize);
     fl::DevicePtr transRaw(trans);
     fl::DevicePtr lossRaw(loss);
-    fl::DevicePtr workspaceRaw(workspace);
+    fl::DevicePtr workspaceRaw(*workspace);
 
     FCC::forward(
         B,
@@ -103,7 +103,7 @@ Variable FullConnectionCriterion::forward(
       loss,
       {inputVar.withoutData(), transVar.withoutData()},
       [=](std::vector<Variable>& inputs, const Variable& gradVar) mutable {
-        backward(inputs, gradVar, B, T, N, trans, workspace);
+        backward(inputs, gradVar, B, T, N, trans, *workspace);
       });
 }
 } // namespace asr
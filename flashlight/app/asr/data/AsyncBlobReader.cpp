@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/app/asr/data/AsyncBlobReader.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace fl {
+namespace app {
+namespace asr {
+
+namespace {
+
+std::mutex& blobStoresMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+std::unordered_map<std::string, BlobStoreFactory>& blobStores() {
+  static std::unordered_map<std::string, BlobStoreFactory> stores = {
+      {"file", []() { return std::make_shared<FileBlobStore>(); }}};
+  return stores;
+}
+
+} // namespace
+
+std::vector<std::string> FileBlobStore::fetch(
+    const std::vector<std::string>& keys) {
+  std::vector<std::string> blobs;
+  blobs.reserve(keys.size());
+  for (const auto& key : keys) {
+    std::ifstream file(key, std::ios::binary);
+    if (!file) {
+      throw std::runtime_error("[FileBlobStore] can't open " + key);
+    }
+    std::ostringstream blob;
+    blob << file.rdbuf();
+    blobs.push_back(blob.str());
+  }
+  return blobs;
+}
+
+void registerBlobStore(const std::string& name, BlobStoreFactory factory) {
+  std::lock_guard<std::mutex> lock(blobStoresMutex());
+  blobStores()[name] = std::move(factory);
+}
+
+std::shared_ptr<BlobStore> createBlobStore(const std::string& name) {
+  std::lock_guard<std::mutex> lock(blobStoresMutex());
+  auto it = blobStores().find(name);
+  if (it == blobStores().end()) {
+    throw std::invalid_argument("[createBlobStore] unknown storage: " + name);
+  }
+  return it->second();
+}
+
+AsyncBlobReader::AsyncBlobReader(
+    std::shared_ptr<BlobStore> store,
+    int maxInFlight /* = 8 */,
+    int maxBatchKeys /* = 16 */,
+    int64_t maxBlobs /* = 1024 */)
+    : store_(std::move(store)),
+      maxBatchKeys_(maxBatchKeys),
+      maxBlobs_(maxBlobs) {
+  if (!store_) {
+    throw std::invalid_argument("[AsyncBlobReader] null storage");
+  }
+  if (maxInFlight < 1 || maxBatchKeys < 1 || maxBlobs < 1) {
+    throw std::invalid_argument(
+        "[AsyncBlobReader] maxInFlight, maxBatchKeys and maxBlobs "
+        "must be positive");
+  }
+  for (int i = 0; i < maxInFlight; ++i) {
+    workers_.emplace_back([this]() { work(); });
+  }
+}
+
+AsyncBlobReader::~AsyncBlobReader() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  queueCv_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+void AsyncBlobReader::prefetch(const std::vector<std::string>& keys) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& key : keys) {
+      if (entries_.count(key)) {
+        continue;
+      }
+      evict();
+      if (entries_.size() >= maxBlobs_) {
+        // Everything is queued or in flight
+        break;
+      }
+      enqueue(key, false);
+    }
+  }
+  queueCv_.notify_all();
+}
+
+std::string AsyncBlobReader::get(const std::string& key) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    enqueue(key, true);
+    queueCv_.notify_one();
+  } else if (it->second.state == State::QUEUED) {
+    queue_.erase(std::find(queue_.begin(), queue_.end(), key));
+    queue_.push_front(key);
+  }
+
+  auto& entry = entries_[key];
+  ++entry.waiters;
+  doneCv_.wait(lock, [&entry]() { return entry.state == State::DONE; });
+  --entry.waiters;
+
+  auto error = entry.error;
+  std::string blob;
+  if (entry.waiters == 0) {
+    blob = std::move(entry.blob);
+    entries_.erase(key);
+  } else {
+    blob = entry.blob;
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  return blob;
+}
+
+AsyncBlobReader::Entry& AsyncBlobReader::enqueue(
+    const std::string& key,
+    bool front) {
+  auto& entry = entries_[key];
+  entry.id = nextId_++;
+  if (front) {
+    queue_.push_front(key);
+  } else {
+    queue_.push_back(key);
+  }
+  return entry;
+}
+
+void AsyncBlobReader::evict() {
+  while (entries_.size() >= maxBlobs_ && !done_.empty()) {
+    auto oldest = done_.front();
+    done_.pop_front();
+    auto it = entries_.find(oldest.second);
+    // Skips blobs read since, and blobs being read
+    if (it != entries_.end() && it->second.id == oldest.first &&
+        it->second.state == State::DONE && it->second.waiters == 0) {
+      entries_.erase(it);
+    }
+  }
+}
+
+void AsyncBlobReader::work() {
+  while (true) {
+    std::vector<std::string> keys;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      queueCv_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+      if (stop_) {
+        return;
+      }
+      while (!queue_.empty() && keys.size() < maxBatchKeys_) {
+        keys.push_back(queue_.front());
+        queue_.pop_front();
+        entries_[keys.back()].state = State::IN_FLIGHT;
+      }
+    }
+
+    std::vector<std::string> blobs;
+    std::exception_ptr error;
+    try {
+      blobs = store_->fetch(keys);
+      if (blobs.size() != keys.size()) {
+        throw std::runtime_error(
+            "[AsyncBlobReader] the storage must give a blob per key");
+      }
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (int i = 0; i < keys.size(); ++i) {
+        auto& entry = entries_[keys[i]];
+        entry.state = State::DONE;
+        if (error) {
+          entry.error = error;
+        } else {
+          entry.blob = std::move(blobs[i]);
+        }
+        done_.emplace_back(entry.id, keys[i]);
+      }
+    }
+    doneCv_.notify_all();
+  }
+}
+
+} // namespace asr
+} // namespace app
+} // namespace fl
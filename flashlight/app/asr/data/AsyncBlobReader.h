@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace fl {
+namespace app {
+namespace asr {
+
+/**
+ * A storage of blobs (e.g. audio files) by key: a file system, an object
+ * store, an HTTP server, a cache... Implementations should fetch the blobs of
+ * several keys in a single request when the storage allows it.
+ */
+class BlobStore {
+ public:
+  virtual ~BlobStore() = default;
+
+  /**
+   * Fetches the blobs of `keys`, in the same order. Called from several
+   * threads at a time. Throws if a blob can't be fetched.
+   */
+  virtual std::vector<std::string> fetch(
+      const std::vector<std::string>& keys) = 0;
+};
+
+/**
+ * Blobs are files, keys their path.
+ */
+class FileBlobStore : public BlobStore {
+ public:
+  std::vector<std::string> fetch(
+      const std::vector<std::string>& keys) override;
+};
+
+using BlobStoreFactory = std::function<std::shared_ptr<BlobStore>()>;
+
+/**
+ * Registers the storage `name` (e.g. "s3"), to be created with
+ * `createBlobStore()`. "file" is a `FileBlobStore`.
+ */
+void registerBlobStore(const std::string& name, BlobStoreFactory factory);
+
+std::shared_ptr<BlobStore> createBlobStore(const std::string& name);
+
+/**
+ * Fetches blobs of a `BlobStore` asynchronously, so that readers don't wait
+ * on the latency of the storage for blobs they announced with `prefetch()`.
+ *
+ * Keys to fetch are queued and fetched by `maxInFlight` threads, each with one
+ * request in flight at a time, which coalesces up to `maxBatchKeys` keys from
+ * the front of the queue. Blobs are kept until they are read with `get()`;
+ * `prefetch()` evicts the oldest of the blobs never read to keep at most
+ * `maxBlobs` blobs queued, in flight or fetched.
+ */
+class AsyncBlobReader {
+ public:
+  explicit AsyncBlobReader(
+      std::shared_ptr<BlobStore> store,
+      int maxInFlight = 8,
+      int maxBatchKeys = 16,
+      int64_t maxBlobs = 1024);
+
+  ~AsyncBlobReader();
+
+  /**
+   * Queues the keys not already queued, in flight or fetched. Doesn't block
+   * on the storage.
+   */
+  void prefetch(const std::vector<std::string>& keys);
+
+  /**
+   * Returns the blob of `key`, waiting for it to be fetched. A key not
+   * fetched yet is moved to the front of the queue. The blob is then
+   * forgotten: reading it again fetches it again.
+   */
+  std::string get(const std::string& key);
+
+ private:
+  enum class State { QUEUED, IN_FLIGHT, DONE };
+
+  struct Entry {
+    State state{State::QUEUED};
+    std::string blob;
+    std::exception_ptr error;
+    int waiters{0};
+    // Identifies the entry in `done_`, as a key may be fetched again
+    int64_t id{0};
+  };
+
+  // Requires mutex_ held
+  Entry& enqueue(const std::string& key, bool front);
+  void evict();
+
+  void work();
+
+  std::shared_ptr<BlobStore> store_;
+  const int maxBatchKeys_;
+  const int64_t maxBlobs_;
+
+  std::unordered_map<std::string, Entry> entries_;
+  std::deque<std::string> queue_;
+  // Fetched blobs not read yet, by (id, key), oldest first
+  std::deque<std::pair<int64_t, std::string>> done_;
+  int64_t nextId_{0};
+  bool stop_{false};
+  std::mutex mutex_;
+  std::condition_variable queueCv_;
+  std::condition_variable doneCv_;
+  std::vector<std::thread> workers_;
+};
+
+} // namespace asr
+} // namespace app
+} // namespace fl
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/app/asr/data/AsyncListFileDataset.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+#include "flashlight/app/asr/data/Sound.h"
+
+namespace fl {
+namespace app {
+namespace asr {
+
+AsyncListFileDataset::AsyncListFileDataset(
+    const std::string& filename,
+    std::shared_ptr<AsyncBlobReader> reader,
+    int64_t lookahead,
+    const DataTransformFunction& inFeatFunc /* = nullptr */,
+    const DataTransformFunction& tgtFeatFunc /* = nullptr */,
+    const DataTransformFunction& wrdFeatFunc /* = nullptr */)
+    : ListFileDataset(filename, inFeatFunc, tgtFeatFunc, wrdFeatFunc),
+      reader_(std::move(reader)),
+      lookahead_(lookahead) {
+  if (!reader_) {
+    throw std::invalid_argument("[AsyncListFileDataset] null reader");
+  }
+}
+
+void AsyncListFileDataset::setReadOrder(const std::vector<int64_t>& order) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  positions_.assign(size(), -1);
+  for (int64_t i = 0; i < order.size(); ++i) {
+    checkIndexBounds(order[i]);
+    positions_[order[i]] = i;
+  }
+  order_ = order;
+  prefetchEnd_ = 0;
+}
+
+std::pair<std::vector<float>, af::dim4> AsyncListFileDataset::loadInput(
+    const int64_t idx) const {
+  std::vector<std::string> keys;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t position = order_.empty() ? idx : positions_[idx];
+    int64_t numPositions = order_.empty() ? size() : order_.size();
+    if (position >= 0) {
+      // Samples are read a bit out of order by prefetch threads, or from the
+      // start again: doesn't request again what was just requested
+      int64_t end = std::min(position + 1 + lookahead_, numPositions);
+      int64_t begin = prefetchEnd_ > position && prefetchEnd_ <= end
+          ? prefetchEnd_
+          : position + 1;
+      for (int64_t i = begin; i < end; ++i) {
+        auto handle = getInput(order_.empty() ? i : order_[i]);
+        keys.push_back(parseSoundSegment(handle).path);
+      }
+      prefetchEnd_ = std::max(begin, end);
+    }
+  }
+  if (!keys.empty()) {
+    reader_->prefetch(keys);
+  }
+  return loadAudio(getInput(idx));
+}
+
+std::pair<std::vector<float>, af::dim4> AsyncListFileDataset::loadAudio(
+    const std::string& handle) const {
+  auto segment = parseSoundSegment(handle);
+  std::istringstream blob(reader_->get(segment.path));
+  auto info = loadSoundInfo(blob);
+  blob.clear();
+  blob.seekg(0);
+  if (segment.isWholeFile()) {
+    return {loadSound<float>(blob), {info.channels, info.frames}};
+  }
+  int64_t startFrame = std::llround(segment.offset * info.samplerate);
+  int64_t numFrames = segment.duration < 0
+      ? -1
+      : std::llround(segment.duration * info.samplerate);
+  auto audio = loadSoundRange<float>(blob, startFrame, numFrames);
+  dim_t frames = audio.size() / info.channels;
+  return {std::move(audio), {info.channels, frames}};
+}
+
+} // namespace asr
+} // namespace app
+} // namespace fl
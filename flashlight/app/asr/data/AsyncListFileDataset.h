@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "flashlight/app/asr/data/AsyncBlobReader.h"
+#include "flashlight/app/asr/data/ListFileDataset.h"
+
+namespace fl {
+namespace app {
+namespace asr {
+
+/**
+ * A `ListFileDataset` reading the audio files through an `AsyncBlobReader`:
+ * the paths of the input handles are keys of its storage. When sample `idx`
+ * is read, the audio of the `lookahead` samples following it in the read
+ * order (the order of indices, or the one given with `setReadOrder()`) is
+ * prefetched, so that reading them doesn't wait on the storage.
+ */
+class AsyncListFileDataset : public ListFileDataset {
+ public:
+  AsyncListFileDataset(
+      const std::string& filename,
+      std::shared_ptr<AsyncBlobReader> reader,
+      int64_t lookahead,
+      const DataTransformFunction& inFeatFunc = nullptr,
+      const DataTransformFunction& tgtFeatFunc = nullptr,
+      const DataTransformFunction& wrdFeatFunc = nullptr);
+
+  /**
+   * Sets the order in which samples are expected to be read, e.g. the
+   * permutation of the indices of a sampler. Indices not in `order` aren't
+   * prefetched. Must not be called while samples are read.
+   */
+  void setReadOrder(const std::vector<int64_t>& order);
+
+  std::pair<std::vector<float>, af::dim4> loadAudio(
+      const std::string& handle) const override;
+
+ protected:
+  std::pair<std::vector<float>, af::dim4> loadInput(
+      const int64_t idx) const override;
+
+ private:
+  std::shared_ptr<AsyncBlobReader> reader_;
+  int64_t lookahead_;
+  std::vector<int64_t> order_;
+  // Position in order_ of each index, -1 if not in it
+  std::vector<int64_t> positions_;
+  // End of the positions already prefetched
+  mutable int64_t prefetchEnd_{0};
+  mutable std::mutex mutex_;
+};
+
+} // namespace asr
+} // namespace app
+} // namespace fl
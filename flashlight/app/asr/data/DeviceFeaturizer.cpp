@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/app/asr/data/DeviceFeaturizer.h"
+
+#include <stdexcept>
+#include <vector>
+
+#include "flashlight/lib/audio/feature/Ceplifter.h"
+#include "flashlight/lib/audio/feature/Dct.h"
+#include "flashlight/lib/audio/feature/TriFilterbank.h"
+#include "flashlight/lib/audio/feature/Windowing.h"
+
+using namespace fl::lib::audio;
+
+namespace {
+
+// d(i) = SUM_t (t * (c(i + t) - c(i - t))) / (2 * SUM_t t^2) along the frames
+// (dim 1), clamped at the first and last frames, as `Derivatives`
+af::array derivative(const af::array& input, int window) {
+  int numFrames = input.dims(1);
+  auto frames = af::range(af::dim4(numFrames), 0, af::dtype::s32);
+  auto output = af::constant(0.0, input.dims());
+  for (int d = 1; d <= window; ++d) {
+    auto next = af::lookup(input, af::min(frames + d, numFrames - 1), 1);
+    auto prev = af::lookup(input, af::max(frames - d, 0), 1);
+    output += d * (next - prev);
+  }
+  float denominator = (window * (window + 1) * (2 * window + 1)) / 3.0;
+  return output / denominator;
+}
+
+// Windows of `localNormalize()`, from prefix sums over the frames
+af::array localNormalize(
+    const af::array& input,
+    int64_t leftCtxSize,
+    int64_t rightCtxSize) {
+  auto numFrames = input.dims(0);
+  auto perFrameSz = input.elements() / numFrames;
+  auto frames = af::moddims(input, af::dim4(numFrames, perFrameSz));
+  auto prefixSum = [](const af::array& x) {
+    return af::join(0, af::constant(0.0, 1), af::accum(x));
+  };
+  auto sum = prefixSum(af::sum(frames, 1));
+  auto sum2 = prefixSum(af::sum(frames * frames, 1));
+
+  auto idx = af::range(af::dim4(numFrames), 0, af::dtype::s32);
+  auto begin = af::max(idx - leftCtxSize, 0);
+  auto end = af::min(idx + rightCtxSize, numFrames - 1) + 1;
+  auto count = (end - begin).as(af::dtype::f32) * perFrameSz;
+  auto mean = (af::lookup(sum, end) - af::lookup(sum, begin)) / count;
+  auto stddev = af::sqrt(
+      (af::lookup(sum2, end) - af::lookup(sum2, begin)) / count - mean * mean);
+  stddev = af::select(stddev > 0.0, stddev, 1.0);
+
+  auto output = (frames - af::tile(mean, 1, perFrameSz)) /
+      af::tile(stddev, 1, perFrameSz);
+  return af::moddims(output, input.dims());
+}
+
+} // namespace
+
+namespace fl {
+namespace app {
+namespace asr {
+
+DeviceFeaturizer::DeviceFeaturizer(
+    const FeatureParams& params,
+    FeatureType featureType)
+    : params_(params), featureType_(featureType) {
+  if (featureType_ == FeatureType::NONE) {
+    return;
+  }
+  // Coefficients of the CPU stages, applied to ones or to the identity
+  int frameSize = params_.numFrameSizeSamples();
+  Windowing windowing(frameSize, params_.windowType);
+  window_ = af::array(
+      frameSize, windowing.apply(std::vector<float>(frameSize, 1.0)).data());
+  if (featureType_ == FeatureType::POW_SPECTRUM) {
+    return;
+  }
+
+  int numFilters = params_.numFilterbankChans;
+  int filterLen = params_.filterFreqResponseLen();
+  TriFilterbank triFltBank(
+      numFilters,
+      filterLen,
+      params_.samplingFreq,
+      params_.lowFreqFilterbank,
+      params_.highFreqFilterbank,
+      FrequencyScale::MEL);
+  // filterLen x numFilters (Row Major)
+  filterbank_ =
+      af::array(numFilters, filterLen, triFltBank.filterbank().data());
+  if (featureType_ == FeatureType::MFCC) {
+    int numCeps = params_.numCepstralCoeffs;
+    Dct dct(numFilters, numCeps);
+    std::vector<float> identity(numFilters * numFilters, 0.0);
+    for (int i = 0; i < numFilters; ++i) {
+      identity[i * numFilters + i] = 1.0;
+    }
+    dct_ = af::array(numCeps, numFilters, dct.apply(identity).data());
+    Ceplifter ceplifter(numCeps, params_.lifterParam);
+    lifter_ = af::array(
+        numCeps, ceplifter.apply(std::vector<float>(numCeps, 1.0)).data());
+  }
+}
+
+af::array DeviceFeaturizer::apply(const af::array& input) const {
+  if (input.type() != af::dtype::f32) {
+    throw std::invalid_argument("DeviceFeaturizer: invalid input type");
+  }
+  auto channels = input.dims(1);
+  if (featureType_ == FeatureType::NONE) {
+    return af::moddims(input, af::dim4(input.dims(0), 1, channels));
+  }
+  if (params_.numFrames(input.dims(0)) == 0) {
+    return af::array(af::dim4(0, featureSize(), channels), af::dtype::f32);
+  }
+
+  auto frames = frameSignal(input);
+  bool useEnergy =
+      params_.useEnergy && featureType_ != FeatureType::POW_SPECTRUM;
+  af::array energy;
+  if (useEnergy && params_.rawEnergy) {
+    energy = frameEnergy(frames);
+  }
+  preprocessFrames(frames);
+  if (useEnergy && !params_.rawEnergy) {
+    energy = frameEnergy(frames);
+  }
+
+  auto features = powerSpectrum(frames);
+  if (featureType_ != FeatureType::POW_SPECTRUM) {
+    features = mfsc(features);
+    if (featureType_ == FeatureType::MFCC) {
+      features = mfcc(features);
+      if (useEnergy) {
+        // Replace C0 with energy
+        features.row(0) = energy;
+      }
+    } else if (useEnergy) {
+      features = af::join(0, energy, features);
+    }
+    features = derivatives(features);
+  }
+  // From FEAT X FRAMES X CHANNELS to FRAMES X FEAT X CHANNELS (Col Major)
+  return af::reorder(features, 1, 0, 2);
+}
+
+int64_t DeviceFeaturizer::featureSize() const {
+  switch (featureType_) {
+    case FeatureType::POW_SPECTRUM:
+      return params_.powSpecFeatSz();
+    case FeatureType::MFSC:
+      return params_.mfscFeatSz();
+    case FeatureType::MFCC:
+      return params_.mfccFeatSz();
+    default:
+      return 1;
+  }
+}
+
+af::array DeviceFeaturizer::frameSignal(const af::array& input) const {
+  auto signal = af::moddims(input, af::dim4(input.dims(0), 1, input.dims(1)));
+  auto frames = af::unwrap(
+      signal,
+      params_.numFrameSizeSamples(),
+      1,
+      params_.numFrameStrideSamples(),
+      1);
+  // Samples as integers, as `frameSignal()` of lib/audio/feature
+  return frames * 32768.0;
+}
+
+af::array DeviceFeaturizer::frameEnergy(const af::array& frames) const {
+  return af::log(af::sum(frames * frames, 0));
+}
+
+void DeviceFeaturizer::preprocessFrames(af::array& frames) const {
+  if (params_.ditherVal != 0.0) {
+    frames += params_.ditherVal * af::randu(frames.dims());
+  }
+  if (params_.zeroMeanFrame) {
+    frames -= af::tile(af::mean(frames, 0), frames.dims(0));
+  }
+  if (params_.preemCoef != 0) {
+    // s'(n) = s(n) - k * s(n - 1), s'(0) = (1 - k) * s(0) in each frame
+    auto prev = af::shift(frames, 1);
+    prev.row(0) = frames.row(0);
+    frames -= params_.preemCoef * prev;
+  }
+  frames *= af::tile(window_, 1, frames.dims(1), frames.dims(2));
+}
+
+af::array DeviceFeaturizer::powerSpectrum(const af::array& frames) const {
+  // Zero-padded to nFft, K = nFft / 2 + 1 bins
+  auto spectrum = af::abs(af::fftR2C<1>(frames, af::dim4(params_.nFft())));
+  if (featureType_ != FeatureType::POW_SPECTRUM && params_.usePower) {
+    spectrum *= spectrum;
+  }
+  return spectrum;
+}
+
+af::array DeviceFeaturizer::mfsc(const af::array& spectrum) const {
+  auto dims = spectrum.dims();
+  auto output = af::matmul(
+      filterbank_, af::moddims(spectrum, af::dim4(dims[0], dims[1] * dims[2])));
+  output = af::log(af::max(output, params_.melFloor));
+  return af::moddims(output, af::dim4(output.dims(0), dims[1], dims[2]));
+}
+
+af::array DeviceFeaturizer::mfcc(const af::array& mfscFeat) const {
+  auto dims = mfscFeat.dims();
+  auto output = af::matmul(
+      dct_, af::moddims(mfscFeat, af::dim4(dims[0], dims[1] * dims[2])));
+  output *= af::tile(lifter_, 1, output.dims(1));
+  return af::moddims(output, af::dim4(output.dims(0), dims[1], dims[2]));
+}
+
+af::array DeviceFeaturizer::derivatives(const af::array& features) const {
+  // Derivatives will not be computed if windowsize <= 0
+  if (params_.deltaWindow <= 0) {
+    return features;
+  }
+  auto deltas = derivative(features, params_.deltaWindow);
+  if (params_.accWindow <= 0) {
+    return af::join(0, features, deltas);
+  }
+  return af::join(0, features, deltas, derivative(deltas, params_.accWindow));
+}
+
+af::array normalizeFeatures(
+    const af::array& features,
+    const std::pair<int, int>& localNormCtx) {
+  if (features.isempty()) {
+    return features;
+  }
+  if (localNormCtx.first > 0 || localNormCtx.second > 0) {
+    return localNormalize(features, localNormCtx.first, localNormCtx.second);
+  }
+  auto flat = af::flat(features);
+  auto output = flat - af::tile(af::mean(flat), flat.dims(0));
+  auto stddev = af::sqrt(af::mean(output * output));
+  stddev = af::select(stddev > 0.0, stddev, 1.0);
+  output /= af::tile(stddev, flat.dims(0));
+  return af::moddims(output, features.dims());
+}
+
+} // namespace asr
+} // namespace app
+} // namespace fl
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <arrayfire.h>
+
+#include "flashlight/app/asr/data/FeatureTransforms.h"
+#include "flashlight/lib/audio/feature/FeatureParams.h"
+
+namespace fl {
+namespace app {
+namespace asr {
+
+/**
+ * Computes the features of `lib/audio/feature` (power spectrum, MFSC or MFCC)
+ * with ArrayFire, on the device of the calling thread. Its stages are those
+ * of the CPU featurizers: framing, dithering, DC removal, pre-emphasis,
+ * windowing, FFT, triangular filterbank, DCT, liftering and derivatives, all
+ * applied to every frame and channel at once. Filterbank, DCT, window and
+ * lifter coefficients are taken from the CPU implementation, so that both
+ * paths give the same features up to the precision of the FFT (single
+ * precision on the device).
+ *
+ * Dithering noise is drawn from the ArrayFire random engine, so dithered
+ * features differ from the CPU ones.
+ */
+class DeviceFeaturizer {
+ public:
+  DeviceFeaturizer(
+      const lib::audio::FeatureParams& params,
+      FeatureType featureType);
+
+  /**
+   * @param[in] input Audio of dims T x CHANNELS (Col Major).
+   * @return Features of dims FRAMES x FEAT x CHANNELS (Col Major), as
+   * `computeFeatures()`. Raw audio (`FeatureType::NONE`) is returned as
+   * T x 1 x CHANNELS.
+   */
+  af::array apply(const af::array& input) const;
+
+  /// Number of features per frame and channel.
+  int64_t featureSize() const;
+
+ private:
+  lib::audio::FeatureParams params_;
+  FeatureType featureType_;
+  // Coefficients of the stages (Col Major)
+  af::array window_; // frame length
+  af::array filterbank_; // numFilterbankChans x filterFreqResponseLen
+  af::array dct_; // numCepstralCoeffs x numFilterbankChans
+  af::array lifter_; // numCepstralCoeffs
+
+  // FRAMELEN x FRAMES x CHANNELS frames of T x CHANNELS audio
+  af::array frameSignal(const af::array& input) const;
+  // Log energy of each frame, 1 x FRAMES x CHANNELS
+  af::array frameEnergy(const af::array& frames) const;
+  // Dithering, DC removal, pre-emphasis and windowing, in place
+  void preprocessFrames(af::array& frames) const;
+  // FEAT x FRAMES x CHANNELS magnitude (or power) spectrum of the frames
+  af::array powerSpectrum(const af::array& frames) const;
+  // FEAT x FRAMES x CHANNELS log mel filterbank energies of a spectrum
+  af::array mfsc(const af::array& spectrum) const;
+  // FEAT x FRAMES x CHANNELS liftered cepstral coefficients of MFSC features
+  af::array mfcc(const af::array& mfscFeat) const;
+  // Appends the derivatives of FEAT x FRAMES x CHANNELS features to them
+  af::array derivatives(const af::array& features) const;
+};
+
+/**
+ * Normalizes FRAMES x FEAT x CHANNELS features on the device, as
+ * `normalizeFeatures()` does on the host.
+ */
+af::array normalizeFeatures(
+    const af::array& features,
+    const std::pair<int, int>& localNormCtx);
+
+} // namespace asr
+} // namespace app
+} // namespace fl
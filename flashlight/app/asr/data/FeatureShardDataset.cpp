@@ -0,0 +1,335 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/app/asr/data/FeatureShardDataset.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "flashlight/app/asr/data/Utils.h"
+#include "flashlight/lib/common/String.h"
+#include "flashlight/lib/common/System.h"
+
+using namespace fl::lib;
+
+namespace {
+
+constexpr const char kMagic[8] = {'F', 'L', 'F', 'E', 'A', 'T', '0', '1'};
+
+struct Header {
+  char magic[8];
+  uint32_t type;
+  uint32_t reserved;
+  uint64_t numSamples;
+  uint64_t indexOffset;
+};
+
+struct IndexEntry {
+  uint64_t offset;
+  uint64_t bytes;
+  int64_t dims[3];
+  float size;
+  uint32_t lengths[3];
+};
+
+std::vector<char> encode(
+    const std::vector<float>& features,
+    int64_t numColumns,
+    fl::app::asr::FeatureShardType type) {
+  using fl::app::asr::FeatureShardType;
+  std::vector<char> bytes;
+  if (type == FeatureShardType::F32) {
+    bytes.resize(features.size() * sizeof(float));
+    std::memcpy(bytes.data(), features.data(), bytes.size());
+  } else if (type == FeatureShardType::F16) {
+    std::vector<uint16_t> half(features.size());
+    std::transform(
+        features.begin(),
+        features.end(),
+        half.begin(),
+        fl::app::asr::floatToHalf);
+    bytes.resize(half.size() * sizeof(uint16_t));
+    std::memcpy(bytes.data(), half.data(), bytes.size());
+  } else if (type == FeatureShardType::INT8) {
+    int64_t T = numColumns > 0 ? features.size() / numColumns : 0;
+    std::vector<float> minimum(numColumns), scale(numColumns);
+    std::vector<uint8_t> quantized(features.size());
+    for (int64_t c = 0; c < numColumns; ++c) {
+      auto begin = features.begin() + c * T;
+      auto range = std::minmax_element(begin, begin + T);
+      minimum[c] = T > 0 ? *range.first : 0;
+      scale[c] = T > 0 ? (*range.second - *range.first) / 255 : 0;
+      for (int64_t t = 0; t < T; ++t) {
+        quantized[c * T + t] = scale[c] > 0
+            ? std::lround((begin[t] - minimum[c]) / scale[c])
+            : 0;
+      }
+    }
+    size_t tableBytes = numColumns * sizeof(float);
+    bytes.resize(2 * tableBytes + quantized.size());
+    std::memcpy(bytes.data(), minimum.data(), tableBytes);
+    std::memcpy(bytes.data() + tableBytes, scale.data(), tableBytes);
+    std::memcpy(
+        bytes.data() + 2 * tableBytes, quantized.data(), quantized.size());
+  } else {
+    throw std::invalid_argument("[FeatureShardWriter] invalid shard type");
+  }
+  return bytes;
+}
+
+std::vector<float> decode(
+    const std::vector<char>& bytes,
+    const af::dim4& dims,
+    fl::app::asr::FeatureShardType type) {
+  using fl::app::asr::FeatureShardType;
+  std::vector<float> features(dims.elements());
+  size_t expectedBytes = 0;
+  int64_t numColumns = dims[1] * dims[2];
+  if (type == FeatureShardType::F32) {
+    expectedBytes = features.size() * sizeof(float);
+  } else if (type == FeatureShardType::F16) {
+    expectedBytes = features.size() * sizeof(uint16_t);
+  } else if (type == FeatureShardType::INT8) {
+    expectedBytes = 2 * numColumns * sizeof(float) + features.size();
+  }
+  if (bytes.size() != expectedBytes) {
+    throw std::runtime_error("[FeatureShardDataset] invalid sample size");
+  }
+
+  if (type == FeatureShardType::F32) {
+    std::memcpy(features.data(), bytes.data(), bytes.size());
+  } else if (type == FeatureShardType::F16) {
+    const char* data = bytes.data();
+    for (auto& feature : features) {
+      uint16_t half;
+      std::memcpy(&half, data, sizeof(half));
+      feature = fl::app::asr::halfToFloat(half);
+      data += sizeof(half);
+    }
+  } else {
+    std::vector<float> minimum(numColumns), scale(numColumns);
+    size_t tableBytes = numColumns * sizeof(float);
+    std::memcpy(minimum.data(), bytes.data(), tableBytes);
+    std::memcpy(scale.data(), bytes.data() + tableBytes, tableBytes);
+    auto quantized =
+        reinterpret_cast<const uint8_t*>(bytes.data() + 2 * tableBytes);
+    int64_t T = dims[0];
+    for (int64_t c = 0; c < numColumns; ++c) {
+      for (int64_t t = 0; t < T; ++t) {
+        features[c * T + t] = minimum[c] + scale[c] * quantized[c * T + t];
+      }
+    }
+  }
+  return features;
+}
+
+#ifndef _WIN32
+// Reads exactly `size` bytes at `offset`, pread() is safe to call from the
+// prefetching threads concurrently
+void readAt(int fd, char* data, size_t size, uint64_t offset) {
+  while (size > 0) {
+    auto n = ::pread(fd, data, size, offset);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      throw std::runtime_error("[FeatureShardDataset] could not read shard");
+    }
+    data += n;
+    size -= n;
+    offset += n;
+  }
+}
+#endif
+
+} // namespace
+
+namespace fl {
+namespace app {
+namespace asr {
+
+FeatureShardWriter::FeatureShardWriter(
+    const std::string& filename,
+    FeatureShardType type)
+    : filename_(filename), type_(type), file_(filename, std::ios::binary) {
+  if (!file_) {
+    throw std::invalid_argument("Unable to open file -" + filename);
+  }
+  Header header = {};
+  file_.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+  offset_ = sizeof(Header);
+}
+
+void FeatureShardWriter::add(
+    const ListFileRow& row,
+    const std::vector<float>& features,
+    const af::dim4& dims) {
+  if (features.size() != dims.elements() || dims[3] != 1) {
+    throw std::invalid_argument(
+        "[FeatureShardWriter] features should have dims "
+        "FRAMES x FEAT x CHANNELS");
+  }
+  auto bytes = encode(features, dims[1] * dims[2], type_);
+  file_.write(bytes.data(), bytes.size());
+  entries_.push_back(
+      {offset_, bytes.size(), {dims[0], dims[1], dims[2]}, row});
+  offset_ += bytes.size();
+}
+
+void FeatureShardWriter::close() {
+  for (const auto& entry : entries_) {
+    IndexEntry indexEntry = {};
+    indexEntry.offset = entry.offset;
+    indexEntry.bytes = entry.bytes;
+    std::copy_n(entry.dims, 3, indexEntry.dims);
+    indexEntry.size = entry.row.size;
+    indexEntry.lengths[0] = entry.row.id.size();
+    indexEntry.lengths[1] = entry.row.input.size();
+    indexEntry.lengths[2] = entry.row.transcript.size();
+    file_.write(reinterpret_cast<const char*>(&indexEntry), sizeof(IndexEntry));
+    file_.write(entry.row.id.data(), entry.row.id.size());
+    file_.write(entry.row.input.data(), entry.row.input.size());
+    file_.write(entry.row.transcript.data(), entry.row.transcript.size());
+  }
+
+  Header header = {};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.type = static_cast<uint32_t>(type_);
+  header.numSamples = entries_.size();
+  header.indexOffset = offset_;
+  file_.seekp(0);
+  file_.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+  file_.close();
+  if (!file_) {
+    throw std::runtime_error(
+        "[FeatureShardWriter] could not write " + filename_);
+  }
+}
+
+FeatureShardDataset::FeatureShardDataset(
+    const std::string& manifest,
+    const DataTransformFunction& inFeatFunc /* = nullptr */,
+    const DataTransformFunction& tgtFeatFunc /* = nullptr */,
+    const DataTransformFunction& wrdFeatFunc /* = nullptr */)
+    : ListFileDataset(inFeatFunc, tgtFeatFunc, wrdFeatFunc) {
+#ifdef _WIN32
+  throw std::runtime_error("FeatureShardDataset is not supported on Windows");
+#else
+  if (!isManifest(manifest)) {
+    throw std::invalid_argument(
+        "[FeatureShardDataset] invalid list of shards " + manifest);
+  }
+  auto lines = getFileContent(manifest);
+  for (size_t i = 1; i < lines.size(); ++i) {
+    auto shard = trim(lines[i]);
+    if (shard.empty()) {
+      continue;
+    }
+    if (shard[0] != pathSeperator()[0]) {
+      shard = pathsConcat(dirname(manifest), shard);
+    }
+    readShard(shard);
+  }
+  targetSizesCache_.resize(numRows_, -1);
+#endif
+}
+
+FeatureShardDataset::~FeatureShardDataset() {
+#ifndef _WIN32
+  for (auto fd : fds_) {
+    ::close(fd);
+  }
+#endif
+}
+
+bool FeatureShardDataset::isManifest(const std::string& filename) {
+  std::ifstream file(filename);
+  std::string line;
+  return std::getline(file, line) &&
+      trim(line) == kFeatureShardManifestHeader;
+}
+
+void FeatureShardDataset::readShard(const std::string& filename) {
+#ifndef _WIN32
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::invalid_argument("Unable to open file -" + filename);
+  }
+  int shard = fds_.size();
+  shards_.push_back(filename);
+  fds_.push_back(fd);
+
+  Header header;
+  readAt(fd, reinterpret_cast<char*>(&header), sizeof(Header), 0);
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.type > static_cast<uint32_t>(FeatureShardType::INT8)) {
+    throw std::runtime_error("[FeatureShardDataset] invalid shard " + filename);
+  }
+  // The index holds the rows, it is read at once
+  int64_t fileSize = ::lseek(fd, 0, SEEK_END);
+  if (header.indexOffset < sizeof(Header) || header.indexOffset > fileSize) {
+    throw std::runtime_error(
+        "[FeatureShardDataset] truncated shard " + filename);
+  }
+  std::vector<char> index(fileSize - header.indexOffset);
+  readAt(fd, index.data(), index.size(), header.indexOffset);
+  const char* data = index.data();
+  const char* end = data + index.size();
+  for (uint64_t i = 0; i < header.numSamples; ++i) {
+    IndexEntry entry;
+    if (end - data < static_cast<int64_t>(sizeof(IndexEntry))) {
+      throw std::runtime_error(
+          "[FeatureShardDataset] truncated shard " + filename);
+    }
+    std::memcpy(&entry, data, sizeof(IndexEntry));
+    data += sizeof(IndexEntry);
+    if (end - data < static_cast<int64_t>(entry.lengths[0]) +
+            entry.lengths[1] + entry.lengths[2]) {
+      throw std::runtime_error(
+          "[FeatureShardDataset] truncated shard " + filename);
+    }
+    ids_.emplace_back(data, entry.lengths[0]);
+    data += entry.lengths[0];
+    inputs_.emplace_back(data, entry.lengths[1]);
+    data += entry.lengths[1];
+    targets_.emplace_back(data, entry.lengths[2]);
+    data += entry.lengths[2];
+    inputSizes_.push_back(entry.size);
+    records_.push_back(
+        {shard,
+         static_cast<FeatureShardType>(header.type),
+         entry.offset,
+         entry.bytes,
+         af::dim4(entry.dims[0], entry.dims[1], entry.dims[2])});
+    ++numRows_;
+  }
+  // Batches read neighbouring samples
+  ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+}
+
+std::pair<std::vector<float>, af::dim4> FeatureShardDataset::loadInput(
+    const int64_t idx) const {
+  const auto& record = records_[idx];
+  std::vector<char> bytes(record.bytes);
+#ifndef _WIN32
+  readAt(fds_[record.shard], bytes.data(), bytes.size(), record.offset);
+#endif
+  return {decode(bytes, record.dims, record.type), record.dims};
+}
+
+} // namespace asr
+} // namespace app
+} // namespace fl
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "flashlight/app/asr/data/ListFileDataset.h"
+#include "flashlight/app/asr/data/ListFileIndex.h"
+
+namespace fl {
+namespace app {
+namespace asr {
+
+/// First line of a list of feature shards
+constexpr const char* kFeatureShardManifestHeader =
+    "# flashlight feature shards";
+
+/// Storage type of the features in a shard.
+enum class FeatureShardType : uint32_t {
+  F32 = 0,
+  /// IEEE half precision
+  F16 = 1,
+  /// 8 bits, with a linear scale per feature and channel of each sample
+  INT8 = 2,
+};
+
+/**
+ * Writes samples with their features into a shard file.
+ *
+ * Layout, in the byte order of the host:
+ *  - header: 8 bytes magic, uint32 type, uint32 reserved, uint64 number of
+ *    samples, uint64 offset of the index;
+ *  - features of each sample, FRAMES x FEAT x CHANNELS (Col Major); INT8
+ *    features are preceded by float minimum[FEAT x CHANNELS] and
+ *    scale[FEAT x CHANNELS];
+ *  - index: for each sample, uint64 offset and size of its features, int64
+ *    dims[3], float input size, uint32 lengths of the id, input handle and
+ *    transcription, followed by these strings.
+ */
+class FeatureShardWriter {
+ public:
+  FeatureShardWriter(const std::string& filename, FeatureShardType type);
+
+  /**
+   * Appends a sample.
+   * @param[in] row The row of the list file the sample comes from.
+   * @param[in] features Features of dims FRAMES x FEAT x CHANNELS.
+   * @param[in] dims Dimensions of `features`.
+   */
+  void add(
+      const ListFileRow& row,
+      const std::vector<float>& features,
+      const af::dim4& dims);
+
+  /// Writes the index and the header, the shard is invalid until then.
+  void close();
+
+ private:
+  struct Entry {
+    uint64_t offset;
+    uint64_t bytes;
+    int64_t dims[3];
+    ListFileRow row;
+  };
+
+  std::string filename_;
+  FeatureShardType type_;
+  std::ofstream file_;
+  uint64_t offset_;
+  std::vector<Entry> entries_;
+};
+
+/**
+ * Dataset of the samples of a list of feature shards, whose features are
+ * computed once by `fl_asr_write_feature_shards` instead of decoding and
+ * featurizing the audio at every epoch.
+ *
+ * The list (manifest) is a text file starting with the line
+ * `kFeatureShardManifestHeader`, followed by the paths of the shards, which
+ * are relative to the manifest directory if not absolute. It can be used
+ * anywhere a list file is expected.
+ *
+ * Samples are read with a single read of their features, given to
+ * `inFeatFunc` as a FRAMES x FEAT x CHANNELS f32 array (see
+ * `inputNormalization()`). Samples are written sorted by decreasing input
+ * size, so that the samples of a batch are contiguous in their shard. The
+ * outputs are the outputs of ListFileDataset.
+ */
+class FeatureShardDataset : public ListFileDataset {
+ public:
+  explicit FeatureShardDataset(
+      const std::string& manifest,
+      const DataTransformFunction& inFeatFunc = nullptr,
+      const DataTransformFunction& tgtFeatFunc = nullptr,
+      const DataTransformFunction& wrdFeatFunc = nullptr);
+
+  ~FeatureShardDataset() override;
+
+  /// Whether `filename` starts with `kFeatureShardManifestHeader`.
+  static bool isManifest(const std::string& filename);
+
+ protected:
+  std::pair<std::vector<float>, af::dim4> loadInput(
+      const int64_t idx) const override;
+
+ private:
+  struct Record {
+    int shard;
+    FeatureShardType type;
+    uint64_t offset;
+    uint64_t bytes;
+    af::dim4 dims;
+  };
+
+  std::vector<std::string> shards_;
+  std::vector<int> fds_;
+  std::vector<Record> records_;
+
+  void readShard(const std::string& filename);
+};
+
+} // namespace asr
+} // namespace app
+} // namespace fl
@@ -9,20 +9,25 @@
 
 #include <algorithm>
 #include <atomic>
+#include <cctype>
+#include <memory>
 #include <mutex>
 #include <stdexcept>
 #include <thread>
 
+#include "flashlight/app/asr/data/DeviceFeaturizer.h"
 #include "flashlight/app/asr/data/Utils.h"
 #include "flashlight/lib/audio/feature/Mfcc.h"
 #include "flashlight/lib/audio/feature/Mfsc.h"
 #include "flashlight/lib/audio/feature/PowerSpectrum.h"
 #include "flashlight/lib/common/String.h"
 #include "flashlight/lib/common/System.h"
+#include "flashlight/lib/text/dictionary/FrozenDictionary.h"
 
 using namespace fl::lib;
 using namespace fl::lib::audio;
 using fl::lib::text::Dictionary;
+using fl::lib::text::FrozenDictionary;
 using fl::lib::text::LexiconMap;
 using fl::lib::text::packReplabels;
 
@@ -55,15 +60,65 @@ namespace fl {
 namespace app {
 namespace asr {
 
+std::vector<float> computeFeatures(
+    const std::vector<float>& input,
+    int64_t channels,
+    const FeatureParams& params,
+    const FeatureType& featureType,
+    af::dim4& dims) {
+  std::vector<float> output;
+  int featSz = 1;
+  if (featureType == FeatureType::POW_SPECTRUM) {
+    thread_local PowerSpectrum powspec(params);
+    featSz = params.powSpecFeatSz();
+    output = powspec.batchApply(input, channels);
+  } else if (featureType == FeatureType::MFSC) {
+    thread_local Mfsc mfsc(params);
+    featSz = params.mfscFeatSz();
+    output = mfsc.batchApply(input, channels);
+  } else if (featureType == FeatureType::MFCC) {
+    thread_local Mfcc mfcc(params);
+    featSz = params.mfccFeatSz();
+    output = mfcc.batchApply(input, channels);
+  } else {
+    // use raw audio
+    output = input; // T X CHANNELS (Col Major)
+  }
+
+  auto T = output.size() / (featSz * channels);
+  dims = af::dim4(T, featSz, channels);
+  // From FEAT X FRAMES X CHANNELS to FRAMES X FEAT X CHANNELS (Col Major)
+  return transpose2d(output, T, featSz, channels);
+}
+
+std::vector<float> normalizeFeatures(
+    const std::vector<float>& features,
+    const af::dim4& dims,
+    const std::pair<int, int>& localNormCtx) {
+  if (localNormCtx.first > 0 || localNormCtx.second > 0) {
+    return localNormalize(
+        features, localNormCtx.first, localNormCtx.second, dims[0]);
+  }
+  return normalize(features);
+}
+
 fl::Dataset::DataTransformFunction inputFeatures(
     const FeatureParams& params,
     const FeatureType& featureType,
     const std::pair<int, int>& localNormCtx,
     const std::vector<sfx::SoundEffectConfig>& sfxConf /* = {} */,
-    const int sfxStartUpdate /* = 0 */) {
+    const int sfxStartUpdate /* = 0 */,
+    const bool onDevice /* = false */) {
   auto sfxCounter = std::make_shared<StartSfxCounter>(sfxStartUpdate);
-  return [params, featureType, localNormCtx, sfxConf, sfxCounter](
-             void* data, af::dim4 dims, af::dtype type) {
+  auto deviceFeaturizer = onDevice
+      ? std::make_shared<DeviceFeaturizer>(params, featureType)
+      : nullptr;
+  return [params,
+          featureType,
+          localNormCtx,
+          sfxConf,
+          sfxCounter,
+          deviceFeaturizer](void* data, af::dim4 dims, af::dtype type) {
     if (type != af::dtype::f32) {
       throw std::invalid_argument("Invalid input type");
     }
@@ -87,36 +142,31 @@ fl::Dataset::DataTransformFunction inputFeatures(
           sfx::createSoundEffect(sfxConf, seed);
       sfx->apply(input);
     }
-    std::vector<float> output;
-    int featSz = 1;
-    if (featureType == FeatureType::POW_SPECTRUM) {
-      thread_local PowerSpectrum powspec(params);
-      featSz = params.powSpecFeatSz();
-      output = powspec.batchApply(input, channels);
-    } else if (featureType == FeatureType::MFSC) {
-      thread_local Mfsc mfsc(params);
-      featSz = params.mfscFeatSz();
-      output = mfsc.batchApply(input, channels);
-    } else if (featureType == FeatureType::MFCC) {
-      thread_local Mfcc mfcc(params);
-      featSz = params.mfccFeatSz();
-      output = mfcc.batchApply(input, channels);
-    } else {
-      // use raw audio
-      output = input; // T X CHANNELS (Col Major)
+    if (deviceFeaturizer) {
+      // Only the raw audio is copied to the device
+      auto features = deviceFeaturizer->apply(
+          fl::hostToDevice(af::dim4(dims[1], channels), input.data()));
+      return normalizeFeatures(features, localNormCtx);
     }
+    af::dim4 featDims;
+    auto output =
+        computeFeatures(input, channels, params, featureType, featDims);
+    output = normalizeFeatures(output, featDims, localNormCtx);
+    return fl::hostToDevice(featDims, output.data());
+  };
+}
 
-    auto T = output.size() / (featSz * channels);
-    // Before: FEAT X FRAMES X CHANNELS  (Col Major)
-    output = transpose2d(output, T, featSz, channels);
-    // After: FRAMES X FEAT X CHANNELS  (Col Major)
-    if (localNormCtx.first > 0 || localNormCtx.second > 0) {
-      output =
-          localNormalize(output, localNormCtx.first, localNormCtx.second, T);
-    } else {
-      output = normalize(output);
+fl::Dataset::DataTransformFunction inputNormalization(
+    const std::pair<int, int>& localNormCtx) {
+  return [localNormCtx](void* data, af::dim4 dims, af::dtype type) {
+    if (type != af::dtype::f32) {
+      throw std::invalid_argument("Invalid input type");
     }
-    return af::array(T, featSz, channels, output.data());
+    std::vector<float> input(
+        static_cast<const float*>(data),
+        static_cast<const float*>(data) + dims.elements());
+    auto output = normalizeFeatures(input, dims, localNormCtx);
+    return fl::hostToDevice(dims, output.data());
   };
 }
 
@@ -125,7 +175,9 @@ fl::Dataset::DataTransformFunction targetFeatures(
     const Dictionary& tokenDict,
     const LexiconMap& lexicon,
     const TargetGenerationConfig& config) {
-  return [tokenDict, lexicon, config](
+  // Shared read-only by the threads of the dataset
+  auto frozenDict = std::make_shared<const FrozenDictionary>(tokenDict);
+  return [tokenDict, frozenDict, lexicon, config](
              void* data, af::dim4 dims, af::dtype /* unused */) {
     std::string transcript(
         static_cast<char*>(data), static_cast<char*>(data) + dims.elements());
@@ -139,11 +191,11 @@ fl::Dataset::DataTransformFunction targetFeatures(
         config.fallbackToLetterWordSepLeft_,
         config.fallbackToLetterWordSepRight_,
         config.skipUnk_);
-    auto tgtVec = tokenDict.mapEntriesToIndices(target);
+    auto tgtVec = frozenDict->mapEntriesToIndices(target);
     if (!config.surround_.empty()) {
       // add surround token at the beginning and end of target
       // only if begin/end tokens are not surround
-      auto idx = tokenDict.getIndex(config.surround_);
+      auto idx = frozenDict->getIndex(config.surround_);
       if (tgtVec.empty() || tgtVec.back() != idx) {
         tgtVec.emplace_back(idx);
       }
@@ -159,7 +211,7 @@ fl::Dataset::DataTransformFunction targetFeatures(
       dedup(tgtVec);
     }
     if (config.eosToken_) {
-      tgtVec.emplace_back(tokenDict.getIndex(kEosToken));
+      tgtVec.emplace_back(frozenDict->getIndex(kEosToken));
     }
     if (tgtVec.empty()) {
       // support empty target
@@ -170,11 +222,24 @@ fl::Dataset::DataTransformFunction targetFeatures(
 }
 
 fl::Dataset::DataTransformFunction wordFeatures(const Dictionary& wrdDict) {
-  return [wrdDict](void* data, af::dim4 dims, af::dtype /* unused */) {
-    std::string transcript(
-        static_cast<char*>(data), static_cast<char*>(data) + dims.elements());
-    auto words = splitOnWhitespace(transcript, true);
-    auto wrdVec = wrdDict.mapEntriesToIndices(words);
+  auto frozenDict = std::make_shared<const FrozenDictionary>(wrdDict);
+  return [frozenDict](void* data, af::dim4 dims, af::dtype /* unused */) {
+    // Words are looked up in place in the transcript
+    const char* transcript = static_cast<const char*>(data);
+    const size_t size = dims.elements();
+    std::vector<int> wrdVec;
+    size_t begin = 0;
+    for (size_t i = 0; i <= size; ++i) {
+      auto c = i < size ? static_cast<unsigned char>(transcript[i]) : ' ';
+      if (!std::isspace(c)) {
+        continue;
+      }
+      if (i > begin) {
+        wrdVec.emplace_back(
+            frozenDict->getIndex(transcript + begin, i - begin));
+      }
+      begin = i + 1;
+    }
     if (wrdVec.empty()) {
       // support empty target
       return af::array().as(s32);
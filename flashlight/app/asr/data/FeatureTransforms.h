@@ -64,12 +64,26 @@ struct TargetGenerationConfig {
   const bool fallbackToLetterWordSepRight_;
 };
 
+/**
+ * Featurizes and normalizes Channels x T audio. With `onDevice`, only the
+ * raw audio (after sound effects) is copied to the device, where it is
+ * featurized and normalized with ArrayFire (see `DeviceFeaturizer`) instead
+ * of on the CPU.
+ */
 fl::Dataset::DataTransformFunction inputFeatures(
     const lib::audio::FeatureParams& params,
     const FeatureType& featureType,
     const std::pair<int, int>& localNormCtx,
     const std::vector<sfx::SoundEffectConfig>& sfxConf = {},
-    const int sfxStartUpdate = 0 );
+    const int sfxStartUpdate = 0,
+    const bool onDevice = false);
+
+/**
+ * Applies the normalization of `inputFeatures()` to features already
+ * computed, of dims FRAMES x FEAT x CHANNELS (see `computeFeatures()`).
+ */
+fl::Dataset::DataTransformFunction inputNormalization(
+    const std::pair<int, int>& localNormCtx);
 
 fl::Dataset::DataTransformFunction targetFeatures(
     const lib::text::Dictionary& tokenDict,
@@ -81,6 +95,23 @@ fl::Dataset::DataTransformFunction wordFeatures(
 
 // ============================== Helper function ==============================
 
+/**
+ * Featurizes audio of dims T x CHANNELS (Col Major) as `inputFeatures()`
+ * does, without the normalization. Returns features of dims
+ * FRAMES x FEAT x CHANNELS (Col Major), set in `dims`.
+ */
+std::vector<float> computeFeatures(
+    const std::vector<float>& input,
+    int64_t channels,
+    const lib::audio::FeatureParams& params,
+    const FeatureType& featureType,
+    af::dim4& dims);
+
+std::vector<float> normalizeFeatures(
+    const std::vector<float>& features,
+    const af::dim4& dims,
+    const std::pair<int, int>& localNormCtx);
+
 // Input: B x inRow x inCol (Row Major), Output: B x inCol x inRow (Row Major)
 template <typename T>
 std::vector<T> transpose2d(
@@ -7,21 +7,14 @@
 
 #include "flashlight/app/asr/data/ListFileDataset.h"
 
+#include <cmath>
+
 #include "flashlight/app/asr/data/Sound.h"
 
 #include "flashlight/lib/common/String.h"
 
 using namespace fl::lib;
 
-namespace {
-constexpr const size_t kIdIdx = 0;
-constexpr const size_t kInIdx = 1;
-constexpr const size_t kSzIdx = 2;
-constexpr const size_t kTgtIdx = 3;
-constexpr const size_t kNumCols = 4;
-
-} // namespace
-
 namespace fl {
 namespace app {
 namespace asr {
@@ -34,6 +27,12 @@ ListFileDataset::ListFileDataset(
       tgtFeatFunc_(tgtFeatFunc),
       wrdFeatFunc_(wrdFeatFunc),
       numRows_(0) {
+  if (ListFileIndex::isIndex(filename)) {
+    index_ = std::make_shared<ListFileIndex>(filename);
+    numRows_ = index_->size();
+    targetSizesCache_.resize(numRows_, -1);
+    return;
+  }
   std::ifstream inFile(filename);
   if (!inFile) {
     throw std::invalid_argument("Unable to open file -" + filename);
@@ -43,25 +42,26 @@ ListFileDataset::ListFileDataset(
     if (line.empty()) {
       continue;
     }
-    auto splits = splitOnWhitespace(line, true);
-    if (splits.size() < 3) {
-      throw std::runtime_error(
-          "File " + filename +
-          " has invalid columns in line (expected 3 columns at least): " +
-          line);
-    }
-
-    ids_.emplace_back(std::move(splits[kIdIdx]));
-    inputs_.emplace_back(std::move(splits[kInIdx]));
-    inputSizes_.emplace_back(std::stof(splits[kSzIdx]));
-    targets_.emplace_back(fl::lib::join(
-        " ", std::vector<std::string>(splits.begin() + kTgtIdx, splits.end())));
+    auto row = parseListFileRow(line, filename);
+    ids_.emplace_back(std::move(row.id));
+    inputs_.emplace_back(std::move(row.input));
+    inputSizes_.emplace_back(row.size);
+    targets_.emplace_back(std::move(row.transcript));
     ++numRows_;
   }
   inFile.close();
   targetSizesCache_.resize(inputSizes_.size(), -1);
 }
 
+ListFileDataset::ListFileDataset(
+    const DataTransformFunction& inFeatFunc,
+    const DataTransformFunction& tgtFeatFunc,
+    const DataTransformFunction& wrdFeatFunc)
+    : inFeatFunc_(inFeatFunc),
+      tgtFeatFunc_(tgtFeatFunc),
+      wrdFeatFunc_(wrdFeatFunc),
+      numRows_(0) {}
+
 int64_t ListFileDataset::size() const {
   return numRows_;
 }
@@ -69,18 +69,22 @@ int64_t ListFileDataset::size() const {
 std::vector<af::array> ListFileDataset::get(const int64_t idx) const {
   checkIndexBounds(idx);
 
-  auto audio = loadAudio(inputs_[idx]); // channels x time
+  auto inputHandle = getInput(idx);
+  auto audio = loadInput(idx); // channels x time for audio
   af::array input;
   if (inFeatFunc_) {
     input = inFeatFunc_(
         static_cast<void*>(audio.first.data()), audio.second, af::dtype::f32);
   } else {
-    input = af::array(audio.second, audio.first.data());
+    input = fl::hostToDevice(audio.second, audio.first.data());
   }
 
+  std::vector<char> curTarget;
+  if (tgtFeatFunc_ || wrdFeatFunc_) {
+    curTarget = getTranscript(idx);
+  }
   af::array target;
   if (tgtFeatFunc_) {
-    std::vector<char> curTarget(targets_[idx].begin(), targets_[idx].end());
     target = tgtFeatFunc_(
         static_cast<void*>(curTarget.data()),
         {static_cast<dim_t>(curTarget.size())},
@@ -90,30 +94,47 @@ std::vector<af::array> ListFileDataset::get(const int64_t idx) const {
 
   af::array words;
   if (wrdFeatFunc_) {
-    std::vector<char> curTarget(targets_[idx].begin(), targets_[idx].end());
     words = wrdFeatFunc_(
         static_cast<void*>(curTarget.data()),
         {static_cast<dim_t>(curTarget.size())},
         af::dtype::b8);
   }
 
-  af::array sampleIdx = af::array(ids_[idx].length(), ids_[idx].data());
-  af::array samplePath = af::array(inputs_[idx].length(), inputs_[idx].data());
-  af::array sampleDuration = af::array(1, inputSizes_.data() + idx);
+  auto sampleId = getId(idx);
+  float inputSize = getInputSize(idx);
+  af::array sampleIdx = af::array(sampleId.length(), sampleId.data());
+  af::array samplePath = af::array(inputHandle.length(), inputHandle.data());
+  af::array sampleDuration = af::array(1, &inputSize);
   af::array sampleTargetSize = af::constant(float(target.elements()), 1);
 
   return {input, target, words, sampleIdx, samplePath, sampleDuration, sampleTargetSize};
 }
 
+std::pair<std::vector<float>, af::dim4> ListFileDataset::loadInput(
+    const int64_t idx) const {
+  return loadAudio(getInput(idx));
+}
+
 std::pair<std::vector<float>, af::dim4> ListFileDataset::loadAudio(
     const std::string& handle) const {
-  auto info = loadSoundInfo(handle.c_str());
-  return {loadSound<float>(handle.c_str()), {info.channels, info.frames}};
+  auto segment = parseSoundSegment(handle);
+  auto info = loadSoundInfo(segment.path);
+  if (segment.isWholeFile()) {
+    return {loadSound<float>(segment.path), {info.channels, info.frames}};
+  }
+  // Only the frames of the segment are decoded
+  int64_t startFrame = std::llround(segment.offset * info.samplerate);
+  int64_t numFrames = segment.duration < 0
+      ? -1
+      : std::llround(segment.duration * info.samplerate);
+  auto audio = loadSoundRange<float>(segment.path, startFrame, numFrames);
+  dim_t frames = audio.size() / info.channels;
+  return {std::move(audio), {info.channels, frames}};
 }
 
 float ListFileDataset::getInputSize(const int64_t idx) const {
   checkIndexBounds(idx);
-  return inputSizes_[idx];
+  return index_ ? index_->inputSize(idx) : inputSizes_[idx];
 }
 
 int64_t ListFileDataset::getTargetSize(const int64_t idx) const {
@@ -124,7 +145,7 @@ int64_t ListFileDataset::getTargetSize(const int64_t idx) const {
   if (!tgtFeatFunc_) {
     return 0;
   }
-  std::vector<char> curTarget(targets_[idx].begin(), targets_[idx].end());
+  auto curTarget = getTranscript(idx);
   auto tgtSize = tgtFeatFunc_(
                      static_cast<void*>(curTarget.data()),
                      {static_cast<dim_t>(curTarget.size())},
@@ -134,6 +155,23 @@ int64_t ListFileDataset::getTargetSize(const int64_t idx) const {
   return tgtSize;
 }
 
+std::string ListFileDataset::getId(const int64_t idx) const {
+  return index_ ? index_->id(idx) : ids_[idx];
+}
+
+std::string ListFileDataset::getInput(const int64_t idx) const {
+  return index_ ? index_->input(idx) : inputs_[idx];
+}
+
+std::vector<char> ListFileDataset::getTranscript(const int64_t idx) const {
+  if (index_) {
+    int64_t length;
+    const char* transcript = index_->transcript(idx, length);
+    return std::vector<char>(transcript, transcript + length);
+  }
+  return std::vector<char>(targets_[idx].begin(), targets_[idx].end());
+}
+
 } // namespace asr
 } // namespace app
 } // namespace fl
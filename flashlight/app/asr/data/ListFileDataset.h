@@ -10,6 +10,7 @@
 #include <unordered_map>
 #include <vector>
 
+#include "flashlight/app/asr/data/ListFileIndex.h"
 #include "flashlight/fl/flashlight.h"
 
 #include "flashlight/lib/text/dictionary/Dictionary.h"
@@ -25,7 +26,9 @@ namespace asr {
  * It accepts a input file consisting of several lines with each row of the
  * form 'utterance_id  input_handle size transcription' where
  * `sample_id` - unique id for the sample
- * `input_handle` - input audio file path.
+ * `input_handle` - input audio file path, or a segment of it as
+ *   `path:offset:duration` in seconds (see `SoundSegment`), of which only
+ *   the frames are decoded.
  * `size` - a real number used for sorting the dataset.
  * `transcription` - word transcrption for this sample
  *
@@ -37,7 +40,11 @@ namespace asr {
  *  train002 /tmp/000000000.flac 360.57  coca cola
  *  train003 /tmp/000000000.flac 123.53  hello world
  *  train004 /tmp/000000000.flac 999.99  quick brown fox jumped
+ *  train005 /tmp/000000001.flac:3600.5:12.25 12250  a segment of a long one
  *
+ * The file can also be a list compiled with `ListFileIndex::write()`, which
+ * is memory-mapped instead of parsed: transcriptions are then only read by
+ * `get()`.
  *
  * Calling `dataset.get(idx)` returns an af::array vector of size 4 - `input`,
  * `target`, `word_transcription`, `sample_id` in the same order.
@@ -63,6 +70,16 @@ class ListFileDataset : public fl::Dataset {
       const std::string& handle) const;
 
  protected:
+  // For subclasses filling the rows themselves
+  ListFileDataset(
+      const DataTransformFunction& inFeatFunc,
+      const DataTransformFunction& tgtFeatFunc,
+      const DataTransformFunction& wrdFeatFunc);
+
+  // Input given to `inFeatFunc_`, the audio of the row by default
+  virtual std::pair<std::vector<float>, af::dim4> loadInput(
+      const int64_t idx) const;
+
   DataTransformFunction inFeatFunc_, tgtFeatFunc_, wrdFeatFunc_;
   int64_t numRows_;
   std::vector<std::string> ids_;
@@ -70,6 +87,12 @@ class ListFileDataset : public fl::Dataset {
   std::vector<std::string> targets_;
   std::vector<float> inputSizes_;
   mutable std::vector<int64_t> targetSizesCache_;
+  // Rows of a compiled list, the vectors above are then empty
+  std::shared_ptr<ListFileIndex> index_;
+
+  std::string getId(const int64_t idx) const;
+  std::string getInput(const int64_t idx) const;
+  std::vector<char> getTranscript(const int64_t idx) const;
 };
 
 } // namespace asr
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/app/asr/data/ListFileIndex.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#include "flashlight/lib/common/String.h"
+
+using namespace fl::lib;
+
+namespace {
+constexpr const size_t kIdIdx = 0;
+constexpr const size_t kInIdx = 1;
+constexpr const size_t kSzIdx = 2;
+constexpr const size_t kTgtIdx = 3;
+
+constexpr const char kMagic[8] = {'F', 'L', 'L', 'S', 'T', 'I', 'X', '1'};
+
+struct Header {
+  char magic[8];
+  uint64_t numRows;
+  uint64_t poolSize;
+};
+
+int64_t padTo8(int64_t size) {
+  return (size + 7) / 8 * 8;
+}
+
+} // namespace
+
+namespace fl {
+namespace app {
+namespace asr {
+
+ListFileRow parseListFileRow(
+    const std::string& line,
+    const std::string& filename) {
+  auto splits = splitOnWhitespace(line, true);
+  if (splits.size() < 3) {
+    throw std::runtime_error(
+        "File " + filename +
+        " has invalid columns in line (expected 3 columns at least): " + line);
+  }
+  ListFileRow row;
+  row.id = std::move(splits[kIdIdx]);
+  row.input = std::move(splits[kInIdx]);
+  row.size = std::stof(splits[kSzIdx]);
+  row.transcript = fl::lib::join(
+      " ", std::vector<std::string>(splits.begin() + kTgtIdx, splits.end()));
+  return row;
+}
+
+ListFileIndex::ListFileIndex(const std::string& filename)
+    : filename_(filename) {
+  mapping_ = std::make_unique<MemoryMappedFile>(filename_);
+  data_ = mapping_->data();
+  fileSize_ = mapping_->size();
+  if (fileSize_ < sizeof(Header)) {
+    throw std::runtime_error("[ListFileIndex] truncated index " + filename);
+  }
+#ifndef _WIN32
+  // Rows are read in the order of the batches, which is random
+  ::madvise(const_cast<char*>(data_), fileSize_, MADV_RANDOM);
+#endif
+
+  Header header;
+  std::memcpy(&header, data_, sizeof(Header));
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+    throw std::runtime_error("[ListFileIndex] invalid index " + filename);
+  }
+  numRows_ = header.numRows;
+  poolSize_ = header.poolSize;
+  int64_t sizesOffset = sizeof(Header) + padTo8(poolSize_);
+  int64_t offsetsOffset = sizesOffset + padTo8(numRows_ * sizeof(float));
+  if (offsetsOffset + (numRows_ + 1) * sizeof(uint64_t) != fileSize_) {
+    throw std::runtime_error("[ListFileIndex] truncated index " + filename);
+  }
+  pool_ = data_ + sizeof(Header);
+  sizes_ = reinterpret_cast<const float*>(data_ + sizesOffset);
+  offsets_ = reinterpret_cast<const uint64_t*>(data_ + offsetsOffset);
+}
+
+bool ListFileIndex::isIndex(const std::string& filename) {
+  std::ifstream file(filename, std::ios::binary);
+  char magic[sizeof(kMagic)];
+  if (!file.read(magic, sizeof(magic))) {
+    return false;
+  }
+  return std::memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+}
+
+int64_t ListFileIndex::write(
+    const std::string& listFilename,
+    const std::string& indexFilename) {
+  std::ifstream inFile(listFilename);
+  if (!inFile) {
+    throw std::invalid_argument("Unable to open file -" + listFilename);
+  }
+  std::ofstream outFile(indexFilename, std::ios::binary);
+  if (!outFile) {
+    throw std::invalid_argument("Unable to open file -" + indexFilename);
+  }
+
+  // The pool is streamed, tables are written once all the rows are known
+  Header header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  outFile.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+  std::vector<float> sizes;
+  std::vector<uint64_t> offsets = {0};
+  std::string line;
+  while (std::getline(inFile, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    auto row = parseListFileRow(line, listFilename);
+    outFile.write(row.id.c_str(), row.id.size() + 1);
+    outFile.write(row.input.c_str(), row.input.size() + 1);
+    outFile.write(row.transcript.data(), row.transcript.size());
+    sizes.push_back(row.size);
+    offsets.push_back(
+        offsets.back() + row.id.size() + row.input.size() + 2 +
+        row.transcript.size());
+  }
+  const char padding[8] = {};
+  outFile.write(padding, padTo8(offsets.back()) - offsets.back());
+  int64_t sizesBytes = sizes.size() * sizeof(float);
+  outFile.write(reinterpret_cast<const char*>(sizes.data()), sizesBytes);
+  outFile.write(padding, padTo8(sizesBytes) - sizesBytes);
+  outFile.write(
+      reinterpret_cast<const char*>(offsets.data()),
+      offsets.size() * sizeof(uint64_t));
+
+  header.numRows = sizes.size();
+  header.poolSize = offsets.back();
+  outFile.seekp(0);
+  outFile.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+  if (!outFile) {
+    throw std::runtime_error(
+        "[ListFileIndex] could not write " + indexFilename);
+  }
+  return sizes.size();
+}
+
+int64_t ListFileIndex::size() const {
+  return numRows_;
+}
+
+float ListFileIndex::inputSize(int64_t idx) const {
+  if (idx < 0 || idx >= numRows_) {
+    throw std::out_of_range("[ListFileIndex] index out of range");
+  }
+  return sizes_[idx];
+}
+
+const char*
+ListFileIndex::field(int64_t idx, int field, int64_t& length) const {
+  if (idx < 0 || idx >= numRows_) {
+    throw std::out_of_range("[ListFileIndex] index out of range");
+  }
+  uint64_t begin = offsets_[idx], end = offsets_[idx + 1];
+  if (begin > end || end > poolSize_) {
+    throw std::runtime_error("[ListFileIndex] corrupted index " + filename_);
+  }
+  const char* data = pool_ + begin;
+  const char* rowEnd = pool_ + end;
+  // The id and the input handle are null-terminated
+  for (int i = 0; i <= std::min(field, 1); ++i) {
+    auto fieldEnd =
+        static_cast<const char*>(std::memchr(data, '\0', rowEnd - data));
+    if (!fieldEnd) {
+      throw std::runtime_error("[ListFileIndex] corrupted index " + filename_);
+    }
+    if (i == field) {
+      length = fieldEnd - data;
+      return data;
+    }
+    data = fieldEnd + 1;
+  }
+  length = rowEnd - data;
+  return data;
+}
+
+std::string ListFileIndex::id(int64_t idx) const {
+  int64_t length;
+  const char* data = field(idx, 0, length);
+  return std::string(data, length);
+}
+
+std::string ListFileIndex::input(int64_t idx) const {
+  int64_t length;
+  const char* data = field(idx, 1, length);
+  return std::string(data, length);
+}
+
+const char* ListFileIndex::transcript(int64_t idx, int64_t& length) const {
+  return field(idx, 2, length);
+}
+
+} // namespace asr
+} // namespace app
+} // namespace fl
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "flashlight/lib/common/System.h"
+
+namespace fl {
+namespace app {
+namespace asr {
+
+/**
+ * A row of a list file: 'sample_id input_handle size transcription'.
+ */
+struct ListFileRow {
+  std::string id;
+  std::string input;
+  float size;
+  std::string transcript;
+};
+
+/**
+ * Parses a non-empty row of the list file `filename`, throws if it has less
+ * than 3 columns.
+ */
+ListFileRow parseListFileRow(
+    const std::string& line,
+    const std::string& filename);
+
+/**
+ * Compiled list file, memory-mapped read-only so that opening it does not
+ * parse nor copy anything, and processes reading the same file share its
+ * pages. It is created from a list file with `ListFileIndex::write()`, or the
+ * `fl_asr_list_to_index` tool.
+ *
+ * Layout, in the byte order of the host:
+ *  - header: 8 bytes magic, uint64 number of rows N, uint64 string pool size;
+ *  - string pool: for each row 'sample_id\0input_handle\0transcription',
+ *    padded to 8 bytes;
+ *  - float sizes[N], padded to 8 bytes;
+ *  - uint64 offsets[N + 1] of the rows in the string pool.
+ */
+class ListFileIndex {
+ public:
+  explicit ListFileIndex(const std::string& filename);
+
+  ListFileIndex(const ListFileIndex&) = delete;
+  ListFileIndex& operator=(const ListFileIndex&) = delete;
+
+  /// Whether `filename` starts with the magic of the format.
+  static bool isIndex(const std::string& filename);
+
+  /**
+   * Compiles the list file `listFilename` into `indexFilename`, reading it
+   * line by line. Returns the number of rows.
+   */
+  static int64_t write(
+      const std::string& listFilename,
+      const std::string& indexFilename);
+
+  int64_t size() const;
+
+  float inputSize(int64_t idx) const;
+
+  std::string id(int64_t idx) const;
+
+  std::string input(int64_t idx) const;
+
+  /**
+   * Returns the transcription of the row, which is not null-terminated, and
+   * sets `length` to its length. It points into the mapping.
+   */
+  const char* transcript(int64_t idx, int64_t& length) const;
+
+ private:
+  std::string filename_;
+  std::unique_ptr<fl::lib::MemoryMappedFile> mapping_;
+  const char* data_{nullptr};
+  int64_t fileSize_{0};
+  int64_t numRows_{0};
+  const char* pool_{nullptr};
+  int64_t poolSize_{0};
+  const float* sizes_{nullptr};
+  const uint64_t* offsets_{nullptr};
+
+  // Bytes of the id (0), input handle (1) or transcription (2) of a row
+  const char* field(int64_t idx, int field, int64_t& length) const;
+};
+
+} // namespace asr
+} // namespace app
+} // namespace fl
@@ -7,6 +7,8 @@
 
 #include "flashlight/app/asr/data/Sound.h"
 
+#include <algorithm>
+#include <cstdlib>
 #include <fstream>
 #include <string>
 #include <unordered_map>
@@ -17,6 +19,31 @@ using namespace fl::app::asr;
 
 namespace {
 
+template <typename T>
+sf_count_t readFrames(SNDFILE* file, T* data, sf_count_t frames) {
+  if (std::is_same<T, float>::value) {
+    return sf_readf_float(file, reinterpret_cast<float*>(data), frames);
+  } else if (std::is_same<T, double>::value) {
+    return sf_readf_double(file, reinterpret_cast<double*>(data), frames);
+  } else if (std::is_same<T, int>::value) {
+    return sf_readf_int(file, reinterpret_cast<int*>(data), frames);
+  } else if (std::is_same<T, short>::value) {
+    return sf_readf_short(file, reinterpret_cast<short*>(data), frames);
+  } else {
+    throw std::logic_error("loadSound: called with unsupported T");
+  }
+}
+
+// Parses a non-negative number, or a negative one if allowNegative
+bool parseSeconds(const std::string& str, bool allowNegative, double& value) {
+  if (str.empty()) {
+    return false;
+  }
+  char* end;
+  value = std::strtod(str.c_str(), &end);
+  return *end == '\0' && (allowNegative || value >= 0);
+}
+
 struct EnumClassHash {
   template <typename T>
   std::size_t operator()(T t) const {
@@ -250,19 +277,11 @@ std::vector<T> loadSound(std::istream& f) {
 
   std::vector<T> in(info.frames * info.channels);
   sf_count_t nframe;
-  if (std::is_same<T, float>::value) {
-    nframe =
-        sf_readf_float(file, reinterpret_cast<float*>(in.data()), info.frames);
-  } else if (std::is_same<T, double>::value) {
-    nframe = sf_readf_double(
-        file, reinterpret_cast<double*>(in.data()), info.frames);
-  } else if (std::is_same<T, int>::value) {
-    nframe = sf_readf_int(file, reinterpret_cast<int*>(in.data()), info.frames);
-  } else if (std::is_same<T, short>::value) {
-    nframe =
-        sf_readf_short(file, reinterpret_cast<short*>(in.data()), info.frames);
-  } else {
-    throw std::logic_error("loadSound: called with unsupported T");
+  try {
+    nframe = readFrames(file, in.data(), info.frames);
+  } catch (...) {
+    sf_close(file);
+    throw;
   }
   sf_close(file);
   if (nframe != info.frames) {
@@ -271,6 +290,100 @@ std::vector<T> loadSound(std::istream& f) {
   return in;
 }
 
+template <typename T>
+std::vector<T> loadSoundRange(
+    const std::string& filename,
+    int64_t startFrame,
+    int64_t numFrames) {
+  std::ifstream f(filename);
+  if (!f.is_open()) {
+    throw std::runtime_error("could not open file " + filename);
+  }
+  return loadSoundRange<T>(f, startFrame, numFrames);
+}
+
+template <typename T>
+std::vector<T>
+loadSoundRange(std::istream& f, int64_t startFrame, int64_t numFrames) {
+  SF_VIRTUAL_IO vsf = {sf_vio_ro_get_filelen,
+                       sf_vio_ro_seek,
+                       sf_vio_ro_read,
+                       sf_vio_ro_write,
+                       sf_vio_ro_tell};
+  SNDFILE* file;
+  SF_INFO info;
+
+  info.format = 0;
+
+  if (!(file = sf_open_virtual(&vsf, SFM_READ, &info, &f))) {
+    throw std::runtime_error(
+        "loadSoundRange: unknown format or could not open stream");
+  }
+  if (startFrame < 0 || startFrame > info.frames) {
+    sf_close(file);
+    throw std::invalid_argument(
+        "loadSoundRange: start frame " + std::to_string(startFrame) +
+        " out of the " + std::to_string(info.frames) + " frames");
+  }
+  if (numFrames < 0 || startFrame + numFrames > info.frames) {
+    numFrames = info.frames - startFrame;
+  }
+
+  std::vector<T> in(numFrames * info.channels);
+  sf_count_t nframe;
+  try {
+    if (startFrame > 0 && sf_seek(file, startFrame, SEEK_SET) != startFrame) {
+      // Not seekable: decode and drop the frames before
+      std::vector<T> skipped(
+          std::min<int64_t>(startFrame, info.samplerate) * info.channels);
+      for (int64_t frame = 0; frame < startFrame;) {
+        auto n = std::min<int64_t>(
+            startFrame - frame, skipped.size() / info.channels);
+        if (readFrames(file, skipped.data(), n) != n) {
+          throw std::runtime_error("loadSoundRange: read error");
+        }
+        frame += n;
+      }
+    }
+    nframe = readFrames(file, in.data(), numFrames);
+  } catch (...) {
+    sf_close(file);
+    throw;
+  }
+  sf_close(file);
+  if (nframe != numFrames) {
+    throw std::runtime_error("loadSoundRange: read error");
+  }
+  return in;
+}
+
+SoundSegment parseSoundSegment(const std::string& handle) {
+  SoundSegment segment;
+  segment.path = handle;
+  // Paths may contain ':', so only a handle ending with 2 valid numbers is a
+  // segment
+  auto durationPos = handle.rfind(':');
+  if (durationPos == std::string::npos || durationPos == 0) {
+    return segment;
+  }
+  auto offsetPos = handle.rfind(':', durationPos - 1);
+  if (offsetPos == std::string::npos || offsetPos == 0) {
+    return segment;
+  }
+  double offset, duration;
+  if (!parseSeconds(
+          handle.substr(offsetPos + 1, durationPos - offsetPos - 1),
+          false,
+          offset) ||
+      !parseSeconds(handle.substr(durationPos + 1), true, duration)) {
+    return segment;
+  }
+  segment.path = handle.substr(0, offsetPos);
+  segment.offset = offset;
+  segment.duration = duration;
+  return segment;
+}
+
 template <typename T>
 void saveSound(
     const std::string& filename,
@@ -373,6 +486,28 @@ template std::vector<double> loadSound<double>(std::istream&);
 template std::vector<int> loadSound<int>(std::istream&);
 template std::vector<short> loadSound<short>(std::istream&);
 
+template std::vector<float>
+loadSoundRange(const std::string&, int64_t, int64_t);
+template std::vector<double>
+loadSoundRange(const std::string&, int64_t, int64_t);
+template std::vector<int> loadSoundRange(const std::string&, int64_t, int64_t);
+template std::vector<short>
+loadSoundRange(const std::string&, int64_t, int64_t);
+
+template std::vector<float> loadSoundRange<float>(
+    std::istream&,
+    int64_t,
+    int64_t);
+template std::vector<double> loadSoundRange<double>(
+    std::istream&,
+    int64_t,
+    int64_t);
+template std::vector<int> loadSoundRange<int>(std::istream&, int64_t, int64_t);
+template std::vector<short> loadSoundRange<short>(
+    std::istream&,
+    int64_t,
+    int64_t);
+
 template void saveSound(
     const std::string&,
     const std::vector<float>&,
@@ -9,6 +9,7 @@
 
 #include <cstdint>
 #include <istream>
+#include <string>
 #include <vector>
 
 namespace fl {
@@ -83,6 +84,39 @@ std::vector<T> loadSound(std::istream& f);
 template <typename T>
 std::vector<T> loadSound(const std::string& filename);
 
+/**
+ * Loads `numFrames` frames (all the frames until the end if negative, or if
+ * there are less), from frame `startFrame`, seeking to it rather than
+ * decoding the frames before when the format allows it (e.g. WAV, FLAC,
+ * OGG). Returns the interleaved samples of the frames.
+ */
+template <typename T>
+std::vector<T>
+loadSoundRange(std::istream& f, int64_t startFrame, int64_t numFrames);
+template <typename T>
+std::vector<T> loadSoundRange(
+    const std::string& filename,
+    int64_t startFrame,
+    int64_t numFrames);
+
+/**
+ * A segment of a sound file, as given by an audio handle of a list file:
+ * either `<path>` for the whole file, or `<path>:<offset>:<duration>` with the
+ * offset and duration of the segment in seconds (a negative duration for
+ * the rest of the file).
+ */
+struct SoundSegment {
+  std::string path;
+  double offset{0};
+  double duration{-1};
+
+  bool isWholeFile() const {
+    return offset == 0 && duration < 0;
+  }
+};
+
+SoundSegment parseSoundSegment(const std::string& handle);
+
 template <typename T>
 void saveSound(
     std::ostream& f,
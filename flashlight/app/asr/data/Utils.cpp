@@ -7,6 +7,8 @@
 
 #include "flashlight/app/asr/data/Utils.h"
 
+#include <cmath>
+#include <cstring>
 #include <iostream>
 
 using fl::lib::text::Dictionary;
@@ -115,6 +117,49 @@ std::pair<int, FeatureType> getFeatureType(
   }
 }
 
+uint16_t floatToHalf(float value) {
+  uint32_t x;
+  std::memcpy(&x, &value, sizeof(x));
+  uint16_t sign = (x >> 16) & 0x8000;
+  uint32_t absx = x & 0x7fffffff;
+  if (absx >= 0x7f800000) {
+    // inf or nan
+    return sign | 0x7c00 | (absx > 0x7f800000 ? 0x200 : 0);
+  }
+  if (absx >= 0x477ff000) {
+    // rounds above the largest half
+    return sign | 0x7c00;
+  }
+  if (absx < 0x38800000) {
+    // subnormal half, exact scaling by 2^24 then rounding
+    float a;
+    std::memcpy(&a, &absx, sizeof(a));
+    return sign | static_cast<uint16_t>(std::nearbyint(a * 16777216.0f));
+  }
+  uint32_t half = (absx - 0x38000000) >> 13;
+  uint32_t rest = absx & 0x1fff;
+  if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+    ++half;
+  }
+  return sign | half;
+}
+
+float halfToFloat(uint16_t value) {
+  uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+  uint32_t exponent = (value >> 10) & 0x1f;
+  uint32_t mantissa = value & 0x3ff;
+  if (exponent == 0) {
+    float a = std::ldexp(static_cast<float>(mantissa), -24);
+    return sign ? -a : a;
+  }
+  uint32_t x = exponent == 0x1f
+      ? sign | 0x7f800000 | (mantissa << 13)
+      : sign | ((exponent + 112) << 23) | (mantissa << 13);
+  float result;
+  std::memcpy(&result, &x, sizeof(result));
+  return result;
+}
+
 } // namespace asr
 } // namespace app
 } // namespace fl
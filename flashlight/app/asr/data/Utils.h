@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -44,6 +45,14 @@ std::pair<int, FeatureType> getFeatureType(
     int channels,
     const fl::lib::audio::FeatureParams& featParams);
 
+/**
+ * Conversions between f32 and the bits of IEEE half precision values, rounding
+ * to nearest even as the conversions of the hardware.
+ */
+uint16_t floatToHalf(float value);
+
+float halfToFloat(uint16_t value);
+
 } // namespace asr
 } // namespace app
 } // namespace fl
@@ -7,7 +7,9 @@
 
 #include "flashlight/app/asr/decoder/ConvLmModule.h"
 
+#include <algorithm>
 #include <string>
+#include <vector>
 
 #include "flashlight/ext/common/DistributedUtils.h"
 
@@ -15,6 +17,73 @@ namespace fl {
 namespace app {
 namespace asr {
 
+namespace {
+
+// Streaming state of the network for a sentence, see Module::streamingState()
+using NetworkState = std::vector<af::array>;
+
+// One token of each of the sentences `batch` (indices in `tokens` and
+// `states`); the state of the network is reset if `resume` is false, and set
+// from the states of the sentences otherwise. Returns the B x C scores.
+std::vector<float> forwardToken(
+    Module& network,
+    const std::vector<int>& tokens,
+    std::vector<std::shared_ptr<void>>& states,
+    const std::vector<int>& batch,
+    bool resume) {
+  network.resetStreamingState();
+  if (resume) {
+    // The states of the batch, concatenated along their last dimension
+    auto first = static_cast<NetworkState*>(states[batch[0]].get());
+    std::vector<Variable> batchedState;
+    for (size_t v = 0; v < first->size(); ++v) {
+      if ((*first)[v].isempty()) {
+        batchedState.emplace_back();
+        continue;
+      }
+      std::vector<Variable> parts;
+      for (int i : batch) {
+        auto state = static_cast<NetworkState*>(states[i].get());
+        parts.push_back(noGrad((*state)[v]));
+      }
+      batchedState.push_back(concatenate(parts, 3));
+    }
+    network.setStreamingState(batchedState);
+  }
+
+  std::vector<int> batchTokens;
+  for (int i : batch) {
+    batchTokens.push_back(tokens[i]);
+  }
+  int batchSize = batch.size();
+  af::array inputData(1, batchSize, batchTokens.data());
+  auto output = network.forwardChunk({fl::input(inputData)})[0];
+  if (af::count<int>(af::isNaN(output.array())) != 0) {
+    throw std::runtime_error("[ConvLM] Encountered NaNs in propagation");
+  }
+  // output (c, 1, b)
+  if (output.dims(1) != 1 || output.dims(2) != batchSize) {
+    throw std::logic_error(
+        "[ConvLM]: incorrect predictions: batch should be " +
+        std::to_string(batchSize) + " but it is " +
+        std::to_string(output.dims(2)));
+  }
+
+  auto nextState = network.streamingState();
+  for (int b = 0; b < batchSize; ++b) {
+    auto state = std::make_shared<NetworkState>();
+    for (const auto& var : nextState) {
+      state->push_back(
+          var.isempty() ? af::array()
+                        : var.array()(af::span, af::span, af::span, b));
+    }
+    states[batch[b]] = state;
+  }
+  return ext::afToVector<float>(output.array());
+}
+
+} // namespace
+
 GetConvLmScoreFunc buildGetConvLmScoreFunction(
     std::shared_ptr<Module> network) {
   auto getConvLmScoreFunc = [network](
@@ -64,6 +133,41 @@ GetConvLmScoreFunc buildGetConvLmScoreFunction(
 
   return getConvLmScoreFunc;
 }
+
+ConvLmIncrementalScoreFunc buildIncrementalConvLmScoreFunction(
+    std::shared_ptr<Module> network) {
+  return [network](
+             const std::vector<int>& tokens,
+             std::vector<std::shared_ptr<void>>& states) {
+    if (tokens.size() != states.size()) {
+      throw std::invalid_argument(
+          "[ConvLM] Different numbers of tokens and states");
+    }
+    // Sentences which start are forwarded separately from the ones which
+    // resume
+    std::vector<int> starting, resuming;
+    for (size_t i = 0; i < tokens.size(); ++i) {
+      (states[i] ? resuming : starting).push_back(i);
+    }
+    std::vector<float> scores;
+    for (bool resume : {false, true}) {
+      const auto& batch = resume ? resuming : starting;
+      if (batch.empty()) {
+        continue;
+      }
+      auto batchScores = forwardToken(*network, tokens, states, batch, resume);
+      size_t vocabSize = batchScores.size() / batch.size();
+      scores.resize(tokens.size() * vocabSize);
+      for (size_t b = 0; b < batch.size(); ++b) {
+        std::copy(
+            batchScores.begin() + b * vocabSize,
+            batchScores.begin() + (b + 1) * vocabSize,
+            scores.begin() + batch[b] * vocabSize);
+      }
+    }
+    return scores;
+  };
+}
 } // namespace asr
 } // namespace app
 } // namespace fl
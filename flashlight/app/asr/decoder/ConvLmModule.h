@@ -18,6 +18,19 @@ using GetConvLmScoreFunc = std::function<std::vector<
     float>(const std::vector<int>&, const std::vector<int>&, int, int)>;
 
 GetConvLmScoreFunc buildGetConvLmScoreFunction(std::shared_ptr<Module> network);
+
+using ConvLmIncrementalScoreFunc = std::function<std::vector<float>(
+    const std::vector<int>&,
+    std::vector<std::shared_ptr<void>>&)>;
+
+/**
+ * Scoring function of the incremental mode of `fl::lib::text::ConvLM`: the
+ * network is forwarded on the new tokens with `Module::forwardChunk()`, from
+ * the streaming states of the previous tokens (the input frames kept by its
+ * causal convolutions), which are cached with each decoder state.
+ */
+ConvLmIncrementalScoreFunc buildIncrementalConvLmScoreFunction(
+    std::shared_ptr<Module> network);
 } // namespace asr
 } // namespace app
 } // namespace fl
@@ -13,6 +13,7 @@
 #include "flashlight/ext/common/SequentialBuilder.h"
 #include "flashlight/fl/dataset/MemoryBlobDataset.h"
 #include "flashlight/fl/meter/EditDistanceMeter.h"
+#include "flashlight/lib/text/decoder/FlatTrie.h"
 #include "flashlight/lib/text/decoder/LexiconDecoder.h"
 #include "flashlight/lib/text/decoder/LexiconFreeDecoder.h"
 
@@ -29,6 +30,34 @@ af::array removeNegative(const af::array& arr) {
 af::array removePad(const af::array& arr, int32_t padIdx) {
   return arr(arr != padIdx);
 }
+
+std::vector<float> emissionToHost(const af::array& emission) {
+  if (emission.numdims() > 2) {
+    throw std::runtime_error("emission should be NxT");
+  }
+  std::vector<float> emissionV(emission.elements());
+  emission.as(af::dtype::f32).host(emissionV.data());
+  return emissionV;
+}
+
+// Replaces the emission of the sample with the best hypothesis
+void setPrediction(
+    std::vector<af::array>& sample,
+    const std::vector<fl::lib::text::DecodeResult>& results) {
+  std::vector<int> tokensV, wordsV;
+  if (results.size() > 0) {
+    tokensV = results[0].tokens;
+    wordsV = results[0].words;
+  }
+  tokensV.erase(std::remove(tokensV.begin(), tokensV.end(), -1), tokensV.end());
+  wordsV.erase(std::remove(wordsV.begin(), wordsV.end(), -1), wordsV.end());
+  sample[kDMTokenPredIdx] =
+      (tokensV.size() > 0 ? af::array(af::dim4(tokensV.size()), tokensV.data())
+                          : af::array());
+  sample[kDMWordPredIdx] =
+      (wordsV.size() > 0 ? af::array(af::dim4(wordsV.size()), wordsV.data())
+                         : af::array());
+}
 } // namespace
 
 // TODO threading?
@@ -136,17 +165,23 @@ std::shared_ptr<fl::lib::text::Trie> DecodeMaster::buildTrie(
 
 std::shared_ptr<fl::Dataset> DecodeMaster::forward(
     const std::shared_ptr<fl::Dataset>& ds) {
+  return forward(ds, net_);
+}
+
+std::shared_ptr<fl::Dataset> DecodeMaster::forward(
+    const std::shared_ptr<fl::Dataset>& ds,
+    const std::shared_ptr<fl::Module>& net) {
   auto emissionDataset = std::make_shared<fl::MemoryBlobDataset>();
   for (auto& batch : *ds) {
     af::array output;
     if (usePlugin_) {
-      output = net_->forward({fl::input(batch[kInputIdx]),
-                              fl::noGrad(batch[kDurationIdx])})
+      output = net->forward({fl::input(batch[kInputIdx]),
+                             fl::noGrad(batch[kDurationIdx])})
                    .front()
                    .array();
     } else {
       output = fl::ext::forwardSequentialModuleWithPadMask(
-                   fl::input(batch[kInputIdx]), net_, batch[kDurationIdx])
+                   fl::input(batch[kInputIdx]), net, batch[kDurationIdx])
                    .array();
     }
     if (output.numdims() > 3) {
@@ -189,35 +224,69 @@ std::shared_ptr<fl::Dataset> DecodeMaster::decode(
   auto predDataset = std::make_shared<fl::MemoryBlobDataset>();
   for (auto& sample : *emissionDataset) {
     auto emission = sample[kDMTokenPredIdx];
-    if (emission.numdims() > 2) {
-      throw std::runtime_error("emission should be NxT");
-    }
-    std::vector<float> emissionV(emission.elements());
-    emission.as(af::dtype::f32).host(emissionV.data());
+    auto emissionV = emissionToHost(emission);
     auto results =
         decoder.decode(emissionV.data(), emission.dims(1), emission.dims(0));
-
-    std::vector<int> tokensV, wordsV;
-    if (results.size() > 0) {
-      tokensV = results[0].tokens;
-      wordsV = results[0].words;
-    }
-    tokensV.erase(
-        std::remove(tokensV.begin(), tokensV.end(), -1), tokensV.end());
-    wordsV.erase(std::remove(wordsV.begin(), wordsV.end(), -1), wordsV.end());
-    sample[kDMTokenPredIdx] =
-        (tokensV.size() > 0
-             ? af::array(af::dim4(tokensV.size()), tokensV.data())
-             : af::array());
-    sample[kDMWordPredIdx] =
-        (wordsV.size() > 0 ? af::array(af::dim4(wordsV.size()), wordsV.data())
-                           : af::array());
+    setPrediction(sample, results);
     predDataset->add(sample);
   }
   predDataset->writeIndex();
   return predDataset;
 }
 
+std::vector<std::shared_ptr<fl::Dataset>> DecodeMaster::decode(
+    const std::shared_ptr<fl::Dataset>& emissionDataset,
+    fl::lib::text::MultiConfigLexiconDecoder& decoder) {
+  std::vector<std::vector<af::array>> samples;
+  std::vector<std::vector<float>> emissions;
+  std::vector<const float*> emissionPtrs;
+  std::vector<int> frames;
+  int nTokens = 0;
+  for (auto& sample : *emissionDataset) {
+    const auto& emission = sample[kDMTokenPredIdx];
+    emissions.push_back(emissionToHost(emission));
+    if (!samples.empty() && emission.dims(0) != nTokens) {
+      throw std::runtime_error(
+          "emissions should have the same number of tokens");
+    }
+    nTokens = emission.dims(0);
+    frames.push_back(emission.dims(1));
+    samples.push_back(sample);
+  }
+  for (const auto& emission : emissions) {
+    emissionPtrs.push_back(emission.data());
+  }
+  auto results = decoder.decodeBatch(emissionPtrs, frames, nTokens);
+
+  std::vector<std::shared_ptr<fl::Dataset>> predDatasets;
+  for (const auto& configResults : results) {
+    auto predDataset = std::make_shared<fl::MemoryBlobDataset>();
+    for (int b = 0; b < samples.size(); b++) {
+      auto sample = samples[b];
+      setPrediction(sample, configResults[b]);
+      predDataset->add(sample);
+    }
+    predDataset->writeIndex();
+    predDatasets.push_back(predDataset);
+  }
+  return predDatasets;
+}
+
+fl::lib::text::LexiconDecoderOptions DecodeMaster::lexiconDecoderOptions(
+    const DecodeMasterLexiconOptions& opt) {
+  fl::lib::text::LexiconDecoderOptions decoderOpt{
+      .beamSize = opt.beamSize,
+      .beamSizeToken = opt.beamSizeToken,
+      .beamThreshold = opt.beamThreshold,
+      .lmWeight = opt.lmWeight,
+      .wordScore = opt.wordScore,
+      .unkScore = opt.unkScore,
+      .silScore = opt.silScore,
+      .logAdd = opt.logAdd,
+      .criterionType = fl::lib::text::CriterionType::CTC};
+  return decoderOpt;
+}
+
 TokenDecodeMaster::TokenDecodeMaster(
     const std::shared_ptr<fl::Module> net,
     const std::shared_ptr<fl::lib::text::LM> lm,
@@ -252,16 +321,7 @@ std::shared_ptr<fl::Dataset> TokenDecodeMaster::decode(
     const fl::lib::text::LexiconMap& lexicon,
     DecodeMasterLexiconOptions opt) {
   auto trie = buildTrie(lexicon, opt.smearMode);
-  fl::lib::text::LexiconDecoderOptions decoderOpt{
-      .beamSize = opt.beamSize,
-      .beamSizeToken = opt.beamSizeToken,
-      .beamThreshold = opt.beamThreshold,
-      .lmWeight = opt.lmWeight,
-      .wordScore = opt.wordScore,
-      .unkScore = opt.unkScore,
-      .silScore = opt.silScore,
-      .logAdd = opt.logAdd,
-      .criterionType = fl::lib::text::CriterionType::CTC};
+  auto decoderOpt = lexiconDecoderOptions(opt);
   auto silIdx = tokenDict_.getIndex(opt.silToken);
   auto blankIdx = tokenDict_.getIndex(opt.blankToken);
   auto unkWordIdx = wordDict_.getIndex(fl::lib::text::kUnkToken);
@@ -270,6 +330,38 @@ std::shared_ptr<fl::Dataset> TokenDecodeMaster::decode(
   return DecodeMaster::decode(emissionDataset, decoder);
 }
 
+std::vector<std::shared_ptr<fl::Dataset>> TokenDecodeMaster::decode(
+    const std::shared_ptr<fl::Dataset>& emissionDataset,
+    const fl::lib::text::LexiconMap& lexicon,
+    const std::vector<DecodeMasterLexiconOptions>& opts,
+    int nThreads /* = 0 */) {
+  if (opts.empty()) {
+    throw std::invalid_argument("TokenDecodeMaster: no decoder options");
+  }
+  const auto& opt = opts.front();
+  // The lexicon is frozen once and shared by all the configurations
+  auto trie = std::make_shared<fl::lib::text::FlatTrie>(
+      *buildTrie(lexicon, opt.smearMode));
+  std::vector<fl::lib::text::LexiconDecoderOptions> decoderOpts;
+  for (const auto& configOpt : opts) {
+    decoderOpts.push_back(lexiconDecoderOptions(configOpt));
+  }
+  auto silIdx = tokenDict_.getIndex(opt.silToken);
+  auto blankIdx = tokenDict_.getIndex(opt.blankToken);
+  auto unkWordIdx = wordDict_.getIndex(fl::lib::text::kUnkToken);
+  fl::lib::text::MultiConfigLexiconDecoder decoder(
+      decoderOpts,
+      trie,
+      lm_,
+      silIdx,
+      blankIdx,
+      unkWordIdx,
+      transition_,
+      true,
+      nThreads);
+  return DecodeMaster::decode(emissionDataset, decoder);
+}
+
 std::vector<std::string> TokenDecodeMaster::computeStringPred(
     const std::vector<int>& tokenIdxSeq) {
   return tknPrediction2Ltr(
@@ -312,16 +404,7 @@ std::shared_ptr<fl::Dataset> WordDecodeMaster::decode(
     const fl::lib::text::LexiconMap& lexicon,
     DecodeMasterLexiconOptions opt) {
   auto trie = buildTrie(lexicon, opt.smearMode);
-  fl::lib::text::LexiconDecoderOptions decoderOpt{
-      .beamSize = opt.beamSize,
-      .beamSizeToken = opt.beamSizeToken,
-      .beamThreshold = opt.beamThreshold,
-      .lmWeight = opt.lmWeight,
-      .wordScore = opt.wordScore,
-      .unkScore = opt.unkScore,
-      .silScore = opt.silScore,
-      .logAdd = opt.logAdd,
-      .criterionType = fl::lib::text::CriterionType::CTC};
+  auto decoderOpt = lexiconDecoderOptions(opt);
   auto silIdx = tokenDict_.getIndex(opt.silToken);
   auto blankIdx = tokenDict_.getIndex(opt.blankToken);
   auto unkWordIdx = wordDict_.getIndex(opt.unkToken);
@@ -330,6 +413,38 @@ std::shared_ptr<fl::Dataset> WordDecodeMaster::decode(
   return DecodeMaster::decode(emissionDataset, decoder);
 }
 
+std::vector<std::shared_ptr<fl::Dataset>> WordDecodeMaster::decode(
+    const std::shared_ptr<fl::Dataset>& emissionDataset,
+    const fl::lib::text::LexiconMap& lexicon,
+    const std::vector<DecodeMasterLexiconOptions>& opts,
+    int nThreads /* = 0 */) {
+  if (opts.empty()) {
+    throw std::invalid_argument("WordDecodeMaster: no decoder options");
+  }
+  const auto& opt = opts.front();
+  // The lexicon is frozen once and shared by all the configurations
+  auto trie = std::make_shared<fl::lib::text::FlatTrie>(
+      *buildTrie(lexicon, opt.smearMode));
+  std::vector<fl::lib::text::LexiconDecoderOptions> decoderOpts;
+  for (const auto& configOpt : opts) {
+    decoderOpts.push_back(lexiconDecoderOptions(configOpt));
+  }
+  auto silIdx = tokenDict_.getIndex(opt.silToken);
+  auto blankIdx = tokenDict_.getIndex(opt.blankToken);
+  auto unkWordIdx = wordDict_.getIndex(opt.unkToken);
+  fl::lib::text::MultiConfigLexiconDecoder decoder(
+      decoderOpts,
+      trie,
+      lm_,
+      silIdx,
+      blankIdx,
+      unkWordIdx,
+      transition_,
+      false,
+      nThreads);
+  return DecodeMaster::decode(emissionDataset, decoder);
+}
+
 std::vector<std::string> WordDecodeMaster::computeStringPred(
     const std::vector<int>& tokenIdxSeq) {
   return tknPrediction2Ltr(
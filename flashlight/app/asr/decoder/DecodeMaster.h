@@ -11,6 +11,7 @@
 #include "flashlight/fl/dataset/datasets.h"
 #include "flashlight/fl/nn/nn.h"
 #include "flashlight/lib/text/decoder/Decoder.h"
+#include "flashlight/lib/text/decoder/MultiConfigLexiconDecoder.h"
 #include "flashlight/lib/text/decoder/Trie.h"
 #include "flashlight/lib/text/decoder/lm/LM.h"
 #include "flashlight/lib/text/dictionary/Dictionary.h"
@@ -69,11 +70,23 @@ class DecodeMaster {
   virtual std::shared_ptr<fl::Dataset> forward(
       const std::shared_ptr<fl::Dataset>& ds);
 
+  // compute emissions of another network, e.g. a snapshot of the network
+  // being trained
+  std::shared_ptr<fl::Dataset> forward(
+      const std::shared_ptr<fl::Dataset>& ds,
+      const std::shared_ptr<fl::Module>& net);
+
   // decode emissions with an existing decoder
   std::shared_ptr<fl::Dataset> decode(
       const std::shared_ptr<fl::Dataset>& eds,
       fl::lib::text::Decoder& decoder);
 
+  // decode emissions with each configuration of an existing decoder, the
+  // emissions are copied to host once for all the configurations
+  std::vector<std::shared_ptr<fl::Dataset>> decode(
+      const std::shared_ptr<fl::Dataset>& eds,
+      fl::lib::text::MultiConfigLexiconDecoder& decoder);
+
   // returns token edit distance and word edit distance stats
   std::pair<std::vector<int64_t>, std::vector<int64_t>> computeMetrics(
       const std::shared_ptr<fl::Dataset>& pds);
@@ -93,6 +106,10 @@ class DecodeMaster {
       const fl::lib::text::LexiconMap& lexicon,
       fl::lib::text::SmearingMode smearMode) const;
 
+  // lexicon decoder options, smearing and tokens are taken from `opt`
+  static fl::lib::text::LexiconDecoderOptions lexiconDecoderOptions(
+      const DecodeMasterLexiconOptions& opt);
+
   std::shared_ptr<fl::Module> net_;
   std::shared_ptr<fl::lib::text::LM> lm_;
   bool isTokenLM_;
@@ -125,6 +142,16 @@ class TokenDecodeMaster : public DecodeMaster {
       const fl::lib::text::LexiconMap& lexicon,
       DecodeMasterLexiconOptions opt);
 
+  // compute predictions from emissions for several lexicon configurations
+  // (which should only differ in beam sizes and scores), with one prediction
+  // dataset per configuration; decodings run on `nThreads` threads (number of
+  // hardware threads if not positive)
+  std::vector<std::shared_ptr<fl::Dataset>> decode(
+      const std::shared_ptr<fl::Dataset>& eds,
+      const fl::lib::text::LexiconMap& lexicon,
+      const std::vector<DecodeMasterLexiconOptions>& opts,
+      int nThreads = 0);
+
   // convert tokens indices predictions into tokens string
   virtual std::vector<std::string> computeStringPred(
       const std::vector<int>& tokenIdxSeq) override;
@@ -155,6 +182,16 @@ class WordDecodeMaster : public DecodeMaster {
       const fl::lib::text::LexiconMap& lexicon,
       DecodeMasterLexiconOptions opt);
 
+  // compute predictions from emissions for several lexicon configurations
+  // (which should only differ in beam sizes and scores), with one prediction
+  // dataset per configuration; decodings run on `nThreads` threads (number of
+  // hardware threads if not positive)
+  std::vector<std::shared_ptr<fl::Dataset>> decode(
+      const std::shared_ptr<fl::Dataset>& eds,
+      const fl::lib::text::LexiconMap& lexicon,
+      const std::vector<DecodeMasterLexiconOptions>& opts,
+      int nThreads = 0);
+
   // convert tokens indices predictions into tokens string
   virtual std::vector<std::string> computeStringPred(
       const std::vector<int>& tokenIdxSeq) override;
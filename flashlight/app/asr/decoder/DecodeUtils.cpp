@@ -57,6 +57,33 @@ std::shared_ptr<fl::lib::text::Trie> buildTrie(
   return trie;
 }
 
+fl::lib::text::KenLMOptions kenLMOptions(
+    const std::string& loadMethod,
+    int64_t prefetchMb) {
+  using fl::lib::text::KenLMLoadMethod;
+  fl::lib::text::KenLMOptions opt;
+  if (loadMethod == "lazy") {
+    opt.loadMethod = KenLMLoadMethod::Lazy;
+  } else if (loadMethod == "populate_or_lazy") {
+    opt.loadMethod = KenLMLoadMethod::PopulateOrLazy;
+  } else if (loadMethod == "populate_or_read") {
+    opt.loadMethod = KenLMLoadMethod::PopulateOrRead;
+  } else if (loadMethod == "read") {
+    opt.loadMethod = KenLMLoadMethod::Read;
+  } else if (loadMethod == "parallel_read") {
+    opt.loadMethod = KenLMLoadMethod::ParallelRead;
+  } else {
+    throw std::runtime_error(
+        "[kenLMOptions] Invalid load method, can be {lazy, populate_or_lazy, populate_or_read, read, parallel_read}, provided value is " +
+        loadMethod);
+  }
+  if (prefetchMb < 0) {
+    throw std::runtime_error("[kenLMOptions] prefetch size should be >= 0");
+  }
+  opt.prefetchBytes = static_cast<size_t>(prefetchMb) << 20;
+  return opt;
+}
+
 } // namespace asr
 } // namespace app
 } // namespace fl
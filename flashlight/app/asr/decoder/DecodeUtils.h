@@ -17,6 +17,7 @@
 
 #include "flashlight/app/asr/decoder/TranscriptionUtils.h"
 #include "flashlight/lib/text/decoder/Trie.h"
+#include "flashlight/lib/text/decoder/lm/KenLM.h"
 #include "flashlight/lib/text/decoder/lm/LM.h"
 #include "flashlight/lib/text/dictionary/Dictionary.h"
 
@@ -37,6 +38,15 @@ std::shared_ptr<fl::lib::text::Trie> buildTrie(
     const int wordSeparatorIdx,
     const int repLabel);
 
+/*
+ * KenLM load options from the name of a load method, {lazy, populate_or_lazy,
+ * populate_or_read, read, parallel_read}, and the head of the model file to
+ * prefetch in MB
+ */
+fl::lib::text::KenLMOptions kenLMOptions(
+    const std::string& loadMethod,
+    int64_t prefetchMb);
+
 } // namespace asr
 } // namespace app
 } // namespace fl
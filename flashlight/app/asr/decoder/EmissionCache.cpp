@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/app/asr/decoder/EmissionCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+
+#include "flashlight/app/asr/data/Utils.h"
+#include "flashlight/lib/common/String.h"
+
+namespace {
+
+constexpr const char kMagic[8] = {'F', 'L', 'E', 'M', 'I', 'T', '0', '1'};
+
+struct Header {
+  char magic[8];
+  uint32_t type;
+  uint32_t topK;
+  uint64_t numUtterances;
+  uint64_t indexOffset;
+};
+
+struct IndexEntry {
+  uint64_t offset;
+  uint64_t bytes;
+  int32_t nFrames;
+  int32_t nTokens;
+  uint32_t lengths[3];
+};
+
+size_t frameBytes(fl::app::asr::EmissionCacheType type, int N, int topK) {
+  using fl::app::asr::EmissionCacheType;
+  switch (type) {
+    case EmissionCacheType::F32:
+      return N * sizeof(float);
+    case EmissionCacheType::F16:
+      return N * sizeof(uint16_t);
+    case EmissionCacheType::TOPK:
+      return sizeof(float) + 2 * topK * sizeof(uint16_t);
+  }
+  throw std::invalid_argument("[EmissionCache] invalid cache type");
+}
+
+std::vector<char> encode(
+    const fl::app::asr::EmissionUnit& unit,
+    fl::app::asr::EmissionCacheType type,
+    int topK) {
+  using fl::app::asr::EmissionCacheType;
+  int T = unit.nFrames, N = unit.nTokens;
+  std::vector<char> bytes(T * frameBytes(type, N, topK));
+  char* data = bytes.data();
+  if (type == EmissionCacheType::F32) {
+    std::memcpy(data, unit.emission.data(), bytes.size());
+  } else if (type == EmissionCacheType::F16) {
+    for (auto score : unit.emission) {
+      auto half = fl::app::asr::floatToHalf(score);
+      std::memcpy(data, &half, sizeof(half));
+      data += sizeof(half);
+    }
+  } else {
+    std::vector<uint16_t> tokens(N);
+    std::vector<uint16_t> halves(topK);
+    for (int t = 0; t < T; ++t) {
+      const float* frame = unit.emission.data() + t * N;
+      std::iota(tokens.begin(), tokens.end(), 0);
+      std::partial_sort(
+          tokens.begin(),
+          tokens.begin() + topK,
+          tokens.end(),
+          [frame](uint16_t a, uint16_t b) { return frame[a] > frame[b]; });
+      // Scores out of the top K are set to the largest of them
+      float fill = 0;
+      if (topK < N) {
+        fill = frame[*std::max_element(
+            tokens.begin() + topK,
+            tokens.end(),
+            [frame](uint16_t a, uint16_t b) { return frame[a] < frame[b]; })];
+      }
+      for (int k = 0; k < topK; ++k) {
+        halves[k] = fl::app::asr::floatToHalf(frame[tokens[k]]);
+      }
+      std::memcpy(data, &fill, sizeof(fill));
+      data += sizeof(fill);
+      std::memcpy(data, tokens.data(), topK * sizeof(uint16_t));
+      data += topK * sizeof(uint16_t);
+      std::memcpy(data, halves.data(), topK * sizeof(uint16_t));
+      data += topK * sizeof(uint16_t);
+    }
+  }
+  return bytes;
+}
+
+std::vector<float> decode(
+    const std::vector<char>& bytes,
+    int T,
+    int N,
+    fl::app::asr::EmissionCacheType type,
+    int topK) {
+  using fl::app::asr::EmissionCacheType;
+  if (bytes.size() != T * frameBytes(type, N, topK)) {
+    throw std::runtime_error("[EmissionCacheReader] invalid emission size");
+  }
+  std::vector<float> emission(static_cast<size_t>(T) * N);
+  const char* data = bytes.data();
+  if (type == EmissionCacheType::F32) {
+    std::memcpy(emission.data(), data, bytes.size());
+  } else if (type == EmissionCacheType::F16) {
+    for (auto& score : emission) {
+      uint16_t half;
+      std::memcpy(&half, data, sizeof(half));
+      score = fl::app::asr::halfToFloat(half);
+      data += sizeof(half);
+    }
+  } else {
+    std::vector<uint16_t> tokens(topK), halves(topK);
+    for (int t = 0; t < T; ++t) {
+      float fill;
+      std::memcpy(&fill, data, sizeof(fill));
+      data += sizeof(fill);
+      std::memcpy(tokens.data(), data, topK * sizeof(uint16_t));
+      data += topK * sizeof(uint16_t);
+      std::memcpy(halves.data(), data, topK * sizeof(uint16_t));
+      data += topK * sizeof(uint16_t);
+
+      float* frame = emission.data() + t * N;
+      std::fill(frame, frame + N, fill);
+      for (int k = 0; k < topK; ++k) {
+        if (tokens[k] >= N) {
+          throw std::runtime_error("[EmissionCacheReader] invalid token");
+        }
+        frame[tokens[k]] = fl::app::asr::halfToFloat(halves[k]);
+      }
+    }
+  }
+  return emission;
+}
+
+} // namespace
+
+namespace fl {
+namespace app {
+namespace asr {
+
+EmissionCacheWriter::EmissionCacheWriter(
+    const std::string& filename,
+    EmissionCacheType type,
+    int topK /* = 0 */)
+    : filename_(filename),
+      type_(type),
+      topK_(type == EmissionCacheType::TOPK ? topK : 0),
+      file_(filename, std::ios::binary) {
+  if (!file_) {
+    throw std::invalid_argument("Unable to open file -" + filename);
+  }
+  if (type_ == EmissionCacheType::TOPK && topK_ <= 0) {
+    throw std::invalid_argument(
+        "[EmissionCacheWriter] K should be positive for TOPK caches");
+  }
+  Header header = {};
+  file_.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+  offset_ = sizeof(Header);
+}
+
+void EmissionCacheWriter::add(
+    const EmissionUnit& emission,
+    const TargetUnit& target) {
+  if (emission.emission.size() !=
+      static_cast<size_t>(emission.nFrames) * emission.nTokens) {
+    throw std::invalid_argument(
+        "[EmissionCacheWriter] emission should have nFrames x nTokens scores");
+  }
+  if (type_ == EmissionCacheType::TOPK &&
+      (emission.nTokens > 65536 || emission.nTokens < topK_)) {
+    throw std::invalid_argument(
+        "[EmissionCacheWriter] TOPK caches need K <= tokens <= 65536");
+  }
+  auto bytes = encode(emission, type_, topK_);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  file_.write(bytes.data(), bytes.size());
+  entries_.push_back(
+      {offset_,
+       bytes.size(),
+       emission.nFrames,
+       emission.nTokens,
+       target,
+       emission.sampleId});
+  offset_ += bytes.size();
+}
+
+void EmissionCacheWriter::close() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& entry : entries_) {
+    auto words = lib::join(" ", entry.target.wordTargetStr);
+    IndexEntry indexEntry = {};
+    indexEntry.offset = entry.offset;
+    indexEntry.bytes = entry.bytes;
+    indexEntry.nFrames = entry.nFrames;
+    indexEntry.nTokens = entry.nTokens;
+    indexEntry.lengths[0] = entry.target.tokenTarget.size();
+    indexEntry.lengths[1] = entry.sampleId.size();
+    indexEntry.lengths[2] = words.size();
+    file_.write(reinterpret_cast<const char*>(&indexEntry), sizeof(IndexEntry));
+    file_.write(
+        reinterpret_cast<const char*>(entry.target.tokenTarget.data()),
+        entry.target.tokenTarget.size() * sizeof(int));
+    file_.write(entry.sampleId.data(), entry.sampleId.size());
+    file_.write(words.data(), words.size());
+  }
+
+  Header header = {};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.type = static_cast<uint32_t>(type_);
+  header.topK = topK_;
+  header.numUtterances = entries_.size();
+  header.indexOffset = offset_;
+  file_.seekp(0);
+  file_.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+  file_.close();
+  if (!file_) {
+    throw std::runtime_error(
+        "[EmissionCacheWriter] could not write " + filename_);
+  }
+}
+
+EmissionCacheReader::EmissionCacheReader(const std::string& filename)
+    : filename_(filename), file_(filename, std::ios::binary) {
+  if (!file_) {
+    throw std::invalid_argument("Unable to open file -" + filename);
+  }
+  Header header;
+  if (!file_.read(reinterpret_cast<char*>(&header), sizeof(Header)) ||
+      std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.type > static_cast<uint32_t>(EmissionCacheType::TOPK)) {
+    throw std::runtime_error(
+        "[EmissionCacheReader] invalid emission cache " + filename);
+  }
+  type_ = static_cast<EmissionCacheType>(header.type);
+  topK_ = header.topK;
+
+  // The index holds the targets, it is read at once
+  file_.seekg(header.indexOffset);
+  records_.resize(header.numUtterances);
+  for (auto& record : records_) {
+    IndexEntry entry;
+    file_.read(reinterpret_cast<char*>(&entry), sizeof(IndexEntry));
+    record.offset = entry.offset;
+    record.bytes = entry.bytes;
+    record.nFrames = entry.nFrames;
+    record.nTokens = entry.nTokens;
+    record.target.tokenTarget.resize(entry.lengths[0]);
+    file_.read(
+        reinterpret_cast<char*>(record.target.tokenTarget.data()),
+        entry.lengths[0] * sizeof(int));
+    record.sampleId.resize(entry.lengths[1]);
+    file_.read(&record.sampleId[0], entry.lengths[1]);
+    std::string words(entry.lengths[2], ' ');
+    file_.read(&words[0], entry.lengths[2]);
+    record.target.wordTargetStr = lib::splitOnWhitespace(words, true);
+    if (!file_) {
+      throw std::runtime_error(
+          "[EmissionCacheReader] truncated emission cache " + filename);
+    }
+  }
+}
+
+int64_t EmissionCacheReader::size() const {
+  return records_.size();
+}
+
+EmissionTargetPair EmissionCacheReader::get(int64_t idx) const {
+  if (idx < 0 || idx >= size()) {
+    throw std::out_of_range("[EmissionCacheReader] invalid index");
+  }
+  const auto& record = records_[idx];
+  std::vector<char> bytes(record.bytes);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    file_.seekg(record.offset);
+    if (!file_.read(bytes.data(), bytes.size())) {
+      throw std::runtime_error(
+          "[EmissionCacheReader] could not read " + filename_);
+    }
+  }
+  EmissionUnit emission(
+      decode(bytes, record.nFrames, record.nTokens, type_, topK_),
+      record.sampleId,
+      record.nFrames,
+      record.nTokens);
+  return {std::move(emission), record.target};
+}
+
+} // namespace asr
+} // namespace app
+} // namespace fl
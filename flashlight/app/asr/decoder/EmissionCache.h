@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "flashlight/app/asr/decoder/Defines.h"
+
+namespace fl {
+namespace app {
+namespace asr {
+
+/// Storage type of the emissions in an emission cache.
+enum class EmissionCacheType : uint32_t {
+  F32 = 0,
+  /// IEEE half precision
+  F16 = 1,
+  /// The K largest scores of each frame, the others are set to the K+1-th
+  TOPK = 2,
+};
+
+/**
+ * Writes the emissions of utterances, with their targets, into a cache file
+ * that Decode reads instead of running the acoustic model.
+ *
+ * Layout, in the byte order of the host:
+ *  - header: 8 bytes magic, uint32 type, uint32 K, uint64 number of
+ *    utterances, uint64 offset of the index;
+ *  - emissions of each utterance, FRAMES x TOKENS (Row Major); TOPK frames
+ *    are a float fill score followed by K uint16 token indices and K half
+ *    scores;
+ *  - index: for each utterance, uint64 offset and size of its emissions,
+ *    int32 number of frames and tokens, uint32 number of token targets and
+ *    lengths of the id and of the word targets joined with spaces, followed
+ *    by the int32 token targets and the strings.
+ *
+ * `add` can be called from several threads.
+ */
+class EmissionCacheWriter {
+ public:
+  EmissionCacheWriter(
+      const std::string& filename,
+      EmissionCacheType type,
+      int topK = 0);
+
+  void add(const EmissionUnit& emission, const TargetUnit& target);
+
+  /// Writes the index and the header, the cache is invalid until then.
+  void close();
+
+ private:
+  struct Entry {
+    uint64_t offset;
+    uint64_t bytes;
+    int nFrames;
+    int nTokens;
+    TargetUnit target;
+    std::string sampleId;
+  };
+
+  std::string filename_;
+  EmissionCacheType type_;
+  int topK_;
+  std::ofstream file_;
+  uint64_t offset_;
+  std::vector<Entry> entries_;
+  std::mutex mutex_;
+};
+
+/**
+ * Reads the utterances of an emission cache written by `EmissionCacheWriter`.
+ * The index is read at construction, emissions at each `get`, which can be
+ * called from several threads.
+ */
+class EmissionCacheReader {
+ public:
+  explicit EmissionCacheReader(const std::string& filename);
+
+  int64_t size() const;
+
+  EmissionTargetPair get(int64_t idx) const;
+
+ private:
+  struct Record {
+    uint64_t offset;
+    uint64_t bytes;
+    int nFrames;
+    int nTokens;
+    TargetUnit target;
+    std::string sampleId;
+  };
+
+  std::string filename_;
+  EmissionCacheType type_;
+  int topK_;
+  std::vector<Record> records_;
+  mutable std::ifstream file_;
+  mutable std::mutex mutex_;
+};
+
+} // namespace asr
+} // namespace app
+} // namespace fl
@@ -8,12 +8,18 @@
 #include "flashlight/app/asr/decoder/PlGenerator.h"
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstdio>
+#include <exception>
+#include <numeric>
+#include <sstream>
 #include <thread>
 
 #include "flashlight/app/asr/common/Defines.h"
 #include "flashlight/app/asr/decoder/TranscriptionUtils.h"
 #include "flashlight/app/asr/runtime/Helpers.h"
+#include "flashlight/ext/common/DistributedUtils.h"
 #include "flashlight/ext/common/SequentialBuilder.h"
 
 namespace {
@@ -29,6 +35,101 @@ namespace fl {
 namespace app {
 namespace asr {
 
+namespace detail {
+
+struct PlGenerationState {
+  std::thread worker;
+  // Folder of the current generation, empty once all its shards are used
+  std::string plDir;
+  // Number of shards of this process written so far
+  std::atomic<int> nShards{0};
+  std::atomic<bool> done{false};
+  std::exception_ptr error;
+
+  void join() {
+    if (worker.joinable()) {
+      worker.join();
+    }
+    if (error) {
+      auto e = error;
+      error = nullptr;
+      std::rethrow_exception(e);
+    }
+  }
+
+  ~PlGenerationState() {
+    if (worker.joinable()) {
+      worker.join();
+    }
+  }
+};
+
+} // namespace detail
+
+namespace {
+
+struct PlConfig {
+  Dictionary tokenDict;
+  TokenToWordFunc tokenToWord;
+  float minInputSize;
+  float maxInputSize;
+  int minTargetSize;
+  int maxTargetSize;
+  // Whether the existing targets are kept instead of the model predictions
+  bool useExistingPl;
+  bool usePlugin;
+};
+
+// Returns the list file line of the pseudo label of `sample`, or an empty
+// string if the sample is filtered out
+std::string pseudoLabel(
+    const std::vector<af::array>& sample,
+    const std::shared_ptr<fl::Module>& ntwrk,
+    const std::shared_ptr<SequenceCriterion>& criterion,
+    const PlConfig& config) {
+  auto duration = afToVector<float>(sample[kDurationIdx]).front();
+  if (duration < config.minInputSize || duration > config.maxInputSize) {
+    return "";
+  }
+
+  std::vector<std::string> words;
+  if (config.useExistingPl) {
+    auto tokenTarget = afToVector<int>(sample[kTargetIdx]);
+    words = config.tokenToWord(tokenTarget, config.tokenDict, false);
+  } else {
+    fl::Variable rawEmission;
+    if (config.usePlugin) {
+      rawEmission = ntwrk
+                        ->forward(
+                            {fl::input(sample[kInputIdx]),
+                             fl::noGrad(sample[kDurationIdx])})
+                        .front();
+    } else {
+      rawEmission = fl::ext::forwardSequentialModuleWithPadMask(
+          fl::input(sample[kInputIdx]), ntwrk, sample[kDurationIdx]);
+    }
+    auto tokenPrediction =
+        afToVector<int>(criterion->viterbiPath(rawEmission.array()));
+    words = config.tokenToWord(tokenPrediction, config.tokenDict, true);
+  }
+  if (words.size() < config.minTargetSize ||
+      words.size() > config.maxTargetSize) {
+    return "";
+  }
+
+  auto sampleId = readSampleIds(sample[kSampleIdx]).front();
+  auto inputPath = readSampleIds(sample[kPathIdx]).front();
+  return sampleId + "\t" + inputPath + "\t" + std::to_string(duration) +
+      "\t" + lib::join(" ", words);
+}
+
+std::string shardPath(const std::string& plDir, int rank, int shard) {
+  return pathsConcat(
+      plDir, std::to_string(rank) + "_" + std::to_string(shard) + ".lst");
+}
+
+} // namespace
+
 PlGenerator::PlGenerator(
     const Dictionary& tokenDict,
     const std::string& runPath,
@@ -49,7 +150,9 @@ PlGenerator::PlGenerator(
     fl::Dataset::DataTransformFunction inputTransform,
     fl::Dataset::DataTransformFunction targetTransform,
     fl::Dataset::DataTransformFunction wordTransform,
-    TokenToWordFunc tokenToWord)
+    TokenToWordFunc tokenToWord,
+    int plShardSize /* = 0 */,
+    int plDevice /* = -1 */)
     : worldRank_(worldRank),
       isMaster_(worldRank_ == 0),
       worldSize_(worldSize),
@@ -66,7 +169,10 @@ PlGenerator::PlGenerator(
       inputTransform_(inputTransform),
       targetTransform_(targetTransform),
       wordTransform_(wordTransform),
-      tokenToWord_(tokenToWord) {
+      tokenToWord_(tokenToWord),
+      plShardSize_(plShardSize),
+      plDevice_(plDevice),
+      generation_(std::make_shared<detail::PlGenerationState>()) {
   // 1. Load PL generating intervals
   auto plEpochVec = lib::split(',', plEpoch, true);
   auto plRatioVec = lib::split(',', plRatio, true);
@@ -123,14 +229,17 @@ std::string PlGenerator::reloadPl(int curEpoch) const {
   std::string plDir =
       pathsConcat(plDir_, kPlSubdirPrefix + std::to_string(lastPlEpoch));
 
+  // Checked by the master only, so that all processes either load the PL or
+  // regenerate it, whatever their views of the file system
   bool isPLReady = true;
-  for (int i = 0; i < worldSize_; i++) {
+  for (int i = 0; worldRank_ == 0 && i < worldSize_; i++) {
     auto listFinishPath = pathsConcat(plDir, std::to_string(i) + ".fns");
     if (!fileExists(listFinishPath)) {
       isPLReady = false;
       break;
     }
   }
+  isPLReady = !fl::ext::broadcastStrings({isPLReady ? plDir : ""})[0].empty();
   if (isPLReady) {
     logMaster("[PlGenerator] Loading existing PL from " + plDir);
     return plDir;
@@ -191,45 +300,28 @@ std::string PlGenerator::regeneratePl(
       "[PlGenerator] " + std::to_string(nSelectedSamples) + "/" +
       std::to_string(fullUnsupDs_->size()) + " samples selected");
 
+  if (plShardSize_ > 0) {
+    startGeneration(curEpoch, plDir, selectedDs, ntwrk, criterion, usePlugin);
+    return plDir;
+  }
+
   /* 2. pseudo label generation */
   ntwrk->eval();
+  PlConfig config{tokenDict_,
+                  tokenToWord_,
+                  minInputSize_,
+                  maxInputSize_,
+                  minTargetSize_,
+                  maxTargetSize_,
+                  useExistingPl_ && seedModelWER_ < currentModelWER_,
+                  usePlugin};
   auto newPlFile = pathsConcat(plDir, std::to_string(worldRank_) + ".lst");
   std::ofstream plStream(newPlFile);
   for (auto& sample : *selectedDs) {
-    auto duration = afToVector<float>(sample[kDurationIdx]).front();
-    if (duration < minInputSize_ || duration > maxInputSize_) {
-      continue;
-    }
-
-    std::vector<std::string> words;
-    if (useExistingPl_ && seedModelWER_ < currentModelWER_) {
-      auto tokenTarget = afToVector<int>(sample[kTargetIdx]);
-      words = tokenToWord_(tokenTarget, tokenDict_, false);
-    } else {
-      fl::Variable rawEmission;
-      if (usePlugin) {
-        rawEmission = ntwrk
-                          ->forward(
-                              {fl::input(sample[kInputIdx]),
-                               fl::noGrad(sample[kDurationIdx])})
-                          .front();
-      } else {
-        rawEmission = fl::ext::forwardSequentialModuleWithPadMask(
-            fl::input(sample[kInputIdx]), ntwrk, sample[kDurationIdx]);
-      }
-      auto tokenPrediction =
-          afToVector<int>(criterion->viterbiPath(rawEmission.array()));
-      words = tokenToWord_(tokenPrediction, tokenDict_, true);
+    auto line = pseudoLabel(sample, ntwrk, criterion, config);
+    if (!line.empty()) {
+      plStream << line << std::endl;
     }
-    if (words.size() < minTargetSize_ || words.size() > maxTargetSize_) {
-      continue;
-    }
-
-    auto sampleId = readSampleIds(sample[kSampleIdx]).front();
-    auto inputPath = readSampleIds(sample[kPathIdx]).front();
-    plStream << sampleId << "\t" << inputPath << "\t"
-             << std::to_string(duration) << "\t" << lib::join(" ", words)
-             << std::endl;
   }
   plStream.close();
 
@@ -248,14 +340,54 @@ std::shared_ptr<fl::Dataset> PlGenerator::createTrainSet(
     const std::string& trainLists,
     const std::string& trainUnsupDir,
     const std::string& batchingStrategy /* = kBatchStrategyNone */,
-    int maxDurationPerBatch /* = 0 */) const {
+    int maxDurationPerBatch /* = 0 */,
+    int numBuckets /* = 10 */) const {
   std::vector<std::string> files;
   for (const auto& file : lib::split(",", trainLists, true)) {
     files.emplace_back(pathsConcat(trainDir, file));
   }
-  for (int i = 0; i < worldSize_; i++) {
-    files.emplace_back(pathsConcat(trainUnsupDir, std::to_string(i) + ".lst"));
+  // Shards written by each process, agreed on by all of them for the
+  // background generation in progress
+  std::vector<int> nShards(worldSize_, -1);
+  if (!generation_->plDir.empty() && trainUnsupDir == generation_->plDir) {
+    af::array counts = af::constant(0, 2 * worldSize_, f32);
+    counts(worldRank_) = generation_->nShards.load();
+    counts(worldSize_ + worldRank_) = generation_->done.load() ? 1 : 0;
+    if (worldSize_ > 1) {
+      fl::allReduce(counts);
+    }
+    auto countVec = afToVector<float>(counts);
+    bool allDone = true;
+    for (int i = 0; i < worldSize_; i++) {
+      nShards[i] = countVec[i];
+      allDone = allDone && countVec[worldSize_ + i] > 0;
+    }
+    if (allDone) {
+      generation_->join();
+      generation_->plDir.clear();
+    }
+    logMaster(
+        "[PlGenerator] Using " +
+        std::to_string(std::accumulate(nShards.begin(), nShards.end(), 0)) +
+        " PL shards of " + trainUnsupDir + (allDone ? "" : " (in progress)"));
   }
+  // The PL files are listed by the master, so that all processes build the
+  // same dataset, and are partitioned the same way
+  std::vector<std::string> plFiles;
+  for (int i = 0; worldRank_ == 0 && i < worldSize_; i++) {
+    auto listPath = pathsConcat(trainUnsupDir, std::to_string(i) + ".lst");
+    if (nShards[i] < 0 && fileExists(listPath)) {
+      plFiles.emplace_back(listPath);
+      continue;
+    }
+    for (int j = 0; nShards[i] < 0 ? fileExists(shardPath(trainUnsupDir, i, j))
+                                   : j < nShards[i];
+         j++) {
+      plFiles.emplace_back(shardPath(trainUnsupDir, i, j));
+    }
+  }
+  plFiles = fl::ext::broadcastStrings(plFiles);
+  files.insert(files.end(), plFiles.begin(), plFiles.end());
 
   return createDataset(
       files,
@@ -269,7 +401,101 @@ std::shared_ptr<fl::Dataset> PlGenerator::createTrainSet(
       worldSize_,
       false, // allowEmpty
       batchingStrategy,
-      maxDurationPerBatch);
+      maxDurationPerBatch,
+      numBuckets);
+}
+
+std::string PlGenerator::pendingPl() const {
+  return generation_->plDir;
+}
+
+void PlGenerator::startGeneration(
+    int curEpoch,
+    const std::string& plDir,
+    std::shared_ptr<fl::Dataset> selectedDs,
+    const std::shared_ptr<fl::Module>& ntwrk,
+    const std::shared_ptr<SequenceCriterion> criterion,
+    bool usePlugin) const {
+  // One generation at a time: the previous one is finished first
+  generation_->join();
+  generation_->plDir = plDir;
+  generation_->nShards = 0;
+  generation_->done = false;
+
+  // The worker labels with a snapshot of the model, which keeps training
+  auto snapshot = std::make_shared<std::stringstream>();
+  fl::save(*snapshot, ntwrk, criterion);
+  int device = plDevice_ >= 0 ? plDevice_ : af::getDevice();
+  PlConfig config{tokenDict_,
+                  tokenToWord_,
+                  minInputSize_,
+                  maxInputSize_,
+                  minTargetSize_,
+                  maxTargetSize_,
+                  useExistingPl_ && seedModelWER_ < currentModelWER_,
+                  usePlugin};
+  auto state = generation_;
+  int rank = worldRank_;
+  int shardSize = plShardSize_;
+  logMaster(
+      "[PlGenerator] Generating PL of epoch " + std::to_string(curEpoch) +
+      " in the background on device " + std::to_string(device));
+
+  state->worker = std::thread([state,
+                               snapshot,
+                               selectedDs,
+                               config,
+                               plDir,
+                               device,
+                               rank,
+                               shardSize]() {
+    try {
+      af::setDevice(device);
+      fl::NoGradGuard noGrad;
+      std::shared_ptr<fl::Module> localNtwrk;
+      std::shared_ptr<SequenceCriterion> localCriterion;
+      fl::load(*snapshot, localNtwrk, localCriterion);
+      localNtwrk->eval();
+      localCriterion->eval();
+
+      // Shards are written under a temporary name and renamed once complete
+      std::ofstream plStream;
+      std::string tmpPath;
+      int nInShard = 0;
+      auto closeShard = [&]() {
+        plStream.close();
+        auto path = shardPath(plDir, rank, state->nShards);
+        if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+          throw std::runtime_error("[PlGenerator] Failed to write " + path);
+        }
+        state->nShards++;
+        nInShard = 0;
+      };
+      for (auto& sample : *selectedDs) {
+        if (nInShard == 0) {
+          tmpPath = shardPath(plDir, rank, state->nShards) + ".tmp";
+          plStream.open(tmpPath);
+        }
+        auto line = pseudoLabel(sample, localNtwrk, localCriterion, config);
+        if (!line.empty()) {
+          plStream << line << std::endl;
+        }
+        if (++nInShard == shardSize) {
+          closeShard();
+        }
+      }
+      if (nInShard > 0) {
+        closeShard();
+      }
+
+      std::ofstream fnsStream(
+          pathsConcat(plDir, std::to_string(rank) + ".fns"));
+      fnsStream << "done";
+    } catch (...) {
+      state->error = std::current_exception();
+    }
+    state->done = true;
+  });
 }
 
 void PlGenerator::setModelWER(const float& wer) {
@@ -20,6 +20,10 @@ namespace fl {
 namespace app {
 namespace asr {
 
+namespace detail {
+struct PlGenerationState;
+} // namespace detail
+
 using TokenToWordFunc = std::function<std::vector<
     std::string>(const std::vector<int>&, const lib::text::Dictionary&, bool)>;
 
@@ -55,6 +59,19 @@ using TokenToWordFunc = std::function<std::vector<
  *      unsupDataDir);
  *  }
  *
+ * With a positive `plShardSize`, pseudo labels are instead generated in the
+ * background by a worker thread of each process, with a snapshot of the model
+ * on device `plDevice` (the device of the training if negative), and written
+ * in list files of `plShardSize` samples. `regeneratePl` then returns without
+ * waiting, and `createTrainSet` uses the shards completed by all the
+ * processes so far. While `pendingPl()` is not empty, the train set should be
+ * recreated from it as the shards come, e.g. at the end of each epoch:
+ *
+ *    unsupDataDir = plGen.regeneratePl(current_epoch, model);
+ *    if (unsupDataDir.empty()) {
+ *      unsupDataDir = plGen.pendingPl();
+ *    }
+ *
  */
 class PlGenerator {
  public:
@@ -78,7 +95,9 @@ class PlGenerator {
       fl::Dataset::DataTransformFunction inputTransform,
       fl::Dataset::DataTransformFunction targetTransform,
       fl::Dataset::DataTransformFunction wordTransform,
-      TokenToWordFunc tokenToWord);
+      TokenToWordFunc tokenToWord,
+      int plShardSize = 0,
+      int plDevice = -1);
 
   /*
    * To resume trainig, try to load existing pseudo labels.
@@ -97,6 +116,12 @@ class PlGenerator {
       const std::shared_ptr<SequenceCriterion> criterion,
       const bool usePlugin = false) const;
 
+  /*
+   * The folder of the pseudo labels being generated in the background, whose
+   * shards `createTrainSet` has not all used yet, or an empty string.
+   */
+  std::string pendingPl() const;
+
   /*
    * This function will create a mixture of supervised data and unalabeled data
    * with pseudo labels.
@@ -106,7 +131,8 @@ class PlGenerator {
       const std::string& trainLists,
       const std::string& trainUnsupDir,
       const std::string& batchingStrategy = kBatchStrategyNone,
-      int maxDurationPerBatch = 0) const;
+      int maxDurationPerBatch = 0,
+      int numBuckets = 10) const;
 
   /* To set the WER of current model in PlGenerator */
   void setModelWER(const float& wer);
@@ -139,7 +165,19 @@ class PlGenerator {
   std::vector<int> plEpochs_;
   std::unordered_map<int, float> plUpdateMap_;
 
+  int plShardSize_;
+  int plDevice_;
+  // Background generation, shared by the copies of the generator
+  std::shared_ptr<detail::PlGenerationState> generation_;
+
   int findLastPlEpoch(int curEpoch) const;
+  void startGeneration(
+      int curEpoch,
+      const std::string& plDir,
+      std::shared_ptr<fl::Dataset> selectedDs,
+      const std::shared_ptr<fl::Module>& ntwrk,
+      const std::shared_ptr<SequenceCriterion> criterion,
+      bool usePlugin) const;
   void logMaster(const std::string& message) const;
 };
 
@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/app/asr/decoder/Seq2SeqAmBatcher.h"
+
+#include <stdexcept>
+#include <utility>
+
+namespace fl {
+namespace app {
+namespace asr {
+
+Seq2SeqAmBatcher::Seq2SeqAmBatcher(
+    std::shared_ptr<SequenceCriterion> criterion,
+    int device,
+    int attRound,
+    int attentionThreshold,
+    float smoothingTemperature,
+    int maxHypotheses,
+    std::chrono::microseconds maxWait)
+    : criterion_(criterion),
+      s2sCriterion_(dynamic_cast<const Seq2SeqCriterion*>(criterion.get())),
+      device_(device),
+      attRound_(attRound),
+      attentionThreshold_(attentionThreshold),
+      smoothingTemperature_(smoothingTemperature),
+      maxHypotheses_(maxHypotheses),
+      maxWait_(maxWait) {
+  if (!s2sCriterion_) {
+    throw std::invalid_argument(
+        "Seq2SeqAmBatcher: the criterion must be a Seq2SeqCriterion");
+  }
+  if (maxHypotheses_ < 1) {
+    throw std::invalid_argument(
+        "Seq2SeqAmBatcher: maxHypotheses must be positive");
+  }
+  worker_ = std::thread([this]() { run(); });
+}
+
+Seq2SeqAmBatcher::~Seq2SeqAmBatcher() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  worker_.join();
+}
+
+AMUpdateFunc Seq2SeqAmBatcher::amUpdateFunc() {
+  // The encoding of the utterance of the decoder, and its initial state
+  auto input = std::make_shared<fl::Variable>();
+  auto dummyState = std::make_shared<Seq2SeqState>(attRound_);
+  return [this, input, dummyState](
+             const float* emissions,
+             const int N,
+             const int T,
+             const std::vector<int>& rawY,
+             const std::vector<AMStatePtr>& rawPrevStates,
+             int& t) {
+    if (t == 0) {
+      *input = fl::Variable(af::array(N, T, emissions), false);
+    }
+    auto request = std::make_unique<Request>();
+    request->input = *input;
+    for (int i = 0; i < rawY.size(); i++) {
+      if (t > 0) {
+        request->ys.push_back(rawY[i]);
+        request->states.push_back(
+            static_cast<Seq2SeqState*>(rawPrevStates[i].get()));
+      } else {
+        request->ys.push_back(-1);
+        request->states.push_back(dummyState.get());
+      }
+    }
+    auto result = submit(std::move(request)).get();
+
+    // Cast back to void*
+    std::vector<AMStatePtr> out;
+    for (auto& os : result.second) {
+      if (os->isValid) {
+        out.push_back(os);
+      } else {
+        out.push_back(nullptr);
+      }
+    }
+    return std::make_pair(std::move(result.first), out);
+  };
+}
+
+std::future<Seq2SeqAmBatcher::Result> Seq2SeqAmBatcher::submit(
+    std::unique_ptr<Request> request) {
+  auto result = request->result.get_future();
+  request->submitted = std::chrono::steady_clock::now();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queuedHypotheses_ += request->ys.size();
+    queue_.push_back(std::move(request));
+  }
+  cv_.notify_all();
+  return result;
+}
+
+void Seq2SeqAmBatcher::run() {
+  af::setDevice(device_);
+  while (true) {
+    std::vector<std::unique_ptr<Request>> batch;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        return;
+      }
+      // Waits for more updates until the batch is full or the first one has
+      // waited for long enough
+      auto deadline = queue_.front()->submitted + maxWait_;
+      cv_.wait_until(lock, deadline, [this]() {
+        return stop_ || queuedHypotheses_ >= maxHypotheses_;
+      });
+      int hypotheses = 0;
+      while (!queue_.empty() &&
+             (batch.empty() ||
+              hypotheses + static_cast<int>(queue_.front()->ys.size()) <=
+                  maxHypotheses_)) {
+        hypotheses += queue_.front()->ys.size();
+        batch.push_back(std::move(queue_.front()));
+        queue_.pop_front();
+      }
+      queuedHypotheses_ -= hypotheses;
+    }
+    process(batch);
+  }
+}
+
+void Seq2SeqAmBatcher::process(std::vector<std::unique_ptr<Request>>& batch) {
+  std::vector<int> numHypotheses;
+  Result result;
+  try {
+    std::vector<fl::Variable> inputs, ys;
+    std::vector<Seq2SeqState*> states;
+    for (auto& request : batch) {
+      inputs.push_back(request->input);
+      numHypotheses.push_back(request->ys.size());
+      for (int i = 0; i < request->ys.size(); i++) {
+        ys.push_back(
+            request->ys[i] < 0
+                ? fl::Variable()
+                : fl::constant(request->ys[i], 1, s32, false));
+        states.push_back(request->states[i]);
+      }
+    }
+    result = s2sCriterion_->decodeBatchStep(
+        inputs,
+        numHypotheses,
+        ys,
+        states,
+        attentionThreshold_,
+        smoothingTemperature_);
+  } catch (...) {
+    for (auto& request : batch) {
+      request->result.set_exception(std::current_exception());
+    }
+    return;
+  }
+
+  // Scattered back to the decoders
+  int begin = 0;
+  for (int r = 0; r < batch.size(); r++) {
+    int end = begin + numHypotheses[r];
+    Result part;
+    part.first.assign(
+        std::make_move_iterator(result.first.begin() + begin),
+        std::make_move_iterator(result.first.begin() + end));
+    part.second.assign(
+        result.second.begin() + begin, result.second.begin() + end);
+    batch[r]->result.set_value(std::move(part));
+    begin = end;
+  }
+}
+
+} // namespace asr
+} // namespace app
+} // namespace fl
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "flashlight/app/asr/criterion/Seq2SeqCriterion.h"
+
+namespace fl {
+namespace app {
+namespace asr {
+
+/**
+ * Runs the AM updates of the Seq2Seq decoders of several threads together:
+ * the decoders of `amUpdateFunc()` submit the hypotheses of their utterance
+ * and wait, while a worker thread gathers the submitted updates and runs them
+ * on the device as one `Seq2SeqCriterion::decodeBatchStep()` over the
+ * hypotheses of all their utterances. A batch is run as soon as it has
+ * `maxHypotheses` hypotheses, or `maxWait` after its first update was
+ * submitted, which bounds the latency added to each step of a decoder when
+ * the others are idle.
+ *
+ * The decoders and the batcher must use the same device, on which the arrays
+ * of the criterion are.
+ */
+class Seq2SeqAmBatcher {
+ public:
+  Seq2SeqAmBatcher(
+      std::shared_ptr<SequenceCriterion> criterion,
+      int device,
+      int attRound,
+      int attentionThreshold,
+      float smoothingTemperature,
+      int maxHypotheses,
+      std::chrono::microseconds maxWait);
+
+  ~Seq2SeqAmBatcher();
+
+  /**
+   * The update function of a decoder, which submits its updates to the
+   * batcher. Each decoder needs its own.
+   */
+  AMUpdateFunc amUpdateFunc();
+
+ private:
+  using Result =
+      std::pair<std::vector<std::vector<float>>, std::vector<Seq2SeqStatePtr>>;
+
+  struct Request {
+    fl::Variable input;
+    // -1 at the first step
+    std::vector<int> ys;
+    std::vector<Seq2SeqState*> states;
+    std::chrono::steady_clock::time_point submitted;
+    std::promise<Result> result;
+  };
+
+  std::future<Result> submit(std::unique_ptr<Request> request);
+  void run();
+  void process(std::vector<std::unique_ptr<Request>>& batch);
+
+  std::shared_ptr<SequenceCriterion> criterion_;
+  const Seq2SeqCriterion* s2sCriterion_;
+  int device_;
+  int attRound_;
+  int attentionThreshold_;
+  float smoothingTemperature_;
+  int maxHypotheses_;
+  std::chrono::microseconds maxWait_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::unique_ptr<Request>> queue_;
+  int queuedHypotheses_{0};
+  bool stop_{false};
+  std::thread worker_;
+};
+
+} // namespace asr
+} // namespace app
+} // namespace fl
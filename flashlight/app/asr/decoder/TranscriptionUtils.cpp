@@ -110,15 +110,17 @@ std::vector<std::string> tknPrediction2Ltr(
     const bool isSeq2seqCrit,
     const int replabel,
     const bool useWordPiece,
-    const std::string& wordSep) {
+    const std::string& wordSep,
+    const bool isCompacted /* = false */) {
   if (tokens.empty()) {
     return std::vector<std::string>{};
   }
 
-  if (criterion == kCtcCriterion || criterion == kAsgCriterion) {
+  if (!isCompacted &&
+      (criterion == kCtcCriterion || criterion == kAsgCriterion)) {
     dedup(tokens);
   }
-  if (criterion == kCtcCriterion) {
+  if (!isCompacted && criterion == kCtcCriterion) {
     int blankIdx = tokenDict.getIndex(kBlankToken);
     tokens.erase(
         std::remove(tokens.begin(), tokens.end(), blankIdx), tokens.end());
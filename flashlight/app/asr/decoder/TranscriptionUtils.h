@@ -50,6 +50,8 @@ std::vector<std::string> tknTarget2Ltr(
     const bool useWordPiece,
     const std::string& wordSep);
 
+// Tokens of CTC or ASG with `isCompacted` were already deduplicated, and
+// stripped of blanks (see `compactViterbiPath()`)
 std::vector<std::string> tknPrediction2Ltr(
     std::vector<int> tokens,
     const fl::lib::text::Dictionary& tokenDict,
@@ -58,7 +60,8 @@ std::vector<std::string> tknPrediction2Ltr(
     const bool isSeq2seqCrit,
     const int replabel,
     const bool useWordPiece,
-    const std::string& wordSep);
+    const std::string& wordSep,
+    const bool isCompacted = false);
 
 std::vector<int> tkn2Idx(
     const std::vector<std::string>& spelling,
@@ -0,0 +1,342 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/app/asr/decoder/TransformerLmModule.h"
+
+#include <algorithm>
+#include <map>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "flashlight/ext/common/DistributedUtils.h"
+
+namespace fl {
+namespace app {
+namespace asr {
+
+namespace {
+
+// Keys and values of consecutive positions of a sentence, for each layer.
+// Pages are immutable once built, and shared by the caches of the sentences
+// with the same prefix
+struct KVPage {
+  std::vector<TransformerKVCache> layers;
+
+  int length() const {
+    return layers.front().length();
+  }
+};
+
+// Cache of a sentence: its tokens, for the frontend, and the keys and values
+// of its positions
+struct LmCache {
+  std::vector<int> tokens;
+  std::vector<std::shared_ptr<const KVPage>> pages;
+};
+
+// The layers of an app/lm model
+struct TransformerLmLayers {
+  std::shared_ptr<Module> frontend;
+  std::vector<std::shared_ptr<Transformer>> transformers;
+  std::vector<std::shared_ptr<Module>> output;
+  std::shared_ptr<AdaptiveSoftMax> softmax;
+};
+
+TransformerLmLayers getLayers(
+    const std::shared_ptr<Module>& network,
+    const std::shared_ptr<Module>& criterion) {
+  auto container = std::dynamic_pointer_cast<Container>(network);
+  if (!container || container->modules().size() < 2) {
+    throw std::invalid_argument(
+        "[TransformerLM] The network should be a container of a frontend "
+        "and transformer layers");
+  }
+  TransformerLmLayers layers;
+  auto modules = container->modules();
+  layers.frontend = modules[0];
+  size_t i = 1;
+  for (; i < modules.size(); ++i) {
+    auto layer = std::dynamic_pointer_cast<Transformer>(modules[i]);
+    if (!layer) {
+      break;
+    }
+    layers.transformers.push_back(layer);
+  }
+  if (layers.transformers.empty()) {
+    throw std::invalid_argument(
+        "[TransformerLM] The frontend of the network should be followed by "
+        "transformer layers");
+  }
+  layers.output.assign(modules.begin() + i, modules.end());
+  if (auto adsm = std::dynamic_pointer_cast<AdaptiveSoftMaxLoss>(criterion)) {
+    layers.softmax = adsm->getActivation();
+  }
+  return layers;
+}
+
+// The cache of layer `layer` for the sentences `batch` (indices in `caches`),
+// whose prefixes have `length` positions
+TransformerKVCache batchCache(
+    const std::vector<std::shared_ptr<void>>& caches,
+    const std::vector<int>& batch,
+    int layer) {
+  std::vector<Variable> keys, values;
+  for (int i : batch) {
+    auto cache = static_cast<const LmCache*>(caches[i].get());
+    std::vector<Variable> pageKeys, pageValues;
+    for (const auto& page : cache->pages) {
+      pageKeys.push_back(page->layers[layer].keys);
+      pageValues.push_back(page->layers[layer].values);
+    }
+    keys.push_back(concatenate(pageKeys, 0));
+    values.push_back(concatenate(pageValues, 0));
+  }
+  TransformerKVCache batched;
+  batched.keys = concatenate(keys, 2);
+  batched.values = concatenate(values, 2);
+  return batched;
+}
+
+// One token of each of the sentences `batch`, of prefixes of `length`
+// positions: replaces their caches with the ones after the token. Returns the
+// B x C scores.
+std::vector<float> forwardToken(
+    const TransformerLmLayers& layers,
+    const std::vector<int>& tokens,
+    std::vector<std::shared_ptr<void>>& caches,
+    const std::vector<int>& batch,
+    int length,
+    int pageSize) {
+  int batchSize = batch.size();
+  // The frontend is forwarded on the whole sentences, for the embedding of
+  // the position of the new tokens
+  std::vector<int> sentences;
+  sentences.reserve((length + 1) * batchSize);
+  for (int i : batch) {
+    if (length > 0) {
+      const auto& prefix = static_cast<const LmCache*>(caches[i].get())->tokens;
+      sentences.insert(sentences.end(), prefix.begin(), prefix.end());
+    }
+    sentences.push_back(tokens[i]);
+  }
+  af::array inputData(length + 1, batchSize, sentences.data());
+  auto hidden = layers.frontend->forward({fl::input(inputData)})[0];
+  hidden = hidden(af::span, af::seq(length, length), af::span);
+
+  // Keys and values of the new position of each sentence, for each layer
+  std::vector<std::shared_ptr<KVPage>> positions(batchSize);
+  for (auto& position : positions) {
+    position = std::make_shared<KVPage>();
+  }
+  for (size_t l = 0; l < layers.transformers.size(); ++l) {
+    auto cache =
+        length > 0 ? batchCache(caches, batch, l) : TransformerKVCache();
+    hidden = layers.transformers[l]->forwardIncremental(hidden, cache);
+    for (int b = 0; b < batchSize; ++b) {
+      TransformerKVCache position;
+      position.keys = Variable(
+          cache.keys.array()(af::seq(length, length), af::span, b), false);
+      position.values = Variable(
+          cache.values.array()(af::seq(length, length), af::span, b), false);
+      positions[b]->layers.push_back(position);
+    }
+  }
+  for (const auto& module : layers.output) {
+    hidden = module->forward({hidden})[0];
+  }
+  auto output = layers.softmax ? layers.softmax->forward(hidden)
+                               : logSoftmax(hidden, 0);
+  if (af::count<int>(af::isNaN(output.array())) != 0) {
+    throw std::runtime_error("[TransformerLM] Encountered NaNs in propagation");
+  }
+  // output (c, 1, b)
+  if (output.dims(1) != 1 || output.dims(2) != batchSize) {
+    throw std::logic_error(
+        "[TransformerLM]: incorrect predictions: batch should be " +
+        std::to_string(batchSize) + " but it is " +
+        std::to_string(output.dims(2)));
+  }
+
+  for (int b = 0; b < batchSize; ++b) {
+    auto next = std::make_shared<LmCache>();
+    if (length > 0) {
+      *next = *static_cast<const LmCache*>(caches[batch[b]].get());
+    }
+    next->tokens.push_back(tokens[batch[b]]);
+    if (next->pages.empty() || next->pages.back()->length() >= pageSize) {
+      next->pages.push_back(positions[b]);
+    } else {
+      // Copy-on-write: the last page of the parent isn't full, the sentence
+      // appends its position to a copy
+      auto page = std::make_shared<KVPage>(*next->pages.back());
+      for (size_t l = 0; l < page->layers.size(); ++l) {
+        auto& layer = page->layers[l];
+        const auto& position = positions[b]->layers[l];
+        layer.keys = concatenate({layer.keys, position.keys}, 0);
+        layer.values = concatenate({layer.values, position.values}, 0);
+      }
+      next->pages.back() = page;
+    }
+    caches[batch[b]] = next;
+  }
+  return ext::afToVector<float>(output.array());
+}
+
+} // namespace
+
+TransformerLmScoreFunc buildTransformerLmScoreFunction(
+    std::shared_ptr<Module> network,
+    std::shared_ptr<Module> criterion,
+    int pageSize /* = 32 */) {
+  if (pageSize < 1) {
+    throw std::invalid_argument("[TransformerLM] Page size is too small");
+  }
+  auto layers = getLayers(network, criterion);
+  return [layers, pageSize](
+             const std::vector<int>& tokens,
+             std::vector<std::shared_ptr<void>>& caches) {
+    if (tokens.size() != caches.size()) {
+      throw std::invalid_argument(
+          "[TransformerLM] Different numbers of tokens and caches");
+    }
+    // The caches of a batch have the same length
+    std::map<int, std::vector<int>> batches;
+    for (size_t i = 0; i < tokens.size(); ++i) {
+      int length = caches[i]
+          ? static_cast<const LmCache*>(caches[i].get())->tokens.size()
+          : 0;
+      batches[length].push_back(i);
+    }
+    std::vector<float> scores;
+    for (const auto& lengthBatch : batches) {
+      const auto& batch = lengthBatch.second;
+      auto batchScores = forwardToken(
+          layers, tokens, caches, batch, lengthBatch.first, pageSize);
+      size_t vocabSize = batchScores.size() / batch.size();
+      scores.resize(tokens.size() * vocabSize);
+      for (size_t b = 0; b < batch.size(); ++b) {
+        std::copy(
+            batchScores.begin() + b * vocabSize,
+            batchScores.begin() + (b + 1) * vocabSize,
+            scores.begin() + batch[b] * vocabSize);
+      }
+    }
+    return scores;
+  };
+}
+
+TransformerLmSentenceScoreFunc buildTransformerLmSentenceScoreFunction(
+    std::shared_ptr<Module> network,
+    std::shared_ptr<Module> criterion,
+    int eosIdx,
+    int padIdx,
+    int maxBatchTokens /* = 4096 */) {
+  if (maxBatchTokens < 1) {
+    throw std::invalid_argument("[TransformerLM] Batch size is too small");
+  }
+  // Only the softmax of an adaptive softmax criterion is used
+  auto layers = getLayers(network, criterion);
+  return [network, layers, eosIdx, padIdx, maxBatchTokens](
+             const std::vector<std::vector<int>>& sentences) {
+    // Sorted distinct sentences: the ones which are the prefix of the next
+    // one are scored with it
+    std::vector<int> order(sentences.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&sentences](int i, int j) {
+      return sentences[i] < sentences[j];
+    });
+    // The sentences forwarded, and the one giving the scores of each sentence
+    std::vector<int> forwarded;
+    std::vector<int> scoredWith(sentences.size());
+    for (int k = order.size() - 1; k >= 0; --k) {
+      const auto& sentence = sentences[order[k]];
+      if (!forwarded.empty()) {
+        const auto& next = sentences[forwarded.back()];
+        if (sentence.size() <= next.size() &&
+            std::equal(sentence.begin(), sentence.end(), next.begin())) {
+          scoredWith[order[k]] = forwarded.back();
+          continue;
+        }
+      }
+      forwarded.push_back(order[k]);
+      scoredWith[order[k]] = order[k];
+    }
+    // Batches of sentences of similar lengths
+    std::stable_sort(
+        forwarded.begin(), forwarded.end(), [&sentences](int i, int j) {
+          return sentences[i].size() > sentences[j].size();
+        });
+
+    // For each forwarded sentence, the log-probabilities of its words and of
+    // the end of sentence after each of its prefixes
+    std::vector<std::vector<float>> wordScores(sentences.size());
+    std::vector<std::vector<float>> eosScores(sentences.size());
+    size_t start = 0;
+    while (start < forwarded.size()) {
+      // With the start of sentence
+      int T = sentences[forwarded[start]].size() + 1;
+      int B = std::max<int>(1, maxBatchTokens / T);
+      size_t end = std::min(forwarded.size(), start + B);
+      B = end - start;
+      std::vector<int> input(T * B, padIdx), sizes(B);
+      for (int b = 0; b < B; ++b) {
+        const auto& sentence = sentences[forwarded[start + b]];
+        input[b * T] = eosIdx;
+        std::copy(sentence.begin(), sentence.end(), input.begin() + b * T + 1);
+        sizes[b] = sentence.size() + 1;
+      }
+      af::array inputData(T, B, input.data());
+      af::array inputSizes(1, B, sizes.data());
+      auto hidden =
+          network->forward({fl::input(inputData), fl::noGrad(inputSizes)})[0];
+      auto output = layers.softmax ? layers.softmax->forward(hidden)
+                                   : logSoftmax(hidden, 0);
+      if (af::count<int>(af::isNaN(output.array())) != 0) {
+        throw std::runtime_error(
+            "[TransformerLM] Encountered NaNs in propagation");
+      }
+      // The log-probabilities of the next words and of the end of sentence,
+      // gathered on the device: the outputs have the size of the vocabulary
+      int C = output.dims(0);
+      std::vector<int> wordIndices(T * B), eosIndices(T * B);
+      for (int i = 0; i < T * B; ++i) {
+        bool last = i % T == T - 1;
+        wordIndices[i] = i * C + (last ? eosIdx : input[i + 1]);
+        eosIndices[i] = i * C + eosIdx;
+      }
+      auto flatOutput = af::flat(output.array());
+      auto words = ext::afToVector<float>(
+          af::lookup(flatOutput, af::array(T * B, wordIndices.data())));
+      auto eos = ext::afToVector<float>(
+          af::lookup(flatOutput, af::array(T * B, eosIndices.data())));
+      for (int b = 0; b < B; ++b) {
+        int idx = forwarded[start + b];
+        wordScores[idx].assign(
+            words.begin() + b * T, words.begin() + b * T + sizes[b] - 1);
+        eosScores[idx].assign(
+            eos.begin() + b * T, eos.begin() + b * T + sizes[b]);
+      }
+      start = end;
+    }
+
+    std::vector<float> scores(sentences.size());
+    for (size_t i = 0; i < sentences.size(); ++i) {
+      int n = sentences[i].size();
+      int idx = scoredWith[i];
+      scores[i] = std::accumulate(
+                      wordScores[idx].begin(),
+                      wordScores[idx].begin() + n,
+                      0.0f) +
+          eosScores[idx][n];
+    }
+    return scores;
+  };
+}
+} // namespace asr
+} // namespace app
+} // namespace fl
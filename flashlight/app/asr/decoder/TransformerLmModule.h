@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include "flashlight/fl/contrib/contrib.h"
+#include "flashlight/fl/flashlight.h"
+
+namespace fl {
+namespace app {
+namespace asr {
+
+using TransformerLmScoreFunc = std::function<std::vector<float>(
+    const std::vector<int>&,
+    std::vector<std::shared_ptr<void>>&)>;
+
+/**
+ * Scoring function of `fl::lib::text::TransformerLM` for a model trained with
+ * `fl/app/lm`: `network` is a container of a frontend (the token and position
+ * embeddings) followed by `fl::Transformer` layers, and optionally by output
+ * layers; the log-probabilities are computed by the adaptive softmax of
+ * `criterion` if it is an `AdaptiveSoftMaxLoss`, and as the log-softmax of
+ * the output otherwise.
+ *
+ * The layers are forwarded with `Transformer::forwardIncremental()` on the new
+ * token of each state. The keys and values of the prefix of a state are kept
+ * in pages of `pageSize` positions: a state shares the full pages of its
+ * parent, so that the sibling hypotheses of a beam hold one copy of their
+ * prefix, and copies the last page of its parent only if it isn't full
+ * (copy-on-write). The states of a call are batched by prefix length.
+ */
+TransformerLmScoreFunc buildTransformerLmScoreFunction(
+    std::shared_ptr<Module> network,
+    std::shared_ptr<Module> criterion,
+    int pageSize = 32);
+
+using TransformerLmSentenceScoreFunc =
+    std::function<std::vector<float>(const std::vector<std::vector<int>>&)>;
+
+/**
+ * Log-probabilities of whole sentences (without their start and end of
+ * sentence `eosIdx`, which are added), e.g. for the rescoring of n-best lists,
+ * with a model trained with `fl/app/lm` (see
+ * `buildTransformerLmScoreFunction()`). The network is forwarded with its
+ * `forward()`, on batches of sentences of similar lengths, of
+ * `maxBatchTokens` tokens at most (padded with `padIdx`). Duplicates are
+ * scored once, and so are sentences which are the prefix of another one: the
+ * causal model gives their scores in the forward of the longer one.
+ */
+TransformerLmSentenceScoreFunc buildTransformerLmSentenceScoreFunction(
+    std::shared_ptr<Module> network,
+    std::shared_ptr<Module> criterion,
+    int eosIdx,
+    int padIdx,
+    int maxBatchTokens = 4096);
+} // namespace asr
+} // namespace app
+} // namespace fl
@@ -13,6 +13,9 @@
 
 #include <glog/logging.h>
 
+#include "flashlight/app/asr/data/AsyncListFileDataset.h"
+#include "flashlight/app/asr/data/FeatureShardDataset.h"
+#include "flashlight/app/asr/data/FeatureTransforms.h"
 #include "flashlight/ext/common/DistributedUtils.h"
 #include "flashlight/lib/common/System.h"
 
@@ -127,9 +130,23 @@ std::shared_ptr<fl::Dataset> createDataset(
     int worldSize /* = 1 */,
     const bool allowEmpty /* = false */,
     const std::string& batchingStrategy /* kBatchStrategyNone */,
-    int maxDurationPerBatch /* = 0 */) {
+    int maxDurationPerBatch /* = 0 */,
+    int numBuckets /* = 10 */) {
   std::vector<std::shared_ptr<const fl::Dataset>> allListDs;
   std::vector<float> sizes;
+  // Shared by the lists read asynchronously, with their first sample index
+  std::shared_ptr<AsyncBlobReader> blobReader;
+  std::vector<std::pair<std::shared_ptr<AsyncListFileDataset>, int64_t>>
+      asyncListDs;
+  if (FLAGS_async_read_inflight > 0) {
+    blobReader = std::make_shared<AsyncBlobReader>(
+        createBlobStore(FLAGS_async_read_store),
+        FLAGS_async_read_inflight,
+        FLAGS_async_read_batch,
+        // Room for the lookahead of prefetch threads reading a bit ahead
+        2 * FLAGS_async_read_lookahead + FLAGS_async_read_inflight *
+                FLAGS_async_read_batch);
+  }
   for (auto& path : paths) {
     std::shared_ptr<ListFileDataset> curListDs;
     if (FLAGS_everstoredb) {
@@ -144,6 +161,28 @@ std::shared_ptr<fl::Dataset> createDataset(
       LOG(FATAL) << "EverstoreDataset not supported: "
                  << "build with -DFL_BUILD_FB_DEPENDENCIES";
 #endif
+    } else if (FeatureShardDataset::isManifest(pathsConcat(rootDir, path))) {
+      // Features are precomputed, only normalize them
+      fl::Dataset::DataTransformFunction normalization;
+      if (inputTransform) {
+        normalization = inputNormalization(
+            {FLAGS_localnrmlleftctx, FLAGS_localnrmlrightctx});
+      }
+      curListDs = std::make_shared<FeatureShardDataset>(
+          pathsConcat(rootDir, path),
+          normalization,
+          targetTransform,
+          wordTransform);
+    } else if (blobReader) {
+      auto asyncDs = std::make_shared<AsyncListFileDataset>(
+          pathsConcat(rootDir, path),
+          blobReader,
+          FLAGS_async_read_lookahead,
+          inputTransform,
+          targetTransform,
+          wordTransform);
+      asyncListDs.emplace_back(asyncDs, sizes.size());
+      curListDs = asyncDs;
     } else {
       curListDs = std::make_shared<ListFileDataset>(
           pathsConcat(rootDir, path),
@@ -178,6 +217,20 @@ std::shared_ptr<fl::Dataset> createDataset(
     std::stable_sort(sizes.begin(), sizes.end(), std::greater<float>());
   }
 
+  // Prefetches the samples of this partition in the order they are batched
+  auto setReadOrder = [&](const std::vector<int64_t>& partition) {
+    for (const auto& ds : asyncListDs) {
+      std::vector<int64_t> order;
+      for (auto id : partition) {
+        int64_t idx = sortedIds[id] - ds.second;
+        if (idx >= 0 && idx < ds.first->size()) {
+          order.push_back(idx);
+        }
+      }
+      ds.first->setReadOrder(order);
+    }
+  };
+
   auto concatListDs = std::make_shared<fl::ConcatDataset>(allListDs);
 
   auto sortedDs =
@@ -206,16 +259,29 @@ std::shared_ptr<fl::Dataset> createDataset(
         sizes, worldRank, worldSize, maxDurationPerBatch, allowEmpty);
     auto partitions = result.first;
     auto batchSizes = result.second;
+    setReadOrder(partitions);
     auto paritionDs =
         std::make_shared<fl::ResampleDataset>(sortedDs, partitions);
     // Batch the dataset
     return std::make_shared<fl::BatchDataset>(paritionDs, batchSizes, batchFns);
+  } else if (batchingStrategy == kBatchStrategyBucket) {
+    // Partition and batch the dataset, rebucketed with resample() each epoch
+    return std::make_shared<fl::BucketBatchDataset>(
+        sortedDs,
+        sizes,
+        worldRank,
+        worldSize,
+        maxDurationPerBatch,
+        numBuckets,
+        batchFns,
+        allowEmpty);
   } else if (
       batchingStrategy == kBatchStrategyNone ||
       batchingStrategy == kBatchStrategyRand) {
     // Partition the dataset and distribute
     auto partitions = fl::partitionByRoundRobin(
         sortedDs->size(), worldRank, worldSize, batchSize, allowEmpty);
+    setReadOrder(partitions);
     auto paritionDs =
         std::make_shared<fl::ResampleDataset>(sortedDs, partitions);
     // Batch the dataset
@@ -231,13 +297,18 @@ std::shared_ptr<fl::Dataset> loadPrefetchDataset(
     std::shared_ptr<fl::Dataset> dataset,
     int prefetchThreads,
     bool shuffle,
-    int shuffleSeed /*= 0 */) {
+    int shuffleSeed /*= 0 */,
+    int reorderWindow /*= 0 */) {
   if (shuffle) {
     dataset = std::make_shared<fl::ShuffleDataset>(dataset, shuffleSeed);
   }
   if (prefetchThreads > 0) {
     dataset = std::make_shared<fl::PrefetchDataset>(
-        dataset, prefetchThreads, prefetchThreads /* prefetch size */);
+        dataset,
+        prefetchThreads,
+        prefetchThreads /* prefetch size */,
+        false /* deviceStaging */,
+        reorderWindow);
   }
   return dataset;
 }
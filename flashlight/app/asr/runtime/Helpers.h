@@ -72,15 +72,19 @@ std::vector<std::string> readSampleIds(const af::array& arr);
 
 /*
  * Utility function for creating a w2l dataset.
- * From gflags it uses FLAGS_everstoredb and FLAGS_memcache
+ * From gflags it uses FLAGS_everstoredb and FLAGS_memcache, and the
+ * FLAGS_async_read_* to read audio files asynchronously (see
+ * `AsyncListFileDataset`)
  * @param inputTransform - a function to featurize input
  * @param targetTransform - a function to featurize target
  * @param wordTransform - a function to featurize words
  * @param padVal - a tuple of padding values when batching input, target, word
- * @param batchingStrategy - batching strategy for the data, for now "none" and
- * "dynamic"
+ * @param batchingStrategy - batching strategy for the data, for now "none",
+ * "dynamic" and "bucket"
  * @param maxDurationPerBatch - is used for batchingStrategy="dynamic", max
  * total duration in a batch
+ * @param numBuckets - is used for batchingStrategy="bucket", number of length
+ * buckets
  */
 std::shared_ptr<fl::Dataset> createDataset(
     const std::vector<std::string>& paths,
@@ -95,13 +99,15 @@ std::shared_ptr<fl::Dataset> createDataset(
     int worldSize = 1,
     const bool allowEmpty = false,
     const std::string& batchingStrategy = kBatchStrategyNone,
-    int maxDurationPerBatch = 0);
+    int maxDurationPerBatch = 0,
+    int numBuckets = 10);
 
 std::shared_ptr<fl::Dataset> loadPrefetchDataset(
     std::shared_ptr<fl::Dataset> dataset,
     int prefetchThreads,
     bool shuffle,
-    int shuffleSeed = 0);
+    int shuffleSeed = 0,
+    int reorderWindow = 0);
 
 /*
  * Function to parse valid set string describing multiple datasets into a vector
@@ -102,6 +102,71 @@ std::string getLogString(
   return status;
 }
 
+std::string getStepProfileString(
+    TrainMeters& meters,
+    const std::string& separator /* = " | " */) {
+  std::string status;
+  auto insertItem = [&](std::string key, const fl::EventTimeMeter& timer) {
+    auto val = key + ": " + format("%.2f", timer.value() * 1000) + "/" +
+        format("%.2f", timer.percentile(0.99) * 1000);
+    status = status + (status.empty() ? "" : separator) + val;
+  };
+  insertItem("smp(ms)", meters.sampletimer);
+  insertItem("fwd(ms)", meters.fwdtimer);
+  insertItem("crit-fwd(ms)", meters.critfwdtimer);
+  insertItem("bwd(ms)", meters.bwdtimer);
+  insertItem("optim(ms)", meters.optimtimer);
+  auto insertLatency = [&](std::string key, const fl::LatencyMeter& meter) {
+    auto p = meter.value();
+    status = status + separator + key + ": " +
+        format("%.2f/%.2f/%.2f/%.2f",
+               p[0] * 1000,
+               p[1] * 1000,
+               p[2] * 1000,
+               p[3] * 1000);
+  };
+  insertLatency("step(ms)", meters.steplatency);
+  insertLatency("wait(ms)", meters.samplelatency);
+  return status;
+}
+
+void setTrainMetrics(TrainMeters& meters) {
+  auto& registry = fl::MetricsRegistry::global();
+  auto setPhase = [&registry](
+                      const std::string& phase,
+                      const fl::EventTimeMeter& timer) {
+    const std::string help = "Time of a phase of the training steps";
+    registry
+        .gauge(
+            "fl_train_phase_seconds",
+            help,
+            {{"phase", phase}, {"stat", "mean"}})
+        .set(timer.value());
+    registry
+        .gauge(
+            "fl_train_phase_seconds",
+            help,
+            {{"phase", phase}, {"stat", "p99"}})
+        .set(timer.percentile(0.99));
+  };
+  setPhase("data", meters.sampletimer);
+  setPhase("forward", meters.fwdtimer);
+  setPhase("criterion", meters.critfwdtimer);
+  setPhase("backward", meters.bwdtimer);
+  setPhase("optimizer", meters.optimtimer);
+
+  registry.gauge("fl_train_loss", "Training loss")
+      .set(meters.train.loss.value()[0]);
+  for (auto& v : meters.valid) {
+    registry.gauge("fl_valid_loss", "Validation loss", {{"set", v.first}})
+        .set(v.second.loss.value()[0]);
+    registry.gauge("fl_valid_ter", "Validation TER", {{"set", v.first}})
+        .set(v.second.tknEdit.errorRate()[0]);
+    registry.gauge("fl_valid_wer", "Validation WER", {{"set", v.first}})
+        .set(v.second.wrdEdit.errorRate()[0]);
+  }
+}
+
 void appendToLog(std::ofstream& logfile, const std::string& logstr) {
   auto write = [&]() {
     logfile.clear(); // reset flags
@@ -145,6 +210,8 @@ void syncMeter(TrainMeters& mtrs) {
   fl::ext::syncMeter(mtrs.critfwdtimer);
   fl::ext::syncMeter(mtrs.bwdtimer);
   fl::ext::syncMeter(mtrs.optimtimer);
+  fl::ext::syncMeter(mtrs.steplatency);
+  fl::ext::syncMeter(mtrs.samplelatency);
   fl::ext::syncMeter(mtrs.train.tknEdit);
   fl::ext::syncMeter(mtrs.train.wrdEdit);
   fl::ext::syncMeter(mtrs.train.loss);
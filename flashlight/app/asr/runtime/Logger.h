@@ -24,11 +24,16 @@ struct DatasetMeters {
 struct TrainMeters {
   fl::TimeMeter runtime;
   fl::TimeMeter timer{true};
-  fl::TimeMeter sampletimer{true};
-  fl::TimeMeter fwdtimer{true}; // includes network + criterion time
-  fl::TimeMeter critfwdtimer{true};
-  fl::TimeMeter bwdtimer{true}; // includes network + criterion time
-  fl::TimeMeter optimtimer{true};
+  // Timers of the phases of a step, on the device
+  fl::EventTimeMeter sampletimer{true};
+  fl::EventTimeMeter fwdtimer{true}; // includes network + criterion time
+  fl::EventTimeMeter critfwdtimer{true};
+  fl::EventTimeMeter bwdtimer{true}; // includes network + criterion time
+  fl::EventTimeMeter optimtimer{true};
+  // Distributions of the wall-clock times of the updates, and of the waits
+  // for the batches, over all the processes once synced
+  fl::LatencyMeter steplatency;
+  fl::LatencyMeter samplelatency;
 
   DatasetMeters train;
   std::map<std::string, DatasetMeters> valid;
@@ -59,6 +64,24 @@ std::string getLogString(
     double scaleFactor,
     const std::string& separator = " | ");
 
+/*
+ * Mean and 99th percentile of the time spent per step in each phase (sample,
+ * forward, criterion forward, backward and optimizer), in ms. Percentiles
+ * are the ones of the current process. Followed by the 50th, 90th, 99th and
+ * 99.9th percentiles of the times of the updates and of the waits for the
+ * batches, over all the processes.
+ */
+std::string getStepProfileString(
+    TrainMeters& meters,
+    const std::string& separator = " | ");
+
+/**
+ * Sets the gauges of the global `fl::MetricsRegistry` of the values reported
+ * since the meters were reset: the mean and 99th percentile of the times of
+ * the phases of a step, and the losses and error rates.
+ */
+void setTrainMetrics(TrainMeters& meters);
+
 void appendToLog(std::ofstream& logfile, const std::string& logstr);
 
 af::array allreduceGet(SpeechStatMeter& mtr);
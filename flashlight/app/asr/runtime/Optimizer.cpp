@@ -29,7 +29,15 @@ std::shared_ptr<fl::FirstOrderOptimizer> initOptimizer(
     auto p = n->params();
     params.insert(params.end(), p.begin(), p.end());
   }
+  return initOptimizer(params, optimizer, lr, momentum, weightdecay);
+}
 
+std::shared_ptr<fl::FirstOrderOptimizer> initOptimizer(
+    const std::vector<fl::Variable>& params,
+    const std::string& optimizer,
+    double lr,
+    double momentum,
+    double weightdecay) {
   std::shared_ptr<fl::FirstOrderOptimizer> opt;
   if (optimizer == kSGDOptimizer) {
     opt = std::make_shared<fl::SGDOptimizer>(params, lr, momentum, weightdecay);
@@ -40,7 +48,8 @@ std::shared_ptr<fl::FirstOrderOptimizer> initOptimizer(
         FLAGS_adambeta1,
         FLAGS_adambeta2,
         FLAGS_optimepsilon,
-        weightdecay);
+        weightdecay,
+        FLAGS_optim8bitstates);
   } else if (optimizer == kRMSPropOptimizer) {
     opt = std::make_shared<fl::RMSPropOptimizer>(
         params, lr, FLAGS_optimrho, FLAGS_optimepsilon, weightdecay);
@@ -57,7 +66,8 @@ std::shared_ptr<fl::FirstOrderOptimizer> initOptimizer(
         FLAGS_adambeta1,
         FLAGS_adambeta2,
         FLAGS_optimepsilon,
-        weightdecay);
+        weightdecay,
+        FLAGS_optim8bitstates);
 
   } else if (optimizer == kNovogradOptimizer) {
     opt = std::make_shared<fl::NovogradOptimizer>(
@@ -20,7 +20,7 @@ namespace asr {
  * Utility function to create an optimizer.
  * Supported optimizers: `sgd`, `adam`, `rmsprop`, `adadelta`, `adagrad`,
  * `amsgrad`, `novograd`. From gflags it uses FLAGS_optimrho, FLAGS_adambeta1,
- * FLAGS_adambeta2, FLAGS_optimepsilon,
+ * FLAGS_adambeta2, FLAGS_optimepsilon, FLAGS_optim8bitstates
  */
 std::shared_ptr<fl::FirstOrderOptimizer> initOptimizer(
     const std::vector<std::shared_ptr<fl::Module>>& nets,
@@ -28,6 +28,16 @@ std::shared_ptr<fl::FirstOrderOptimizer> initOptimizer(
     double lr,
     double momentum,
     double weightdecay);
+
+/*
+ * As above, for the parameters `params`.
+ */
+std::shared_ptr<fl::FirstOrderOptimizer> initOptimizer(
+    const std::vector<fl::Variable>& params,
+    const std::string& optimizer,
+    double lr,
+    double momentum,
+    double weightdecay);
 } // namespace asr
 } // namespace app
 } // namespace fl
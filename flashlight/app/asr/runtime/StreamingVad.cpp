@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/app/asr/runtime/StreamingVad.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "flashlight/ext/common/Utils-inl.h"
+
+namespace fl {
+namespace app {
+namespace asr {
+
+bool VadChunkResult::hasSpeech() const {
+  return std::find(isSpeech.begin(), isSpeech.end(), true) != isSpeech.end();
+}
+
+StreamingFeatureNormalizer::StreamingFeatureNormalizer(
+    int numFeat,
+    std::pair<int, int> localNormCtx)
+    : numFeat_(numFeat),
+      leftCtx_(localNormCtx.first),
+      rightCtx_(localNormCtx.second) {
+  if (numFeat_ <= 0 || leftCtx_ < 0 || rightCtx_ < 0) {
+    throw std::invalid_argument(
+        "StreamingFeatureNormalizer: invalid feature size or context");
+  }
+  reset();
+}
+
+void StreamingFeatureNormalizer::reset() {
+  frames_.clear();
+  framesBegin_ = numFrames_ = numEmitted_ = 0;
+  sum_ = sum2_ = 0;
+  count_ = 0;
+}
+
+std::vector<float> StreamingFeatureNormalizer::normalize(int64_t frame) const {
+  double sum = sum_, sum2 = sum2_;
+  int64_t count = count_;
+  if (leftCtx_ > 0 || rightCtx_ > 0) {
+    sum = sum2 = 0;
+    auto begin = std::max<int64_t>(frame - leftCtx_, 0);
+    auto end = std::min<int64_t>(frame + rightCtx_, numFrames_ - 1);
+    for (auto f = begin; f <= end; ++f) {
+      for (auto x : frames_[f - framesBegin_]) {
+        sum += x;
+        sum2 += x * x;
+      }
+    }
+    count = (end - begin + 1) * numFeat_;
+  }
+  double mean = sum / count;
+  double stddev = std::sqrt(std::max(sum2 / count - mean * mean, 0.0));
+  std::vector<float> out(frames_[frame - framesBegin_]);
+  for (auto& x : out) {
+    x -= mean;
+    if (stddev > 0) {
+      x /= stddev;
+    }
+  }
+  return out;
+}
+
+std::vector<float> StreamingFeatureNormalizer::apply(
+    const std::vector<float>& features,
+    bool last) {
+  if (features.size() % numFeat_ != 0) {
+    throw std::invalid_argument(
+        "StreamingFeatureNormalizer: features should be FEAT X FRAMES");
+  }
+  for (size_t i = 0; i < features.size(); i += numFeat_) {
+    frames_.emplace_back(
+        features.begin() + i, features.begin() + i + numFeat_);
+    for (int j = 0; j < numFeat_; ++j) {
+      sum_ += features[i + j];
+      sum2_ += features[i + j] * features[i + j];
+    }
+    count_ += numFeat_;
+    ++numFrames_;
+  }
+
+  auto end = last ? numFrames_ : numFrames_ - rightCtx_;
+  std::vector<float> out;
+  for (; numEmitted_ < end; ++numEmitted_) {
+    auto frame = normalize(numEmitted_);
+    out.insert(out.end(), frame.begin(), frame.end());
+  }
+  // Keep the left context of the next frame to normalize
+  while (framesBegin_ < numEmitted_ - leftCtx_) {
+    frames_.pop_front();
+    ++framesBegin_;
+  }
+  if (last) {
+    frames_.clear();
+    framesBegin_ = numFrames_ = numEmitted_ = 0;
+  }
+  return out;
+}
+
+StreamingVad::StreamingVad(
+    std::shared_ptr<fl::Module> network,
+    const fl::lib::audio::FeatureParams& featParams,
+    FeatureType featType,
+    std::pair<int, int> localNormCtx,
+    int blankIdx,
+    double threshold /* = 0.99 */)
+    : network_(std::move(network)),
+      featType_(featType),
+      blankIdx_(blankIdx),
+      threshold_(threshold),
+      normalizer_(
+          featType == FeatureType::MFSC ? featParams.mfscFeatSz() : 1,
+          localNormCtx),
+      numFeat_(featType == FeatureType::MFSC ? featParams.mfscFeatSz() : 1),
+      numFrames_(0) {
+  if (featType_ == FeatureType::MFSC) {
+    mfsc_ = std::make_unique<fl::lib::audio::StreamingMfsc>(featParams);
+  } else if (featType_ != FeatureType::NONE) {
+    throw std::invalid_argument(
+        "StreamingVad: only MFSC features and raw audio can be streamed");
+  }
+  reset();
+}
+
+void StreamingVad::reset() {
+  if (mfsc_) {
+    mfsc_->reset();
+  }
+  normalizer_.reset();
+  network_->resetStreamingState();
+  numFrames_ = 0;
+}
+
+VadChunkResult StreamingVad::apply(const std::vector<float>& samples) {
+  return process(mfsc_ ? mfsc_->apply(samples) : samples, false);
+}
+
+VadChunkResult StreamingVad::finish() {
+  auto result = process(mfsc_ ? mfsc_->flush() : std::vector<float>(), true);
+  reset();
+  return result;
+}
+
+VadChunkResult StreamingVad::process(
+    const std::vector<float>& features,
+    bool last) {
+  VadChunkResult result;
+  result.firstFrame = numFrames_;
+  auto normalized = normalizer_.apply(features, last);
+  int64_t T = normalized.size() / numFeat_;
+  if (T == 0) {
+    return result;
+  }
+  // From FEAT X FRAMES to FRAMES X FEAT (Col Major), as `inputFeatures()`
+  auto input = fl::input(
+      af::array(af::dim4(numFeat_, T), normalized.data()).T());
+  auto emission = network_->forwardChunk({input}).front();
+  if (emission.isempty()) {
+    // The network needs more input
+    return result;
+  }
+
+  int N = emission.dims(0);
+  int outT = emission.dims(1);
+  auto probs = fl::ext::afToVector<float>(fl::softmax(emission, 0).as(f32));
+  result.blankProbs.resize(outT);
+  result.tokens.resize(outT);
+  result.isSpeech.resize(outT);
+  for (int t = 0; t < outT; ++t) {
+    const float* frame = probs.data() + t * N;
+    result.blankProbs[t] = frame[blankIdx_];
+    result.tokens[t] = std::max_element(frame, frame + N) - frame;
+    result.isSpeech[t] = frame[blankIdx_] < threshold_;
+  }
+  numFrames_ += outT;
+  return result;
+}
+
+} // namespace asr
+} // namespace app
+} // namespace fl
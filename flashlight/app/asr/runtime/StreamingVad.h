@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "flashlight/app/asr/data/FeatureTransforms.h"
+#include "flashlight/fl/nn/nn.h"
+#include "flashlight/lib/audio/feature/StreamingMfsc.h"
+
+namespace fl {
+namespace app {
+namespace asr {
+
+/**
+ * Speech / non-speech decisions for the frames of the acoustic model output
+ * which became available with a chunk of audio.
+ */
+struct VadChunkResult {
+  // Index of the first frame in the stream
+  int64_t firstFrame = 0;
+  // Probability of blank of each frame
+  std::vector<float> blankProbs;
+  // Most likely token of each frame
+  std::vector<int> tokens;
+  // Each frame is speech if its probability of blank is below the threshold
+  std::vector<bool> isSpeech;
+
+  bool hasSpeech() const;
+};
+
+/**
+ * Normalizes features of a stream, frame by frame, as `normalizeFeatures()`
+ * does on the whole utterance. With a local normalization context, frames are
+ * normalized once `rightCtx` more frames are available (or the stream ends),
+ * which is exact. Without it, frames are normalized with the statistics of
+ * the stream so far instead of those of the whole utterance.
+ */
+class StreamingFeatureNormalizer {
+ public:
+  StreamingFeatureNormalizer(int numFeat, std::pair<int, int> localNormCtx);
+
+  // features - next frames (Col Major : FEAT X FRAMES)
+  // Returns - the normalized frames which became final (FEAT X FRAMES)
+  std::vector<float> apply(const std::vector<float>& features, bool last);
+
+  void reset();
+
+ private:
+  int numFeat_;
+  int leftCtx_, rightCtx_;
+  // Frames from `framesBegin_` kept for the windows of the next frames
+  std::deque<std::vector<float>> frames_;
+  int64_t framesBegin_, numFrames_, numEmitted_;
+  // Running sums of the stream, without local normalization context
+  double sum_, sum2_;
+  int64_t count_;
+
+  std::vector<float> normalize(int64_t frame) const;
+};
+
+/**
+ * Voice activity detection with a CTC acoustic model on audio fed chunk by
+ * chunk, e.g. in front of a serving pipeline. Features are computed on the
+ * stream (`StreamingMfsc`, or raw audio), and the acoustic model forwards
+ * each chunk with `Module::forwardChunk()`, so that the cost of a chunk does
+ * not depend on the length of the stream. The decisions of a frame are
+ * delayed by the derivatives windows of the features, the right context of
+ * the local normalization and the right context of the acoustic model only.
+ * The network should be in eval mode.
+ *
+ * Example usage:
+ *   StreamingVad vad(network, featParams, FeatureType::MFSC, {0, 0}, blank);
+ *   while (...) { auto result = vad.apply(chunk); ... }
+ *   auto result = vad.finish();
+ */
+class StreamingVad {
+ public:
+  StreamingVad(
+      std::shared_ptr<fl::Module> network,
+      const fl::lib::audio::FeatureParams& featParams,
+      FeatureType featType,
+      std::pair<int, int> localNormCtx,
+      int blankIdx,
+      double threshold = 0.99);
+
+  // samples - next samples of a mono signal
+  VadChunkResult apply(const std::vector<float>& samples);
+
+  // Ends the stream, the next chunk starts a new one. Frames still waiting
+  // for the right context of the acoustic model are not output.
+  VadChunkResult finish();
+
+  // Drops the state of the current stream
+  void reset();
+
+ private:
+  std::shared_ptr<fl::Module> network_;
+  FeatureType featType_;
+  int blankIdx_;
+  double threshold_;
+  std::unique_ptr<fl::lib::audio::StreamingMfsc> mfsc_;
+  StreamingFeatureNormalizer normalizer_;
+  int numFeat_;
+  int64_t numFrames_;
+
+  VadChunkResult process(const std::vector<float>& features, bool last);
+};
+
+} // namespace asr
+} // namespace app
+} // namespace fl
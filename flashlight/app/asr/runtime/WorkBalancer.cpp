@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/app/asr/runtime/WorkBalancer.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "flashlight/ext/common/DistributedUtils.h"
+#include "flashlight/fl/flashlight.h"
+
+namespace fl {
+namespace app {
+namespace asr {
+
+WorkBalancer::WorkBalancer(
+    int64_t worldRank,
+    int64_t worldSize,
+    double smoothing /* = 0.5 */,
+    double minWeight /* = 0.1 */)
+    : worldRank_(worldRank),
+      smoothing_(smoothing),
+      minWeight_(minWeight),
+      weights_(worldSize, 1.0) {
+  if (worldRank < 0 || worldRank >= worldSize) {
+    throw std::invalid_argument("[WorkBalancer] invalid worldRank, worldSize");
+  }
+  if (smoothing < 0 || smoothing >= 1 || minWeight <= 0 || minWeight > 1) {
+    throw std::invalid_argument(
+        "[WorkBalancer] smoothing should be in [0, 1) and minWeight in (0, 1]");
+  }
+}
+
+void WorkBalancer::add(double size, double seconds) {
+  size_ += size;
+  seconds_ += seconds;
+}
+
+std::vector<double> WorkBalancer::rebalance() {
+  std::vector<double> throughputs(weights_.size(), 0);
+  if (seconds_ > 0) {
+    throughputs[worldRank_] = size_ / seconds_;
+  }
+  if (fl::isDistributedInit()) {
+    af::array all(throughputs.size(), throughputs.data());
+    fl::allReduce(all);
+    throughputs = fl::ext::afToVector<double>(all);
+  }
+  size_ = 0;
+  seconds_ = 0;
+  return update(throughputs);
+}
+
+std::vector<double> WorkBalancer::update(
+    const std::vector<double>& throughputs) {
+  if (throughputs.size() != weights_.size()) {
+    throw std::invalid_argument(
+        "[WorkBalancer] a throughput per process is expected");
+  }
+  double maxThroughput =
+      *std::max_element(throughputs.begin(), throughputs.end());
+  // Processes keep their weight until they all have measures
+  if (*std::min_element(throughputs.begin(), throughputs.end()) <= 0) {
+    return weights_;
+  }
+  for (size_t i = 0; i < weights_.size(); ++i) {
+    double weight = std::max(minWeight_, throughputs[i] / maxThroughput);
+    weights_[i] = smoothing_ * weights_[i] + (1 - smoothing_) * weight;
+  }
+  return weights_;
+}
+
+const std::vector<double>& WorkBalancer::weights() const {
+  return weights_;
+}
+
+} // namespace asr
+} // namespace app
+} // namespace fl
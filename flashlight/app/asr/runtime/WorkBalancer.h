@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace fl {
+namespace app {
+namespace asr {
+
+/**
+ * Balances the work of processes of different speeds in distributed
+ * training. Each process records how long its forward and backward passes
+ * take with `add()`; `rebalance()` then gives the weights of the processes,
+ * proportional to their throughputs, to set the token budget of their batches
+ * with `BucketBatchDataset::setPartitionWeights()`. Steps then take about the
+ * same time on all the processes, instead of the slowest one setting the pace.
+ */
+class WorkBalancer {
+ public:
+  /**
+   * @param[in] worldRank Rank of the current process.
+   * @param[in] worldSize Number of processes.
+   * @param[in] smoothing Part of the previous weights kept in the new ones, to
+   * damp the noise of the measures.
+   * @param[in] minWeight Lowest weight of a process relative to the fastest.
+   */
+  WorkBalancer(
+      int64_t worldRank,
+      int64_t worldSize,
+      double smoothing = 0.5,
+      double minWeight = 0.1);
+
+  /**
+   * Records that `size` tokens (padding included) were processed in
+   * `seconds`.
+   */
+  void add(double size, double seconds);
+
+  /**
+   * Exchanges the measures of all the processes with an allreduce, and
+   * returns the updated weights, the same on all of them. Must be called by
+   * all the processes. The measures are then reset.
+   */
+  std::vector<double> rebalance();
+
+  /**
+   * Updates the weights from the throughput of each process, 0 if unknown.
+   */
+  std::vector<double> update(const std::vector<double>& throughputs);
+
+  const std::vector<double>& weights() const;
+
+ private:
+  int64_t worldRank_;
+  double smoothing_;
+  double minWeight_;
+  double size_{0};
+  double seconds_{0};
+  std::vector<double> weights_;
+};
+
+} // namespace asr
+} // namespace app
+} // namespace fl
@@ -12,3 +12,5 @@
 #include "flashlight/app/asr/runtime/Logger.h"
 #include "flashlight/app/asr/runtime/Optimizer.h"
 #include "flashlight/app/asr/runtime/SpeechStatMeter.h"
+#include "flashlight/app/asr/runtime/StreamingVad.h"
+#include "flashlight/app/asr/runtime/WorkBalancer.h"
@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/app/asr/server/HttpServer.h"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <glog/logging.h>
+
+#include "flashlight/lib/common/String.h"
+
+namespace fl {
+namespace app {
+namespace asr {
+
+namespace {
+
+// Upper bounds of the request, to refuse malformed ones
+constexpr size_t kMaxHeaderBytes = 64 * 1024;
+constexpr size_t kMaxBodyBytes = 256 * 1024 * 1024;
+// Idle time after which a client is disconnected, so that it doesn't hold a
+// worker
+constexpr int kReceiveTimeoutSeconds = 30;
+// Status of the requests whose client timed out, which aren't answered
+constexpr int kTimeoutStatus = 408;
+
+std::string statusText(int status) {
+  switch (status) {
+    case 200:
+      return "OK";
+    case 400:
+      return "Bad Request";
+    case 404:
+      return "Not Found";
+    case 413:
+      return "Payload Too Large";
+    case 503:
+      return "Service Unavailable";
+    default:
+      return status < 500 ? "Error" : "Internal Server Error";
+  }
+}
+
+bool writeAll(int fd, const std::string& data) {
+  size_t written = 0;
+  while (written < data.size()) {
+    // Without SIGPIPE, which would kill the server if the client is gone
+    auto n = ::send(
+        fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return false;
+    }
+    written += n;
+  }
+  return true;
+}
+
+// Status of a failed recv()
+int recvError() {
+  return errno == EAGAIN || errno == EWOULDBLOCK ? kTimeoutStatus : 400;
+}
+
+// Reads the request into `request`, returns an error status or 0
+int readRequest(int fd, HttpRequest& request) {
+  std::string data;
+  char buffer[64 * 1024];
+  size_t headerEnd;
+  while ((headerEnd = data.find("\r\n\r\n")) == std::string::npos) {
+    if (data.size() > kMaxHeaderBytes) {
+      return 400;
+    }
+    auto n = ::recv(fd, buffer, sizeof(buffer), 0);
+    if (n < 0) {
+      return recvError();
+    }
+    if (n == 0) {
+      return 400;
+    }
+    data.append(buffer, n);
+  }
+
+  auto lines = fl::lib::split("\r\n", data.substr(0, headerEnd));
+  auto requestLine = fl::lib::splitOnWhitespace(lines.front(), true);
+  if (requestLine.size() < 2) {
+    return 400;
+  }
+  request.method = requestLine[0];
+  request.path = requestLine[1];
+  for (size_t i = 1; i < lines.size(); ++i) {
+    auto colon = lines[i].find(':');
+    if (colon == std::string::npos) {
+      continue;
+    }
+    auto name = lines[i].substr(0, colon);
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    request.headers[name] = fl::lib::trim(lines[i].substr(colon + 1));
+  }
+
+  size_t contentLength = 0;
+  auto it = request.headers.find("content-length");
+  if (it != request.headers.end()) {
+    try {
+      contentLength = std::stoull(it->second);
+    } catch (const std::exception&) {
+      return 400;
+    }
+  }
+  if (contentLength > kMaxBodyBytes) {
+    return 413;
+  }
+  request.body = data.substr(headerEnd + 4);
+  while (request.body.size() < contentLength) {
+    auto n = ::recv(
+        fd,
+        buffer,
+        std::min(sizeof(buffer), contentLength - request.body.size()),
+        0);
+    if (n < 0) {
+      return recvError();
+    }
+    if (n == 0) {
+      return 400;
+    }
+    request.body.append(buffer, n);
+  }
+  request.body.resize(contentLength);
+  return 0;
+}
+
+} // namespace
+
+HttpServer::HttpServer(int port, Handler handler, int nThreads /* = 16 */)
+    : port_(port),
+      listening_(false),
+      handler_(std::move(handler)),
+      nThreads_(std::max(1, nThreads)),
+      socket_(-1),
+      stopped_(false),
+      connections_(nThreads_ * 4) {}
+
+HttpServer::~HttpServer() {
+  stop();
+}
+
+void HttpServer::run() {
+  socket_ = ::socket(AF_INET, SOCK_STREAM, 0);
+  if (socket_ < 0) {
+    throw std::runtime_error("HttpServer: could not create a socket");
+  }
+  int reuse = 1;
+  ::setsockopt(socket_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  sockaddr_in address;
+  std::memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port_);
+  if (::bind(socket_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) <
+          0 ||
+      ::listen(socket_, 128) < 0) {
+    ::close(socket_);
+    throw std::runtime_error(
+        "HttpServer: could not listen on port " + std::to_string(port_));
+  }
+  socklen_t addressSize = sizeof(address);
+  if (::getsockname(
+          socket_, reinterpret_cast<sockaddr*>(&address), &addressSize) == 0) {
+    port_ = ntohs(address.sin_port);
+  }
+  listening_ = true;
+  LOG(INFO) << "[HttpServer] listening on port " << port_;
+
+  for (int i = 0; i < nThreads_; ++i) {
+    workers_.emplace_back([this]() {
+      int connection;
+      while (connections_.get(connection)) {
+        serve(connection);
+        ::close(connection);
+      }
+    });
+  }
+  while (!stopped_) {
+    int connection = ::accept(socket_, nullptr, nullptr);
+    if (connection < 0) {
+      if (stopped_) {
+        break;
+      }
+      continue;
+    }
+    timeval timeout{kReceiveTimeoutSeconds, 0};
+    ::setsockopt(
+        connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    connections_.add(connection);
+  }
+  connections_.finishAdding();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+  workers_.clear();
+  listening_ = false;
+}
+
+void HttpServer::stop() {
+  if (!stopped_.exchange(true) && socket_ >= 0) {
+    // Unblocks accept()
+    ::shutdown(socket_, SHUT_RDWR);
+    ::close(socket_);
+  }
+}
+
+bool HttpServer::listening() const {
+  return listening_;
+}
+
+int HttpServer::port() const {
+  return port_;
+}
+
+void HttpServer::serve(int connection) {
+  HttpRequest request;
+  HttpResponse response;
+  int error = readRequest(connection, request);
+  if (error == kTimeoutStatus) {
+    // Closed by the worker
+    return;
+  }
+  if (error != 0) {
+    response.status = error;
+    response.body = statusText(error) + "\n";
+  } else {
+    try {
+      response = handler_(request);
+    } catch (const std::exception& ex) {
+      response.status = 500;
+      response.body = std::string(ex.what()) + "\n";
+    }
+  }
+  std::ostringstream ss;
+  ss << "HTTP/1.1 " << response.status << " " << statusText(response.status)
+     << "\r\n"
+     << "Content-Type: " << response.contentType << "\r\n"
+     << "Content-Length: " << response.body.size() << "\r\n"
+     << "Connection: close\r\n\r\n"
+     << response.body;
+  writeAll(connection, ss.str());
+}
+
+} // namespace asr
+} // namespace app
+} // namespace fl
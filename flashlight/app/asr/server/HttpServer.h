@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "flashlight/lib/common/ProducerConsumerQueue.h"
+
+namespace fl {
+namespace app {
+namespace asr {
+
+struct HttpRequest {
+  std::string method;
+  std::string path;
+  // Header names are lower case
+  std::unordered_map<std::string, std::string> headers;
+  std::string body;
+};
+
+struct HttpResponse {
+  int status = 200;
+  std::string contentType = "text/plain";
+  std::string body;
+};
+
+/**
+ * Minimal HTTP/1.1 server on POSIX sockets, without dependencies: each
+ * connection serves one request (`Connection: close`), whose body is given by
+ * `Content-Length`. Connections are handled by a pool of `nThreads` threads,
+ * which run the handler concurrently. A client which sends nothing for 30
+ * seconds while its request is read is disconnected.
+ */
+class HttpServer {
+ public:
+  using Handler = std::function<HttpResponse(const HttpRequest&)>;
+
+  HttpServer(int port, Handler handler, int nThreads = 16);
+
+  ~HttpServer();
+
+  // Accepts connections until `stop()` is called
+  void run();
+
+  void stop();
+
+  // Whether `run()` is listening, on `port()`
+  bool listening() const;
+
+  // The port listened on, e.g. the one picked by the OS when constructed with
+  // port 0
+  int port() const;
+
+ private:
+  std::atomic<int> port_;
+  std::atomic<bool> listening_;
+  Handler handler_;
+  int nThreads_;
+  int socket_;
+  std::atomic<bool> stopped_;
+  fl::lib::ProducerConsumerQueue<int> connections_;
+  std::vector<std::thread> workers_;
+
+  void serve(int connection);
+};
+
+} // namespace asr
+} // namespace app
+} // namespace fl
@@ -0,0 +1,337 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/app/asr/server/InferenceEngine.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+#include "flashlight/app/asr/data/Sound.h"
+#include "flashlight/ext/common/SequentialBuilder.h"
+#include "flashlight/ext/common/Utils-inl.h"
+
+namespace fl {
+namespace app {
+namespace asr {
+
+namespace {
+
+double elapsedMs(
+    std::chrono::steady_clock::time_point begin,
+    std::chrono::steady_clock::time_point end) {
+  return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+std::string escapeJson(const std::string& str) {
+  std::ostringstream ss;
+  for (char c : str) {
+    switch (c) {
+      case '"':
+        ss << "\\\"";
+        break;
+      case '\\':
+        ss << "\\\\";
+        break;
+      case '\n':
+        ss << "\\n";
+        break;
+      default:
+        ss << c;
+    }
+  }
+  return ss.str();
+}
+
+} // namespace
+
+LatencyStats::LatencyStats(size_t window /* = 10000 */)
+    : window_(std::max<size_t>(window, 1)), next_(0), count_(0) {}
+
+void LatencyStats::add(double ms) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (latencies_.size() < window_) {
+    latencies_.push_back(ms);
+  } else {
+    latencies_[next_] = ms;
+  }
+  next_ = (next_ + 1) % window_;
+  ++count_;
+}
+
+double LatencyStats::percentile(double p) const {
+  std::vector<double> latencies;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    latencies = latencies_;
+  }
+  if (latencies.empty()) {
+    return 0;
+  }
+  size_t k = std::min<size_t>(
+      latencies.size() - 1, std::floor(p * (latencies.size() - 1) + 0.5));
+  std::nth_element(latencies.begin(), latencies.begin() + k, latencies.end());
+  return latencies[k];
+}
+
+int64_t LatencyStats::count() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return count_;
+}
+
+InferenceEngine::InferenceEngine(
+    std::shared_ptr<fl::Module> network,
+    fl::Dataset::DataTransformFunction inputTransform,
+    DecoderFactory decoderFactory,
+    Transcriber transcriber,
+    const InferenceEngineOptions& options)
+    : network_(std::move(network)),
+      inputTransform_(std::move(inputTransform)),
+      decoderFactory_(std::move(decoderFactory)),
+      transcriber_(std::move(transcriber)),
+      options_(options),
+      stopped_(false),
+      decodeQueue_(std::max(1, options.maxBatchSize) * 4),
+      numRejected_(0),
+      numFailed_(0),
+      numBatches_(0),
+      numBatched_(0),
+      decodeQueueDepth_(0) {
+  if (options_.maxBatchSize <= 0 || options_.nDecoderThreads <= 0 ||
+      options_.maxWaitMs < 0) {
+    throw std::invalid_argument("InferenceEngine: invalid options");
+  }
+  network_->eval();
+  // The device of the acoustic model is the one of the thread creating the
+  // engine
+  int device = af::getDevice();
+  batcher_ = std::thread([this, device]() {
+    af::setDevice(device);
+    batchLoop();
+  });
+  for (int i = 0; i < options_.nDecoderThreads; ++i) {
+    decoders_.emplace_back([this]() { decodeLoop(); });
+  }
+}
+
+InferenceEngine::~InferenceEngine() {
+  {
+    std::lock_guard<std::mutex> lock(requestsMutex_);
+    stopped_ = true;
+  }
+  requestsCondition_.notify_all();
+  batcher_.join();
+  decodeQueue_.finishAdding();
+  for (auto& decoder : decoders_) {
+    decoder.join();
+  }
+}
+
+std::future<InferenceResult> InferenceEngine::recognize(
+    const std::vector<float>& audio,
+    int channels /* = 1 */) {
+  auto promise = std::make_shared<std::promise<InferenceResult>>();
+  auto future = promise->get_future();
+  auto arrival = Clock::now();
+  try {
+    if (channels <= 0 || audio.empty() || audio.size() % channels != 0) {
+      throw std::invalid_argument("InferenceEngine: invalid audio");
+    }
+    auto features = inputTransform_(
+        const_cast<float*>(audio.data()),
+        af::dim4(channels, audio.size() / channels),
+        af::dtype::f32);
+    {
+      std::lock_guard<std::mutex> lock(requestsMutex_);
+      if (stopped_ || requests_.size() >= options_.maxQueueSize) {
+        ++numRejected_;
+        throw std::runtime_error("InferenceEngine: too many requests queued");
+      }
+      requests_.push_back({features, arrival, promise});
+    }
+    requestsCondition_.notify_all();
+  } catch (...) {
+    promise->set_exception(std::current_exception());
+  }
+  return future;
+}
+
+size_t InferenceEngine::queueDepth() const {
+  std::lock_guard<std::mutex> lock(requestsMutex_);
+  return requests_.size();
+}
+
+void InferenceEngine::batchLoop() {
+  while (true) {
+    std::vector<Request> batch;
+    {
+      std::unique_lock<std::mutex> lock(requestsMutex_);
+      requestsCondition_.wait(
+          lock, [this]() { return stopped_ || !requests_.empty(); });
+      if (requests_.empty()) {
+        return;
+      }
+      // Wait for more requests until the deadline of the oldest one
+      auto deadline = requests_.front().arrival +
+          std::chrono::milliseconds(options_.maxWaitMs);
+      requestsCondition_.wait_until(lock, deadline, [this]() {
+        return stopped_ || requests_.size() >= options_.maxBatchSize;
+      });
+      while (!requests_.empty() && batch.size() < options_.maxBatchSize) {
+        batch.push_back(std::move(requests_.front()));
+        requests_.pop_front();
+      }
+    }
+    forward(batch);
+  }
+}
+
+void InferenceEngine::forward(std::vector<Request>& batch) {
+  // Requests handed over to the decoders
+  size_t numQueued = 0;
+  try {
+    int B = batch.size();
+    int maxT = 0;
+    std::vector<float> durations(B);
+    for (int b = 0; b < B; ++b) {
+      durations[b] = batch[b].features.dims(0);
+      maxT = std::max<int>(maxT, durations[b]);
+    }
+    // T x FEAT x CHANNELS x B, padded with zeros as in the datasets
+    const auto& first = batch.front().features;
+    af::array input =
+        af::constant(0, maxT, first.dims(1), first.dims(2), B, f32);
+    for (int b = 0; b < B; ++b) {
+      input(af::seq(durations[b]), af::span, af::span, b) = batch[b].features;
+    }
+    auto emission = fl::ext::forwardSequentialModuleWithPadMask(
+        fl::input(input), network_, af::array(1, B, durations.data()));
+    int N = emission.dims(0);
+    int T = emission.dims(1);
+    auto emissionVec = fl::ext::afToVector<float>(emission.as(f32));
+    auto forwarded = Clock::now();
+    ++numBatches_;
+    numBatched_ += B;
+
+    for (int b = 0; b < B; ++b) {
+      // Frames of the request, in proportion to its number of input frames
+      // as for the padding mask of the forward
+      int frames = std::min<int>(T, std::ceil(T * durations[b] / maxT));
+      ++decodeQueueDepth_;
+      auto begin = emissionVec.begin() + static_cast<size_t>(b) * T * N;
+      decodeQueue_.add(
+          {std::vector<float>(begin, begin + frames * N),
+           frames,
+           N,
+           batch[b].arrival,
+           forwarded,
+           batch[b].promise});
+      ++numQueued;
+    }
+  } catch (...) {
+    numFailed_ += batch.size() - numQueued;
+    for (size_t b = numQueued; b < batch.size(); ++b) {
+      batch[b].promise->set_exception(std::current_exception());
+    }
+  }
+}
+
+void InferenceEngine::decodeLoop() {
+  std::unique_ptr<fl::lib::text::Decoder> decoder;
+  DecodeTask task;
+  while (decodeQueue_.get(task)) {
+    --decodeQueueDepth_;
+    try {
+      if (!decoder) {
+        decoder = decoderFactory_();
+      }
+      auto results = decoder->decode(task.emission.data(), task.T, task.N);
+      InferenceResult result;
+      result.transcription =
+          results.empty() ? "" : transcriber_(results.front());
+      auto now = Clock::now();
+      result.queueMs = elapsedMs(task.arrival, task.forwarded);
+      result.totalMs = elapsedMs(task.arrival, now);
+      latency_.add(result.totalMs);
+      task.promise->set_value(std::move(result));
+    } catch (...) {
+      ++numFailed_;
+      task.promise->set_exception(std::current_exception());
+    }
+  }
+}
+
+std::string InferenceEngine::metrics() const {
+  std::ostringstream ss;
+  ss << "# TYPE fl_asr_requests_total counter\n"
+     << "fl_asr_requests_total " << latency_.count() << "\n"
+     << "# TYPE fl_asr_requests_rejected_total counter\n"
+     << "fl_asr_requests_rejected_total " << numRejected_ << "\n"
+     << "# TYPE fl_asr_requests_failed_total counter\n"
+     << "fl_asr_requests_failed_total " << numFailed_ << "\n"
+     << "# TYPE fl_asr_queue_depth gauge\n"
+     << "fl_asr_queue_depth " << queueDepth() << "\n"
+     << "# TYPE fl_asr_decode_queue_depth gauge\n"
+     << "fl_asr_decode_queue_depth " << decodeQueueDepth_ << "\n"
+     << "# TYPE fl_asr_batches_total counter\n"
+     << "fl_asr_batches_total " << numBatches_ << "\n"
+     << "# TYPE fl_asr_batched_requests_total counter\n"
+     << "fl_asr_batched_requests_total " << numBatched_ << "\n"
+     << "# TYPE fl_asr_latency_ms summary\n";
+  for (double q : {0.5, 0.9, 0.99}) {
+    ss << "fl_asr_latency_ms{quantile=\"" << q << "\"} "
+       << latency_.percentile(q) << "\n";
+  }
+  return ss.str();
+}
+
+HttpServer::Handler makeInferenceHandler(InferenceEngine& engine) {
+  return [&engine](const HttpRequest& request) {
+    HttpResponse response;
+    if (request.method == "GET" && request.path == "/health") {
+      response.body = "ok\n";
+    } else if (request.method == "GET" && request.path == "/metrics") {
+      response.contentType = "text/plain; version=0.0.4";
+      response.body = engine.metrics();
+    } else if (request.method == "POST" && request.path == "/recognize") {
+      // The body is an audio file in any format supported by libsndfile
+      int channels;
+      std::vector<float> audio;
+      try {
+        std::istringstream infoStream(request.body);
+        channels = loadSoundInfo(infoStream).channels;
+        std::istringstream audioStream(request.body);
+        audio = loadSound<float>(audioStream);
+      } catch (const std::exception& ex) {
+        response.status = 400;
+        response.body = std::string("Invalid audio: ") + ex.what() + "\n";
+        return response;
+      }
+      try {
+        auto result = engine.recognize(audio, channels).get();
+        response.contentType = "application/json";
+        std::ostringstream ss;
+        ss << "{\"transcription\": \"" << escapeJson(result.transcription)
+           << "\", \"queue_ms\": " << result.queueMs
+           << ", \"total_ms\": " << result.totalMs << "}\n";
+        response.body = ss.str();
+      } catch (const std::exception& ex) {
+        response.status = 503;
+        response.body = std::string(ex.what()) + "\n";
+      }
+    } else {
+      response.status = 404;
+      response.body = "Not Found\n";
+    }
+    return response;
+  };
+}
+
+} // namespace asr
+} // namespace app
+} // namespace fl
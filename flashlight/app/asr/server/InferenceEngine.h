@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "flashlight/app/asr/server/HttpServer.h"
+#include "flashlight/fl/flashlight.h"
+#include "flashlight/lib/common/ProducerConsumerQueue.h"
+#include "flashlight/lib/text/decoder/Decoder.h"
+
+namespace fl {
+namespace app {
+namespace asr {
+
+/**
+ * Latencies of the last `window` requests, from which percentiles are
+ * computed. Thread-safe.
+ */
+class LatencyStats {
+ public:
+  explicit LatencyStats(size_t window = 10000);
+
+  void add(double ms);
+
+  // Returns the p-th percentile (0 <= p <= 1) of the window, 0 if empty
+  double percentile(double p) const;
+
+  int64_t count() const;
+
+ private:
+  std::vector<double> latencies_;
+  size_t window_;
+  size_t next_;
+  int64_t count_;
+  mutable std::mutex mutex_;
+};
+
+struct InferenceEngineOptions {
+  // Maximum number of requests forwarded together by the acoustic model
+  int maxBatchSize = 8;
+  // Maximum time a request waits for others to be batched with
+  int maxWaitMs = 20;
+  // Number of threads running the beam-search decoder
+  int nDecoderThreads = 4;
+  // Requests waiting for the acoustic model above which new ones are refused
+  int maxQueueSize = 256;
+};
+
+struct InferenceResult {
+  std::string transcription;
+  // Time spent waiting for the acoustic model, and in total
+  double queueMs;
+  double totalMs;
+};
+
+/**
+ * Keeps an acoustic model and a decoder resident to transcribe concurrent
+ * requests. Requests are featurized in the calling thread, then batched
+ * dynamically: a batch is forwarded as soon as it has `maxBatchSize`
+ * requests, or when its oldest request waited `maxWaitMs`. Emissions are
+ * decoded by a pool of `nDecoderThreads` threads, each with its own decoder
+ * from `decoderFactory` (decoders can share a frozen lexicon and an LM, as in
+ * Decode).
+ */
+class InferenceEngine {
+ public:
+  using DecoderFactory =
+      std::function<std::unique_ptr<fl::lib::text::Decoder>()>;
+  using Transcriber =
+      std::function<std::string(const fl::lib::text::DecodeResult&)>;
+
+  InferenceEngine(
+      std::shared_ptr<fl::Module> network,
+      fl::Dataset::DataTransformFunction inputTransform,
+      DecoderFactory decoderFactory,
+      Transcriber transcriber,
+      const InferenceEngineOptions& options);
+
+  ~InferenceEngine();
+
+  /**
+   * Queues the interleaved samples of an audio with `channels` channels.
+   * The future holds an exception if the request could not be processed,
+   * e.g. when too many requests are queued.
+   */
+  std::future<InferenceResult> recognize(
+      const std::vector<float>& audio,
+      int channels = 1);
+
+  // Requests waiting for the acoustic model
+  size_t queueDepth() const;
+
+  const LatencyStats& latency() const {
+    return latency_;
+  }
+
+  // Metrics in the text format of Prometheus
+  std::string metrics() const;
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Request {
+    af::array features;
+    Clock::time_point arrival;
+    std::shared_ptr<std::promise<InferenceResult>> promise;
+  };
+
+  struct DecodeTask {
+    std::vector<float> emission;
+    int T;
+    int N;
+    Clock::time_point arrival;
+    Clock::time_point forwarded;
+    std::shared_ptr<std::promise<InferenceResult>> promise;
+  };
+
+  std::shared_ptr<fl::Module> network_;
+  fl::Dataset::DataTransformFunction inputTransform_;
+  DecoderFactory decoderFactory_;
+  Transcriber transcriber_;
+  InferenceEngineOptions options_;
+
+  std::deque<Request> requests_;
+  mutable std::mutex requestsMutex_;
+  std::condition_variable requestsCondition_;
+  bool stopped_;
+
+  fl::lib::ProducerConsumerQueue<DecodeTask> decodeQueue_;
+  std::thread batcher_;
+  std::vector<std::thread> decoders_;
+
+  LatencyStats latency_;
+  std::atomic<int64_t> numRejected_;
+  std::atomic<int64_t> numFailed_;
+  std::atomic<int64_t> numBatches_;
+  std::atomic<int64_t> numBatched_;
+  std::atomic<int64_t> decodeQueueDepth_;
+
+  void batchLoop();
+  void forward(std::vector<Request>& batch);
+  void decodeLoop();
+};
+
+/**
+ * Handler of the requests of `fl_asr_server`, served by `engine`:
+ * - GET /health;
+ * - GET /metrics returns `engine.metrics()`;
+ * - POST /recognize takes an audio file in any format supported by
+ *   libsndfile, and returns its transcription and latencies in JSON.
+ */
+HttpServer::Handler makeInferenceHandler(InferenceEngine& engine);
+
+} // namespace asr
+} // namespace app
+} // namespace fl
@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <csignal>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include "flashlight/fl/flashlight.h"
+
+#include "flashlight/app/asr/common/Defines.h"
+#include "flashlight/app/asr/data/FeatureTransforms.h"
+#include "flashlight/app/asr/data/Utils.h"
+#include "flashlight/app/asr/decoder/DecodeUtils.h"
+#include "flashlight/app/asr/decoder/Defines.h"
+#include "flashlight/app/asr/decoder/TranscriptionUtils.h"
+#include "flashlight/app/asr/server/HttpServer.h"
+#include "flashlight/app/asr/server/InferenceEngine.h"
+#include "flashlight/ext/common/Serializer.h"
+#include "flashlight/lib/text/decoder/LexiconDecoder.h"
+#include "flashlight/lib/text/decoder/lm/KenLM.h"
+
+DEFINE_string(am_path, "", "Path to the CTC trained acoustic model");
+DEFINE_string(tokens_path, "", "Path to the model tokens set");
+DEFINE_string(
+    lexicon_path,
+    "",
+    "Path to the lexicon which defines mapping between word and tokens + "
+    "restricts beam search");
+DEFINE_string(
+    lm_path,
+    "",
+    "Path to ngram language model. Either arpa file or KenLM bin file");
+DEFINE_int32(beam_size, 100, "Beam size for the beam-search decoding");
+DEFINE_int32(
+    beam_size_token,
+    10,
+    "Tokens beam size for the beam-search decoding");
+DEFINE_double(beam_threshold, 100, "Beam-search decoding pruning parameters");
+DEFINE_double(lm_weight, 3, "Beam-search decoding language model weight");
+DEFINE_double(word_score, 0, "Beam-search decoding word addition score");
+DEFINE_int64(sample_rate, 16000, "Sample rate of the input audio");
+DEFINE_int32(port, 8080, "Port the HTTP server listens on");
+DEFINE_int32(
+    nthread_http,
+    16,
+    "Number of threads handling connections, i.e. of concurrent requests");
+DEFINE_int32(
+    max_batch_size,
+    8,
+    "Maximum number of requests forwarded together by the acoustic model");
+DEFINE_int32(
+    max_wait_ms,
+    20,
+    "Maximum time (in ms) a request waits for others to be batched with");
+DEFINE_int32(
+    nthread_decoder,
+    4,
+    "Number of threads running the beam-search decoder");
+DEFINE_int32(
+    max_queue_size,
+    256,
+    "Number of requests waiting for the acoustic model above which new ones "
+    "are refused with 503");
+
+namespace {
+
+fl::app::asr::HttpServer* gServer = nullptr;
+
+void handleSignal(int /* signal */) {
+  if (gServer) {
+    gServer->stop();
+  }
+}
+
+void loadModel(
+    std::shared_ptr<fl::Module>& network,
+    std::unordered_map<std::string, std::string>& networkFlags) {
+  std::unordered_map<std::string, std::string> cfg;
+  std::string version;
+
+  LOG(INFO) << "[Server] Reading acoustic model from " << FLAGS_am_path;
+  fl::ext::Serializer::load(FLAGS_am_path, version, cfg, network);
+  if (version != FL_APP_ASR_VERSION) {
+    LOG(WARNING) << "[Server] Acoustic model version " << version
+                 << " and code version " << FL_APP_ASR_VERSION;
+  }
+  if (cfg.find(fl::app::asr::kGflags) == cfg.end()) {
+    LOG(FATAL) << "[Server] Invalid config is loaded from acoustic model "
+               << FLAGS_am_path;
+  }
+  for (auto line : fl::lib::split("\n", cfg[fl::app::asr::kGflags])) {
+    if (line == "") {
+      continue;
+    }
+    auto res = fl::lib::split("=", line);
+    if (res.size() >= 2) {
+      auto key = fl::lib::split("--", res[0])[1];
+      networkFlags[key] = res[1];
+    }
+  }
+  if (networkFlags["criterion"] != fl::app::asr::kCtcCriterion) {
+    LOG(FATAL) << "[Server] Only CTC models are supported, got "
+               << networkFlags["criterion"];
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+  fl::init();
+
+  /* ===================== Parse Options ===================== */
+  gflags::ParseCommandLineFlags(&argc, &argv, false);
+  for (const auto& path :
+       {FLAGS_am_path, FLAGS_tokens_path, FLAGS_lexicon_path, FLAGS_lm_path}) {
+    if (path.empty() || !fl::lib::fileExists(path)) {
+      LOG(FATAL) << "[Server] Invalid path '" << path
+                 << "' for --am_path, --tokens_path, --lexicon_path or "
+                 << "--lm_path";
+    }
+  }
+
+  /* ===================== Create Network ===================== */
+  af::setDevice(0);
+  std::shared_ptr<fl::Module> network;
+  std::unordered_map<std::string, std::string> networkFlags;
+  loadModel(network, networkFlags);
+  network->eval();
+
+  /* ===================== Set All Dictionaries ===================== */
+  fl::lib::text::Dictionary tokenDict(FLAGS_tokens_path);
+  tokenDict.addEntry(fl::app::asr::kBlankToken);
+  int blankIdx = tokenDict.getIndex(fl::app::asr::kBlankToken);
+  int wordSepIdx = networkFlags["wordseparator"] == ""
+      ? -1
+      : tokenDict.getIndex(networkFlags["wordseparator"]);
+  fl::lib::text::LexiconMap lexicon =
+      fl::lib::text::loadWords(FLAGS_lexicon_path, -1);
+  fl::lib::text::Dictionary wordDict = fl::lib::text::createWordDict(lexicon);
+  int unkWordIdx = wordDict.getIndex(fl::lib::text::kUnkToken);
+
+  /* ===================== Set LM, Trie, Decoder ===================== */
+  // The LM and the frozen lexicon are loaded once, and shared by the
+  // decoders of all threads
+  auto lm = std::make_shared<fl::lib::text::KenLM>(FLAGS_lm_path, wordDict);
+  auto trie = fl::app::asr::buildTrie(
+      "wrd" /* decoderType */,
+      true /* useLexicon */,
+      lm,
+      "max" /* smearing */,
+      tokenDict,
+      lexicon,
+      wordDict,
+      wordSepIdx,
+      0 /* repLabel */);
+  auto flatTrie = std::make_shared<fl::lib::text::FlatTrie>(*trie);
+  trie.reset();
+  LOG(INFO) << "[Server] Language model and lexicon are loaded";
+
+  fl::lib::text::LexiconDecoderOptions decoderOpt{
+      .beamSize = FLAGS_beam_size,
+      .beamSizeToken = FLAGS_beam_size_token,
+      .beamThreshold = FLAGS_beam_threshold,
+      .lmWeight = FLAGS_lm_weight,
+      .wordScore = FLAGS_word_score,
+      .unkScore = -std::numeric_limits<float>::infinity(),
+      .silScore = 0,
+      .logAdd = false,
+      .criterionType = fl::lib::text::CriterionType::CTC};
+  auto decoderFactory = [&]() {
+    return std::unique_ptr<fl::lib::text::Decoder>(
+        new fl::lib::text::LexiconDecoder(
+            decoderOpt,
+            flatTrie,
+            lm,
+            wordSepIdx,
+            blankIdx,
+            unkWordIdx,
+            std::vector<float>(),
+            false));
+  };
+  auto transcriber = [&](const fl::lib::text::DecodeResult& result) {
+    auto words = fl::app::asr::wrdIdx2Wrd(
+        fl::app::asr::validateIdx(result.words, unkWordIdx), wordDict);
+    return fl::lib::join(" ", words);
+  };
+
+  /* ===================== Features ===================== */
+  fl::lib::audio::FeatureParams featParams(
+      FLAGS_sample_rate,
+      std::atoll(networkFlags["framesizems"].c_str()),
+      std::atoll(networkFlags["framestridems"].c_str()),
+      std::atoll(networkFlags["filterbanks"].c_str()),
+      std::atoll(networkFlags["lowfreqfilterbank"].c_str()),
+      std::atoll(networkFlags["highfreqfilterbank"].c_str()),
+      std::atoll(networkFlags["mfcccoeffs"].c_str()),
+      fl::app::asr::kLifterParam /* lifterparam */,
+      std::atoll(networkFlags["devwin"].c_str()) /* delta window */,
+      std::atoll(networkFlags["devwin"].c_str()) /* delta-delta window */);
+  featParams.useEnergy = false;
+  featParams.usePower = false;
+  featParams.zeroMeanFrame = false;
+  auto featType = fl::app::asr::getFeatureType(
+                      networkFlags["features_type"], 1, featParams)
+                      .second;
+  auto inputTransform = fl::app::asr::inputFeatures(
+      featParams,
+      featType,
+      {std::atoi(networkFlags["localnrmlleftctx"].c_str()),
+       std::atoi(networkFlags["localnrmlrightctx"].c_str())},
+      /*sfxConf=*/{});
+
+  /* ===================== Serve ===================== */
+  fl::app::asr::InferenceEngineOptions engineOpt;
+  engineOpt.maxBatchSize = FLAGS_max_batch_size;
+  engineOpt.maxWaitMs = FLAGS_max_wait_ms;
+  engineOpt.nDecoderThreads = FLAGS_nthread_decoder;
+  engineOpt.maxQueueSize = FLAGS_max_queue_size;
+  fl::app::asr::InferenceEngine engine(
+      network, inputTransform, decoderFactory, transcriber, engineOpt);
+
+  fl::app::asr::HttpServer server(
+      FLAGS_port,
+      fl::app::asr::makeInferenceHandler(engine),
+      FLAGS_nthread_http);
+  gServer = &server;
+  std::signal(SIGINT, handleSignal);
+  std::signal(SIGTERM, handleSignal);
+  server.run();
+  gServer = nullptr;
+  LOG(INFO) << "[Server] Stopped";
+  return 0;
+}
@@ -16,6 +16,7 @@
 
 using namespace fl;
 using namespace fl::app::asr;
+using fl::ext::afToVector;
 
 namespace {
 
@@ -125,6 +126,28 @@ TEST(CriterionTest, CTCJacobian) {
   jacobianTest(funcConvIn, in);
 }
 
+TEST(CriterionTest, CTCHalf) {
+  if (!FL_BACKEND_CUDA) {
+    GTEST_SKIP() << "Half-precision CTC is only supported on CUDA";
+  }
+  int N = 30, T = 80, L = 20, B = 3;
+  auto in = Variable(af::log(af::randu(N, T, B)), true);
+  auto t = af::abs(af::randu(L, B, af::dtype::s32)) % (N - 2);
+  auto tgt = Variable(t.as(af::dtype::s32), false);
+  auto inHalf = Variable(in.array().as(f16), true);
+  auto ctc = ConnectionistTemporalClassificationCriterion();
+
+  auto loss = ctc.forward({in, tgt}).front();
+  auto lossHalf = ctc.forward({inHalf, tgt}).front();
+  ASSERT_EQ(lossHalf.type(), f32);
+  checkZero((loss - lossHalf).array() / loss.array(), 1E-2);
+
+  loss.backward();
+  lossHalf.backward();
+  ASSERT_EQ(inHalf.grad().type(), f16);
+  checkZero(in.grad().array() - inHalf.grad().array().as(f32), 1E-2);
+}
+
 TEST(CriterionTest, Batching) {
   {
     int N = 10, T = 25, L = 15, B = 5;
@@ -367,6 +390,46 @@ TEST(CriterionTest, ViterbiPathConstrained) {
   ASSERT_LE(af::max<float>(af::abs(diff)), kEpsilon);
 }
 
+TEST(CriterionTest, CompactViterbiPath) {
+  // Blank is 3, the second path has 5 frames and the third no frame
+  std::vector<int> pathVec = {0, 0, 3, 0, 1, 1, 2, 3,
+                              3, 2, 2, 1, 1, 0, 0, 0,
+                              1, 1, 1, 1, 1, 1, 1, 1};
+  std::vector<int> framesVec = {8, 5, 0};
+  af::array path(8, 3, pathVec.data());
+  af::array frames(3, framesVec.data());
+
+  af::array sizes;
+  auto tokens = afToVector<int>(compactViterbiPath(path, frames, 3, sizes));
+  ASSERT_EQ(tokens, std::vector<int>({0, 0, 1, 2, 2, 1}));
+  ASSERT_EQ(afToVector<int>(sizes), std::vector<int>({4, 2, 0}));
+
+  // Without blank (ASG)
+  tokens = afToVector<int>(compactViterbiPath(path, frames, -1, sizes));
+  ASSERT_EQ(tokens, std::vector<int>({0, 3, 0, 1, 2, 3, 3, 2, 1}));
+  ASSERT_EQ(afToVector<int>(sizes), std::vector<int>({6, 3, 0}));
+}
+
+TEST(CriterionTest, PackTokensAndWords) {
+  // Word separator is 0, tokens are padded with -1
+  std::vector<int> tokensVec = {0, 1, 2, 0, 0, 3, 0, -1,
+                                4, 4, 0, 5, -1, -1, -1, -1};
+  af::array tokens(8, 2, tokensVec.data());
+  af::array sizes;
+  auto letters = packTokens(tokens, tokens >= 0, 0, sizes);
+  ASSERT_EQ(afToVector<int>(sizes), std::vector<int>({5, 4}));
+  ASSERT_EQ(
+      afToVector<int>(letters),
+      std::vector<int>({1, 2, 0, 0, 3, 4, 4, 0, 5, -1}));
+
+  auto words = lettersToWords(letters, 0, sizes);
+  ASSERT_EQ(afToVector<int>(sizes), std::vector<int>({2, 2}));
+  // 2 words of up to 2 letters: {1, 2} {3} and {4, 4} {5}
+  ASSERT_TRUE(words.dims() == af::dim4(2, 2, 2));
+  ASSERT_EQ(
+      afToVector<int>(words), std::vector<int>({1, 3, 2, -1, 4, 5, 4, -1}));
+}
+
 // Test that CTC can return a path with no spaces
 TEST(CriterionTest, CTCViterbiPathNopaces) {
   const int B = 3; // Batchsize
@@ -589,6 +652,48 @@ TEST(CriterionTest, FACJacobian) {
   jacobianTest(funcTrans, transition);
 }
 
+TEST(CriterionTest, CriterionWorkspace) {
+  CriterionWorkspace workspace;
+  auto buffer = workspace.get<std::vector<uint8_t>>(100);
+  ASSERT_EQ(workspace.capacity(), 100);
+  // Held by the caller: a new buffer is given
+  auto other = workspace.get<std::vector<uint8_t>>(50);
+  ASSERT_NE(buffer, other);
+  ASSERT_EQ(workspace.capacity(), 100);
+  auto* data = other->data();
+  buffer.reset();
+  other.reset();
+  ASSERT_EQ(workspace.get<std::vector<uint8_t>>(80)->data(), data);
+  // Grows geometrically
+  workspace.get<std::vector<uint8_t>>(120);
+  ASSERT_EQ(workspace.capacity(), 200);
+  workspace.release();
+  ASSERT_EQ(workspace.capacity(), 0);
+}
+
+TEST(CriterionTest, FACWorkspaceReuse) {
+  int N = 5, L = 4;
+  auto fac = ForceAlignmentCriterion(N);
+  std::vector<Variable> inputs, targets, losses;
+  for (int T : {10, 20, 15}) {
+    inputs.push_back(Variable(af::log(af::randu(N, T, 2)), true));
+    auto t = af::abs(af::randu(L, 2, af::dtype::s32)) % N;
+    targets.push_back(Variable(t.as(af::dtype::s32), false));
+    // The previous backwards are still pending
+    losses.push_back(fac(inputs.back(), targets.back()));
+  }
+  for (size_t i = 0; i < inputs.size(); i++) {
+    losses[i].backward();
+    auto ref = ForceAlignmentCriterion(N);
+    ref.setParams(fac.param(0), 0);
+    auto input = Variable(inputs[i].array(), true);
+    auto loss = ref(input, targets[i]);
+    loss.backward();
+    ASSERT_TRUE(allClose(loss, losses[i], 1E-5));
+    ASSERT_TRUE(allClose(input.grad(), inputs[i].grad(), 1E-5));
+  }
+}
+
 TEST(CriterionTest, ASGCost) {
   // Test case: 1
   constexpr int N1 = 2, L1 = 2, T1 = 3, B1 = 2;
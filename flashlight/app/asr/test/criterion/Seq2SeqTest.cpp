@@ -142,6 +142,41 @@ TEST(Seq2SeqTest, Seq2SeqBeamSearchViterbi) {
   }
 }
 
+TEST(Seq2SeqTest, Seq2SeqBatchedBeamSearch) {
+  int nclass = 40;
+  int hiddendim = 256;
+  int inputsteps = 200;
+  int maxoutputlen = 100;
+  int batchsize = 3;
+
+  Seq2SeqCriterion seq2seq(
+      nclass,
+      hiddendim,
+      nclass - 2 /* eos token index */,
+      nclass - 1 /* pad token index */,
+      maxoutputlen,
+      {std::make_shared<ContentAttention>()});
+
+  seq2seq.eval();
+  auto input = af::randn(hiddendim, inputsteps, batchsize, f32);
+
+  // Greedy decoding of the batch
+  auto greedyPaths = seq2seq.batchedBeamPath(input, af::array(), 1);
+  ASSERT_EQ(greedyPaths.size(), batchsize);
+  for (int b = 0; b < batchsize; b++) {
+    auto viterbipath = afToVector<int>(seq2seq.viterbiPath(input.slice(b)));
+    ASSERT_EQ(greedyPaths[b], viterbipath);
+  }
+
+  // Utterances are decoded independently
+  auto beamPaths = seq2seq.batchedBeamPath(input, af::array(), 4);
+  for (int b = 0; b < batchsize; b++) {
+    ASSERT_LE(beamPaths[b].size(), maxoutputlen);
+    auto single = seq2seq.batchedBeamPath(input.slice(b), af::array(), 4);
+    ASSERT_EQ(beamPaths[b], single[0]);
+  }
+}
+
 TEST(Seq2SeqTest, Seq2SeqMedianWindow) {
   int nclass = 40;
   int hiddendim = 256;
@@ -227,6 +262,39 @@ TEST(Seq2SeqTest, Seq2SeqStepWindowVectorized) {
   ASSERT_TRUE(allClose(attentionV, attentionS, 1e-6));
 }
 
+TEST(Seq2SeqTest, Seq2SeqLocationAttnVectorizedRNN) {
+  int nclass = 20;
+  int hiddendim = 16;
+  int batchsize = 2;
+  int inputsteps = 20;
+  int outputsteps = 10;
+  int maxoutputlen = 20;
+
+  Seq2SeqCriterion seq2seq(
+      nclass,
+      hiddendim,
+      nclass - 2 /* eos token index */,
+      nclass - 1 /* pad token index */,
+      maxoutputlen,
+      {std::make_shared<SimpleLocationAttention>(3)},
+      std::make_shared<MedianWindow>(2, 3),
+      true);
+
+  auto input = af::randn(hiddendim, inputsteps, batchsize, f32);
+  auto target = af::randu(outputsteps, batchsize, f32) * 0.99 * nclass;
+  target = target.as(s32);
+
+  Variable outputV, attentionV, outputS, attentionS;
+  std::tie(outputV, attentionV) = seq2seq.vectorizedRNNDecoder(
+      noGrad(input), noGrad(target), af::array(), af::array());
+
+  std::tie(outputS, attentionS) =
+      seq2seq.decoder(noGrad(input), noGrad(target), af::array(), af::array());
+
+  ASSERT_TRUE(allClose(outputV, outputS, 1e-5));
+  ASSERT_TRUE(allClose(attentionV, attentionS, 1e-5));
+}
+
 TEST(Seq2SeqTest, Seq2SeqAttn) {
   int N = 5, H = 8, B = 1, T = 10, U = 5, maxoutputlen = 100;
   Seq2SeqCriterion seq2seq(
@@ -420,6 +488,93 @@ TEST(Seq2SeqTest, BatchedDecoderStep) {
   }
 }
 
+TEST(Seq2SeqTest, CrossUtteranceDecoderStep) {
+  int N = 5, H = 8, maxoutputlen = 100;
+  int nRnnLayer = 2, nAttnRound = 2;
+  std::vector<std::shared_ptr<AttentionBase>> attentions(
+      nAttnRound, std::make_shared<ContentAttention>());
+  Seq2SeqCriterion seq2seq(
+      N,
+      H,
+      N - 2,
+      N - 1,
+      maxoutputlen,
+      attentions,
+      nullptr,
+      false,
+      100,
+      0.0,
+      false,
+      kRandSampling,
+      1.0,
+      nRnnLayer,
+      nAttnRound,
+      0.0);
+  seq2seq.eval();
+
+  // Utterances of different lengths, the second one at its first step
+  std::vector<int> lengths = {20, 13, 7};
+  std::vector<int> numHypotheses = {3, 1, 4};
+  std::vector<Variable> inputs;
+  std::vector<Seq2SeqState> inStates;
+  std::vector<int> tokens;
+  for (int u = 0; u < lengths.size(); u++) {
+    inputs.push_back(noGrad(af::randn(H, lengths[u], 1, f32)));
+    for (int i = 0; i < numHypotheses[u]; i++) {
+      Seq2SeqState state(nAttnRound);
+      if (u != 1) {
+        state.alpha = noGrad(af::randn(1, lengths[u], 1, f32));
+        for (int j = 0; j < nAttnRound; j++) {
+          state.hidden[j] = noGrad(af::randn(H, 1, nRnnLayer, f32));
+        }
+        state.summary = noGrad(af::randn(H, 1, 1, f32));
+        state.step = 3;
+      }
+      inStates.push_back(state);
+      tokens.push_back(u == 1 ? -1 : i % N);
+    }
+  }
+  auto makeYs = [&](int begin, int end) {
+    std::vector<Variable> ys;
+    for (int i = begin; i < end; i++) {
+      ys.push_back(
+          tokens[i] < 0 ? Variable() : constant(tokens[i], 1, s32, false));
+    }
+    return ys;
+  };
+  std::vector<Seq2SeqState*> inStatePtrs;
+  for (auto& state : inStates) {
+    inStatePtrs.push_back(&state);
+  }
+
+  auto ys = makeYs(0, inStates.size());
+  auto batched =
+      seq2seq.decodeBatchStep(inputs, numHypotheses, ys, inStatePtrs);
+  int begin = 0;
+  for (int u = 0; u < lengths.size(); u++) {
+    int end = begin + numHypotheses[u];
+    auto uttYs = makeYs(begin, end);
+    auto single = seq2seq.decodeBatchStep(
+        inputs[u],
+        uttYs,
+        std::vector<Seq2SeqState*>(
+            inStatePtrs.begin() + begin, inStatePtrs.begin() + end));
+    for (int i = begin; i < end; i++) {
+      for (int j = 0; j < N; j++) {
+        ASSERT_NEAR(single.first[i - begin][j], batched.first[i][j], 1e-5);
+      }
+      ASSERT_EQ(
+          single.second[i - begin]->peakAttnPos,
+          batched.second[i]->peakAttnPos);
+      ASSERT_EQ(batched.second[i]->alpha.dims(0), lengths[u]);
+    }
+    begin = end;
+  }
+  ASSERT_THROW(
+      seq2seq.decodeBatchStep(inputs, {3, 1, 3}, ys, inStatePtrs),
+      std::invalid_argument);
+}
+
 TEST(Seq2SeqTest, Seq2SeqSampling) {
   int N = 5, H = 8, B = 1, T = 10, U = 5, maxoutputlen = 100;
   auto input = noGrad(af::randn(H, T, B, f32));
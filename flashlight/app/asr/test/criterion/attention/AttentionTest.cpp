@@ -198,6 +198,18 @@ TEST(AttentionTest, MultiHeadContentAttention) {
             encodedy, encodedx, Variable{}, Variable{}, currentPad);
         ASSERT_EQ(alphas.dims(), af::dim4(U * NH, T, B));
         ASSERT_EQ(summaries.dims(), af::dim4(H, U, B));
+
+        // Same attention from the keys and values computed beforehand
+        Variable precomputedAlphas, precomputedSummaries;
+        std::tie(precomputedAlphas, precomputedSummaries) =
+            attention.forwardPrecomputed(
+                encodedy,
+                attention.precomputeEncoded(encodedx),
+                Variable{},
+                Variable{},
+                currentPad);
+        ASSERT_TRUE(allClose(precomputedAlphas, alphas, 1e-5));
+        ASSERT_TRUE(allClose(precomputedSummaries, summaries, 1e-5));
         if (!currentPad.isempty()) {
           ASSERT_TRUE(
               af::count<int>(
@@ -224,6 +236,25 @@ TEST(AttentionTest, JacobianMaskAttention) {
   ASSERT_TRUE(jacobianTestImpl(func_in, in, 2e-4));
 }
 
+TEST(AttentionTest, MaskAttentionWithWindow) {
+  // CxTxB
+  auto in = Variable(af::randu(10, 9, 5, af::dtype::f32), true);
+  auto window = Variable(af::log(af::randu(10, 9, 5, af::dtype::f32)), false);
+  std::vector<int> inpSzRaw = {1, 2, 4, 8, 16};
+  auto inpSz = Variable(
+      af::array(af::dim4(1, inpSzRaw.size()), inpSzRaw.data()), false);
+
+  // Same as adding the window before masking
+  auto fused = fl::app::asr::maskAttention(in, window, inpSz);
+  auto unfused = fl::app::asr::maskAttention(in + window, inpSz);
+  ASSERT_TRUE(allClose(fused, unfused));
+
+  auto func_in = [&](Variable& input) {
+    return fl::app::asr::maskAttention(input, window, inpSz);
+  };
+  ASSERT_TRUE(jacobianTestImpl(func_in, in, 2e-4));
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   fl::init();
@@ -274,6 +274,42 @@ TEST(WindowTest, SoftPretrainWindow) {
           0) == targetlen / 2 * inputsteps);
 }
 
+TEST(WindowTest, BatchedWindow) {
+  int inputsteps = 40;
+  int targetlen = 10;
+  std::vector<int> steps = {0, 3, 3, 7};
+  int batchsize = steps.size();
+
+  Variable inputAttn; // dummy
+  std::vector<std::shared_ptr<WindowBase>> windows = {
+      std::make_shared<StepWindow>(0, 5, 1.5, 4.5),
+      std::make_shared<SoftWindow>(5.0, 3.2, 2),
+      std::make_shared<SoftPretrainWindow>(5.0)};
+  for (const auto& window : windows) {
+    // Same as the windows of each hypothesis at its own step
+    auto maskB =
+        window->computeBatchedWindow(inputAttn, steps, targetlen, inputsteps);
+    ASSERT_EQ(maskB.dims(), af::dim4(1, inputsteps, batchsize));
+    for (int b = 0; b < batchsize; b++) {
+      auto mask =
+          window->computeWindow(inputAttn, steps[b], targetlen, inputsteps, 1);
+      ASSERT_TRUE(allClose(maskB.array()(af::span, af::span, b), mask.array()));
+    }
+  }
+
+  // Hypotheses at the same step of a window depending on the attention
+  MedianWindow medianWindow(2, 3);
+  auto prevAttn =
+      Variable(af::randu(af::dim4(1, inputsteps, batchsize)), false);
+  std::vector<int> sameSteps(batchsize, 4);
+  ASSERT_TRUE(allClose(
+      medianWindow.computeBatchedWindow(
+          prevAttn, sameSteps, targetlen, inputsteps),
+      medianWindow.computeWindow(
+          prevAttn, 4, targetlen, inputsteps, batchsize)));
+  ASSERT_FALSE(medianWindow.isVectorizable());
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   fl::init();
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <arrayfire.h>
+#include <gtest/gtest.h>
+
+#include "flashlight/app/asr/data/AsyncBlobReader.h"
+#include "flashlight/app/asr/data/AsyncListFileDataset.h"
+#include "flashlight/fl/common/Init.h"
+#include "flashlight/lib/common/String.h"
+#include "flashlight/lib/common/System.h"
+
+using namespace fl::lib;
+using namespace fl::app::asr;
+
+namespace {
+std::string loadPath = "";
+
+// Blobs are their key, "missing" can't be fetched
+class MemoryBlobStore : public BlobStore {
+ public:
+  std::vector<std::string> fetch(
+      const std::vector<std::string>& keys) override {
+    if (gate.valid()) {
+      gate.wait();
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    requests.push_back(keys);
+    std::vector<std::string> blobs;
+    for (const auto& key : keys) {
+      if (key == "missing") {
+        throw std::runtime_error("missing blob");
+      }
+      blobs.push_back(key);
+    }
+    return blobs;
+  }
+
+  int64_t numFetched() {
+    std::lock_guard<std::mutex> lock(mutex);
+    int64_t n = 0;
+    for (const auto& request : requests) {
+      n += request.size();
+    }
+    return n;
+  }
+
+  // Fetches wait for it if valid
+  std::shared_future<void> gate;
+  std::vector<std::vector<std::string>> requests;
+  std::mutex mutex;
+};
+} // namespace
+
+TEST(AsyncBlobReaderTest, Get) {
+  auto store = std::make_shared<MemoryBlobStore>();
+  AsyncBlobReader reader(store, 2, 4);
+  ASSERT_EQ(reader.get("a"), "a");
+  std::vector<std::string> keys;
+  for (int i = 0; i < 32; ++i) {
+    keys.push_back(std::to_string(i));
+  }
+  reader.prefetch(keys);
+  for (const auto& key : keys) {
+    ASSERT_EQ(reader.get(key), key);
+  }
+  // Each key is fetched once, coalesced by up to 4 keys
+  ASSERT_EQ(store->numFetched(), 33);
+  for (const auto& request : store->requests) {
+    ASSERT_LE(request.size(), 4);
+  }
+  // Read blobs are fetched again
+  ASSERT_EQ(reader.get("a"), "a");
+  ASSERT_EQ(store->numFetched(), 34);
+  ASSERT_THROW(reader.get("missing"), std::runtime_error);
+}
+
+TEST(AsyncBlobReaderTest, Concurrent) {
+  auto store = std::make_shared<MemoryBlobStore>();
+  AsyncBlobReader reader(store, 4, 8);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&reader, t]() {
+      std::vector<std::string> keys;
+      for (int i = 0; i < 100; ++i) {
+        keys.push_back(std::to_string(t) + ":" + std::to_string(i));
+      }
+      reader.prefetch(keys);
+      for (const auto& key : keys) {
+        EXPECT_EQ(reader.get(key), key);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(store->numFetched(), 400);
+}
+
+TEST(AsyncBlobReaderTest, MaxBlobs) {
+  auto store = std::make_shared<MemoryBlobStore>();
+  std::promise<void> open;
+  store->gate = open.get_future().share();
+  AsyncBlobReader reader(store, 1, 1, 4);
+  std::vector<std::string> keys;
+  for (int i = 0; i < 16; ++i) {
+    keys.push_back(std::to_string(i));
+  }
+  // No more than 4 blobs are queued or in flight
+  reader.prefetch(keys);
+  open.set_value();
+  ASSERT_EQ(reader.get("15"), "15");
+  ASSERT_EQ(reader.get("3"), "3");
+  ASSERT_EQ(store->numFetched(), 5);
+}
+
+TEST(AsyncBlobReaderTest, BlobStores) {
+  ASSERT_TRUE(std::dynamic_pointer_cast<FileBlobStore>(
+      createBlobStore("file")));
+  ASSERT_THROW(createBlobStore("memory"), std::invalid_argument);
+  registerBlobStore(
+      "memory", []() { return std::make_shared<MemoryBlobStore>(); });
+  ASSERT_TRUE(std::dynamic_pointer_cast<MemoryBlobStore>(
+      createBlobStore("memory")));
+}
+
+TEST(AsyncBlobReaderTest, AsyncListFileDataset) {
+  auto data = getFileContent(pathsConcat(loadPath, "data.lst"));
+  const std::string listPath = fl::lib::getTmpPath("async.lst");
+  std::ofstream out(listPath);
+  for (auto& d : data) {
+    replaceAll(d, "<TESTDIR>", loadPath);
+    out << d;
+    out << "\n";
+  }
+  out.close();
+
+  auto reader =
+      std::make_shared<AsyncBlobReader>(std::make_shared<FileBlobStore>());
+  ListFileDataset listds(listPath);
+  AsyncListFileDataset asyncds(listPath, reader, 2);
+  ASSERT_EQ(asyncds.size(), listds.size());
+  asyncds.setReadOrder({2, 0, 1});
+  for (auto i : {2, 0, 1}) {
+    auto expected = listds.get(i);
+    auto sample = asyncds.get(i);
+    ASSERT_EQ(sample.size(), expected.size());
+    ASSERT_EQ(sample[0].dims(), expected[0].dims());
+    ASSERT_TRUE(af::allTrue<bool>(sample[0] == expected[0]));
+  }
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  fl::init();
+
+// Resolve directory for data
+#ifdef DATA_TEST_DATADIR
+  loadPath = DATA_TEST_DATADIR;
+#endif
+
+  return RUN_ALL_TESTS();
+}
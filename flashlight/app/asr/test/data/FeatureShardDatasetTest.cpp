@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <arrayfire.h>
+#include <gtest/gtest.h>
+
+#include "flashlight/app/asr/data/FeatureShardDataset.h"
+#include "flashlight/fl/common/Init.h"
+#include "flashlight/lib/common/System.h"
+
+using namespace fl::app::asr;
+
+namespace {
+
+std::vector<float> randomFeatures(const af::dim4& dims) {
+  std::vector<float> features(dims.elements());
+  for (size_t i = 0; i < features.size(); ++i) {
+    features[i] = (static_cast<int>(i * 37) % 101) / 10.0 - 5.0;
+  }
+  return features;
+}
+
+auto letterToTarget = [](void* data, af::dim4 dims, af::dtype /* unused */) {
+  std::vector<int> tgt(
+      static_cast<char*>(data), static_cast<char*>(data) + dims.elements());
+  if (tgt.empty()) {
+    return af::array().as(s32);
+  }
+  return af::array(tgt.size(), tgt.data());
+};
+
+void testShards(FeatureShardType type, float tolerance) {
+  std::vector<af::dim4> dims = {{50, 3, 1}, {20, 3, 2}, {7, 3, 1}};
+  std::vector<ListFileRow> rows = {
+      {"a", "/a.flac", 3.5, "hello world"},
+      {"b", "/b.flac", 2.0, ""},
+      {"c", "/c.flac", 1.5, "x"}};
+
+  auto manifest = fl::lib::getTmpPath("FeatureShardDatasetTest.shards");
+  {
+    // Two samples in the first shard, one in the second
+    FeatureShardWriter first(manifest + ".0.flfeat", type);
+    first.add(rows[0], randomFeatures(dims[0]), dims[0]);
+    first.add(rows[1], randomFeatures(dims[1]), dims[1]);
+    first.close();
+    FeatureShardWriter second(manifest + ".1.flfeat", type);
+    second.add(rows[2], randomFeatures(dims[2]), dims[2]);
+    second.close();
+    std::ofstream out(manifest);
+    out << kFeatureShardManifestHeader << "\n"
+        << fl::lib::basename(manifest) << ".0.flfeat\n"
+        << manifest << ".1.flfeat\n";
+  }
+  ASSERT_TRUE(FeatureShardDataset::isManifest(manifest));
+  ASSERT_FALSE(FeatureShardDataset::isManifest(manifest + ".0.flfeat"));
+
+  FeatureShardDataset ds(manifest, nullptr, letterToTarget);
+  ASSERT_EQ(ds.size(), 3);
+  for (int i = 0; i < 3; ++i) {
+    auto sample = ds.get(i);
+    ASSERT_EQ(sample.size(), 7);
+    ASSERT_EQ(sample[0].dims(), dims[i]);
+    auto expected = randomFeatures(dims[i]);
+    std::vector<float> features(sample[0].elements());
+    sample[0].host(features.data());
+    for (size_t j = 0; j < expected.size(); ++j) {
+      ASSERT_NEAR(features[j], expected[j], tolerance);
+    }
+    ASSERT_EQ(sample[1].elements(), rows[i].transcript.size());
+    ASSERT_EQ(ds.getTargetSize(i), rows[i].transcript.size());
+    ASSERT_EQ(ds.getInputSize(i), rows[i].size);
+    ASSERT_EQ(sample[3].elements(), rows[i].id.size());
+    ASSERT_EQ(sample[4].elements(), rows[i].input.size());
+  }
+}
+
+} // namespace
+
+TEST(FeatureShardDatasetTest, F32) {
+  testShards(FeatureShardType::F32, 0);
+}
+
+TEST(FeatureShardDatasetTest, F16) {
+  // 11 bits of precision on values within [-5, 5]
+  testShards(FeatureShardType::F16, 5.0 / 2048);
+}
+
+TEST(FeatureShardDatasetTest, Int8) {
+  // Half a step of 10 / 255
+  testShards(FeatureShardType::INT8, 10.0 / 255 / 2 + 1e-5);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  fl::init();
+  return RUN_ALL_TESTS();
+}
@@ -389,6 +389,48 @@ TEST(FeaturizationTest, inputFeaturizer) {
   }
 }
 
+TEST(FeaturizationTest, deviceInputFeaturizer) {
+  auto channels = 2;
+  auto samplerate = 16000;
+  int insize = 1.3 * samplerate;
+  std::vector<float> input(insize * channels);
+  for (int j = 0; j < input.size(); ++j) {
+    input[j] = std::sin(2 * M_PI * 440 * j / samplerate) +
+        0.1 * (std::rand() / static_cast<float>(RAND_MAX) - 0.5);
+  }
+  FeatureParams featParams(
+      samplerate,
+      25, // framesize
+      10, // framestride
+      40, // filterbanks
+      0, // lowfreqfilterbank,
+      samplerate / 2, // highfreqfilterbank
+      13, // mfcccoeffs
+      kLifterParam, // lifterparam
+      2, // delta window
+      2 // delta-delta window
+  );
+  featParams.zeroMeanFrame = true;
+  std::vector<std::pair<int, int>> normCtxs = {{-1, -1}, {5, 3}};
+  for (auto featType :
+       {FeatureType::POW_SPECTRUM, FeatureType::MFSC, FeatureType::MFCC}) {
+    for (auto useEnergy : {true, false}) {
+      featParams.useEnergy = useEnergy;
+      for (const auto& normCtx : normCtxs) {
+        auto cpuFeaturizer = inputFeatures(featParams, featType, normCtx);
+        auto deviceFeaturizer =
+            inputFeatures(featParams, featType, normCtx, {}, 0, true);
+        auto expected = cpuFeaturizer(
+            input.data(), af::dim4(channels, insize), af::dtype::f32);
+        auto output = deviceFeaturizer(
+            input.data(), af::dim4(channels, insize), af::dtype::f32);
+        ASSERT_EQ(output.dims(), expected.dims());
+        ASSERT_LT(af::max<double>(af::abs(output - expected)), 1E-3);
+      }
+    }
+  }
+}
+
 TEST(FeaturizationTest, targetFeaturizer) {
   using fl::app::asr::kEosToken;
 
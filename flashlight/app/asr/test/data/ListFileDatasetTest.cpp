@@ -13,6 +13,7 @@
 #include <gtest/gtest.h>
 
 #include "flashlight/app/asr/data/ListFileDataset.h"
+#include "flashlight/app/asr/data/ListFileIndex.h"
 #include "flashlight/fl/common/Init.h"
 #include "flashlight/lib/common/String.h"
 #include "flashlight/lib/common/System.h"
@@ -62,6 +63,42 @@ TEST(ListFileDatasetTest, LoadData) {
   }
 }
 
+TEST(ListFileDatasetTest, LoadIndex) {
+  auto data = getFileContent(pathsConcat(loadPath, "data.lst"));
+  const std::string listPath = fl::lib::getTmpPath("index.lst");
+  std::ofstream out(listPath);
+  for (auto& d : data) {
+    replaceAll(d, "<TESTDIR>", loadPath);
+    out << d;
+    out << "\n";
+  }
+  // Row without transcription
+  out << "empty " << pathsConcat(loadPath, "test_mono.wav") << " 1.5\n";
+  out.close();
+  const std::string indexPath = fl::lib::getTmpPath("index.lsti");
+  ASSERT_EQ(ListFileIndex::write(listPath, indexPath), 4);
+  ASSERT_TRUE(ListFileIndex::isIndex(indexPath));
+  ASSERT_FALSE(ListFileIndex::isIndex(listPath));
+
+  ListFileDataset listds(listPath, nullptr, letterToTarget);
+  ListFileDataset indexds(indexPath, nullptr, letterToTarget);
+  ASSERT_EQ(indexds.size(), listds.size());
+  for (int i = 0; i < listds.size(); ++i) {
+    ASSERT_EQ(indexds.getInputSize(i), listds.getInputSize(i));
+    ASSERT_EQ(indexds.getTargetSize(i), listds.getTargetSize(i));
+    auto expected = listds.get(i);
+    auto sample = indexds.get(i);
+    ASSERT_EQ(sample.size(), expected.size());
+    for (int j = 0; j < expected.size(); ++j) {
+      ASSERT_EQ(sample[j].dims(), expected[j].dims());
+      if (!expected[j].isempty()) {
+        ASSERT_TRUE(af::allTrue<bool>(sample[j] == expected[j]));
+      }
+    }
+  }
+  ASSERT_TRUE(indexds.get(3)[1].isempty());
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   fl::init();
@@ -106,6 +106,47 @@ TEST(SoundTest, Stereo) {
   }
 }
 
+TEST(SoundTest, Range) {
+  auto audiopath = pathsConcat(loadPath, "test_stereo.wav");
+  auto info = loadSoundInfo(audiopath);
+  auto vecFloat = loadSound<float>(audiopath);
+
+  int64_t start = 1000, frames = 5000;
+  auto range = loadSoundRange<float>(audiopath, start, frames);
+  ASSERT_EQ(range.size(), frames * info.channels);
+  for (int64_t i = 0; i < range.size(); ++i) {
+    ASSERT_EQ(range[i], vecFloat[start * info.channels + i]);
+  }
+
+  // Until the end
+  auto rest = loadSoundRange<float>(audiopath, start, -1);
+  ASSERT_EQ(rest.size(), (info.frames - start) * info.channels);
+  auto clamped = loadSoundRange<float>(audiopath, start, info.frames);
+  ASSERT_EQ(clamped, rest);
+  ASSERT_EQ(loadSoundRange<float>(audiopath, 0, -1), vecFloat);
+  ASSERT_THROW(
+      loadSoundRange<float>(audiopath, info.frames + 1, 1),
+      std::invalid_argument);
+}
+
+TEST(SoundTest, ParseSegment) {
+  auto whole = parseSoundSegment("/tmp/a.flac");
+  ASSERT_EQ(whole.path, "/tmp/a.flac");
+  ASSERT_TRUE(whole.isWholeFile());
+
+  auto segment = parseSoundSegment("/tmp/a.flac:3600.5:12.25");
+  ASSERT_EQ(segment.path, "/tmp/a.flac");
+  ASSERT_DOUBLE_EQ(segment.offset, 3600.5);
+  ASSERT_DOUBLE_EQ(segment.duration, 12.25);
+  ASSERT_FALSE(segment.isWholeFile());
+
+  ASSERT_DOUBLE_EQ(parseSoundSegment("/tmp/a.flac:2:-1").duration, -1);
+  // Not segments
+  ASSERT_EQ(parseSoundSegment("/tmp/a:b.flac").path, "/tmp/a:b.flac");
+  ASSERT_EQ(parseSoundSegment("/tmp/a.flac:-1:2").path, "/tmp/a.flac:-1:2");
+  ASSERT_EQ(parseSoundSegment("/tmp/a.flac::2").path, "/tmp/a.flac::2");
+}
+
 TEST(SoundTest, OggReadWrite) {
   auto audiopath = pathsConcat(loadPath, "test_stereo.wav");
   const std::string outaudiopath = getTmpPath("test.ogg");
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+#include "flashlight/lib/text/decoder/LexiconDecoder.h"
+
+using namespace fl::lib::text;
+
+/**
+ * Compares merging candidates by sorting them with merging them through a
+ * hash table in `candidatesStore`, for a frame of `nCandidates` candidates
+ * proposed from `nStates` distinct (LM state, lexicon node) pairs.
+ */
+int main() {
+  const int beamSize = 500, nCandidates = 500 * 50, nStates = 5000;
+  const int nTokens = 30, ntimes = 50;
+
+  std::mt19937 gen(0);
+  std::uniform_int_distribution<int> stateDist(0, nStates - 1);
+  std::uniform_int_distribution<int> tokenDist(0, nTokens - 1);
+  std::uniform_real_distribution<double> scoreDist(-50, 0);
+
+  std::vector<LMStatePtr> lmStates(nStates);
+  for (auto& state : lmStates) {
+    state = std::make_shared<LMState>();
+  }
+  std::vector<FlatTrieNode> lexNodes(nStates);
+
+  std::vector<LexiconDecoderState> proposals;
+  for (int i = 0; i < nCandidates; i++) {
+    int state = stateDist(gen);
+    proposals.emplace_back(
+        scoreDist(gen),
+        lmStates[state],
+        &lexNodes[state],
+        nullptr,
+        tokenDist(gen),
+        -1,
+        tokenDist(gen) % 2);
+  }
+
+  std::vector<LexiconDecoderState> candidates;
+  std::vector<LexiconDecoderState*> candidatePtrs;
+  std::vector<LexiconDecoderState> outputs;
+  std::vector<int> mergeTable;
+
+  for (bool hashMerge : {false, true}) {
+    double totalTime = 0;
+    for (int i = 0; i < ntimes; ++i) {
+      candidates = proposals;
+      candidatePtrs.clear();
+      auto start = std::chrono::steady_clock::now();
+      candidatesStore(
+          candidates,
+          candidatePtrs,
+          outputs,
+          beamSize,
+          -std::numeric_limits<double>::infinity(),
+          false,
+          false,
+          hashMerge ? &mergeTable : nullptr);
+      totalTime += std::chrono::duration<double, std::milli>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    }
+    std::cout << (hashMerge ? "Hash" : "Sort") << " merging: "
+              << candidatePtrs.size() << " distinct candidates, "
+              << std::setprecision(5) << totalTime / ntimes << " msec"
+              << std::endl;
+  }
+  return 0;
+}
@@ -10,6 +10,7 @@
 #include <arrayfire.h>
 #include "flashlight/fl/flashlight.h"
 
+#include "flashlight/app/asr/decoder/ConvLmModule.h"
 #include "flashlight/ext/common/SequentialBuilder.h"
 #include "flashlight/lib/common/System.h"
 
@@ -68,6 +69,45 @@ TEST(ConvLmModuleTest, GCNN14BCrossEntropy) {
   ASSERT_EQ(output.dims(), af::dim4(nclass, inputlength, batchsize));
 }
 
+TEST(ConvLmModuleTest, GCNN14BIncremental) {
+  const std::string archfile = pathsConcat(archDir, "gcnn_14B_lm_arch_ce.txt");
+  int nclass = 30;
+  int inputlength = 8;
+
+  std::shared_ptr<Module> model = buildSequentialModule(archfile, 1, nclass);
+  model->eval();
+  auto fullScore = buildGetConvLmScoreFunction(model);
+  auto incrementalScore = buildIncrementalConvLmScoreFunction(model);
+
+  // Two sentences, the second of which starts a step later
+  std::vector<int> tokens(inputlength);
+  for (int i = 0; i < inputlength; ++i) {
+    tokens[i] = (7 * i + 3) % nclass;
+  }
+  std::vector<std::shared_ptr<void>> states(1);
+  std::vector<int> stepTokens = {tokens[0]};
+  for (int t = 0; t < inputlength; ++t) {
+    auto scores = incrementalScore(stepTokens, states);
+    ASSERT_EQ(scores.size(), nclass * stepTokens.size());
+    auto expected = fullScore(tokens, {t}, t + 1, 1);
+    for (int c = 0; c < nclass; ++c) {
+      ASSERT_NEAR(scores[c], expected[c], 1E-4);
+    }
+    if (t > 0) {
+      auto expectedSecond = fullScore(tokens, {t - 1}, t, 1);
+      for (int c = 0; c < nclass; ++c) {
+        ASSERT_NEAR(scores[nclass + c], expectedSecond[c], 1E-4);
+      }
+    }
+    if (t + 1 < inputlength) {
+      stepTokens = {tokens[t + 1], tokens[t]};
+      if (t == 0) {
+        states.push_back(nullptr);
+      }
+    }
+  }
+}
+
 TEST(ConvLmModuleTest, SerializationGCNN14BAdaptiveSoftmax) {
   char* user = getenv("USER");
   std::string userstr = "unknown";
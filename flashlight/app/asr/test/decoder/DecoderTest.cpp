@@ -98,6 +98,17 @@ TEST(DecoderTest, run) {
   auto lm = std::make_shared<KenLM>(pathsConcat(dataDir, "lm.arpa"), wordDict);
   LOG(INFO) << "[Decoder] LM constructed.\n";
 
+  // Instances loaded from the same file serve from the same model
+  {
+    size_t nModels = KenLM::nSharedModels();
+    KenLM sharedLm(pathsConcat(dataDir, "lm.arpa"), wordDict);
+    ASSERT_EQ(KenLM::nSharedModels(), nModels);
+    KenLMOptions lazyOpt;
+    lazyOpt.loadMethod = KenLMLoadMethod::Lazy;
+    KenLM lazyLm(pathsConcat(dataDir, "lm.arpa"), wordDict, lazyOpt);
+    ASSERT_EQ(KenLM::nSharedModels(), nModels + 1);
+  }
+
   std::vector<std::string> sentence{"the", "cat", "sat", "on", "the", "mat"};
   auto inState = lm->start(0);
   float totalScore = 0, lmScore = 0;
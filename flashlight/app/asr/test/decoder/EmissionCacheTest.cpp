@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/app/asr/decoder/EmissionCache.h"
+#include "flashlight/lib/common/System.h"
+
+using namespace fl::app::asr;
+
+namespace {
+
+EmissionUnit makeEmission(const std::string& id, int T, int N) {
+  std::vector<float> emission(T * N);
+  for (size_t i = 0; i < emission.size(); ++i) {
+    emission[i] = (static_cast<int>(i * 37) % 101) / 10.0 - 5.0;
+  }
+  return EmissionUnit(emission, id, T, N);
+}
+
+std::vector<EmissionTargetPair> writeAndRead(
+    const std::vector<EmissionTargetPair>& pairs,
+    EmissionCacheType type,
+    int topK = 0) {
+  auto path = fl::lib::getTmpPath("EmissionCacheTest.bin");
+  EmissionCacheWriter writer(path, type, topK);
+  for (const auto& pair : pairs) {
+    writer.add(pair.first, pair.second);
+  }
+  writer.close();
+
+  EmissionCacheReader reader(path);
+  std::vector<EmissionTargetPair> result;
+  for (int64_t i = 0; i < reader.size(); ++i) {
+    result.push_back(reader.get(i));
+  }
+  return result;
+}
+
+std::vector<EmissionTargetPair> samplePairs() {
+  TargetUnit first, second;
+  first.wordTargetStr = {"hello", "world"};
+  first.tokenTarget = {3, 1, 4, 1, 5};
+  return {{makeEmission("a", 20, 7), first},
+          {makeEmission("b", 3, 7), second}};
+}
+
+void checkTargets(
+    const std::vector<EmissionTargetPair>& expected,
+    const std::vector<EmissionTargetPair>& result) {
+  ASSERT_EQ(result.size(), expected.size());
+  for (size_t i = 0; i < result.size(); ++i) {
+    EXPECT_EQ(result[i].first.sampleId, expected[i].first.sampleId);
+    EXPECT_EQ(result[i].first.nFrames, expected[i].first.nFrames);
+    EXPECT_EQ(result[i].first.nTokens, expected[i].first.nTokens);
+    EXPECT_EQ(result[i].second.wordTargetStr, expected[i].second.wordTargetStr);
+    EXPECT_EQ(result[i].second.tokenTarget, expected[i].second.tokenTarget);
+  }
+}
+
+} // namespace
+
+TEST(EmissionCacheTest, F32) {
+  auto pairs = samplePairs();
+  auto result = writeAndRead(pairs, EmissionCacheType::F32);
+  checkTargets(pairs, result);
+  for (size_t i = 0; i < result.size(); ++i) {
+    EXPECT_EQ(result[i].first.emission, pairs[i].first.emission);
+  }
+}
+
+TEST(EmissionCacheTest, F16) {
+  auto pairs = samplePairs();
+  auto result = writeAndRead(pairs, EmissionCacheType::F16);
+  checkTargets(pairs, result);
+  for (size_t i = 0; i < result.size(); ++i) {
+    const auto& expected = pairs[i].first.emission;
+    for (size_t j = 0; j < expected.size(); ++j) {
+      // 11 bits of precision on values within [-5, 5]
+      EXPECT_NEAR(result[i].first.emission[j], expected[j], 5.0 / 2048);
+    }
+  }
+}
+
+TEST(EmissionCacheTest, TopK) {
+  const int K = 3;
+  auto pairs = samplePairs();
+  auto result = writeAndRead(pairs, EmissionCacheType::TOPK, K);
+  checkTargets(pairs, result);
+  for (size_t i = 0; i < result.size(); ++i) {
+    int N = pairs[i].first.nTokens;
+    for (int t = 0; t < pairs[i].first.nFrames; ++t) {
+      std::vector<float> frame(
+          pairs[i].first.emission.begin() + t * N,
+          pairs[i].first.emission.begin() + (t + 1) * N);
+      std::vector<float> sorted = frame;
+      std::sort(sorted.begin(), sorted.end(), std::greater<float>());
+      for (int n = 0; n < N; ++n) {
+        float score = result[i].first.emission[t * N + n];
+        if (frame[n] > sorted[K]) {
+          EXPECT_NEAR(score, frame[n], 5.0 / 2048);
+        } else {
+          // Scores out of the top K (or tied with the K-th) are the K+1-th
+          EXPECT_NEAR(score, sorted[K], 5.0 / 2048);
+        }
+      }
+    }
+  }
+  EXPECT_THROW(
+      EmissionCacheWriter(
+          fl::lib::getTmpPath("EmissionCacheTest.bin"),
+          EmissionCacheType::TOPK,
+          0),
+      std::invalid_argument);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
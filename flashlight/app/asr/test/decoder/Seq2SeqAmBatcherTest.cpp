@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <arrayfire.h>
+#include "flashlight/fl/flashlight.h"
+
+#include "flashlight/app/asr/criterion/attention/attention.h"
+#include "flashlight/app/asr/criterion/criterion.h"
+#include "flashlight/app/asr/decoder/Seq2SeqAmBatcher.h"
+
+using namespace fl;
+using namespace fl::app::asr;
+
+TEST(Seq2SeqAmBatcherTest, MatchesUnbatchedUpdates) {
+  const int N = 6, H = 8, nAttnRound = 1, beamSize = 3, numDecoders = 4;
+  std::vector<std::shared_ptr<AttentionBase>> attentions(
+      nAttnRound, std::make_shared<ContentAttention>());
+  std::shared_ptr<SequenceCriterion> criterion =
+      std::make_shared<Seq2SeqCriterion>(
+          N,
+          H,
+          N - 2,
+          N - 1,
+          100,
+          attentions,
+          nullptr,
+          false,
+          100,
+          0.0,
+          false,
+          kRandSampling,
+          1.0,
+          1,
+          nAttnRound,
+          0.0);
+  criterion->eval();
+
+  std::vector<std::vector<float>> emissions;
+  for (int d = 0; d < numDecoders; d++) {
+    emissions.push_back(afToVector<float>(af::randn(H, 10 + 3 * d)));
+  }
+  // Two steps of each decoder, the second one from the states of the first
+  auto decode = [&](AMUpdateFunc amUpdate, int d) {
+    std::vector<std::vector<float>> scores;
+    int T = emissions[d].size() / H;
+    int t = 0;
+    auto first = amUpdate(emissions[d].data(), H, T, {-1}, {nullptr}, t);
+    scores.push_back(first.first[0]);
+    t = 1;
+    std::vector<int> ys(beamSize);
+    std::vector<AMStatePtr> states(beamSize, first.second[0]);
+    for (int i = 0; i < beamSize; i++) {
+      ys[i] = (d + i) % N;
+    }
+    auto second = amUpdate(emissions[d].data(), H, T, ys, states, t);
+    for (auto& s : second.first) {
+      scores.push_back(s);
+    }
+    return scores;
+  };
+
+  std::vector<std::vector<std::vector<float>>> expected;
+  for (int d = 0; d < numDecoders; d++) {
+    expected.push_back(decode(
+        buildSeq2SeqRnnAmUpdateFunction(
+            criterion, nAttnRound, beamSize, 1000, 1.0),
+        d));
+  }
+
+  const int device = af::getDevice();
+  for (int maxHypotheses : {1, 5, 100}) {
+    Seq2SeqAmBatcher batcher(
+        criterion,
+        device,
+        nAttnRound,
+        1000,
+        1.0,
+        maxHypotheses,
+        std::chrono::milliseconds(5));
+    std::vector<std::vector<std::vector<float>>> scores(numDecoders);
+    std::vector<std::thread> threads;
+    for (int d = 0; d < numDecoders; d++) {
+      auto amUpdate = batcher.amUpdateFunc();
+      threads.emplace_back([&, amUpdate, d]() {
+        af::setDevice(device);
+        scores[d] = decode(amUpdate, d);
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    for (int d = 0; d < numDecoders; d++) {
+      ASSERT_EQ(scores[d].size(), expected[d].size());
+      for (int i = 0; i < scores[d].size(); i++) {
+        for (int j = 0; j < N; j++) {
+          ASSERT_NEAR(scores[d][i][j], expected[d][i][j], 1e-4);
+        }
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  fl::init();
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <arrayfire.h>
+#include "flashlight/fl/flashlight.h"
+
+#include "flashlight/app/asr/decoder/TransformerLmModule.h"
+#include "flashlight/ext/common/DistributedUtils.h"
+
+using namespace fl;
+using namespace fl::app::asr;
+
+namespace {
+
+const int kNClass = 20;
+
+// The layout of the models of fl/app/lm: a frontend and transformer layers,
+// forwarded on the tokens (T x B) and their lengths
+class TransformerLm : public Container {
+ public:
+  TransformerLm() {
+    auto frontend = std::make_shared<Sequential>();
+    frontend->add(std::make_shared<Embedding>(16, kNClass));
+    frontend->add(std::make_shared<SinusoidalPositionEmbedding>(16));
+    add(frontend);
+    for (int i = 0; i < 2; ++i) {
+      add(std::make_shared<Transformer>(
+          16, 8, 32, 2, 0, 0.0, 0.0, true, false));
+    }
+  }
+
+  std::vector<Variable> forward(const std::vector<Variable>& input) override {
+    auto hidden = module(0)->forward({input[0]})[0];
+    for (int i = 1; i < modules().size(); ++i) {
+      hidden = module(i)->forward({hidden, Variable()})[0];
+    }
+    return {hidden};
+  }
+
+  std::string prettyString() const override {
+    return "TransformerLm";
+  }
+};
+
+// Scores of the token following `tokens`, forwarding the whole sentence
+std::vector<float> fullScore(Module& network, std::vector<int> tokens) {
+  int T = tokens.size();
+  af::array input(T, 1, tokens.data());
+  auto hidden = network.forward({noGrad(input), Variable()})[0];
+  auto output = logSoftmax(hidden, 0);
+  return ext::afToVector<float>(output.array().col(T - 1));
+}
+
+} // namespace
+
+TEST(TransformerLmModuleTest, Incremental) {
+  auto network = std::make_shared<TransformerLm>();
+  network->eval();
+  // Pages of two positions: the caches share full pages and copy the others
+  auto score = buildTransformerLmScoreFunction(network, nullptr, 2);
+
+  std::vector<int> tokens = {2, 7, 11, 3, 5};
+  std::vector<std::shared_ptr<void>> caches(1);
+  std::shared_ptr<void> prefixCache;
+  for (int t = 0; t < tokens.size(); ++t) {
+    auto scores = score({tokens[t]}, caches);
+    ASSERT_EQ(scores.size(), kNClass);
+    auto expected = fullScore(
+        *network, std::vector<int>(tokens.begin(), tokens.begin() + t + 1));
+    for (int c = 0; c < kNClass; ++c) {
+      ASSERT_NEAR(scores[c], expected[c], 1E-4);
+    }
+    if (t == 2) {
+      prefixCache = caches[0];
+    }
+  }
+
+  // Sibling hypotheses of the same prefix, batched with a longer one
+  std::vector<std::shared_ptr<void>> siblings = {
+      prefixCache, prefixCache, caches[0]};
+  auto scores = score({4, 9, 1}, siblings);
+  ASSERT_EQ(scores.size(), 3 * kNClass);
+  std::vector<std::vector<int>> sentences = {
+      {2, 7, 11, 4}, {2, 7, 11, 9}, {2, 7, 11, 3, 5, 1}};
+  for (int b = 0; b < sentences.size(); ++b) {
+    auto expected = fullScore(*network, sentences[b]);
+    for (int c = 0; c < kNClass; ++c) {
+      ASSERT_NEAR(scores[b * kNClass + c], expected[c], 1E-4);
+    }
+  }
+  // The caches of the prefix are unchanged
+  std::vector<std::shared_ptr<void>> prefix = {prefixCache};
+  auto again = score({4}, prefix);
+  for (int c = 0; c < kNClass; ++c) {
+    ASSERT_NEAR(again[c], scores[c], 1E-4);
+  }
+}
+
+TEST(TransformerLmModuleTest, SentenceScores) {
+  auto network = std::make_shared<TransformerLm>();
+  network->eval();
+  int eos = 0, pad = 1;
+  // Batches of 8 tokens at most
+  auto score =
+      buildTransformerLmSentenceScoreFunction(network, nullptr, eos, pad, 8);
+
+  // With duplicates and prefixes of other sentences
+  std::vector<std::vector<int>> sentences = {
+      {7, 11}, {7, 11, 3}, {7}, {}, {7, 11}, {4, 2, 9, 5, 6, 8, 3}};
+  auto scores = score(sentences);
+  ASSERT_EQ(scores.size(), sentences.size());
+  for (int i = 0; i < sentences.size(); ++i) {
+    std::vector<int> prefix = {eos};
+    float expected = 0;
+    for (int word : sentences[i]) {
+      expected += fullScore(*network, prefix)[word];
+      prefix.push_back(word);
+    }
+    expected += fullScore(*network, prefix)[eos];
+    ASSERT_NEAR(scores[i], expected, 1E-4);
+  }
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  fl::init();
+  return RUN_ALL_TESTS();
+}
@@ -125,6 +125,61 @@ TEST(RuntimeTest, parseValidSets) {
   ASSERT_EQ(op2[2], (std::pair<std::string, std::string>("d3.lst", "d3.lst")));
 }
 
+TEST(RuntimeTest, StreamingFeatureNormalizer) {
+  const int numFeat = 3, T = 40;
+  std::vector<float> features(numFeat * T); // FEAT X FRAMES
+  for (size_t i = 0; i < features.size(); ++i) {
+    features[i] = (static_cast<int>(i * 37) % 23) / 4.0 - 2.0;
+  }
+  // normalizeFeatures expects FRAMES X FEAT
+  auto frames = transpose2d(features, T, numFeat);
+  af::dim4 dims(T, numFeat);
+  std::pair<int, int> ctx = {5, 3};
+  auto expected = transpose2d(normalizeFeatures(frames, dims, ctx), numFeat, T);
+
+  // Same normalization fed by chunks of 7 frames
+  StreamingFeatureNormalizer normalizer(numFeat, ctx);
+  std::vector<float> result;
+  for (int t = 0; t < T; t += 7) {
+    int end = std::min(t + 7, T);
+    auto out = normalizer.apply(
+        std::vector<float>(
+            features.begin() + t * numFeat, features.begin() + end * numFeat),
+        end == T);
+    // Frames are output once their right context is available
+    ASSERT_EQ(
+        result.size() + out.size(),
+        (end == T ? T : std::max(end - ctx.second, 0)) * numFeat);
+    result.insert(result.end(), out.begin(), out.end());
+  }
+  ASSERT_EQ(result.size(), expected.size());
+  for (size_t i = 0; i < result.size(); ++i) {
+    ASSERT_NEAR(result[i], expected[i], 1E-4);
+  }
+}
+
+TEST(RuntimeTest, WorkBalancer) {
+  WorkBalancer balancer(0, 2, 0.5, 0.25);
+  ASSERT_EQ(balancer.weights(), std::vector<double>({1, 1}));
+  // Unknown throughputs keep the weights
+  ASSERT_EQ(balancer.update({100, 0}), std::vector<double>({1, 1}));
+  // Process 1 is twice as slow: its weight moves halfway to 0.5
+  auto weights = balancer.update({100, 50});
+  ASSERT_DOUBLE_EQ(weights[0], 1);
+  ASSERT_DOUBLE_EQ(weights[1], 0.75);
+  // Weights don't go below minWeight
+  weights = balancer.update({100, 1});
+  ASSERT_DOUBLE_EQ(weights[1], 0.5);
+
+  // Without distributed training, the measures of the process itself
+  WorkBalancer single(0, 1);
+  single.add(100, 2);
+  ASSERT_EQ(single.rebalance(), std::vector<double>({1}));
+
+  ASSERT_THROW(WorkBalancer(2, 2), std::invalid_argument);
+  ASSERT_THROW(balancer.update({1}), std::invalid_argument);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   fl::init();
@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/app/asr/data/Sound.h"
+#include "flashlight/app/asr/server/HttpServer.h"
+#include "flashlight/app/asr/server/InferenceEngine.h"
+#include "flashlight/fl/flashlight.h"
+#include "flashlight/lib/text/decoder/LexiconFreeDecoder.h"
+#include "flashlight/lib/text/decoder/lm/ZeroLM.h"
+
+using namespace fl::app::asr;
+
+namespace {
+
+// Tokens: 0 = <sil>, 1 = <blank>, 2 = 'a', 3 = 'b'
+constexpr int kNTokens = 4;
+constexpr int kSil = 0;
+constexpr int kBlank = 1;
+
+// Runs a server on a port picked by the OS for the duration of a test
+class ServerRunner {
+ public:
+  explicit ServerRunner(HttpServer::Handler handler)
+      : server_(0, std::move(handler), 2),
+        thread_([this]() { server_.run(); }) {
+    auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!server_.listening() &&
+           std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  ~ServerRunner() {
+    server_.stop();
+    thread_.join();
+  }
+
+  int port() const {
+    return server_.port();
+  }
+
+ private:
+  HttpServer server_;
+  std::thread thread_;
+};
+
+int connectTo(int port) {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in address;
+  std::memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+  if (fd < 0 ||
+      ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) <
+          0) {
+    throw std::runtime_error("could not connect to the server");
+  }
+  return fd;
+}
+
+void sendAll(int fd, const std::string& data) {
+  size_t written = 0;
+  while (written < data.size()) {
+    auto n = ::send(
+        fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+    if (n <= 0) {
+      throw std::runtime_error("could not send the request");
+    }
+    written += n;
+  }
+}
+
+// Sends `request` and returns the whole response
+std::string query(int port, const std::string& request) {
+  int fd = connectTo(port);
+  sendAll(fd, request);
+  std::string response;
+  char buffer[4096];
+  ssize_t n;
+  while ((n = ::recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+    response.append(buffer, n);
+  }
+  ::close(fd);
+  return response;
+}
+
+std::string get(int port, const std::string& path) {
+  return query(port, "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n");
+}
+
+std::string post(int port, const std::string& path, const std::string& body) {
+  std::ostringstream ss;
+  ss << "POST " << path << " HTTP/1.1\r\nHost: localhost\r\n"
+     << "Content-Length: " << body.size() << "\r\n\r\n"
+     << body;
+  return query(port, ss.str());
+}
+
+std::string responseBody(const std::string& response) {
+  auto headerEnd = response.find("\r\n\r\n");
+  return headerEnd == std::string::npos ? ""
+                                        : response.substr(headerEnd + 4);
+}
+
+} // namespace
+
+TEST(HttpServerTest, Request) {
+  ServerRunner runner([](const HttpRequest& request) {
+    HttpResponse response;
+    response.body = request.method + " " + request.path + " " + request.body;
+    return response;
+  });
+  ASSERT_GT(runner.port(), 0);
+
+  auto response = post(runner.port(), "/echo", "hello");
+  EXPECT_EQ(response.find("HTTP/1.1 200 OK\r\n"), 0);
+  EXPECT_NE(response.find("Content-Length: 16\r\n"), std::string::npos);
+  EXPECT_EQ(responseBody(response), "POST /echo hello");
+
+  // A request line without a path
+  response = query(runner.port(), "GET\r\n\r\n");
+  EXPECT_EQ(response.find("HTTP/1.1 400 Bad Request\r\n"), 0);
+}
+
+TEST(HttpServerTest, ClientDisconnects) {
+  // Larger than the socket buffers, so that the server writes to a closed
+  // connection
+  std::string large(16 * 1024 * 1024, 'x');
+  ServerRunner runner([&large](const HttpRequest& request) {
+    HttpResponse response;
+    response.body = request.path == "/large" ? large : "ok";
+    return response;
+  });
+
+  int fd = connectTo(runner.port());
+  sendAll(fd, "GET /large HTTP/1.1\r\n\r\n");
+  ::close(fd);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  // The server is still running
+  EXPECT_EQ(responseBody(get(runner.port(), "/small")), "ok");
+}
+
+TEST(ServerTest, RecognizeAndMetrics) {
+  // Features are the frames of the audio, forwarded as emissions
+  auto network = std::make_shared<fl::Sequential>();
+  network->add(fl::Reorder(1, 0, 2, 3));
+  auto inputTransform = [](void* data, af::dim4 dims, af::dtype /* type */) {
+    int T = dims[1] / kNTokens;
+    auto frames = af::array(af::dim4(kNTokens, T), static_cast<float*>(data));
+    return af::array(frames.T());
+  };
+  auto decoderFactory = []() {
+    fl::lib::text::LexiconFreeDecoderOptions opt{
+        .beamSize = 10,
+        .beamSizeToken = kNTokens,
+        .beamThreshold = 100.0,
+        .lmWeight = 0.0,
+        .silScore = 0.0,
+        .logAdd = false,
+        .criterionType = fl::lib::text::CriterionType::CTC};
+    return std::unique_ptr<fl::lib::text::Decoder>(
+        new fl::lib::text::LexiconFreeDecoder(
+            opt,
+            std::make_shared<fl::lib::text::ZeroLM>(),
+            kSil,
+            kBlank,
+            {}));
+  };
+  auto transcriber = [](const fl::lib::text::DecodeResult& result) {
+    std::string transcription;
+    int prev = -1;
+    for (int token : result.tokens) {
+      if (token > kBlank && token != prev) {
+        transcription += 'a' + (token - 2);
+      }
+      prev = token;
+    }
+    return transcription;
+  };
+  InferenceEngineOptions engineOpt;
+  engineOpt.maxWaitMs = 0;
+  engineOpt.nDecoderThreads = 1;
+  InferenceEngine engine(
+      network, inputTransform, decoderFactory, transcriber, engineOpt);
+  ServerRunner runner(makeInferenceHandler(engine));
+
+  // Frames of 'a', 'a', <blank>, 'b', 'b', <blank>
+  std::vector<float> audio;
+  for (int token : {2, 2, kBlank, 3, 3, kBlank}) {
+    for (int n = 0; n < kNTokens; ++n) {
+      audio.push_back(n == token ? 0.9 : -0.9);
+    }
+  }
+  std::stringstream wav;
+  saveSound(wav, audio, 16000, 1, SoundFormat::WAV, SoundSubFormat::FLOAT);
+
+  auto response = post(runner.port(), "/recognize", wav.str());
+  EXPECT_EQ(response.find("HTTP/1.1 200 OK\r\n"), 0);
+  EXPECT_NE(response.find("\"transcription\": \"ab\""), std::string::npos);
+
+  response = post(runner.port(), "/recognize", "not an audio file");
+  EXPECT_EQ(response.find("HTTP/1.1 400 Bad Request\r\n"), 0);
+
+  response = get(runner.port(), "/metrics");
+  EXPECT_EQ(response.find("HTTP/1.1 200 OK\r\n"), 0);
+  auto metrics = responseBody(response);
+  EXPECT_NE(metrics.find("fl_asr_requests_total 1\n"), std::string::npos);
+  EXPECT_NE(metrics.find("fl_asr_batches_total 1\n"), std::string::npos);
+  EXPECT_NE(
+      metrics.find("fl_asr_latency_ms{quantile=\"0.5\"}"), std::string::npos);
+
+  response = get(runner.port(), "/unknown");
+  EXPECT_EQ(response.find("HTTP/1.1 404 Not Found\r\n"), 0);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  fl::init();
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Compiles a list file into the binary format of ListFileIndex, which
+ * ListFileDataset maps instead of parsing it:
+ *   fl_asr_list_to_index <train.lst> <train.lsti>
+ * The compiled list can be used anywhere a list file is expected.
+ */
+
+#include <string>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "flashlight/app/asr/data/ListFileIndex.h"
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+  std::string exec(argv[0]);
+  gflags::SetUsageMessage(
+      "Usage: " + exec + " <input list file> <output compiled list file>");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  if (argc != 3) {
+    LOG(FATAL) << gflags::ProgramUsage();
+  }
+
+  auto numRows = fl::app::asr::ListFileIndex::write(argv[1], argv[2]);
+  LOG(INFO) << "Compiled " << numRows << " samples from " << argv[1]
+            << " into " << argv[2];
+  return 0;
+}
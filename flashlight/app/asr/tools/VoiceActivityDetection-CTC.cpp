@@ -21,6 +21,11 @@
  *   acoustic model output only (output in .tsc file for each sample).
  * - Frame wise token emissions based on the most-likely token emitted for each
  *   chunk, (output in .fwt file for each sample).
+ *
+ * With --vad_chunk_size_ms, the audio of each sample is fed to a
+ * `StreamingVad` chunk by chunk, as in a serving pipeline, and the
+ * speech/non-speech decisions of each chunk are logged as they come.
+ * Only MFSC features and raw audio are supported in this mode.
  */
 
 #include <stdlib.h>
@@ -36,6 +41,7 @@
 #include "flashlight/app/asr/common/Defines.h"
 #include "flashlight/app/asr/criterion/criterion.h"
 #include "flashlight/app/asr/data/FeatureTransforms.h"
+#include "flashlight/app/asr/data/Sound.h"
 #include "flashlight/app/asr/data/Utils.h"
 #include "flashlight/app/asr/decoder/TranscriptionUtils.h"
 #include "flashlight/app/asr/runtime/runtime.h"
@@ -52,6 +58,11 @@ DEFINE_double(
     0.99,
     "Blank probability threshold at which a frame is deemed voice-inactive");
 DEFINE_string(outpath, "", "Output path for generated results files");
+DEFINE_int64(
+    vad_chunk_size_ms,
+    0,
+    "Streaming mode: size of the audio chunks (in ms) fed to the acoustic "
+    "model, 0 to process whole files");
 
 // Extensions for each output file
 const std::string kVadExt = ".vad";
@@ -213,18 +224,11 @@ int main(int argc, char** argv) {
   }
 
   /* ===================== Test ===================== */
-  int cnt = 0;
-  auto prefetchds =
-      loadPrefetchDataset(ds, FLAGS_nthread, false /* shuffle */, 0 /* seed */);
-  for (auto& sample : *prefetchds) {
-    auto rawEmission = fl::ext::forwardSequentialModuleWithPadMask(
-        fl::input(sample[kInputIdx]), network, sample[kDurationIdx]);
-    auto sampleId = readSampleIds(sample[kSampleIdx]).front();
-    LOG(INFO) << "Processing sample ID " << sampleId;
-
+  int blank = tokenDict.getIndex(kBlankToken);
+  auto writeResults = [&](const std::string& sampleId,
+                          const std::vector<int>& tokenPrediction,
+                          const std::vector<float>& blankProbs) {
     // Hypothesis
-    auto tokenPrediction =
-        afToVector<int>(criterion->viterbiPath(rawEmission.array()));
     auto letterPrediction = tknPrediction2Ltr(
         tokenPrediction,
         tokenDict,
@@ -264,13 +268,10 @@ int main(int argc, char** argv) {
     tknOutStream << std::endl;
     tknOutStream.close();
 
-    int blank = tokenDict.getIndex(kBlankToken);
-    int N = rawEmission.dims(0);
-    int T = rawEmission.dims(1);
+    int T = blankProbs.size();
     float vadFrameCnt = 0;
-    auto emissions = afToVector<float>(softmax(rawEmission, 0).array());
     for (int i = 0; i < T; i++) {
-      if (emissions[i * N + blank] < FLAGS_vad_threshold) {
+      if (blankProbs[i] < FLAGS_vad_threshold) {
         vadFrameCnt += 1;
       }
     }
@@ -278,8 +279,7 @@ int main(int argc, char** argv) {
     // Output chunk-level VAD probabilities
     std::ofstream vadProbOutStream(baseName + kVadExt);
     for (int i = 0; i < T; i++) {
-      vadProbOutStream << std::setprecision(4) << emissions[i * N + blank]
-                       << " ";
+      vadProbOutStream << std::setprecision(4) << blankProbs[i] << " ";
     }
     vadProbOutStream << std::endl;
     vadProbOutStream.close();
@@ -298,6 +298,87 @@ int main(int argc, char** argv) {
     }
     statsOutStream << std::endl;
     statsOutStream.close();
+  };
+
+  int cnt = 0;
+  if (FLAGS_vad_chunk_size_ms > 0) {
+    StreamingVad vad(
+        network,
+        featParams,
+        featType,
+        {FLAGS_localnrmlleftctx, FLAGS_localnrmlrightctx},
+        blank,
+        FLAGS_vad_threshold);
+    int64_t chunkSamples = FLAGS_samplerate * FLAGS_vad_chunk_size_ms / 1000;
+    // Samples of the list file: "id audio_path duration transcription"
+    std::ifstream listStream(fl::lib::pathsConcat(FLAGS_datadir, FLAGS_test));
+    std::string line;
+    while (std::getline(listStream, line)) {
+      auto fields = splitOnWhitespace(line, true);
+      if (fields.size() < 2) {
+        continue;
+      }
+      const auto& sampleId = fields[0];
+      LOG(INFO) << "Processing sample ID " << sampleId;
+      auto info = loadSoundInfo(fields[1]);
+      if (info.channels != 1) {
+        LOG(FATAL) << "Streaming VAD expects mono audio: " << fields[1];
+      }
+      auto audio = loadSound<float>(fields[1]);
+
+      std::vector<int> tokenPrediction;
+      std::vector<float> blankProbs;
+      auto addResult = [&](const VadChunkResult& result, int64_t end) {
+        tokenPrediction.insert(
+            tokenPrediction.end(), result.tokens.begin(), result.tokens.end());
+        blankProbs.insert(
+            blankProbs.end(),
+            result.blankProbs.begin(),
+            result.blankProbs.end());
+        if (!result.isSpeech.empty()) {
+          FL_VLOG(1) << sampleId << " audio up to "
+                  << end * 1000 / FLAGS_samplerate << "ms: frames "
+                  << result.firstFrame << "-"
+                  << result.firstFrame + result.isSpeech.size() - 1
+                  << (result.hasSpeech() ? " speech" : " non-speech");
+        }
+      };
+      for (int64_t start = 0; start < audio.size(); start += chunkSamples) {
+        auto end = std::min<int64_t>(start + chunkSamples, audio.size());
+        addResult(
+            vad.apply(std::vector<float>(
+                audio.begin() + start, audio.begin() + end)),
+            end);
+      }
+      addResult(vad.finish(), audio.size());
+      writeResults(sampleId, tokenPrediction, blankProbs);
+
+      ++cnt;
+      if (cnt == FLAGS_maxload) {
+        break;
+      }
+    }
+    return 0;
+  }
+
+  auto prefetchds =
+      loadPrefetchDataset(ds, FLAGS_nthread, false /* shuffle */, 0 /* seed */);
+  for (auto& sample : *prefetchds) {
+    auto rawEmission = fl::ext::forwardSequentialModuleWithPadMask(
+        fl::input(sample[kInputIdx]), network, sample[kDurationIdx]);
+    auto sampleId = readSampleIds(sample[kSampleIdx]).front();
+    LOG(INFO) << "Processing sample ID " << sampleId;
+
+    auto tokenPrediction =
+        afToVector<int>(criterion->viterbiPath(rawEmission.array()));
+    int N = rawEmission.dims(0);
+    int T = rawEmission.dims(1);
+    auto emissions = afToVector<float>(softmax(rawEmission, 0).array());
+    std::vector<float> blankProbs(T);
+    for (int i = 0; i < T; i++) {
+      blankProbs[i] = emissions[i * N + blank];
+    }
+    writeResults(sampleId, tokenPrediction, blankProbs);
 
     ++cnt;
     if (cnt == FLAGS_maxload) {
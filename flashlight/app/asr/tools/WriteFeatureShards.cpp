@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Featurizes the audio of a list file once and writes the features into
+ * shards read by FeatureShardDataset:
+ *   fl_asr_write_feature_shards --list=train.lst --output=train.shards \
+ *     --features_type=mfsc --filterbanks=80 --shard_type=f16
+ * The features flags must be the ones used for training. `output` is the
+ * list of the shards, which are written next to it, and can be used in place
+ * of the list file. Sound effects can't be applied to precomputed features.
+ */
+
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "flashlight/app/asr/common/Defines.h"
+#include "flashlight/app/asr/common/Flags.h"
+#include "flashlight/app/asr/data/FeatureShardDataset.h"
+#include "flashlight/app/asr/data/FeatureTransforms.h"
+#include "flashlight/app/asr/data/Sound.h"
+#include "flashlight/app/asr/data/Utils.h"
+#include "flashlight/fl/common/threadpool/ThreadPool.h"
+#include "flashlight/lib/common/System.h"
+
+namespace {
+
+DEFINE_string(list, "", "List file of the samples to featurize");
+DEFINE_string(
+    output,
+    "",
+    "Path of the list of shards, shards are written in the same directory");
+DEFINE_int64(shard_samples, 1000, "Number of samples per shard");
+DEFINE_string(
+    shard_type,
+    "f32",
+    "Storage type of the features, supports {'f32', 'f16', 'int8'}");
+
+} // namespace
+
+using namespace fl::app::asr;
+using namespace fl::lib;
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+  std::string exec(argv[0]);
+  gflags::SetUsageMessage(
+      "Usage: " + exec + " --list=<list file> --output=<list of shards>");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  if (FLAGS_list.empty() || FLAGS_output.empty()) {
+    LOG(FATAL) << gflags::ProgramUsage();
+  }
+
+  FeatureShardType shardType;
+  if (FLAGS_shard_type == "f32") {
+    shardType = FeatureShardType::F32;
+  } else if (FLAGS_shard_type == "f16") {
+    shardType = FeatureShardType::F16;
+  } else if (FLAGS_shard_type == "int8") {
+    shardType = FeatureShardType::INT8;
+  } else {
+    LOG(FATAL) << "Unsupported shard type '" << FLAGS_shard_type << "'";
+  }
+
+  fl::lib::audio::FeatureParams featParams(
+      FLAGS_samplerate,
+      FLAGS_framesizems,
+      FLAGS_framestridems,
+      FLAGS_filterbanks,
+      FLAGS_lowfreqfilterbank,
+      FLAGS_highfreqfilterbank,
+      FLAGS_mfcccoeffs,
+      kLifterParam /* lifterparam */,
+      FLAGS_devwin /* delta window */,
+      FLAGS_devwin /* delta-delta window */);
+  featParams.useEnergy = false;
+  featParams.usePower = false;
+  featParams.zeroMeanFrame = false;
+  FeatureType featType =
+      getFeatureType(FLAGS_features_type, FLAGS_channels, featParams).second;
+
+  std::vector<ListFileRow> rows;
+  std::ifstream listFile(FLAGS_list);
+  if (!listFile) {
+    LOG(FATAL) << "Unable to open file -" << FLAGS_list;
+  }
+  std::string line;
+  while (std::getline(listFile, line)) {
+    if (!line.empty()) {
+      rows.push_back(parseListFileRow(line, FLAGS_list));
+    }
+  }
+  // Same order as the batching, so that batches read contiguous samples
+  std::stable_sort(
+      rows.begin(), rows.end(), [](const ListFileRow& l, const ListFileRow& r) {
+        return l.size > r.size;
+      });
+
+  using Features = std::pair<std::vector<float>, af::dim4>;
+  auto featurize = [&featParams, featType](const std::string& handle) {
+    auto info = loadSoundInfo(handle.c_str());
+    auto audio = loadSound<float>(handle.c_str());
+    if (info.channels > 1) {
+      audio = transpose2d(audio, info.frames, info.channels);
+    }
+    af::dim4 dims;
+    auto features =
+        computeFeatures(audio, info.channels, featParams, featType, dims);
+    return Features(std::move(features), dims);
+  };
+
+  int nthread = std::max<int>(FLAGS_nthread, 1);
+  fl::ThreadPool threadPool(nthread);
+  std::ofstream manifest(FLAGS_output);
+  if (!manifest) {
+    LOG(FATAL) << "Unable to open file -" << FLAGS_output;
+  }
+  manifest << kFeatureShardManifestHeader << "\n";
+  for (size_t begin = 0; begin < rows.size(); begin += FLAGS_shard_samples) {
+    auto end = std::min<size_t>(begin + FLAGS_shard_samples, rows.size());
+    auto shardName = basename(FLAGS_output) + "." +
+        std::to_string(begin / FLAGS_shard_samples) + ".flfeat";
+    FeatureShardWriter writer(
+        pathsConcat(dirname(FLAGS_output), shardName), shardType);
+    // Bounded number of samples in flight, written in order
+    std::deque<std::future<Features>> pending;
+    size_t next = begin;
+    for (size_t i = begin; i < end; ++i) {
+      while (next < end && pending.size() < 4 * nthread) {
+        pending.push_back(threadPool.enqueue(featurize, rows[next].input));
+        ++next;
+      }
+      auto features = pending.front().get();
+      pending.pop_front();
+      writer.add(rows[i], features.first, features.second);
+    }
+    writer.close();
+    manifest << shardName << "\n";
+    LOG(INFO) << "Wrote " << end << "/" << rows.size() << " samples";
+  }
+  return 0;
+}
@@ -5,6 +5,12 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
@@ -14,9 +20,11 @@
 #include "flashlight/app/asr/data/Utils.h"
 #include "flashlight/app/asr/runtime/runtime.h"
 #include "flashlight/app/asr/tools/alignment/Utils.h"
+#include "flashlight/ext/common/DistributedUtils.h"
 #include "flashlight/ext/common/SequentialBuilder.h"
 #include "flashlight/ext/common/Serializer.h"
 #include "flashlight/fl/flashlight.h"
+#include "flashlight/lib/common/ProducerConsumerQueue.h"
 #include "flashlight/lib/common/System.h"
 #include "flashlight/lib/text/dictionary/Defines.h"
 #include "flashlight/lib/text/dictionary/Dictionary.h"
@@ -25,6 +33,20 @@ using namespace fl::app::asr;
 using namespace fl::lib;
 using namespace fl::app::asr::alignment;
 
+namespace {
+
+// Score of the padding frames for the tokens out of the final state
+constexpr float kPadFrameScore = -1e6;
+
+// Viterbi path of an utterance, processed by the writer thread
+struct AlignmentUnit {
+  std::string sampleId;
+  std::vector<std::string> path;
+  double timeScale;
+};
+
+} // namespace
+
 int main(int argc, char** argv) {
   std::string exec(argv[0]);
   google::InitGoogleLogging(argv[0]);
@@ -49,6 +71,17 @@ int main(int argc, char** argv) {
     gflags::ReadFromFlagsFile(FLAGS_flagsfile, argv[0], true);
   }
 
+  // Each process aligns a shard of the dataset on its own device
+  if (FLAGS_enable_distributed) {
+    fl::ext::initDistributed(
+        FLAGS_world_rank,
+        FLAGS_world_size,
+        FLAGS_max_devices_per_node,
+        FLAGS_rndv_filepath);
+  }
+  int worldRank = fl::getWorldRank();
+  int worldSize = fl::getWorldSize();
+
   /* ===================== Create Network ===================== */
   std::shared_ptr<fl::Module> network;
   std::shared_ptr<SequenceCriterion> criterion;
@@ -100,9 +133,12 @@ int main(int argc, char** argv) {
   text::DictionaryMap dicts;
   dicts.insert({kTargetIdx, tokenDict});
 
-  std::mutex write_mutex;
+  // Ranks write shards, concatenated by rank 0 at the end
+  auto shardPath = [&alignFilePath](int rank) {
+    return alignFilePath + ".rank" + std::to_string(rank);
+  };
   std::ofstream alignFile;
-  alignFile.open(alignFilePath);
+  alignFile.open(worldSize > 1 ? shardPath(worldRank) : alignFilePath);
   if (!alignFile.is_open() || !alignFile.good()) {
     LOG(FATAL) << "Error opening log file";
   } else {
@@ -121,7 +157,6 @@ int main(int argc, char** argv) {
   LOG(INFO) << "Loaded lexicon";
 
   auto writeLog = [&](const std::string& logStr) {
-    std::lock_guard<std::mutex> lock(write_mutex);
     alignFile << logStr;
     if (FLAGS_show) {
       std::cout << logStr;
@@ -129,8 +164,6 @@ int main(int argc, char** argv) {
   };
 
   /* ===================== Create Dataset ===================== */
-  int worldRank = 0;
-  int worldSize = 1;
   fl::lib::audio::FeatureParams featParams(
       FLAGS_samplerate,
       FLAGS_framesizems,
@@ -174,7 +207,7 @@ int main(int argc, char** argv) {
   auto ds = createDataset(
       {FLAGS_test},
       FLAGS_datadir,
-      1,
+      FLAGS_align_batchsize,
       inputTransform,
       targetTransform,
       wordTransform,
@@ -183,14 +216,32 @@ int main(int argc, char** argv) {
       worldSize);
 
   LOG(INFO) << "[Dataset] Dataset loaded";
+  ds = loadPrefetchDataset(ds, FLAGS_nthread, false /* shuffle */);
 
   auto postprocessFN = getWordSegmenter(criterion);
 
-  int batches = 0;
+  // Segmentation and writing run in their own thread, so that they overlap
+  // with the forward and the Viterbi of the next batches
+  fl::lib::ProducerConsumerQueue<AlignmentUnit> alignmentQueue(
+      std::max(1, FLAGS_align_batchsize) * 16);
+  std::thread writer([&]() {
+    AlignmentUnit unit;
+    while (alignmentQueue.get(unit)) {
+      const std::vector<AlignedWord> segmentation = postprocessFN(
+          unit.path, FLAGS_replabel, FLAGS_framestridems * unit.timeScale);
+      const std::string ctmString = getCTMFormat(segmentation);
+      std::stringstream buffer;
+      buffer << unit.sampleId << "\t" << ctmString << "\n";
+      writeLog(buffer.str());
+    }
+  });
+
+  int samples = 0;
   fl::TimeMeter alignMtr;
   fl::TimeMeter fwdMtr;
   fl::TimeMeter parseMtr;
 
+  bool isCtc = FLAGS_criterion == kCtcCriterion;
   for (auto& sample : *ds) {
     fwdMtr.resume();
     const auto input = fl::input(sample[kInputIdx]);
@@ -198,40 +249,91 @@ int main(int argc, char** argv) {
         input, network, sample[kDurationIdx]);
     fwdMtr.stop();
     alignMtr.resume();
-    auto bestPaths = criterion->viterbiPathWithTarget(
-        rawEmission.array(), sample[kTargetIdx]);
+    af::array emission = rawEmission.array();
+    const af::array& target = sample[kTargetIdx];
+    int T = emission.dims(1);
+    int B = emission.dims(2);
+
+    // Frames of each utterance, in proportion to its number of input frames
+    // as for the padding mask of the forward
+    auto durations = fl::ext::afToVector<float>(sample[kDurationIdx].as(f32));
+    float maxDuration = *std::max_element(durations.begin(), durations.end());
+    std::vector<int> nFrames(B, T);
+    auto targetVec = fl::ext::afToVector<int>(target);
+    int L = target.dims(0);
+    for (int b = 0; b < B && maxDuration > 0; b++) {
+      nFrames[b] = std::min<int>(T, std::ceil(T * durations[b] / maxDuration));
+      if (nFrames[b] == T) {
+        continue;
+      }
+      // Padding frames only score the token of the final state (blank for
+      // CTC, the last target token for ASG), so that the path is aligned
+      // as without padding and stays in that state after the last frame
+      int lastToken = -1;
+      if (isCtc) {
+        lastToken = numClasses - 1;
+      } else {
+        for (int l = 0; l < L && targetVec[b * L + l] != targetpadVal; l++) {
+          lastToken = targetVec[b * L + l];
+        }
+      }
+      if (lastToken >= 0) {
+        auto padFrames = af::seq(nFrames[b], T - 1);
+        emission(af::span, padFrames, b) = kPadFrameScore;
+        emission(lastToken, padFrames, b) = 0;
+      }
+    }
+    auto bestPaths = criterion->viterbiPathWithTarget(emission, target);
     alignMtr.stop();
     parseMtr.resume();
 
-    const double timeScale =
-        static_cast<double>(input.dims(0)) / rawEmission.dims(1);
+    const double timeScale = static_cast<double>(input.dims(0)) / T;
 
-    const std::vector<std::vector<std::string>> tokenPaths =
+    std::vector<std::vector<std::string>> tokenPaths =
         mapIndexToToken(bestPaths, dicts);
     const std::vector<std::string> sampleIdsStr =
         readSampleIds(sample[kSampleIdx]);
 
     for (int b = 0; b < tokenPaths.size(); b++) {
       if (sampleIdsStr.size() > b) {
-        const std::vector<std::string>& path = tokenPaths[b];
-        const std::vector<AlignedWord> segmentation = postprocessFN(
-            path, FLAGS_replabel, FLAGS_framestridems * timeScale);
-        const std::string ctmString = getCTMFormat(segmentation);
-        std::stringstream buffer;
-        buffer << sampleIdsStr[b] << "\t" << ctmString << "\n";
-        writeLog(buffer.str());
+        auto& path = tokenPaths[b];
+        if (path.size() > nFrames[b]) {
+          path.resize(nFrames[b]);
+        }
+        alignmentQueue.add({sampleIdsStr[b], std::move(path), timeScale});
+        if (++samples % 500 == 0) {
+          LOG(INFO) << "Done samples: " << samples;
+        }
       }
     }
     parseMtr.stop();
-    ++batches;
-    if (batches % 500 == 0) {
-      LOG(INFO) << "Done samples: " << batches;
-    }
   }
+  alignmentQueue.finishAdding();
+  writer.join();
 
   LOG(INFO) << "Align time: " << alignMtr.value();
   LOG(INFO) << "Fwd time: " << fwdMtr.value();
   LOG(INFO) << "Parse time: " << parseMtr.value();
   alignFile.close();
+
+  if (worldSize > 1) {
+    fl::barrier();
+    if (worldRank == 0) {
+      LOG(INFO) << "Merging the alignments of " << worldSize << " ranks";
+      std::ofstream mergedFile(alignFilePath);
+      for (int rank = 0; rank < worldSize; rank++) {
+        std::ifstream shardFile(shardPath(rank));
+        if (!shardFile) {
+          LOG(FATAL) << "Error opening alignment shard " << shardPath(rank);
+        }
+        mergedFile << shardFile.rdbuf();
+        shardFile.close();
+        std::remove(shardPath(rank).c_str());
+      }
+      if (!mergedFile) {
+        LOG(FATAL) << "Error writing alignment to " << alignFilePath;
+      }
+    }
+  }
   return 0;
 }
@@ -13,6 +13,7 @@
 
 #include "flashlight/app/asr/common/Defines.h"
 #include "flashlight/app/asr/criterion/criterion.h"
+#include "flashlight/ext/common/Utils-inl.h"
 #include "flashlight/lib/text/dictionary/Dictionary.h"
 
 using namespace fl::app::asr;
@@ -62,11 +63,13 @@ std::vector<std::vector<std::string>> mapIndexToToken(
     fl::lib::text::DictionaryMap dicts) {
   const int B = paths.dims(1);
   const int T = paths.dims(0);
+  // Copied at once, rather than a device read per frame
+  auto pathsVec = fl::ext::afToVector<int>(paths);
   std::vector<std::vector<std::string>> batchTokensPath;
   for (int b = 0; b < B; b++) {
     std::vector<std::string> tokens;
     for (int t = 0; t < T; t++) {
-      int p = paths(t, b).scalar<int>();
+      int p = pathsVec[b * T + t];
       if (p == -1) {
         break;
       }
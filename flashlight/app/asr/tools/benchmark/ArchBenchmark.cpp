@@ -22,6 +22,16 @@ DEFINE_int32(in_features, 80, "Number of input features");
 DEFINE_int32(out_channels, 28, "Number of output channels");
 DEFINE_string(arch, "", "path to architecture file");
 DEFINE_bool(use_amp, false, "Use AMP");
+DEFINE_bool(
+    profile_layers,
+    true,
+    "Print the forward and backward time, FLOPs and memory of each layer");
+DEFINE_double(
+    peak_tflops,
+    0,
+    "Peak TFLOP/s of the device, to report the fraction of the roofline "
+    "achieved by each layer (with --peak_gbps)");
+DEFINE_double(peak_gbps, 0, "Peak memory bandwidth of the device in GB/s");
 
 namespace {
 
@@ -32,7 +42,8 @@ float run(
     bool useAmp,
     bool runBwd,
     int numIters,
-    bool usePlugin) {
+    bool usePlugin,
+    fl::ModuleProfiler* profiler = nullptr) {
   input.setCalcGrad(false);
   network->eval();
   if (useAmp) {
@@ -56,17 +67,26 @@ float run(
     }
     if (runBwd) {
       output.backward();
+      if (profiler) {
+        profiler->endBackward();
+      }
     }
   };
   // warmup
   for (int i = 0; i < 3; ++i) {
     benchmarkFunc();
   }
+  if (profiler) {
+    profiler->start();
+  }
   auto t1 = std::chrono::high_resolution_clock::now();
   for (int i = 0; i < numIters; ++i) {
     benchmarkFunc();
   }
   auto t2 = std::chrono::high_resolution_clock::now();
+  if (profiler) {
+    profiler->stop();
+  }
   return std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1)
              .count() /
       numIters;
@@ -118,5 +138,20 @@ int main(int argc, char** argv) {
                    usePlugin)
             << " msec" << std::endl;
 
+  if (FLAGS_profile_layers) {
+    // Synchronizes around each layer, slower than the runs above
+    fl::ModuleProfiler profiler;
+    run(network,
+        input,
+        duration,
+        FLAGS_use_amp /* useAmp */,
+        true /* runBwd */,
+        FLAGS_num_iters,
+        usePlugin,
+        &profiler);
+    std::cout << "Layers (Fwd+Bwd, per call):" << std::endl
+              << profiler.table(FLAGS_peak_tflops, FLAGS_peak_gbps);
+  }
+
   return 0;
 }
@@ -0,0 +1,438 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Measures the throughput of the training input pipeline of fl_asr_train,
+ * built from the same flags:
+ *   fl_asr_data_benchmark --flagsfile=train.cfg --benchmark_nthreads=1,4,8
+ * The stages of the samples (read, decode, augment, featurize, h2d, batch)
+ * are first timed one after the other on a few rows of the first training
+ * list. The whole pipeline (createDataset() and loadPrefetchDataset()) is then
+ * iterated with each number of threads. Results are written as JSON lines.
+ *
+ * On CPU hosts, the split of the cores between the computation and the
+ * prefetching threads (see `fl::ThreadBudget`, --thread_budget of fl_asr_train)
+ * is found by training the network on the batches with each split:
+ *   fl_asr_data_benchmark --flagsfile=train.cfg --benchmark_train
+ *     --benchmark_thread_splits=28:4,24:8,16:16
+ * The split of the most samples per second is written last.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "flashlight/app/asr/augmentation/SoundEffectConfig.h"
+#include "flashlight/app/asr/common/Defines.h"
+#include "flashlight/app/asr/common/Flags.h"
+#include "flashlight/app/asr/data/FeatureTransforms.h"
+#include "flashlight/app/asr/data/ListFileIndex.h"
+#include "flashlight/app/asr/data/Sound.h"
+#include "flashlight/app/asr/data/Utils.h"
+#include "flashlight/app/asr/runtime/runtime.h"
+#include "flashlight/ext/common/SequentialBuilder.h"
+#include "flashlight/ext/plugin/ModulePlugin.h"
+#include "flashlight/fl/flashlight.h"
+#include "flashlight/lib/common/String.h"
+#include "flashlight/lib/common/System.h"
+#include "flashlight/lib/text/dictionary/Dictionary.h"
+#include "flashlight/lib/text/dictionary/Utils.h"
+
+namespace {
+
+DEFINE_string(
+    benchmark_nthreads,
+    "1,4,8",
+    "Numbers of prefetch threads with which the pipeline is iterated");
+DEFINE_int64(
+    benchmark_batches,
+    100,
+    "Number of batches iterated for each number of threads, 0 for an epoch");
+DEFINE_int64(
+    benchmark_stage_samples,
+    100,
+    "Number of samples whose stages are timed, 0 to skip the stages");
+DEFINE_string(
+    benchmark_thread_splits,
+    "",
+    "Comma-separated compute:prefetch thread splits of the CPUs (e.g. 24:8,16:16), each set with fl::setThreadBudget() to iterate the pipeline, instead of --benchmark_nthreads");
+DEFINE_bool(
+    benchmark_train,
+    false,
+    "Trains the --arch network on the batches of the pipeline (forward and backward of the sum of its output), so that the computation competes with the prefetching threads");
+DEFINE_string(
+    benchmark_output,
+    "",
+    "File to which the JSON lines are written, stdout if empty");
+
+using Clock = std::chrono::high_resolution_clock;
+
+double elapsedMs(const Clock::time_point& start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+double percentile(std::vector<double> values, double p) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  return values[std::min<size_t>(p * values.size(), values.size() - 1)];
+}
+
+struct StageTimes {
+  std::vector<double> ms;
+  int64_t bytes = 0;
+
+  std::string json(const std::string& stage) const {
+    double total = 0;
+    for (auto t : ms) {
+      total += t;
+    }
+    std::ostringstream ss;
+    ss << "{\"benchmark\": \"asr_data\", \"stage\": \"" << stage
+       << "\", \"samples\": " << ms.size()
+       << ", \"mean_ms\": " << (ms.empty() ? 0 : total / ms.size())
+       << ", \"p50_ms\": " << percentile(ms, 0.5)
+       << ", \"p99_ms\": " << percentile(ms, 0.99)
+       << ", \"bytes_per_sec\": " << (total > 0 ? bytes * 1000. / total : 0)
+       << "}";
+    return ss.str();
+  }
+};
+
+} // namespace
+
+using namespace fl::app::asr;
+using namespace fl::lib;
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+  std::string exec(argv[0]);
+  gflags::SetUsageMessage(
+      "Usage: " + exec + " --flagsfile=<training flags> [--benchmark_*]");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  if (FLAGS_train.empty()) {
+    LOG(FATAL) << gflags::ProgramUsage();
+  }
+  fl::init();
+
+  std::ofstream outputFile;
+  if (!FLAGS_benchmark_output.empty()) {
+    outputFile.open(FLAGS_benchmark_output);
+    if (!outputFile) {
+      LOG(FATAL) << "Unable to open file -" << FLAGS_benchmark_output;
+    }
+  }
+  std::ostream& output =
+      FLAGS_benchmark_output.empty() ? std::cout : outputFile;
+
+  /* ===================== Same dataset as fl_asr_train ===================== */
+  fl::lib::text::Dictionary tokenDict(FLAGS_tokens);
+  for (int64_t r = 1; r <= FLAGS_replabel; ++r) {
+    tokenDict.addEntry("<" + std::to_string(r) + ">");
+  }
+  if (FLAGS_criterion == kCtcCriterion) {
+    tokenDict.addEntry(kBlankToken);
+  }
+  bool isSeq2seqCrit = FLAGS_criterion == kSeq2SeqTransformerCriterion ||
+      FLAGS_criterion == kSeq2SeqRNNCriterion;
+  if (isSeq2seqCrit) {
+    tokenDict.addEntry(fl::app::asr::kEosToken);
+    tokenDict.addEntry(fl::lib::text::kPadToken);
+  }
+  fl::lib::text::Dictionary wordDict;
+  fl::lib::text::LexiconMap lexicon;
+  if (!FLAGS_lexicon.empty()) {
+    lexicon = fl::lib::text::loadWords(FLAGS_lexicon, FLAGS_maxword);
+    wordDict = fl::lib::text::createWordDict(lexicon);
+  }
+
+  fl::lib::audio::FeatureParams featParams(
+      FLAGS_samplerate,
+      FLAGS_framesizems,
+      FLAGS_framestridems,
+      FLAGS_filterbanks,
+      FLAGS_lowfreqfilterbank,
+      FLAGS_highfreqfilterbank,
+      FLAGS_mfcccoeffs,
+      kLifterParam /* lifterparam */,
+      FLAGS_devwin /* delta window */,
+      FLAGS_devwin /* delta-delta window */);
+  featParams.useEnergy = false;
+  featParams.usePower = false;
+  featParams.zeroMeanFrame = false;
+  auto featureRes =
+      getFeatureType(FLAGS_features_type, FLAGS_channels, featParams);
+  FeatureType featType = featureRes.second;
+  TargetGenerationConfig targetGenConfig(
+      FLAGS_wordseparator,
+      FLAGS_sampletarget,
+      FLAGS_criterion,
+      FLAGS_surround,
+      isSeq2seqCrit,
+      FLAGS_replabel,
+      true /* skip unk */,
+      FLAGS_usewordpiece /* fallback2LetterWordSepLeft */,
+      !FLAGS_usewordpiece /* fallback2LetterWordSepLeft */);
+  const auto sfxConf = (FLAGS_sfx_config.empty())
+      ? std::vector<sfx::SoundEffectConfig>()
+      : sfx::readSoundEffectConfigFile(FLAGS_sfx_config);
+  std::pair<int, int> localNormCtx{
+      FLAGS_localnrmlleftctx, FLAGS_localnrmlrightctx};
+  auto inputTransform = inputFeatures(
+      featParams,
+      featType,
+      localNormCtx,
+      sfxConf,
+      0 /* sfxStartUpdate */,
+      FLAGS_features_on_device);
+  int targetpadVal = isSeq2seqCrit
+      ? tokenDict.getIndex(fl::lib::text::kPadToken)
+      : kTargetPadValue;
+  std::vector<std::string> trainSplits = fl::lib::split(",", FLAGS_train, true);
+
+  /* ============================ Stages ============================ */
+  if (FLAGS_benchmark_stage_samples > 0) {
+    auto listPath = pathsConcat(FLAGS_datadir, trainSplits.front());
+    std::ifstream listFile(listPath);
+    if (!listFile) {
+      LOG(FATAL) << "Unable to open file -" << listPath;
+    }
+    // Without sound effects, which are timed on their own
+    auto featurizeOnDevice = inputFeatures(
+        featParams, featType, localNormCtx, {}, 0, true /* onDevice */);
+    auto soundEffect =
+        sfxConf.empty() ? nullptr : sfx::createSoundEffect(sfxConf);
+    StageTimes read, decode, augment, featurize, h2d, batch;
+    std::vector<af::array> features;
+    size_t numSamples = FLAGS_benchmark_stage_samples;
+    std::string line;
+    while (features.size() < numSamples &&
+           std::getline(listFile, line)) {
+      if (line.empty()) {
+        continue;
+      }
+      auto row = parseListFileRow(line, listPath);
+
+      auto start = Clock::now();
+      std::ifstream audioFile(row.input, std::ios::binary);
+      std::string data(
+          (std::istreambuf_iterator<char>(audioFile)),
+          std::istreambuf_iterator<char>());
+      read.ms.push_back(elapsedMs(start));
+      read.bytes += data.size();
+
+      start = Clock::now();
+      std::istringstream infoStream(data);
+      auto info = loadSoundInfo(infoStream);
+      std::istringstream audioStream(data);
+      auto audio = loadSound<float>(audioStream);
+      if (info.channels > 1) {
+        audio = transpose2d(audio, info.frames, info.channels);
+      }
+      decode.ms.push_back(elapsedMs(start));
+      decode.bytes += audio.size() * sizeof(float);
+
+      if (soundEffect) {
+        start = Clock::now();
+        soundEffect->apply(audio);
+        augment.ms.push_back(elapsedMs(start));
+        augment.bytes += audio.size() * sizeof(float);
+      }
+
+      af::dim4 audioDims(info.frames, info.channels);
+      af::array feat;
+      if (FLAGS_features_on_device) {
+        // The transform uploads the audio itself: `featurize` includes the
+        // upload timed by `h2d`
+        start = Clock::now();
+        auto audioArr = fl::hostToDevice(audioDims, audio.data());
+        audioArr.eval();
+        af::sync();
+        h2d.ms.push_back(elapsedMs(start));
+        h2d.bytes += audioArr.bytes();
+        start = Clock::now();
+        feat = featurizeOnDevice(audio.data(), audioDims, f32);
+        feat.eval();
+        af::sync();
+        featurize.ms.push_back(elapsedMs(start));
+      } else {
+        start = Clock::now();
+        af::dim4 featDims;
+        auto hostFeat = computeFeatures(
+            audio, info.channels, featParams, featType, featDims);
+        hostFeat = normalizeFeatures(hostFeat, featDims, localNormCtx);
+        featurize.ms.push_back(elapsedMs(start));
+        start = Clock::now();
+        feat = fl::hostToDevice(featDims, hostFeat.data());
+        feat.eval();
+        af::sync();
+        h2d.ms.push_back(elapsedMs(start));
+        h2d.bytes += feat.bytes();
+      }
+      featurize.bytes += feat.bytes();
+      features.push_back(feat);
+    }
+
+    // Same padding and layout as the batches of createDataset()
+    for (size_t begin = 0; begin < features.size();
+         begin += FLAGS_batchsize) {
+      std::vector<af::array> samples(
+          features.begin() + begin,
+          features.begin() +
+              std::min<size_t>(begin + FLAGS_batchsize, features.size()));
+      auto start = Clock::now();
+      auto joined = fl::join(samples, 0, 3);
+      joined.eval();
+      af::sync();
+      batch.ms.push_back(elapsedMs(start));
+      batch.bytes += joined.bytes();
+    }
+
+    output << read.json("read") << "\n" << decode.json("decode") << "\n";
+    if (soundEffect) {
+      output << augment.json("augment") << "\n";
+    }
+    output << featurize.json("featurize") << "\n"
+           << h2d.json("h2d") << "\n"
+           << batch.json("batch") << std::endl;
+  }
+
+  /* =========================== Pipeline =========================== */
+  auto trainds = createDataset(
+      trainSplits,
+      FLAGS_datadir,
+      FLAGS_batchsize,
+      inputTransform,
+      targetFeatures(tokenDict, lexicon, targetGenConfig),
+      wordFeatures(wordDict),
+      std::make_tuple(0, targetpadVal, kTargetPadValue),
+      0 /* worldRank */,
+      1 /* worldSize */,
+      false /* allowEmpty */,
+      FLAGS_batching_strategy,
+      FLAGS_batching_max_duration,
+      FLAGS_batching_num_buckets);
+  std::shared_ptr<fl::Module> network;
+  bool usePlugin = endsWith(FLAGS_arch, ".so");
+  if (FLAGS_benchmark_train) {
+    int numFeatures = featureRes.first;
+    int numClasses = tokenDict.indexSize();
+    if (usePlugin) {
+      network = fl::ext::ModulePlugin(FLAGS_arch).arch(numFeatures, numClasses);
+    } else {
+      network =
+          fl::ext::buildSequentialModule(FLAGS_arch, numFeatures, numClasses);
+    }
+    network->train();
+  }
+  // Forward and backward of a batch
+  auto trainStep = [&](const std::vector<af::array>& sample) {
+    auto input = fl::input(sample[kInputIdx]);
+    fl::Variable output;
+    if (usePlugin) {
+      output =
+          network->forward({input, fl::noGrad(sample[kDurationIdx])}).front();
+    } else {
+      output = fl::ext::forwardSequentialModuleWithPadMask(
+          input, network, sample[kDurationIdx]);
+    }
+    network->zeroGrad();
+    fl::sum(output, {0, 1, 2, 3}).backward();
+    af::sync();
+  };
+
+  // Compute threads (0 without budget) and prefetching threads
+  std::vector<std::pair<int, int>> splits;
+  if (FLAGS_benchmark_thread_splits.empty()) {
+    for (const auto& nthread : split(",", FLAGS_benchmark_nthreads, true)) {
+      splits.emplace_back(0, std::stoi(nthread));
+    }
+  } else {
+    for (const auto& splitStr :
+         split(",", FLAGS_benchmark_thread_splits, true)) {
+      auto threads = split(":", splitStr);
+      if (threads.size() != 2) {
+        LOG(FATAL) << "Invalid thread split " << splitStr;
+      }
+      splits.emplace_back(std::stoi(threads[0]), std::stoi(threads[1]));
+    }
+  }
+  std::pair<int, int> bestSplit;
+  double bestSamplesPerSec = -1;
+  for (const auto& threadSplit : splits) {
+    int nthread = threadSplit.second;
+    if (threadSplit.first > 0) {
+      auto budget = fl::partitionCpus(nthread, 0, threadSplit.first);
+      fl::setThreadBudget(budget);
+      LOG(INFO) << "Thread budget: " << budget.prettyString();
+    }
+    auto prefetchds = loadPrefetchDataset(
+        trainds,
+        nthread,
+        true /* shuffle */,
+        0 /* seed */,
+        FLAGS_prefetch_reorder_window);
+    int64_t numBatches = FLAGS_benchmark_batches > 0
+        ? std::min(FLAGS_benchmark_batches, prefetchds->size())
+        : prefetchds->size();
+    // The first batch, which waits for the threads to start, isn't timed
+    std::vector<double> batchMs;
+    int64_t samples = 0, bytes = 0;
+    Clock::time_point start, batchStart;
+    for (int64_t i = 0; i < numBatches; ++i) {
+      auto sample = prefetchds->get(i);
+      af::sync();
+      if (network) {
+        trainStep(sample);
+      }
+      if (i == 0) {
+        start = Clock::now();
+      } else {
+        batchMs.push_back(elapsedMs(batchStart));
+        samples += sample[kInputIdx].dims(3);
+        bytes += sample[kInputIdx].bytes();
+      }
+      batchStart = Clock::now();
+    }
+    double totalMs = numBatches > 1 ? elapsedMs(start) : 0;
+    double samplesPerSec = totalMs > 0 ? samples * 1000. / totalMs : 0;
+    if (samplesPerSec > bestSamplesPerSec) {
+      bestSamplesPerSec = samplesPerSec;
+      bestSplit = threadSplit;
+    }
+    output << "{\"benchmark\": \"asr_data\", \"stage\": \"pipeline\""
+           << ", \"compute_threads\": " << threadSplit.first
+           << ", \"nthread\": " << nthread << ", \"train\": "
+           << (network ? "true" : "false")
+           << ", \"batches\": " << batchMs.size()
+           << ", \"samples\": " << samples
+           << ", \"samples_per_sec\": " << samplesPerSec
+           << ", \"bytes_per_sec\": "
+           << (totalMs > 0 ? bytes * 1000. / totalMs : 0)
+           << ", \"batch_p50_ms\": " << percentile(batchMs, 0.5)
+           << ", \"batch_p99_ms\": " << percentile(batchMs, 0.99) << "}"
+           << std::endl;
+  }
+  if (splits.size() > 1) {
+    output << "{\"benchmark\": \"asr_data\", \"stage\": \"best_split\""
+           << ", \"compute_threads\": " << bestSplit.first
+           << ", \"nthread\": " << bestSplit.second
+           << ", \"samples_per_sec\": " << bestSamplesPerSec << "}"
+           << std::endl;
+  }
+  return 0;
+}
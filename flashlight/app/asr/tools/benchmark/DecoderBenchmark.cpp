@@ -0,0 +1,631 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Measures the throughput of the beam-search decoders of fl_asr_decode,
+ * built from the same flags:
+ *   fl_asr_decoder_benchmark --flagsfile=decode.cfg
+ *       --benchmark_beamsizes=50,500 --benchmark_nthreads=1,8
+ *       [--emission_cache=dev.emissions]
+ * Utterances are replayed from the emission cache written by fl_asr_decode,
+ * or generated as peaky distributions over the spellings of random words of
+ * the lexicon (or random tokens without a lexicon). Each decoder is run with
+ * each beam size and number of threads, the utterances being split among
+ * the threads, and reports the real-time factor, the hypotheses extended per
+ * second, and the heap allocations and LM queries per frame as JSON lines.
+ *
+ * The seq2seq decoders need a seq2seq --criterion: their acoustic model is
+ * replaced by one returning the i-th frame of the emissions at the i-th
+ * output step, whose allocations are not counted.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "flashlight/app/asr/common/Defines.h"
+#include "flashlight/app/asr/common/Flags.h"
+#include "flashlight/app/asr/decoder/DecodeUtils.h"
+#include "flashlight/app/asr/decoder/Defines.h"
+#include "flashlight/app/asr/decoder/EmissionCache.h"
+#include "flashlight/lib/common/String.h"
+#include "flashlight/lib/common/System.h"
+#include "flashlight/lib/text/decoder/FlatTrie.h"
+#include "flashlight/lib/text/decoder/LexiconDecoder.h"
+#include "flashlight/lib/text/decoder/LexiconFreeDecoder.h"
+#include "flashlight/lib/text/decoder/LexiconFreeSeq2SeqDecoder.h"
+#include "flashlight/lib/text/decoder/LexiconSeq2SeqDecoder.h"
+#include "flashlight/lib/text/decoder/lm/KenLM.h"
+#include "flashlight/lib/text/decoder/lm/ZeroLM.h"
+#include "flashlight/lib/text/dictionary/Dictionary.h"
+#include "flashlight/lib/text/dictionary/Utils.h"
+
+namespace {
+
+// Heap allocations of the calling thread while counting. Trivially
+// initialized, so that operator new can use it at any time.
+thread_local int64_t tlsAllocations = 0;
+thread_local bool tlsCountAllocations = false;
+
+} // namespace
+
+void* operator new(std::size_t size) {
+  if (tlsCountAllocations) {
+    ++tlsAllocations;
+  }
+  if (void* ptr = std::malloc(size > 0 ? size : 1)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t /* size */) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t /* size */) noexcept {
+  std::free(ptr);
+}
+
+namespace {
+
+DEFINE_string(
+    benchmark_decoders,
+    "",
+    "Decoders run, among lexicon, lexiconfree, lexiconseq2seq and "
+    "lexiconfreeseq2seq. Defaults to those of --criterion");
+DEFINE_string(
+    benchmark_beamsizes,
+    "50,500",
+    "Beam sizes with which each decoder is run");
+DEFINE_string(
+    benchmark_nthreads,
+    "1,8",
+    "Numbers of decoder threads with which each decoder is run");
+DEFINE_int64(
+    benchmark_utterances,
+    200,
+    "Number of utterances decoded, read from --emission_cache if set, "
+    "synthetic otherwise");
+DEFINE_int64(
+    benchmark_words,
+    20,
+    "Number of words of the synthetic utterances");
+DEFINE_double(
+    benchmark_peak,
+    0.9,
+    "Probability of the emitted token in each frame of the synthetic "
+    "utterances");
+DEFINE_double(
+    benchmark_frame_ms,
+    40,
+    "Duration of a frame of the emissions, for the real-time factor");
+DEFINE_string(
+    benchmark_output,
+    "",
+    "File to which the JSON lines are written, stdout if empty");
+
+using Clock = std::chrono::high_resolution_clock;
+using namespace fl::lib::text;
+
+/**
+ * Counts the queries to the LM it wraps. KenLM is shared by the threads as in
+ * fl_asr_decode, hence the atomic counter.
+ */
+class CountingLM : public LM {
+ public:
+  explicit CountingLM(LMPtr lm) : lm_(std::move(lm)) {}
+
+  LMStatePtr start(bool startWithNothing) override {
+    return lm_->start(startWithNothing);
+  }
+
+  std::pair<LMStatePtr, float> score(
+      const LMStatePtr& state,
+      const int usrTokenIdx) override {
+    queries_.fetch_add(1, std::memory_order_relaxed);
+    return lm_->score(state, usrTokenIdx);
+  }
+
+  std::vector<std::pair<LMStatePtr, float>> scoreBatch(
+      const std::vector<LMQuery>& queries) override {
+    queries_.fetch_add(queries.size(), std::memory_order_relaxed);
+    return lm_->scoreBatch(queries);
+  }
+
+  std::pair<LMStatePtr, float> finish(const LMStatePtr& state) override {
+    queries_.fetch_add(1, std::memory_order_relaxed);
+    return lm_->finish(state);
+  }
+
+  void updateCache(std::vector<LMStatePtr> states) override {
+    lm_->updateCache(std::move(states));
+  }
+
+  int64_t queries() const {
+    return queries_.load();
+  }
+
+  void reset() {
+    queries_.store(0);
+  }
+
+ private:
+  LMPtr lm_;
+  std::atomic<int64_t> queries_{0};
+};
+
+struct Components {
+  Dictionary tokenDict;
+  Dictionary wordDict;
+  LexiconMap lexicon;
+  std::shared_ptr<CountingLM> lm;
+  FlatTriePtr flatTrie;
+  CriterionType criterionType;
+  int silIdx = -1;
+  int blankIdx = -1;
+  int unkWordIdx = -1;
+  int eosIdx = -1;
+};
+
+struct Counters {
+  int64_t frames = 0;
+  int64_t hypotheses = 0;
+  int64_t allocations = 0;
+};
+
+/**
+ * A log-softmax distribution peaked on `token` with probability
+ * FLAGS_benchmark_peak, the others being noisy.
+ */
+void peakyFrame(float* frame, int N, int token, std::mt19937& rng) {
+  std::normal_distribution<float> noise(0, 1);
+  double rest = 0;
+  std::vector<double> probs(N);
+  for (int n = 0; n < N; ++n) {
+    probs[n] = n == token ? 0 : std::exp(noise(rng));
+    rest += probs[n];
+  }
+  for (int n = 0; n < N; ++n) {
+    double p = n == token ? FLAGS_benchmark_peak
+                          : (1 - FLAGS_benchmark_peak) * probs[n] / rest;
+    frame[n] = std::log(std::max(p, 1e-30));
+  }
+}
+
+std::vector<fl::app::asr::EmissionUnit> syntheticUtterances(
+    const Components& c) {
+  std::vector<std::vector<int>> spellings;
+  for (const auto& word : c.lexicon) {
+    auto tokens = fl::app::asr::tkn2Idx(
+        word.second.front(), c.tokenDict, FLAGS_replabel);
+    if (!tokens.empty()) {
+      spellings.push_back(std::move(tokens));
+    }
+  }
+  int N = c.tokenDict.indexSize();
+  // Tokens which can be emitted without a lexicon
+  int nTokens = N;
+  if (c.blankIdx >= 0) {
+    nTokens = std::min(nTokens, c.blankIdx);
+  }
+  if (c.eosIdx >= 0) {
+    nTokens = std::min(nTokens, c.eosIdx);
+  }
+
+  std::mt19937 rng(0);
+  std::vector<fl::app::asr::EmissionUnit> utterances;
+  for (int64_t u = 0; u < FLAGS_benchmark_utterances; ++u) {
+    std::vector<int> path;
+    for (int64_t w = 0; w < FLAGS_benchmark_words; ++w) {
+      if (spellings.empty()) {
+        path.push_back(rng() % nTokens);
+        continue;
+      }
+      for (int token : spellings[rng() % spellings.size()]) {
+        if (c.blankIdx >= 0) {
+          // CTC: tokens are separated by blanks
+          path.push_back(c.blankIdx);
+          path.push_back(token);
+        } else if (c.eosIdx >= 0) {
+          path.push_back(token);
+        } else {
+          // ASG: tokens last for several frames
+          path.push_back(token);
+          path.push_back(token);
+        }
+      }
+    }
+    if (c.eosIdx >= 0) {
+      path.push_back(c.eosIdx);
+    }
+
+    fl::app::asr::EmissionUnit unit;
+    unit.sampleId = std::to_string(u);
+    unit.nFrames = path.size();
+    unit.nTokens = N;
+    unit.emission.resize(unit.nFrames * N);
+    for (int t = 0; t < unit.nFrames; ++t) {
+      peakyFrame(unit.emission.data() + t * N, N, path[t], rng);
+    }
+    utterances.push_back(std::move(unit));
+  }
+  return utterances;
+}
+
+// Steps the decoder frame by frame to count the hypotheses of each frame
+template <typename T>
+void decodeFrames(
+    T& decoder,
+    const fl::app::asr::EmissionUnit& unit,
+    Counters& counters) {
+  decoder.decodeBegin();
+  for (int t = 0; t < unit.nFrames; ++t) {
+    decoder.decodeStep(
+        unit.emission.data() + t * unit.nTokens, 1, unit.nTokens);
+    counters.hypotheses += decoder.nHypothesis();
+  }
+  decoder.decodeEnd();
+  decoder.getAllFinalHypothesis();
+}
+
+AMUpdateFunc replayAmUpdateFunc(Counters& counters) {
+  auto amState = std::make_shared<int>(0);
+  return [&counters, amState](
+             const float* emissions,
+             const int N,
+             const int T,
+             const std::vector<int>& rawY,
+             const std::vector<AMStatePtr>& /* rawPrevStates */,
+             int& t) {
+    tlsCountAllocations = false;
+    counters.hypotheses += rawY.size();
+    const float* frame = emissions + std::min(t, T - 1) * N;
+    std::vector<std::vector<float>> scores(
+        rawY.size(), std::vector<float>(frame, frame + N));
+    std::vector<AMStatePtr> states(rawY.size(), amState);
+    tlsCountAllocations = true;
+    return std::make_pair(std::move(scores), std::move(states));
+  };
+}
+
+void decodeUtterances(
+    const std::string& decoderType,
+    int beamSize,
+    int maxFrames,
+    const Components& c,
+    const std::vector<fl::app::asr::EmissionUnit>& utterances,
+    size_t begin,
+    size_t stride,
+    Counters& counters) {
+  bool isLmToken = FLAGS_decodertype == "tkn";
+  const std::vector<float> transitions;
+  std::unique_ptr<LexiconDecoder> lexiconDecoder;
+  std::unique_ptr<LexiconFreeDecoder> lexiconFreeDecoder;
+  std::unique_ptr<Decoder> seq2seqDecoder;
+  if (decoderType == "lexicon") {
+    lexiconDecoder = std::make_unique<LexiconDecoder>(
+        LexiconDecoderOptions{.beamSize = beamSize,
+                              .beamSizeToken = FLAGS_beamsizetoken,
+                              .beamThreshold = FLAGS_beamthreshold,
+                              .lmWeight = FLAGS_lmweight,
+                              .wordScore = FLAGS_wordscore,
+                              .unkScore = FLAGS_unkscore,
+                              .silScore = FLAGS_silscore,
+                              .logAdd = FLAGS_logadd,
+                              .criterionType = c.criterionType,
+                              .hashMerge = FLAGS_hashmerge,
+                              .blankSkipThreshold = FLAGS_blankskipthreshold,
+                              .lmLookaheadWords = FLAGS_lmlookaheadwords,
+                              .lmLookaheadCacheSize = FLAGS_lmlookaheadcache,
+                              .adaptiveBeam =
+                                  {.targetCandidates =
+                                       FLAGS_adaptivebeamcandidates,
+                                   .frameTimeBudget =
+                                       FLAGS_adaptivebeamframetime / 1000,
+                                   .minThreshold =
+                                       FLAGS_adaptivebeamminthreshold}},
+        c.flatTrie,
+        c.lm,
+        c.silIdx,
+        c.blankIdx,
+        c.unkWordIdx,
+        transitions,
+        isLmToken);
+  } else if (decoderType == "lexiconfree") {
+    lexiconFreeDecoder = std::make_unique<LexiconFreeDecoder>(
+        LexiconFreeDecoderOptions{.beamSize = beamSize,
+                                  .beamSizeToken = FLAGS_beamsizetoken,
+                                  .beamThreshold = FLAGS_beamthreshold,
+                                  .lmWeight = FLAGS_lmweight,
+                                  .silScore = FLAGS_silscore,
+                                  .logAdd = FLAGS_logadd,
+                                  .criterionType = c.criterionType,
+                                  .hashMerge = FLAGS_hashmerge},
+        c.lm,
+        c.silIdx,
+        c.blankIdx,
+        transitions);
+  } else if (decoderType == "lexiconseq2seq") {
+    seq2seqDecoder = std::make_unique<LexiconSeq2SeqDecoder>(
+        LexiconSeq2SeqDecoderOptions{.beamSize = beamSize,
+                                     .beamSizeToken = FLAGS_beamsizetoken,
+                                     .beamThreshold = FLAGS_beamthreshold,
+                                     .lmWeight = FLAGS_lmweight,
+                                     .wordScore = FLAGS_wordscore,
+                                     .eosScore = FLAGS_eosscore,
+                                     .logAdd = FLAGS_logadd,
+                                     .hashMerge = FLAGS_hashmerge},
+        c.flatTrie,
+        c.lm,
+        c.eosIdx,
+        replayAmUpdateFunc(counters),
+        maxFrames,
+        isLmToken);
+  } else {
+    seq2seqDecoder = std::make_unique<LexiconFreeSeq2SeqDecoder>(
+        LexiconFreeSeq2SeqDecoderOptions{.beamSize = beamSize,
+                                         .beamSizeToken = FLAGS_beamsizetoken,
+                                         .beamThreshold = FLAGS_beamthreshold,
+                                         .lmWeight = FLAGS_lmweight,
+                                         .eosScore = FLAGS_eosscore,
+                                         .logAdd = FLAGS_logadd,
+                                         .hashMerge = FLAGS_hashmerge},
+        c.lm,
+        c.eosIdx,
+        replayAmUpdateFunc(counters),
+        maxFrames);
+  }
+
+  int64_t allocations = tlsAllocations;
+  tlsCountAllocations = true;
+  for (size_t i = begin; i < utterances.size(); i += stride) {
+    const auto& unit = utterances[i];
+    if (lexiconDecoder) {
+      decodeFrames(*lexiconDecoder, unit, counters);
+    } else if (lexiconFreeDecoder) {
+      decodeFrames(*lexiconFreeDecoder, unit, counters);
+    } else {
+      seq2seqDecoder->decode(unit.emission.data(), unit.nFrames, unit.nTokens);
+    }
+    counters.frames += unit.nFrames;
+  }
+  tlsCountAllocations = false;
+  counters.allocations = tlsAllocations - allocations;
+}
+
+std::vector<int> toInts(const std::string& list) {
+  std::vector<int> values;
+  for (const auto& value : fl::lib::split(",", list, true)) {
+    values.push_back(std::stoi(value));
+  }
+  return values;
+}
+
+} // namespace
+
+using namespace fl::app::asr;
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+  std::string exec(argv[0]);
+  gflags::SetUsageMessage(
+      "Usage: " + exec + " --flagsfile=<decoding flags> [--benchmark_*]");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  if (FLAGS_tokens.empty()) {
+    LOG(FATAL) << gflags::ProgramUsage();
+  }
+
+  std::ofstream outputFile;
+  if (!FLAGS_benchmark_output.empty()) {
+    outputFile.open(FLAGS_benchmark_output);
+    if (!outputFile) {
+      LOG(FATAL) << "Unable to open file -" << FLAGS_benchmark_output;
+    }
+  }
+  std::ostream& output =
+      FLAGS_benchmark_output.empty() ? std::cout : outputFile;
+
+  /* ================ Same components as fl_asr_decode ================ */
+  Components c;
+  c.tokenDict = Dictionary(FLAGS_tokens);
+  for (int64_t r = 1; r <= FLAGS_replabel; ++r) {
+    c.tokenDict.addEntry("<" + std::to_string(r) + ">");
+  }
+  if (FLAGS_criterion == kCtcCriterion) {
+    c.tokenDict.addEntry(kBlankToken);
+  }
+  bool isSeq2seqCrit = FLAGS_criterion == kSeq2SeqTransformerCriterion ||
+      FLAGS_criterion == kSeq2SeqRNNCriterion;
+  if (isSeq2seqCrit) {
+    c.tokenDict.addEntry(fl::app::asr::kEosToken);
+    c.tokenDict.addEntry(fl::lib::text::kPadToken);
+  }
+  c.criterionType = CriterionType::ASG;
+  if (FLAGS_criterion == kCtcCriterion) {
+    c.criterionType = CriterionType::CTC;
+    c.blankIdx = c.tokenDict.getIndex(kBlankToken);
+  } else if (isSeq2seqCrit) {
+    c.criterionType = CriterionType::S2S;
+    c.eosIdx = c.tokenDict.getIndex(fl::app::asr::kEosToken);
+  }
+  if (!FLAGS_wordseparator.empty()) {
+    c.silIdx = c.tokenDict.getIndex(FLAGS_wordseparator);
+  }
+  if (!FLAGS_lexicon.empty()) {
+    c.lexicon = loadWords(FLAGS_lexicon, FLAGS_maxword);
+    c.wordDict = createWordDict(c.lexicon);
+  }
+
+  Dictionary usrDict = c.tokenDict;
+  if (!FLAGS_lm.empty() && FLAGS_decodertype == "wrd") {
+    usrDict = c.wordDict;
+    c.unkWordIdx = c.wordDict.getIndex(kUnkToken);
+  }
+  LMPtr lm = std::make_shared<ZeroLM>();
+  if (!FLAGS_lm.empty()) {
+    if (FLAGS_lmtype != "kenlm") {
+      LOG(FATAL) << "Only KenLM is benchmarked, not " << FLAGS_lmtype;
+    }
+    auto kenLm = std::make_shared<KenLM>(
+        FLAGS_lm,
+        usrDict,
+        kenLMOptions(FLAGS_lm_load_method, FLAGS_lm_prefetch_mb));
+    if (FLAGS_lm_cache_size > 0) {
+      kenLm->setScoreCache(KenLM::createScoreCache(FLAGS_lm_cache_size));
+    }
+    lm = kenLm;
+  }
+  c.lm = std::make_shared<CountingLM>(lm);
+
+  std::vector<std::string> decoderTypes =
+      fl::lib::split(",", FLAGS_benchmark_decoders, true);
+  if (decoderTypes.empty()) {
+    decoderTypes = isSeq2seqCrit
+        ? std::vector<std::string>{"lexiconseq2seq", "lexiconfreeseq2seq"}
+        : std::vector<std::string>{"lexicon", "lexiconfree"};
+    if (c.lexicon.empty()) {
+      decoderTypes.erase(decoderTypes.begin());
+    }
+  }
+  for (const auto& type : decoderTypes) {
+    bool lexiconBased = type == "lexicon" || type == "lexiconseq2seq";
+    bool seq2seq = type == "lexiconseq2seq" || type == "lexiconfreeseq2seq";
+    if (!lexiconBased && type != "lexiconfree" && !seq2seq) {
+      LOG(FATAL) << "Unknown decoder: " << type;
+    }
+    if (seq2seq != isSeq2seqCrit) {
+      LOG(FATAL) << "The " << type << " decoder doesn't decode the "
+                 << FLAGS_criterion << " criterion";
+    }
+    if (lexiconBased && c.lexicon.empty()) {
+      LOG(FATAL) << "The " << type << " decoder needs a --lexicon";
+    }
+    if (!lexiconBased && !FLAGS_lm.empty() && FLAGS_decodertype == "wrd") {
+      LOG(FATAL) << "The " << type << " decoder needs a token LM";
+    }
+  }
+  if (!c.lexicon.empty()) {
+    auto trie = buildTrie(
+        FLAGS_decodertype,
+        true /* useLexicon */,
+        c.lm,
+        FLAGS_smearing,
+        c.tokenDict,
+        c.lexicon,
+        c.wordDict,
+        c.silIdx,
+        FLAGS_replabel);
+    c.flatTrie = std::make_shared<FlatTrie>(*trie);
+  }
+
+  /* ===================== Utterances ===================== */
+  std::vector<EmissionUnit> utterances;
+  std::string source = "synthetic";
+  if (!FLAGS_emission_cache.empty()) {
+    source = "recorded";
+    EmissionCacheReader reader(FLAGS_emission_cache);
+    for (int64_t i = 0; i < reader.size() &&
+         (FLAGS_benchmark_utterances <= 0 || i < FLAGS_benchmark_utterances);
+         ++i) {
+      auto unit = reader.get(i).first;
+      if (unit.nTokens != c.tokenDict.indexSize()) {
+        LOG(FATAL) << "Emissions of " << unit.nTokens << " tokens, but "
+                   << c.tokenDict.indexSize() << " tokens in the dictionary";
+      }
+      utterances.push_back(std::move(unit));
+    }
+  } else {
+    utterances = syntheticUtterances(c);
+  }
+  int maxFrames = 0;
+  for (const auto& unit : utterances) {
+    maxFrames = std::max(maxFrames, unit.nFrames);
+  }
+  LOG(INFO) << "Decoding " << utterances.size() << " " << source
+            << " utterances";
+
+  /* ===================== Decoders ===================== */
+  for (const auto& type : decoderTypes) {
+    for (int beamSize : toInts(FLAGS_benchmark_beamsizes)) {
+      for (int nThreads : toInts(FLAGS_benchmark_nthreads)) {
+        c.lm->reset();
+        std::vector<Counters> counters(nThreads);
+        auto start = Clock::now();
+        std::vector<std::thread> threads;
+        for (int tid = 0; tid < nThreads; ++tid) {
+          threads.emplace_back([&, tid]() {
+            decodeUtterances(
+                type,
+                beamSize,
+                maxFrames,
+                c,
+                utterances,
+                tid,
+                nThreads,
+                counters[tid]);
+          });
+        }
+        for (auto& thread : threads) {
+          thread.join();
+        }
+        double seconds =
+            std::chrono::duration<double>(Clock::now() - start).count();
+
+        Counters total;
+        for (const auto& counter : counters) {
+          total.frames += counter.frames;
+          total.hypotheses += counter.hypotheses;
+          total.allocations += counter.allocations;
+        }
+        double frames = std::max<int64_t>(total.frames, 1);
+        double audioSeconds = total.frames * FLAGS_benchmark_frame_ms / 1000;
+        output << "{\"benchmark\": \"asr_decoder\", \"decoder\": \"" << type
+               << "\", \"lm\": \"" << (FLAGS_lm.empty() ? "zerolm" : "kenlm")
+               << "\", \"emissions\": \"" << source
+               << "\", \"beam_size\": " << beamSize
+               << ", \"threads\": " << nThreads
+               << ", \"utterances\": " << utterances.size()
+               << ", \"frames\": " << total.frames
+               << ", \"seconds\": " << seconds << ", \"rtf\": "
+               << (audioSeconds > 0 ? seconds / audioSeconds : 0)
+               << ", \"hypotheses_per_sec\": " << total.hypotheses / seconds
+               << ", \"allocations_per_frame\": "
+               << total.allocations / frames
+               << ", \"lm_queries_per_frame\": " << c.lm->queries() / frames
+               << "}" << std::endl;
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Measures the throughput of the training steps of fl_asr_train on synthetic
+ * batches, built from the same flags:
+ *   fl_asr_train_benchmark --flagsfile=train.cfg --benchmark_steps=100
+ * The network (--arch, e.g. TDS or Conformer) and the ctc or asg criterion are
+ * trained with the optimizers, mixed precision and distributed reduction of
+ * the training, on batches of --batchsize random features of
+ * --benchmark_input_frames frames sampled once: the input pipeline isn't
+ * measured (see fl_asr_data_benchmark). With --enable_distributed, each
+ * process trains on its batches. The throughput, the peak of the device
+ * memory and the time per step of each phase are written as JSON.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "flashlight/app/asr/common/Defines.h"
+#include "flashlight/app/asr/common/Flags.h"
+#include "flashlight/app/asr/criterion/criterion.h"
+#include "flashlight/app/asr/data/FeatureTransforms.h"
+#include "flashlight/app/asr/data/Utils.h"
+#include "flashlight/app/asr/runtime/runtime.h"
+#include "flashlight/ext/common/DistributedUtils.h"
+#include "flashlight/ext/common/SequentialBuilder.h"
+#include "flashlight/ext/common/TrainBenchmark.h"
+#include "flashlight/ext/plugin/ModulePlugin.h"
+#include "flashlight/fl/flashlight.h"
+#include "flashlight/lib/common/String.h"
+#include "flashlight/lib/common/System.h"
+#include "flashlight/lib/text/dictionary/Dictionary.h"
+
+namespace {
+
+DEFINE_int64(benchmark_steps, 100, "Number of timed training steps");
+DEFINE_int64(
+    benchmark_warmup_steps,
+    10,
+    "Untimed steps before the ones of --benchmark_steps");
+DEFINE_int64(
+    benchmark_input_frames,
+    1500,
+    "Number of frames of the synthetic inputs (15 sec with a 10 ms stride)");
+DEFINE_int64(
+    benchmark_target_length,
+    50,
+    "Number of tokens of the synthetic targets");
+DEFINE_string(
+    benchmark_output,
+    "",
+    "File to which the JSON report is written, stdout if empty");
+
+} // namespace
+
+using namespace fl::app::asr;
+using namespace fl::lib;
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+  std::string exec(argv[0]);
+  gflags::SetUsageMessage(
+      "Usage: " + exec + " --flagsfile=<training flags> [--benchmark_*]");
+  gflags::ParseCommandLineFlags(&argc, &argv, false);
+  if (!FLAGS_flagsfile.empty()) {
+    LOG(INFO) << "Reading flags from file " << FLAGS_flagsfile;
+    gflags::ReadFromFlagsFile(FLAGS_flagsfile, argv[0], true);
+    // Re-parse command line flags to override values in the flag file.
+    gflags::ParseCommandLineFlags(&argc, &argv, false);
+  }
+  if (FLAGS_arch.empty() || FLAGS_tokens.empty()) {
+    LOG(FATAL) << gflags::ProgramUsage();
+  }
+  fl::init();
+
+  std::shared_ptr<fl::CoalescingReducer> reducer;
+  if (FLAGS_enable_distributed) {
+    fl::ext::initDistributed(
+        FLAGS_world_rank,
+        FLAGS_world_size,
+        FLAGS_max_devices_per_node,
+        FLAGS_rndv_filepath);
+    reducer = std::make_shared<fl::CoalescingReducer>(1.0, true, true);
+  }
+  const bool isMaster = fl::getWorldRank() == 0;
+
+  /* ================ Same network and criterion as fl_asr_train ============ */
+  fl::lib::text::Dictionary tokenDict(FLAGS_tokens);
+  for (int64_t r = 1; r <= FLAGS_replabel; ++r) {
+    tokenDict.addEntry("<" + std::to_string(r) + ">");
+  }
+  if (FLAGS_criterion == kCtcCriterion) {
+    tokenDict.addEntry(kBlankToken);
+  }
+  const int numClasses = tokenDict.indexSize();
+
+  fl::lib::audio::FeatureParams featParams(
+      FLAGS_samplerate,
+      FLAGS_framesizems,
+      FLAGS_framestridems,
+      FLAGS_filterbanks,
+      FLAGS_lowfreqfilterbank,
+      FLAGS_highfreqfilterbank,
+      FLAGS_mfcccoeffs,
+      kLifterParam /* lifterparam */,
+      FLAGS_devwin /* delta window */,
+      FLAGS_devwin /* delta-delta window */);
+  const int numFeatures =
+      getFeatureType(FLAGS_features_type, FLAGS_channels, featParams).first;
+
+  std::shared_ptr<fl::Module> network;
+  const bool usePlugin = endsWith(FLAGS_arch, ".so");
+  if (usePlugin) {
+    network = fl::ext::ModulePlugin(FLAGS_arch).arch(numFeatures, numClasses);
+  } else {
+    network =
+        fl::ext::buildSequentialModule(FLAGS_arch, numFeatures, numClasses);
+  }
+  auto scalemode = getCriterionScaleMode(FLAGS_onorm, FLAGS_sqnorm);
+  std::shared_ptr<SequenceCriterion> criterion;
+  if (FLAGS_criterion == kCtcCriterion) {
+    criterion = std::make_shared<CTCLoss>(scalemode);
+  } else if (FLAGS_criterion == kAsgCriterion) {
+    criterion =
+        std::make_shared<ASGLoss>(numClasses, scalemode, FLAGS_transdiag);
+  } else {
+    // The seq2seq criteria need targets of the token dictionary
+    LOG(FATAL) << "fl_asr_train_benchmark supports the ctc and asg criteria, "
+               << "not " << FLAGS_criterion;
+  }
+  auto netoptim = initOptimizer(
+      {network}, FLAGS_netoptim, FLAGS_lr, FLAGS_momentum, FLAGS_weightdecay);
+  auto critoptim =
+      initOptimizer({criterion}, FLAGS_critoptim, FLAGS_lrcrit, 0.0, 0.0);
+  fl::broadcastParameters(network);
+  fl::broadcastParameters(criterion);
+  if (reducer) {
+    fl::distributeModuleGrads(network, reducer);
+    fl::distributeModuleGrads(criterion, reducer);
+  }
+  std::vector<fl::Variable> params = network->params();
+  auto critParams = criterion->params();
+  params.insert(params.end(), critParams.begin(), critParams.end());
+  if (FLAGS_fl_amp_use_mixed_precision) {
+    fl::OptimMode::get().setOptimLevel(fl::OptimLevel::O1);
+  }
+  fl::DynamicScaler scaler(
+      FLAGS_fl_amp_scale_factor,
+      std::max<double>(
+          FLAGS_fl_amp_scale_factor, FLAGS_fl_amp_max_scale_factor),
+      std::max<unsigned int>(1, FLAGS_fl_amp_scale_factor_update_interval));
+
+  /* ========================== Synthetic batch =========================== */
+  const int64_t batchSize = FLAGS_batchsize;
+  const int64_t numFrames = FLAGS_benchmark_input_frames;
+  auto input = af::randn(numFrames, numFeatures, 1, batchSize);
+  // Without the blank of ctc, the last token
+  auto target = (af::randu(FLAGS_benchmark_target_length, batchSize) *
+                 (numClasses - 1))
+                    .as(s32);
+  auto duration = af::constant(numFrames, 1, batchSize, s64);
+
+  // The loss is summed over the samples of all the processes, so the
+  // gradients are scaled down by the total batch size
+  const double totalBatchSize = batchSize * fl::getWorldSize();
+  fl::TimeMeter fwdTimer, critFwdTimer, bwdTimer, optimTimer;
+  auto trainStep = [&]() {
+    network->train();
+    criterion->train();
+    netoptim->zeroGrad();
+    critoptim->zeroGrad();
+
+    fwdTimer.resume();
+    fl::Variable output;
+    if (usePlugin) {
+      output =
+          network->forward({fl::input(input), fl::noGrad(duration)}).front();
+    } else {
+      output = fl::ext::forwardSequentialModuleWithPadMask(
+          fl::input(input), network, duration);
+    }
+    af::sync();
+    fwdTimer.stop();
+    critFwdTimer.resume();
+    auto loss = criterion->forward({output, fl::noGrad(target)}).front();
+    af::sync();
+    critFwdTimer.stop();
+
+    bwdTimer.resume();
+    if (FLAGS_fl_amp_use_mixed_precision) {
+      loss = scaler.scale(loss);
+    }
+    loss.backward();
+    if (reducer) {
+      reducer->finalize();
+    }
+    af::sync();
+    bwdTimer.stop();
+
+    optimTimer.resume();
+    if (FLAGS_fl_amp_use_mixed_precision) {
+      // Steps with overflowing gradients are skipped
+      if (!scaler.unscale(params, totalBatchSize)) {
+        optimTimer.stop();
+        return;
+      }
+    } else {
+      for (auto& p : params) {
+        if (p.isGradAvailable()) {
+          p.grad() = p.grad() / totalBatchSize;
+        }
+      }
+    }
+    if (FLAGS_maxgradnorm > 0) {
+      fl::clipGradNormAsync(params, FLAGS_maxgradnorm);
+    }
+    critoptim->step();
+    netoptim->step();
+    af::sync();
+    optimTimer.stop();
+  };
+
+  /* ============================== Steps =============================== */
+  fl::ext::TrainBenchmark benchmark(
+      "asr_train",
+      "frames",
+      FLAGS_benchmark_warmup_steps,
+      FLAGS_benchmark_steps);
+  benchmark.setConfig("arch", FLAGS_arch);
+  benchmark.setConfig("criterion", FLAGS_criterion);
+  benchmark.setConfig("netoptim", FLAGS_netoptim);
+  benchmark.setConfig("batch_size", std::to_string(batchSize));
+  benchmark.setConfig("input_frames", std::to_string(numFrames));
+  benchmark.setConfig("features", std::to_string(numFeatures));
+  benchmark.setConfig("classes", std::to_string(numClasses));
+  benchmark.setConfig(
+      "mixed_precision",
+      FLAGS_fl_amp_use_mixed_precision ? "true" : "false");
+  while (!benchmark.done()) {
+    trainStep();
+    if (benchmark.endStep(batchSize, batchSize * numFrames)) {
+      fwdTimer.reset();
+      critFwdTimer.reset();
+      bwdTimer.reset();
+      optimTimer.reset();
+    }
+  }
+  benchmark.setPhase("forward", fwdTimer.value());
+  benchmark.setPhase("criterion_forward", critFwdTimer.value());
+  benchmark.setPhase("backward", bwdTimer.value());
+  benchmark.setPhase("optimizer", optimTimer.value());
+  auto report = benchmark.report();
+  if (isMaster) {
+    if (FLAGS_benchmark_output.empty()) {
+      std::cout << report << std::endl;
+    } else {
+      auto stream = createOutputStream(FLAGS_benchmark_output);
+      stream << report << std::endl;
+    }
+  }
+  return 0;
+}
@@ -90,6 +90,7 @@ int main(int argc, char** argv) {
 
   af::setSeed(FLAGS_seed);
   fl::DynamicBenchmark::setBenchmarkMode(FLAGS_fl_benchmark_mode);
+  fl::DynamicBenchmark::setCacheFile(FLAGS_fl_benchmark_cache);
 
   std::shared_ptr<fl::Reducer> reducer = nullptr;
   if (FLAGS_enable_distributed) {
@@ -221,6 +222,16 @@ int main(int argc, char** argv) {
       worldSize,
       false // allowEmpty
   );
+  if (FLAGS_dataset_cache_mb > 0) {
+    // Batches are featurized at the first epoch only
+    fl::CacheDatasetOptions cacheOptions;
+    cacheOptions.maxBytes = FLAGS_dataset_cache_mb << 20;
+    if (!FLAGS_dataset_cache_spill_path.empty()) {
+      cacheOptions.spillPath =
+          FLAGS_dataset_cache_spill_path + "." + std::to_string(worldRank);
+    }
+    trainds = std::make_shared<fl::CacheDataset>(trainds, cacheOptions);
+  }
 
   std::map<std::string, std::shared_ptr<fl::Dataset>> validds;
   int64_t validBatchSize =
@@ -471,7 +482,7 @@ int main(int argc, char** argv) {
           FLAGS_saug_tmaskn);
     }
 
-    fl::allReduceParameters(ntwrk);
+    fl::broadcastParameters(ntwrk);
 
     auto resetTimeStatMeters = [&meters]() {
       meters.runtime.reset();
@@ -535,6 +546,13 @@ int main(int argc, char** argv) {
         resetTimeStatMeters();
       }
       std::hash<std::string> hasher;
+      if (auto cache = std::dynamic_pointer_cast<fl::CacheDataset>(trainset)) {
+        auto stats = cache->stats();
+        FL_LOG_MASTER(INFO)
+            << "Dataset cache: hit rate " << stats.hitRate() << ", "
+            << (stats.bytes >> 20) << " MB in memory, "
+            << (stats.spillBytes >> 20) << " MB spilled";
+      }
       FL_LOG_MASTER(INFO) << "Shuffling trainset";
       auto curTrainset = loadPrefetchDataset(
           trainset, FLAGS_nthread, true /* shuffle */, curEpoch /* seed */);
@@ -582,7 +600,9 @@ int main(int argc, char** argv) {
           auto input = fl::input(batch[kInputIdx]);
           if (FLAGS_saug_start_update >= 0 &&
               curBatch >= FLAGS_saug_start_update) {
-            input = saug->forward({input}).front();
+            input =
+                saug->forward({input, fl::noGrad(batch[kDurationIdx])})
+                    .front();
           }
           auto output = fl::ext::forwardSequentialModuleWithPadMask(
               input, ntwrk, batch[kDurationIdx]);
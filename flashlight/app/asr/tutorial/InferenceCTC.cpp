@@ -48,6 +48,19 @@ DEFINE_double(beam_threshold, 100, "Beam-search decoding pruning parameters");
 DEFINE_double(lm_weight, 3, "Beam-search decoding language model weight");
 DEFINE_double(word_score, 0, "Beam-search decoding word addition score");
 DEFINE_int64(sample_rate, 16000, "Sample rate of the input audio");
+DEFINE_int64(
+    chunk_size_ms,
+    0,
+    "Streaming decoding: size of the audio chunks (in ms) fed to the acoustic "
+    "model and the decoder, the words are printed as soon as they are final. "
+    "Chunks are forwarded with the streaming inference of the modules, which "
+    "keeps the context of the previous chunks (e.g. in TDS and Conformer "
+    "blocks). 0 to decode the whole audio at once");
+DEFINE_int32(
+    max_delay,
+    -1,
+    "Streaming decoding: maximum number of emission frames the decoder can "
+    "wait for before finalizing words, -1 for no limit");
 DEFINE_string(
     audio_list,
     "",
@@ -263,36 +276,81 @@ int main(int argc, char** argv) {
     }
     auto audioInfo = fl::app::asr::loadSoundInfo(audioPath.c_str());
     auto audio = fl::app::asr::loadSound<float>(audioPath.c_str());
-    af::array input = inputTransform(
-        static_cast<void*>(audio.data()),
-        af::dim4(audioInfo.channels, audioInfo.frames),
-        af::dtype::f32);
-    auto inputLen = af::constant(input.dims(0), af::dim4(1));
-    auto rawEmission = fl::ext::forwardSequentialModuleWithPadMask(
-        fl::input(input), network, inputLen);
-    auto emission = fl::ext::afToVector<float>(rawEmission);
 
-    const auto& result = decoder.decode(
-        emission.data(),
-        rawEmission.dims(1) /* time */,
-        rawEmission.dims(0) /* ntokens */);
+    // Audio samples are interleaved, `nFrames` is the number of samples per
+    // channel
+    auto computeEmission =
+        [&](float* samples, int64_t nFrames, int& T, int& N) {
+          af::array input = inputTransform(
+              static_cast<void*>(samples),
+              af::dim4(audioInfo.channels, nFrames),
+              af::dtype::f32);
+          auto inputLen = af::constant(input.dims(0), af::dim4(1));
+          auto rawEmission = fl::ext::forwardSequentialModuleWithPadMask(
+              fl::input(input), network, inputLen);
+          T = rawEmission.dims(1);
+          N = rawEmission.dims(0);
+          return fl::ext::afToVector<float>(rawEmission);
+        };
+    auto computeChunkEmission =
+        [&](float* samples, int64_t nFrames, int& T, int& N) {
+          af::array input = inputTransform(
+              static_cast<void*>(samples),
+              af::dim4(audioInfo.channels, nFrames),
+              af::dtype::f32);
+          auto rawEmission =
+              network->forwardChunk({fl::input(input)}).front();
+          if (rawEmission.isempty()) {
+            // The network needs more input
+            T = 0;
+            return std::vector<float>();
+          }
+          T = rawEmission.dims(1);
+          N = rawEmission.dims(0);
+          return fl::ext::afToVector<float>(rawEmission.as(f32));
+        };
+    auto getWords = [&](const fl::lib::text::DecodeResult& result) {
+      auto rawWordPrediction =
+          fl::app::asr::validateIdx(result.words, unkWordIdx);
+      return fl::app::asr::wrdIdx2Wrd(rawWordPrediction, wordDict);
+    };
 
-    // Take top hypothesis and cleanup predictions
-    auto rawWordPrediction = result[0].words;
-    auto rawTokenPrediction = result[0].tokens;
+    std::vector<std::string> wordPrediction;
+    if (FLAGS_chunk_size_ms > 0) {
+      int64_t chunkFrames = FLAGS_sample_rate * FLAGS_chunk_size_ms / 1000;
+      int64_t nFrames = audio.size() / audioInfo.channels;
+      decoder.decodeBegin();
+      network->resetStreamingState();
+      for (int64_t start = 0; start < nFrames; start += chunkFrames) {
+        int T, N;
+        auto emission = computeChunkEmission(
+            audio.data() + start * audioInfo.channels,
+            std::min(chunkFrames, nFrames - start),
+            T,
+            N);
+        if (T == 0) {
+          continue;
+        }
+        auto words = getWords(decoder.decodeChunk(
+            emission.data(), T, N, FLAGS_max_delay));
+        if (!words.empty()) {
+          LOG(INFO) << "[Inference tutorial for CTC]: partial output for "
+                    << audioPath << " ("
+                    << (start * 1000 / FLAGS_sample_rate) << "ms)\n"
+                    << fl::lib::join(" ", words);
+        }
+        wordPrediction.insert(wordPrediction.end(), words.begin(), words.end());
+      }
+      auto words = getWords(decoder.decodeStreamEnd());
+      wordPrediction.insert(wordPrediction.end(), words.begin(), words.end());
+    } else {
+      int T, N;
+      auto emission = computeEmission(audio.data(), audioInfo.frames, T, N);
+      const auto& result = decoder.decode(emission.data(), T, N);
+      // Take top hypothesis and cleanup predictions
+      wordPrediction = getWords(result[0]);
+    }
 
-    auto tokenPrediction = fl::app::asr::tknPrediction2Ltr(
-        rawTokenPrediction,
-        tokenDict,
-        fl::app::asr::kCtcCriterion,
-        networkFlags["surround"],
-        false /* eostoken */,
-        0 /* replabel */,
-        false /* usewordpiece */,
-        networkFlags["wordseparator"]);
-    rawWordPrediction =
-        fl::app::asr::validateIdx(rawWordPrediction, unkWordIdx);
-    auto wordPrediction = fl::app::asr::wrdIdx2Wrd(rawWordPrediction, wordDict);
     auto wordPredictionStr = fl::lib::join(" ", wordPrediction);
     LOG(INFO) << "[Inference tutorial for CTC]: predicted output for "
               << audioPath << "\n"
@@ -46,7 +46,8 @@ std::unordered_map<std::string, uint64_t> getImagenetLabels(
 std::shared_ptr<Dataset> imagenetDataset(
     const std::string& imgDir,
     const std::unordered_map<std::string, uint64_t>& labelMap,
-    std::vector<Dataset::TransformFunction> transformfns) {
+    std::vector<Dataset::TransformFunction> transformfns,
+    const fl::ext::image::JpegDecodeOptions& decodeOptions /* = {} */) {
   std::vector<std::string> filepaths = lib::fileGlob(imgDir + "/**/*.JPEG");
   if (filepaths.empty()) {
     throw std::runtime_error(
@@ -54,7 +55,8 @@ std::shared_ptr<Dataset> imagenetDataset(
   }
 
   // Create image dataset
-  std::shared_ptr<Dataset> imageDataset = fl::ext::image::jpegLoader(filepaths);
+  std::shared_ptr<Dataset> imageDataset =
+      fl::ext::image::jpegLoader(filepaths, decodeOptions);
   imageDataset = std::make_shared<TransformDataset>(imageDataset, transformfns);
 
   // Create labels from filepaths
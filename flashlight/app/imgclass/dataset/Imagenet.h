@@ -63,11 +63,14 @@ std::unordered_map<std::string, uint64_t> getImagenetLabels(
  * std::cout << sample[0].dims() << std::endl; // {224, 224, 3, 1}
  * std::cout << sample[1].dims() << std::endl; // {1, 1, 1, 1}
  *
+ * The jpegs are decoded according to @param[decodeOptions], e.g. with
+ * libjpeg-turbo downscaling them to the size needed by the transforms.
  */
 std::shared_ptr<Dataset> imagenetDataset(
     const std::string& fp,
     const std::unordered_map<std::string, uint64_t>& labelMap,
-    std::vector<Dataset::TransformFunction> transformfns);
+    std::vector<Dataset::TransformFunction> transformfns,
+    const fl::ext::image::JpegDecodeOptions& decodeOptions = {});
 
 constexpr uint64_t kImagenetInputIdx = 0;
 constexpr uint64_t kImagenetTargetIdx = 1;
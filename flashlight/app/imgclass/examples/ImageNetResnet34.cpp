@@ -5,14 +5,20 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <cmath>
+#include <cstdlib>
 #include <exception>
 #include <iomanip>
+#include <iostream>
+#include <memory>
 
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
 #include "flashlight/app/imgclass/dataset/Imagenet.h"
+#include "flashlight/ext/common/BatchBudgetProbe.h"
 #include "flashlight/ext/common/DistributedUtils.h"
+#include "flashlight/ext/common/TrainBenchmark.h"
 #include "flashlight/ext/image/af/Transforms.h"
 #include "flashlight/ext/image/fl/dataset/DistributedDataset.h"
 #include "flashlight/ext/image/fl/models/Resnet.h"
@@ -27,6 +33,27 @@ DEFINE_double(train_momentum, 0.9f, "Momentum");
 
 DEFINE_double(train_wd, 1e-4f, "Weight decay");
 DEFINE_uint64(train_epochs, 50, "Number of epochs to train");
+DEFINE_bool(
+    train_mixed_precision,
+    false,
+    "Train with mixed precision and dynamic loss scaling");
+DEFINE_double(
+    train_amp_scale_factor,
+    4096.,
+    "Initial loss scale factor for mixed precision training");
+DEFINE_bool(
+    train_channels_last,
+    false,
+    "Run the model channels-last (NHWC in cuDNN), faster with mixed precision "
+    "on tensor cores");
+DEFINE_double(
+    train_amp_max_scale_factor,
+    32000.,
+    "Maximum loss scale factor for mixed precision training");
+DEFINE_uint64(
+    train_amp_scale_factor_update_interval,
+    2000,
+    "Number of steps without overflow after which the loss scale is doubled");
 DEFINE_bool(distributed_enable, true, "Enable distributed training");
 DEFINE_int64(
     distributed_max_devices_per_node,
@@ -46,8 +73,52 @@ DEFINE_string(
     "Shared file path used for setting up rendezvous."
     "If empty, uses MPI to initialize.");
 DEFINE_uint64(data_batch_size, 256, "Total batch size across all gpus");
+DEFINE_bool(
+    data_probe_batch_size,
+    false,
+    "Set 'data_batch_size' before training to the largest one which fits in the "
+    "memory of the device with 'data_probe_margin' of headroom, measured with a "
+    "forward and backward of the model");
+DEFINE_double(
+    data_probe_margin,
+    0.1,
+    "Share of the memory of the device left free by 'data_probe_batch_size'");
+DEFINE_bool(
+    data_batch_augmentation,
+    false,
+    "Augment the images of a batch together, instead of one at a time in "
+    "the loader threads");
+DEFINE_string(
+    data_local_cache_dir,
+    "",
+    "If not empty, node-local directory (e.g. on NVMe) where each process "
+    "caches the decoded images of its stable shard of the training set at the "
+    "first epoch, for the next ones. Needs 'data_batch_augmentation'");
+DEFINE_int64(
+    data_reshuffle_epochs,
+    0,
+    "With 'data_local_cache_dir', reshuffle the training set across the "
+    "processes every this many epochs, which clears their caches (0: never)");
+DEFINE_string(
+    data_jpeg_backend,
+    "stb",
+    "Jpeg decoder: stb, turbo (libjpeg-turbo) or nvjpeg (on the device)");
 DEFINE_string(exp_checkpoint_path, "/tmp/model", "Checkpointing prefix path");
 DEFINE_int64(exp_checkpoint_epoch, -1, "Checkpoint epoch to load from");
+DEFINE_int64(
+    benchmark_steps,
+    0,
+    "If positive, measures the throughput of this number of training steps "
+    "on synthetic batches of random images instead of training, and writes "
+    "the report as JSON to 'benchmark_output'");
+DEFINE_int64(
+    benchmark_warmup_steps,
+    10,
+    "Untimed steps before the ones of 'benchmark_steps'");
+DEFINE_string(
+    benchmark_output,
+    "",
+    "File of the JSON report of 'benchmark_steps', stdout if empty");
 
 using namespace fl;
 using fl::ext::image::compose;
@@ -75,8 +146,10 @@ std::tuple<double, double, double> evalLoop(
     // Compute and record the loss.
     auto loss = categoricalCrossEntropy(output, target);
     lossMeter.add(loss.array().scalar<float>());
-    top5Acc.add(output.array(), target.array());
-    top1Acc.add(output.array(), target.array());
+    // Outputs may be f16 in mixed precision
+    auto outputArray = output.array().as(f32);
+    top5Acc.add(outputArray, target.array());
+    top1Acc.add(outputArray, target.array());
   }
   model->train();
   fl::ext::syncMeter(lossMeter);
@@ -145,40 +218,219 @@ int main(int argc, char** argv) {
                fl::ext::image::centerCropTransform(randomCropSize),
                fl::ext::image::normalizeImage(mean, std)});
 
+  // The decoders which support it downscale the images, as long as they
+  // remain larger than after the resize transforms
+  fl::ext::image::JpegDecodeOptions trainDecodeOptions;
+  if (FLAGS_data_jpeg_backend == "turbo") {
+    trainDecodeOptions.backend = fl::ext::image::JpegBackend::Turbo;
+  } else if (FLAGS_data_jpeg_backend == "nvjpeg") {
+    trainDecodeOptions.backend = fl::ext::image::JpegBackend::NvJpeg;
+  } else if (FLAGS_data_jpeg_backend != "stb") {
+    LOG(FATAL) << "Unknown --data_jpeg_backend " << FLAGS_data_jpeg_backend;
+  }
+  auto valDecodeOptions = trainDecodeOptions;
+  trainDecodeOptions.minSize = randomResizeMax;
+  valDecodeOptions.minSize = randomResizeMin;
+
+  // The same augmentations, applied to whole batches of decoded images
+  std::vector<Dataset::BatchFunction> trainBatchFns, valBatchFns;
+  if (FLAGS_data_batch_augmentation) {
+    // As resizing the shortest side between 256 and 480 before the crop
+    auto trainRegion = [=](int w, int h) {
+      const float resize = randomResizeMin +
+          (randomResizeMax - randomResizeMin) *
+              (static_cast<float>(std::rand()) / RAND_MAX);
+      const int side = std::min<int>(
+          std::min(w, h), std::round(std::min(w, h) * randomCropSize / resize));
+      const int x = std::rand() % (w - side + 1);
+      const int y = std::rand() % (h - side + 1);
+      return fl::ext::image::ImageRegion{x, y, side, side};
+    };
+    trainBatchFns = {fl::ext::image::batchAugmentation(
+        randomCropSize, trainRegion, horizontalFlipProb, mean, std)};
+    valBatchFns = {fl::ext::image::batchAugmentation(
+        randomCropSize,
+        fl::ext::image::centerCropRegion(
+            static_cast<float>(randomCropSize) / randomResizeMin),
+        0,
+        mean,
+        std)};
+    // Only decoded by the loader threads
+    trainTransforms = nullptr;
+    valTransforms = nullptr;
+  }
+
+  //////////////////////////
+  //  Load model and optimizer
+  /////////////////////////
+  auto model = fl::ext::image::resnet34(
+      FLAGS_train_channels_last ? fl::ImageLayout::CWHN
+                                : fl::ImageLayout::WHCN);
+  // synchronize parameters of the model so that the parameters in each process
+  // is the same
+  fl::broadcastParameters(model);
+
+  SGDOptimizer opt(
+      model->params(), FLAGS_train_lr, FLAGS_train_momentum, FLAGS_train_wd);
+
+  std::unique_ptr<DynamicScaler> scaler;
+  if (FLAGS_train_mixed_precision) {
+    OptimMode::get().setOptimLevel(OptimLevel::O1);
+    scaler = std::make_unique<DynamicScaler>(
+        FLAGS_train_amp_scale_factor,
+        FLAGS_train_amp_max_scale_factor,
+        FLAGS_train_amp_scale_factor_update_interval);
+  }
+
+  // Before the gradients are distributed: the processes probe alone
+  if (FLAGS_data_probe_batch_size) {
+    // Batches of cropped images, whose size doesn't vary
+    auto probeStep = [&model, randomCropSize](int64_t batchSize) {
+      model->train();
+      auto inputs = noGrad(
+          af::randu(randomCropSize, randomCropSize, 3, batchSize, f32));
+      auto target = noGrad(af::constant(0, batchSize, u64));
+      categoricalCrossEntropy(model->forward(inputs), target).backward();
+      model->zeroGrad();
+    };
+    // Doubled until out of memory
+    const int64_t maxBatchSize = 1 << 16;
+    FLAGS_data_batch_size = fl::ext::findMaxBatchBudget(
+        probeStep, 1, maxBatchSize, FLAGS_data_probe_margin);
+    if (FLAGS_data_batch_size == 0) {
+      LOG(FATAL) << "A single image doesn't fit in the memory of the device";
+    }
+    FL_LOG_MASTER(INFO) << "Probed data_batch_size: " << FLAGS_data_batch_size;
+  }
+
+  // Add a hook to synchronize gradients of model parameters as they are
+  // computed
+  fl::distributeModuleGrads(model, reducer);
+
+  // The phases of the steps are only timed in the benchmark, as they are
+  // synchronized with the device
+  TimeMeter fwdTimer, bwdTimer, optimTimer;
+  // Returns the output and the loss
+  auto trainStep = [&](const Variable& inputs,
+                       const Variable& target,
+                       bool timed) {
+    auto startPhase = [timed](TimeMeter& timer) {
+      if (timed) {
+        timer.resume();
+      }
+    };
+    auto endPhase = [timed](TimeMeter& timer) {
+      if (timed) {
+        af::sync();
+        timer.stop();
+      }
+    };
+    opt.zeroGrad();
+    // Get the activations from the model, and the loss
+    startPhase(fwdTimer);
+    auto output = model->forward(inputs);
+    auto loss = categoricalCrossEntropy(output, target);
+    endPhase(fwdTimer);
+
+    // Backprop, update the weights and then zero the gradients.
+    startPhase(bwdTimer);
+    auto scaledLoss = scaler ? scaler->scale(loss) : loss;
+    scaledLoss.backward();
+    if (FLAGS_distributed_enable) {
+      reducer->finalize();
+    }
+    endPhase(bwdTimer);
+    // Steps with overflowing gradients are skipped
+    startPhase(optimTimer);
+    if (!scaler || scaler->unscale(model->params())) {
+      opt.step();
+    }
+    endPhase(optimTimer);
+    return std::make_pair(output, loss);
+  };
+
+  if (FLAGS_benchmark_steps > 0) {
+    // Batches of cropped images, as in the probe, sampled once
+    auto inputs = noGrad(af::randu(
+        randomCropSize, randomCropSize, 3, FLAGS_data_batch_size, f32));
+    // Over the 1000 classes of the model
+    auto target =
+        noGrad((af::randu(FLAGS_data_batch_size) * 1000).as(u64));
+    const int64_t numPixels = randomCropSize * randomCropSize;
+    fl::ext::TrainBenchmark benchmark(
+        "imgclass_train",
+        "pixels",
+        FLAGS_benchmark_warmup_steps,
+        FLAGS_benchmark_steps);
+    benchmark.setConfig("arch", "resnet34");
+    benchmark.setConfig("batch_size", std::to_string(FLAGS_data_batch_size));
+    benchmark.setConfig("image_size", std::to_string(randomCropSize));
+    benchmark.setConfig(
+        "channels_last", FLAGS_train_channels_last ? "true" : "false");
+    benchmark.setConfig(
+        "mixed_precision", FLAGS_train_mixed_precision ? "true" : "false");
+    model->train();
+    while (!benchmark.done()) {
+      trainStep(inputs, target, true);
+      if (benchmark.endStep(
+              FLAGS_data_batch_size, FLAGS_data_batch_size * numPixels)) {
+        fwdTimer.reset();
+        bwdTimer.reset();
+        optimTimer.reset();
+      }
+    }
+    benchmark.setPhase("forward", fwdTimer.value());
+    benchmark.setPhase("backward", bwdTimer.value());
+    benchmark.setPhase("optimizer", optimTimer.value());
+    auto report = benchmark.report();
+    if (isMaster) {
+      if (FLAGS_benchmark_output.empty()) {
+        std::cout << report << std::endl;
+      } else {
+        auto stream = lib::createOutputStream(FLAGS_benchmark_output);
+        stream << report << std::endl;
+      }
+    }
+    return 0;
+  }
+
+  //////////////////////////
+  //  Create datasets
+  /////////////////////////
   const int64_t batchSizePerGpu = FLAGS_data_batch_size;
   const int64_t prefetchThreads = 10;
   const int64_t prefetchSize = FLAGS_data_batch_size;
   auto labelMap = getImagenetLabels(labelPath);
+  fl::ext::image::DistributedDatasetOptions trainOptions;
+  if (!FLAGS_data_local_cache_dir.empty()) {
+    // The random crops of the images must not be cached
+    if (!FLAGS_data_batch_augmentation) {
+      LOG(FATAL) << "--data_local_cache_dir needs --data_batch_augmentation";
+    }
+    trainOptions.localCachePath = lib::pathsConcat(
+        FLAGS_data_local_cache_dir,
+        "train." + std::to_string(worldRank) + ".cache");
+    trainOptions.reshuffleEpochs = FLAGS_data_reshuffle_epochs;
+  }
   auto trainDataset = fl::ext::image::DistributedDataset(
-      imagenetDataset(trainList, labelMap, {trainTransforms}),
+      imagenetDataset(
+          trainList, labelMap, {trainTransforms}, trainDecodeOptions),
       worldRank,
       worldSize,
       batchSizePerGpu,
       prefetchThreads,
-      prefetchSize);
+      prefetchSize,
+      trainBatchFns,
+      trainOptions);
 
   auto valDataset = fl::ext::image::DistributedDataset(
-      imagenetDataset(valList, labelMap, {valTransforms}),
+      imagenetDataset(valList, labelMap, {valTransforms}, valDecodeOptions),
       worldRank,
       worldSize,
       batchSizePerGpu,
       prefetchThreads,
-      prefetchSize);
-
-  //////////////////////////
-  //  Load model and optimizer
-  /////////////////////////
-  auto model = fl::ext::image::resnet34();
-  // synchronize parameters of the model so that the parameters in each process
-  // is the same
-  fl::allReduceParameters(model);
-
-  // Add a hook to synchronize gradients of model parameters as they are
-  // computed
-  fl::distributeModuleGrads(model, reducer);
-
-  SGDOptimizer opt(
-      model->params(), FLAGS_train_lr, FLAGS_train_momentum, FLAGS_train_wd);
+      prefetchSize,
+      valBatchFns);
 
   auto lrScheduler = [&opt](int epoch) {
     // Adjust learning rate every 30 epoch after 30
@@ -221,30 +473,17 @@ int main(int argc, char** argv) {
     timeMeter.resume();
     int idx = 0;
     for (auto& example : trainDataset) {
-      opt.zeroGrad();
-      // Make a Variable from the input array.
+      // Make Variables from the input and target arrays.
       auto inputs = noGrad(example[kImagenetInputIdx]);
-
-      // Get the activations from the model.
-      auto output = model->forward(inputs);
-
-      // Make a Variable from the target array.
       auto target = noGrad(example[kImagenetTargetIdx]);
+      Variable output, loss;
+      std::tie(output, loss) = trainStep(inputs, target, false);
 
-      // Compute and record the loss.
-      auto loss = categoricalCrossEntropy(output, target);
-
+      // Record the loss.
       trainLossMeter.add(loss.array());
-      top5Acc.add(output.array(), target.array());
-      top1Acc.add(output.array(), target.array());
-
-      // Backprop, update the weights and then zero the gradients.
-      loss.backward();
-
-      if (FLAGS_distributed_enable) {
-        reducer->finalize();
-      }
-      opt.step();
+      auto outputArray = output.array().as(f32);
+      top5Acc.add(outputArray, target.array());
+      top1Acc.add(outputArray, target.array());
 
       // Compute and record the prediction error.
       double trainLoss = trainLossMeter.value()[0];
@@ -268,6 +507,12 @@ int main(int argc, char** argv) {
     }
     timeMeter.reset();
     timeMeter.stop();
+    if (!FLAGS_data_local_cache_dir.empty()) {
+      auto cacheStats = trainDataset.cacheStats();
+      FL_LOG_MASTER(INFO) << "Epoch " << epoch << " local cache hit rate: "
+                          << cacheStats.hitRate() << ", "
+                          << (cacheStats.spillBytes >> 20) << " MB on disk";
+    }
 
     double valLoss, valTop1Error, valTop5Err;
     std::tie(valLoss, valTop5Err, valTop1Error) = evalLoop(model, valDataset);
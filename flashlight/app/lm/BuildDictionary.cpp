@@ -11,10 +11,13 @@
 
 #include "flashlight/app/lm/common/Defines.h"
 #include "flashlight/app/lm/common/Helpers.h"
+#include "flashlight/app/lm/data/TokenStream.h"
 #include "flashlight/fl/common/Init.h"
 #include "flashlight/fl/common/Logging.h"
 #include "flashlight/lib/common/String.h"
 #include "flashlight/lib/common/System.h"
+#include "flashlight/lib/text/dictionary/Dictionary.h"
+#include "flashlight/lib/text/tokenizer/PartialFileReader.h"
 #include "flashlight/lib/text/tokenizer/Tokenizer.h"
 
 /**
@@ -29,14 +32,17 @@
  *   --dictionary=dictionary.txt \
  *   --dictionary_min_appearence=2 \
  *   --dictionary_max_size=200000 \
- *   --write_meta=true
+ *   --write_meta=true \
+ *   --write_token_stream=true
  *
  * -------------------------------
  *
  * It reads multiple files and count the tokens in them. Tokens will first be
  * filter by appearance and then be saved out as dictionary. If `write_meta` is
  * on, the meta data of each training file will also be generated in the same
- * folder with suffix `.desc`.
+ * folder with suffix `.desc`. If `write_token_stream` is on, each training file
+ * is also tokenized with the dictionary, and saved in the same folder with
+ * suffix `.tok`, to be memory-mapped by `fl_lm_train --data_token_stream`.
  */
 
 namespace {
@@ -67,6 +73,11 @@ DEFINE_bool(
     write_meta,
     false,
     "Generate (true) or not (false) the meta data of a file");
+DEFINE_bool(
+    write_token_stream,
+    false,
+    "Tokenize (true) or not (false) the files with the dictionary into token "
+    "streams");
 } // namespace
 
 int main(int argc, char** argv) {
@@ -124,5 +135,36 @@ int main(int argc, char** argv) {
 
   LOG(INFO) << "Dictionary saved to: " << FLAGS_dictionary;
 
+  if (FLAGS_write_token_stream) {
+    // The same indices as the dictionary read by fl_lm_train
+    fl::lib::text::Dictionary dictionary;
+    dictionary.addEntry(fl::lib::text::kEosToken);
+    dictionary.addEntry(fl::lib::text::kUnkToken);
+    dictionary.addEntry(fl::lib::text::kPadToken);
+    dictionary.addEntry(fl::lib::text::kMaskToken);
+    for (const auto& tcp : tokenCountPairs) {
+      dictionary.addEntry(tcp.first);
+    }
+    dictionary.setDefaultIndex(
+        dictionary.getIndex(fl::lib::text::kUnkToken));
+
+    fl::lib::text::PartialFileReader reader(0, 1);
+    for (const auto& file : files) {
+      auto path = fl::lib::pathsConcat(FLAGS_data_dir, file);
+      auto streamPath = path + fl::app::lm::kTokenStreamSuffix;
+      fl::app::lm::TokenStreamWriter writer(
+          streamPath,
+          dictionary.getIndex(fl::lib::text::kEosToken),
+          dictionary.entrySize());
+      reader.loadFile(path);
+      while (reader.hasNextLine()) {
+        auto tokens = tokenizer.tokenize(reader.getLine());
+        writer.addSentence(dictionary.mapEntriesToIndices(tokens));
+      }
+      writer.close();
+      LOG(INFO) << "  Token stream saved to: " << streamPath;
+    }
+  }
+
   return 0;
 }
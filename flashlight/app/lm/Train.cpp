@@ -26,7 +26,9 @@ int main(int argc, char** argv) {
 
   /* Select mode */
   std::string mode;
-  if (fileExists(
+  if (FLAGS_benchmark_steps > 0) {
+    mode = "benchmark";
+  } else if (fileExists(
           pathsConcat(FLAGS_exp_rundir, FLAGS_exp_model_name + ".bin"))) {
     mode = "continue";
   } else if (!FLAGS_exp_init_model_path.empty()) {
@@ -40,5 +42,9 @@ int main(int argc, char** argv) {
   // flags may be overridden from the model
   // so reloading from command line again
   gflags::ParseCommandLineFlags(&argc, &argv, false);
-  trainer.runTraining();
+  if (mode == "benchmark") {
+    trainer.runBenchmark();
+  } else {
+    trainer.runTraining();
+  }
 }
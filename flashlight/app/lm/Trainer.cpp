@@ -7,6 +7,9 @@
 
 #include "flashlight/app/lm/Trainer.h"
 #include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
 
 using namespace fl::ext;
 using namespace fl::lib;
@@ -31,6 +34,26 @@ DEFINE_string(
     loss_adsm_cutoffs,
     "",
     "Cutoffs for AdaptiveSoftMax comma separated.");
+DEFINE_string(
+    loss_adsm_sampling,
+    "",
+    "Sampled softmax of the tail clusters of AdaptiveSoftMax in training: "
+    "'log_uniform' or 'unigram' (counts of the dictionary) negatives. "
+    "If empty, the full softmax is computed.");
+DEFINE_int64(
+    loss_adsm_negatives,
+    1024,
+    "Number of negatives drawn in each tail cluster with "
+    "'--loss_adsm_sampling'.");
+DEFINE_bool(
+    loss_adsm_shared_negatives,
+    true,
+    "Share the negatives of '--loss_adsm_sampling' across the batch, "
+    "otherwise they are drawn for each target.");
+DEFINE_double(
+    loss_ce_label_smoothing,
+    0.0,
+    "Label smoothing of the cross entropy (ce) loss.");
 
 /* DISTRIBUTED TRAINING */
 DEFINE_bool(distributed_enable, false, "Enable distributed training.");
@@ -49,8 +72,42 @@ DEFINE_int64(
 DEFINE_string(
     distributed_rndv_filepath,
     "",
-    "Distributed training. Shared file path used for setting up rendezvous."
+    "Distributed training. Shared file path used for setting up rendezvous, "
+    "or 'tcp://host:port' of a TCP store served by rank 0. "
     "If empty, uses MPI to initialize.");
+DEFINE_bool(
+    distributed_shard_optimizer,
+    false,
+    "Distributed training. Partition the optimizer state and the reduced "
+    "gradients across processes. Each process saves its part of the optimizer "
+    "state next to the checkpoint, which is restored with the same world "
+    "size.");
+DEFINE_int64(
+    distributed_local_sgd_period,
+    0,
+    "Distributed training. Local SGD: update the parameters of each process "
+    "independently, and average them every that many updates instead of "
+    "reducing the gradients at every update; 0 to reduce the gradients.");
+DEFINE_int64(
+    distributed_local_sgd_warmup,
+    0,
+    "Distributed training. Local SGD: number of first updates whose gradients "
+    "are still reduced (post-local SGD).");
+DEFINE_double(
+    distributed_local_sgd_momentum,
+    0.0,
+    "Distributed training. Local SGD: momentum of the outer updates moving "
+    "the parameters to their averages (SlowMo).");
+DEFINE_double(
+    distributed_local_sgd_lr,
+    1.0,
+    "Distributed training. Local SGD: learning rate of the outer updates "
+    "(SlowMo).");
+DEFINE_bool(
+    distributed_local_sgd_optim_state,
+    false,
+    "Distributed training. Local SGD: average the optimizer state (e.g. "
+    "momentums) too.");
 
 /* RUN OPTIONS */
 DEFINE_string(
@@ -65,6 +122,37 @@ DEFINE_string(
     exp_init_model_path,
     "",
     "Initialization model full path, used as init model to start training.");
+DEFINE_string(
+    exp_mem_profile_save,
+    "",
+    "Records the peak number of blocks of each size allocated by the memory "
+    "manager and saves them to this file each epoch, to warm start the "
+    "memory manager of later runs with '--exp_mem_profile_load'.");
+DEFINE_string(
+    exp_mem_profile_load,
+    "",
+    "Preallocates the cache of the memory manager from a profile saved with "
+    "'--exp_mem_profile_save'.");
+DEFINE_bool(
+    exp_async_checkpoint,
+    true,
+    "Write checkpoints in a background thread, from a snapshot taken in host "
+    "memory, instead of blocking training until they are written.");
+DEFINE_int64(
+    exp_metrics_port,
+    0,
+    "If positive, serves metrics (throughput, step times, memory usage, "
+    "all-reduced bytes) to Prometheus over HTTP at /metrics, on this port "
+    "plus the rank of the process.");
+DEFINE_string(
+    exp_metrics_statsd,
+    "",
+    "host:port of a StatsD server to push the metrics of '--exp_metrics_port' "
+    "to, with the rank of the process as a tag.");
+DEFINE_int64(
+    exp_metrics_statsd_interval,
+    10000,
+    "Interval between the pushes to '--exp_metrics_statsd', in ms.");
 
 /* DATA OPTIONS */
 DEFINE_string(
@@ -97,11 +185,34 @@ DEFINE_string(
     "How to split sentences to form samples and batch. \
     'none' means split joined text into chunks of '--data_tokens_per_sample' tokens. \
     'eos' means split text by the end of sentence to create a sample, \
-    if sentence len greater than '--data_tokens_per_sample' then exclude this sentence.");
+    if sentence len greater than '--data_tokens_per_sample' then exclude this sentence. \
+    'pack' means pack consecutive sentences into samples of at most \
+    '--data_tokens_per_sample' tokens, excluding longer sentences; the network \
+    is given the ids of the sentences in each sample instead of its size, so \
+    that attention doesn't cross sentence boundaries.");
 DEFINE_bool(
     data_use_dynamic_batching,
     false,
-    "if or not use dynamic batching in case of '--data_sample_break_mode=eos'.");
+    "if or not use dynamic batching in case of '--data_sample_break_mode=eos'. \
+    Validation data is always batched dynamically.");
+DEFINE_bool(
+    data_probe_batch_size,
+    false,
+    "Set '--data_batch_size' before training to the largest one whose full \
+    batches of '--data_tokens_per_sample' tokens fit in the memory of the device \
+    with '--data_probe_margin' of headroom, measured with a forward and backward \
+    of the network and criterion. The probed value is saved in the flags of the \
+    model, which does not probe again when continued.");
+DEFINE_double(
+    data_probe_margin,
+    0.1,
+    "Share of the memory of the device left free by '--data_probe_batch_size'");
+DEFINE_bool(
+    data_token_stream,
+    false,
+    "Memory-map the token streams '<file>.tok' written by "
+    "'fl_lm_dictionary_builder --write_token_stream' instead of reading and "
+    "tokenizing the text files.");
 
 /* DICTIONARY OPTIONS */
 DEFINE_string(
@@ -175,6 +286,36 @@ DEFINE_int64(
     train_total_updates,
     std::numeric_limits<int64_t>::max(),
     "Total number of updates.");
+DEFINE_int64(
+    train_accumulate_batches,
+    1,
+    "Number of batches whose gradients are accumulated, and reduced once in \
+    distributed training, per update.");
+DEFINE_bool(
+    train_mixed_precision,
+    false,
+    "Train with mixed precision: matmuls and convolutions run in fp16, \
+    reductions, softmax and normalizations in fp32 (optim level O1), \
+    with dynamic loss scaling.");
+DEFINE_double(
+    train_amp_scale_factor,
+    4096.,
+    "Initial loss scale factor with '--train_mixed_precision'.");
+DEFINE_double(
+    train_amp_max_scale_factor,
+    32000.,
+    "Maximum loss scale factor with '--train_mixed_precision'.");
+DEFINE_int64(
+    train_amp_scale_factor_update_interval,
+    2000,
+    "Number of updates without overflow after which the loss scale factor \
+    is doubled with '--train_mixed_precision'.");
+DEFINE_bool(
+    train_fp16_tables,
+    false,
+    "Store the tables of the embeddings and of the adaptive softmax in fp16, \
+    halving the memory traffic of their lookups and projections; they are \
+    updated through fp32 master weights held by the optimizer.");
 
 /* MASK OPTIONS */
 DEFINE_double(mask_prob, 0.15, "[mask lm task] Probability of masking.");
@@ -191,6 +332,22 @@ DEFINE_int64(
     1,
     "[mask lm task] Min number of masked tokens in each sample.");
 
+/* BENCHMARK OPTIONS */
+DEFINE_int64(
+    benchmark_steps,
+    0,
+    "If positive, measures the throughput of this number of training steps \
+    on synthetic batches of random tokens instead of training, and writes \
+    the report as JSON to '--benchmark_output'.");
+DEFINE_int64(
+    benchmark_warmup_steps,
+    10,
+    "Untimed steps before the ones of '--benchmark_steps'.");
+DEFINE_string(
+    benchmark_output,
+    "",
+    "File of the JSON report of '--benchmark_steps', stdout if empty.");
+
 /* ================================ Trainer ================================ */
 
 /* ============= Public functions ============= */
@@ -205,6 +362,8 @@ Trainer::Trainer(const std::string& mode) {
     initFork();
   } else if (mode == "eval") {
     initEval();
+  } else if (mode == "benchmark") {
+    initBenchmark();
   } else {
     throw std::invalid_argument("Trainer doesn't support mode: " + mode);
   }
@@ -213,9 +372,21 @@ Trainer::Trainer(const std::string& mode) {
   FL_LOG_MASTER(INFO) << "Gflags after parsing \n" << serializeGflags("; ");
 
   initArrayFire();
-  if (FLAGS_distributed_enable) {
+  initMemoryManager();
+  if (FLAGS_distributed_enable && !FLAGS_distributed_shard_optimizer) {
     reducer_ = std::make_shared<fl::CoalescingReducer>(1.0, true, true);
   }
+  if (FLAGS_train_mixed_precision) {
+    FL_LOG_MASTER(INFO) << "Mixed precision training with loss scaling";
+    fl::OptimMode::get().setOptimLevel(fl::OptimLevel::O1);
+    scaler_ = std::make_unique<fl::DynamicScaler>(
+        FLAGS_train_amp_scale_factor,
+        FLAGS_train_amp_max_scale_factor,
+        FLAGS_train_amp_scale_factor_update_interval);
+  }
+  if (FLAGS_data_probe_batch_size && mode != "eval") {
+    probeBatchSize();
+  }
 
   FL_LOG_MASTER(INFO) << "network (" << fl::numTotalParams(network_)
                       << " params): " << network_->prettyString();
@@ -236,17 +407,42 @@ void Trainer::runTraining() {
 
   FL_LOG_MASTER(INFO) << "training started (epoch=" << epoch_
                       << " batch=" << batchIdx_ << ")";
-
-  fl::allReduceParameters(network_);
-  fl::allReduceParameters(criterion_);
+  fl::ext::MetricsExporters metricsExporters(
+      FLAGS_exp_metrics_port,
+      FLAGS_exp_metrics_statsd,
+      FLAGS_exp_metrics_statsd_interval,
+      fl::getWorldRank());
+  auto& updatesMetric = fl::MetricsRegistry::global().counter(
+      "fl_train_updates_total", "Updates of the models");
+  // Steps end with a synchronization
+  auto& updateTimeMetric = fl::MetricsRegistry::global().histogram(
+      "fl_train_update_seconds", "Time of the updates");
+
+  fl::broadcastParameters(network_);
+  fl::broadcastParameters(criterion_);
+  if (FLAGS_distributed_enable && FLAGS_distributed_local_sgd_period > 0) {
+    collectParameters();
+    std::vector<std::shared_ptr<fl::FirstOrderOptimizer>> optimizers;
+    if (FLAGS_distributed_local_sgd_optim_state) {
+      optimizers.push_back(optimizer_);
+    }
+    averager_ = std::make_unique<fl::ModelAverager>(
+        parameters_,
+        FLAGS_distributed_local_sgd_period,
+        FLAGS_distributed_local_sgd_warmup,
+        FLAGS_distributed_local_sgd_momentum,
+        FLAGS_distributed_local_sgd_lr,
+        optimizers);
+  }
   auto modelPath = pathsConcat(FLAGS_exp_rundir, FLAGS_exp_model_name + ".bin");
 
   while (batchIdx_ < FLAGS_train_total_updates) {
     // Advance epoch
-    if (batchIdx_ && batchIdx_ % trainDataset_->size() == 0) {
+    if (batchIdx_ && batchIdx_ % updatesPerEpoch() == 0) {
       stopTimers();
       ++epoch_;
       trainDataset_->shuffle(FLAGS_train_seed + epoch_);
+      averageModels();
       saveCheckpoint(modelPath);
       logMemoryManagerStatus();
     }
@@ -254,13 +450,22 @@ void Trainer::runTraining() {
     // Run train
     runTimeMeter_.resume();
     batchTimerMeter_.resume();
+    auto stepStart = std::chrono::steady_clock::now();
     trainStep();
+    updateTimeMetric.observe(std::chrono::duration<double>(
+                                 std::chrono::steady_clock::now() - stepStart)
+                                 .count());
+    updatesMetric.add();
     batchTimerMeter_.incUnit();
     ++batchIdx_;
+    if (averager_) {
+      averager_->step(batchIdx_);
+    }
 
     // Run evaluation and save best checkpoint
     if (FLAGS_train_report_updates &&
         batchIdx_ % FLAGS_train_report_updates == 0) {
+      averageModels();
       auto loss = runEvaluation();
       if (loss < bestLoss_) {
         bestLoss_ = loss;
@@ -268,6 +473,7 @@ void Trainer::runTraining() {
       }
 
       auto progress = getProgress();
+      setMetrics();
       FL_LOG_MASTER(INFO) << progress;
       if (isMaster()) {
         logWriter_ << progress << "\n" << std::flush;
@@ -278,57 +484,179 @@ void Trainer::runTraining() {
     // Force saving checkpoint every given interval
     if (FLAGS_train_save_updates && batchIdx_ % FLAGS_train_save_updates == 0) {
       stopTimers();
+      averageModels();
       saveCheckpoint(modelPath, "." + std::to_string(batchIdx_));
     }
   }
+  logMemoryManagerStatus();
+}
+
+void Trainer::runBenchmark() {
+  // Full batches of random tokens, as in probeBatchSize(), sampled once
+  std::vector<std::vector<af::array>> samples;
+  for (int64_t i = 0; i < accumulateBatches(); ++i) {
+    af::array tokens =
+        (af::randu(FLAGS_data_tokens_per_sample, FLAGS_data_batch_size) *
+         dictionary_.entrySize())
+            .as(s32);
+    tokens(tokens == kPadIdx_) = kEosIdx_;
+    samples.push_back({tokens});
+  }
+  const int64_t numSamples = accumulateBatches() * FLAGS_data_batch_size;
+  fl::broadcastParameters(network_);
+  fl::broadcastParameters(criterion_);
+
+  fl::ext::TrainBenchmark benchmark(
+      "lm_train",
+      "tokens",
+      FLAGS_benchmark_warmup_steps,
+      FLAGS_benchmark_steps);
+  benchmark.setConfig("arch", FLAGS_train_arch_file);
+  benchmark.setConfig("task", FLAGS_train_task);
+  benchmark.setConfig("loss", FLAGS_loss_type);
+  benchmark.setConfig("optimizer", FLAGS_train_optimizer);
+  benchmark.setConfig("batch_size", std::to_string(FLAGS_data_batch_size));
+  benchmark.setConfig(
+      "tokens_per_sample", std::to_string(FLAGS_data_tokens_per_sample));
+  benchmark.setConfig(
+      "accumulate_batches", std::to_string(accumulateBatches()));
+  benchmark.setConfig(
+      "mixed_precision", FLAGS_train_mixed_precision ? "true" : "false");
+  benchmark.setConfig(
+      "dictionary_size", std::to_string(dictionary_.entrySize()));
+  resetMeters();
+  while (!benchmark.done()) {
+    sampleTimerMeter_.resume();
+    trainStep(samples);
+    ++batchIdx_;
+    if (benchmark.endStep(
+            numSamples, numSamples * FLAGS_data_tokens_per_sample)) {
+      resetMeters();
+    }
+  }
+  stopTimers();
+
+  // The meters are means over their units: batches, or steps
+  const double steps = FLAGS_benchmark_steps;
+  const double batches = steps * accumulateBatches();
+  benchmark.setPhase("data", sampleTimerMeter_.value() * steps);
+  benchmark.setPhase(
+      "forward",
+      (fwdTimeMeter_.value() - critFwdTimeMeter_.value()) * batches);
+  benchmark.setPhase("criterion_forward", critFwdTimeMeter_.value() * batches);
+  // The backward of each batch, and the reduction of the step
+  benchmark.setPhase("backward", bwdTimeMeter_.value() * (batches + steps));
+  benchmark.setPhase("optimizer", optimTimeMeter_.value() * steps);
+  auto report = benchmark.report();
+  if (isMaster()) {
+    if (FLAGS_benchmark_output.empty()) {
+      std::cout << report << std::endl;
+    } else {
+      auto stream = createOutputStream(FLAGS_benchmark_output);
+      stream << report << std::endl;
+    }
+  }
 }
 
 void Trainer::trainStep() {
+  sampleTimerMeter_.resume();
+  int64_t first = (batchIdx_ % updatesPerEpoch()) * accumulateBatches();
+  int64_t last =
+      std::min<int64_t>(first + accumulateBatches(), trainDataset_->size());
+  std::vector<std::vector<af::array>> samples;
+  for (int64_t idx = first; idx < last; ++idx) {
+    samples.push_back(trainDataset_->get(idx));
+  }
+  trainStep(samples);
+}
+
+void Trainer::trainStep(const std::vector<std::vector<af::array>>& samples) {
   network_->train();
   criterion_->train();
   setLr();
 
-  // 1. Sample
-  fl::Variable input, target;
-  sampleTimerMeter_.resume();
-  std::tie(input, target) = getInputAndTarget(trainDataset_->get(batchIdx_));
-  af::array inputSizes = af::sum(input.array() != kPadIdx_, 0);
-  sampleTimerMeter_.stopAndIncUnit();
-
-  // 2. Forward
-  fwdTimeMeter_.resume();
-  auto output = network_->forward({input, fl::noGrad(inputSizes)}).front();
-  af::sync();
-  critFwdTimeMeter_.resume();
-  auto loss = criterion_->forward({output, target}).front();
-  af::sync();
-  fwdTimeMeter_.stopAndIncUnit();
-  critFwdTimeMeter_.stopAndIncUnit();
-
-  float numTokens = af::count<float>(target.array() != kPadIdx_);
-  if (numTokens > 0) {
-    auto weight =
-        numTokens / (FLAGS_data_tokens_per_sample * FLAGS_data_batch_size);
-    trainLossMeter_.add(af::mean<float>(loss.array()) / numTokens, weight);
-    tokenCountMeter_.add(numTokens);
+  // 1. Sample all the batches of the update, whose losses are normalized by
+  // the total number of tokens
+  std::vector<fl::Variable> inputs, targets;
+  std::vector<af::array> inputSizes, numTokens;
+  af::array totalTokens = af::constant(0, 1, f32);
+  for (const auto& sample : samples) {
+    fl::Variable input, target;
+    std::tie(input, target) = getInputAndTarget(sample);
+    inputSizes.push_back(getInputSizes(sample, input));
+    numTokens.push_back(af::count(target.array() != kPadIdx_).as(f32));
+    totalTokens += numTokens.back();
+    inputs.push_back(input);
+    targets.push_back(target);
+  }
+  if (FLAGS_distributed_enable && !isLocalUpdate()) {
+    fl::allReduce(totalTokens);
   }
+  sampleTimerMeter_.stopAndIncUnit();
 
-  // 3. Backward
-  bwdTimeMeter_.resume();
+  auto& samplesMetric = fl::MetricsRegistry::global().counter(
+      "fl_train_samples_total", "Samples trained on");
+  auto& tokensMetric = fl::MetricsRegistry::global().counter(
+      "fl_train_tokens_total", "Target tokens trained on, padding excluded");
   optimizer_->zeroGrad();
-  af::array numTokensArr = af::array(1, &numTokens);
-  if (FLAGS_distributed_enable) {
-    fl::allReduce(numTokensArr);
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    // 2. Forward
+    fwdTimeMeter_.resume();
+    auto output =
+        network_->forward({inputs[i], fl::noGrad(inputSizes[i])}).front();
+    af::sync();
+    critFwdTimeMeter_.resume();
+    auto loss = criterion_->forward({output, targets[i]}).front();
+    af::sync();
+    fwdTimeMeter_.stopAndIncUnit();
+    critFwdTimeMeter_.stopAndIncUnit();
+
+    // The meters are updated on the device, without waiting for the loss:
+    // the batches without tokens are added with a zero weight
+    auto hasTokens = (numTokens[i] > 0).as(f32);
+    trainLossMeter_.add(
+        af::mean(af::flat(loss.array())).as(f32) /
+            af::max(numTokens[i], 1.0),
+        numTokens[i] /
+            static_cast<float>(
+                FLAGS_data_tokens_per_sample * FLAGS_data_batch_size));
+    tokenCountMeter_.add(numTokens[i], hasTokens);
+    // After the synchronization of the forward
+    samplesMetric.add(inputs[i].dims(1));
+    tokensMetric.add(numTokens[i].scalar<float>());
+
+    // 3. Backward, summing the gradients of the batches
+    bwdTimeMeter_.resume();
+    loss = loss / fl::Variable(totalTokens, false);
+    if (scaler_) {
+      loss = scaler_->scale(loss);
+    }
+    loss.backward();
+    af::sync();
+    bwdTimeMeter_.stopAndIncUnit();
   }
-  loss = loss / fl::Variable(numTokensArr, false);
-  loss.backward();
+  // Reduced once per update
+  bwdTimeMeter_.resume();
   reduceGrads();
   af::sync();
   bwdTimeMeter_.stopAndIncUnit();
 
   // 4. Optimization
   optimTimeMeter_.resume();
-  fl::clipGradNorm(parameters_, FLAGS_train_max_grad_norm);
+  if (scaler_ && !unscaleGrads()) {
+    FL_VLOG(2) << "AMP: update skipped, scale factor decreased to "
+               << scaler_->getScaleFactor();
+    optimTimeMeter_.stopAndIncUnit();
+    return;
+  }
+  auto shardedOptimizer =
+      std::dynamic_pointer_cast<fl::ShardedOptimizer>(optimizer_);
+  if (shardedOptimizer) {
+    // Gradients are reduced by the optimizer
+    shardedOptimizer->clipGradNormAsync(FLAGS_train_max_grad_norm);
+  } else {
+    fl::clipGradNormAsync(parameters_, FLAGS_train_max_grad_norm);
+  }
   optimizer_->step();
   af::sync();
   optimTimeMeter_.stopAndIncUnit();
@@ -337,20 +665,24 @@ void Trainer::trainStep() {
 void Trainer::evalStep() {
   network_->eval();
   criterion_->eval();
+  fl::NoGradGuard noGrad;
 
-  for (const auto& sample : *validDataset_) {
+  // The batches are sorted by length: each process evaluates every
+  // `getWorldSize()`-th of them, so that they all get as many tokens
+  for (int64_t i = fl::getWorldRank(); i < validDataset_->size();
+       i += fl::getWorldSize()) {
+    auto sample = validDataset_->get(i);
     fl::Variable input, target;
     std::tie(input, target) = getInputAndTarget(sample);
-    af::array inputSizes = af::sum(input.array() != kPadIdx_, 0);
+    af::array inputSizes = getInputSizes(sample, input);
     auto output = network_->forward({input, fl::noGrad(inputSizes)}).front();
     auto loss = criterion_->forward({output, target}).front();
-    auto numTokens = af::count<int>(target.array() != kPadIdx_);
-    if (numTokens > 0) {
-      auto weight = numTokens /
-          static_cast<double>(
-                        FLAGS_data_tokens_per_sample * FLAGS_data_batch_size);
-      validLossMeter_.add(af::mean<double>(loss.array()) / numTokens, weight);
-    }
+    auto numTokens = af::count(target.array() != kPadIdx_).as(f32);
+    validLossMeter_.add(
+        af::mean(af::flat(loss.array())).as(f32) / af::max(numTokens, 1.0),
+        numTokens /
+            static_cast<float>(
+                FLAGS_data_tokens_per_sample * FLAGS_data_batch_size));
   }
 }
 
@@ -368,6 +700,8 @@ void Trainer::initTrain() {
   createDictionary();
   createNetwork();
   createCriterion();
+  setTablesType();
+  setCriterionSampling();
   createOptimizer();
 
   createTrainDatasets();
@@ -396,9 +730,39 @@ void Trainer::initContinue() {
   gflags::ReadFlagsFromString(gflagsStr_, gflags::GetArgv0(), true);
 
   createDictionary();
+  setCriterionSampling();
   createTrainDatasets();
+  // Batches of the epoch in the order of train(), which are then indexed
+  // from batchIdx_: the earlier ones aren't read again
+  for (int64_t epoch = 2; epoch <= epoch_; ++epoch) {
+    trainDataset_->shuffle(FLAGS_train_seed + epoch);
+  }
   createValidDatasets();
   // the network, criterion and optimizer will be reused
+  // sharded optimizer states are saved by each process next to the checkpoint
+  if (!optimizer_ ||
+      (FLAGS_distributed_enable && FLAGS_distributed_shard_optimizer)) {
+    createOptimizer();
+    auto sharded = std::dynamic_pointer_cast<fl::ShardedOptimizer>(optimizer_);
+    auto shardPath = getShardCheckpointPath(checkPoint);
+    bool restored = false;
+    if (sharded && fileExists(shardPath)) {
+      std::string shardVersion;
+      int64_t worldSize;
+      fl::Variable shard;
+      std::shared_ptr<fl::FirstOrderOptimizer> shardOptimizer;
+      fl::ext::Serializer::load(
+          shardPath, shardVersion, worldSize, shard, shardOptimizer);
+      if (worldSize == fl::getWorldSize()) {
+        sharded->setShard(shard, shardOptimizer);
+        restored = true;
+      }
+    }
+    if (!restored) {
+      FL_LOG_MASTER(WARNING) << "Creating a fresh optimizer: its state is not "
+                                "restored from the checkpoint";
+    }
+  }
 }
 
 void Trainer::initFork() {
@@ -421,6 +785,8 @@ void Trainer::initFork() {
       batchIdx_);
 
   createDictionary();
+  setTablesType();
+  setCriterionSampling();
   createOptimizer();
   createTrainDatasets();
   createValidDatasets();
@@ -443,6 +809,16 @@ void Trainer::initEval() {
   // the network and criterion will be reused
 }
 
+void Trainer::initBenchmark() {
+  FL_LOG_MASTER(INFO) << "Benchmarking a fresh model on synthetic batches";
+  createDictionary();
+  createNetwork();
+  createCriterion();
+  setTablesType();
+  setCriterionSampling();
+  createOptimizer();
+}
+
 void Trainer::createDictionary() {
   auto stream = createInputStream(FLAGS_dictionary);
   std::string line;
@@ -455,6 +831,11 @@ void Trainer::createDictionary() {
       continue;
     }
     dictionary_.addEntry(tkns.front());
+    tokenCounts_.resize(dictionary_.entrySize());
+    if (tkns.size() > 1) {
+      tokenCounts_[dictionary_.getIndex(tkns.front())] =
+          std::strtod(tkns[1].c_str(), nullptr);
+    }
     if (dictionary_.entrySize() == FLAGS_dictionary_max_size &&
         FLAGS_dictionary_max_size > 0) {
       break;
@@ -471,6 +852,21 @@ void Trainer::createDictionary() {
 }
 
 void Trainer::createTrainDatasets() {
+  if (FLAGS_data_token_stream) {
+    trainDataset_ = std::make_shared<TextDataset>(
+        FLAGS_data_dir,
+        getTokenStreamFiles(FLAGS_data_train),
+        fl::getWorldRank(),
+        fl::getWorldSize(),
+        dictionary_,
+        FLAGS_data_tokens_per_sample,
+        FLAGS_data_batch_size,
+        FLAGS_data_sample_break_mode,
+        true);
+    FL_LOG_MASTER(INFO) << "train dataset: " << trainDataset_->size()
+                        << " samples";
+    return;
+  }
   fl::lib::text::Tokenizer tokenizer;
   fl::lib::text::PartialFileReader partialFileReader(
       fl::getWorldRank(), fl::getWorldSize());
@@ -488,10 +884,65 @@ void Trainer::createTrainDatasets() {
                       << " samples";
 }
 
+void Trainer::probeBatchSize() {
+  // Full batches of random tokens, whose targets are spread over the
+  // clusters of an adaptive softmax
+  const int64_t numTokens = FLAGS_data_tokens_per_sample;
+  auto probeStep = [this, numTokens](int64_t batchSize) {
+    network_->train();
+    criterion_->train();
+    af::array tokens =
+        (af::randu(numTokens, batchSize) * dictionary_.entrySize()).as(s32);
+    tokens(tokens == kPadIdx_) = kEosIdx_;
+    fl::Variable input, target;
+    std::tie(input, target) = getInputAndTarget({tokens});
+    auto output =
+        network_->forward({input, fl::noGrad(getInputSizes({tokens}, input))})
+            .front();
+    criterion_->forward({output, target}).front().backward();
+    network_->zeroGrad();
+    criterion_->zeroGrad();
+  };
+  // Doubled until out of memory
+  const int64_t maxBatchSize = 1 << 20;
+  int64_t batchSize = fl::ext::findMaxBatchBudget(
+      probeStep, 1, maxBatchSize, FLAGS_data_probe_margin);
+  if (batchSize == 0) {
+    throw std::runtime_error(
+        "A sample of '--data_tokens_per_sample' tokens doesn't fit in the "
+        "memory of the device");
+  }
+  FLAGS_data_batch_size = batchSize;
+  FLAGS_data_probe_batch_size = false;
+  gflagsStr_ = serializeGflags();
+  FL_LOG_MASTER(INFO) << "Probed data_batch_size: " << batchSize;
+  // No datasets in the benchmark mode
+  if (trainDataset_) {
+    createTrainDatasets();
+    createValidDatasets();
+  }
+}
+
 void Trainer::createValidDatasets() {
+  // Every process reads all the sentences, batched by length, and evaluates
+  // its share of the batches in evalStep()
+  if (FLAGS_data_token_stream) {
+    validDataset_ = std::make_shared<TextDataset>(
+        FLAGS_data_dir,
+        getTokenStreamFiles(FLAGS_data_valid),
+        0,
+        1,
+        dictionary_,
+        FLAGS_data_tokens_per_sample,
+        FLAGS_data_batch_size,
+        "eos",
+        /* useDynamicBatching = */ true);
+    FL_LOG_MASTER(INFO) << "valid dataset: " << validDataset_->size()
+                        << " samples";
+    return;
+  }
   fl::lib::text::Tokenizer tokenizer;
-  fl::lib::text::PartialFileReader partialFileReader(
-      fl::getWorldRank(), fl::getWorldSize());
+  fl::lib::text::PartialFileReader partialFileReader(0, 1);
 
   validDataset_ = std::make_shared<TextDataset>(
       FLAGS_data_dir,
@@ -502,7 +953,7 @@ void Trainer::createValidDatasets() {
       FLAGS_data_tokens_per_sample,
       FLAGS_data_batch_size,
       "eos",
-      FLAGS_data_use_dynamic_batching);
+      /* useDynamicBatching = */ true);
   FL_LOG_MASTER(INFO) << "valid dataset: " << validDataset_->size()
                       << " samples";
 }
@@ -526,14 +977,71 @@ void Trainer::createCriterion() {
     criterion_ = std::make_shared<fl::AdaptiveSoftMaxLoss>(
         softmax, fl::ReduceMode::SUM, kPadIdx_);
   } else if (FLAGS_loss_type == "ce") {
-    criterion_ = std::make_shared<fl::CategoricalCrossEntropy>(
-        fl::ReduceMode::SUM, kPadIdx_);
+    // The softmax is fused in the loss, networks can output logits (or
+    // log-probabilities, which are their own log-softmax)
+    criterion_ = std::make_shared<fl::SoftmaxCrossEntropy>(
+        fl::ReduceMode::SUM, kPadIdx_, FLAGS_loss_ce_label_smoothing);
   } else {
     throw std::runtime_error(
         "Criterion is not supported, check 'loss_type' flag possible values");
   }
 }
 
+void Trainer::setTablesType() {
+  if (!FLAGS_train_fp16_tables) {
+    return;
+  }
+  int numTables = 0;
+  std::function<void(const fl::ModulePtr&)> visit =
+      [&](const fl::ModulePtr& module) {
+        if (auto emb = std::dynamic_pointer_cast<fl::Embedding>(module)) {
+          emb->setWeightType(af::dtype::f16);
+          ++numTables;
+        } else if (
+            auto adaptiveEmb =
+                std::dynamic_pointer_cast<fl::AdaptiveEmbedding>(module)) {
+          adaptiveEmb->setWeightType(af::dtype::f16);
+          ++numTables;
+        } else if (
+            auto container = std::dynamic_pointer_cast<fl::Container>(module)) {
+          for (const auto& child : container->modules()) {
+            visit(child);
+          }
+        }
+      };
+  visit(network_);
+  auto adsm = std::dynamic_pointer_cast<fl::AdaptiveSoftMaxLoss>(criterion_);
+  if (adsm) {
+    adsm->getActivation()->setWeightType(af::dtype::f16);
+    ++numTables;
+  }
+  FL_LOG_MASTER(INFO) << "Tables stored in fp16: " << numTables;
+}
+
+void Trainer::setCriterionSampling() {
+  auto adsm = std::dynamic_pointer_cast<fl::AdaptiveSoftMaxLoss>(criterion_);
+  if (!adsm || FLAGS_loss_adsm_sampling.empty()) {
+    return;
+  }
+  using Sampling = fl::AdaptiveSoftMaxLoss::NegativeSampling;
+  Sampling sampling;
+  if (FLAGS_loss_adsm_sampling == "log_uniform") {
+    sampling = Sampling::LOG_UNIFORM;
+  } else if (FLAGS_loss_adsm_sampling == "unigram") {
+    sampling = Sampling::UNIGRAM;
+  } else {
+    throw std::runtime_error(
+        "Sampling is not supported, check 'loss_adsm_sampling' flag possible "
+        "values");
+  }
+  adsm->setSampledSoftmax(
+      sampling,
+      FLAGS_loss_adsm_negatives,
+      FLAGS_loss_adsm_shared_negatives,
+      tokenCounts_,
+      FLAGS_train_seed + fl::getWorldRank());
+}
+
 void Trainer::collectParameters() {
   parameters_ = network_->params();
   const auto& criterionParams = criterion_->params();
@@ -543,25 +1051,38 @@ void Trainer::collectParameters() {
 
 void Trainer::createOptimizer() {
   collectParameters();
-  if (FLAGS_train_optimizer == "nag") {
-    optimizer_ = std::make_shared<fl::NAGOptimizer>(
-        parameters_,
-        FLAGS_train_lr,
-        FLAGS_train_momentum,
-        FLAGS_train_weight_decay);
-  } else if (FLAGS_train_optimizer == "sgd") {
-    optimizer_ = std::make_shared<fl::SGDOptimizer>(
-        parameters_,
-        FLAGS_train_lr,
-        FLAGS_train_momentum,
-        FLAGS_train_weight_decay,
-        false);
-  } else if (FLAGS_train_optimizer == "adagrad") {
-    optimizer_ = std::make_shared<fl::AdagradOptimizer>(
-        parameters_, FLAGS_train_lr, 1e-8, FLAGS_train_weight_decay);
+  auto makeOptimizer = [](const std::vector<fl::Variable>& parameters)
+      -> std::shared_ptr<fl::FirstOrderOptimizer> {
+    if (FLAGS_train_optimizer == "nag") {
+      return std::make_shared<fl::NAGOptimizer>(
+          parameters,
+          FLAGS_train_lr,
+          FLAGS_train_momentum,
+          FLAGS_train_weight_decay);
+    } else if (FLAGS_train_optimizer == "sgd") {
+      return std::make_shared<fl::SGDOptimizer>(
+          parameters,
+          FLAGS_train_lr,
+          FLAGS_train_momentum,
+          FLAGS_train_weight_decay,
+          false);
+    } else if (FLAGS_train_optimizer == "adagrad") {
+      return std::make_shared<fl::AdagradOptimizer>(
+          parameters, FLAGS_train_lr, 1e-8, FLAGS_train_weight_decay);
+    } else {
+      throw std::runtime_error(
+          "Optimizer is not supported, check 'train_optimizer' flag possible values");
+    }
+  };
+  if (FLAGS_distributed_enable && FLAGS_distributed_shard_optimizer) {
+    optimizer_ =
+        std::make_shared<fl::ShardedOptimizer>(parameters_, makeOptimizer);
+  } else if (FLAGS_train_fp16_tables) {
+    // The fp16 tables are updated through fp32 master weights
+    optimizer_ = std::make_shared<fl::MasterWeightsOptimizer>(
+        parameters_, makeOptimizer);
   } else {
-    throw std::runtime_error(
-        "Optimizer is not supported, check 'train_optimizer' flag possible values");
+    optimizer_ = makeOptimizer(parameters_);
   }
 }
 
@@ -630,6 +1151,22 @@ std::pair<fl::Variable, fl::Variable> Trainer::getInputAndTarget(
   return std::make_pair(input, target);
 }
 
+af::array Trainer::getInputSizes(
+    const std::vector<af::array>& sample,
+    const fl::Variable& input) const {
+  if (FLAGS_data_sample_break_mode != "pack") {
+    return af::sum(input.array() != kPadIdx_, 0);
+  }
+  // Ids (1, 2, ...) of the sentences packed in each sample, 0 on padding:
+  // a sentence begins at the <eos> which ends the previous one
+  auto segments = af::accum((sample[0] == kEosIdx_).as(s32), 0) *
+      (sample[0] != kPadIdx_).as(s32);
+  if (FLAGS_train_task == "autoreg") {
+    segments = segments.rows(0, input.dims(0) - 1);
+  }
+  return segments;
+}
+
 void Trainer::setLr() {
   double lr;
   if (batchIdx_ < FLAGS_train_warmup_updates) {
@@ -659,7 +1196,7 @@ void Trainer::setLr() {
 
 void Trainer::reduceGrads() {
   collectParameters();
-  if (reducer_) {
+  if (reducer_ && !isLocalUpdate()) {
     for (auto& p : parameters_) {
       if (!p.isGradAvailable()) {
         p.addGrad(fl::constant(0.0, p.dims(), p.type(), false));
@@ -672,12 +1209,55 @@ void Trainer::reduceGrads() {
   }
 }
 
+bool Trainer::isLocalUpdate() const {
+  // batchIdx_ counts the updates done before this one
+  return averager_ && averager_->isLocal(batchIdx_ + 1);
+}
+
+void Trainer::averageModels() {
+  if (averager_ && averager_->isLocal(batchIdx_)) {
+    averager_->average();
+  }
+}
+
 /* ============= Stateless training helpers ============= */
+bool Trainer::unscaleGrads() {
+  auto shardedOptimizer =
+      std::dynamic_pointer_cast<fl::ShardedOptimizer>(optimizer_);
+  if (!shardedOptimizer) {
+    // Reduced gradients are the same on all processes
+    return scaler_->unscale(parameters_);
+  }
+  // Each process checks its part of the reduced gradients
+  shardedOptimizer->reduceGrads();
+  auto overflow = scaler_->unscaleAsync({shardedOptimizer->getShard()});
+  fl::allReduce(overflow);
+  return scaler_->update(overflow.scalar<float>() != 0);
+}
+
 void Trainer::initArrayFire() const {
   // Set arrayfire seed for reproducibility
   af::setSeed(FLAGS_train_seed);
 }
 
+void Trainer::initMemoryManager() const {
+  if (FLAGS_exp_mem_profile_load.empty() &&
+      FLAGS_exp_mem_profile_save.empty()) {
+    return;
+  }
+  auto* curMemMgr = dynamic_cast<fl::CachingMemoryManager*>(
+      fl::MemoryManagerInstaller::currentlyInstalledMemoryManager());
+  if (!curMemMgr) {
+    throw std::invalid_argument(
+        "'--exp_mem_profile_load' and '--exp_mem_profile_save' require the CachingMemoryManager");
+  }
+  if (!FLAGS_exp_mem_profile_load.empty()) {
+    curMemMgr->warmStart(fl::CachingMemoryManager::AllocationProfile::load(
+        FLAGS_exp_mem_profile_load));
+  }
+  curMemMgr->setProfilingEnabled(!FLAGS_exp_mem_profile_save.empty());
+}
+
 std::vector<int> Trainer::parseCutoffs(int64_t nClasses) const {
   // parse cutoffs for adaptive softmax
   std::vector<int> cutoffs;
@@ -695,6 +1275,28 @@ std::vector<int> Trainer::parseCutoffs(int64_t nClasses) const {
   return cutoffs;
 }
 
+std::string Trainer::getTokenStreamFiles(const std::string& filenames) const {
+  std::vector<std::string> files;
+  for (const auto& file : split(',', filenames)) {
+    files.push_back(file + kTokenStreamSuffix);
+  }
+  return join(",", files);
+}
+
+std::string Trainer::getShardCheckpointPath(const std::string& path) const {
+  return path + ".shard" + std::to_string(fl::getWorldRank());
+}
+
+int64_t Trainer::accumulateBatches() const {
+  return FLAGS_train_accumulate_batches;
+}
+
+int64_t Trainer::updatesPerEpoch() const {
+  // The last update of the epoch may accumulate fewer batches
+  return (trainDataset_->size() + accumulateBatches() - 1) /
+      accumulateBatches();
+}
+
 bool Trainer::isMaster() const {
   return fl::getWorldRank() == 0;
 }
@@ -710,6 +1312,25 @@ void Trainer::checkArgs() const {
     throw std::invalid_argument(
         "'--dictionary_max_size' should be positive or -1");
   }
+  if (FLAGS_train_accumulate_batches < 1) {
+    throw std::invalid_argument(
+        "'--train_accumulate_batches' should be positive");
+  }
+  if (FLAGS_distributed_local_sgd_period > 0 &&
+      FLAGS_distributed_shard_optimizer) {
+    // The gradients are reduced by the sharded optimizer
+    throw std::invalid_argument(
+        "'--distributed_local_sgd_period' can't be used with "
+        "'--distributed_shard_optimizer'");
+  }
+  if (FLAGS_train_fp16_tables &&
+      (FLAGS_distributed_shard_optimizer ||
+       FLAGS_distributed_local_sgd_period > 0)) {
+    // Both update the parameters outside of the master weights
+    throw std::invalid_argument(
+        "'--train_fp16_tables' can't be used with "
+        "'--distributed_shard_optimizer' or '--distributed_local_sgd_period'");
+  }
 }
 
 /* ============= Meter helpers ============= */
@@ -727,16 +1348,17 @@ void Trainer::resetMeters() {
 }
 
 void Trainer::syncMeters() {
-  syncMeter(trainLossMeter_);
-  syncMeter(validLossMeter_);
-  syncMeter(runTimeMeter_);
-  syncMeter(batchTimerMeter_);
-  syncMeter(sampleTimerMeter_);
-  syncMeter(fwdTimeMeter_);
-  syncMeter(critFwdTimeMeter_);
-  syncMeter(bwdTimeMeter_);
-  syncMeter(optimTimeMeter_);
-  syncMeter(tokenCountMeter_);
+  fl::ext::syncMeters(
+      trainLossMeter_,
+      validLossMeter_,
+      runTimeMeter_,
+      batchTimerMeter_,
+      sampleTimerMeter_,
+      fwdTimeMeter_,
+      critFwdTimeMeter_,
+      bwdTimeMeter_,
+      optimTimeMeter_,
+      tokenCountMeter_);
 }
 
 void Trainer::stopTimers() {
@@ -750,35 +1372,53 @@ void Trainer::stopTimers() {
 }
 
 /* ============= Logging helpers ============= */
-void Trainer::saveCheckpoint(const std::string& path, const std::string& suffix)
-    const {
+void Trainer::saveCheckpoint(
+    const std::string& path,
+    const std::string& suffix) {
+  if (!checkpointer_) {
+    checkpointer_ = std::make_unique<AsyncCheckpointer>(
+        /* async = */ FLAGS_exp_async_checkpoint);
+  }
+  std::vector<std::string> paths = {path};
+  if (!suffix.empty()) {
+    paths.push_back(path + suffix);
+  }
+
+  // Each process saves its part of a sharded optimizer state, in parallel,
+  // together with the shard it updates
+  auto sharded = std::dynamic_pointer_cast<fl::ShardedOptimizer>(optimizer_);
+  if (sharded) {
+    std::vector<std::string> shardPaths;
+    for (const auto& p : paths) {
+      shardPaths.push_back(getShardCheckpointPath(p));
+    }
+    int64_t worldSize = fl::getWorldSize();
+    checkpointer_->save(
+        shardPaths,
+        FL_APP_LM_VERSION,
+        worldSize,
+        sharded->getShard(),
+        sharded->getShardOptimizer());
+  }
   if (!isMaster()) {
     return;
   }
 
   FL_LOG_MASTER(INFO) << "saving model checkpoint (epoch=" << epoch_
                       << " batch=" << batchIdx_ << ") to: " << path;
-  Serializer::save(
-      path,
+  std::shared_ptr<fl::FirstOrderOptimizer> optimizer;
+  if (!sharded) {
+    optimizer = optimizer_;
+  }
+  checkpointer_->save(
+      paths,
       FL_APP_LM_VERSION,
       network_,
       criterion_,
-      optimizer_,
+      optimizer,
       epoch_,
       batchIdx_,
       gflagsStr_);
-
-  if (!suffix.empty()) {
-    Serializer::save(
-        path + suffix,
-        FL_APP_LM_VERSION,
-        network_,
-        criterion_,
-        optimizer_,
-        epoch_,
-        batchIdx_,
-        gflagsStr_);
-  }
 }
 
 void Trainer::logMemoryManagerStatus() const {
@@ -788,13 +1428,39 @@ void Trainer::logMemoryManagerStatus() const {
     if (curMemMgr) {
       curMemMgr->printInfo("Memory Manager Stats", 0 /* device id */);
     }
+    auto* cachingMemMgr = dynamic_cast<fl::CachingMemoryManager*>(curMemMgr);
+    if (cachingMemMgr && !FLAGS_exp_mem_profile_save.empty()) {
+      cachingMemMgr->getAllocationProfile().save(FLAGS_exp_mem_profile_save);
+    }
   }
 }
 
+void Trainer::setMetrics() const {
+  auto& registry = fl::MetricsRegistry::global();
+  auto setPhase = [&registry](
+                      const std::string& phase, const fl::TimeMeter& timer) {
+    registry
+        .gauge(
+            "fl_train_phase_seconds",
+            "Mean time of a phase of the training steps",
+            {{"phase", phase}})
+        .set(timer.value());
+  };
+  setPhase("data", sampleTimerMeter_);
+  setPhase("forward", fwdTimeMeter_);
+  setPhase("criterion", critFwdTimeMeter_);
+  setPhase("backward", bwdTimeMeter_);
+  setPhase("optimizer", optimTimeMeter_);
+  registry.gauge("fl_train_loss", "Training loss")
+      .set(trainLossMeter_.value()[0]);
+  registry.gauge("fl_valid_loss", "Validation loss", {{"set", "valid"}})
+      .set(validLossMeter_.value()[0]);
+}
+
 std::string Trainer::getProgress() const {
   std::ostringstream oss;
   oss << "[epoch=" << epoch_ << " batch=" << batchIdx_ << "/"
-      << trainDataset_->size() << "]";
+      << updatesPerEpoch() << "]";
 
   // Run time
   int rt = runTimeMeter_.value();
@@ -16,8 +16,12 @@
 #include "flashlight/app/lm/common/Helpers.h"
 #include "flashlight/app/lm/data/TextDataset.h"
 
+#include "flashlight/ext/common/AsyncCheckpointer.h"
+#include "flashlight/ext/common/BatchBudgetProbe.h"
 #include "flashlight/ext/common/DistributedUtils.h"
+#include "flashlight/ext/common/MetricsExporters.h"
 #include "flashlight/ext/common/Serializer.h"
+#include "flashlight/ext/common/TrainBenchmark.h"
 #include "flashlight/ext/plugin/ModulePlugin.h"
 #include "flashlight/fl/contrib/contrib.h"
 #include "flashlight/fl/flashlight.h"
@@ -38,6 +42,10 @@ namespace lm {
 DECLARE_string(loss_type);
 DECLARE_int64(loss_adsm_input_size);
 DECLARE_string(loss_adsm_cutoffs);
+DECLARE_string(loss_adsm_sampling);
+DECLARE_int64(loss_adsm_negatives);
+DECLARE_bool(loss_adsm_shared_negatives);
+DECLARE_double(loss_ce_label_smoothing);
 
 /* DISTRIBUTED TRAINING */
 DECLARE_bool(distributed_enable);
@@ -45,11 +53,23 @@ DECLARE_int64(distributed_world_rank);
 DECLARE_int64(distributed_world_size);
 DECLARE_int64(distributed_max_devices_per_node);
 DECLARE_string(distributed_rndv_filepath);
+DECLARE_bool(distributed_shard_optimizer);
+DECLARE_int64(distributed_local_sgd_period);
+DECLARE_int64(distributed_local_sgd_warmup);
+DECLARE_double(distributed_local_sgd_momentum);
+DECLARE_double(distributed_local_sgd_lr);
+DECLARE_bool(distributed_local_sgd_optim_state);
 
 /* RUN OPTIONS */
 DECLARE_string(exp_rundir);
 DECLARE_string(exp_model_name);
 DECLARE_string(exp_init_model_path);
+DECLARE_string(exp_mem_profile_save);
+DECLARE_string(exp_mem_profile_load);
+DECLARE_bool(exp_async_checkpoint);
+DECLARE_int64(exp_metrics_port);
+DECLARE_string(exp_metrics_statsd);
+DECLARE_int64(exp_metrics_statsd_interval);
 
 /* DATA OPTIONS */
 DECLARE_string(data_dir);
@@ -59,6 +79,9 @@ DECLARE_int64(data_batch_size);
 DECLARE_int64(data_tokens_per_sample);
 DECLARE_string(data_sample_break_mode);
 DECLARE_bool(data_use_dynamic_batching);
+DECLARE_bool(data_probe_batch_size);
+DECLARE_double(data_probe_margin);
+DECLARE_bool(data_token_stream);
 
 /* DICTIONARY OPTIONS */
 DECLARE_string(dictionary);
@@ -80,6 +103,12 @@ DECLARE_double(train_max_grad_norm);
 DECLARE_int64(train_save_updates);
 DECLARE_int64(train_report_updates);
 DECLARE_int64(train_total_updates);
+DECLARE_int64(train_accumulate_batches);
+DECLARE_bool(train_mixed_precision);
+DECLARE_double(train_amp_scale_factor);
+DECLARE_double(train_amp_max_scale_factor);
+DECLARE_int64(train_amp_scale_factor_update_interval);
+DECLARE_bool(train_fp16_tables);
 
 /* MASK OPTIONS */
 DECLARE_double(mask_prob);
@@ -87,6 +116,11 @@ DECLARE_double(mask_rand_token_prob);
 DECLARE_double(mask_same_token_prob);
 DECLARE_int64(mask_min_length);
 
+/* BENCHMARK OPTIONS */
+DECLARE_int64(benchmark_steps);
+DECLARE_int64(benchmark_warmup_steps);
+DECLARE_string(benchmark_output);
+
 class Trainer {
  public:
   explicit Trainer(const std::string& mode);
@@ -96,7 +130,12 @@ class Trainer {
   Trainer& operator=(const Trainer&) = delete;
 
   void runTraining();
+  // Measures the throughput of the training steps on synthetic batches with
+  // '--benchmark_steps', in the "benchmark" mode
+  void runBenchmark();
   void trainStep();
+  // A step on the batches of an update, with the sample timer running
+  void trainStep(const std::vector<std::vector<af::array>>& samples);
   void evalStep();
   float runEvaluation();
 
@@ -113,12 +152,18 @@ class Trainer {
   std::string version_{FL_APP_LM_VERSION};
 
   fl::lib::text::Dictionary dictionary_;
+  // Counts of the dictionary entries, for unigram sampling
+  std::vector<double> tokenCounts_;
   std::shared_ptr<TextDataset> trainDataset_;
   std::shared_ptr<TextDataset> validDataset_;
 
   std::shared_ptr<fl::Reducer> reducer_;
+  // Local SGD with '--distributed_local_sgd_period'
+  std::unique_ptr<fl::ModelAverager> averager_;
   std::shared_ptr<fl::FirstOrderOptimizer> optimizer_;
   std::vector<fl::Variable> parameters_;
+  // Loss scaling with '--train_mixed_precision'
+  std::unique_ptr<fl::DynamicScaler> scaler_;
 
   fl::AverageValueMeter trainLossMeter_;
   fl::AverageValueMeter validLossMeter_;
@@ -132,31 +177,58 @@ class Trainer {
   fl::AverageValueMeter tokenCountMeter_;
 
   std::ofstream logWriter_;
+  std::unique_ptr<fl::ext::AsyncCheckpointer> checkpointer_;
 
   /* Initializers */
   void initTrain();
   void initContinue();
   void initFork();
   void initEval();
+  void initBenchmark();
 
   void createDictionary();
   void createTrainDatasets();
   void createValidDatasets();
+  // Sets '--data_batch_size' with '--data_probe_batch_size', and creates the
+  // datasets again
+  void probeBatchSize();
   void createNetwork();
   void createCriterion();
+  // Applies '--train_fp16_tables' to the network and the criterion
+  void setTablesType();
+  // Applies '--loss_adsm_sampling' to the adaptive softmax criterion
+  void setCriterionSampling();
   void collectParameters();
   void createOptimizer();
 
   /* Stateful training helpers */
   std::pair<fl::Variable, fl::Variable> getInputAndTarget(
       const std::vector<af::array>& sample) const;
+  // Sizes of the inputs, or ids of the sentences packed in them with
+  // '--data_sample_break_mode=pack'
+  af::array getInputSizes(
+      const std::vector<af::array>& sample,
+      const fl::Variable& input) const;
   void setLr();
   void reduceGrads();
+  // Whether the gradients of the current update stay local, with local SGD
+  bool isLocalUpdate() const;
+  // Averages the parameters of the processes, between local updates
+  void averageModels();
+  // Unscales the reduced gradients; returns false if they overflowed
+  bool unscaleGrads();
 
   /* Stateless training helpers */
   void initArrayFire() const;
+  void initMemoryManager() const;
   std::vector<int> parseCutoffs(int64_t nClasses) const;
+  // Batches per update with '--train_accumulate_batches', and updates per
+  // epoch
+  int64_t accumulateBatches() const;
+  int64_t updatesPerEpoch() const;
   bool isMaster() const;
+  std::string getTokenStreamFiles(const std::string& filenames) const;
+  std::string getShardCheckpointPath(const std::string& path) const;
   void checkArgs() const;
 
   /* Meter helpers */
@@ -165,10 +237,11 @@ class Trainer {
   void stopTimers();
 
   /* Logging helpers */
-  void saveCheckpoint(const std::string& path, const std::string& suffix = "")
-      const;
+  void saveCheckpoint(const std::string& path, const std::string& suffix = "");
   void logMemoryManagerStatus() const;
   std::string getProgress() const;
+  // Sets the gauges of the global fl::MetricsRegistry from the meters
+  void setMetrics() const;
 };
 
 } // namespace lm
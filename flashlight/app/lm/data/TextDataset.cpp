@@ -14,8 +14,10 @@
 #include "flashlight/lib/common/String.h"
 #include "flashlight/lib/common/System.h"
 #include "flashlight/lib/text/dictionary/Defines.h"
+#include "flashlight/lib/text/dictionary/FrozenDictionary.h"
 
 using fl::lib::text::Dictionary;
+using fl::lib::text::FrozenDictionary;
 using fl::lib::text::PartialFileReader;
 using fl::lib::text::Tokenizer;
 
@@ -50,6 +52,7 @@ TextDataset::TextDataset(
   data_.reserve(kMaxTokenInBuffer);
   const auto eos = dictionary.getIndex(fl::lib::text::kEosToken);
   data_.push_back(eos);
+  const FrozenDictionary frozenDictionary(dictionary);
 
   // Each pair of indices in sentenceRanges indicates the position in data_ of
   // the 2 <eos> tokens around a given sentence.
@@ -66,7 +69,7 @@ TextDataset::TextDataset(
       }
 
       const auto tokens = tokenizer.tokenize(reader.getLine());
-      const auto indices = dictionary.mapEntriesToIndices(tokens);
+      const auto indices = frozenDictionary.mapEntriesToIndices(tokens);
       if (data_.size() + indices.size() > kMaxTokenInBuffer) {
         FL_LOG(INFO) << "[TextDataset] stop loading at 10,000,000,000 tokens";
         break;
@@ -82,6 +85,94 @@ TextDataset::TextDataset(
   const int64_t nTokens = data_.size();
 
   /* 2. Batchify */
+  batchify(
+      nTokens,
+      sentenceRanges,
+      tokensPerSample,
+      batchSize,
+      sampleBreakMode,
+      useDynamicBatching);
+
+  FL_LOG(INFO) << "[TextDataset] (" << reader.getRank() << "/"
+               << reader.getTotalReaders() << ") Loaded " << nTokens
+               << " tokens, " << sentenceRanges.size() << " sentences and "
+               << size() << " batches";
+}
+
+TextDataset::TextDataset(
+    const std::string& dataDirectory,
+    const std::string& filenames,
+    int rank,
+    int totalReaders,
+    const Dictionary& dictionary,
+    int64_t tokensPerSample /* = 1024 */,
+    int64_t batchSize /* = 1 */,
+    const std::string& sampleBreakMode /* = "none" */,
+    bool useDynamicBatching /* = false */)
+    : pad_(dictionary.getIndex(fl::lib::text::kPadToken)) {
+  /* 1. Map data */
+  // The dataset has the same layout as data_ of text files, with the parts of
+  // the streams read sharing the <eos> tokens at their boundaries
+  const auto eos = dictionary.getIndex(fl::lib::text::kEosToken);
+  std::vector<std::pair<int64_t, int64_t>> sentenceRanges;
+  int64_t nTokens = 0;
+  auto files = lib::split(',', filenames);
+  for (const auto& file : files) {
+    const auto path = fl::lib::pathsConcat(dataDirectory, file);
+    auto stream = std::make_shared<TokenStream>(path);
+    if (stream->eos() != eos ||
+        stream->dictionarySize() !=
+            static_cast<int64_t>(dictionary.entrySize())) {
+      throw std::invalid_argument(
+          "[TextDataset] " + path +
+          " was tokenized with a different dictionary");
+    }
+    const int64_t nSentences = stream->numSentences();
+    const int64_t firstSentence = nSentences * rank / totalReaders;
+    const int64_t lastSentence = nSentences * (rank + 1) / totalReaders;
+    if (firstSentence == lastSentence) {
+      continue;
+    }
+    const auto firstEos = stream->eosPosition(firstSentence);
+    const auto lastEos = stream->eosPosition(lastSentence);
+    // Position in the dataset of the <eos> token before the first sentence
+    const int64_t eosBegin = nTokens == 0 ? 0 : nTokens - 1;
+    StreamRegion region{stream, nTokens, firstEos, lastEos - firstEos + 1};
+    if (nTokens > 0) {
+      ++region.first;
+      --region.count;
+    }
+    for (int64_t i = firstSentence; i < lastSentence; ++i) {
+      sentenceRanges.emplace_back(
+          eosBegin + stream->eosPosition(i) - firstEos,
+          eosBegin + stream->eosPosition(i + 1) - firstEos);
+    }
+    nTokens += region.count;
+    streamRegions_.push_back(std::move(region));
+  }
+
+  /* 2. Batchify */
+  batchify(
+      nTokens,
+      sentenceRanges,
+      tokensPerSample,
+      batchSize,
+      sampleBreakMode,
+      useDynamicBatching);
+
+  FL_LOG(INFO) << "[TextDataset] (" << rank << "/" << totalReaders
+               << ") Mapped " << nTokens << " tokens, "
+               << sentenceRanges.size() << " sentences and " << size()
+               << " batches";
+}
+
+void TextDataset::batchify(
+    int64_t nTokens,
+    std::vector<std::pair<int64_t, int64_t>>& sentenceRanges,
+    int64_t tokensPerSample,
+    int64_t batchSize,
+    const std::string& sampleBreakMode,
+    bool useDynamicBatching) {
   if (batchSize <= 0) {
     throw std::invalid_argument(
         "[TextDataset] BatchSize needs to be positive.");
@@ -141,16 +232,71 @@ TextDataset::TextDataset(
     if (!batch.empty()) {
       batches_.push_back(std::move(batch));
     }
+  } else if (sampleBreakMode == "pack") {
+    // Consecutive sentences are packed into samples, sharing the <eos> tokens
+    // between them, as long as they fit in `tokensPerSample` tokens;
+    // Sentences with length > `tokensPerSample` are skipped;
+    // Total tokens per batch <= `batchSize` * `tokensPerSample`
+
+    std::vector<SamplePosition> batch;
+    SamplePosition sample{-1, -1};
+    auto addSample = [&]() {
+      if (sample.first < 0) {
+        return;
+      }
+      batch.push_back(sample);
+      sample = SamplePosition{-1, -1};
+      if (batch.size() == batchSize) {
+        batches_.push_back(std::move(batch));
+        batch = std::vector<SamplePosition>();
+      }
+    };
+    for (const auto& range : sentenceRanges) {
+      if (range.second - range.first + 1 > tokensPerSample) {
+        addSample();
+        continue;
+      }
+      if (sample.first >= 0 && range.first == sample.last &&
+          range.second - sample.first + 1 <= tokensPerSample) {
+        sample.last = range.second;
+      } else {
+        addSample();
+        sample = SamplePosition{range.first, range.second};
+      }
+    }
+    addSample();
+    if (!batch.empty()) {
+      batches_.push_back(std::move(batch));
+    }
   } else {
     throw std::invalid_argument(
-        "Invalid sampleBreakMode: should be none or eos, but it is given " +
+        "Invalid sampleBreakMode: should be none, eos or pack, but it is "
+        "given " +
         sampleBreakMode);
   }
+}
 
-  FL_LOG(INFO) << "[TextDataset] (" << reader.getRank() << "/"
-               << reader.getTotalReaders() << ") Loaded " << nTokens
-               << " tokens, " << sentenceRanges.size() << " sentences and "
-               << size() << " batches";
+void TextDataset::readTokens(int64_t first, int64_t count, int* out) const {
+  if (streamRegions_.empty()) {
+    std::memcpy(out, data_.data() + first, sizeof(int) * count);
+    return;
+  }
+  // The last region beginning at or before `first`
+  auto region = std::upper_bound(
+      streamRegions_.begin(),
+      streamRegions_.end(),
+      first,
+      [](int64_t pos, const StreamRegion& r) { return pos < r.begin; });
+  --region;
+  while (count > 0) {
+    const int64_t offset = first - region->begin;
+    const int64_t n = std::min(count, region->count - offset);
+    region->stream->read(region->first + offset, n, out);
+    first += n;
+    count -= n;
+    out += n;
+    ++region;
+  }
 }
 
 int64_t TextDataset::size() const {
@@ -166,10 +312,8 @@ std::vector<af::array> TextDataset::get(const int64_t idx) const {
   std::vector<int> buffer(batch.size() * maxLength, pad_);
   for (int64_t i = 0; i < batch.size(); ++i) {
     const auto& pos = batch[i];
-    std::memcpy(
-        buffer.data() + i * maxLength,
-        data_.data() + pos.first,
-        sizeof(int) * (pos.last - pos.first + 1));
+    readTokens(
+        pos.first, pos.last - pos.first + 1, buffer.data() + i * maxLength);
   }
   return {af::array(maxLength, batch.size(), buffer.data())};
 }
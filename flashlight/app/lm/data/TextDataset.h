@@ -7,9 +7,12 @@
 
 #pragma once
 
+#include <memory>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "flashlight/app/lm/data/TokenStream.h"
 #include "flashlight/fl/flashlight.h"
 #include "flashlight/lib/text/dictionary/Dictionary.h"
 #include "flashlight/lib/text/tokenizer/PartialFileReader.h"
@@ -41,11 +44,23 @@ namespace lm {
  * - "eos": Each sentence is a sample padded with <eos> on both ends.
  *          Sentences with length > `tokensPerSample` are skipped;
  *          Total tokens per batch <= `batchSize` * `tokensPerSample`
+ * - "pack": Consecutive sentences are packed into samples of at most
+ *           `tokensPerSample` tokens, each sentence sharing its <eos> tokens
+ *           with its neighbours. Sentences with length > `tokensPerSample`
+ *           are skipped. Samples are mostly full, so that there is little
+ *           padding; the sentences of a sample are told apart by their <eos>
+ *           tokens, e.g. to pass their ids to `fl::Transformer`.
  * @param useDynamicBatching Use dynamic batching when `sampleBreakMode`="eos".
  * In this case, `batchsize` is ignored and as many sentences as possible are
  * included in each batch. All samples are padded with token <pad> to the length
  * of the longest one in a certain batch. To better fit more samples in each
  * batch, samples are sorted by length.
+ *
+ * Alternatively, TextDataset can read pre-tokenized files written by
+ * `TokenStreamWriter` (e.g. with `fl_lm_dictionary_builder
+ * --write_token_stream`), which are memory-mapped instead of being read and
+ * tokenized: each of the `totalReaders` readers takes an equal part of the
+ * sentences of each file.
  */
 
 class TextDataset : public fl::Dataset {
@@ -61,6 +76,17 @@ class TextDataset : public fl::Dataset {
       const std::string& sampleBreakMode = "none",
       bool useDynamicBatching = false);
 
+  TextDataset(
+      const std::string& dataDirectory,
+      const std::string& filenames,
+      int rank,
+      int totalReaders,
+      const fl::lib::text::Dictionary& dictionary,
+      int64_t tokensPerSample = 1024,
+      int64_t batchSize = 1,
+      const std::string& sampleBreakMode = "none",
+      bool useDynamicBatching = false);
+
   int64_t size() const override;
 
   std::vector<af::array> get(const int64_t idx) const override;
@@ -75,7 +101,27 @@ class TextDataset : public fl::Dataset {
     int64_t last;
   };
 
+  // The parts of the token streams read, in order, if pre-tokenized
+  struct StreamRegion {
+    std::shared_ptr<TokenStream> stream;
+    int64_t begin; // position of the first token in the dataset
+    int64_t first; // position of the first token in the stream
+    int64_t count;
+  };
+
+  // Forms batches_ from the positions of the <eos> tokens around sentences
+  void batchify(
+      int64_t nTokens,
+      std::vector<std::pair<int64_t, int64_t>>& sentenceRanges,
+      int64_t tokensPerSample,
+      int64_t batchSize,
+      const std::string& sampleBreakMode,
+      bool useDynamicBatching);
+
+  void readTokens(int64_t first, int64_t count, int* out) const;
+
   std::vector<int> data_; // eos prepended, so all indices shifted by 1
+  std::vector<StreamRegion> streamRegions_;
   std::vector<std::vector<SamplePosition>> batches_;
 };
 
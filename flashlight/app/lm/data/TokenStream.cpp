@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/app/lm/data/TokenStream.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace fl {
+namespace app {
+namespace lm {
+
+namespace {
+
+constexpr char kMagic[8] = {'F', 'L', 'T', 'O', 'K', 'E', 'N', 'S'};
+constexpr uint32_t kFormatVersion = 1;
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t tokenBytes;
+  int64_t numTokens;
+  int64_t numSentences;
+  int64_t eos;
+  int64_t dictionarySize;
+  uint64_t indexOffset;
+  uint64_t reserved;
+};
+static_assert(sizeof(Header) == 64, "unexpected padding in Header");
+
+} // namespace
+
+TokenStreamWriter::TokenStreamWriter(
+    const std::string& path,
+    int eos,
+    int64_t dictionarySize)
+    : path_(path),
+      stream_(path + ".tmp", std::ios::binary | std::ios::trunc),
+      eos_(eos),
+      dictionarySize_(dictionarySize),
+      tokenBytes_(
+          dictionarySize <= std::numeric_limits<uint16_t>::max() + 1 ? 2 : 4) {
+  if (!stream_.is_open()) {
+    throw std::runtime_error(
+        "TokenStreamWriter: failed to open file for writing: " + path_ +
+        ".tmp");
+  }
+  // The header is written by close(), once the sizes are known
+  Header header{};
+  stream_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  eosPositions_.push_back(0);
+  writeToken(eos_);
+}
+
+TokenStreamWriter::~TokenStreamWriter() {
+  if (!closed_) {
+    // An incomplete stream is discarded
+    stream_.close();
+    std::remove((path_ + ".tmp").c_str());
+  }
+}
+
+void TokenStreamWriter::writeToken(int index) {
+  if (index < 0 || index >= dictionarySize_) {
+    throw std::invalid_argument(
+        "TokenStreamWriter: token index out of the dictionary: " +
+        std::to_string(index));
+  }
+  if (tokenBytes_ == 2) {
+    auto value = static_cast<uint16_t>(index);
+    stream_.write(reinterpret_cast<const char*>(&value), sizeof(value));
+  } else {
+    auto value = static_cast<int32_t>(index);
+    stream_.write(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+  ++numTokens_;
+}
+
+void TokenStreamWriter::addSentence(const std::vector<int>& indices) {
+  if (closed_) {
+    throw std::logic_error("TokenStreamWriter: addSentence after close");
+  }
+  for (auto index : indices) {
+    writeToken(index);
+  }
+  eosPositions_.push_back(numTokens_);
+  writeToken(eos_);
+}
+
+void TokenStreamWriter::close() {
+  if (closed_) {
+    return;
+  }
+  // The index is aligned for direct access in the mapping
+  uint64_t indexOffset = sizeof(Header) + numTokens_ * tokenBytes_;
+  std::vector<char> padding((8 - indexOffset % 8) % 8, 0);
+  stream_.write(padding.data(), padding.size());
+  indexOffset += padding.size();
+  stream_.write(
+      reinterpret_cast<const char*>(eosPositions_.data()),
+      eosPositions_.size() * sizeof(uint64_t));
+
+  Header header{};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kFormatVersion;
+  header.tokenBytes = tokenBytes_;
+  header.numTokens = numTokens_;
+  header.numSentences = eosPositions_.size() - 1;
+  header.eos = eos_;
+  header.dictionarySize = dictionarySize_;
+  header.indexOffset = indexOffset;
+  stream_.seekp(0);
+  stream_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  stream_.close();
+  if (!stream_) {
+    throw std::runtime_error(
+        "TokenStreamWriter: failed to write file: " + path_ + ".tmp");
+  }
+  if (std::rename((path_ + ".tmp").c_str(), path_.c_str()) != 0) {
+    throw std::runtime_error("TokenStreamWriter: failed to rename " + path_);
+  }
+  closed_ = true;
+}
+
+TokenStream::TokenStream(const std::string& path) : path_(path) {
+  mapping_ = std::make_unique<fl::lib::MemoryMappedFile>(path);
+  if (mapping_->size() < sizeof(Header)) {
+    throw std::runtime_error("TokenStream: invalid file: " + path);
+  }
+
+  Header header;
+  std::memcpy(&header, mapping_->data(), sizeof(header));
+  tokenBytes_ = header.tokenBytes;
+  numTokens_ = header.numTokens;
+  numSentences_ = header.numSentences;
+  eos_ = header.eos;
+  dictionarySize_ = header.dictionarySize;
+  uint64_t indexBytes = (numSentences_ + 1) * sizeof(uint64_t);
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kFormatVersion ||
+      (tokenBytes_ != 2 && tokenBytes_ != 4) || numTokens_ < 1 ||
+      numSentences_ < 0 ||
+      sizeof(Header) + numTokens_ * tokenBytes_ > header.indexOffset ||
+      header.indexOffset + indexBytes > mapping_->size()) {
+    throw std::runtime_error("TokenStream: invalid header: " + path);
+  }
+  auto base = mapping_->data();
+  tokens_ = base + sizeof(Header);
+  eosPositions_ = reinterpret_cast<const uint64_t*>(base + header.indexOffset);
+}
+
+int64_t TokenStream::numTokens() const {
+  return numTokens_;
+}
+
+int64_t TokenStream::numSentences() const {
+  return numSentences_;
+}
+
+int64_t TokenStream::eosPosition(int64_t i) const {
+  if (i < 0 || i > numSentences_) {
+    throw std::out_of_range(
+        "TokenStream: sentence index " + std::to_string(i) +
+        " out of range for " + path_);
+  }
+  return eosPositions_[i];
+}
+
+int TokenStream::eos() const {
+  return eos_;
+}
+
+int64_t TokenStream::dictionarySize() const {
+  return dictionarySize_;
+}
+
+void TokenStream::read(int64_t first, int64_t count, int* out) const {
+  if (first < 0 || count < 0 || first + count > numTokens_) {
+    throw std::out_of_range("TokenStream: read out of range for " + path_);
+  }
+  if (tokenBytes_ == 2) {
+    auto tokens = reinterpret_cast<const uint16_t*>(tokens_) + first;
+    std::copy(tokens, tokens + count, out);
+  } else {
+    std::memcpy(out, tokens_ + first * tokenBytes_, count * sizeof(int));
+  }
+}
+
+} // namespace lm
+} // namespace app
+} // namespace fl
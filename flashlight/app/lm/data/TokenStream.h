@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "flashlight/lib/common/System.h"
+
+namespace fl {
+namespace app {
+namespace lm {
+
+/**
+ * Suffix of the token streams written next to text files by
+ * `fl_lm_dictionary_builder --write_token_stream`.
+ */
+constexpr const char* kTokenStreamSuffix = ".tok";
+
+/**
+ * Writes a pre-tokenized text file: the token indices of the sentences, laid
+ * out as
+ *   <eos> sentence <eos> sentence <eos> ... <eos> sentence <eos>
+ * followed by an index of the positions of the <eos> tokens. Indices are
+ * stored as uint16 if the dictionary has at most 65536 entries, and as int32
+ * otherwise.
+ *
+ * The file is written to a temporary path, renamed once `close()` is called.
+ */
+class TokenStreamWriter {
+ public:
+  TokenStreamWriter(const std::string& path, int eos, int64_t dictionarySize);
+  ~TokenStreamWriter();
+
+  void addSentence(const std::vector<int>& indices);
+
+  void close();
+
+ private:
+  void writeToken(int index);
+
+  std::string path_;
+  std::ofstream stream_;
+  int eos_;
+  int64_t dictionarySize_;
+  uint32_t tokenBytes_;
+  int64_t numTokens_{0};
+  std::vector<uint64_t> eosPositions_;
+  bool closed_{false};
+};
+
+/**
+ * A memory-mapped token stream written by `TokenStreamWriter`. Opening it only
+ * reads the header: tokens are read from disk by the OS when accessed, and
+ * the pages are shared by all the processes reading the same file.
+ */
+class TokenStream {
+ public:
+  explicit TokenStream(const std::string& path);
+
+  TokenStream(const TokenStream&) = delete;
+  TokenStream& operator=(const TokenStream&) = delete;
+
+  /** Returns the number of tokens, including <eos> tokens. */
+  int64_t numTokens() const;
+
+  int64_t numSentences() const;
+
+  /**
+   * Returns the position of the <eos> token before the `i`-th sentence, for
+   * `i` in [0, numSentences()]; `numSentences()` gives the last <eos>.
+   */
+  int64_t eosPosition(int64_t i) const;
+
+  int eos() const;
+
+  int64_t dictionarySize() const;
+
+  /** Copies the tokens at positions [first, first + count) to `out`. */
+  void read(int64_t first, int64_t count, int* out) const;
+
+ private:
+  std::string path_;
+  std::unique_ptr<fl::lib::MemoryMappedFile> mapping_;
+  uint32_t tokenBytes_;
+  int64_t numTokens_;
+  int64_t numSentences_;
+  int eos_;
+  int64_t dictionarySize_;
+  const char* tokens_;
+  const uint64_t* eosPositions_;
+};
+
+} // namespace lm
+} // namespace app
+} // namespace fl
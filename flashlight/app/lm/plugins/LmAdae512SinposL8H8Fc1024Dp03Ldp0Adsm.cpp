@@ -43,10 +43,17 @@ class LmAdae512SinposL8H8Fc1024Dp03Ldp0Adsm : public fl::Container {
     auto xSizes = input[1].array();
     // expected input dims T x B x 1 x 1
     int T = out.dims(0), B = out.dims(1);
-    auto inputMaxSize = af::tile(af::max(xSizes), 1, B);
-    af::array inputNotPaddedSize = af::ceil(xSizes * T / inputMaxSize);
-    auto padMask = af::iota(af::dim4(T, 1), af::dim4(1, B)) <
-        af::tile(inputNotPaddedSize, T, 1);
+    af::array padMask;
+    if (T > 1 && xSizes.dims(0) == T) {
+      // ids of the sentences packed in the samples (--data_sample_break_mode
+      // =pack), which are used as is by the transformers
+      padMask = xSizes;
+    } else {
+      auto inputMaxSize = af::tile(af::max(xSizes), 1, B);
+      af::array inputNotPaddedSize = af::ceil(xSizes * T / inputMaxSize);
+      padMask = af::iota(af::dim4(T, 1), af::dim4(1, B)) <
+          af::tile(inputNotPaddedSize, T, 1);
+    }
     out = frontend_->forward(out);
     for (int trIdx = 0; trIdx < transformers_.size(); trIdx++) {
       out = transformers_[trIdx]->forward({out, fl::noGrad(padMask)}).front();
@@ -11,6 +11,7 @@
 #include <gtest/gtest.h>
 
 #include "flashlight/app/lm/data/TextDataset.h"
+#include "flashlight/app/lm/data/TokenStream.h"
 #include "flashlight/fl/common/Init.h"
 #include "flashlight/lib/text/dictionary/Defines.h"
 #include "flashlight/lib/text/dictionary/Dictionary.h"
@@ -132,6 +133,94 @@ TEST(TextDatasetTest, EosModeWithDynamicBatching) {
   }
 }
 
+TEST(TextDatasetTest, PackMode) {
+  fl::lib::text::Tokenizer tokenizer;
+  fl::lib::text::PartialFileReader partialFileReader(0, 1);
+  Dictionary dictionary =
+      createDictionary(pathsConcat(dataDir, "dictionary.txt"));
+  const int eos = dictionary.getIndex(kEosToken);
+
+  int tokensPerSample = 12;
+  int batchSize = 2;
+
+  TextDataset dataset(
+      dataDir,
+      "train.txt",
+      partialFileReader,
+      tokenizer,
+      dictionary,
+      tokensPerSample,
+      batchSize,
+      "pack");
+
+  ASSERT_EQ(dataset.size(), 2);
+
+  // Sentences of 7, 6 | 5, 4, 5 | 5, 6 | 7 tokens with their <eos>, sharing
+  // the <eos> between them
+  std::vector<int> targetLen = {12, 10};
+  std::vector<std::vector<int>> targetEos = {{3, 4}, {3, 2}};
+  for (int i = 0; i < dataset.size(); i++) {
+    auto sample = dataset.get(i);
+    ASSERT_EQ(sample.size(), 1);
+    ASSERT_EQ(sample[0].dims(0), targetLen[i]);
+    ASSERT_EQ(sample[0].dims(1), batchSize);
+    for (int b = 0; b < batchSize; ++b) {
+      ASSERT_EQ(af::count<int>(sample[0].col(b) == eos), targetEos[i][b]);
+    }
+  }
+}
+
+TEST(TextDatasetTest, TokenStream) {
+  fl::lib::text::Tokenizer tokenizer;
+  Dictionary dictionary =
+      createDictionary(pathsConcat(dataDir, "dictionary.txt"));
+
+  // Tokenize the text file twice, so that streams are concatenated
+  const auto tmpDir = getTmpPath("TextDatasetTest");
+  dirCreate(tmpDir);
+  const std::string streamFile = "train.txt" + std::string(kTokenStreamSuffix);
+  {
+    TokenStreamWriter writer(
+        pathsConcat(tmpDir, streamFile),
+        dictionary.getIndex(kEosToken),
+        dictionary.entrySize());
+    fl::lib::text::PartialFileReader reader(0, 1);
+    reader.loadFile(pathsConcat(dataDir, "train.txt"));
+    while (reader.hasNextLine()) {
+      auto tokens = tokenizer.tokenize(reader.getLine());
+      writer.addSentence(dictionary.mapEntriesToIndices(tokens));
+    }
+    writer.close();
+  }
+  for (const std::string mode : {"none", "eos", "pack"}) {
+    fl::lib::text::PartialFileReader reader(0, 1);
+    TextDataset text(
+        dataDir,
+        "train.txt,train.txt",
+        reader,
+        tokenizer,
+        dictionary,
+        5,
+        2,
+        mode);
+    TextDataset mapped(
+        tmpDir, streamFile + "," + streamFile, 0, 1, dictionary, 5, 2, mode);
+    ASSERT_EQ(mapped.size(), text.size());
+    for (int i = 0; i < text.size(); i++) {
+      auto expected = text.get(i);
+      auto sample = mapped.get(i);
+      ASSERT_EQ(sample[0].dims(), expected[0].dims());
+      ASSERT_TRUE(af::allTrue<bool>(sample[0] == expected[0]));
+    }
+  }
+
+  // Mismatched dictionaries are detected
+  Dictionary other = dictionary;
+  other.addEntry("__other_token__");
+  ASSERT_THROW(
+      TextDataset(tmpDir, streamFile, 0, 1, other), std::invalid_argument);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   fl::init();
@@ -0,0 +1,117 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/ext/common/AsyncCheckpointer.h"
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+#include "flashlight/lib/common/System.h"
+
+namespace fl {
+namespace ext {
+
+namespace {
+
+void writeImpl(const std::string& filepath, const std::string& data) {
+  auto tmpPath = filepath + ".tmp";
+  {
+    std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+      throw std::runtime_error("failed to open file for writing: " + tmpPath);
+    }
+    file.write(data.data(), data.size());
+    file.flush();
+    if (!file) {
+      throw std::runtime_error("failed to write file: " + tmpPath);
+    }
+  }
+  // Atomically replace the previous checkpoint
+  if (std::rename(tmpPath.c_str(), filepath.c_str()) != 0) {
+    throw std::runtime_error("failed to rename " + tmpPath + " to " + filepath);
+  }
+}
+
+void writeFiles(
+    const std::vector<std::string>& filepaths,
+    const std::shared_ptr<const std::string>& data) {
+  for (const auto& filepath : filepaths) {
+    try {
+      lib::retryWithBackoff(
+          std::chrono::seconds(1),
+          2.0,
+          6,
+          writeImpl,
+          filepath,
+          *data); // max wait 31s
+    } catch (const std::exception& ex) {
+      FL_LOG(fl::ERROR) << "Error while saving \"" << filepath
+                        << "\": " << ex.what() << "\n";
+      throw;
+    }
+  }
+}
+
+} // namespace
+
+AsyncCheckpointer::AsyncCheckpointer(
+    bool async /* = true */,
+    size_t maxPending /* = 2 */)
+    : async_(async), maxPending_(maxPending) {
+  if (maxPending_ == 0) {
+    throw std::invalid_argument("AsyncCheckpointer: maxPending must be > 0");
+  }
+  if (async_) {
+    threadPool_ = std::make_unique<ThreadPool>(1);
+  }
+}
+
+AsyncCheckpointer::~AsyncCheckpointer() {
+  try {
+    wait();
+  } catch (const std::exception&) {
+    // Already logged by the writer
+  }
+}
+
+void AsyncCheckpointer::write(
+    const std::vector<std::string>& filepaths,
+    std::shared_ptr<const std::string> data) {
+  if (!async_) {
+    writeFiles(filepaths, data);
+    return;
+  }
+  while (pending_.size() >= maxPending_) {
+    auto oldest = std::move(pending_.front());
+    pending_.pop_front();
+    oldest.get();
+  }
+  pending_.push_back(
+      threadPool_->enqueue(writeFiles, filepaths, std::move(data)));
+}
+
+void AsyncCheckpointer::wait() {
+  std::exception_ptr error;
+  while (!pending_.empty()) {
+    try {
+      pending_.front().get();
+    } catch (...) {
+      if (!error) {
+        error = std::current_exception();
+      }
+    }
+    pending_.pop_front();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+} // namespace ext
+} // namespace fl
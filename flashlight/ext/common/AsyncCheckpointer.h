@@ -0,0 +1,105 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <deque>
+#include <future>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "flashlight/fl/common/threadpool/ThreadPool.h"
+#include "flashlight/fl/flashlight.h"
+
+namespace fl {
+namespace ext {
+
+/**
+ * Saves checkpoints in the format of `Serializer::save` without blocking the
+ * caller on the filesystem.
+ *
+ * `save` serializes its arguments to host memory, copying the arrays from the
+ * device: the snapshot is consistent with the state at the call, and training
+ * can modify the arguments as soon as it returns. The serialized bytes are
+ * then written by a background thread to temporary files, which are renamed
+ * to the destinations, so that a checkpoint is either complete or absent.
+ *
+ * Writes are made one at a time, in order. At most `maxPending` snapshots are
+ * kept in host memory: `save` waits for the oldest write if there are more.
+ */
+class AsyncCheckpointer {
+ public:
+  /**
+   * @param async Whether files are written in the background, or by `save`
+   * @param maxPending The maximum number of snapshots waiting to be written
+   */
+  explicit AsyncCheckpointer(bool async = true, size_t maxPending = 2);
+
+  /** Waits for the pending writes; write errors are logged. */
+  ~AsyncCheckpointer();
+
+  AsyncCheckpointer(const AsyncCheckpointer&) = delete;
+  AsyncCheckpointer& operator=(const AsyncCheckpointer&) = delete;
+
+  /**
+   * Snapshots the arguments, and writes the snapshot to all the given paths
+   * (e.g. the last and the best checkpoints). Rethrows the errors of previous
+   * writes waited for.
+   */
+  template <class... Args>
+  void save(
+      const std::vector<std::string>& filepaths,
+      const std::string& version,
+      const Args&... args) {
+    write(filepaths, snapshot(version, args...));
+  }
+
+  /**
+   * Snapshots the arguments, as `save` does, without writing them: the
+   * snapshot can be written later with `write`, e.g. to save the model of a
+   * validation which finished since as the best one.
+   */
+  template <class... Args>
+  static std::shared_ptr<const std::string> snapshot(
+      const std::string& version,
+      const Args&... args) {
+    auto data = std::make_shared<std::string>();
+    {
+      std::ostringstream stream;
+      cereal::BinaryOutputArchive ar(stream);
+      ar(version);
+      ar(args...);
+      *data = stream.str();
+    }
+    return data;
+  }
+
+  /**
+   * Writes a snapshot to all the given paths.
+   */
+  void write(
+      const std::vector<std::string>& filepaths,
+      std::shared_ptr<const std::string> data);
+
+  /**
+   * Blocks until all the pending writes are done, and rethrows the first
+   * error among them.
+   */
+  void wait();
+
+ private:
+  bool async_;
+  size_t maxPending_;
+  std::deque<std::future<void>> pending_;
+  std::unique_ptr<ThreadPool> threadPool_;
+};
+
+} // namespace ext
+} // namespace fl
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/ext/common/BatchBudgetProbe.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <arrayfire.h>
+
+#include "flashlight/fl/common/Logging.h"
+#include "flashlight/fl/distributed/distributed.h"
+#include "flashlight/fl/memory/memory.h"
+
+namespace fl {
+namespace ext {
+
+size_t measurePeakMemory(const std::function<void()>& fn) {
+  auto* manager = dynamic_cast<fl::CachingMemoryManager*>(
+      fl::MemoryManagerInstaller::currentlyInstalledMemoryManager());
+  if (!manager) {
+    throw std::runtime_error(
+        "measurePeakMemory: needs the CachingMemoryManager");
+  }
+  af::sync();
+  manager->signalMemoryCleanup();
+  manager->resetPeakMemoryStats();
+  size_t peak;
+  try {
+    fn();
+    af::sync();
+    peak = manager->getMemoryStats().peakAllocatedBytes;
+  } catch (const af::exception& ex) {
+    if (ex.err() != AF_ERR_NO_MEM) {
+      throw;
+    }
+    peak = std::numeric_limits<size_t>::max();
+  }
+  af::sync();
+  manager->signalMemoryCleanup();
+  return peak;
+}
+
+int64_t searchMaxBudget(
+    const std::function<bool(int64_t)>& fits,
+    int64_t minBudget,
+    int64_t maxBudget) {
+  if (minBudget < 1 || maxBudget < minBudget) {
+    throw std::invalid_argument(
+        "searchMaxBudget: needs 1 <= minBudget <= maxBudget");
+  }
+  if (!fits(minBudget)) {
+    return 0;
+  }
+  // fits(good), !fits(bad) if bad <= maxBudget
+  int64_t good = minBudget;
+  int64_t bad = maxBudget + 1;
+  while (good < maxBudget) {
+    int64_t next = std::min(2 * good, maxBudget);
+    if (!fits(next)) {
+      bad = next;
+      break;
+    }
+    good = next;
+  }
+  while (bad - good > 1) {
+    int64_t mid = good + (bad - good) / 2;
+    if (fits(mid)) {
+      good = mid;
+    } else {
+      bad = mid;
+    }
+  }
+  return good;
+}
+
+int64_t findMaxBatchBudget(
+    const std::function<void(int64_t)>& step,
+    int64_t minBudget,
+    int64_t maxBudget,
+    double safetyMargin /* = 0.1 */) {
+  auto* manager = dynamic_cast<fl::CachingMemoryManager*>(
+      fl::MemoryManagerInstaller::currentlyInstalledMemoryManager());
+  size_t capacity = manager ? manager->getMemoryStats().capacityBytes : 0;
+  if (capacity == 0) {
+    throw std::runtime_error(
+        "findMaxBatchBudget: needs the CachingMemoryManager, on a device of "
+        "known memory");
+  }
+  const double limit = (1 - safetyMargin) * capacity;
+  auto fits = [&](int64_t budget) {
+    size_t peak = measurePeakMemory([&]() { step(budget); });
+    FL_LOG(fl::INFO) << "Batch budget probe: " << budget << " -> "
+                     << (peak == std::numeric_limits<size_t>::max()
+                             ? std::string("out of memory")
+                             : std::to_string(peak >> 20) + " MB")
+                     << " of " << (capacity >> 20) << " MB";
+    return peak <= limit;
+  };
+  int64_t budget = searchMaxBudget(fits, minBudget, maxBudget);
+
+  if (fl::isDistributedInit() && fl::getWorldSize() > 1) {
+    // One slot per process, summed
+    std::vector<double> budgets(fl::getWorldSize(), 0);
+    budgets[fl::getWorldRank()] = budget;
+    af::array all(budgets.size(), budgets.data());
+    fl::allReduce(all);
+    budget = af::min<double>(all);
+  }
+  return budget;
+}
+
+} // namespace ext
+} // namespace fl
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace fl {
+namespace ext {
+
+/**
+ * Returns the peak of the device memory held by the `CachingMemoryManager`
+ * while running `fn`, in bytes, with the cache of the active device freed
+ * before. The memory allocated before (e.g. the parameters and the states of
+ * the optimizer) is included. Returns `SIZE_MAX` if `fn` runs out of memory.
+ * Throws if the `CachingMemoryManager` isn't the installed memory manager.
+ */
+size_t measurePeakMemory(const std::function<void()>& fn);
+
+/**
+ * Returns the largest budget in [`minBudget`, `maxBudget`] for which
+ * `fits(budget)`, assuming that larger budgets need more memory: budgets are
+ * doubled from `minBudget` until one doesn't fit, then bisected. Returns 0
+ * if `minBudget` doesn't fit.
+ */
+int64_t searchMaxBudget(
+    const std::function<bool(int64_t)>& fits,
+    int64_t minBudget,
+    int64_t maxBudget);
+
+/**
+ * Finds the largest batch budget (in samples, tokens, frames...) for which
+ * `step(budget)` - typically the forward and backward of a synthesized
+ * worst-case batch of the budget with the real criterion - peaks below
+ * `1 - safetyMargin` of the memory of the device (see `measurePeakMemory()`).
+ * The margin is headroom for what the probe doesn't allocate, like the
+ * buffers of distributed gradients or fragmentation over a run. `step` must
+ * not communicate with other processes: in distributed training, every
+ * process probes alone, and the minimum of their budgets is returned to all.
+ * Returns 0 if `minBudget` doesn't fit.
+ */
+int64_t findMaxBatchBudget(
+    const std::function<void(int64_t)>& step,
+    int64_t minBudget,
+    int64_t maxBudget,
+    double safetyMargin = 0.1);
+
+} // namespace ext
+} // namespace fl
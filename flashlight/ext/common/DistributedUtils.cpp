@@ -17,6 +17,7 @@ void initDistributed(
     int worldSize,
     int maxDevicesPerNode,
     const std::string& rndvFilepath) {
+  const std::string kTcpPrefix = "tcp://";
   if (rndvFilepath.empty()) {
     distributedInit(
         fl::DistributedInit::MPI,
@@ -24,6 +25,15 @@ void initDistributed(
         -1, // unused for MPI
         {{fl::DistributedConstants::kMaxDevicePerNode,
           std::to_string(maxDevicesPerNode)}});
+  } else if (rndvFilepath.compare(0, kTcpPrefix.size(), kTcpPrefix) == 0) {
+    distributedInit(
+        fl::DistributedInit::TCP,
+        worldRank,
+        worldSize,
+        {{fl::DistributedConstants::kMaxDevicePerNode,
+          std::to_string(maxDevicesPerNode)},
+         {fl::DistributedConstants::kTcpAddress,
+          rndvFilepath.substr(kTcpPrefix.size())}});
   } else {
     distributedInit(
         fl::DistributedInit::FILE_SYSTEM,
@@ -57,12 +67,22 @@ af::array allreduceGet(fl::TimeMeter& mtr) {
   return af::constant(mtr.value(), 1, af::dtype::f64);
 }
 
+af::array allreduceGet(fl::EventTimeMeter& mtr) {
+  return af::constant(mtr.value(), 1, af::dtype::f64);
+}
+
 af::array allreduceGet(fl::TopKMeter& mtr) {
   std::pair<int32_t, int32_t> stats = mtr.getStats();
   std::vector<int32_t> vec = {stats.first, stats.second};
   return af::array(vec.size(), vec.data());
 }
 
+af::array allreduceGet(fl::LatencyMeter& mtr) {
+  // Counts are exact as doubles below 2^53
+  auto state = mtr.getState();
+  return af::array(state.size(), state.data());
+}
+
 void allreduceSet(fl::AverageValueMeter& mtr, af::array& val) {
   mtr.reset();
   auto valVec = afToVector<double>(val);
@@ -96,10 +116,88 @@ void allreduceSet(fl::TimeMeter& mtr, af::array& val) {
   mtr.set(valVec[0] / worldSize);
 }
 
+void allreduceSet(fl::EventTimeMeter& mtr, af::array& val) {
+  auto worldSize = fl::getWorldSize();
+  auto valVec = afToVector<double>(val);
+  mtr.set(valVec[0] / worldSize);
+}
+
 void allreduceSet(fl::TopKMeter& mtr, af::array& val) {
   mtr.reset();
   auto valVec = afToVector<int32_t>(val);
   mtr.set(valVec[0], valVec[1]);
 }
+
+void allreduceSet(fl::LatencyMeter& mtr, af::array& val) {
+  mtr.set(afToVector<double>(val));
+}
+
+void allReduceJoined(std::vector<af::array>& arrs) {
+  std::vector<double> joined;
+  for (const auto& arr : arrs) {
+    auto values = afToVector<double>(arr.as(af::dtype::f64));
+    joined.insert(joined.end(), values.begin(), values.end());
+  }
+  if (joined.empty()) {
+    return;
+  }
+  af::array sum(joined.size(), joined.data());
+  fl::allReduce(sum);
+  joined = afToVector<double>(sum);
+  size_t offset = 0;
+  for (auto& arr : arrs) {
+    const size_t n = arr.elements();
+    arr = af::array(arr.dims(), joined.data() + offset).as(arr.type());
+    offset += n;
+  }
+}
+
+std::vector<std::string> broadcastStrings(
+    const std::vector<std::string>& strings,
+    int rootRank /* = 0 */) {
+  if (!fl::isDistributedInit() || fl::getWorldSize() == 1) {
+    return strings;
+  }
+  // The numbers of strings and of characters, then the lengths and the
+  // characters
+  bool isRoot = fl::getWorldRank() == rootRank;
+  std::vector<long long> lengths;
+  std::string chars;
+  for (const auto& str : strings) {
+    lengths.push_back(str.size());
+    chars += str;
+  }
+  std::vector<long long> counts = {
+      static_cast<long long>(lengths.size()),
+      static_cast<long long>(chars.size())};
+  af::array countsArr(counts.size(), counts.data());
+  fl::broadcast(countsArr, rootRank);
+  counts = afToVector<long long>(countsArr);
+  if (counts[0] == 0) {
+    return {};
+  }
+
+  af::array lengthsArr = isRoot ? af::array(lengths.size(), lengths.data())
+                                : af::array(counts[0], af::dtype::s64);
+  af::array charsArr = isRoot
+      ? af::array(chars.size(), reinterpret_cast<const uint8_t*>(chars.data()))
+      : af::array(counts[1], af::dtype::u8);
+  fl::broadcastMultiple({&lengthsArr, &charsArr}, rootRank);
+  if (isRoot) {
+    return strings;
+  }
+  lengths = afToVector<long long>(lengthsArr);
+  chars.resize(counts[1]);
+  if (counts[1] > 0) {
+    charsArr.host(&chars[0]);
+  }
+  std::vector<std::string> result;
+  size_t offset = 0;
+  for (auto length : lengths) {
+    result.push_back(chars.substr(offset, length));
+    offset += length;
+  }
+  return result;
+}
 } // namespace ext
 } // namespace fl
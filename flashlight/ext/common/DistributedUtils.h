@@ -16,7 +16,9 @@ namespace fl {
 namespace ext {
 
 /**
- * Call Flashlight API to initialize distributed environment.
+ * Call Flashlight API to initialize distributed environment: with MPI if
+ * `rndvFilepath` is empty, with a TCP store served by rank 0 if it is
+ * "tcp://host:port", and with a shared file path otherwise.
  */
 void initDistributed(
     int worldRank,
@@ -28,13 +30,17 @@ af::array allreduceGet(AverageValueMeter& mtr);
 af::array allreduceGet(EditDistanceMeter& mtr);
 af::array allreduceGet(CountMeter& mtr);
 af::array allreduceGet(TimeMeter& mtr);
+af::array allreduceGet(EventTimeMeter& mtr);
 af::array allreduceGet(TopKMeter& mtr);
+af::array allreduceGet(LatencyMeter& mtr);
 
 void allreduceSet(AverageValueMeter& mtr, af::array& val);
 void allreduceSet(EditDistanceMeter& mtr, af::array& val);
 void allreduceSet(CountMeter& mtr, af::array& val);
 void allreduceSet(TimeMeter& mtr, af::array& val);
+void allreduceSet(EventTimeMeter& mtr, af::array& val);
 void allreduceSet(TopKMeter& mtr, af::array& val);
+void allreduceSet(LatencyMeter& mtr, af::array& val);
 
 /**
  * Synchronize meters across process.
@@ -53,7 +59,40 @@ template void syncMeter<AverageValueMeter>(AverageValueMeter& mtr);
 template void syncMeter<EditDistanceMeter>(EditDistanceMeter& mtr);
 template void syncMeter<CountMeter>(CountMeter& mtr);
 template void syncMeter<TimeMeter>(TimeMeter& mtr);
+template void syncMeter<EventTimeMeter>(EventTimeMeter& mtr);
 template void syncMeter<TopKMeter>(TopKMeter& mtr);
+template void syncMeter<LatencyMeter>(LatencyMeter& mtr);
+
+/**
+ * Sums arrays of any types over all processes with a single allreduce of
+ * their values as doubles, which are exact for counts below 2^53.
+ */
+void allReduceJoined(std::vector<af::array>& arrs);
+
+/**
+ * Returns the strings of the process of rank `rootRank` on all processes,
+ * e.g. a list of files found by the root only, so that all processes agree
+ * on it even if their views of a shared file system differ.
+ */
+std::vector<std::string> broadcastStrings(
+    const std::vector<std::string>& strings,
+    int rootRank = 0);
+
+/**
+ * Synchronize several meters across process with a single allreduce.
+ */
+template <typename... T>
+void syncMeters(T&... mtrs) {
+  if (!fl::isDistributedInit()) {
+    return;
+  }
+  std::vector<af::array> arrs = {allreduceGet(mtrs)...};
+  allReduceJoined(arrs);
+  size_t i = 0;
+  // Braced initializers are evaluated in order
+  int unused[] = {(allreduceSet(mtrs, arrs[i++]), 0)...};
+  (void)unused;
+}
 
 } // namespace ext
 } // namespace fl
@@ -0,0 +1,247 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/ext/common/MappedTensorFile.h"
+
+#include <sys/mman.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace fl {
+namespace ext {
+
+namespace {
+
+constexpr char kMagic[8] = {'F', 'L', 'T', 'E', 'N', 'S', 'O', 'R'};
+constexpr uint32_t kFormatVersion = 1;
+
+uint64_t alignUp(uint64_t offset) {
+  auto alignment = MappedTensorFile::kAlignment;
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+template <typename T>
+void append(std::string& header, T value) {
+  header.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Reads the header of the mapping sequentially, with bounds checks
+class HeaderReader {
+ public:
+  HeaderReader(const char* data, size_t size, const std::string& path)
+      : data_(data), size_(size), path_(path) {}
+
+  template <typename T>
+  T read() {
+    T value;
+    std::memcpy(&value, advance(sizeof(value)), sizeof(value));
+    return value;
+  }
+
+  std::string readString(size_t n) {
+    return std::string(advance(n), n);
+  }
+
+ private:
+  const char* advance(size_t n) {
+    if (n > size_ - pos_) {
+      throw std::runtime_error("MappedTensorFile: truncated header: " + path_);
+    }
+    auto ptr = data_ + pos_;
+    pos_ += n;
+    return ptr;
+  }
+
+  const char* data_;
+  size_t size_;
+  size_t pos_{0};
+  const std::string& path_;
+};
+
+} // namespace
+
+constexpr size_t MappedTensorFile::kAlignment;
+
+MappedTensorFile::MappedTensorFile(const std::string& path) : path_(path) {
+  using fl::lib::MemoryMappedFile;
+  mapping_ = std::make_unique<MemoryMappedFile>(
+      path, MemoryMappedFile::kPrivate);
+  auto mappingSize = mapping_->size();
+  if (mappingSize == 0) {
+    throw std::runtime_error("MappedTensorFile: empty file: " + path);
+  }
+
+  HeaderReader reader(mapping_->data(), mappingSize, path);
+  if (reader.readString(sizeof(kMagic)) !=
+      std::string(kMagic, sizeof(kMagic))) {
+    throw std::runtime_error("MappedTensorFile: invalid magic: " + path);
+  }
+  auto version = reader.read<uint32_t>();
+  if (version != kFormatVersion) {
+    throw std::runtime_error(
+        "MappedTensorFile: unsupported format version " +
+        std::to_string(version) + ": " + path);
+  }
+  metadata_ = reader.readString(reader.read<uint64_t>());
+  auto count = reader.read<uint64_t>();
+  for (uint64_t i = 0; i < count; ++i) {
+    Entry entry;
+    for (int d = 0; d < 4; ++d) {
+      entry.dims[d] = reader.read<int64_t>();
+    }
+    entry.type = static_cast<af::dtype>(reader.read<int32_t>());
+    entry.offset = reader.read<uint64_t>();
+    entry.bytes = reader.read<uint64_t>();
+    if (entry.offset > mappingSize ||
+        entry.bytes > mappingSize - entry.offset ||
+        entry.bytes != entry.dims.elements() * af::getSizeOf(entry.type)) {
+      throw std::runtime_error(
+          "MappedTensorFile: invalid tensor " + std::to_string(i) + ": " +
+          path);
+    }
+    entries_.push_back(entry);
+  }
+  // The payloads are read once, in order
+  ::madvise(const_cast<char*>(mapping_->data()), mappingSize, MADV_SEQUENTIAL);
+}
+
+const std::string& MappedTensorFile::metadata() const {
+  return metadata_;
+}
+
+size_t MappedTensorFile::size() const {
+  return entries_.size();
+}
+
+const MappedTensorFile::Entry& MappedTensorFile::entry(size_t i) const {
+  if (i >= entries_.size()) {
+    throw std::out_of_range(
+        "MappedTensorFile: tensor index " + std::to_string(i) +
+        " out of range for " + path_);
+  }
+  return entries_[i];
+}
+
+af::dim4 MappedTensorFile::dims(size_t i) const {
+  return entry(i).dims;
+}
+
+af::dtype MappedTensorFile::type(size_t i) const {
+  return entry(i).type;
+}
+
+const void* MappedTensorFile::data(size_t i) const {
+  return mapping_->data() + entry(i).offset;
+}
+
+af::array MappedTensorFile::array(size_t i) const {
+  const auto& e = entry(i);
+  af::array arr(e.dims, e.type);
+  if (e.bytes > 0) {
+    arr.write(data(i), e.bytes, afHost);
+  }
+  return arr;
+}
+
+void saveMappedTensors(
+    const std::string& path,
+    const std::vector<af::array>& tensors,
+    const std::string& metadata /* = "" */) {
+  // The size of the header is known before the offsets of the payloads
+  uint64_t entrySize = 4 * sizeof(int64_t) + sizeof(int32_t) +
+      2 * sizeof(uint64_t);
+  uint64_t headerSize = sizeof(kMagic) + sizeof(kFormatVersion) +
+      sizeof(uint64_t) + metadata.size() + sizeof(uint64_t) +
+      tensors.size() * entrySize;
+
+  std::string header(kMagic, sizeof(kMagic));
+  append(header, kFormatVersion);
+  append<uint64_t>(header, metadata.size());
+  header += metadata;
+  append<uint64_t>(header, tensors.size());
+  std::vector<uint64_t> offsets;
+  uint64_t offset = alignUp(headerSize);
+  for (const auto& tensor : tensors) {
+    if (tensor.issparse()) {
+      throw std::invalid_argument(
+          "saveMappedTensors: sparse arrays are not supported");
+    }
+    for (int d = 0; d < 4; ++d) {
+      append<int64_t>(header, tensor.dims(d));
+    }
+    append<int32_t>(header, tensor.type());
+    append<uint64_t>(header, offset);
+    append<uint64_t>(header, tensor.bytes());
+    offsets.push_back(offset);
+    offset = alignUp(offset + tensor.bytes());
+  }
+
+  auto tmpPath = path + ".tmp";
+  {
+    std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+      throw std::runtime_error(
+          "saveMappedTensors: failed to open file for writing: " + tmpPath);
+    }
+    file.write(header.data(), header.size());
+    std::vector<char> host;
+    for (size_t i = 0; i < tensors.size(); ++i) {
+      // Zero padding up to the aligned offset
+      std::vector<char> padding(
+          offsets[i] - static_cast<uint64_t>(file.tellp()), 0);
+      file.write(padding.data(), padding.size());
+      host.resize(tensors[i].bytes());
+      if (!host.empty()) {
+        tensors[i].host(host.data());
+      }
+      file.write(host.data(), host.size());
+    }
+    if (!file) {
+      throw std::runtime_error(
+          "saveMappedTensors: failed to write file: " + tmpPath);
+    }
+  }
+  if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+    throw std::runtime_error(
+        "saveMappedTensors: failed to rename " + tmpPath + " to " + path);
+  }
+}
+
+void saveParams(
+    const std::string& path,
+    const fl::Module& module,
+    const std::string& metadata /* = "" */) {
+  std::vector<af::array> tensors;
+  for (const auto& param : module.params()) {
+    tensors.push_back(param.array());
+  }
+  saveMappedTensors(path, tensors, metadata);
+}
+
+void loadParams(const MappedTensorFile& file, fl::Module& module) {
+  auto params = module.params();
+  if (params.size() != file.size()) {
+    throw std::invalid_argument(
+        "loadParams: the module has " + std::to_string(params.size()) +
+        " parameters, the file has " + std::to_string(file.size()));
+  }
+  for (size_t i = 0; i < params.size(); ++i) {
+    if (params[i].dims() != file.dims(i) || params[i].type() != file.type(i)) {
+      throw std::invalid_argument(
+          "loadParams: mismatched dimensions or type of parameter " +
+          std::to_string(i));
+    }
+    module.setParams(
+        Variable(file.array(i), params[i].isCalcGrad()), static_cast<int>(i));
+  }
+}
+
+} // namespace ext
+} // namespace fl
@@ -0,0 +1,115 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "flashlight/fl/flashlight.h"
+#include "flashlight/lib/common/System.h"
+
+namespace fl {
+namespace ext {
+
+/**
+ * A file of raw tensors which can be memory-mapped, e.g. to load the
+ * parameters of models for inference without deserializing them.
+ *
+ * The file starts with a small header: a magic string, user metadata (e.g. a
+ * version and the architecture) and, for each tensor, its dimensions, type
+ * and position. The payloads follow, each aligned to `kAlignment` bytes, as
+ * laid out in memory by ArrayFire.
+ *
+ * Reading a `MappedTensorFile` only parses the header: the payloads are read
+ * from disk by the OS when accessed, and uploaded to the device directly from
+ * the mapping, one tensor at a time, without intermediate host buffers.
+ *
+ * Example usage:
+ *
+ * \code
+ * saveParams(path, *model);
+ * ...
+ * auto model = buildSequentialModule(archfile, nFeatures, nClasses);
+ * MappedTensorFile file(path);
+ * loadParams(file, *model);
+ * \endcode
+ */
+class MappedTensorFile {
+ public:
+  static constexpr size_t kAlignment = 4096;
+
+  /** Maps the file and parses its header. */
+  explicit MappedTensorFile(const std::string& path);
+
+  MappedTensorFile(const MappedTensorFile&) = delete;
+  MappedTensorFile& operator=(const MappedTensorFile&) = delete;
+
+  const std::string& metadata() const;
+
+  /** Returns the number of tensors. */
+  size_t size() const;
+
+  af::dim4 dims(size_t i) const;
+
+  af::dtype type(size_t i) const;
+
+  /**
+   * Returns the payload of the `i`-th tensor in the mapping, which is valid
+   * as long as the file is; on the CPU, it can be used in place.
+   */
+  const void* data(size_t i) const;
+
+  /** Uploads the `i`-th tensor to a new array. */
+  af::array array(size_t i) const;
+
+ private:
+  struct Entry {
+    af::dim4 dims;
+    af::dtype type;
+    uint64_t offset;
+    uint64_t bytes;
+  };
+
+  const Entry& entry(size_t i) const;
+
+  std::string path_;
+  std::string metadata_;
+  std::vector<Entry> entries_;
+  std::unique_ptr<fl::lib::MemoryMappedFile> mapping_;
+};
+
+/**
+ * Writes arrays in the format of `MappedTensorFile`, to a temporary file
+ * renamed to `path` once complete.
+ */
+void saveMappedTensors(
+    const std::string& path,
+    const std::vector<af::array>& tensors,
+    const std::string& metadata = "");
+
+/**
+ * Writes the parameters of a module in the format of `MappedTensorFile`.
+ */
+void saveParams(
+    const std::string& path,
+    const fl::Module& module,
+    const std::string& metadata = "");
+
+/**
+ * Sets the parameters of a module (e.g. a `Sequential` built by
+ * `buildSequentialModule`) from a `MappedTensorFile` saved by `saveParams`,
+ * uploading them one by one. Throws if the numbers, dimensions or types of
+ * the parameters differ.
+ */
+void loadParams(const MappedTensorFile& file, fl::Module& module);
+
+} // namespace ext
+} // namespace fl
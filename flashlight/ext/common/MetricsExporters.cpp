@@ -0,0 +1,81 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/ext/common/MetricsExporters.h"
+
+#include <stdexcept>
+
+#include <arrayfire.h>
+
+#include "flashlight/fl/memory/memory.h"
+
+namespace fl {
+namespace ext {
+
+MetricsExporters::MetricsExporters(
+    int port,
+    const std::string& statsdAddress,
+    int64_t intervalMs,
+    int rank) {
+  auto& registry = fl::MetricsRegistry::global();
+  registry.setConstantLabels({{"rank", std::to_string(rank)}});
+
+  // Collected from the threads of the exporters
+  const int device = af::getDevice();
+  auto& allocated = registry.gauge(
+      "fl_memory_allocated_bytes",
+      "Device memory held by the memory manager");
+  auto& cached = registry.gauge(
+      "fl_memory_cached_bytes",
+      "Device memory held by the memory manager and not in use");
+  auto& fragmentation = registry.gauge(
+      "fl_memory_fragmentation",
+      "Share of the device memory held by the memory manager not in use");
+  memoryCollector_ =
+      registry.addCollector([device, &allocated, &cached, &fragmentation]() {
+        auto* manager = dynamic_cast<fl::CachingMemoryManager*>(
+            fl::MemoryManagerInstaller::currentlyInstalledMemoryManager());
+        if (!manager) {
+          return;
+        }
+        auto stats = manager->getMemoryStats(device);
+        allocated.set(stats.allocatedBytes);
+        cached.set(stats.cachedBytes);
+        fragmentation.set(
+            stats.allocatedBytes > 0
+                ? static_cast<double>(stats.cachedBytes) / stats.allocatedBytes
+                : 0);
+      });
+
+  if (port > 0) {
+    server_ = std::make_unique<fl::MetricsServer>(port + rank);
+  }
+  if (!statsdAddress.empty()) {
+    auto colon = statsdAddress.rfind(':');
+    if (colon == std::string::npos || colon + 1 == statsdAddress.size()) {
+      throw std::invalid_argument(
+          "MetricsExporters: StatsD address must be host:port, not " +
+          statsdAddress);
+    }
+    statsd_ = std::make_unique<fl::StatsdExporter>(
+        statsdAddress.substr(0, colon),
+        std::stoi(statsdAddress.substr(colon + 1)),
+        "",
+        intervalMs);
+  }
+}
+
+MetricsExporters::~MetricsExporters() {
+  // The last push collects the memory usage
+  statsd_.reset();
+  server_.reset();
+  fl::MetricsRegistry::global().removeCollector(memoryCollector_);
+}
+
+} // namespace ext
+} // namespace fl
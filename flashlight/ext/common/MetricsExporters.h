@@ -0,0 +1,53 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "flashlight/fl/common/Metrics.h"
+
+namespace fl {
+namespace ext {
+
+/**
+ * The exporters of the global `MetricsRegistry` of a training or decoding
+ * process, which they label with its rank. While they live, they also export
+ * the memory usage of the active device, if the installed memory manager is a
+ * `CachingMemoryManager`: the memory it holds, the memory cached in it, and
+ * its fragmentation, the share of the memory held which is cached.
+ */
+class MetricsExporters {
+ public:
+  /**
+   * @param port If positive, the metrics are served to Prometheus on
+   * `port + rank`, so that the processes of a host have ports of their own
+   * @param statsdAddress `host:port` of a StatsD server to push the metrics
+   * to, none if empty
+   * @param intervalMs Interval between pushes to StatsD
+   * @param rank Rank of the process, the value of the label `rank`
+   */
+  MetricsExporters(
+      int port,
+      const std::string& statsdAddress,
+      int64_t intervalMs,
+      int rank);
+  ~MetricsExporters();
+
+  MetricsExporters(const MetricsExporters&) = delete;
+  MetricsExporters& operator=(const MetricsExporters&) = delete;
+
+ private:
+  std::unique_ptr<fl::MetricsServer> server_;
+  std::unique_ptr<fl::StatsdExporter> statsd_;
+  int64_t memoryCollector_{-1};
+};
+
+} // namespace ext
+} // namespace fl
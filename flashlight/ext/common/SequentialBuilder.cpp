@@ -73,9 +73,10 @@ fl::Variable forwardSequentialModuleWithPadMask(
     auto tr = std::dynamic_pointer_cast<fl::Transformer>(module);
     auto cfr = std::dynamic_pointer_cast<fl::Conformer>(module);
     if (tr != nullptr || cfr != nullptr) {
-      output = module->forward({output, fl::noGrad(padMask)}).front();
+      output =
+          fl::forwardModule(*module, {output, fl::noGrad(padMask)}).front();
     } else {
-      output = module->forward({output}).front();
+      output = fl::forwardModule(*module, {output}).front();
     }
   }
   return output.as(input.type());
@@ -84,6 +85,24 @@ fl::Variable forwardSequentialModuleWithPadMask(
 } // namespace fl
 
 namespace {
+// Optional [windowLeft] [windowRight] [numGlobalTokens] of the self-attention
+// from params[first], -1 (no bound) and 0 by default
+fl::AttentionWindow parseAttentionWindow(
+    const std::vector<std::string>& params,
+    size_t first) {
+  fl::AttentionWindow window;
+  if (params.size() > first) {
+    window.left = std::stoi(params[first]);
+  }
+  if (params.size() > first + 1) {
+    window.right = std::stoi(params[first + 1]);
+  }
+  if (params.size() > first + 2) {
+    window.numGlobal = std::stoi(params[first + 2]);
+  }
+  return window;
+}
+
 std::shared_ptr<Module> parseLine(const std::string& line) {
   int dummy;
   return parseLines({line}, 0, dummy);
@@ -134,7 +153,7 @@ std::shared_ptr<Module> parseLines(
   /* ========== TRANSFORMERS ========== */
 
   if (params[0] == "TR") {
-    if (!inRange(6, params.size(), 9)) {
+    if (!inRange(6, params.size(), 12)) {
       throw std::invalid_argument("Failed parsing - " + line);
     }
     int modelDim = std::stoi(params[1]);
@@ -145,7 +164,7 @@ std::shared_ptr<Module> parseLines(
     float pLayerdrop = (params.size() >= 7) ? std::stof(params[6]) : 0.0;
     int preLN = (params.size() >= 8) ? std::stoi(params[7]) : 0;
     bool useFutureMask = (params.size() >= 9) ? std::stoi(params[8]) : 0;
-    return std::make_shared<Transformer>(
+    auto tr = std::make_shared<Transformer>(
         modelDim,
         modelDim / nHead,
         mlpDim,
@@ -155,10 +174,12 @@ std::shared_ptr<Module> parseLines(
         pLayerdrop,
         useFutureMask,
         preLN);
+    tr->setAttentionWindow(parseAttentionWindow(params, 9));
+    return tr;
   }
 
   if (params[0] == "CFR") {
-    if (!inRange(7, params.size(), 8)) {
+    if (!inRange(7, params.size(), 11)) {
       throw std::invalid_argument("Failed parsing - " + line);
     }
     int modelDim = std::stoi(params[1]);
@@ -168,7 +189,7 @@ std::shared_ptr<Module> parseLines(
     int kernel = std::stoi(params[5]);
     float pDropout = std::stof(params[6]);
     float pLayerdrop = (params.size() >= 8) ? std::stof(params[7]) : 0.0;
-    return std::make_shared<Conformer>(
+    auto cfr = std::make_shared<Conformer>(
         modelDim,
         modelDim / nHead,
         mlpDim,
@@ -177,6 +198,8 @@ std::shared_ptr<Module> parseLines(
         kernel,
         pDropout,
         pLayerdrop);
+    cfr->setAttentionWindow(parseAttentionWindow(params, 8));
+    return cfr;
   }
 
   if (params[0] == "POSEMB") {
@@ -347,6 +370,14 @@ std::shared_ptr<Module> parseLines(
     return std::make_shared<WeightNorm>(parseLine(childStr), dim);
   }
 
+  if (params[0] == "CKPT") {
+    if (params.size() < 2) {
+      throw std::invalid_argument("Failed parsing - " + line);
+    }
+    std::string childStr = fl::lib::join(" ", params.begin() + 1, params.end());
+    return std::make_shared<Checkpoint>(parseLine(childStr));
+  }
+
   if (params[0] == "DO") {
     if (params.size() != 2) {
       throw std::invalid_argument("Failed parsing - " + line);
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/ext/common/TrainBenchmark.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <arrayfire.h>
+
+#include "flashlight/fl/distributed/distributed.h"
+#include "flashlight/fl/memory/memory.h"
+
+namespace fl {
+namespace ext {
+
+namespace {
+
+fl::CachingMemoryManager* cachingMemoryManager() {
+  return dynamic_cast<fl::CachingMemoryManager*>(
+      fl::MemoryManagerInstaller::currentlyInstalledMemoryManager());
+}
+
+std::string jsonString(const std::string& str) {
+  std::ostringstream ss;
+  ss << '"';
+  for (unsigned char c : str) {
+    if (c == '"' || c == '\\') {
+      ss << '\\' << c;
+    } else if (c < 0x20) {
+      ss << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+         << static_cast<int>(c) << std::dec;
+    } else {
+      ss << c;
+    }
+  }
+  ss << '"';
+  return ss.str();
+}
+
+} // namespace
+
+TrainBenchmark::TrainBenchmark(
+    std::string name,
+    std::string unit,
+    int64_t warmupSteps,
+    int64_t steps)
+    : name_(std::move(name)),
+      unit_(std::move(unit)),
+      warmupSteps_(warmupSteps),
+      steps_(steps) {
+  if (warmupSteps_ < 0 || steps_ < 1) {
+    throw std::invalid_argument(
+        "[TrainBenchmark] needs warmupSteps >= 0 and steps >= 1");
+  }
+  if (warmupSteps_ == 0) {
+    start();
+  }
+}
+
+void TrainBenchmark::start() {
+  af::sync();
+  if (auto* manager = cachingMemoryManager()) {
+    manager->resetPeakMemoryStats();
+  }
+  start_ = Clock::now();
+}
+
+bool TrainBenchmark::endStep(int64_t samples, int64_t units /* = 0 */) {
+  if (done()) {
+    throw std::logic_error("[TrainBenchmark] all the steps have run");
+  }
+  ++step_;
+  if (step_ <= warmupSteps_) {
+    if (step_ == warmupSteps_) {
+      start();
+      return true;
+    }
+    return false;
+  }
+  samples_ += samples;
+  units_ += units;
+  if (done()) {
+    af::sync();
+    seconds_ = std::chrono::duration<double>(Clock::now() - start_).count();
+    if (auto* manager = cachingMemoryManager()) {
+      peakMemory_ = manager->getMemoryStats().peakAllocatedBytes;
+    }
+  }
+  return false;
+}
+
+bool TrainBenchmark::done() const {
+  return step_ >= warmupSteps_ + steps_;
+}
+
+void TrainBenchmark::setPhase(const std::string& phase, double seconds) {
+  phases_[phase] = seconds;
+}
+
+void TrainBenchmark::setConfig(
+    const std::string& key,
+    const std::string& value) {
+  config_[key] = value;
+}
+
+std::string TrainBenchmark::report() const {
+  if (!done()) {
+    throw std::logic_error("[TrainBenchmark] report() before the last step");
+  }
+  // The values of each process, one after the other
+  std::vector<double> values = {
+      seconds_,
+      static_cast<double>(samples_),
+      static_cast<double>(units_),
+      static_cast<double>(peakMemory_)};
+  for (const auto& phase : phases_) {
+    values.push_back(phase.second);
+  }
+  const size_t numValues = values.size();
+  int worldSize = 1;
+  if (fl::isDistributedInit() && fl::getWorldSize() > 1) {
+    worldSize = fl::getWorldSize();
+    af::array gathered;
+    fl::allGather(af::array(numValues, values.data()), gathered);
+    values.resize(gathered.elements());
+    gathered.host(values.data());
+  }
+  double seconds = 0, samples = 0, units = 0, peakMemory = 0;
+  std::vector<double> phases(phases_.size(), 0);
+  for (int rank = 0; rank < worldSize; ++rank) {
+    const double* rankValues = values.data() + rank * numValues;
+    seconds = std::max(seconds, rankValues[0]);
+    samples += rankValues[1];
+    units += rankValues[2];
+    peakMemory = std::max(peakMemory, rankValues[3]);
+    for (size_t i = 0; i < phases.size(); ++i) {
+      phases[i] += rankValues[4 + i] / worldSize;
+    }
+  }
+
+  std::ostringstream ss;
+  ss << std::setprecision(6) << "{\"benchmark\": " << jsonString(name_)
+     << ", \"world_size\": " << worldSize
+     << ", \"warmup_steps\": " << warmupSteps_ << ", \"steps\": " << steps_
+     << ", \"seconds\": " << seconds
+     << ", \"samples\": " << static_cast<int64_t>(samples)
+     << ", \"samples_per_sec\": " << (seconds > 0 ? samples / seconds : 0)
+     << ", " << jsonString(unit_) << ": " << static_cast<int64_t>(units)
+     << ", " << jsonString(unit_ + "_per_sec") << ": "
+     << (seconds > 0 ? units / seconds : 0)
+     << ", \"step_ms\": " << seconds * 1000 / steps_
+     << ", \"peak_memory_bytes\": " << static_cast<int64_t>(peakMemory)
+     << ", \"phase_ms\": {";
+  // Per step
+  size_t i = 0;
+  for (const auto& phase : phases_) {
+    ss << (i ? ", " : "") << jsonString(phase.first) << ": "
+       << phases[i] * 1000 / steps_;
+    ++i;
+  }
+  ss << "}, \"config\": {";
+  i = 0;
+  for (const auto& entry : config_) {
+    ss << (i++ ? ", " : "") << jsonString(entry.first) << ": "
+       << jsonString(entry.second);
+  }
+  ss << "}}";
+  return ss.str();
+}
+
+} // namespace ext
+} // namespace fl
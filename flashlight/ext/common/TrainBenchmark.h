@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace fl {
+namespace ext {
+
+/**
+ * Measures the steady-state throughput of a training loop, typically on
+ * synthetic in-memory batches so that the input pipeline isn't measured:
+ * after `warmupSteps` steps (allocations of the memory manager, JIT, autotuned
+ * kernels), the next `steps` steps are timed, with the peak of the device
+ * memory held by the `CachingMemoryManager` and the times of the phases
+ * measured by the loop (forward, backward, optimizer...). The report is a
+ * JSON object on one line, to compare the throughput of versions, devices or
+ * configurations. Example usage:
+ *
+ * \code
+ * TrainBenchmark benchmark("lm_train", "tokens", 10, 100);
+ * while (!benchmark.done()) {
+ *   trainStep(batch);
+ *   if (benchmark.endStep(batchSize, batchSize * tokensPerSample)) {
+ *     resetTimers(); // end of the warmup
+ *   }
+ * }
+ * benchmark.setPhase("forward", fwdTimer.value());
+ * std::cout << benchmark.report() << std::endl;
+ * \endcode
+ */
+class TrainBenchmark {
+ public:
+  /**
+   * `name` identifies the benchmark in the report, and `unit` what the
+   * samples are made of (e.g. frames, tokens, pixels), counted as well.
+   */
+  TrainBenchmark(
+      std::string name,
+      std::string unit,
+      int64_t warmupSteps,
+      int64_t steps);
+
+  /**
+   * Ends a step of `samples` samples of `units` units in total. Returns
+   * whether the warmup ended with this step, after which the timers of the
+   * phases should be reset: the steps are timed from there.
+   */
+  bool endStep(int64_t samples, int64_t units = 0);
+
+  /** Returns whether all the steps have run. */
+  bool done() const;
+
+  /** Sets the time in seconds spent in a phase over the timed steps. */
+  void setPhase(const std::string& phase, double seconds);
+
+  /** Sets a configuration entry written in the report. */
+  void setConfig(const std::string& key, const std::string& value);
+
+  /**
+   * Returns the report, once `done()`. In distributed training, this is a
+   * collective call of all the processes, which must set the same phases:
+   * the samples are summed over the processes and divided by the time of
+   * the slowest, the peak memory is the highest, and the phases are averaged.
+   */
+  std::string report() const;
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  // Starts timing the steps, once the device is done with the warmup
+  void start();
+
+  std::string name_;
+  std::string unit_;
+  int64_t warmupSteps_;
+  int64_t steps_;
+  int64_t step_{0};
+  int64_t samples_{0};
+  int64_t units_{0};
+  Clock::time_point start_;
+  double seconds_{0};
+  size_t peakMemory_{0};
+  std::map<std::string, double> phases_;
+  std::map<std::string, std::string> config_;
+};
+
+} // namespace ext
+} // namespace fl
@@ -35,5 +35,32 @@ std::vector<T> afToVector(const fl::Variable& var) {
   return afToVector<T>(var.array());
 }
 
+/**
+ * Convert an arrayfire array into a std::vector, copying it through a pinned
+ * host buffer. Faster than `afToVector()` for large device arrays, such as
+ * emissions.
+ *
+ * @param arr input array to convert
+ *
+ */
+template <typename T>
+std::vector<T> afToVectorPinned(const af::array& arr) {
+  std::vector<T> vec(arr.elements());
+  fl::copyToHostPinned(arr, vec.data());
+  return vec;
+}
+
+/**
+ * Convert the array in a Variable into a std::vector through a pinned host
+ * buffer.
+ *
+ * @param var input Variables to convert
+ *
+ */
+template <typename T>
+std::vector<T> afToVectorPinned(const fl::Variable& var) {
+  return afToVectorPinned<T>(var.array());
+}
+
 } // namespace ext
 } // namespace fl
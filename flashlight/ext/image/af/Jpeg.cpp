@@ -7,13 +7,281 @@
 
 #include "flashlight/ext/image/af/Jpeg.h"
 
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#ifdef FL_USE_LIBJPEG_TURBO
+// clang-format off
+#include <csetjmp>
+#include <cstdio>
+#include <jpeglib.h>
+// clang-format on
+#endif
+
+#ifdef FL_USE_NVJPEG
+#include <nvjpeg.h>
+
+#include "flashlight/fl/common/backend/cuda/CudaUtils.h"
+#endif
+
 namespace fl {
 namespace ext {
 namespace image {
 
+namespace {
+
+std::vector<unsigned char> readFile(const std::string& fp) {
+  std::ifstream file(fp, std::ios::binary);
+  if (!file) {
+    throw std::invalid_argument("Could not load from filepath" + fp);
+  }
+  return std::vector<unsigned char>(
+      std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+ImageRegion sampleRegion(const JpegDecodeOptions& options, int w, int h) {
+  if (!options.region) {
+    return {0, 0, w, h};
+  }
+  auto region = options.region(w, h);
+  if (region.x < 0 || region.y < 0 || region.w <= 0 || region.h <= 0 ||
+      region.x + region.w > w || region.y + region.h > h) {
+    throw std::invalid_argument("loadJpeg: region out of the image");
+  }
+  return region;
+}
+
+// Crops a W x H x C image
+af::array crop(const af::array& img, const ImageRegion& region) {
+  if (region.x == 0 && region.y == 0 && region.w == img.dims(0) &&
+      region.h == img.dims(1)) {
+    return img;
+  }
+  return img(
+      af::seq(region.x, region.x + region.w - 1),
+      af::seq(region.y, region.y + region.h - 1),
+      af::span);
+}
+
+af::array loadStb(const std::string& fp, const JpegDecodeOptions& options) {
+  auto img = loadJpeg(fp, options.channels);
+  return crop(img, sampleRegion(options, img.dims(0), img.dims(1)));
+}
+
+#ifdef FL_USE_LIBJPEG_TURBO
+
+struct TurboErrorManager {
+  jpeg_error_mgr pub;
+  jmp_buf jump;
+};
+
+void turboErrorExit(j_common_ptr cinfo) {
+  auto err = reinterpret_cast<TurboErrorManager*>(cinfo->err);
+  std::longjmp(err->jump, 1);
+}
+
+/*
+ * Decodes the region of the image from `options` as C x W x H in `pixels`,
+ * and returns false on errors. Objects with destructors must not be created
+ * after the `setjmp`, so the buffers are given by the caller.
+ */
+bool decodeTurbo(
+    const std::vector<unsigned char>& data,
+    const JpegDecodeOptions& options,
+    std::vector<unsigned char>& pixels,
+    std::vector<unsigned char>& row,
+    int& width,
+    int& height) {
+  jpeg_decompress_struct cinfo;
+  TurboErrorManager err;
+  ImageRegion region;
+  cinfo.err = jpeg_std_error(&err.pub);
+  err.pub.error_exit = turboErrorExit;
+  if (setjmp(err.jump)) {
+    jpeg_destroy_decompress(&cinfo);
+    return false;
+  }
+  jpeg_create_decompress(&cinfo);
+  jpeg_mem_src(&cinfo, data.data(), data.size());
+  jpeg_read_header(&cinfo, TRUE);
+  int imgW = cinfo.image_width;
+  int imgH = cinfo.image_height;
+  try {
+    region = sampleRegion(options, imgW, imgH);
+  } catch (const std::exception&) {
+    jpeg_destroy_decompress(&cinfo);
+    throw;
+  }
+
+  // The smallest scale in eighths keeping the region above minSize
+  int scaleNum = 8;
+  if (options.minSize > 0) {
+    for (int num = 1; num < 8; ++num) {
+      if (std::min(region.w, region.h) * num >= options.minSize * 8) {
+        scaleNum = num;
+        break;
+      }
+    }
+  }
+  cinfo.scale_num = scaleNum;
+  cinfo.scale_denom = 8;
+  cinfo.out_color_space = options.channels == 1 ? JCS_GRAYSCALE : JCS_RGB;
+  jpeg_start_decompress(&cinfo);
+
+  // The region in the downscaled image
+  int outW = cinfo.output_width;
+  int outH = cinfo.output_height;
+  int x0 = static_cast<int64_t>(region.x) * outW / imgW;
+  int x1 = std::max<int>(
+      x0 + 1, (static_cast<int64_t>(region.x + region.w) * outW) / imgW);
+  int y0 = static_cast<int64_t>(region.y) * outH / imgH;
+  int y1 = std::max<int>(
+      y0 + 1, (static_cast<int64_t>(region.y + region.h) * outH) / imgH);
+  // Columns are decoded from an iMCU boundary, left of x0
+  JDIMENSION cropX = x0;
+  JDIMENSION cropW = x1 - x0;
+  if (cropW < cinfo.output_width) {
+    jpeg_crop_scanline(&cinfo, &cropX, &cropW);
+  }
+  if (y0 > 0) {
+    jpeg_skip_scanlines(&cinfo, y0);
+  }
+  int channels = cinfo.output_components;
+  size_t stride = static_cast<size_t>(cinfo.output_width) * channels;
+  width = x1 - x0;
+  height = y1 - y0;
+  pixels.resize(static_cast<size_t>(width) * height * channels);
+  row.resize(stride);
+  JSAMPROW rowPtr = row.data();
+  for (int y = 0; y < height; ++y) {
+    jpeg_read_scanlines(&cinfo, &rowPtr, 1);
+    std::copy_n(
+        row.data() + (x0 - cropX) * channels,
+        static_cast<size_t>(width) * channels,
+        pixels.data() + static_cast<size_t>(y) * width * channels);
+  }
+  // The remaining scanlines are not read
+  jpeg_destroy_decompress(&cinfo);
+  return true;
+}
+
+af::array loadTurbo(const std::string& fp, const JpegDecodeOptions& options) {
+  if (options.channels != 1 && options.channels != 3) {
+    throw std::invalid_argument(
+        "loadJpeg: libjpeg-turbo needs 1 or 3 channels");
+  }
+  auto data = readFile(fp);
+  std::vector<unsigned char> pixels, row;
+  int w, h;
+  if (!decodeTurbo(data, options, pixels, row, w, h)) {
+    // e.g. CMYK images
+    return loadStb(fp, options);
+  }
+  af::array result = af::array(options.channels, w, h, pixels.data());
+  return af::reorder(result, 1, 2, 0);
+}
+
+#else
+
+af::array loadTurbo(const std::string&, const JpegDecodeOptions&) {
+  throw std::invalid_argument(
+      "loadJpeg: built without libjpeg-turbo "
+      "(FL_EXT_IMAGE_USE_LIBJPEG_TURBO)");
+}
+
+#endif // FL_USE_LIBJPEG_TURBO
+
+#ifdef FL_USE_NVJPEG
+
+// A decoder per thread, as nvJPEG states can not be shared
+class NvJpegDecoder {
+ public:
+  NvJpegDecoder() {
+    check(nvjpegCreateSimple(&handle_));
+    check(nvjpegJpegStateCreate(handle_, &state_));
+  }
+
+  ~NvJpegDecoder() {
+    nvjpegJpegStateDestroy(state_);
+    nvjpegDestroy(handle_);
+  }
+
+  af::array decode(
+      const std::vector<unsigned char>& data,
+      const JpegDecodeOptions& options) {
+    int nComponents;
+    nvjpegChromaSubsampling_t subsampling;
+    int widths[NVJPEG_MAX_COMPONENT];
+    int heights[NVJPEG_MAX_COMPONENT];
+    check(nvjpegGetImageInfo(
+        handle_,
+        data.data(),
+        data.size(),
+        &nComponents,
+        &subsampling,
+        widths,
+        heights));
+    int w = widths[0];
+    int h = heights[0];
+    auto region = sampleRegion(options, w, h);
+    // Planar channels of rows of w pixels, i.e. W x H x C
+    af::array result(w, h, options.channels, u8);
+    auto ptr = result.device<unsigned char>();
+    nvjpegImage_t image;
+    for (int c = 0; c < options.channels; ++c) {
+      image.channel[c] = ptr + static_cast<size_t>(c) * w * h;
+      image.pitch[c] = w;
+    }
+    check(nvjpegDecode(
+        handle_,
+        state_,
+        data.data(),
+        data.size(),
+        options.channels == 1 ? NVJPEG_OUTPUT_Y : NVJPEG_OUTPUT_RGB,
+        &image,
+        fl::cuda::getActiveStream()));
+    result.unlock();
+    return crop(result, region);
+  }
+
+ private:
+  nvjpegHandle_t handle_;
+  nvjpegJpegState_t state_;
+
+  static void check(nvjpegStatus_t status) {
+    if (status != NVJPEG_STATUS_SUCCESS) {
+      throw std::runtime_error(
+          "loadJpeg: nvJPEG error " + std::to_string(status));
+    }
+  }
+};
+
+af::array loadNvJpeg(const std::string& fp, const JpegDecodeOptions& options) {
+  if (options.channels != 1 && options.channels != 3) {
+    throw std::invalid_argument("loadJpeg: nvJPEG needs 1 or 3 channels");
+  }
+  thread_local NvJpegDecoder decoder;
+  return decoder.decode(readFile(fp), options);
+}
+
+#else
+
+af::array loadNvJpeg(const std::string&, const JpegDecodeOptions&) {
+  throw std::invalid_argument(
+      "loadJpeg: built without nvJPEG (FL_EXT_IMAGE_USE_NVJPEG)");
+}
+
+#endif // FL_USE_NVJPEG
+
+} // namespace
+
 /*
  * Loads a jpeg from filepath fp. Note: It will automatically convert from any
  * number of channels to create an array with 3 channels
@@ -36,6 +304,37 @@ af::array loadJpeg(const std::string& fp, int desiredNumberOfChannels) {
   }
 }
 
+bool isJpegBackendAvailable(JpegBackend backend) {
+  switch (backend) {
+    case JpegBackend::Stb:
+      return true;
+    case JpegBackend::Turbo:
+#ifdef FL_USE_LIBJPEG_TURBO
+      return true;
+#else
+      return false;
+#endif
+    case JpegBackend::NvJpeg:
+#ifdef FL_USE_NVJPEG
+      return true;
+#else
+      return false;
+#endif
+  }
+  return false;
+}
+
+af::array loadJpeg(const std::string& fp, const JpegDecodeOptions& options) {
+  switch (options.backend) {
+    case JpegBackend::Turbo:
+      return loadTurbo(fp, options);
+    case JpegBackend::NvJpeg:
+      return loadNvJpeg(fp, options);
+    default:
+      return loadStb(fp, options);
+  }
+}
+
 } // namespace image
 } // namespace ext
 } // namespace fl
@@ -9,12 +9,48 @@
 
 #include <arrayfire.h>
 
+#include "flashlight/ext/image/af/Transforms.h"
+
 namespace fl {
 namespace ext {
 namespace image {
 
 af::array loadJpeg(const std::string& fp, int desiredNumberOfChannels = 3);
 
+enum class JpegBackend {
+  // stb_image on the host, always available
+  Stb,
+  // libjpeg-turbo on the host, which downscales in the DCT domain and only
+  // decodes the requested region. Requires FL_EXT_IMAGE_USE_LIBJPEG_TURBO
+  Turbo,
+  // nvJPEG on the device. Requires FL_EXT_IMAGE_USE_NVJPEG
+  NvJpeg,
+};
+
+/* Returns if the backend was built in */
+bool isJpegBackendAvailable(JpegBackend backend);
+
+struct JpegDecodeOptions {
+  JpegBackend backend = JpegBackend::Stb;
+  // 1 (grayscale) or 3 (RGB)
+  int channels = 3;
+  // If > 0, the image may be decoded downscaled (by 1/8 to 7/8), as long as
+  // the smallest side of the decoded region is at least `minSize`. Only
+  // supported by libjpeg-turbo
+  int minSize = 0;
+  // If set, chooses the part of the image which is decoded from its size,
+  // e.g. `randomResizeCropRegion()`. Only libjpeg-turbo skips the pixels
+  // outside of it, the other backends crop the decoded image
+  ImageRegionSampler region;
+};
+
+/*
+ * Loads a jpeg from filepath fp as a W x H x C array of u8, with the
+ * backend of `options`. With libjpeg-turbo, the images it does not support
+ * (e.g. CMYK) are decoded with stb_image
+ */
+af::array loadJpeg(const std::string& fp, const JpegDecodeOptions& options);
+
 } // namespace image
 } // namespace ext
 } // namespace fl
@@ -7,8 +7,11 @@
 
 #include "flashlight/ext/image/af/Transforms.h"
 
+#include <algorithm>
+#include <cmath>
 #include <numeric>
 #include <random>
+#include <stdexcept>
 
 // TODO consider moving these outside of annonymous namespace
 namespace {
@@ -88,21 +91,17 @@ ImageTransform randomHorizontalFlipTransform(const float p) {
   };
 };
 
-ImageTransform randomResizeCropTransform(
-    const int size,
+ImageRegionSampler randomResizeCropRegion(
     const float scaleLow,
     const float scaleHigh,
     const float ratioLow,
     const float ratioHigh) {
-  return [=](const af::array& in) mutable {
-    const int w = in.dims(0);
-    const int h = in.dims(1);
+  return [=](int w, int h) {
     const float area = w * h;
     for (int i = 0; i < 10; i++) {
       const float scale = randomFloat(scaleLow, scaleHigh);
       const float logRatio =
           randomFloat(std::log(ratioLow), std::log(ratioHigh));
-      ;
       const float targetArea = scale * area;
       const float targetRatio = std::exp(logRatio);
       const int tw = std::round(std::sqrt(targetArea * targetRatio));
@@ -110,11 +109,34 @@ ImageTransform randomResizeCropTransform(
       if (0 < tw && tw <= w && 0 < th && th <= h) {
         const int x = std::rand() % (w - tw + 1);
         const int y = std::rand() % (h - th + 1);
-        return resize(crop(in, x, y, tw, th), size);
+        return ImageRegion{x, y, tw, th};
       }
     }
-    return centerCrop(resizeSmallest(in, size), size);
-    ;
+    // Center crop of the largest square
+    const int size = std::min(w, h);
+    return ImageRegion{(w - size) / 2, (h - size) / 2, size, size};
+  };
+}
+
+ImageRegionSampler centerCropRegion(const float scale) {
+  return [scale](int w, int h) {
+    const int side = std::max(
+        1, std::min<int>(std::round(std::min(w, h) * scale), std::min(w, h)));
+    return ImageRegion{(w - side) / 2, (h - side) / 2, side, side};
+  };
+}
+
+ImageTransform randomResizeCropTransform(
+    const int size,
+    const float scaleLow,
+    const float scaleHigh,
+    const float ratioLow,
+    const float ratioHigh) {
+  auto sampler =
+      randomResizeCropRegion(scaleLow, scaleHigh, ratioLow, ratioHigh);
+  return [=](const af::array& in) {
+    const auto region = sampler(in.dims(0), in.dims(1));
+    return resize(crop(in, region.x, region.y, region.w, region.h), size);
   };
 }
 
@@ -155,6 +177,94 @@ ImageTransform normalizeImage(
   };
 };
 
+BatchImageTransform batchAugmentation(
+    const int size,
+    ImageRegionSampler region,
+    const float flipProb,
+    const std::vector<float>& meanVec,
+    const std::vector<float>& stdVec) {
+  if (meanVec.empty() || meanVec.size() != stdVec.size()) {
+    throw std::invalid_argument(
+        "batchAugmentation: invalid mean and std of the channels");
+  }
+  const int channels = meanVec.size();
+  const af::array meanArr(1, 1, channels, 1, meanVec.data());
+  const af::array stdArr(1, 1, channels, 1, stdVec.data());
+  return [=](const std::vector<af::array>& images) {
+    const int batchSize = images.size();
+    if (batchSize == 0) {
+      throw std::invalid_argument("batchAugmentation: empty batch");
+    }
+    int maxW = 0;
+    int maxH = 0;
+    for (const auto& img : images) {
+      if (img.dims(2) != channels || img.dims(3) != 1) {
+        throw std::invalid_argument(
+            "batchAugmentation: images must be W x H x C, with C channels "
+            "as in the mean and std");
+      }
+      maxW = std::max<int>(maxW, img.dims(0));
+      maxH = std::max<int>(maxH, img.dims(1));
+    }
+
+    // For each image, the first sampled position and the step between
+    // outputs (negative when flipped), and the bounds of the crop
+    std::vector<float> xStart(batchSize), xStep(batchSize);
+    std::vector<float> yStart(batchSize), yStep(batchSize);
+    std::vector<float> xLow(batchSize), xHigh(batchSize);
+    std::vector<float> yLow(batchSize), yHigh(batchSize);
+    for (int b = 0; b < batchSize; ++b) {
+      const int w = images[b].dims(0);
+      const int h = images[b].dims(1);
+      const auto crop = region ? region(w, h) : ImageRegion{0, 0, w, h};
+      xStep[b] = static_cast<float>(crop.w) / size;
+      yStep[b] = static_cast<float>(crop.h) / size;
+      xStart[b] = crop.x + 0.5f * xStep[b] - 0.5f;
+      yStart[b] = crop.y + 0.5f * yStep[b] - 0.5f;
+      if (randomFloat(0, 1) < flipProb) {
+        xStart[b] = crop.x + crop.w - 0.5f * xStep[b] - 0.5f;
+        xStep[b] = -xStep[b];
+      }
+      xLow[b] = crop.x;
+      xHigh[b] = crop.x + crop.w - 1;
+      yLow[b] = crop.y;
+      yHigh[b] = crop.y + crop.h - 1;
+    }
+
+    // The images in a single array, padded with zeros
+    af::array padded = af::constant(0, maxW, maxH, channels, batchSize, f32);
+    for (int b = 0; b < batchSize; ++b) {
+      padded(
+          af::seq(images[b].dims(0)),
+          af::seq(images[b].dims(1)),
+          af::span,
+          b) = images[b].as(f32);
+    }
+
+    // Sampling positions of the outputs in each image, S x S x C x B. They
+    // are clamped to the crop, so that the padding is never interpolated.
+    auto param = [batchSize, size](const std::vector<float>& v) {
+      return af::tile(af::array(1, 1, 1, batchSize, v.data()), size, size, 1);
+    };
+    auto outDims = af::dim4(size, size, 1, batchSize);
+    af::array pos0 = af::range(outDims, 0, f32) * param(xStep) + param(xStart);
+    pos0 = af::min(af::max(pos0, param(xLow)), param(xHigh));
+    af::array pos1 = af::range(outDims, 1, f32) * param(yStep) + param(yStart);
+    pos1 = af::min(af::max(pos1, param(yLow)), param(yHigh));
+    af::array out = af::approx2(
+        padded,
+        af::tile(pos0, 1, 1, channels),
+        af::tile(pos1, 1, 1, channels),
+        AF_INTERP_BILINEAR,
+        0.0);
+
+    out = out / 255.f;
+    out = af::batchFunc(out, meanArr, af::operator-);
+    out = af::batchFunc(out, stdArr, af::operator/);
+    return out;
+  };
+}
+
 } // namespace image
 } // namespace ext
 } // namespace fl
@@ -9,6 +9,7 @@
 
 #include <arrayfire.h>
 #include <functional>
+#include <vector>
 
 namespace fl {
 namespace ext {
@@ -17,6 +18,21 @@ namespace image {
 // Same function signature as DataTransform but removes fl dep
 using ImageTransform = std::function<af::array(const af::array&)>;
 
+// Rectangle of w x h pixels at (x, y) in an image
+struct ImageRegion {
+  int x;
+  int y;
+  int w;
+  int h;
+};
+
+// Chooses a region of an image from its width and height
+using ImageRegionSampler = std::function<ImageRegion(int, int)>;
+
+// Same function signature as BatchFunction but removes fl dep
+using BatchImageTransform =
+    std::function<af::array(const std::vector<af::array>&)>;
+
 ImageTransform normalizeImage(
     const std::vector<float>& meanVec,
     const std::vector<float>& stdVec);
@@ -29,6 +45,25 @@ ImageTransform normalizeImage(
  */
 ImageTransform randomResizeTransform(const int low, const int high);
 
+/*
+ * Samples the crop of `randomResizeCropTransform`, which covers a fraction
+ * in [scaleLow, scaleHigh] of the image, with an aspect ratio in
+ * [ratioLow, ratioHigh]. It can be given to the jpeg decoder, so that the
+ * pixels outside of the crop are not decoded, before resizing.
+ */
+ImageRegionSampler randomResizeCropRegion(
+    const float scaleLow,
+    const float scaleHigh,
+    const float ratioLow,
+    const float ratioHigh);
+
+/*
+ * Samples the center square of an image, whose side is a fraction @param
+ * scale of the smallest side, e.g. 224 / 256 for a center crop of 224 after
+ * resizing to 256
+ */
+ImageRegionSampler centerCropRegion(const float scale);
+
 ImageTransform randomResizeCropTransform(
     const int resize,
     const float scaleLow,
@@ -62,6 +97,23 @@ ImageTransform randomHorizontalFlipTransform(const float p = 0.5);
  */
 ImageTransform compose(std::vector<ImageTransform> transformfns);
 
+/*
+ * Augments a batch of W x H x C images of different sizes into a
+ * @param size x @param size x C x B array, as the per image transforms would
+ * one image at a time: each image is cropped to the region from @param
+ * region, resized with bilinear interpolation, flipped horizontally with a
+ * probability @param flipProb and normalized. The random parameters are
+ * drawn on the host, and the images are transformed together by a few
+ * batched operations, instead of many small ones per image. To be used as
+ * the batch function of the images in a `BatchDataset`.
+ */
+BatchImageTransform batchAugmentation(
+    const int size,
+    ImageRegionSampler region,
+    const float flipProb,
+    const std::vector<float>& meanVec,
+    const std::vector<float>& stdVec);
+
 } // namespace image
 } // namespace ext
 } // namespace fl
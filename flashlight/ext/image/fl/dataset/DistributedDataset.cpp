@@ -7,17 +7,47 @@
 
 #include "flashlight/ext/image/fl/dataset/DistributedDataset.h"
 
+#include <algorithm>
+#include <numeric>
+#include <random>
+
 namespace fl {
 namespace ext {
 namespace image {
 
+namespace {
+
+std::vector<int64_t> shuffled(
+    std::vector<int64_t> indices,
+    std::seed_seq& seq) {
+  std::mt19937_64 rng(seq);
+  std::shuffle(indices.begin(), indices.end(), rng);
+  return indices;
+}
+
+} // namespace
+
 DistributedDataset::DistributedDataset(
     std::shared_ptr<Dataset> base,
     int64_t worldRank,
     int64_t worldSize,
     int64_t batchSize,
     int64_t numThreads,
-    int64_t prefetchSize) {
+    int64_t prefetchSize,
+    const std::vector<Dataset::BatchFunction>& batchfns /* = {} */,
+    const DistributedDatasetOptions& options /* = {} */)
+    : base_(base),
+      worldRank_(worldRank),
+      worldSize_(worldSize),
+      batchSize_(batchSize),
+      numThreads_(numThreads),
+      prefetchSize_(prefetchSize),
+      batchfns_(batchfns),
+      options_(options) {
+  if (!options_.localCachePath.empty()) {
+    buildShard();
+    return;
+  }
   shuffle_ = std::make_shared<ShuffleDataset>(base);
   auto permfn = [worldSize, worldRank](int64_t idx) {
     return (idx * worldSize) + worldRank;
@@ -30,7 +60,49 @@ DistributedDataset::DistributedDataset(
   }
   ds_ = std::make_shared<ResampleDataset>(shuffle_, permfn, partitionSize);
   ds_ = std::make_shared<PrefetchDataset>(ds_, numThreads, prefetchSize);
-  ds_ = std::make_shared<BatchDataset>(ds_, batchSize);
+  ds_ = std::make_shared<BatchDataset>(
+      ds_, batchSize, BatchDatasetPolicy::INCLUDE_LAST, batchfns);
+}
+
+void DistributedDataset::buildShard() {
+  // The same order on all the processes: the samples in their order in `base`
+  // (e.g. sorted by directory) until the first reshuffle
+  std::vector<int64_t> order(base_->size());
+  std::iota(order.begin(), order.end(), 0);
+  int64_t reshuffles =
+      options_.reshuffleEpochs > 0 ? epoch_ / options_.reshuffleEpochs : 0;
+  if (reshuffles > 0) {
+    std::seed_seq seq{
+        static_cast<int64_t>(options_.seed), static_cast<int64_t>(reshuffles)};
+    order = shuffled(std::move(order), seq);
+  }
+
+  // Contiguous ranges, of the sizes of the interleaved shards
+  int64_t partitionSize = base_->size() / worldSize_;
+  int64_t leftOver = base_->size() % worldSize_;
+  int64_t begin = worldRank_ * partitionSize + std::min(worldRank_, leftOver);
+  if (worldRank_ < leftOver) {
+    partitionSize++;
+  }
+  shard_.assign(order.begin() + begin, order.begin() + begin + partitionSize);
+
+  // The file of the previous cache is closed before being truncated
+  ds_.reset();
+  shardDataset_.reset();
+  cache_.reset();
+  CacheDatasetOptions cacheOptions;
+  cacheOptions.maxBytes = options_.cacheMemoryBytes;
+  cacheOptions.spillPath = options_.localCachePath;
+  cacheOptions.maxSpillBytes = options_.maxCacheBytes;
+  cache_ = std::make_shared<CacheDataset>(base_, cacheOptions);
+
+  std::seed_seq seq{static_cast<int64_t>(options_.seed), worldRank_, epoch_};
+  shardDataset_ =
+      std::make_shared<ResampleDataset>(cache_, shuffled(shard_, seq));
+  ds_ = std::make_shared<PrefetchDataset>(
+      shardDataset_, numThreads_, prefetchSize_);
+  ds_ = std::make_shared<BatchDataset>(
+      ds_, batchSize_, BatchDatasetPolicy::INCLUDE_LAST, batchfns_);
 }
 
 std::vector<af::array> DistributedDataset::get(const int64_t idx) const {
@@ -39,13 +111,27 @@ std::vector<af::array> DistributedDataset::get(const int64_t idx) const {
 }
 
 void DistributedDataset::resample() {
-  shuffle_->resample();
+  if (!cache_) {
+    shuffle_->resample();
+    return;
+  }
+  ++epoch_;
+  if (options_.reshuffleEpochs > 0 && epoch_ % options_.reshuffleEpochs == 0) {
+    buildShard();
+    return;
+  }
+  std::seed_seq seq{static_cast<int64_t>(options_.seed), worldRank_, epoch_};
+  shardDataset_->resample(shuffled(shard_, seq));
 }
 
 int64_t DistributedDataset::size() const {
   return ds_->size();
 }
 
+CacheDatasetStats DistributedDataset::cacheStats() const {
+  return cache_ ? cache_->stats() : CacheDatasetStats();
+}
+
 } // namespace image
 } // namespace ext
 } // namespace fl
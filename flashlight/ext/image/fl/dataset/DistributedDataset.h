@@ -7,12 +7,41 @@
 
 #pragma once
 
+#include <string>
+
 #include "flashlight/fl/dataset/datasets.h"
 
 namespace fl {
 namespace ext {
 namespace image {
 
+struct DistributedDatasetOptions {
+  // If not empty, file of a node-local disk (e.g. NVMe) to which the process
+  // writes the samples of its shard as they are read, at the first epoch. The
+  // shards are then stable: each process keeps its contiguous range of the
+  // samples (ranks of a node are assumed consecutive, for which the ranges are
+  // contiguous as well), and shuffles it at each epoch.
+  std::string localCachePath;
+  // Bytes of cached samples kept in memory rather than written to the file
+  int64_t cacheMemoryBytes = 0;
+  // Bytes of samples written to the file, after which they're read again
+  int64_t maxCacheBytes = 1LL << 38;
+  // If > 0, the samples are reshuffled across all the processes every
+  // `reshuffleEpochs` calls to `resample()`, and the caches are cleared
+  int64_t reshuffleEpochs = 0;
+  // Seed of the shuffles, which must be the same on all the processes
+  int seed = 0;
+};
+
+/**
+ * The shard of a process of a dataset for distributed training, shuffled at
+ * each `resample()`, prefetched and batched. By default, the dataset is
+ * shuffled as a whole and sharded again at each epoch. With
+ * `options.localCachePath`, the shards are stable, and cached on a local disk
+ * (see `CacheDataset`) so that later epochs don't read the source of the
+ * samples: `base` must then return the same sample for an index, i.e. its
+ * random augmentations must be done in `batchfns`.
+ */
 class DistributedDataset : public Dataset {
  public:
   DistributedDataset(
@@ -21,7 +50,9 @@ class DistributedDataset : public Dataset {
       int64_t worldSize,
       int64_t batchSize,
       int64_t numThreads,
-      int64_t prefetchSize);
+      int64_t prefetchSize,
+      const std::vector<Dataset::BatchFunction>& batchfns = {},
+      const DistributedDatasetOptions& options = DistributedDatasetOptions());
 
   std::vector<af::array> get(const int64_t idx) const override;
 
@@ -29,9 +60,32 @@ class DistributedDataset : public Dataset {
 
   int64_t size() const override;
 
+  /**
+   * Hits and misses of the local cache, empty if not caching.
+   */
+  CacheDatasetStats cacheStats() const;
+
  private:
+  // Stable shards: sets `shard_` to the samples of this process and builds
+  // the cache and the datasets above it
+  void buildShard();
+
+  std::shared_ptr<Dataset> base_;
+  int64_t worldRank_;
+  int64_t worldSize_;
+  int64_t batchSize_;
+  int64_t numThreads_;
+  int64_t prefetchSize_;
+  std::vector<Dataset::BatchFunction> batchfns_;
+  DistributedDatasetOptions options_;
+
   std::shared_ptr<Dataset> ds_;
   std::shared_ptr<ShuffleDataset> shuffle_;
+
+  std::shared_ptr<CacheDataset> cache_;
+  std::shared_ptr<ResampleDataset> shardDataset_;
+  std::vector<int64_t> shard_;
+  int64_t epoch_{0};
 };
 
 } // namespace image
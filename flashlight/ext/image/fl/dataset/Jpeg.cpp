@@ -5,9 +5,10 @@
  * LICENSE file in the root directory of this source tree.
  */
 
-#include "flashlight/ext/image/af/Jpeg.h"
+#include "flashlight/ext/image/fl/dataset/Jpeg.h"
 
 #include <memory>
+#include <stdexcept>
 
 #include "flashlight/ext/image/fl/dataset/LoaderDataset.h"
 #include "flashlight/fl/dataset/datasets.h"
@@ -24,6 +25,19 @@ std::shared_ptr<Dataset> jpegLoader(std::vector<std::string> fps) {
       });
 }
 
+std::shared_ptr<Dataset> jpegLoader(
+    std::vector<std::string> fps,
+    const JpegDecodeOptions& options) {
+  if (!isJpegBackendAvailable(options.backend)) {
+    throw std::invalid_argument("jpegLoader: jpeg backend not built in");
+  }
+  return std::make_shared<LoaderDataset<std::string>>(
+      fps, [options](const std::string& fp) {
+        std::vector<af::array> result = {loadJpeg(fp, options)};
+        return result;
+      });
+}
+
 } // namespace image
 } // namespace ext
 } // namespace fl
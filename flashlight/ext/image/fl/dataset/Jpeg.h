@@ -9,6 +9,7 @@
 
 #include <memory>
 
+#include "flashlight/ext/image/af/Jpeg.h"
 #include "flashlight/fl/dataset/datasets.h"
 
 namespace fl {
@@ -17,6 +18,14 @@ namespace image {
 
 std::shared_ptr<Dataset> jpegLoader(std::vector<std::string> fps);
 
+/*
+ * Loads the jpegs of `fps` with the decoder of `options`, e.g. libjpeg-turbo
+ * decoding only the crop of a `randomResizeCropRegion()`
+ */
+std::shared_ptr<Dataset> jpegLoader(
+    std::vector<std::string> fps,
+    const JpegDecodeOptions& options);
+
 } // namespace image
 } // namespace ext
 } // namespace fl
@@ -13,16 +13,27 @@ namespace image {
 
 namespace {
 
-Conv2D conv3x3(int inC, int outC, int stride, int groups) {
+Conv2D
+conv3x3(int inC, int outC, int stride, int groups, ImageLayout layout) {
   const auto pad = PaddingMode::SAME;
-  return Conv2D(
-      inC, outC, 3, 3, stride, stride, pad, pad, 1, 1, false, groups);
+  auto conv =
+      Conv2D(inC, outC, 3, 3, stride, stride, pad, pad, 1, 1, false, groups);
+  conv.setLayout(layout);
+  return conv;
 }
 
-Conv2D conv1x1(int inC, int outC, int stride, int groups) {
+Conv2D
+conv1x1(int inC, int outC, int stride, int groups, ImageLayout layout) {
   const auto pad = PaddingMode::SAME;
-  return Conv2D(
-      inC, outC, 1, 1, stride, stride, pad, pad, 1, 1, false, groups);
+  auto conv =
+      Conv2D(inC, outC, 1, 1, stride, stride, pad, pad, 1, 1, false, groups);
+  conv.setLayout(layout);
+  return conv;
+}
+
+// Feature axis of the batchnorms
+int channelAxis(ImageLayout layout) {
+  return layout == ImageLayout::CWHN ? 0 : 2;
 }
 
 } // namespace
@@ -37,50 +48,67 @@ ConvBnAct::ConvBnAct(
     const int sx,
     const int sy,
     bool bn,
-    bool act) {
+    bool act,
+    ImageLayout layout) {
   const auto pad = PaddingMode::SAME;
   const bool bias = !bn;
-  add(std::make_shared<fl::Conv2D>(
-      inC, outC, kw, kh, sx, sy, pad, pad, 1, 1, bias));
+  auto conv = std::make_shared<fl::Conv2D>(
+      inC, outC, kw, kh, sx, sy, pad, pad, 1, 1, bias);
+  conv->setLayout(layout);
+  add(conv);
   if (bn) {
-    add(std::make_shared<fl::BatchNorm>(2, outC));
+    add(std::make_shared<fl::BatchNorm>(channelAxis(layout), outC));
   }
   if (act) {
     add(std::make_shared<fl::ReLU>());
   }
 }
 
+std::vector<fl::Variable> ConvBnAct::forward(
+    const std::vector<fl::Variable>& inputs) {
+  auto bn = modules().size() == 3
+      ? std::dynamic_pointer_cast<fl::BatchNorm>(module(1))
+      : nullptr;
+  if (!bn) {
+    return Sequential::forward(inputs);
+  }
+  auto out = module(0)->forward(inputs);
+  return {bn->forwardRelu(out[0])};
+}
+
 ResNetBlock::ResNetBlock() = default;
 
-ResNetBlock::ResNetBlock(const int inC, const int outC, const int stride) {
-  add(std::make_shared<Conv2D>(conv3x3(inC, outC, stride, 1)));
-  add(std::make_shared<BatchNorm>(BatchNorm(2, outC)));
+ResNetBlock::ResNetBlock(
+    const int inC,
+    const int outC,
+    const int stride,
+    ImageLayout layout) {
+  const int axis = channelAxis(layout);
+  add(std::make_shared<Conv2D>(conv3x3(inC, outC, stride, 1, layout)));
+  add(std::make_shared<BatchNorm>(BatchNorm(axis, outC)));
   add(std::make_shared<ReLU>());
-  add(std::make_shared<Conv2D>(conv3x3(outC, outC, 1, 1)));
-  add(std::make_shared<BatchNorm>(BatchNorm(2, outC)));
+  add(std::make_shared<Conv2D>(conv3x3(outC, outC, 1, 1, layout)));
+  add(std::make_shared<BatchNorm>(BatchNorm(axis, outC)));
   add(std::make_shared<ReLU>());
   if (inC != outC || stride > 1) {
     Sequential downsample;
-    downsample.add(conv1x1(inC, outC, stride, 1));
-    downsample.add(BatchNorm(2, outC));
+    downsample.add(conv1x1(inC, outC, stride, 1, layout));
+    downsample.add(BatchNorm(axis, outC));
     add(downsample);
   }
 }
 
 std::vector<fl::Variable> ResNetBlock::forward(
     const std::vector<fl::Variable>& inputs) {
+  // The ReLU modules (2 and 5) are applied by the batchnorms
   auto c1 = module(0);
-  auto bn1 = module(1);
-  auto relu1 = module(2);
+  auto bn1 = std::dynamic_pointer_cast<BatchNorm>(module(1));
   auto c2 = module(3);
-  auto bn2 = module(4);
-  auto relu2 = module(5);
+  auto bn2 = std::dynamic_pointer_cast<BatchNorm>(module(4));
   std::vector<fl::Variable> out;
   out = c1->forward(inputs);
-  out = bn1->forward(out);
-  out = relu1->forward(out);
+  out = {bn1->forwardRelu(out[0])};
   out = c2->forward(out);
-  out = bn2->forward(out);
 
   std::vector<fl::Variable> shortcut;
   if (modules().size() > 6) {
@@ -88,7 +116,7 @@ std::vector<fl::Variable> ResNetBlock::forward(
   } else {
     shortcut = inputs;
   }
-  return relu2->forward({out[0] + shortcut[0]});
+  return {bn2->forwardRelu(out[0], shortcut[0])};
 }
 
 std::string ResNetBlock::prettyString() const {
@@ -101,30 +129,38 @@ ResNetStage::ResNetStage(
     const int inC,
     const int outC,
     const int numBlocks,
-    const int stride) {
-  add(ResNetBlock(inC, outC, stride));
+    const int stride,
+    ImageLayout layout) {
+  add(ResNetBlock(inC, outC, stride, layout));
   for (int i = 1; i < numBlocks; i++) {
-    add(ResNetBlock(outC, outC));
+    add(ResNetBlock(outC, outC, 1, layout));
   }
 }
 
-std::shared_ptr<Sequential> resnet34() {
+std::shared_ptr<Sequential> resnet34(
+    ImageLayout layout /* = ImageLayout::WHCN */) {
   auto model = std::make_shared<Sequential>();
+  if (layout == ImageLayout::CWHN) {
+    // 244x244x3 -> 3x244x244, the only conversion of the layout: the
+    // classifier output of 1x1 images is 1000x1x1 in both layouts
+    model->add(Reorder(2, 0, 1, 3));
+  }
   // conv1 -> 244x244x3 -> 112x112x64
-  model->add(ConvBnAct(3, 64, 7, 7, 2, 2));
+  model->add(ConvBnAct(3, 64, 7, 7, 2, 2, true, true, layout));
   // maxpool -> 112x122x64 -> 56x56x64
-  model->add(Pool2D(3, 3, 2, 2, -1, -1, PoolingMode::MAX));
+  model->add(Pool2D(3, 3, 2, 2, -1, -1, PoolingMode::MAX, layout));
   // conv2_x -> 56x56x64 -> 56x56x64
-  model->add(ResNetStage(64, 64, 3, 1));
+  model->add(ResNetStage(64, 64, 3, 1, layout));
   // conv3_x -> 56x56x64 -> 28x28x128
-  model->add(ResNetStage(64, 128, 4, 2));
+  model->add(ResNetStage(64, 128, 4, 2, layout));
   // conv4_x -> 28x28x128 -> 14x14x256
-  model->add(ResNetStage(128, 256, 6, 2));
+  model->add(ResNetStage(128, 256, 6, 2, layout));
   // conv5_x -> 14x14x256 -> 7x7x256
-  model->add(ResNetStage(256, 512, 3, 2));
+  model->add(ResNetStage(256, 512, 3, 2, layout));
   // pool 7x7x512 -> 1x1x512
-  model->add(Pool2D(7, 7, 1, 1, 0, 0, fl::PoolingMode::AVG_EXCLUDE_PADDING));
-  model->add(ConvBnAct(512, 1000, 1, 1, 1, 1, false, false));
+  model->add(Pool2D(
+      7, 7, 1, 1, 0, 0, fl::PoolingMode::AVG_EXCLUDE_PADDING, layout));
+  model->add(ConvBnAct(512, 1000, 1, 1, 1, 1, false, false, layout));
   model->add(View({1000, -1}));
   model->add(LogSoftmax());
   return model;
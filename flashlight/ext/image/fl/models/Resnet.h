@@ -24,7 +24,14 @@ class ConvBnAct : public fl::Sequential {
       const int sx = 1,
       const int sy = 1,
       bool bn = true,
-      bool act = true);
+      bool act = true,
+      ImageLayout layout = ImageLayout::WHCN);
+
+  using fl::Sequential::forward;
+
+  // Fuses the batchnorm and the activation with `BatchNorm::forwardRelu()`
+  std::vector<fl::Variable> forward(
+      const std::vector<fl::Variable>& inputs) override;
 
  private:
   FL_SAVE_LOAD_WITH_BASE(fl::Sequential)
@@ -38,8 +45,11 @@ class ResNetBlock : public fl::Container {
   explicit ResNetBlock(
       const int inChannels,
       const int outChannels,
-      const int stride = 1);
+      const int stride = 1,
+      ImageLayout layout = ImageLayout::WHCN);
 
+  // The batchnorms are fused with the shortcut and the activations, see
+  // `BatchNorm::forwardRelu()`
   std::vector<fl::Variable> forward(
       const std::vector<fl::Variable>& inputs) override;
 
@@ -53,11 +63,17 @@ class ResNetStage : public fl::Sequential {
       const int inChannels,
       const int outChannels,
       const int numBlocks,
-      const int stride);
+      const int stride,
+      ImageLayout layout = ImageLayout::WHCN);
   FL_SAVE_LOAD_WITH_BASE(fl::Sequential)
 };
 
-std::shared_ptr<Sequential> resnet34();
+/**
+ * ResNet-34 on W x H x C x N images. With `ImageLayout::CWHN`, the images are
+ * reordered once at the input, and the convolutions, batchnorms and poolings
+ * run channels-last (NHWC in cuDNN), which is faster for f16 on tensor cores.
+ */
+std::shared_ptr<Sequential> resnet34(ImageLayout layout = ImageLayout::WHCN);
 
 } // namespace image
 } // namespace ext
@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/ext/integrations/halide/HalideFusion.h"
+
+#include <array>
+#include <mutex>
+#include <stdexcept>
+
+#include "flashlight/ext/integrations/halide/HalideInterface.h"
+
+namespace fl {
+namespace ext {
+
+namespace detail {
+
+namespace {
+
+// Threads per CUDA block of the elementwise kernels
+constexpr int kBlockSize = 256;
+// Points per task of the elementwise pipelines on the host
+constexpr int kHostTaskSize = 4096;
+constexpr int kHostVectorSize = 8;
+
+// Inputs are flattened so pipelines are 1D
+void scheduleElementwise(Halide::Func& func) {
+  Halide::Var x = func.args()[0];
+#if FL_BACKEND_CUDA
+  // One point per thread
+  Halide::Var block, thread;
+  func.gpu_tile(
+      x,
+      block,
+      thread,
+      kBlockSize,
+      Halide::TailStrategy::GuardWithIf,
+      Halide::DeviceAPI::CUDA);
+#else
+  // Parallel tasks of vectorized points
+  Halide::Var task, point;
+  func.split(x, task, point, kHostTaskSize, Halide::TailStrategy::GuardWithIf)
+      .parallel(task)
+      .vectorize(point, kHostVectorSize);
+#endif
+}
+
+} // namespace
+
+struct HalideElementwisePipelines {
+  std::string name;
+  std::vector<Halide::ImageParam> inputs;
+  // Gradient of the output, input of the backward pipeline
+  Halide::ImageParam gradOutput;
+  std::vector<Halide::Param<float>> scalars;
+  Halide::Pipeline forward;
+  Halide::Pipeline backward;
+  bool compiled{false};
+  // Parameters are shared by calls
+  std::mutex mutex;
+
+  void compile() {
+    if (compiled) {
+      return;
+    }
+    forward.compile_jit(halideTarget());
+    backward.compile_jit(halideTarget());
+    compiled = true;
+  }
+
+  std::vector<af::array> run(
+      Halide::Pipeline& pipeline,
+      std::vector<af::array> args,
+      const std::vector<float>& values,
+      int numOutputs) {
+    std::lock_guard<std::mutex> lock(mutex);
+    compile();
+    std::vector<std::unique_ptr<HalideBufferWrapper<float>>> wrappers;
+    for (int i = 0; i < args.size(); ++i) {
+      wrappers.emplace_back(
+          std::make_unique<HalideBufferWrapper<float>>(args[i]));
+      auto& param = i < inputs.size() ? inputs[i] : gradOutput;
+      param.set(wrappers.back()->getBuffer());
+    }
+    for (int i = 0; i < values.size(); ++i) {
+      scalars[i].set(values[i]);
+    }
+
+    std::vector<af::array> outputs;
+    std::vector<Halide::Buffer<>> buffers;
+    for (int i = 0; i < numOutputs; ++i) {
+      outputs.emplace_back(args[0].dims(), f32);
+    }
+    for (auto& output : outputs) {
+      wrappers.emplace_back(
+          std::make_unique<HalideBufferWrapper<float>>(output));
+      buffers.push_back(wrappers.back()->getBuffer());
+    }
+    Halide::Realization realization(buffers);
+    pipeline.realize(realization, halideTarget());
+    return outputs;
+  }
+};
+
+} // namespace detail
+
+HalideElementwise::HalideElementwise(
+    const std::string& name,
+    int numInputs,
+    int numScalars,
+    ForwardFunc forward,
+    BackwardFunc backward)
+    : pipelines_(std::make_shared<detail::HalideElementwisePipelines>()) {
+  if (numInputs < 1) {
+    throw std::invalid_argument(
+        "HalideElementwise: expects at least one input");
+  }
+  auto& p = *pipelines_;
+  p.name = name;
+  Halide::Var x("x");
+  Exprs inputValues, scalarValues;
+  for (int i = 0; i < numInputs; ++i) {
+    p.inputs.emplace_back(
+        Halide::Float(32), 1, name + "_input" + std::to_string(i));
+    inputValues.push_back(p.inputs.back()(x));
+  }
+  for (int i = 0; i < numScalars; ++i) {
+    p.scalars.emplace_back(name + "_scalar" + std::to_string(i));
+    scalarValues.push_back(p.scalars.back());
+  }
+  p.gradOutput = Halide::ImageParam(Halide::Float(32), 1, name + "_grad");
+
+  Halide::Func forwardFunc(name);
+  forwardFunc(x) = Halide::cast<float>(forward(inputValues, scalarValues));
+  scheduleElementwise(forwardFunc);
+  p.forward = Halide::Pipeline(forwardFunc);
+
+  auto grads = backward(inputValues, scalarValues, p.gradOutput(x));
+  if (grads.size() != numInputs) {
+    throw std::invalid_argument(
+        "HalideElementwise: expects the gradient of each input");
+  }
+  for (auto& grad : grads) {
+    grad = Halide::cast<float>(grad);
+  }
+  // All the gradients are computed by a single kernel
+  Halide::Func backwardFunc(name + "_backward");
+  if (grads.size() == 1) {
+    backwardFunc(x) = grads[0];
+  } else {
+    backwardFunc(x) = Halide::Tuple(grads);
+  }
+  scheduleElementwise(backwardFunc);
+  p.backward = Halide::Pipeline(backwardFunc);
+}
+
+Variable HalideElementwise::operator()(
+    const std::vector<Variable>& inputs,
+    const std::vector<float>& scalars /* = {} */) const {
+  if (inputs.size() != pipelines_->inputs.size() ||
+      scalars.size() != pipelines_->scalars.size()) {
+    throw std::invalid_argument(
+        "HalideElementwise: invalid number of inputs or scalars for " +
+        pipelines_->name);
+  }
+  std::vector<af::array> args;
+  for (auto& input : inputs) {
+    if (input.type() != f32 || input.dims() != inputs[0].dims()) {
+      throw std::invalid_argument(
+          "HalideElementwise: expects f32 inputs of the same dimensions");
+    }
+    args.push_back(af::flat(input.array()));
+  }
+  auto dims = inputs[0].dims();
+  auto pipelines = pipelines_;
+  auto result = af::moddims(
+      pipelines->run(pipelines->forward, args, scalars, 1)[0], dims);
+
+  auto gradFunc = [pipelines, scalars, dims](
+                      std::vector<Variable>& inputs,
+                      const Variable& gradOutput) {
+    std::vector<af::array> args;
+    for (auto& input : inputs) {
+      args.push_back(af::flat(input.array()));
+    }
+    args.push_back(af::flat(gradOutput.array().as(f32)));
+    auto grads =
+        pipelines->run(pipelines->backward, args, scalars, inputs.size());
+    for (int i = 0; i < inputs.size(); ++i) {
+      if (inputs[i].isCalcGrad()) {
+        inputs[i].addGrad(Variable(af::moddims(grads[i], dims), false));
+      }
+    }
+  };
+  return Variable(result, inputs, gradFunc);
+}
+
+namespace {
+
+Halide::Expr sigmoid(const Halide::Expr& x) {
+  return 1 / (1 + Halide::exp(-x));
+}
+
+} // namespace
+
+Variable halideSwish(const Variable& input, float beta /* = 1.0 */) {
+  static const HalideElementwise swish(
+      "swish",
+      1,
+      1,
+      [](const auto& in, const auto& scalars) {
+        return in[0] * sigmoid(scalars[0] * in[0]);
+      },
+      [](const auto& in, const auto& scalars, const Halide::Expr& grad) {
+        auto sig = sigmoid(scalars[0] * in[0]);
+        return HalideElementwise::Exprs{
+            grad * (sig + scalars[0] * in[0] * sig * (1 - sig))};
+      });
+  return swish({input}, {beta});
+}
+
+Variable halideGatedLinearUnit(const Variable& input, const int dim) {
+  static const HalideElementwise glu(
+      "glu",
+      2,
+      0,
+      [](const auto& in, const auto& scalars) {
+        return in[0] * sigmoid(in[1]);
+      },
+      [](const auto& in, const auto& scalars, const Halide::Expr& grad) {
+        auto sig = sigmoid(in[1]);
+        return HalideElementwise::Exprs{
+            grad * sig, grad * in[0] * sig * (1 - sig)};
+      });
+  auto inSize = input.dims(dim);
+  if (inSize % 2 == 1) {
+    throw std::invalid_argument("halving dimension must be even for GLU");
+  }
+  std::array<af::seq, 4> fhalf, shalf;
+  fhalf.fill(af::span);
+  shalf.fill(af::span);
+  fhalf[dim] = af::seq(inSize / 2);
+  shalf[dim] = af::seq(inSize / 2, inSize - 1);
+  return glu(
+      {input(fhalf[0], fhalf[1], fhalf[2], fhalf[3]),
+       input(shalf[0], shalf[1], shalf[2], shalf[3])});
+}
+
+Variable halideClamp(const Variable& input, float lo, float hi) {
+  static const HalideElementwise clamp(
+      "clamp",
+      1,
+      2,
+      [](const auto& in, const auto& scalars) {
+        return Halide::clamp(in[0], scalars[0], scalars[1]);
+      },
+      [](const auto& in, const auto& scalars, const Halide::Expr& grad) {
+        return HalideElementwise::Exprs{Halide::select(
+            in[0] > scalars[0] && in[0] < scalars[1], grad, 0.0f)};
+      });
+  return clamp({input}, {lo, hi});
+}
+
+Variable
+halideMaskScale(const Variable& input, const Variable& mask, float scale) {
+  static const HalideElementwise maskScale(
+      "mask_scale",
+      2,
+      1,
+      [](const auto& in, const auto& scalars) {
+        return in[0] * in[1] * scalars[0];
+      },
+      [](const auto& in, const auto& scalars, const Halide::Expr& grad) {
+        return HalideElementwise::Exprs{
+            grad * in[1] * scalars[0], grad * in[0] * scalars[0]};
+      });
+  return maskScale({input, mask.as(f32)}, {scale});
+}
+
+} // namespace ext
+} // namespace fl
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <Halide.h>
+
+#include "flashlight/fl/autograd/Variable.h"
+
+namespace fl {
+namespace ext {
+
+namespace detail {
+struct HalideElementwisePipelines;
+} // namespace detail
+
+/**
+ * A chain of elementwise operations on f32 inputs of the same dimensions,
+ * fused into a single Halide pipeline (one CUDA kernel, or one parallel
+ * vectorized loop with the CPU backend), with its gradient computed by a
+ * second pipeline.
+ *
+ * The operations are given as Halide expressions of the (scalar) values of
+ * the inputs at a point and of scalar parameters, and the gradient as the
+ * expressions of the gradient with respect to each input, given the gradient
+ * of the output. Pipelines are JIT-compiled on first use.
+ *
+ * Example:
+   \code
+   // swish(x) = x * sigmoid(x)
+   auto swish = HalideElementwise(
+       "swish",
+       1, // inputs
+       0, // scalars
+       [](const auto& in, const auto& scalars) {
+         return in[0] / (1 + Halide::exp(-in[0]));
+       },
+       [](const auto& in, const auto& scalars, const Halide::Expr& grad) {
+         auto sig = 1 / (1 + Halide::exp(-in[0]));
+         return std::vector<Halide::Expr>{
+             grad * (sig + in[0] * sig * (1 - sig))};
+       });
+   auto y = swish({x});
+   \endcode
+ */
+class HalideElementwise {
+ public:
+  using Exprs = std::vector<Halide::Expr>;
+  using ForwardFunc =
+      std::function<Halide::Expr(const Exprs& inputs, const Exprs& scalars)>;
+  using BackwardFunc = std::function<Exprs(
+      const Exprs& inputs,
+      const Exprs& scalars,
+      const Halide::Expr& gradOutput)>;
+
+  /**
+   * @param name the name of the pipelines
+   * @param numInputs the number of inputs
+   * @param numScalars the number of scalar parameters
+   * @param forward the expression of the output
+   * @param backward the expressions of the gradients of the inputs
+   */
+  HalideElementwise(
+      const std::string& name,
+      int numInputs,
+      int numScalars,
+      ForwardFunc forward,
+      BackwardFunc backward);
+
+  /**
+   * Computes the output for `inputs`, of the same dimensions and of type f32,
+   * with the values of the scalar parameters `scalars`.
+   */
+  Variable operator()(
+      const std::vector<Variable>& inputs,
+      const std::vector<float>& scalars = {}) const;
+
+ private:
+  std::shared_ptr<detail::HalideElementwisePipelines> pipelines_;
+};
+
+/**
+ * Fused \f$ x \cdot \sigma(\beta x) \f$.
+ */
+Variable halideSwish(const Variable& input, float beta = 1.0);
+
+/**
+ * Fused gated linear unit, see `fl::gatedlinearunit`.
+ */
+Variable halideGatedLinearUnit(const Variable& input, const int dim);
+
+/**
+ * Fused `fl::clamp`.
+ */
+Variable halideClamp(const Variable& input, float lo, float hi);
+
+/**
+ * Fused application of a dropout mask: \f$ x \cdot mask \cdot scale \f$.
+ */
+Variable
+halideMaskScale(const Variable& input, const Variable& mask, float scale);
+
+} // namespace ext
+} // namespace fl
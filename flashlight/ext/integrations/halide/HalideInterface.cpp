@@ -6,12 +6,19 @@
  */
 
 #include "flashlight/ext/integrations/halide/HalideInterface.h"
-#include "flashlight/fl/common/CudaUtils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <unordered_set>
 
 #include <af/device.h>
 #include <af/dim4.hpp>
 
+#if FL_BACKEND_CUDA
+#include "flashlight/fl/common/CudaUtils.h"
+
 #include <cuda.h> // Driver API needed for CUcontext
+#endif
 
 /*
  * Replace Halide weakly-linked CUDA handles.
@@ -76,6 +83,7 @@
  * I couldn't quite get this to work, but it might work better and not have some
  * side effects that the current implementation does. Unclear.
  */
+#if FL_BACKEND_CUDA
 extern "C" {
 
 int halide_cuda_device_malloc(void* /* user_context */, halide_buffer_t* buf) {
@@ -127,6 +135,7 @@ int halide_get_gpu_device(void* /* user_context */) {
 }
 
 } // extern "C"
+#endif // FL_BACKEND_CUDA
 
 namespace fl {
 namespace ext {
@@ -200,5 +209,79 @@ af::dtype halideRuntimeTypeToAfType(halide_type_t type) {
           "halideRuntimeTypeToAfType: unsupported or unknown Halide type");
   }
 }
+
+Halide::Target halideTarget() {
+  auto target = Halide::get_target_from_environment();
+#if FL_BACKEND_CUDA
+  target = target.with_feature(Halide::Target::Feature::CUDA);
+#endif
+  return target;
+}
+
+namespace {
+
+// Loads the plugin of an autoscheduler, e.g. libautoschedule_adams2019 for
+// Adams2019, once per process. Called under the lock of the registry
+void loadAutoscheduler(const std::string& autoscheduler) {
+  static std::unordered_set<std::string> loaded;
+  if (loaded.count(autoscheduler)) {
+    return;
+  }
+  std::string lib = "autoschedule_" + autoscheduler;
+  std::transform(lib.begin(), lib.end(), lib.begin(), [](unsigned char c) {
+    return std::tolower(c);
+  });
+  Halide::load_plugin(lib);
+  loaded.insert(autoscheduler);
+}
+
+} // namespace
+
+constexpr const char* HalidePipelineRegistry::kCpuAutoscheduler;
+constexpr const char* HalidePipelineRegistry::kGpuAutoscheduler;
+
+HalidePipelineRegistry& HalidePipelineRegistry::getInstance() {
+  static HalidePipelineRegistry registry;
+  return registry;
+}
+
+void HalidePipelineRegistry::registerPipeline(
+    const std::string& name,
+    Builder builder,
+    const std::string& autoscheduler /* = "" */) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (entries_.count(name)) {
+    throw std::invalid_argument(
+        "HalidePipelineRegistry: pipeline already registered: " + name);
+  }
+  entries_[name] = Entry{std::move(builder), autoscheduler, {}};
+}
+
+Halide::Pipeline& HalidePipelineRegistry::get(
+    const std::string& name,
+    const Halide::Target& target /* = halideTarget() */) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(name);
+  if (it == entries_.end()) {
+    throw std::invalid_argument(
+        "HalidePipelineRegistry: no pipeline registered as " + name);
+  }
+  auto& entry = it->second;
+  auto& pipeline = entry.compiled[target.to_string()];
+  if (!pipeline) {
+    std::string autoscheduler = entry.autoscheduler;
+    if (autoscheduler.empty()) {
+      autoscheduler =
+          target.has_gpu_feature() ? kGpuAutoscheduler : kCpuAutoscheduler;
+    }
+    loadAutoscheduler(autoscheduler);
+    // Each target schedules its own definition of the pipeline
+    auto built = std::make_unique<Halide::Pipeline>(entry.builder());
+    built->auto_schedule(autoscheduler, target);
+    built->compile_jit(target);
+    pipeline = std::move(built);
+  }
+  return *pipeline;
+}
 } // namespace ext
 } // namespace fl
@@ -7,16 +7,25 @@
 
 #pragma once
 
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
+#if FL_BACKEND_CUDA
 #include <cuda.h>
 #include <cuda_runtime.h>
+#endif
 
 #include <Halide.h>
 #include <HalideBuffer.h>
 #include <HalideRuntime.h>
+#if FL_BACKEND_CUDA
 #include <HalideRuntimeCuda.h>
+#endif
 
 #include <af/array.h>
 
@@ -47,6 +56,13 @@ af::dim4 halideToAfDims(const Halide::Buffer<void>& buffer);
 
 af::dtype halideRuntimeTypeToAfType(halide_type_t type);
 
+/**
+ * The Halide target of the memory of ArrayFire arrays with the backend
+ * flashlight is built with: the host target from the environment, with the
+ * CUDA feature for the CUDA backend.
+ */
+Halide::Target halideTarget();
+
 /**
  * A thin wrapper around an ArrayFire array as converted to a Halide buffer.
  *
@@ -54,6 +70,10 @@ af::dtype halideRuntimeTypeToAfType(halide_type_t type);
  * underlying Array is properly managed as it relates to the lifetime of hte
  * Halide Buffer.
  *
+ * With the CUDA backend, the array's device memory is wrapped as the
+ * buffer's device allocation. With the CPU backend, the array's memory is on
+ * the host and is the buffer's host allocation: no copy is made either way.
+ *
  * The toHalideBuffer and fromHalideBuffer functions provide indefinite lifetime
  * guarantees around their conversions which are unmanaged and require manual
  * cleanup. Use this class instead for automatic lifetime management.
@@ -63,12 +83,18 @@ class HalideBufferWrapper {
  public:
   HalideBufferWrapper(af::array& array) {
     devicePtr_ = DevicePtr(array);
+#if FL_BACKEND_CUDA
     halideBuffer_ = Halide::Buffer<T>(afToHalideDims(array.dims()));
     // Halide::Buffer::device_detach_native(...) is implicitly called by the
     // Halide::Buffer dtor which will preserve the Array's underlying memory
     FL_HALIDE_CHECK(halideBuffer_.device_wrap_native(
         halide_cuda_device_interface(), (uint64_t)devicePtr_.get()));
     halideBuffer_.set_device_dirty();
+#else
+    // The buffer doesn't own host memory it is created with
+    halideBuffer_ = Halide::Buffer<T>(
+        static_cast<T*>(devicePtr_.get()), afToHalideDims(array.dims()));
+#endif
   }
 
   Halide::Buffer<T>& getBuffer() {
@@ -84,6 +110,75 @@ class HalideBufferWrapper {
   Halide::Buffer<T> halideBuffer_;
 };
 
+/**
+ * A registry of JIT-compiled Halide pipelines, scheduled by a Halide
+ * autoscheduler for each target they are used with, rather than by hand.
+ *
+ * Pipelines are registered by name with a function building them, whose
+ * inputs and outputs have estimates of their sizes (see
+ * `Halide::Func::set_estimates()` and `Halide::ImageParam::set_estimates()`),
+ * as autoschedulers require them. A pipeline is built, scheduled and compiled
+ * on its first use with a target, then reused: the builder is called once per
+ * target and must define new `Halide::Func`s each time.
+ *
+ * Example:
+   \code
+   auto& registry = HalidePipelineRegistry::getInstance();
+   registry.registerPipeline("scale", [&]() {
+     Halide::Func scale("scale");
+     scale(x) = input(x) * factor;
+     input.set_estimates({{0, 1 << 20}});
+     scale.set_estimates({{0, 1 << 20}});
+     return Halide::Pipeline(scale);
+   });
+   registry.get("scale").realize(realization, halideTarget());
+   \endcode
+ */
+class HalidePipelineRegistry {
+ public:
+  using Builder = std::function<Halide::Pipeline()>;
+
+  static HalidePipelineRegistry& getInstance();
+
+  /**
+   * Registers pipeline `name`, built by `builder`.
+   *
+   * @param autoscheduler the Halide autoscheduler with which to schedule the
+   * pipeline (its plugin, e.g. `libautoschedule_adams2019`, is loaded on
+   * first use). If empty, the default for each target:
+   * `kGpuAutoscheduler` for targets with a GPU feature and
+   * `kCpuAutoscheduler` otherwise.
+   */
+  void registerPipeline(
+      const std::string& name,
+      Builder builder,
+      const std::string& autoscheduler = "");
+
+  /**
+   * Returns pipeline `name` scheduled and compiled for `target`.
+   */
+  Halide::Pipeline& get(
+      const std::string& name,
+      const Halide::Target& target = halideTarget());
+
+  static constexpr const char* kCpuAutoscheduler = "Adams2019";
+  static constexpr const char* kGpuAutoscheduler = "Li2018";
+
+ private:
+  HalidePipelineRegistry() = default;
+
+  struct Entry {
+    Builder builder;
+    std::string autoscheduler;
+    // By target string
+    std::unordered_map<std::string, std::unique_ptr<Halide::Pipeline>>
+        compiled;
+  };
+
+  std::unordered_map<std::string, Entry> entries_;
+  std::mutex mutex_;
+};
+
 namespace detail {
 
 /**
@@ -99,6 +194,11 @@ Halide::Buffer<T> toHalideBuffer(af::array& arr) {
   // Since the buffer manages the memory, give it a persistent pointer that
   // won't be unlocked or invalidated if the Array falls out of scope.
   void* deviceMem = arr.device<void>();
+#if !FL_BACKEND_CUDA
+  // Host memory
+  return Halide::Buffer<T>(
+      static_cast<T*>(deviceMem), afToHalideDims(arr.dims()));
+#else
   Halide::Buffer<T> buffer(afToHalideDims(arr.dims()));
   // Target is CUDA only -- TODO: change based on location of af::array
   // and try to move away from halide_cuda_device_interface()
@@ -112,6 +212,7 @@ Halide::Buffer<T> toHalideBuffer(af::array& arr) {
       halide_cuda_device_interface(), (uint64_t)deviceMem));
   buffer.set_device_dirty();
   return buffer;
+#endif
 }
 
 /**
@@ -130,6 +231,15 @@ Halide::Buffer<T> toHalideBuffer(af::array& arr) {
  */
 template <typename T>
 af::array fromHalideBuffer(Halide::Buffer<T>& buffer) {
+#if !FL_BACKEND_CUDA
+  if (buffer.get()->owns_host_memory()) {
+    throw std::invalid_argument(
+        "fl::ext::fromHalideBuffer can only be called with buffers created "
+        "with fl::ext::toHalideBuffer or buffers that don't own their host "
+        "memory.");
+  }
+  return af::array(halideToAfDims(buffer), buffer.data(), afDevice);
+#else
   T* deviceMem = reinterpret_cast<T*>(buffer.raw_buffer()->device);
   if (buffer.get()->device_ownership() ==
       Halide::Runtime::BufferDeviceOwnership::WrappedNative) {
@@ -141,6 +251,7 @@ af::array fromHalideBuffer(Halide::Buffer<T>& buffer) {
         "device ownership policies.");
   }
   return af::array(halideToAfDims(buffer), deviceMem, afDevice);
+#endif
 }
 } // namespace detail
 } // namespace ext
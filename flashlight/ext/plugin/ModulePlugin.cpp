@@ -8,16 +8,50 @@
 
 #include "flashlight/ext/plugin/ModulePlugin.h"
 
+#include <stdexcept>
+
 namespace fl {
 namespace ext {
 
-ModulePlugin::ModulePlugin(const std::string& name) : fl::Plugin(name) {
-  arch_ = getSymbol<w2l_module_plugin_t>("createModule");
+ModulePlugin::ModulePlugin(const std::string& name)
+    : fl::Plugin(name), name_(name) {
+  if (hasSymbol("createModule")) {
+    arch_ = getSymbol<w2l_module_plugin_t>("createModule");
+  }
+  if (hasSymbol("registerPlugin")) {
+    auto registerPlugin = getSymbol<w2l_register_plugin_t>("registerPlugin");
+    auto& registry = PluginRegistry::getInstance();
+    registry.setOwner(name_);
+    try {
+      registerPlugin(&registry);
+    } catch (...) {
+      registry.setOwner("");
+      registry.unregister(name_);
+      throw;
+    }
+    registry.setOwner("");
+    registered_ = true;
+  }
+  if (!arch_ && !registered_) {
+    throw std::runtime_error(
+        "ModulePlugin: library <" + name +
+        "> defines neither createModule nor registerPlugin");
+  }
+}
+
+ModulePlugin::~ModulePlugin() {
+  if (registered_) {
+    PluginRegistry::getInstance().unregister(name_);
+  }
 }
 
 std::shared_ptr<fl::Module> ModulePlugin::arch(
     int64_t nFeatures,
     int64_t nClasses) {
+  if (!arch_) {
+    throw std::runtime_error(
+        "ModulePlugin: library <" + name_ + "> doesn't define createModule");
+  }
   return std::shared_ptr<fl::Module>(arch_(nFeatures, nClasses));
 }
 
@@ -8,6 +8,7 @@
 
 #pragma once
 
+#include "flashlight/ext/plugin/PluginRegistry.h"
 #include "flashlight/fl/common/Plugin.h"
 #include "flashlight/fl/nn/modules/Module.h"
 
@@ -16,13 +17,29 @@ namespace ext {
 
 typedef Module* (*w2l_module_plugin_t)(int64_t nFeatures, int64_t nClasses);
 
+/**
+ * Registers the ops, module replacements and benchmark candidates of a
+ * plugin, see `PluginRegistry`.
+ */
+typedef void (*w2l_register_plugin_t)(PluginRegistry* registry);
+
+/**
+ * A shared library defining (with C linkage) an arch as `createModule`
+ * (see `w2l_module_plugin_t`), and/or registering custom kernels with
+ * `registerPlugin` (see `w2l_register_plugin_t`), which is called on load.
+ * What the plugin registered is unregistered when it is destroyed.
+ */
 class ModulePlugin : public Plugin {
  public:
   explicit ModulePlugin(const std::string& name);
+  ~ModulePlugin();
+
   std::shared_ptr<fl::Module> arch(int64_t nFeatures, int64_t nClasses);
 
  private:
-  w2l_module_plugin_t arch_;
+  std::string name_;
+  w2l_module_plugin_t arch_{nullptr};
+  bool registered_{false};
 };
 
 } // namespace ext
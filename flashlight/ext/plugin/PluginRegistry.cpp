@@ -0,0 +1,226 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/ext/plugin/PluginRegistry.h"
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+#include "flashlight/fl/common/Defines.h"
+#include "flashlight/fl/nn/modules/Container.h"
+
+namespace fl {
+namespace ext {
+
+namespace {
+
+std::shared_ptr<Module> replaceModulesImpl(
+    const std::shared_ptr<Module>& module,
+    const std::vector<ModuleReplacement>& replacements) {
+  for (const auto& replacement : replacements) {
+    auto replaced = replacement(module);
+    if (replaced) {
+      return replaced;
+    }
+  }
+  auto container = std::dynamic_pointer_cast<Container>(module);
+  if (container) {
+    auto modules = container->modules();
+    for (int i = 0; i < modules.size(); ++i) {
+      auto replaced = replaceModulesImpl(modules[i], replacements);
+      if (replaced != modules[i]) {
+        container->setModule(i, replaced);
+      }
+    }
+  }
+  return module;
+}
+
+} // namespace
+
+PluginRegistry& PluginRegistry::getInstance() {
+  static PluginRegistry registry;
+  return registry;
+}
+
+void PluginRegistry::registerOp(const std::string& name, PluginOp op) {
+  if (!op.forward) {
+    throw std::invalid_argument(
+        "[PluginRegistry] op without forward: " + name);
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (ops_.count(name)) {
+    throw std::invalid_argument(
+        "[PluginRegistry] op already registered: " + name);
+  }
+  ops_.emplace(name, Entry<PluginOp>{owner_, std::move(op)});
+}
+
+bool PluginRegistry::hasOp(const std::string& name) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return ops_.count(name) > 0;
+}
+
+Variable PluginRegistry::op(
+    const std::string& name,
+    const std::vector<Variable>& inputs) const {
+  PluginOp op;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = ops_.find(name);
+    if (it == ops_.end()) {
+      throw std::invalid_argument("[PluginRegistry] no op registered: " + name);
+    }
+    op = it->second.value;
+  }
+
+  std::vector<af::array> arrays;
+  for (const auto& input : inputs) {
+    arrays.push_back(input.array());
+  }
+  auto output = op.forward(arrays);
+  if (!op.backward) {
+    return Variable(output, false);
+  }
+
+  auto backward = op.backward;
+  auto gradFunc = [name, backward, output](
+                      std::vector<Variable>& inputs,
+                      const Variable& gradOutput) {
+    std::vector<af::array> arrays;
+    for (const auto& input : inputs) {
+      arrays.push_back(input.array());
+    }
+    auto grads = backward(arrays, output, gradOutput.array());
+    if (grads.size() != inputs.size()) {
+      throw std::runtime_error(
+          "[PluginRegistry] the backward of op " + name +
+          " must give the gradient of each input");
+    }
+    for (int i = 0; i < inputs.size(); ++i) {
+      if (inputs[i].isCalcGrad() && !grads[i].isempty()) {
+        inputs[i].addGrad(Variable(grads[i], false));
+      }
+    }
+  };
+  return Variable(output, inputs, gradFunc);
+}
+
+void PluginRegistry::registerModuleReplacement(
+    const std::string& name,
+    ModuleReplacement replacement) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  replacements_.emplace_back(
+      name, Entry<ModuleReplacement>{owner_, std::move(replacement)});
+}
+
+std::shared_ptr<Module> PluginRegistry::replaceModules(
+    const std::shared_ptr<Module>& module) const {
+  std::vector<ModuleReplacement> replacements;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& replacement : replacements_) {
+      replacements.push_back(replacement.second.value);
+    }
+  }
+  return replaceModulesImpl(module, replacements);
+}
+
+void PluginRegistry::registerBenchmarkCandidate(
+    const std::string& benchmark,
+    const std::string& opName) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  candidates_[benchmark].push_back(Entry<std::string>{owner_, opName});
+}
+
+Variable PluginRegistry::autotuned(
+    const std::string& benchmark,
+    const Builtin& builtin,
+    const std::vector<Variable>& inputs,
+    const std::string& cacheKey /* = "" */) {
+  if (!DynamicBenchmark::getBenchmarkMode()) {
+    return builtin(inputs);
+  }
+
+  std::vector<std::string> candidates;
+  std::shared_ptr<DynamicBenchmark> dynamicBenchmark;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = candidates_.find(benchmark);
+    std::string key = "plugin:" + benchmark;
+    if (it != candidates_.end()) {
+      for (const auto& candidate : it->second) {
+        if (ops_.count(candidate.value)) {
+          candidates.push_back(candidate.value);
+          key += ":" + candidate.value;
+        }
+      }
+    }
+    if (candidates.empty()) {
+      return builtin(inputs);
+    }
+    // The benchmark of other candidates doesn't apply
+    key += "|" + cacheKey;
+    auto& benchmarkPtr = benchmarks_[key];
+    if (!benchmarkPtr) {
+      // 0 is the builtin
+      std::vector<int> options(candidates.size() + 1);
+      for (int i = 0; i < options.size(); ++i) {
+        options[i] = i;
+      }
+      benchmarkPtr = std::make_shared<DynamicBenchmark>(
+          std::make_shared<DynamicBenchmarkOptions<int>>(
+              options, kDynamicBenchmarkDefaultCount),
+          key);
+    }
+    dynamicBenchmark = benchmarkPtr;
+  }
+
+  int option =
+      dynamicBenchmark->getOptions<DynamicBenchmarkOptions<int>>()
+          ->currentOption();
+  Variable output;
+  dynamicBenchmark->audit([&]() {
+    output =
+        option == 0 ? builtin(inputs) : op(candidates[option - 1], inputs);
+  });
+  return output;
+}
+
+void PluginRegistry::unregister(const std::string& owner) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto it = ops_.begin(); it != ops_.end();) {
+    it = it->second.owner == owner ? ops_.erase(it) : std::next(it);
+  }
+  replacements_.erase(
+      std::remove_if(
+          replacements_.begin(),
+          replacements_.end(),
+          [&owner](const auto& r) { return r.second.owner == owner; }),
+      replacements_.end());
+  for (auto& candidates : candidates_) {
+    auto& entries = candidates.second;
+    entries.erase(
+        std::remove_if(
+            entries.begin(),
+            entries.end(),
+            [&owner](const auto& c) { return c.owner == owner; }),
+        entries.end());
+  }
+  // Benchmarks may run candidates of the plugin
+  benchmarks_.clear();
+}
+
+void PluginRegistry::setOwner(const std::string& owner) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  owner_ = owner;
+}
+
+} // namespace ext
+} // namespace fl
@@ -0,0 +1,158 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "flashlight/fl/autograd/Variable.h"
+#include "flashlight/fl/common/DynamicBenchmark.h"
+#include "flashlight/fl/nn/modules/Module.h"
+
+namespace fl {
+namespace ext {
+
+/**
+ * A custom autograd op. `forward` computes the output from the arrays of the
+ * inputs, and `backward` the gradients of the inputs (an empty array for an
+ * input without gradient) from the inputs, the output and the gradient of the
+ * output. Ops without `backward` have no gradient.
+ */
+struct PluginOp {
+  using Forward =
+      std::function<af::array(const std::vector<af::array>& inputs)>;
+  using Backward = std::function<std::vector<af::array>(
+      const std::vector<af::array>& inputs,
+      const af::array& output,
+      const af::array& gradOutput)>;
+
+  Forward forward;
+  Backward backward;
+};
+
+/**
+ * Converts a module into an optimized implementation of it (e.g. a faster
+ * `Conformer` block), with the same parameters, or returns nullptr if it
+ * doesn't apply to the module.
+ */
+using ModuleReplacement =
+    std::function<std::shared_ptr<Module>(const std::shared_ptr<Module>&)>;
+
+/**
+ * Holds what plugins provide besides archs (see `ModulePlugin`):
+ * - custom autograd ops, by name;
+ * - optimized implementations of modules, applied to models with
+ *   `replaceModules()`;
+ * - ops that are candidates of benchmarks: `autotuned()` runs the fastest of
+ *   a builtin implementation and of the candidates of a benchmark, as timed
+ *   by a `DynamicBenchmark`.
+ *
+ * Plugins register them in their `registerPlugin` function (see
+ * `w2l_register_plugin_t`). What a plugin registers runs its code, so it is
+ * unregistered when the plugin is unloaded: ops, gradients and modules it
+ * created must not be used after that.
+ */
+class PluginRegistry {
+ public:
+  using Builtin = std::function<Variable(const std::vector<Variable>&)>;
+
+  static PluginRegistry& getInstance();
+
+  /**
+   * Registers op `name`. Throws if there is already an op `name`.
+   */
+  void registerOp(const std::string& name, PluginOp op);
+
+  bool hasOp(const std::string& name) const;
+
+  /**
+   * Runs op `name` on `inputs`. The gradient of the output is computed by the
+   * backward of the op.
+   */
+  Variable op(const std::string& name, const std::vector<Variable>& inputs)
+      const;
+
+  /**
+   * Registers a replacement for modules, named `name`. Replacements are
+   * tried in the order of their registration.
+   */
+  void registerModuleReplacement(
+      const std::string& name,
+      ModuleReplacement replacement);
+
+  /**
+   * Replaces `module` and, recursively, the modules of containers by the
+   * first replacement that applies to them.
+   *
+   * @return the replacement of `module`, or `module` (with its modules
+   * replaced if it is a container)
+   */
+  std::shared_ptr<Module> replaceModules(
+      const std::shared_ptr<Module>& module) const;
+
+  /**
+   * Registers op `opName` (which may be registered later) as a candidate of
+   * benchmark `benchmark`.
+   */
+  void registerBenchmarkCandidate(
+      const std::string& benchmark,
+      const std::string& opName);
+
+  /**
+   * Runs `builtin` or one of the candidate ops of benchmark `benchmark` on
+   * `inputs`. In benchmark mode (see `DynamicBenchmark::setBenchmarkMode()`),
+   * each is timed `kDynamicBenchmarkDefaultCount` times for each `cacheKey`
+   * (e.g. describing the dimensions of the inputs) before the fastest is
+   * kept; otherwise, or without candidates, `builtin` is run.
+   */
+  Variable autotuned(
+      const std::string& benchmark,
+      const Builtin& builtin,
+      const std::vector<Variable>& inputs,
+      const std::string& cacheKey = "");
+
+  /**
+   * Unregisters what plugin `owner` registered.
+   */
+  void unregister(const std::string& owner);
+
+ private:
+  friend class ModulePlugin;
+
+  PluginRegistry() = default;
+
+  // Sets the plugin that owns new registrations, empty if none
+  void setOwner(const std::string& owner);
+
+  template <typename T>
+  struct Entry {
+    std::string owner;
+    T value;
+  };
+
+  std::unordered_map<std::string, Entry<PluginOp>> ops_;
+  std::vector<std::pair<std::string, Entry<ModuleReplacement>>>
+      replacements_;
+  // Op names by benchmark
+  std::unordered_map<std::string, std::vector<Entry<std::string>>>
+      candidates_;
+  // By benchmark, candidates and cache key
+  std::unordered_map<std::string, std::shared_ptr<DynamicBenchmark>>
+      benchmarks_;
+  std::string owner_;
+  mutable std::mutex mutex_;
+};
+
+} // namespace ext
+} // namespace fl
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "flashlight/ext/common/AsyncCheckpointer.h"
+#include "flashlight/ext/common/Serializer.h"
+#include "flashlight/fl/common/Init.h"
+#include "flashlight/lib/common/System.h"
+
+using namespace fl;
+using namespace fl::ext;
+
+TEST(AsyncCheckpointerTest, SaveLoad) {
+  const std::string path = fl::lib::getTmpPath("AsyncCheckpointer.mdl");
+  const std::string bestPath = path + ".best";
+  auto model = std::make_shared<Linear>(4, 3);
+  auto expected = model->param(0).array().copy();
+
+  AsyncCheckpointer checkpointer;
+  checkpointer.save({path, bestPath}, "1", model, std::string("meta"));
+  // The snapshot is taken by save: later updates are not saved
+  model->setParams(Variable(af::constant(0, expected.dims()), true), 0);
+  checkpointer.wait();
+
+  for (const auto& p : {path, bestPath}) {
+    std::string version, meta;
+    std::shared_ptr<Linear> loaded;
+    Serializer::load(p, version, loaded, meta);
+    ASSERT_EQ(version, "1");
+    ASSERT_EQ(meta, "meta");
+    ASSERT_TRUE(allClose(loaded->param(0).array(), expected));
+    ASSERT_FALSE(fl::lib::fileExists(p + ".tmp"));
+  }
+}
+
+TEST(AsyncCheckpointerTest, Snapshot) {
+  const std::string path = fl::lib::getTmpPath("AsyncCheckpointerSnap.mdl");
+  auto model = std::make_shared<Linear>(4, 3);
+  auto expected = model->param(0).array().copy();
+
+  auto snapshot = AsyncCheckpointer::snapshot("1", model);
+  model->setParams(Variable(af::constant(0, expected.dims()), true), 0);
+  AsyncCheckpointer checkpointer;
+  checkpointer.write({path}, snapshot);
+  checkpointer.wait();
+
+  std::string version;
+  std::shared_ptr<Linear> loaded;
+  Serializer::load(path, version, loaded);
+  ASSERT_TRUE(allClose(loaded->param(0).array(), expected));
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  fl::init();
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/ext/common/BatchBudgetProbe.h"
+#include "flashlight/fl/common/Init.h"
+
+using namespace fl::ext;
+
+TEST(BatchBudgetProbeTest, SearchMaxBudget) {
+  std::vector<int64_t> probed;
+  auto fitsBelow = [&probed](int64_t limit) {
+    return [&probed, limit](int64_t budget) {
+      probed.push_back(budget);
+      return budget <= limit;
+    };
+  };
+  ASSERT_EQ(searchMaxBudget(fitsBelow(37), 1, 1000), 37);
+  // Doubled up to the first failure, then bisected
+  ASSERT_EQ(
+      std::vector<int64_t>(probed.begin(), probed.begin() + 7),
+      std::vector<int64_t>({1, 2, 4, 8, 16, 32, 64}));
+  ASSERT_LE(probed.size(), 7 + 5);
+
+  ASSERT_EQ(searchMaxBudget(fitsBelow(5000), 3, 1000), 1000);
+  ASSERT_EQ(searchMaxBudget(fitsBelow(2), 3, 1000), 0);
+  ASSERT_EQ(searchMaxBudget(fitsBelow(4), 4, 4), 4);
+  ASSERT_THROW(searchMaxBudget(fitsBelow(4), 0, 4), std::invalid_argument);
+  ASSERT_THROW(searchMaxBudget(fitsBelow(4), 5, 4), std::invalid_argument);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  fl::init();
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdint>
+#include <fstream>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/ext/common/MappedTensorFile.h"
+#include "flashlight/fl/common/Init.h"
+#include "flashlight/lib/common/System.h"
+
+using namespace fl;
+using namespace fl::ext;
+
+TEST(MappedTensorFileTest, SaveLoadTensors) {
+  const std::string path = fl::lib::getTmpPath("MappedTensorFile.bin");
+  std::vector<af::array> tensors = {
+      af::randu(3, 5),
+      af::range(af::dim4(7), -1, s32),
+      af::array(af::dim4(0), f32),
+      af::randu(2, 3, 4, 5, f64)};
+  saveMappedTensors(path, tensors, "metadata");
+
+  MappedTensorFile file(path);
+  ASSERT_EQ(file.metadata(), "metadata");
+  ASSERT_EQ(file.size(), tensors.size());
+  for (size_t i = 0; i < tensors.size(); ++i) {
+    ASSERT_EQ(file.dims(i), tensors[i].dims());
+    ASSERT_EQ(file.type(i), tensors[i].type());
+    ASSERT_EQ(
+        reinterpret_cast<uintptr_t>(file.data(i)) %
+            MappedTensorFile::kAlignment,
+        0);
+    if (tensors[i].elements() > 0) {
+      ASSERT_TRUE(allClose(file.array(i), tensors[i]));
+    }
+  }
+  ASSERT_THROW(file.array(tensors.size()), std::out_of_range);
+}
+
+TEST(MappedTensorFileTest, SaveLoadParams) {
+  const std::string path = fl::lib::getTmpPath("MappedTensorFileParams.bin");
+  Sequential model;
+  model.add(Linear(6, 4));
+  model.add(ReLU());
+  model.add(Linear(4, 2));
+  saveParams(path, model);
+
+  Sequential loaded;
+  loaded.add(Linear(6, 4));
+  loaded.add(ReLU());
+  loaded.add(Linear(4, 2));
+  MappedTensorFile file(path);
+  loadParams(file, loaded);
+  ASSERT_TRUE(allParamsClose(loaded, model));
+
+  Sequential mismatched;
+  mismatched.add(Linear(6, 4));
+  ASSERT_THROW(loadParams(file, mismatched), std::invalid_argument);
+}
+
+TEST(MappedTensorFileTest, InvalidFile) {
+  const std::string path = fl::lib::getTmpPath("MappedTensorFileInvalid.bin");
+  {
+    std::ofstream file(path, std::ios::binary);
+    file << "not a tensor file";
+  }
+  ASSERT_THROW(MappedTensorFile file(path), std::runtime_error);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  fl::init();
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <stdexcept>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/ext/common/TrainBenchmark.h"
+#include "flashlight/fl/common/Init.h"
+
+using namespace fl::ext;
+
+TEST(TrainBenchmarkTest, Steps) {
+  TrainBenchmark benchmark("test_train", "tokens", 2, 3);
+  ASSERT_FALSE(benchmark.endStep(100, 1000));
+  // End of the warmup, whose samples aren't counted
+  ASSERT_TRUE(benchmark.endStep(100, 1000));
+  ASSERT_THROW(benchmark.report(), std::logic_error);
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_FALSE(benchmark.done());
+    ASSERT_FALSE(benchmark.endStep(10, 20));
+  }
+  ASSERT_TRUE(benchmark.done());
+  ASSERT_THROW(benchmark.endStep(10, 20), std::logic_error);
+
+  benchmark.setPhase("forward", 0.3);
+  benchmark.setPhase("backward", 0.6);
+  benchmark.setConfig("arch", "a \"quoted\" path");
+  auto report = benchmark.report();
+  ASSERT_EQ(report.front(), '{');
+  ASSERT_EQ(report.back(), '}');
+  ASSERT_EQ(report.find('\n'), std::string::npos);
+  ASSERT_NE(report.find("\"benchmark\": \"test_train\""), std::string::npos);
+  ASSERT_NE(report.find("\"steps\": 3"), std::string::npos);
+  ASSERT_NE(report.find("\"samples\": 30,"), std::string::npos);
+  ASSERT_NE(report.find("\"tokens\": 60,"), std::string::npos);
+  ASSERT_NE(report.find("\"tokens_per_sec\": "), std::string::npos);
+  // Per step, phases sorted by name
+  ASSERT_NE(
+      report.find("\"phase_ms\": {\"backward\": 200, \"forward\": 100}"),
+      std::string::npos);
+  ASSERT_NE(
+      report.find("\"arch\": \"a \\\"quoted\\\" path\""), std::string::npos);
+
+  ASSERT_THROW(
+      TrainBenchmark("test_train", "tokens", 1, 0), std::invalid_argument);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  fl::init();
+  return RUN_ALL_TESTS();
+}
@@ -10,6 +10,7 @@
 #include <cmath>
 #include <vector>
 
+#include "flashlight/ext/integrations/halide/HalideFusion.h"
 #include "flashlight/ext/integrations/halide/HalideInterface.h"
 #include "flashlight/fl/autograd/Functions.h"
 #include "flashlight/fl/autograd/Variable.h"
@@ -83,10 +84,15 @@ TEST(HalideTest, ConvertArray) {
     ext::HalideBufferWrapper<float> halideBufWrapper(arr);
     // Underlying memory should be the same
     DevicePtr arrPtr(arr);
-    EXPECT_EQ(
-        arrPtr.get(),
-        reinterpret_cast<void*>(
-            halideBufWrapper.getBuffer().raw_buffer()->device));
+#if FL_BACKEND_CUDA
+    auto* bufferMem = reinterpret_cast<void*>(
+        halideBufWrapper.getBuffer().raw_buffer()->device);
+#else
+    // Host memory
+    auto* bufferMem =
+        static_cast<void*>(halideBufWrapper.getBuffer().raw_buffer()->host);
+#endif
+    EXPECT_EQ(arrPtr.get(), bufferMem);
   }
   // The underlying Array should remain unchanged after the wrapper is destroyed
   EXPECT_TRUE(fl::allClose(arr, arrCopy));
@@ -152,6 +158,74 @@ TEST(HalideTest, SimpleJITHalidePipeline) {
   Halide::Buffer<int> out = sum.realize(xDim, yDim);
 }
 
+TEST(HalideTest, AutoScheduledPipeline) {
+  int size = 1000;
+  auto& registry = ext::HalidePipelineRegistry::getInstance();
+  Halide::ImageParam input(Halide::Float(32), 1, "autoScheduledInput");
+  registry.registerPipeline("autoScheduledTest", [input, size]() mutable {
+    Halide::Func axpb("axpb");
+    Halide::Var x("x");
+    axpb(x) = 2 * input(x) + 1;
+    input.set_estimates({{0, size}});
+    axpb.set_estimates({{0, size}});
+    return Halide::Pipeline(axpb);
+  });
+  EXPECT_THROW(
+      registry.registerPipeline(
+          "autoScheduledTest", []() { return Halide::Pipeline(); }),
+      std::invalid_argument);
+  EXPECT_THROW(registry.get("notRegistered"), std::invalid_argument);
+
+  auto arr = af::randu(size);
+  auto output = af::array(size, af::dtype::f32);
+  {
+    ext::HalideBufferWrapper<float> inputHalide(arr);
+    ext::HalideBufferWrapper<float> outputHalide(output);
+    input.set(inputHalide.getBuffer());
+    auto& pipeline = registry.get("autoScheduledTest");
+    // Compiled once per target
+    EXPECT_EQ(&pipeline, &registry.get("autoScheduledTest"));
+    Halide::Realization realization({outputHalide.getBuffer()});
+    pipeline.realize(realization, ext::halideTarget());
+  }
+  EXPECT_TRUE(fl::allClose(output, 2 * arr + 1, 1E-5));
+}
+
+TEST(HalideTest, FusedElementwise) {
+  auto x = Variable(af::randn(10, 6, 3), true);
+  auto mask = Variable(af::randu(10, 6, 3) > 0.5, false);
+  auto ops = {
+      std::make_pair(
+          ext::halideSwish(x, 1.5), x * fl::sigmoid(1.5 * x)),
+      std::make_pair(
+          ext::halideGatedLinearUnit(x, 1), fl::gatedlinearunit(x, 1)),
+      std::make_pair(ext::halideClamp(x, -0.5, 0.5), fl::clamp(x, -0.5, 0.5)),
+      std::make_pair(
+          ext::halideMaskScale(x, mask, 2), x * mask.as(f32) * 2)};
+  for (auto& op : ops) {
+    ASSERT_TRUE(fl::allClose(op.first, op.second, 1E-5));
+    auto grad = Variable(af::randn(op.first.dims()), false);
+    x.zeroGrad();
+    op.first.backward(grad);
+    auto fusedGrad = x.grad().array();
+    x.zeroGrad();
+    op.second.backward(grad);
+    ASSERT_TRUE(fl::allClose(fusedGrad, x.grad().array(), 1E-5));
+  }
+
+  auto fma = ext::HalideElementwise(
+      "fma",
+      3,
+      0,
+      [](const auto& in, const auto& scalars) { return in[0] * in[1] + in[2]; },
+      [](const auto& in, const auto& scalars, const Halide::Expr& grad) {
+        return ext::HalideElementwise::Exprs{grad * in[1], grad * in[0], grad};
+      });
+  auto y = Variable(af::randn(10, 6, 3), false);
+  ASSERT_TRUE(fl::allClose(fma({x, y, y}), x * y + y, 1E-5));
+  EXPECT_THROW(fma({x, y}), std::invalid_argument);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
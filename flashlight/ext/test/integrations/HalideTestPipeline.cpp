@@ -20,6 +20,8 @@ int main(int argc, char** argv) {
 
   testFunc(x, y) = input(x, y) + sinVals(x, y) + offset;
 
+  Halide::Target target = Halide::get_target_from_environment();
+#if FL_BACKEND_CUDA
   Var xOuter, yOuter, xInner, yInner;
   testFunc.gpu_tile(
       x,
@@ -32,14 +34,16 @@ int main(int argc, char** argv) {
       16, // threads
       Halide::TailStrategy::Auto,
       Halide::DeviceAPI::CUDA);
+  target = target.with_feature(Halide::Target::Feature::CUDA);
+#else
+  testFunc.parallel(y).vectorize(x, 8);
+#endif
 
   testFunc.compile_to_static_library(
       "HalideTestPipeline",
       {input, offset}, // arguments
       "testFunc",
-      Halide::get_target_from_environment()
-          .with_feature(Halide::Target::Feature::CUDA)
-          .with_feature(Halide::Target::Debug));
+      target.with_feature(Halide::Target::Debug));
 
   std::cout << "HalideTestPipeline pipeline compiled, but not yet run."
             << std::endl;
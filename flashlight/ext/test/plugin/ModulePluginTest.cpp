@@ -10,6 +10,7 @@
 #include <gtest/gtest.h>
 
 #include "flashlight/ext/plugin/ModulePlugin.h"
+#include "flashlight/ext/plugin/PluginRegistry.h"
 #include "flashlight/fl/contrib/modules/modules.h"
 #include "flashlight/fl/flashlight.h"
 #include "flashlight/lib/common/System.h"
@@ -45,6 +46,46 @@ TEST(ModulePluginTest, ModulePlugin) {
   ASSERT_EQ(output.dims(), af::dim4(noutput, batchsize));
 }
 
+TEST(ModulePluginTest, PluginRegistry) {
+  const std::string libfile =
+      fl::lib::pathsConcat(pluginDir, "test_module_plugin.so");
+  auto& registry = fl::ext::PluginRegistry::getInstance();
+  {
+    fl::ext::ModulePlugin plugin(libfile);
+    ASSERT_TRUE(registry.hasOp("testScaleByTwo"));
+
+    // Op and its gradient
+    auto x = Variable(af::randn(5, 3), true);
+    auto y = registry.op("testScaleByTwo", {x});
+    ASSERT_TRUE(allClose(y.array(), x.array() * 2));
+    y.backward();
+    ASSERT_TRUE(allClose(x.grad().array(), af::constant(2, 5, 3)));
+    EXPECT_THROW(registry.op("notRegistered", {x}), std::invalid_argument);
+
+    // Module replacements
+    auto model = std::make_shared<Sequential>();
+    model->add(Linear(5, 4));
+    model->add(ReLU());
+    auto replaced = registry.replaceModules(model);
+    ASSERT_EQ(replaced, model);
+    ASSERT_NE(std::dynamic_pointer_cast<Identity>(model->module(1)), nullptr);
+    ASSERT_EQ(model->params().size(), 2);
+
+    // Benchmark candidates give the same result as the builtin
+    auto builtin = [](const std::vector<Variable>& inputs) {
+      return inputs[0] + inputs[0];
+    };
+    DynamicBenchmark::setBenchmarkMode(true);
+    for (size_t i = 0; i < 3 * kDynamicBenchmarkDefaultCount; ++i) {
+      auto out = registry.autotuned("testScale", builtin, {x}, "5x3");
+      ASSERT_TRUE(allClose(out.array(), x.array() * 2));
+    }
+    DynamicBenchmark::setBenchmarkMode(false);
+  }
+  // Unregistered with the plugin
+  ASSERT_FALSE(registry.hasOp("testScaleByTwo"));
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   fl::init();
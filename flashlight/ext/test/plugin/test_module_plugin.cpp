@@ -6,6 +6,7 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include "flashlight/ext/plugin/PluginRegistry.h"
 #include "flashlight/fl/flashlight.h"
 #include "flashlight/fl/contrib/contrib.h"
 
@@ -14,3 +15,27 @@ extern "C" fl::Module* createModule(int64_t nFeature, int64_t nLabel) {
   seq->add(std::make_shared<fl::Linear>(nFeature, nLabel));
   return seq;
 }
+
+extern "C" void registerPlugin(fl::ext::PluginRegistry* registry) {
+  fl::ext::PluginOp scale;
+  scale.forward = [](const std::vector<af::array>& inputs) {
+    return inputs[0] * 2;
+  };
+  scale.backward = [](const std::vector<af::array>& /* inputs */,
+                      const af::array& /* output */,
+                      const af::array& gradOutput) {
+    return std::vector<af::array>{gradOutput * 2};
+  };
+  registry->registerOp("testScaleByTwo", scale);
+  registry->registerBenchmarkCandidate("testScale", "testScaleByTwo");
+  // ReLU -> Identity
+  registry->registerModuleReplacement(
+      "testNoReLU",
+      [](const std::shared_ptr<fl::Module>& module)
+          -> std::shared_ptr<fl::Module> {
+        if (std::dynamic_pointer_cast<fl::ReLU>(module)) {
+          return std::make_shared<fl::Identity>();
+        }
+        return nullptr;
+      });
+}
@@ -15,12 +15,17 @@
 
 #include <algorithm>
 #include <array>
+#include <map>
 #include <stdexcept>
+#include <tuple>
+#include <vector>
 
 #include <af/internal.h>
 
 #include "flashlight/fl/autograd/Functions.h"
+#include "flashlight/fl/autograd/Utils.h"
 #include "flashlight/fl/autograd/Variable.h"
+#include "flashlight/fl/common/Trace.h"
 
 namespace fl {
 namespace detail {
@@ -62,9 +67,19 @@ bool areVariableTypesEqual(const Variable& a, const Variable& b) {
   return a.type() == b.type();
 }
 
+Variable autocastOperand(const Variable& operand, const Variable& other) {
+  if (OptimMode::get().getOptimLevel() != OptimLevel::DEFAULT &&
+      operand.type() == af::dtype::f16 && other.type() == af::dtype::f32) {
+    return operand.as(af::dtype::f32);
+  }
+  return operand;
+}
+
 } // namespace detail
 
-Variable operator+(const Variable& lhs, const Variable& rhs) {
+Variable operator+(const Variable& lhsIn, const Variable& rhsIn) {
+  auto lhs = detail::autocastOperand(lhsIn, rhsIn);
+  auto rhs = detail::autocastOperand(rhsIn, lhsIn);
   FL_VARIABLE_DTYPES_MATCH_CHECK(lhs, rhs);
   auto result = lhs.array() + rhs.array();
   auto gradFunc = [](std::vector<Variable>& inputs,
@@ -88,7 +103,9 @@ Variable operator+(const double& lhsVal, const Variable& rhs) {
   return rhs + lhsVal;
 }
 
-Variable operator-(const Variable& lhs, const Variable& rhs) {
+Variable operator-(const Variable& lhsIn, const Variable& rhsIn) {
+  auto lhs = detail::autocastOperand(lhsIn, rhsIn);
+  auto rhs = detail::autocastOperand(rhsIn, lhsIn);
   FL_VARIABLE_DTYPES_MATCH_CHECK(lhs, rhs);
   auto result = lhs.array() - rhs.array();
   auto gradFunc = [](std::vector<Variable>& inputs,
@@ -117,7 +134,9 @@ Variable operator-(const double& lhsVal, const Variable& rhs) {
   return Variable(result, {rhs.withoutData()}, gradFunc);
 }
 
-Variable operator*(const Variable& lhs, const Variable& rhs) {
+Variable operator*(const Variable& lhsIn, const Variable& rhsIn) {
+  auto lhs = detail::autocastOperand(lhsIn, rhsIn);
+  auto rhs = detail::autocastOperand(rhsIn, lhsIn);
   FL_VARIABLE_DTYPES_MATCH_CHECK(lhs, rhs);
   auto result = lhs.array() * rhs.array();
   auto gradFunc = [](std::vector<Variable>& inputs,
@@ -149,7 +168,9 @@ Variable operator*(const double& lhsVal, const Variable& rhs) {
   return rhs * lhsVal;
 }
 
-Variable operator/(const Variable& lhs, const Variable& rhs) {
+Variable operator/(const Variable& lhsIn, const Variable& rhsIn) {
+  auto lhs = detail::autocastOperand(lhsIn, rhsIn);
+  auto rhs = detail::autocastOperand(rhsIn, lhsIn);
   FL_VARIABLE_DTYPES_MATCH_CHECK(lhs, rhs);
   auto result = lhs.array() / rhs.array();
   auto gradFunc = [](std::vector<Variable>& inputs,
@@ -262,7 +283,9 @@ Variable operator!(const Variable& input) {
   return Variable(result, false);
 }
 
-Variable max(const Variable& lhs, const Variable& rhs) {
+Variable max(const Variable& lhsIn, const Variable& rhsIn) {
+  auto lhs = detail::autocastOperand(lhsIn, rhsIn);
+  auto rhs = detail::autocastOperand(rhsIn, lhsIn);
   FL_VARIABLE_DTYPES_MATCH_CHECK(lhs, rhs);
   auto result = af::max(lhs.array(), rhs.array());
   auto gradFunc = [](std::vector<Variable>& inputs,
@@ -290,7 +313,9 @@ Variable max(const double& lhsVal, const Variable& rhs) {
   return max(rhs, lhsVal);
 }
 
-Variable min(const Variable& lhs, const Variable& rhs) {
+Variable min(const Variable& lhsIn, const Variable& rhsIn) {
+  auto lhs = detail::autocastOperand(lhsIn, rhsIn);
+  auto rhs = detail::autocastOperand(rhsIn, lhsIn);
   FL_VARIABLE_DTYPES_MATCH_CHECK(lhs, rhs);
   auto result = af::min(lhs.array(), rhs.array());
   auto gradFunc = [](std::vector<Variable>& inputs,
@@ -694,7 +719,10 @@ Variable normalize(
   return input / tileAs(invscale, input);
 }
 
-Variable matmul(const Variable& lhs, const Variable& rhs) {
+Variable matmul(const Variable& lhsIn, const Variable& rhsIn) {
+  FL_TRACE(AUTOGRAD, "matmul");
+  auto lhs = FL_ADJUST_INPUT_TYPE(lhsIn);
+  auto rhs = FL_ADJUST_INPUT_TYPE(rhsIn);
   FL_VARIABLE_DTYPES_MATCH_CHECK(lhs, rhs);
   // lhs:Input[0] -- [M, N]
   // rhs:Input[1] -- [N, K]
@@ -702,6 +730,7 @@ Variable matmul(const Variable& lhs, const Variable& rhs) {
   // -- matmul([M, N], [N, K]) --  [M, K]
   // result:gradOutput -- [M, K]
   auto result = matmul(lhs.array(), rhs.array());
+  detail::FlopCounter::add(2.0 * result.elements() * lhs.dims(1));
   auto gradFunc = [](std::vector<Variable>& inputs,
                      const Variable& gradOutput) {
     if (inputs[0].isCalcGrad()) {
@@ -722,7 +751,10 @@ Variable matmul(const Variable& lhs, const Variable& rhs) {
   return Variable(result, {lhs, rhs}, gradFunc);
 }
 
-Variable matmulTN(const Variable& lhs, const Variable& rhs) {
+Variable matmulTN(const Variable& lhsIn, const Variable& rhsIn) {
+  FL_TRACE(AUTOGRAD, "matmulTN");
+  auto lhs = FL_ADJUST_INPUT_TYPE(lhsIn);
+  auto rhs = FL_ADJUST_INPUT_TYPE(rhsIn);
   FL_VARIABLE_DTYPES_MATCH_CHECK(lhs, rhs);
   // lhs:Input[0] -- [N, M]
   // rhs:Input[1] -- [N, K]
@@ -731,6 +763,7 @@ Variable matmulTN(const Variable& lhs, const Variable& rhs) {
   // -- matmul([M, N], [N, K]) -- [M, K]
   // result:gradOutput -- [M, K]
   auto result = matmulTN(lhs.array(), rhs.array());
+  detail::FlopCounter::add(2.0 * result.elements() * lhs.dims(0));
   auto gradFunc = [](std::vector<Variable>& inputs,
                      const Variable& gradOutput) {
     if (inputs[0].isCalcGrad()) {
@@ -749,7 +782,10 @@ Variable matmulTN(const Variable& lhs, const Variable& rhs) {
   return Variable(result, {lhs, rhs}, gradFunc);
 }
 
-Variable matmulNT(const Variable& lhs, const Variable& rhs) {
+Variable matmulNT(const Variable& lhsIn, const Variable& rhsIn) {
+  FL_TRACE(AUTOGRAD, "matmulNT");
+  auto lhs = FL_ADJUST_INPUT_TYPE(lhsIn);
+  auto rhs = FL_ADJUST_INPUT_TYPE(rhsIn);
   FL_VARIABLE_DTYPES_MATCH_CHECK(lhs, rhs);
   // lhs:Input[0] -- [M, N]
   // rhs:Input[1] -- [K, N]
@@ -758,6 +794,7 @@ Variable matmulNT(const Variable& lhs, const Variable& rhs) {
   // -- matmul([M, N], [N, K]) -- [M, K]
   // result:gradOutput -- [M, K]
   auto result = matmulNT(lhs.array(), rhs.array());
+  detail::FlopCounter::add(2.0 * result.elements() * lhs.dims(1));
   auto gradFunc = [](std::vector<Variable>& inputs,
                      const Variable& gradOutput) {
     if (inputs[0].isCalcGrad()) {
@@ -957,6 +994,75 @@ Variable categoricalCrossEntropy(
   return Variable(result, {input.withoutData(), targets}, gradFunc);
 }
 
+Variable softmaxCrossEntropy(
+    const Variable& input,
+    const Variable& targets,
+    ReduceMode reduction /* =ReduceMode::MEAN */,
+    int ignoreIndex /* = -1 */,
+    double labelSmoothing /* = 0.0 */) {
+  // input -- [C, X1, X2, X3]
+  // target -- [X1, X2, X3, 1]
+  for (int i = 1; i < 4; i++) {
+    if (input.dims(i) != targets.dims(i - 1)) {
+      throw std::invalid_argument(
+          "dimension mismatch in softmax cross entropy");
+    }
+  }
+  if (targets.dims(3) != 1) {
+    throw std::invalid_argument("dimension mismatch in softmax cross entropy");
+  }
+  if (labelSmoothing < 0.0 || labelSmoothing > 1.0) {
+    throw std::invalid_argument(
+        "label smoothing must be in [0, 1] in softmax cross entropy");
+  }
+
+  int C = input.dims(0);
+  int X = targets.elements();
+  auto y = af::flat(targets.array()).as(af::dtype::s32);
+  if (af::anyTrue<bool>(((y < 0) || (y >= C)) && (y != ignoreIndex))) {
+    throw std::invalid_argument(
+        "target contains elements out of valid range [0, num_categories) "
+        "in softmax cross entropy");
+  }
+
+  auto x = af::moddims(input.array(), af::dim4(C, X)).as(af::dtype::f32);
+  af::array loss, logSumExp;
+  detail::softmaxCrossEntropyForward(
+      x, y, ignoreIndex, labelSmoothing, loss, logSumExp);
+
+  auto inputDims = input.dims();
+  auto gradFunc = [C, X, y, logSumExp, ignoreIndex, labelSmoothing, inputDims](
+                      std::vector<Variable>& inputs,
+                      const Variable& gradOutput) {
+    af::array grad;
+    detail::softmaxCrossEntropyBackward(
+        af::moddims(inputs[0].array(), af::dim4(C, X)).as(af::dtype::f32),
+        y,
+        logSumExp,
+        af::flat(gradOutput.array()).as(af::dtype::f32),
+        ignoreIndex,
+        labelSmoothing,
+        grad);
+    inputs[0].addGrad(Variable(
+        af::moddims(grad, inputDims).as(inputs[0].type()), false));
+  };
+  auto result = Variable(
+      af::moddims(loss.as(input.type()), targets.dims()),
+      {input, targets},
+      gradFunc);
+
+  if (reduction == ReduceMode::NONE) {
+    return result;
+  } else if (reduction == ReduceMode::MEAN) {
+    auto denominator = af::count<int>(y != ignoreIndex);
+    return sum(flat(result), {0}) / denominator;
+  } else if (reduction == ReduceMode::SUM) {
+    return sum(flat(result), {0});
+  }
+  throw std::invalid_argument(
+      "unknown reduction method for softmax cross entropy");
+}
+
 Variable reorder(
     const Variable& input,
     const int dim0,
@@ -1006,6 +1112,7 @@ Variable linear(const Variable& in, const Variable& wt, const Variable& bs) {
 
   auto output =
       moddims(af::matmul(weight.array(), moddims(input.array(), to2d)), to4d);
+  detail::FlopCounter::add(2.0 * output.elements() * input.dims(0));
 
   auto hasBias = bias.elements() > 0;
   if (hasBias) {
@@ -1049,6 +1156,235 @@ Variable linear(const Variable& in, const Variable& wt, const Variable& bs) {
   return Variable(output, {input, weight}, gradFunc);
 }
 
+namespace {
+
+// Derivative of the tanh approximation of gelu, as a JIT expression
+af::array geluGrad(const af::array& x) {
+  auto t = af::tanh(0.7978845608 * (x + 0.044715 * x * x * x));
+  return 0.5 * (1.0 + t) +
+      0.5 * x * (1.0 - t * t) * 0.7978845608 * (1.0 + 0.134145 * x * x);
+}
+
+// The fused kernels take contiguous arrays, e.g. not indexed views
+af::array contiguous(const af::array& arr) {
+  return af::isLinear(arr) ? arr : arr.copy();
+}
+
+Variable activate(const Variable& input, LinearActivation activation) {
+  switch (activation) {
+    case LinearActivation::RELU:
+      return relu(input);
+    case LinearActivation::GELU:
+      return gelu(input);
+    default:
+      return input;
+  }
+}
+
+} // namespace
+
+Variable linear(
+    const Variable& in,
+    const Variable& wt,
+    const Variable& bs,
+    LinearActivation activation) {
+  bool hasBias = bs.elements() > 0;
+  auto bias = hasBias ? bs : Variable(af::array().as(in.type()), false);
+  FL_VARIABLE_DTYPES_MATCH_CHECK(in, wt, bias);
+  auto input = FL_ADJUST_INPUT_TYPE(in);
+  auto weight = FL_ADJUST_INPUT_TYPE(wt);
+  if (!detail::fusedLinearSupported(input.type())) {
+    return activate(
+        hasBias ? linear(input, weight, FL_ADJUST_INPUT_TYPE(bias))
+                : linear(input, weight),
+        activation);
+  }
+  if (hasBias) {
+    bias = FL_ADJUST_INPUT_TYPE(bias);
+  }
+
+  af::dim4 to2d(input.dims(0), input.elements() / input.dims(0));
+  auto to4d = input.dims();
+  to4d[0] = weight.dims(0);
+  bool calcGrad = input.isCalcGrad() || weight.isCalcGrad() ||
+      (hasBias && bias.isCalcGrad());
+  // The backward pass of a GELU needs its input; a ReLU its output
+  bool keepPreActivation = calcGrad && activation == LinearActivation::GELU;
+  af::array output, preActivation;
+  detail::linearForward(
+      contiguous(af::moddims(input.array(), to2d)),
+      contiguous(weight.array()),
+      hasBias ? contiguous(bias.array()) : af::array(),
+      activation,
+      keepPreActivation,
+      output,
+      preActivation);
+  output = af::moddims(output, to4d);
+  detail::FlopCounter::add(2.0 * output.elements() * input.dims(0));
+
+  auto relued = activation == LinearActivation::RELU ? output : af::array();
+  auto gradFunc = [hasBias, activation, relued, preActivation](
+                      std::vector<Variable>& inputs,
+                      const Variable& gradOutput) {
+    auto& in = inputs[0];
+    auto& wt = inputs[1];
+    auto grad = gradOutput.array();
+    if (activation == LinearActivation::RELU) {
+      grad = grad * (relued > 0).as(grad.type());
+    } else if (activation == LinearActivation::GELU) {
+      grad = grad * af::moddims(geluGrad(preActivation), grad.dims());
+    }
+    auto nframes = in.elements() / in.dims(0);
+    auto grad2d =
+        contiguous(af::moddims(grad, af::dim4(wt.dims(0), nframes)));
+    if (in.isCalcGrad()) {
+      in.addGrad(Variable(
+          af::moddims(af::matmulTN(wt.array(), grad2d), in.dims()), false));
+    }
+    bool calcGradBias = hasBias && inputs[2].isCalcGrad();
+    if (wt.isCalcGrad() || calcGradBias) {
+      af::array gradWeight, gradBias;
+      detail::linearBackwardWeight(
+          contiguous(af::moddims(in.array(), af::dim4(in.dims(0), nframes))),
+          grad2d,
+          calcGradBias,
+          gradWeight,
+          gradBias);
+      if (wt.isCalcGrad()) {
+        wt.addGrad(Variable(gradWeight, false));
+      }
+      if (calcGradBias) {
+        inputs[2].addGrad(Variable(gradBias, false));
+      }
+    }
+  };
+  if (hasBias) {
+    return Variable(output, {input, weight, bias}, gradFunc);
+  }
+  return Variable(output, {input, weight}, gradFunc);
+}
+
+namespace {
+
+// Rounding of the int8 kernels, in f32
+af::array emulateQuantization(const af::array& input, float scale) {
+  return af::clamp(af::round(input / scale), -128.0, 127.0) * scale;
+}
+
+// f32 values of int8 weights stored as u8, scaled along `dim`
+af::array dequantizeWeights(
+    const af::array& weights,
+    const af::array& scales,
+    int dim) {
+  auto values = weights.as(f32);
+  values = af::select(values >= 128, values - 256, values);
+  af::dim4 scaleDims(1, 1, 1, 1);
+  scaleDims[dim] = scales.elements();
+  return values * detail::tileAs(moddims(scales, scaleDims), values.dims());
+}
+
+void checkQuantizedWeights(
+    const char* name,
+    const af::array& weights,
+    const af::array& weightScales,
+    int outputDim) {
+  if (weights.type() != u8 || weightScales.type() != f32) {
+    throw std::invalid_argument(
+        std::string(name) + ": expected u8 weights and f32 scales");
+  }
+  if (weightScales.elements() != weights.dims(outputDim)) {
+    throw std::invalid_argument(
+        std::string(name) + ": expected one scale per output channel");
+  }
+}
+
+} // namespace
+
+Variable quantizedLinear(
+    const Variable& input,
+    const af::array& weights,
+    const af::array& weightScales,
+    float inputScale,
+    const Variable& bias) {
+  checkQuantizedWeights("quantizedLinear", weights, weightScales, 0);
+  if (input.dims(0) != weights.dims(1)) {
+    throw std::invalid_argument(
+        "quantizedLinear: mismatched input and weight dimensions");
+  }
+  auto in = input.array().as(f32);
+  af::dim4 to2d(in.dims(0), in.elements() / in.dims(0));
+  auto to4d = in.dims();
+  to4d[0] = weights.dims(0);
+
+  af::array output;
+  if (detail::int8KernelsSupported()) {
+    output = detail::int8Linear(
+        moddims(in, to2d), weights, weightScales * inputScale, inputScale);
+  } else {
+    output = af::matmul(
+        dequantizeWeights(weights, weightScales, 0),
+        emulateQuantization(moddims(in, to2d), inputScale));
+  }
+  output = moddims(output, to4d);
+  detail::FlopCounter::add(2.0 * output.elements() * in.dims(0));
+  if (bias.elements() > 0) {
+    output = output +
+        detail::tileAs(moddims(bias.array().as(f32), weights.dims(0)), to4d);
+  }
+  return Variable(output, false);
+}
+
+Variable quantizedConv2d(
+    const Variable& input,
+    const af::array& weights,
+    const af::array& weightScales,
+    float inputScale,
+    const Variable& bias,
+    int sx /* = 1 */,
+    int sy /* = 1 */,
+    int px /* = 0 */,
+    int py /* = 0 */,
+    int dx /* = 1 */,
+    int dy /* = 1 */,
+    int groups /* = 1 */) {
+  checkQuantizedWeights("quantizedConv2d", weights, weightScales, 3);
+  auto in = input.array().as(f32);
+
+  af::array output;
+  if (detail::int8KernelsSupported()) {
+    output = detail::int8Conv2d(
+        in,
+        weights,
+        weightScales * inputScale,
+        inputScale,
+        sx,
+        sy,
+        px,
+        py,
+        dx,
+        dy,
+        groups);
+  } else {
+    output = conv2d(
+                 Variable(emulateQuantization(in, inputScale), false),
+                 Variable(dequantizeWeights(weights, weightScales, 3), false),
+                 sx,
+                 sy,
+                 px,
+                 py,
+                 dx,
+                 dy,
+                 groups)
+                 .array();
+  }
+  if (bias.elements() > 0) {
+    auto biasArr =
+        moddims(bias.array().as(f32), af::dim4(1, 1, weights.dims(3)));
+    output = output + detail::tileAs(biasArr, output.dims());
+  }
+  return Variable(output, false);
+}
+
 Variable gatedlinearunit(const Variable& input, const int dim) {
   auto inDims = input.dims();
   auto inType = input.type();
@@ -1082,7 +1418,119 @@ Variable gatedlinearunit(const Variable& input, const int dim) {
   return Variable(fhalfout * shalfout, {input.withoutData()}, gradFunc);
 }
 
-Variable embedding(const Variable& input, const Variable& embeddings) {
+std::tuple<Variable, Variable, Variable> rnn(
+    const Variable& input,
+    const Variable& hiddenState,
+    const Variable& cellState,
+    const Variable& weights,
+    int hiddenSize,
+    int numLayers,
+    RnnMode mode,
+    bool bidirectional,
+    float dropout,
+    const af::array& sequenceLengths) {
+  int batchSize = input.dims(1);
+  int seqLength = input.dims(2);
+  // Each weight is used once per step and sample (padded steps included)
+  detail::FlopCounter::add(2.0 * weights.elements() * batchSize * seqLength);
+  std::vector<int> lengths;
+  if (!sequenceLengths.isempty()) {
+    if (sequenceLengths.elements() != batchSize) {
+      throw std::invalid_argument(
+          "rnn: sequenceLengths should have one length per sample");
+    }
+    lengths.resize(batchSize);
+    sequenceLengths.as(s32).host(lengths.data());
+    for (auto length : lengths) {
+      if (length < 1 || length > seqLength) {
+        throw std::invalid_argument(
+            "rnn: sequence lengths should be in [1, sequence length]");
+      }
+    }
+  }
+  if (std::all_of(lengths.begin(), lengths.end(), [seqLength](int length) {
+        return length == seqLength;
+      })) {
+    return rnn(
+        input,
+        hiddenState,
+        cellState,
+        weights,
+        hiddenSize,
+        numLayers,
+        mode,
+        bidirectional,
+        dropout);
+  }
+  if (detail::variableLengthRnnSupported()) {
+    return detail::variableLengthRnn(
+        input,
+        hiddenState,
+        cellState,
+        weights,
+        hiddenSize,
+        numLayers,
+        mode,
+        bidirectional,
+        dropout,
+        lengths);
+  }
+
+  // Runs the samples of each length together, for that length
+  std::map<int, std::vector<int>> samplesByLength;
+  for (int b = 0; b < batchSize; ++b) {
+    samplesByLength[lengths[b]].push_back(b);
+  }
+  std::vector<Variable> ys, hiddenStates, cellStates;
+  std::vector<int> order;
+  for (const auto& group : samplesByLength) {
+    int length = group.first;
+    const auto& samples = group.second;
+    af::array index(samples.size(), samples.data());
+    auto select = [&index](const Variable& state) {
+      return state.isempty() ? state : state(af::span, index);
+    };
+    Variable y, hy, cy;
+    std::tie(y, hy, cy) =
+        rnn(input(af::span, index, af::seq(length)),
+            select(hiddenState),
+            select(cellState),
+            weights,
+            hiddenSize,
+            numLayers,
+            mode,
+            bidirectional,
+            dropout);
+    if (length < seqLength) {
+      y = padding(y, {{0, 0}, {0, 0}, {0, seqLength - length}}, 0);
+    }
+    ys.push_back(y);
+    hiddenStates.push_back(hy);
+    if (mode == RnnMode::LSTM) {
+      cellStates.push_back(cy);
+    }
+    order.insert(order.end(), samples.begin(), samples.end());
+  }
+
+  // Back to the order of the batch
+  std::vector<int> inverseOrder(batchSize);
+  for (int i = 0; i < batchSize; ++i) {
+    inverseOrder[order[i]] = i;
+  }
+  af::array inverse(batchSize, inverseOrder.data());
+  auto y = concatenate(ys, 1)(af::span, inverse);
+  auto hy = concatenate(hiddenStates, 1)(af::span, inverse);
+  Variable cy;
+  if (!cellStates.empty()) {
+    cy = concatenate(cellStates, 1)(af::span, inverse);
+  }
+  return std::make_tuple(y, hy, cy);
+}
+
+Variable embedding(
+    const Variable& input,
+    const Variable& embeddings,
+    bool sparseGrad /* = false */) {
   if (input.numdims() >= 4) {
     throw std::invalid_argument("embedding input must have 3 or fewer dims");
   }
@@ -1093,8 +1541,9 @@ Variable embedding(const Variable& input, const Variable& embeddings) {
   af::array result =
       af::moddims(embeddings.array()(af::span, idxs), resultDims);
 
-  auto gradFunc = [](std::vector<Variable>& inputs,
-                     const Variable& gradOutput) {
+  auto gradFunc = [sparseGrad](
+                      std::vector<Variable>& inputs,
+                      const Variable& gradOutput) {
     auto& w = inputs[1];
     if (!w.isCalcGrad()) {
       return;
@@ -1102,7 +1551,17 @@ Variable embedding(const Variable& input, const Variable& embeddings) {
 
     auto ip = af::flat(inputs[0].array());
     auto deltas = af::moddims(gradOutput.array(), w.dims(0), ip.elements());
+    if (sparseGrad) {
+      w.addGrad(Variable::sparse(deltas, ip, 1, w.dims()));
+      return;
+    }
 
+    // Sparse arrays don't support f16: the gradient of f16 embeddings is
+    // computed in f32
+    auto gradType = deltas.type();
+    if (gradType == af::dtype::f16) {
+      deltas = deltas.as(af::dtype::f32);
+    }
     auto sp = af::sparse(
         ip.elements(),
         w.dims(1),
@@ -1112,7 +1571,7 @@ Variable embedding(const Variable& input, const Variable& embeddings) {
         AF_STORAGE_CSR);
 
     auto grad = transpose(matmulTN(sp, transpose(deltas)));
-    w.addGrad(Variable(grad, false));
+    w.addGrad(Variable(grad.as(gradType), false));
   };
 
   return Variable(result, {input, embeddings}, gradFunc);
@@ -1139,13 +1598,22 @@ Variable padding(
 }
 
 Variable dropout(const Variable& input, double p) {
-  if (p > 0.0) {
-    auto mask = Variable(
-        (af::randu(input.dims(), input.type()) > p).as(input.type()), false);
-    return 1.0 / (1.0 - p) * mask * input;
-  } else {
+  if (p <= 0.0) {
     return input;
   }
+  // Drawn on the device, as for the fused attention; the backward pass
+  // regenerates the mask from the seed
+  auto seed = af::randu(1, af::dtype::u64);
+  af::array out;
+  detail::dropoutForward(input.array(), p, seed, out);
+  auto gradFunc = [p, seed](
+                      std::vector<Variable>& inputs,
+                      const Variable& gradOutput) {
+    af::array grad;
+    detail::dropoutForward(gradOutput.array(), p, seed, grad);
+    inputs[0].addGrad(Variable(grad, false));
+  };
+  return Variable(out, {input.withoutData()}, gradFunc);
 }
 
 Variable relu(const Variable& input) {
@@ -1159,6 +1627,171 @@ Variable gelu(const Variable& in) {
        fl::tanh(0.7978845608 * (input + 0.044715 * input * input * input)));
 }
 
+Variable biasGelu(const Variable& input, const Variable& bias) {
+  if (bias.elements() != input.dims(0)) {
+    throw std::invalid_argument("biasGelu: invalid bias size");
+  }
+  auto f32 = af::dtype::f32;
+  af::array out;
+  detail::biasGeluForward(input.array().as(f32), bias.array().as(f32), out);
+  auto gradFunc = [](std::vector<Variable>& inputs,
+                     const Variable& gradOutput) {
+    auto f32 = af::dtype::f32;
+    af::array gradInput;
+    detail::biasGeluBackward(
+        inputs[0].array().as(f32),
+        inputs[1].array().as(f32),
+        gradOutput.array().as(f32),
+        gradInput);
+    if (inputs[1].isCalcGrad()) {
+      auto gradBias = af::sum(
+          af::moddims(gradInput, af::dim4(inputs[0].dims(0), -1)), 1);
+      inputs[1].addGrad(Variable(
+          af::moddims(gradBias, inputs[1].dims()).as(inputs[1].type()),
+          false));
+    }
+    inputs[0].addGrad(Variable(gradInput.as(inputs[0].type()), false));
+  };
+  return Variable(out.as(input.type()), {input, bias}, gradFunc);
+}
+
+Variable residualLayerNorm(
+    const Variable& input,
+    const Variable& residual,
+    const Variable& weight,
+    const Variable& bias,
+    double eps) {
+  if (!residual.isempty() && residual.dims() != input.dims()) {
+    throw std::invalid_argument(
+        "residualLayerNorm: input and residual sizes are different");
+  }
+  for (const auto& param : {weight, bias}) {
+    if (param.elements() > 1 && param.elements() != input.dims(0)) {
+      throw std::invalid_argument(
+          "residualLayerNorm: invalid weight or bias size");
+    }
+  }
+  auto f32 = af::dtype::f32;
+  auto asF32 = [f32](const Variable& var) {
+    return var.isempty() ? af::array() : var.array().as(f32);
+  };
+  af::array out, mean, rstd;
+  detail::layerNormForward(
+      input.array().as(f32),
+      asF32(residual),
+      asF32(weight),
+      asF32(bias),
+      eps,
+      out,
+      mean,
+      rstd);
+
+  // inputs are {input, residual, weight, bias}, any but the first may be empty
+  auto gradFunc = [mean, rstd](
+                      std::vector<Variable>& inputs,
+                      const Variable& gradOutput) {
+    auto f32 = af::dtype::f32;
+    auto asF32 = [f32](const Variable& var) {
+      return var.isempty() ? af::array() : var.array().as(f32);
+    };
+    af::array gradInput, gradWeight, gradBias;
+    detail::layerNormBackward(
+        inputs[0].array().as(f32),
+        asF32(inputs[1]),
+        asF32(inputs[2]),
+        mean,
+        rstd,
+        gradOutput.array().as(f32),
+        gradInput,
+        gradWeight,
+        gradBias);
+    // the per-row gradients are summed for singleton parameters
+    auto addParamGrad = [](Variable& param, const af::array& grad) {
+      if (param.isempty() || !param.isCalcGrad()) {
+        return;
+      }
+      auto g = param.elements() == 1 ? af::sum(grad) : grad;
+      param.addGrad(
+          Variable(af::moddims(g, param.dims()).as(param.type()), false));
+    };
+    addParamGrad(inputs[2], gradWeight);
+    addParamGrad(inputs[3], gradBias);
+    if (!inputs[1].isempty()) {
+      inputs[1].addGrad(Variable(gradInput.as(inputs[1].type()), false));
+    }
+    inputs[0].addGrad(Variable(gradInput.as(inputs[0].type()), false));
+  };
+  return Variable(
+      out.as(input.type()), {input, residual, weight, bias}, gradFunc);
+}
+
+Variable layerNorm(
+    const Variable& input,
+    const Variable& weight,
+    const Variable& bias,
+    double eps) {
+  return residualLayerNorm(input, Variable(), weight, bias, eps);
+}
+
+Variable depthwiseConv1d(
+    const Variable& input,
+    const Variable& weights,
+    const Variable& bias,
+    int leftPad,
+    int rightPad,
+    int sx /* = 1 */,
+    int dx /* = 1 */) {
+  int channels = input.dims(2), outChannels = weights.dims(3);
+  if (weights.dims(1) != 1 || weights.dims(2) != 1 ||
+      outChannels % channels != 0) {
+    throw std::invalid_argument("depthwiseConv1d: invalid weights size");
+  }
+  if (!bias.isempty() && bias.elements() != outChannels) {
+    throw std::invalid_argument("depthwiseConv1d: invalid bias size");
+  }
+  if (leftPad < 0 || rightPad < 0 || sx < 1 || dx < 1) {
+    throw std::invalid_argument("depthwiseConv1d: invalid parameters");
+  }
+  auto f32 = af::dtype::f32;
+  af::array out;
+  detail::depthwiseConv1dForward(
+      input.array().as(f32),
+      weights.array().as(f32),
+      bias.isempty() ? af::array() : af::flat(bias.array()).as(f32),
+      leftPad,
+      rightPad,
+      sx,
+      dx,
+      out);
+
+  // inputs are {input, weights, bias}, the last of which may be empty
+  auto gradFunc = [leftPad, sx, dx](
+                      std::vector<Variable>& inputs,
+                      const Variable& gradOutput) {
+    auto f32 = af::dtype::f32;
+    auto gradOut = gradOutput.array().as(f32);
+    af::array gradInput, gradWeight;
+    detail::depthwiseConv1dBackward(
+        inputs[0].array().as(f32),
+        inputs[1].array().as(f32),
+        gradOut,
+        leftPad,
+        sx,
+        dx,
+        gradInput,
+        gradWeight);
+    if (!inputs[2].isempty() && inputs[2].isCalcGrad()) {
+      auto gradBias = af::sum(af::sum(af::sum(gradOut, 0), 1), 3);
+      inputs[2].addGrad(Variable(
+          af::moddims(gradBias, inputs[2].dims()).as(inputs[2].type()),
+          false));
+    }
+    inputs[1].addGrad(Variable(gradWeight.as(inputs[1].type()), false));
+    inputs[0].addGrad(Variable(gradInput.as(inputs[0].type()), false));
+  };
+  return Variable(out.as(input.type()), {input, weights, bias}, gradFunc);
+}
+
 fl::Variable relativePositionEmbeddingRotate(const fl::Variable& input) {
   auto data = input.array();
   int d0 = data.dims(0);
@@ -1183,6 +1816,112 @@ fl::Variable relativePositionEmbeddingRotate(const fl::Variable& input) {
   return fl::Variable(data, {input}, gradFunc);
 }
 
+namespace {
+
+// Attention of moddims'ed (T x headDim x nHeads * B) queries, keys and values
+// computed by the fused kernels of the backend
+Variable fusedAttention(
+    const Variable& q,
+    const Variable& k,
+    const Variable& v,
+    const Variable& posEmb,
+    const Variable& mask,
+    const Variable& padMask,
+    int32_t nHeads,
+    double pDropout,
+    int32_t offset,
+    const AttentionWindow& window) {
+  auto f32 = af::dtype::f32;
+  auto maskArr = mask.isempty() ? af::array() : mask.array().as(f32);
+  auto padMaskArr = padMask.isempty() ? af::array() : padMask.array().as(f32);
+  // Drawn on the device, so that the random engine is advanced (and can be
+  // reseeded) as with unfused dropout, without synchronizing with the host
+  auto seed = pDropout > 0.0 ? af::randu(1, af::dtype::u64)
+                             : af::constant(0, 1, af::dtype::u64);
+  af::array out, logSumExp;
+  detail::fusedAttentionForward(
+      q.array().as(f32),
+      k.array().as(f32),
+      v.array().as(f32),
+      posEmb.isempty() ? af::array() : posEmb.array().as(f32),
+      maskArr,
+      padMaskArr,
+      nHeads,
+      offset,
+      pDropout,
+      seed,
+      window,
+      out,
+      logSumExp);
+
+  std::vector<Variable> inputs = {q, k, v};
+  if (!posEmb.isempty()) {
+    inputs.push_back(posEmb);
+  }
+  auto gradFunc = [maskArr,
+                   padMaskArr,
+                   nHeads,
+                   offset,
+                   pDropout,
+                   seed,
+                   window,
+                   out,
+                   logSumExp](
+                      std::vector<Variable>& inputs,
+                      const Variable& gradOutput) {
+    auto f32 = af::dtype::f32;
+    bool hasPosEmb = inputs.size() > 3;
+    af::array gradQ, gradK, gradV, gradPosEmb;
+    detail::fusedAttentionBackward(
+        inputs[0].array().as(f32),
+        inputs[1].array().as(f32),
+        inputs[2].array().as(f32),
+        hasPosEmb ? inputs[3].array().as(f32) : af::array(),
+        maskArr,
+        padMaskArr,
+        nHeads,
+        offset,
+        pDropout,
+        seed,
+        window,
+        out,
+        logSumExp,
+        gradOutput.array().as(f32),
+        gradQ,
+        gradK,
+        gradV,
+        gradPosEmb);
+    inputs[0].addGrad(Variable(gradQ.as(inputs[0].type()), false));
+    inputs[1].addGrad(Variable(gradK.as(inputs[1].type()), false));
+    inputs[2].addGrad(Variable(gradV.as(inputs[2].type()), false));
+    if (hasPosEmb) {
+      inputs[3].addGrad(Variable(gradPosEmb.as(inputs[3].type()), false));
+    }
+  };
+  return Variable(out.as(v.type()), inputs, gradFunc);
+}
+
+// Additive Tq x Tk mask of the pairs of queries and keys out of `window`
+af::array attentionWindowMask(
+    int tq,
+    int tk,
+    int offset,
+    const AttentionWindow& window) {
+  auto pos = af::range(af::dim4(tq, tk), 0) + offset;
+  auto j = af::range(af::dim4(tq, tk), 1);
+  auto inWindow = af::constant(1, tq, tk, b8);
+  if (window.left >= 0) {
+    inWindow = inWindow && (j >= pos - window.left);
+  }
+  if (window.right >= 0) {
+    inWindow = inWindow && (j <= pos + window.right);
+  }
+  inWindow = inWindow || (j < window.numGlobal) || (pos < window.numGlobal);
+  return af::log(inWindow.as(f32));
+}
+
+} // namespace
+
 fl::Variable multiheadAttention(
     const fl::Variable& query,
     const fl::Variable& key,
@@ -1192,7 +1931,8 @@ fl::Variable multiheadAttention(
     const fl::Variable& padMask,
     const int32_t nHeads,
     const double pDropout,
-    const int32_t offset /* = 0 */) {
+    const int32_t offset /* = 0 */,
+    const AttentionWindow& window /* = AttentionWindow() */) {
   int32_t bsz = query.dims(2);
   int32_t modelDim = query.dims(1);
   int32_t headDim = modelDim / nHeads;
@@ -1202,6 +1942,20 @@ fl::Variable multiheadAttention(
   auto v = moddims(value, af::dim4(-1, headDim, nHeads * bsz));
 
   q = q / std::sqrt(float(headDim));
+  if (!padMask.isempty() && padMask.dims(0) != query.dims(0)) {
+    throw std::invalid_argument(
+        "multiheadAttention: invalid padding mask size");
+  }
+  if (!mask.isempty() && mask.dims(2) != 1 && mask.dims(2) != bsz) {
+    throw std::invalid_argument("multiheadAttention: invalid mask size");
+  }
+  if (!mask.isCalcGrad() && !padMask.isCalcGrad() &&
+      detail::fusedAttentionSupported(headDim)) {
+    auto result = fusedAttention(
+        q, k, v, posEmb, mask, padMask, nHeads, pDropout, offset, window);
+    return moddims(result, af::dim4(-1, headDim * nHeads, bsz));
+  }
+
   auto scores = matmulNT(q, k);
   if (!posEmb.isempty()) {
     int n = posEmb.dims(0) / 2 - offset;
@@ -1210,13 +1964,24 @@ fl::Variable multiheadAttention(
     scores = scores + transpose(pscores.rows(n, n + k.dims(0) - 1));
   }
   if (!mask.isempty()) {
-    scores = scores + tileAs(mask.as(scores.type()), scores);
+    auto maskTile = mask.as(scores.type());
+    if (mask.dims(2) > 1) {
+      // The mask of each element of the batch is shared by its heads
+      af::dim4 dims(mask.dims(0), mask.dims(1), 1, bsz);
+      maskTile = moddims(maskTile, dims);
+      dims[2] = nHeads;
+      maskTile = moddims(tileAs(maskTile, dims), scores.dims());
+    }
+    scores = scores + tileAs(maskTile, scores);
+  }
+  if (!window.isFull()) {
+    auto windowMask = Variable(
+        attentionWindowMask(q.dims(0), k.dims(0), offset, window)
+            .as(scores.type()),
+        false);
+    scores = scores + tileAs(windowMask, scores);
   }
   if (!padMask.isempty()) {
-    if (padMask.dims(0) != query.dims(0)) {
-      throw std::invalid_argument(
-          "multiheadAttention: invalid padding mask size");
-    }
     auto padMaskTile = moddims(padMask, af::dim4(1, padMask.dims(0), 1, bsz));
     padMaskTile = tileAs(
         padMaskTile, af::dim4(padMask.dims(0), padMask.dims(0), nHeads, bsz));
@@ -39,6 +39,14 @@ af::array sumAs(const af::array& input, const af::dim4& rdims);
 
 bool areVariableTypesEqual(const Variable& a, const Variable& b);
 
+/**
+ * Casts the f16 operand of a binary operator to f32 if the other operand is
+ * f32 and the optim level isn't DEFAULT, so that mixed-precision models (e.g.
+ * adding the f16 output of a matmul to an f32 residual) need no explicit
+ * casts. Returns the operand unchanged otherwise.
+ */
+Variable autocastOperand(const Variable& operand, const Variable& other);
+
 template <typename... Args>
 bool areVariableTypesEqual(
     const Variable& a,
@@ -596,6 +604,30 @@ Variable linear(const Variable& input, const Variable& weight);
 Variable
 linear(const Variable& input, const Variable& weight, const Variable& bias);
 
+/**
+ * Applies a linear transformation followed by an activation:
+ * \f[
+ *    y = activation(Ax + b)
+ * \f]
+ * The bias and the activation are fused into the matrix product where the
+ * backend supports it (cuBLASLt epilogues on CUDA, DNNL post-ops on CPU),
+ * and the backward pass reduces the gradient of the bias with the one of
+ * the weight, so that neither the biased nor the activated outputs need
+ * separate passes.
+ *
+ * @param input a Variable with shape [\f$N\f$, \f$M\f$, \f$B_1\f$,
+ * \f$B_2\f$]
+ * @param weight a Variable with shape [\f$K\f$, \f$N\f$]
+ * @param bias a Variable with shape [\f$K\f$], or an empty Variable
+ * @param activation the activation applied to the output
+ * @return a Variable with shape [\f$K\f$, \f$M\f$, \f$B_1\f$, \f$B_2\f$]
+ */
+Variable linear(
+    const Variable& input,
+    const Variable& weight,
+    const Variable& bias,
+    LinearActivation activation);
+
 /**
  * Applies a 2D convolution over an input signal given filter weights. In the
  * simplest case, the output with shape [\f$X_{out}\f$, \f$Y_{out}\f$,
@@ -625,6 +657,9 @@ linear(const Variable& input, const Variable& weight, const Variable& bias);
  * @param groups number of filter groups
  * @param benchmarks [optional] a `ConvBenchmarks` instance to use to
  * dynamically benchmark configuration attributes for computations.
+ * @param layout layout of `input` and of the output: with
+ * `ImageLayout::CWHN`, they have shapes [\f$C\f$, \f$X\f$, \f$Y\f$,
+ * \f$N\f$] instead, while `weights` keep their shape
  * @return a Variable with shape [\f$X_{out}\f$, \f$Y_{out}\f$, \f$C_{out}\f$,
  * \f$N\f$]]
  */
@@ -638,7 +673,8 @@ Variable conv2d(
     int dx = 1,
     int dy = 1,
     int groups = 1,
-    std::shared_ptr<detail::ConvBenchmarks> benchmarks = nullptr);
+    std::shared_ptr<detail::ConvBenchmarks> benchmarks = nullptr,
+    ImageLayout layout = ImageLayout::WHCN);
 
 /**
  * Applies a 2D convolution over an input signal given filter weights and
@@ -670,6 +706,9 @@ Variable conv2d(
  * @param groups number of filter groups
  * @param benchmarks [optional] a `ConvBenchmarks` instance to use to
  * dynamically benchmark configuration attributes for computations.
+ * @param layout layout of `input` and of the output: with
+ * `ImageLayout::CWHN`, they have shapes [\f$C\f$, \f$X\f$, \f$Y\f$,
+ * \f$N\f$] instead, while `weights` keep their shape
  * @param bias a Variable with shape [\f$C_{out}\f$]
  * @return a Variable with shape [\f$X_{out}\f$, \f$Y_{out}\f$, \f$C_{out}\f$,
  * \f$N\f$]]
@@ -685,7 +724,85 @@ Variable conv2d(
     int dx = 1,
     int dy = 1,
     int groups = 1,
-    std::shared_ptr<detail::ConvBenchmarks> benchmarks = nullptr);
+    std::shared_ptr<detail::ConvBenchmarks> benchmarks = nullptr,
+    ImageLayout layout = ImageLayout::WHCN);
+
+/**
+ * Depthwise 1D convolution along the first dimension, with dedicated
+ * kernels: each output channel $j$ convolves the input channel
+ * $\lfloor j \cdot C_{in} / C_{out} 
+floor$ with its own filter. This
+ * is `conv2d` with a kernel of height 1 and $C_{in}$ groups, which the
+ * generic convolution algorithms handle poorly, and with different paddings
+ * on the left and on the right (e.g. no right padding for a causal
+ * convolution). Computed in f32.
+ *
+ * @param input a Variable with shape [$X_{in}$, $Y$, $C_{in}$,
+ * $N$]; the columns of the second dimension are convolved independently
+ * @param weights a Variable with shape [$K_x$, 1, 1, $C_{out}$],
+ * with $C_{out}$ a multiple of $C_{in}$
+ * @param bias a Variable with $C_{out}$ elements, or empty
+ * @param leftPad number of positions of zero-padding before the input
+ * @param rightPad number of positions of zero-padding after the input
+ * @param sx stride in the first dimension
+ * @param dx dilation of the kernel
+ * @return a Variable with shape [$X_{out}$, $Y$, $C_{out}$,
+ * $N$]
+ */
+Variable depthwiseConv1d(
+    const Variable& input,
+    const Variable& weights,
+    const Variable& bias,
+    int leftPad,
+    int rightPad,
+    int sx = 1,
+    int dx = 1);
+
+/**
+ * Int8 inference counterpart of `linear`: the input is quantized with the
+ * symmetric scale `inputScale`, multiplied by int8 weights and the products
+ * are dequantized with `inputScale * weightScales` in f32. No gradients are
+ * computed.
+ *
+ * @param input a Variable with shape [\f$N\f$, \f$M\f$, \f$B_1\f$, \f$B_2\f$]
+ * @param weights int8 weights with shape [\f$K\f$, \f$N\f$], stored as the
+ * bytes of an u8 array (ArrayFire has no signed 8-bit type)
+ * @param weightScales f32 scales of the rows of the weights, of size \f$K\f$
+ * @param inputScale scale of the input: \f$x \approx 127 \cdot inputScale\f$
+ * for the largest inputs
+ * @param bias a Variable with shape [\f$K\f$], or empty
+ * @return a Variable with shape [\f$K\f$, \f$M\f$, \f$B_1\f$, \f$B_2\f$]
+ */
+Variable quantizedLinear(
+    const Variable& input,
+    const af::array& weights,
+    const af::array& weightScales,
+    float inputScale,
+    const Variable& bias);
+
+/**
+ * Int8 inference counterpart of `conv2d`, quantized as `quantizedLinear`.
+ *
+ * @param weights int8 weights with shape [\f$K_x\f$, \f$K_y\f$, \f$C_{in}\f$,
+ * \f$C_{out}\f$], stored as the bytes of an u8 array
+ * @param weightScales f32 scales of the output channels, of size \f$C_{out}\f$
+ * @param bias a Variable with shape [\f$C_{out}\f$], or empty
+ *
+ * Other parameters are the ones of `conv2d`.
+ */
+Variable quantizedConv2d(
+    const Variable& input,
+    const af::array& weights,
+    const af::array& weightScales,
+    float inputScale,
+    const Variable& bias,
+    int sx = 1,
+    int sy = 1,
+    int px = 0,
+    int py = 0,
+    int dx = 1,
+    int dy = 1,
+    int groups = 1);
 
 /**
  * Applies a 2D pooling over an input signal composed of several input planes.
@@ -703,6 +820,7 @@ Variable conv2d(
  * - MAX
  * - AVG_INCLUDE_PADDING
  * - AVG_EXCLUDE_PADDING
+ * @param layout layout of `input` and of the output, as for `conv2d`
  */
 Variable pool2d(
     const Variable& input,
@@ -712,7 +830,8 @@ Variable pool2d(
     int sy = 1,
     int px = 0,
     int py = 0,
-    PoolingMode mode = PoolingMode::MAX);
+    PoolingMode mode = PoolingMode::MAX,
+    ImageLayout layout = ImageLayout::WHCN);
 
 /**
  * Applies a softmax function on Variable `input` along dimension `dim`, so that
@@ -780,6 +899,42 @@ Variable categoricalCrossEntropy(
     ReduceMode reduction = ReduceMode::MEAN,
     int ignoreIndex = -1);
 
+/**
+ * Computes the categorical cross entropy of the softmax of (unnormalized)
+ * logits, i.e. `categoricalCrossEntropy(logSoftmax(input, 0), ...)`, with
+ * optional label smoothing:
+ * \f[
+    loss(x, y) = -(1 - \epsilon) \log p_y(x)
+        - \frac{\epsilon}{C} \sum_{c} \log p_c(x)
+ * \f]
+ * where \f$p(x)\f$ is the softmax of \f$x\f$ over its \f$C\f$ classes.
+ *
+ * The loss and its gradient are computed by fused kernels which only keep
+ * the log-sum-exp of each column of `input` for the backward pass, rather
+ * than the whole log-softmax. Since
+ * `logSoftmax(logSoftmax(x, 0), 0) == logSoftmax(x, 0)`, the loss of
+ * log-probabilities and its gradient through `logSoftmax` are those of
+ * `categoricalCrossEntropy`.
+ *
+ * @param input a `Variable` of logits with shape [\f$C\f$, \f$B_1\f$,
+ * \f$B_2\f$, \f$B_3\f$]
+ * @param targets an integer `Variable` with shape [\f$B_1\f$, \f$B_2\f$,
+ * \f$B_3\f$]. The values must be in \f$[0, C - 1]\f$
+ * @param reduction reduction mode, see `categoricalCrossEntropy`
+ * @param ignoreIndex a target value that is ignored and does not contribute
+ * to the loss or the input gradient, see `categoricalCrossEntropy`
+ * @param labelSmoothing \f$\epsilon\f$, the weight of the uniform
+ * distribution mixed with the targets
+ * @return a `Variable` of loss value with shape scalar by default. If `reduce`
+ * is NONE, then [\f$B_1\f$, \f$B_2\f$, \f$B_3\f$].
+ */
+Variable softmaxCrossEntropy(
+    const Variable& input,
+    const Variable& targets,
+    ReduceMode reduction = ReduceMode::MEAN,
+    int ignoreIndex = -1,
+    double labelSmoothing = 0.0);
+
 /**
  * The gated linear unit.
  * \f[
@@ -843,6 +998,32 @@ std::tuple<Variable, Variable, Variable> rnn(
     bool bidirectional,
     float dropout);
 
+/**
+ * Applies an RNN unit to a batch of sequences of different lengths, padded to
+ * the `sequence length` of `input`: each sample is only processed for its
+ * number of steps in `sequenceLengths` (integers of size [batch size], in
+ * [1, sequence length]), so that the output at padded steps is zero, and the
+ * returned hidden and cell states are those at the last step of each sample
+ * (the first step for the backward direction of bidirectional RNNs).
+ * Otherwise the same as `rnn()` above, which it is with empty
+ * `sequenceLengths`.
+ *
+ * Backends without support for variable lengths in their RNN kernels (see
+ * `detail::variableLengthRnnSupported()`) run the samples of each length
+ * together, for that length.
+ */
+std::tuple<Variable, Variable, Variable> rnn(
+    const Variable& input,
+    const Variable& hiddenState,
+    const Variable& cellState,
+    const Variable& weights,
+    int hiddenSize,
+    int numLayers,
+    RnnMode mode,
+    bool bidirectional,
+    float dropout,
+    const af::array& sequenceLengths);
+
 /**
  * Looks up embeddings in a fixed dictionary and size.
  * @param input a Variable of a list of indices with shape [\f$B_1\f$,
@@ -850,10 +1031,16 @@ std::tuple<Variable, Variable, Variable> rnn(
  * @param embeddings a Variable of an embedding matrix with shape [\f$D\f$,
  * \f$N\f$], where \f$N\f$ is the number of items and \f$D\f$ is the embedding
  * size.
+ * @param sparseGrad if true, the gradient of `embeddings` is sparse (see
+ * `Variable::sparse()`): it only holds the embeddings of the indices of
+ * `input`
  * @return a Variable of embeddings with shape [\f$D\f$, \f$B_1\f$, \f$B_2\f$,
  * \f$B_3\f$]
  */
-Variable embedding(const Variable& input, const Variable& embeddings);
+Variable embedding(
+    const Variable& input,
+    const Variable& embeddings,
+    bool sparseGrad = false);
 
 /**
  * Applies Batch Normalization over a 4D input (a mini-batch of 2D inputs with
@@ -894,6 +1081,30 @@ Variable batchnorm(
     double momentum,
     double epsilon);
 
+/**
+ * Computes `relu(batchnorm(input, ...) + residual)`, with the arguments of
+ * `batchnorm`, e.g. at the end of the blocks of a ResNet; `residual` may be
+ * empty. With cuDNN, in training mode, the normalization, the addition and
+ * the activation of channels-last f16 images (`axes` = {0} of C x W x H x N
+ * inputs, see `ImageLayout::CWHN`, with C a multiple of 4) run in a single
+ * kernel, and so do their gradients; in eval mode, the addition and the
+ * activation are applied to the output of the normalization in one pass.
+ * Other inputs and backends chain the operators.
+ *
+ * @param residual empty, or a Variable of the shape of `input`
+ */
+Variable batchnormRelu(
+    const Variable& input,
+    const Variable& residual,
+    const Variable& weight,
+    const Variable& bias,
+    Variable& runningMean,
+    Variable& runningVar,
+    const std::vector<int>& axes,
+    bool train,
+    double momentum,
+    double epsilon);
+
 /**
  * Applies asymmetric padding on a Variable `input`.
  * @param input input Variable
@@ -908,7 +1119,9 @@ Variable padding(
     double val);
 
 /**
- * Applies dropout on a Variable `input`.
+ * Applies dropout on a Variable `input`. The mask is regenerated from a seed
+ * in the backward pass rather than stored (see `detail::dropoutForward`),
+ * and the input isn't kept.
  * @param input input Variable
  * @param p the probability of dropout
  * @return a droped out Variable
@@ -930,11 +1143,68 @@ Variable relu(const Variable& input);
  */
 Variable gelu(const Variable& input);
 
+/**
+ * Applies `gelu` to `input + bias` in a single fused kernel, where `bias` is
+ * broadcast along the columns of `input`.
+ * @param input input Variable
+ * @param bias bias Variable with `input.dims(0)` elements
+ */
+Variable biasGelu(const Variable& input, const Variable& bias);
+
+/**
+ * Applies [Layer Normalization](https://arxiv.org/pdf/1607.06450.pdf) along
+ * the first dimension of `input`, with a single fused kernel computing the
+ * statistics, the normalization and the affine transformation of each column:
+ * \f[out(x) = \frac{x - E[x]}{\sqrt{Var[x]+\epsilon}} \times w + b \f]
+ * @param input input Variable
+ * @param weight empty (no scaling), or a Variable of one or `input.dims(0)`
+ * elements
+ * @param bias empty (no shift), or a Variable of one or `input.dims(0)`
+ * elements
+ * @param eps \f$\epsilon\f$
+ */
+Variable layerNorm(
+    const Variable& input,
+    const Variable& weight,
+    const Variable& bias,
+    double eps);
+
+/**
+ * Computes `layerNorm(input + residual, weight, bias, eps)`, adding the
+ * residual in the normalization kernel rather than in a separate pass.
+ */
+Variable residualLayerNorm(
+    const Variable& input,
+    const Variable& residual,
+    const Variable& weight,
+    const Variable& bias,
+    double eps);
+
 /**
  * Relative positional embedding for the multihead attention
  * Implementation partially follows https://arxiv.org/pdf/1803.02155.pdf
  */
-Variable relativePositionalEmbeddingRotate(const Variable& input);
+Variable relativePositionEmbeddingRotate(const Variable& input);
+
+/**
+ * Local (banded) window of the self-attention of `multiheadAttention`, for
+ * long inputs: the query at position t attends to the keys at positions
+ * [t - left, t + right], and to the first `numGlobal` positions, whose
+ * queries attend to all the keys (as the global tokens of
+ * [Beltagy et al (2020)](https://arxiv.org/abs/2004.05150)). The query i is
+ * at position i + offset among the keys. A negative `left` or `right` doesn't
+ * bound the window on that side; the default window is the full attention.
+ */
+struct AttentionWindow {
+  int32_t left{-1};
+  int32_t right{-1};
+  int32_t numGlobal{0};
+
+  /// Whether every query attends to every key.
+  bool isFull() const {
+    return left < 0 && right < 0;
+  }
+};
 
 /**
  * Multihead Attention function
@@ -946,12 +1216,25 @@ Variable relativePositionalEmbeddingRotate(const Variable& input);
  * positional embedding in additon to standard computations
  * @param mask mask or not future in the computations T x T
  * if non-empty then don't use future (for example for autoregressive language
- * models or for decoder part in the encoder-decoder transformer models)
+ * models or for decoder part in the encoder-decoder transformer models).
+ * It can also be of size T x T x B, with a mask per element of the batch,
+ * e.g. a block-diagonal mask over the sentences packed in each sample
  * @param padMask mask which is 1 for positions where pad token is,
  * don't attend to the pad-positions, of size T x B
  * @param nHeads number of heads
  * @param pDropout dropout probability
  * @param offset size of the current output from the decoder used now as input
+ * @param window local window of the attention (see `AttentionWindow`),
+ * combined with the masks
+ *
+ * When the masks don't require gradients and the backend supports the size of
+ * the heads (see `detail::fusedAttentionSupported()`), the attention is
+ * computed by fused kernels which don't materialize the T x T attention
+ * matrix, neither in the forward nor in the backward pass. Their dropout masks
+ * are drawn from a seed taken from the ArrayFire random engine. The fused
+ * kernels only compute the blocks of scores within the window, so that a
+ * local window of size W costs O(T * W); the unfused operators mask the
+ * T x T scores instead.
  */
 Variable multiheadAttention(
     const Variable& query,
@@ -962,7 +1245,303 @@ Variable multiheadAttention(
     const Variable& padMask,
     const int32_t nHeads,
     const double pDropout,
-    const int32_t offset = 0);
+    const int32_t offset = 0,
+    const AttentionWindow& window = AttentionWindow());
+
+namespace detail {
+
+/**
+ * Whether the fused attention kernels of the backend support heads of size
+ * `headDim`; `multiheadAttention` falls back to unfused operators otherwise.
+ */
+bool fusedAttentionSupported(int headDim);
+
+/**
+ * Fused (memory-efficient) attention: computes
+ * `dropout(softmax(q * k^T + bias, 1)) * v` block by block, without
+ * materializing the T x T attention matrix. The bias is the sum of the
+ * relative positional scores of `posEmb` (as computed with
+ * `relativePositionEmbeddingRotate`), `mask` and `padMask`, any of which may
+ * be empty. Only the pairs of queries and keys within `window` are computed.
+ * All arrays are f32.
+ *
+ * @param q scaled queries of size Tq x headDim x nHeads * B
+ * @param k keys of size Tk x headDim x nHeads * B
+ * @param v values of size Tk x headDim x nHeads * B
+ * @param posEmb positional embeddings of size P x headDim x (1 or nHeads * B)
+ * @param mask additive mask of size Tq x Tk, or Tq x Tk x B
+ * @param padMask additive padding mask of size Tk x B
+ * @param nHeads number of heads
+ * @param offset offset of the queries in the positional embeddings
+ * @param pDropout dropout probability of the attention weights
+ * @param seed dropout seed, an u64 array of one element
+ * @param window local window of the attention, the query i being at position
+ * i + offset among the keys
+ * @param out output of size Tq x headDim x nHeads * B
+ * @param logSumExp log-sum-exp of the scores of size Tq x 1 x nHeads * B,
+ * used by the backward pass
+ */
+void fusedAttentionForward(
+    const af::array& q,
+    const af::array& k,
+    const af::array& v,
+    const af::array& posEmb,
+    const af::array& mask,
+    const af::array& padMask,
+    int nHeads,
+    int offset,
+    float pDropout,
+    const af::array& seed,
+    const AttentionWindow& window,
+    af::array& out,
+    af::array& logSumExp);
+
+/**
+ * Backward pass of `fusedAttentionForward`: recomputes the attention weights
+ * block by block from `logSumExp` and computes the gradients of `q`, `k`, `v`
+ * and `posEmb` (empty if `posEmb` is) given the gradient of the output.
+ */
+void fusedAttentionBackward(
+    const af::array& q,
+    const af::array& k,
+    const af::array& v,
+    const af::array& posEmb,
+    const af::array& mask,
+    const af::array& padMask,
+    int nHeads,
+    int offset,
+    float pDropout,
+    const af::array& seed,
+    const AttentionWindow& window,
+    const af::array& out,
+    const af::array& logSumExp,
+    const af::array& gradOut,
+    af::array& gradQ,
+    af::array& gradK,
+    af::array& gradV,
+    af::array& gradPosEmb);
+
+/**
+ * Fused layer normalization along the first dimension of `input + residual`
+ * (`residual` may be empty). All arrays are f32; `weight` and `bias` have zero,
+ * one or `input.dims(0)` elements.
+ *
+ * @param out output of the size of `input`
+ * @param mean mean of each column, of size 1 x columns
+ * @param rstd inverse standard deviation of each column, of size 1 x columns
+ */
+void layerNormForward(
+    const af::array& input,
+    const af::array& residual,
+    const af::array& weight,
+    const af::array& bias,
+    float eps,
+    af::array& out,
+    af::array& mean,
+    af::array& rstd);
+
+/**
+ * Backward pass of `layerNormForward`: computes the gradient of the input
+ * (which is also the one of the residual), and the gradients of the weight and
+ * of the bias for each row, of size `input.dims(0)`.
+ */
+void layerNormBackward(
+    const af::array& input,
+    const af::array& residual,
+    const af::array& weight,
+    const af::array& mean,
+    const af::array& rstd,
+    const af::array& gradOut,
+    af::array& gradInput,
+    af::array& gradWeight,
+    af::array& gradBias);
+
+/**
+ * Fused `gelu(input + bias)`, with `bias` of `input.dims(0)` elements. All
+ * arrays are f32.
+ */
+void biasGeluForward(
+    const af::array& input,
+    const af::array& bias,
+    af::array& out);
+
+/**
+ * Backward pass of `biasGeluForward`: computes the gradient of `input + bias`.
+ */
+void biasGeluBackward(
+    const af::array& input,
+    const af::array& bias,
+    const af::array& gradOut,
+    af::array& gradInput);
+
+/**
+ * Whether the backend fuses linear layers with their bias and activation
+ * for arrays of type `type`; `linear` falls back to unfused operators
+ * otherwise.
+ */
+bool fusedLinearSupported(af::dtype type);
+
+/**
+ * Fused `activation(weight * input + bias)` of a 2D `input` (K x N) and
+ * `weight` (M x K); `bias` (M elements) may be empty.
+ *
+ * @param out output of size M x N
+ * @param preActivation `weight * input + bias`, before a GELU activation,
+ * if `keepPreActivation` (used by the backward pass), else empty
+ */
+void linearForward(
+    const af::array& input,
+    const af::array& weight,
+    const af::array& bias,
+    LinearActivation activation,
+    bool keepPreActivation,
+    af::array& out,
+    af::array& preActivation);
+
+/**
+ * Gradient of the weight of `linearForward`, `gradPreActivation * input^T`,
+ * given the gradient of its output before the activation (M x N). The
+ * gradient of the bias, the sum of the columns of `gradPreActivation`, is
+ * reduced in the same pass if `computeGradBias`.
+ */
+void linearBackwardWeight(
+    const af::array& input,
+    const af::array& gradPreActivation,
+    bool computeGradBias,
+    af::array& gradWeight,
+    af::array& gradBias);
+
+/**
+ * Depthwise 1D convolution of `depthwiseConv1d` (all arrays are f32, `bias`
+ * may be empty): `out` has `weight.dims(3)` channels, and `leftPad` zeros
+ * before and `rightPad` zeros after each column of the input.
+ */
+void depthwiseConv1dForward(
+    const af::array& input,
+    const af::array& weight,
+    const af::array& bias,
+    int leftPad,
+    int rightPad,
+    int stride,
+    int dilation,
+    af::array& out);
+
+/**
+ * Backward pass of `depthwiseConv1dForward`: computes the gradients of the
+ * input and of the weight given the gradient of the output. The gradient of
+ * the bias is the sum of `gradOut` over all but its third dimension.
+ */
+void depthwiseConv1dBackward(
+    const af::array& input,
+    const af::array& weight,
+    const af::array& gradOut,
+    int leftPad,
+    int stride,
+    int dilation,
+    af::array& gradInput,
+    af::array& gradWeight);
+
+/**
+ * Fused dropout: zeroes each element of `input` (f16, f32 or f64) with
+ * probability `p`, and scales the others by `1 / (1 - p)`. Whether an element
+ * is kept only depends on `seed` (an u64 array of one element) and on its
+ * index, through a counter-based generator: the mask is never stored, and the
+ * backward pass regenerates it by applying the same function, with the same
+ * seed, to the gradient.
+ */
+void dropoutForward(
+    const af::array& input,
+    float p,
+    const af::array& seed,
+    af::array& out);
+
+/**
+ * Fused softmax cross entropy of the columns of `logits` (C x X, f32) with
+ * `targets` (X, s32); columns with `ignoreIndex` as target have a zero loss.
+ *
+ * @param loss loss of each column, of size X
+ * @param logSumExp log-sum-exp of each column, of size X, used by the backward
+ * pass
+ */
+void softmaxCrossEntropyForward(
+    const af::array& logits,
+    const af::array& targets,
+    int ignoreIndex,
+    float labelSmoothing,
+    af::array& loss,
+    af::array& logSumExp);
+
+/**
+ * Backward pass of `softmaxCrossEntropyForward`: computes the gradient of the
+ * logits, `(softmax(logits) - smoothed targets) * gradLoss`, in a single pass.
+ */
+void softmaxCrossEntropyBackward(
+    const af::array& logits,
+    const af::array& targets,
+    const af::array& logSumExp,
+    const af::array& gradLoss,
+    int ignoreIndex,
+    float labelSmoothing,
+    af::array& gradLogits);
+
+/**
+ * Whether the backend has int8 kernels for `quantizedLinear` and
+ * `quantizedConv2d`; they are emulated in f32 otherwise, with the same
+ * rounding of the inputs and weights.
+ */
+bool int8KernelsSupported();
+
+/**
+ * Int8 product of the weights (K x N, int8 as u8) with the quantized columns
+ * of `input` (N x M, f32), dequantized by `outputScales` (K, f32). Returns a
+ * K x M f32 array.
+ */
+af::array int8Linear(
+    const af::array& input,
+    const af::array& weights,
+    const af::array& outputScales,
+    float inputScale);
+
+/**
+ * Int8 convolution of the quantized `input` (f32) with the weights (int8 as
+ * u8), dequantized by `outputScales` (f32, one per output channel).
+ */
+af::array int8Conv2d(
+    const af::array& input,
+    const af::array& weights,
+    const af::array& outputScales,
+    float inputScale,
+    int sx,
+    int sy,
+    int px,
+    int py,
+    int dx,
+    int dy,
+    int groups);
+
+/**
+ * Whether the RNN kernels of the backend process sequences of different
+ * lengths in a padded batch (cuDNN does).
+ */
+bool variableLengthRnnSupported();
+
+/**
+ * `rnn()` of sequences of `sequenceLengths` steps with the kernels of the
+ * backend, see `variableLengthRnnSupported()`.
+ */
+std::tuple<Variable, Variable, Variable> variableLengthRnn(
+    const Variable& input,
+    const Variable& hiddenState,
+    const Variable& cellState,
+    const Variable& weights,
+    int hiddenSize,
+    int numLayers,
+    RnnMode mode,
+    bool bidirectional,
+    float dropout,
+    const std::vector<int>& sequenceLengths);
+
+} // namespace detail
 
 /**
  * This function computes the gradient of an indexing operator
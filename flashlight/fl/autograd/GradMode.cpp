@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/autograd/GradMode.h"
+
+namespace fl {
+
+namespace {
+
+thread_local bool gradEnabled = true;
+
+} // namespace
+
+bool isGradEnabled() {
+  return gradEnabled;
+}
+
+void setGradEnabled(bool enabled) {
+  gradEnabled = enabled;
+}
+
+NoGradGuard::NoGradGuard() : prevEnabled_(gradEnabled) {
+  gradEnabled = false;
+}
+
+NoGradGuard::~NoGradGuard() {
+  gradEnabled = prevEnabled_;
+}
+
+} // namespace fl
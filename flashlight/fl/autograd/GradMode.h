@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+namespace fl {
+
+/**
+ * Whether operations on Variables record the computation graph in the
+ * calling thread (true by default). When disabled, the outputs of operations
+ * don't require gradient and keep neither their inputs nor their gradient
+ * function, whatever their inputs are.
+ */
+bool isGradEnabled();
+
+/**
+ * Enables or disables the recording of the computation graph in the calling
+ * thread. See `isGradEnabled()`.
+ */
+void setGradEnabled(bool enabled);
+
+/**
+ * Disables the recording of the computation graph in the calling thread
+ * during its lifetime, for inference:
+ * \code{.cpp}
+ * model->eval();
+ * {
+ *   fl::NoGradGuard noGrad;
+ *   auto output = model->forward(input);
+ * }
+ * \endcode
+ * Guards nest: the previous mode is restored on destruction.
+ */
+class NoGradGuard {
+ public:
+  NoGradGuard();
+  ~NoGradGuard();
+
+  NoGradGuard(const NoGradGuard&) = delete;
+  NoGradGuard& operator=(const NoGradGuard&) = delete;
+
+ private:
+  bool prevEnabled_;
+};
+
+} // namespace fl
@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/autograd/Offload.h"
+
+#include <memory>
+#include <unordered_set>
+#include <utility>
+
+#include "flashlight/fl/autograd/GradMode.h"
+
+namespace fl {
+namespace detail {
+
+class OffloadedActivations {
+ public:
+  // Offloads the data saved by the graph of `outputs`, see
+  // `offloadActivations()`
+  static std::shared_ptr<OffloadedActivations> create(
+      const std::vector<Variable>& outputs,
+      const std::vector<Variable>& inputs,
+      size_t minBytes);
+
+  bool empty() const {
+    return arrays_.empty();
+  }
+
+  void prefetch() {
+    if (restored_) {
+      return;
+    }
+    for (auto& entry : arrays_) {
+      entry.second->prefetch();
+    }
+  }
+
+  // Brings the data back to the Variables, and prefetches the activations
+  // offloaded before
+  void restore() {
+    if (restored_) {
+      return;
+    }
+    for (auto& entry : arrays_) {
+      entry.first->data = entry.second->restore();
+    }
+    arrays_.clear();
+    restored_ = true;
+    if (auto previous = previous_.lock()) {
+      previous->prefetch();
+    }
+  }
+
+ private:
+  std::vector<std::pair<
+      std::shared_ptr<Variable::SharedData>,
+      std::unique_ptr<OffloadedArray>>>
+      arrays_;
+  bool restored_{false};
+  std::weak_ptr<OffloadedActivations> previous_;
+};
+
+namespace {
+
+// The activations last offloaded by the thread, restored next in the backward
+// pass
+thread_local std::weak_ptr<OffloadedActivations> lastOffloaded;
+
+} // namespace
+
+std::shared_ptr<OffloadedActivations> OffloadedActivations::create(
+    const std::vector<Variable>& outputs,
+    const std::vector<Variable>& inputs,
+    size_t minBytes) {
+  std::unordered_set<const Variable::SharedGrad*> visited;
+  std::unordered_set<const Variable::SharedData*> kept;
+  for (const auto& input : inputs) {
+    visited.insert(input.sharedGrad_.get());
+    kept.insert(input.sharedData_.get());
+  }
+  std::vector<const Variable*> stack;
+  for (const auto& output : outputs) {
+    kept.insert(output.sharedData_.get());
+    if (visited.insert(output.sharedGrad_.get()).second) {
+      stack.push_back(&output);
+    }
+  }
+
+  auto activations = std::make_shared<OffloadedActivations>();
+  while (!stack.empty()) {
+    auto var = stack.back();
+    stack.pop_back();
+    for (const auto& input : var->sharedGrad_->inputs) {
+      if (visited.insert(input.sharedGrad_.get()).second) {
+        stack.push_back(&input);
+      }
+      auto& shared = input.sharedData_;
+      if (!kept.insert(shared.get()).second || shared->data.isempty() ||
+          shared->data.issparse() || !shared->sparseIndices.isempty() ||
+          shared->data.bytes() < minBytes) {
+        continue;
+      }
+      activations->arrays_.emplace_back(
+          shared, std::make_unique<OffloadedArray>(shared->data));
+      shared->data = af::array().as(shared->data.type());
+    }
+  }
+  if (!activations->empty()) {
+    activations->previous_ = lastOffloaded;
+    lastOffloaded = activations;
+  }
+  return activations;
+}
+
+} // namespace detail
+
+std::vector<Variable> offloadActivations(
+    const std::vector<Variable>& outputs,
+    const std::vector<Variable>& inputs,
+    size_t minBytes /* = 0 */) {
+  if (!isGradEnabled()) {
+    return outputs;
+  }
+  // The outputs don't keep JIT references to the offloaded arrays
+  for (const auto& output : outputs) {
+    output.eval();
+  }
+  auto activations =
+      detail::OffloadedActivations::create(outputs, inputs, minBytes);
+  if (activations->empty()) {
+    return outputs;
+  }
+
+  // The gradient of the outputs is propagated before the nodes of their
+  // graph use their inputs
+  auto gradFunc = [activations](
+                      std::vector<Variable>& inputs,
+                      const Variable& gradOutput) {
+    activations->restore();
+    inputs[0].addGrad(gradOutput);
+  };
+  std::vector<Variable> result;
+  for (const auto& output : outputs) {
+    if (!output.isCalcGrad()) {
+      result.push_back(output);
+      continue;
+    }
+    result.emplace_back(
+        output.array(), std::vector<Variable>{output.withoutData()}, gradFunc);
+  }
+  return result;
+}
+
+} // namespace fl
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <arrayfire.h>
+
+#include "flashlight/fl/autograd/Variable.h"
+#include "flashlight/fl/common/PinnedHostBuffer.h"
+
+namespace fl {
+
+/**
+ * Offloads the activations saved for the backward pass by the graph of
+ * `outputs` to pinned host memory, and returns Variables with the data of
+ * `outputs` which bring them back to the device when their gradient is
+ * propagated:
+ * \code{.cpp}
+ * auto hidden = layer1->forward(input);
+ * hidden = offloadActivations({hidden}, {input}, 1 << 20)[0];
+ * auto loss = layer2->forward(hidden);
+ * loss.backward(); // restores the activations of layer1 before using them
+ * \endcode
+ *
+ * The graph is walked from `outputs` up to the Variables of `inputs`
+ * (typically the inputs and the parameters of a module), whose data, like
+ * that of `outputs`, stays on the device. The data of the other inputs of the
+ * nodes of the graph of at least `minBytes` bytes is copied to the host, and
+ * released on the device: the data of Variables sharing it outside the graph
+ * is offloaded as well. Arrays captured by the gradient functions themselves
+ * are not offloaded.
+ *
+ * On CUDA the copies are enqueued on a copy stream, overlapping the
+ * computation, and the device memory is given back to the
+ * `CachingMemoryManager` once the copy has completed (see
+ * `fl::cuda::recordStream()`). When the activations of a call are restored in
+ * the backward pass, those of the previous call on the same thread are
+ * prefetched, so that they are back on the device by the time the backward
+ * pass reaches them. On other backends the copies are synchronous.
+ *
+ * Does nothing if the gradient isn't recorded.
+ */
+std::vector<Variable> offloadActivations(
+    const std::vector<Variable>& outputs,
+    const std::vector<Variable>& inputs,
+    size_t minBytes = 0);
+
+namespace detail {
+
+/**
+ * Copy of an array in pinned host memory, and the copy back to the device,
+ * implemented by each backend. The copy to the host is enqueued by the
+ * constructor.
+ */
+class OffloadedArray {
+ public:
+  explicit OffloadedArray(const af::array& arr);
+  ~OffloadedArray();
+
+  OffloadedArray(const OffloadedArray&) = delete;
+  OffloadedArray& operator=(const OffloadedArray&) = delete;
+
+  /**
+   * Enqueues the copy back to a new device array, if not already done.
+   */
+  void prefetch();
+
+  /**
+   * Returns the device array, which computations enqueued afterwards may use.
+   */
+  af::array restore();
+
+  size_t bytes() const {
+    return host_.bytes();
+  }
+
+ private:
+  PinnedHostBuffer host_;
+  af::dim4 dims_;
+  af::dtype type_;
+  af::array device_;
+  // Completion of the last copy, on backends with streams
+  void* event_{nullptr};
+};
+
+} // namespace detail
+
+} // namespace fl
@@ -18,4 +18,27 @@ bool allClose(
   return allClose(a.array(), b.array(), absTolerance);
 }
 
+namespace detail {
+
+namespace {
+// Innermost counter of the thread
+thread_local FlopCounter* tlsFlopCounter = nullptr;
+} // namespace
+
+FlopCounter::FlopCounter() : parent_(tlsFlopCounter) {
+  tlsFlopCounter = this;
+}
+
+FlopCounter::~FlopCounter() {
+  tlsFlopCounter = parent_;
+}
+
+void FlopCounter::add(double flops) {
+  for (auto* counter = tlsFlopCounter; counter; counter = counter->parent_) {
+    counter->flops_ += flops;
+  }
+}
+
+} // namespace detail
+
 } // namespace fl
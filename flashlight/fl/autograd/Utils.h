@@ -28,4 +28,38 @@ bool allClose(const Variable& a, const Variable& b, double absTolerance = 1e-5);
 
 /** @} */
 
+namespace detail {
+
+/**
+ * Counts the floating point operations of the matrix multiplications,
+ * convolutions and RNNs run on the calling thread while it is alive, but not
+ * those of the element-wise functions or of the gradients. Counters nest: an
+ * operation is counted by all the counters of the thread, e.g. those of a
+ * module and of its container (see `ModuleProfiler`).
+ */
+class FlopCounter {
+ public:
+  FlopCounter();
+  ~FlopCounter();
+
+  FlopCounter(const FlopCounter&) = delete;
+  FlopCounter& operator=(const FlopCounter&) = delete;
+
+  double flops() const {
+    return flops_;
+  }
+
+  /**
+   * Adds `flops` to the counters of the calling thread, called by the
+   * functions computing the operations.
+   */
+  static void add(double flops);
+
+ private:
+  double flops_{0};
+  FlopCounter* parent_;
+};
+
+} // namespace detail
+
 } // namespace fl
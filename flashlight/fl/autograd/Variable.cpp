@@ -18,6 +18,7 @@
 #include <af/internal.h>
 #include <algorithm>
 #include <cassert>
+#include <cstddef>
 #include <functional>
 #include <memory>
 #include <stdexcept>
@@ -25,10 +26,144 @@
 #include <utility>
 
 #include "flashlight/fl/autograd/Functions.h"
+#include "flashlight/fl/autograd/GradMode.h"
+#include "flashlight/fl/common/Trace.h"
 #include "flashlight/fl/common/Utils.h"
 
 namespace fl {
 
+namespace {
+
+// Free lists of blocks by size class, for the shared states of Variables
+// (with the control blocks of their shared_ptr), which are small and
+// allocated and released at the rate of the operations. Blocks released by
+// another thread than the one which allocated them go to its free lists.
+class NodePool {
+ public:
+  static constexpr size_t kGranularity = 16;
+  // Blocks of up to 256 bytes
+  static constexpr size_t kNumClasses = 16;
+  static constexpr size_t kMaxFreeBlocks = 4096;
+
+  ~NodePool();
+
+  void* allocate(size_t bytes) {
+    auto sizeClass = (bytes - 1) / kGranularity;
+    if (sizeClass >= kNumClasses || !freeLists_[sizeClass].head) {
+      return ::operator new(roundUp(bytes));
+    }
+    auto& list = freeLists_[sizeClass];
+    auto* block = list.head;
+    list.head = block->next;
+    --list.size;
+    return block;
+  }
+
+  void deallocate(void* ptr, size_t bytes) {
+    auto sizeClass = (bytes - 1) / kGranularity;
+    if (sizeClass >= kNumClasses ||
+        freeLists_[sizeClass].size >= kMaxFreeBlocks) {
+      ::operator delete(ptr);
+      return;
+    }
+    auto& list = freeLists_[sizeClass];
+    auto* block = static_cast<FreeBlock*>(ptr);
+    block->next = list.head;
+    list.head = block;
+    ++list.size;
+  }
+
+  static size_t roundUp(size_t bytes) {
+    return (bytes + kGranularity - 1) / kGranularity * kGranularity;
+  }
+
+ private:
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  struct FreeList {
+    FreeBlock* head{nullptr};
+    size_t size{0};
+  };
+
+  FreeList freeLists_[kNumClasses];
+};
+
+// Variables released by the destructors of static or thread-local objects may
+// outlive the pool of the thread
+thread_local bool nodePoolDestroyed = false;
+
+NodePool::~NodePool() {
+  nodePoolDestroyed = true;
+  for (auto& list : freeLists_) {
+    while (list.head) {
+      auto* next = list.head->next;
+      ::operator delete(list.head);
+      list.head = next;
+    }
+  }
+}
+
+NodePool* nodePool() {
+  if (nodePoolDestroyed) {
+    return nullptr;
+  }
+  static thread_local NodePool pool;
+  return &pool;
+}
+
+template <typename T>
+struct NodeAllocator {
+  using value_type = T;
+
+  NodeAllocator() = default;
+
+  template <typename U>
+  NodeAllocator(const NodeAllocator<U>& /* other */) {}
+
+  T* allocate(size_t n) {
+    static_assert(
+        alignof(T) <= NodePool::kGranularity,
+        "NodeAllocator: unsupported alignment");
+    auto* pool = nodePool();
+    auto bytes = n * sizeof(T);
+    if (!pool) {
+      return static_cast<T*>(::operator new(bytes));
+    }
+    return static_cast<T*>(pool->allocate(bytes));
+  }
+
+  void deallocate(T* ptr, size_t n) {
+    auto* pool = nodePool();
+    if (pool) {
+      pool->deallocate(ptr, n * sizeof(T));
+    } else {
+      ::operator delete(ptr);
+    }
+  }
+};
+
+template <typename T, typename U>
+bool operator==(const NodeAllocator<T>&, const NodeAllocator<U>&) {
+  return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const NodeAllocator<T>&, const NodeAllocator<U>&) {
+  return false;
+}
+
+} // namespace
+
+std::shared_ptr<Variable::SharedData> Variable::makeSharedData() {
+  return std::allocate_shared<SharedData>(NodeAllocator<SharedData>());
+}
+
+std::shared_ptr<Variable::SharedGrad> Variable::makeSharedGrad() {
+  return std::allocate_shared<SharedGrad>(NodeAllocator<SharedGrad>());
+}
+
 Variable::Variable(af::array data, bool calcGrad) {
   sharedData_->data = std::move(data);
   sharedGrad_->calcGrad = calcGrad;
@@ -39,7 +174,8 @@ Variable::Variable(
     std::vector<Variable> inputs,
     GradFunc gradFunc) {
   sharedData_->data = std::move(data);
-  if (std::any_of(inputs.begin(), inputs.end(), [](const Variable& input) {
+  if (isGradEnabled() &&
+      std::any_of(inputs.begin(), inputs.end(), [](const Variable& input) {
         return input.isCalcGrad();
       })) {
     sharedGrad_->calcGrad = true;
@@ -143,9 +279,100 @@ Variable& Variable::grad() const {
     throw std::logic_error("gradient not calculated yet for this Variable");
   }
 
+  if (sharedGrad_->grad->isSparse()) {
+    *sharedGrad_->grad = sharedGrad_->grad->toDense();
+  }
+  return *sharedGrad_->grad;
+}
+
+Variable& Variable::sparseGrad() const {
+  if (!isGradSparse()) {
+    throw std::logic_error("sparse gradient not available for this Variable");
+  }
   return *sharedGrad_->grad;
 }
 
+bool Variable::isGradSparse() const {
+  return isGradAvailable() && sharedGrad_->grad->isSparse();
+}
+
+Variable Variable::sparse(
+    const af::array& values,
+    const af::array& indices,
+    int dim,
+    const af::dim4& dims) {
+  if (dim != 0 && dim != 1) {
+    throw std::invalid_argument("Variable::sparse: dim must be 0 or 1");
+  }
+  if (dims[2] != 1 || dims[3] != 1) {
+    throw std::invalid_argument("Variable::sparse: dims must be 2D");
+  }
+  if (indices.elements() != values.dims(dim)) {
+    throw std::invalid_argument(
+        "Variable::sparse: mismatched number of indices and slices");
+  }
+  af::array uniqueIndices = af::flat(indices).as(s32);
+  af::array sums = values;
+  if (!indices.isempty()) {
+    af::array sortedIndices, permutation;
+    af::sort(sortedIndices, permutation, uniqueIndices);
+    af::array sorted = dim == 0 ? values(permutation, af::span)
+                                : values(af::span, permutation);
+    // f16 slices are summed in f32
+    if (values.type() == f16) {
+      sorted = sorted.as(f32);
+    }
+    af::sumByKey(uniqueIndices, sums, sortedIndices, sorted, dim);
+    sums = sums.as(values.type());
+  }
+  Variable result(sums, false);
+  result.sharedData_->sparseIndices = uniqueIndices;
+  result.sharedData_->sparseDim = dim;
+  result.sharedData_->denseDims = dims;
+  return result;
+}
+
+bool Variable::isSparse() const {
+  return sharedData_->sparseDim >= 0;
+}
+
+const af::array& Variable::sparseIndices() const {
+  if (!isSparse()) {
+    throw std::logic_error("Variable::sparseIndices: Variable is not sparse");
+  }
+  return sharedData_->sparseIndices;
+}
+
+int Variable::sparseDim() const {
+  if (!isSparse()) {
+    throw std::logic_error("Variable::sparseDim: Variable is not sparse");
+  }
+  return sharedData_->sparseDim;
+}
+
+af::dim4 Variable::denseDims() const {
+  if (!isSparse()) {
+    throw std::logic_error("Variable::denseDims: Variable is not sparse");
+  }
+  return sharedData_->denseDims;
+}
+
+Variable Variable::toDense() const {
+  if (!isSparse()) {
+    throw std::logic_error("Variable::toDense: Variable is not sparse");
+  }
+  auto dense = af::constant(0, sharedData_->denseDims, type());
+  const auto& indices = sharedData_->sparseIndices;
+  if (!indices.isempty()) {
+    if (sharedData_->sparseDim == 0) {
+      dense(indices, af::span) = array();
+    } else {
+      dense(af::span, indices) = array();
+    }
+  }
+  return Variable(dense, false);
+}
+
 std::vector<Variable>& Variable::getInputs() const {
   return sharedGrad_->inputs;
 }
@@ -232,7 +459,9 @@ void Variable::addGrad(const Variable& childGrad) {
             "two inputs of different types.";
       throw std::invalid_argument(ss.str());
     }
-    if (sharedGrad_->grad) {
+    if (childGrad.isSparse() || (sharedGrad_->grad && isGradSparse())) {
+      addSparseGrad(childGrad);
+    } else if (sharedGrad_->grad) {
       // Prevent increment of array refcount to avoid a copy
       // if getting a device pointer. See
       // https://git.io/fp9oM for more
@@ -250,6 +479,28 @@ void Variable::addGrad(const Variable& childGrad) {
   }
 }
 
+void Variable::addSparseGrad(const Variable& childGrad) {
+  auto& grad = sharedGrad_->grad;
+  if (!grad) {
+    grad = std::make_unique<Variable>(childGrad);
+  } else if (
+      grad->isSparse() && childGrad.isSparse() &&
+      grad->sparseDim() == childGrad.sparseDim()) {
+    int dim = childGrad.sparseDim();
+    grad = std::make_unique<Variable>(sparse(
+        af::join(dim, grad->array(), childGrad.array()),
+        af::join(0, grad->sparseIndices(), childGrad.sparseIndices()),
+        dim,
+        childGrad.denseDims()));
+  } else {
+    auto dense = grad->isSparse() ? grad->toDense().array() : grad->array();
+    dense += childGrad.isSparse() ? childGrad.toDense().array()
+                                  : childGrad.array();
+    grad = std::make_unique<Variable>(dense, false);
+    grad->eval();
+  }
+}
+
 void Variable::registerGradHook(const GradHook& hook) {
   sharedGrad_->onGradAvailable = hook;
 }
@@ -267,18 +518,26 @@ void Variable::applyGradHook() {
 
 void Variable::calcGradInputs(bool retainGraph) {
   if (sharedGrad_->gradFunc) {
+    FL_TRACE(AUTOGRAD, "gradFunc");
     if (!sharedGrad_->grad) {
       throw std::logic_error("gradient was not propagated to this Variable");
     }
 
+    // Gradient functions take dense gradients
+    if (sharedGrad_->grad->isSparse()) {
+      *sharedGrad_->grad = sharedGrad_->grad->toDense();
+    }
     sharedGrad_->gradFunc(sharedGrad_->inputs, *sharedGrad_->grad);
   }
   if (!retainGraph) {
     sharedGrad_->inputs.clear();
+    // Releases the arrays captured by the gradient function
+    sharedGrad_->gradFunc = nullptr;
   }
 }
 
 void Variable::backward(const Variable& grad, bool retainGraph) {
+  FL_TRACE(AUTOGRAD, "backward");
   addGrad(grad);
   auto dag = build();
   for (auto iter = dag.rbegin(); iter != dag.rend(); iter++) {
@@ -385,22 +644,26 @@ Variable Variable::withoutData() const {
 Variable::DAG Variable::build() const {
   std::unordered_set<SharedGrad*> cache;
   DAG dag;
-  std::function<void(const Variable&)> recurse;
-
-  // Topological sort
-  recurse = [&](const Variable& var) {
-    auto id = var.sharedGrad_.get();
-    if (cache.find(id) != cache.end()) {
-      return;
-    }
-    for (const auto& input : var.getInputs()) {
-      recurse(input);
+  // Topological sort, as an iterative depth-first search so that deep graphs
+  // (unrolled RNNs, long stacks of layers) don't overflow the stack. The
+  // graph holds Variables without data so that the data of a Variable is
+  // released once the Variables using it have propagated their gradient.
+  std::vector<std::pair<const Variable*, size_t>> stack;
+  cache.insert(sharedGrad_.get());
+  stack.emplace_back(this, 0);
+  while (!stack.empty()) {
+    auto var = stack.back().first;
+    auto& inputs = var->getInputs();
+    auto next = stack.back().second++;
+    if (next < inputs.size()) {
+      if (cache.insert(inputs[next].sharedGrad_.get()).second) {
+        stack.emplace_back(&inputs[next], 0);
+      }
+      continue;
     }
-    cache.insert(id);
-    dag.push_back(var);
-  };
-
-  recurse(*this);
+    dag.push_back(var->withoutData());
+    stack.pop_back();
+  }
   return dag;
 }
 
@@ -24,9 +24,14 @@
 
 #include "flashlight/fl/common/Defines.h"
 #include "flashlight/fl/common/Serialization.h"
+#include "flashlight/fl/common/SmallFunction.h"
 
 namespace fl {
 
+namespace detail {
+class OffloadedActivations;
+} // namespace detail
+
 /**
  *  Variable wraps an Arrayfire array and facilitates easy backpropagation
  *
@@ -70,8 +75,13 @@ namespace fl {
  */
 class Variable {
  public:
-  using GradFunc = std::function<
-      void(std::vector<Variable>& inputs, const Variable& grad_output)>;
+  /**
+   * Gradient functions capturing up to 64 bytes (a few arrays and
+   * dimensions) are stored without allocation, see `SmallFunction`.
+   */
+  using GradFunc = SmallFunction<
+      void(std::vector<Variable>& inputs, const Variable& grad_output),
+      64>;
 
   using GradHook = std::function<void(Variable& grad)>;
 
@@ -95,6 +105,10 @@ class Variable {
    * @param[in] inputs a vector specifying inputs for this Variable
    * @param[in] gradFunc function specifying how to calculate gradient of the
    * input Variables
+   *
+   * The inputs and gradient function are only kept if the gradient is
+   * required for one of the inputs and the graph is recorded (see
+   * `isGradEnabled()`).
    */
   Variable(af::array data, std::vector<Variable> inputs, GradFunc gradFunc);
 
@@ -146,6 +160,60 @@ class Variable {
    */
   bool isGradAvailable() const;
 
+  /**
+   * Returns whether the gradient has been calculated for the Variable and is
+   * sparse (see `sparse()`), e.g. for embeddings looked up with sparse
+   * gradients. `grad()` converts sparse gradients to dense ones: optimizers
+   * and reducers which support them use `sparseGrad()` instead.
+   */
+  bool isGradSparse() const;
+
+  /**
+   * @return a reference to the underlying gradient Variable, which must be
+   * sparse. Unlike `grad()`, it is not converted to a dense Variable.
+   */
+  Variable& sparseGrad() const;
+
+  /**
+   * Creates a sparse Variable, used for gradients of 2D arrays of which only
+   * a few slices are nonzero (e.g. the embeddings of the tokens of a batch).
+   * The Variable holds the slices `values` along dimension `dim` (0 or 1) of
+   * an array of dimensions `dims`, at the positions `indices`. Slices at the
+   * same position are summed, so that the indices of the Variable are unique
+   * and sorted.
+   */
+  static Variable sparse(
+      const af::array& values,
+      const af::array& indices,
+      int dim,
+      const af::dim4& dims);
+
+  /**
+   * Returns whether the Variable is sparse, in which case `array()` returns
+   * the slices it holds.
+   */
+  bool isSparse() const;
+
+  /**
+   * Returns the (s32) positions of the slices held by a sparse Variable.
+   */
+  const af::array& sparseIndices() const;
+
+  /**
+   * Returns the dimension along which a sparse Variable is sliced.
+   */
+  int sparseDim() const;
+
+  /**
+   * Returns the dimensions of the dense array of a sparse Variable.
+   */
+  af::dim4 denseDims() const;
+
+  /**
+   * Returns a Variable wrapping the dense array of a sparse Variable.
+   */
+  Variable toDense() const;
+
   /**
    * Returns the dimension of the array wrapped by the Variable
    */
@@ -245,7 +313,8 @@ class Variable {
 
   /**
    * Registers a lambda function `hook` to be applied on the gradient w.r.t
-   * Variable after it is computed during backward pass
+   * Variable after it is computed during backward pass. The gradient may be
+   * sparse (see `isSparse()`).
    */
   void registerGradHook(const GradHook& hook);
 
@@ -260,7 +329,9 @@ class Variable {
    * is computed.
    * @param[in] grad gradient w.r.t to the Variable
    * @param[in] retainGraph If False, clears the input Variables stored
-   * by the Variable
+   * by the Variable. The inputs and gradient function of each Variable of the
+   * graph are then released as soon as its gradient has been propagated, so
+   * that intermediate arrays are freed during the backward pass.
    */
   void backward(const Variable& grad, bool retainGraph = false);
 
@@ -339,6 +410,8 @@ class Variable {
   Variable withoutData() const;
 
  private:
+  friend class detail::OffloadedActivations;
+
   using DAG = std::vector<Variable>;
 
   /**
@@ -348,14 +421,16 @@ class Variable {
 
   /**
    * Builds the computation graph which comprises of all the input Variables for
-   * which the gradient of `var` can be propagated using chain rule
+   * which the gradient of `var` can be propagated using chain rule, in
+   * topological order. The Variables of the graph don't hold their data,
+   * which is only kept by the Variables using them as inputs.
    */
   DAG build() const;
 
   /**
    * Calculate the gradient of inputs.
-   * @param[in] retainGraph If False, clears the inputs stored
-   * by the Variable
+   * @param[in] retainGraph If False, clears the inputs and gradient function
+   * stored by the Variable
    */
   void calcGradInputs(bool retainGraph = false);
 
@@ -364,9 +439,19 @@ class Variable {
    */
   void applyGradHook();
 
+  /**
+   * Adds a gradient when either it or the current gradient is sparse
+   */
+  void addSparseGrad(const Variable& childGrad);
+
   struct SharedData {
     /// Array wrapped by this Variable
     af::array data;
+    /// For sparse Variables, positions of the slices of `data` along
+    /// `sparseDim` in the dense array, of dimensions `denseDims`
+    af::array sparseIndices;
+    int sparseDim{-1};
+    af::dim4 denseDims;
 
     FL_SAVE_LOAD(data)
   };
@@ -387,8 +472,15 @@ class Variable {
     FL_SAVE_LOAD(calcGrad);
   };
 
-  std::shared_ptr<SharedData> sharedData_{std::make_shared<SharedData>()};
-  std::shared_ptr<SharedGrad> sharedGrad_{std::make_shared<SharedGrad>()};
+  /**
+   * The shared states are allocated from free lists of the calling thread,
+   * as graphs of small operations create and release many of them.
+   */
+  static std::shared_ptr<SharedData> makeSharedData();
+  static std::shared_ptr<SharedGrad> makeSharedGrad();
+
+  std::shared_ptr<SharedData> sharedData_{makeSharedData()};
+  std::shared_ptr<SharedGrad> sharedGrad_{makeSharedGrad()};
 
   // NB: array only; we don't try to serialize the autograd graph
   // Saving the sharedData ptr helps to avoid saving variables which share the
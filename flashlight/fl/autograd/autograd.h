@@ -16,5 +16,7 @@
 #pragma once
 
 #include "flashlight/fl/autograd/Functions.h"
+#include "flashlight/fl/autograd/GradMode.h"
+#include "flashlight/fl/autograd/Offload.h"
 #include "flashlight/fl/autograd/Utils.h"
 #include "flashlight/fl/autograd/Variable.h"
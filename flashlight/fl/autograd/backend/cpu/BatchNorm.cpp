@@ -26,6 +26,17 @@ constexpr size_t kWIdx = 1;
 constexpr size_t kChannelSizeIdx = 2;
 constexpr size_t kBatchSizeIdx = 3;
 
+// Primitives cached in detail::DnnlPrimitiveCache
+struct BatchNormForward {
+  std::shared_ptr<dnnl::batch_normalization_forward::primitive_desc> primDesc;
+  dnnl::batch_normalization_forward primitive;
+};
+
+struct BatchNormBackward {
+  dnnl::batch_normalization_backward::primitive_desc primDesc;
+  dnnl::batch_normalization_backward primitive;
+};
+
 } // namespace
 
 Variable batchnorm(
@@ -123,12 +134,25 @@ Variable batchnorm(
       ? dnnl::normalization_flags::none
       : dnnl::normalization_flags::use_global_stats;
   flag = flag | dnnl::normalization_flags::use_scale_shift;
-  auto fwdDesc = dnnl::batch_normalization_forward::desc(
-      kind, inputOutputMemDesc, epsilon, flag);
-  auto fwdPrimDesc =
-      std::make_shared<dnnl::batch_normalization_forward::primitive_desc>(
-          fwdDesc, dnnlEngine);
-  auto bn = dnnl::batch_normalization_forward(*fwdPrimDesc);
+  auto cacheKey = detail::DnnlCacheKey()
+                      .add(kind)
+                      .add(flag)
+                      .add(epsilon)
+                      .add(dType)
+                      .add(inputOutputDims);
+  auto fwdPrimitives =
+      detail::DnnlPrimitiveCache::getInstance().get<BatchNormForward>(
+          cacheKey, [&]() {
+            auto fwdDesc = dnnl::batch_normalization_forward::desc(
+                kind, inputOutputMemDesc, epsilon, flag);
+            auto primDesc = std::make_shared<
+                dnnl::batch_normalization_forward::primitive_desc>(
+                fwdDesc, dnnlEngine);
+            return BatchNormForward{
+                primDesc, dnnl::batch_normalization_forward(*primDesc)};
+          });
+  auto fwdPrimDesc = fwdPrimitives->primDesc;
+  auto bn = fwdPrimitives->primitive;
   std::unordered_map<int, dnnl::memory> bnFwdArgs = {
       {DNNL_ARG_SRC, inputMemory.getMemory()},
       {DNNL_ARG_MEAN, meanMemory.getMemory()},
@@ -149,6 +173,7 @@ Variable batchnorm(
                    epsilon,
                    nfeatures,
                    fwdPrimDesc,
+                   cacheKey,
                    outputMemDesc = outputMemory.getDescriptor(),
                    inputOutputDims,
                    formatNCHW,
@@ -189,16 +214,22 @@ Variable batchnorm(
         grad_weightsDNNL.array(), weightsDnnlDims, format2d);
 
     // Primitives and descriptors
-    auto bwdDesc = dnnl::batch_normalization_backward::desc(
-        dnnl::prop_kind::backward,
-        gradOutputMem.getDescriptor(),
-        outputMemDesc,
-        epsilon,
-        dnnl::normalization_flags::use_scale_shift);
-    auto bwdPrimDesc = dnnl::batch_normalization_backward::primitive_desc(
-        bwdDesc, dnnlEngineBwd, *fwdPrimDesc);
-    auto bwdPrim =
-        std::make_shared<dnnl::batch_normalization_backward>(bwdPrimDesc);
+    auto bwdPrimitives =
+        detail::DnnlPrimitiveCache::getInstance().get<BatchNormBackward>(
+            cacheKey, [&]() {
+              auto bwdDesc = dnnl::batch_normalization_backward::desc(
+                  dnnl::prop_kind::backward,
+                  gradOutputMem.getDescriptor(),
+                  outputMemDesc,
+                  epsilon,
+                  dnnl::normalization_flags::use_scale_shift);
+              auto bwdPrimDesc =
+                  dnnl::batch_normalization_backward::primitive_desc(
+                      bwdDesc, dnnlEngineBwd, *fwdPrimDesc);
+              return BatchNormBackward{
+                  bwdPrimDesc,
+                  dnnl::batch_normalization_backward(bwdPrimDesc)};
+            });
 
     // Execute
     std::vector<dnnl::primitive> networkBackwards;
@@ -210,7 +241,7 @@ Variable batchnorm(
          {DNNL_ARG_DIFF_SRC, gradInputMem.getMemory()},
          {DNNL_ARG_DIFF_DST, gradOutputMem.getMemory()},
          {DNNL_ARG_DIFF_SCALE_SHIFT, gradWeightsMem.getMemory()}}};
-    networkBackwards.push_back(*bwdPrim);
+    networkBackwards.push_back(bwdPrimitives->primitive);
     detail::executeNetwork(networkBackwards, bwdArgs);
 
     // Update grad
@@ -262,4 +293,31 @@ Variable batchnorm(
   }
 }
 
+Variable batchnormRelu(
+    const Variable& input,
+    const Variable& residual,
+    const Variable& weight,
+    const Variable& bias,
+    Variable& runningMean,
+    Variable& runningVar,
+    const std::vector<int>& axes,
+    bool train,
+    double momentum,
+    double epsilon) {
+  auto out = batchnorm(
+      input,
+      weight,
+      bias,
+      runningMean,
+      runningVar,
+      axes,
+      train,
+      momentum,
+      epsilon);
+  if (!residual.isempty()) {
+    out = out + residual;
+  }
+  return relu(out);
+}
+
 } // namespace fl
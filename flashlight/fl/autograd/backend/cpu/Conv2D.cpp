@@ -14,6 +14,7 @@
 #include <dnnl.hpp>
 
 #include "flashlight/fl/autograd/Functions.h"
+#include "flashlight/fl/autograd/Utils.h"
 #include "flashlight/fl/autograd/Variable.h"
 #include "flashlight/fl/autograd/backend/cpu/DnnlUtils.h"
 
@@ -34,6 +35,22 @@ constexpr size_t kIOChannelSizeIdx = 2;
 constexpr size_t kIOBatchSizeIdx = 3;
 constexpr size_t kWeightOutputChannelSizeIdx = 3;
 
+// Primitives cached in detail::DnnlPrimitiveCache
+struct ConvForward {
+  std::shared_ptr<convolution_forward::primitive_desc> primDesc;
+  convolution_forward primitive;
+};
+
+struct ConvBackwardData {
+  convolution_backward_data::primitive_desc primDesc;
+  convolution_backward_data primitive;
+};
+
+struct ConvBackwardWeights {
+  convolution_backward_weights::primitive_desc primDesc;
+  convolution_backward_weights primitive;
+};
+
 } // namespace
 
 Variable conv2d(
@@ -46,12 +63,25 @@ Variable conv2d(
     int dx,
     int dy,
     int groups,
-    std::shared_ptr<detail::ConvBenchmarks> benchmarks) {
+    std::shared_ptr<detail::ConvBenchmarks> benchmarks,
+    ImageLayout layout) {
   if (input.type() == f16) {
     throw std::runtime_error("Half precision is not supported in CPU.");
   }
   auto dummy_bias = Variable(af::array(), false);
-  return conv2d(input, weights, dummy_bias, sx, sy, px, py, dx, dy, groups);
+  return conv2d(
+      input,
+      weights,
+      dummy_bias,
+      sx,
+      sy,
+      px,
+      py,
+      dx,
+      dy,
+      groups,
+      benchmarks,
+      layout);
 }
 
 Variable conv2d(
@@ -65,10 +95,27 @@ Variable conv2d(
     int dx,
     int dy,
     int groups,
-    std::shared_ptr<detail::ConvBenchmarks> benchmarks) {
+    std::shared_ptr<detail::ConvBenchmarks> benchmarks,
+    ImageLayout layout) {
   if (input.type() == f16) {
     throw std::runtime_error("Half precision is not supported in CPU.");
   }
+  if (layout == ImageLayout::CWHN) {
+    // Computed in the default layout
+    auto output = conv2d(
+        reorder(input, 1, 2, 0, 3),
+        weights,
+        bias,
+        sx,
+        sy,
+        px,
+        py,
+        dx,
+        dy,
+        groups,
+        benchmarks);
+    return reorder(output, 2, 0, 1, 3);
+  }
   auto output = af::array(
       1 +
           (input.dims(kWIdx) + (2 * px) -
@@ -149,45 +196,58 @@ Variable conv2d(
       ? prop_kind::forward_training
       : prop_kind::forward_inference;
 
-  // Convolution descriptor
-  std::shared_ptr<convolution_forward::desc> fwdDescriptor;
-  if (hasBias) {
-    fwdDescriptor = std::make_shared<convolution_forward::desc>(
-        forwardMode,
-        algorithm::convolution_direct,
-        inputMD,
-        weightMD,
-        biasMD,
-        outputMD,
-        mStrideDims,
-        mDilationDims,
-        mPaddingDims,
-        mPaddingDims);
-  } else {
-    fwdDescriptor = std::make_shared<convolution_forward::desc>(
-        forwardMode,
-        algorithm::convolution_direct,
-        inputMD,
-        weightMD,
-        outputMD,
-        mStrideDims,
-        mDilationDims,
-        mPaddingDims,
-        mPaddingDims);
-  }
-
-  // Primitive descriptor
+  // The primitives only depend on the shapes and parameters of the convolution
+  auto cacheKey = detail::DnnlCacheKey()
+                      .add(forwardMode)
+                      .add(hasBias)
+                      .add(dataType)
+                      .add(mInputDims)
+                      .add(mWeightDims)
+                      .add(mOutputDims)
+                      .add(mStrideDims)
+                      .add(mDilationDims)
+                      .add(mPaddingDims);
   auto& dnnlEngine = detail::DnnlEngine::getInstance().getEngine();
-  auto fwdPrimDesc = std::make_shared<convolution_forward::primitive_desc>(
-      *fwdDescriptor, dnnlEngine);
+  auto fwdPrimitives =
+      detail::DnnlPrimitiveCache::getInstance().get<ConvForward>(
+          cacheKey, [&]() {
+            // Convolution descriptor
+            std::shared_ptr<convolution_forward::desc> fwdDescriptor;
+            if (hasBias) {
+              fwdDescriptor = std::make_shared<convolution_forward::desc>(
+                  forwardMode,
+                  algorithm::convolution_direct,
+                  inputMD,
+                  weightMD,
+                  biasMD,
+                  outputMD,
+                  mStrideDims,
+                  mDilationDims,
+                  mPaddingDims,
+                  mPaddingDims);
+            } else {
+              fwdDescriptor = std::make_shared<convolution_forward::desc>(
+                  forwardMode,
+                  algorithm::convolution_direct,
+                  inputMD,
+                  weightMD,
+                  outputMD,
+                  mStrideDims,
+                  mDilationDims,
+                  mPaddingDims,
+                  mPaddingDims);
+            }
+            // Primitive descriptor
+            auto primDesc =
+                std::make_shared<convolution_forward::primitive_desc>(
+                    *fwdDescriptor, dnnlEngine);
+            return ConvForward{primDesc, convolution_forward(*primDesc)};
+          });
+  auto fwdPrimDesc = fwdPrimitives->primDesc;
 
   // Create memory
-  const detail::DnnlMemoryWrapper inputMemInit(
-      input.array(), {mInputDims}, formatNCHW);
   const detail::DnnlMemoryWrapper outputMemInit(
       output, {mOutputDims}, formatNCHW);
-  const detail::DnnlMemoryWrapper weightsMem(
-      weights.array(), {mWeightDims}, formatWeight);
 
   // Network for execution
   std::vector<primitive> network;
@@ -200,28 +260,42 @@ Variable conv2d(
   auto inputDesc = fwdPrimDesc->src_desc();
   auto weightsDesc = fwdPrimDesc->weights_desc();
   auto outputDesc = fwdPrimDesc->dst_desc();
-  // Input
-  auto inputMemory = detail::dnnlAlignOrdering(
-      network, fwdArgs, inputMemInit.getMemory(), inputDesc);
-  auto weightsMemory = detail::dnnlAlignOrdering(
-      network, fwdArgs, weightsMem.getMemory(), weightsDesc);
+  // Input - the output of a previous primitive may already be in the layout
+  // of the convolution
+  bool inference = forwardMode == prop_kind::forward_inference;
+  auto inputMemory =
+      inference ? detail::dnnlFindLayout(input.array()) : dnnl::memory();
+  detail::DnnlMemoryWrapper inputMemInit;
+  if (!inputMemory || inputMemory.get_desc() != inputDesc) {
+    inputMemInit =
+        detail::DnnlMemoryWrapper(input.array(), {mInputDims}, formatNCHW);
+    inputMemory = detail::dnnlAlignOrdering(
+        network, fwdArgs, inputMemInit.getMemory(), inputDesc);
+  }
+  // Weights
+  dnnl::memory weightsMemory;
+  detail::DnnlMemoryWrapper weightsMem;
+  if (inference && weightMD != weightsDesc) {
+    // Constant weights are kept in the layout of the convolution across calls
+    weightsMemory = detail::dnnlReorderedConstant(
+        weights.array(), {mWeightDims}, formatWeight, weightsDesc);
+  } else {
+    weightsMem = detail::DnnlMemoryWrapper(
+        weights.array(), {mWeightDims}, formatWeight);
+    weightsMemory = detail::dnnlAlignOrdering(
+        network, fwdArgs, weightsMem.getMemory(), weightsDesc);
+  }
   // Output - adds a reorder after the conv if needed
   auto outputMemory = outputMemInit.getMemory();
   if (outputMemInit.getMemory().get_desc() != outputDesc) {
     outputMemory = memory(outputDesc, dnnlEngine);
   }
 
-  // Create convolution
-  std::shared_ptr<convolution_forward> conv;
+  // Convolution
   auto formatBias = memory::format_tag::x;
   const detail::DnnlMemoryWrapper biasMemory(
       bias.array(), mBiasDims, formatBias);
-  if (hasBias) {
-    conv = std::make_shared<convolution_forward>(*fwdPrimDesc);
-  } else {
-    conv = std::make_shared<convolution_forward>(*fwdPrimDesc);
-  }
-  network.push_back(*conv);
+  network.push_back(fwdPrimitives->primitive);
 
   // Conv fwd args
   std::unordered_map<int, dnnl::memory> convFwdArgs = {
@@ -235,7 +309,8 @@ Variable conv2d(
 
   // Add output reordering if needed
   if (outputMemory != outputMemInit.getMemory()) {
-    network.push_back(dnnl::reorder(outputMemory, outputMemInit.getMemory()));
+    network.push_back(
+        detail::dnnlReorder(outputMemory, outputMemInit.getMemory()));
     fwdArgs.push_back(
         {{DNNL_ARG_FROM, outputMemory},
          {DNNL_ARG_TO, outputMemInit.getMemory()}});
@@ -243,6 +318,9 @@ Variable conv2d(
 
   // Run
   detail::executeNetwork(network, fwdArgs);
+  if (inference && outputMemory != outputMemInit.getMemory()) {
+    detail::dnnlRecordLayout(output, outputMemory);
+  }
 
   /***************************** Backward ******************************/
   auto gradFunc = [hasBias,
@@ -263,6 +341,7 @@ Variable conv2d(
                    outputMD,
                    weightMD,
                    biasMD,
+                   cacheKey,
                    fwdPrimDesc // used for creating a bw desc
   ](std::vector<Variable>& inputs, const Variable& grad_output) {
     auto& inputRef = inputs[0];
@@ -276,20 +355,26 @@ Variable conv2d(
       auto gradInput =
           Variable(af::array(inputRef.dims(), inputRef.type()), false);
 
-      // Backward descriptor
-      auto bwdDataDesc = std::make_shared<convolution_backward_data::desc>(
-          algorithm::convolution_direct,
-          inputMD,
-          weightMD,
-          outputMD,
-          mStrideDims,
-          mDilationDims,
-          mPaddingDims,
-          mPaddingDims);
-      // Primitive descriptor
-      auto bwdDataPrimDesc =
-          std::make_shared<convolution_backward_data::primitive_desc>(
-              *bwdDataDesc, dnnlEngineBwd, *fwdPrimDesc);
+      auto bwdDataPrimitives =
+          detail::DnnlPrimitiveCache::getInstance().get<ConvBackwardData>(
+              cacheKey, [&]() {
+                // Backward descriptor
+                auto bwdDataDesc = convolution_backward_data::desc(
+                    algorithm::convolution_direct,
+                    inputMD,
+                    weightMD,
+                    outputMD,
+                    mStrideDims,
+                    mDilationDims,
+                    mPaddingDims,
+                    mPaddingDims);
+                // Primitive descriptor
+                auto primDesc = convolution_backward_data::primitive_desc(
+                    bwdDataDesc, dnnlEngineBwd, *fwdPrimDesc);
+                return ConvBackwardData{
+                    primDesc, convolution_backward_data(primDesc)};
+              });
+      auto& bwdDataPrimDesc = bwdDataPrimitives->primDesc;
 
       // Create memory
       const detail::DnnlMemoryWrapper gradOutputMemInit(
@@ -303,9 +388,9 @@ Variable conv2d(
       std::vector<std::unordered_map<int, dnnl::memory>> bwdDataArgs;
 
       // Check for reorderings
-      auto gradOutputDesc = bwdDataPrimDesc->diff_dst_desc();
-      auto weightsDesc = bwdDataPrimDesc->weights_desc();
-      auto gradInputDesc = bwdDataPrimDesc->diff_src_desc();
+      auto gradOutputDesc = bwdDataPrimDesc.diff_dst_desc();
+      auto weightsDesc = bwdDataPrimDesc.weights_desc();
+      auto gradInputDesc = bwdDataPrimDesc.diff_src_desc();
       auto gradOutputMemory = detail::dnnlAlignOrdering(
           networkBackwards,
           bwdDataArgs,
@@ -323,19 +408,16 @@ Variable conv2d(
       }
 
       // Convolution backwards
-      auto convBwdData =
-          std::make_shared<convolution_backward_data>(*bwdDataPrimDesc);
-
       bwdDataArgs.push_back(
           {{DNNL_ARG_DIFF_SRC, gradInputMemory},
            {DNNL_ARG_WEIGHTS, weightsMemoryBackwards},
            {DNNL_ARG_DIFF_DST, gradOutputMemory}});
-      networkBackwards.push_back(*convBwdData);
+      networkBackwards.push_back(bwdDataPrimitives->primitive);
 
       // Reorder the output (which is gradInput here) if necessary
       if (gradInputMemory != gradInputMemInit.getMemory()) {
-        networkBackwards.push_back(
-            dnnl::reorder(gradInputMemory, gradInputMemInit.getMemory()));
+        networkBackwards.push_back(detail::dnnlReorder(
+            gradInputMemory, gradInputMemInit.getMemory()));
         bwdDataArgs.push_back(
             {{DNNL_ARG_FROM, gradInputMemory},
              {DNNL_ARG_TO, gradInputMemInit.getMemory()}});
@@ -358,34 +440,43 @@ Variable conv2d(
         gradBias = Variable(af::array(biasRef.dims(), biasRef.type()), false);
       }
 
-      // Weight backward descriptor
-      std::shared_ptr<convolution_backward_weights::desc> bwdWeightDesc;
-      if (hasBias) {
-        bwdWeightDesc = std::make_shared<convolution_backward_weights::desc>(
-            algorithm::convolution_direct,
-            inputMD,
-            weightMD,
-            biasMD,
-            outputMD,
-            mStrideDims,
-            mDilationDims,
-            mPaddingDims,
-            mPaddingDims);
-      } else {
-        bwdWeightDesc = std::make_shared<convolution_backward_weights::desc>(
-            algorithm::convolution_direct,
-            inputMD,
-            weightMD,
-            outputMD,
-            mStrideDims,
-            mDilationDims,
-            mPaddingDims,
-            mPaddingDims);
-      }
-      // Weight backward primitive descriptor
-      auto bwdWeightPrimDesc =
-          std::make_shared<convolution_backward_weights::primitive_desc>(
-              *bwdWeightDesc, dnnlEngineBwd, *fwdPrimDesc);
+      auto bwdWeightsPrimitives =
+          detail::DnnlPrimitiveCache::getInstance().get<ConvBackwardWeights>(
+              cacheKey, [&]() {
+                // Weight backward descriptor
+                std::shared_ptr<convolution_backward_weights::desc>
+                    bwdWeightDesc;
+                if (hasBias) {
+                  bwdWeightDesc =
+                      std::make_shared<convolution_backward_weights::desc>(
+                          algorithm::convolution_direct,
+                          inputMD,
+                          weightMD,
+                          biasMD,
+                          outputMD,
+                          mStrideDims,
+                          mDilationDims,
+                          mPaddingDims,
+                          mPaddingDims);
+                } else {
+                  bwdWeightDesc =
+                      std::make_shared<convolution_backward_weights::desc>(
+                          algorithm::convolution_direct,
+                          inputMD,
+                          weightMD,
+                          outputMD,
+                          mStrideDims,
+                          mDilationDims,
+                          mPaddingDims,
+                          mPaddingDims);
+                }
+                // Weight backward primitive descriptor
+                auto primDesc = convolution_backward_weights::primitive_desc(
+                    *bwdWeightDesc, dnnlEngineBwd, *fwdPrimDesc);
+                return ConvBackwardWeights{
+                    primDesc, convolution_backward_weights(primDesc)};
+              });
+      auto& bwdWeightPrimDesc = bwdWeightsPrimitives->primDesc;
 
       // Create memory
       const detail::DnnlMemoryWrapper inputRawMemInitBwd(
@@ -399,9 +490,9 @@ Variable conv2d(
       std::vector<std::unordered_map<int, dnnl::memory>> bwdWeightsArgs;
 
       // Check for reorderings, reorder if needed
-      auto inputDesc = bwdWeightPrimDesc->src_desc();
-      auto gradOutputDesc = bwdWeightPrimDesc->diff_dst_desc();
-      auto gradWeightsDesc = bwdWeightPrimDesc->diff_weights_desc();
+      auto inputDesc = bwdWeightPrimDesc.src_desc();
+      auto gradOutputDesc = bwdWeightPrimDesc.diff_dst_desc();
+      auto gradWeightsDesc = bwdWeightPrimDesc.diff_weights_desc();
       auto inputMemoryBackwards = detail::dnnlAlignOrdering(
           networkBackwards,
           bwdWeightsArgs,
@@ -418,8 +509,7 @@ Variable conv2d(
         gradWeightsMemory = memory(gradWeightsDesc, dnnlEngineBwd);
       }
 
-      // Create the convolution backward weight
-      std::shared_ptr<convolution_backward_weights> bwdWeights;
+      // Convolution backward weight
       std::unordered_map<int, dnnl::memory> bwdConvWeightsArgs = {
           {DNNL_ARG_SRC, inputMemoryBackwards},
           {DNNL_ARG_DIFF_WEIGHTS, gradWeightsMemory},
@@ -429,20 +519,15 @@ Variable conv2d(
       const detail::DnnlMemoryWrapper gradBiasMem(
           gradBias.array(), mBiasDims, formatBias);
       if (hasBias) {
-        bwdWeights =
-            std::make_shared<convolution_backward_weights>(*bwdWeightPrimDesc);
         bwdConvWeightsArgs[DNNL_ARG_DIFF_BIAS] = gradBiasMem.getMemory();
-      } else {
-        bwdWeights =
-            std::make_shared<convolution_backward_weights>(*bwdWeightPrimDesc);
       }
-      networkBackwards.push_back(*bwdWeights);
+      networkBackwards.push_back(bwdWeightsPrimitives->primitive);
       bwdWeightsArgs.push_back(bwdConvWeightsArgs);
 
       // Reorder weight gradients if necessary
       if (gradWeightsMemory != gradWeightsMemInit.getMemory()) {
-        networkBackwards.push_back(
-            dnnl::reorder(gradWeightsMemory, gradWeightsMemInit.getMemory()));
+        networkBackwards.push_back(detail::dnnlReorder(
+            gradWeightsMemory, gradWeightsMemInit.getMemory()));
         bwdWeightsArgs.push_back(
             {{DNNL_ARG_FROM, gradWeightsMemory},
              {DNNL_ARG_TO, gradWeightsMemInit.getMemory()}});
@@ -458,6 +543,10 @@ Variable conv2d(
     }
   };
 
+  // Each output element is a dot product over a filter
+  detail::FlopCounter::add(
+      2.0 * output.elements() * weights.elements() / weights.dims(3));
+
   // Return for forward
   if (hasBias) {
     return Variable(output, {input, weights, bias}, gradFunc);
@@ -12,6 +12,8 @@
 #include <dnnl_ocl.hpp>
 #endif
 
+#include <af/internal.h>
+
 #include "flashlight/fl/autograd/backend/cpu/DnnlUtils.h"
 #include "flashlight/fl/common/Defines.h"
 
@@ -69,10 +71,44 @@ dnnl::memory::dims convertAfDim4ToDnnlDims(const af::dim4& afDims) {
   return convertAfToDnnlDims(dimVec);
 }
 
+namespace {
+
+// Number of outputs recorded by dnnlRecordLayout
+constexpr size_t kLayoutCapacity = 8;
+
+// The contents of an array, in another layout
+struct ArrayMemory {
+  af::array source; // keeps the buffer shared, hence constant
+  dnnl::memory memory;
+};
+
+// The raw pointer identifies the buffer without copying it, unlike
+// af::array::device() for shared buffers
+DnnlCacheKey arrayKey(const af::array& array) {
+  auto key =
+      DnnlCacheKey().add(af::getRawPtr(array)).add(af::getOffset(array));
+  for (int i = 0; i < 4; ++i) {
+    key.add(array.dims(i));
+  }
+  return key;
+}
+
+DnnlPrimitiveCache& layoutCache() {
+  static DnnlPrimitiveCache cache(kLayoutCapacity);
+  return cache;
+}
+
+} // namespace
+
 DnnlMemoryWrapper::DnnlMemoryWrapper(
     const af::array& array,
     dnnl::memory::dims dims,
-    dnnl::memory::format_tag format) {
+    dnnl::memory::format_tag format,
+    dnnl::memory::data_type dataType /* = undef */) {
+  if (!array.isempty() && af::isLinear(array)) {
+    // Unshares the buffer, which would be copied by af::array::device()
+    layoutCache().erase<ArrayMemory>(arrayKey(array));
+  }
 #if FL_BACKEND_OPENCL
   fl::ocl::DevicePtrOpenCl _devicePtr(array);
   cl_mem* buffer = _devicePtr.getAsClMem();
@@ -81,8 +117,10 @@ DnnlMemoryWrapper::DnnlMemoryWrapper(
   devicePtr_ = fl::DevicePtr(array);
   void* buffer = devicePtr_.get();
 #endif
-  descriptor_ =
-      dnnl::memory::desc({dims}, detail::dnnlMapToType(array.type()), format);
+  if (dataType == dnnl::memory::data_type::undef) {
+    dataType = detail::dnnlMapToType(array.type());
+  }
+  descriptor_ = dnnl::memory::desc({dims}, dataType, format);
   memory_ = dnnl::memory(
       descriptor_, detail::DnnlEngine::getInstance().getEngine(), buffer);
 }
@@ -112,7 +150,7 @@ dnnl::memory dnnlAlignOrdering(
     // use the ordering requested by the descriptor
     memoryOut =
         dnnl::memory(desc, detail::DnnlEngine::getInstance().getEngine());
-    net.push_back(dnnl::reorder(memory, memoryOut));
+    net.push_back(dnnlReorder(memory, memoryOut));
     netArgs.push_back({{DNNL_ARG_FROM, memory}, {DNNL_ARG_TO, memoryOut}});
   }
   return memoryOut;
@@ -141,6 +179,127 @@ void executeNetwork(
   }
 }
 
+DnnlCacheKey& DnnlCacheKey::add(const dnnl::memory::dims& dims) {
+  add(dims.size());
+  key_.append(
+      reinterpret_cast<const char*>(dims.data()),
+      dims.size() * sizeof(dnnl::memory::dim));
+  return *this;
+}
+
+DnnlCacheKey& DnnlCacheKey::add(const dnnl::memory::desc& desc) {
+  return add(desc.data);
+}
+
+const std::string& DnnlCacheKey::str() const {
+  return key_;
+}
+
+constexpr size_t DnnlPrimitiveCache::kCapacity;
+
+DnnlPrimitiveCache::DnnlPrimitiveCache(
+    size_t capacity /* = kCapacity */)
+    : capacity_(capacity) {}
+
+size_t DnnlPrimitiveCache::size() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.size();
+}
+
+void DnnlPrimitiveCache::insertImpl(
+    std::string key,
+    std::shared_ptr<void> value) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    entries_.erase(it->second);
+    index_.erase(it);
+  }
+  entries_.emplace_front(key, std::move(value));
+  index_[std::move(key)] = entries_.begin();
+  if (entries_.size() > capacity_) {
+    index_.erase(entries_.back().first);
+    entries_.pop_back();
+  }
+}
+
+void DnnlPrimitiveCache::eraseImpl(const std::string& key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    entries_.erase(it->second);
+    index_.erase(it);
+  }
+}
+
+void DnnlPrimitiveCache::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  index_.clear();
+  entries_.clear();
+}
+
+DnnlPrimitiveCache& DnnlPrimitiveCache::getInstance() {
+  static DnnlPrimitiveCache instance;
+  return instance;
+}
+
+dnnl::reorder dnnlReorder(const dnnl::memory& from, const dnnl::memory& to) {
+  auto key = DnnlCacheKey().add(from.get_desc()).add(to.get_desc());
+  return *DnnlPrimitiveCache::getInstance().get<dnnl::reorder>(
+      key, [&from, &to]() { return dnnl::reorder(from, to); });
+}
+
+dnnl::memory dnnlReorderedConstant(
+    const af::array& array,
+    const dnnl::memory::dims& dims,
+    dnnl::memory::format_tag format,
+    const dnnl::memory::desc& desc,
+    dnnl::memory::data_type dataType /* = undef */) {
+  auto makeKey = [&]() {
+    return arrayKey(array).add(dims).add(format).add(desc).add(dataType);
+  };
+  auto& cache = DnnlPrimitiveCache::getInstance();
+  bool cacheable = af::isLinear(array);
+  if (cacheable) {
+    if (auto cached = cache.find<ArrayMemory>(makeKey())) {
+      return cached->memory;
+    }
+  }
+
+  auto result = std::make_shared<ArrayMemory>();
+  {
+    const DnnlMemoryWrapper from(array, dims, format, dataType);
+    result->memory = dnnl::memory(desc, DnnlEngine::getInstance().getEngine());
+    std::vector<dnnl::primitive> net = {
+        dnnlReorder(from.getMemory(), result->memory)};
+    std::vector<std::unordered_map<int, dnnl::memory>> args = {
+        {{DNNL_ARG_FROM, from.getMemory()}, {DNNL_ARG_TO, result->memory}}};
+    executeNetwork(net, args);
+  }
+  if (cacheable) {
+    // Keyed after the reorder, which may have moved the array to a new buffer
+    result->source = array;
+    cache.insert(makeKey(), result);
+  }
+  return result->memory;
+}
+
+void dnnlRecordLayout(const af::array& array, const dnnl::memory& memory) {
+  if (!array.isempty() && af::isLinear(array)) {
+    layoutCache().insert(
+        arrayKey(array),
+        std::make_shared<ArrayMemory>(ArrayMemory{array, memory}));
+  }
+}
+
+dnnl::memory dnnlFindLayout(const af::array& array) {
+  if (array.isempty() || !af::isLinear(array)) {
+    return dnnl::memory();
+  }
+  auto recorded = layoutCache().find<ArrayMemory>(arrayKey(array));
+  return recorded ? recorded->memory : dnnl::memory();
+}
+
 dnnl::algorithm dnnlMapToPoolingMode(const PoolingMode mode) {
   switch (mode) {
     case PoolingMode::MAX:
@@ -8,6 +8,13 @@
 #pragma once
 
 #include <array>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <unordered_map>
 
 #include <arrayfire.h>
 #include <dnnl.hpp>
@@ -65,14 +72,17 @@ dnnl::memory::dims convertAfDim4ToDnnlDims(const af::dim4& afDims);
 
 /**
  * A light wrapper around dnnl::memory that manages underlying memory lifetime
- * in accordance with fl::DevicePtr.
+ * in accordance with fl::DevicePtr. The data type of the memory is the type
+ * of the array unless `dataType` is given, e.g. to view the bytes of a u8
+ * array as s8 values.
  */
 class DnnlMemoryWrapper {
  public:
   DnnlMemoryWrapper(
       const af::array& array,
       dnnl::memory::dims dims,
-      dnnl::memory::format_tag format);
+      dnnl::memory::format_tag format,
+      dnnl::memory::data_type dataType = dnnl::memory::data_type::undef);
   DnnlMemoryWrapper() = default;
 
   DnnlMemoryWrapper& operator=(DnnlMemoryWrapper&& other);
@@ -94,7 +104,8 @@ class DnnlMemoryWrapper {
  * needs to be ordered based on the primitive descriptor's required ordering.
  *
  * If so, adds a ``dnnl::reorder`` layer to the network, and returns a new
- * memory descriptor that will be properly reordered.
+ * memory descriptor that will be properly reordered. Reorder primitives are
+ * taken from `DnnlPrimitiveCache`.
  */
 dnnl::memory dnnlAlignOrdering(
     std::vector<dnnl::primitive>& net,
@@ -116,6 +127,159 @@ void executeNetwork(
     std::vector<dnnl::primitive>& net,
     std::vector<std::unordered_map<int, dnnl::memory>>& args);
 
+/**
+ * Builds keys for `DnnlPrimitiveCache` from the values on which primitives
+ * depend: memory descriptors and dimensions, propagation kinds, algorithms and
+ * other trivially copyable parameters.
+ */
+class DnnlCacheKey {
+ public:
+  template <typename T>
+  DnnlCacheKey& add(const T& value) {
+    static_assert(
+        std::is_trivially_copyable<T>::value,
+        "DnnlCacheKey: values must be trivially copyable");
+    key_.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    return *this;
+  }
+
+  DnnlCacheKey& add(const dnnl::memory::dims& dims);
+
+  DnnlCacheKey& add(const dnnl::memory::desc& desc);
+
+  const std::string& str() const;
+
+ private:
+  std::string key_;
+};
+
+/**
+ * A process-wide cache of DNNL primitive descriptors and primitives, whose
+ * creation can take as long as their execution for small inputs. Values are
+ * identified by their type and a `DnnlCacheKey`; the least recently used ones
+ * are evicted once the cache has `capacity` values.
+ *
+ * Primitives don't hold memory, so a cached primitive can be executed with any
+ * memory matching the descriptors it was created for.
+ */
+class DnnlPrimitiveCache {
+ public:
+  static constexpr size_t kCapacity = 1024;
+
+  explicit DnnlPrimitiveCache(size_t capacity = kCapacity);
+
+  /**
+   * Returns the value of type `T` cached for `key`, or null.
+   */
+  template <typename T>
+  std::shared_ptr<T> find(const DnnlCacheKey& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(fullKey<T>(key));
+    if (it == index_.end()) {
+      return nullptr;
+    }
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return std::static_pointer_cast<T>(it->second->second);
+  }
+
+  /**
+   * Caches `value` for `key`, replacing any previous value.
+   */
+  template <typename T>
+  void insert(const DnnlCacheKey& key, std::shared_ptr<T> value) {
+    insertImpl(fullKey<T>(key), std::move(value));
+  }
+
+  /**
+   * Removes the value of type `T` cached for `key`, if any.
+   */
+  template <typename T>
+  void erase(const DnnlCacheKey& key) {
+    eraseImpl(fullKey<T>(key));
+  }
+
+  /**
+   * Returns the value of type `T` cached for `key`, calling `create()` to make
+   * it on cache misses.
+   */
+  template <typename T, typename F>
+  std::shared_ptr<T> get(const DnnlCacheKey& key, F create) {
+    auto value = find<T>(key);
+    if (!value) {
+      // Created without the lock: concurrent misses create the same value
+      value = std::make_shared<T>(create());
+      insert(key, value);
+    }
+    return value;
+  }
+
+  size_t size();
+
+  void clear();
+
+  static DnnlPrimitiveCache& getInstance();
+
+ private:
+  using Entry = std::pair<std::string, std::shared_ptr<void>>;
+
+  template <typename T>
+  static std::string fullKey(const DnnlCacheKey& key) {
+    return std::string(typeid(T).name()) + '\0' + key.str();
+  }
+
+  void insertImpl(std::string key, std::shared_ptr<void> value);
+
+  void eraseImpl(const std::string& key);
+
+  const size_t capacity_;
+  std::mutex mutex_;
+  std::list<Entry> entries_;
+  std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+};
+
+/**
+ * Returns a reorder primitive from the descriptor of `from` to the descriptor
+ * of `to`, from `DnnlPrimitiveCache`.
+ */
+dnnl::reorder dnnlReorder(const dnnl::memory& from, const dnnl::memory& to);
+
+/**
+ * Returns memory holding `array`, of the given dims and format, reordered to
+ * `desc`, e.g. the blocked layout preferred by a primitive for weights.
+ * `dataType` is as for `DnnlMemoryWrapper`.
+ *
+ * The reordered memory is cached with a reference to the buffer of `array`:
+ * since ArrayFire copies buffers on write when they are shared, the buffer is
+ * constant as long as it is cached, and later calls with the same array reuse
+ * the reordered memory without accessing the array. Meant for constant
+ * parameters in inference; other arrays should use `dnnlAlignOrdering`.
+ */
+dnnl::memory dnnlReorderedConstant(
+    const af::array& array,
+    const dnnl::memory::dims& dims,
+    dnnl::memory::format_tag format,
+    const dnnl::memory::desc& desc,
+    dnnl::memory::data_type dataType = dnnl::memory::data_type::undef);
+
+/**
+ * Records that `memory` holds the contents of `array`, the output of a DNNL
+ * primitive, in the (e.g. blocked) layout in which the primitive computed it.
+ * A DNNL primitive consuming `array` next can use `memory` directly, found
+ * with `dnnlFindLayout`, instead of reordering `array` again.
+ *
+ * As for `dnnlReorderedConstant`, the buffer of `array` is kept shared, hence
+ * constant, while recorded; only the last few outputs are recorded. Since
+ * ArrayFire copies shared buffers to get their device pointers, the record is
+ * dropped when a `DnnlMemoryWrapper` is made for `array`.
+ */
+void dnnlRecordLayout(const af::array& array, const dnnl::memory& memory);
+
+/**
+ * Returns the memory recorded for `array` by `dnnlRecordLayout`, or a null
+ * memory.
+ */
+dnnl::memory dnnlFindLayout(const af::array& array);
+
 /**
  * Given a flashlight pooling mode, returns the corresponding dnnl pooling
  * mode.
@@ -132,6 +296,10 @@ inline dnnl::memory::data_type dnnlMapToType(const af::dtype t) {
     return dnnl::memory::data_type::f16;
   } else if (t == af::dtype::f32) {
     return dnnl::memory::data_type::f32;
+  } else if (t == af::dtype::u8) {
+    return dnnl::memory::data_type::u8;
+  } else if (t == af::dtype::s32) {
+    return dnnl::memory::data_type::s32;
   } else if (t == af::dtype::f64) {
     throw std::invalid_argument("float64 is not supported by DNNL");
   } else {
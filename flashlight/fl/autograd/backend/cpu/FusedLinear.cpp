@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <unordered_map>
+#include <vector>
+
+#include <arrayfire.h>
+#include <dnnl.hpp>
+
+#include "flashlight/fl/autograd/Functions.h"
+#include "flashlight/fl/autograd/backend/cpu/DnnlUtils.h"
+
+using namespace dnnl;
+
+namespace fl {
+namespace detail {
+
+namespace {
+
+// Primitives cached in DnnlPrimitiveCache
+struct LinearForward {
+  inner_product_forward primitive;
+};
+
+struct LinearBackwardWeight {
+  inner_product_backward_weights primitive;
+};
+
+// Column-major [K, N] inputs, [M, K] weights and [M, N] outputs are
+// row-major NxK inputs, MxK weights in the io format and NxM outputs
+struct LinearDescs {
+  memory::dims inputDims, weightDims, biasDims, outputDims;
+  memory::desc input, weight, bias, output;
+
+  LinearDescs(dim_t k, dim_t n, dim_t m, bool hasBias) {
+    auto type = memory::data_type::f32;
+    inputDims = convertAfToDnnlDims({n, k});
+    weightDims = convertAfToDnnlDims({m, k});
+    biasDims = hasBias ? memory::dims{m} : memory::dims{};
+    outputDims = convertAfToDnnlDims({n, m});
+    this->input = memory::desc(inputDims, type, memory::format_tag::nc);
+    this->weight = memory::desc(weightDims, type, memory::format_tag::io);
+    if (hasBias) {
+      bias = memory::desc(biasDims, type, memory::format_tag::x);
+    }
+    output = memory::desc(outputDims, type, memory::format_tag::nc);
+  }
+
+  inner_product_forward::desc forwardDesc(prop_kind kind) const {
+    if (biasDims.empty()) {
+      return inner_product_forward::desc(kind, input, weight, output);
+    }
+    return inner_product_forward::desc(kind, input, weight, bias, output);
+  }
+};
+
+} // namespace
+
+bool fusedLinearSupported(af::dtype type) {
+  return type == af::dtype::f32;
+}
+
+void linearForward(
+    const af::array& input,
+    const af::array& weight,
+    const af::array& bias,
+    LinearActivation activation,
+    bool keepPreActivation,
+    af::array& out,
+    af::array& preActivation) {
+  bool hasBias = !bias.isempty();
+  LinearDescs descs(input.dims(0), input.dims(1), weight.dims(0), hasBias);
+  // The pre-activation of a GELU is the output of the product, activated
+  // with a JIT expression
+  bool postOp = activation != LinearActivation::NONE && !keepPreActivation;
+  auto cacheKey = DnnlCacheKey()
+                      .add(descs.inputDims)
+                      .add(descs.weightDims)
+                      .add(hasBias)
+                      .add(postOp ? activation : LinearActivation::NONE);
+  auto& dnnlEngine = DnnlEngine::getInstance().getEngine();
+  auto primitives = DnnlPrimitiveCache::getInstance().get<LinearForward>(
+      cacheKey, [&]() {
+        primitive_attr attr;
+        if (postOp) {
+          post_ops ops;
+          ops.append_eltwise(
+              1.0f,
+              activation == LinearActivation::RELU
+                  ? algorithm::eltwise_relu
+                  : algorithm::eltwise_gelu_tanh,
+              0.0f,
+              0.0f);
+          attr.set_post_ops(ops);
+        }
+        auto primDesc = inner_product_forward::primitive_desc(
+            descs.forwardDesc(prop_kind::forward_inference), attr, dnnlEngine);
+        return LinearForward{inner_product_forward(primDesc)};
+      });
+
+  out = af::array(weight.dims(0), input.dims(1));
+  std::vector<primitive> network;
+  std::vector<std::unordered_map<int, memory>> args;
+  const DnnlMemoryWrapper inputMem(
+      input, descs.inputDims, memory::format_tag::nc);
+  const DnnlMemoryWrapper weightMem(
+      weight, descs.weightDims, memory::format_tag::io);
+  const DnnlMemoryWrapper outputMem(
+      out, descs.outputDims, memory::format_tag::nc);
+  std::unordered_map<int, memory> forwardArgs = {
+      {DNNL_ARG_SRC, inputMem.getMemory()},
+      {DNNL_ARG_WEIGHTS, weightMem.getMemory()},
+      {DNNL_ARG_DST, outputMem.getMemory()}};
+  DnnlMemoryWrapper biasMem;
+  if (hasBias) {
+    biasMem = DnnlMemoryWrapper(bias, descs.biasDims, memory::format_tag::x);
+    forwardArgs.insert({DNNL_ARG_BIAS, biasMem.getMemory()});
+  }
+  network.push_back(primitives->primitive);
+  args.push_back(std::move(forwardArgs));
+  executeNetwork(network, args);
+
+  preActivation = af::array();
+  if (activation != LinearActivation::NONE && !postOp) {
+    preActivation = out;
+    out = activation == LinearActivation::RELU
+        ? af::max(preActivation, 0.0)
+        : 0.5 * preActivation *
+            (1.0 +
+             af::tanh(
+                 0.7978845608 *
+                 (preActivation +
+                  0.044715 * preActivation * preActivation * preActivation)));
+  }
+}
+
+void linearBackwardWeight(
+    const af::array& input,
+    const af::array& gradPreActivation,
+    bool computeGradBias,
+    af::array& gradWeight,
+    af::array& gradBias) {
+  dim_t m = gradPreActivation.dims(0);
+  LinearDescs descs(input.dims(0), input.dims(1), m, computeGradBias);
+  auto cacheKey = DnnlCacheKey()
+                      .add(descs.inputDims)
+                      .add(descs.weightDims)
+                      .add(computeGradBias);
+  auto& dnnlEngine = DnnlEngine::getInstance().getEngine();
+  auto primitives =
+      DnnlPrimitiveCache::getInstance().get<LinearBackwardWeight>(
+          cacheKey, [&]() {
+            auto forwardPrimDesc = inner_product_forward::primitive_desc(
+                descs.forwardDesc(prop_kind::forward_training), dnnlEngine);
+            auto desc = computeGradBias
+                ? inner_product_backward_weights::desc(
+                      descs.input, descs.weight, descs.bias, descs.output)
+                : inner_product_backward_weights::desc(
+                      descs.input, descs.weight, descs.output);
+            auto primDesc = inner_product_backward_weights::primitive_desc(
+                desc, dnnlEngine, forwardPrimDesc);
+            return LinearBackwardWeight{
+                inner_product_backward_weights(primDesc)};
+          });
+
+  gradWeight = af::array(m, input.dims(0));
+  std::vector<primitive> network;
+  std::vector<std::unordered_map<int, memory>> args;
+  const DnnlMemoryWrapper inputMem(
+      input, descs.inputDims, memory::format_tag::nc);
+  const DnnlMemoryWrapper gradOutputMem(
+      gradPreActivation, descs.outputDims, memory::format_tag::nc);
+  const DnnlMemoryWrapper gradWeightMem(
+      gradWeight, descs.weightDims, memory::format_tag::io);
+  std::unordered_map<int, memory> backwardArgs = {
+      {DNNL_ARG_SRC, inputMem.getMemory()},
+      {DNNL_ARG_DIFF_DST, gradOutputMem.getMemory()},
+      {DNNL_ARG_DIFF_WEIGHTS, gradWeightMem.getMemory()}};
+  DnnlMemoryWrapper gradBiasMem;
+  if (computeGradBias) {
+    gradBias = af::array(m);
+    gradBiasMem =
+        DnnlMemoryWrapper(gradBias, descs.biasDims, memory::format_tag::x);
+    backwardArgs.insert({DNNL_ARG_DIFF_BIAS, gradBiasMem.getMemory()});
+  }
+  network.push_back(primitives->primitive);
+  args.push_back(std::move(backwardArgs));
+  executeNetwork(network, args);
+}
+
+} // namespace detail
+} // namespace fl
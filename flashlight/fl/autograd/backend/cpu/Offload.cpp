@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <utility>
+
+#include "flashlight/fl/autograd/Offload.h"
+#include "flashlight/fl/common/Utils.h"
+
+namespace fl {
+namespace detail {
+
+// Copies are synchronous on this backend
+
+OffloadedArray::OffloadedArray(const af::array& arr)
+    : host_(arr.bytes()), dims_(arr.dims()), type_(arr.type()) {
+  arr.host(host_.get());
+}
+
+OffloadedArray::~OffloadedArray() = default;
+
+void OffloadedArray::prefetch() {
+  if (!device_.isempty()) {
+    return;
+  }
+  af_array device;
+  AF_CHECK(af_create_array(
+      &device, host_.get(), dims_.ndims(), dims_.get(), type_));
+  device_ = af::array(device);
+}
+
+af::array OffloadedArray::restore() {
+  prefetch();
+  return std::move(device_);
+}
+
+} // namespace detail
+} // namespace fl
@@ -25,6 +25,17 @@ constexpr size_t kHIdx = 1;
 constexpr size_t kChannelSizeIdx = 2;
 constexpr size_t kBatchSizeIdx = 3;
 
+// Primitives cached in detail::DnnlPrimitiveCache
+struct PoolForward {
+  pooling_forward::primitive_desc primDesc;
+  pooling_forward primitive;
+};
+
+struct PoolBackward {
+  pooling_backward::primitive_desc primDesc;
+  pooling_backward primitive;
+};
+
 } // namespace
 
 namespace fl {
@@ -37,7 +48,14 @@ Variable pool2d(
     int sy,
     int px,
     int py,
-    PoolingMode mode) {
+    PoolingMode mode,
+    ImageLayout layout) {
+  if (layout == ImageLayout::CWHN) {
+    // Computed in the default layout
+    auto output =
+        pool2d(reorder(input, 1, 2, 0, 3), wx, wy, sx, sy, px, py, mode);
+    return reorder(output, 2, 0, 1, 3);
+  }
   auto inputDimsRaw = input.dims();
   auto output = af::array(
       1 + (input.dims(kWIdx) + 2 * px - wx) / sx,
@@ -64,33 +82,57 @@ Variable pool2d(
   auto formatNCHW = memory::format_tag::nchw;
   auto formatAny = memory::format_tag::any;
 
+  // Choose a mode based on whether gradients are needed
+  auto forwardMode =
+      input.isCalcGrad() ? prop_kind::forward : prop_kind::forward_inference;
+  bool inference = forwardMode == prop_kind::forward_inference;
+
   // Memory desc
   auto inputMD = memory::desc({inputDims}, dataType, formatNCHW);
   auto outputMD = memory::desc({outputDims}, dataType, formatAny);
 
-  // Memory
+  // Memory - the output of a previous primitive can be pooled in its layout
   auto& dnnlEngine = detail::DnnlEngine::getInstance().getEngine();
-  const detail::DnnlMemoryWrapper inputMemInit(
-      input.array(), {inputDims}, formatNCHW);
+  auto inputLayoutMemory =
+      inference ? detail::dnnlFindLayout(input.array()) : memory();
+  detail::DnnlMemoryWrapper inputMemInit;
+  if (inputLayoutMemory && inputLayoutMemory.get_desc().dims() == inputDims) {
+    inputMD = inputLayoutMemory.get_desc();
+  } else {
+    inputLayoutMemory = memory();
+    inputMemInit =
+        detail::DnnlMemoryWrapper(input.array(), {inputDims}, formatNCHW);
+  }
   const detail::DnnlMemoryWrapper outputMemInit(
       output, {outputDims}, formatNCHW);
 
-  // Choose a mode based on whether gradients are needed
-  auto forwardMode =
-      input.isCalcGrad() ? prop_kind::forward : prop_kind::forward_inference;
-
-  // Descriptors
+  // Primitives
   auto poolingMode = detail::dnnlMapToPoolingMode(mode);
-  auto desc = pooling_forward::desc(
-      forwardMode,
-      poolingMode,
-      inputMD,
-      outputMD,
-      strideDims,
-      windowDims,
-      paddingDims,
-      paddingDims);
-  auto primDesc = pooling_forward::primitive_desc(desc, dnnlEngine);
+  auto cacheKey = detail::DnnlCacheKey()
+                      .add(forwardMode)
+                      .add(poolingMode)
+                      .add(dataType)
+                      .add(inputMD)
+                      .add(outputDims)
+                      .add(windowDims)
+                      .add(strideDims)
+                      .add(paddingDims);
+  auto fwdPrimitives =
+      detail::DnnlPrimitiveCache::getInstance().get<PoolForward>(
+          cacheKey, [&]() {
+            auto desc = pooling_forward::desc(
+                forwardMode,
+                poolingMode,
+                inputMD,
+                outputMD,
+                strideDims,
+                windowDims,
+                paddingDims,
+                paddingDims);
+            auto primDesc = pooling_forward::primitive_desc(desc, dnnlEngine);
+            return PoolForward{primDesc, pooling_forward(primDesc)};
+          });
+  auto& primDesc = fwdPrimitives->primDesc;
 
   // Network
   std::vector<primitive> network;
@@ -98,44 +140,47 @@ Variable pool2d(
   // Reorder if needed
   auto inputDesc = primDesc.src_desc();
   auto outputDesc = primDesc.dst_desc();
-  auto inputMemory = detail::dnnlAlignOrdering(
-      network, fwdArgs, inputMemInit.getMemory(), inputDesc);
+  auto inputMemory = inputLayoutMemory
+      ? inputLayoutMemory
+      : detail::dnnlAlignOrdering(
+            network, fwdArgs, inputMemInit.getMemory(), inputDesc);
   auto outputMemory = outputMemInit.getMemory();
   if (outputMemInit.getMemory().get_desc() != outputDesc) {
     outputMemory = memory(outputDesc, dnnlEngine);
   }
   // Workspace and layer (only training mode requires a workspace)
   std::shared_ptr<memory> workspaceMemory; // no default ctors
-  std::shared_ptr<pooling_forward> pooling;
   std::unordered_map<int, dnnl::memory> fwdPoolingArgs;
   fwdPoolingArgs[DNNL_ARG_SRC] = inputMemory;
   fwdPoolingArgs[DNNL_ARG_DST] = outputMemory;
   if (input.isCalcGrad()) {
     workspaceMemory =
         std::make_shared<memory>(primDesc.workspace_desc(), dnnlEngine);
-    pooling = std::make_shared<pooling_forward>(primDesc);
     fwdPoolingArgs[DNNL_ARG_WORKSPACE] = *workspaceMemory;
-  } else {
-    pooling = std::make_shared<pooling_forward>(primDesc);
   }
-  network.push_back(*pooling);
+  network.push_back(fwdPrimitives->primitive);
   fwdArgs.push_back(fwdPoolingArgs);
 
   // Add output reordering if needed
   if (outputMemory != outputMemInit.getMemory()) {
-    network.push_back(dnnl::reorder(outputMemory, outputMemInit.getMemory()));
+    network.push_back(
+        detail::dnnlReorder(outputMemory, outputMemInit.getMemory()));
     fwdArgs.push_back(
         {{DNNL_ARG_FROM, outputMemory},
          {DNNL_ARG_TO, outputMemInit.getMemory()}});
   }
 
   detail::executeNetwork(network, fwdArgs);
+  if (inference && outputMemory != outputMemInit.getMemory()) {
+    detail::dnnlRecordLayout(output, outputMemory);
+  }
 
   auto gradFunc =
       [dataType,
        formatNCHW,
        inputDimsRaw, // need to pass if inputs are empty
-       primDescFwd = std::move(primDesc), // forward desc
+       primDescFwd = primDesc, // forward desc
+       cacheKey,
        poolingMode,
        // needed for backwards pass. null in inference mode
        workspaceMemory,
@@ -169,17 +214,23 @@ Variable pool2d(
         // pooling_backward descriptors require an ordering
         auto gradInputMD = gradInputMemInit.getMemory().get_desc();
         auto gradOutputMD = gradOutputMemInit.getMemory().get_desc();
-        auto bwdDesc = pooling_backward::desc(
-            poolingMode,
-            gradInputMD,
-            gradOutputMD,
-            strideDims,
-            windowDims,
-            paddingDims,
-            paddingDims);
-        // Pass forward descriptor as a hint
-        auto bwdPrimDesc = pooling_backward::primitive_desc(
-            bwdDesc, dnnlEngineBwd, primDescFwd);
+        auto bwdPrimitives =
+            detail::DnnlPrimitiveCache::getInstance().get<PoolBackward>(
+                cacheKey, [&]() {
+                  auto bwdDesc = pooling_backward::desc(
+                      poolingMode,
+                      gradInputMD,
+                      gradOutputMD,
+                      strideDims,
+                      windowDims,
+                      paddingDims,
+                      paddingDims);
+                  // Pass forward descriptor as a hint
+                  auto bwdPrimDesc = pooling_backward::primitive_desc(
+                      bwdDesc, dnnlEngineBwd, primDescFwd);
+                  return PoolBackward{
+                      bwdPrimDesc, pooling_backward(bwdPrimDesc)};
+                });
 
         std::vector<primitive> networkBackward;
         std::vector<std::unordered_map<int, dnnl::memory>> bwdArgs;
@@ -190,13 +241,12 @@ Variable pool2d(
             gradOutputMemInit.getMemory(),
             outputMemory.get_desc());
 
-        auto poolBwd = pooling_backward(bwdPrimDesc);
         std::unordered_map<int, dnnl::memory> bwdPoolingArgs = {
             {DNNL_ARG_DIFF_SRC, gradInputMemInit.getMemory()},
             {DNNL_ARG_DIFF_DST, gradOutputMemory},
             {DNNL_ARG_WORKSPACE, *workspaceMemory}};
         bwdArgs.push_back(bwdPoolingArgs);
-        networkBackward.push_back(poolBwd);
+        networkBackward.push_back(bwdPrimitives->primitive);
 
         detail::executeNetwork(networkBackward, bwdArgs);
 
@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <arrayfire.h>
+#include <dnnl.hpp>
+
+#include "flashlight/fl/autograd/Functions.h"
+#include "flashlight/fl/autograd/backend/cpu/DnnlUtils.h"
+
+using namespace dnnl;
+
+namespace fl {
+namespace detail {
+
+namespace {
+
+// Primitives cached in DnnlPrimitiveCache
+struct Int8InnerProduct {
+  inner_product_forward::primitive_desc primDesc;
+  inner_product_forward primitive;
+};
+
+struct Int8ConvForward {
+  convolution_forward::primitive_desc primDesc;
+  convolution_forward primitive;
+};
+
+struct QuantizeReorder {
+  reorder primitive;
+};
+
+// Products are scaled per output channel (dimension 1 of the destination)
+// by scales given at execution
+primitive_attr outputScalesAttr() {
+  primitive_attr attr;
+  attr.set_output_scales(1 << 1, {DNNL_RUNTIME_F32_VAL});
+  return attr;
+}
+
+// Adds to the network the quantization of the f32 `input` into s8 memory of
+// descriptor `desc`: values are divided by `inputScale`, rounded and
+// saturated by the reorder
+memory quantizeInput(
+    std::vector<primitive>& net,
+    std::vector<std::unordered_map<int, memory>>& netArgs,
+    const memory& input,
+    const memory::desc& desc,
+    float inputScale) {
+  auto& dnnlEngine = DnnlEngine::getInstance().getEngine();
+  memory quantized(desc, dnnlEngine);
+  auto key = DnnlCacheKey().add(input.get_desc()).add(desc).add(inputScale);
+  auto quantize = DnnlPrimitiveCache::getInstance().get<QuantizeReorder>(
+      key, [&]() {
+        primitive_attr attr;
+        attr.set_output_scales(0, {1 / inputScale});
+        return QuantizeReorder{
+            reorder(reorder::primitive_desc(input, quantized, attr))};
+      });
+  net.push_back(quantize->primitive);
+  netArgs.push_back({{DNNL_ARG_FROM, input}, {DNNL_ARG_TO, quantized}});
+  return quantized;
+}
+
+} // namespace
+
+bool int8KernelsSupported() {
+  return true;
+}
+
+af::array int8Linear(
+    const af::array& input,
+    const af::array& weights,
+    const af::array& outputScales,
+    float inputScale) {
+  // Column-major [N, M] inputs and [K, N] weights are row-major MxN inputs
+  // and KxN weights in the io format
+  auto output = af::array(weights.dims(0), input.dims(1));
+  memory::dims mInputDims =
+      convertAfToDnnlDims({input.dims(1), input.dims(0)});
+  memory::dims mWeightDims =
+      convertAfToDnnlDims({weights.dims(0), weights.dims(1)});
+  memory::dims mOutputDims =
+      convertAfToDnnlDims({input.dims(1), weights.dims(0)});
+
+  auto formatAny = memory::format_tag::any;
+  auto inputMD = memory::desc(mInputDims, memory::data_type::s8, formatAny);
+  auto weightMD = memory::desc(mWeightDims, memory::data_type::s8, formatAny);
+  auto outputMD = memory::desc(
+      mOutputDims, memory::data_type::f32, memory::format_tag::nc);
+
+  auto cacheKey =
+      DnnlCacheKey().add(mInputDims).add(mWeightDims).add(mOutputDims);
+  auto& dnnlEngine = DnnlEngine::getInstance().getEngine();
+  auto primitives = DnnlPrimitiveCache::getInstance().get<Int8InnerProduct>(
+      cacheKey, [&]() {
+        auto desc = inner_product_forward::desc(
+            prop_kind::forward_inference, inputMD, weightMD, outputMD);
+        auto primDesc = inner_product_forward::primitive_desc(
+            desc, outputScalesAttr(), dnnlEngine);
+        return Int8InnerProduct{primDesc, inner_product_forward(primDesc)};
+      });
+
+  std::vector<primitive> network;
+  std::vector<std::unordered_map<int, memory>> args;
+  const DnnlMemoryWrapper inputMem(input, mInputDims, memory::format_tag::nc);
+  auto inputMemory = quantizeInput(
+      network,
+      args,
+      inputMem.getMemory(),
+      primitives->primDesc.src_desc(),
+      inputScale);
+  // Constant weights are kept in the layout of the primitive across calls
+  auto weightsMemory = dnnlReorderedConstant(
+      weights,
+      mWeightDims,
+      memory::format_tag::io,
+      primitives->primDesc.weights_desc(),
+      memory::data_type::s8);
+  const DnnlMemoryWrapper scalesMem(
+      outputScales, {weights.dims(0)}, memory::format_tag::x);
+  const DnnlMemoryWrapper outputMem(
+      output, mOutputDims, memory::format_tag::nc);
+
+  network.push_back(primitives->primitive);
+  args.push_back(
+      {{DNNL_ARG_SRC, inputMemory},
+       {DNNL_ARG_WEIGHTS, weightsMemory},
+       {DNNL_ARG_DST, outputMem.getMemory()},
+       {DNNL_ARG_ATTR_OUTPUT_SCALES, scalesMem.getMemory()}});
+  executeNetwork(network, args);
+  return output;
+}
+
+af::array int8Conv2d(
+    const af::array& input,
+    const af::array& weights,
+    const af::array& outputScales,
+    float inputScale,
+    int sx,
+    int sy,
+    int px,
+    int py,
+    int dx,
+    int dy,
+    int groups) {
+  // Input, output: WHCN (NCHW for DNNL); weights: WHIO (OIHW)
+  auto output = af::array(
+      1 + (input.dims(0) + 2 * px - (1 + (weights.dims(0) - 1) * dx)) / sx,
+      1 + (input.dims(1) + 2 * py - (1 + (weights.dims(1) - 1) * dy)) / sy,
+      weights.dims(3),
+      input.dims(3));
+  auto formatNCHW = memory::format_tag::nchw;
+  auto formatWeight =
+      groups == 1 ? memory::format_tag::oihw : memory::format_tag::goihw;
+  memory::dims mInputDims = convertAfToDnnlDims(
+      {input.dims(3), input.dims(2), input.dims(1), input.dims(0)});
+  memory::dims mWeightDims;
+  if (groups == 1) {
+    mWeightDims = convertAfToDnnlDims(
+        {weights.dims(3), input.dims(2), weights.dims(1), weights.dims(0)});
+  } else {
+    mWeightDims = convertAfToDnnlDims(
+        {groups,
+         weights.dims(3) / groups,
+         input.dims(2) / groups,
+         weights.dims(1),
+         weights.dims(0)});
+  }
+  memory::dims mOutputDims = convertAfToDnnlDims(
+      {input.dims(3), weights.dims(3), output.dims(1), output.dims(0)});
+  memory::dims mStrideDims = {sy, sx};
+  memory::dims mPaddingDims = {py, px};
+  // DNNL dilations start at 0, see conv2d
+  memory::dims mDilationDims = {dy - 1, dx - 1};
+
+  auto formatAny = memory::format_tag::any;
+  auto inputMD = memory::desc(mInputDims, memory::data_type::s8, formatAny);
+  auto weightMD = memory::desc(mWeightDims, memory::data_type::s8, formatAny);
+  auto outputMD = memory::desc(mOutputDims, memory::data_type::f32, formatAny);
+
+  auto cacheKey = DnnlCacheKey()
+                      .add(mInputDims)
+                      .add(mWeightDims)
+                      .add(mOutputDims)
+                      .add(mStrideDims)
+                      .add(mDilationDims)
+                      .add(mPaddingDims);
+  auto& dnnlEngine = DnnlEngine::getInstance().getEngine();
+  auto primitives = DnnlPrimitiveCache::getInstance().get<Int8ConvForward>(
+      cacheKey, [&]() {
+        auto desc = convolution_forward::desc(
+            prop_kind::forward_inference,
+            algorithm::convolution_direct,
+            inputMD,
+            weightMD,
+            outputMD,
+            mStrideDims,
+            mDilationDims,
+            mPaddingDims,
+            mPaddingDims);
+        auto primDesc = convolution_forward::primitive_desc(
+            desc, outputScalesAttr(), dnnlEngine);
+        return Int8ConvForward{primDesc, convolution_forward(primDesc)};
+      });
+
+  std::vector<primitive> network;
+  std::vector<std::unordered_map<int, memory>> args;
+  const DnnlMemoryWrapper inputMem(input, mInputDims, formatNCHW);
+  auto inputMemory = quantizeInput(
+      network,
+      args,
+      inputMem.getMemory(),
+      primitives->primDesc.src_desc(),
+      inputScale);
+  auto weightsMemory = dnnlReorderedConstant(
+      weights,
+      mWeightDims,
+      formatWeight,
+      primitives->primDesc.weights_desc(),
+      memory::data_type::s8);
+  const DnnlMemoryWrapper scalesMem(
+      outputScales, {weights.dims(3)}, memory::format_tag::x);
+  const DnnlMemoryWrapper outputMemInit(output, mOutputDims, formatNCHW);
+  auto outputMemory = outputMemInit.getMemory();
+  if (outputMemory.get_desc() != primitives->primDesc.dst_desc()) {
+    outputMemory = memory(primitives->primDesc.dst_desc(), dnnlEngine);
+  }
+
+  network.push_back(primitives->primitive);
+  args.push_back(
+      {{DNNL_ARG_SRC, inputMemory},
+       {DNNL_ARG_WEIGHTS, weightsMemory},
+       {DNNL_ARG_DST, outputMemory},
+       {DNNL_ARG_ATTR_OUTPUT_SCALES, scalesMem.getMemory()}});
+  if (outputMemory != outputMemInit.getMemory()) {
+    network.push_back(dnnlReorder(outputMemory, outputMemInit.getMemory()));
+    args.push_back(
+        {{DNNL_ARG_FROM, outputMemory},
+         {DNNL_ARG_TO, outputMemInit.getMemory()}});
+  }
+  executeNetwork(network, args);
+  return output;
+}
+
+} // namespace detail
+} // namespace fl
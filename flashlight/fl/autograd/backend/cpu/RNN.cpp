@@ -13,6 +13,7 @@
 #include <dnnl.hpp>
 
 #include "flashlight/fl/autograd/Functions.h"
+#include "flashlight/fl/autograd/GradMode.h"
 #include "flashlight/fl/autograd/Variable.h"
 #include "flashlight/fl/autograd/backend/cpu/DnnlUtils.h"
 
@@ -214,6 +215,12 @@ ParsedWeightsAndBias parseWeights(
   return out;
 }
 
+// Primitive cached in detail::DnnlPrimitiveCache
+struct RnnForward {
+  dnnl::primitive primitive;
+  dnnl::memory::desc workspaceDesc;
+};
+
 struct RnnResult {
   dnnl::memory workspace;
   af::array y; // output
@@ -319,35 +326,51 @@ RnnResult rnnImpl(
   std::vector<std::unordered_map<int, dnnl::memory>> fwdArgs;
 
   // reorder input weights
-  network.push_back(
-      dnnl::reorder(weightsInputMemRawInit.getMemory(), weightsInputMemInit));
+  network.push_back(detail::dnnlReorder(
+      weightsInputMemRawInit.getMemory(), weightsInputMemInit));
   fwdArgs.push_back(
       {{DNNL_ARG_FROM, weightsInputMemRawInit.getMemory()},
        {DNNL_ARG_TO, weightsInputMemInit}});
   // reorder iter weights
-  network.push_back(
-      dnnl::reorder(weightsHiddenMemRawInit.getMemory(), weightsHiddenMemInit));
+  network.push_back(detail::dnnlReorder(
+      weightsHiddenMemRawInit.getMemory(), weightsHiddenMemInit));
   fwdArgs.push_back(
       {{DNNL_ARG_FROM, weightsHiddenMemRawInit.getMemory()},
        {DNNL_ARG_TO, weightsHiddenMemInit}});
 
   // Initialize descriptors
+  auto cacheKey = detail::DnnlCacheKey()
+                      .add(kind)
+                      .add(mode)
+                      .add(activation)
+                      .add(direction)
+                      .add(dType)
+                      .add(hiddenState.isempty())
+                      .add(cellState.isempty())
+                      .add(inputDims)
+                      .add(hDims)
+                      .add(weightsInputDims)
+                      .add(weightsHiddenDims);
+  auto& cache = detail::DnnlPrimitiveCache::getInstance();
+  std::shared_ptr<RnnForward> rnnPrimitives;
   if (mode == RnnMode::RELU || mode == RnnMode::TANH) {
-    auto vanilla = dnnl::vanilla_rnn_forward::desc(
-        kind,
-        activation,
-        direction,
-        inputMemInit.getDescriptor(),
-        hiddenInMemInit.getDescriptor(),
-        weightsInputMemDesc, // weights "layer"
-        weightsHiddenMemDesc, // weights "iter"
-        biasMemInit.getDescriptor(),
-        outputMemInit.getDescriptor(),
-        hiddenOutMemInit.getDescriptor());
-    auto vanillaPd =
-        dnnl::vanilla_rnn_forward::primitive_desc(vanilla, dnnlEngine);
-    network.push_back(dnnl::vanilla_rnn_forward(vanillaPd));
-    workspace = dnnl::memory(vanillaPd.workspace_desc(), dnnlEngine);
+    rnnPrimitives = cache.get<RnnForward>(cacheKey, [&]() {
+      auto vanilla = dnnl::vanilla_rnn_forward::desc(
+          kind,
+          activation,
+          direction,
+          inputMemInit.getDescriptor(),
+          hiddenInMemInit.getDescriptor(),
+          weightsInputMemDesc, // weights "layer"
+          weightsHiddenMemDesc, // weights "iter"
+          biasMemInit.getDescriptor(),
+          outputMemInit.getDescriptor(),
+          hiddenOutMemInit.getDescriptor());
+      auto vanillaPd =
+          dnnl::vanilla_rnn_forward::primitive_desc(vanilla, dnnlEngine);
+      return RnnForward{
+          dnnl::vanilla_rnn_forward(vanillaPd), vanillaPd.workspace_desc()};
+    });
 
   } else if (mode == RnnMode::LSTM) {
     // LSTM-only
@@ -363,40 +386,44 @@ RnnResult rnnImpl(
     // output cell state
     detail::DnnlMemoryWrapper cellOutMemInit(cy, cDims, ldnc);
 
-    auto lstm = dnnl::lstm_forward::desc(
-        kind,
-        direction,
-        inputMemInit.getDescriptor(),
-        hiddenInMemInit.getDescriptor(),
-        cellInMemInit.getDescriptor(),
-        weightsInputMemDesc, // weights "layer"
-        weightsHiddenMemDesc, // weights "iter"
-        biasMemInit.getDescriptor(),
-        outputMemInit.getDescriptor(),
-        hiddenOutMemInit.getDescriptor(),
-        cellOutMemInit.getDescriptor());
-    auto lstmPd = dnnl::lstm_forward::primitive_desc(lstm, dnnlEngine);
-    network.push_back(dnnl::lstm_forward(lstmPd));
-    workspace = dnnl::memory(lstmPd.workspace_desc(), dnnlEngine);
+    rnnPrimitives = cache.get<RnnForward>(cacheKey, [&]() {
+      auto lstm = dnnl::lstm_forward::desc(
+          kind,
+          direction,
+          inputMemInit.getDescriptor(),
+          hiddenInMemInit.getDescriptor(),
+          cellInMemInit.getDescriptor(),
+          weightsInputMemDesc, // weights "layer"
+          weightsHiddenMemDesc, // weights "iter"
+          biasMemInit.getDescriptor(),
+          outputMemInit.getDescriptor(),
+          hiddenOutMemInit.getDescriptor(),
+          cellOutMemInit.getDescriptor());
+      auto lstmPd = dnnl::lstm_forward::primitive_desc(lstm, dnnlEngine);
+      return RnnForward{dnnl::lstm_forward(lstmPd), lstmPd.workspace_desc()};
+    });
     rnnFwdArgs.insert({DNNL_ARG_SRC_ITER_C, cellInMemInit.getMemory()});
     rnnFwdArgs.insert({DNNL_ARG_DST_ITER_C, cellOutMemInit.getMemory()});
 
   } else if (mode == RnnMode::GRU) {
-    // Use a linear-before-reset GRU so we can have parity with cuDNN
-    auto gru = dnnl::lbr_gru_forward::desc(
-        kind,
-        direction,
-        inputMemInit.getDescriptor(),
-        hiddenInMemInit.getDescriptor(),
-        weightsInputMemDesc,
-        weightsHiddenMemDesc,
-        biasMemInit.getDescriptor(),
-        outputMemInit.getDescriptor(),
-        hiddenOutMemInit.getDescriptor());
-    auto gruPd = dnnl::lbr_gru_forward::primitive_desc(gru, dnnlEngine);
-    network.push_back(dnnl::lbr_gru_forward(gruPd));
-    workspace = dnnl::memory(gruPd.workspace_desc(), dnnlEngine);
+    rnnPrimitives = cache.get<RnnForward>(cacheKey, [&]() {
+      // Use a linear-before-reset GRU so we can have parity with cuDNN
+      auto gru = dnnl::lbr_gru_forward::desc(
+          kind,
+          direction,
+          inputMemInit.getDescriptor(),
+          hiddenInMemInit.getDescriptor(),
+          weightsInputMemDesc,
+          weightsHiddenMemDesc,
+          biasMemInit.getDescriptor(),
+          outputMemInit.getDescriptor(),
+          hiddenOutMemInit.getDescriptor());
+      auto gruPd = dnnl::lbr_gru_forward::primitive_desc(gru, dnnlEngine);
+      return RnnForward{dnnl::lbr_gru_forward(gruPd), gruPd.workspace_desc()};
+    });
   }
+  network.push_back(rnnPrimitives->primitive);
+  workspace = dnnl::memory(rnnPrimitives->workspaceDesc, dnnlEngine);
   rnnFwdArgs.insert({DNNL_ARG_WORKSPACE, workspace});
   fwdArgs.push_back(rnnFwdArgs);
 
@@ -433,7 +460,8 @@ std::tuple<Variable, Variable, Variable> rnn(
       ? dnnl::rnn_direction::bidirectional_concat
       : dnnl::rnn_direction::unidirectional_left2right;
   int directionMult = bidirectional ? 2 : 1;
-  auto kind = (inputV.isCalcGrad() || weightsV.isCalcGrad())
+  auto kind = (isGradEnabled() &&
+               (inputV.isCalcGrad() || weightsV.isCalcGrad()))
       ? dnnl::prop_kind::forward_training
       : dnnl::prop_kind::forward_inference;
   int numGates = 1;
@@ -551,4 +579,29 @@ std::tuple<Variable, Variable, Variable> rnn(
       Variable(result.cy, {}, gradFuncUnsupported));
 }
 
+namespace detail {
+
+// DNNL RNN primitives process whole sequences: rnn() runs the samples of
+// each length separately
+bool variableLengthRnnSupported() {
+  return false;
+}
+
+std::tuple<Variable, Variable, Variable> variableLengthRnn(
+    const Variable& /* input */,
+    const Variable& /* hiddenState */,
+    const Variable& /* cellState */,
+    const Variable& /* weights */,
+    int /* hiddenSize */,
+    int /* numLayers */,
+    RnnMode /* mode */,
+    bool /* bidirectional */,
+    float /* dropout */,
+    const std::vector<int>& /* sequenceLengths */) {
+  throw std::logic_error(
+      "variableLengthRnn: variable lengths are not supported by the kernels");
+}
+
+} // namespace detail
+
 } // namespace fl
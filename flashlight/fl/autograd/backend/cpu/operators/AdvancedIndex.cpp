@@ -7,12 +7,53 @@
 
 #include <af/array.h>
 
+#include <algorithm>
+#include <future>
+#include <numeric>
 #include <stdexcept>
+#include <thread>
 #include <vector>
 
+#include "flashlight/fl/autograd/Variable.h"
+#include "flashlight/fl/common/Init.h"
+
 namespace fl {
 
-class Variable;
+namespace {
+
+// Minimum number of elements per worker
+constexpr dim_t kMinElementsPerWorker = 1 << 14;
+
+std::vector<int64_t> indexToHost(const af::array& idx) {
+  std::vector<int64_t> host(idx.elements());
+  if (!host.empty()) {
+    idx.as(af::dtype::s64).host(host.data());
+  }
+  return host;
+}
+
+// Runs fn(begin, end) on ranges splitting [0, size) across workers, as many
+// as the threads of the computation in the thread budget or the cores
+template <typename Fn>
+void parallelFor(dim_t size, const Fn& fn) {
+  dim_t maxWorkers = fl::getThreadBudget().computeThreads;
+  if (maxWorkers <= 0) {
+    maxWorkers = std::max(1u, std::thread::hardware_concurrency());
+  }
+  dim_t numWorkers = std::min<dim_t>(
+      maxWorkers, std::max<dim_t>(1, size / kMinElementsPerWorker));
+  std::vector<std::future<void>> workers;
+  for (dim_t w = 0; w < numWorkers; ++w) {
+    dim_t begin = size * w / numWorkers;
+    dim_t end = size * (w + 1) / numWorkers;
+    workers.push_back(std::async(std::launch::async, fn, begin, end));
+  }
+  for (auto& worker : workers) {
+    worker.get();
+  }
+}
+
+} // namespace
 
 void gradAdvancedIndex(
     const Variable& inp,
@@ -21,7 +62,96 @@ void gradAdvancedIndex(
     const af::dim4& outDims,
     const std::vector<af::array>& idxArr,
     Variable& out) {
-  throw std::runtime_error("gradAdvancedIndex not implemented for cpu");
+  auto inpType = inp.type();
+  auto outType = out.type();
+
+  if ((inpType != f32) && (inpType != f16)) {
+    throw std::invalid_argument("Input type must be f16/f32");
+  }
+  if ((outType != f32) && (outType != f16)) {
+    throw std::invalid_argument("Output type must be f16/f32");
+  }
+  if (idxArr.size() != 4) {
+    throw std::invalid_argument("Index array vector must be length 4");
+  }
+  std::vector<std::vector<int64_t>> indices(4);
+  for (int i = 0; i < 4; i++) {
+    if (idxArr[i].isempty()) {
+      continue;
+    }
+    auto type = idxArr[i].type();
+    if (type != s32 && type != s64 && type != u32 && type != u64) {
+      throw std::invalid_argument(
+          "Index type must be one of s32/s64/u32/u64, observed type is " +
+          std::to_string(type));
+    }
+    indices[i] = indexToHost(idxArr[i]);
+  }
+
+  // Strides of the input and output arrays; arrayfire dimensions are
+  // inverted compared to numpy
+  dim_t dims[4], strides[4], outStrides[4];
+  for (int i = 0; i < 4; i++) {
+    dims[i] = idxEnd[i] - idxStart[i];
+  }
+  strides[0] = 1;
+  outStrides[0] = 1;
+  for (int i = 1; i < 4; i++) {
+    strides[i] = strides[i - 1] * dims[i - 1];
+    outStrides[i] = outStrides[i - 1] * outDims[i - 1];
+  }
+  dim_t numElements = strides[3] * dims[3];
+
+  std::vector<float> grad(numElements);
+  if (numElements > 0) {
+    inp.array().as(f32).host(grad.data());
+  }
+  std::vector<float> result(out.elements());
+  if (!result.empty()) {
+    out.array().as(f32).host(result.data());
+  }
+
+  // Output index of each input element
+  std::vector<int64_t> keys(numElements);
+  parallelFor(numElements, [&](dim_t begin, dim_t end) {
+    for (dim_t e = begin; e < end; ++e) {
+      dim_t cursor = e;
+      int64_t outIdx = 0;
+      for (int i = 3; i >= 0; i--) {
+        dim_t index = cursor / strides[i];
+        cursor = cursor % strides[i];
+        outIdx += (indices[i].empty() ? idxStart[i] + index
+                                      : indices[i][index]) *
+            outStrides[i];
+      }
+      keys[e] = outIdx;
+    }
+  });
+
+  // Elements grouped by output, in input order: each output sums its
+  // elements sequentially, so that results don't depend on the number of
+  // workers, and workers write disjoint outputs
+  std::vector<dim_t> order(numElements);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&keys](dim_t a, dim_t b) {
+    return keys[a] < keys[b];
+  });
+  parallelFor(numElements, [&](dim_t begin, dim_t end) {
+    // Runs sharing an output belong to the worker where they start
+    auto startsRun = [&](dim_t pos) {
+      return pos == 0 || keys[order[pos]] != keys[order[pos - 1]];
+    };
+    while (begin < end && !startsRun(begin)) {
+      ++begin;
+    }
+    for (dim_t pos = begin; pos < numElements && (pos < end || !startsRun(pos));
+         ++pos) {
+      result[keys[order[pos]]] += grad[order[pos]];
+    }
+  });
+
+  auto resultArr = af::array(out.dims(), result.data());
+  out.array() = outType == f16 ? resultArr.as(f16) : resultArr;
 }
 
 } // namespace fl
@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <vector>
+
+#include <arrayfire.h>
+
+#include "flashlight/fl/autograd/Functions.h"
+
+namespace fl {
+namespace detail {
+
+namespace {
+
+std::vector<float> toHost(const af::array& arr) {
+  std::vector<float> host(arr.elements());
+  if (!host.empty()) {
+    arr.host(host.data());
+  }
+  return host;
+}
+
+// Sizes of a depthwise convolution: the input and the output are columns of
+// `length` and `outLength` frames, for `columns` positions of the second
+// dimension, `channels` input channels of `multiplier` output channels each,
+// and `batch` samples
+struct Conv1dSizes {
+  int length, outLength, kernelSize, columns, channels, multiplier, batch;
+
+  Conv1dSizes(const af::array& input, const af::array& weight, int outLength)
+      : length(input.dims(0)),
+        outLength(outLength),
+        kernelSize(weight.dims(0)),
+        columns(input.dims(1)),
+        channels(input.dims(2)),
+        multiplier(weight.dims(3) / input.dims(2)),
+        batch(input.dims(3)) {}
+
+  // Index of the first frame of an input column
+  size_t inputColumn(int col, int ch, int n) const {
+    return (static_cast<size_t>(n * channels + ch) * columns + col) * length;
+  }
+
+  // Index of the first frame of an output column
+  size_t outputColumn(int col, int outCh, int n) const {
+    size_t outChannels = channels * multiplier;
+    return ((n * outChannels + outCh) * columns + col) * outLength;
+  }
+};
+
+} // namespace
+
+void depthwiseConv1dForward(
+    const af::array& input,
+    const af::array& weight,
+    const af::array& bias,
+    int leftPad,
+    int rightPad,
+    int stride,
+    int dilation,
+    af::array& out) {
+  int span = (weight.dims(0) - 1) * dilation + 1;
+  int padded = input.dims(0) + leftPad + rightPad;
+  int outLength = padded < span ? 0 : (padded - span) / stride + 1;
+  auto outDims = input.dims();
+  outDims[0] = outLength;
+  outDims[2] = weight.dims(3);
+  if (outDims.elements() == 0) {
+    out = af::array(outDims, af::dtype::f32);
+    return;
+  }
+  Conv1dSizes s(input, weight, outLength);
+  auto x = toHost(input);
+  auto w = toHost(weight);
+  auto b = toHost(bias);
+  std::vector<float> y(outDims.elements());
+  for (int n = 0; n < s.batch; ++n) {
+    for (int ch = 0; ch < s.channels; ++ch) {
+      for (int m = 0; m < s.multiplier; ++m) {
+        int outCh = ch * s.multiplier + m;
+        const float* wo =
+            w.data() + static_cast<size_t>(outCh) * s.kernelSize;
+        float bo = b.empty() ? 0 : b[outCh];
+        for (int col = 0; col < s.columns; ++col) {
+          const float* xc = x.data() + s.inputColumn(col, ch, n);
+          float* yc = y.data() + s.outputColumn(col, outCh, n);
+          for (int t = 0; t < outLength; ++t) {
+            int start = t * stride - leftPad;
+            float sum = bo;
+            for (int k = 0; k < s.kernelSize; ++k) {
+              int i = start + k * dilation;
+              if (i >= 0 && i < s.length) {
+                sum += wo[k] * xc[i];
+              }
+            }
+            yc[t] = sum;
+          }
+        }
+      }
+    }
+  }
+  out = af::array(outDims, y.data());
+}
+
+void depthwiseConv1dBackward(
+    const af::array& input,
+    const af::array& weight,
+    const af::array& gradOut,
+    int leftPad,
+    int stride,
+    int dilation,
+    af::array& gradInput,
+    af::array& gradWeight) {
+  if (input.elements() == 0 || gradOut.elements() == 0) {
+    gradInput = af::constant(0, input.dims(), af::dtype::f32);
+    gradWeight = af::constant(0, weight.dims(), af::dtype::f32);
+    return;
+  }
+  Conv1dSizes s(input, weight, gradOut.dims(0));
+  auto x = toHost(input);
+  auto w = toHost(weight);
+  auto gy = toHost(gradOut);
+  std::vector<float> gx(x.size(), 0), gw(w.size(), 0);
+  for (int n = 0; n < s.batch; ++n) {
+    for (int ch = 0; ch < s.channels; ++ch) {
+      for (int m = 0; m < s.multiplier; ++m) {
+        int outCh = ch * s.multiplier + m;
+        size_t wOffset = static_cast<size_t>(outCh) * s.kernelSize;
+        for (int col = 0; col < s.columns; ++col) {
+          const float* xc = x.data() + s.inputColumn(col, ch, n);
+          float* gxc = gx.data() + s.inputColumn(col, ch, n);
+          const float* gyc = gy.data() + s.outputColumn(col, outCh, n);
+          for (int t = 0; t < s.outLength; ++t) {
+            int start = t * stride - leftPad;
+            for (int k = 0; k < s.kernelSize; ++k) {
+              int i = start + k * dilation;
+              if (i >= 0 && i < s.length) {
+                gxc[i] += w[wOffset + k] * gyc[t];
+                gw[wOffset + k] += xc[i] * gyc[t];
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  gradInput = af::array(input.dims(), gx.data());
+  gradWeight = af::array(weight.dims(), gw.data());
+}
+
+} // namespace detail
+} // namespace fl
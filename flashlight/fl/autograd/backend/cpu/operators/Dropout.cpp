@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <arrayfire.h>
+
+#include "flashlight/fl/autograd/Functions.h"
+
+namespace fl {
+namespace detail {
+
+void dropoutForward(
+    const af::array& input,
+    float p,
+    const af::array& seed,
+    af::array& out) {
+  dim_t n = input.elements();
+  if (n == 0) {
+    out = input;
+    return;
+  }
+  // The seed stays on the device, broadcast into the expression, so that
+  // neither pass waits for the kernels which produced it
+  auto s = af::tile(af::flat(seed.as(af::dtype::u64)), af::dim4(n));
+  // The generator of the fused attention kernels (splitmix64 of the element
+  // index), as a single JIT expression: the mask is never materialized
+  af::array z = (af::range(af::dim4(n), 0, af::dtype::u64) + 1ULL) *
+          0x9E3779B97F4A7C15ULL +
+      s;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  z = z ^ (z >> 31);
+  auto u = (z >> 40).as(af::dtype::f32) * (1.0f / 16777216.0f);
+  auto keep = af::moddims(u >= p, input.dims()).as(input.type());
+  out = input * keep * (p < 1 ? 1.0 / (1.0 - p) : 0.0);
+  out.eval();
+}
+
+} // namespace detail
+} // namespace fl
@@ -0,0 +1,421 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include <arrayfire.h>
+
+#include "flashlight/fl/autograd/Functions.h"
+
+namespace fl {
+namespace detail {
+
+namespace {
+
+// Queries and keys per block of scores
+constexpr int kBlockSize = 64;
+
+const float kInf = std::numeric_limits<float>::infinity();
+
+std::vector<float> toHost(const af::array& arr) {
+  std::vector<float> host(arr.elements());
+  if (!host.empty()) {
+    arr.as(af::dtype::f32).host(host.data());
+  }
+  return host;
+}
+
+// Attention problem on host memory; arrays are column-major as in ArrayFire
+struct HostAttention {
+  int tq, tk, headDim, nHeads, nBatchHeads;
+  int nPos{0}, posStart{0}, offset;
+  bool posEmbPerHead{false};
+  // Whether the mask is Tq x Tk x B rather than Tq x Tk
+  bool maskPerBatch{false};
+  float pDropout;
+  uint64_t seed;
+  AttentionWindow window;
+  std::vector<float> q, k, v, posEmb, mask, padMask;
+
+  HostAttention(
+      const af::array& qArr,
+      const af::array& kArr,
+      const af::array& vArr,
+      const af::array& posEmbArr,
+      const af::array& maskArr,
+      const af::array& padMaskArr,
+      int numHeads,
+      int queryOffset,
+      float dropout,
+      const af::array& seedArr,
+      const AttentionWindow& attentionWindow)
+      : tq(qArr.dims(0)),
+        tk(kArr.dims(0)),
+        headDim(qArr.dims(1)),
+        nHeads(numHeads),
+        nBatchHeads(qArr.dims(2)),
+        offset(queryOffset),
+        pDropout(dropout),
+        seed(dropout > 0 ? seedArr.as(af::dtype::u64).scalar<uintl>() : 0),
+        window(attentionWindow),
+        q(toHost(qArr)),
+        k(toHost(kArr)),
+        v(toHost(vArr)),
+        posEmb(toHost(posEmbArr)),
+        mask(toHost(maskArr)),
+        padMask(toHost(padMaskArr)) {
+    if (!posEmbArr.isempty()) {
+      nPos = posEmbArr.dims(0);
+      posStart = nPos / 2 - offset;
+      posEmbPerHead = posEmbArr.dims(2) > 1;
+    }
+    maskPerBatch = !maskArr.isempty() && maskArr.dims(2) > 1;
+  }
+
+  // Row-major (rows x headDim) copy of the slice `slice` of `src`
+  std::vector<float>
+  head(const std::vector<float>& src, int rows, int slice) const {
+    std::vector<float> dst(rows * headDim);
+    for (int d = 0; d < headDim; ++d) {
+      const float* col = src.data() + rows * (d + headDim * slice);
+      for (int r = 0; r < rows; ++r) {
+        dst[r * headDim + d] = col[r];
+      }
+    }
+    return dst;
+  }
+
+  void storeHead(
+      std::vector<float>& dst,
+      const std::vector<float>& src,
+      int rows,
+      int slice) const {
+    for (int d = 0; d < headDim; ++d) {
+      float* col = dst.data() + rows * (d + headDim * slice);
+      for (int r = 0; r < rows; ++r) {
+        col[r] += src[r * headDim + d];
+      }
+    }
+  }
+
+  int posSlice(int hb) const {
+    return posEmbPerHead ? hb : 0;
+  }
+
+  float dot(const float* lhs, const float* rhs) const {
+    float res = 0;
+    for (int d = 0; d < headDim; ++d) {
+      res += lhs[d] * rhs[d];
+    }
+    return res;
+  }
+
+  // Whether the query i attends to the key j
+  bool inWindow(int i, int j) const {
+    int pos = i + offset;
+    if (j < window.numGlobal || pos < window.numGlobal) {
+      return true;
+    }
+    return (window.left < 0 || j >= pos - window.left) &&
+        (window.right < 0 || j <= pos + window.right);
+  }
+
+  // Whether a query of [i0, i1) attends to a key of [j0, j1)
+  bool blockInWindow(int i0, int i1, int j0, int j1) const {
+    if (window.isFull() || j0 < window.numGlobal ||
+        i0 + offset < window.numGlobal) {
+      return true;
+    }
+    return (window.left < 0 || j1 - 1 >= i0 + offset - window.left) &&
+        (window.right < 0 || j0 <= i1 - 1 + offset + window.right);
+  }
+
+  // Row of the positional embeddings of the pair (i, j), -1 if none
+  int posRow(int i, int j) const {
+    int r = posStart + j - i;
+    return (r >= 0 && r < nPos) ? r : -1;
+  }
+
+  // Dropout scale of the attention weight (i, j) of head hb
+  float keepScale(int i, int j, int hb) const {
+    if (pDropout <= 0) {
+      return 1;
+    }
+    uint64_t idx = (static_cast<uint64_t>(hb) * tk + j) * tq + i;
+    uint64_t z = seed + (idx + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    float u = (z >> 40) * (1.0f / 16777216.0f);
+    return u < pDropout ? 0 : 1 / (1 - pDropout);
+  }
+
+  // Scores of the queries [i0, i1) and keys [j0, j1) of head hb, row-major
+  // in a kBlockSize x kBlockSize block
+  void scores(
+      const std::vector<float>& qh,
+      const std::vector<float>& kh,
+      const std::vector<float>& peh,
+      int hb,
+      int i0,
+      int i1,
+      int j0,
+      int j1,
+      std::vector<float>& s) const {
+    const float* pad =
+        padMask.empty() ? nullptr : padMask.data() + tk * (hb / nHeads);
+    const float* msk = mask.empty()
+        ? nullptr
+        : mask.data() + (maskPerBatch ? tq * tk * (hb / nHeads) : 0);
+    for (int i = i0; i < i1; ++i) {
+      const float* qi = qh.data() + i * headDim;
+      float* si = s.data() + (i - i0) * kBlockSize;
+      for (int j = j0; j < j1; ++j) {
+        if (!inWindow(i, j)) {
+          si[j - j0] = -kInf;
+          continue;
+        }
+        float score = dot(qi, kh.data() + j * headDim);
+        int r = posRow(i, j);
+        if (r >= 0) {
+          score += dot(qi, peh.data() + r * headDim);
+        }
+        if (msk) {
+          score += msk[i + tq * j];
+        }
+        if (pad) {
+          score += pad[j];
+        }
+        si[j - j0] = score;
+      }
+    }
+  }
+};
+
+} // namespace
+
+bool fusedAttentionSupported(int /* headDim */) {
+  return true;
+}
+
+void fusedAttentionForward(
+    const af::array& qArr,
+    const af::array& kArr,
+    const af::array& vArr,
+    const af::array& posEmbArr,
+    const af::array& maskArr,
+    const af::array& padMaskArr,
+    int nHeads,
+    int offset,
+    float pDropout,
+    const af::array& seed,
+    const AttentionWindow& window,
+    af::array& outArr,
+    af::array& logSumExpArr) {
+  HostAttention att(
+      qArr,
+      kArr,
+      vArr,
+      posEmbArr,
+      maskArr,
+      padMaskArr,
+      nHeads,
+      offset,
+      pDropout,
+      seed,
+      window);
+  int tq = att.tq, tk = att.tk, headDim = att.headDim;
+  std::vector<float> out(att.q.size(), 0);
+  std::vector<float> logSumExp(tq * att.nBatchHeads);
+  std::vector<float> s(kBlockSize * kBlockSize);
+  std::vector<float> rowMax(kBlockSize), rowSum(kBlockSize);
+  std::vector<float> acc(kBlockSize * headDim);
+
+  for (int hb = 0; hb < att.nBatchHeads; ++hb) {
+    auto qh = att.head(att.q, tq, hb);
+    auto kh = att.head(att.k, tk, hb);
+    auto vh = att.head(att.v, tk, hb);
+    auto peh = att.nPos > 0 ? att.head(att.posEmb, att.nPos, att.posSlice(hb))
+                            : std::vector<float>();
+    std::vector<float> oh(tq * headDim);
+    for (int i0 = 0; i0 < tq; i0 += kBlockSize) {
+      int i1 = std::min(i0 + kBlockSize, tq);
+      std::fill(rowMax.begin(), rowMax.end(), -kInf);
+      std::fill(rowSum.begin(), rowSum.end(), 0);
+      std::fill(acc.begin(), acc.end(), 0);
+      // Online softmax over the blocks of keys
+      for (int j0 = 0; j0 < tk; j0 += kBlockSize) {
+        int j1 = std::min(j0 + kBlockSize, tk);
+        if (!att.blockInWindow(i0, i1, j0, j1)) {
+          continue;
+        }
+        att.scores(qh, kh, peh, hb, i0, i1, j0, j1, s);
+        for (int i = i0; i < i1; ++i) {
+          const float* si = s.data() + (i - i0) * kBlockSize;
+          float* ai = acc.data() + (i - i0) * headDim;
+          float m = *std::max_element(si, si + j1 - j0);
+          float newMax = std::max(rowMax[i - i0], m);
+          if (newMax == -kInf) {
+            continue;
+          }
+          float alpha = std::exp(rowMax[i - i0] - newMax);
+          rowSum[i - i0] *= alpha;
+          for (int d = 0; d < headDim; ++d) {
+            ai[d] *= alpha;
+          }
+          for (int j = j0; j < j1; ++j) {
+            float p = std::exp(si[j - j0] - newMax);
+            rowSum[i - i0] += p;
+            float w = p * att.keepScale(i, j, hb);
+            if (w == 0) {
+              continue;
+            }
+            const float* vj = vh.data() + j * headDim;
+            for (int d = 0; d < headDim; ++d) {
+              ai[d] += w * vj[d];
+            }
+          }
+          rowMax[i - i0] = newMax;
+        }
+      }
+      for (int i = i0; i < i1; ++i) {
+        float l = rowSum[i - i0];
+        const float* ai = acc.data() + (i - i0) * headDim;
+        for (int d = 0; d < headDim; ++d) {
+          oh[i * headDim + d] = l > 0 ? ai[d] / l : 0;
+        }
+        logSumExp[i + tq * hb] = l > 0 ? rowMax[i - i0] + std::log(l) : kInf;
+      }
+    }
+    att.storeHead(out, oh, tq, hb);
+  }
+  outArr = af::array(qArr.dims(), out.data());
+  logSumExpArr = af::array(tq, 1, att.nBatchHeads, logSumExp.data());
+}
+
+void fusedAttentionBackward(
+    const af::array& qArr,
+    const af::array& kArr,
+    const af::array& vArr,
+    const af::array& posEmbArr,
+    const af::array& maskArr,
+    const af::array& padMaskArr,
+    int nHeads,
+    int offset,
+    float pDropout,
+    const af::array& seed,
+    const AttentionWindow& window,
+    const af::array& outArr,
+    const af::array& logSumExpArr,
+    const af::array& gradOutArr,
+    af::array& gradQArr,
+    af::array& gradKArr,
+    af::array& gradVArr,
+    af::array& gradPosEmbArr) {
+  HostAttention att(
+      qArr,
+      kArr,
+      vArr,
+      posEmbArr,
+      maskArr,
+      padMaskArr,
+      nHeads,
+      offset,
+      pDropout,
+      seed,
+      window);
+  int tq = att.tq, tk = att.tk, headDim = att.headDim;
+  auto out = toHost(outArr);
+  auto logSumExp = toHost(logSumExpArr);
+  auto gradOut = toHost(gradOutArr);
+  std::vector<float> gradQ(att.q.size(), 0), gradK(att.k.size(), 0),
+      gradV(att.v.size(), 0), gradPosEmb(att.posEmb.size(), 0);
+  std::vector<float> s(kBlockSize * kBlockSize);
+
+  for (int hb = 0; hb < att.nBatchHeads; ++hb) {
+    auto qh = att.head(att.q, tq, hb);
+    auto kh = att.head(att.k, tk, hb);
+    auto vh = att.head(att.v, tk, hb);
+    auto peh = att.nPos > 0 ? att.head(att.posEmb, att.nPos, att.posSlice(hb))
+                            : std::vector<float>();
+    auto oh = att.head(out, tq, hb);
+    auto dOh = att.head(gradOut, tq, hb);
+    std::vector<float> dq(qh.size(), 0), dk(kh.size(), 0), dv(vh.size(), 0),
+        dpe(peh.size(), 0);
+    // delta_i = sum_j attn_ij * dA_ij = dO_i . O_i
+    std::vector<float> delta(tq);
+    for (int i = 0; i < tq; ++i) {
+      delta[i] = att.dot(dOh.data() + i * headDim, oh.data() + i * headDim);
+    }
+    const float* lse = logSumExp.data() + tq * hb;
+
+    for (int i0 = 0; i0 < tq; i0 += kBlockSize) {
+      int i1 = std::min(i0 + kBlockSize, tq);
+      for (int j0 = 0; j0 < tk; j0 += kBlockSize) {
+        int j1 = std::min(j0 + kBlockSize, tk);
+        if (!att.blockInWindow(i0, i1, j0, j1)) {
+          continue;
+        }
+        att.scores(qh, kh, peh, hb, i0, i1, j0, j1, s);
+        for (int i = i0; i < i1; ++i) {
+          if (lse[i] == kInf) {
+            continue;
+          }
+          const float* qi = qh.data() + i * headDim;
+          const float* dOi = dOh.data() + i * headDim;
+          float* dqi = dq.data() + i * headDim;
+          for (int j = j0; j < j1; ++j) {
+            float p = std::exp(s[(i - i0) * kBlockSize + j - j0] - lse[i]);
+            if (p == 0) {
+              continue;
+            }
+            float keep = att.keepScale(i, j, hb);
+            const float* vj = vh.data() + j * headDim;
+            float dS = p * (att.dot(dOi, vj) * keep - delta[i]);
+            float w = p * keep;
+            const float* kj = kh.data() + j * headDim;
+            float* dkj = dk.data() + j * headDim;
+            float* dvj = dv.data() + j * headDim;
+            for (int d = 0; d < headDim; ++d) {
+              dvj[d] += w * dOi[d];
+              dqi[d] += dS * kj[d];
+              dkj[d] += dS * qi[d];
+            }
+            int r = att.posRow(i, j);
+            if (r >= 0) {
+              const float* per = peh.data() + r * headDim;
+              float* dper = dpe.data() + r * headDim;
+              for (int d = 0; d < headDim; ++d) {
+                dqi[d] += dS * per[d];
+                dper[d] += dS * qi[d];
+              }
+            }
+          }
+        }
+      }
+    }
+    att.storeHead(gradQ, dq, tq, hb);
+    att.storeHead(gradK, dk, tk, hb);
+    att.storeHead(gradV, dv, tk, hb);
+    if (att.nPos > 0) {
+      att.storeHead(gradPosEmb, dpe, att.nPos, att.posSlice(hb));
+    }
+  }
+  gradQArr = af::array(qArr.dims(), gradQ.data());
+  gradKArr = af::array(kArr.dims(), gradK.data());
+  gradVArr = af::array(vArr.dims(), gradV.data());
+  gradPosEmbArr = att.nPos > 0 ? af::array(posEmbArr.dims(), gradPosEmb.data())
+                               : af::array();
+}
+
+} // namespace detail
+} // namespace fl
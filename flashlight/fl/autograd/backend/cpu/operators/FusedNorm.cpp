@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cmath>
+#include <vector>
+
+#include <arrayfire.h>
+
+#include "flashlight/fl/autograd/Functions.h"
+
+namespace fl {
+namespace detail {
+
+namespace {
+
+constexpr float kGeluScale = 0.7978845608f;
+constexpr float kGeluCubic = 0.044715f;
+
+std::vector<float> toHost(const af::array& arr) {
+  std::vector<float> host(arr.elements());
+  if (!host.empty()) {
+    arr.as(af::dtype::f32).host(host.data());
+  }
+  return host;
+}
+
+// Input (plus the residual, if any) on host memory, as a rows x cols matrix
+std::vector<float> sumToHost(
+    const af::array& input,
+    const af::array& residual) {
+  auto x = toHost(input);
+  if (!residual.isempty()) {
+    auto r = toHost(residual);
+    for (size_t i = 0; i < x.size(); ++i) {
+      x[i] += r[i];
+    }
+  }
+  return x;
+}
+
+// Value of an affine parameter of zero, one or `rows` elements for a row
+inline float
+paramAt(const std::vector<float>& param, int row, float defaultValue) {
+  if (param.empty()) {
+    return defaultValue;
+  }
+  return param.size() == 1 ? param[0] : param[row];
+}
+
+// Flattens the dimensions after the first one, for JIT expressions
+af::array asMatrix(const af::array& arr) {
+  return af::moddims(arr, af::dim4(arr.dims(0), arr.elements() / arr.dims(0)));
+}
+
+} // namespace
+
+void layerNormForward(
+    const af::array& input,
+    const af::array& residual,
+    const af::array& weight,
+    const af::array& bias,
+    float eps,
+    af::array& out,
+    af::array& mean,
+    af::array& rstd) {
+  int rows = input.dims(0);
+  int cols = input.elements() / rows;
+  auto x = sumToHost(input, residual);
+  auto w = toHost(weight);
+  auto b = toHost(bias);
+  std::vector<float> y(x.size()), mu(cols), rs(cols);
+  for (int c = 0; c < cols; ++c) {
+    const float* xc = x.data() + static_cast<size_t>(c) * rows;
+    float* yc = y.data() + static_cast<size_t>(c) * rows;
+    double sum = 0;
+    for (int i = 0; i < rows; ++i) {
+      sum += xc[i];
+    }
+    float m = sum / rows;
+    double sqSum = 0;
+    for (int i = 0; i < rows; ++i) {
+      sqSum += (xc[i] - m) * (xc[i] - m);
+    }
+    float r = 1.0 / std::sqrt(sqSum / rows + eps);
+    for (int i = 0; i < rows; ++i) {
+      yc[i] = (xc[i] - m) * r * paramAt(w, i, 1) + paramAt(b, i, 0);
+    }
+    mu[c] = m;
+    rs[c] = r;
+  }
+  out = af::array(input.dims(), y.data());
+  mean = af::array(1, cols, mu.data());
+  rstd = af::array(1, cols, rs.data());
+}
+
+void layerNormBackward(
+    const af::array& input,
+    const af::array& residual,
+    const af::array& weight,
+    const af::array& mean,
+    const af::array& rstd,
+    const af::array& gradOut,
+    af::array& gradInput,
+    af::array& gradWeight,
+    af::array& gradBias) {
+  int rows = input.dims(0);
+  int cols = input.elements() / rows;
+  auto x = sumToHost(input, residual);
+  auto w = toHost(weight);
+  auto mu = toHost(mean);
+  auto rs = toHost(rstd);
+  auto dy = toHost(gradOut);
+  std::vector<float> dx(x.size()), dw(rows, 0), db(rows, 0);
+  for (int c = 0; c < cols; ++c) {
+    size_t base = static_cast<size_t>(c) * rows;
+    // dx = rstd * (g - mean(g) - xhat * mean(g * xhat)), with g = dy * w
+    double gSum = 0, gxSum = 0;
+    for (int i = 0; i < rows; ++i) {
+      float xhat = (x[base + i] - mu[c]) * rs[c];
+      float g = dy[base + i] * paramAt(w, i, 1);
+      gSum += g;
+      gxSum += g * xhat;
+      dw[i] += dy[base + i] * xhat;
+      db[i] += dy[base + i];
+    }
+    float gMean = gSum / rows;
+    float gxMean = gxSum / rows;
+    for (int i = 0; i < rows; ++i) {
+      float xhat = (x[base + i] - mu[c]) * rs[c];
+      float g = dy[base + i] * paramAt(w, i, 1);
+      dx[base + i] = rs[c] * (g - gMean - xhat * gxMean);
+    }
+  }
+  gradInput = af::array(input.dims(), dx.data());
+  gradWeight = af::array(rows, dw.data());
+  gradBias = af::array(rows, db.data());
+}
+
+// The elementwise operations are fused by the ArrayFire JIT in one kernel
+
+void biasGeluForward(
+    const af::array& input,
+    const af::array& bias,
+    af::array& out) {
+  auto x = asMatrix(input);
+  auto z = x + af::tile(af::moddims(bias, af::dim4(x.dims(0))), 1, x.dims(1));
+  auto y = 0.5 * z * (1 + af::tanh(kGeluScale * (z + kGeluCubic * z * z * z)));
+  out = af::moddims(y, input.dims());
+  out.eval();
+}
+
+void biasGeluBackward(
+    const af::array& input,
+    const af::array& bias,
+    const af::array& gradOut,
+    af::array& gradInput) {
+  auto x = asMatrix(input);
+  auto z = x + af::tile(af::moddims(bias, af::dim4(x.dims(0))), 1, x.dims(1));
+  auto t = af::tanh(kGeluScale * (z + kGeluCubic * z * z * z));
+  auto dz = 0.5 * (1 + t) +
+      0.5 * z * (1 - t * t) * kGeluScale * (1 + 3 * kGeluCubic * z * z);
+  gradInput = af::moddims(asMatrix(gradOut) * dz, input.dims());
+  gradInput.eval();
+}
+
+} // namespace detail
+} // namespace fl
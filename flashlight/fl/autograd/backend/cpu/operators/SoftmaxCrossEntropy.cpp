@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <arrayfire.h>
+
+#include "flashlight/fl/autograd/Functions.h"
+
+// The expressions below are fused by the ArrayFire JIT into the kernels of
+// the reductions, so that no C x X array but the gradient is materialized
+
+namespace fl {
+namespace detail {
+
+void softmaxCrossEntropyForward(
+    const af::array& logits,
+    const af::array& targets,
+    int ignoreIndex,
+    float labelSmoothing,
+    af::array& loss,
+    af::array& logSumExp) {
+  int C = logits.dims(0);
+  int X = logits.dims(1);
+  auto maxLogits = af::max(logits, 0);
+  logSumExp = af::flat(
+      af::log(af::sum(af::exp(logits - af::tile(maxLogits, C)), 0)) +
+      maxLogits);
+  auto ignored = targets == ignoreIndex;
+  auto columns = af::range(af::dim4(X), 0, af::dtype::s32);
+  auto index = af::select(ignored, 0, targets) + C * columns;
+  auto targetLogits = af::flat(logits)(index);
+  loss = logSumExp - (1 - labelSmoothing) * targetLogits;
+  if (labelSmoothing > 0) {
+    loss -= labelSmoothing * af::flat(af::mean(logits, 0));
+  }
+  loss = af::select(ignored, 0, loss);
+  loss.eval();
+  logSumExp.eval();
+}
+
+void softmaxCrossEntropyBackward(
+    const af::array& logits,
+    const af::array& targets,
+    const af::array& logSumExp,
+    const af::array& gradLoss,
+    int ignoreIndex,
+    float labelSmoothing,
+    af::array& gradLogits) {
+  int C = logits.dims(0);
+  int X = logits.dims(1);
+  auto row = [C, X](const af::array& arr) {
+    return af::tile(af::moddims(arr, af::dim4(1, X)), C);
+  };
+  auto scale = af::select(targets == ignoreIndex, 0, gradLoss);
+  auto classes = af::range(af::dim4(C, X), 0, af::dtype::s32);
+  auto oneHot = classes == row(targets);
+  gradLogits = (af::exp(logits - row(logSumExp)) -
+                (1 - labelSmoothing) * oneHot - labelSmoothing / C) *
+      row(scale);
+  gradLogits.eval();
+}
+
+} // namespace detail
+} // namespace fl
@@ -7,6 +7,7 @@
 
 #include <algorithm>
 #include <stdexcept>
+#include <vector>
 
 #include <cudnn.h>
 
@@ -44,6 +45,7 @@ Variable batchnorm(
 
   cudnnBatchNormMode_t mode;
   af::dim4 inDescDims, wtDescDims;
+  auto inDescLayout = ImageLayout::WHCN;
 
   auto max_axis = *std::max_element(axes.begin(), axes.end());
   auto min_axis = *std::min_element(axes.begin(), axes.end());
@@ -54,7 +56,21 @@ Variable batchnorm(
     throw std::invalid_argument("unsupported axis config for cuDNN batchnorm");
   }
 
-  if (min_axis == 0) {
+  if (axes.size() == 1 && min_axis == 0 && input.numdims() == 4 &&
+      input.dims(1) * input.dims(2) > 1) {
+    // Channels-last images (ImageLayout::CWHN): normalizing each channel is a
+    // spatial batchnorm on NHWC, whose kernels are faster than per-activation
+    // ones
+    mode = CUDNN_BATCHNORM_SPATIAL;
+#if CUDNN_VERSION >= 7003
+    if (train) {
+      mode = CUDNN_BATCHNORM_SPATIAL_PERSISTENT;
+    }
+#endif
+    inDescDims = input.dims();
+    inDescLayout = ImageLayout::CWHN;
+    wtDescDims = af::dim4(1, 1, nfeatures);
+  } else if (min_axis == 0) {
     mode = CUDNN_BATCHNORM_PER_ACTIVATION;
     inDescDims = af::dim4(1, 1, nfeatures, input.elements() / nfeatures);
     wtDescDims = af::dim4(1, 1, nfeatures);
@@ -92,7 +108,7 @@ Variable batchnorm(
   af::dtype scalarsType =
       input.type() == af::dtype::f16 ? af::dtype::f32 : input.type();
 
-  auto inDesc = TensorDescriptor(input.type(), inDescDims);
+  auto inDesc = TensorDescriptor(input.type(), inDescDims, inDescLayout);
   auto wtDesc = TensorDescriptor(weightArray.type(), wtDescDims);
 
   af::array saveMean, saveVar;
@@ -147,8 +163,14 @@ Variable batchnorm(
     }
   }
   auto gradFunc =
-      [train, saveMean, saveVar, mode, inDescDims, wtDescDims, epsilon](
-          std::vector<Variable>& inputs, const Variable& gradOutput) {
+      [train,
+       saveMean,
+       saveVar,
+       mode,
+       inDescDims,
+       inDescLayout,
+       wtDescDims,
+       epsilon](std::vector<Variable>& inputs, const Variable& gradOutput) {
         if (!train) {
           throw std::logic_error(
               "can't compute batchnorm grad when train was not specified");
@@ -169,7 +191,8 @@ Variable batchnorm(
         const void* one1 = kOne(scalarsType);
         const void* zero0 = kZero(scalarsType);
 
-        auto iDesc = TensorDescriptor(inArray.type(), inDescDims);
+        auto iDesc =
+            TensorDescriptor(inArray.type(), inDescDims, inDescLayout);
         auto wDesc = TensorDescriptor(wt.type(), wtDescDims);
         // CuDNN doesn't support calculating only the gradients
         // required for batchnorm
@@ -219,4 +242,294 @@ Variable batchnorm(
   return Variable(output, {in, weight, bias}, gradFunc);
 }
 
+namespace {
+
+// Whether cudnnBatchNormalizationForwardTrainingEx fuses the normalization,
+// the addition and the activation: f16 NHWC images, with C % 4 == 0
+bool fusedBatchnormReluSupported(
+    const af::array& input,
+    const Variable& residual,
+    const std::vector<int>& axes) {
+#if CUDNN_VERSION >= 7400
+  return input.type() == af::dtype::f16 && axes.size() == 1 && axes[0] == 0 &&
+      input.numdims() == 4 && input.dims(1) * input.dims(2) > 1 &&
+      input.dims(0) % 4 == 0 &&
+      (residual.isempty() ||
+       (residual.dims() == input.dims() && residual.type() == input.type()));
+#else
+  return false;
+#endif
+}
+
+} // namespace
+
+Variable batchnormRelu(
+    const Variable& in,
+    const Variable& residual,
+    const Variable& weight,
+    const Variable& bias,
+    Variable& runningMean,
+    Variable& runningVar,
+    const std::vector<int>& axes,
+    bool train,
+    double momentum,
+    double epsilon) {
+  auto input = FL_ADJUST_INPUT_TYPE(in);
+  if (!train) {
+    // One pass over the output of the normalization for the addition and the
+    // activation, which have no gradient in eval mode
+    auto out = batchnorm(
+        in,
+        weight,
+        bias,
+        runningMean,
+        runningVar,
+        axes,
+        train,
+        momentum,
+        epsilon);
+    auto output = residual.isempty()
+        ? af::max(out.array(), 0.0)
+        : af::max(out.array() + residual.array().as(out.type()), 0.0);
+    auto gradFunc = [](std::vector<Variable>& /* unused */,
+                       const Variable& /* unused */) {
+      throw std::logic_error(
+          "can't compute batchnorm grad when train was not specified");
+    };
+    std::vector<Variable> inputs = {out};
+    if (!residual.isempty()) {
+      inputs.push_back(residual);
+    }
+    return Variable(output, inputs, gradFunc);
+  }
+  if (!fusedBatchnormReluSupported(input.array(), residual, axes)) {
+    auto out = batchnorm(
+        in,
+        weight,
+        bias,
+        runningMean,
+        runningVar,
+        axes,
+        train,
+        momentum,
+        epsilon);
+    if (!residual.isempty()) {
+      out = out + residual;
+    }
+    return relu(out);
+  }
+#if CUDNN_VERSION >= 7400
+  if (weight.type() != af::dtype::f32) {
+    throw std::invalid_argument(
+        "fl::batchnormRelu: non-input tensors must be of type f32");
+  }
+  FL_VARIABLE_DTYPES_MATCH_CHECK(weight, bias, runningMean, runningVar);
+
+  const int nfeatures = input.dims(0);
+  const auto mode = CUDNN_BATCHNORM_SPATIAL_PERSISTENT;
+  const bool hasResidual = !residual.isempty();
+  const auto bnOps = hasResidual ? CUDNN_BATCHNORM_OPS_BN_ADD_ACTIVATION
+                                 : CUDNN_BATCHNORM_OPS_BN_ACTIVATION;
+  const af::dim4 wtDescDims(1, 1, nfeatures);
+  if (!weight.isempty() && weight.elements() != nfeatures) {
+    throw std::invalid_argument("[BatchNorm] Invalid shape for weight.");
+  }
+  if (!bias.isempty() && bias.elements() != nfeatures) {
+    throw std::invalid_argument("[BatchNorm] Invalid shape for bias.");
+  }
+  af::array weightArray = weight.isempty()
+      ? af::constant(1.0, wtDescDims, af::dtype::f32)
+      : weight.array();
+  af::array biasArray = bias.isempty()
+      ? af::constant(0.0, wtDescDims, af::dtype::f32)
+      : bias.array();
+
+  auto inDesc =
+      TensorDescriptor(input.type(), input.dims(), ImageLayout::CWHN);
+  auto wtDesc = TensorDescriptor(af::dtype::f32, wtDescDims);
+  auto actDesc = ActivationDescriptor();
+  auto zDesc = hasResidual ? inDesc.descriptor : nullptr;
+  auto handle = getCudnnHandle();
+
+  size_t workspaceBytes, reserveBytes;
+  CUDNN_CHECK_ERR(cudnnGetBatchNormalizationForwardTrainingExWorkspaceSize(
+      handle,
+      mode,
+      bnOps,
+      inDesc.descriptor,
+      zDesc,
+      inDesc.descriptor,
+      wtDesc.descriptor,
+      actDesc.descriptor,
+      &workspaceBytes));
+  CUDNN_CHECK_ERR(cudnnGetBatchNormalizationTrainingExReserveSpaceSize(
+      handle,
+      mode,
+      bnOps,
+      actDesc.descriptor,
+      inDesc.descriptor,
+      &reserveBytes));
+  // Kept for the backward pass with the output, from which the activation is
+  // differentiated
+  af::array reserve(std::max<size_t>(reserveBytes, 1), af::dtype::b8);
+  auto output = af::array(input.dims(), input.type());
+  auto saveMean = af::array(nfeatures, af::dtype::f32);
+  auto saveVar = af::array(nfeatures, af::dtype::f32);
+  {
+    af::array workspace(std::max<size_t>(workspaceBytes, 1), af::dtype::b8);
+    DevicePtr inRaw(input.array());
+    DevicePtr resRaw(hasResidual ? residual.array() : af::array());
+    DevicePtr outRaw(output);
+    DevicePtr wtRaw(weightArray);
+    DevicePtr bsRaw(biasArray);
+    DevicePtr runMeanRaw(runningMean.array());
+    DevicePtr runVarRaw(runningVar.array());
+    DevicePtr saveMeanRaw(saveMean);
+    DevicePtr saveVarRaw(saveVar);
+    DevicePtr workspaceRaw(workspace);
+    DevicePtr reserveRaw(reserve);
+    CUDNN_CHECK_ERR(cudnnBatchNormalizationForwardTrainingEx(
+        handle,
+        mode,
+        bnOps,
+        kOne(af::dtype::f32),
+        kZero(af::dtype::f32),
+        inDesc.descriptor,
+        inRaw.get(),
+        zDesc,
+        resRaw.get(),
+        inDesc.descriptor,
+        outRaw.get(),
+        wtDesc.descriptor,
+        wtRaw.get(),
+        bsRaw.get(),
+        momentum,
+        runMeanRaw.get(),
+        runVarRaw.get(),
+        epsilon,
+        saveMeanRaw.get(),
+        saveVarRaw.get(),
+        actDesc.descriptor,
+        workspaceRaw.get(),
+        workspaceBytes,
+        reserveRaw.get(),
+        reserveBytes));
+  }
+
+  auto gradFunc = [output,
+                   saveMean,
+                   saveVar,
+                   reserve,
+                   reserveBytes,
+                   hasResidual,
+                   wtDescDims,
+                   epsilon](
+                      std::vector<Variable>& inputs,
+                      const Variable& gradOutput) {
+    const auto mode = CUDNN_BATCHNORM_SPATIAL_PERSISTENT;
+    const auto bnOps = hasResidual ? CUDNN_BATCHNORM_OPS_BN_ADD_ACTIVATION
+                                   : CUDNN_BATCHNORM_OPS_BN_ACTIVATION;
+    auto& in = inputs[0];
+    auto inArray = in.array().as(output.type());
+    auto gradOutputArray = gradOutput.array().as(output.type());
+    auto wt = inputs[1].isempty()
+        ? Variable(af::constant(1.0, wtDescDims, af::dtype::f32), false)
+        : inputs[1];
+    auto bsArray = inputs[2].isempty()
+        ? af::constant(0.0, wtDescDims, af::dtype::f32)
+        : inputs[2].array();
+
+    auto iDesc =
+        TensorDescriptor(output.type(), output.dims(), ImageLayout::CWHN);
+    auto wDesc = TensorDescriptor(af::dtype::f32, wtDescDims);
+    auto actDesc = ActivationDescriptor();
+    auto dzDesc = hasResidual ? iDesc.descriptor : nullptr;
+    auto handle = getCudnnHandle();
+    size_t workspaceBytes;
+    CUDNN_CHECK_ERR(cudnnGetBatchNormalizationBackwardExWorkspaceSize(
+        handle,
+        mode,
+        bnOps,
+        iDesc.descriptor,
+        iDesc.descriptor,
+        iDesc.descriptor,
+        dzDesc,
+        iDesc.descriptor,
+        wDesc.descriptor,
+        actDesc.descriptor,
+        &workspaceBytes));
+
+    // CuDNN computes all the gradients at once: the one of the residual is
+    // the gradient of the activation
+    auto gradIn = af::array(output.dims(), output.type());
+    auto gradRes =
+        hasResidual ? af::array(output.dims(), output.type()) : af::array();
+    auto gradWt = af::array(wt.dims(), af::dtype::f32);
+    auto gradBs = af::array(wt.dims(), af::dtype::f32);
+    {
+      af::array workspace(std::max<size_t>(workspaceBytes, 1), af::dtype::b8);
+      DevicePtr iRaw(inArray);
+      DevicePtr yRaw(output);
+      DevicePtr gradOpRaw(gradOutputArray);
+      DevicePtr gradResRaw(gradRes);
+      DevicePtr gradInRaw(gradIn);
+      DevicePtr wRaw(wt.array());
+      DevicePtr bsRaw(bsArray);
+      DevicePtr gradWtRaw(gradWt);
+      DevicePtr gradBsRaw(gradBs);
+      DevicePtr saveMeanRaw(saveMean);
+      DevicePtr saveVarRaw(saveVar);
+      DevicePtr workspaceRaw(workspace);
+      DevicePtr reserveRaw(reserve);
+      CUDNN_CHECK_ERR(cudnnBatchNormalizationBackwardEx(
+          handle,
+          mode,
+          bnOps,
+          kOne(af::dtype::f32),
+          kZero(af::dtype::f32),
+          kOne(af::dtype::f32),
+          kZero(af::dtype::f32),
+          iDesc.descriptor,
+          iRaw.get(),
+          iDesc.descriptor,
+          yRaw.get(),
+          iDesc.descriptor,
+          gradOpRaw.get(),
+          dzDesc,
+          gradResRaw.get(),
+          iDesc.descriptor,
+          gradInRaw.get(),
+          wDesc.descriptor,
+          wRaw.get(),
+          bsRaw.get(),
+          gradWtRaw.get(),
+          gradBsRaw.get(),
+          epsilon,
+          saveMeanRaw.get(),
+          saveVarRaw.get(),
+          actDesc.descriptor,
+          workspaceRaw.get(),
+          workspaceBytes,
+          reserveRaw.get(),
+          reserveBytes));
+    }
+    in.addGrad(Variable(gradIn.as(in.type()), false));
+    wt.addGrad(Variable(gradWt.as(wt.type()), false));
+    if (!inputs[2].isempty()) {
+      inputs[2].addGrad(Variable(gradBs.as(inputs[2].type()), false));
+    }
+    if (hasResidual) {
+      inputs[3].addGrad(Variable(gradRes.as(inputs[3].type()), false));
+    }
+  };
+  std::vector<Variable> inputs = {in, weight, bias};
+  if (hasResidual) {
+    inputs.push_back(residual);
+  }
+  return Variable(output, inputs, gradFunc);
+#else
+  throw std::logic_error("fl::batchnormRelu: fused ops need cuDNN 7.4");
+#endif
+}
+
 } // namespace fl
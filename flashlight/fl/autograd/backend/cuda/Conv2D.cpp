@@ -6,11 +6,14 @@
  */
 
 #include <array>
+#include <sstream>
 #include <stdexcept>
+#include <string>
 
 #include <cudnn.h>
 
 #include "flashlight/fl/autograd/Functions.h"
+#include "flashlight/fl/autograd/Utils.h"
 #include "flashlight/fl/autograd/Variable.h"
 #include "flashlight/fl/autograd/backend/cuda/CudnnUtils.h"
 #include "flashlight/fl/common/DevicePtr.h"
@@ -203,13 +206,42 @@ const fl::cpp::fl_unordered_map<KernelMode, cudnnMathType_t>
          CUDNN_TENSOR_OP_MATH_ALLOW_CONVERSION},
         {KernelMode::F16, CUDNN_TENSOR_OP_MATH_ALLOW_CONVERSION}};
 
-std::shared_ptr<fl::DynamicBenchmark> createBenchmarkOptions() {
+/**
+ * Identifies a convolution in the persistent benchmark cache: the optimal
+ * kernel mode depends on the device, the cuDNN version, the parameters of the
+ * convolution, and the shapes and type of its operands.
+ */
+std::string benchmarkCacheKey(
+    const std::string& op,
+    const af::array& in,
+    const af::array& wt,
+    const std::array<int, 7>& params,
+    fl::ImageLayout layout) {
+  char name[256], platform[256], toolkit[256], compute[256];
+  af::deviceInfo(name, platform, toolkit, compute);
+  std::ostringstream key;
+  key << op << ";" << name << ";" << compute << ";cudnn"
+      << cudnnGetVersion() << ";" << in.type();
+  for (const auto& dims : {in.dims(), wt.dims()}) {
+    key << ";" << dims[0] << "x" << dims[1] << "x" << dims[2] << "x"
+        << dims[3];
+  }
+  for (auto param : params) {
+    key << ";" << param;
+  }
+  key << ";layout" << static_cast<int>(layout);
+  return key.str();
+}
+
+std::shared_ptr<fl::DynamicBenchmark> createBenchmarkOptions(
+    const std::string& cacheKey) {
   return std::make_shared<fl::DynamicBenchmark>(
       std::make_shared<fl::DynamicBenchmarkOptions<KernelMode>>(
           std::vector<KernelMode>({KernelMode::F32,
                                    KernelMode::F32_ALLOW_CONVERSION,
                                    KernelMode::F16}),
-          fl::kDynamicBenchmarkDefaultCount));
+          fl::kDynamicBenchmarkDefaultCount),
+      cacheKey);
 }
 
 /**
@@ -243,10 +275,22 @@ Variable conv2d(
     int dx,
     int dy,
     int groups,
-    std::shared_ptr<detail::ConvBenchmarks> benchmarks) {
+    std::shared_ptr<detail::ConvBenchmarks> benchmarks,
+    ImageLayout layout) {
   auto dummy_bias = Variable(af::array(input.type()), false);
   return conv2d(
-      input, weights, dummy_bias, sx, sy, px, py, dx, dy, groups, benchmarks);
+      input,
+      weights,
+      dummy_bias,
+      sx,
+      sy,
+      px,
+      py,
+      dx,
+      dy,
+      groups,
+      benchmarks,
+      layout);
 }
 
 Variable conv2d(
@@ -260,7 +304,8 @@ Variable conv2d(
     int dx,
     int dy,
     int groups,
-    std::shared_ptr<detail::ConvBenchmarks> benchmarks) {
+    std::shared_ptr<detail::ConvBenchmarks> benchmarks,
+    ImageLayout layout) {
   FL_VARIABLE_DTYPES_MATCH_CHECK(in, wt, bs);
 
   auto input = FL_ADJUST_INPUT_TYPE(in);
@@ -268,9 +313,16 @@ Variable conv2d(
   auto bias = FL_ADJUST_INPUT_TYPE(bs);
 
   auto hasBias = bias.elements() > 0;
+  if (layout == ImageLayout::CWHN) {
+    // Channels-last filters and bias, their gradients are reordered back
+    weights = reorder(weights, 2, 0, 1, 3);
+    if (hasBias) {
+      bias = moddims(bias, af::dim4(bias.elements()));
+    }
+  }
 
-  auto inDesc = TensorDescriptor(input);
-  auto wtDesc = FilterDescriptor(weights.array());
+  auto inDesc = TensorDescriptor(input, layout);
+  auto wtDesc = FilterDescriptor(weights.array(), layout);
   auto convDesc = ConvDescriptor(input.type(), px, py, sx, sy, dx, dy, groups);
   if (input.type() == f16) {
     CUDNN_CHECK_ERR(cudnnSetConvolutionMathType(
@@ -287,8 +339,11 @@ Variable conv2d(
       wtDesc.descriptor,
       4,
       odims.data()));
-  auto output = af::array(odims[3], odims[2], odims[1], odims[0], input.type());
-  auto outDesc = TensorDescriptor(output);
+  // odims are N x C x H x W
+  auto output = layout == ImageLayout::CWHN
+      ? af::array(odims[1], odims[3], odims[2], odims[0], input.type())
+      : af::array(odims[3], odims[2], odims[1], odims[0], input.type());
+  auto outDesc = TensorDescriptor(output, layout);
 
   auto handle = getCudnnHandle();
 
@@ -341,7 +396,7 @@ Variable conv2d(
         outPtr.get()));
 
     if (hasBias) {
-      auto bsDesc = TensorDescriptor(bias.array());
+      auto bsDesc = TensorDescriptor(bias.array(), layout);
       DevicePtr bsPtr(bias.array());
 
       CUDNN_CHECK_ERR(cudnnAddTensor(
@@ -354,382 +409,405 @@ Variable conv2d(
           outPtr.get()));
     }
   }
-  auto gradFunc = [sx, sy, px, py, dx, dy, hasBias, groups, benchmarks](
-                      std::vector<Variable>& inputs,
-                      const Variable& gradOutput) {
-    // Create benchmarks if needed
-    if (benchmarks && DynamicBenchmark::getBenchmarkMode()) {
-      if (!benchmarks->bwdFilterBenchmark) {
-        benchmarks->bwdFilterBenchmark = createBenchmarkOptions();
-      }
-      if (!benchmarks->bwdDataBenchmark) {
-        benchmarks->bwdDataBenchmark = createBenchmarkOptions();
-      }
-      if (!benchmarks->bwdBiasBenchmark) {
-        benchmarks->bwdBiasBenchmark = createBenchmarkOptions();
-      }
-    }
+  auto gradFunc =
+      [sx, sy, px, py, dx, dy, hasBias, groups, benchmarks, layout](
+          std::vector<Variable>& inputs, const Variable& gradOutput) {
+        auto& in = inputs[0];
+        auto& wt = inputs[1];
+
+        // Create benchmarks if needed
+        if (benchmarks && DynamicBenchmark::getBenchmarkMode()) {
+          std::array<int, 7> params = {sx, sy, px, py, dx, dy, groups};
+          if (!benchmarks->bwdFilterBenchmark) {
+            benchmarks->bwdFilterBenchmark = createBenchmarkOptions(
+                benchmarkCacheKey(
+                    "conv2d_bwd_filter",
+                    in.array(),
+                    wt.array(),
+                    params,
+                    layout));
+          }
+          if (!benchmarks->bwdDataBenchmark) {
+            benchmarks->bwdDataBenchmark = createBenchmarkOptions(
+                benchmarkCacheKey(
+                    "conv2d_bwd_data", in.array(), wt.array(), params, layout));
+          }
+          if (!benchmarks->bwdBiasBenchmark) {
+            benchmarks->bwdBiasBenchmark = createBenchmarkOptions(
+                benchmarkCacheKey(
+                    "conv2d_bwd_bias", in.array(), wt.array(), params, layout));
+          }
+        }
+
+        // Create default descriptors assuming no casts. If dynamic
+        // benchmarking suggests input or weight casting should occur, these
+        // descriptors may not be used/new ones with the correct types will be
+        // used instead.
+        auto iDesc = TensorDescriptor(in, layout);
+        auto wDesc = FilterDescriptor(wt.array(), layout);
+        auto cDesc = ConvDescriptor(in.type(), px, py, sx, sy, dx, dy, groups);
+        auto oDesc = TensorDescriptor(gradOutput.array(), layout);
+
+        auto hndl = getCudnnHandle();
+
+        auto scalarsType = in.type() == f16 ? f32 : in.type();
+        const void* oneg = kOne(scalarsType);
+        const void* zerog = kZero(scalarsType);
+
+        // Bias gradients
+        if (hasBias && inputs.size() > 2 && inputs[2].isCalcGrad()) {
+          auto& bias = inputs[2];
+          auto convolutionBackwardBias = [&bias, &hndl, oneg, zerog, layout](
+                                             const af::array& bsArray,
+                                             const af::array& gradOutput,
+                                             const TensorDescriptor& oDesc) {
+            DevicePtr gradResultPtr(gradOutput);
+
+            auto gradBias =
+                Variable(af::array(bsArray.dims(), bsArray.type()), false);
+            {
+              DevicePtr gradBiasPtr(gradBias.array());
+              auto bDesc = TensorDescriptor(bsArray, layout);
+              CUDNN_CHECK_ERR(cudnnConvolutionBackwardBias(
+                  hndl,
+                  oneg,
+                  oDesc.descriptor,
+                  gradResultPtr.get(),
+                  zerog,
+                  bDesc.descriptor,
+                  gradBiasPtr.get()));
+            }
+            bias.addGrad(gradBias);
+          };
 
-    auto& in = inputs[0];
-    auto& wt = inputs[1];
-
-    // Create default descriptors assuming no casts. If dynamic
-    // benchmarking suggests input or weight casting should occur, these
-    // descriptors may not be used/new ones with the correct types will be used
-    // instead.
-    auto iDesc = TensorDescriptor(in);
-    auto wDesc = FilterDescriptor(wt.array());
-    auto cDesc = ConvDescriptor(in.type(), px, py, sx, sy, dx, dy, groups);
-    auto oDesc = TensorDescriptor(gradOutput.array());
-
-    auto hndl = getCudnnHandle();
-
-    auto scalarsType = in.type() == f16 ? f32 : in.type();
-    const void* oneg = kOne(scalarsType);
-    const void* zerog = kZero(scalarsType);
-
-    // Bias gradients
-    if (hasBias && inputs.size() > 2 && inputs[2].isCalcGrad()) {
-      auto& bias = inputs[2];
-      auto convolutionBackwardBias = [&bias, &hndl, oneg, zerog](
-                                         const af::array& bsArray,
-                                         const af::array& gradOutput,
-                                         const TensorDescriptor& oDesc) {
-        DevicePtr gradResultPtr(gradOutput);
-
-        auto gradBias =
-            Variable(af::array(bsArray.dims(), bsArray.type()), false);
-        {
-          DevicePtr gradBiasPtr(gradBias.array());
-          auto bDesc = TensorDescriptor(bsArray);
-          CUDNN_CHECK_ERR(cudnnConvolutionBackwardBias(
-              hndl,
-              oneg,
-              oDesc.descriptor,
-              gradResultPtr.get(),
-              zerog,
-              bDesc.descriptor,
-              gradBiasPtr.get()));
+          if (benchmarks && DynamicBenchmark::getBenchmarkMode()) {
+            KernelMode biasBwdOption =
+                benchmarks->bwdBiasBenchmark
+                    ->getOptions<DynamicBenchmarkOptions<KernelMode>>()
+                    ->currentOption();
+
+            if (in.type() == af::dtype::f16 &&
+                biasBwdOption == KernelMode::F32 &&
+                biasBwdOption == KernelMode::F32_ALLOW_CONVERSION) {
+              // The input type of fp16, but the result of the dynamic
+              // benchmark is that using fp32 kernels is faster for computing
+              // bwd with fp16 kernels, including the cast
+              af::array biasF32;
+              af::array gradOutputF32;
+              // Time cast bias and grad output if benchmarking
+              benchmarks->bwdBiasBenchmark->audit(
+                  [&bias, &gradOutput, &biasF32, &gradOutputF32]() {
+                    biasF32 = bias.array().as(af::dtype::f32);
+                    gradOutputF32 = gradOutput.array().as(af::dtype::f32);
+                  },
+                  /* incrementCount = */ false);
+              auto oDescF32 = TensorDescriptor(gradOutputF32, layout);
+              // Perform bias gradient computation
+              benchmarks->bwdBiasBenchmark->audit([&convolutionBackwardBias,
+                                                   &biasF32,
+                                                   &gradOutputF32,
+                                                   &oDescF32]() {
+                convolutionBackwardBias(biasF32, gradOutputF32, oDescF32);
+              });
+            } else {
+              // Grad output and bias types are already the same, so perform the
+              // computation using whatever input type is given
+              benchmarks->bwdBiasBenchmark->audit(
+                  [&convolutionBackwardBias, &bias, &gradOutput, &oDesc]() {
+                    convolutionBackwardBias(
+                        bias.array(), gradOutput.array(), oDesc);
+                  });
+            }
+          } else {
+            // No benchmark; proceed normally
+            convolutionBackwardBias(bias.array(), gradOutput.array(), oDesc);
+          }
         }
-        bias.addGrad(gradBias);
-      };
 
-      if (benchmarks && DynamicBenchmark::getBenchmarkMode()) {
-        KernelMode biasBwdOption =
-            benchmarks->bwdBiasBenchmark
-                ->getOptions<DynamicBenchmarkOptions<KernelMode>>()
-                ->currentOption();
-
-        if (in.type() == af::dtype::f16 && biasBwdOption == KernelMode::F32 &&
-            biasBwdOption == KernelMode::F32_ALLOW_CONVERSION) {
-          // The input type of fp16, but the result of the dynamic benchmark is
-          // that using fp32 kernels is faster for computing bwd with fp16
-          // kernels, including the cast
-          af::array biasF32;
-          af::array gradOutputF32;
-          // Time cast bias and grad output if benchmarking
-          benchmarks->bwdBiasBenchmark->audit(
-              [&bias, &gradOutput, &biasF32, &gradOutputF32]() {
-                biasF32 = bias.array().as(af::dtype::f32);
-                gradOutputF32 = gradOutput.array().as(af::dtype::f32);
-              },
-              /* incrementCount = */ false);
-          auto oDescF32 = TensorDescriptor(gradOutputF32);
-          // Perform bias gradient computation
-          benchmarks->bwdBiasBenchmark->audit([&convolutionBackwardBias,
-                                               &biasF32,
-                                               &gradOutputF32,
-                                               &oDescF32]() {
-            convolutionBackwardBias(biasF32, gradOutputF32, oDescF32);
-          });
+        // Gradients with respect to the input
+        auto convolutionBackwardData =
+            [&hndl, &in, &benchmarks, oneg, zerog, dx, dy](
+                const af::array& inArray,
+                const af::array& wtArray,
+                const af::array& gradOutputArray,
+                TensorDescriptor& iDesc,
+                FilterDescriptor& wDesc,
+                ConvDescriptor& cDesc,
+                TensorDescriptor& oDesc) {
+              if (benchmarks && DynamicBenchmark::getBenchmarkMode()) {
+                setCudnnMathType(
+                    cDesc,
+                    benchmarks->bwdDataBenchmark
+                        ->getOptions<DynamicBenchmarkOptions<KernelMode>>());
+              }
+
+              DevicePtr wPtr(wtArray);
+              if (in.isCalcGrad()) {
+                bool isStrided = (dx * dy) > 1;
+                auto bwdDataAlgoBestPerf = getBwdDataAlgo(
+                    iDesc.descriptor,
+                    wDesc.descriptor,
+                    cDesc.descriptor,
+                    oDesc.descriptor,
+                    isStrided,
+                    inArray.type());
+
+                af::array ws;
+                try {
+                  ws = af::array(bwdDataAlgoBestPerf.memory, af::dtype::b8);
+                } catch (const std::exception& e) {
+                  bwdDataAlgoBestPerf.algo = kBwdDataDefaultAlgo;
+                  CUDNN_CHECK_ERR(cudnnGetConvolutionBackwardDataWorkspaceSize(
+                      hndl,
+                      wDesc.descriptor,
+                      oDesc.descriptor,
+                      cDesc.descriptor,
+                      iDesc.descriptor,
+                      bwdDataAlgoBestPerf.algo,
+                      &bwdDataAlgoBestPerf.memory));
+                  ws = af::array(bwdDataAlgoBestPerf.memory, af::dtype::b8);
+                }
+                auto gradInput =
+                    Variable(af::array(inArray.dims(), inArray.type()), false);
+                {
+                  DevicePtr gradInputPtr(gradInput.array());
+                  DevicePtr gradResultPtr(gradOutputArray);
+                  DevicePtr wsPtr(ws);
+                  CUDNN_CHECK_ERR(cudnnConvolutionBackwardData(
+                      hndl,
+                      oneg,
+                      wDesc.descriptor,
+                      wPtr.get(),
+                      oDesc.descriptor,
+                      gradResultPtr.get(),
+                      cDesc.descriptor,
+                      bwdDataAlgoBestPerf.algo,
+                      wsPtr.get(),
+                      bwdDataAlgoBestPerf.memory,
+                      zerog,
+                      iDesc.descriptor,
+                      gradInputPtr.get()));
+                }
+                in.addGrad(gradInput);
+              }
+            };
+
+        if (benchmarks && DynamicBenchmark::getBenchmarkMode()) {
+          KernelMode dataBwdOption =
+              benchmarks->bwdDataBenchmark
+                  ->getOptions<DynamicBenchmarkOptions<KernelMode>>()
+                  ->currentOption();
+
+          if (in.type() == af::dtype::f16 && dataBwdOption == KernelMode::F32 &&
+              dataBwdOption == KernelMode::F32_ALLOW_CONVERSION) {
+            // The input type of fp16, but the result of the dynamic benchmark
+            // is that using fp32 kernels is faster for computing bwd with fp16
+            // kernels, including the cast
+            af::array inArrayF32;
+            af::array wtArrayF32;
+            af::array gradOutputArrayF32;
+            benchmarks->bwdDataBenchmark->audit(
+                [&in,
+                 &inArrayF32,
+                 &wt,
+                 &wtArrayF32,
+                 &gradOutput,
+                 &gradOutputArrayF32]() {
+                  inArrayF32 = in.array().as(af::dtype::f32);
+                  wtArrayF32 = wt.array().as(af::dtype::f32);
+                  gradOutputArrayF32 = gradOutput.array().as(af::dtype::f32);
+                },
+                /* incrementCount = */ false);
+
+            auto iDescF32 = TensorDescriptor(inArrayF32, layout);
+            auto wDescF32 = FilterDescriptor(wtArrayF32, layout);
+            auto cDescF32 =
+                ConvDescriptor(af::dtype::f32, px, py, sx, sy, dx, dy, groups);
+            auto oDescF32 = TensorDescriptor(gradOutputArrayF32, layout);
+            // core bwd data computation
+            benchmarks->bwdDataBenchmark->audit([&convolutionBackwardData,
+                                                 &inArrayF32,
+                                                 &wtArrayF32,
+                                                 &gradOutputArrayF32,
+                                                 &iDescF32,
+                                                 &wDescF32,
+                                                 &cDescF32,
+                                                 &oDescF32]() {
+              convolutionBackwardData(
+                  inArrayF32,
+                  wtArrayF32,
+                  gradOutputArrayF32,
+                  iDescF32,
+                  wDescF32,
+                  cDescF32,
+                  oDescF32);
+            });
+          } else {
+            benchmarks->bwdDataBenchmark->audit([&convolutionBackwardData,
+                                                 &in,
+                                                 &wt,
+                                                 &gradOutput,
+                                                 &iDesc,
+                                                 &wDesc,
+                                                 &cDesc,
+                                                 &oDesc]() {
+              convolutionBackwardData(
+                  in.array(),
+                  wt.array(),
+                  gradOutput.array(),
+                  iDesc,
+                  wDesc,
+                  cDesc,
+                  oDesc);
+            });
+          }
         } else {
-          // Grad output and bias types are already the same, so perform the
-          // computation using whatever input type is given
-          benchmarks->bwdBiasBenchmark->audit(
-              [&convolutionBackwardBias, &bias, &gradOutput, &oDesc]() {
-                convolutionBackwardBias(
-                    bias.array(), gradOutput.array(), oDesc);
-              });
+          // No benchmarking - proceed normally
+          convolutionBackwardData(
+              in.array(),
+              wt.array(),
+              gradOutput.array(),
+              iDesc,
+              wDesc,
+              cDesc,
+              oDesc);
         }
-      } else {
-        // No benchmark; proceed normally
-        convolutionBackwardBias(bias.array(), gradOutput.array(), oDesc);
-      }
-    }
 
-    // Gradients with respect to the input
-    auto convolutionBackwardData =
-        [&hndl, &in, &benchmarks, oneg, zerog, dx, dy](
-            const af::array& inArray,
-            const af::array& wtArray,
-            const af::array& gradOutputArray,
-            TensorDescriptor& iDesc,
-            FilterDescriptor& wDesc,
-            ConvDescriptor& cDesc,
-            TensorDescriptor& oDesc) {
+        // Gradients with respect to the filter
+        auto convolutionBackwardFilter = [&hndl, &wt, &benchmarks, oneg, zerog](
+                                             const af::array& inArray,
+                                             const af::array& wtArray,
+                                             const af::array& gradOutputArray,
+                                             TensorDescriptor& iDesc,
+                                             FilterDescriptor& wDesc,
+                                             ConvDescriptor& cDesc,
+                                             TensorDescriptor& oDesc) {
           if (benchmarks && DynamicBenchmark::getBenchmarkMode()) {
             setCudnnMathType(
                 cDesc,
-                benchmarks->bwdDataBenchmark
+                benchmarks->bwdFilterBenchmark
                     ->getOptions<DynamicBenchmarkOptions<KernelMode>>());
           }
 
-          DevicePtr wPtr(wtArray);
-          if (in.isCalcGrad()) {
-            bool isStrided = (dx * dy) > 1;
-            auto bwdDataAlgoBestPerf = getBwdDataAlgo(
+          DevicePtr iPtr(inArray);
+          if (wt.isCalcGrad()) {
+            auto bwdFilterAlgoBestPerf = getBwdFilterAlgo(
                 iDesc.descriptor,
                 wDesc.descriptor,
                 cDesc.descriptor,
                 oDesc.descriptor,
-                isStrided,
                 inArray.type());
 
             af::array ws;
             try {
-              ws = af::array(bwdDataAlgoBestPerf.memory, af::dtype::b8);
+              ws = af::array(bwdFilterAlgoBestPerf.memory, af::dtype::b8);
             } catch (const std::exception& e) {
-              bwdDataAlgoBestPerf.algo = kBwdDataDefaultAlgo;
-              CUDNN_CHECK_ERR(cudnnGetConvolutionBackwardDataWorkspaceSize(
+              bwdFilterAlgoBestPerf.algo = kBwdFilterDefaultAlgo;
+              CUDNN_CHECK_ERR(cudnnGetConvolutionBackwardFilterWorkspaceSize(
                   hndl,
-                  wDesc.descriptor,
+                  iDesc.descriptor,
                   oDesc.descriptor,
                   cDesc.descriptor,
-                  iDesc.descriptor,
-                  bwdDataAlgoBestPerf.algo,
-                  &bwdDataAlgoBestPerf.memory));
-              ws = af::array(bwdDataAlgoBestPerf.memory, af::dtype::b8);
+                  wDesc.descriptor,
+                  bwdFilterAlgoBestPerf.algo,
+                  &bwdFilterAlgoBestPerf.memory));
+              ws = af::array(bwdFilterAlgoBestPerf.memory, af::dtype::b8);
             }
-            auto gradInput =
-                Variable(af::array(inArray.dims(), inArray.type()), false);
+            auto gradWeight =
+                Variable(af::array(wtArray.dims(), wtArray.type()), false);
             {
-              DevicePtr gradInputPtr(gradInput.array());
+              DevicePtr gradWeightPtr(gradWeight.array());
               DevicePtr gradResultPtr(gradOutputArray);
               DevicePtr wsPtr(ws);
-              CUDNN_CHECK_ERR(cudnnConvolutionBackwardData(
+              CUDNN_CHECK_ERR(cudnnConvolutionBackwardFilter(
                   hndl,
                   oneg,
-                  wDesc.descriptor,
-                  wPtr.get(),
+                  iDesc.descriptor,
+                  iPtr.get(),
                   oDesc.descriptor,
                   gradResultPtr.get(),
                   cDesc.descriptor,
-                  bwdDataAlgoBestPerf.algo,
+                  bwdFilterAlgoBestPerf.algo,
                   wsPtr.get(),
-                  bwdDataAlgoBestPerf.memory,
+                  bwdFilterAlgoBestPerf.memory,
                   zerog,
-                  iDesc.descriptor,
-                  gradInputPtr.get()));
+                  wDesc.descriptor,
+                  gradWeightPtr.get()));
             }
-            in.addGrad(gradInput);
+            wt.addGrad(gradWeight);
           }
         };
 
-    if (benchmarks && DynamicBenchmark::getBenchmarkMode()) {
-      KernelMode dataBwdOption =
-          benchmarks->bwdDataBenchmark
-              ->getOptions<DynamicBenchmarkOptions<KernelMode>>()
-              ->currentOption();
-
-      if (in.type() == af::dtype::f16 && dataBwdOption == KernelMode::F32 &&
-          dataBwdOption == KernelMode::F32_ALLOW_CONVERSION) {
-        // The input type of fp16, but the result of the dynamic benchmark is
-        // that using fp32 kernels is faster for computing bwd with fp16
-        // kernels, including the cast
-        af::array inArrayF32;
-        af::array wtArrayF32;
-        af::array gradOutputArrayF32;
-        benchmarks->bwdDataBenchmark->audit(
-            [&in,
-             &inArrayF32,
-             &wt,
-             &wtArrayF32,
-             &gradOutput,
-             &gradOutputArrayF32]() {
-              inArrayF32 = in.array().as(af::dtype::f32);
-              wtArrayF32 = wt.array().as(af::dtype::f32);
-              gradOutputArrayF32 = gradOutput.array().as(af::dtype::f32);
-            },
-            /* incrementCount = */ false);
-
-        auto iDescF32 = TensorDescriptor(inArrayF32);
-        auto wDescF32 = FilterDescriptor(wtArrayF32);
-        auto cDescF32 =
-            ConvDescriptor(af::dtype::f32, px, py, sx, sy, dx, dy, groups);
-        auto oDescF32 = TensorDescriptor(gradOutputArrayF32);
-        // core bwd data computation
-        benchmarks->bwdDataBenchmark->audit([&convolutionBackwardData,
-                                             &inArrayF32,
-                                             &wtArrayF32,
-                                             &gradOutputArrayF32,
-                                             &iDescF32,
-                                             &wDescF32,
-                                             &cDescF32,
-                                             &oDescF32]() {
-          convolutionBackwardData(
-              inArrayF32,
-              wtArrayF32,
-              gradOutputArrayF32,
-              iDescF32,
-              wDescF32,
-              cDescF32,
-              oDescF32);
-        });
-      } else {
-        benchmarks->bwdDataBenchmark->audit([&convolutionBackwardData,
-                                             &in,
-                                             &wt,
-                                             &gradOutput,
-                                             &iDesc,
-                                             &wDesc,
-                                             &cDesc,
-                                             &oDesc]() {
-          convolutionBackwardData(
-              in.array(),
-              wt.array(),
-              gradOutput.array(),
-              iDesc,
-              wDesc,
-              cDesc,
-              oDesc);
-        });
-      }
-    } else {
-      // No benchmarking - proceed normally
-      convolutionBackwardData(
-          in.array(),
-          wt.array(),
-          gradOutput.array(),
-          iDesc,
-          wDesc,
-          cDesc,
-          oDesc);
-    }
-
-    // Gradients with respect to the filter
-    auto convolutionBackwardFilter = [&hndl, &wt, &benchmarks, oneg, zerog](
-                                         const af::array& inArray,
-                                         const af::array& wtArray,
-                                         const af::array& gradOutputArray,
-                                         TensorDescriptor& iDesc,
-                                         FilterDescriptor& wDesc,
-                                         ConvDescriptor& cDesc,
-                                         TensorDescriptor& oDesc) {
-      if (benchmarks && DynamicBenchmark::getBenchmarkMode()) {
-        setCudnnMathType(
-            cDesc,
-            benchmarks->bwdFilterBenchmark
-                ->getOptions<DynamicBenchmarkOptions<KernelMode>>());
-      }
-
-      DevicePtr iPtr(inArray);
-      if (wt.isCalcGrad()) {
-        auto bwdFilterAlgoBestPerf = getBwdFilterAlgo(
-            iDesc.descriptor,
-            wDesc.descriptor,
-            cDesc.descriptor,
-            oDesc.descriptor,
-            inArray.type());
-
-        af::array ws;
-        try {
-          ws = af::array(bwdFilterAlgoBestPerf.memory, af::dtype::b8);
-        } catch (const std::exception& e) {
-          bwdFilterAlgoBestPerf.algo = kBwdFilterDefaultAlgo;
-          CUDNN_CHECK_ERR(cudnnGetConvolutionBackwardFilterWorkspaceSize(
-              hndl,
-              iDesc.descriptor,
-              oDesc.descriptor,
-              cDesc.descriptor,
-              wDesc.descriptor,
-              bwdFilterAlgoBestPerf.algo,
-              &bwdFilterAlgoBestPerf.memory));
-          ws = af::array(bwdFilterAlgoBestPerf.memory, af::dtype::b8);
-        }
-        auto gradWeight =
-            Variable(af::array(wtArray.dims(), wtArray.type()), false);
-        {
-          DevicePtr gradWeightPtr(gradWeight.array());
-          DevicePtr gradResultPtr(gradOutputArray);
-          DevicePtr wsPtr(ws);
-          CUDNN_CHECK_ERR(cudnnConvolutionBackwardFilter(
-              hndl,
-              oneg,
-              iDesc.descriptor,
-              iPtr.get(),
-              oDesc.descriptor,
-              gradResultPtr.get(),
-              cDesc.descriptor,
-              bwdFilterAlgoBestPerf.algo,
-              wsPtr.get(),
-              bwdFilterAlgoBestPerf.memory,
-              zerog,
-              wDesc.descriptor,
-              gradWeightPtr.get()));
-        }
-        wt.addGrad(gradWeight);
-      }
-    };
-
-    if (benchmarks && DynamicBenchmark::getBenchmarkMode()) {
-      KernelMode dataBwdOption =
-          benchmarks->bwdFilterBenchmark
-              ->getOptions<DynamicBenchmarkOptions<KernelMode>>()
-              ->currentOption();
-
-      if (in.type() == af::dtype::f16 && dataBwdOption == KernelMode::F32 &&
-          dataBwdOption == KernelMode::F32_ALLOW_CONVERSION) {
-        // The input type of fp16, but the result of the dynamic benchmark is
-        // that using fp32 kernels is faster for computing bwd with fp16
-        // kernels, including the cast
-        af::array inArrayF32;
-        af::array wtArrayF32;
-        af::array gradOutputArrayF32;
-        benchmarks->bwdFilterBenchmark->audit(
-            [&in,
-             &inArrayF32,
-             &wt,
-             &wtArrayF32,
-             &gradOutput,
-             &gradOutputArrayF32]() {
-              inArrayF32 = in.array().as(af::dtype::f32);
-              wtArrayF32 = wt.array().as(af::dtype::f32);
-              gradOutputArrayF32 = gradOutput.array().as(af::dtype::f32);
-            },
-            /* incrementCount = */ false);
-
-        auto iDescF32 = TensorDescriptor(inArrayF32);
-        auto wDescF32 = FilterDescriptor(wtArrayF32);
-        auto cDescF32 =
-            ConvDescriptor(af::dtype::f32, px, py, sx, sy, dx, dy, groups);
-        auto oDescF32 = TensorDescriptor(gradOutputArrayF32);
-        // core bwd data computation
-        benchmarks->bwdFilterBenchmark->audit([&convolutionBackwardFilter,
-                                               &inArrayF32,
-                                               &wtArrayF32,
-                                               &gradOutputArrayF32,
-                                               &iDescF32,
-                                               &wDescF32,
-                                               &cDescF32,
-                                               &oDescF32]() {
-          convolutionBackwardFilter(
-              inArrayF32,
-              wtArrayF32,
-              gradOutputArrayF32,
-              iDescF32,
-              wDescF32,
-              cDescF32,
-              oDescF32);
-        });
-      } else {
-        benchmarks->bwdFilterBenchmark->audit([&convolutionBackwardFilter,
-                                               &in,
-                                               &wt,
-                                               &gradOutput,
-                                               &iDesc,
-                                               &wDesc,
-                                               &cDesc,
-                                               &oDesc]() {
+        if (benchmarks && DynamicBenchmark::getBenchmarkMode()) {
+          KernelMode dataBwdOption =
+              benchmarks->bwdFilterBenchmark
+                  ->getOptions<DynamicBenchmarkOptions<KernelMode>>()
+                  ->currentOption();
+
+          if (in.type() == af::dtype::f16 && dataBwdOption == KernelMode::F32 &&
+              dataBwdOption == KernelMode::F32_ALLOW_CONVERSION) {
+            // The input type of fp16, but the result of the dynamic benchmark
+            // is that using fp32 kernels is faster for computing bwd with fp16
+            // kernels, including the cast
+            af::array inArrayF32;
+            af::array wtArrayF32;
+            af::array gradOutputArrayF32;
+            benchmarks->bwdFilterBenchmark->audit(
+                [&in,
+                 &inArrayF32,
+                 &wt,
+                 &wtArrayF32,
+                 &gradOutput,
+                 &gradOutputArrayF32]() {
+                  inArrayF32 = in.array().as(af::dtype::f32);
+                  wtArrayF32 = wt.array().as(af::dtype::f32);
+                  gradOutputArrayF32 = gradOutput.array().as(af::dtype::f32);
+                },
+                /* incrementCount = */ false);
+
+            auto iDescF32 = TensorDescriptor(inArrayF32, layout);
+            auto wDescF32 = FilterDescriptor(wtArrayF32, layout);
+            auto cDescF32 =
+                ConvDescriptor(af::dtype::f32, px, py, sx, sy, dx, dy, groups);
+            auto oDescF32 = TensorDescriptor(gradOutputArrayF32, layout);
+            // core bwd data computation
+            benchmarks->bwdFilterBenchmark->audit([&convolutionBackwardFilter,
+                                                   &inArrayF32,
+                                                   &wtArrayF32,
+                                                   &gradOutputArrayF32,
+                                                   &iDescF32,
+                                                   &wDescF32,
+                                                   &cDescF32,
+                                                   &oDescF32]() {
+              convolutionBackwardFilter(
+                  inArrayF32,
+                  wtArrayF32,
+                  gradOutputArrayF32,
+                  iDescF32,
+                  wDescF32,
+                  cDescF32,
+                  oDescF32);
+            });
+          } else {
+            benchmarks->bwdFilterBenchmark->audit([&convolutionBackwardFilter,
+                                                   &in,
+                                                   &wt,
+                                                   &gradOutput,
+                                                   &iDesc,
+                                                   &wDesc,
+                                                   &cDesc,
+                                                   &oDesc]() {
+              convolutionBackwardFilter(
+                  in.array(),
+                  wt.array(),
+                  gradOutput.array(),
+                  iDesc,
+                  wDesc,
+                  cDesc,
+                  oDesc);
+            });
+          }
+        } else {
           convolutionBackwardFilter(
               in.array(),
               wt.array(),
@@ -738,19 +816,12 @@ Variable conv2d(
               wDesc,
               cDesc,
               oDesc);
-        });
-      }
-    } else {
-      convolutionBackwardFilter(
-          in.array(),
-          wt.array(),
-          gradOutput.array(),
-          iDesc,
-          wDesc,
-          cDesc,
-          oDesc);
-    }
-  };
+        }
+      };
+
+  // Each output element is a dot product over a filter
+  detail::FlopCounter::add(
+      2.0 * output.elements() * weights.elements() / weights.dims(3));
 
   if (hasBias) {
     return Variable(output, {input, weights, bias}, gradFunc);
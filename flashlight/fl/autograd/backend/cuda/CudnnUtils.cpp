@@ -8,6 +8,9 @@
 #include "flashlight/fl/autograd/backend/cuda/CudnnUtils.h"
 
 #include <array>
+#include <cstring>
+#include <functional>
+#include <map>
 #include <stdexcept>
 #include <unordered_map>
 
@@ -54,6 +57,61 @@ struct CudnnDropoutStruct {
 };
 #endif
 
+// Size at which the cache of a kind of descriptors (of a thread) is cleared
+constexpr size_t kMaxCachedDescriptors = 1024;
+
+using DescriptorKey = std::vector<int64_t>;
+
+// Returns the descriptor of `Descriptor` kind cached for `key`, or caches the
+// one returned by `create`
+template <typename Descriptor>
+std::shared_ptr<void> cachedDescriptor(
+    const DescriptorKey& key,
+    const std::function<std::shared_ptr<void>()>& create) {
+  thread_local std::map<DescriptorKey, std::shared_ptr<void>> cache;
+  auto it = cache.find(key);
+  if (it != cache.end()) {
+    return it->second;
+  }
+  if (cache.size() >= kMaxCachedDescriptors) {
+    // Descriptors still in use are destroyed with their last user
+    cache.clear();
+  }
+  auto handle = create();
+  cache.emplace(key, handle);
+  return handle;
+}
+
+int64_t floatBits(float value) {
+  int32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+std::shared_ptr<void> tensorDescriptor(
+    cudnnDataType_t type,
+    const std::array<int, 4>& dims,
+    const std::array<int, 4>& strides) {
+  DescriptorKey key = {type};
+  key.insert(key.end(), dims.begin(), dims.end());
+  key.insert(key.end(), strides.begin(), strides.end());
+  return cachedDescriptor<cudnnTensorDescriptor_t>(key, [&]() {
+    cudnnTensorDescriptor_t descriptor;
+    CUDNN_CHECK_ERR(cudnnCreateTensorDescriptor(&descriptor));
+    std::shared_ptr<void> handle(descriptor, [](void* d) {
+      CUDNN_CHECK_ERR(cudnnDestroyTensorDescriptor(
+          static_cast<cudnnTensorDescriptor_t>(d)));
+    });
+    CUDNN_CHECK_ERR(cudnnSetTensorNdDescriptor(
+        descriptor /* descriptor handle */,
+        type /* = dataType */,
+        4,
+        dims.data(),
+        strides.data()));
+    return handle;
+  });
+}
+
 } // namespace
 
 namespace fl {
@@ -112,31 +170,39 @@ cudnnRNNMode_t cudnnMapToRNNMode(const RnnMode mode) {
   }
 }
 
-TensorDescriptor::TensorDescriptor(const Variable& input)
-    : TensorDescriptor(input.array()) {}
+TensorDescriptor::TensorDescriptor(
+    const Variable& input,
+    ImageLayout layout /* = ImageLayout::WHCN */)
+    : TensorDescriptor(input.array(), layout) {}
 
 TensorDescriptor::TensorDescriptor(
     const af::dtype type,
-    const af::dim4& af_dims) {
-  CUDNN_CHECK_ERR(cudnnCreateTensorDescriptor(&descriptor));
+    const af::dim4& af_dims,
+    ImageLayout layout /* = ImageLayout::WHCN */) {
   cudnnDataType_t cudnntype = cudnnMapToType(type);
 
   std::array<int, 4> dims = {
       (int)af_dims[3], (int)af_dims[2], (int)af_dims[1], (int)af_dims[0]};
 
   // Sets strides so array is contiguous row-major for cudnn
-  std::vector<int> r_strides = {1};
-  for (auto it = dims.rbegin(); it != dims.rend() - 1; ++it) {
-    r_strides.push_back(r_strides.back() * (*it));
+  std::array<int, 4> strides;
+  strides[3] = 1;
+  for (int i = 2; i >= 0; --i) {
+    strides[i] = strides[i + 1] * dims[i + 1];
+  }
+  if (layout == ImageLayout::CWHN) {
+    int c = af_dims[0], w = af_dims[1], h = af_dims[2];
+    dims = {(int)af_dims[3], c, h, w};
+    strides = {c * w * h, 1, c * w, c};
   }
-  std::vector<int> strides(r_strides.rbegin(), r_strides.rend());
 
-  CUDNN_CHECK_ERR(cudnnSetTensorNdDescriptor(
-      descriptor, cudnntype, dims.size(), dims.data(), strides.data()));
+  handle_ = tensorDescriptor(cudnntype, dims, strides);
+  descriptor = static_cast<cudnnTensorDescriptor_t>(handle_.get());
 }
 
-TensorDescriptor::TensorDescriptor(const af::array& input) {
-  CUDNN_CHECK_ERR(cudnnCreateTensorDescriptor(&descriptor));
+TensorDescriptor::TensorDescriptor(
+    const af::array& input,
+    ImageLayout layout /* = ImageLayout::WHCN */) {
   cudnnDataType_t cudnntype = cudnnMapToType(input.type());
 
   auto afstrides = af::getStrides(input);
@@ -149,18 +215,20 @@ TensorDescriptor::TensorDescriptor(const af::array& input) {
                                 (int)afstrides[0]};
   std::array<int, 4> dims = {
       (int)afdims[3], (int)afdims[2], (int)afdims[1], (int)afdims[0]};
+  if (layout == ImageLayout::CWHN) {
+    // NCHW dimensions with the strides of NHWC
+    strides = {(int)afstrides[3],
+               (int)afstrides[0],
+               (int)afstrides[2],
+               (int)afstrides[1]};
+    dims = {(int)afdims[3], (int)afdims[0], (int)afdims[2], (int)afdims[1]};
+  }
 
-  CUDNN_CHECK_ERR(cudnnSetTensorNdDescriptor(
-      descriptor /* descriptor handle */,
-      cudnntype /* = dataType */,
-      4,
-      dims.data(),
-      strides.data()));
+  handle_ = tensorDescriptor(cudnntype, dims, strides);
+  descriptor = static_cast<cudnnTensorDescriptor_t>(handle_.get());
 }
 
-TensorDescriptor::~TensorDescriptor() {
-  CUDNN_CHECK_ERR(cudnnDestroyTensorDescriptor(descriptor));
-}
+TensorDescriptor::~TensorDescriptor() = default;
 
 TensorDescriptorArray::TensorDescriptorArray(
     int size,
@@ -184,78 +252,132 @@ PoolingDescriptor::PoolingDescriptor(
     int px,
     int py,
     PoolingMode mode) {
-  CUDNN_CHECK_ERR(cudnnCreatePoolingDescriptor(&descriptor));
   std::array<int, 2> window = {(int)wy, (int)wx};
   std::array<int, 2> padding = {(int)py, (int)px};
   std::array<int, 2> stride = {(int)sy, (int)sx};
 
   auto cudnnpoolingmode = cudnnMapToPoolingMode(mode);
-  CUDNN_CHECK_ERR(cudnnSetPoolingNdDescriptor(
-      descriptor,
-      cudnnpoolingmode,
-      CUDNN_PROPAGATE_NAN,
-      2,
-      window.data(),
-      padding.data(),
-      stride.data()));
+  DescriptorKey key = {wx, wy, sx, sy, px, py, cudnnpoolingmode};
+  handle_ = cachedDescriptor<cudnnPoolingDescriptor_t>(key, [&]() {
+    cudnnPoolingDescriptor_t desc;
+    CUDNN_CHECK_ERR(cudnnCreatePoolingDescriptor(&desc));
+    std::shared_ptr<void> handle(desc, [](void* d) {
+      CUDNN_CHECK_ERR(cudnnDestroyPoolingDescriptor(
+          static_cast<cudnnPoolingDescriptor_t>(d)));
+    });
+    CUDNN_CHECK_ERR(cudnnSetPoolingNdDescriptor(
+        desc,
+        cudnnpoolingmode,
+        CUDNN_PROPAGATE_NAN,
+        2,
+        window.data(),
+        padding.data(),
+        stride.data()));
+    return handle;
+  });
+  descriptor = static_cast<cudnnPoolingDescriptor_t>(handle_.get());
 }
 
-PoolingDescriptor::~PoolingDescriptor() {
-  CUDNN_CHECK_ERR(cudnnDestroyPoolingDescriptor(descriptor));
+PoolingDescriptor::~PoolingDescriptor() = default;
+
+ActivationDescriptor::ActivationDescriptor() {
+  DescriptorKey key = {CUDNN_ACTIVATION_RELU};
+  handle_ = cachedDescriptor<cudnnActivationDescriptor_t>(key, []() {
+    cudnnActivationDescriptor_t desc;
+    CUDNN_CHECK_ERR(cudnnCreateActivationDescriptor(&desc));
+    std::shared_ptr<void> handle(desc, [](void* d) {
+      CUDNN_CHECK_ERR(cudnnDestroyActivationDescriptor(
+          static_cast<cudnnActivationDescriptor_t>(d)));
+    });
+    CUDNN_CHECK_ERR(cudnnSetActivationDescriptor(
+        desc, CUDNN_ACTIVATION_RELU, CUDNN_PROPAGATE_NAN, 0.0));
+    return handle;
+  });
+  descriptor = static_cast<cudnnActivationDescriptor_t>(handle_.get());
 }
 
-FilterDescriptor::FilterDescriptor(const Variable& input)
-    : FilterDescriptor(input.array()) {}
+ActivationDescriptor::~ActivationDescriptor() = default;
+
+FilterDescriptor::FilterDescriptor(
+    const Variable& input,
+    ImageLayout layout /* = ImageLayout::WHCN */)
+    : FilterDescriptor(input.array(), layout) {}
 
-FilterDescriptor::FilterDescriptor(const af::array& input) {
-  CUDNN_CHECK_ERR(cudnnCreateFilterDescriptor(&descriptor));
+FilterDescriptor::FilterDescriptor(
+    const af::array& input,
+    ImageLayout layout /* = ImageLayout::WHCN */) {
   cudnnDataType_t cudnntype = cudnnMapToType(input.type());
   auto afdims = input.dims();
   std::array<int, 4> dims = {
       (int)afdims[3], (int)afdims[2], (int)afdims[1], (int)afdims[0]};
+  auto format = CUDNN_TENSOR_NCHW;
+  if (layout == ImageLayout::CWHN) {
+    // KCRS dimensions, stored as KRSC
+    dims = {(int)afdims[3], (int)afdims[0], (int)afdims[2], (int)afdims[1]};
+    format = CUDNN_TENSOR_NHWC;
+  }
 
-  CUDNN_CHECK_ERR(cudnnSetFilterNdDescriptor(
-      descriptor, cudnntype, CUDNN_TENSOR_NCHW, 4, dims.data()));
+  DescriptorKey key = {cudnntype, format};
+  key.insert(key.end(), dims.begin(), dims.end());
+  handle_ = cachedDescriptor<cudnnFilterDescriptor_t>(key, [&]() {
+    cudnnFilterDescriptor_t desc;
+    CUDNN_CHECK_ERR(cudnnCreateFilterDescriptor(&desc));
+    std::shared_ptr<void> handle(desc, [](void* d) {
+      CUDNN_CHECK_ERR(cudnnDestroyFilterDescriptor(
+          static_cast<cudnnFilterDescriptor_t>(d)));
+    });
+    CUDNN_CHECK_ERR(
+        cudnnSetFilterNdDescriptor(desc, cudnntype, format, 4, dims.data()));
+    return handle;
+  });
+  descriptor = static_cast<cudnnFilterDescriptor_t>(handle_.get());
 }
 
-FilterDescriptor::~FilterDescriptor() {
-  CUDNN_CHECK_ERR(cudnnDestroyFilterDescriptor(descriptor));
-}
+FilterDescriptor::~FilterDescriptor() = default;
 
 DropoutDescriptor::DropoutDescriptor(float drop_prob) {
-  CUDNN_CHECK_ERR(cudnnCreateDropoutDescriptor(&descriptor));
-  auto handle = getCudnnHandle();
-  unsigned long long seed = 0;
-  size_t state_size;
-  CUDNN_CHECK_ERR(cudnnDropoutGetStatesSize(handle, &state_size));
-  auto& dropout_states = getDropoutStates();
-  if (dropout_states.isempty()) {
-    dropout_states = af::array(state_size, af::dtype::b8);
-    DevicePtr statesraw(dropout_states);
-    CUDNN_CHECK_ERR(cudnnSetDropoutDescriptor(
-        descriptor, handle, drop_prob, statesraw.get(), state_size, seed));
-  } else {
-    DevicePtr statesraw(dropout_states);
+  DescriptorKey key = {af::getDevice(), floatBits(drop_prob)};
+  handle_ = cachedDescriptor<cudnnDropoutDescriptor_t>(key, [&]() {
+    cudnnDropoutDescriptor_t desc;
+    CUDNN_CHECK_ERR(cudnnCreateDropoutDescriptor(&desc));
+    std::shared_ptr<void> handle(desc, [](void* d) {
+      CUDNN_CHECK_ERR(cudnnDestroyDropoutDescriptor(
+          static_cast<cudnnDropoutDescriptor_t>(d)));
+    });
+    auto cudnnHandle = getCudnnHandle();
+    unsigned long long seed = 0;
+    size_t state_size;
+    CUDNN_CHECK_ERR(cudnnDropoutGetStatesSize(cudnnHandle, &state_size));
+    auto& dropout_states = getDropoutStates();
+    if (dropout_states.isempty()) {
+      // Initializes the states, which is expensive
+      dropout_states = af::array(state_size, af::dtype::b8);
+      DevicePtr statesraw(dropout_states);
+      CUDNN_CHECK_ERR(cudnnSetDropoutDescriptor(
+          desc, cudnnHandle, drop_prob, statesraw.get(), state_size, seed));
+    } else {
+      DevicePtr statesraw(dropout_states);
 // See https://git.io/fp9oo for an explanation.
 #if CUDNN_VERSION >= 7000
-    CUDNN_CHECK_ERR(cudnnRestoreDropoutDescriptor(
-        descriptor, handle, drop_prob, statesraw.get(), state_size, seed));
+      CUDNN_CHECK_ERR(cudnnRestoreDropoutDescriptor(
+          desc, cudnnHandle, drop_prob, statesraw.get(), state_size, seed));
 #else
-    auto dropout_struct = reinterpret_cast<CudnnDropoutStruct*>(descriptor);
-    dropout_struct->dropout = drop_prob;
-    dropout_struct->nstates = state_size;
-    dropout_struct->states = statesraw.get();
+      auto dropout_struct = reinterpret_cast<CudnnDropoutStruct*>(desc);
+      dropout_struct->dropout = drop_prob;
+      dropout_struct->nstates = state_size;
+      dropout_struct->states = statesraw.get();
 #endif
-  }
+    }
+    return handle;
+  });
+  descriptor = static_cast<cudnnDropoutDescriptor_t>(handle_.get());
 }
 
-DropoutDescriptor::~DropoutDescriptor() {
-  CUDNN_CHECK_ERR(cudnnDestroyDropoutDescriptor(descriptor));
-}
+DropoutDescriptor::~DropoutDescriptor() = default;
 
 af::array& DropoutDescriptor::getDropoutStates() {
-  thread_local af::array dropout_states;
-  return dropout_states;
+  thread_local std::unordered_map<int, af::array> dropout_states;
+  return dropout_states[af::getDevice()];
 }
 
 RNNDescriptor::RNNDescriptor(
@@ -265,8 +387,6 @@ RNNDescriptor::RNNDescriptor(
     RnnMode mode,
     bool bidirectional,
     DropoutDescriptor& dropout) {
-  CUDNN_CHECK_ERR(cudnnCreateRNNDescriptor(&descriptor));
-
   auto handle = getCudnnHandle();
 
   cudnnRNNInputMode_t in_mode = CUDNN_LINEAR_INPUT;
@@ -278,37 +398,87 @@ RNNDescriptor::RNNDescriptor(
   cudnnRNNAlgo_t algo = CUDNN_RNN_ALGO_STANDARD;
   cudnnDataType_t cudnntype = cudnnMapToType(type);
 
-#if CUDNN_VERSION >= 7000 && CUDNN_VERSION < 8000 
-  CUDNN_CHECK_ERR(cudnnSetRNNDescriptor(
-      handle,
-      descriptor,
+  // The dropout descriptor is used by the RNN descriptor: kept with it
+  auto dropoutHandle = dropout.handle_;
+  DescriptorKey key = {
+      af::getDevice(),
+      cudnntype,
       hidden_size,
       num_layers,
-      dropout.descriptor,
-      in_mode,
-      dir,
       cell,
-      algo,
-      cudnntype));
-#else
-  CUDNN_CHECK_ERR(cudnnSetRNNDescriptor_v6(
-      handle,
-      descriptor,
-      hidden_size,
-      num_layers,
-      dropout.descriptor,
-      in_mode,
       dir,
-      cell,
-      algo,
-      cudnntype));
+      reinterpret_cast<int64_t>(dropoutHandle.get())};
+  handle_ = cachedDescriptor<cudnnRNNDescriptor_t>(key, [&]() {
+    cudnnRNNDescriptor_t desc;
+    CUDNN_CHECK_ERR(cudnnCreateRNNDescriptor(&desc));
+    std::shared_ptr<void> rnnHandle(desc, [dropoutHandle](void* d) {
+      CUDNN_CHECK_ERR(
+          cudnnDestroyRNNDescriptor(static_cast<cudnnRNNDescriptor_t>(d)));
+    });
+#if CUDNN_VERSION >= 7000 && CUDNN_VERSION < 8000
+    CUDNN_CHECK_ERR(cudnnSetRNNDescriptor(
+        handle,
+        desc,
+        hidden_size,
+        num_layers,
+        dropout.descriptor,
+        in_mode,
+        dir,
+        cell,
+        algo,
+        cudnntype));
+#else
+    CUDNN_CHECK_ERR(cudnnSetRNNDescriptor_v6(
+        handle,
+        desc,
+        hidden_size,
+        num_layers,
+        dropout.descriptor,
+        in_mode,
+        dir,
+        cell,
+        algo,
+        cudnntype));
 #endif
+    return rnnHandle;
+  });
+  descriptor = static_cast<cudnnRNNDescriptor_t>(handle_.get());
 }
 
-RNNDescriptor::~RNNDescriptor() {
-  CUDNN_CHECK_ERR(cudnnDestroyRNNDescriptor(descriptor));
+RNNDescriptor::~RNNDescriptor() = default;
+
+RNNDataDescriptor::RNNDataDescriptor(
+    af::dtype type,
+    int maxSeqLength,
+    int batchSize,
+    int vectorSize,
+    const std::vector<int>& seqLengths) {
+  auto cudnntype = cudnnMapToType(type);
+  DescriptorKey key = {cudnntype, maxSeqLength, batchSize, vectorSize};
+  key.insert(key.end(), seqLengths.begin(), seqLengths.end());
+  handle_ = cachedDescriptor<cudnnRNNDataDescriptor_t>(key, [&]() {
+    cudnnRNNDataDescriptor_t desc;
+    CUDNN_CHECK_ERR(cudnnCreateRNNDataDescriptor(&desc));
+    std::shared_ptr<void> handle(desc, [](void* d) {
+      CUDNN_CHECK_ERR(cudnnDestroyRNNDataDescriptor(
+          static_cast<cudnnRNNDataDescriptor_t>(d)));
+    });
+    CUDNN_CHECK_ERR(cudnnSetRNNDataDescriptor(
+        desc,
+        cudnntype,
+        CUDNN_RNN_DATA_LAYOUT_SEQ_MAJOR_UNPACKED,
+        maxSeqLength,
+        batchSize,
+        vectorSize,
+        seqLengths.data(),
+        const_cast<void*>(kZero(type)) /* paddingFill */));
+    return handle;
+  });
+  descriptor = static_cast<cudnnRNNDataDescriptor_t>(handle_.get());
 }
 
+RNNDataDescriptor::~RNNDataDescriptor() = default;
+
 ConvDescriptor::ConvDescriptor(
     af::dtype type,
     int px,
@@ -318,27 +488,34 @@ ConvDescriptor::ConvDescriptor(
     int dx,
     int dy,
     int groups) {
-  CUDNN_CHECK_ERR(cudnnCreateConvolutionDescriptor(&descriptor));
   cudnnDataType_t cudnntype = cudnnMapToType(type);
   std::array<int, 2> padding = {(int)py, (int)px};
   std::array<int, 2> stride = {(int)sy, (int)sx};
   std::array<int, 2> dilation = {(int)dy, (int)dx};
 
-  CUDNN_CHECK_ERR(cudnnSetConvolutionNdDescriptor(
-      descriptor,
-      2,
-      padding.data(),
-      stride.data(),
-      dilation.data(),
-      CUDNN_CROSS_CORRELATION,
-      cudnntype));
-
-  CUDNN_CHECK_ERR(cudnnSetConvolutionGroupCount(descriptor, groups));
+  DescriptorKey key = {cudnntype, px, py, sx, sy, dx, dy, groups};
+  handle_ = cachedDescriptor<cudnnConvolutionDescriptor_t>(key, [&]() {
+    cudnnConvolutionDescriptor_t desc;
+    CUDNN_CHECK_ERR(cudnnCreateConvolutionDescriptor(&desc));
+    std::shared_ptr<void> handle(desc, [](void* d) {
+      CUDNN_CHECK_ERR(cudnnDestroyConvolutionDescriptor(
+          static_cast<cudnnConvolutionDescriptor_t>(d)));
+    });
+    CUDNN_CHECK_ERR(cudnnSetConvolutionNdDescriptor(
+        desc,
+        2,
+        padding.data(),
+        stride.data(),
+        dilation.data(),
+        CUDNN_CROSS_CORRELATION,
+        cudnntype));
+    CUDNN_CHECK_ERR(cudnnSetConvolutionGroupCount(desc, groups));
+    return handle;
+  });
+  descriptor = static_cast<cudnnConvolutionDescriptor_t>(handle_.get());
 }
 
-ConvDescriptor::~ConvDescriptor() {
-  CUDNN_CHECK_ERR(cudnnDestroyConvolutionDescriptor(descriptor));
-}
+ConvDescriptor::~ConvDescriptor() = default;
 
 cudnnHandle_t getCudnnHandle() {
   int af_id = af::getDevice();
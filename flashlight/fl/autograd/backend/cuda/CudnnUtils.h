@@ -7,6 +7,9 @@
 
 #pragma once
 
+#include <memory>
+#include <vector>
+
 #include <arrayfire.h>
 #include <cudnn.h>
 
@@ -15,15 +18,36 @@
 
 namespace fl {
 
+/*
+ * The descriptors below are taken from thread-local caches keyed by the
+ * parameters they are set with (shapes, strides, types...), so that ops of
+ * the same shapes share them instead of creating and setting new ones at each
+ * call. A cached descriptor is destroyed once evicted and no longer used.
+ * Settings applied to `descriptor` after construction (e.g. the math type)
+ * are shared with the next users: ops set them before each use.
+ */
+
 class TensorDescriptor {
  public:
-  explicit TensorDescriptor(const af::array& a);
-  explicit TensorDescriptor(const Variable& a);
-
-  TensorDescriptor(const af::dtype type, const af::dim4& af_dims);
+  // With `ImageLayout::CWHN`, describes a C x W x H x N array as NHWC
+  explicit TensorDescriptor(
+      const af::array& a,
+      ImageLayout layout = ImageLayout::WHCN);
+  explicit TensorDescriptor(
+      const Variable& a,
+      ImageLayout layout = ImageLayout::WHCN);
+
+  // Contiguous tensor of dimensions `af_dims`
+  TensorDescriptor(
+      const af::dtype type,
+      const af::dim4& af_dims,
+      ImageLayout layout = ImageLayout::WHCN);
 
   cudnnTensorDescriptor_t descriptor;
   ~TensorDescriptor();
+
+ private:
+  std::shared_ptr<void> handle_;
 };
 
 class TensorDescriptorArray {
@@ -40,10 +64,19 @@ class TensorDescriptorArray {
 
 class FilterDescriptor {
  public:
-  explicit FilterDescriptor(const af::array& a);
-  explicit FilterDescriptor(const Variable& a);
+  // With `ImageLayout::CWHN`, describes C_in x K_x x K_y x C_out filters as
+  // NHWC
+  explicit FilterDescriptor(
+      const af::array& a,
+      ImageLayout layout = ImageLayout::WHCN);
+  explicit FilterDescriptor(
+      const Variable& a,
+      ImageLayout layout = ImageLayout::WHCN);
   cudnnFilterDescriptor_t descriptor;
   ~FilterDescriptor();
+
+ private:
+  std::shared_ptr<void> handle_;
 };
 
 class ConvDescriptor {
@@ -59,6 +92,9 @@ class ConvDescriptor {
       int groups = 1);
   cudnnConvolutionDescriptor_t descriptor;
   ~ConvDescriptor();
+
+ private:
+  std::shared_ptr<void> handle_;
 };
 
 class PoolingDescriptor {
@@ -73,6 +109,20 @@ class PoolingDescriptor {
       PoolingMode mode);
   cudnnPoolingDescriptor_t descriptor;
   ~PoolingDescriptor();
+
+ private:
+  std::shared_ptr<void> handle_;
+};
+
+// ReLU activation, fused into the batchnorm kernels
+class ActivationDescriptor {
+ public:
+  ActivationDescriptor();
+  cudnnActivationDescriptor_t descriptor;
+  ~ActivationDescriptor();
+
+ private:
+  std::shared_ptr<void> handle_;
 };
 
 class DropoutDescriptor {
@@ -81,7 +131,13 @@ class DropoutDescriptor {
   cudnnDropoutDescriptor_t descriptor;
   ~DropoutDescriptor();
 
+  // The random number generator states of the active device, initialized
+  // once per device and thread, and shared by its dropout descriptors
   af::array& getDropoutStates();
+
+ private:
+  friend class RNNDescriptor;
+  std::shared_ptr<void> handle_;
 };
 
 class RNNDescriptor {
@@ -95,6 +151,29 @@ class RNNDescriptor {
       DropoutDescriptor& dropout);
   cudnnRNNDescriptor_t descriptor;
   ~RNNDescriptor();
+
+ private:
+  std::shared_ptr<void> handle_;
+};
+
+/**
+ * Sequences of `seqLengths` steps (one per sample) in an unpacked
+ * (padded) sequence-major tensor of size vectorSize x batchSize x
+ * maxSeqLength; padded steps of an RNN output are set to zero.
+ */
+class RNNDataDescriptor {
+ public:
+  RNNDataDescriptor(
+      af::dtype type,
+      int maxSeqLength,
+      int batchSize,
+      int vectorSize,
+      const std::vector<int>& seqLengths);
+  cudnnRNNDataDescriptor_t descriptor;
+  ~RNNDataDescriptor();
+
+ private:
+  std::shared_ptr<void> handle_;
 };
 
 #define CUDNN_CHECK_ERR(expr) ::fl::cudnnCheckErr((expr))
@@ -0,0 +1,304 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cublasLt.h>
+
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#include <arrayfire.h>
+
+#include "flashlight/fl/autograd/Functions.h"
+#include "flashlight/fl/common/DevicePtr.h"
+#include "flashlight/fl/common/backend/cuda/CudaUtils.h"
+
+// The GELU and bias gradient epilogues of cuBLASLt need CUDA 11.4
+#define FL_CUBLASLT_EPILOGUES (CUDART_VERSION >= 11040)
+
+namespace fl {
+namespace detail {
+
+#if FL_CUBLASLT_EPILOGUES
+
+namespace {
+
+constexpr size_t kWorkspaceBytes = 4 << 20;
+
+void check(cublasStatus_t status, const char* call) {
+  if (status != CUBLAS_STATUS_SUCCESS) {
+    throw std::runtime_error(
+        std::string("fusedLinear: ") + call + " failed with status " +
+        std::to_string(static_cast<int>(status)));
+  }
+}
+
+cublasLtHandle_t getHandle() {
+  static std::once_flag flag;
+  static cublasLtHandle_t handle;
+  std::call_once(flag, []() { check(cublasLtCreate(&handle), "create"); });
+  return handle;
+}
+
+cudaDataType_t cudaType(af::dtype type) {
+  return type == af::dtype::f16 ? CUDA_R_16F : CUDA_R_32F;
+}
+
+// The descriptors of a cuBLASLt matrix product, destroyed with it
+struct LtMatmul {
+  cublasLtMatmulDesc_t desc{nullptr};
+  cublasLtMatrixLayout_t a{nullptr}, b{nullptr}, d{nullptr};
+  cublasLtMatmulPreference_t preference{nullptr};
+
+  ~LtMatmul() {
+    if (preference) {
+      cublasLtMatmulPreferenceDestroy(preference);
+    }
+    for (auto layout : {a, b, d}) {
+      if (layout) {
+        cublasLtMatrixLayoutDestroy(layout);
+      }
+    }
+    if (desc) {
+      cublasLtMatmulDescDestroy(desc);
+    }
+  }
+
+  template <typename T>
+  void set(cublasLtMatmulDescAttributes_t attribute, const T& value) {
+    check(
+        cublasLtMatmulDescSetAttribute(desc, attribute, &value, sizeof(value)),
+        "set attribute");
+  }
+};
+
+// Computes the column-major `d` (m x n) = `a` (m x k) * op(`b`), with `b` of
+// k x n, or n x k if `transB`, and the epilogue `epilogue`, whose bias and
+// auxiliary pointers are set by the caller with `setup`. Returns false if
+// cuBLASLt has no algorithm for the product.
+template <typename F>
+bool ltMatmul(
+    const af::array& a,
+    const af::array& b,
+    bool transB,
+    af::array& d,
+    cublasLtEpilogue_t epilogue,
+    F setup) {
+  uint64_t m = a.dims(0), k = a.dims(1), n = d.dims(1);
+  auto type = cudaType(a.type());
+  LtMatmul op;
+  check(
+      cublasLtMatmulDescCreate(&op.desc, CUBLAS_COMPUTE_32F, CUDA_R_32F),
+      "create descriptor");
+  cublasOperation_t transA = CUBLAS_OP_N;
+  cublasOperation_t opB = transB ? CUBLAS_OP_T : CUBLAS_OP_N;
+  op.set(CUBLASLT_MATMUL_DESC_TRANSA, transA);
+  op.set(CUBLASLT_MATMUL_DESC_TRANSB, opB);
+  op.set(CUBLASLT_MATMUL_DESC_EPILOGUE, epilogue);
+  setup(op);
+  check(cublasLtMatrixLayoutCreate(&op.a, type, m, k, m), "create layout");
+  check(
+      transB ? cublasLtMatrixLayoutCreate(&op.b, type, n, k, n)
+             : cublasLtMatrixLayoutCreate(&op.b, type, k, n, k),
+      "create layout");
+  check(cublasLtMatrixLayoutCreate(&op.d, type, m, n, m), "create layout");
+  check(cublasLtMatmulPreferenceCreate(&op.preference), "create preference");
+  size_t workspaceBytes = kWorkspaceBytes;
+  check(
+      cublasLtMatmulPreferenceSetAttribute(
+          op.preference,
+          CUBLASLT_MATMUL_PREF_MAX_WORKSPACE_BYTES,
+          &workspaceBytes,
+          sizeof(workspaceBytes)),
+      "set preference");
+  cublasLtMatmulHeuristicResult_t heuristic;
+  int numResults = 0;
+  auto handle = getHandle();
+  auto status = cublasLtMatmulAlgoGetHeuristic(
+      handle,
+      op.desc,
+      op.a,
+      op.b,
+      op.d,
+      op.d,
+      op.preference,
+      1,
+      &heuristic,
+      &numResults);
+  if (status != CUBLAS_STATUS_SUCCESS || numResults == 0) {
+    return false;
+  }
+
+  auto workspace = af::array(kWorkspaceBytes, af::dtype::u8);
+  float alpha = 1, beta = 0;
+  DevicePtr aRaw(a), bRaw(b), dRaw(d), workspaceRaw(workspace);
+  check(
+      cublasLtMatmul(
+          handle,
+          op.desc,
+          &alpha,
+          aRaw.get(),
+          op.a,
+          bRaw.get(),
+          op.b,
+          &beta,
+          dRaw.get(),
+          op.d,
+          dRaw.get(),
+          op.d,
+          &heuristic.algo,
+          workspaceRaw.get(),
+          kWorkspaceBytes,
+          cuda::getActiveStream()),
+      "matmul");
+  return true;
+}
+
+cublasLtEpilogue_t forwardEpilogue(
+    LinearActivation activation,
+    bool hasBias,
+    bool keepPreActivation) {
+  switch (activation) {
+    case LinearActivation::RELU:
+      return hasBias ? CUBLASLT_EPILOGUE_RELU_BIAS : CUBLASLT_EPILOGUE_RELU;
+    case LinearActivation::GELU:
+      if (keepPreActivation) {
+        return hasBias ? CUBLASLT_EPILOGUE_GELU_AUX_BIAS
+                       : CUBLASLT_EPILOGUE_GELU_AUX;
+      }
+      return hasBias ? CUBLASLT_EPILOGUE_GELU_BIAS : CUBLASLT_EPILOGUE_GELU;
+    default:
+      return hasBias ? CUBLASLT_EPILOGUE_BIAS : CUBLASLT_EPILOGUE_DEFAULT;
+  }
+}
+
+} // namespace
+
+bool fusedLinearSupported(af::dtype type) {
+  return type == af::dtype::f32 || type == af::dtype::f16;
+}
+
+void linearForward(
+    const af::array& input,
+    const af::array& weight,
+    const af::array& bias,
+    LinearActivation activation,
+    bool keepPreActivation,
+    af::array& out,
+    af::array& preActivation) {
+  bool hasBias = !bias.isempty();
+  bool keepAux = keepPreActivation && activation == LinearActivation::GELU;
+  out = af::array(weight.dims(0), input.dims(1), input.type());
+  preActivation = keepAux ? af::array(out.dims(), out.type()) : af::array();
+  bool fused;
+  {
+    DevicePtr biasRaw(bias), auxRaw(preActivation);
+    fused = ltMatmul(
+        weight,
+        input,
+        false,
+        out,
+        forwardEpilogue(activation, hasBias, keepAux),
+        [&](LtMatmul& op) {
+          if (hasBias) {
+            op.set(CUBLASLT_MATMUL_DESC_BIAS_POINTER, biasRaw.get());
+          }
+          if (keepAux) {
+            int64_t ld = out.dims(0);
+            op.set(CUBLASLT_MATMUL_DESC_EPILOGUE_AUX_POINTER, auxRaw.get());
+            op.set(CUBLASLT_MATMUL_DESC_EPILOGUE_AUX_LD, ld);
+          }
+        });
+  }
+  if (fused) {
+    return;
+  }
+  // No algorithm for the epilogue (e.g. for unaligned sizes)
+  auto pre = af::matmul(weight, input);
+  if (hasBias) {
+    pre = pre + af::tile(bias, 1, pre.dims(1));
+  }
+  preActivation = keepAux ? pre : af::array();
+  if (activation == LinearActivation::RELU) {
+    out = af::max(pre, 0.0);
+  } else if (activation == LinearActivation::GELU) {
+    out = 0.5 * pre *
+        (1.0 + af::tanh(0.7978845608 * (pre + 0.044715 * pre * pre * pre)));
+  } else {
+    out = pre;
+  }
+}
+
+void linearBackwardWeight(
+    const af::array& input,
+    const af::array& gradPreActivation,
+    bool computeGradBias,
+    af::array& gradWeight,
+    af::array& gradBias) {
+  auto type = gradPreActivation.type();
+  gradWeight = af::array(gradPreActivation.dims(0), input.dims(0), type);
+  gradBias = af::array();
+  if (computeGradBias) {
+    gradBias = af::array(gradPreActivation.dims(0), type);
+  }
+  bool fused;
+  {
+    DevicePtr gradBiasRaw(gradBias);
+    // The bias gradient reduces `gradPreActivation` over the inner dimension
+    // of the product
+    fused = ltMatmul(
+        gradPreActivation,
+        input,
+        true,
+        gradWeight,
+        computeGradBias ? CUBLASLT_EPILOGUE_BGRADA : CUBLASLT_EPILOGUE_DEFAULT,
+        [&](LtMatmul& op) {
+          if (computeGradBias) {
+            op.set(CUBLASLT_MATMUL_DESC_BIAS_POINTER, gradBiasRaw.get());
+          }
+        });
+  }
+  if (fused) {
+    return;
+  }
+  gradWeight = af::matmulNT(gradPreActivation, input);
+  if (computeGradBias) {
+    gradBias = af::sum(gradPreActivation, 1);
+  }
+}
+
+#else
+
+bool fusedLinearSupported(af::dtype /* type */) {
+  return false;
+}
+
+void linearForward(
+    const af::array& /* input */,
+    const af::array& /* weight */,
+    const af::array& /* bias */,
+    LinearActivation /* activation */,
+    bool /* keepPreActivation */,
+    af::array& /* out */,
+    af::array& /* preActivation */) {
+  throw std::logic_error("linearForward: fused linear layers not supported");
+}
+
+void linearBackwardWeight(
+    const af::array& /* input */,
+    const af::array& /* gradPreActivation */,
+    bool /* computeGradBias */,
+    af::array& /* gradWeight */,
+    af::array& /* gradBias */) {
+  throw std::logic_error(
+      "linearBackwardWeight: fused linear layers not supported");
+}
+
+#endif
+
+} // namespace detail
+} // namespace fl
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+#include <af/device.h>
+#include <af/internal.h>
+
+#include "flashlight/fl/autograd/Offload.h"
+#include "flashlight/fl/common/DevicePtr.h"
+#include "flashlight/fl/common/backend/cuda/CudaUtils.h"
+
+namespace fl {
+namespace detail {
+
+namespace {
+
+// The stream of the copies of offloaded activations on the active device
+cudaStream_t copyStream() {
+  static std::mutex mutex;
+  static std::unordered_map<int, cudaStream_t> streams;
+  std::lock_guard<std::mutex> lock(mutex);
+  auto& stream = streams[af::getDevice()];
+  if (!stream) {
+    FL_CUDA_CHECK(cudaStreamCreateWithFlags(&stream, cudaStreamNonBlocking));
+  }
+  return stream;
+}
+
+} // namespace
+
+OffloadedArray::OffloadedArray(const af::array& arr)
+    : host_(arr.bytes()), dims_(arr.dims()), type_(arr.type()) {
+  auto src = af::isLinear(arr) ? arr : arr.copy();
+  src.eval();
+  cudaEvent_t event;
+  FL_CUDA_CHECK(
+      cudaEventCreateWithFlags(&event, cuda::detail::kCudaEventDefaultFlags));
+  event_ = event;
+
+  auto stream = copyStream();
+  // The copy starts once the array is computed
+  cuda::synchronizeStreams(stream, cuda::getActiveStream(), event);
+  DevicePtr ptr(src);
+  FL_CUDA_CHECK(cudaMemcpyAsync(
+      host_.get(), ptr.get(), host_.bytes(), cudaMemcpyDeviceToHost, stream));
+  // The device memory may be freed before the copy has completed
+  cuda::recordStream(ptr.get(), stream);
+  FL_CUDA_CHECK(cudaEventRecord(event, stream));
+}
+
+OffloadedArray::~OffloadedArray() {
+  // The host memory is reused once the copies have completed; destructors
+  // don't throw
+  auto event = static_cast<cudaEvent_t>(event_);
+  cudaEventSynchronize(event);
+  cudaEventDestroy(event);
+}
+
+void OffloadedArray::prefetch() {
+  if (!device_.isempty()) {
+    return;
+  }
+  auto event = static_cast<cudaEvent_t>(event_);
+  auto stream = copyStream();
+  device_ = af::array(dims_, type_);
+  // The memory of the new array may still be used by the ArrayFire stream
+  cuda::synchronizeStreams(stream, cuda::getActiveStream(), event);
+  DevicePtr ptr(device_);
+  FL_CUDA_CHECK(cudaMemcpyAsync(
+      ptr.get(), host_.get(), host_.bytes(), cudaMemcpyHostToDevice, stream));
+  cuda::recordStream(ptr.get(), stream);
+  FL_CUDA_CHECK(cudaEventRecord(event, stream));
+}
+
+af::array OffloadedArray::restore() {
+  prefetch();
+  // Computations enqueued afterwards wait for the copy
+  FL_CUDA_CHECK(cudaStreamWaitEvent(
+      cuda::getActiveStream(), static_cast<cudaEvent_t>(event_), 0));
+  return std::move(device_);
+}
+
+} // namespace detail
+} // namespace fl
@@ -21,20 +21,24 @@ Variable pool2d(
     int sy,
     int px,
     int py,
-    PoolingMode mode /* = PoolingMode::MAX */) {
-  auto in_desc = TensorDescriptor(input);
+    PoolingMode mode /* = PoolingMode::MAX */,
+    ImageLayout layout /* = ImageLayout::WHCN */) {
+  auto in_desc = TensorDescriptor(input, layout);
 
   // init pooling descriptor
   auto pool_desc = PoolingDescriptor(wx, wy, sx, sy, px, py, mode);
 
   // init output descriptor
-  auto ix = input.dims(0);
-  auto iy = input.dims(1);
+  bool channelsLast = layout == ImageLayout::CWHN;
+  auto ix = input.dims(channelsLast ? 1 : 0);
+  auto iy = input.dims(channelsLast ? 2 : 1);
   auto ox = 1 + (ix + 2 * px - wx) / sx;
   auto oy = 1 + (iy + 2 * py - wy) / sy;
 
-  auto output = af::randu(ox, oy, input.dims(2), input.dims(3), input.type());
-  auto out_desc = TensorDescriptor(output);
+  auto output = channelsLast
+      ? af::array(input.dims(0), ox, oy, input.dims(3), input.type())
+      : af::array(ox, oy, input.dims(2), input.dims(3), input.type());
+  auto out_desc = TensorDescriptor(output, layout);
   {
     DevicePtr inputraw(input.array());
     DevicePtr resultraw(output);
@@ -53,15 +57,15 @@ Variable pool2d(
         out_desc.descriptor,
         resultraw.get()));
   }
-  auto gradFunc = [wx, wy, sx, sy, px, py, mode, output](
+  auto gradFunc = [wx, wy, sx, sy, px, py, mode, layout, output](
                       std::vector<Variable>& inputs,
                       const Variable& grad_output) {
     auto& in = inputs[0];
     if (!in.isCalcGrad()) {
       return;
     }
-    auto i_desc = TensorDescriptor(in);
-    auto o_desc = TensorDescriptor(output);
+    auto i_desc = TensorDescriptor(in, layout);
+    auto o_desc = TensorDescriptor(output, layout);
     auto p_desc = PoolingDescriptor(wx, wy, sx, sy, px, py, mode);
 
     auto grad_input = Variable(af::array(in.dims(), in.type()), false);
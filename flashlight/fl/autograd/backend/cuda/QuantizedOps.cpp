@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <stdexcept>
+
+#include <arrayfire.h>
+
+#include "flashlight/fl/autograd/Functions.h"
+
+namespace fl {
+namespace detail {
+
+// Quantized functions are emulated in f32 on this backend
+bool int8KernelsSupported() {
+  return false;
+}
+
+af::array int8Linear(
+    const af::array& /* input */,
+    const af::array& /* weights */,
+    const af::array& /* outputScales */,
+    float /* inputScale */) {
+  throw std::logic_error("int8Linear: int8 kernels are not supported");
+}
+
+af::array int8Conv2d(
+    const af::array& /* input */,
+    const af::array& /* weights */,
+    const af::array& /* outputScales */,
+    float /* inputScale */,
+    int /* sx */,
+    int /* sy */,
+    int /* px */,
+    int /* py */,
+    int /* dx */,
+    int /* dy */,
+    int /* groups */) {
+  throw std::logic_error("int8Conv2d: int8 kernels are not supported");
+}
+
+} // namespace detail
+} // namespace fl
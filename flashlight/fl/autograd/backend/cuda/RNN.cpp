@@ -7,8 +7,12 @@
 
 #include "flashlight/fl/autograd/Functions.h"
 
+#include <memory>
+#include <vector>
+
 #include <cudnn.h>
 
+#include "flashlight/fl/autograd/GradMode.h"
 #include "flashlight/fl/autograd/Variable.h"
 #include "flashlight/fl/autograd/backend/cuda/CudnnUtils.h"
 #include "flashlight/fl/common/DevicePtr.h"
@@ -19,6 +23,25 @@ struct RNNGradData {
   af::array dhy;
   af::array dcy;
 };
+
+void setRNNOptions(
+    fl::RNNDescriptor& rnnDesc,
+    af::dtype type,
+    bool variableLengths) {
+  if (type == f16) {
+    CUDNN_CHECK_ERR(cudnnSetRNNMatrixMathType(
+        rnnDesc.descriptor, CUDNN_TENSOR_OP_MATH_ALLOW_CONVERSION));
+  } else {
+    CUDNN_CHECK_ERR(
+        cudnnSetRNNMatrixMathType(rnnDesc.descriptor, CUDNN_DEFAULT_MATH));
+  }
+  // Required by the unpacked layout of RNNDataDescriptor. Set either way:
+  // the descriptor may be a cached one of variable lengths.
+  CUDNN_CHECK_ERR(cudnnSetRNNPaddingMode(
+      rnnDesc.descriptor,
+      variableLengths ? CUDNN_RNN_PADDED_IO_ENABLED
+                      : CUDNN_RNN_PADDED_IO_DISABLED));
+}
 } // namespace
 
 namespace fl {
@@ -33,7 +56,8 @@ void rnnBackward(
     int hiddenSize,
     RnnMode mode,
     bool bidirectional,
-    float dropProb) {
+    float dropProb,
+    const std::vector<int>& seqLengths) {
   if (inputs.size() != 4) {
     throw std::invalid_argument("wrong # of inputs for RNN");
   }
@@ -65,13 +89,7 @@ void rnnBackward(
   DropoutDescriptor dropout(dropProb);
   RNNDescriptor rnnDesc(
       input.type(), hiddenSize, numLayers, mode, bidirectional, dropout);
-  if (input.type() == f16) {
-    CUDNN_CHECK_ERR(cudnnSetRNNMatrixMathType(
-        rnnDesc.descriptor, CUDNN_TENSOR_OP_MATH_ALLOW_CONVERSION));
-  } else {
-    CUDNN_CHECK_ERR(
-        cudnnSetRNNMatrixMathType(rnnDesc.descriptor, CUDNN_DEFAULT_MATH));
-  }
+  setRNNOptions(rnnDesc, input.type(), !seqLengths.empty());
 
   TensorDescriptorArray yDesc(seqLength, y.type(), {1, 1, outSize, batchSize});
 
@@ -123,34 +141,72 @@ void rnnBackward(
 
     /* We need to update reserveSpace even if we just want the
      * weight gradients. */
-    CUDNN_CHECK_ERR(cudnnRNNBackwardData(
-        handle,
-        rnnDesc.descriptor,
-        seqLength,
-        yDesc.descriptors,
-        yRaw.get(),
-        dyDesc.descriptors,
-        dyRaw.get(),
-        dhyDesc.descriptor,
-        dhyRaw.get(),
-        dcyDesc.descriptor,
-        dcyRaw.get(),
-        wDesc.descriptor,
-        wRaw.get(),
-        hxDesc.descriptor,
-        hxRaw.get(),
-        cxDesc.descriptor,
-        cxRaw.get(),
-        dxDescs.descriptors,
-        dxRaw.get(),
-        dhxDesc.descriptor,
-        dhxRaw.get(),
-        dcxDesc.descriptor,
-        dcxRaw.get(),
-        workspaceRaw.get(),
-        workspaceSize,
-        reserveSpaceRaw.get(),
-        reserveSize));
+    if (seqLengths.empty()) {
+      CUDNN_CHECK_ERR(cudnnRNNBackwardData(
+          handle,
+          rnnDesc.descriptor,
+          seqLength,
+          yDesc.descriptors,
+          yRaw.get(),
+          dyDesc.descriptors,
+          dyRaw.get(),
+          dhyDesc.descriptor,
+          dhyRaw.get(),
+          dcyDesc.descriptor,
+          dcyRaw.get(),
+          wDesc.descriptor,
+          wRaw.get(),
+          hxDesc.descriptor,
+          hxRaw.get(),
+          cxDesc.descriptor,
+          cxRaw.get(),
+          dxDescs.descriptors,
+          dxRaw.get(),
+          dhxDesc.descriptor,
+          dhxRaw.get(),
+          dcxDesc.descriptor,
+          dcxRaw.get(),
+          workspaceRaw.get(),
+          workspaceSize,
+          reserveSpaceRaw.get(),
+          reserveSize));
+    } else {
+      RNNDataDescriptor xData(
+          x.type(), seqLength, batchSize, inputSize, seqLengths);
+      RNNDataDescriptor yData(
+          y.type(), seqLength, batchSize, outSize, seqLengths);
+      CUDNN_CHECK_ERR(cudnnRNNBackwardDataEx(
+          handle,
+          rnnDesc.descriptor,
+          yData.descriptor,
+          yRaw.get(),
+          yData.descriptor,
+          dyRaw.get(),
+          nullptr,
+          nullptr,
+          dhyDesc.descriptor,
+          dhyRaw.get(),
+          dcyDesc.descriptor,
+          dcyRaw.get(),
+          wDesc.descriptor,
+          wRaw.get(),
+          hxDesc.descriptor,
+          hxRaw.get(),
+          cxDesc.descriptor,
+          cxRaw.get(),
+          xData.descriptor,
+          dxRaw.get(),
+          dhxDesc.descriptor,
+          dhxRaw.get(),
+          dcxDesc.descriptor,
+          dcxRaw.get(),
+          nullptr,
+          nullptr,
+          workspaceRaw.get(),
+          workspaceSize,
+          reserveSpaceRaw.get(),
+          reserveSize));
+    }
   }
   if (input.isCalcGrad()) {
     input.addGrad(dx);
@@ -165,13 +221,7 @@ void rnnBackward(
   }
 
   if (weights.isCalcGrad()) {
-    if (input.type() == f16) {
-      CUDNN_CHECK_ERR(cudnnSetRNNMatrixMathType(
-          rnnDesc.descriptor, CUDNN_TENSOR_OP_MATH_ALLOW_CONVERSION));
-    } else {
-      CUDNN_CHECK_ERR(
-          cudnnSetRNNMatrixMathType(rnnDesc.descriptor, CUDNN_DEFAULT_MATH));
-    }
+    setRNNOptions(rnnDesc, input.type(), !seqLengths.empty());
     TensorDescriptorArray xDescs(
         seqLength, x.type(), {1, 1, inputSize, batchSize});
     Variable dw(
@@ -184,38 +234,69 @@ void rnnBackward(
       DevicePtr dwRaw(dw.array());
       DevicePtr hxRaw(hxArray);
 
-      CUDNN_CHECK_ERR(cudnnRNNBackwardWeights(
-          handle,
-          rnnDesc.descriptor,
-          seqLength,
-          xDescs.descriptors,
-          xRaw.get(),
-          hxDesc.descriptor,
-          hxRaw.get(),
-          yDesc.descriptors,
-          yRaw.get(),
-          workspaceRaw.get(),
-          workspaceSize,
-          dwDesc.descriptor,
-          dwRaw.get(),
-          reserveSpaceRaw.get(),
-          reserveSize));
+      if (seqLengths.empty()) {
+        CUDNN_CHECK_ERR(cudnnRNNBackwardWeights(
+            handle,
+            rnnDesc.descriptor,
+            seqLength,
+            xDescs.descriptors,
+            xRaw.get(),
+            hxDesc.descriptor,
+            hxRaw.get(),
+            yDesc.descriptors,
+            yRaw.get(),
+            workspaceRaw.get(),
+            workspaceSize,
+            dwDesc.descriptor,
+            dwRaw.get(),
+            reserveSpaceRaw.get(),
+            reserveSize));
+      } else {
+        RNNDataDescriptor xData(
+            x.type(), seqLength, batchSize, inputSize, seqLengths);
+        RNNDataDescriptor yData(
+            y.type(), seqLength, batchSize, outSize, seqLengths);
+        CUDNN_CHECK_ERR(cudnnRNNBackwardWeightsEx(
+            handle,
+            rnnDesc.descriptor,
+            xData.descriptor,
+            xRaw.get(),
+            hxDesc.descriptor,
+            hxRaw.get(),
+            yData.descriptor,
+            yRaw.get(),
+            workspaceRaw.get(),
+            workspaceSize,
+            dwDesc.descriptor,
+            dwRaw.get(),
+            reserveSpaceRaw.get(),
+            reserveSize));
+      }
     }
     weights.addGrad(dw);
   }
 } // namespace fl
 
-std::tuple<Variable, Variable, Variable> rnn(
-    const Variable& input,
-    const Variable& hiddenState,
-    const Variable& cellState,
-    const Variable& weights,
+namespace {
+
+// With empty seqLengths, all the sequences have the full length
+std::tuple<Variable, Variable, Variable> cudnnRnn(
+    const Variable& inputIn,
+    const Variable& hiddenStateIn,
+    const Variable& cellStateIn,
+    const Variable& weightsIn,
     int hiddenSize,
     int numLayers,
     RnnMode mode,
     bool bidirectional,
-    float dropProb) {
-  FL_VARIABLE_DTYPES_MATCH_CHECK(input, hiddenState, cellState, weights);
+    float dropProb,
+    const std::vector<int>& seqLengths) {
+  FL_VARIABLE_DTYPES_MATCH_CHECK(
+      inputIn, hiddenStateIn, cellStateIn, weightsIn);
+  auto input = FL_ADJUST_INPUT_TYPE(inputIn);
+  auto hiddenState = FL_ADJUST_INPUT_TYPE(hiddenStateIn);
+  auto cellState = FL_ADJUST_INPUT_TYPE(cellStateIn);
+  auto weights = FL_ADJUST_INPUT_TYPE(weightsIn);
 
   auto& x = input.array();
 
@@ -225,13 +306,7 @@ std::tuple<Variable, Variable, Variable> rnn(
   DropoutDescriptor dropout(dropProb);
   RNNDescriptor rnnDesc(
       input.type(), hiddenSize, numLayers, mode, bidirectional, dropout);
-  if (input.type() == f16) {
-    CUDNN_CHECK_ERR(cudnnSetRNNMatrixMathType(
-        rnnDesc.descriptor, CUDNN_TENSOR_OP_MATH_ALLOW_CONVERSION));
-  } else {
-    CUDNN_CHECK_ERR(
-        cudnnSetRNNMatrixMathType(rnnDesc.descriptor, CUDNN_DEFAULT_MATH));
-  }
+  setRNNOptions(rnnDesc, input.type(), !seqLengths.empty());
 
   auto dims = x.dims();
 
@@ -244,6 +319,13 @@ std::tuple<Variable, Variable, Variable> rnn(
 
   TensorDescriptorArray xDescs(
       seqLength, x.type(), {1, 1, inputSize, batchSize});
+  std::unique_ptr<RNNDataDescriptor> xData, yData;
+  if (!seqLengths.empty()) {
+    xData = std::make_unique<RNNDataDescriptor>(
+        x.type(), seqLength, batchSize, inputSize, seqLengths);
+    yData = std::make_unique<RNNDataDescriptor>(
+        input.type(), seqLength, batchSize, outSize, seqLengths);
+  }
 
   if (!hxArray.isempty() &&
       !(hxArray.dims(0) == hiddenSize && hxArray.dims(1) == batchSize &&
@@ -298,6 +380,74 @@ std::tuple<Variable, Variable, Variable> rnn(
       &workspaceSize));
   af::array workspace(workspaceSize, af::dtype::b8);
 
+  // Without gradient, runs without the reserve space kept for the backward
+  bool calcGrad = isGradEnabled() &&
+      (input.isCalcGrad() || hiddenState.isCalcGrad() ||
+       cellState.isCalcGrad() || weights.isCalcGrad());
+  if (!calcGrad) {
+    DevicePtr xRaw(x);
+    DevicePtr hxRaw(hxArray);
+    DevicePtr cxRaw(cxArray);
+    DevicePtr wRaw(weights.array());
+    DevicePtr yRaw(y);
+    DevicePtr hyRaw(hy);
+    DevicePtr cyRaw(cy);
+    DevicePtr workspaceRaw(workspace);
+
+    if (seqLengths.empty()) {
+      CUDNN_CHECK_ERR(cudnnRNNForwardInference(
+          handle,
+          rnnDesc.descriptor,
+          seqLength,
+          xDescs.descriptors,
+          xRaw.get(),
+          hxDesc.descriptor,
+          hxRaw.get(),
+          cxDesc.descriptor,
+          cxRaw.get(),
+          wDesc.descriptor,
+          wRaw.get(),
+          yDesc.descriptors,
+          yRaw.get(),
+          hyDesc.descriptor,
+          hyRaw.get(),
+          cyDesc.descriptor,
+          cyRaw.get(),
+          workspaceRaw.get(),
+          workspaceSize));
+    } else {
+      CUDNN_CHECK_ERR(cudnnRNNForwardInferenceEx(
+          handle,
+          rnnDesc.descriptor,
+          xData->descriptor,
+          xRaw.get(),
+          hxDesc.descriptor,
+          hxRaw.get(),
+          cxDesc.descriptor,
+          cxRaw.get(),
+          wDesc.descriptor,
+          wRaw.get(),
+          yData->descriptor,
+          yRaw.get(),
+          hyDesc.descriptor,
+          hyRaw.get(),
+          cyDesc.descriptor,
+          cyRaw.get(),
+          nullptr,
+          nullptr,
+          nullptr,
+          nullptr,
+          nullptr,
+          nullptr,
+          nullptr,
+          nullptr,
+          workspaceRaw.get(),
+          workspaceSize));
+    }
+    return std::make_tuple(
+        Variable(y, false), Variable(hy, false), Variable(cy, false));
+  }
+
   size_t reserveSize;
   CUDNN_CHECK_ERR(cudnnGetRNNTrainingReserveSize(
       handle, rnnDesc.descriptor, seqLength, xDescs.descriptors, &reserveSize));
@@ -313,28 +463,60 @@ std::tuple<Variable, Variable, Variable> rnn(
     DevicePtr workspaceRaw(workspace);
     DevicePtr reserveSpaceRaw(reserveSpace);
 
-    CUDNN_CHECK_ERR(cudnnRNNForwardTraining(
-        handle,
-        rnnDesc.descriptor,
-        seqLength,
-        xDescs.descriptors,
-        xRaw.get(),
-        hxDesc.descriptor,
-        hxRaw.get(),
-        cxDesc.descriptor,
-        cxRaw.get(),
-        wDesc.descriptor,
-        wRaw.get(),
-        yDesc.descriptors,
-        yRaw.get(),
-        hyDesc.descriptor,
-        hyRaw.get(),
-        cyDesc.descriptor,
-        cyRaw.get(),
-        workspaceRaw.get(),
-        workspaceSize,
-        reserveSpaceRaw.get(),
-        reserveSize));
+    if (seqLengths.empty()) {
+      CUDNN_CHECK_ERR(cudnnRNNForwardTraining(
+          handle,
+          rnnDesc.descriptor,
+          seqLength,
+          xDescs.descriptors,
+          xRaw.get(),
+          hxDesc.descriptor,
+          hxRaw.get(),
+          cxDesc.descriptor,
+          cxRaw.get(),
+          wDesc.descriptor,
+          wRaw.get(),
+          yDesc.descriptors,
+          yRaw.get(),
+          hyDesc.descriptor,
+          hyRaw.get(),
+          cyDesc.descriptor,
+          cyRaw.get(),
+          workspaceRaw.get(),
+          workspaceSize,
+          reserveSpaceRaw.get(),
+          reserveSize));
+    } else {
+      CUDNN_CHECK_ERR(cudnnRNNForwardTrainingEx(
+          handle,
+          rnnDesc.descriptor,
+          xData->descriptor,
+          xRaw.get(),
+          hxDesc.descriptor,
+          hxRaw.get(),
+          cxDesc.descriptor,
+          cxRaw.get(),
+          wDesc.descriptor,
+          wRaw.get(),
+          yData->descriptor,
+          yRaw.get(),
+          hyDesc.descriptor,
+          hyRaw.get(),
+          cyDesc.descriptor,
+          cyRaw.get(),
+          nullptr,
+          nullptr,
+          nullptr,
+          nullptr,
+          nullptr,
+          nullptr,
+          nullptr,
+          nullptr,
+          workspaceRaw.get(),
+          workspaceSize,
+          reserveSpaceRaw.get(),
+          reserveSize));
+    }
   }
   auto gradData = std::make_shared<RNNGradData>();
 
@@ -347,6 +529,7 @@ std::tuple<Variable, Variable, Variable> rnn(
                    mode,
                    bidirectional,
                    dropProb,
+                   seqLengths,
                    gradData](
                       std::vector<Variable>& inputs,
                       const Variable& /* gradOutput */) {
@@ -361,7 +544,8 @@ std::tuple<Variable, Variable, Variable> rnn(
         hiddenSize,
         mode,
         bidirectional,
-        dropProb);
+        dropProb,
+        seqLengths);
   };
 
   Variable dummy(
@@ -397,4 +581,61 @@ std::tuple<Variable, Variable, Variable> rnn(
   return std::make_tuple(yv, hyv, cyv);
 }
 
+} // namespace
+
+std::tuple<Variable, Variable, Variable> rnn(
+    const Variable& input,
+    const Variable& hiddenState,
+    const Variable& cellState,
+    const Variable& weights,
+    int hiddenSize,
+    int numLayers,
+    RnnMode mode,
+    bool bidirectional,
+    float dropProb) {
+  return cudnnRnn(
+      input,
+      hiddenState,
+      cellState,
+      weights,
+      hiddenSize,
+      numLayers,
+      mode,
+      bidirectional,
+      dropProb,
+      {});
+}
+
+namespace detail {
+
+bool variableLengthRnnSupported() {
+  return true;
+}
+
+std::tuple<Variable, Variable, Variable> variableLengthRnn(
+    const Variable& input,
+    const Variable& hiddenState,
+    const Variable& cellState,
+    const Variable& weights,
+    int hiddenSize,
+    int numLayers,
+    RnnMode mode,
+    bool bidirectional,
+    float dropout,
+    const std::vector<int>& sequenceLengths) {
+  return cudnnRnn(
+      input,
+      hiddenState,
+      cellState,
+      weights,
+      hiddenSize,
+      numLayers,
+      mode,
+      bidirectional,
+      dropout,
+      sequenceLengths);
+}
+
+} // namespace detail
+
 } // namespace fl
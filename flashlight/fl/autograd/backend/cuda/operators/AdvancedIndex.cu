@@ -6,9 +6,14 @@
  */
 
 #include <af/array.h>
+#include <arrayfire.h>
 
+#include <algorithm>
+#include <limits>
 #include <stdexcept>
 
+#include <cub/cub.cuh>
+
 #include "flashlight/fl/autograd/Variable.h"
 #include "flashlight/fl/common/CppBackports.h"
 #include "flashlight/fl/common/backend/cuda/CudaUtils.h"
@@ -19,59 +24,273 @@
 
 const fl::cpp::fl_unordered_set<af::dtype> validIndexTypes{s32, s64, u32, u64};
 
-template <class Float, class Index>
-__global__ void gradAdvancedIndexKernel(
-    const Float* inp,
+namespace {
+
+// The sort-based scatter only pays off for large gradients, when many elements
+// are added to the same outputs, e.g. for frequent tokens in embeddings
+constexpr dim_t kSortMinElements = 1 << 16;
+constexpr double kSortMinDuplication = 4.0;
+
+// Strides of the gradient of the output of the index operator and of the
+// gradient of its input
+struct Strides {
+  dim_t dims[4];
+  dim_t strides[4];
+  dim_t outStrides[4];
+};
+
+__device__ Strides computeStrides(
     const dim_t* idxStart,
     const dim_t* idxEnd,
-    const dim_t* outDims,
-    const dim_t* idxArr,
-    Float* out) {
-  // Compute striding information for
-  // the input and output tensors
-  dim_t dims[4], strides[4];
-  dim_t outStrides[4];
+    const dim_t* outDims) {
+  Strides s;
   for (int i = 0; i < 4; i++) {
-    dims[i] = idxEnd[i] - idxStart[i];
+    s.dims[i] = idxEnd[i] - idxStart[i];
   }
-  strides[0] = 1;
-  outStrides[0] = 1;
+  s.strides[0] = 1;
+  s.outStrides[0] = 1;
   // arrayfire dimensions are inverted compared to numpy
   // hence, stride computation starts from 1 to 4
   for (int i = 1; i < 4; i++) {
-    strides[i] = strides[i - 1] * dims[i - 1];
-    outStrides[i] = outStrides[i - 1] * outDims[i - 1];
+    s.strides[i] = s.strides[i - 1] * s.dims[i - 1];
+    s.outStrides[i] = s.outStrides[i - 1] * outDims[i - 1];
+  }
+  return s;
+}
+
+// Index in the output of the input element `tid`
+template <class Index>
+__device__ dim_t outputIndex(
+    dim_t tid,
+    const Strides& s,
+    const dim_t* idxStart,
+    const dim_t* idxArr) {
+  // Compute input array index for CUDA thread
+  dim_t index[4];
+  dim_t cursor = tid;
+  for (int i = 3; i >= 0; i--) {
+    index[i] = cursor / s.strides[i];
+    cursor = cursor % s.strides[i];
   }
 
+  dim_t outIdx = 0;
+  for (int i = 0; i < 4; i++) {
+    // If indexing array specified, use it
+    if (idxArr[i]) {
+      auto idxArrPtr = (Index*)idxArr[i];
+      outIdx += idxArrPtr[index[i]] * s.outStrides[i];
+    } else {
+      outIdx += (idxStart[i] + index[i]) * s.outStrides[i];
+    }
+  }
+  return outIdx;
+}
+
+template <class Float, class Index>
+__global__ void gradAdvancedIndexKernel(
+    const Float* inp,
+    const dim_t* idxStart,
+    const dim_t* idxEnd,
+    const dim_t* outDims,
+    const dim_t* idxArr,
+    Float* out) {
+  auto s = computeStrides(idxStart, idxEnd, outDims);
+
   // Map CUDA thread to an element in the input array
   for (dim_t tid = threadIdx.x + blockIdx.x * BLOCK_SIZE;
-       tid < (strides[3] * dims[3]);
+       tid < (s.strides[3] * s.dims[3]);
        tid += (GRID_SIZE * BLOCK_SIZE)) {
-    // Compute input array index for CUDA thread
-    dim_t index[4];
-    dim_t cursor = tid;
-    for (int i = 3; i >= 0; i--) {
-      index[i] = cursor / strides[i];
-      cursor = cursor % strides[i];
-    }
-
-    dim_t inpIdx = tid;
-    dim_t outIdx = 0;
-    for (int i = 0; i < 4; i++) {
-      // If indexing array specified, use it
-      if (idxArr[i]) {
-        auto idxArrPtr = (Index*)idxArr[i];
-        outIdx += idxArrPtr[index[i]] * outStrides[i];
-      } else {
-        outIdx += (idxStart[i] + index[i]) * outStrides[i];
-      }
-    }
     // atomic addition is done to ensure correct
     // gradient computation for repeated indices
-    atomicAdd(&out[outIdx], inp[inpIdx]);
+    atomicAdd(
+        &out[outputIndex<Index>(tid, s, idxStart, idxArr)], inp[tid]);
+  }
+}
+
+template <class Index>
+__global__ void outputIndicesKernel(
+    const dim_t* idxStart,
+    const dim_t* idxEnd,
+    const dim_t* outDims,
+    const dim_t* idxArr,
+    int64_t* keys) {
+  auto s = computeStrides(idxStart, idxEnd, outDims);
+  for (dim_t tid = threadIdx.x + blockIdx.x * BLOCK_SIZE;
+       tid < (s.strides[3] * s.dims[3]);
+       tid += (GRID_SIZE * BLOCK_SIZE)) {
+    keys[tid] = outputIndex<Index>(tid, s, idxStart, idxArr);
   }
 }
 
+// Adds the reduced gradients to distinct outputs, hence without atomics
+template <class Float>
+__global__ void scatterAddKernel(
+    const int64_t* uniqueKeys,
+    const Float* sums,
+    const int* numUnique,
+    Float* out) {
+  for (int i = threadIdx.x + blockIdx.x * BLOCK_SIZE; i < *numUnique;
+       i += (GRID_SIZE * BLOCK_SIZE)) {
+    out[uniqueKeys[i]] += sums[i];
+  }
+}
+
+af::array cubTempStorage(size_t bytes) {
+  return af::array(static_cast<dim_t>(std::max<size_t>(bytes, 1)), b8);
+}
+
+// Sorts the elements of the input by output index, with a stable radix sort,
+// then reduces runs of equal indices in order: the result doesn't depend on
+// scheduling, and no two threads add to the same output
+template <class Index>
+void sortedScatterAdd(
+    const float* inp,
+    int numElements,
+    dim_t numOutputs,
+    const dim_t* idxStart,
+    const dim_t* idxEnd,
+    const dim_t* outDims,
+    const dim_t* idxArr,
+    float* out,
+    cudaStream_t stream) {
+  af::array keys(numElements, s64), sortedKeys(numElements, s64);
+  af::array sortedValues(numElements, f32);
+  af::array uniqueKeys(numElements, s64), sums(numElements, f32);
+  af::array numUnique(1, s32);
+  fl::DevicePtr keysRaw(keys), sortedKeysRaw(sortedKeys);
+  fl::DevicePtr sortedValuesRaw(sortedValues);
+  fl::DevicePtr uniqueKeysRaw(uniqueKeys), sumsRaw(sums);
+  fl::DevicePtr numUniqueRaw(numUnique);
+  auto keysPtr = static_cast<int64_t*>(keysRaw.get());
+  auto sortedKeysPtr = static_cast<int64_t*>(sortedKeysRaw.get());
+  auto sortedValuesPtr = static_cast<float*>(sortedValuesRaw.get());
+  auto uniqueKeysPtr = static_cast<int64_t*>(uniqueKeysRaw.get());
+  auto sumsPtr = static_cast<float*>(sumsRaw.get());
+  auto numUniquePtr = static_cast<int*>(numUniqueRaw.get());
+
+  outputIndicesKernel<Index><<<GRID_SIZE, BLOCK_SIZE, 0, stream>>>(
+      idxStart, idxEnd, outDims, idxArr, keysPtr);
+  FL_CUDA_CHECK(cudaPeekAtLastError());
+
+  // Only sort the bits of the output indices
+  int endBit = 1;
+  while (endBit < 63 && (dim_t(1) << endBit) < numOutputs) {
+    ++endBit;
+  }
+  size_t sortBytes = 0;
+  FL_CUDA_CHECK(cub::DeviceRadixSort::SortPairs(
+      nullptr,
+      sortBytes,
+      keysPtr,
+      sortedKeysPtr,
+      inp,
+      sortedValuesPtr,
+      numElements,
+      0,
+      endBit,
+      stream));
+  auto sortStorage = cubTempStorage(sortBytes);
+  {
+    fl::DevicePtr storage(sortStorage);
+    FL_CUDA_CHECK(cub::DeviceRadixSort::SortPairs(
+        storage.get(),
+        sortBytes,
+        keysPtr,
+        sortedKeysPtr,
+        inp,
+        sortedValuesPtr,
+        numElements,
+        0,
+        endBit,
+        stream));
+  }
+
+  size_t reduceBytes = 0;
+  FL_CUDA_CHECK(cub::DeviceReduce::ReduceByKey(
+      nullptr,
+      reduceBytes,
+      sortedKeysPtr,
+      uniqueKeysPtr,
+      sortedValuesPtr,
+      sumsPtr,
+      numUniquePtr,
+      cub::Sum(),
+      numElements,
+      stream));
+  auto reduceStorage = cubTempStorage(reduceBytes);
+  {
+    fl::DevicePtr storage(reduceStorage);
+    FL_CUDA_CHECK(cub::DeviceReduce::ReduceByKey(
+        storage.get(),
+        reduceBytes,
+        sortedKeysPtr,
+        uniqueKeysPtr,
+        sortedValuesPtr,
+        sumsPtr,
+        numUniquePtr,
+        cub::Sum(),
+        numElements,
+        stream));
+  }
+
+  scatterAddKernel<float><<<GRID_SIZE, BLOCK_SIZE, 0, stream>>>(
+      uniqueKeysPtr, sumsPtr, numUniquePtr, out);
+  FL_CUDA_CHECK(cudaPeekAtLastError());
+}
+
+// Chooses the sort-based scatter if the input is large and the average number
+// of elements added to each output, estimated from the duplication of the
+// index arrays (which are small), is high
+bool useSortedScatter(
+    dim_t numElements,
+    const std::vector<af::array>& idxArr) {
+  if (numElements < kSortMinElements ||
+      numElements > std::numeric_limits<int>::max()) {
+    return false;
+  }
+  double duplication = 1.0;
+  for (const auto& idx : idxArr) {
+    if (!idx.isempty()) {
+      duplication *= static_cast<double>(idx.elements()) /
+          af::setUnique(idx).elements();
+    }
+  }
+  return duplication >= kSortMinDuplication;
+}
+
+template <class Index>
+void gradAdvancedIndexImpl(
+    const float* inp,
+    dim_t numElements,
+    dim_t numOutputs,
+    const dim_t* idxStart,
+    const dim_t* idxEnd,
+    const dim_t* outDims,
+    const dim_t* idxArr,
+    bool sorted,
+    float* out,
+    cudaStream_t stream) {
+  if (sorted) {
+    sortedScatterAdd<Index>(
+        inp,
+        numElements,
+        numOutputs,
+        idxStart,
+        idxEnd,
+        outDims,
+        idxArr,
+        out,
+        stream);
+  } else {
+    gradAdvancedIndexKernel<float, Index>
+        <<<GRID_SIZE, BLOCK_SIZE, 0, stream>>>(
+            inp, idxStart, idxEnd, outDims, idxArr, out);
+    FL_CUDA_CHECK(cudaPeekAtLastError());
+  }
+}
+
+} // namespace
+
 namespace fl {
 
 void gradAdvancedIndex(
@@ -141,46 +360,65 @@ void gradAdvancedIndex(
   DevicePtr devIdxPtr(arrIdxPtr);
 
   cudaStream_t stream = cuda::getActiveStream();
+  auto numElements = inp.elements();
+  bool sorted = useSortedScatter(numElements, idxArr);
+  auto inpPtr = static_cast<const float*>(inpRaw.get());
+  auto idxStartPtr = static_cast<const dim_t*>(devIdxStart.get());
+  auto idxEndPtr = static_cast<const dim_t*>(devIdxEnd.get());
+  auto outDimsPtr = static_cast<const dim_t*>(devOutDims.get());
+  auto idxPtrPtr = static_cast<const dim_t*>(devIdxPtr.get());
+  auto outPtr = static_cast<float*>(outRaw.get());
   if (idxTypes.size() == 0 || idxTypes[0] == s32) {
-    gradAdvancedIndexKernel<float, int32_t>
-        <<<GRID_SIZE, BLOCK_SIZE, 0, stream>>>(
-            static_cast<const float*>(inpRaw.get()),
-            static_cast<const dim_t*>(devIdxStart.get()),
-            static_cast<const dim_t*>(devIdxEnd.get()),
-            static_cast<const dim_t*>(devOutDims.get()),
-            static_cast<const dim_t*>(devIdxPtr.get()),
-            static_cast<float*>(outRaw.get()));
+    gradAdvancedIndexImpl<int32_t>(
+        inpPtr,
+        numElements,
+        out.elements(),
+        idxStartPtr,
+        idxEndPtr,
+        outDimsPtr,
+        idxPtrPtr,
+        sorted,
+        outPtr,
+        stream);
   } else if (idxTypes[0] == s64) {
-    gradAdvancedIndexKernel<float, int64_t>
-        <<<GRID_SIZE, BLOCK_SIZE, 0, stream>>>(
-            static_cast<const float*>(inpRaw.get()),
-            static_cast<const dim_t*>(devIdxStart.get()),
-            static_cast<const dim_t*>(devIdxEnd.get()),
-            static_cast<const dim_t*>(devOutDims.get()),
-            static_cast<const dim_t*>(devIdxPtr.get()),
-            static_cast<float*>(outRaw.get()));
+    gradAdvancedIndexImpl<int64_t>(
+        inpPtr,
+        numElements,
+        out.elements(),
+        idxStartPtr,
+        idxEndPtr,
+        outDimsPtr,
+        idxPtrPtr,
+        sorted,
+        outPtr,
+        stream);
   } else if (idxTypes[0] == u32) {
-    gradAdvancedIndexKernel<float, uint32_t>
-        <<<GRID_SIZE, BLOCK_SIZE, 0, stream>>>(
-            static_cast<const float*>(inpRaw.get()),
-            static_cast<const dim_t*>(devIdxStart.get()),
-            static_cast<const dim_t*>(devIdxEnd.get()),
-            static_cast<const dim_t*>(devOutDims.get()),
-            static_cast<const dim_t*>(devIdxPtr.get()),
-            static_cast<float*>(outRaw.get()));
+    gradAdvancedIndexImpl<uint32_t>(
+        inpPtr,
+        numElements,
+        out.elements(),
+        idxStartPtr,
+        idxEndPtr,
+        outDimsPtr,
+        idxPtrPtr,
+        sorted,
+        outPtr,
+        stream);
   } else if (idxTypes[0] == u64) {
-    gradAdvancedIndexKernel<float, uint64_t>
-        <<<GRID_SIZE, BLOCK_SIZE, 0, stream>>>(
-            static_cast<const float*>(inpRaw.get()),
-            static_cast<const dim_t*>(devIdxStart.get()),
-            static_cast<const dim_t*>(devIdxEnd.get()),
-            static_cast<const dim_t*>(devOutDims.get()),
-            static_cast<const dim_t*>(devIdxPtr.get()),
-            static_cast<float*>(outRaw.get()));
+    gradAdvancedIndexImpl<uint64_t>(
+        inpPtr,
+        numElements,
+        out.elements(),
+        idxStartPtr,
+        idxEndPtr,
+        outDimsPtr,
+        idxPtrPtr,
+        sorted,
+        outPtr,
+        stream);
   } else {
     throw std::invalid_argument("Index type must be one of s32/s64/u32/u64");
   }
-  FL_CUDA_CHECK(cudaPeekAtLastError());
 
   if (outType == f16) {
     out = out.as(f16);
@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <af/array.h>
+
+#include <algorithm>
+
+#include "flashlight/fl/autograd/Functions.h"
+#include "flashlight/fl/common/DevicePtr.h"
+#include "flashlight/fl/common/backend/cuda/CudaUtils.h"
+
+// Each thread computes a frame of the output (or of the input gradient);
+// each block reduces the gradient of a weight
+#define THREADS 256
+#define WARP_SIZE 32
+#define MAX_BLOCKS 4096
+
+namespace {
+
+// Sizes of a depthwise convolution: columns of `length` input and
+// `outLength` output frames, for `columns` positions of the second
+// dimension, `channels` input channels of `multiplier` output channels each,
+// and `batch` samples
+struct Conv1dSizes {
+  int length, outLength, kernelSize, columns, channels, multiplier, batch;
+  int leftPad, stride, dilation;
+};
+
+__device__ __forceinline__ float warpSum(float val) {
+  for (int offset = WARP_SIZE / 2; offset > 0; offset /= 2) {
+    val += __shfl_xor_sync(0xffffffff, val, offset);
+  }
+  return val;
+}
+
+// Sum over the threads of the block, returned to the first one
+__device__ float blockSum(float val, float* shared) {
+  int lane = threadIdx.x % WARP_SIZE;
+  int warp = threadIdx.x / WARP_SIZE;
+  val = warpSum(val);
+  if (lane == 0) {
+    shared[warp] = val;
+  }
+  __syncthreads();
+  val = lane < blockDim.x / WARP_SIZE ? shared[lane] : 0;
+  return warpSum(val);
+}
+
+// Output frames are indexed as [t, col, outCh, n]
+__global__ void depthwiseConv1dForwardKernel(
+    Conv1dSizes s,
+    const float* input,
+    const float* weight,
+    const float* bias,
+    float* out) {
+  int outChannels = s.channels * s.multiplier;
+  size_t n = static_cast<size_t>(s.outLength) * s.columns * outChannels *
+      s.batch;
+  for (size_t idx = blockIdx.x * blockDim.x + threadIdx.x; idx < n;
+       idx += blockDim.x * gridDim.x) {
+    int t = idx % s.outLength;
+    size_t rest = idx / s.outLength;
+    int col = rest % s.columns;
+    rest /= s.columns;
+    int outCh = rest % outChannels;
+    int b = rest / outChannels;
+    int ch = outCh / s.multiplier;
+    const float* x = input +
+        ((static_cast<size_t>(b) * s.channels + ch) * s.columns + col) *
+            s.length;
+    const float* w = weight + static_cast<size_t>(outCh) * s.kernelSize;
+    int start = t * s.stride - s.leftPad;
+    float sum = bias ? bias[outCh] : 0;
+    for (int k = 0; k < s.kernelSize; ++k) {
+      int i = start + k * s.dilation;
+      if (i >= 0 && i < s.length) {
+        sum += w[k] * x[i];
+      }
+    }
+    out[idx] = sum;
+  }
+}
+
+// Input frames are indexed as [i, col, ch, n]; each sums the outputs of the
+// `multiplier` channels it contributes to
+__global__ void depthwiseConv1dGradInputKernel(
+    Conv1dSizes s,
+    const float* weight,
+    const float* gradOut,
+    float* gradInput) {
+  int outChannels = s.channels * s.multiplier;
+  size_t n = static_cast<size_t>(s.length) * s.columns * s.channels * s.batch;
+  for (size_t idx = blockIdx.x * blockDim.x + threadIdx.x; idx < n;
+       idx += blockDim.x * gridDim.x) {
+    int i = idx % s.length;
+    size_t rest = idx / s.length;
+    int col = rest % s.columns;
+    rest /= s.columns;
+    int ch = rest % s.channels;
+    int b = rest / s.channels;
+    float sum = 0;
+    for (int m = 0; m < s.multiplier; ++m) {
+      int outCh = ch * s.multiplier + m;
+      const float* w = weight + static_cast<size_t>(outCh) * s.kernelSize;
+      const float* gy = gradOut +
+          ((static_cast<size_t>(b) * outChannels + outCh) * s.columns + col) *
+              s.outLength;
+      for (int k = 0; k < s.kernelSize; ++k) {
+        // Output frame t reads input frame t * stride - leftPad + k * dilation
+        int pos = i + s.leftPad - k * s.dilation;
+        if (pos < 0 || pos % s.stride != 0) {
+          continue;
+        }
+        int t = pos / s.stride;
+        if (t < s.outLength) {
+          sum += w[k] * gy[t];
+        }
+      }
+    }
+    gradInput[idx] = sum;
+  }
+}
+
+// The block (k, outCh) reduces the products of the input and output
+// gradient frames over the columns and the batch
+__global__ void depthwiseConv1dGradWeightKernel(
+    Conv1dSizes s,
+    const float* input,
+    const float* gradOut,
+    float* gradWeight) {
+  __shared__ float shared[WARP_SIZE];
+  int k = blockIdx.x;
+  int outCh = blockIdx.y;
+  int ch = outCh / s.multiplier;
+  int outChannels = s.channels * s.multiplier;
+  size_t n = static_cast<size_t>(s.outLength) * s.columns * s.batch;
+  float sum = 0;
+  for (size_t idx = threadIdx.x; idx < n; idx += blockDim.x) {
+    int t = idx % s.outLength;
+    size_t rest = idx / s.outLength;
+    int col = rest % s.columns;
+    int b = rest / s.columns;
+    int i = t * s.stride - s.leftPad + k * s.dilation;
+    if (i >= 0 && i < s.length) {
+      size_t x = ((static_cast<size_t>(b) * s.channels + ch) * s.columns +
+                  col) *
+              s.length +
+          i;
+      size_t gy =
+          ((static_cast<size_t>(b) * outChannels + outCh) * s.columns + col) *
+              s.outLength +
+          t;
+      sum += input[x] * gradOut[gy];
+    }
+  }
+  sum = blockSum(sum, shared);
+  if (threadIdx.x == 0) {
+    gradWeight[static_cast<size_t>(outCh) * s.kernelSize + k] = sum;
+  }
+}
+
+Conv1dSizes sizes(
+    const af::array& input,
+    const af::array& weight,
+    int outLength,
+    int leftPad,
+    int stride,
+    int dilation) {
+  Conv1dSizes s;
+  s.length = input.dims(0);
+  s.outLength = outLength;
+  s.kernelSize = weight.dims(0);
+  s.columns = input.dims(1);
+  s.channels = input.dims(2);
+  s.multiplier = weight.dims(3) / input.dims(2);
+  s.batch = input.dims(3);
+  s.leftPad = leftPad;
+  s.stride = stride;
+  s.dilation = dilation;
+  return s;
+}
+
+int numBlocks(size_t n) {
+  return std::min<size_t>((n + THREADS - 1) / THREADS, MAX_BLOCKS);
+}
+
+} // namespace
+
+namespace fl {
+namespace detail {
+
+void depthwiseConv1dForward(
+    const af::array& input,
+    const af::array& weight,
+    const af::array& bias,
+    int leftPad,
+    int rightPad,
+    int stride,
+    int dilation,
+    af::array& out) {
+  int span = (weight.dims(0) - 1) * dilation + 1;
+  int padded = input.dims(0) + leftPad + rightPad;
+  int outLength = padded < span ? 0 : (padded - span) / stride + 1;
+  auto outDims = input.dims();
+  outDims[0] = outLength;
+  outDims[2] = weight.dims(3);
+  out = af::array(outDims, af::dtype::f32);
+  if (outDims.elements() == 0) {
+    return;
+  }
+  auto s = sizes(input, weight, outLength, leftPad, stride, dilation);
+  {
+    DevicePtr inputRaw(input), weightRaw(weight), biasRaw(bias),
+        outRaw(out);
+    depthwiseConv1dForwardKernel<<<
+        numBlocks(out.elements()),
+        THREADS,
+        0,
+        cuda::getActiveStream()>>>(
+        s,
+        static_cast<const float*>(inputRaw.get()),
+        static_cast<const float*>(weightRaw.get()),
+        static_cast<const float*>(biasRaw.get()),
+        static_cast<float*>(outRaw.get()));
+    FL_CUDA_CHECK(cudaPeekAtLastError());
+  }
+}
+
+void depthwiseConv1dBackward(
+    const af::array& input,
+    const af::array& weight,
+    const af::array& gradOut,
+    int leftPad,
+    int stride,
+    int dilation,
+    af::array& gradInput,
+    af::array& gradWeight) {
+  if (input.elements() == 0 || gradOut.elements() == 0) {
+    gradInput = af::constant(0, input.dims(), af::dtype::f32);
+    gradWeight = af::constant(0, weight.dims(), af::dtype::f32);
+    return;
+  }
+  gradInput = af::array(input.dims(), af::dtype::f32);
+  gradWeight = af::array(weight.dims(), af::dtype::f32);
+  auto s = sizes(input, weight, gradOut.dims(0), leftPad, stride, dilation);
+  auto stream = cuda::getActiveStream();
+  {
+    DevicePtr inputRaw(input), weightRaw(weight), gradOutRaw(gradOut),
+        gradInputRaw(gradInput), gradWeightRaw(gradWeight);
+    depthwiseConv1dGradInputKernel<<<
+        numBlocks(input.elements()),
+        THREADS,
+        0,
+        stream>>>(
+        s,
+        static_cast<const float*>(weightRaw.get()),
+        static_cast<const float*>(gradOutRaw.get()),
+        static_cast<float*>(gradInputRaw.get()));
+    FL_CUDA_CHECK(cudaPeekAtLastError());
+    dim3 grid(s.kernelSize, weight.dims(3));
+    depthwiseConv1dGradWeightKernel<<<grid, THREADS, 0, stream>>>(
+        s,
+        static_cast<const float*>(inputRaw.get()),
+        static_cast<const float*>(gradOutRaw.get()),
+        static_cast<float*>(gradWeightRaw.get()));
+    FL_CUDA_CHECK(cudaPeekAtLastError());
+  }
+}
+
+} // namespace detail
+} // namespace fl
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <af/array.h>
+#include <cuda_fp16.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "flashlight/fl/autograd/Functions.h"
+#include "flashlight/fl/common/DevicePtr.h"
+#include "flashlight/fl/common/backend/cuda/CudaUtils.h"
+
+#define THREADS 256
+
+namespace {
+
+// Whether the element idx is kept, from the generator of the fused attention
+// kernels (splitmix64 of the element index)
+__device__ __forceinline__ bool keep(uint64_t seed, size_t idx, float p) {
+  uint64_t z = seed + (static_cast<uint64_t>(idx) + 1) * 0x9E3779B97F4A7C15ULL;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  z ^= z >> 31;
+  return (z >> 40) * (1.0f / 16777216.0f) >= p;
+}
+
+template <typename T>
+__global__ void dropoutKernel(
+    size_t n,
+    const T* input,
+    float p,
+    float scale,
+    const uint64_t* seedPtr,
+    T* out) {
+  uint64_t seed = *seedPtr;
+  for (size_t i = blockIdx.x * blockDim.x + threadIdx.x; i < n;
+       i += blockDim.x * gridDim.x) {
+    float x = keep(seed, i, p) ? static_cast<float>(input[i]) * scale : 0;
+    out[i] = static_cast<T>(x);
+  }
+}
+
+template <>
+__global__ void dropoutKernel<double>(
+    size_t n,
+    const double* input,
+    float p,
+    float scale,
+    const uint64_t* seedPtr,
+    double* out) {
+  uint64_t seed = *seedPtr;
+  for (size_t i = blockIdx.x * blockDim.x + threadIdx.x; i < n;
+       i += blockDim.x * gridDim.x) {
+    out[i] = keep(seed, i, p) ? input[i] * scale : 0.0;
+  }
+}
+
+template <typename T>
+void launchDropout(
+    const af::array& input,
+    float p,
+    const af::array& seed,
+    af::array& out) {
+  size_t n = input.elements();
+  size_t blocks = std::min<size_t>((n + THREADS - 1) / THREADS, 4096);
+  float scale = p < 1 ? 1 / (1 - p) : 0;
+  fl::DevicePtr inputRaw(input), seedRaw(seed), outRaw(out);
+  dropoutKernel<T><<<blocks, THREADS, 0, fl::cuda::getActiveStream()>>>(
+      n,
+      static_cast<const T*>(inputRaw.get()),
+      p,
+      scale,
+      static_cast<const uint64_t*>(seedRaw.get()),
+      static_cast<T*>(outRaw.get()));
+  FL_CUDA_CHECK(cudaPeekAtLastError());
+}
+
+} // namespace
+
+namespace fl {
+namespace detail {
+
+void dropoutForward(
+    const af::array& input,
+    float p,
+    const af::array& seed,
+    af::array& out) {
+  out = af::array(input.dims(), input.type());
+  if (input.elements() == 0) {
+    return;
+  }
+  auto seed64 = seed.as(af::dtype::u64);
+  switch (input.type()) {
+    case af::dtype::f16:
+      launchDropout<__half>(input, p, seed64, out);
+      break;
+    case af::dtype::f32:
+      launchDropout<float>(input, p, seed64, out);
+      break;
+    case af::dtype::f64:
+      launchDropout<double>(input, p, seed64, out);
+      break;
+    default:
+      throw std::invalid_argument("dropout: unsupported type");
+  }
+}
+
+} // namespace detail
+} // namespace fl
@@ -0,0 +1,655 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <af/array.h>
+
+#include <cstdint>
+#include <stdexcept>
+
+#include "flashlight/fl/autograd/Functions.h"
+#include "flashlight/fl/common/DevicePtr.h"
+#include "flashlight/fl/common/backend/cuda/CudaUtils.h"
+
+// Each warp computes a row of queries (or keys, for the gradients of the keys
+// and values); the keys (queries) are read by blocks of TILE_SIZE rows loaded
+// in shared memory
+#define NUM_WARPS 4
+#define TILE_SIZE 32
+#define WARP_SIZE 32
+// Heads of up to MAX_CHUNKS * WARP_SIZE elements
+#define MAX_CHUNKS 4
+
+namespace {
+
+struct AttentionParams {
+  int tq;
+  int tk;
+  int headDim;
+  int nHeads;
+  int nPos;
+  int posStart;
+  int posEmbPerHead;
+  // Whether the mask is Tq x Tk x B rather than Tq x Tk
+  int maskPerBatch;
+  float pDropout;
+  // Position of the first query among the keys, and local window (see
+  // fl::AttentionWindow)
+  int offset;
+  int windowLeft;
+  int windowRight;
+  int numGlobal;
+};
+
+// Rows [begin(), end()) of the keys (or queries) attended to (or attending
+// to) a block of queries (keys): the global rows [0, globalEnd), then the
+// band [lo, hi). Read by tiles of TILE_SIZE rows starting at begin() then
+// next(row0), skipping the rows between the global rows and the band.
+struct RowSpan {
+  int globalEnd;
+  int lo;
+  int hi;
+
+  __device__ __forceinline__ int begin() const {
+    return globalEnd > 0 ? 0 : lo;
+  }
+
+  __device__ __forceinline__ int next(int row0) const {
+    row0 += TILE_SIZE;
+    return (row0 >= globalEnd && row0 < lo) ? lo : row0;
+  }
+
+  __device__ __forceinline__ int end() const {
+    return max(globalEnd, hi);
+  }
+};
+
+// Keys attended to by the queries [i0, i1)
+__device__ __forceinline__ RowSpan
+keySpan(const AttentionParams& p, int i0, int i1) {
+  int pos0 = i0 + p.offset, pos1 = i1 - 1 + p.offset;
+  if ((p.windowLeft < 0 && p.windowRight < 0) || pos0 < p.numGlobal) {
+    return {0, 0, p.tk};
+  }
+  int lo = p.windowLeft < 0 ? 0 : max(pos0 - p.windowLeft, 0);
+  int hi = p.windowRight < 0 ? p.tk : min(pos1 + p.windowRight + 1, p.tk);
+  return {min(p.numGlobal, p.tk), lo, hi};
+}
+
+// Queries attending to the keys [j0, j1)
+__device__ __forceinline__ RowSpan
+querySpan(const AttentionParams& p, int j0, int j1) {
+  if ((p.windowLeft < 0 && p.windowRight < 0) || j0 < p.numGlobal) {
+    return {0, 0, p.tq};
+  }
+  int lo = p.windowRight < 0 ? 0 : max(j0 - p.windowRight - p.offset, 0);
+  int hi = p.windowLeft < 0
+      ? p.tq
+      : min(j1 - 1 + p.windowLeft + 1 - p.offset, p.tq);
+  return {min(max(p.numGlobal - p.offset, 0), p.tq), lo, hi};
+}
+
+// Whether the query i attends to the key j
+__device__ __forceinline__ bool
+inWindow(const AttentionParams& p, int i, int j) {
+  int pos = i + p.offset;
+  if (j < p.numGlobal || pos < p.numGlobal) {
+    return true;
+  }
+  return (p.windowLeft < 0 || j >= pos - p.windowLeft) &&
+      (p.windowRight < 0 || j <= pos + p.windowRight);
+}
+
+__device__ __forceinline__ float warpSum(float val) {
+  for (int offset = WARP_SIZE / 2; offset > 0; offset /= 2) {
+    val += __shfl_xor_sync(0xffffffff, val, offset);
+  }
+  return val;
+}
+
+// Dropout scale of the attention weight (i, j) of head hb
+__device__ __forceinline__ float
+keepScale(const AttentionParams& p, uint64_t seed, int i, int j, int hb) {
+  if (p.pDropout <= 0) {
+    return 1;
+  }
+  uint64_t idx = (static_cast<uint64_t>(hb) * p.tk + j) * p.tq + i;
+  uint64_t z = seed + (idx + 1) * 0x9E3779B97F4A7C15ULL;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  z ^= z >> 31;
+  float u = (z >> 40) * (1.0f / 16777216.0f);
+  return u < p.pDropout ? 0 : 1 / (1 - p.pDropout);
+}
+
+// Positional embeddings of the head hb
+__device__ __forceinline__ const float*
+posEmbHead(const AttentionParams& p, const float* posEmb, int hb) {
+  return posEmb + p.posEmbPerHead * hb * p.nPos * p.headDim;
+}
+
+// Bias of the score (i, j) from the masks
+__device__ __forceinline__ float maskBias(
+    const AttentionParams& p,
+    const float* mask,
+    const float* padMask,
+    int i,
+    int j,
+    int hb) {
+  float bias = 0;
+  if (mask) {
+    int b = p.maskPerBatch * (hb / p.nHeads);
+    bias += mask[i + p.tq * (j + p.tk * b)];
+  }
+  if (padMask) {
+    bias += padMask[j + p.tk * (hb / p.nHeads)];
+  }
+  return bias;
+}
+
+// Loads rows [row0, row0 + TILE_SIZE) of the head hb of `src` (rows x
+// headDim x nBatchHeads) in `dst` (TILE_SIZE x headDim, row-major)
+__device__ __forceinline__ void loadTile(
+    const AttentionParams& p,
+    const float* src,
+    int rows,
+    int row0,
+    int hb,
+    float* dst) {
+  for (int idx = threadIdx.x; idx < TILE_SIZE * p.headDim; idx += blockDim.x) {
+    int r = idx % TILE_SIZE;
+    int d = idx / TILE_SIZE;
+    dst[r * p.headDim + d] = (row0 + r < rows)
+        ? src[row0 + r + rows * (d + p.headDim * hb)]
+        : 0;
+  }
+}
+
+template <int Chunks>
+__global__ void fusedAttentionForwardKernel(
+    AttentionParams p,
+    const float* q,
+    const float* k,
+    const float* v,
+    const float* posEmb,
+    const float* mask,
+    const float* padMask,
+    const uint64_t* seedPtr,
+    float* out,
+    float* logSumExp) {
+  extern __shared__ float smem[];
+  float* kTile = smem;
+  float* vTile = smem + TILE_SIZE * p.headDim;
+
+  int lane = threadIdx.x % WARP_SIZE;
+  int hb = blockIdx.y;
+  int i = blockIdx.x * NUM_WARPS + threadIdx.x / WARP_SIZE;
+  bool active = i < p.tq;
+  uint64_t seed = p.pDropout > 0 ? *seedPtr : 0;
+  const float* pe = posEmb ? posEmbHead(p, posEmb, hb) : nullptr;
+
+  float qi[Chunks], acc[Chunks];
+#pragma unroll
+  for (int c = 0; c < Chunks; ++c) {
+    int d = lane + WARP_SIZE * c;
+    qi[c] = (active && d < p.headDim) ? q[i + p.tq * (d + p.headDim * hb)] : 0;
+    acc[c] = 0;
+  }
+  float rowMax = -INFINITY, rowSum = 0;
+  int i0 = blockIdx.x * NUM_WARPS;
+  auto span = keySpan(p, i0, min(i0 + NUM_WARPS, p.tq));
+
+  for (int j0 = span.begin(); j0 < span.end(); j0 = span.next(j0)) {
+    __syncthreads();
+    loadTile(p, k, p.tk, j0, hb, kTile);
+    loadTile(p, v, p.tk, j0, hb, vTile);
+    __syncthreads();
+    if (!active) {
+      continue;
+    }
+    int numKeys = min(TILE_SIZE, p.tk - j0);
+    for (int jj = 0; jj < numKeys; ++jj) {
+      int j = j0 + jj;
+      if (!inWindow(p, i, j)) {
+        continue;
+      }
+      int r = p.posStart + j - i;
+      bool hasPos = pe && r >= 0 && r < p.nPos;
+      float part = 0;
+#pragma unroll
+      for (int c = 0; c < Chunks; ++c) {
+        int d = lane + WARP_SIZE * c;
+        if (d < p.headDim) {
+          part += qi[c] * kTile[jj * p.headDim + d];
+          if (hasPos) {
+            part += qi[c] * pe[r + p.nPos * d];
+          }
+        }
+      }
+      float score = warpSum(part) + maskBias(p, mask, padMask, i, j, hb);
+      float newMax = fmaxf(rowMax, score);
+      if (newMax == -INFINITY) {
+        continue;
+      }
+      float alpha = expf(rowMax - newMax);
+      float prob = expf(score - newMax);
+      rowSum = rowSum * alpha + prob;
+      float w = prob * keepScale(p, seed, i, j, hb);
+#pragma unroll
+      for (int c = 0; c < Chunks; ++c) {
+        int d = lane + WARP_SIZE * c;
+        acc[c] = acc[c] * alpha +
+            (d < p.headDim ? w * vTile[jj * p.headDim + d] : 0);
+      }
+      rowMax = newMax;
+    }
+  }
+  if (!active) {
+    return;
+  }
+#pragma unroll
+  for (int c = 0; c < Chunks; ++c) {
+    int d = lane + WARP_SIZE * c;
+    if (d < p.headDim) {
+      out[i + p.tq * (d + p.headDim * hb)] = rowSum > 0 ? acc[c] / rowSum : 0;
+    }
+  }
+  if (lane == 0) {
+    logSumExp[i + p.tq * hb] =
+        rowSum > 0 ? rowMax + logf(rowSum) : INFINITY;
+  }
+}
+
+// Gradients of the queries and positional embeddings, per query
+template <int Chunks>
+__global__ void fusedAttentionGradQueryKernel(
+    AttentionParams p,
+    const float* q,
+    const float* k,
+    const float* v,
+    const float* posEmb,
+    const float* mask,
+    const float* padMask,
+    const uint64_t* seedPtr,
+    const float* logSumExp,
+    const float* delta,
+    const float* gradOut,
+    float* gradQ,
+    float* gradPosEmb) {
+  extern __shared__ float smem[];
+  float* kTile = smem;
+  float* vTile = smem + TILE_SIZE * p.headDim;
+
+  int lane = threadIdx.x % WARP_SIZE;
+  int hb = blockIdx.y;
+  int i = blockIdx.x * NUM_WARPS + threadIdx.x / WARP_SIZE;
+  bool active = i < p.tq;
+  uint64_t seed = p.pDropout > 0 ? *seedPtr : 0;
+  const float* pe = posEmb ? posEmbHead(p, posEmb, hb) : nullptr;
+  float* gradPe = gradPosEmb ? gradPosEmb + (pe - posEmb) : nullptr;
+
+  float qi[Chunks], dOi[Chunks], dqi[Chunks];
+#pragma unroll
+  for (int c = 0; c < Chunks; ++c) {
+    int d = lane + WARP_SIZE * c;
+    bool valid = active && d < p.headDim;
+    qi[c] = valid ? q[i + p.tq * (d + p.headDim * hb)] : 0;
+    dOi[c] = valid ? gradOut[i + p.tq * (d + p.headDim * hb)] : 0;
+    dqi[c] = 0;
+  }
+  float lse = active ? logSumExp[i + p.tq * hb] : INFINITY;
+  float di = active ? delta[i + p.tq * hb] : 0;
+  int i0 = blockIdx.x * NUM_WARPS;
+  auto span = keySpan(p, i0, min(i0 + NUM_WARPS, p.tq));
+
+  for (int j0 = span.begin(); j0 < span.end(); j0 = span.next(j0)) {
+    __syncthreads();
+    loadTile(p, k, p.tk, j0, hb, kTile);
+    loadTile(p, v, p.tk, j0, hb, vTile);
+    __syncthreads();
+    if (lse == INFINITY) {
+      continue;
+    }
+    int numKeys = min(TILE_SIZE, p.tk - j0);
+    for (int jj = 0; jj < numKeys; ++jj) {
+      int j = j0 + jj;
+      if (!inWindow(p, i, j)) {
+        continue;
+      }
+      int r = p.posStart + j - i;
+      bool hasPos = pe && r >= 0 && r < p.nPos;
+      float part = 0, partGrad = 0;
+#pragma unroll
+      for (int c = 0; c < Chunks; ++c) {
+        int d = lane + WARP_SIZE * c;
+        if (d < p.headDim) {
+          part += qi[c] * kTile[jj * p.headDim + d];
+          if (hasPos) {
+            part += qi[c] * pe[r + p.nPos * d];
+          }
+          partGrad += dOi[c] * vTile[jj * p.headDim + d];
+        }
+      }
+      float score = warpSum(part) + maskBias(p, mask, padMask, i, j, hb);
+      float prob = expf(score - lse);
+      float dA = warpSum(partGrad);
+      if (prob == 0) {
+        continue;
+      }
+      float dS = prob * (dA * keepScale(p, seed, i, j, hb) - di);
+#pragma unroll
+      for (int c = 0; c < Chunks; ++c) {
+        int d = lane + WARP_SIZE * c;
+        if (d < p.headDim) {
+          dqi[c] += dS * kTile[jj * p.headDim + d];
+          if (hasPos) {
+            dqi[c] += dS * pe[r + p.nPos * d];
+            atomicAdd(&gradPe[r + p.nPos * d], dS * qi[c]);
+          }
+        }
+      }
+    }
+  }
+  if (!active) {
+    return;
+  }
+#pragma unroll
+  for (int c = 0; c < Chunks; ++c) {
+    int d = lane + WARP_SIZE * c;
+    if (d < p.headDim) {
+      gradQ[i + p.tq * (d + p.headDim * hb)] = dqi[c];
+    }
+  }
+}
+
+// Gradients of the keys and values, per key
+template <int Chunks>
+__global__ void fusedAttentionGradKeyValueKernel(
+    AttentionParams p,
+    const float* q,
+    const float* k,
+    const float* v,
+    const float* posEmb,
+    const float* mask,
+    const float* padMask,
+    const uint64_t* seedPtr,
+    const float* logSumExp,
+    const float* delta,
+    const float* gradOut,
+    float* gradK,
+    float* gradV) {
+  extern __shared__ float smem[];
+  float* qTile = smem;
+  float* dOTile = smem + TILE_SIZE * p.headDim;
+  float* lseTile = smem + 2 * TILE_SIZE * p.headDim;
+  float* deltaTile = lseTile + TILE_SIZE;
+
+  int lane = threadIdx.x % WARP_SIZE;
+  int hb = blockIdx.y;
+  int j = blockIdx.x * NUM_WARPS + threadIdx.x / WARP_SIZE;
+  bool active = j < p.tk;
+  uint64_t seed = p.pDropout > 0 ? *seedPtr : 0;
+  const float* pe = posEmb ? posEmbHead(p, posEmb, hb) : nullptr;
+
+  float kj[Chunks], vj[Chunks], dkj[Chunks], dvj[Chunks];
+#pragma unroll
+  for (int c = 0; c < Chunks; ++c) {
+    int d = lane + WARP_SIZE * c;
+    bool valid = active && d < p.headDim;
+    kj[c] = valid ? k[j + p.tk * (d + p.headDim * hb)] : 0;
+    vj[c] = valid ? v[j + p.tk * (d + p.headDim * hb)] : 0;
+    dkj[c] = 0;
+    dvj[c] = 0;
+  }
+
+  int j0 = blockIdx.x * NUM_WARPS;
+  auto span = querySpan(p, j0, min(j0 + NUM_WARPS, p.tk));
+
+  for (int i0 = span.begin(); i0 < span.end(); i0 = span.next(i0)) {
+    __syncthreads();
+    loadTile(p, q, p.tq, i0, hb, qTile);
+    loadTile(p, gradOut, p.tq, i0, hb, dOTile);
+    for (int r = threadIdx.x; r < TILE_SIZE; r += blockDim.x) {
+      bool valid = i0 + r < p.tq;
+      lseTile[r] = valid ? logSumExp[i0 + r + p.tq * hb] : INFINITY;
+      deltaTile[r] = valid ? delta[i0 + r + p.tq * hb] : 0;
+    }
+    __syncthreads();
+    if (!active) {
+      continue;
+    }
+    int numQueries = min(TILE_SIZE, p.tq - i0);
+    for (int ii = 0; ii < numQueries; ++ii) {
+      int i = i0 + ii;
+      if (lseTile[ii] == INFINITY || !inWindow(p, i, j)) {
+        continue;
+      }
+      int r = p.posStart + j - i;
+      bool hasPos = pe && r >= 0 && r < p.nPos;
+      float part = 0, partGrad = 0;
+#pragma unroll
+      for (int c = 0; c < Chunks; ++c) {
+        int d = lane + WARP_SIZE * c;
+        if (d < p.headDim) {
+          float qd = qTile[ii * p.headDim + d];
+          part += qd * kj[c];
+          if (hasPos) {
+            part += qd * pe[r + p.nPos * d];
+          }
+          partGrad += dOTile[ii * p.headDim + d] * vj[c];
+        }
+      }
+      float score = warpSum(part) + maskBias(p, mask, padMask, i, j, hb);
+      float prob = expf(score - lseTile[ii]);
+      float dA = warpSum(partGrad);
+      if (prob == 0) {
+        continue;
+      }
+      float keep = keepScale(p, seed, i, j, hb);
+      float dS = prob * (dA * keep - deltaTile[ii]);
+#pragma unroll
+      for (int c = 0; c < Chunks; ++c) {
+        int d = lane + WARP_SIZE * c;
+        if (d < p.headDim) {
+          dkj[c] += dS * qTile[ii * p.headDim + d];
+          dvj[c] += prob * keep * dOTile[ii * p.headDim + d];
+        }
+      }
+    }
+  }
+  if (!active) {
+    return;
+  }
+#pragma unroll
+  for (int c = 0; c < Chunks; ++c) {
+    int d = lane + WARP_SIZE * c;
+    if (d < p.headDim) {
+      gradK[j + p.tk * (d + p.headDim * hb)] = dkj[c];
+      gradV[j + p.tk * (d + p.headDim * hb)] = dvj[c];
+    }
+  }
+}
+
+AttentionParams makeParams(
+    const af::array& q,
+    const af::array& k,
+    const af::array& posEmb,
+    const af::array& mask,
+    int nHeads,
+    int offset,
+    float pDropout,
+    const fl::AttentionWindow& window) {
+  if (q.dims(2) > 65535) {
+    throw std::invalid_argument(
+        "fusedAttention: too many heads times batch size");
+  }
+  AttentionParams p;
+  p.tq = q.dims(0);
+  p.tk = k.dims(0);
+  p.headDim = q.dims(1);
+  p.nHeads = nHeads;
+  p.nPos = posEmb.isempty() ? 0 : posEmb.dims(0);
+  p.posStart = p.nPos / 2 - offset;
+  p.posEmbPerHead = posEmb.isempty() ? 0 : (posEmb.dims(2) > 1);
+  p.maskPerBatch = mask.isempty() ? 0 : (mask.dims(2) > 1);
+  p.pDropout = pDropout;
+  p.offset = offset;
+  p.windowLeft = window.left;
+  p.windowRight = window.right;
+  p.numGlobal = window.numGlobal;
+  return p;
+}
+
+dim3 gridSize(int rows, int nBatchHeads) {
+  return dim3((rows + NUM_WARPS - 1) / NUM_WARPS, nBatchHeads);
+}
+
+} // namespace
+
+// Dispatches KERNEL on the number of elements per lane of the heads
+#define FL_ATTENTION_DISPATCH(HEAD_DIM, KERNEL, GRID, SHARED, STREAM, ...) \
+  if ((HEAD_DIM) <= WARP_SIZE) {                                           \
+    KERNEL<1><<<GRID, NUM_WARPS * WARP_SIZE, SHARED, STREAM>>>(__VA_ARGS__); \
+  } else if ((HEAD_DIM) <= 2 * WARP_SIZE) {                                \
+    KERNEL<2><<<GRID, NUM_WARPS * WARP_SIZE, SHARED, STREAM>>>(__VA_ARGS__); \
+  } else {                                                                 \
+    KERNEL<4><<<GRID, NUM_WARPS * WARP_SIZE, SHARED, STREAM>>>(__VA_ARGS__); \
+  }
+
+namespace fl {
+namespace detail {
+
+bool fusedAttentionSupported(int headDim) {
+  return headDim <= MAX_CHUNKS * WARP_SIZE;
+}
+
+void fusedAttentionForward(
+    const af::array& q,
+    const af::array& k,
+    const af::array& v,
+    const af::array& posEmb,
+    const af::array& mask,
+    const af::array& padMask,
+    int nHeads,
+    int offset,
+    float pDropout,
+    const af::array& seed,
+    const AttentionWindow& window,
+    af::array& out,
+    af::array& logSumExp) {
+  if (!fusedAttentionSupported(q.dims(1))) {
+    throw std::invalid_argument("fusedAttentionForward: head too large");
+  }
+  auto p = makeParams(q, k, posEmb, mask, nHeads, offset, pDropout, window);
+  out = af::array(q.dims(), af::dtype::f32);
+  logSumExp = af::array(p.tq, 1, q.dims(2), af::dtype::f32);
+  {
+    DevicePtr qRaw(q), kRaw(k), vRaw(v), posEmbRaw(posEmb), maskRaw(mask),
+        padMaskRaw(padMask), seedRaw(seed), outRaw(out),
+        logSumExpRaw(logSumExp);
+    size_t shared = 2 * TILE_SIZE * p.headDim * sizeof(float);
+    cudaStream_t stream = cuda::getActiveStream();
+    FL_ATTENTION_DISPATCH(
+        p.headDim,
+        fusedAttentionForwardKernel,
+        gridSize(p.tq, q.dims(2)),
+        shared,
+        stream,
+        p,
+        static_cast<const float*>(qRaw.get()),
+        static_cast<const float*>(kRaw.get()),
+        static_cast<const float*>(vRaw.get()),
+        static_cast<const float*>(posEmbRaw.get()),
+        static_cast<const float*>(maskRaw.get()),
+        static_cast<const float*>(padMaskRaw.get()),
+        static_cast<const uint64_t*>(seedRaw.get()),
+        static_cast<float*>(outRaw.get()),
+        static_cast<float*>(logSumExpRaw.get()));
+    FL_CUDA_CHECK(cudaPeekAtLastError());
+  }
+}
+
+void fusedAttentionBackward(
+    const af::array& q,
+    const af::array& k,
+    const af::array& v,
+    const af::array& posEmb,
+    const af::array& mask,
+    const af::array& padMask,
+    int nHeads,
+    int offset,
+    float pDropout,
+    const af::array& seed,
+    const AttentionWindow& window,
+    const af::array& out,
+    const af::array& logSumExp,
+    const af::array& gradOut,
+    af::array& gradQ,
+    af::array& gradK,
+    af::array& gradV,
+    af::array& gradPosEmb) {
+  auto p = makeParams(q, k, posEmb, mask, nHeads, offset, pDropout, window);
+  // delta_i = sum_j attn_ij * dA_ij = dO_i . O_i
+  af::array delta = af::sum(gradOut * out, 1);
+  delta.eval();
+  gradQ = af::array(q.dims(), af::dtype::f32);
+  gradK = af::array(k.dims(), af::dtype::f32);
+  gradV = af::array(v.dims(), af::dtype::f32);
+  // Accumulated with atomics
+  gradPosEmb = posEmb.isempty()
+      ? af::array()
+      : af::constant(0, posEmb.dims(), af::dtype::f32);
+  {
+    DevicePtr qRaw(q), kRaw(k), vRaw(v), posEmbRaw(posEmb), maskRaw(mask),
+        padMaskRaw(padMask), seedRaw(seed), logSumExpRaw(logSumExp),
+        deltaRaw(delta), gradOutRaw(gradOut), gradQRaw(gradQ),
+        gradKRaw(gradK), gradVRaw(gradV), gradPosEmbRaw(gradPosEmb);
+    cudaStream_t stream = cuda::getActiveStream();
+    FL_ATTENTION_DISPATCH(
+        p.headDim,
+        fusedAttentionGradQueryKernel,
+        gridSize(p.tq, q.dims(2)),
+        2 * TILE_SIZE * p.headDim * sizeof(float),
+        stream,
+        p,
+        static_cast<const float*>(qRaw.get()),
+        static_cast<const float*>(kRaw.get()),
+        static_cast<const float*>(vRaw.get()),
+        static_cast<const float*>(posEmbRaw.get()),
+        static_cast<const float*>(maskRaw.get()),
+        static_cast<const float*>(padMaskRaw.get()),
+        static_cast<const uint64_t*>(seedRaw.get()),
+        static_cast<const float*>(logSumExpRaw.get()),
+        static_cast<const float*>(deltaRaw.get()),
+        static_cast<const float*>(gradOutRaw.get()),
+        static_cast<float*>(gradQRaw.get()),
+        static_cast<float*>(gradPosEmbRaw.get()));
+    FL_CUDA_CHECK(cudaPeekAtLastError());
+    FL_ATTENTION_DISPATCH(
+        p.headDim,
+        fusedAttentionGradKeyValueKernel,
+        gridSize(p.tk, q.dims(2)),
+        2 * TILE_SIZE * (p.headDim + 1) * sizeof(float),
+        stream,
+        p,
+        static_cast<const float*>(qRaw.get()),
+        static_cast<const float*>(kRaw.get()),
+        static_cast<const float*>(vRaw.get()),
+        static_cast<const float*>(posEmbRaw.get()),
+        static_cast<const float*>(maskRaw.get()),
+        static_cast<const float*>(padMaskRaw.get()),
+        static_cast<const uint64_t*>(seedRaw.get()),
+        static_cast<const float*>(logSumExpRaw.get()),
+        static_cast<const float*>(deltaRaw.get()),
+        static_cast<const float*>(gradOutRaw.get()),
+        static_cast<float*>(gradKRaw.get()),
+        static_cast<float*>(gradVRaw.get()));
+    FL_CUDA_CHECK(cudaPeekAtLastError());
+  }
+}
+
+} // namespace detail
+} // namespace fl
@@ -0,0 +1,326 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <af/array.h>
+
+#include <algorithm>
+
+#include "flashlight/fl/autograd/Functions.h"
+#include "flashlight/fl/common/DevicePtr.h"
+#include "flashlight/fl/common/backend/cuda/CudaUtils.h"
+
+// Each block normalizes a column; the parameter gradients are accumulated by
+// blocks of THREADS rows and COLS_PER_BLOCK columns
+#define THREADS 256
+#define WARP_SIZE 32
+#define COLS_PER_BLOCK 64
+#define GELU_SCALE 0.7978845608f
+#define GELU_CUBIC 0.044715f
+
+namespace {
+
+__device__ __forceinline__ float warpSum(float val) {
+  for (int offset = WARP_SIZE / 2; offset > 0; offset /= 2) {
+    val += __shfl_xor_sync(0xffffffff, val, offset);
+  }
+  return val;
+}
+
+// Sum over the threads of the block, returned to all of them
+__device__ float blockSum(float val, float* shared) {
+  int lane = threadIdx.x % WARP_SIZE;
+  int warp = threadIdx.x / WARP_SIZE;
+  val = warpSum(val);
+  __syncthreads();
+  if (lane == 0) {
+    shared[warp] = val;
+  }
+  __syncthreads();
+  val = lane < blockDim.x / WARP_SIZE ? shared[lane] : 0;
+  return warpSum(val);
+}
+
+__device__ __forceinline__ float
+paramAt(const float* param, int size, int row, float defaultValue) {
+  if (!param) {
+    return defaultValue;
+  }
+  return size == 1 ? param[0] : param[row];
+}
+
+__device__ __forceinline__ float
+inputAt(const float* input, const float* residual, size_t idx) {
+  return residual ? input[idx] + residual[idx] : input[idx];
+}
+
+__global__ void layerNormForwardKernel(
+    int rows,
+    const float* input,
+    const float* residual,
+    const float* weight,
+    int weightSize,
+    const float* bias,
+    int biasSize,
+    float eps,
+    float* out,
+    float* mean,
+    float* rstd) {
+  __shared__ float shared[WARP_SIZE];
+  size_t base = static_cast<size_t>(blockIdx.x) * rows;
+  float sum = 0;
+  for (int i = threadIdx.x; i < rows; i += blockDim.x) {
+    sum += inputAt(input, residual, base + i);
+  }
+  float m = blockSum(sum, shared) / rows;
+  float sqSum = 0;
+  for (int i = threadIdx.x; i < rows; i += blockDim.x) {
+    float d = inputAt(input, residual, base + i) - m;
+    sqSum += d * d;
+  }
+  float r = rsqrtf(blockSum(sqSum, shared) / rows + eps);
+  for (int i = threadIdx.x; i < rows; i += blockDim.x) {
+    float xhat = (inputAt(input, residual, base + i) - m) * r;
+    out[base + i] = xhat * paramAt(weight, weightSize, i, 1) +
+        paramAt(bias, biasSize, i, 0);
+  }
+  if (threadIdx.x == 0) {
+    mean[blockIdx.x] = m;
+    rstd[blockIdx.x] = r;
+  }
+}
+
+__global__ void layerNormGradInputKernel(
+    int rows,
+    const float* input,
+    const float* residual,
+    const float* weight,
+    int weightSize,
+    const float* mean,
+    const float* rstd,
+    const float* gradOut,
+    float* gradInput) {
+  __shared__ float shared[WARP_SIZE];
+  size_t base = static_cast<size_t>(blockIdx.x) * rows;
+  float m = mean[blockIdx.x];
+  float r = rstd[blockIdx.x];
+  // dx = rstd * (g - mean(g) - xhat * mean(g * xhat)), with g = dy * w
+  float gSum = 0, gxSum = 0;
+  for (int i = threadIdx.x; i < rows; i += blockDim.x) {
+    float xhat = (inputAt(input, residual, base + i) - m) * r;
+    float g = gradOut[base + i] * paramAt(weight, weightSize, i, 1);
+    gSum += g;
+    gxSum += g * xhat;
+  }
+  float gMean = blockSum(gSum, shared) / rows;
+  float gxMean = blockSum(gxSum, shared) / rows;
+  for (int i = threadIdx.x; i < rows; i += blockDim.x) {
+    float xhat = (inputAt(input, residual, base + i) - m) * r;
+    float g = gradOut[base + i] * paramAt(weight, weightSize, i, 1);
+    gradInput[base + i] = r * (g - gMean - xhat * gxMean);
+  }
+}
+
+__global__ void layerNormGradParamsKernel(
+    int rows,
+    int cols,
+    const float* input,
+    const float* residual,
+    const float* mean,
+    const float* rstd,
+    const float* gradOut,
+    float* gradWeight,
+    float* gradBias) {
+  int i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i >= rows) {
+    return;
+  }
+  int c0 = blockIdx.y * COLS_PER_BLOCK;
+  int c1 = min(c0 + COLS_PER_BLOCK, cols);
+  float dw = 0, db = 0;
+  for (int c = c0; c < c1; ++c) {
+    size_t idx = static_cast<size_t>(c) * rows + i;
+    float xhat = (inputAt(input, residual, idx) - mean[c]) * rstd[c];
+    dw += gradOut[idx] * xhat;
+    db += gradOut[idx];
+  }
+  atomicAdd(gradWeight + i, dw);
+  atomicAdd(gradBias + i, db);
+}
+
+__global__ void biasGeluForwardKernel(
+    size_t n,
+    int rows,
+    const float* input,
+    const float* bias,
+    float* out) {
+  for (size_t idx = blockIdx.x * blockDim.x + threadIdx.x; idx < n;
+       idx += blockDim.x * gridDim.x) {
+    float z = input[idx] + bias[idx % rows];
+    out[idx] =
+        0.5f * z * (1 + tanhf(GELU_SCALE * (z + GELU_CUBIC * z * z * z)));
+  }
+}
+
+__global__ void biasGeluBackwardKernel(
+    size_t n,
+    int rows,
+    const float* input,
+    const float* bias,
+    const float* gradOut,
+    float* gradInput) {
+  for (size_t idx = blockIdx.x * blockDim.x + threadIdx.x; idx < n;
+       idx += blockDim.x * gridDim.x) {
+    float z = input[idx] + bias[idx % rows];
+    float t = tanhf(GELU_SCALE * (z + GELU_CUBIC * z * z * z));
+    float dz = 0.5f * (1 + t) +
+        0.5f * z * (1 - t * t) * GELU_SCALE * (1 + 3 * GELU_CUBIC * z * z);
+    gradInput[idx] = gradOut[idx] * dz;
+  }
+}
+
+unsigned elementwiseGridSize(size_t n) {
+  size_t blocks = (n + THREADS - 1) / THREADS;
+  return std::max<size_t>(1, std::min<size_t>(blocks, 4096));
+}
+
+} // namespace
+
+namespace fl {
+namespace detail {
+
+void layerNormForward(
+    const af::array& input,
+    const af::array& residual,
+    const af::array& weight,
+    const af::array& bias,
+    float eps,
+    af::array& out,
+    af::array& mean,
+    af::array& rstd) {
+  int rows = input.dims(0);
+  int cols = input.elements() / rows;
+  out = af::array(input.dims(), af::dtype::f32);
+  mean = af::array(1, cols, af::dtype::f32);
+  rstd = af::array(1, cols, af::dtype::f32);
+  {
+    DevicePtr inputRaw(input), residualRaw(residual), weightRaw(weight),
+        biasRaw(bias), outRaw(out), meanRaw(mean), rstdRaw(rstd);
+    layerNormForwardKernel<<<cols, THREADS, 0, cuda::getActiveStream()>>>(
+        rows,
+        static_cast<const float*>(inputRaw.get()),
+        static_cast<const float*>(residualRaw.get()),
+        static_cast<const float*>(weightRaw.get()),
+        weight.elements(),
+        static_cast<const float*>(biasRaw.get()),
+        bias.elements(),
+        eps,
+        static_cast<float*>(outRaw.get()),
+        static_cast<float*>(meanRaw.get()),
+        static_cast<float*>(rstdRaw.get()));
+    FL_CUDA_CHECK(cudaPeekAtLastError());
+  }
+}
+
+void layerNormBackward(
+    const af::array& input,
+    const af::array& residual,
+    const af::array& weight,
+    const af::array& mean,
+    const af::array& rstd,
+    const af::array& gradOut,
+    af::array& gradInput,
+    af::array& gradWeight,
+    af::array& gradBias) {
+  int rows = input.dims(0);
+  int cols = input.elements() / rows;
+  gradInput = af::array(input.dims(), af::dtype::f32);
+  // Accumulated with atomics
+  gradWeight = af::constant(0, rows, af::dtype::f32);
+  gradBias = af::constant(0, rows, af::dtype::f32);
+  {
+    DevicePtr inputRaw(input), residualRaw(residual), weightRaw(weight),
+        meanRaw(mean), rstdRaw(rstd), gradOutRaw(gradOut),
+        gradInputRaw(gradInput), gradWeightRaw(gradWeight),
+        gradBiasRaw(gradBias);
+    cudaStream_t stream = cuda::getActiveStream();
+    layerNormGradInputKernel<<<cols, THREADS, 0, stream>>>(
+        rows,
+        static_cast<const float*>(inputRaw.get()),
+        static_cast<const float*>(residualRaw.get()),
+        static_cast<const float*>(weightRaw.get()),
+        weight.elements(),
+        static_cast<const float*>(meanRaw.get()),
+        static_cast<const float*>(rstdRaw.get()),
+        static_cast<const float*>(gradOutRaw.get()),
+        static_cast<float*>(gradInputRaw.get()));
+    FL_CUDA_CHECK(cudaPeekAtLastError());
+    dim3 grid(
+        (rows + THREADS - 1) / THREADS,
+        (cols + COLS_PER_BLOCK - 1) / COLS_PER_BLOCK);
+    layerNormGradParamsKernel<<<grid, THREADS, 0, stream>>>(
+        rows,
+        cols,
+        static_cast<const float*>(inputRaw.get()),
+        static_cast<const float*>(residualRaw.get()),
+        static_cast<const float*>(meanRaw.get()),
+        static_cast<const float*>(rstdRaw.get()),
+        static_cast<const float*>(gradOutRaw.get()),
+        static_cast<float*>(gradWeightRaw.get()),
+        static_cast<float*>(gradBiasRaw.get()));
+    FL_CUDA_CHECK(cudaPeekAtLastError());
+  }
+}
+
+void biasGeluForward(
+    const af::array& input,
+    const af::array& bias,
+    af::array& out) {
+  size_t n = input.elements();
+  out = af::array(input.dims(), af::dtype::f32);
+  {
+    DevicePtr inputRaw(input), biasRaw(bias), outRaw(out);
+    biasGeluForwardKernel<<<
+        elementwiseGridSize(n),
+        THREADS,
+        0,
+        cuda::getActiveStream()>>>(
+        n,
+        input.dims(0),
+        static_cast<const float*>(inputRaw.get()),
+        static_cast<const float*>(biasRaw.get()),
+        static_cast<float*>(outRaw.get()));
+    FL_CUDA_CHECK(cudaPeekAtLastError());
+  }
+}
+
+void biasGeluBackward(
+    const af::array& input,
+    const af::array& bias,
+    const af::array& gradOut,
+    af::array& gradInput) {
+  size_t n = input.elements();
+  gradInput = af::array(input.dims(), af::dtype::f32);
+  {
+    DevicePtr inputRaw(input), biasRaw(bias), gradOutRaw(gradOut),
+        gradInputRaw(gradInput);
+    biasGeluBackwardKernel<<<
+        elementwiseGridSize(n),
+        THREADS,
+        0,
+        cuda::getActiveStream()>>>(
+        n,
+        input.dims(0),
+        static_cast<const float*>(inputRaw.get()),
+        static_cast<const float*>(biasRaw.get()),
+        static_cast<const float*>(gradOutRaw.get()),
+        static_cast<float*>(gradInputRaw.get()));
+    FL_CUDA_CHECK(cudaPeekAtLastError());
+  }
+}
+
+} // namespace detail
+} // namespace fl
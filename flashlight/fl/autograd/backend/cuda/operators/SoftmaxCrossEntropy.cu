@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <af/array.h>
+
+#include <algorithm>
+#include <cfloat>
+
+#include "flashlight/fl/autograd/Functions.h"
+#include "flashlight/fl/common/DevicePtr.h"
+#include "flashlight/fl/common/backend/cuda/CudaUtils.h"
+
+// Each block reduces a column of logits in a single pass, with an online
+// log-sum-exp
+#define THREADS 256
+#define WARP_SIZE 32
+
+namespace {
+
+struct LogSumExp {
+  float max;
+  float sum;
+};
+
+__device__ __forceinline__ LogSumExp combine(LogSumExp a, LogSumExp b) {
+  float m = fmaxf(a.max, b.max);
+  if (m == -FLT_MAX) {
+    return a;
+  }
+  return {m, a.sum * __expf(a.max - m) + b.sum * __expf(b.max - m)};
+}
+
+__device__ __forceinline__ LogSumExp warpReduce(LogSumExp val) {
+  for (int offset = WARP_SIZE / 2; offset > 0; offset /= 2) {
+    LogSumExp other = {
+        __shfl_xor_sync(0xffffffff, val.max, offset),
+        __shfl_xor_sync(0xffffffff, val.sum, offset)};
+    val = combine(val, other);
+  }
+  return val;
+}
+
+__device__ __forceinline__ float warpSum(float val) {
+  for (int offset = WARP_SIZE / 2; offset > 0; offset /= 2) {
+    val += __shfl_xor_sync(0xffffffff, val, offset);
+  }
+  return val;
+}
+
+__global__ void softmaxCrossEntropyForwardKernel(
+    int C,
+    const float* logits,
+    const int* targets,
+    int ignoreIndex,
+    float labelSmoothing,
+    float* loss,
+    float* logSumExp) {
+  __shared__ LogSumExp sharedLse[THREADS / WARP_SIZE];
+  __shared__ float sharedSum[THREADS / WARP_SIZE];
+  const float* x = logits + static_cast<size_t>(blockIdx.x) * C;
+  LogSumExp lse = {-FLT_MAX, 0};
+  float sum = 0;
+  for (int c = threadIdx.x; c < C; c += blockDim.x) {
+    lse = combine(lse, {x[c], 1});
+    sum += x[c];
+  }
+  lse = warpReduce(lse);
+  sum = warpSum(sum);
+  int lane = threadIdx.x % WARP_SIZE;
+  int warp = threadIdx.x / WARP_SIZE;
+  if (lane == 0) {
+    sharedLse[warp] = lse;
+    sharedSum[warp] = sum;
+  }
+  __syncthreads();
+  if (warp == 0) {
+    bool valid = lane < blockDim.x / WARP_SIZE;
+    lse = valid ? sharedLse[lane] : LogSumExp{-FLT_MAX, 0};
+    sum = valid ? sharedSum[lane] : 0;
+    lse = warpReduce(lse);
+    sum = warpSum(sum);
+    if (lane == 0) {
+      float logZ = lse.max + __logf(lse.sum);
+      int target = targets[blockIdx.x];
+      logSumExp[blockIdx.x] = logZ;
+      loss[blockIdx.x] = target == ignoreIndex
+          ? 0
+          : logZ - (1 - labelSmoothing) * x[target] -
+              labelSmoothing * sum / C;
+    }
+  }
+}
+
+__global__ void softmaxCrossEntropyBackwardKernel(
+    size_t n,
+    int C,
+    const float* logits,
+    const int* targets,
+    const float* logSumExp,
+    const float* gradLoss,
+    int ignoreIndex,
+    float labelSmoothing,
+    float* gradLogits) {
+  for (size_t idx = blockIdx.x * blockDim.x + threadIdx.x; idx < n;
+       idx += blockDim.x * gridDim.x) {
+    size_t col = idx / C;
+    int c = idx % C;
+    int target = targets[col];
+    if (target == ignoreIndex) {
+      gradLogits[idx] = 0;
+      continue;
+    }
+    float p = __expf(logits[idx] - logSumExp[col]);
+    float y = (c == target ? 1 - labelSmoothing : 0) + labelSmoothing / C;
+    gradLogits[idx] = (p - y) * gradLoss[col];
+  }
+}
+
+} // namespace
+
+namespace fl {
+namespace detail {
+
+void softmaxCrossEntropyForward(
+    const af::array& logits,
+    const af::array& targets,
+    int ignoreIndex,
+    float labelSmoothing,
+    af::array& loss,
+    af::array& logSumExp) {
+  int C = logits.dims(0);
+  int X = logits.dims(1);
+  loss = af::array(X, af::dtype::f32);
+  logSumExp = af::array(X, af::dtype::f32);
+  {
+    DevicePtr logitsRaw(logits), targetsRaw(targets), lossRaw(loss),
+        logSumExpRaw(logSumExp);
+    softmaxCrossEntropyForwardKernel<<<
+        X,
+        THREADS,
+        0,
+        cuda::getActiveStream()>>>(
+        C,
+        static_cast<const float*>(logitsRaw.get()),
+        static_cast<const int*>(targetsRaw.get()),
+        ignoreIndex,
+        labelSmoothing,
+        static_cast<float*>(lossRaw.get()),
+        static_cast<float*>(logSumExpRaw.get()));
+    FL_CUDA_CHECK(cudaPeekAtLastError());
+  }
+}
+
+void softmaxCrossEntropyBackward(
+    const af::array& logits,
+    const af::array& targets,
+    const af::array& logSumExp,
+    const af::array& gradLoss,
+    int ignoreIndex,
+    float labelSmoothing,
+    af::array& gradLogits) {
+  size_t n = logits.elements();
+  size_t blocks = std::max<size_t>(
+      1, std::min<size_t>((n + THREADS - 1) / THREADS, 4096));
+  gradLogits = af::array(logits.dims(), af::dtype::f32);
+  {
+    DevicePtr logitsRaw(logits), targetsRaw(targets),
+        logSumExpRaw(logSumExp), gradLossRaw(gradLoss),
+        gradLogitsRaw(gradLogits);
+    softmaxCrossEntropyBackwardKernel<<<
+        blocks,
+        THREADS,
+        0,
+        cuda::getActiveStream()>>>(
+        n,
+        logits.dims(0),
+        static_cast<const float*>(logitsRaw.get()),
+        static_cast<const int*>(targetsRaw.get()),
+        static_cast<const float*>(logSumExpRaw.get()),
+        static_cast<const float*>(gradLossRaw.get()),
+        ignoreIndex,
+        labelSmoothing,
+        static_cast<float*>(gradLogitsRaw.get()));
+    FL_CUDA_CHECK(cudaPeekAtLastError());
+  }
+}
+
+} // namespace detail
+} // namespace fl
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Implements batch normalization at inference over the n elements of input,
+ * with the running statistics: the feature of element e is
+ * (e / inner) % nFeat, where inner is the number of elements below the
+ * normalized axes. weight and bias are applied if hasWeight and hasBias.
+ * Results are written in to output with the same dimensions as input.
+ * Global work size is [n].
+ *
+ * Kernels are defined for float and half (storage only, computed in float).
+ */
+
+#define LOAD_float(p, i) ((p)[i])
+#define STORE_float(v, p, i) ((p)[i] = (v))
+#define LOAD_half(p, i) vload_half((i), (p))
+#define STORE_half(v, p, i) vstore_half((v), (i), (p))
+
+#define DEFINE_BATCHNORM_KERNELS(T)                                           \
+  void __kernel batchnorm_infer_##T(                                          \
+      __global const T* input,                                                \
+      __global const T* runningMean,                                          \
+      __global const T* runningVar,                                           \
+      __global const T* weight,                                               \
+      __global const T* bias,                                                 \
+      __global T* output,                                                     \
+      int n,                                                                  \
+      int inner,                                                              \
+      int nFeat,                                                              \
+      float epsilon,                                                          \
+      int hasWeight,                                                          \
+      int hasBias) {                                                          \
+    const int e = get_global_id(0);                                           \
+    if (e >= n) return;                                                       \
+    const int f = (e / inner) % nFeat;                                        \
+                                                                              \
+    float scale = rsqrt(LOAD_##T(runningVar, f) + epsilon);                   \
+    if (hasWeight) {                                                          \
+      scale *= LOAD_##T(weight, f);                                           \
+    }                                                                         \
+    float value = (LOAD_##T(input, e) - LOAD_##T(runningMean, f)) * scale;    \
+    if (hasBias) {                                                            \
+      value += LOAD_##T(bias, f);                                             \
+    }                                                                         \
+    STORE_##T(value, output, e);                                              \
+  }
+
+DEFINE_BATCHNORM_KERNELS(float)
+DEFINE_BATCHNORM_KERNELS(half)
@@ -7,11 +7,86 @@
 
 #include <algorithm>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
+#include <CL/cl2.hpp>
+#include <af/opencl.h>
 #include <arrayfire.h>
 
+#include "opencl_kernels/BatchNorm_cl.h"
+
 #include "flashlight/fl/autograd/Functions.h"
 #include "flashlight/fl/autograd/Variable.h"
+#include "flashlight/fl/common/OpenClUtils.h"
+
+namespace {
+
+using namespace ::fl::ocl;
+
+/**
+ * Normalizes input with the running statistics (and weight and bias if
+ * nonempty) in a single kernel. The features are along the nFeat elements
+ * from axis minAxis.
+ */
+af::array batchnormInfer(
+    const af::array& input,
+    const af::array& runningMean,
+    const af::array& runningVar,
+    const af::array& weight,
+    const af::array& bias,
+    int minAxis,
+    int nFeat,
+    float epsilon) {
+  std::string name =
+      input.type() == f16 ? "batchnorm_infer_half" : "batchnorm_infer_float";
+  cl_kernel kernel =
+      OpenClStream::instance()->getOrCreateKernel(name, opencl::BatchNorm_cl);
+
+  int n = input.elements();
+  int inner = 1;
+  for (int d = 0; d < minAxis; ++d) {
+    inner *= input.dims(d);
+  }
+  int hasWeight = weight.isempty() ? 0 : 1;
+  int hasBias = bias.isempty() ? 0 : 1;
+
+  // The kernels take the type of the input
+  auto type = input.type();
+  auto mean = runningMean.as(type);
+  auto var = runningVar.as(type);
+  auto wt = hasWeight ? weight.as(type) : mean;
+  auto bs = hasBias ? bias.as(type) : mean;
+  af::array output(input.dims(), type);
+  {
+    DevicePtrOpenCl inputPtr(input);
+    DevicePtrOpenCl meanPtr(mean);
+    DevicePtrOpenCl varPtr(var);
+    DevicePtrOpenCl weightPtr(wt);
+    DevicePtrOpenCl biasPtr(bs);
+    DevicePtrOpenCl outputPtr(output);
+    addArgs(
+        kernel,
+        inputPtr.getAsClMem(),
+        meanPtr.getAsClMem(),
+        varPtr.getAsClMem(),
+        weightPtr.getAsClMem(),
+        biasPtr.getAsClMem(),
+        outputPtr.getAsClMem(),
+        &n,
+        &inner,
+        &nFeat,
+        &epsilon,
+        &hasWeight,
+        &hasBias);
+
+    const std::vector<size_t> globalWorkSize = {static_cast<size_t>(n)};
+    OpenClStream::instance()->enqueue(kernel, globalWorkSize);
+  }
+  return output;
+}
+
+} // namespace
 
 namespace fl {
 
@@ -54,6 +129,24 @@ Variable batchnorm(
     runningVar =
         Variable(af::constant(1.0, featDims.elements(), input.type()), false);
   }
+
+  bool calcGrad = input.isCalcGrad() ||
+      (!weight.isempty() && weight.isCalcGrad()) ||
+      (!bias.isempty() && bias.isCalcGrad());
+  if (!train && !calcGrad) {
+    return Variable(
+        batchnormInfer(
+            input.array(),
+            runningMean.array(),
+            runningVar.array(),
+            weight.array(),
+            bias.array(),
+            minAxis,
+            featDims.elements(),
+            epsilon),
+        false);
+  }
+
   auto runningMeanDims = fl::moddims(runningMean, featDims);
   auto runningVarDims = fl::moddims(runningVar, featDims);
 
@@ -89,4 +182,31 @@ Variable batchnorm(
   return result;
 }
 
+Variable batchnormRelu(
+    const Variable& input,
+    const Variable& residual,
+    const Variable& weight,
+    const Variable& bias,
+    Variable& runningMean,
+    Variable& runningVar,
+    const std::vector<int>& axes,
+    bool train,
+    double momentum,
+    double epsilon) {
+  auto out = batchnorm(
+      input,
+      weight,
+      bias,
+      runningMean,
+      runningVar,
+      axes,
+      train,
+      momentum,
+      epsilon);
+  if (!residual.isempty()) {
+    out = out + residual;
+  }
+  return relu(out);
+}
+
 } // namespace fl
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Implements the forward part of 2D convolution (cross-correlation, as cuDNN)
+ * of input of dimensions [ix, iy, chan, batch] by weights of dimensions
+ * [wx, wy, chan / groups, oc], plus bias of dimension [oc] if hasBias.
+ * Results are written in to output which is expected to be of dimensions
+ * [ox, oy, oc, batch].
+ *
+ * Kernels are defined for float and half (storage only: half values are
+ * loaded and stored with vload_half() / vstore_half(), which don't need
+ * cl_khr_fp16, and accumulated in float):
+ * - conv2d_fwd_direct_<type>: one work item per output element, global work
+ *   size [ox * oy, oc, batch].
+ * - conv2d_fwd_oc4_<type>: one work item per 4 output channels of an output
+ *   position, reusing each input value for the 4 of them, global work size
+ *   [ox * oy, oc / 4, batch]. Needs (oc / groups) % 4 == 0.
+ */
+
+#define LOAD_float(p, i) ((p)[i])
+#define STORE_float(v, p, i) ((p)[i] = (v))
+#define LOAD_half(p, i) vload_half((i), (p))
+#define STORE_half(v, p, i) vstore_half((v), (i), (p))
+
+#define CONV2D_ARGS(T)                                                        \
+  __global const T *input, __global const T *weights, __global const T *bias, \
+      __global T *output, int ix, int iy, int chan, int batch, int wx,        \
+      int wy, int oc, int ox, int oy, int sx, int sy, int px, int py, int dx, \
+      int dy, int groups, int hasBias
+
+#define DEFINE_CONV2D_KERNELS(T)                                              \
+  void __kernel conv2d_fwd_direct_##T(CONV2D_ARGS(T)) {                       \
+    const int o = get_global_id(0);                                           \
+    const int k = get_global_id(1);                                           \
+    const int b = get_global_id(2);                                           \
+    if (o >= ox * oy || k >= oc || b >= batch) return;                        \
+                                                                              \
+    const int x = o % ox;                                                     \
+    const int y = o / ox;                                                     \
+    const int cg = chan / groups;                                             \
+    const int g = k / (oc / groups);                                          \
+                                                                              \
+    float sum = hasBias ? LOAD_##T(bias, k) : 0.0f;                           \
+    for (int c = 0; c < cg; ++c) {                                            \
+      const int inBase = ix * iy * (g * cg + c + chan * b);                   \
+      const int wtBase = wx * wy * (c + cg * k);                              \
+      for (int j = 0; j < wy; ++j) {                                          \
+        const int yy = y * sy - py + j * dy;                                  \
+        if (yy < 0 || yy >= iy) continue;                                     \
+        for (int i = 0; i < wx; ++i) {                                        \
+          const int xx = x * sx - px + i * dx;                                \
+          if (xx < 0 || xx >= ix) continue;                                   \
+          sum += LOAD_##T(input, inBase + xx + ix * yy) *                     \
+              LOAD_##T(weights, wtBase + i + wx * j);                         \
+        }                                                                     \
+      }                                                                       \
+    }                                                                         \
+    STORE_##T(sum, output, o + ox * oy * (k + oc * b));                       \
+  }                                                                           \
+                                                                              \
+  void __kernel conv2d_fwd_oc4_##T(CONV2D_ARGS(T)) {                          \
+    const int o = get_global_id(0);                                           \
+    const int k0 = 4 * get_global_id(1);                                      \
+    const int b = get_global_id(2);                                           \
+    if (o >= ox * oy || k0 >= oc || b >= batch) return;                       \
+                                                                              \
+    const int x = o % ox;                                                     \
+    const int y = o / ox;                                                     \
+    const int cg = chan / groups;                                             \
+    const int g = k0 / (oc / groups);                                         \
+    const int wSize = wx * wy;                                                \
+                                                                              \
+    float4 sum = (float4)(0.0f);                                              \
+    if (hasBias) {                                                            \
+      sum = (float4)(LOAD_##T(bias, k0),                                      \
+                     LOAD_##T(bias, k0 + 1),                                  \
+                     LOAD_##T(bias, k0 + 2),                                  \
+                     LOAD_##T(bias, k0 + 3));                                 \
+    }                                                                         \
+    for (int c = 0; c < cg; ++c) {                                            \
+      const int inBase = ix * iy * (g * cg + c + chan * b);                   \
+      const int wtBase = wSize * (c + cg * k0);                               \
+      const int wtStride = wSize * cg;                                        \
+      for (int j = 0; j < wy; ++j) {                                          \
+        const int yy = y * sy - py + j * dy;                                  \
+        if (yy < 0 || yy >= iy) continue;                                     \
+        for (int i = 0; i < wx; ++i) {                                        \
+          const int xx = x * sx - px + i * dx;                                \
+          if (xx < 0 || xx >= ix) continue;                                   \
+          const float in = LOAD_##T(input, inBase + xx + ix * yy);            \
+          const int w = wtBase + i + wx * j;                                  \
+          sum += in *                                                         \
+              (float4)(LOAD_##T(weights, w),                                  \
+                       LOAD_##T(weights, w + wtStride),                       \
+                       LOAD_##T(weights, w + 2 * wtStride),                   \
+                       LOAD_##T(weights, w + 3 * wtStride));                  \
+        }                                                                     \
+      }                                                                       \
+    }                                                                         \
+    const int outBase = o + ox * oy * (k0 + oc * b);                          \
+    STORE_##T(sum.x, output, outBase);                                        \
+    STORE_##T(sum.y, output, outBase + ox * oy);                              \
+    STORE_##T(sum.z, output, outBase + 2 * ox * oy);                          \
+    STORE_##T(sum.w, output, outBase + 3 * ox * oy);                          \
+  }
+
+DEFINE_CONV2D_KERNELS(float)
+DEFINE_CONV2D_KERNELS(half)
@@ -5,22 +5,30 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <array>
 #include <memory>
+#include <sstream>
+#include <string>
 #include <vector>
 
+#include <CL/cl2.hpp>
+#include <af/opencl.h>
 #include <arrayfire.h>
 
+#include "opencl_kernels/Conv2D_cl.h"
+
 #include "flashlight/fl/autograd/Functions.h"
 #include "flashlight/fl/autograd/Variable.h"
+#include "flashlight/fl/common/Defines.h"
+#include "flashlight/fl/common/DynamicBenchmark.h"
+#include "flashlight/fl/common/OpenClUtils.h"
 
 namespace fl {
 
-namespace detail {
-class ConvBenchmark;
-} // namespace detail
-
 namespace {
 
+using namespace ::fl::ocl;
+
 // Input, output: WHCN; weights: WHIO
 constexpr size_t kWIdx = 0;
 constexpr size_t kHIdx = 1;
@@ -88,27 +96,8 @@ Variable conv2dWithoutBiasAndGroups(
   return Variable(convOut, {input, weights}, gradFunc);
 }
 
-} // namespace
-
-Variable conv2d(
-    const Variable& input,
-    const Variable& weights,
-    int sx,
-    int sy,
-    int px,
-    int py,
-    int dx,
-    int dy,
-    int groups,
-    std::shared_ptr<detail::ConvBenchmarks> benchmarks) {
-  if (input.type() == f16) {
-    throw std::runtime_error("Half precision is not supported in opencl.");
-  }
-  Variable dummy_bias = Variable(af::array(), false);
-  return conv2d(input, weights, dummy_bias, sx, sy, px, py, dx, dy, groups);
-}
-
-Variable conv2d(
+// Computed by ArrayFire, in the precision of the input
+Variable conv2dArrayFire(
     const Variable& input,
     const Variable& weights,
     const Variable& bias,
@@ -118,16 +107,7 @@ Variable conv2d(
     int py,
     int dx,
     int dy,
-    int groups,
-    std::shared_ptr<detail::ConvBenchmarks> benchmarks) {
-  if (input.type() == f16) {
-    throw std::runtime_error("Half precision is not supported in opencl.");
-  }
-  const int chan = input.dims(kIOChannelSizeIdx);
-  if ((chan % groups) != 0) {
-    throw std::runtime_error(
-        "Number of channels must be devisible by number of groups");
-  }
+    int groups) {
   auto deviceId = af::getDevice();
 
   std::vector<Variable> groupInput = fl::split(
@@ -179,4 +159,256 @@ Variable conv2d(
   }
 }
 
+// Forward kernels: ArrayFire (unwrap + matmul) or the kernels of Conv2D.cl
+enum class ConvKernel { ArrayFire = 0, Direct = 1, Oc4 = 2 };
+
+/**
+ * Identifies a convolution in the persistent benchmark cache: the optimal
+ * kernel depends on the device, the parameters of the convolution, and the
+ * shapes and type of its operands.
+ */
+std::string benchmarkCacheKey(
+    const af::array& in,
+    const af::array& wt,
+    const std::array<int, 8>& params) {
+  char name[256], platform[256], toolkit[256], compute[256];
+  af::deviceInfo(name, platform, toolkit, compute);
+  std::ostringstream key;
+  key << "conv2d_fwd_opencl;" << name << ";" << platform << ";" << in.type();
+  for (const auto& dims : {in.dims(), wt.dims()}) {
+    key << ";" << dims[0] << "x" << dims[1] << "x" << dims[2] << "x"
+        << dims[3];
+  }
+  for (auto param : params) {
+    key << ";" << param;
+  }
+  return key.str();
+}
+
+/**
+ * Picks the forward kernel of a convolution without gradient: the fastest
+ * one found by the dynamic benchmark if benchmarking, otherwise the first
+ * kernel applicable. ArrayFire computes half precision in float.
+ */
+ConvKernel chooseKernel(
+    const af::array& input,
+    const af::array& weights,
+    const std::array<int, 8>& params,
+    const std::shared_ptr<detail::ConvBenchmarks>& benchmarks) {
+  int groups = params[6];
+  std::vector<ConvKernel> kernels;
+  if ((weights.dims(kWeightOutputChannelSizeIdx) / groups) % 4 == 0) {
+    kernels.push_back(ConvKernel::Oc4);
+  }
+  kernels.push_back(ConvKernel::Direct);
+  if (input.type() != f16) {
+    kernels.push_back(ConvKernel::ArrayFire);
+  }
+  if (!benchmarks || !DynamicBenchmark::getBenchmarkMode()) {
+    return kernels.front();
+  }
+  if (!benchmarks->fwdBenchmark) {
+    benchmarks->fwdBenchmark = std::make_shared<DynamicBenchmark>(
+        std::make_shared<DynamicBenchmarkOptions<ConvKernel>>(
+            kernels, kDynamicBenchmarkDefaultCount),
+        benchmarkCacheKey(input, weights, params));
+  }
+  return benchmarks->fwdBenchmark
+      ->getOptions<DynamicBenchmarkOptions<ConvKernel>>()
+      ->currentOption();
+}
+
+// Runs a kernel of Conv2D.cl; bias can be empty
+af::array conv2dKernelFwd(
+    ConvKernel kernelType,
+    const af::array& input,
+    const af::array& weights,
+    const af::array& bias,
+    int sx,
+    int sy,
+    int px,
+    int py,
+    int dx,
+    int dy,
+    int groups) {
+  std::string name = kernelType == ConvKernel::Oc4 ? "conv2d_fwd_oc4_"
+                                                   : "conv2d_fwd_direct_";
+  name += input.type() == f16 ? "half" : "float";
+  cl_kernel kernel =
+      OpenClStream::instance()->getOrCreateKernel(name, opencl::Conv2D_cl);
+
+  int ix = input.dims(kWIdx);
+  int iy = input.dims(kHIdx);
+  int chan = input.dims(kIOChannelSizeIdx);
+  int batch = input.dims(3);
+  int wx = weights.dims(kWIdx);
+  int wy = weights.dims(kHIdx);
+  int oc = weights.dims(kWeightOutputChannelSizeIdx);
+  int ox = 1 + (ix + 2 * px - (1 + (wx - 1) * dx)) / sx;
+  int oy = 1 + (iy + 2 * py - (1 + (wy - 1) * dy)) / sy;
+  int hasBias = bias.isempty() ? 0 : 1;
+
+  af::array output(ox, oy, oc, batch, input.type());
+  // The kernels take the type of the input
+  auto wt = weights.as(input.type());
+  auto bs = hasBias ? bias.as(input.type()) : wt;
+  {
+    DevicePtrOpenCl inputPtr(input);
+    DevicePtrOpenCl weightsPtr(wt);
+    DevicePtrOpenCl biasPtr(bs);
+    DevicePtrOpenCl outputPtr(output);
+    addArgs(
+        kernel,
+        inputPtr.getAsClMem(),
+        weightsPtr.getAsClMem(),
+        biasPtr.getAsClMem(),
+        outputPtr.getAsClMem(),
+        &ix,
+        &iy,
+        &chan,
+        &batch,
+        &wx,
+        &wy,
+        &oc,
+        &ox,
+        &oy,
+        &sx,
+        &sy,
+        &px,
+        &py,
+        &dx,
+        &dy,
+        &groups,
+        &hasBias);
+
+    const std::vector<size_t> globalWorkSize = {
+        static_cast<size_t>(ox * oy),
+        static_cast<size_t>(kernelType == ConvKernel::Oc4 ? oc / 4 : oc),
+        static_cast<size_t>(batch)};
+    OpenClStream::instance()->enqueue(kernel, globalWorkSize);
+  }
+  return output;
+}
+
+} // namespace
+
+Variable conv2d(
+    const Variable& input,
+    const Variable& weights,
+    int sx,
+    int sy,
+    int px,
+    int py,
+    int dx,
+    int dy,
+    int groups,
+    std::shared_ptr<detail::ConvBenchmarks> benchmarks,
+    ImageLayout layout) {
+  Variable dummy_bias = Variable(af::array(), false);
+  return conv2d(
+      input,
+      weights,
+      dummy_bias,
+      sx,
+      sy,
+      px,
+      py,
+      dx,
+      dy,
+      groups,
+      benchmarks,
+      layout);
+}
+
+Variable conv2d(
+    const Variable& input,
+    const Variable& weights,
+    const Variable& bias,
+    int sx,
+    int sy,
+    int px,
+    int py,
+    int dx,
+    int dy,
+    int groups,
+    std::shared_ptr<detail::ConvBenchmarks> benchmarks,
+    ImageLayout layout) {
+  if (layout == ImageLayout::CWHN) {
+    // Computed in the default layout
+    auto output = conv2d(
+        reorder(input, 1, 2, 0, 3),
+        weights,
+        bias,
+        sx,
+        sy,
+        px,
+        py,
+        dx,
+        dy,
+        groups,
+        benchmarks);
+    return reorder(output, 2, 0, 1, 3);
+  }
+  const int chan = input.dims(kIOChannelSizeIdx);
+  if ((chan % groups) != 0) {
+    throw std::runtime_error(
+        "Number of channels must be devisible by number of groups");
+  }
+
+  // Without gradient (e.g. inference), the kernels of Conv2D.cl can be used
+  bool calcGrad = input.isCalcGrad() || weights.isCalcGrad() ||
+      (!bias.isempty() && bias.isCalcGrad());
+  if (!calcGrad) {
+    std::array<int, 8> params = {
+        sx, sy, px, py, dx, dy, groups, bias.isempty() ? 0 : 1};
+    auto kernel =
+        chooseKernel(input.array(), weights.array(), params, benchmarks);
+    Variable output;
+    auto run = [&]() {
+      if (kernel == ConvKernel::ArrayFire) {
+        output = conv2dArrayFire(
+            input, weights, bias, sx, sy, px, py, dx, dy, groups);
+        return;
+      }
+      output = Variable(
+          conv2dKernelFwd(
+              kernel,
+              input.array(),
+              weights.array(),
+              bias.array(),
+              sx,
+              sy,
+              px,
+              py,
+              dx,
+              dy,
+              groups),
+          false);
+    };
+    if (benchmarks && benchmarks->fwdBenchmark) {
+      benchmarks->fwdBenchmark->audit(run);
+    } else {
+      run();
+    }
+    return output;
+  }
+  if (input.type() == f16) {
+    // Computed in float by ArrayFire
+    auto output = conv2dArrayFire(
+        input.as(f32),
+        weights.as(f32),
+        bias.isempty() ? bias : bias.as(f32),
+        sx,
+        sy,
+        px,
+        py,
+        dx,
+        dy,
+        groups);
+    return output.as(f16);
+  }
+  return conv2dArrayFire(
+      input, weights, bias, sx, sy, px, py, dx, dy, groups);
+}
+
 } // namespace fl
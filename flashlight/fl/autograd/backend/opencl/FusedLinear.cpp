@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <stdexcept>
+
+#include <arrayfire.h>
+
+#include "flashlight/fl/autograd/Functions.h"
+
+namespace fl {
+namespace detail {
+
+// Linear layers are computed by unfused operators on this backend
+bool fusedLinearSupported(af::dtype /* type */) {
+  return false;
+}
+
+void linearForward(
+    const af::array& /* input */,
+    const af::array& /* weight */,
+    const af::array& /* bias */,
+    LinearActivation /* activation */,
+    bool /* keepPreActivation */,
+    af::array& /* out */,
+    af::array& /* preActivation */) {
+  throw std::logic_error("linearForward: fused linear layers not supported");
+}
+
+void linearBackwardWeight(
+    const af::array& /* input */,
+    const af::array& /* gradPreActivation */,
+    bool /* computeGradBias */,
+    af::array& /* gradWeight */,
+    af::array& /* gradBias */) {
+  throw std::logic_error(
+      "linearBackwardWeight: fused linear layers not supported");
+}
+
+} // namespace detail
+} // namespace fl
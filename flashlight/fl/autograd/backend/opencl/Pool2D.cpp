@@ -117,7 +117,14 @@ Variable pool2d(
     int sy,
     int px,
     int py,
-    PoolingMode mode /* = PoolingMode::MAX */) {
+    PoolingMode mode /* = PoolingMode::MAX */,
+    ImageLayout layout /* = ImageLayout::WHCN */) {
+  if (layout == ImageLayout::CWHN) {
+    // Computed in the default layout
+    auto output =
+        pool2d(reorder(input, 1, 2, 0, 3), wx, wy, sx, sy, px, py, mode);
+    return reorder(output, 2, 0, 1, 3);
+  }
   if (mode != PoolingMode::MAX) {
     throw std::runtime_error("pool2d unsupported mode");
   }
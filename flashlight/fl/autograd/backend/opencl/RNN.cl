@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Implements one time step of an RNN layer direction, with all the gates of
+ * a unit fused in a single work item. The inputs are the projections of the
+ * input (at offset xOffset of xproj) and of the previous hidden state (hproj)
+ * by the weights of all the gates, of dimensions [gates * hiddenSize, batch],
+ * without biases. The biases of the input and hidden projections (of
+ * dimension [gates * hiddenSize]) are added in the kernel, with the gates in
+ * the cuDNN order:
+ * - vanilla: h = act(x + h)
+ * - LSTM: i, f, g, o, with c = f * c + i * g and h = o * tanh(c)
+ * - GRU: r, z, n, with n = tanh(x_n + r * h_n) and h = (1 - z) * n + z * h
+ *
+ * The new hidden state (and cell state) of dimensions [hiddenSize, batch] are
+ * written in to h (and c), and the hidden state also at offset yOffset of y
+ * with stride yStride between samples. Global work size is
+ * [hiddenSize, batch].
+ *
+ * Kernels are defined for float and half (storage only, computed in float).
+ */
+
+#define LOAD_float(p, i) ((p)[i])
+#define STORE_float(v, p, i) ((p)[i] = (v))
+#define LOAD_half(p, i) vload_half((i), (p))
+#define STORE_half(v, p, i) vstore_half((v), (i), (p))
+
+#define RNN_SIGMOID(v) (1.0f / (1.0f + exp(-(v))))
+
+#define RNN_STEP_ARGS(T)                                                      \
+  __global const T *xproj, int xOffset, __global const T *hproj,              \
+      __global const T *inputBias, __global const T *hiddenBias
+
+#define RNN_STEP_OUTPUT_ARGS(T)                                               \
+  __global T *h, __global T *y, int yOffset, int yStride, int hiddenSize,     \
+      int batch
+
+#define DEFINE_RNN_KERNELS(T)                                                 \
+  void __kernel rnn_vanilla_step_##T(                                         \
+      RNN_STEP_ARGS(T), RNN_STEP_OUTPUT_ARGS(T), int relu) {                  \
+    const int j = get_global_id(0);                                           \
+    const int b = get_global_id(1);                                           \
+    if (j >= hiddenSize || b >= batch) return;                                \
+    const int e = j + hiddenSize * b;                                         \
+                                                                              \
+    float v = LOAD_##T(xproj, xOffset + e) + LOAD_##T(inputBias, j) +         \
+        LOAD_##T(hproj, e) + LOAD_##T(hiddenBias, j);                         \
+    v = relu ? fmax(v, 0.0f) : tanh(v);                                       \
+    STORE_##T(v, h, e);                                                       \
+    STORE_##T(v, y, yOffset + j + yStride * b);                               \
+  }                                                                           \
+                                                                              \
+  void __kernel rnn_lstm_step_##T(                                            \
+      RNN_STEP_ARGS(T),                                                       \
+      __global const T *cPrev,                                                \
+      __global T *c,                                                          \
+      RNN_STEP_OUTPUT_ARGS(T)) {                                              \
+    const int j = get_global_id(0);                                           \
+    const int b = get_global_id(1);                                           \
+    if (j >= hiddenSize || b >= batch) return;                                \
+    const int e = j + hiddenSize * b;                                         \
+    const int g = j + 4 * hiddenSize * b;                                     \
+                                                                              \
+    float z[4];                                                               \
+    for (int k = 0; k < 4; ++k) {                                             \
+      const int o = k * hiddenSize;                                           \
+      z[k] = LOAD_##T(xproj, xOffset + g + o) + LOAD_##T(hproj, g + o) +      \
+          LOAD_##T(inputBias, j + o) + LOAD_##T(hiddenBias, j + o);           \
+    }                                                                         \
+    const float cNew = RNN_SIGMOID(z[1]) * LOAD_##T(cPrev, e) +               \
+        RNN_SIGMOID(z[0]) * tanh(z[2]);                                       \
+    const float hNew = RNN_SIGMOID(z[3]) * tanh(cNew);                        \
+    STORE_##T(cNew, c, e);                                                    \
+    STORE_##T(hNew, h, e);                                                    \
+    STORE_##T(hNew, y, yOffset + j + yStride * b);                            \
+  }                                                                           \
+                                                                              \
+  void __kernel rnn_gru_step_##T(                                             \
+      RNN_STEP_ARGS(T), __global const T *hPrev, RNN_STEP_OUTPUT_ARGS(T)) {   \
+    const int j = get_global_id(0);                                           \
+    const int b = get_global_id(1);                                           \
+    if (j >= hiddenSize || b >= batch) return;                                \
+    const int e = j + hiddenSize * b;                                         \
+    const int g = j + 3 * hiddenSize * b;                                     \
+                                                                              \
+    float x[3];                                                               \
+    float r[3];                                                               \
+    for (int k = 0; k < 3; ++k) {                                             \
+      const int o = k * hiddenSize;                                           \
+      x[k] = LOAD_##T(xproj, xOffset + g + o) + LOAD_##T(inputBias, j + o);   \
+      r[k] = LOAD_##T(hproj, g + o) + LOAD_##T(hiddenBias, j + o);            \
+    }                                                                         \
+    const float reset = RNN_SIGMOID(x[0] + r[0]);                             \
+    const float update = RNN_SIGMOID(x[1] + r[1]);                            \
+    const float n = tanh(x[2] + reset * r[2]);                                \
+    const float hNew = (1.0f - update) * n + update * LOAD_##T(hPrev, e);     \
+    STORE_##T(hNew, h, e);                                                    \
+    STORE_##T(hNew, y, yOffset + j + yStride * b);                            \
+  }
+
+DEFINE_RNN_KERNELS(float)
+DEFINE_RNN_KERNELS(half)
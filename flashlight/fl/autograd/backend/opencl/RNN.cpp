@@ -6,26 +6,390 @@
  */
 
 #include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <CL/cl2.hpp>
+#include <af/opencl.h>
+#include <arrayfire.h>
+
+#include "opencl_kernels/RNN_cl.h"
 
 #include "flashlight/fl/autograd/Functions.h"
+#include "flashlight/fl/autograd/GradMode.h"
 #include "flashlight/fl/autograd/Variable.h"
+#include "flashlight/fl/common/OpenClUtils.h"
+
+namespace {
+
+using namespace ::fl::ocl;
+using fl::RnnMode;
+using fl::Variable;
+
+// Weights of one direction of a layer
+struct DirectionWeights {
+  // [input size, gates * hidden size]
+  Variable inputWeights;
+  // [hidden size, gates * hidden size]
+  Variable hiddenWeights;
+  // [gates * hidden size]
+  Variable inputBias;
+  Variable hiddenBias;
+};
+
+int numGates(RnnMode mode) {
+  switch (mode) {
+    case RnnMode::LSTM:
+      return 4;
+    case RnnMode::GRU:
+      return 3;
+    default:
+      return 1;
+  }
+}
+
+/**
+ * Parses flat RNN weights in the cuDNN layout: for each layer and direction,
+ * the matrices of all the gates of the input projection then those of the
+ * hidden projection, followed by, for each layer and direction, the biases of
+ * the input projection then those of the hidden projection. The matrix of
+ * each gate is [hidden size, input size] in row major order, so that the
+ * gates stack into an [input size, gates * hidden size] array.
+ */
+std::vector<DirectionWeights> parseWeights(
+    const Variable& weights,
+    int inSize,
+    int hiddenSize,
+    int numLayers,
+    int directions,
+    int gates) {
+  std::vector<DirectionWeights> parsed(numLayers * directions);
+  int gateSize = gates * hiddenSize;
+  dim_t offset = 0;
+  auto take = [&weights, &offset](dim_t d0, dim_t d1) {
+    if (offset + d0 * d1 > weights.elements()) {
+      throw std::invalid_argument("invalid weights size for RNN");
+    }
+    auto w = fl::moddims(
+        weights(af::seq(offset, offset + d0 * d1 - 1)), af::dim4(d0, d1));
+    offset += d0 * d1;
+    return w;
+  };
+  for (int l = 0; l < numLayers; ++l) {
+    int layerInSize = l == 0 ? inSize : directions * hiddenSize;
+    for (int d = 0; d < directions; ++d) {
+      auto& w = parsed[l * directions + d];
+      w.inputWeights = take(layerInSize, gateSize);
+      w.hiddenWeights = take(hiddenSize, gateSize);
+    }
+  }
+  for (auto& w : parsed) {
+    w.inputBias = take(gateSize, 1);
+    w.hiddenBias = take(gateSize, 1);
+  }
+  if (offset != weights.elements()) {
+    throw std::invalid_argument("invalid weights size for RNN");
+  }
+  return parsed;
+}
+
+std::string kernelName(RnnMode mode, af::dtype type) {
+  std::string name = mode == RnnMode::LSTM
+      ? "rnn_lstm_step_"
+      : (mode == RnnMode::GRU ? "rnn_gru_step_" : "rnn_vanilla_step_");
+  return name + (type == f16 ? "half" : "float");
+}
+
+/**
+ * Runs one direction of a layer over input of dimensions [input size, batch
+ * size, sequence length], from hidden state h (and cell state c for LSTM),
+ * which are replaced by those at the last step. The input projection of all
+ * the steps is a single GEMM, then each step is a GEMM for the hidden
+ * projection and a single kernel for all the gates, which writes the hidden
+ * state of the direction in to y of dimensions [directions * hidden size,
+ * batch size, sequence length].
+ */
+void runDirection(
+    RnnMode mode,
+    const af::array& input,
+    const DirectionWeights& weights,
+    int direction,
+    int directions,
+    af::array& h,
+    af::array& c,
+    af::array& y) {
+  int inSize = input.dims(0);
+  int batchSize = input.dims(1);
+  int seqLength = input.dims(2);
+  int hiddenSize = h.dims(0);
+  int gateSize = weights.hiddenWeights.dims(1);
+  auto type = input.type();
+
+  auto xproj = af::matmulTN(
+      weights.inputWeights.array(),
+      af::moddims(input, inSize, batchSize * seqLength));
+  const auto& hiddenWeights = weights.hiddenWeights.array();
+  const auto& inputBias = weights.inputBias.array();
+  const auto& hiddenBias = weights.hiddenBias.array();
+
+  cl_kernel kernel = OpenClStream::instance()->getOrCreateKernel(
+      kernelName(mode, type), opencl::RNN_cl);
+  int relu = mode == RnnMode::RELU ? 1 : 0;
+  int yStride = directions * hiddenSize;
+  const std::vector<size_t> globalWorkSize = {
+      static_cast<size_t>(hiddenSize), static_cast<size_t>(batchSize)};
+
+  for (int s = 0; s < seqLength; ++s) {
+    int t = direction == 0 ? s : seqLength - 1 - s;
+    int xOffset = gateSize * batchSize * t;
+    int yOffset = direction * hiddenSize + yStride * batchSize * t;
+    auto hproj = af::matmulTN(hiddenWeights, h);
+    af::array hNew(hiddenSize, batchSize, type);
+    af::array cNew;
+    {
+      DevicePtrOpenCl xprojPtr(xproj);
+      DevicePtrOpenCl hprojPtr(hproj);
+      DevicePtrOpenCl inputBiasPtr(inputBias);
+      DevicePtrOpenCl hiddenBiasPtr(hiddenBias);
+      DevicePtrOpenCl hNewPtr(hNew);
+      DevicePtrOpenCl yPtr(y);
+      if (mode == RnnMode::LSTM) {
+        cNew = af::array(hiddenSize, batchSize, type);
+        DevicePtrOpenCl cPtr(c);
+        DevicePtrOpenCl cNewPtr(cNew);
+        addArgs(
+            kernel,
+            xprojPtr.getAsClMem(),
+            &xOffset,
+            hprojPtr.getAsClMem(),
+            inputBiasPtr.getAsClMem(),
+            hiddenBiasPtr.getAsClMem(),
+            cPtr.getAsClMem(),
+            cNewPtr.getAsClMem(),
+            hNewPtr.getAsClMem(),
+            yPtr.getAsClMem(),
+            &yOffset,
+            &yStride,
+            &hiddenSize,
+            &batchSize);
+        OpenClStream::instance()->enqueue(kernel, globalWorkSize);
+      } else if (mode == RnnMode::GRU) {
+        DevicePtrOpenCl hPtr(h);
+        addArgs(
+            kernel,
+            xprojPtr.getAsClMem(),
+            &xOffset,
+            hprojPtr.getAsClMem(),
+            inputBiasPtr.getAsClMem(),
+            hiddenBiasPtr.getAsClMem(),
+            hPtr.getAsClMem(),
+            hNewPtr.getAsClMem(),
+            yPtr.getAsClMem(),
+            &yOffset,
+            &yStride,
+            &hiddenSize,
+            &batchSize);
+        OpenClStream::instance()->enqueue(kernel, globalWorkSize);
+      } else {
+        addArgs(
+            kernel,
+            xprojPtr.getAsClMem(),
+            &xOffset,
+            hprojPtr.getAsClMem(),
+            inputBiasPtr.getAsClMem(),
+            hiddenBiasPtr.getAsClMem(),
+            hNewPtr.getAsClMem(),
+            yPtr.getAsClMem(),
+            &yOffset,
+            &yStride,
+            &hiddenSize,
+            &batchSize,
+            &relu);
+        OpenClStream::instance()->enqueue(kernel, globalWorkSize);
+      }
+    }
+    h = hNew;
+    if (mode == RnnMode::LSTM) {
+      c = cNew;
+    }
+  }
+}
+
+/**
+ * Same as runDirection() with differentiable operations, for training:
+ * returns the hidden states of all the steps, of dimensions [hidden size,
+ * batch size, sequence length].
+ */
+Variable runDirectionWithGrad(
+    RnnMode mode,
+    const Variable& input,
+    const DirectionWeights& weights,
+    int direction,
+    Variable& h,
+    Variable& c) {
+  int inSize = input.dims(0);
+  int batchSize = input.dims(1);
+  int seqLength = input.dims(2);
+  int hiddenSize = h.dims(0);
+  int gateSize = weights.hiddenWeights.dims(1);
+
+  auto xproj = fl::matmulTN(
+      weights.inputWeights,
+      fl::moddims(input, af::dim4(inSize, batchSize * seqLength)));
+  xproj = fl::moddims(
+      xproj + fl::tileAs(weights.inputBias, xproj),
+      af::dim4(gateSize, batchSize, seqLength));
+  auto gate = [hiddenSize](const Variable& v, int k) {
+    return v.rows(k * hiddenSize, (k + 1) * hiddenSize - 1);
+  };
+
+  std::vector<Variable> outputs(seqLength);
+  for (int s = 0; s < seqLength; ++s) {
+    int t = direction == 0 ? s : seqLength - 1 - s;
+    auto x = fl::moddims(
+        xproj(af::span, af::span, t), af::dim4(gateSize, batchSize));
+    auto hproj = fl::matmulTN(weights.hiddenWeights, h);
+    hproj = hproj + fl::tileAs(weights.hiddenBias, hproj);
+    switch (mode) {
+      case RnnMode::LSTM: {
+        auto z = x + hproj;
+        c = fl::sigmoid(gate(z, 1)) * c +
+            fl::sigmoid(gate(z, 0)) * fl::tanh(gate(z, 2));
+        h = fl::sigmoid(gate(z, 3)) * fl::tanh(c);
+        break;
+      }
+      case RnnMode::GRU: {
+        auto reset = fl::sigmoid(gate(x, 0) + gate(hproj, 0));
+        auto update = fl::sigmoid(gate(x, 1) + gate(hproj, 1));
+        auto n = fl::tanh(gate(x, 2) + reset * gate(hproj, 2));
+        h = (1.0 - update) * n + update * h;
+        break;
+      }
+      case RnnMode::RELU:
+        h = fl::max(x + hproj, 0.0);
+        break;
+      default:
+        h = fl::tanh(x + hproj);
+    }
+    outputs[t] = fl::moddims(h, af::dim4(hiddenSize, batchSize, 1));
+  }
+  return fl::concatenate(outputs, 2);
+}
+
+} // namespace
 
 namespace fl {
 
-// TODO, implement RNN, also check to ensure there will appropriate checks to
-// guard the use of half precision in case CPU implementation doesn't support
-// it.
 std::tuple<Variable, Variable, Variable> rnn(
+    const Variable& input,
+    const Variable& hiddenState,
+    const Variable& cellState,
+    const Variable& weights,
+    int hiddenSize,
+    int numLayers,
+    RnnMode mode,
+    bool bidirectional,
+    float dropout) {
+  auto type = input.type();
+  if (type != f32 && type != f16) {
+    throw std::invalid_argument("opencl rnn: only f32 and f16 are supported");
+  }
+  int inSize = input.dims(0);
+  int batchSize = input.dims(1);
+  int directions = bidirectional ? 2 : 1;
+  int totalLayers = numLayers * directions;
+  if (!hiddenState.isempty() &&
+      !(hiddenState.dims(0) == hiddenSize &&
+        hiddenState.dims(1) == batchSize &&
+        hiddenState.dims(2) == totalLayers)) {
+    throw std::invalid_argument("invalid hidden state dims for RNN");
+  }
+  if (!cellState.isempty() &&
+      !(mode == RnnMode::LSTM && cellState.dims(0) == hiddenSize &&
+        cellState.dims(1) == batchSize && cellState.dims(2) == totalLayers)) {
+    throw std::invalid_argument("invalid cell state dims for RNN");
+  }
+
+  auto parsed = parseWeights(
+      weights, inSize, hiddenSize, numLayers, directions, numGates(mode));
+  // Initial hidden or cell state of a layer direction
+  auto initialState = [&](const Variable& state, int index) {
+    if (state.isempty()) {
+      return Variable(af::constant(0, hiddenSize, batchSize, type), false);
+    }
+    return fl::moddims(
+        state(af::span, af::span, index), af::dim4(hiddenSize, batchSize));
+  };
+  bool calcGrad = isGradEnabled() &&
+      (input.isCalcGrad() || hiddenState.isCalcGrad() ||
+       cellState.isCalcGrad() || weights.isCalcGrad());
+
+  Variable y = input;
+  std::vector<Variable> hy(totalLayers), cy(totalLayers);
+  for (int l = 0; l < numLayers; ++l) {
+    if (l > 0 && dropout > 0.0) {
+      y = fl::dropout(y, dropout);
+    }
+    if (calcGrad) {
+      std::vector<Variable> outputs(directions);
+      for (int d = 0; d < directions; ++d) {
+        int index = l * directions + d;
+        auto h = initialState(hiddenState, index);
+        auto c = initialState(cellState, index);
+        outputs[d] = runDirectionWithGrad(mode, y, parsed[index], d, h, c);
+        hy[index] = h;
+        cy[index] = c;
+      }
+      y = fl::concatenate(outputs, 0);
+    } else {
+      af::array output(directions * hiddenSize, batchSize, input.dims(2), type);
+      for (int d = 0; d < directions; ++d) {
+        int index = l * directions + d;
+        auto h = initialState(hiddenState, index).array();
+        auto c = initialState(cellState, index).array();
+        runDirection(
+            mode, y.array(), parsed[index], d, directions, h, c, output);
+        hy[index] = Variable(h, false);
+        cy[index] = Variable(c, false);
+      }
+      y = Variable(output, false);
+    }
+  }
+
+  auto stack = [hiddenSize, batchSize](const std::vector<Variable>& states) {
+    std::vector<Variable> stacked;
+    for (const auto& state : states) {
+      stacked.push_back(
+          fl::moddims(state, af::dim4(hiddenSize, batchSize, 1)));
+    }
+    return fl::concatenate(stacked, 2);
+  };
+  return std::make_tuple(
+      y, stack(hy), mode == RnnMode::LSTM ? stack(cy) : Variable());
+}
+
+namespace detail {
+
+bool variableLengthRnnSupported() {
+  return false;
+}
+
+std::tuple<Variable, Variable, Variable> variableLengthRnn(
     const Variable& /* input */,
-    const Variable& /* hidden_state */,
-    const Variable& /* cell_state */,
+    const Variable& /* hiddenState */,
+    const Variable& /* cellState */,
     const Variable& /* weights */,
-    int /* hidden_size */,
-    int /* num_layers */,
+    int /* hiddenSize */,
+    int /* numLayers */,
     RnnMode /* mode */,
     bool /* bidirectional */,
-    float /* dropout */) {
-  throw std::runtime_error("rnn not yet implemented on opencl");
+    float /* dropout */,
+    const std::vector<int>& /* sequenceLengths */) {
+  throw std::logic_error(
+      "variableLengthRnn: variable lengths are not supported by the kernels");
 }
 
+} // namespace detail
+
 } // namespace fl
@@ -16,6 +16,9 @@ namespace fl {
 // ODR
 constexpr const char* DistributedConstants::kMaxDevicePerNode;
 constexpr const char* DistributedConstants::kFilePath;
+constexpr const char* DistributedConstants::kTcpAddress;
+constexpr const char* DistributedConstants::kHierarchical;
+constexpr const char* DistributedConstants::kPipelineStages;
 constexpr const std::size_t DistributedConstants::kCoalesceCacheSize;
 
 OptimLevel OptimMode::getOptimLevel() {
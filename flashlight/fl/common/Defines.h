@@ -53,6 +53,29 @@ enum class RnnMode {
   GRU = 3,
 };
 
+/**
+ * Activation applied to the output of a linear layer, fused with its matrix
+ * product and its bias where the backend supports it (see `fl::linear`)
+ */
+enum class LinearActivation {
+  NONE = 0,
+  RELU = 1,
+  /// The tanh approximation of `fl::gelu`
+  GELU = 2,
+};
+
+/**
+ * Memory layout of batches of 2D images, in the column-major order of
+ * ArrayFire
+ */
+enum class ImageLayout {
+  /// [\f$X\f$, \f$Y\f$, \f$C\f$, \f$N\f$], NCHW in cuDNN
+  WHCN = 0,
+  /// Channels-last, [\f$C\f$, \f$X\f$, \f$Y\f$, \f$N\f$], NHWC in cuDNN:
+  /// faster f16 convolutions with tensor cores
+  CWHN = 1,
+};
+
 enum class PaddingMode {
   /// Use smallest possible padding such that out_size = ceil(in_size/stride)
   SAME = -1,
@@ -68,11 +91,19 @@ enum class DistributedBackend {
 enum class DistributedInit {
   MPI = 0,
   FILE_SYSTEM = 1,
+  /// Rendezvous through a TCP store served by the process of rank 0
+  TCP = 2,
 };
 
 struct DistributedConstants {
   static constexpr const char* kMaxDevicePerNode = "MAX_DEVICE_PER_NODE";
   static constexpr const char* kFilePath = "FILE_PATH";
+  /// "host:port" of the store served by rank 0 with `DistributedInit::TCP`
+  static constexpr const char* kTcpAddress = "TCP_ADDRESS";
+  /// Reduce within nodes, then between nodes, if set to "1"
+  static constexpr const char* kHierarchical = "HIERARCHICAL";
+  /// Number of stages of pipeline parallelism, see `fl::Pipeline`
+  static constexpr const char* kPipelineStages = "PIPELINE_STAGES";
   static constexpr const std::size_t kCoalesceCacheSize =
       ((size_t)(20) << 20); // 20 MB
 };
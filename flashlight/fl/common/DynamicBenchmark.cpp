@@ -8,11 +8,51 @@
 
 #include "flashlight/fl/common/DynamicBenchmark.h"
 
+#include <fstream>
+#include <mutex>
+
+#include "flashlight/fl/common/Logging.h"
+
 namespace fl {
 
+namespace {
+
+// Persistent cache of the optimal options: a file of "<key>\t<index>" lines,
+// of which the last one wins for a given key
+struct BenchmarkCache {
+  std::mutex mutex;
+  std::string path;
+  std::unordered_map<std::string, size_t> entries;
+};
+
+BenchmarkCache& benchmarkCache() {
+  static BenchmarkCache cache;
+  return cache;
+}
+
+} // namespace
+
 // Default value for benchmark mode
 bool DynamicBenchmark::benchmarkMode_ = false;
 
+DynamicBenchmark::DynamicBenchmark(
+    std::shared_ptr<DynamicBenchmarkOptionsBase> options,
+    const std::string& cacheKey /* = "" */)
+    : options_(options) {
+  auto& cache = benchmarkCache();
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  if (cacheKey.empty() || cache.path.empty()) {
+    return;
+  }
+  auto entry = cache.entries.find(cacheKey);
+  if (entry != cache.entries.end() &&
+      entry->second < options_->numOptions()) {
+    options_->setOptimalOptionIndex(entry->second);
+  } else {
+    cacheKey_ = cacheKey;
+  }
+}
+
 void DynamicBenchmark::audit(
     const std::function<void()>& function,
     bool incrementCount) {
@@ -37,6 +77,22 @@ void DynamicBenchmark::stop(bool incrementCount) {
   af::sync();
   auto elapsedTime = af::timer::stop(currentTimer_);
   options_->accumulateTimeToCurrentOption(elapsedTime, incrementCount);
+  if (!cacheKey_.empty() && options_->timingsComplete()) {
+    auto idx = options_->optimalOptionIndex();
+    auto& cache = benchmarkCache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.entries[cacheKey_] = idx;
+    if (!cache.path.empty()) {
+      // A single appended line, which concurrent writers don't interleave
+      std::ofstream file(cache.path, std::ios::app);
+      file << (cacheKey_ + "\t" + std::to_string(idx) + "\n") << std::flush;
+      if (!file) {
+        FL_LOG(fl::WARNING) << "DynamicBenchmark: failed to write to cache "
+                            << cache.path;
+      }
+    }
+    cacheKey_.clear();
+  }
 }
 
 void DynamicBenchmark::setBenchmarkMode(bool mode) {
@@ -47,4 +103,24 @@ bool DynamicBenchmark::getBenchmarkMode() {
   return benchmarkMode_;
 }
 
+void DynamicBenchmark::setCacheFile(const std::string& path) {
+  auto& cache = benchmarkCache();
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  cache.path = path;
+  cache.entries.clear();
+  std::ifstream file(path);
+  std::string line;
+  while (std::getline(file, line)) {
+    auto sep = line.rfind('\t');
+    if (sep == std::string::npos || sep == 0) {
+      continue;
+    }
+    try {
+      cache.entries[line.substr(0, sep)] = std::stoul(line.substr(sep + 1));
+    } catch (const std::exception&) {
+      // Ignore lines truncated by interrupted writers
+    }
+  }
+}
+
 } // namespace fl
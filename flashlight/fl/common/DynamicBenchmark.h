@@ -11,6 +11,7 @@
 #include <functional>
 #include <memory>
 #include <stdexcept>
+#include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -43,6 +44,24 @@ struct DynamicBenchmarkOptionsBase {
         "- unimplemented");
   }
 
+  virtual size_t numOptions() {
+    throw std::logic_error(
+        "DynamicBenchmarkOptionsBase::numOptions "
+        "- unimplemented");
+  }
+
+  virtual size_t optimalOptionIndex() {
+    throw std::logic_error(
+        "DynamicBenchmarkOptionsBase::optimalOptionIndex "
+        "- unimplemented");
+  }
+
+  virtual void setOptimalOptionIndex(size_t) {
+    throw std::logic_error(
+        "DynamicBenchmarkOptionsBase::setOptimalOptionIndex "
+        "- unimplemented");
+  }
+
  protected:
   // Not intended for construction
   DynamicBenchmarkOptionsBase() = default;
@@ -166,6 +185,41 @@ struct DynamicBenchmarkOptions : DynamicBenchmarkOptionsBase {
     }
   }
 
+  /**
+   * @return the number of options.
+   */
+  size_t numOptions() override {
+    return options_.size();
+  }
+
+  /**
+   * @return the index of the optimal option. Timings must be complete.
+   */
+  size_t optimalOptionIndex() override {
+    if (!timingsComplete()) {
+      throw std::logic_error(
+          "Options::optimalOptionIndex: "
+          "benchmarking is not complete");
+    }
+    return currentOptionIdx_;
+  }
+
+  /**
+   * Fixes the optimal option, e.g. to one found by a previous benchmark, and
+   * marks timings as complete.
+   *
+   * @param[in] idx the index of the option to use
+   */
+  void setOptimalOptionIndex(size_t idx) override {
+    if (idx >= options_.size()) {
+      throw std::invalid_argument(
+          "Options::setOptimalOptionIndex: "
+          "index out of range");
+    }
+    timingsComplete_ = true;
+    currentOptionIdx_ = idx;
+  }
+
   /**
    * Resets options state to the default. Clears timings and counts.
    */
@@ -198,9 +252,20 @@ struct DynamicBenchmarkOptions : DynamicBenchmarkOptionsBase {
  */
 class DynamicBenchmark {
  public:
+  /**
+   * Constructs a benchmark given its options.
+   *
+   * @param[in] options the options to benchmark
+   * @param[in] cacheKey if nonempty, identifies the benchmarked operation in
+   * the cache set with `setCacheFile`: it should include everything on which
+   * the optimal option depends, e.g. the device, the library version, the
+   * shapes and type of the inputs. If the cache has an entry for the key,
+   * the benchmark starts complete with the cached option; otherwise, the
+   * optimal option is added to the cache once found.
+   */
   explicit DynamicBenchmark(
-      std::shared_ptr<DynamicBenchmarkOptionsBase> options)
-      : options_(options) {}
+      std::shared_ptr<DynamicBenchmarkOptionsBase> options,
+      const std::string& cacheKey = "");
 
   virtual ~DynamicBenchmark() = default;
 
@@ -241,6 +306,17 @@ class DynamicBenchmark {
    */
   static bool getBenchmarkMode();
 
+  /**
+   * Sets the file of the persistent benchmark cache, and loads the optimal
+   * options found by previous runs. Options found by subsequent benchmarks
+   * are appended to the file, which can be shared by concurrent processes.
+   * Affects the `DynamicBenchmark`s constructed afterwards.
+   *
+   * @param[in] path the path of the cache file, created if needed; an empty
+   * path disables the cache
+   */
+  static void setCacheFile(const std::string& path);
+
  private:
   // Starts the benchmark timer
   void start();
@@ -248,6 +324,8 @@ class DynamicBenchmark {
   void stop(bool incrementCount);
 
   std::shared_ptr<DynamicBenchmarkOptionsBase> options_;
+  // Key in the benchmark cache, empty if not cached
+  std::string cacheKey_;
   // Timer for current benchmark iteration
   af::timer currentTimer_;
 
@@ -260,6 +338,8 @@ class DynamicBenchmark {
 namespace detail {
 
 struct ConvBenchmarks {
+  // Forward kernel (OpenCL backend)
+  std::shared_ptr<DynamicBenchmark> fwdBenchmark;
   std::shared_ptr<DynamicBenchmark> bwdFilterBenchmark;
   std::shared_ptr<DynamicBenchmark> bwdDataBenchmark;
   std::shared_ptr<DynamicBenchmark> bwdBiasBenchmark;
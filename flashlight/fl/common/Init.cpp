@@ -5,21 +5,64 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include "flashlight/fl/common/Init.h"
+
+#include <algorithm>
+#include <cstdlib>
 #include <mutex>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <dlfcn.h>
 
 #include <af/device.h>
 
+#include "flashlight/fl/common/threadpool/ThreadAffinity.h"
 #include "flashlight/fl/memory/MemoryManagerInstaller.h"
 
 namespace fl {
 namespace {
 std::once_flag flInitFlag;
+
+std::mutex threadBudgetMutex;
+ThreadBudget threadBudget;
+
+// Calls the `int -> void` function `name` if the process has it, e.g.
+// omp_set_num_threads when a library linked OpenMP
+void callIfLoaded(const char* name, int arg) {
+  auto fn = reinterpret_cast<void (*)(int)>(dlsym(RTLD_DEFAULT, name));
+  if (fn) {
+    fn(arg);
+  }
+}
+
+std::string cpuList(const std::vector<int>& cpus) {
+  if (cpus.empty()) {
+    return "any";
+  }
+  std::ostringstream ss;
+  for (size_t i = 0; i < cpus.size(); ++i) {
+    size_t j = i;
+    while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) {
+      ++j;
+    }
+    ss << (i > 0 ? "," : "") << cpus[i];
+    if (j > i) {
+      ss << "-" << cpus[j];
+    }
+    i = j;
+  }
+  return ss.str();
 }
+} // namespace
 
 /**
  * Initialize Flashlight. Performs setup, including:
  * - Ensures ArrayFire globals are initialized
  * - Sets the default memory manager (CachingMemoryManager)
+ * - Sets the default pinned memory manager (CachingMemoryManager)
  *
  * Can only be called once per process. Subsequent calls will be noops.
  */
@@ -33,8 +76,102 @@ void init() {
     // opencl kernels.
     if (FL_BACKEND_CUDA) {
       MemoryManagerInstaller::installDefaultMemoryManager();
+      MemoryManagerInstaller::installDefaultPinnedMemoryManager();
     }
   });
 }
 
+std::string ThreadBudget::prettyString() const {
+  std::ostringstream ss;
+  ss << "compute " << computeThreads << " threads on CPUs "
+     << cpuList(computeCpus) << ", data " << dataThreads
+     << " threads on CPUs " << cpuList(dataCpus) << ", decoder "
+     << decoderThreads << " threads on CPUs " << cpuList(decoderCpus);
+  return ss.str();
+}
+
+ThreadBudget partitionCpus(
+    int dataThreads,
+    int decoderThreads,
+    int computeThreads /* = 0 */,
+    std::vector<int> cpus /* = {} */) {
+  if (dataThreads < 0 || decoderThreads < 0 || computeThreads < 0) {
+    throw std::invalid_argument("partitionCpus: negative number of threads");
+  }
+  if (cpus.empty()) {
+    cpus = detail::allowedCpus();
+  }
+  // Without affinity support, pools are sized but not pinned
+  const int numCpus = cpus.empty()
+      ? std::max<int>(1, std::thread::hardware_concurrency())
+      : cpus.size();
+  ThreadBudget budget;
+  budget.computeThreads = computeThreads > 0
+      ? computeThreads
+      : std::max(1, numCpus - dataThreads - decoderThreads);
+  budget.dataThreads = dataThreads;
+  budget.decoderThreads = decoderThreads;
+  if (cpus.empty()) {
+    return budget;
+  }
+
+  std::vector<int> shares = {
+      budget.computeThreads, budget.dataThreads, budget.decoderThreads};
+  const int total = std::accumulate(shares.begin(), shares.end(), 0);
+  if (total > numCpus) {
+    for (auto& share : shares) {
+      if (share > 0) {
+        share = std::max<int>(1, int64_t(share) * numCpus / total);
+      }
+    }
+    int sum = std::accumulate(shares.begin(), shares.end(), 0);
+    for (; sum > numCpus; --sum) {
+      auto largest = std::max_element(shares.begin(), shares.end());
+      if (*largest <= 1) {
+        break;
+      }
+      --*largest;
+    }
+    shares[0] += std::max(0, numCpus - sum);
+  }
+  std::vector<int>* poolCpus[] = {
+      &budget.computeCpus, &budget.dataCpus, &budget.decoderCpus};
+  int next = 0;
+  for (size_t pool = 0; pool < shares.size(); ++pool) {
+    for (int i = 0; i < shares[pool]; ++i) {
+      poolCpus[pool]->push_back(cpus[next++ % numCpus]);
+    }
+  }
+  return budget;
+}
+
+void setThreadBudget(const ThreadBudget& budget) {
+  if (budget.computeThreads < 1) {
+    throw std::invalid_argument(
+        "setThreadBudget: needs at least a thread of the computation");
+  }
+  {
+    std::lock_guard<std::mutex> lock(threadBudgetMutex);
+    threadBudget = budget;
+  }
+  const auto threads = std::to_string(budget.computeThreads);
+  for (const char* var :
+       {"OMP_NUM_THREADS", "MKL_NUM_THREADS", "OPENBLAS_NUM_THREADS"}) {
+    setenv(var, threads.c_str(), 1);
+  }
+  for (const char* setter :
+       {"omp_set_num_threads",
+        "mkl_set_num_threads",
+        "openblas_set_num_threads"}) {
+    callIfLoaded(setter, budget.computeThreads);
+  }
+  // Unpinned, e.g. outside of the cgroup CPUs, the computation still runs
+  detail::pinCurrentThread(budget.computeCpus);
+}
+
+ThreadBudget getThreadBudget() {
+  std::lock_guard<std::mutex> lock(threadBudgetMutex);
+  return threadBudget;
+}
+
 } // namespace fl
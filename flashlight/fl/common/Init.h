@@ -7,6 +7,9 @@
 
 #pragma once
 
+#include <string>
+#include <vector>
+
 namespace fl {
 
 /**
@@ -14,4 +17,56 @@ namespace fl {
  */
 void init();
 
+/**
+ * How the CPUs of the process are shared by its thread pools, which
+ * otherwise each size themselves to all the cores and oversubscribe them.
+ * Each pool is pinned to its own CPUs; pools share CPUs only when there are
+ * fewer CPUs than pools. Pools of no threads have no CPUs.
+ */
+struct ThreadBudget {
+  // Intra-op threads of the computation: OpenMP (e.g. of DNNL) and the BLAS
+  // of the ArrayFire CPU backend, 0 if no budget is set
+  int computeThreads = 0;
+  // Data loading threads, e.g. of PrefetchDataset
+  int dataThreads = 0;
+  // Threads of the decoders
+  int decoderThreads = 0;
+  // CPUs of each pool, anywhere if empty
+  std::vector<int> computeCpus;
+  std::vector<int> dataCpus;
+  std::vector<int> decoderCpus;
+
+  std::string prettyString() const;
+};
+
+/**
+ * Partitions `cpus` (the CPUs the calling thread may run on if empty) among
+ * `dataThreads` data loading threads, `decoderThreads` decoder threads and
+ * `computeThreads` threads of the computation, or the CPUs left by the other
+ * pools if 0. Each pool gets a CPU per thread, or a share of the CPUs in
+ * proportion to its threads (at least one) if there are more threads than
+ * CPUs, the computation taking the CPUs left by rounding.
+ */
+ThreadBudget partitionCpus(
+    int dataThreads,
+    int decoderThreads,
+    int computeThreads = 0,
+    std::vector<int> cpus = {});
+
+/**
+ * Applies `budget`: sets the threads of OpenMP, MKL and OpenBLAS (when the
+ * process has them) to `budget.computeThreads`, for the calling thread and
+ * for the libraries reading their environment later, and pins the calling
+ * thread, and the threads it starts from now on, to `budget.computeCpus`.
+ * Call it from the thread running the computation, e.g. after parsing the
+ * flags in `main()`. The data and decoder pools are then placed on their CPUs
+ * when created (PrefetchDataset does so by itself).
+ */
+void setThreadBudget(const ThreadBudget& budget);
+
+/**
+ * Returns the budget set with `setThreadBudget()`, of no threads if none.
+ */
+ThreadBudget getThreadBudget();
+
 } // namespace fl
@@ -0,0 +1,525 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/common/Metrics.h"
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include "flashlight/fl/common/Logging.h"
+
+namespace fl {
+
+namespace {
+
+// StatsD packets fit in the MTU of most networks
+constexpr size_t kMaxStatsdPacket = 1432;
+
+void atomicAdd(std::atomic<double>& atomic, double value) {
+  double current = atomic.load(std::memory_order_relaxed);
+  while (!atomic.compare_exchange_weak(
+      current, current + value, std::memory_order_relaxed)) {
+  }
+}
+
+std::string formatValue(double value) {
+  if (std::isinf(value)) {
+    return value > 0 ? "+Inf" : "-Inf";
+  }
+  std::ostringstream ss;
+  ss << std::setprecision(15) << value;
+  return ss.str();
+}
+
+std::string escapeLabel(const std::string& value) {
+  std::string escaped;
+  for (char c : value) {
+    if (c == '\\' || c == '"') {
+      escaped += '\\';
+      escaped += c;
+    } else if (c == '\n') {
+      escaped += "\\n";
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+// name="value",... in the order of `labels`
+std::string formatLabels(const MetricLabels& labels) {
+  std::string str;
+  for (const auto& label : labels) {
+    if (!str.empty()) {
+      str += ',';
+    }
+    str += label.first + "=\"" + escapeLabel(label.second) + "\"";
+  }
+  return str;
+}
+
+std::string labelsSuffix(const MetricLabels& labels) {
+  return labels.empty() ? "" : "{" + formatLabels(labels) + "}";
+}
+
+void sendAll(int fd, const std::string& data) {
+  const char* ptr = data.data();
+  size_t size = data.size();
+  while (size > 0) {
+    auto n = ::send(fd, ptr, size, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+    ptr += n;
+    size -= n;
+  }
+}
+
+} // namespace
+
+const std::vector<double> kMetricSecondsBounds = {
+    0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25,
+    0.5,   1,      2.5,   5,    10,    30,   60,  600};
+
+void MetricCounter::add(double value /* = 1 */) {
+  atomicAdd(value_, value);
+}
+
+double MetricCounter::value() const {
+  return value_.load(std::memory_order_relaxed);
+}
+
+void MetricGauge::set(double value) {
+  value_.store(value, std::memory_order_relaxed);
+}
+
+void MetricGauge::add(double value) {
+  atomicAdd(value_, value);
+}
+
+double MetricGauge::value() const {
+  return value_.load(std::memory_order_relaxed);
+}
+
+MetricHistogram::MetricHistogram(std::vector<double> bounds) {
+  if (!std::is_sorted(bounds.begin(), bounds.end()) ||
+      std::adjacent_find(bounds.begin(), bounds.end()) != bounds.end()) {
+    throw std::invalid_argument(
+        "MetricHistogram: bounds must be strictly increasing");
+  }
+  data_.counts.assign(bounds.size() + 1, 0);
+  data_.bounds = std::move(bounds);
+}
+
+void MetricHistogram::observe(double value) {
+  auto bucket =
+      std::lower_bound(data_.bounds.begin(), data_.bounds.end(), value) -
+      data_.bounds.begin();
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++data_.counts[bucket];
+  data_.sum += value;
+  ++data_.count;
+}
+
+MetricHistogram::Snapshot MetricHistogram::snapshot() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return data_;
+}
+
+MetricsRegistry& MetricsRegistry::global() {
+  static MetricsRegistry registry;
+  return registry;
+}
+
+MetricsRegistry::Family& MetricsRegistry::family(
+    const std::string& name,
+    const std::string& help,
+    MetricType type,
+    const MetricLabels& labels,
+    std::string& key) {
+  auto it = families_.find(name);
+  if (it == families_.end()) {
+    it = families_.emplace(name, Family()).first;
+    it->second.type = type;
+    it->second.help = help;
+  } else if (it->second.type != type) {
+    throw std::invalid_argument(
+        "MetricsRegistry: metric " + name + " has another type");
+  }
+  key = formatLabels(labels);
+  it->second.labels.emplace(key, labels);
+  return it->second;
+}
+
+MetricCounter& MetricsRegistry::counter(
+    const std::string& name,
+    const std::string& help,
+    const MetricLabels& labels /* = {} */) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::string key;
+  auto& metric = family(name, help, MetricType::COUNTER, labels, key)
+                     .counters[key];
+  if (!metric) {
+    metric = std::make_unique<MetricCounter>();
+  }
+  return *metric;
+}
+
+MetricGauge& MetricsRegistry::gauge(
+    const std::string& name,
+    const std::string& help,
+    const MetricLabels& labels /* = {} */) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::string key;
+  auto& metric =
+      family(name, help, MetricType::GAUGE, labels, key).gauges[key];
+  if (!metric) {
+    metric = std::make_unique<MetricGauge>();
+  }
+  return *metric;
+}
+
+MetricHistogram& MetricsRegistry::histogram(
+    const std::string& name,
+    const std::string& help,
+    const std::vector<double>& bounds /* = kMetricSecondsBounds */,
+    const MetricLabels& labels /* = {} */) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::string key;
+  auto& metric = family(name, help, MetricType::HISTOGRAM, labels, key)
+                     .histograms[key];
+  if (!metric) {
+    metric = std::make_unique<MetricHistogram>(bounds);
+  }
+  return *metric;
+}
+
+void MetricsRegistry::setConstantLabels(const MetricLabels& labels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  constantLabels_ = labels;
+}
+
+int64_t MetricsRegistry::addCollector(std::function<void()> collector) {
+  std::lock_guard<std::mutex> collectLock(collectMutex_);
+  std::lock_guard<std::mutex> lock(mutex_);
+  collectors_[nextCollector_] = std::move(collector);
+  return nextCollector_++;
+}
+
+void MetricsRegistry::removeCollector(int64_t id) {
+  // Waits for a collect running it
+  std::lock_guard<std::mutex> collectLock(collectMutex_);
+  std::lock_guard<std::mutex> lock(mutex_);
+  collectors_.erase(id);
+}
+
+std::vector<MetricSample> MetricsRegistry::collect() {
+  std::lock_guard<std::mutex> collectLock(collectMutex_);
+  // Collectors set metrics of the registry: they run without its lock
+  for (auto& collector : collectors_) {
+    collector.second();
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<MetricSample> samples;
+  for (const auto& entry : families_) {
+    const auto& family = entry.second;
+    for (const auto& labels : family.labels) {
+      MetricSample sample;
+      sample.name = entry.first;
+      sample.help = family.help;
+      sample.type = family.type;
+      sample.labels = labels.second;
+      sample.labels.insert(
+          sample.labels.end(), constantLabels_.begin(), constantLabels_.end());
+      switch (family.type) {
+        case MetricType::COUNTER:
+          sample.value = family.counters.at(labels.first)->value();
+          break;
+        case MetricType::GAUGE:
+          sample.value = family.gauges.at(labels.first)->value();
+          break;
+        case MetricType::HISTOGRAM:
+          sample.histogram = family.histograms.at(labels.first)->snapshot();
+          break;
+      }
+      samples.push_back(std::move(sample));
+    }
+  }
+  return samples;
+}
+
+std::string formatPrometheus(const std::vector<MetricSample>& samples) {
+  std::ostringstream ss;
+  const std::string* lastName = nullptr;
+  for (const auto& sample : samples) {
+    if (!lastName || *lastName != sample.name) {
+      static const char* kTypes[] = {"counter", "gauge", "histogram"};
+      ss << "# HELP " << sample.name << " " << sample.help << "\n";
+      ss << "# TYPE " << sample.name << " "
+         << kTypes[static_cast<int>(sample.type)] << "\n";
+      lastName = &sample.name;
+    }
+    if (sample.type != MetricType::HISTOGRAM) {
+      ss << sample.name << labelsSuffix(sample.labels) << " "
+         << formatValue(sample.value) << "\n";
+      continue;
+    }
+    // Buckets are cumulative
+    const auto& histogram = sample.histogram;
+    uint64_t cumulated = 0;
+    for (size_t i = 0; i < histogram.counts.size(); ++i) {
+      cumulated += histogram.counts[i];
+      auto labels = sample.labels;
+      labels.emplace_back(
+          "le",
+          formatValue(
+              i < histogram.bounds.size()
+                  ? histogram.bounds[i]
+                  : std::numeric_limits<double>::infinity()));
+      ss << sample.name << "_bucket" << labelsSuffix(labels) << " "
+         << cumulated << "\n";
+    }
+    ss << sample.name << "_sum" << labelsSuffix(sample.labels) << " "
+       << formatValue(histogram.sum) << "\n";
+    ss << sample.name << "_count" << labelsSuffix(sample.labels) << " "
+       << histogram.count << "\n";
+  }
+  return ss.str();
+}
+
+MetricsServer::MetricsServer(
+    int port,
+    MetricsRegistry& registry /* = MetricsRegistry::global() */)
+    : registry_(registry) {
+  listenFd_ = ::socket(AF_INET6, SOCK_STREAM, 0);
+  if (listenFd_ < 0) {
+    throw std::runtime_error("MetricsServer: socket creation failed");
+  }
+  int on = 1;
+  ::setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  // Accept IPv4 connections as well
+  int off = 0;
+  ::setsockopt(listenFd_, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+  sockaddr_in6 addr{};
+  addr.sin6_family = AF_INET6;
+  addr.sin6_addr = in6addr_any;
+  addr.sin6_port = htons(port);
+  socklen_t addrLen = sizeof(addr);
+  if (::bind(listenFd_, reinterpret_cast<sockaddr*>(&addr), addrLen) < 0 ||
+      ::listen(listenFd_, SOMAXCONN) < 0 ||
+      ::getsockname(
+          listenFd_, reinterpret_cast<sockaddr*>(&addr), &addrLen) < 0) {
+    auto err = std::string(std::strerror(errno));
+    ::close(listenFd_);
+    throw std::runtime_error(
+        "MetricsServer: cannot listen on port " + std::to_string(port) +
+        ": " + err);
+  }
+  port_ = ntohs(addr.sin6_port);
+  thread_ = std::thread([this]() { serve(); });
+}
+
+MetricsServer::~MetricsServer() {
+  stop_ = true;
+  thread_.join();
+  ::close(listenFd_);
+}
+
+void MetricsServer::serve() {
+  while (!stop_) {
+    pollfd pfd{listenFd_, POLLIN, 0};
+    if (::poll(&pfd, 1, 100 /* ms, to check stop_ */) <= 0) {
+      continue;
+    }
+    int fd = ::accept(listenFd_, nullptr, nullptr);
+    if (fd < 0) {
+      continue;
+    }
+    // Slow clients don't block the server for long
+    timeval timeout{1, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos &&
+           request.size() < 8192) {
+      auto n = ::recv(fd, buffer, sizeof(buffer), 0);
+      if (n <= 0) {
+        break;
+      }
+      request.append(buffer, n);
+    }
+
+    std::string status = "200 OK";
+    std::string body;
+    const std::string kGet = "GET /metrics";
+    if (request.compare(0, kGet.size(), kGet) == 0 &&
+        (request[kGet.size()] == ' ' || request[kGet.size()] == '?')) {
+      try {
+        body = formatPrometheus(registry_.collect());
+      } catch (const std::exception& ex) {
+        status = "500 Internal Server Error";
+        body = std::string(ex.what()) + "\n";
+      }
+    } else {
+      status = "404 Not Found";
+      body = "Metrics are served at /metrics\n";
+    }
+    std::ostringstream response;
+    response << "HTTP/1.1 " << status << "\r\n"
+             << "Content-Type: text/plain; version=0.0.4\r\n"
+             << "Content-Length: " << body.size() << "\r\n"
+             << "Connection: close\r\n\r\n"
+             << body;
+    sendAll(fd, response.str());
+    ::close(fd);
+  }
+}
+
+StatsdExporter::StatsdExporter(
+    const std::string& host,
+    int port,
+    const std::string& prefix /* = "" */,
+    int64_t intervalMs /* = 10000 */,
+    MetricsRegistry& registry /* = MetricsRegistry::global() */)
+    : registry_(registry), prefix_(prefix), intervalMs_(intervalMs) {
+  if (intervalMs_ <= 0) {
+    throw std::invalid_argument("StatsdExporter: interval must be positive");
+  }
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  addrinfo* addrs = nullptr;
+  if (::getaddrinfo(
+          host.c_str(), std::to_string(port).c_str(), &hints, &addrs) != 0) {
+    throw std::runtime_error("StatsdExporter: cannot resolve " + host);
+  }
+  for (auto* addr = addrs; addr; addr = addr->ai_next) {
+    fd_ = ::socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+    if (fd_ < 0) {
+      continue;
+    }
+    // Sends to the server with send()
+    if (::connect(fd_, addr->ai_addr, addr->ai_addrlen) == 0) {
+      break;
+    }
+    ::close(fd_);
+    fd_ = -1;
+  }
+  ::freeaddrinfo(addrs);
+  if (fd_ < 0) {
+    throw std::runtime_error(
+        "StatsdExporter: cannot reach " + host + ":" + std::to_string(port));
+  }
+  thread_ = std::thread([this]() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopCv_.wait_for(
+        lock, std::chrono::milliseconds(intervalMs_), [this]() {
+          return stop_;
+        })) {
+      lock.unlock();
+      try {
+        flush();
+      } catch (const std::exception& ex) {
+        FL_LOG(fl::WARNING) << "StatsdExporter: " << ex.what();
+      }
+      lock.lock();
+    }
+  });
+}
+
+StatsdExporter::~StatsdExporter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  stopCv_.notify_all();
+  thread_.join();
+  try {
+    flush();
+  } catch (const std::exception& ex) {
+    FL_LOG(fl::WARNING) << "StatsdExporter: " << ex.what();
+  }
+  ::close(fd_);
+}
+
+void StatsdExporter::flush() {
+  auto samples = registry_.collect();
+  std::lock_guard<std::mutex> lock(flushMutex_);
+  std::string packet;
+  auto add = [&](const std::string& line) {
+    if (!packet.empty() && packet.size() + 1 + line.size() > kMaxStatsdPacket) {
+      send(packet);
+      packet.clear();
+    }
+    packet += (packet.empty() ? "" : "\n") + line;
+  };
+  // Increment of a cumulated value since the last push
+  auto delta = [this](const std::string& key, double value) {
+    auto& last = lastValues_[key];
+    // A value lower than the last one was reset
+    double increment = value >= last ? value - last : value;
+    last = value;
+    return increment;
+  };
+
+  for (const auto& sample : samples) {
+    std::string tags;
+    for (const auto& label : sample.labels) {
+      tags += (tags.empty() ? "|#" : ",") + label.first + ":" + label.second;
+    }
+    const std::string name = prefix_ + sample.name;
+    const std::string key = name + labelsSuffix(sample.labels);
+    switch (sample.type) {
+      case MetricType::COUNTER: {
+        double increment = delta(key, sample.value);
+        if (increment != 0) {
+          add(name + ":" + formatValue(increment) + "|c" + tags);
+        }
+        break;
+      }
+      case MetricType::GAUGE:
+        add(name + ":" + formatValue(sample.value) + "|g" + tags);
+        break;
+      case MetricType::HISTOGRAM: {
+        double count = delta(key + ".count", sample.histogram.count);
+        double sum = delta(key + ".sum", sample.histogram.sum);
+        if (count != 0) {
+          add(name + ".count:" + formatValue(count) + "|c" + tags);
+          add(name + ".sum:" + formatValue(sum) + "|c" + tags);
+        }
+        break;
+      }
+    }
+  }
+  if (!packet.empty()) {
+    send(packet);
+  }
+}
+
+void StatsdExporter::send(const std::string& packet) {
+  // Metrics are best effort: lost packets are not retried
+  ::send(fd_, packet.data(), packet.size(), MSG_NOSIGNAL);
+}
+
+} // namespace fl
@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace fl {
+
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+enum class MetricType { COUNTER, GAUGE, HISTOGRAM };
+
+/**
+ * A value which only increases, e.g. the number of samples trained on.
+ * Thread-safe.
+ */
+class MetricCounter {
+ public:
+  void add(double value = 1);
+  double value() const;
+
+ private:
+  std::atomic<double> value_{0};
+};
+
+/**
+ * A value which goes up and down, e.g. the memory in use. Thread-safe.
+ */
+class MetricGauge {
+ public:
+  void set(double value);
+  void add(double value);
+  double value() const;
+
+ private:
+  std::atomic<double> value_{0};
+};
+
+/**
+ * Counts observed values (e.g. step times) in buckets of fixed upper bounds.
+ * Thread-safe.
+ */
+class MetricHistogram {
+ public:
+  struct Snapshot {
+    // Upper bounds of the buckets but the last one, of +Inf
+    std::vector<double> bounds;
+    // Values observed in each bucket, not cumulated
+    std::vector<uint64_t> counts;
+    double sum{0};
+    uint64_t count{0};
+  };
+
+  /**
+   * @param bounds increasing upper bounds of the buckets
+   */
+  explicit MetricHistogram(std::vector<double> bounds);
+
+  void observe(double value);
+  Snapshot snapshot() const;
+
+ private:
+  mutable std::mutex mutex_;
+  Snapshot data_;
+};
+
+// Bounds of histograms of durations in seconds, from 1 ms to 10 min
+extern const std::vector<double> kMetricSecondsBounds;
+
+/**
+ * The value of a metric when the metrics are collected.
+ */
+struct MetricSample {
+  std::string name;
+  std::string help;
+  MetricType type;
+  // With the constant labels of the registry
+  MetricLabels labels;
+  // Of a counter or a gauge
+  double value{0};
+  MetricHistogram::Snapshot histogram;
+};
+
+/**
+ * A registry of the metrics of the process (throughput, step times, memory
+ * usage...), which exporters (see `MetricsServer` and `StatsdExporter`)
+ * collect periodically. Metrics are identified by a name and labels, and
+ * created when first requested; they live as long as the registry, so that
+ * the references returned can be kept:
+ * \code{.cpp}
+   auto& samples = fl::MetricsRegistry::global().counter(
+       "fl_train_samples_total", "Samples trained on");
+   ...
+   samples.add(batchSize);
+ * \endcode
+ * Names follow the conventions of Prometheus: `[a-zA-Z_:][a-zA-Z0-9_:]*`, in
+ * base units, with `_total` for counters.
+ */
+class MetricsRegistry {
+ public:
+  static MetricsRegistry& global();
+
+  /**
+   * Returns the metric `name` with `labels`, created if needed. Throws if a
+   * metric of another type already has this name.
+   */
+  MetricCounter& counter(
+      const std::string& name,
+      const std::string& help,
+      const MetricLabels& labels = {});
+  MetricGauge& gauge(
+      const std::string& name,
+      const std::string& help,
+      const MetricLabels& labels = {});
+  /**
+   * `bounds` are those of the histogram when it is created.
+   */
+  MetricHistogram& histogram(
+      const std::string& name,
+      const std::string& help,
+      const std::vector<double>& bounds = kMetricSecondsBounds,
+      const MetricLabels& labels = {});
+
+  /**
+   * Labels added to all the metrics when they are collected, e.g. the rank
+   * of the process.
+   */
+  void setConstantLabels(const MetricLabels& labels);
+
+  /**
+   * Adds a function called before the metrics are collected, to set the
+   * gauges of values which are read rather than recorded (e.g. the memory
+   * in use). Returns an id for `removeCollector()`.
+   */
+  int64_t addCollector(std::function<void()> collector);
+  void removeCollector(int64_t id);
+
+  /**
+   * Runs the collectors, and returns the value of all the metrics, sorted by
+   * name and labels.
+   */
+  std::vector<MetricSample> collect();
+
+ private:
+  struct Family {
+    MetricType type;
+    std::string help;
+    // Metrics by formatted labels, with their labels
+    std::map<std::string, MetricLabels> labels;
+    std::map<std::string, std::unique_ptr<MetricCounter>> counters;
+    std::map<std::string, std::unique_ptr<MetricGauge>> gauges;
+    std::map<std::string, std::unique_ptr<MetricHistogram>> histograms;
+  };
+
+  Family& family(
+      const std::string& name,
+      const std::string& help,
+      MetricType type,
+      const MetricLabels& labels,
+      std::string& key);
+
+  std::mutex mutex_;
+  std::map<std::string, Family> families_;
+  MetricLabels constantLabels_;
+  std::map<int64_t, std::function<void()>> collectors_;
+  int64_t nextCollector_{0};
+  // Serializes the collects, and the collectors
+  std::mutex collectMutex_;
+};
+
+/**
+ * Formats `samples` in the text exposition format of Prometheus.
+ */
+std::string formatPrometheus(const std::vector<MetricSample>& samples);
+
+/**
+ * Serves the metrics of a registry over HTTP at `/metrics`, for Prometheus
+ * to scrape, from a thread of its own. One request is served at a time.
+ */
+class MetricsServer {
+ public:
+  /**
+   * @param port port to listen on, 0 for any free port (see `port()`)
+   */
+  explicit MetricsServer(
+      int port,
+      MetricsRegistry& registry = MetricsRegistry::global());
+  ~MetricsServer();
+
+  int port() const {
+    return port_;
+  }
+
+ private:
+  void serve();
+
+  MetricsRegistry& registry_;
+  int listenFd_{-1};
+  int port_{0};
+  std::atomic<bool> stop_{false};
+  std::thread thread_;
+};
+
+/**
+ * Pushes the metrics of a registry to a StatsD server over UDP every
+ * `intervalMs` milliseconds, from a thread of its own, and when destroyed.
+ * Counters are sent as the increments since the last push, gauges as their
+ * value, and histograms as the increments of their count and their sum.
+ * Labels are sent as DogStatsD tags (`|#name:value`), which StatsD servers
+ * without tags ignore or drop: `prefix` then tells processes apart.
+ */
+class StatsdExporter {
+ public:
+  StatsdExporter(
+      const std::string& host,
+      int port,
+      const std::string& prefix = "",
+      int64_t intervalMs = 10000,
+      MetricsRegistry& registry = MetricsRegistry::global());
+  ~StatsdExporter();
+
+  /**
+   * Pushes the metrics now.
+   */
+  void flush();
+
+ private:
+  void send(const std::string& packet);
+
+  MetricsRegistry& registry_;
+  const std::string prefix_;
+  const int64_t intervalMs_;
+  int fd_{-1};
+  // Values of the last push, of counters and histogram counts and sums
+  std::unordered_map<std::string, double> lastValues_;
+  std::mutex flushMutex_;
+  std::mutex mutex_;
+  bool stop_{false};
+  std::condition_variable stopCv_;
+  std::thread thread_;
+};
+
+} // namespace fl
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/common/PinnedHostBuffer.h"
+
+#include <cstring>
+
+#include "flashlight/fl/common/Utils.h"
+
+namespace fl {
+
+PinnedHostBuffer::PinnedHostBuffer(size_t bytes)
+    : ptr_(nullptr), bytes_(bytes) {
+  if (bytes_ > 0) {
+    AF_CHECK(af_alloc_pinned(&ptr_, bytes_));
+  }
+}
+
+PinnedHostBuffer::~PinnedHostBuffer() {
+  if (ptr_ != nullptr) {
+    af_free_pinned(ptr_);
+  }
+}
+
+PinnedHostBuffer::PinnedHostBuffer(PinnedHostBuffer&& other) noexcept
+    : ptr_(other.ptr_), bytes_(other.bytes_) {
+  other.ptr_ = nullptr;
+  other.bytes_ = 0;
+}
+
+PinnedHostBuffer& PinnedHostBuffer::operator=(
+    PinnedHostBuffer&& other) noexcept {
+  if (ptr_ != nullptr) {
+    af_free_pinned(ptr_);
+  }
+  ptr_ = other.ptr_;
+  bytes_ = other.bytes_;
+  other.ptr_ = nullptr;
+  other.bytes_ = 0;
+  return *this;
+}
+
+void copyToHostPinned(const af::array& arr, void* dst) {
+  if (arr.isempty()) {
+    return;
+  }
+  PinnedHostBuffer buffer(arr.bytes());
+  arr.host(buffer.get());
+  std::memcpy(dst, buffer.get(), buffer.bytes());
+}
+
+} // namespace fl
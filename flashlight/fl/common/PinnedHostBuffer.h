@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+#include <arrayfire.h>
+
+namespace fl {
+
+/**
+ * PinnedHostBuffer provides an RAII wrapper for page-locked host memory
+ * allocated by the ArrayFire pinned memory manager (`af_alloc_pinned`). Device
+ * copies from or to pinned memory are faster than from pageable memory and
+ * can be asynchronous. When flashlight caches pinned memory (see
+ * `MemoryManagerInstaller::installDefaultPinnedMemoryManager()`), buffers are
+ * reused instead of registered on every allocation, so short-lived buffers
+ * are cheap. A PinnedHostBuffer is movable, but not copyable.
+ * Example Usage :
+ * \code{.cpp}
+ * auto A = af::randu(10, 10);
+ * {
+ *     PinnedHostBuffer buffer(A.bytes());
+ *     A.host(buffer.get());
+ * }
+ * // buffer is destructed and its memory is back to the pinned memory manager
+ * \endcode
+ */
+class PinnedHostBuffer {
+ public:
+  /**
+   * Creates an empty PinnedHostBuffer.
+   */
+  PinnedHostBuffer() : ptr_(nullptr), bytes_(0) {}
+
+  /**
+   * @param bytes size of the buffer in bytes
+   */
+  explicit PinnedHostBuffer(size_t bytes);
+
+  /**
+   * The memory is given back to the pinned memory manager in destructor
+   */
+  ~PinnedHostBuffer();
+
+  PinnedHostBuffer(const PinnedHostBuffer& other) = delete;
+
+  PinnedHostBuffer& operator=(const PinnedHostBuffer& other) = delete;
+
+  PinnedHostBuffer(PinnedHostBuffer&& other) noexcept;
+
+  PinnedHostBuffer& operator=(PinnedHostBuffer&& other) noexcept;
+
+  void* get() const {
+    return ptr_;
+  }
+
+  template <typename T>
+  T* getAs() const {
+    return reinterpret_cast<T*>(ptr_);
+  }
+
+  size_t bytes() const {
+    return bytes_;
+  }
+
+ private:
+  void* ptr_;
+  size_t bytes_;
+};
+
+/**
+ * Copies the data of an array to `dst` through a pinned host buffer, which is
+ * faster than `af::array::host()` to pageable memory for large device arrays.
+ *
+ * @param[in] arr input array
+ * @param[out] dst host memory of at least `arr.bytes()` bytes
+ */
+void copyToHostPinned(const af::array& arr, void* dst);
+
+} // namespace fl
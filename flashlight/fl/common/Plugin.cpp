@@ -37,6 +37,11 @@ void* Plugin::getRawSymbol(const std::string& symbol) {
   return addr;
 }
 
+bool Plugin::hasSymbol(const std::string& symbol) {
+  dlerror(); // clear errors
+  return dlsym(handle_, symbol.c_str()) != nullptr;
+}
+
 Plugin::~Plugin() {
   if (handle_) {
     dlclose(handle_);
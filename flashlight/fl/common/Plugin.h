@@ -23,6 +23,9 @@ class Plugin {
     return (T)getRawSymbol(symbol);
   }
 
+  // Whether the library defines `symbol`, for optional symbols
+  bool hasSymbol(const std::string& symbol);
+
  private:
   void* getRawSymbol(const std::string& symbol);
   std::string name_;
@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace fl {
+
+template <typename Signature, size_t Capacity = 64>
+class SmallFunction;
+
+/**
+ * A copyable type-erased callable, like `std::function`, which stores
+ * callables of up to `Capacity` bytes (e.g. lambdas capturing a few arrays)
+ * in place instead of allocating them on the heap. Larger callables, and
+ * those which may throw when moved, are allocated on the heap.
+ *
+ * \code{.cpp}
+ * SmallFunction<int(int)> addOne = [](int x) { return x + 1; };
+ * addOne(1); // 2
+ * addOne = nullptr; // empty, calls throw std::bad_function_call
+ * \endcode
+ */
+template <typename R, typename... Args, size_t Capacity>
+class SmallFunction<R(Args...), Capacity> {
+ public:
+  SmallFunction() noexcept = default;
+
+  SmallFunction(std::nullptr_t) noexcept {}
+
+  template <
+      typename F,
+      typename = typename std::enable_if<
+          !std::is_same<typename std::decay<F>::type, SmallFunction>::value &&
+          !std::is_same<typename std::decay<F>::type, std::nullptr_t>::
+              value>::type>
+  SmallFunction(F&& f) {
+    using Callable = typename std::decay<F>::type;
+    if (isEmpty(f)) {
+      return;
+    }
+    StorageFor<Callable>::create(&storage_, std::forward<F>(f));
+    ops_ = &opsFor<Callable>();
+  }
+
+  SmallFunction(const SmallFunction& other) {
+    if (other.ops_) {
+      other.ops_->copy(&other.storage_, &storage_);
+      ops_ = other.ops_;
+    }
+  }
+
+  SmallFunction(SmallFunction&& other) noexcept {
+    if (other.ops_) {
+      other.ops_->move(&other.storage_, &storage_);
+      ops_ = other.ops_;
+      other.ops_ = nullptr;
+    }
+  }
+
+  ~SmallFunction() {
+    reset();
+  }
+
+  SmallFunction& operator=(const SmallFunction& other) {
+    if (this != &other) {
+      *this = SmallFunction(other);
+    }
+    return *this;
+  }
+
+  SmallFunction& operator=(SmallFunction&& other) noexcept {
+    if (this != &other) {
+      reset();
+      if (other.ops_) {
+        other.ops_->move(&other.storage_, &storage_);
+        ops_ = other.ops_;
+        other.ops_ = nullptr;
+      }
+    }
+    return *this;
+  }
+
+  SmallFunction& operator=(std::nullptr_t) noexcept {
+    reset();
+    return *this;
+  }
+
+  template <
+      typename F,
+      typename = typename std::enable_if<
+          !std::is_same<typename std::decay<F>::type, SmallFunction>::value &&
+          !std::is_same<typename std::decay<F>::type, std::nullptr_t>::
+              value>::type>
+  SmallFunction& operator=(F&& f) {
+    return *this = SmallFunction(std::forward<F>(f));
+  }
+
+  explicit operator bool() const noexcept {
+    return ops_ != nullptr;
+  }
+
+  R operator()(Args... args) const {
+    if (!ops_) {
+      throw std::bad_function_call();
+    }
+    return ops_->invoke(&storage_, std::forward<Args>(args)...);
+  }
+
+  /**
+   * Whether callables of type `F` are stored in place.
+   */
+  template <typename F>
+  static constexpr bool isInline() {
+    return sizeof(F) <= Capacity &&
+        alignof(F) <= alignof(std::max_align_t) &&
+        std::is_nothrow_move_constructible<F>::value;
+  }
+
+ private:
+  using Storage = typename std::
+      aligned_storage<Capacity, alignof(std::max_align_t)>::type;
+
+  struct Ops {
+    R (*invoke)(void* storage, Args&&... args);
+    void (*copy)(const void* src, void* dst);
+    void (*move)(void* src, void* dst) noexcept;
+    void (*destroy)(void* storage) noexcept;
+  };
+
+  template <typename F>
+  struct InlineStorage {
+    template <typename G>
+    static void create(void* storage, G&& f) {
+      new (storage) F(std::forward<G>(f));
+    }
+    static F& get(void* storage) {
+      return *static_cast<F*>(storage);
+    }
+    static void move(void* src, void* dst) noexcept {
+      new (dst) F(std::move(get(src)));
+      get(src).~F();
+    }
+    static void destroy(void* storage) noexcept {
+      get(storage).~F();
+    }
+  };
+
+  template <typename F>
+  struct HeapStorage {
+    template <typename G>
+    static void create(void* storage, G&& f) {
+      *static_cast<F**>(storage) = new F(std::forward<G>(f));
+    }
+    static F& get(void* storage) {
+      return **static_cast<F**>(storage);
+    }
+    static void move(void* src, void* dst) noexcept {
+      *static_cast<F**>(dst) = *static_cast<F**>(src);
+    }
+    static void destroy(void* storage) noexcept {
+      delete *static_cast<F**>(storage);
+    }
+  };
+
+  template <typename F>
+  using StorageFor = typename std::
+      conditional<isInline<F>(), InlineStorage<F>, HeapStorage<F>>::type;
+
+  template <typename F>
+  static R invokeCallable(void* storage, Args&&... args) {
+    return StorageFor<F>::get(storage)(std::forward<Args>(args)...);
+  }
+
+  template <typename F>
+  static void copyCallable(const void* src, void* dst) {
+    const F& from = StorageFor<F>::get(const_cast<void*>(src));
+    StorageFor<F>::create(dst, from);
+  }
+
+  template <typename F>
+  static const Ops& opsFor() {
+    static const Ops ops = {
+        &invokeCallable<F>,
+        &copyCallable<F>,
+        &StorageFor<F>::move,
+        &StorageFor<F>::destroy};
+    return ops;
+  }
+
+  // Null function pointers and empty std::functions make empty functions
+  template <typename F>
+  static bool isEmpty(const F& /* f */) {
+    return false;
+  }
+
+  template <typename T>
+  static bool isEmpty(T* f) {
+    return f == nullptr;
+  }
+
+  template <typename Sig>
+  static bool isEmpty(const std::function<Sig>& f) {
+    return !f;
+  }
+
+  void reset() noexcept {
+    if (ops_) {
+      ops_->destroy(&storage_);
+      ops_ = nullptr;
+    }
+  }
+
+  mutable Storage storage_;
+  const Ops* ops_{nullptr};
+};
+
+} // namespace fl
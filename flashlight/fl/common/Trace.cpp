@@ -0,0 +1,289 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/common/Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_set>
+#include <vector>
+
+namespace fl {
+
+namespace detail {
+
+std::atomic<uint32_t> traceMask{0};
+
+int64_t traceNowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+} // namespace detail
+
+namespace {
+
+struct TraceEvent {
+  const char* name;
+  uint32_t category;
+  int64_t beginNs;
+  int64_t endNs;
+  // Handles of the device events, -1 if none
+  int64_t deviceBegin;
+  int64_t deviceEnd;
+};
+
+/**
+ * The ring buffer of a thread, written by this thread only: the i-th scope
+ * goes to events[i % events.size()], then `count` is published.
+ */
+struct ThreadTrace {
+  ThreadTrace(int64_t capacity, int64_t generation, int tid)
+      : events(capacity), generation(generation), tid(tid) {}
+
+  std::vector<TraceEvent> events;
+  std::atomic<int64_t> count{0};
+  // Recording (see `Tracer::start()`) for which the buffer was created
+  const int64_t generation;
+  const int tid;
+  // Guarded by the mutex of the registry
+  std::string name;
+};
+
+struct TraceRegistry {
+  std::mutex mutex;
+  // Buffers of the current recording, kept after their thread exits
+  std::vector<std::shared_ptr<ThreadTrace>> threads;
+  std::atomic<int64_t> generation{0};
+  std::atomic<bool> device{false};
+  int64_t eventsPerThread = TraceOptions().eventsPerThread;
+  int64_t startNs = 0;
+  // 0 is the track of the device
+  int nextTid = 1;
+};
+
+// Never destroyed: threads may record until the end of the process
+TraceRegistry& registry() {
+  static auto* registry = new TraceRegistry();
+  return *registry;
+}
+
+thread_local std::shared_ptr<ThreadTrace> tlsTrace;
+thread_local int tlsTid = -1;
+thread_local std::string tlsThreadName;
+
+ThreadTrace* threadTrace() {
+  auto& reg = registry();
+  if (!tlsTrace ||
+      tlsTrace->generation != reg.generation.load(std::memory_order_acquire)) {
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    if (tlsTid < 0) {
+      tlsTid = reg.nextTid++;
+    }
+    tlsTrace = std::make_shared<ThreadTrace>(
+        reg.eventsPerThread, reg.generation.load(), tlsTid);
+    tlsTrace->name = tlsThreadName;
+    reg.threads.push_back(tlsTrace);
+  }
+  return tlsTrace.get();
+}
+
+const char* categoryName(uint32_t category) {
+  switch (static_cast<TraceCategory>(category)) {
+    case TraceCategory::AUTOGRAD:
+      return "autograd";
+    case TraceCategory::DATA:
+      return "data";
+    case TraceCategory::DISTRIBUTED:
+      return "distributed";
+    case TraceCategory::DECODER:
+      return "decoder";
+    case TraceCategory::USER:
+      return "user";
+  }
+  return "unknown";
+}
+
+void writeJsonString(std::ostream& out, const std::string& str) {
+  out << '"';
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      out << '\\' << c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      out << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+          << static_cast<int>(c) << std::dec << std::setfill(' ');
+    } else {
+      out << c;
+    }
+  }
+  out << '"';
+}
+
+void writeThreadName(std::ostream& out, int tid, const std::string& name) {
+  out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": "
+      << tid << ", \"args\": {\"name\": ";
+  writeJsonString(out, name);
+  out << "}}";
+}
+
+void writeScope(
+    std::ostream& out,
+    const char* name,
+    uint32_t category,
+    int tid,
+    int64_t beginNs,
+    int64_t endNs) {
+  out << "{\"name\": ";
+  writeJsonString(out, name);
+  out << ", \"cat\": \"" << categoryName(category)
+      << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << tid
+      << ", \"ts\": " << beginNs / 1e3
+      << ", \"dur\": " << (endNs - beginNs) / 1e3 << "}";
+}
+
+} // namespace
+
+void Tracer::start(const TraceOptions& options /* = TraceOptions() */) {
+  if (options.eventsPerThread <= 0) {
+    throw std::invalid_argument("Tracer: eventsPerThread must be positive");
+  }
+  auto& reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  reg.threads.clear();
+  reg.eventsPerThread = options.eventsPerThread;
+  bool device = options.device && detail::deviceTraceSupported();
+  if (device) {
+    detail::deviceTraceReset(options.maxDeviceEvents);
+  }
+  reg.device.store(device);
+  reg.startNs = detail::traceNowNs();
+  reg.generation.fetch_add(1, std::memory_order_release);
+  detail::traceMask.store(options.categories);
+}
+
+void Tracer::stop() {
+  detail::traceMask.store(0);
+}
+
+bool Tracer::deviceSupported() {
+  return detail::deviceTraceSupported();
+}
+
+void Tracer::dump(const std::string& path) {
+  auto& reg = registry();
+  std::vector<std::shared_ptr<ThreadTrace>> threads;
+  std::vector<std::string> names;
+  int64_t startNs;
+  {
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    threads = reg.threads;
+    for (const auto& thread : threads) {
+      names.push_back(thread->name);
+    }
+    startNs = reg.startNs;
+  }
+
+  std::ofstream out(path);
+  if (!out) {
+    throw std::runtime_error("Tracer: could not open " + path);
+  }
+  out << std::fixed << std::setprecision(3) << "{\"traceEvents\": [\n";
+  writeThreadName(out, 0, "device");
+  for (size_t t = 0; t < threads.size(); ++t) {
+    const auto& thread = *threads[t];
+    out << ",\n";
+    writeThreadName(
+        out,
+        thread.tid,
+        names[t].empty() ? "thread " + std::to_string(thread.tid) : names[t]);
+
+    // Copies the scopes, then drops the ones overwritten meanwhile
+    const int64_t capacity = thread.events.size();
+    int64_t count = thread.count.load(std::memory_order_acquire);
+    int64_t first = std::max<int64_t>(0, count - capacity);
+    std::vector<TraceEvent> events;
+    for (int64_t i = first; i < count; ++i) {
+      events.push_back(thread.events[i % capacity]);
+    }
+    int64_t overwritten =
+        thread.count.load(std::memory_order_acquire) - capacity;
+    for (int64_t i = std::max(first, overwritten); i < count; ++i) {
+      const auto& event = events[i - first];
+      out << ",\n";
+      writeScope(
+          out,
+          event.name,
+          event.category,
+          thread.tid,
+          event.beginNs - startNs,
+          event.endNs - startNs);
+      int64_t deviceBeginNs, deviceEndNs;
+      if (event.deviceBegin >= 0 && event.deviceEnd >= 0 &&
+          detail::deviceTraceTime(event.deviceBegin, deviceBeginNs) &&
+          detail::deviceTraceTime(event.deviceEnd, deviceEndNs)) {
+        out << ",\n";
+        writeScope(
+            out,
+            event.name,
+            event.category,
+            0,
+            deviceBeginNs - startNs,
+            deviceEndNs - startNs);
+      }
+    }
+  }
+  out << "\n]}\n";
+  if (!out) {
+    throw std::runtime_error("Tracer: could not write to " + path);
+  }
+}
+
+void Tracer::setThreadName(const std::string& name) {
+  tlsThreadName = name;
+  auto& reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  if (tlsTrace && tlsTrace->generation == reg.generation.load()) {
+    tlsTrace->name = name;
+  }
+}
+
+const char* Tracer::intern(const std::string& name) {
+  // Never destroyed, as the registry
+  static auto* names = new std::unordered_set<std::string>();
+  static std::mutex mutex;
+  std::lock_guard<std::mutex> lock(mutex);
+  return names->insert(name).first->c_str();
+}
+
+void ScopedTrace::begin() {
+  beginNs_ = detail::traceNowNs();
+  deviceBegin_ = registry().device.load(std::memory_order_relaxed)
+      ? detail::deviceTraceRecord()
+      : -1;
+}
+
+void ScopedTrace::end() {
+  int64_t deviceEnd = deviceBegin_ >= 0 ? detail::deviceTraceRecord() : -1;
+  int64_t endNs = detail::traceNowNs();
+  auto* trace = threadTrace();
+  auto i = trace->count.load(std::memory_order_relaxed);
+  trace->events[i % trace->events.size()] = {name_,
+                                             static_cast<uint32_t>(category_),
+                                             beginNs_,
+                                             endNs,
+                                             deviceBegin_,
+                                             deviceEnd};
+  trace->count.store(i + 1, std::memory_order_release);
+}
+
+} // namespace fl
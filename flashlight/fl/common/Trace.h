@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace fl {
+
+/**
+ * Categories of the scopes recorded by `Tracer`, combined as a mask in
+ * `TraceOptions::categories`.
+ */
+enum class TraceCategory : uint32_t {
+  AUTOGRAD = 1 << 0,
+  DATA = 1 << 1,
+  DISTRIBUTED = 1 << 2,
+  DECODER = 1 << 3,
+  USER = 1 << 4,
+};
+
+constexpr uint32_t kTraceAllCategories = 0xffffffff;
+
+struct TraceOptions {
+  // Mask of the `TraceCategory`s recorded
+  uint32_t categories = kTraceAllCategories;
+  // Scopes kept by each thread, the oldest ones are overwritten
+  int64_t eventsPerThread = 1 << 16;
+  // If true, the scopes also record events on the stream of the device, and
+  // the time the device spent on their work is shown on a separate track.
+  // Not supported by all backends (see `Tracer::deviceSupported()`).
+  bool device = false;
+  // Device events, shared by all the threads, after which scopes are
+  // only timed on the host
+  int64_t maxDeviceEvents = 1 << 16;
+};
+
+namespace detail {
+
+// Mask of the categories recorded, 0 if tracing is stopped
+extern std::atomic<uint32_t> traceMask;
+
+// Implemented by the backends: device events which can be timed against
+// the host clock. Records are thread-safe.
+bool deviceTraceSupported();
+// Releases the previous events, and records the reference event
+void deviceTraceReset(int64_t maxEvents);
+// Returns a handle to an event recorded on the active stream, or -1
+int64_t deviceTraceRecord();
+// Time of the host clock (see `traceNowNs()`) at which the event completed.
+// Waits for it. Returns false if it can't be timed.
+bool deviceTraceTime(int64_t handle, int64_t& ns);
+
+int64_t traceNowNs();
+
+} // namespace detail
+
+/**
+ * A tracer recording timed scopes of all the threads in process (data
+ * loading, forward and backward, communication, decoding), written as a
+ * Chrome trace which chrome://tracing or https://ui.perfetto.dev open:
+ * \code{.cpp}
+   fl::Tracer::start();
+   for (auto& batch : *prefetched) {
+     FL_TRACE(USER, "step");
+     ...
+   }
+   fl::Tracer::stop();
+   fl::Tracer::dump("/tmp/train.trace.json");
+ * \endcode
+ *
+ * Each thread records to its own ring buffer without locks. Scopes of a
+ * category which isn't recorded cost an atomic load.
+ */
+class Tracer {
+ public:
+  /**
+   * Starts recording, dropping the scopes of a previous recording.
+   */
+  static void start(const TraceOptions& options = TraceOptions());
+
+  /**
+   * Stops recording. The recorded scopes are kept until the next `start()`.
+   */
+  static void stop();
+
+  static bool enabled(TraceCategory category) {
+    return detail::traceMask.load(std::memory_order_relaxed) &
+        static_cast<uint32_t>(category);
+  }
+
+  static bool deviceSupported();
+
+  /**
+   * Writes the recorded scopes to `path` as Chrome trace JSON. Threads may
+   * still be recording: the scopes they overwrite during the dump are left
+   * out. Waits for the device events.
+   */
+  static void dump(const std::string& path);
+
+  /**
+   * Names the tracks of the calling thread, e.g. "PrefetchDataset worker".
+   */
+  static void setThreadName(const std::string& name);
+
+  /**
+   * Returns a copy of `name` which lives until the end of the process, for
+   * the names of scopes which aren't literals.
+   */
+  static const char* intern(const std::string& name);
+};
+
+/**
+ * An RAII abstraction recording a scope of `Tracer` from its construction
+ * to its destruction. `name` must outlive the recording: a literal, or
+ * `Tracer::intern()`ed.
+ */
+class ScopedTrace {
+ public:
+  ScopedTrace(TraceCategory category, const char* name)
+      : name_(Tracer::enabled(category) ? name : nullptr),
+        category_(category) {
+    if (name_) {
+      begin();
+    }
+  }
+
+  ~ScopedTrace() {
+    if (name_) {
+      end();
+    }
+  }
+
+  ScopedTrace(const ScopedTrace&) = delete;
+  ScopedTrace& operator=(const ScopedTrace&) = delete;
+
+ private:
+  void begin();
+  void end();
+
+  const char* name_;
+  TraceCategory category_;
+  int64_t beginNs_;
+  int64_t deviceBegin_;
+};
+
+} // namespace fl
+
+// Used to generate a unique name for the expansion
+#define _FL_TRACE_CAT_IMPL(a, b) a##b
+#define _FL_TRACE_CAT(a, b) _FL_TRACE_CAT_IMPL(a, b)
+
+/**
+ * Records the enclosing scope, e.g. `FL_TRACE(DATA, "decode")`.
+ */
+#define FL_TRACE(category, name)                            \
+  fl::ScopedTrace _FL_TRACE_CAT(flScopedTrace, __LINE__)( \
+      fl::TraceCategory::category, name)
@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/common/Trace.h"
+
+namespace fl {
+namespace detail {
+
+// Work isn't queued on a device stream which could be timed apart from the
+// host: scopes are only timed on the host.
+
+bool deviceTraceSupported() {
+  return false;
+}
+
+void deviceTraceReset(int64_t /* maxEvents */) {}
+
+int64_t deviceTraceRecord() {
+  return -1;
+}
+
+bool deviceTraceTime(int64_t /* handle */, int64_t& /* ns */) {
+  return false;
+}
+
+} // namespace detail
+} // namespace fl
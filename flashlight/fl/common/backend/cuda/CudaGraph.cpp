@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/common/backend/cuda/CudaGraph.h"
+
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#include <af/internal.h>
+
+#include "flashlight/fl/common/Logging.h"
+#include "flashlight/fl/common/backend/cuda/CudaUtils.h"
+#include "flashlight/fl/memory/MemoryManagerInstaller.h"
+#include "flashlight/fl/memory/managers/CachingMemoryManager.h"
+
+namespace fl {
+namespace cuda {
+
+namespace {
+
+CachingMemoryManager* cachingMemoryManager() {
+  return dynamic_cast<CachingMemoryManager*>(
+      MemoryManagerInstaller::currentlyInstalledMemoryManager());
+}
+
+bool sameBuffer(const af::array& lhs, const af::array& rhs) {
+  return !lhs.isempty() && !rhs.isempty() &&
+      af::getRawPtr(lhs) == af::getRawPtr(rhs);
+}
+
+// Enqueues the copy of the evaluated `src` to the buffer of `dst`
+void copyBuffer(af::array& dst, const af::array& src, cudaStream_t stream) {
+  if (src.bytes() != dst.bytes() || !af::isLinear(src) ||
+      !af::isLinear(dst)) {
+    throw std::invalid_argument(
+        "CudaGraphStep: arrays bound to a step must keep their shapes and be "
+        "linear");
+  }
+  FL_CUDA_CHECK(cudaMemcpyAsync(
+      static_cast<char*>(af::getRawPtr(dst)) +
+          af::getOffset(dst) * dst.bytes() / dst.elements(),
+      static_cast<const char*>(af::getRawPtr(src)) +
+          af::getOffset(src) * src.bytes() / src.elements(),
+      src.bytes(),
+      cudaMemcpyDeviceToDevice,
+      stream));
+}
+
+} // namespace
+
+CudaGraphStep::CudaGraphStep(
+    std::function<void()> step,
+    std::vector<af::array*> arrays,
+    int numWarmupSteps /* = 2 */,
+    int maxGraphs /* = 8 */)
+    : step_(std::move(step)),
+      arrays_(std::move(arrays)),
+      numWarmupSteps_(numWarmupSteps),
+      maxGraphs_(maxGraphs) {
+  if (!step_) {
+    throw std::invalid_argument("CudaGraphStep: invalid step");
+  }
+  for (auto* array : arrays_) {
+    if (!array) {
+      throw std::invalid_argument("CudaGraphStep: null array");
+    }
+  }
+}
+
+CudaGraphStep::~CudaGraphStep() {
+  for (auto& graph : graphs_) {
+    try {
+      release(*graph.second);
+    } catch (const std::exception& ex) {
+      FL_LOG(fl::ERROR) << "CudaGraphStep: failed to release a graph: "
+                        << ex.what();
+    }
+  }
+}
+
+std::string CudaGraphStep::shapeKey() const {
+  std::ostringstream key;
+  key << af::getDevice();
+  for (const auto* array : arrays_) {
+    auto dims = array->dims();
+    key << ";" << array->type() << ":" << dims[0] << "x" << dims[1] << "x"
+        << dims[2] << "x" << dims[3];
+  }
+  return key.str();
+}
+
+size_t CudaGraphStep::numGraphs() const {
+  size_t count = 0;
+  for (const auto& graph : graphs_) {
+    count += graph.second->exec ? 1 : 0;
+  }
+  return count;
+}
+
+bool CudaGraphStep::run() {
+  auto key = shapeKey();
+  auto it = graphs_.find(key);
+  if (it == graphs_.end()) {
+    if (static_cast<int>(graphs_.size()) >= maxGraphs_) {
+      step_();
+      return false;
+    }
+    it = graphs_.emplace(key, std::make_unique<Graph>()).first;
+    it->second->device = af::getDevice();
+  }
+  auto& graph = *it->second;
+  if (graph.failed || graph.eagerSteps < numWarmupSteps_) {
+    ++graph.eagerSteps;
+    step_();
+    return false;
+  }
+  if (!graph.exec && !capture(graph)) {
+    step_();
+    return false;
+  }
+
+  auto stream = getActiveStream();
+  for (size_t i = 0; i < arrays_.size(); ++i) {
+    auto& buffer = graph.inputs[i];
+    if (!buffer.isempty() && !sameBuffer(*arrays_[i], buffer)) {
+      arrays_[i]->eval();
+      copyBuffer(buffer, *arrays_[i], stream);
+    }
+  }
+  FL_CUDA_CHECK(cudaGraphLaunch(graph.exec, stream));
+  for (size_t i = 0; i < arrays_.size(); ++i) {
+    *arrays_[i] =
+        graph.inputs[i].isempty() ? graph.outputs[i] : graph.inputs[i];
+  }
+  return true;
+}
+
+bool CudaGraphStep::capture(Graph& graph) {
+  auto* manager = cachingMemoryManager();
+  if (!manager) {
+    FL_LOG(fl::WARNING) << "CudaGraphStep: steps are only captured with the "
+                        << "CachingMemoryManager, running eagerly";
+    graph.failed = true;
+    return false;
+  }
+  // Pending work may not be captured
+  for (auto* array : arrays_) {
+    array->eval();
+  }
+  af::sync();
+  graph.inputs.clear();
+  for (auto* array : arrays_) {
+    graph.inputs.push_back(*array);
+  }
+
+  auto stream = getActiveStream();
+  graph.pool = manager->createPrivatePool();
+  manager->beginPrivatePool(graph.pool);
+  bool captured = false;
+  FL_CUDA_CHECK(cudaStreamBeginCapture(stream, cudaStreamCaptureModeRelaxed));
+  try {
+    step_();
+    for (size_t i = 0; i < arrays_.size(); ++i) {
+      arrays_[i]->eval();
+      // The new values of the arrays are read by the next replay
+      if (!graph.inputs[i].isempty() &&
+          !sameBuffer(*arrays_[i], graph.inputs[i])) {
+        copyBuffer(graph.inputs[i], *arrays_[i], stream);
+      }
+    }
+    captured = true;
+  } catch (const std::exception& ex) {
+    FL_LOG(fl::WARNING) << "CudaGraphStep: failed to capture the step, "
+                        << "running eagerly: " << ex.what();
+  }
+  cudaGraph_t cudaGraph = nullptr;
+  auto err = cudaStreamEndCapture(stream, &cudaGraph);
+  manager->endPrivatePool();
+  if (captured && err == cudaSuccess && cudaGraph) {
+    err = cudaGraphInstantiate(&graph.exec, cudaGraph, nullptr, nullptr, 0);
+    captured = (err == cudaSuccess);
+  } else {
+    captured = false;
+  }
+  if (cudaGraph) {
+    cudaGraphDestroy(cudaGraph);
+  }
+
+  if (!captured) {
+    // Clears the error of an invalidated capture
+    cudaGetLastError();
+    graph.exec = nullptr;
+    graph.failed = true;
+  } else {
+    for (auto* array : arrays_) {
+      graph.outputs.push_back(*array);
+    }
+  }
+  // Nothing was computed by the capture
+  for (size_t i = 0; i < arrays_.size(); ++i) {
+    if (!graph.inputs[i].isempty() || !captured) {
+      *arrays_[i] = graph.inputs[i];
+    }
+  }
+  if (!captured) {
+    release(graph);
+  }
+  return captured;
+}
+
+void CudaGraphStep::release(Graph& graph) {
+  int device = af::getDevice();
+  af::setDevice(graph.device);
+  if (graph.exec) {
+    FL_CUDA_CHECK(cudaGraphExecDestroy(graph.exec));
+    graph.exec = nullptr;
+  }
+  graph.inputs.clear();
+  graph.outputs.clear();
+  auto* manager = cachingMemoryManager();
+  if (graph.pool && manager) {
+    manager->releasePrivatePool(graph.pool);
+  }
+  graph.pool = 0;
+  af::setDevice(device);
+}
+
+} // namespace cuda
+} // namespace fl
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <cuda_runtime.h>
+
+#include <arrayfire.h>
+
+namespace fl {
+namespace cuda {
+
+/**
+ * Captures a step of fixed-shape work (forward, backward and optimizer
+ * update of a training step, or an inference step) in a CUDA graph and
+ * replays it, which removes the launch overhead of its kernels. Graphs are
+ * captured per shapes of the arrays of the step: a step with new shapes is
+ * run eagerly for a few warmup steps, then captured; steps which can't be
+ * captured keep running eagerly.
+ *
+ * Replays only run the device work of the step, as enqueued on the ArrayFire
+ * stream while capturing:
+ * - arrays used from one step to the next (inputs, parameters, optimizer
+ *   state, outputs) must be bound to the step. Replays read and write the
+ *   buffers bound arrays had during the capture: new values assigned to the
+ *   arrays between steps are copied to these buffers before a replay, and
+ *   arrays are assigned the buffers written after it. Outputs are
+ *   overwritten by the next replay;
+ * - the step must not synchronize with the host (copies to the host, like
+ *   `scalar()`, or cuDNN benchmarks during the warmup steps only), and its
+ *   host state (e.g. step counters) is the one of the capture.
+ *
+ * The memory of the step is allocated in a private pool of the
+ * `CachingMemoryManager` (see `CachingMemoryManager::createPrivatePool()`),
+ * so that replays find it at the same addresses; steps run eagerly with other
+ * memory managers.
+ *
+ * \code{.cpp}
+ * std::vector<af::array*> arrays = {&input.array(), &target.array(),
+ *                                   &loss.array()};
+ * for (auto& param : model->params()) {
+ *   arrays.push_back(&param.array());
+ * }
+ * fl::cuda::CudaGraphStep step(
+ *     [&]() {
+ *       optimizer.zeroGrad();
+ *       loss = criterion(model->forward(input), target);
+ *       loss.backward();
+ *       optimizer.step();
+ *     },
+ *     arrays);
+ * for (auto& batch : dataset) {
+ *   input.array() = batch[0];
+ *   target.array() = batch[1];
+ *   step.run();
+ * }
+ * \endcode
+ */
+class CudaGraphStep {
+ public:
+  /**
+   * @param step Work of a step
+   * @param arrays Arrays of the step, whose buffers are bound to its graphs
+   * @param numWarmupSteps Steps of the same shapes run eagerly before their
+   * capture
+   * @param maxGraphs Maximum number of graphs (shapes) captured; steps of
+   * other shapes are run eagerly
+   */
+  CudaGraphStep(
+      std::function<void()> step,
+      std::vector<af::array*> arrays,
+      int numWarmupSteps = 2,
+      int maxGraphs = 8);
+  ~CudaGraphStep();
+
+  CudaGraphStep(const CudaGraphStep&) = delete;
+  CudaGraphStep& operator=(const CudaGraphStep&) = delete;
+
+  /**
+   * Runs a step, replaying the graph of the current shapes of the arrays if
+   * captured.
+   *
+   * @return whether the step was replayed
+   */
+  bool run();
+
+  /// Number of graphs captured.
+  size_t numGraphs() const;
+
+ private:
+  // Graph of the step for some shapes
+  struct Graph {
+    int device;
+    int eagerSteps{0};
+    bool failed{false};
+    cudaGraphExec_t exec{nullptr};
+    size_t pool{0};
+    // Buffers of the arrays read by replays, empty for the arrays empty
+    // before the capture (outputs)
+    std::vector<af::array> inputs;
+    // Buffers of the arrays written by replays
+    std::vector<af::array> outputs;
+  };
+
+  std::function<void()> step_;
+  std::vector<af::array*> arrays_;
+  int numWarmupSteps_;
+  int maxGraphs_;
+  std::map<std::string, std::unique_ptr<Graph>> graphs_;
+
+  // Key of the graph of the current shapes of the arrays (and device)
+  std::string shapeKey() const;
+  // Captures the step in `graph`, false if it can't be captured
+  bool capture(Graph& graph);
+  void release(Graph& graph);
+};
+
+} // namespace cuda
+} // namespace fl
@@ -12,6 +12,9 @@
 
 #include <af/device.h>
 
+#include "flashlight/fl/memory/MemoryManagerInstaller.h"
+#include "flashlight/fl/memory/managers/CachingMemoryManager.h"
+
 namespace fl {
 namespace cuda {
 
@@ -28,6 +31,14 @@ void synchronizeStreams(
   FL_CUDA_CHECK(cudaStreamWaitEvent(blockee, event, 0));
 }
 
+void recordStream(const void* ptr, cudaStream_t stream) {
+  auto* manager = dynamic_cast<CachingMemoryManager*>(
+      MemoryManagerInstaller::currentlyInstalledMemoryManager());
+  if (manager) {
+    manager->recordStream(ptr, static_cast<void*>(stream));
+  }
+}
+
 namespace detail {
 
 void check(cudaError_t err, const char* file, int line) {
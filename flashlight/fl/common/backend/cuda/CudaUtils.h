@@ -44,6 +44,15 @@ void synchronizeStreams(
     cudaStream_t blockOn,
     cudaEvent_t event);
 
+/**
+ * Declares that the memory at `ptr`, allocated by the installed memory
+ * manager on the ArrayFire stream, is used by operations enqueued on
+ * `stream`. With the `CachingMemoryManager`, the memory is not reused until
+ * these operations have completed, even once freed by ArrayFire. Does
+ * nothing with other memory managers.
+ */
+void recordStream(const void* ptr, cudaStream_t stream);
+
 namespace detail {
 
 // Flags for CUDA Event creation. Timing creates overhead, so disable.
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/common/Trace.h"
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include <af/device.h>
+
+#include "flashlight/fl/common/backend/cuda/CudaUtils.h"
+
+namespace fl {
+namespace detail {
+
+namespace {
+
+// Handles are the index of the event, and the number of resets in the high
+// bits, so that the handles of a previous recording are rejected
+constexpr int kTraceHandleBits = 32;
+
+struct DeviceTrace {
+  std::mutex mutex;
+  // Reused by the next recordings
+  std::vector<cudaEvent_t> events;
+  int64_t used{0};
+  int64_t maxEvents{0};
+  int64_t resets{0};
+  int device{-1};
+  // Completed at `referenceNs` on the host clock
+  cudaEvent_t reference{nullptr};
+  int64_t referenceNs{0};
+};
+
+// Never destroyed: scopes may be recorded until the end of the process
+DeviceTrace& deviceTrace() {
+  static auto* trace = new DeviceTrace();
+  return *trace;
+}
+
+} // namespace
+
+bool deviceTraceSupported() {
+  return true;
+}
+
+void deviceTraceReset(int64_t maxEvents) {
+  auto& trace = deviceTrace();
+  std::lock_guard<std::mutex> lock(trace.mutex);
+  ++trace.resets;
+  trace.used = 0;
+  trace.maxEvents = std::min<int64_t>(maxEvents, 1LL << kTraceHandleBits);
+  if (trace.device != af::getDevice()) {
+    // Events are timed against a reference of the same device
+    for (auto event : trace.events) {
+      FL_CUDA_CHECK(cudaEventDestroy(event));
+    }
+    trace.events.clear();
+    if (trace.reference) {
+      FL_CUDA_CHECK(cudaEventDestroy(trace.reference));
+    }
+    trace.device = af::getDevice();
+    // Timed events: no cudaEventDisableTiming
+    FL_CUDA_CHECK(cudaEventCreate(&trace.reference));
+  }
+  // Recorded on an idle stream, the reference completes right away
+  auto stream = cuda::getActiveStream();
+  FL_CUDA_CHECK(cudaStreamSynchronize(stream));
+  FL_CUDA_CHECK(cudaEventRecord(trace.reference, stream));
+  FL_CUDA_CHECK(cudaEventSynchronize(trace.reference));
+  trace.referenceNs = traceNowNs();
+}
+
+int64_t deviceTraceRecord() {
+  auto& trace = deviceTrace();
+  std::lock_guard<std::mutex> lock(trace.mutex);
+  if (trace.used >= trace.maxEvents || af::getDevice() != trace.device) {
+    return -1;
+  }
+  if (trace.used == static_cast<int64_t>(trace.events.size())) {
+    cudaEvent_t event;
+    FL_CUDA_CHECK(cudaEventCreate(&event));
+    trace.events.push_back(event);
+  }
+  auto idx = trace.used++;
+  FL_CUDA_CHECK(cudaEventRecord(trace.events[idx], cuda::getActiveStream()));
+  return (trace.resets << kTraceHandleBits) | idx;
+}
+
+bool deviceTraceTime(int64_t handle, int64_t& ns) {
+  auto& trace = deviceTrace();
+  std::lock_guard<std::mutex> lock(trace.mutex);
+  int64_t idx = handle & ((1LL << kTraceHandleBits) - 1);
+  if ((handle >> kTraceHandleBits) != trace.resets || idx >= trace.used) {
+    return false;
+  }
+  float ms;
+  if (cudaEventSynchronize(trace.events[idx]) != cudaSuccess ||
+      cudaEventElapsedTime(&ms, trace.reference, trace.events[idx]) !=
+          cudaSuccess) {
+    return false;
+  }
+  ns = trace.referenceNs + static_cast<int64_t>(ms * 1e6);
+  return true;
+}
+
+} // namespace detail
+} // namespace fl
@@ -12,8 +12,12 @@
 #include "flashlight/fl/common/DevicePtr.h"
 #include "flashlight/fl/common/DynamicBenchmark.h"
 #include "flashlight/fl/common/Init.h"
+#include "flashlight/fl/common/Metrics.h"
+#include "flashlight/fl/common/PinnedHostBuffer.h"
 #include "flashlight/fl/common/Profile.h"
 #include "flashlight/fl/common/Serialization.h"
+#include "flashlight/fl/common/Trace.h"
 #include "flashlight/fl/common/Types.h"
 #include "flashlight/fl/common/Utils.h"
 #include "flashlight/fl/common/threadpool/ThreadPool.h"
+#include "flashlight/fl/common/threadpool/WorkStealingThreadPool.h"
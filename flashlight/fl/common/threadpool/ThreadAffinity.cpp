@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/common/threadpool/ThreadAffinity.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace fl {
+
+namespace {
+
+// Parses a Linux CPU list such as "0-15,32-47"
+std::vector<int> parseCpuList(const std::string& list) {
+  std::vector<int> cpus;
+  std::stringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    if (range.empty() || range == "\n") {
+      continue;
+    }
+    auto dash = range.find('-');
+    int first = std::stoi(range.substr(0, dash));
+    int last =
+        dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+// The allowed CPUs of each NUMA node having some
+std::vector<std::vector<int>> numaNodes(const std::vector<int>& allowed) {
+  std::vector<std::vector<int>> nodes;
+  for (int node = 0;; ++node) {
+    std::ifstream file(
+        "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    if (!file) {
+      break;
+    }
+    std::string list;
+    std::getline(file, list);
+    std::vector<int> cpus;
+    for (int cpu : parseCpuList(list)) {
+      if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end()) {
+        cpus.push_back(cpu);
+      }
+    }
+    if (!cpus.empty()) {
+      nodes.push_back(std::move(cpus));
+    }
+  }
+  if (nodes.empty()) {
+    nodes.push_back(allowed);
+  }
+  return nodes;
+}
+
+} // namespace
+
+ThreadAffinity threadAffinityFromString(const std::string& affinity) {
+  if (affinity == "none") {
+    return ThreadAffinity::None;
+  } else if (affinity == "cpu") {
+    return ThreadAffinity::Cpu;
+  } else if (affinity == "numa") {
+    return ThreadAffinity::NumaNode;
+  }
+  throw std::invalid_argument(
+      "threadAffinityFromString: unknown affinity " + affinity);
+}
+
+namespace detail {
+
+std::vector<int> allowedCpus() {
+  std::vector<int> cpus;
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &set)) {
+        cpus.push_back(cpu);
+      }
+    }
+  }
+#endif
+  return cpus;
+}
+
+std::vector<WorkerPlacement> placeWorkers(
+    ThreadAffinity affinity,
+    size_t numThreads,
+    const std::vector<int>& cpus /* = {} */) {
+  std::vector<WorkerPlacement> placements(numThreads);
+  auto allowed = cpus.empty() ? allowedCpus() : cpus;
+  if (allowed.empty()) {
+    return placements;
+  }
+  if (affinity == ThreadAffinity::None) {
+    if (!cpus.empty()) {
+      for (auto& placement : placements) {
+        placement.cpus = cpus;
+      }
+    }
+    return placements;
+  }
+  auto nodes = numaNodes(allowed);
+  if (affinity == ThreadAffinity::NumaNode) {
+    for (size_t i = 0; i < numThreads; ++i) {
+      placements[i].node = i % nodes.size();
+      placements[i].cpus = nodes[placements[i].node];
+    }
+    return placements;
+  }
+  // The CPUs of the nodes, node after node
+  std::vector<std::pair<int, int>> cpuNodes;
+  for (size_t node = 0; node < nodes.size(); ++node) {
+    for (int cpu : nodes[node]) {
+      cpuNodes.emplace_back(cpu, node);
+    }
+  }
+  for (size_t i = 0; i < numThreads; ++i) {
+    const auto& cpuNode = cpuNodes[i % cpuNodes.size()];
+    placements[i].cpus = {cpuNode.first};
+    placements[i].node = cpuNode.second;
+  }
+  return placements;
+}
+
+bool pinCurrentThread(const std::vector<int>& cpus) {
+  if (cpus.empty()) {
+    return true;
+  }
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus) {
+    CPU_SET(cpu, &set);
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  return false;
+#endif
+}
+
+} // namespace detail
+} // namespace fl
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace fl {
+
+/**
+ * Where the workers of a WorkStealingThreadPool run.
+ */
+enum class ThreadAffinity {
+  // Anywhere, as scheduled by the OS
+  None,
+  // Each worker on one of the CPUs the process may run on, in order
+  Cpu,
+  // Each worker on the CPUs of a NUMA node, the workers spread round-robin
+  // over the nodes
+  NumaNode,
+};
+
+/**
+ * Parses "none", "cpu" or "numa".
+ */
+ThreadAffinity threadAffinityFromString(const std::string& affinity);
+
+namespace detail {
+
+struct WorkerPlacement {
+  // CPUs the worker is pinned to, anywhere if empty
+  std::vector<int> cpus;
+  // NUMA node of the CPUs
+  int node = 0;
+};
+
+/**
+ * Returns the CPUs the calling thread may run on, none without affinity
+ * support.
+ */
+std::vector<int> allowedCpus();
+
+/**
+ * Places `numThreads` workers with `affinity` on `cpus`, the CPUs the calling
+ * thread may run on if empty (see `fl::ThreadBudget` for the CPUs of a pool).
+ * On given `cpus`, workers without affinity run anywhere on them. Without the
+ * sysfs topology of Linux, the system is a single node, and without affinity
+ * support workers aren't pinned.
+ */
+std::vector<WorkerPlacement> placeWorkers(
+    ThreadAffinity affinity,
+    size_t numThreads,
+    const std::vector<int>& cpus = {});
+
+/**
+ * Pins the calling thread to `cpus`, if not empty. Returns false if the
+ * thread can't be pinned, e.g. to CPUs outside of its cgroup.
+ */
+bool pinCurrentThread(const std::vector<int>& cpus);
+
+} // namespace detail
+} // namespace fl
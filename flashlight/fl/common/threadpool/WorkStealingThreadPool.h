@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "flashlight/fl/common/threadpool/ThreadAffinity.h"
+
+namespace fl {
+
+/**
+ * A thread pool where each worker has its own task queue. Tasks are
+ * distributed round-robin over the queues (or pushed to the queue of the
+ * calling worker), and idle workers steal tasks from the back of the other
+ * queues. Compared to ThreadPool, workers do not contend on a single queue,
+ * and a worker stuck on a slow task does not hold the tasks queued behind it.
+ *
+ * Workers can be pinned to CPUs or NUMA nodes (see ThreadAffinity). They then
+ * steal from the workers of their node before the others, so that tasks stay
+ * close to the memory of the worker which enqueued them.
+ *
+ * Basic usage:
+  \code
+    WorkStealingThreadPool pool(4);
+    auto result = pool.enqueue([](int answer) { return answer; }, 42);
+    std::cout << result.get() << std::endl;
+
+    // 16 workers pinned to the nodes of the machine, running 1000 tasks
+    WorkStealingThreadPool numaPool(16, nullptr, ThreadAffinity::NumaNode);
+    auto results = numaPool.enqueueBulk(1000, [](size_t i) { return i * i; });
+  \endcode
+ */
+class WorkStealingThreadPool {
+ public:
+  /**
+   * Launches the workers.
+   * \param [in] threads number of threads
+   * \param [in] initFn initialization code (if any) that will be run on all the
+   * threads
+   * \param [in] affinity where the workers run, pinned before `initFn`
+   * \param [in] cpus the CPUs the workers are placed on (e.g. those of a pool
+   * of the `ThreadBudget`), all the CPUs of the process if empty
+   */
+  WorkStealingThreadPool(
+      size_t threads,
+      const std::function<void(size_t)>& initFn = nullptr,
+      ThreadAffinity affinity = ThreadAffinity::None,
+      const std::vector<int>& cpus = {});
+
+  /**
+   * Adds a new work item to the pool.
+   * \param [in] f function to be executed in threadpool
+   * \param [in] args varadic arguments for the function
+   */
+  template <class F, class... Args>
+  auto enqueue(F&& f, Args&&... args)
+      -> std::future<typename std::result_of<F(Args...)>::type>;
+
+  /**
+   * Adds the tasks `f(0)`, ..., `f(n - 1)`, spread over the queues with a
+   * single lock of each, and wakes all the workers.
+   * \param [in] n number of tasks
+   * \param [in] f function called with the index of each task
+   */
+  template <class F>
+  auto enqueueBulk(size_t n, F&& f)
+      -> std::vector<std::future<typename std::result_of<F(size_t)>::type>>;
+
+  size_t size() const {
+    return workers_.size();
+  }
+
+  /// Runs the remaining tasks and joins all threads.
+  ~WorkStealingThreadPool();
+
+ private:
+  struct WorkQueue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  std::vector<std::unique_ptr<WorkQueue>> queues_;
+  // Queues visited by each worker to pop a task: its own, then those of the
+  // workers of its node, then the others
+  std::vector<std::vector<size_t>> popOrder_;
+  std::vector<std::thread> workers_;
+  std::atomic<size_t> nextQueue_{0};
+
+  // Number of queued tasks, guarded by mutex_. Queue mutexes are taken
+  // inside mutex_ (enqueue) or alone (pop), never the other way around.
+  size_t numTasks_{0};
+  bool stop_{false};
+  std::mutex mutex_;
+  std::condition_variable condition_;
+
+  // Index of the calling worker in the pool it belongs to
+  static size_t& workerIndex() {
+    static thread_local size_t index = -1;
+    return index;
+  }
+  static const WorkStealingThreadPool*& workerPool() {
+    static thread_local const WorkStealingThreadPool* pool = nullptr;
+    return pool;
+  }
+
+  bool popTask(size_t id, std::function<void()>& task);
+};
+
+inline WorkStealingThreadPool::WorkStealingThreadPool(
+    size_t threads,
+    const std::function<void(size_t)>& initFn /* = nullptr */,
+    ThreadAffinity affinity /* = ThreadAffinity::None */,
+    const std::vector<int>& cpus /* = {} */) {
+  if (threads == 0) {
+    throw std::invalid_argument("WorkStealingThreadPool needs a thread");
+  }
+  auto placements = detail::placeWorkers(affinity, threads, cpus);
+  for (size_t id = 0; id < threads; ++id) {
+    queues_.push_back(std::make_unique<WorkQueue>());
+    std::vector<size_t> order;
+    for (bool sameNode : {true, false}) {
+      for (size_t i = 0; i < threads; ++i) {
+        size_t other = (id + i) % threads;
+        if ((placements[other].node == placements[id].node) == sameNode) {
+          order.push_back(other);
+        }
+      }
+    }
+    popOrder_.push_back(std::move(order));
+  }
+  for (size_t id = 0; id < threads; ++id) {
+    auto cpus = placements[id].cpus;
+    workers_.emplace_back([this, initFn, id, cpus] {
+      // Unpinned workers still run, e.g. outside of the cgroup CPUs
+      detail::pinCurrentThread(cpus);
+      workerIndex() = id;
+      workerPool() = this;
+      if (initFn) {
+        initFn(id);
+      }
+      for (;;) {
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          condition_.wait(lock, [this] { return stop_ || numTasks_ > 0; });
+          if (stop_ && numTasks_ == 0) {
+            return;
+          }
+        }
+        std::function<void()> task;
+        if (popTask(id, task)) {
+          task();
+        }
+      }
+    });
+  }
+}
+
+inline bool WorkStealingThreadPool::popTask(
+    size_t id,
+    std::function<void()>& task) {
+  bool found = false;
+  // Own queue first, oldest task first
+  for (size_t i = 0; i < queues_.size() && !found; ++i) {
+    auto& queue = *queues_[popOrder_[id][i]];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+      continue;
+    }
+    if (i == 0) {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+    } else {
+      // Steal the newest task, the owner is about to run the oldest ones
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+    }
+    found = true;
+  }
+  if (found) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    --numTasks_;
+  }
+  // Not found if another worker took the task between the wait and the pop
+  return found;
+}
+
+template <class F, class... Args>
+auto WorkStealingThreadPool::enqueue(F&& f, Args&&... args)
+    -> std::future<typename std::result_of<F(Args...)>::type> {
+  using return_type = typename std::result_of<F(Args...)>::type;
+
+  auto task = std::make_shared<std::packaged_task<return_type()>>(
+      std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+  std::future<return_type> res = task->get_future();
+
+  size_t id = workerPool() == this ? workerIndex()
+                                   : nextQueue_++ % queues_.size();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // don't allow enqueueing after stopping the pool
+    if (stop_) {
+      throw std::runtime_error("enqueue on stopped WorkStealingThreadPool");
+    }
+    {
+      std::lock_guard<std::mutex> queueLock(queues_[id]->mutex);
+      queues_[id]->tasks.emplace_back([task]() { (*task)(); });
+    }
+    // Workers decrement the count under mutex_ after a pop, so it never goes
+    // negative
+    ++numTasks_;
+  }
+  condition_.notify_one();
+  return res;
+}
+
+template <class F>
+auto WorkStealingThreadPool::enqueueBulk(size_t n, F&& f)
+    -> std::vector<std::future<typename std::result_of<F(size_t)>::type>> {
+  using return_type = typename std::result_of<F(size_t)>::type;
+
+  std::vector<std::future<return_type>> res;
+  res.reserve(n);
+  // Spread from the queue of the calling worker, or from the next queue of
+  // the round-robin of enqueue()
+  std::vector<std::vector<std::function<void()>>> queueTasks(queues_.size());
+  size_t first = workerPool() == this ? workerIndex() : nextQueue_.fetch_add(n);
+  for (size_t i = 0; i < n; ++i) {
+    auto task = std::make_shared<std::packaged_task<return_type()>>(
+        std::bind(f, i));
+    res.push_back(task->get_future());
+    queueTasks[(first + i) % queues_.size()].emplace_back(
+        [task]() { (*task)(); });
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stop_) {
+      throw std::runtime_error(
+          "enqueueBulk on stopped WorkStealingThreadPool");
+    }
+    for (size_t id = 0; id < queues_.size(); ++id) {
+      if (queueTasks[id].empty()) {
+        continue;
+      }
+      std::lock_guard<std::mutex> queueLock(queues_[id]->mutex);
+      for (auto& task : queueTasks[id]) {
+        queues_[id]->tasks.emplace_back(std::move(task));
+      }
+    }
+    numTasks_ += n;
+  }
+  condition_.notify_all();
+  return res;
+}
+
+inline WorkStealingThreadPool::~WorkStealingThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  condition_.notify_all();
+  for (std::thread& worker : workers_) {
+    worker.join();
+  }
+}
+
+} // namespace fl
@@ -12,11 +12,41 @@
 
 namespace fl {
 
+namespace {
+
+// Looks up the rows `input` of `weights` of shape [N, D] as columns of shape
+// [D, B], with a sparse gradient for `weights`
+Variable lookupRows(const Variable& input, const Variable& weights) {
+  auto rows = weights.array()(af::flat(input.array()), af::span);
+  auto result = af::transpose(rows);
+  auto weightsDims = weights.dims();
+  auto gradFunc = [weightsDims](
+                      std::vector<Variable>& inputs,
+                      const Variable& gradOutput) {
+    auto& w = inputs[1];
+    if (!w.isCalcGrad()) {
+      return;
+    }
+    w.addGrad(Variable::sparse(
+        af::transpose(gradOutput.array()),
+        af::flat(inputs[0].array()),
+        0,
+        weightsDims));
+  };
+  return Variable(result, {input, weights.withoutData()}, gradFunc);
+}
+
+} // namespace
+
 AdaptiveEmbedding::AdaptiveEmbedding(
     int embeddingDim,
     std::vector<int> cutoff,
-    float divValue /*= 4 */)
-    : embeddingDim_(embeddingDim), cutoff_(cutoff), divValue_(divValue) {
+    float divValue /*= 4 */,
+    bool sparseGrad /* = false */)
+    : embeddingDim_(embeddingDim),
+      cutoff_(cutoff),
+      divValue_(divValue),
+      sparseGrad_(sparseGrad) {
   if (cutoff_.empty()) {
     throw std::invalid_argument("Invalid cutoff for AdaptiveEmbedding");
   }
@@ -54,8 +84,9 @@ Variable AdaptiveEmbedding::forward(const Variable& input) {
 
   af::array headMask = flatInput.array() < cutoff_[0];
   if (af::sum(headMask).scalar<unsigned int>() > 0) {
-    auto headEmbedding =
-        embedding(flatInput(headMask), reorder(params_[0], 1, 0));
+    auto headEmbedding = sparseGrad_
+        ? lookupRows(flatInput(headMask), params_[0])
+        : embedding(flatInput(headMask), reorder(params_[0], 1, 0));
     headEmbedding = matmul(params_[1], headEmbedding);
     indices.push_back(Variable(af::where(headMask), false));
     embeddings.push_back(headEmbedding);
@@ -65,9 +96,10 @@ Variable AdaptiveEmbedding::forward(const Variable& input) {
     af::array tailMask = flatInput.array() < cutoff_[tailIdx] &&
         flatInput.array() >= cutoff_[tailIdx - 1];
     if (af::anyTrue<bool>(tailMask)) {
-      auto tailEmbedding = embedding(
-          flatInput(tailMask) - cutoff_[tailIdx - 1],
-          reorder(params_[tailIdx * 2], 1, 0));
+      auto tailInput = flatInput(tailMask) - cutoff_[tailIdx - 1];
+      auto tailEmbedding = sparseGrad_
+          ? lookupRows(tailInput, params_[tailIdx * 2])
+          : embedding(tailInput, reorder(params_[tailIdx * 2], 1, 0));
       tailEmbedding = matmul(params_[tailIdx * 2 + 1], tailEmbedding);
       indices.push_back(Variable(af::where(tailMask), false));
       embeddings.push_back(tailEmbedding);
@@ -86,6 +118,16 @@ Variable AdaptiveEmbedding::forward(const Variable& input) {
       af::dim4(embeddingDim_, input.dims(0), input.dims(1), input.dims(2)));
 }
 
+void AdaptiveEmbedding::setSparseGrad(bool sparseGrad) {
+  sparseGrad_ = sparseGrad;
+}
+
+void AdaptiveEmbedding::setWeightType(af::dtype type) {
+  for (auto& param : params_) {
+    param.array() = param.array().as(type);
+  }
+}
+
 std::string AdaptiveEmbedding::prettyString() const {
   std::ostringstream ss;
   ss << "AdaptiveEmbedding (dim: " << embeddingDim_ << "), (cutoff: ";
@@ -25,8 +25,14 @@ class AdaptiveEmbedding : public UnaryModule {
   int embeddingDim_;
   std::vector<int> cutoff_;
   float divValue_;
+  bool sparseGrad_{false};
 
-  FL_SAVE_LOAD_WITH_BASE(UnaryModule, embeddingDim_, cutoff_, divValue_)
+  FL_SAVE_LOAD_WITH_BASE(
+      UnaryModule,
+      embeddingDim_,
+      cutoff_,
+      divValue_,
+      fl::versioned(sparseGrad_, 1))
 
  public:
   /**
@@ -44,11 +50,28 @@ class AdaptiveEmbedding : public UnaryModule {
    * assigned to an 'overflow' bucket.
    * @param divValue is the scaling factor for tail groups dimention reduction
    * (see paper https://arxiv.org/pdf/1809.10853.pdf for details).
+   * @param sparseGrad if true, the gradients of the head and tail embeddings
+   * are sparse: they only hold the embeddings looked up (see
+   * `Variable::sparse()`)
    */
   explicit AdaptiveEmbedding(
       int embeddingDim,
       std::vector<int> cutoff,
-      float divValue = 4);
+      float divValue = 4,
+      bool sparseGrad = false);
+
+  /**
+   * Enables or disables sparse gradients, e.g. for a loaded model.
+   */
+  void setSparseGrad(bool sparseGrad);
+
+  /**
+   * Stores the embeddings and the projections in `type`, e.g. f16 to halve
+   * the memory traffic of the lookups; the output is in the same type. The
+   * parameters are cast in place (see `MasterWeightsOptimizer` to keep f32
+   * weights for the updates).
+   */
+  void setWeightType(af::dtype type);
 
   Variable forward(const Variable& input) override;
 
@@ -58,3 +81,4 @@ class AdaptiveEmbedding : public UnaryModule {
 } // namespace fl
 
 CEREAL_REGISTER_TYPE(fl::AdaptiveEmbedding)
+CEREAL_CLASS_VERSION(fl::AdaptiveEmbedding, 1)
@@ -69,7 +69,14 @@ Variable AsymmetricConv1D::forward(const Variable& input) {
   Variable output;
   int cutPx = std::abs(2 * (0.5 - futurePart_)) * px;
   int asymmetryPx = px + cutPx;
-  if (bias_) {
+  if (xStride_ == 1 && !useInt8(input) && useDepthwiseConv1d(input, 0)) {
+    // the padding of the kept frames, rather than cutting the output
+    return futurePart_ > 0.5 ? depthwiseConvolve(input, px - cutPx, px + cutPx)
+                             : depthwiseConvolve(input, px + cutPx, px - cutPx);
+  }
+  if (useInt8(input)) {
+    output = int8Forward(input, asymmetryPx, 0);
+  } else if (bias_) {
     output = conv2d(
         input,
         params_[0],
@@ -101,6 +108,14 @@ Variable AsymmetricConv1D::forward(const Variable& input) {
   return output;
 }
 
+int AsymmetricConv1D::streamingLeftPadding() const {
+  // Left padding of the input once the output is cut, see forward()
+  auto px =
+      fl::derivePadding(xStride_, xFilter_, xStride_, xPad_, xDilation_);
+  int cutPx = std::abs(2 * (0.5 - futurePart_)) * px;
+  return futurePart_ > 0.5 ? px - cutPx : px + cutPx;
+}
+
 std::string AsymmetricConv1D::prettyString() const {
   std::ostringstream ss;
   ss << "AsymmetricConv1D";
@@ -54,6 +54,9 @@ class AsymmetricConv1D : public fl::Conv2D {
 
   std::string prettyString() const override;
 
+ protected:
+  int streamingLeftPadding() const override;
+
  private:
   FL_SAVE_LOAD_WITH_BASE(fl::Conv2D, futurePart_)
   float futurePart_;
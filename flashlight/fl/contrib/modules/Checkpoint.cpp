@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/contrib/modules/Checkpoint.h"
+
+#include <algorithm>
+
+#include "flashlight/fl/autograd/Functions.h"
+
+namespace fl {
+
+namespace {
+
+uintl drawSeed() {
+  return af::randu(1, af::dtype::u64).scalar<uintl>();
+}
+
+// Recomputes the forward pass of `module` from the inputs of a checkpoint and
+// adds the gradients of its inputs and parameters given the gradients of its
+// outputs. `nodeInputs` are the inputs of the checkpoint followed by the
+// parameters of the module.
+void recompute(
+    const std::shared_ptr<Module>& module,
+    uintl seed,
+    std::vector<Variable>& nodeInputs,
+    size_t numInputs,
+    const std::vector<Variable>& outputGrads) {
+  auto resumeSeed = drawSeed();
+  af::setSeed(seed);
+
+  std::vector<Variable> inputs;
+  for (size_t i = 0; i < numInputs; ++i) {
+    inputs.emplace_back(nodeInputs[i].array(), nodeInputs[i].isCalcGrad());
+  }
+  // Leaf copies of the parameters, whose gradients are added to the
+  // parameters once, by the backward pass of the checkpoint
+  auto params = module->params();
+  std::vector<Variable> leafParams;
+  for (int i = 0; i < params.size(); ++i) {
+    leafParams.emplace_back(params[i].array(), params[i].isCalcGrad());
+    module->setParams(leafParams.back(), i);
+  }
+  std::vector<Variable> outputs;
+  try {
+    outputs = module->forward(inputs);
+  } catch (...) {
+    for (int i = 0; i < params.size(); ++i) {
+      module->setParams(params[i], i);
+    }
+    throw;
+  }
+  for (int i = 0; i < params.size(); ++i) {
+    module->setParams(params[i], i);
+  }
+  af::setSeed(resumeSeed);
+
+  // A single backward pass over all outputs, from sum(output * grad)
+  Variable root;
+  for (size_t k = 0; k < outputs.size(); ++k) {
+    if (!outputs[k].isCalcGrad() || outputGrads[k].isempty()) {
+      continue;
+    }
+    if (outputs.size() == 1) {
+      outputs[k].backward(outputGrads[k]);
+      break;
+    }
+    auto dot = sum(flat(outputs[k] * outputGrads[k]), {0}).as(af::dtype::f32);
+    root = root.isempty() ? dot : root + dot;
+  }
+  if (!root.isempty()) {
+    root.backward();
+  }
+
+  for (size_t i = 0; i < numInputs; ++i) {
+    if (inputs[i].isGradAvailable()) {
+      nodeInputs[i].addGrad(inputs[i].grad());
+    }
+  }
+  for (size_t i = 0; i < leafParams.size(); ++i) {
+    if (leafParams[i].isGradAvailable()) {
+      nodeInputs[numInputs + i].addGrad(leafParams[i].grad());
+    }
+  }
+}
+
+} // namespace
+
+std::vector<Variable> Checkpoint::forward(const std::vector<Variable>& inputs) {
+  auto module = modules_[0];
+  auto params = module->params();
+  auto calcGrad = [](const Variable& v) { return v.isCalcGrad(); };
+  if (!train_ ||
+      (std::none_of(inputs.begin(), inputs.end(), calcGrad) &&
+       std::none_of(params.begin(), params.end(), calcGrad))) {
+    return module->forward(inputs);
+  }
+
+  auto seed = drawSeed();
+  af::setSeed(seed);
+  std::vector<af::array> outputs;
+  {
+    std::vector<Variable> detached;
+    for (const auto& input : inputs) {
+      detached.emplace_back(input.array(), false);
+    }
+    // The graph of the module, and its activations, are released at the end
+    // of this scope; the outputs are evaluated so that they don't hold JIT
+    // references to the activations
+    for (auto& output : module->forward(detached)) {
+      outputs.push_back(output.array());
+      outputs.back().eval();
+    }
+  }
+
+  // The outputs of the checkpoint depend on a single node keeping its inputs
+  // (with their data) and the parameters of the module. Each output stores its
+  // gradient, from which the node recomputes the module in the backward pass.
+  auto outputGrads = std::make_shared<std::vector<Variable>>(outputs.size());
+  std::vector<Variable> nodeInputs(inputs.begin(), inputs.end());
+  for (const auto& param : params) {
+    nodeInputs.push_back(param.withoutData());
+  }
+  auto numInputs = inputs.size();
+  auto gradFunc = [module, seed, numInputs, outputGrads](
+                      std::vector<Variable>& nodeInputs,
+                      const Variable& /* unused */) {
+    recompute(module, seed, nodeInputs, numInputs, *outputGrads);
+    for (auto& grad : *outputGrads) {
+      grad = Variable();
+    }
+  };
+  Variable node(af::constant(0, 1), std::move(nodeInputs), gradFunc);
+
+  std::vector<Variable> result;
+  for (size_t k = 0; k < outputs.size(); ++k) {
+    auto outputGradFunc = [k, outputGrads](
+                              std::vector<Variable>& nodeInputs,
+                              const Variable& gradOutput) {
+      (*outputGrads)[k] = gradOutput;
+      // Makes the node run once all the outputs have their gradient
+      nodeInputs[0].addGrad(Variable(af::constant(0, 1), false));
+    };
+    result.emplace_back(
+        outputs[k], std::vector<Variable>{node}, outputGradFunc);
+  }
+  return result;
+}
+
+std::string Checkpoint::prettyString() const {
+  return "Checkpoint (" + modules_[0]->prettyString() + ")";
+}
+
+} // namespace fl
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "flashlight/fl/common/Defines.h"
+#include "flashlight/fl/nn/modules/Container.h"
+
+namespace fl {
+
+/**
+ * Gradient checkpointing (activation recomputation) of a module: in training,
+ * the intermediate activations of the wrapped module are discarded after the
+ * forward pass, and only its inputs and outputs are kept. The forward pass of
+ * the module is recomputed during the backward pass to compute its
+ * gradients, which trades compute for the memory of the activations. This is
+ * typically applied to each block of a deep network:
+ * \code{.cpp}
+ * Sequential model;
+ * for (int i = 0; i < nLayers; ++i) {
+ *   model.add(Checkpoint(std::make_shared<Transformer>(...)));
+ * }
+ * \endcode
+ *
+ * The random state of ArrayFire is seeded before the forward pass of the
+ * module and restored for its recomputation, so that dropout (and layer
+ * drop) masks are the same in both passes. The recomputation reseeds the
+ * random state afterwards with a value drawn before it.
+ *
+ * In evaluation mode, or when no gradient is required, the module is run as
+ * is. Running statistics of the module (`BatchNorm`) are updated by both
+ * passes, so layers with running statistics should not be checkpointed.
+ */
+class Checkpoint : public Container {
+ private:
+  Checkpoint() = default;
+  FL_SAVE_LOAD_WITH_BASE(Container)
+
+ public:
+  /**
+   * @param module The module whose activations are recomputed in the
+   * backward pass
+   */
+  template <typename T>
+  explicit Checkpoint(std::shared_ptr<T> module) {
+    add(module);
+  }
+
+  template <typename T>
+  explicit Checkpoint(const T& module)
+      : Checkpoint(std::make_shared<T>(module)) {}
+
+  std::vector<Variable> forward(const std::vector<Variable>& inputs) override;
+
+  std::string prettyString() const override;
+};
+
+} // namespace fl
+
+CEREAL_REGISTER_TYPE(fl::Checkpoint)
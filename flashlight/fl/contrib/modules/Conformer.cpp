@@ -5,6 +5,10 @@
  * LICENSE file in the root directory of this source tree.
  */
 #include "flashlight/fl/contrib/modules/Conformer.h"
+
+#include <algorithm>
+#include <stdexcept>
+
 #include "flashlight/fl/autograd/Functions.h"
 #include "flashlight/fl/nn/Init.h"
 #include "flashlight/fl/nn/Utils.h"
@@ -115,43 +119,105 @@ Variable Conformer::conformerInitLinear(int32_t inDim, int32_t outDim) {
   return fl::uniform(outDim, inDim, -std, std);
 }
 
+Variable Conformer::feedForward(
+    const Variable& input,
+    const std::shared_ptr<Linear>& w1,
+    const std::shared_ptr<Linear>& w2,
+    const std::shared_ptr<LayerNorm>& norm) {
+  float pDropout = train_ ? pDropout_ : 0.0;
+  return input +
+      dropout(
+             (*w2)(dropout(
+                 fl::swish((*w1)(((*norm)(input)).as(input.type())), 1.),
+                 pDropout)),
+             pDropout);
+}
+
+Variable Conformer::attention(
+    const Variable& q,
+    const Variable& k,
+    const Variable& v,
+    const Variable& padMask,
+    int offset) {
+  float pDropout = train_ ? pDropout_ : 0.0;
+  int bsz = q.dims(2);
+
+  Variable mask, posEmb;
+  if (posEmbContextSize_ > 0) {
+    posEmb = tile(params_[0].as(q.type()), af::dim4(1, 1, nHeads_ * bsz));
+  }
+  auto result = multiheadAttention(
+      q,
+      k,
+      v,
+      posEmb,
+      mask,
+      padMask,
+      nHeads_,
+      pDropout,
+      offset,
+      attentionWindow_);
+  return (*wf_)(transpose(result));
+}
+
 Variable Conformer::mhsa(const Variable& input, const Variable& inputPadMask) {
   float pDropout = train_ ? pDropout_ : 0.0;
-  int bsz = input.dims(2);
 
   auto normedInput = (*normMhsa_)(input);
   auto q = transpose((*wq_)(normedInput));
   auto k = transpose((*wk_)(normedInput));
   auto v = transpose((*wv_)(normedInput));
 
-  Variable mask, posEmb;
-  if (posEmbContextSize_ > 0) {
-    posEmb = tile(params_[0].as(input.type()), af::dim4(1, 1, nHeads_ * bsz));
-  }
   fl::Variable padMask;
   if (!inputPadMask.isempty()) {
     auto padMaskArr = inputPadMask.array();
     padMaskArr = af::resize(padMaskArr, input.dims(1), input.dims(2));
     padMask = fl::Variable(af::log(padMaskArr), false);
   }
-  auto result =
-      multiheadAttention(q, k, v, posEmb, mask, padMask, nHeads_, pDropout, 0);
-  result = (*wf_)(transpose(result));
+  auto result = attention(q, k, v, padMask, 0);
   result = input + dropout(result, pDropout);
   return result;
 }
 
-Variable Conformer::conv(const Variable& input) {
-  float pDropout = train_ ? pDropout_ : 0.0;
+Variable Conformer::mhsaChunk(const Variable& input) {
+  auto normedInput = (*normMhsa_)(input);
+  auto q = transpose((*wq_)(normedInput));
+  auto k = transpose((*wk_)(normedInput));
+  auto v = transpose((*wv_)(normedInput));
+  int offset = streamKeys_.isempty() ? 0 : streamKeys_.dims(0);
+  if (offset > 0) {
+    k = concatenate({streamKeys_, k}, 0);
+    v = concatenate({streamValues_, v}, 0);
+  }
+  // Cache the keys and values of the left context of the next chunk
+  int len = k.dims(0);
+  int leftContext = streamingLeftContext();
+  int keep = leftContext < 0 ? len : std::min(leftContext, len);
+  if (keep > 0) {
+    streamKeys_ = Variable(k.array().rows(len - keep, len - 1), false);
+    streamValues_ = Variable(v.array().rows(len - keep, len - 1), false);
+  } else {
+    streamKeys_ = Variable();
+    streamValues_ = Variable();
+  }
+  return input + attention(q, k, v, Variable(), offset);
+}
+
+Variable Conformer::convDepthWiseInput(const Variable& input) {
   // input C x T x B x 1
   // apply first pointwise conv
   auto result =
       gatedlinearunit((*conv1_)(((*normConv1_)(input)).as(input.type())), 0);
   result = reorder(input, 1, 3, 0, 2);
   // T x 1 x C x B
-  // apply depthwise separable convolutions
-  result = (*convDepthWise_)(result);
-  result = reorder(result, 2, 0, 3, 1);
+  return result;
+}
+
+Variable Conformer::convOutput(
+    const Variable& depthWiseOutput,
+    const Variable& input) {
+  float pDropout = train_ ? pDropout_ : 0.0;
+  auto result = reorder(depthWiseOutput, 2, 0, 3, 1);
   // C x T x B x 1
   result = fl::swish(((*normConv2_)(result)).as(input.type()), 1.);
   // apply second pointwise conv
@@ -159,42 +225,102 @@ Variable Conformer::conv(const Variable& input) {
   return result + input;
 }
 
+Variable Conformer::conv(const Variable& input) {
+  // apply depthwise separable convolutions
+  return convOutput((*convDepthWise_)(convDepthWiseInput(input)), input);
+}
+
 std::vector<Variable> Conformer::forward(const std::vector<Variable>& input) {
   if (input.size() != 2) {
     throw std::invalid_argument(
         "Invalid inputs for conformer block: there should be input "
         "and paddding mask (can be empty Variable)");
   }
-  float pDropout = train_ ? pDropout_ : 0.0;
-  float f = 1.0;
-  if (train_ && (af::randu(1).scalar<float>() < pLayerDropout_)) {
-    f = 0.0;
-  }
   auto x = input[0];
+  if (train_ && dropLayer(pLayerDropout_)) {
+    // The branches of a dropped layer are skipped
+    return {(*norm3_)(x).as(x.type())};
+  }
   // apply first feed-forward module
-  auto ffn1 =
-      x +
-      dropout(
-          (*w12_)(dropout(
-              fl::swish((*w11_)(((*norm1_)(x)).as(x.type())), 1.), pDropout)),
-          pDropout);
-  x = x + f * 0.5 * ffn1;
+  x = x + 0.5 * feedForward(x, w11_, w12_, norm1_);
   // apply multihead attention module
-  x = x + f * mhsa(x, input[1]);
+  x = x + mhsa(x, input[1]);
   // apply conv module
-  x = x + f * conv(x);
+  x = x + conv(x);
   // apply second feed-forward module
-  auto ffn2 =
-      x +
-      dropout(
-          (*w22_)(dropout(
-              fl::swish((*w21_)(((*norm2_)(x)).as(x.type())), 1.), pDropout)),
-          pDropout);
-  x = x + f * 0.5 * ffn2;
-  x = ((*norm3_)(x)).as(x.type());
+  auto ffn2 = feedForward(x, w21_, w22_, norm2_);
+  x = (norm3_->forwardResidual(x, (0.5 * ffn2).as(x.type())))
+          .as(x.type());
   return {x};
 }
 
+std::vector<Variable> Conformer::forwardChunk(
+    const std::vector<Variable>& input) {
+  if (input.empty() || input.size() > 2 ||
+      (input.size() == 2 && !input[1].isempty())) {
+    throw std::invalid_argument(
+        "Conformer::forwardChunk - expects a chunk without padding mask");
+  }
+  auto x = input[0];
+  x = x + 0.5 * feedForward(x, w11_, w12_, norm1_);
+  x = x + mhsaChunk(x);
+  // the output of the depthwise convolution is delayed by its right padding
+  auto convOut = convDepthWise_->forwardChunk({convDepthWiseInput(x)})[0];
+  x = takeStreamFrames(
+      streamResidual_, x, convOut.isempty() ? 0 : convOut.dims(0), 1);
+  if (convOut.isempty()) {
+    return {Variable()};
+  }
+  x = x + convOutput(convOut, x);
+  auto ffn2 = feedForward(x, w21_, w22_, norm2_);
+  x = (norm3_->forwardResidual(x, (0.5 * ffn2).as(x.type()))).as(x.type());
+  return {x};
+}
+
+void Conformer::resetStreamingState() {
+  Container::resetStreamingState();
+  streamKeys_ = Variable();
+  streamValues_ = Variable();
+  streamResidual_ = Variable();
+}
+
+std::vector<Variable> Conformer::streamingState() const {
+  throw std::logic_error("Conformer: streaming states are not supported");
+}
+
+void Conformer::setStreamingState(const std::vector<Variable>& /* state */) {
+  throw std::logic_error("Conformer: streaming states are not supported");
+}
+
+int32_t Conformer::streamingLeftContext() const {
+  if (streamingLeftContext_ >= 0 || posEmbContextSize_ <= 0) {
+    return streamingLeftContext_;
+  }
+  return posEmbContextSize_ - 1;
+}
+
+void Conformer::setStreamingLeftContext(int32_t leftContext) {
+  if (posEmbContextSize_ > 0 &&
+      (leftContext < 0 || leftContext >= posEmbContextSize_)) {
+    throw std::invalid_argument(
+        "Conformer::setStreamingLeftContext - the left context should be "
+        "smaller than posEmbContextSize");
+  }
+  streamingLeftContext_ = leftContext;
+}
+
+void Conformer::setAttentionWindow(const AttentionWindow& window) {
+  if (window.numGlobal < 0) {
+    throw std::invalid_argument(
+        "Conformer::setAttentionWindow - negative number of global tokens");
+  }
+  attentionWindow_ = window;
+}
+
+const AttentionWindow& Conformer::attentionWindow() const {
+  return attentionWindow_;
+}
+
 std::string Conformer::prettyString() const {
   std::ostringstream ss;
   ss << "Conformer "
@@ -205,6 +331,10 @@ std::string Conformer::prettyString() const {
      << "(pLayerDropout: " << pLayerDropout_ << "), "
      << "(posEmbContextSize: " << posEmbContextSize_ << "), "
      << "(convKernelSize: " << convKernelSize_ << ") ";
+  if (!attentionWindow_.isFull()) {
+    ss << "(attentionWindow: " << attentionWindow_.left << ", "
+       << attentionWindow_.right << ", " << attentionWindow_.numGlobal << ") ";
+  }
   return ss.str();
 }
 
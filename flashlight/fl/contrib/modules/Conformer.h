@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include "flashlight/fl/autograd/Functions.h"
 #include "flashlight/fl/nn/modules/Container.h"
 #include "flashlight/fl/nn/modules/Conv2D.h"
 #include "flashlight/fl/nn/modules/LayerNorm.h"
@@ -46,6 +47,49 @@ class Conformer : public Container {
       float pLayerDropout = 0.);
 
   std::vector<Variable> forward(const std::vector<Variable>& input) override;
+
+  /**
+   * Forwards the next chunk of a stream (C x T x B, without padding mask), for
+   * real-time inference: the self-attention attends to the chunk and to the
+   * keys and values cached for the last `streamingLeftContext()` positions,
+   * and the depthwise convolution keeps its last input frames, so that its
+   * output is delayed by its right padding. The cost of a chunk is linear in
+   * its size. Layer drop isn't applied. See `Module::forwardChunk()`.
+   */
+  std::vector<Variable> forwardChunk(
+      const std::vector<Variable>& input) override;
+
+  void resetStreamingState() override;
+
+  /**
+   * Not supported: the cached keys and values have the batch along their
+   * third dimension. Throws.
+   */
+  std::vector<Variable> streamingState() const override;
+
+  void setStreamingState(const std::vector<Variable>& state) override;
+
+  /**
+   * Number of previous positions the self-attention attends to in
+   * `forwardChunk()`: by default, posEmbContextSize - 1, the largest distance
+   * with a positional embedding, and no limit without positional embeddings.
+   */
+  int32_t streamingLeftContext() const;
+
+  /// Sets `streamingLeftContext()`; -1 for no limit.
+  void setStreamingLeftContext(int32_t leftContext);
+
+  /**
+   * Restricts the self-attention to a local window, combined with the
+   * padding mask (see `AttentionWindow`), for long-form inputs: the fused
+   * attention then costs O(T * W) for a window of size W instead of O(T^2).
+   * In `forwardChunk()`, the window applies to the chunk and its cached left
+   * context. Saved with the module.
+   */
+  void setAttentionWindow(const AttentionWindow& window);
+
+  const AttentionWindow& attentionWindow() const;
+
   std::string prettyString() const override;
 
  private:
@@ -54,14 +98,33 @@ class Conformer : public Container {
   int32_t convKernelSize_;
   double pDropout_;
   float pLayerDropout_;
+  AttentionWindow attentionWindow_;
 
   std::shared_ptr<Linear> w11_, w12_, w21_, w22_, wq_, wk_, wv_, wf_, conv1_, conv2_;
   std::shared_ptr<LayerNorm> norm1_, norm2_, normMhsa_, normConv1_, normConv2_,
       norm3_;
   std::shared_ptr<Conv2D> convDepthWise_;
 
+  // Streaming state, see forwardChunk()
+  int32_t streamingLeftContext_{-1};
+  Variable streamKeys_, streamValues_, streamResidual_;
+
   static Variable conformerInitLinear(int32_t inDim, int32_t outDim);
+  Variable feedForward(
+      const Variable& input,
+      const std::shared_ptr<Linear>& w1,
+      const std::shared_ptr<Linear>& w2,
+      const std::shared_ptr<LayerNorm>& norm);
+  Variable attention(
+      const Variable& q,
+      const Variable& k,
+      const Variable& v,
+      const Variable& padMask,
+      int offset);
   Variable mhsa(const Variable& input, const Variable& inputPadMask);
+  Variable mhsaChunk(const Variable& input);
+  Variable convDepthWiseInput(const Variable& input);
+  Variable convOutput(const Variable& depthWiseOutput, const Variable& input);
   Variable conv(const Variable& input);
 
   Conformer() = default;
@@ -89,9 +152,13 @@ class Conformer : public Container {
       pDropout_,
       pLayerDropout_,
       posEmbContextSize_,
-      convKernelSize_)
+      convKernelSize_,
+      fl::versioned(attentionWindow_.left, 1),
+      fl::versioned(attentionWindow_.right, 1),
+      fl::versioned(attentionWindow_.numGlobal, 1))
 };
 
 } // namespace fl
 
 CEREAL_REGISTER_TYPE(fl::Conformer);
+CEREAL_CLASS_VERSION(fl::Conformer, 1)
@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/contrib/modules/Offload.h"
+
+#include <algorithm>
+
+#include "flashlight/fl/autograd/Offload.h"
+
+namespace fl {
+
+std::vector<Variable> Offload::forward(const std::vector<Variable>& inputs) {
+  auto module = modules_[0];
+  auto params = module->params();
+  auto calcGrad = [](const Variable& v) { return v.isCalcGrad(); };
+  if (!train_ ||
+      (std::none_of(inputs.begin(), inputs.end(), calcGrad) &&
+       std::none_of(params.begin(), params.end(), calcGrad))) {
+    return module->forward(inputs);
+  }
+
+  auto outputs = module->forward(inputs);
+  std::vector<Variable> kept(inputs.begin(), inputs.end());
+  kept.insert(kept.end(), params.begin(), params.end());
+  return offloadActivations(outputs, kept, minBytes_);
+}
+
+std::string Offload::prettyString() const {
+  return "Offload (" + modules_[0]->prettyString() + ")";
+}
+
+} // namespace fl
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "flashlight/fl/common/Defines.h"
+#include "flashlight/fl/nn/modules/Container.h"
+
+namespace fl {
+
+/**
+ * Activation offloading of a module: in training, the activations saved by
+ * the wrapped module for the backward pass are copied to pinned host memory
+ * after its forward pass, and released on the device until the backward pass
+ * reaches the module (see `offloadActivations()`). Unlike `Checkpoint`, the
+ * forward pass is not recomputed, which trades host memory and bandwidth for
+ * the device memory of the activations:
+ * \code{.cpp}
+ * Sequential model;
+ * for (int i = 0; i < nLayers; ++i) {
+ *   // Offload the activations of at least 1MB
+ *   model.add(Offload(std::make_shared<Transformer>(...), 1 << 20));
+ * }
+ * \endcode
+ *
+ * The inputs, the outputs and the parameters of the module stay on the
+ * device. In evaluation mode, or when no gradient is required, the module is
+ * run as is.
+ */
+class Offload : public Container {
+ private:
+  Offload() = default;
+  size_t minBytes_{0};
+  FL_SAVE_LOAD_WITH_BASE(Container, minBytes_)
+
+ public:
+  /**
+   * @param module The module whose activations are offloaded
+   * @param minBytes The size from which an activation is offloaded
+   */
+  template <typename T>
+  explicit Offload(std::shared_ptr<T> module, size_t minBytes = 0)
+      : minBytes_(minBytes) {
+    add(module);
+  }
+
+  template <typename T>
+  explicit Offload(const T& module, size_t minBytes = 0)
+      : Offload(std::make_shared<T>(module), minBytes) {}
+
+  std::vector<Variable> forward(const std::vector<Variable>& inputs) override;
+
+  std::string prettyString() const override;
+};
+
+} // namespace fl
+
+CEREAL_REGISTER_TYPE(fl::Offload)
@@ -6,6 +6,7 @@
  */
 
 #include <math.h>
+#include <algorithm>
 #include <sstream>
 #include <stdexcept>
 
@@ -60,7 +61,7 @@ RawWavSpecAugment::RawWavSpecAugment(
 }
 
 void RawWavSpecAugment::precomputeFilters() {
-  if (!lowPassFilters_.empty()) {
+  if (!filterWidths_.empty()) {
     return;
   }
   auto mel2hz = [](float mel) {
@@ -85,6 +86,7 @@ void RawWavSpecAugment::precomputeFilters() {
   }
   transBandKhz[0] = transBandKhz[1];
   ignoredLowPassFilters_ = 0;
+  std::vector<af::array> kernels;
   // compute filters for each frequency point, nMel + 1 low pass filters
   for (int fidx = 0; fidx < cutoff_.size(); fidx++) {
     int width = 2. / (1e-6 + transBandKhz[fidx]);
@@ -92,7 +94,8 @@ void RawWavSpecAugment::precomputeFilters() {
       FL_LOG(fl::INFO) << "RawWavSpecAugment raw wave: frequency "
                        << cutoff_[fidx]
                        << " will be skipped for eval, too large kernel";
-      lowPassFilters_.push_back(nullptr);
+      filterWidths_.push_back(-1);
+      kernels.emplace_back();
       ignoredLowPassFilters_++;
       continue;
     }
@@ -107,24 +110,46 @@ void RawWavSpecAugment::precomputeFilters() {
     kernel = kernel * blackmanWindow;
     // normalize kernel
     kernel = kernel / af::tile(af::sum(kernel), 2 * width + 1);
-    // create low pass filter
-    auto filter = std::make_shared<Conv2D>(
-        Variable(kernel, false), 1, 1, PaddingMode::SAME, 0);
-    filter->eval();
-    lowPassFilters_.push_back(filter);
+    filterWidths_.push_back(width);
+    kernels.push_back(kernel);
   }
-  if (ignoredLowPassFilters_ >= lowPassFilters_.size()) {
+  if (ignoredLowPassFilters_ >= filterWidths_.size()) {
     throw std::invalid_argument(
         "All low pass filters are ignored, too huge kernel for all frequencies");
   }
+  int maxWidth = *std::max_element(filterWidths_.begin(), filterWidths_.end());
+  lowPassKernels_ = af::constant(0, 2 * maxWidth + 1, filterWidths_.size());
+  for (int fidx = 0; fidx < filterWidths_.size(); fidx++) {
+    int width = filterWidths_[fidx];
+    if (width >= 0) {
+      lowPassKernels_(af::seq(maxWidth - width, maxWidth + width), fidx) =
+          kernels[fidx];
+    }
+  }
 }
 
 Variable RawWavSpecAugment::forward(const Variable& input) {
+  return augment(input, af::array());
+}
+
+std::vector<Variable> RawWavSpecAugment::forward(
+    const std::vector<Variable>& inputs) {
+  if (inputs.size() != 1 && inputs.size() != 2) {
+    throw std::invalid_argument(
+        "RawWavSpecAugment expects the input, and optionally its sizes");
+  }
+  return {augment(
+      inputs[0], inputs.size() == 2 ? inputs[1].array() : af::array())};
+}
+
+Variable RawWavSpecAugment::augment(
+    const Variable& input,
+    const af::array& inputSizes) {
   if (input.isCalcGrad()) {
     throw std::invalid_argument(
         "input gradient calculation is not supported for RawWavSpecAugment.");
   }
-  if (lowPassFilters_.empty()) {
+  if (filterWidths_.empty()) {
     throw std::invalid_argument("invalid RawWavSpecAugment, filters are empty");
   }
 
@@ -135,36 +160,77 @@ Variable RawWavSpecAugment::forward(const Variable& input) {
   }
 
   // input is expected T x C x B (mostly C=1)
-  af::dim4 timeView = af::dim4(
-      inputCast.dims(0),
-      inputCast.dims(1) * inputCast.dims(2) * inputCast.dims(3));
-  for (int i = 0; i < numFreqMask_; ++i) {
-    auto low = generateRandomInt(ignoredLowPassFilters_, rawWavNMels_);
-    auto high =
-        generateRandomInt(low, std::min(rawWavNMels_, low + freqMaskF_) + 1);
-    if (high > low) {
-      auto inputForFilter = fl::moddims(output, timeView);
-      auto midLowWav = lowPassFilters_[high]->forward(inputForFilter);
-      auto lowWav = lowPassFilters_[low]->forward(inputForFilter);
-      output = output - fl::moddims(midLowWav - lowWav, inputCast.dims());
+  int numTimeSteps = inputCast.dims(0); // number of time steps
+  int numChannels = inputCast.dims(1);
+  int batchSize = inputCast.dims(2) * inputCast.dims(3);
+  auto lengths =
+      detail::specAugmentLengths(inputSizes, numTimeSteps, batchSize);
+
+  // The masked bins of a sample are merged into bands [low, high), each
+  // removed by the difference of two low pass filters: the band-stop filter
+  // of a sample is delta - sum(lowPass[high] - lowPass[low]), i.e. delta
+  // minus a combination of the low pass filters with coefficients -1 and 1
+  std::vector<float> coefs(filterWidths_.size() * batchSize, 0);
+  int width = -1;
+  for (int b = 0; b < batchSize; ++b) {
+    std::vector<bool> masked(rawWavNMels_ + 1, false);
+    for (int i = 0; i < numFreqMask_; ++i) {
+      auto low = generateRandomInt(ignoredLowPassFilters_, rawWavNMels_);
+      auto high =
+          generateRandomInt(low, std::min(rawWavNMels_, low + freqMaskF_) + 1);
+      std::fill(masked.begin() + low, masked.begin() + high, true);
+    }
+    auto* sampleCoefs = coefs.data() + b * filterWidths_.size();
+    for (int bin = 0; bin < rawWavNMels_; ++bin) {
+      if (masked[bin] && (bin == 0 || !masked[bin - 1])) {
+        sampleCoefs[bin] -= 1;
+        width = std::max(width, filterWidths_[bin]);
+      }
+      if (masked[bin] && !masked[bin + 1]) {
+        sampleCoefs[bin + 1] += 1;
+        width = std::max(width, filterWidths_[bin + 1]);
+      }
     }
   }
+  if (width >= 0) {
+    int maxWidth = (lowPassKernels_.dims(0) - 1) / 2;
+    auto kernels = -af::matmul(
+        lowPassKernels_.rows(maxWidth - width, maxWidth + width),
+        af::array(af::dim4(filterWidths_.size(), batchSize), coefs.data()));
+    kernels.row(width) += 1;
+    // Depthwise convolution, with the kernel of each sample for its channels
+    auto weights = af::moddims(
+        af::tile(
+            af::moddims(kernels, af::dim4(2 * width + 1, 1, batchSize)),
+            1,
+            numChannels),
+        af::dim4(2 * width + 1, 1, 1, numChannels * batchSize));
+    auto filtered = fl::conv2d(
+        fl::moddims(
+            output, af::dim4(numTimeSteps, 1, numChannels * batchSize)),
+        Variable(weights.as(inputCast.type()), false),
+        1,
+        1,
+        width,
+        0,
+        1,
+        1,
+        numChannels * batchSize);
+    output = fl::moddims(filtered, inputCast.dims());
+  }
 
   double replaceVal = (maskStrategy_ == MaskingStrategy::GLOBAL_MEAN)
       ? af::mean<double>(inputCast.array())
       : 0.0;
 
-  auto& opArr = output.array();
-  auto numTimeSteps = inputCast.dims(0); // number of time steps
-  // an upper bound on the time mask
-  int T = std::min(timeMaskT_, static_cast<int>(numTimeSteps * timeMaskP_));
-  if (T > 0) {
-    for (int i = 0; i < numTimeMask_; ++i) {
-      auto t = generateRandomInt(0, T);
-      auto t0 = generateRandomInt(0, numTimeSteps - t);
-      opArr(af::seq(t0, t0 + t), af::span, af::span, af::span) = replaceVal;
-    }
-  }
+  auto timeBounds = detail::specAugmentTimeMasks(
+      eng_, lengths, timeMaskT_, timeMaskP_, numTimeMask_);
+  auto timeMask = af::moddims(
+      detail::specAugmentMask(
+          timeBounds, numTimeMask_, numTimeSteps, 0, batchSize),
+      af::dim4(numTimeSteps, 1, inputCast.dims(2), inputCast.dims(3)));
+  output.array() = af::select(
+      af::tile(timeMask, 1, numChannels), replaceVal, output.array());
   return output;
 }
 
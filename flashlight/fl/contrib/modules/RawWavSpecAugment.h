@@ -9,6 +9,7 @@
 
 #include <random>
 
+#include "flashlight/fl/contrib/modules/SpecAugment.h"
 #include "flashlight/fl/nn/nn.h"
 
 namespace fl {
@@ -29,6 +30,11 @@ namespace fl {
  * is measured in number of input frames: there are sampleRate frames in 1s
  * audio, e.g. 50 frames for time masking of standard specAug corresponds to
  *8000 frames (in case of 16kHz audio) for time masking with raw wave specaug
+ *
+ * Masks are drawn for each sample of the batch. The frequency masks of a
+ * sample are merged into one band-stop filter, and the filters of all
+ * samples are applied by a single depthwise convolution. As for SpecAugment,
+ * the sizes of the samples can be given as a second input.
  **/
 class RawWavSpecAugment : public UnaryModule {
  public:
@@ -53,6 +59,12 @@ class RawWavSpecAugment : public UnaryModule {
       MaskingStrategy mStrategy = MaskingStrategy::ZERO);
 
   Variable forward(const Variable& input) override;
+
+  /**
+   * Forwards {input} or {input, inputSizes}.
+   */
+  std::vector<Variable> forward(const std::vector<Variable>& inputs) override;
+
   std::string prettyString() const override;
 
  private:
@@ -81,13 +93,16 @@ class RawWavSpecAugment : public UnaryModule {
   int maxKernelSize_;
   int ignoredLowPassFilters_;
   std::vector<float> cutoff_;
-  std::vector<std::shared_ptr<Conv2D>> lowPassFilters_;
+  // Half widths of the low pass filters, -1 for the ignored ones
+  std::vector<int> filterWidths_;
+  // Low pass filters (columns), centered and zero-padded to the widest one
+  af::array lowPassKernels_;
 
   int generateRandomInt(int low, int high);
 
   void precomputeFilters();
 
-  af::array lowPassFilter(int freq, af::array wav);
+  Variable augment(const Variable& input, const af::array& inputSizes);
 
   RawWavSpecAugment() = default;
 
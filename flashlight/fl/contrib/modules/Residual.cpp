@@ -78,6 +78,21 @@ std::vector<Variable> Residual::forward(const std::vector<Variable>& inputs) {
 }
 
 Variable Residual::forward(const Variable& input) {
+  return forwardLayers(input, false);
+}
+
+std::vector<Variable> Residual::forwardChunk(
+    const std::vector<Variable>& inputs) {
+  if (inputs.size() != 1) {
+    throw std::invalid_argument("Residual module expects only one input");
+  }
+  return {forwardLayers(inputs[0], true)};
+}
+
+Variable Residual::forwardLayers(const Variable& input, bool chunk) {
+  auto forwardModule = [chunk](Module& module, const Variable& x) {
+    return (chunk ? module.forwardChunk({x}) : module.forward({x})).front();
+  };
   Variable output = input;
   int nLayers = modules_.size() - projectionsIndices_.size();
   std::vector<Variable> outputs(nLayers + 1, Variable());
@@ -93,16 +108,14 @@ Variable Residual::forward(const Variable& input) {
       for (const auto& shortcut : shortcut_[layerIndex]) {
         Variable connectionOut = outputs[shortcut.first];
         if (shortcut.second != -1) {
-          connectionOut = modules_[shortcut.second]
-                              ->forward({outputs[shortcut.first]})
-                              .front();
+          connectionOut = forwardModule(
+              *modules_[shortcut.second], outputs[shortcut.first]);
         }
         output = output + connectionOut.as(output.type());
       }
     }
-    output = modules_[moduleIndex]
-                 ->forward({applyScale(output, layerIndex)})
-                 .front();
+    output = forwardModule(
+        *modules_[moduleIndex], applyScale(output, layerIndex));
     outputs[layerIndex + 1] = output;
     layerIndex++;
     moduleIndex++;
@@ -111,9 +124,8 @@ Variable Residual::forward(const Variable& input) {
     for (const auto& shortcut : shortcut_[nLayers]) {
       Variable connectionOut = outputs[shortcut.first];
       if (shortcut.second != -1) {
-        connectionOut = modules_[shortcut.second]
-                            ->forward({outputs[shortcut.first]})
-                            .front();
+        connectionOut = forwardModule(
+            *modules_[shortcut.second], outputs[shortcut.first]);
       }
       output = output + connectionOut.as(output.type());
     }
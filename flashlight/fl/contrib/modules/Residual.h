@@ -58,6 +58,8 @@ class Residual : public Container {
   void checkShortcut(int fromLayer, int toLayer);
   void processShortcut(int fromLayer, int toLayer, int projectionIndex);
   Variable applyScale(const Variable& input, const int layerIndex);
+  // Forwards the input, or the next chunk of a stream if `chunk`
+  Variable forwardLayers(const Variable& input, bool chunk);
 
   // Maps end -> start
   std::unordered_map<int, std::unordered_map<int, int>> shortcut_;
@@ -134,6 +136,14 @@ class Residual : public Container {
 
   Variable forward(const Variable& input);
 
+  /**
+   * Forwards the next chunk of a stream through the layers and the shortcut
+   * connections, which requires layers without delay (e.g. causal
+   * convolutions). See `Module::forwardChunk()`.
+   */
+  std::vector<Variable> forwardChunk(
+      const std::vector<Variable>& inputs) override;
+
   std::string prettyString() const override;
 };
 
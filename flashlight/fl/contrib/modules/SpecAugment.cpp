@@ -5,6 +5,8 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <algorithm>
+#include <cmath>
 #include <sstream>
 #include <stdexcept>
 
@@ -12,6 +14,87 @@
 
 namespace fl {
 
+namespace detail {
+
+std::vector<int> specAugmentLengths(
+    const af::array& inputSizes,
+    int numFrames,
+    int batchSize) {
+  std::vector<int> lengths(batchSize, numFrames);
+  if (inputSizes.isempty()) {
+    return lengths;
+  }
+  if (inputSizes.elements() != batchSize) {
+    throw std::invalid_argument(
+        "SpecAugment: inputSizes must have one size per sample");
+  }
+  std::vector<float> sizes(batchSize);
+  inputSizes.as(f32).host(sizes.data());
+  float maxSize = *std::max_element(sizes.begin(), sizes.end());
+  if (maxSize <= 0) {
+    return lengths;
+  }
+  for (int b = 0; b < batchSize; ++b) {
+    lengths[b] = std::min(
+        numFrames,
+        static_cast<int>(std::ceil(sizes[b] * numFrames / maxSize)));
+  }
+  return lengths;
+}
+
+std::vector<float> specAugmentTimeMasks(
+    std::mt19937& eng,
+    const std::vector<int>& lengths,
+    int maxWidth,
+    float maxRatio,
+    int numMasks) {
+  std::vector<float> bounds(2 * numMasks * lengths.size(), 0);
+  for (size_t b = 0; b < lengths.size(); ++b) {
+    // an upper bound on the time mask
+    int T = std::min(maxWidth, static_cast<int>(lengths[b] * maxRatio));
+    if (T <= 0) {
+      continue;
+    }
+    for (int i = 0; i < numMasks; ++i) {
+      auto t = std::uniform_int_distribution<int>(0, T - 1)(eng);
+      auto t0 = std::uniform_int_distribution<int>(0, lengths[b] - t - 1)(eng);
+      bounds[2 * (numMasks * b + i)] = t0;
+      bounds[2 * (numMasks * b + i) + 1] = t0 + t + 1;
+    }
+  }
+  return bounds;
+}
+
+af::array specAugmentMask(
+    const std::vector<float>& bounds,
+    int numMasks,
+    int size,
+    int dim,
+    int batchSize) {
+  af::dim4 dims(1);
+  dims[dim] = size;
+  auto positions = af::iota(dims, af::dim4(1, 1, 1, batchSize));
+  af::dim4 boundDims(1, 1, 1, batchSize);
+  af::dim4 tileDims(1);
+  tileDims[dim] = size;
+  dims[3] = batchSize;
+  auto mask = af::constant(0, dims, b8);
+  if (numMasks == 0) {
+    return mask;
+  }
+  af::array boundsArr(af::dim4(2 * numMasks, batchSize), bounds.data());
+  for (int i = 0; i < numMasks; ++i) {
+    auto begin = af::moddims(boundsArr.row(2 * i), boundDims);
+    auto end = af::moddims(boundsArr.row(2 * i + 1), boundDims);
+    mask = mask ||
+        (positions >= af::tile(begin, tileDims) &&
+         positions < af::tile(end, tileDims));
+  }
+  return mask;
+}
+
+} // namespace detail
+
 SpecAugment::SpecAugment(
     int tWarpW,
     int fMaskF,
@@ -39,6 +122,22 @@ SpecAugment::SpecAugment(
 }
 
 Variable SpecAugment::forward(const Variable& input) {
+  return augment(input, af::array());
+}
+
+std::vector<Variable> SpecAugment::forward(
+    const std::vector<Variable>& inputs) {
+  if (inputs.size() != 1 && inputs.size() != 2) {
+    throw std::invalid_argument(
+        "SpecAugment expects the input, and optionally its sizes");
+  }
+  return {augment(
+      inputs[0], inputs.size() == 2 ? inputs[1].array() : af::array())};
+}
+
+Variable SpecAugment::augment(
+    const Variable& input,
+    const af::array& inputSizes) {
   if (input.isCalcGrad()) {
     throw std::invalid_argument(
         "input gradient calculation is not supported for SpecAugment.");
@@ -49,8 +148,6 @@ Variable SpecAugment::forward(const Variable& input) {
     return output;
   }
 
-  auto& opArr = output.array();
-
   double replaceVal = (maskStrategy_ == MaskingStrategy::GLOBAL_MEAN)
       ? af::mean<double>(input.array())
       : 0.0;
@@ -59,22 +156,33 @@ Variable SpecAugment::forward(const Variable& input) {
   if (numFreqChans < freqMaskF_) {
     throw std::runtime_error("Invalid input frequency channels");
   }
-  for (int i = 0; i < numFreqMask_; ++i) {
-    auto f = generateRandomInt(0, freqMaskF_);
-    auto f0 = generateRandomInt(0, numFreqChans - f);
-    opArr(af::span, af::seq(f0, f0 + f), af::span, af::span) = replaceVal;
-  }
-
   auto numTimeSteps = input.dims(0); // number of time steps
-  // an upper bound on the time mask
-  int T = std::min(timeMaskT_, static_cast<int>(numTimeSteps * timeMaskP_));
-  if (T > 0) {
-    for (int i = 0; i < numTimeMask_; ++i) {
-      auto t = generateRandomInt(0, T);
-      auto t0 = generateRandomInt(0, numTimeSteps - t);
-      opArr(af::seq(t0, t0 + t), af::span, af::span, af::span) = replaceVal;
+  int batchSize = input.dims(3);
+  auto lengths =
+      detail::specAugmentLengths(inputSizes, numTimeSteps, batchSize);
+
+  // Masks of all samples are drawn at once, and applied by a single
+  // element-wise kernel
+  std::vector<float> freqBounds(2 * numFreqMask_ * batchSize);
+  for (int b = 0; b < batchSize; ++b) {
+    for (int i = 0; i < numFreqMask_; ++i) {
+      auto f = generateRandomInt(0, freqMaskF_);
+      auto f0 = generateRandomInt(0, numFreqChans - f);
+      freqBounds[2 * (numFreqMask_ * b + i)] = f0;
+      freqBounds[2 * (numFreqMask_ * b + i) + 1] = f0 + f + 1;
     }
   }
+  auto timeBounds = detail::specAugmentTimeMasks(
+      eng_, lengths, timeMaskT_, timeMaskP_, numTimeMask_);
+  auto freqMask =
+      detail::specAugmentMask(
+      freqBounds, numFreqMask_, numFreqChans, 1, batchSize);
+  auto timeMask =
+      detail::specAugmentMask(
+      timeBounds, numTimeMask_, numTimeSteps, 0, batchSize);
+  auto mask = af::tile(freqMask, numTimeSteps, 1, input.dims(2)) ||
+      af::tile(timeMask, 1, numFreqChans, input.dims(2));
+  output.array() = af::select(mask, replaceVal, input.array());
 
   return output;
 }
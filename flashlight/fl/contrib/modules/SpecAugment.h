@@ -13,6 +13,46 @@
 
 namespace fl {
 
+namespace detail {
+
+/**
+ * Lengths (in frames) of the samples of a batch of `numFrames` frames, given
+ * their sizes `inputSizes` (1 x `batchSize`) in any unit, e.g. durations: the
+ * longest sample spans the `numFrames` frames. If `inputSizes` is empty, all
+ * samples span the `numFrames` frames.
+ */
+std::vector<int> specAugmentLengths(
+    const af::array& inputSizes,
+    int numFrames,
+    int batchSize);
+
+/**
+ * Draws the bounds of `numMasks` time masks for each sample of length
+ * `lengths[b]`, of at most min(`maxWidth`, `maxRatio` * length) frames.
+ * Returns the flattened 2 * `numMasks` x batch matrix of [begin, end) bounds.
+ */
+std::vector<float> specAugmentTimeMasks(
+    std::mt19937& eng,
+    const std::vector<int>& lengths,
+    int maxWidth,
+    float maxRatio,
+    int numMasks);
+
+/**
+ * Mask of dimension `size` along `dim` and `batchSize` along dimension 3,
+ * true inside the intervals given by `bounds` (2 * `numMasks` x `batchSize`,
+ * as returned by `specAugmentTimeMasks`). The mask is built with element-wise
+ * operations, which are fused (JIT) by ArrayFire.
+ */
+af::array specAugmentMask(
+    const std::vector<float>& bounds,
+    int numMasks,
+    int size,
+    int dim,
+    int batchSize);
+
+} // namespace detail
+
 /**
  * Implementation of SpecAugment: A Simple Data Augmentation Method
  * for Automatic Speech Recognition - https://arxiv.org/pdf/1904.08779.pdf
@@ -25,6 +65,11 @@ namespace fl {
  * LibriSpeech double (LD)   80        27        2     100       1.0       2
  * Switchboard mild (SM)     40        15        2      70       0.2       2
  * Switchboard strong (SS)   40        27        2      70       0.2       2
+ *
+ * The input is T x F x C x B. Masks are drawn for each sample of the batch,
+ * and applied to the whole batch at once. The sizes of the samples (1 x B,
+ * e.g. their durations) can be given as a second input, so that time masks
+ * stay within the unpadded frames of each sample.
  **/
 class SpecAugment : public UnaryModule {
  public:
@@ -45,6 +90,11 @@ class SpecAugment : public UnaryModule {
 
   Variable forward(const Variable& input) override;
 
+  /**
+   * Forwards {input} or {input, inputSizes}.
+   */
+  std::vector<Variable> forward(const std::vector<Variable>& inputs) override;
+
   FL_SAVE_LOAD_WITH_BASE(
       UnaryModule,
       timeWarpW_,
@@ -78,6 +128,8 @@ class SpecAugment : public UnaryModule {
 
   int generateRandomInt(int low, int high);
 
+  Variable augment(const Variable& input, const af::array& inputSizes);
+
   SpecAugment() = default;
 };
 
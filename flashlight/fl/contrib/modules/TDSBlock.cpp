@@ -68,11 +68,46 @@ TDSBlock::TDSBlock(
 }
 
 std::vector<Variable> TDSBlock::forward(const std::vector<Variable>& inputs) {
+  // The residual connections are added in the kernels of the layer norms
+  auto norm1 = std::dynamic_pointer_cast<LayerNorm>(module(1));
+  auto norm2 = std::dynamic_pointer_cast<LayerNorm>(module(3));
   auto out = inputs[0];
-  out = module(0)->forward({out})[0] + out;
-  out = module(1)->forward({out})[0];
-  out = module(2)->forward({out})[0] + out;
-  return module(3)->forward({out});
+  out = norm1->forwardResidual(module(0)->forward({out})[0], out);
+  return {norm2->forwardResidual(module(2)->forward({out})[0], out)};
+}
+
+std::vector<Variable> TDSBlock::forwardChunk(
+    const std::vector<Variable>& inputs) {
+  auto conv = module(0)->forwardChunk({inputs[0]})[0];
+  auto out = takeStreamFrames(
+      streamResidual_, inputs[0], conv.isempty() ? 0 : conv.dims(0));
+  if (conv.isempty()) {
+    return {Variable()};
+  }
+  out = conv + out;
+  out = module(1)->forwardChunk({out})[0];
+  out = module(2)->forwardChunk({out})[0] + out;
+  return module(3)->forwardChunk({out});
+}
+
+void TDSBlock::resetStreamingState() {
+  Container::resetStreamingState();
+  streamResidual_ = Variable();
+}
+
+std::vector<Variable> TDSBlock::streamingState() const {
+  auto state = Container::streamingState();
+  state.push_back(streamResidual_);
+  return state;
+}
+
+void TDSBlock::setStreamingState(const std::vector<Variable>& state) {
+  if (state.empty()) {
+    throw std::invalid_argument("TDSBlock: invalid streaming state");
+  }
+  Container::setStreamingState(
+      std::vector<Variable>(state.begin(), state.end() - 1));
+  streamResidual_ = state.back();
 }
 
 std::string TDSBlock::prettyString() const {
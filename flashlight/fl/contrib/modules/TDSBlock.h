@@ -56,7 +56,29 @@ class TDSBlock : public Container {
       bool lNormIncludeTime = true);
 
   std::vector<Variable> forward(const std::vector<Variable>& inputs) override;
+
+  /**
+   * Forwards the next chunk of a stream: the convolution keeps the last input
+   * frames, and its output is delayed by its right padding. Outputs match
+   * `forward()` on the whole stream with `lNormIncludeTime = false`; with
+   * the time dimension included, statistics are computed over each chunk.
+   * See `Module::forwardChunk()`.
+   */
+  std::vector<Variable> forwardChunk(
+      const std::vector<Variable>& inputs) override;
+
+  void resetStreamingState() override;
+
+  /// The states of the modules, then the frames kept for the residual
+  std::vector<Variable> streamingState() const override;
+
+  void setStreamingState(const std::vector<Variable>& state) override;
+
   std::string prettyString() const override;
+
+ private:
+  // Input frames waiting for the delayed output of the convolution
+  Variable streamResidual_;
 };
 
 } // namespace fl
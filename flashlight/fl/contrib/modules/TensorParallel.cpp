@@ -0,0 +1,304 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/contrib/modules/TensorParallel.h"
+
+#include <cmath>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "flashlight/fl/autograd/Functions.h"
+
+namespace fl {
+
+namespace {
+
+// The part of the current process of the first dimension
+af::array sliceFeatures(const af::array& arr, const DistributedGroup& group) {
+  dim_t n = arr.dims(0) / group.size;
+  return arr(af::seq(group.rank * n, (group.rank + 1) * n - 1), af::span);
+}
+
+// The arrays of the processes of the group, concatenated along the first
+// dimension
+af::array gatherFeatures(const af::array& arr, const DistributedGroup& group) {
+  af::array gathered;
+  allGather(arr, gathered, group);
+  auto dims = arr.dims();
+  gathered = af::moddims(
+      gathered, af::dim4(dims[0], dims[1] * dims[2] * dims[3], group.size));
+  gathered = af::reorder(gathered, 0, 2, 1);
+  return af::moddims(
+      gathered, af::dim4(dims[0] * group.size, dims[1], dims[2], dims[3]));
+}
+
+// Gives all the processes of the group the array of its first process
+void shareFromFirst(af::array& arr, const DistributedGroup& group) {
+  if (group.size <= 1) {
+    return;
+  }
+  if (group.rank != 0) {
+    arr = af::constant(0, arr.dims(), arr.type());
+  }
+  allReduce(arr, group);
+}
+
+void checkDivisible(dim_t size, const DistributedGroup& group, const char* m) {
+  if (size % group.size != 0) {
+    throw std::invalid_argument(
+        std::string(m) + ": size " + std::to_string(size) +
+        " not divisible by the group size " + std::to_string(group.size));
+  }
+}
+
+Linear columnPart(const Linear& full, const DistributedGroup& group) {
+  auto weight = full.param(0).array();
+  checkDivisible(weight.dims(0), group, "ColumnParallelLinear");
+  auto w = Variable(sliceFeatures(weight, group), true);
+  if (full.params().size() < 2) {
+    return Linear(w);
+  }
+  return Linear(w, Variable(sliceFeatures(full.param(1).array(), group), true));
+}
+
+Linear rowPart(const Linear& full, const DistributedGroup& group) {
+  auto weight = full.param(0).array();
+  checkDivisible(weight.dims(1), group, "RowParallelLinear");
+  dim_t n = weight.dims(1) / group.size;
+  auto w = Variable(
+      weight(af::span, af::seq(group.rank * n, (group.rank + 1) * n - 1)),
+      true);
+  if (full.params().size() < 2) {
+    return Linear(w);
+  }
+  return Linear(w, Variable(full.param(1).array().copy(), true));
+}
+
+} // namespace
+
+Variable copyToGroup(const Variable& input, const DistributedGroup& group) {
+  if (group.size <= 1) {
+    return input;
+  }
+  auto gradFunc = [group](
+                      std::vector<Variable>& inputs,
+                      const Variable& gradOutput) {
+    // Summed in place
+    auto grad = gradOutput.array().copy();
+    allReduce(grad, group);
+    inputs[0].addGrad(Variable(grad, false));
+  };
+  return Variable(input.array(), {input.withoutData()}, gradFunc);
+}
+
+Variable reduceFromGroup(const Variable& input, const DistributedGroup& group) {
+  if (group.size <= 1) {
+    return input;
+  }
+  auto result = input.array().copy();
+  allReduce(result, group);
+  auto gradFunc = [](std::vector<Variable>& inputs,
+                     const Variable& gradOutput) {
+    inputs[0].addGrad(gradOutput);
+  };
+  return Variable(result, {input.withoutData()}, gradFunc);
+}
+
+Variable gatherFromGroup(const Variable& input, const DistributedGroup& group) {
+  if (group.size <= 1) {
+    return input;
+  }
+  auto gradFunc = [group](
+                      std::vector<Variable>& inputs,
+                      const Variable& gradOutput) {
+    inputs[0].addGrad(
+        Variable(sliceFeatures(gradOutput.array(), group), false));
+  };
+  return Variable(
+      gatherFeatures(input.array(), group), {input.withoutData()}, gradFunc);
+}
+
+Variable scatterToGroup(const Variable& input, const DistributedGroup& group) {
+  if (group.size <= 1) {
+    return input;
+  }
+  checkDivisible(input.dims(0), group, "scatterToGroup");
+  auto gradFunc = [group](
+                      std::vector<Variable>& inputs,
+                      const Variable& gradOutput) {
+    inputs[0].addGrad(
+        Variable(gatherFeatures(gradOutput.array(), group), false));
+  };
+  return Variable(
+      sliceFeatures(input.array(), group), {input.withoutData()}, gradFunc);
+}
+
+ColumnParallelLinear::ColumnParallelLinear(
+    int inputSize,
+    int outputSize,
+    const DistributedGroup& group,
+    bool bias /* = true */,
+    bool gatherOutput /* = false */)
+    : Linear(inputSize, outputSize / group.size, bias),
+      group_(group),
+      gatherOutput_(gatherOutput) {
+  checkDivisible(outputSize, group, "ColumnParallelLinear");
+}
+
+ColumnParallelLinear::ColumnParallelLinear(
+    const Linear& full,
+    const DistributedGroup& group,
+    bool gatherOutput /* = false */)
+    : Linear(columnPart(full, group)),
+      group_(group),
+      gatherOutput_(gatherOutput) {}
+
+Variable ColumnParallelLinear::forward(const Variable& input) {
+  return forwardActivation(input, LinearActivation::NONE);
+}
+
+Variable ColumnParallelLinear::forwardActivation(
+    const Variable& input,
+    LinearActivation activation) {
+  auto output =
+      Linear::forwardActivation(copyToGroup(input, group_), activation);
+  return gatherOutput_ ? gatherFromGroup(output, group_) : output;
+}
+
+std::string ColumnParallelLinear::prettyString() const {
+  std::ostringstream ss;
+  ss << "ColumnParallelLinear (part " << group_.rank << " of " << group_.size
+     << "): " << Linear::prettyString();
+  if (gatherOutput_) {
+    ss << " (gathered output)";
+  }
+  return ss.str();
+}
+
+RowParallelLinear::RowParallelLinear(
+    int inputSize,
+    int outputSize,
+    const DistributedGroup& group,
+    bool bias /* = true */,
+    bool inputIsParallel /* = true */)
+    : Linear(inputSize / group.size, outputSize, bias),
+      group_(group),
+      inputIsParallel_(inputIsParallel) {
+  checkDivisible(inputSize, group, "RowParallelLinear");
+  // The initialization of `Linear` scales with the fan-in of the whole layer
+  double scale = 1.0 / std::sqrt(static_cast<double>(group.size));
+  for (auto& param : params_) {
+    param.array() = param.array() * scale;
+  }
+  if (bias) {
+    shareFromFirst(params_[1].array(), group_);
+  }
+}
+
+RowParallelLinear::RowParallelLinear(
+    const Linear& full,
+    const DistributedGroup& group,
+    bool inputIsParallel /* = true */)
+    : Linear(rowPart(full, group)),
+      group_(group),
+      inputIsParallel_(inputIsParallel) {}
+
+Variable RowParallelLinear::forward(const Variable& input) {
+  auto x = inputIsParallel_ ? input : scatterToGroup(input, group_);
+  auto output = reduceFromGroup(linear(x, params_[0].as(x.type())), group_);
+  if (params_.size() > 1) {
+    // Added once, to the sum
+    output = output + tileAs(params_[1].as(output.type()), output);
+  }
+  return output;
+}
+
+Variable RowParallelLinear::forwardActivation(
+    const Variable& input,
+    LinearActivation activation) {
+  return activate(forward(input), activation);
+}
+
+std::string RowParallelLinear::prettyString() const {
+  std::ostringstream ss;
+  ss << "RowParallelLinear (part " << group_.rank << " of " << group_.size
+     << "): " << Linear::prettyString();
+  if (!inputIsParallel_) {
+    ss << " (scattered input)";
+  }
+  return ss.str();
+}
+
+TensorParallelTransformer::TensorParallelTransformer(
+    int32_t modelDim,
+    int32_t headDim,
+    int32_t mlpDim,
+    int32_t nHeads,
+    int32_t bptt,
+    float pDropout,
+    float pLayerdrop,
+    const DistributedGroup& group,
+    bool useMask /* = false */,
+    bool preLN /* = false */)
+    : Transformer(
+          modelDim,
+          headDim,
+          mlpDim,
+          nHeads,
+          bptt,
+          pDropout,
+          pLayerdrop,
+          useMask,
+          preLN),
+      group_(group) {
+  checkDivisible(nHeads, group, "TensorParallelTransformer");
+  checkDivisible(mlpDim, group, "TensorParallelTransformer");
+  // The features of the first layer of each block are split, then the inputs
+  // of the second one, which sums the outputs over the group
+  w1_ = std::make_shared<ColumnParallelLinear>(*w1_, group);
+  w2_ = std::make_shared<RowParallelLinear>(*w2_, group);
+  wq_ = std::make_shared<ColumnParallelLinear>(*wq_, group);
+  wk_ = std::make_shared<ColumnParallelLinear>(*wk_, group);
+  wv_ = std::make_shared<ColumnParallelLinear>(*wv_, group);
+  wf_ = std::make_shared<RowParallelLinear>(*wf_, group);
+  // In the order of the modules of `Transformer`
+  std::vector<std::shared_ptr<Linear>> layers = {w1_, w2_, wq_, wk_, wv_, wf_};
+  for (size_t i = 0; i < layers.size(); ++i) {
+    setModule(i, layers[i]);
+  }
+  nHeads_ /= group.size;
+  if (bptt > 0) {
+    shareFromFirst(params_[0].array(), group_);
+  }
+}
+
+void TensorParallelTransformer::setGroup(const DistributedGroup& group) {
+  group_ = group;
+  for (const auto& layer : {w1_, wq_, wk_, wv_}) {
+    std::static_pointer_cast<ColumnParallelLinear>(layer)->setGroup(group);
+  }
+  for (const auto& layer : {w2_, wf_}) {
+    std::static_pointer_cast<RowParallelLinear>(layer)->setGroup(group);
+  }
+}
+
+Variable TensorParallelTransformer::positionEmbedding() {
+  // Shared by the heads of all the processes
+  return copyToGroup(params_[0], group_);
+}
+
+std::string TensorParallelTransformer::prettyString() const {
+  std::ostringstream ss;
+  ss << "TensorParallelTransformer (part " << group_.rank << " of "
+     << group_.size << "): " << Transformer::prettyString();
+  return ss.str();
+}
+
+} // namespace fl
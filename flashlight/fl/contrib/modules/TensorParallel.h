@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "flashlight/fl/contrib/modules/Transformer.h"
+#include "flashlight/fl/distributed/DistributedApi.h"
+#include "flashlight/fl/nn/modules/Linear.h"
+
+namespace fl {
+
+/**
+ * \defgroup tensor_parallel Tensor Parallelism
+ * Intra-layer model parallelism (see [Shoeybi et al
+ * (2019)](https://arxiv.org/abs/1909.08053)): the weights of a layer are
+ * split between the processes of a `DistributedGroup`, which compute their
+ * part of the output, and synchronize the activations or their gradients with
+ * collectives over the group. A column-parallel layer followed by a
+ * row-parallel layer (e.g. the feed-forward network of a transformer) needs a
+ * single allreduce in the forward pass, and one in the backward pass.
+ *
+ * These require a distributed build; the processes of a group must run the
+ * same layers in the same order.
+ * @{
+ */
+
+/**
+ * Identity in the forward pass; sums the gradient over the processes of
+ * `group` in the backward pass. Used on the input of a column-parallel layer,
+ * which every process of the group uses.
+ */
+Variable copyToGroup(const Variable& input, const DistributedGroup& group);
+
+/**
+ * Sums the input over the processes of `group` in the forward pass; identity
+ * in the backward pass. Used on the output of a row-parallel layer.
+ */
+Variable reduceFromGroup(const Variable& input, const DistributedGroup& group);
+
+/**
+ * Concatenates the inputs of the processes of `group` along the first
+ * dimension, by rank in the group; the backward pass keeps the gradient of
+ * the part of the current process.
+ */
+Variable gatherFromGroup(const Variable& input, const DistributedGroup& group);
+
+/**
+ * Keeps the part of the current process of the first dimension of the input,
+ * which must be divisible by the group size; the backward pass gathers the
+ * gradients of the parts from the processes of `group`.
+ */
+Variable scatterToGroup(const Variable& input, const DistributedGroup& group);
+
+/**
+ * A `Linear` layer whose output features are split between the processes of
+ * a group: each process holds `outputSize / group.size` rows of the weight
+ * (and of the bias), and computes the matching features of the output.
+ *
+ * The group isn't serialized: after loading a layer, set it with `setGroup`.
+ */
+class ColumnParallelLinear : public Linear {
+ public:
+  /**
+   * @param inputSize the size of each input sample
+   * @param outputSize the size of the output samples of the whole layer,
+   * divisible by the group size
+   * @param group the processes between which the layer is split
+   * @param bias whether the layer includes a bias term
+   * @param gatherOutput whether to gather the output features of all the
+   * processes, rather than output those of the current process
+   */
+  ColumnParallelLinear(
+      int inputSize,
+      int outputSize,
+      const DistributedGroup& group,
+      bool bias = true,
+      bool gatherOutput = false);
+
+  /**
+   * The part of the current process of the layer `full`, e.g. a layer built
+   * by all the processes of the group from the same seed.
+   */
+  ColumnParallelLinear(
+      const Linear& full,
+      const DistributedGroup& group,
+      bool gatherOutput = false);
+
+  Variable forward(const Variable& input) override;
+
+  /// The activation of the output features of the current process is fused
+  Variable forwardActivation(
+      const Variable& input,
+      LinearActivation activation) override;
+
+  const DistributedGroup& group() const {
+    return group_;
+  }
+
+  void setGroup(const DistributedGroup& group) {
+    group_ = group;
+  }
+
+  std::string prettyString() const override;
+
+ private:
+  ColumnParallelLinear() = default;
+
+  DistributedGroup group_;
+  bool gatherOutput_{false};
+
+  FL_SAVE_LOAD_WITH_BASE(Linear, gatherOutput_)
+};
+
+/**
+ * A `Linear` layer whose input features are split between the processes of a
+ * group: each process holds `inputSize / group.size` columns of the weight,
+ * and the outputs of the processes are summed over the group. The bias,
+ * added to the sum, is the same on all the processes.
+ *
+ * The group isn't serialized: after loading a layer, set it with `setGroup`.
+ */
+class RowParallelLinear : public Linear {
+ public:
+  /**
+   * Builds a collective over the group, which gives all its processes the
+   * same bias.
+   *
+   * @param inputSize the size of the input samples of the whole layer,
+   * divisible by the group size
+   * @param outputSize the size of each output sample
+   * @param group the processes between which the layer is split
+   * @param bias whether the layer includes a bias term
+   * @param inputIsParallel whether the input holds the features of the
+   * current process (e.g. the output of a `ColumnParallelLinear`), rather
+   * than all of them
+   */
+  RowParallelLinear(
+      int inputSize,
+      int outputSize,
+      const DistributedGroup& group,
+      bool bias = true,
+      bool inputIsParallel = true);
+
+  /**
+   * The part of the current process of the layer `full`, e.g. a layer built
+   * by all the processes of the group from the same seed.
+   */
+  RowParallelLinear(
+      const Linear& full,
+      const DistributedGroup& group,
+      bool inputIsParallel = true);
+
+  Variable forward(const Variable& input) override;
+
+  /// The activation follows the sum over the group, unfused
+  Variable forwardActivation(
+      const Variable& input,
+      LinearActivation activation) override;
+
+  const DistributedGroup& group() const {
+    return group_;
+  }
+
+  void setGroup(const DistributedGroup& group) {
+    group_ = group;
+  }
+
+  std::string prettyString() const override;
+
+ private:
+  RowParallelLinear() = default;
+
+  DistributedGroup group_;
+  bool inputIsParallel_{true};
+
+  FL_SAVE_LOAD_WITH_BASE(Linear, inputIsParallel_)
+};
+
+/**
+ * A `Transformer` layer whose attention heads and feed-forward features are
+ * split between the processes of a group: each process runs
+ * `nHeads / group.size` heads, with its columns of the query, key and value
+ * projections and its rows of the output projection, and `mlpDim /
+ * group.size` features of the feed-forward network. The inputs and outputs
+ * are the same on all the processes of the group.
+ *
+ * The layer is built as the `Transformer` of the same parameters, which it
+ * then splits: on processes with the same seed, the group computes the same
+ * function as that `Transformer`. Building the layer is a collective over the
+ * group, which gives all its processes the same shared parameters.
+ *
+ * The group isn't serialized: after loading a layer, set it with `setGroup`.
+ */
+class TensorParallelTransformer : public Transformer {
+ public:
+  TensorParallelTransformer(
+      int32_t modelDim,
+      int32_t headDim,
+      int32_t mlpDim,
+      int32_t nHeads,
+      int32_t bptt,
+      float pDropout,
+      float pLayerdrop,
+      const DistributedGroup& group,
+      bool useMask = false,
+      bool preLN = false);
+
+  const DistributedGroup& group() const {
+    return group_;
+  }
+
+  void setGroup(const DistributedGroup& group);
+
+  std::string prettyString() const override;
+
+ protected:
+  Variable positionEmbedding() override;
+
+ private:
+  TensorParallelTransformer() = default;
+
+  DistributedGroup group_;
+
+  FL_SAVE_LOAD_WITH_BASE(Transformer)
+};
+
+/** @} */
+
+} // namespace fl
+
+CEREAL_REGISTER_TYPE(fl::ColumnParallelLinear)
+CEREAL_REGISTER_TYPE(fl::RowParallelLinear)
+CEREAL_REGISTER_TYPE(fl::TensorParallelTransformer)
@@ -64,7 +64,8 @@ Transformer::Transformer(
 
 Variable Transformer::mlp(const Variable& input) {
   float pDropout = train_ ? pDropout_ : 0.0;
-  return (*w2_)(dropout(relu((*w1_)(input)), pDropout));
+  return (*w2_)(dropout(
+      w1_->forwardActivation(input, LinearActivation::RELU), pDropout));
 }
 
 Variable Transformer::getMask(int32_t n, bool cache) {
@@ -76,23 +77,30 @@ Variable Transformer::getMask(int32_t n, bool cache) {
   return Variable(af::log(mask), false);
 }
 
+Variable Transformer::getSegmentMask(const af::array& segments) {
+  int n = segments.dims(0), bsz = segments.dims(1);
+  auto segQ = af::tile(af::moddims(segments, n, 1, bsz), 1, n);
+  auto segK = af::tile(af::moddims(segments, 1, n, bsz), n);
+  // Block-diagonal: each position only attends to its own segment
+  auto mask = (segQ == segK).as(af::dtype::f32);
+  if (useMask_ && n > 1) {
+    mask = mask * af::tile(af::lower(af::constant(1.0, n, n), true), 1, 1, bsz);
+  }
+  return Variable(af::log(mask), false);
+}
+
 Variable Transformer::selfAttention(const std::vector<Variable>& input) {
   // previous step[optionally], input, padMask
   auto encoderInput = input.at(input.size() - 2);
   // in case of previous state input[0] has size CxT_prevxB
-  int n = input[0].dims(1), bsz = input[0].dims(2);
-  double pDrop = train_ ? pDropout_ : 0.0;
+  int n = input[0].dims(1);
 
   auto q = transpose((*wq_)(encoderInput));
   std::vector<fl::Variable> inputWithState(input.begin(), input.end() - 1);
   auto k = transpose((*wk_)(concatenate(inputWithState, 1)));
   auto v = transpose((*wv_)(concatenate(inputWithState, 1)));
 
-  Variable mask, posEmb;
-  if (bptt_ > 0) {
-    posEmb =
-        tile(params_[0].as(encoderInput.type()), af::dim4(1, 1, nHeads_ * bsz));
-  }
+  Variable mask;
   if (useMask_ && encoderInput.dims(1) > 1) {
     // mask future if we use the previous state (then n is previous time)
     mask = getMask(n, input.size() == 3);
@@ -106,13 +114,44 @@ Variable Transformer::selfAttention(const std::vector<Variable>& input) {
     auto padMaskArr = input.back().array();
     padMaskArr =
         af::resize(padMaskArr, encoderInput.dims(1), encoderInput.dims(2));
-    padMask = fl::Variable(af::log(padMaskArr), false);
+    if (input.size() == 2 && af::anyTrue<bool>(padMaskArr > 1)) {
+      mask = getSegmentMask(padMaskArr);
+    } else {
+      padMask = fl::Variable(af::log(padMaskArr), false);
+    }
+  }
+  return attention(q, k, v, mask, padMask, offset);
+}
+
+Variable Transformer::attention(
+    const Variable& q,
+    const Variable& k,
+    const Variable& v,
+    const Variable& mask,
+    const Variable& padMask,
+    int offset) {
+  int bsz = q.dims(2);
+  double pDrop = train_ ? pDropout_ : 0.0;
+
+  Variable posEmb;
+  if (bptt_ > 0) {
+    posEmb =
+        tile(positionEmbedding().as(q.type()), af::dim4(1, 1, nHeads_ * bsz));
   }
   auto result = multiheadAttention(
-      q, k, v, posEmb, mask, padMask, nHeads_, pDrop, offset);
-  result = (*wf_)(transpose(result));
+      q, k, v, posEmb, mask, padMask, nHeads_, pDrop, offset, attentionWindow_);
+  return (*wf_)(transpose(result));
+}
 
-  return result;
+Variable
+Transformer::residual(const Variable& x, const Variable& attention, float f) {
+  if (preLN_) {
+    auto h = (f * (*norm1_)(attention)).as(x.type()) + x;
+    return f * (*norm2_)(mlp(h)).as(h.type()) + h;
+  } else {
+    auto h = norm1_->forwardResidual((f * attention).as(x.type()), x);
+    return norm2_->forwardResidual((f * mlp(h)).as(h.type()), h);
+  }
 }
 
 std::vector<Variable> Transformer::forward(const std::vector<Variable>& input) {
@@ -130,17 +169,98 @@ std::vector<Variable> Transformer::forward(const std::vector<Variable>& input) {
         "Invalid inputs for transformer block: input and Mask batch sizes are different");
   }
 
-  float f = 1.0;
-  if (train_ && (af::randu(1).scalar<float>() < pLayerdrop_)) {
-    f = 0.0;
+  if (train_ && dropLayer(pLayerdrop_)) {
+    // The branches of a dropped layer are skipped: only the normalizations
+    // of a post-LN layer remain
+    if (preLN_) {
+      return {x};
+    }
+    return {(*norm2_)((*norm1_)(x)).as(x.type())};
   }
-  if (preLN_) {
-    auto h = (f * (*norm1_)(selfAttention(input))).as(x.type()) + x;
-    return {f * (*norm2_)(mlp(h)).as(h.type()) + h};
-  } else {
-    auto h = (*norm1_)((f * selfAttention(input)).as(x.type()) + x);
-    return {(*norm2_)((f * mlp(h)).as(h.type()) + h)};
+  return {residual(x, selfAttention(input), 1.0)};
+}
+
+Variable Transformer::positionEmbedding() {
+  return params_[0];
+}
+
+Variable Transformer::forwardIncremental(
+    const Variable& input,
+    TransformerKVCache& cache) {
+  int n = cache.length(), nNew = input.dims(1);
+  if (n > 0 && cache.keys.dims(2) != input.dims(2)) {
+    throw std::invalid_argument(
+        "Transformer::forwardIncremental - input and cache batch sizes are "
+        "different");
+  }
+  auto q = transpose((*wq_)(input));
+  auto k = transpose((*wk_)(input));
+  auto v = transpose((*wv_)(input));
+  if (n > 0) {
+    k = concatenate({cache.keys, k}, 0);
+    v = concatenate({cache.values, v}, 0);
+  }
+  cache.keys = k;
+  cache.values = v;
+
+  Variable mask;
+  if (useMask_ && nNew > 1) {
+    // the i-th new position attends to the cache and to the new positions <= i
+    auto i = af::range(af::dim4(nNew, n + nNew), 0);
+    auto j = af::range(af::dim4(nNew, n + nNew), 1);
+    mask = Variable(af::log((j <= i + n).as(af::dtype::f32)), false);
+  }
+  return residual(input, attention(q, k, v, mask, Variable(), n), 1.0);
+}
+
+TransformerKVCache TransformerKVCache::gather(const af::array& index) const {
+  TransformerKVCache cache;
+  if (length() > 0) {
+    cache.keys = Variable(af::lookup(keys.array(), index, 2), false);
+    cache.values = Variable(af::lookup(values.array(), index, 2), false);
+  }
+  return cache;
+}
+
+TransformerKVCache TransformerKVCache::slice(int b) const {
+  TransformerKVCache cache;
+  if (length() > 0) {
+    cache.keys = keys.slice(b);
+    cache.values = values.slice(b);
   }
+  return cache;
+}
+
+TransformerKVCache TransformerKVCache::batch(
+    const std::vector<const TransformerKVCache*>& caches) {
+  TransformerKVCache cache;
+  if (caches.empty() || caches[0]->length() == 0) {
+    return cache;
+  }
+  std::vector<Variable> keys, values;
+  for (const auto* c : caches) {
+    if (c->length() != caches[0]->length()) {
+      throw std::invalid_argument(
+          "TransformerKVCache::batch - caches have different lengths");
+    }
+    keys.push_back(c->keys);
+    values.push_back(c->values);
+  }
+  cache.keys = concatenate(keys, 2);
+  cache.values = concatenate(values, 2);
+  return cache;
+}
+
+void Transformer::setAttentionWindow(const AttentionWindow& window) {
+  if (window.numGlobal < 0) {
+    throw std::invalid_argument(
+        "Transformer::setAttentionWindow - negative number of global tokens");
+  }
+  attentionWindow_ = window;
+}
+
+const AttentionWindow& Transformer::attentionWindow() const {
+  return attentionWindow_;
 }
 
 std::string Transformer::prettyString() const {
@@ -151,6 +271,10 @@ std::string Transformer::prettyString() const {
      << "(bptt: " << bptt_ << "), "
      << "(useMask: " << useMask_ << "), "
      << "(preLayerNorm: " << preLN_ << ")";
+  if (!attentionWindow_.isFull()) {
+    ss << ", (attentionWindow: " << attentionWindow_.left << ", "
+       << attentionWindow_.right << ", " << attentionWindow_.numGlobal << ")";
+  }
   return ss.str();
 }
 
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include "flashlight/fl/autograd/Functions.h"
 #include "flashlight/fl/nn/modules/Container.h"
 #include "flashlight/fl/nn/modules/LayerNorm.h"
 #include "flashlight/fl/nn/modules/Linear.h"
@@ -14,6 +15,37 @@
 
 namespace fl {
 
+/**
+ * Keys and values of the self-attention of a `Transformer` layer for the
+ * positions decoded so far, of size T x nHeads * headDim x B, used by
+ * `Transformer::forwardIncremental()`. Each element of the batch is a
+ * hypothesis; the cache is reordered with `gather()` when hypotheses are
+ * pruned or forked (e.g. by a beam search).
+ */
+struct TransformerKVCache {
+  Variable keys;
+  Variable values;
+
+  /// Number of positions in the cache.
+  int length() const {
+    return keys.isempty() ? 0 : keys.dims(0);
+  }
+
+  /**
+   * Cache of the hypotheses `index` (e.g. the parents of the hypotheses of a
+   * beam): the b-th hypothesis of the result is the hypothesis index[b] of
+   * this cache.
+   */
+  TransformerKVCache gather(const af::array& index) const;
+
+  /// Cache of the b-th hypothesis.
+  TransformerKVCache slice(int b) const;
+
+  /// Concatenates the hypotheses of caches of the same length.
+  static TransformerKVCache batch(
+      const std::vector<const TransformerKVCache*>& caches);
+};
+
 /**
  * A module which implements a Transformer.
  *
@@ -21,7 +53,9 @@ namespace fl {
  * (2017)](https://arxiv.org/abs/1706.03762).
  *
  * This module also supports layer drop regularization, as introduced in
- * [Fan et al (2019)](https://arxiv.org/abs/1909.11556).
+ * [Fan et al (2019)](https://arxiv.org/abs/1909.11556). A dropped layer
+ * skips its attention and feed-forward branches: its parameters get no
+ * gradient, and the processes drop the same layers (see `dropLayer`).
  *
  * Forward takes {previous step[optionally], input, padMask}
  * previous step is used in for the decoder phase, previous output with size
@@ -30,7 +64,10 @@ namespace fl {
  * padMask is with T''xB sizes (T'' will be af::resize to the input size)
  * padMask should be empty if "previous step" is provided (in the decoder phase)
  * padMask is expected to have "1" on the normal positions and "0" on the padded
- * positions
+ * positions. Without previous step, padMask can also hold the ids (1, 2, ...)
+ * of several segments, e.g. sentences packed in the same sample: each
+ * position then only attends to the positions of its own segment, through a
+ * block-diagonal mask of size T x T x B.
  *
  * @param modelDim input embedding dimension
  * @param headDim dimension of each head
@@ -44,6 +81,9 @@ namespace fl {
  * if true then don't use future (for example for autoregressive language models
  * or for decoder part in the encoder-decoder transformer models)
  * @param preLN apply layer normalization before or after residual connection
+ *
+ * For long inputs, the self-attention can be restricted to a local window
+ * (see `setAttentionWindow()`).
  */
 class Transformer : public Container {
  public:
@@ -59,22 +99,59 @@ class Transformer : public Container {
       bool preLN = false);
 
   std::vector<Variable> forward(const std::vector<Variable>& input) override;
+
+  /**
+   * Incremental decoding: computes the output of the new positions `input`
+   * (of size C x T x B) attending to the positions in `cache`, then appends
+   * the keys and values of `input` to `cache`. Decoding a sequence position
+   * by position costs O(T) per position, instead of O(T^2) with the previous
+   * step passed to `forward()`. The future is masked if the layer uses masks.
+   * Layer drop isn't applied, this is meant for inference.
+   */
+  Variable forwardIncremental(const Variable& input, TransformerKVCache& cache);
+
+  /**
+   * Restricts the self-attention to a local window, combined with the masks
+   * of the future, of the padding and of the segments (see
+   * `AttentionWindow`): the fused attention then costs O(T * W) for a window
+   * of size W instead of O(T^2). Saved with the module.
+   */
+  void setAttentionWindow(const AttentionWindow& window);
+
+  const AttentionWindow& attentionWindow() const;
+
   std::string prettyString() const override;
 
- private:
+ protected:
   int32_t nHeads_;
   int32_t bptt_;
   double pDropout_;
   double pLayerdrop_;
   bool useMask_;
   bool preLN_;
+  AttentionWindow attentionWindow_;
   std::shared_ptr<Linear> w1_, w2_, wq_, wk_, wv_, wf_;
   std::shared_ptr<LayerNorm> norm1_, norm2_;
 
   Variable mlp(const Variable& input);
   Variable getMask(int32_t n, bool cache = false);
+  Variable getSegmentMask(const af::array& segments);
   Variable selfAttention(const std::vector<Variable>& input);
+  Variable attention(
+      const Variable& q,
+      const Variable& k,
+      const Variable& v,
+      const Variable& mask,
+      const Variable& padMask,
+      int offset);
+  Variable residual(const Variable& x, const Variable& attention, float f);
+
+  // The relative position embedding, shared by the heads
+  virtual Variable positionEmbedding();
 
+  Transformer();
+
+ private:
   FL_SAVE_LOAD_WITH_BASE(
       Container,
       w1_,
@@ -90,11 +167,13 @@ class Transformer : public Container {
       pLayerdrop_,
       bptt_,
       useMask_,
-      preLN_)
-
-  Transformer();
+      preLN_,
+      fl::versioned(attentionWindow_.left, 1),
+      fl::versioned(attentionWindow_.right, 1),
+      fl::versioned(attentionWindow_.numGlobal, 1))
 };
 
 } // namespace fl
 
 CEREAL_REGISTER_TYPE(fl::Transformer);
+CEREAL_CLASS_VERSION(fl::Transformer, 1)
@@ -9,7 +9,9 @@
 
 #include "flashlight/fl/contrib/modules/AdaptiveEmbedding.h"
 #include "flashlight/fl/contrib/modules/AsymmetricConv1D.h"
+#include "flashlight/fl/contrib/modules/Checkpoint.h"
 #include "flashlight/fl/contrib/modules/Conformer.h" 
+#include "flashlight/fl/contrib/modules/Offload.h"
 #include "flashlight/fl/contrib/modules/PositionEmbedding.h"
 #include "flashlight/fl/contrib/modules/RawWavSpecAugment.h"
 #include "flashlight/fl/contrib/modules/Residual.h"
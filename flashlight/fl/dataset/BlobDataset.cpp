@@ -6,13 +6,89 @@
  */
 
 #include <array>
+#include <memory>
+#include <stdexcept>
+#include <string>
 #include <thread>
 
+#if FL_USE_ZSTD
+#include <zstd.h>
+#endif
+
 #include "flashlight/fl/dataset/BlobDataset.h"
+#include "flashlight/fl/dataset/DeviceStaging.h"
 
 namespace fl {
 
 const int64_t magicNumber = 0x31626f6c423a6c66;
+// Entries with a compression and a stored size
+const int64_t magicNumberCompressed = 0x32626f6c423a6c66;
+
+namespace {
+
+// Number of int64s per entry of the index, without and with compression
+constexpr int kRawEntryFields = 6;
+constexpr int kEntryFields = 8;
+
+int64_t rawBytes(const BlobDatasetEntry& e) {
+  return af::getSizeOf(e.type) * e.dims.elements();
+}
+
+// Per-thread buffer of the compressed data read from the blob
+std::vector<char>& readBuffer() {
+  static thread_local std::vector<char> buffer;
+  return buffer;
+}
+
+#if FL_USE_ZSTD
+// Per-thread (de)compression contexts
+ZSTD_CCtx* compressionContext() {
+  static thread_local std::unique_ptr<ZSTD_CCtx, size_t (*)(ZSTD_CCtx*)> ctx(
+      ZSTD_createCCtx(), ZSTD_freeCCtx);
+  return ctx.get();
+}
+
+ZSTD_DCtx* decompressionContext() {
+  static thread_local std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)> ctx(
+      ZSTD_createDCtx(), ZSTD_freeDCtx);
+  return ctx.get();
+}
+#endif
+
+// Compresses `raw` in `stored`; returns false if it doesn't shrink
+bool compress(
+    BlobCompression compression,
+    int level,
+    const std::vector<uint8_t>& raw,
+    std::vector<uint8_t>& stored) {
+#if FL_USE_ZSTD
+  if (compression == BlobCompression::Zstd) {
+    stored.resize(ZSTD_compressBound(raw.size()));
+    size_t size = ZSTD_compressCCtx(
+        compressionContext(),
+        stored.data(),
+        stored.size(),
+        raw.data(),
+        raw.size(),
+        level);
+    if (ZSTD_isError(size)) {
+      throw std::runtime_error(
+          std::string("BlobDataset: compression failed: ") +
+          ZSTD_getErrorName(size));
+    }
+    stored.resize(size);
+    return stored.size() < raw.size();
+  }
+#endif
+  (void)level;
+  (void)raw;
+  (void)stored;
+  throw std::invalid_argument(
+      "BlobDataset: unsupported compression " +
+      std::to_string(static_cast<int64_t>(compression)));
+}
+
+} // namespace
 
 BlobDatasetEntryBuffer::BlobDatasetEntryBuffer() {}
 
@@ -35,6 +111,9 @@ BlobDatasetEntry BlobDatasetEntryBuffer::get(const int64_t idx) const {
     e.dims[i] = data_[idx * nFieldPerEntry_ + i + 1];
   }
   e.offset = data_[idx * nFieldPerEntry_ + 5];
+  e.compression =
+      static_cast<BlobCompression>(data_[idx * nFieldPerEntry_ + 6]);
+  e.storedBytes = data_[idx * nFieldPerEntry_ + 7];
   return e;
 }
 
@@ -44,6 +123,8 @@ void BlobDatasetEntryBuffer::add(const BlobDatasetEntry& e) {
     data_.push_back(e.dims[i]);
   }
   data_.push_back(e.offset);
+  data_.push_back(static_cast<int64_t>(e.compression));
+  data_.push_back(e.storedBytes);
 }
 
 char* BlobDatasetEntryBuffer::data() {
@@ -54,6 +135,49 @@ int64_t BlobDatasetEntryBuffer::bytes() const {
   return data_.size() * sizeof(int64_t);
 };
 
+bool BlobDatasetEntryBuffer::hasCompression() const {
+  for (int64_t i = 0; i < size(); i++) {
+    if (data_[i * nFieldPerEntry_ + 6] !=
+        static_cast<int64_t>(BlobCompression::None)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::vector<int64_t> BlobDatasetEntryBuffer::pack(int nFields) const {
+  if (nFields == nFieldPerEntry_) {
+    return data_;
+  }
+  std::vector<int64_t> table;
+  table.reserve(size() * nFields);
+  for (int64_t i = 0; i < size(); i++) {
+    auto first = data_.begin() + i * nFieldPerEntry_;
+    table.insert(table.end(), first, first + nFields);
+  }
+  return table;
+}
+
+void BlobDatasetEntryBuffer::unpack(
+    const std::vector<int64_t>& table,
+    int nFields) {
+  if (nFields == nFieldPerEntry_) {
+    data_ = table;
+    return;
+  }
+  data_.clear();
+  for (int64_t i = 0; i < table.size() / nFields; i++) {
+    BlobDatasetEntry e;
+    e.type = static_cast<af::dtype>(table[i * nFields]);
+    for (int j = 0; j < 4; j++) {
+      e.dims[j] = table[i * nFields + j + 1];
+    }
+    e.offset = table[i * nFields + 5];
+    e.storedBytes = rawBytes(e);
+    add(e);
+  }
+}
+
 BlobDataset::BlobDataset() {}
 
 int64_t BlobDataset::size() const {
@@ -79,28 +203,82 @@ std::vector<std::vector<uint8_t>> BlobDataset::rawGet(const int64_t idx) const {
 };
 
 void BlobDataset::add(const std::vector<af::array>& sample) {
-  int64_t entryOffset;
+  addEncoded(encode(sample));
+}
+
+BlobDatasetEncodedSample BlobDataset::encode(
+    const std::vector<af::array>& sample) const {
+  BlobDatasetEncodedSample encoded;
+  for (const auto& array : sample) {
+    BlobDatasetEntry e;
+    e.type = array.type();
+    e.dims = array.dims();
+    e.offset = 0;
+    std::vector<uint8_t> buffer(array.bytes());
+    if (!buffer.empty()) {
+      array.host(buffer.data());
+    }
+    if (compression_ != BlobCompression::None && !buffer.empty()) {
+      std::vector<uint8_t> compressed;
+      if (compress(compression_, compressionLevel_, buffer, compressed)) {
+        e.compression = compression_;
+        buffer.swap(compressed);
+      }
+    }
+    e.storedBytes = buffer.size();
+    encoded.entries.push_back(e);
+    encoded.data.push_back(std::move(buffer));
+  }
+  return encoded;
+}
+
+void BlobDataset::addEncoded(const BlobDatasetEncodedSample& sample) {
+  std::vector<int64_t> offsets;
   {
     std::lock_guard<std::mutex> lock(mutex_);
-    entryOffset = entries_.size();
     offsets_.push_back(entries_.size());
-    sizes_.push_back(sample.size());
-    for (const auto& array : sample) {
-      BlobDatasetEntry e;
-      e.type = array.type();
-      e.dims = array.dims();
+    sizes_.push_back(sample.entries.size());
+    for (auto e : sample.entries) {
       e.offset = indexOffset_;
-      indexOffset_ += array.bytes();
+      indexOffset_ += e.storedBytes;
       entries_.add(e);
+      offsets.push_back(e.offset);
     }
   }
-  for (int64_t i = 0; i < sample.size(); i++) {
-    auto& array = sample[i];
-    const auto& e = entries_.get(entryOffset + i);
-    writeArray(e, array);
+  for (int64_t i = 0; i < sample.data.size(); i++) {
+    writeData(
+        offsets[i],
+        reinterpret_cast<const char*>(sample.data[i].data()),
+        sample.data[i].size());
   }
 }
 
+void BlobDataset::setCompression(
+    BlobCompression compression,
+    int level /* = 1 */) {
+  if (!compressionSupported(compression)) {
+    throw std::invalid_argument(
+        "BlobDataset::setCompression: unsupported compression " +
+        std::to_string(static_cast<int64_t>(compression)));
+  }
+  compression_ = compression;
+  compressionLevel_ = level;
+}
+
+bool BlobDataset::compressionSupported(BlobCompression compression) {
+  switch (compression) {
+    case BlobCompression::None:
+      return true;
+    case BlobCompression::Zstd:
+#if FL_USE_ZSTD
+      return true;
+#else
+      return false;
+#endif
+  }
+  return false;
+}
+
 void BlobDataset::add(const BlobDataset& blob, int64_t chunkSize) {
   std::lock_guard<std::mutex> lock(mutex_);
   if (chunkSize <= 0) {
@@ -141,29 +319,63 @@ std::vector<uint8_t> BlobDataset::readRawArray(
     const BlobDatasetEntry& e) const {
   std::vector<uint8_t> buffer;
   if (e.dims.elements() > 0) {
-    buffer.resize(af::getSizeOf(e.type) * e.dims.elements());
-    readData(
-        e.offset,
-        (char*)buffer.data(),
-        af::getSizeOf(e.type) * e.dims.elements());
+    buffer.resize(rawBytes(e));
+    if (e.compression != BlobCompression::None) {
+      decompressArray(e, buffer.data());
+    } else {
+      readData(e.offset, (char*)buffer.data(), buffer.size());
+    }
   }
   return buffer;
 }
 
+void BlobDataset::decompressArray(const BlobDatasetEntry& e, uint8_t* buffer)
+    const {
+  const char* stored = mappedData(e.offset, e.storedBytes);
+  if (!stored) {
+    auto& readBuf = readBuffer();
+    readBuf.resize(e.storedBytes);
+    readData(e.offset, readBuf.data(), e.storedBytes);
+    stored = readBuf.data();
+  }
+#if FL_USE_ZSTD
+  if (e.compression == BlobCompression::Zstd) {
+    size_t size = ZSTD_decompressDCtx(
+        decompressionContext(), buffer, rawBytes(e), stored, e.storedBytes);
+    if (ZSTD_isError(size) || size != rawBytes(e)) {
+      throw std::runtime_error("BlobDataset: corrupted compressed array");
+    }
+    return;
+  }
+#endif
+  (void)buffer;
+  throw std::runtime_error(
+      "BlobDataset: unsupported compression " +
+      std::to_string(static_cast<int64_t>(e.compression)) +
+      " of a stored array");
+}
+
 af::array BlobDataset::readArray(const BlobDatasetEntry& e, int i) const {
   if (e.dims.elements() > 0) {
-    auto buffer = readRawArray(e);
     auto keyval = hostTransforms_.find(i);
     if (keyval == hostTransforms_.end()) {
-      af_array c_array;
-      af_err status = af_create_array(
-          &c_array, buffer.data(), e.dims.ndims(), e.dims.get(), e.type);
-      if (status != AF_SUCCESS) {
-        throw af::exception(
-            "unable to create array", __FILE__, __LINE__, status);
+      if (e.compression != BlobCompression::None) {
+        // The data can be released once uploaded: reuse the buffer
+        static thread_local std::vector<uint8_t> buffer;
+        buffer.resize(rawBytes(e));
+        decompressArray(e, buffer.data());
+        return hostToDevice(buffer.data(), e.dims, e.type);
+      }
+      std::vector<uint8_t> buffer;
+      const void* data = mappedData(e.offset, rawBytes(e));
+      if (!data) {
+        buffer = readRawArray(e);
+        data = buffer.data();
       }
-      return af::array(c_array);
+      return hostToDevice(data, e.dims, e.type);
     } else {
+      // Transforms may modify the data in place
+      auto buffer = readRawArray(e);
       return keyval->second(buffer.data(), e.dims, e.type);
     }
   } else {
@@ -171,19 +383,23 @@ af::array BlobDataset::readArray(const BlobDatasetEntry& e, int i) const {
   }
 }
 
-void BlobDataset::writeArray(
-    const BlobDatasetEntry& e,
-    const af::array& array) {
-  std::vector<uint8_t> buffer(array.bytes());
-  array.host(buffer.data());
-  writeData(e.offset, (char*)buffer.data(), buffer.size());
+const char* BlobDataset::mappedData(
+    int64_t /* offset */,
+    int64_t /* size */) const {
+  return nullptr;
 }
 
 void BlobDataset::writeIndex() {
   std::lock_guard<std::mutex> lock(mutex_);
 
+  // Blobs without compression keep the original format
+  bool compressed = entries_.hasCompression();
+  auto table = entries_.pack(compressed ? kEntryFields : kRawEntryFields);
   int64_t offset = 0;
-  offset += writeData(offset, (char*)&magicNumber, sizeof(int64_t));
+  offset += writeData(
+      offset,
+      (char*)(compressed ? &magicNumberCompressed : &magicNumber),
+      sizeof(int64_t));
   writeData(offset, (char*)&indexOffset_, sizeof(int64_t));
 
   offset = indexOffset_;
@@ -193,7 +409,7 @@ void BlobDataset::writeIndex() {
   offset += writeData(offset, (char*)&entriesSize, sizeof(int64_t));
   offset += writeData(offset, (char*)sizes_.data(), sizeof(int64_t) * size);
   offset += writeData(offset, (char*)offsets_.data(), sizeof(int64_t) * size);
-  writeData(offset, entries_.data(), entries_.bytes());
+  writeData(offset, (char*)table.data(), sizeof(int64_t) * table.size());
   flushData();
 }
 
@@ -210,10 +426,13 @@ void BlobDataset::readIndex() {
 
   int64_t magicNumberCheck = 0;
   int64_t offset = readData(0, (char*)&magicNumberCheck, sizeof(int64_t));
-  if (magicNumber != magicNumberCheck) {
+  if (magicNumber != magicNumberCheck &&
+      magicNumberCompressed != magicNumberCheck) {
     throw af::exception(
         "Not a fl::BlobDataset", __FILE__, __LINE__, AF_ERR_RUNTIME);
   }
+  int nFields = magicNumberCheck == magicNumberCompressed ? kEntryFields
+                                                          : kRawEntryFields;
   readData(offset, (char*)&indexOffset_, sizeof(int64_t));
   offset = indexOffset_;
 
@@ -223,11 +442,12 @@ void BlobDataset::readIndex() {
   offset += readData(offset, (char*)&entriesSize, sizeof(int64_t));
   sizes_.resize(size);
   offsets_.resize(size);
-  entries_.resize(entriesSize);
+  std::vector<int64_t> table(entriesSize * nFields);
 
   offset += readData(offset, (char*)sizes_.data(), sizeof(int64_t) * size);
   offset += readData(offset, (char*)offsets_.data(), sizeof(int64_t) * size);
-  readData(offset, entries_.data(), entries_.bytes());
+  readData(offset, (char*)table.data(), sizeof(int64_t) * table.size());
+  entries_.unpack(table, nFields);
 }
 
 void BlobDataset::flush() {
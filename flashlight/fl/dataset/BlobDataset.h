@@ -33,18 +33,24 @@ namespace fl {
  *
  * The dataset is thread-safe for read and write operations.
  *
+ * Arrays can be compressed when added (see setCompression()), and are
+ * decompressed when read, independently in each reading thread, into
+ * buffers reused by the thread. BlobDatasetWriter adds samples copied and
+ * compressed by several threads.
+ *
  * Concrete versions of this class must implement writeData(), readData(),
  * flushData() and isEmptyData().
  *
  *
  * For advanced users, the format of the blob is the following:
   \code{.unparsed}
-  <int64: magic number (0x31626f6c423a6c66)>
+  <int64: magic number (0x31626f6c423a6c66, or 0x32626f6c423a6c66 if
+          some arrays are compressed)>
   <int64: offset to index>
   ---- raw data ----
-  <raw tensor data>
+  <raw (or compressed) tensor data>
   ...
-  <raw tensor data>
+  <raw (or compressed) tensor data>
   ---- index ----
   <int64: # of samples in dataset (size)>
   <int64: # of tensors in dataset (entries)>
@@ -52,19 +58,31 @@ namespace fl {
   <int64*size: start offset in entry table for each sample>
   <int64*6*entries: entry table seen as int64s {type, dim0, .. dim3, offset}>
   \endcode
+  * With compressed arrays, the entry table has 8 int64s per entry: {type,
+  * dim0, .. dim3, offset, compression, stored bytes}.
   *
  */
 
+/// Compression of the arrays of a BlobDataset.
+enum class BlobCompression : int64_t {
+  None = 0,
+  /// Zstandard, if flashlight is built with it
+  Zstd = 1,
+};
+
 struct BlobDatasetEntry {
   af::dtype type;
   af::dim4 dims;
   int64_t offset;
+  BlobCompression compression{BlobCompression::None};
+  // Size of the array in the blob, in bytes
+  int64_t storedBytes{0};
 };
 
 class BlobDatasetEntryBuffer {
  private:
   std::vector<int64_t> data_;
-  const int nFieldPerEntry_ = 6;
+  const int nFieldPerEntry_ = 8;
 
  public:
   BlobDatasetEntryBuffer();
@@ -75,6 +93,22 @@ class BlobDatasetEntryBuffer {
   void add(const BlobDatasetEntry& entry);
   char* data();
   int64_t bytes() const;
+  /// Whether some entries are compressed.
+  bool hasCompression() const;
+  /// Entry table of the index, with `nFields` (6 or 8) int64s per entry.
+  std::vector<int64_t> pack(int nFields) const;
+  /// Sets the entries from an entry table with `nFields` int64s per entry.
+  void unpack(const std::vector<int64_t>& table, int nFields);
+};
+
+/**
+ * A sample copied to the host and compressed by BlobDataset::encode(), to be
+ * written with BlobDataset::addEncoded(). The offsets of its entries are set
+ * when it is written.
+ */
+struct BlobDatasetEncodedSample {
+  std::vector<BlobDatasetEntry> entries;
+  std::vector<std::vector<uint8_t>> data;
 };
 
 class BlobDataset : public Dataset {
@@ -84,11 +118,14 @@ class BlobDataset : public Dataset {
   std::vector<int64_t> offsets_;
   int64_t indexOffset_;
   std::unordered_map<int, DataTransformFunction> hostTransforms_;
+  BlobCompression compression_{BlobCompression::None};
+  int compressionLevel_{1};
   mutable std::mutex mutex_;
 
   std::vector<uint8_t> readRawArray(const BlobDatasetEntry& e) const;
+  // Raw data of a compressed entry, decompressed in `buffer`
+  void decompressArray(const BlobDatasetEntry& e, uint8_t* buffer) const;
   af::array readArray(const BlobDatasetEntry& e, int i) const;
-  void writeArray(const BlobDatasetEntry& e, const af::array& array);
 
  protected:
   void readIndex();
@@ -108,6 +145,14 @@ class BlobDataset : public Dataset {
    * @param[in] size Raw data size in bytes.
    */
   virtual int64_t readData(int64_t offset, char* data, int64_t size) const = 0;
+  /* Return a pointer to raw data in the blob if the blob is resident in
+   * memory, or nullptr if it must be read with readData(). Arrays are then
+   * created from the blob memory directly.
+   * Implementation must be thread-safe.
+   * @param[in] offset Offset in the blob in bytes.
+   * @param[in] size Raw data size in bytes.
+   */
+  virtual const char* mappedData(int64_t offset, int64_t size) const;
   /* Make sure all written data is flushed in the blob.
    * Implementation must be thread-safe.
    */
@@ -148,6 +193,36 @@ class BlobDataset : public Dataset {
    */
   void add(const std::vector<af::array>& sample);
 
+  /**
+   * Copies the arrays of a sample to the host and compresses them (see
+   * setCompression()), for addEncoded(). Doesn't access the blob: several
+   * threads can encode samples while another adds them.
+   * @param[in] sample A vector of arrays.
+   */
+  BlobDatasetEncodedSample encode(const std::vector<af::array>& sample) const;
+
+  /**
+   * Add a sample encoded with encode(). The dataset must have been opened
+   * in read-write mode.
+   * @param[in] sample An encoded sample.
+   */
+  void addEncoded(const BlobDatasetEncodedSample& sample);
+
+  /**
+   * Compress the arrays added from now on, e.g. with a fast zstd `level`.
+   * The compression is recorded per entry: a blob can mix compressed and
+   * uncompressed arrays, and arrays which don't compress are stored as is.
+   * Not thread-safe with add() or encode(). Throws if `compression` isn't
+   * supported (see compressionSupported()).
+   * @param[in] compression The compression.
+   * @param[in] level The compression level, in ZSTD_minCLevel() to
+   * ZSTD_maxCLevel() for zstd.
+   */
+  void setCompression(BlobCompression compression, int level = 1);
+
+  /// Whether flashlight is built with the library of `compression`.
+  static bool compressionSupported(BlobCompression compression);
+
   /**
    * Add an entire blob to the current blob. This efficiently concatenate
    * blobs by reading and writing (possibly large) chunks.
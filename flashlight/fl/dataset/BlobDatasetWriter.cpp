@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/dataset/BlobDatasetWriter.h"
+
+#include <chrono>
+#include <stdexcept>
+
+#include "flashlight/fl/common/Logging.h"
+
+namespace fl {
+
+BlobDatasetWriter::BlobDatasetWriter(
+    BlobDataset& blob,
+    int numThreads,
+    int64_t maxPending /* = 0 */)
+    : blob_(blob),
+      maxPending_(maxPending > 0 ? maxPending : 4 * numThreads) {
+  if (numThreads < 1 || maxPending < 0) {
+    throw std::invalid_argument(
+        "BlobDatasetWriter: needs numThreads >= 1 and maxPending >= 0");
+  }
+  auto deviceId = af::getDevice();
+  threadPool_ = std::make_unique<ThreadPool>(
+      numThreads, [deviceId](int /* threadId */) { af::setDevice(deviceId); });
+}
+
+BlobDatasetWriter::~BlobDatasetWriter() {
+  try {
+    close();
+  } catch (const std::exception& ex) {
+    FL_LOG(fl::ERROR) << "BlobDatasetWriter: samples lost: " << ex.what();
+  }
+}
+
+void BlobDatasetWriter::add(const std::vector<af::array>& sample) {
+  // Write the samples already encoded, in order
+  while (!pending_.empty() &&
+         (pending_.size() >= maxPending_ ||
+          pending_.front().wait_for(std::chrono::seconds(0)) ==
+              std::future_status::ready)) {
+    commit();
+  }
+  const BlobDataset* blob = &blob_;
+  pending_.push_back(threadPool_->enqueue(
+      [blob, sample]() { return blob->encode(sample); }));
+}
+
+void BlobDatasetWriter::close() {
+  while (!pending_.empty()) {
+    commit();
+  }
+}
+
+void BlobDatasetWriter::commit() {
+  auto future = std::move(pending_.front());
+  pending_.pop_front();
+  // Drop the later samples on error, to not leave a gap in the order
+  BlobDatasetEncodedSample sample;
+  try {
+    sample = future.get();
+  } catch (...) {
+    for (auto& f : pending_) {
+      f.wait();
+    }
+    pending_.clear();
+    throw;
+  }
+  blob_.addEncoded(sample);
+}
+
+} // namespace fl
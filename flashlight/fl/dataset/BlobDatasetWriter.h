@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <deque>
+#include <future>
+#include <memory>
+#include <vector>
+
+#include "flashlight/fl/common/threadpool/ThreadPool.h"
+#include "flashlight/fl/dataset/BlobDataset.h"
+
+namespace fl {
+
+/**
+ * Writes samples to a BlobDataset with a pool of threads.
+ *
+ * The samples are copied to the host and compressed (see
+ * BlobDataset::setCompression()) by the threads in parallel, and appended to
+ * the blob in the order of add(), so that the indices of the samples are the
+ * same as with BlobDataset::add(). At most `maxPending` samples are encoded
+ * at once: add() blocks when they are all waiting their turn.
+ *
+ * Example:
+  \code{.cpp}
+  FileBlobDataset blob("data.blob", true, true);
+  blob.setCompression(BlobCompression::Zstd);
+  {
+    BlobDatasetWriter writer(blob, 8);
+    for (auto& sample : samples) {
+      writer.add(sample);
+    }
+    writer.close();
+  }
+  blob.writeIndex();
+  \endcode
+ */
+class BlobDatasetWriter {
+ public:
+  /**
+   * Creates a `BlobDatasetWriter`.
+   * @param[in] blob The blob written to, which must outlive the writer.
+   * @param[in] numThreads Number of threads encoding the samples.
+   * @param[in] maxPending Maximum number of samples added and not written
+   * yet, `4 * numThreads` if 0.
+   */
+  BlobDatasetWriter(BlobDataset& blob, int numThreads, int64_t maxPending = 0);
+
+  /// Writes the pending samples; errors are logged.
+  ~BlobDatasetWriter();
+
+  /**
+   * Adds a sample, written after the samples added before. Not thread-safe.
+   * Rethrows the error of a previous sample, if any.
+   * @param[in] sample A sample.
+   */
+  void add(const std::vector<af::array>& sample);
+
+  /**
+   * Waits for all the samples added to be written. Rethrows the error of a
+   * sample, if any. The index of the blob is left to the caller to write.
+   */
+  void close();
+
+ private:
+  // Writes the oldest pending sample
+  void commit();
+
+  BlobDataset& blob_;
+  int64_t maxPending_;
+  std::unique_ptr<ThreadPool> threadPool_;
+  std::deque<std::future<BlobDatasetEncodedSample>> pending_;
+};
+
+} // namespace fl
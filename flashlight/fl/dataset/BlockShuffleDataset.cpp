@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/dataset/BlockShuffleDataset.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+namespace fl {
+
+namespace {
+
+// Same implementation as ShuffleDataset, independent of the standard library
+void shuffle(std::vector<int64_t>& vec, std::mt19937_64& rng) {
+  auto n = vec.size();
+  for (auto i = n; i >= 1; --i) {
+    std::swap(vec[i - 1], vec[rng() % n]);
+  }
+}
+
+} // namespace
+
+BlockShuffleDataset::BlockShuffleDataset(
+    std::shared_ptr<const Dataset> dataset,
+    int64_t blockSize,
+    int64_t bufferSize,
+    int seed /* = 0 */,
+    int64_t worldRank /* = 0 */,
+    int64_t worldSize /* = 1 */)
+    : ResampleDataset(dataset),
+      blockSize_(blockSize),
+      bufferSize_(bufferSize),
+      worldRank_(worldRank),
+      worldSize_(worldSize),
+      rng_(seed) {
+  if (blockSize_ <= 0 || bufferSize_ <= 0) {
+    throw std::invalid_argument(
+        "BlockShuffleDataset: blockSize and bufferSize must be positive");
+  }
+  if (worldSize_ <= 0 || worldRank_ < 0 || worldRank_ >= worldSize_) {
+    throw std::invalid_argument("BlockShuffleDataset: invalid rank");
+  }
+  resample();
+}
+
+void BlockShuffleDataset::resample() {
+  int64_t n = dataset_->size();
+  resampleVec_.clear();
+  if (n == 0) {
+    return;
+  }
+  // The random draws of the blocks are the same on all ranks
+  int64_t offset = rng_() % std::min(blockSize_, n);
+  int64_t numBlocks = n / blockSize_;
+  // A single rank also reads the leftover samples, as a shorter block
+  if (worldSize_ == 1 && n % blockSize_ > 0) {
+    ++numBlocks;
+  }
+  std::vector<int64_t> blocks(numBlocks);
+  std::iota(blocks.begin(), blocks.end(), 0);
+  shuffle(blocks, rng_);
+  std::mt19937_64 bufferRng(rng_() + worldRank_);
+
+  std::vector<int64_t> buffer;
+  buffer.reserve(std::min(bufferSize_, n));
+  // Ranks get the same number of blocks, the others are left out
+  int64_t rankBlocks = numBlocks / worldSize_;
+  for (int64_t b = worldRank_; b < rankBlocks * worldSize_; b += worldSize_) {
+    int64_t start = blocks[b] * blockSize_;
+    int64_t end = std::min(start + blockSize_, n);
+    for (int64_t i = start; i < end; ++i) {
+      // Blocks wrap around the end of the dataset
+      int64_t idx = (offset + i) % n;
+      if (static_cast<int64_t>(buffer.size()) < bufferSize_) {
+        buffer.push_back(idx);
+        continue;
+      }
+      auto& slot = buffer[bufferRng() % bufferSize_];
+      resampleVec_.push_back(slot);
+      slot = idx;
+    }
+  }
+  shuffle(buffer, bufferRng);
+  resampleVec_.insert(resampleVec_.end(), buffer.begin(), buffer.end());
+}
+
+void BlockShuffleDataset::setSeed(int seed) {
+  rng_.seed(seed);
+}
+
+} // namespace fl
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include "flashlight/fl/dataset/ResampleDataset.h"
+
+#include <random>
+
+namespace fl {
+
+/**
+ * A view into a dataset, shuffled with a locality-preserving permutation for
+ * datasets which are read sequentially (e.g. a FileBlobDataset on a spinning
+ * disk or a network filesystem). The indices are split into contiguous
+ * blocks of `blockSize` samples, whose order is shuffled. The resulting
+ * stream of indices then goes through a shuffle buffer of `bufferSize`
+ * indices: each index is swapped with a random one of the buffer. Reads
+ * therefore stay within windows of about `bufferSize` samples of the
+ * (block-wise sequential) stream.
+ *
+ * In distributed training, each of the `worldSize` ranks gets disjoint
+ * blocks, given the same seed on all ranks. Ranks get the same number of
+ * samples: a few samples, different at each resample(), are left out of the
+ * epoch. The grid of blocks is shifted by a random offset at each
+ * resample(), so that blocks differ between epochs.
+ *
+ * Example:
+  \code{.cpp}
+  auto blob = std::make_shared<FileBlobDataset>("data.blob");
+  // Blocks of 1024 consecutive samples, mixed by a buffer of 8192 samples
+  BlockShuffleDataset shuffleds(blob, 1024, 8192, seed, worldRank, worldSize);
+  for (int epoch = 0; epoch < nEpochs; ++epoch) {
+    shuffleds.resample();
+    for (auto& sample : shuffleds) {
+      // ...
+    }
+  }
+  \endcode
+ */
+class BlockShuffleDataset : public ResampleDataset {
+ public:
+  /**
+   * Creates a `BlockShuffleDataset`.
+   * @param[in] dataset The underlying dataset.
+   * @param[in] blockSize Number of consecutive samples of a block.
+   * @param[in] bufferSize Number of indices of the shuffle buffer. With 1,
+   * blocks are read in order.
+   * @param[in] seed Initial seed, which must be the same on all ranks.
+   * @param[in] worldRank Rank of the process.
+   * @param[in] worldSize Number of processes sharing the dataset.
+   */
+  BlockShuffleDataset(
+      std::shared_ptr<const Dataset> dataset,
+      int64_t blockSize,
+      int64_t bufferSize,
+      int seed = 0,
+      int64_t worldRank = 0,
+      int64_t worldSize = 1);
+
+  /**
+   * Generates a new permutation of the blocks, and of the buffered indices.
+   */
+  void resample();
+
+  /**
+   * Sets the PRNG seed.
+   * @param[in] seed The desired seed.
+   */
+  void setSeed(int seed);
+
+ private:
+  int64_t blockSize_;
+  int64_t bufferSize_;
+  int64_t worldRank_;
+  int64_t worldSize_;
+  std::mt19937_64 rng_;
+};
+
+} // namespace fl
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/dataset/BucketBatchDataset.h"
+
+#include <stdexcept>
+
+namespace fl {
+
+BucketBatchDataset::BucketBatchDataset(
+    std::shared_ptr<const Dataset> dataset,
+    std::vector<float> samplesSize,
+    int64_t partitionId,
+    int64_t numPartitions,
+    int64_t maxSizePerBatch,
+    int64_t numBuckets,
+    const std::vector<BatchFunction>& batchfns /* = {} */,
+    bool allowEmpty /* = false */,
+    int seed /* = 0 */)
+    : dataset_(dataset),
+      samplesSize_(std::move(samplesSize)),
+      partitionId_(partitionId),
+      numPartitions_(numPartitions),
+      maxSizePerBatch_(maxSizePerBatch),
+      numBuckets_(numBuckets),
+      batchFns_(batchfns),
+      allowEmpty_(allowEmpty),
+      rng_(seed) {
+  if (!dataset_) {
+    throw std::invalid_argument("dataset to be batched is null");
+  }
+  if (samplesSize_.size() != static_cast<size_t>(dataset_->size())) {
+    throw std::invalid_argument(
+        "[BucketBatchDataset] samplesSize should have the size of the dataset");
+  }
+  resample();
+}
+
+int64_t BucketBatchDataset::size() const {
+  return batchDataset_ ? batchDataset_->size() : 0;
+}
+
+std::vector<af::array> BucketBatchDataset::get(const int64_t idx) const {
+  checkIndexBounds(idx);
+  return batchDataset_->get(idx);
+}
+
+void BucketBatchDataset::resample() {
+  auto result = bucketPartitionByRoundRobin(
+      samplesSize_,
+      partitionId_,
+      numPartitions_,
+      maxSizePerBatch_,
+      numBuckets_,
+      rng_(),
+      allowEmpty_,
+      partitionWeights_);
+  if (result.second.empty()) {
+    batchDataset_.reset();
+    return;
+  }
+  auto partitionDs =
+      std::make_shared<ResampleDataset>(dataset_, std::move(result.first));
+  batchDataset_ =
+      std::make_shared<BatchDataset>(partitionDs, result.second, batchFns_);
+}
+
+void BucketBatchDataset::setSeed(int seed) {
+  rng_.seed(seed);
+}
+
+void BucketBatchDataset::setPartitionWeights(std::vector<double> weights) {
+  partitionWeights_ = std::move(weights);
+}
+
+} // namespace fl
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <random>
+
+#include "flashlight/fl/dataset/BatchDataset.h"
+#include "flashlight/fl/dataset/ResampleDataset.h"
+
+namespace fl {
+
+/**
+ * A view into a dataset where samples of similar lengths are packed into
+ * batches of at most `maxSizePerBatch` tokens (padding included), see
+ * bucketPartitionByRoundRobin(). Batches are distributed so that all the
+ * partitions get batches of the same bucket at each step.
+ *
+ * Example:
+  \code{.cpp}
+  // Samples of lengths 1 to 100
+  std::vector<float> sizes(100);
+  std::iota(sizes.begin(), sizes.end(), 1);
+
+  // 4 length buckets, batches of at most 200 tokens, a single partition
+  BucketBatchDataset batchds(ds, sizes, 0, 1, 200, 4);
+  // Rebuild the buckets and the batches for a new epoch
+  batchds.resample();
+  \endcode
+ */
+class BucketBatchDataset : public Dataset {
+ public:
+  /**
+   * Creates a `BucketBatchDataset`.
+   * @param[in] dataset The underlying dataset.
+   * @param[in] samplesSize The samples lengths in tokens.
+   * @param[in] partitionId Rank of the current partition.
+   * @param[in] numPartitions Total number of partitions.
+   * @param[in] maxSizePerBatch Maximum number of tokens in a batch.
+   * @param[in] numBuckets Number of length buckets.
+   * @param[in] batchfns Custom batch function to use for difference indices.
+   * @param[in] allowEmpty Whether partitions can miss the last batches.
+   * @param[in] seed Initial seed, which must be the same on all partitions.
+   */
+  BucketBatchDataset(
+      std::shared_ptr<const Dataset> dataset,
+      std::vector<float> samplesSize,
+      int64_t partitionId,
+      int64_t numPartitions,
+      int64_t maxSizePerBatch,
+      int64_t numBuckets,
+      const std::vector<BatchFunction>& batchfns = {},
+      bool allowEmpty = false,
+      int seed = 0);
+
+  int64_t size() const override;
+
+  std::vector<af::array> get(const int64_t idx) const override;
+
+  /**
+   * Shuffles the samples within their buckets and the order of the batches.
+   */
+  void resample();
+
+  /**
+   * Sets the PRNG seed.
+   * @param[in] seed The desired seed.
+   */
+  void setSeed(int seed);
+
+  /**
+   * Sets the weights of the partitions for the next `resample()`, see
+   * bucketPartitionByRoundRobin(). They must be the same on all partitions.
+   * @param[in] weights A positive weight per partition, or empty.
+   */
+  void setPartitionWeights(std::vector<double> weights);
+
+ private:
+  std::shared_ptr<const Dataset> dataset_;
+  std::vector<float> samplesSize_;
+  int64_t partitionId_;
+  int64_t numPartitions_;
+  int64_t maxSizePerBatch_;
+  int64_t numBuckets_;
+  std::vector<BatchFunction> batchFns_;
+  bool allowEmpty_;
+  std::vector<double> partitionWeights_;
+  std::mt19937_64 rng_;
+
+  // Null when the partition has no batch
+  std::shared_ptr<BatchDataset> batchDataset_;
+};
+
+} // namespace fl
@@ -0,0 +1,230 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/dataset/CacheDataset.h"
+
+#include <stdexcept>
+
+#include "flashlight/fl/dataset/DeviceStaging.h"
+
+namespace fl {
+
+double CacheDatasetStats::hitRate() const {
+  auto total = hits + spillHits + misses;
+  return total > 0 ? static_cast<double>(hits + spillHits) / total : 0.0;
+}
+
+CacheDataset::CacheDataset(
+    std::shared_ptr<const Dataset> dataset,
+    const CacheDatasetOptions& options /* = CacheDatasetOptions() */)
+    : dataset_(dataset), options_(options) {
+  if (!dataset_) {
+    throw std::invalid_argument("CacheDataset: dataset is null");
+  }
+  if (!options_.spillPath.empty()) {
+    spillStream_.open(
+        options_.spillPath,
+        std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!spillStream_) {
+      throw std::runtime_error(
+          "CacheDataset: could not open " + options_.spillPath);
+    }
+  }
+}
+
+int64_t CacheDataset::size() const {
+  return dataset_->size();
+}
+
+std::vector<af::array> CacheDataset::get(const int64_t idx) const {
+  checkIndexBounds(idx);
+  CachedSample cached;
+  bool inMemory = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = cache_.find(idx);
+    if (it != cache_.end()) {
+      lru_.splice(lru_.begin(), lru_, it->second.lru);
+      ++stats_.hits;
+      // Arrays and host buffers are shared: they're uploaded out of the lock
+      cached.arrays = it->second.arrays;
+      inMemory = true;
+    }
+  }
+  if (inMemory) {
+    return fromMemory(cached);
+  }
+
+  std::vector<af::array> sample;
+  bool inSpill = false;
+  std::vector<SpilledArray> spilled;
+  if (!options_.spillPath.empty()) {
+    std::lock_guard<std::mutex> lock(spillMutex_);
+    auto it = spilled_.find(idx);
+    if (it != spilled_.end()) {
+      spilled = it->second;
+      inSpill = true;
+    }
+  }
+  if (inSpill) {
+    sample = fromSpill(spilled);
+  } else {
+    sample = dataset_->get(idx);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (inSpill) {
+      ++stats_.spillHits;
+    } else {
+      ++stats_.misses;
+    }
+  }
+
+  for (const auto& evicted : insert(idx, sample)) {
+    spill(evicted.first, evicted.second);
+  }
+  return sample;
+}
+
+CacheDatasetStats CacheDataset::stats() const {
+  CacheDatasetStats stats;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats = stats_;
+  }
+  std::lock_guard<std::mutex> lock(spillMutex_);
+  stats.spillBytes = spillOffset_;
+  return stats;
+}
+
+void CacheDataset::resetStats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.hits = 0;
+  stats_.spillHits = 0;
+  stats_.misses = 0;
+}
+
+std::vector<af::array> CacheDataset::fromMemory(
+    const CachedSample& sample) const {
+  std::vector<af::array> arrays;
+  for (const auto& array : sample.arrays) {
+    if (options_.device) {
+      arrays.push_back(array.device);
+    } else if (array.dims.elements() > 0) {
+      arrays.push_back(
+          hostToDevice(array.host->data(), array.dims, array.type));
+    } else {
+      arrays.push_back(af::array(array.dims, array.type));
+    }
+  }
+  return arrays;
+}
+
+std::vector<af::array> CacheDataset::fromSpill(
+    const std::vector<SpilledArray>& arrays) const {
+  std::ifstream stream(options_.spillPath, std::ios::in | std::ios::binary);
+  std::vector<af::array> sample;
+  std::vector<char> buffer;
+  for (const auto& array : arrays) {
+    int64_t bytes = array.dims.elements() * af::getSizeOf(array.type);
+    if (bytes == 0) {
+      sample.push_back(af::array(array.dims, array.type));
+      continue;
+    }
+    buffer.resize(bytes);
+    stream.seekg(array.offset);
+    stream.read(buffer.data(), bytes);
+    if (!stream) {
+      throw std::runtime_error(
+          "CacheDataset: could not read " + options_.spillPath);
+    }
+    sample.push_back(hostToDevice(buffer.data(), array.dims, array.type));
+  }
+  return sample;
+}
+
+std::vector<std::pair<int64_t, CacheDataset::CachedSample>>
+CacheDataset::insert(int64_t idx, const std::vector<af::array>& sample)
+    const {
+  CachedSample cached;
+  cached.bytes = 0;
+  for (const auto& array : sample) {
+    CachedArray entry;
+    entry.dims = array.dims();
+    entry.type = array.type();
+    if (options_.device) {
+      entry.device = array;
+    } else {
+      auto host = std::make_shared<std::vector<uint8_t>>(array.bytes());
+      if (!host->empty()) {
+        array.host(host->data());
+      }
+      entry.host = host;
+    }
+    cached.bytes += array.bytes();
+    cached.arrays.push_back(std::move(entry));
+  }
+
+  std::vector<std::pair<int64_t, CachedSample>> evicted;
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (cache_.find(idx) != cache_.end()) {
+    // Fetched concurrently by another get()
+    return evicted;
+  }
+  if (cached.bytes > options_.maxBytes) {
+    evicted.emplace_back(idx, std::move(cached));
+    return evicted;
+  }
+  lru_.push_front(idx);
+  cached.lru = lru_.begin();
+  stats_.bytes += cached.bytes;
+  cache_.emplace(idx, std::move(cached));
+  while (stats_.bytes > options_.maxBytes) {
+    auto it = cache_.find(lru_.back());
+    lru_.pop_back();
+    stats_.bytes -= it->second.bytes;
+    evicted.emplace_back(it->first, std::move(it->second));
+    cache_.erase(it);
+  }
+  return evicted;
+}
+
+void CacheDataset::spill(int64_t idx, const CachedSample& sample) const {
+  if (options_.spillPath.empty()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(spillMutex_);
+  if (spilled_.find(idx) != spilled_.end() ||
+      spillOffset_ + sample.bytes > options_.maxSpillBytes) {
+    return;
+  }
+  std::vector<SpilledArray> arrays;
+  std::vector<uint8_t> buffer;
+  for (const auto& array : sample.arrays) {
+    int64_t bytes = array.dims.elements() * af::getSizeOf(array.type);
+    const uint8_t* data = nullptr;
+    if (bytes > 0 && array.host) {
+      data = array.host->data();
+    } else if (bytes > 0) {
+      buffer.resize(bytes);
+      array.device.host(buffer.data());
+      data = buffer.data();
+    }
+    spillStream_.write(reinterpret_cast<const char*>(data), bytes);
+    arrays.push_back({array.dims, array.type, spillOffset_});
+    spillOffset_ += bytes;
+  }
+  // Visible to the streams of fromSpill()
+  spillStream_.flush();
+  if (!spillStream_) {
+    throw std::runtime_error(
+        "CacheDataset: could not write to " + options_.spillPath);
+  }
+  spilled_.emplace(idx, std::move(arrays));
+}
+
+} // namespace fl
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "flashlight/fl/dataset/Dataset.h"
+
+namespace fl {
+
+struct CacheDatasetOptions {
+  // Bytes of samples kept in memory, evicting the least recently used ones
+  int64_t maxBytes = 1LL << 30;
+  // If true, the samples are kept as arrays on the device, otherwise in host
+  // memory (uploaded with hostToDevice() on each get)
+  bool device = false;
+  // If not empty, file to which the samples evicted from memory are written,
+  // e.g. on a local SSD. The file is truncated.
+  std::string spillPath;
+  // Bytes of samples written to `spillPath`, after which the evicted samples
+  // are dropped
+  int64_t maxSpillBytes = 1LL << 34;
+};
+
+struct CacheDatasetStats {
+  int64_t hits = 0;
+  int64_t spillHits = 0;
+  int64_t misses = 0;
+  // Bytes currently in memory, and written to the spill file
+  int64_t bytes = 0;
+  int64_t spillBytes = 0;
+
+  // Fraction of the gets served from memory or from the spill file
+  double hitRate() const;
+};
+
+/**
+ * A view into a dataset which caches its samples, so that decoding and
+ * featurization are done once for several epochs. Samples are cached by
+ * their index in the underlying dataset, which must return the same sample
+ * for an index: CacheDataset goes below the random transforms (e.g. data
+ * augmentation), and below ShuffleDataset or ResampleDataset, whose remapped
+ * indices then hit the cache of the samples they point to.
+ *
+ * Example:
+  \code{.cpp}
+  // Featurize once, then shuffle the cached samples at each epoch
+  auto featurized = std::make_shared<TransformDataset>(audio, transforms);
+  CacheDatasetOptions options;
+  options.maxBytes = 4LL << 30;
+  options.spillPath = "/mnt/ssd/features.cache";
+  auto cached = std::make_shared<CacheDataset>(featurized, options);
+  auto shuffled = std::make_shared<ShuffleDataset>(cached);
+  \endcode
+ *
+ * get() is thread-safe, e.g. under a PrefetchDataset.
+ */
+class CacheDataset : public Dataset {
+ public:
+  explicit CacheDataset(
+      std::shared_ptr<const Dataset> dataset,
+      const CacheDatasetOptions& options = CacheDatasetOptions());
+
+  int64_t size() const override;
+
+  std::vector<af::array> get(const int64_t idx) const override;
+
+  CacheDatasetStats stats() const;
+
+  // Resets the counters of hits and misses
+  void resetStats();
+
+ private:
+  struct CachedArray {
+    af::array device;
+    // Shared with the gets which upload it
+    std::shared_ptr<const std::vector<uint8_t>> host;
+    af::dim4 dims;
+    af::dtype type;
+  };
+
+  struct CachedSample {
+    std::vector<CachedArray> arrays;
+    int64_t bytes;
+    std::list<int64_t>::iterator lru;
+  };
+
+  struct SpilledArray {
+    af::dim4 dims;
+    af::dtype type;
+    int64_t offset;
+  };
+
+  std::vector<af::array> fromMemory(const CachedSample& sample) const;
+  std::vector<af::array> fromSpill(
+      const std::vector<SpilledArray>& arrays) const;
+  // Inserts `sample` in memory, and returns the evicted samples
+  std::vector<std::pair<int64_t, CachedSample>> insert(
+      int64_t idx,
+      const std::vector<af::array>& sample) const;
+  void spill(int64_t idx, const CachedSample& sample) const;
+
+  std::shared_ptr<const Dataset> dataset_;
+  CacheDatasetOptions options_;
+
+  // Most recently used samples first
+  mutable std::list<int64_t> lru_;
+  mutable std::unordered_map<int64_t, CachedSample> cache_;
+  mutable CacheDatasetStats stats_;
+  mutable std::mutex mutex_;
+
+  mutable std::unordered_map<int64_t, std::vector<SpilledArray>> spilled_;
+  mutable std::ofstream spillStream_;
+  mutable int64_t spillOffset_{0};
+  mutable std::mutex spillMutex_;
+};
+
+} // namespace fl
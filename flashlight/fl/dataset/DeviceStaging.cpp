@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/dataset/DeviceStaging.h"
+
+namespace fl {
+
+namespace {
+
+std::shared_ptr<DeviceStaging>& threadStaging() {
+  static thread_local std::shared_ptr<DeviceStaging> staging;
+  return staging;
+}
+
+} // namespace
+
+void DeviceStaging::setThreadStaging(std::shared_ptr<DeviceStaging> staging) {
+  threadStaging() = std::move(staging);
+}
+
+af::array
+hostToDevice(const void* data, const af::dim4& dims, af::dtype type) {
+  auto& staging = threadStaging();
+  if (staging) {
+    return staging->upload(data, dims, type);
+  }
+  return detail::createArray(data, dims, type);
+}
+
+namespace detail {
+
+af::array createArray(const void* data, const af::dim4& dims, af::dtype type) {
+  af_array c_array;
+  af_err status =
+      af_create_array(&c_array, data, dims.ndims(), dims.get(), type);
+  if (status != AF_SUCCESS) {
+    throw af::exception("unable to create array", __FILE__, __LINE__, status);
+  }
+  return af::array(c_array);
+}
+
+} // namespace detail
+
+} // namespace fl
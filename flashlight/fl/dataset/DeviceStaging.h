@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <memory>
+
+#include <arrayfire.h>
+
+namespace fl {
+
+/**
+ * Uploads host data to the device through a pool of pinned host staging
+ * buffers and a dedicated copy stream.
+ *
+ * The host-to-device copy of each upload is done asynchronously on the copy
+ * stream, and overlaps with the computation queued on the ArrayFire stream,
+ * which only waits for it through a (fast) device-to-device copy into the
+ * returned array. The calling thread only blocks when all the staging
+ * buffers are in use.
+ *
+ * With backends other than CUDA, arrays are created directly from the host
+ * data.
+ */
+class DeviceStaging {
+ public:
+  /**
+   * Creates a `DeviceStaging` uploading to the current device.
+   * @param[in] numBuffers Number of staging buffers, i.e. maximum number of
+   * uploads in flight.
+   */
+  explicit DeviceStaging(int64_t numBuffers);
+
+  ~DeviceStaging();
+
+  DeviceStaging(const DeviceStaging&) = delete;
+  DeviceStaging& operator=(const DeviceStaging&) = delete;
+
+  /**
+   * Creates an array from host data. The array can be used right away on the
+   * ArrayFire stream; the host data can be released on return.
+   * @param[in] data Host data.
+   * @param[in] dims Dimensions of the array.
+   * @param[in] type Type of the array.
+   */
+  af::array upload(const void* data, const af::dim4& dims, af::dtype type);
+
+  /**
+   * Sets the staging used by hostToDevice() on the calling thread.
+   * @param[in] staging The staging, or nullptr to create arrays directly.
+   */
+  static void setThreadStaging(std::shared_ptr<DeviceStaging> staging);
+
+ private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+namespace detail {
+
+/// Creates an array from host data with ArrayFire.
+af::array createArray(const void* data, const af::dim4& dims, af::dtype type);
+
+} // namespace detail
+
+/**
+ * Creates an array from host data, through the staging of the calling thread
+ * if any (see DeviceStaging::setThreadStaging()).
+ * @param[in] data Host data.
+ * @param[in] dims Dimensions of the array.
+ * @param[in] type Type of the array.
+ */
+af::array hostToDevice(const void* data, const af::dim4& dims, af::dtype type);
+
+/**
+ * Creates an array from a host buffer, through the staging of the calling
+ * thread if any (see DeviceStaging::setThreadStaging()).
+ * @param[in] dims Dimensions of the array.
+ * @param[in] data Host data.
+ */
+template <typename T>
+af::array hostToDevice(const af::dim4& dims, const T* data) {
+  return hostToDevice(
+      data, dims, static_cast<af::dtype>(af::dtype_traits<T>::af_type));
+}
+
+} // namespace fl
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/dataset/LazyShuffleDataset.h"
+
+#include <stdexcept>
+
+namespace fl {
+
+namespace {
+
+// splitmix64 finalizer, the round function of the Feistel network
+uint64_t mix(uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+} // namespace
+
+LazyShuffleDataset::LazyShuffleDataset(
+    std::shared_ptr<const Dataset> dataset,
+    int seed /* = 0 */)
+    : dataset_(dataset), rng_(seed) {
+  if (!dataset_) {
+    throw std::invalid_argument("LazyShuffleDataset: dataset is null");
+  }
+  size_ = dataset_->size();
+  int bits = 0;
+  while ((int64_t(1) << bits) < size_) {
+    ++bits;
+  }
+  halfBits_ = (bits + 1) / 2;
+  resample();
+}
+
+int64_t LazyShuffleDataset::size() const {
+  return size_;
+}
+
+std::vector<af::array> LazyShuffleDataset::get(const int64_t idx) const {
+  checkIndexBounds(idx);
+  return dataset_->get(permute(idx));
+}
+
+void LazyShuffleDataset::resample() {
+  for (auto& key : keys_) {
+    key = rng_();
+  }
+}
+
+void LazyShuffleDataset::setSeed(int seed) {
+  rng_.seed(seed);
+}
+
+int64_t LazyShuffleDataset::permute(int64_t idx) const {
+  const uint64_t mask = (uint64_t(1) << halfBits_) - 1;
+  uint64_t x = idx;
+  // Cycle walking: the bijection of the superset is iterated until it's back
+  // in [0, size_), less than 4 times on average as the superset is less than
+  // 4 times larger
+  do {
+    uint64_t left = x >> halfBits_;
+    uint64_t right = x & mask;
+    for (auto key : keys_) {
+      auto next = left ^ (mix(right ^ key) & mask);
+      left = right;
+      right = next;
+    }
+    x = (left << halfBits_) | right;
+  } while (x >= static_cast<uint64_t>(size_));
+  return x;
+}
+
+} // namespace fl
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <array>
+#include <random>
+
+#include "flashlight/fl/dataset/Dataset.h"
+
+namespace fl {
+
+/**
+ * A view into a dataset, with indices permuted randomly like
+ * ShuffleDataset, but without storing the permutation: indices are mapped
+ * on the fly by a keyed bijection (a Feistel network, cycle-walked to the
+ * size of the dataset), which needs constant memory for datasets of any size.
+ * A mapping costs a few hashes.
+ *
+ * Example:
+  \code{.cpp}
+  // A corpus of 100M samples, reshuffled at each epoch
+  LazyShuffleDataset shuffleds(corpus, seed);
+  for (int epoch = 0; epoch < nEpochs; ++epoch) {
+    shuffleds.resample();
+    for (auto& sample : shuffleds) {
+      // ...
+    }
+  }
+  \endcode
+ */
+class LazyShuffleDataset : public Dataset {
+ public:
+  /**
+   * Creates a `LazyShuffleDataset`.
+   * @param[in] dataset The underlying dataset.
+   * @param[in] seed Initial seed.
+   */
+  explicit LazyShuffleDataset(
+      std::shared_ptr<const Dataset> dataset,
+      int seed = 0);
+
+  int64_t size() const override;
+
+  std::vector<af::array> get(const int64_t idx) const override;
+
+  /**
+   * Draws new keys, i.e. a new random permutation for the dataset.
+   */
+  void resample();
+
+  /**
+   * Sets the PRNG seed.
+   * @param[in] seed The desired seed.
+   */
+  void setSeed(int seed);
+
+  /**
+   * Returns the index of the underlying dataset to which `idx` is mapped.
+   */
+  int64_t permute(int64_t idx) const;
+
+ private:
+  static constexpr int kRounds = 4;
+
+  std::shared_ptr<const Dataset> dataset_;
+  int64_t size_;
+  // The bijection is on [0, 2^(2 * halfBits_)), a superset of [0, size_)
+  int halfBits_;
+  std::array<uint64_t, kRounds> keys_;
+  std::mt19937_64 rng_;
+};
+
+} // namespace fl
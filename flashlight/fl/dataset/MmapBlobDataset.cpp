@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/dataset/MmapBlobDataset.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fl {
+
+MmapBlobDataset::MmapBlobDataset(const std::string& name, bool sequential)
+    : name_(name) {
+#ifdef _WIN32
+  throw std::runtime_error("MmapBlobDataset is not supported on Windows");
+#else
+  int fd = ::open(name_.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("could not open file " + name);
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    ::close(fd);
+    throw std::runtime_error("could not stat file " + name);
+  }
+  size_ = st.st_size;
+  if (size_ > 0) {
+    void* addr = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+      ::close(fd);
+      throw std::runtime_error("could not map file " + name);
+    }
+    data_ = static_cast<const char*>(addr);
+  }
+  // The mapping stays valid after closing the descriptor
+  ::close(fd);
+  advise(0, size_, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+#endif
+  readIndex();
+}
+
+std::vector<af::array> MmapBlobDataset::get(const int64_t idx) const {
+  std::shared_ptr<const AccessOrder> accessOrder;
+  {
+    std::lock_guard<std::mutex> lock(accessOrderMutex_);
+    accessOrder = accessOrder_;
+  }
+  if (accessOrder && idx >= 0 && idx < accessOrder->position.size()) {
+    auto pos = accessOrder->position[idx];
+    if (pos >= 0) {
+      // Previous samples already prefetched all but the last one
+      auto first = pos == 0 ? 1 : pos + accessOrder->lookahead;
+      auto last = std::min<int64_t>(
+          pos + accessOrder->lookahead, accessOrder->order.size() - 1);
+      for (auto i = first; i <= last; i++) {
+        prefetchSample(accessOrder->order[i]);
+      }
+    }
+  }
+  return BlobDataset::get(idx);
+}
+
+std::vector<BlobDatasetSpan> MmapBlobDataset::rawGetSpans(
+    const int64_t idx) const {
+  std::vector<BlobDatasetSpan> sample;
+  for (const auto& e : getEntries(idx)) {
+    if (e.compression != BlobCompression::None) {
+      throw std::invalid_argument(
+          "MmapBlobDataset::rawGetSpans - sample " + std::to_string(idx) +
+          " is compressed");
+    }
+    int64_t size = e.storedBytes;
+    sample.push_back(
+        {reinterpret_cast<const uint8_t*>(mappedData(e.offset, size)), size});
+  }
+  return sample;
+}
+
+void MmapBlobDataset::prefetch(const std::vector<int64_t>& indices) const {
+  for (auto idx : indices) {
+    prefetchSample(idx);
+  }
+}
+
+void MmapBlobDataset::setAccessOrder(
+    const std::vector<int64_t>& order,
+    int64_t lookahead) {
+  if (lookahead < 0) {
+    throw std::invalid_argument("lookahead must be non-negative");
+  }
+  std::shared_ptr<AccessOrder> accessOrder;
+  if (lookahead > 0 && !order.empty()) {
+    accessOrder = std::make_shared<AccessOrder>();
+    accessOrder->order = order;
+    accessOrder->position.assign(size(), -1);
+    for (int64_t i = 0; i < order.size(); i++) {
+      if (order[i] < 0 || order[i] >= size()) {
+        throw std::out_of_range("access order index out of range");
+      }
+      accessOrder->position[order[i]] = i;
+    }
+    accessOrder->lookahead = lookahead;
+  }
+  {
+    std::lock_guard<std::mutex> lock(accessOrderMutex_);
+    accessOrder_ = accessOrder;
+  }
+}
+
+int64_t MmapBlobDataset::writeData(
+    int64_t /* offset */,
+    const char* /* data */,
+    int64_t /* size */) const {
+  throw std::runtime_error("MmapBlobDataset is read-only");
+}
+
+int64_t MmapBlobDataset::readData(int64_t offset, char* data, int64_t size)
+    const {
+  std::memcpy(data, mappedData(offset, size), size);
+  return size;
+}
+
+const char* MmapBlobDataset::mappedData(int64_t offset, int64_t size) const {
+  if (offset < 0 || size < 0 || offset + size > size_) {
+    throw std::out_of_range("read beyond the end of blob " + name_);
+  }
+  return data_ + offset;
+}
+
+void MmapBlobDataset::flushData() {}
+
+bool MmapBlobDataset::isEmptyData() const {
+  return size_ == 0;
+}
+
+void MmapBlobDataset::advise(int64_t offset, int64_t size, int advice) const {
+#ifndef _WIN32
+  if (size <= 0) {
+    return;
+  }
+  // madvise() needs page-aligned addresses
+  static const int64_t pageSize = ::sysconf(_SC_PAGESIZE);
+  int64_t begin = offset / pageSize * pageSize;
+  // Hints are best-effort, failures are ignored
+  ::madvise(const_cast<char*>(data_) + begin, offset + size - begin, advice);
+#endif
+}
+
+void MmapBlobDataset::prefetchSample(int64_t idx) const {
+#ifndef _WIN32
+  if (idx < 0 || idx >= size()) {
+    return;
+  }
+  for (const auto& e : getEntries(idx)) {
+    advise(e.offset, e.storedBytes, MADV_WILLNEED);
+  }
+#endif
+}
+
+MmapBlobDataset::~MmapBlobDataset() {
+#ifndef _WIN32
+  if (data_) {
+    ::munmap(const_cast<char*>(data_), size_);
+  }
+#endif
+}
+
+} // namespace fl
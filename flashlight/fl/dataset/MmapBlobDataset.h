@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include "flashlight/fl/dataset/BlobDataset.h"
+
+#include <memory>
+#include <mutex>
+
+namespace fl {
+
+/**
+ * A read-only view on raw data stored in a memory-mapped blob.
+ */
+struct BlobDatasetSpan {
+  const uint8_t* data;
+  int64_t size;
+};
+
+/**
+ * A read-only BlobDataset on a memory-mapped file.
+ *
+ * Arrays are created directly from the mapped pages, without going through
+ * an intermediate host buffer, and rawGetSpans() gives access to the raw
+ * data without any copy. Pages are loaded lazily by the OS and shared by all
+ * the processes mapping the same blob.
+ *
+ * The kernel readahead is disabled by default, as samples are usually read
+ * in random order: setAccessOrder() lets the dataset prefetch the next
+ * samples of the sampler order instead.
+ */
+class MmapBlobDataset : public BlobDataset {
+ public:
+  /**
+   * Creates a `MmapBlobDataset`, specifying a blob file name. The blob must
+   * have been written with writeIndex().
+   * @param[in] name A blob file name.
+   * @param[in] sequential If true, samples are expected to be read in order
+   * and the kernel readahead is kept.
+   */
+  explicit MmapBlobDataset(const std::string& name, bool sequential = false);
+
+  virtual ~MmapBlobDataset() override;
+
+  std::vector<af::array> get(const int64_t idx) const override;
+
+  /**
+   * Return views on the raw data stored in given sample, valid for the
+   * lifetime of the dataset. Dimensions and types of each array can be
+   * retrieved with getEntries(). Throws if the sample is compressed.
+   * @param[in] idx An index in the dataset.
+   */
+  std::vector<BlobDatasetSpan> rawGetSpans(const int64_t idx) const;
+
+  /**
+   * Hint the OS to read the pages of given samples ahead of time.
+   * @param[in] indices Indices in the dataset.
+   */
+  void prefetch(const std::vector<int64_t>& indices) const;
+
+  /**
+   * Set the order in which samples will be read (e.g. the permutation of a
+   * ShuffleDataset). Each get() then prefetches the `lookahead` samples
+   * following the current one in that order.
+   * @param[in] order Indices in the dataset, in reading order.
+   * @param[in] lookahead Number of samples to prefetch. 0 disables
+   * prefetching.
+   */
+  void setAccessOrder(const std::vector<int64_t>& order, int64_t lookahead);
+
+ protected:
+  int64_t writeData(int64_t offset, const char* data, int64_t size)
+      const override;
+  int64_t readData(int64_t offset, char* data, int64_t size) const override;
+  const char* mappedData(int64_t offset, int64_t size) const override;
+  void flushData() override;
+  bool isEmptyData() const override;
+
+ private:
+  struct AccessOrder {
+    std::vector<int64_t> order;
+    // Position of each sample in `order`, -1 if absent
+    std::vector<int64_t> position;
+    int64_t lookahead;
+  };
+
+  std::string name_;
+  const char* data_{nullptr};
+  int64_t size_{0};
+
+  std::shared_ptr<const AccessOrder> accessOrder_;
+  mutable std::mutex accessOrderMutex_;
+
+  void advise(int64_t offset, int64_t size, int advice) const;
+  void prefetchSample(int64_t idx) const;
+};
+
+} // namespace fl
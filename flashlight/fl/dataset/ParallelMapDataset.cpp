@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/dataset/ParallelMapDataset.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "flashlight/fl/common/Trace.h"
+
+namespace fl {
+
+namespace {
+
+// Index of the worker running on the calling thread
+thread_local int tlsWorker = 0;
+
+// Finalizer of SplitMix64, which spreads consecutive inputs
+uint64_t mix(uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+} // namespace
+
+ParallelMapDataset::ParallelMapDataset(
+    std::shared_ptr<const Dataset> dataset,
+    const TransformFactory& factory,
+    int64_t numThreads,
+    int64_t prefetchSize,
+    uint64_t seed /* = 0 */)
+    : dataset_(dataset),
+      numThreads_(numThreads),
+      prefetchSize_(prefetchSize),
+      seed_(seed) {
+  if (!dataset_) {
+    throw std::invalid_argument("ParallelMapDataset: dataset is null");
+  }
+  if (!factory) {
+    throw std::invalid_argument("ParallelMapDataset: factory is null");
+  }
+  if (!(numThreads_ > 0 && prefetchSize_ > 0) &&
+      !(numThreads_ == 0 && prefetchSize_ == 0)) {
+    throw std::invalid_argument(
+        "ParallelMapDataset: invalid numThreads or prefetchSize");
+  }
+  for (int64_t i = 0; i < std::max<int64_t>(numThreads_, 1); ++i) {
+    transforms_.push_back(factory());
+  }
+  if (numThreads_ > 0) {
+    auto deviceId = af::getDevice();
+    threadPool_ = std::make_unique<ThreadPool>(
+        numThreads_, [deviceId](int threadId) {
+          af::setDevice(deviceId);
+          tlsWorker = threadId;
+          Tracer::setThreadName(
+              "ParallelMapDataset worker " + std::to_string(threadId));
+        });
+  }
+}
+
+int64_t ParallelMapDataset::size() const {
+  return dataset_->size();
+}
+
+std::vector<af::array> ParallelMapDataset::get(const int64_t idx) const {
+  checkIndexBounds(idx);
+
+  if (numThreads_ == 0) {
+    return transform(idx, epoch_, 0);
+  }
+
+  // Restart prefetching on non-sequential access
+  if (idx != curIdx_) {
+    prefetchCache_ = {};
+  }
+  while (prefetchCache_.size() < prefetchSize_) {
+    auto fetchIdx = idx + prefetchCache_.size();
+    if (fetchIdx >= size()) {
+      break;
+    }
+    prefetchCache_.emplace(
+        threadPool_->enqueue([this, fetchIdx, epoch = epoch_]() {
+          return transform(fetchIdx, epoch, tlsWorker);
+        }));
+  }
+
+  auto sample = prefetchCache_.front().get();
+  prefetchCache_.pop();
+  curIdx_ = idx + 1;
+  return sample;
+}
+
+void ParallelMapDataset::setEpoch(int64_t epoch) {
+  // Prefetched samples have the seeds of the previous epoch
+  prefetchCache_ = {};
+  curIdx_ = -1;
+  epoch_ = epoch;
+}
+
+std::vector<af::array>
+ParallelMapDataset::transform(int64_t idx, int64_t epoch, int worker) const {
+  FL_TRACE(DATA, "ParallelMapDataset::transform");
+  auto seed = mix(mix(mix(seed_) ^ epoch) ^ idx);
+  return transforms_[worker](dataset_->get(idx), seed);
+}
+
+} // namespace fl
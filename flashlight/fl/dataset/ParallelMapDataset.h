@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <future>
+#include <memory>
+#include <queue>
+
+#include "flashlight/fl/common/threadpool/ThreadPool.h"
+#include "flashlight/fl/dataset/Dataset.h"
+
+namespace fl {
+
+/**
+ * A view into a dataset whose samples are transformed in background threads,
+ * prefetching `prefetchSize` samples in advance as PrefetchDataset does.
+ *
+ * Unlike the functions of TransformDataset, the transforms don't need to be
+ * re-entrant: each worker thread has its own instance, created by the given
+ * factory, so stateful transforms (e.g. sound effect chains or SpecAugment)
+ * keep their state per thread. Each sample is transformed with a seed, from
+ * which all its randomness must derive, computed from the seed of the
+ * dataset, the epoch and the index of the sample: outputs don't depend on the
+ * number of threads nor on their scheduling.
+ *
+ * Access should be sequential: put ShuffleDataset below, and BatchDataset
+ * above, with a `prefetchSize` of a few batches.
+ *
+ * Example:
+  \code{.cpp}
+  auto factory = []() {
+    // One engine per thread, reseeded for each sample
+    auto engine = std::make_shared<std::mt19937>();
+    return [engine](std::vector<af::array> sample, uint64_t seed) {
+      engine->seed(seed);
+      std::uniform_real_distribution<float> gain(0.5, 2.0);
+      sample[0] = sample[0] * gain(*engine);
+      return sample;
+    };
+  };
+  auto mapped = std::make_shared<ParallelMapDataset>(
+      std::make_shared<ShuffleDataset>(ds), factory, 8, 4 * batchSize);
+  auto batched = std::make_shared<BatchDataset>(mapped, batchSize);
+  for (int epoch = 0; epoch < nEpochs; ++epoch) {
+    mapped->setEpoch(epoch);
+    for (auto& batch : *batched) {
+      // ...
+    }
+  }
+  \endcode
+ */
+class ParallelMapDataset : public Dataset {
+ public:
+  using SampleTransform = std::function<
+      std::vector<af::array>(std::vector<af::array>, uint64_t /* seed */)>;
+  // Creates the transform instance of a worker thread
+  using TransformFactory = std::function<SampleTransform()>;
+
+  /**
+   * Creates a `ParallelMapDataset`.
+   * @param[in] dataset The underlying dataset.
+   * @param[in] factory Creates the transform of each worker thread.
+   * @param[in] numThreads Number of worker threads. If 0, samples are
+   * transformed in get().
+   * @param[in] prefetchSize Number of samples transformed in advance.
+   * @param[in] seed Seed of the transforms, combined with the epoch and the
+   * index of each sample.
+   */
+  ParallelMapDataset(
+      std::shared_ptr<const Dataset> dataset,
+      const TransformFactory& factory,
+      int64_t numThreads,
+      int64_t prefetchSize,
+      uint64_t seed = 0);
+
+  int64_t size() const override;
+
+  std::vector<af::array> get(const int64_t idx) const override;
+
+  /**
+   * Sets the epoch of the following gets, so that the random transforms
+   * differ between epochs. Discards the prefetched samples.
+   */
+  void setEpoch(int64_t epoch);
+
+ private:
+  std::vector<af::array> transform(int64_t idx, int64_t epoch, int worker)
+      const;
+
+  std::shared_ptr<const Dataset> dataset_;
+  int64_t numThreads_, prefetchSize_;
+  uint64_t seed_;
+  int64_t epoch_{0};
+  // One instance per worker, or a single one without threads
+  std::vector<SampleTransform> transforms_;
+  // Destroyed before the transforms, which its remaining tasks use
+  std::unique_ptr<ThreadPool> threadPool_;
+
+  mutable std::queue<std::future<std::vector<af::array>>> prefetchCache_;
+  mutable int64_t curIdx_{-1};
+};
+
+} // namespace fl
@@ -5,10 +5,14 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <algorithm>
+#include <chrono>
 #include <memory>
 #include <stdexcept>
 
+#include "flashlight/fl/common/Init.h"
 #include "flashlight/fl/common/Serialization.h"
+#include "flashlight/fl/common/Trace.h"
 #include "flashlight/fl/dataset/PrefetchDataset.h"
 
 namespace fl {
@@ -16,10 +20,15 @@ namespace fl {
 PrefetchDataset::PrefetchDataset(
     std::shared_ptr<const Dataset> dataset,
     int64_t numThreads,
-    int64_t prefetchSize)
+    int64_t prefetchSize,
+    bool deviceStaging,
+    int64_t reorderWindow,
+    ThreadAffinity affinity)
     : dataset_(dataset),
       numThreads_(numThreads),
       prefetchSize_(prefetchSize),
+      reorderWindow_(reorderWindow),
+      nextFetchIdx_(-1),
       curIdx_(-1) {
   if (!dataset_) {
     throw std::invalid_argument("dataset to be prefetched is null");
@@ -28,11 +37,31 @@ PrefetchDataset::PrefetchDataset(
       !(numThreads_ == 0 && prefetchSize_ == 0)) {
     throw std::invalid_argument("invalid numThreads or prefetchSize");
   }
+  if (reorderWindow_ < 0) {
+    throw std::invalid_argument("invalid reorderWindow");
+  }
   if (numThreads_ > 0) {
     auto deviceId = af::getDevice();
-    threadPool_ = std::make_unique<ThreadPool>(
-        numThreads_,
-        [deviceId](int /* threadId */) { af::setDevice(deviceId); });
+    if (deviceStaging) {
+      // Each sample usually has a few large arrays, leave some headroom
+      staging_ = std::make_shared<DeviceStaging>(4 * prefetchSize_);
+    }
+    auto staging = staging_;
+    auto initFn = [deviceId, staging](int threadId) {
+      af::setDevice(deviceId);
+      DeviceStaging::setThreadStaging(staging);
+      Tracer::setThreadName(
+          "PrefetchDataset worker " + std::to_string(threadId));
+    };
+    // On the data CPUs of the thread budget, if set
+    auto cpus = getThreadBudget().dataCpus;
+    if (reorderWindow_ > 0 || affinity != ThreadAffinity::None ||
+        !cpus.empty()) {
+      stealingPool_ = std::make_unique<WorkStealingThreadPool>(
+          numThreads_, initFn, affinity, cpus);
+    } else {
+      threadPool_ = std::make_unique<ThreadPool>(numThreads_, initFn);
+    }
   }
 }
 
@@ -40,8 +69,12 @@ std::vector<af::array> PrefetchDataset::get(int64_t idx) const {
   checkIndexBounds(idx);
 
   if (numThreads_ == 0) {
+    curIdx_ = idx + 1;
     return dataset_->get(idx);
   }
+  if (reorderWindow_ > 0) {
+    return getOutOfOrder(idx);
+  }
 
   // remove from cache (if necessary)
   while (!prefetchCache_.empty() && idx != curIdx_) {
@@ -55,11 +88,22 @@ std::vector<af::array> PrefetchDataset::get(int64_t idx) const {
     if (fetchIdx >= size()) {
       break;
     }
-    prefetchCache_.emplace(threadPool_->enqueue(
-        [this, fetchIdx]() { return this->dataset_->get(fetchIdx); }));
+    auto fetch = [this, fetchIdx]() {
+      FL_TRACE(DATA, "PrefetchDataset::fetch");
+      return this->dataset_->get(fetchIdx);
+    };
+    prefetchCache_.emplace(
+        threadPool_ ? threadPool_->enqueue(fetch)
+                    : stealingPool_->enqueue(fetch));
   }
 
+  FL_TRACE(DATA, "PrefetchDataset::wait");
+  auto start = std::chrono::steady_clock::now();
   auto curSample = prefetchCache_.front().get();
+  lastWaitTime_ = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+  totalWaitTime_ += lastWaitTime_;
 
   prefetchCache_.pop();
   curIdx_ = idx + 1;
@@ -69,4 +113,117 @@ std::vector<af::array> PrefetchDataset::get(int64_t idx) const {
 int64_t PrefetchDataset::size() const {
   return dataset_->size();
 }
+
+std::vector<af::array> PrefetchDataset::getOutOfOrder(int64_t idx) const {
+  // Restart prefetching on non-sequential access
+  if (idx != curIdx_) {
+    reorderCache_.clear();
+    ready_ = std::make_shared<ReadySamples>();
+    nextFetchIdx_ = idx;
+  }
+
+  while (reorderCache_.size() < prefetchSize_ && nextFetchIdx_ < size()) {
+    fetchOutOfOrder(nextFetchIdx_++);
+  }
+
+  FL_TRACE(DATA, "PrefetchDataset::wait");
+  auto start = std::chrono::steady_clock::now();
+  int64_t sampleIdx;
+  {
+    std::unique_lock<std::mutex> lock(ready_->mutex);
+    auto oldestIdx = reorderCache_.begin()->first;
+    if (idx - oldestIdx >= reorderWindow_) {
+      // The oldest sample is late enough, wait for it
+      ready_->cv.wait(
+          lock, [&]() { return ready_->indices.count(oldestIdx) > 0; });
+      sampleIdx = oldestIdx;
+    } else {
+      ready_->cv.wait(lock, [&]() { return !ready_->indices.empty(); });
+      sampleIdx = *ready_->indices.begin();
+    }
+    ready_->indices.erase(sampleIdx);
+  }
+  auto cacheIt = reorderCache_.find(sampleIdx);
+  // Ends waiting for the task to store its result
+  auto sample = cacheIt->second.get();
+  reorderCache_.erase(cacheIt);
+  lastWaitTime_ = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+  totalWaitTime_ += lastWaitTime_;
+
+  curIdx_ = idx + 1;
+  return sample;
+}
+
+void PrefetchDataset::fetchOutOfOrder(int64_t fetchIdx) const {
+  auto ready = ready_;
+  reorderCache_.emplace(
+      fetchIdx, stealingPool_->enqueue([this, fetchIdx, ready]() {
+        // Signal readiness even if get() throws
+        struct Notifier {
+          ReadySamples& ready;
+          int64_t idx;
+          ~Notifier() {
+            {
+              std::lock_guard<std::mutex> lock(ready.mutex);
+              ready.indices.insert(idx);
+            }
+            ready.cv.notify_one();
+          }
+        } notifier{*ready, fetchIdx};
+        FL_TRACE(DATA, "PrefetchDataset::fetch");
+        return this->dataset_->get(fetchIdx);
+      }));
+}
+
+PrefetchDataset::State PrefetchDataset::getState() const {
+  State state;
+  state.cursor = std::max<int64_t>(curIdx_, 0);
+  state.nextFetch = state.cursor;
+  if (reorderWindow_ > 0 && numThreads_ > 0 && curIdx_ >= 0) {
+    state.nextFetch = nextFetchIdx_;
+    for (const auto& sample : reorderCache_) {
+      state.inFlight.push_back(sample.first);
+    }
+  }
+  return state;
+}
+
+void PrefetchDataset::setState(const State& state) {
+  if (state.cursor < 0 || state.cursor > size() ||
+      state.nextFetch < state.cursor || state.nextFetch > size()) {
+    throw std::invalid_argument("[PrefetchDataset] invalid state");
+  }
+  for (auto idx : state.inFlight) {
+    if (idx < 0 || idx >= state.nextFetch) {
+      throw std::invalid_argument("[PrefetchDataset] invalid in-flight sample");
+    }
+  }
+  if (state.nextFetch - state.inFlight.size() != state.cursor ||
+      (reorderWindow_ == 0 && state.nextFetch != state.cursor)) {
+    throw std::invalid_argument(
+        "[PrefetchDataset] state of a different reorder window");
+  }
+
+  // Pending samples of the current pass are discarded
+  prefetchCache_ = {};
+  reorderCache_.clear();
+  ready_ = std::make_shared<ReadySamples>();
+  curIdx_ = state.cursor;
+  nextFetchIdx_ = state.nextFetch;
+  if (reorderWindow_ > 0 && numThreads_ > 0) {
+    for (auto idx : state.inFlight) {
+      fetchOutOfOrder(idx);
+    }
+  }
+}
+
+double PrefetchDataset::lastWaitTime() const {
+  return lastWaitTime_;
+}
+
+double PrefetchDataset::totalWaitTime() const {
+  return totalWaitTime_;
+}
 } // namespace fl
@@ -7,12 +7,20 @@
 
 #pragma once
 
+#include <condition_variable>
 #include <future>
+#include <map>
+#include <mutex>
 #include <queue>
+#include <set>
+#include <vector>
 
+#include "flashlight/fl/common/Serialization.h"
 #include "flashlight/fl/dataset/Dataset.h"
+#include "flashlight/fl/dataset/DeviceStaging.h"
 
 #include "flashlight/fl/common/threadpool/ThreadPool.h"
+#include "flashlight/fl/common/threadpool/WorkStealingThreadPool.h"
 
 namespace fl {
 
@@ -43,25 +51,95 @@ class PrefetchDataset : public Dataset {
    * @param[in] dataset The underlying dataset.
    * @param[in] numThreads Number of threads used by the threadpool
    * @param[in] prefetchSize Number of samples to be prefetched
+   * @param[in] deviceStaging If true, arrays created with hostToDevice() by
+   * the threadpool are uploaded asynchronously through pinned staging
+   * buffers (see DeviceStaging), so that copies overlap with computation.
+   * @param[in] reorderWindow If positive, samples are delivered out of order:
+   * get() returns the first ready prefetched sample instead of waiting for
+   * the requested one, and a sample is returned at most `reorderWindow`
+   * calls after its turn. Each sample is still returned once per sequential
+   * pass. Samples are then fetched by a WorkStealingThreadPool.
+   * @param[in] affinity Where the threads run. Samples are fetched by a
+   * WorkStealingThreadPool of pinned workers unless ThreadAffinity::None.
+   * Threads run on the data CPUs of the `ThreadBudget`, if one is set.
    */
   explicit PrefetchDataset(
       std::shared_ptr<const Dataset> dataset,
       int64_t numThreads,
-      int64_t prefetchSize);
+      int64_t prefetchSize,
+      bool deviceStaging = false,
+      int64_t reorderWindow = 0,
+      ThreadAffinity affinity = ThreadAffinity::None);
 
   int64_t size() const override;
 
   std::vector<af::array> get(const int64_t idx) const override;
 
+  /**
+   * Returns the time in seconds the last get() waited for its sample. A
+   * non-zero wait means that the input pipeline is the bottleneck.
+   */
+  double lastWaitTime() const;
+
+  /**
+   * Returns the total time in seconds get() waited for samples.
+   */
+  double totalWaitTime() const;
+
+  /**
+   * Position of a pass over the dataset, e.g. saved with a checkpoint to
+   * resume training mid-epoch. `cursor` samples were returned by get(): all
+   * the samples before `nextFetch` but the `inFlight` ones, which were being
+   * fetched (only in out-of-order mode, `nextFetch` is `cursor` otherwise).
+   */
+  struct State {
+    int64_t cursor{0};
+    int64_t nextFetch{0};
+    std::vector<int64_t> inFlight;
+
+    FL_SAVE_LOAD(cursor, nextFetch, inFlight)
+  };
+
+  State getState() const;
+
+  /**
+   * Resumes a pass from `state` (of a `PrefetchDataset` of the same dataset
+   * and reorder window): the next sample is get(state.cursor), and samples
+   * already returned aren't fetched again. In-flight samples are fetched
+   * again.
+   */
+  void setState(const State& state);
+
+ private:
+  std::vector<af::array> getOutOfOrder(const int64_t idx) const;
+  void fetchOutOfOrder(int64_t fetchIdx) const;
+
  protected:
   std::shared_ptr<const Dataset> dataset_;
   int64_t numThreads_, prefetchSize_;
 
  private:
+  // Indices of the finished samples of the out-of-order mode. Tasks of
+  // previous passes keep their own (discarded) state.
+  struct ReadySamples {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::set<int64_t> indices;
+  };
+
+  std::shared_ptr<DeviceStaging> staging_;
   std::unique_ptr<ThreadPool> threadPool_;
+  std::unique_ptr<WorkStealingThreadPool> stealingPool_;
+  int64_t reorderWindow_;
   // state variables
   mutable std::queue<std::future<std::vector<af::array>>> prefetchCache_;
+  mutable std::map<int64_t, std::future<std::vector<af::array>>>
+      reorderCache_;
+  mutable std::shared_ptr<ReadySamples> ready_;
+  mutable int64_t nextFetchIdx_;
   mutable int64_t curIdx_;
+  mutable double lastWaitTime_{0};
+  mutable double totalWaitTime_{0};
 };
 
 } // namespace fl
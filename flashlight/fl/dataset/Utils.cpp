@@ -8,10 +8,30 @@
 #include "flashlight/fl/dataset/Utils.h"
 
 #include <algorithm>
+#include <iterator>
+#include <numeric>
+#include <random>
 #include <stdexcept>
 
 namespace fl {
 
+namespace {
+
+// Same permutation on all the partitions, whatever the standard library
+template <class T>
+void shuffle(
+    std::vector<T>& v,
+    size_t begin,
+    size_t end,
+    std::mt19937_64& rng) {
+  auto n = end - begin;
+  for (auto i = n; i >= 1; --i) {
+    std::swap(v[begin + i - 1], v[begin + rng() % n]);
+  }
+}
+
+} // namespace
+
 std::vector<int64_t> partitionByRoundRobin(
     int64_t numSamples,
     int64_t partitionId,
@@ -121,6 +141,125 @@ dynamicPartitionByRoundRobin(
   return {outSamples, outBatchSizes};
 }
 
+std::pair<std::vector<int64_t>, std::vector<int64_t>>
+bucketPartitionByRoundRobin(
+    const std::vector<float>& samplesSize,
+    int64_t partitionId,
+    int64_t numPartitions,
+    int64_t maxSizePerBatch,
+    int64_t numBuckets,
+    int seed,
+    bool allowEmpty /* = false */,
+    const std::vector<double>& partitionWeights /* = {} */) {
+  if (partitionId < 0 || partitionId >= numPartitions) {
+    throw std::invalid_argument(
+        "[bucketPartitionByRoundRobin] invalid partitionId, numPartitions");
+  }
+  if (numBuckets <= 0) {
+    throw std::invalid_argument(
+        "[bucketPartitionByRoundRobin] numBuckets should be positive");
+  }
+  // Token budget of the batches of each partition
+  std::vector<double> maxSizes(numPartitions, maxSizePerBatch);
+  if (!partitionWeights.empty()) {
+    if (partitionWeights.size() != numPartitions ||
+        *std::min_element(partitionWeights.begin(), partitionWeights.end()) <=
+            0) {
+      throw std::invalid_argument(
+          "[bucketPartitionByRoundRobin] partitionWeights should have a "
+          "positive weight per partition");
+    }
+    double maxWeight =
+        *std::max_element(partitionWeights.begin(), partitionWeights.end());
+    for (int64_t p = 0; p < numPartitions; ++p) {
+      maxSizes[p] *= partitionWeights[p] / maxWeight;
+    }
+  }
+  for (auto size : samplesSize) {
+    if (size > maxSizePerBatch) {
+      throw std::invalid_argument(
+          "[bucketPartitionByRoundRobin] invalid samples length: each sample "
+          "should have size <= maxSizePerBatch, either filter data or set larger maxSizePerBatch. "
+          "maxSizePerBatch were set to " +
+          std::to_string(maxSizePerBatch) + " sample size is " +
+          std::to_string(size));
+    }
+  }
+
+  std::vector<int64_t> sortedIds(samplesSize.size());
+  std::iota(sortedIds.begin(), sortedIds.end(), 0);
+  std::stable_sort(
+      sortedIds.begin(),
+      sortedIds.end(),
+      [&samplesSize](int64_t l, int64_t r) {
+        return samplesSize[l] < samplesSize[r];
+      });
+
+  std::mt19937_64 rng(seed);
+  using Batch = std::vector<int64_t>;
+  std::vector<std::vector<Batch>> groups;
+  std::vector<Batch> leftovers;
+  const int64_t numSamples = sortedIds.size();
+  for (int64_t bucket = 0; bucket < numBuckets; ++bucket) {
+    auto begin = bucket * numSamples / numBuckets;
+    auto end = (bucket + 1) * numSamples / numBuckets;
+    shuffle(sortedIds, begin, end, rng);
+
+    // Batch b is packed for partition b % numPartitions
+    std::vector<Batch> batches;
+    Batch batch;
+    float maxSampleLen = 0;
+    for (auto i = begin; i < end; ++i) {
+      auto sampleIdx = sortedIds[i];
+      float sampleLen = std::max(maxSampleLen, samplesSize[sampleIdx]);
+      auto maxSize = maxSizes[batches.size() % numPartitions];
+      if (!batch.empty() && (batch.size() + 1) * sampleLen > maxSize) {
+        batches.push_back(std::move(batch));
+        batch.clear();
+        sampleLen = samplesSize[sampleIdx];
+      }
+      batch.push_back(sampleIdx);
+      maxSampleLen = sampleLen;
+    }
+    if (!batch.empty()) {
+      batches.push_back(std::move(batch));
+    }
+
+    // Groups of batches of the same bucket have similar sizes
+    size_t numGroups = batches.size() / numPartitions;
+    for (size_t g = 0; g < numGroups; ++g) {
+      groups.emplace_back(
+          std::make_move_iterator(batches.begin() + g * numPartitions),
+          std::make_move_iterator(batches.begin() + (g + 1) * numPartitions));
+    }
+    leftovers.insert(
+        leftovers.end(),
+        std::make_move_iterator(batches.begin() + numGroups * numPartitions),
+        std::make_move_iterator(batches.end()));
+  }
+  // Leftovers of neighbouring buckets are the closest in length
+  for (size_t offset = 0; offset < leftovers.size(); offset += numPartitions) {
+    auto end = std::min<size_t>(offset + numPartitions, leftovers.size());
+    if (end - offset < numPartitions && !allowEmpty) {
+      break;
+    }
+    groups.emplace_back(
+        std::make_move_iterator(leftovers.begin() + offset),
+        std::make_move_iterator(leftovers.begin() + end));
+  }
+  shuffle(groups, 0, groups.size(), rng);
+
+  std::vector<int64_t> outSamples, outBatchSizes;
+  for (const auto& group : groups) {
+    if (partitionId < group.size()) {
+      const auto& batch = group[partitionId];
+      outBatchSizes.push_back(batch.size());
+      outSamples.insert(outSamples.end(), batch.begin(), batch.end());
+    }
+  }
+  return {outSamples, outBatchSizes};
+}
+
 std::vector<af::array> makeBatchFromRange(
     std::shared_ptr<const Dataset> dataset,
     std::vector<Dataset::BatchFunction> batchFns,
@@ -49,6 +49,40 @@ dynamicPartitionByRoundRobin(
     int64_t maxSizePerBatch,
     bool allowEmpty = false);
 
+/**
+ * Partitions the samples into length buckets and returns ids of the samples
+ * with dynamic batching, as in dynamicPartitionByRoundRobin(): samples are
+ * split into `numBuckets` buckets of similar lengths (quantiles), shuffled
+ * within their bucket and packed into batches of at most `maxSizePerBatch`
+ * tokens (including padded tokens). Batches are then grouped by
+ * `numPartitions` batches of the same bucket, one per partition, so that the
+ * partitions get balanced work, and the groups are shuffled. All the
+ * partitions must use the same seed.
+ *
+ * Partitions of different speeds can be given `partitionWeights`: the
+ * batches of a partition then have at most `maxSizePerBatch` times its weight
+ * divided by the largest weight tokens, so that they take about the same
+ * time on all the partitions.
+ * @param samplesSize samples length in tokens
+ * @param partitionId rank of the current partition [0, numPartitions)
+ * @param numPartitions total partitions
+ * @param maxSizePerBatch total number of tokens in the batch
+ * @param numBuckets number of length buckets
+ * @param seed seed of the shuffling
+ * @param partitionWeights positive weight of each partition, the same for all
+ * if empty
+ */
+std::pair<std::vector<int64_t>, std::vector<int64_t>>
+bucketPartitionByRoundRobin(
+    const std::vector<float>& samplesSize,
+    int64_t partitionId,
+    int64_t numPartitions,
+    int64_t maxSizePerBatch,
+    int64_t numBuckets,
+    int seed,
+    bool allowEmpty = false,
+    const std::vector<double>& partitionWeights = {});
+
 /**
  * Make batch by applying batchFn to the data
  * @param data data to be batchified
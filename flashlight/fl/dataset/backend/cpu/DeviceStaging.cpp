@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/dataset/DeviceStaging.h"
+
+#include <stdexcept>
+
+namespace fl {
+
+// Host and device memory are not distinct, or copies are not exposed by the
+// backend: arrays are created directly.
+struct DeviceStaging::Impl {};
+
+DeviceStaging::DeviceStaging(int64_t numBuffers) {
+  if (numBuffers <= 0) {
+    throw std::invalid_argument("DeviceStaging: numBuffers must be positive");
+  }
+}
+
+DeviceStaging::~DeviceStaging() = default;
+
+af::array
+DeviceStaging::upload(const void* data, const af::dim4& dims, af::dtype type) {
+  return detail::createArray(data, dims, type);
+}
+
+} // namespace fl
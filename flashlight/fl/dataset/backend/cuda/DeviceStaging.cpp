@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/dataset/DeviceStaging.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include "flashlight/fl/common/DevicePtr.h"
+#include "flashlight/fl/common/PinnedHostBuffer.h"
+#include "flashlight/fl/common/backend/cuda/CudaUtils.h"
+
+namespace fl {
+
+namespace {
+
+/**
+ * A pinned host buffer and a device buffer of the same capacity. The device
+ * buffer is owned by the slot (never returned to the ArrayFire memory
+ * manager while in use), so it can be written from the copy stream.
+ */
+struct StagingSlot {
+  std::mutex mutex;
+  PinnedHostBuffer host;
+  af::array device;
+  size_t capacity{0};
+  // Recorded on the copy stream once the host buffer has been copied
+  cudaEvent_t copied;
+  // Recorded on the ArrayFire stream once the device buffer has been copied
+  cudaEvent_t consumed;
+};
+
+} // namespace
+
+struct DeviceStaging::Impl {
+  int device;
+  cudaStream_t copyStream;
+  std::vector<std::unique_ptr<StagingSlot>> slots;
+  size_t nextSlot{0};
+  std::mutex mutex;
+};
+
+DeviceStaging::DeviceStaging(int64_t numBuffers)
+    : impl_(std::make_unique<Impl>()) {
+  if (numBuffers <= 0) {
+    throw std::invalid_argument("DeviceStaging: numBuffers must be positive");
+  }
+  impl_->device = af::getDevice();
+  FL_CUDA_CHECK(
+      cudaStreamCreateWithFlags(&impl_->copyStream, cudaStreamNonBlocking));
+  for (int64_t i = 0; i < numBuffers; ++i) {
+    auto slot = std::make_unique<StagingSlot>();
+    FL_CUDA_CHECK(cudaEventCreateWithFlags(
+        &slot->copied, cuda::detail::kCudaEventDefaultFlags));
+    FL_CUDA_CHECK(cudaEventCreateWithFlags(
+        &slot->consumed, cuda::detail::kCudaEventDefaultFlags));
+    impl_->slots.push_back(std::move(slot));
+  }
+}
+
+DeviceStaging::~DeviceStaging() {
+  // No exceptions from the destructor: errors are ignored
+  cudaStreamSynchronize(impl_->copyStream);
+  for (auto& slot : impl_->slots) {
+    cudaEventSynchronize(slot->consumed);
+    cudaEventDestroy(slot->copied);
+    cudaEventDestroy(slot->consumed);
+  }
+  cudaStreamDestroy(impl_->copyStream);
+}
+
+af::array
+DeviceStaging::upload(const void* data, const af::dim4& dims, af::dtype type) {
+  const size_t bytes = dims.elements() * af::getSizeOf(type);
+  if (bytes == 0 || af::getDevice() != impl_->device) {
+    return detail::createArray(data, dims, type);
+  }
+
+  StagingSlot* slot;
+  {
+    std::lock_guard<std::mutex> lock(impl_->mutex);
+    slot = impl_->slots[impl_->nextSlot].get();
+    impl_->nextSlot = (impl_->nextSlot + 1) % impl_->slots.size();
+  }
+  std::lock_guard<std::mutex> lock(slot->mutex);
+
+  // Wait for the previous copy from the host buffer
+  FL_CUDA_CHECK(cudaEventSynchronize(slot->copied));
+  if (slot->capacity < bytes) {
+    // Previous device-to-device copies are ordered on the ArrayFire stream,
+    // the device buffer can be released right away. The host buffer goes
+    // back to the pinned memory manager.
+    slot->capacity = std::max(bytes, 2 * slot->capacity);
+    slot->host = PinnedHostBuffer(slot->capacity);
+    slot->device = af::array(slot->capacity, u8);
+    // The fresh device buffer may be still in use by work queued on the
+    // ArrayFire stream before its previous release
+    FL_CUDA_CHECK(cudaEventRecord(slot->consumed, cuda::getActiveStream()));
+  }
+  std::memcpy(slot->host.get(), data, bytes);
+
+  auto afStream = cuda::getActiveStream();
+  af::array out(dims, type);
+  {
+    DevicePtr staged(slot->device);
+    DevicePtr outPtr(out);
+    // Host to device on the copy stream, once the last device-to-device
+    // copy from the device buffer is done
+    FL_CUDA_CHECK(cudaStreamWaitEvent(impl_->copyStream, slot->consumed, 0));
+    FL_CUDA_CHECK(cudaMemcpyAsync(
+        staged.get(),
+        slot->host.get(),
+        bytes,
+        cudaMemcpyHostToDevice,
+        impl_->copyStream));
+    FL_CUDA_CHECK(cudaEventRecord(slot->copied, impl_->copyStream));
+    // Device to device on the ArrayFire stream
+    FL_CUDA_CHECK(cudaStreamWaitEvent(afStream, slot->copied, 0));
+    FL_CUDA_CHECK(cudaMemcpyAsync(
+        outPtr.get(),
+        staged.get(),
+        bytes,
+        cudaMemcpyDeviceToDevice,
+        afStream));
+    FL_CUDA_CHECK(cudaEventRecord(slot->consumed, afStream));
+  }
+  return out;
+}
+
+} // namespace fl
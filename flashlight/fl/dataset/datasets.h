@@ -9,12 +9,20 @@
 
 #include "flashlight/fl/dataset/BatchDataset.h"
 #include "flashlight/fl/dataset/BlobDataset.h"
+#include "flashlight/fl/dataset/BlobDatasetWriter.h"
+#include "flashlight/fl/dataset/BlockShuffleDataset.h"
+#include "flashlight/fl/dataset/BucketBatchDataset.h"
+#include "flashlight/fl/dataset/CacheDataset.h"
 #include "flashlight/fl/dataset/ConcatDataset.h"
 #include "flashlight/fl/dataset/Dataset.h"
 #include "flashlight/fl/dataset/DatasetIterator.h"
+#include "flashlight/fl/dataset/DeviceStaging.h"
 #include "flashlight/fl/dataset/FileBlobDataset.h"
+#include "flashlight/fl/dataset/LazyShuffleDataset.h"
 #include "flashlight/fl/dataset/MemoryBlobDataset.h"
 #include "flashlight/fl/dataset/MergeDataset.h"
+#include "flashlight/fl/dataset/MmapBlobDataset.h"
+#include "flashlight/fl/dataset/ParallelMapDataset.h"
 #include "flashlight/fl/dataset/PrefetchDataset.h"
 #include "flashlight/fl/dataset/ResampleDataset.h"
 #include "flashlight/fl/dataset/ShuffleDataset.h"
@@ -7,6 +7,17 @@
 
 #include "flashlight/fl/distributed/DistributedApi.h"
 
+#include <algorithm>
+#include <climits>
+#include <exception>
+#include <stdexcept>
+#include <string>
+
+#include <unistd.h>
+
+#include "flashlight/fl/common/Metrics.h"
+#include "flashlight/fl/common/Trace.h"
+
 namespace fl {
 
 bool isDistributedInit() {
@@ -17,11 +28,83 @@ DistributedBackend distributedBackend() {
   return detail::DistributedInfo::getInstance().backend_;
 }
 
+int getPipelineStages() {
+  if (!isDistributedInit()) {
+    return 1;
+  }
+  return detail::DistributedInfo::getInstance().pipelineStages_;
+}
+
+namespace {
+
+// Gathers the slices of a sparse Variable from all the processes, which may
+// hold different numbers of slices, and sums the slices at the same indices
+void allGatherSparse(Variable& var) {
+  int dim = var.sparseDim();
+  // slices are gathered as columns
+  af::array values = dim == 0 ? af::transpose(var.array()) : var.array();
+  const auto& indices = var.sparseIndices();
+  dim_t count = indices.elements();
+  af::array counts;
+  allGather(af::constant(count, 1, s32), counts);
+  std::vector<int> hostCounts(counts.elements());
+  counts.host(hostCounts.data());
+  int maxCount = *std::max_element(hostCounts.begin(), hostCounts.end());
+  if (maxCount == 0) {
+    return;
+  }
+
+  // padded to the same number of slices on all processes
+  auto paddedIndices = af::constant(0, maxCount, s32);
+  auto paddedValues = af::constant(0, values.dims(0), maxCount, values.type());
+  if (count > 0) {
+    paddedIndices(af::seq(count)) = indices;
+    paddedValues(af::span, af::seq(count)) = values;
+  }
+  af::array gatheredIndices, gatheredValues;
+  allGather(paddedIndices, gatheredIndices);
+  allGather(paddedValues, gatheredValues);
+  gatheredValues = af::moddims(
+      gatheredValues, values.dims(0), maxCount * hostCounts.size());
+
+  std::vector<int> keep;
+  for (size_t rank = 0; rank < hostCounts.size(); ++rank) {
+    for (int i = 0; i < hostCounts[rank]; ++i) {
+      keep.push_back(rank * maxCount + i);
+    }
+  }
+  af::array keepArr(keep.size(), keep.data());
+  af::array slices = gatheredValues(af::span, keepArr);
+  var = Variable::sparse(
+      dim == 0 ? af::transpose(slices) : slices,
+      gatheredIndices(keepArr),
+      dim,
+      var.denseDims());
+}
+
+// Bytes reduced by this process, to monitor the bandwidth of the reductions
+void countReducedBytes(size_t bytes) {
+  static auto& counter = MetricsRegistry::global().counter(
+      "fl_allreduce_bytes_total", "Bytes of the arrays all-reduced");
+  counter.add(bytes);
+}
+
+} // namespace
+
 void allReduce(
     Variable& var,
     double scale /* = 1.0 */,
     bool async /* = false */) {
+  FL_TRACE(DISTRIBUTED, "allReduce");
+  if (var.isSparse()) {
+    if (getWorldSize() > 1) {
+      allGatherSparse(var);
+    }
+    var.array() *= scale;
+    return;
+  }
   if (getWorldSize() > 1) {
+    countReducedBytes(var.bytes());
     allReduce(var.array(), async);
   }
   var.array() *= scale;
@@ -32,12 +115,22 @@ void allReduceMultiple(
     double scale /* = 1.0 */,
     bool async /* = false */,
     bool contiguous /* = false */) {
+  FL_TRACE(DISTRIBUTED, "allReduceMultiple");
   // return a vector of pointers to avoid copying
   std::vector<af::array*> arrs;
   for (auto& var : vars) {
+    if (var.isSparse()) {
+      throw std::invalid_argument(
+          "allReduceMultiple: sparse Variables must be reduced by allReduce");
+    }
     arrs.push_back(&var.array());
   }
   if (getWorldSize() > 1) {
+    size_t bytes = 0;
+    for (const auto* arr : arrs) {
+      bytes += arr->bytes();
+    }
+    countReducedBytes(bytes);
     allReduceMultiple(arrs, async, contiguous);
   }
   for (auto& var : vars) {
@@ -45,16 +138,90 @@ void allReduceMultiple(
   }
 }
 
+void send(const af::array& arr, int dst) {
+  sendRecv({{&arr, dst}}, {});
+}
+
+void recv(af::array& arr, int src) {
+  sendRecv({}, {{&arr, src}});
+}
+
 void barrier() {
+  FL_TRACE(DISTRIBUTED, "barrier");
+  // Gathered rather than allreduced, since allreduces may span the processes
+  // of a pipeline stage only
   auto arr = af::constant(0, 1);
-  allReduce(arr, false);
+  af::array gathered;
+  allGather(arr, gathered);
 
-  // This hack is to make sure `arr` will not be optimized away from arrayfire
-  // JIT during allreduce().
-  af::sum<float>(arr);
+  // Waits for the collective, enqueued on the stream with NCCL
+  af::sum<float>(gathered);
 }
 
 namespace detail {
+
+NodeTopology getNodeTopology(
+    const std::vector<std::string>& hostnames,
+    int worldRank) {
+  NodeTopology topology{0, 0, -1, 0};
+  std::unordered_map<std::string, int> nodeIndices;
+  for (int rank = 0; rank < static_cast<int>(hostnames.size()); ++rank) {
+    const auto& hostname = hostnames[rank];
+    if (nodeIndices.find(hostname) == nodeIndices.end()) {
+      nodeIndices[hostname] = topology.numNodes++;
+    }
+    if (hostname == hostnames[worldRank]) {
+      if (rank < worldRank) {
+        ++topology.localRank;
+      }
+      ++topology.localSize;
+    }
+  }
+  topology.nodeIndex = nodeIndices[hostnames[worldRank]];
+  return topology;
+}
+
+std::string getHostname() {
+  char hostname[HOST_NAME_MAX + 1];
+  if (gethostname(hostname, sizeof(hostname)) != 0) {
+    throw std::runtime_error("getHostname: gethostname failed");
+  }
+  hostname[HOST_NAME_MAX] = '\0';
+  return hostname;
+}
+
+bool isHierarchicalRequested(
+    const std::unordered_map<std::string, std::string>& params) {
+  auto hierarchical = params.find(DistributedConstants::kHierarchical);
+  return hierarchical != params.end() && hierarchical->second == "1";
+}
+
+int getRequestedPipelineStages(
+    const std::unordered_map<std::string, std::string>& params,
+    int worldSize) {
+  auto it = params.find(DistributedConstants::kPipelineStages);
+  if (it == params.end()) {
+    return 1;
+  }
+  int stages = 0;
+  try {
+    stages = std::stoi(it->second);
+  } catch (const std::exception&) {
+  }
+  if (stages < 1 || worldSize % stages != 0) {
+    throw std::invalid_argument(
+        "distributedInit: the number of pipeline stages must divide the "
+        "world size, got " +
+        it->second);
+  }
+  if (stages > 1 && isHierarchicalRequested(params)) {
+    throw std::invalid_argument(
+        "distributedInit: pipeline stages can't be combined with "
+        "hierarchical collectives");
+  }
+  return stages;
+}
+
 /*  static */ DistributedInfo& DistributedInfo::getInstance() {
   static DistributedInfo dinfo;
   return dinfo;
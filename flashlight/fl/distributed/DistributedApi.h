@@ -7,8 +7,10 @@
 
 #pragma once
 
+#include <memory>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "flashlight/fl/autograd/Variable.h"
@@ -27,7 +29,16 @@ namespace fl {
  * @param initMethod Initialization method used for setting up the rendezvous
  * @param worldSize Total number of processes in the communication group
  *`@param worldRank 0-indexed rank of the current process
- * @param params Additional parameters (if any) needed for initialization
+ * @param params Additional parameters (if any) needed for initialization. With
+ * `DistributedConstants::kHierarchical` set to "1", processes are grouped in
+ * nodes by hostname, and allreduces (hence barriers) sum within the nodes,
+ * then between one process per node, then broadcast the sum within the nodes.
+ * With `DistributedConstants::kPipelineStages` set to a number of stages `P`
+ * dividing the world size, the process of rank `r` runs the stage `r % P` of
+ * a pipeline (see `Pipeline`), and allreduces (hence the reducers) sum over
+ * the `getWorldSize() / P` processes of the same stage only: the data-parallel
+ * replicas of the stage. The other collectives and barriers span the world.
+ * Pipeline stages can't be combined with hierarchical collectives.
  */
 void distributedInit(
     DistributedInit initMethod,
@@ -57,9 +68,44 @@ int getWorldRank();
  */
 int getWorldSize();
 
+/**
+ * Returns the number of pipeline stages set by `distributedInit`, 1 if none
+ * or if the distributed environment is not initialized.
+ */
+int getPipelineStages();
+
+/**
+ * A subgroup of the processes, for collectives between some processes only,
+ * e.g. the processes sharing the shards of tensor-parallel layers. A
+ * default-constructed group holds the current process alone.
+ */
+struct DistributedGroup {
+  /// Index of the communicator of the group in the backend, -1 if alone
+  int id = -1;
+  /// Rank of the current process in the group
+  int rank = 0;
+  /// Number of processes of the group
+  int size = 1;
+};
+
+/**
+ * Splits the processes into groups: the processes calling it with the same
+ * `color` form a group, in which they are ordered by world rank. This is a
+ * collective call of all the processes, which must create their groups in
+ * the same order.
+ *
+ * @param[in] color the group of the current process
+ * @return the group of the current process
+ */
+DistributedGroup createGroup(int color);
+
 /**
  * Synchronizes a the array wrapped by the Variable with allreduce.
  *
+ * A sparse Variable (see `Variable::sparse()`) is replaced by the sum of the
+ * sparse Variables of all processes, whose slices are gathered rather than
+ * summed in dense arrays; this is synchronous.
+ *
  * @param[in] var a variable whose array will be synchronized
  * @param[in] scale scale the Variable after allreduce by this factor
  * @param[in] async perform the allReduce operation asynchronously in a separate
@@ -76,7 +122,9 @@ void allReduce(Variable& var, double scale = 1.0, bool async = false);
  * @param[in] async perform the allReduce operation asynchronously in a separate
  * compute stream to the ArrayFire compute stream. NB: if used,
  * ``syncDistributed`` *must* be called in order to ensure the ArrayFire CUDA
- * stream waits until ``allReduce`` is complete and uses updated values.
+ * stream waits until ``allReduce`` is complete and uses updated values. With
+ * Gloo, the collectives run in order on a communication thread, which writes
+ * the sum to `arr`: `arr` must not be evaluated before ``syncDistributed``.
  */
 void allReduce(af::array& arr, bool async = false);
 
@@ -114,6 +162,112 @@ void allReduceMultiple(
     bool async = false,
     bool contiguous = false);
 
+/**
+ * Sums an array over all processes and scatters the result: the process of
+ * rank `r` gets the `r`-th of the `getWorldSize()` equal parts of the
+ * flattened sum.
+ *
+ * @param[in] input an array whose number of elements is a multiple of the
+ * world size, of the same dimensions and type on all processes
+ * @param[out] output a 1D array of `input.elements() / getWorldSize()`
+ * elements of the type of `input`
+ */
+void reduceScatter(const af::array& input, af::array& output);
+
+/**
+ * Gathers an array from all processes: every process gets the concatenation,
+ * by rank, of the flattened arrays of all the processes.
+ *
+ * @param[in] input an array of the same number of elements and type on all
+ * processes
+ * @param[out] output a 1D array of `input.elements() * getWorldSize()`
+ * elements of the type of `input`
+ */
+void allGather(const af::array& input, af::array& output);
+
+/**
+ * Broadcasts an array from the process of rank `rootRank` to all processes,
+ * in place, e.g. to start training from the parameters of one process rather
+ * than from their average. Broadcasts span the world, also with pipeline
+ * stages. The elements are sent as bytes, so that arrays of any type can be
+ * broadcast. With NCCL, the broadcast is enqueued on the ArrayFire CUDA
+ * stream.
+ *
+ * @param arr an array of the same number of elements and type on all
+ * processes, which gets the array of the root
+ * @param[in] rootRank the rank of the process whose array is broadcast
+ */
+void broadcast(af::array& arr, int rootRank = 0);
+
+/**
+ * Broadcasts arrays from the process of rank `rootRank` to all processes, in
+ * place, in a single collective: with NCCL, the broadcasts are grouped in one
+ * launch, and with Gloo, the arrays are copied one after the other in a
+ * staging buffer, which is broadcast once. The arrays may have different
+ * types.
+ *
+ * @param[in] arrs pointers to arrays of the same numbers of elements and
+ * types on all processes, which get the arrays of the root
+ * @param[in] rootRank the rank of the process whose arrays are broadcast
+ */
+void broadcastMultiple(const std::vector<af::array*>& arrs, int rootRank = 0);
+
+/**
+ * Sums an array over the processes of a group, in place, like the
+ * synchronous `allReduce` over the world.
+ *
+ * @param arr an array of the same dimensions and type on the processes of
+ * `group`
+ * @param[in] group a group created by `createGroup`
+ */
+void allReduce(af::array& arr, const DistributedGroup& group);
+
+/**
+ * Gathers an array from the processes of a group: each of them gets the
+ * concatenation, by rank in the group, of their flattened arrays.
+ *
+ * @param[in] input an array of the same number of elements and type on the
+ * processes of `group`
+ * @param[out] output a 1D array of `input.elements() * group.size` elements
+ * of the type of `input`
+ * @param[in] group a group created by `createGroup`
+ */
+void allGather(
+    const af::array& input,
+    af::array& output,
+    const DistributedGroup& group);
+
+/**
+ * Point-to-point transfers between processes: sends each array of `sends` to
+ * the process of the paired rank, and receives each array of `recvs` from the
+ * process of the paired rank, in place. The transfers of a call run
+ * concurrently, so that processes may send to each other in the same call
+ * without deadlocking; transfers between the same pair of processes, in the
+ * same direction, are matched in order.
+ *
+ * A received array must have the number of elements and the type of the
+ * array sent, and must not share its data with other arrays. With NCCL, the
+ * transfers are enqueued on the ArrayFire CUDA stream.
+ *
+ * @param[in] sends the arrays to send, with the ranks of their destinations
+ * @param[in] recvs the arrays to receive into, with the ranks of their sources
+ */
+void sendRecv(
+    const std::vector<std::pair<const af::array*, int>>& sends,
+    const std::vector<std::pair<af::array*, int>>& recvs);
+
+/**
+ * Sends an array to the process of rank `dst`, which receives it with `recv`.
+ * See `sendRecv`.
+ */
+void send(const af::array& arr, int dst);
+
+/**
+ * Receives in place an array sent by the process of rank `src` with `send`.
+ * See `sendRecv`.
+ */
+void recv(af::array& arr, int src);
+
 /**
  * Synchronizes operations in the ArrayFire compute stream with operations in
  * the distributed compute stream, if applicable. That is, all operations in the
@@ -122,10 +276,34 @@ void allReduceMultiple(
  *
  * Note that if asynchronous allReduce is not used, this operation will be a
  * no-op, since no operations will be enqueued on the distributed compute
- * stream.
+ * stream. With Gloo, it waits for the asynchronous collectives of the
+ * communication thread, and rethrows their first error.
  */
 void syncDistributed();
 
+/**
+ * The completion of the asynchronous operations enqueued in the distributed
+ * compute stream before an event was recorded, see `recordDistributedEvent`.
+ */
+struct DistributedEvent {
+  /// State of the backend, null if no operation was pending
+  std::shared_ptr<void> impl;
+};
+
+/**
+ * Records the asynchronous operations (e.g. ``allReduce`` with `async`)
+ * enqueued so far, so that the ArrayFire compute stream can wait for them
+ * only, while the operations enqueued later still run.
+ */
+DistributedEvent recordDistributedEvent();
+
+/**
+ * As ``syncDistributed``, for the operations recorded by `event` only: the
+ * operations of the ArrayFire compute stream enqueued after this call wait for
+ * them. With Gloo, blocks until they are done and rethrows their first error.
+ */
+void waitDistributedEvent(const DistributedEvent& event);
+
 /**
  * Blocks until all CPU processes have reached this routine.
  */
@@ -134,6 +312,43 @@ void barrier();
 /** @} */
 
 namespace detail {
+
+/**
+ * The position of a process in its node (the processes of the same hostname),
+ * and of its node among the nodes, which are ordered by their lowest rank.
+ */
+struct NodeTopology {
+  int localRank;
+  int localSize;
+  int nodeIndex;
+  int numNodes;
+};
+
+NodeTopology getNodeTopology(
+    const std::vector<std::string>& hostnames,
+    int worldRank);
+
+/**
+ * Returns the hostname of the current process.
+ */
+std::string getHostname();
+
+/**
+ * Returns whether hierarchical collectives are requested in the parameters of
+ * `distributedInit`.
+ */
+bool isHierarchicalRequested(
+    const std::unordered_map<std::string, std::string>& params);
+
+/**
+ * Returns the number of pipeline stages requested in the parameters of
+ * `distributedInit`, 1 if none. Throws if it doesn't divide `worldSize` or
+ * if hierarchical collectives are requested as well.
+ */
+int getRequestedPipelineStages(
+    const std::unordered_map<std::string, std::string>& params,
+    int worldSize);
+
 class DistributedInfo {
  public:
   static DistributedInfo& getInstance();
@@ -141,6 +356,7 @@ class DistributedInfo {
   bool isInitialized_ = false;
   DistributedInit initMethod_;
   DistributedBackend backend_;
+  int pipelineStages_ = 1;
 
  private:
   DistributedInfo() = default;
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/distributed/ModelAverager.h"
+
+#include <stdexcept>
+
+#include "flashlight/fl/distributed/DistributedApi.h"
+
+namespace fl {
+
+ModelAverager::ModelAverager(
+    const std::vector<Variable>& parameters,
+    int64_t period,
+    int64_t warmupUpdates /* = 0 */,
+    double outerMomentum /* = 0.0 */,
+    double outerLr /* = 1.0 */,
+    std::vector<std::shared_ptr<FirstOrderOptimizer>> optimizers /* = {} */)
+    : parameters_(parameters),
+      period_(period),
+      warmupUpdates_(warmupUpdates),
+      outerMomentum_(outerMomentum),
+      outerLr_(outerLr),
+      optimizers_(std::move(optimizers)) {
+  if (period_ < 1 || warmupUpdates_ < 0) {
+    throw std::invalid_argument(
+        "ModelAverager: period should be positive, warmupUpdates not negative");
+  }
+  for (const auto& optimizer : optimizers_) {
+    if (!optimizer) {
+      throw std::invalid_argument("ModelAverager: null optimizer");
+    }
+  }
+  resetAnchor();
+}
+
+bool ModelAverager::isLocal(int64_t update) const {
+  return update > warmupUpdates_;
+}
+
+bool ModelAverager::step(int64_t update) {
+  // The parameters are the same on all the processes at the end of the
+  // synchronous updates
+  if (update == warmupUpdates_) {
+    resetAnchor();
+  }
+  if (!isLocal(update) || (update - warmupUpdates_) % period_ != 0) {
+    return false;
+  }
+  average();
+  return true;
+}
+
+void ModelAverager::average() {
+  std::vector<af::array*> arrs;
+  for (auto& param : parameters_) {
+    arrs.push_back(&param.array());
+  }
+  for (auto& optimizer : optimizers_) {
+    for (auto* arr : optimizer->getStateArrays()) {
+      if (!arr->isempty()) {
+        arrs.push_back(arr);
+      }
+    }
+  }
+  if (getWorldSize() > 1) {
+    allReduceMultiple(arrs);
+    const double scale = 1.0 / getWorldSize();
+    for (auto* arr : arrs) {
+      *arr *= scale;
+    }
+  }
+
+  if (!hasOuterUpdate()) {
+    return;
+  }
+  for (size_t i = 0; i < parameters_.size(); ++i) {
+    momentum_[i] =
+        outerMomentum_ * momentum_[i] + (anchor_[i] - parameters_[i].array());
+    anchor_[i] = anchor_[i] - outerLr_ * momentum_[i];
+    parameters_[i].array() = anchor_[i].copy();
+  }
+}
+
+bool ModelAverager::hasOuterUpdate() const {
+  return outerMomentum_ != 0.0 || outerLr_ != 1.0;
+}
+
+void ModelAverager::resetAnchor() {
+  if (!hasOuterUpdate()) {
+    return;
+  }
+  anchor_.clear();
+  momentum_.clear();
+  for (auto& param : parameters_) {
+    anchor_.push_back(param.array().copy());
+    momentum_.push_back(af::constant(0, param.dims(), param.type()));
+  }
+}
+
+} // namespace fl
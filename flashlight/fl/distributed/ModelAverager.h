@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "flashlight/fl/optim/Optimizers.h"
+
+namespace fl {
+
+/**
+ * Local SGD for clusters with slow interconnects: instead of reducing the
+ * gradients at every update, the processes update their parameters
+ * independently, and average them every `period` updates with a single
+ * `allReduceMultiple`. The state of the given optimizers (e.g. the moments of
+ * `AdamOptimizer`) is averaged too.
+ *
+ * The first `warmupUpdates` updates are synchronous, their gradients reduced
+ * as usual (post-local SGD, https://arxiv.org/abs/1808.07217): `isLocal()`
+ * tells whether the gradients of an update must be reduced.
+ *
+ * With an outer momentum or learning rate (SlowMo,
+ * https://arxiv.org/abs/1910.00643), the averaged parameters are moved from
+ * the previous average `x0` by a momentum update: with the average `x`,
+ * `u = outerMomentum * u + (x0 - x)` and the parameters become
+ * `x0 - outerLr * u`. With the defaults, they are the average. The
+ * parameters must be the same on all the processes when the `ModelAverager`
+ * is created.
+ *
+ * Example usage:
+ *
+ * \code
+ * ModelAverager averager(model.params(), 8, 1000, 0.5, 1.0, {optimizer});
+ * for (int64_t update = 1; update <= numUpdates; ++update) {
+ *   reducer->setSynchronize(!averager.isLocal(update));
+ *   optimizer->zeroGrad();
+ *   loss(update).backward();
+ *   reducer->finalize();
+ *   optimizer->step();
+ *   averager.step(update);
+ * }
+ * \endcode
+ */
+class ModelAverager {
+ public:
+  /**
+   * @param parameters The parameters from e.g. `model.params()`
+   * @param period Number of local updates between averages
+   * @param warmupUpdates Number of first updates whose gradients are reduced
+   * @param outerMomentum Momentum of the outer update
+   * @param outerLr Learning rate of the outer update
+   * @param optimizers Optimizers whose state is averaged too
+   */
+  ModelAverager(
+      const std::vector<Variable>& parameters,
+      int64_t period,
+      int64_t warmupUpdates = 0,
+      double outerMomentum = 0.0,
+      double outerLr = 1.0,
+      std::vector<std::shared_ptr<FirstOrderOptimizer>> optimizers = {});
+
+  /**
+   * Whether the update `update` (counted from 1) is local: its gradients
+   * must not be reduced.
+   */
+  bool isLocal(int64_t update) const;
+
+  /**
+   * Called by all the processes after the update `update`, even if it was
+   * skipped: averages the parameters when due. Returns whether it did.
+   */
+  bool step(int64_t update);
+
+  /**
+   * Averages the parameters and the optimizer states now, e.g. before
+   * evaluating or saving the model. Called by all the processes.
+   */
+  void average();
+
+ private:
+  bool hasOuterUpdate() const;
+  // Starts the outer updates from the current parameters, which must be the
+  // same on all the processes
+  void resetAnchor();
+
+  std::vector<Variable> parameters_;
+  int64_t period_;
+  int64_t warmupUpdates_;
+  double outerMomentum_;
+  double outerLr_;
+  std::vector<std::shared_ptr<FirstOrderOptimizer>> optimizers_;
+  // Previous average and outer momentum, with an outer update
+  std::vector<af::array> anchor_;
+  std::vector<af::array> momentum_;
+};
+
+} // namespace fl
@@ -0,0 +1,263 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/distributed/PipelinedOptimizer.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+#include "flashlight/fl/common/Trace.h"
+#include "flashlight/fl/nn/modules/Module.h"
+
+namespace fl {
+
+PipelinedOptimizer::PipelinedOptimizer(
+    const std::vector<Variable>& parameters,
+    const OptimizerFactory& createOptimizer,
+    double gradScale /* = 1.0 */,
+    std::size_t bucketBytes /* = DistributedConstants::kCoalesceCacheSize */)
+    : FirstOrderOptimizer(parameters, 0.0),
+      gradScale_(gradScale),
+      bucketBytes_(bucketBytes) {
+  if (parameters_.empty()) {
+    throw std::invalid_argument("PipelinedOptimizer: no parameters");
+  }
+  for (const auto& parameter : parameters_) {
+    optimizers_.push_back(createOptimizer({parameter}));
+  }
+  lr_ = optimizers_.front()->getLr();
+}
+
+void PipelinedOptimizer::registerGradHooks() {
+  for (size_t i = 0; i < parameters_.size(); ++i) {
+    parameters_[i].registerGradHook(
+        [this, i](Variable& /* grad */) { gradReady(i); });
+  }
+}
+
+void PipelinedOptimizer::setGradNormalizer(const af::array& count) {
+  if (count.elements() != 1) {
+    throw std::invalid_argument(
+        "PipelinedOptimizer::setGradNormalizer - expects one element");
+  }
+  normalizer_ = count.as(af::dtype::f32).copy();
+  normalizerReduced_ = false;
+}
+
+void PipelinedOptimizer::gradReady(std::size_t i) {
+  if (!reducing_) {
+    // The updates of the last step read the buffers, which are reused
+    awaitAll();
+    reducing_ = true;
+    added_.assign(parameters_.size(), false);
+    slots_.resize(parameters_.size());
+    // Before the first bucket, so that the events of the buckets cover it
+    if (!normalizer_.isempty() && getWorldSize() > 1) {
+      allReduce(normalizer_, /* async = */ true);
+    }
+    normalizerReduced_ = true;
+  }
+  auto& parameter = parameters_[i];
+  if (parameter.isGradSparse()) {
+    throw std::invalid_argument(
+        "PipelinedOptimizer: sparse gradients are not supported");
+  }
+  if (added_[i]) {
+    // e.g. with several backward passes per step
+    throw std::runtime_error(
+        "PipelinedOptimizer: gradient computed twice before step()");
+  }
+  added_[i] = true;
+  // buckets hold gradients of a single type
+  if (!bucketParams_.empty() &&
+      parameters_[bucketParams_.front()].type() != parameter.type()) {
+    reduceBucket();
+  }
+  bucketParams_.push_back(i);
+  bucketParamsBytes_ += parameter.grad().bytes();
+
+  bool full;
+  if (currBucket_ < buckets_.size()) {
+    full = bucketParams_.size() == buckets_[currBucket_].size;
+  } else {
+    // first step: form a new bucket
+    full = bucketParamsBytes_ >= bucketBytes_;
+  }
+  if (full) {
+    reduceBucket();
+  }
+}
+
+void PipelinedOptimizer::reduceBucket() {
+  if (bucketParams_.empty()) {
+    return;
+  }
+  FL_TRACE(DISTRIBUTED, "PipelinedOptimizer::reduceBucket");
+  dim_t elements = 0;
+  for (auto i : bucketParams_) {
+    elements += parameters_[i].elements();
+  }
+  auto type = parameters_[bucketParams_.front()].type();
+  if (currBucket_ == buckets_.size()) {
+    buckets_.emplace_back();
+  }
+  auto& bucket = buckets_[currBucket_];
+  bucket.size = bucketParams_.size();
+  if (bucket.buffer.elements() != elements || bucket.buffer.type() != type) {
+    bucket.buffer = af::array(elements, type);
+  }
+
+  dim_t offset = 0;
+  for (auto i : bucketParams_) {
+    slots_[i] = {currBucket_, offset};
+    dim_t n = parameters_[i].elements();
+    if (n > 0) {
+      bucket.buffer(af::seq(offset, offset + n - 1)) =
+          af::flat(parameters_[i].grad().array());
+      offset += n;
+    }
+  }
+  if (getWorldSize() > 1) {
+    allReduce(bucket.buffer, /* async = */ true);
+  }
+  bucket.reduced = recordDistributedEvent();
+  bucket.awaited = false;
+
+  bucketParams_.clear();
+  bucketParamsBytes_ = 0;
+  ++currBucket_;
+}
+
+void PipelinedOptimizer::step() {
+  FL_TRACE(DISTRIBUTED, "PipelinedOptimizer::step");
+  // the gradients which weren't added by the hooks
+  for (size_t i = 0; i < parameters_.size(); ++i) {
+    if ((!reducing_ || !added_[i]) && parameters_[i].isGradAvailable()) {
+      gradReady(i);
+    }
+  }
+  if (!reducing_) {
+    awaitAll();
+    return;
+  }
+  reduceBucket();
+  // the remaining buckets were not used during this step
+  buckets_.resize(currBucket_);
+  currBucket_ = 0;
+  reducing_ = false;
+  if (!normalizer_.isempty() && !normalizerReduced_ && getWorldSize() > 1) {
+    allReduce(normalizer_, /* async = */ true);
+    waitDistributedEvent(recordDistributedEvent());
+  }
+
+  for (size_t i = 0; i < parameters_.size(); ++i) {
+    if (added_[i]) {
+      pending_[parameters_[i].array().get()] = i;
+    }
+  }
+  pendingNormalizer_ = normalizer_;
+  normalizer_ = af::array();
+  pendingLr_ = lr_;
+}
+
+void PipelinedOptimizer::update(std::size_t i) {
+  auto& parameter = parameters_[i];
+  auto& bucket = buckets_[slots_[i].bucket];
+  if (!bucket.awaited) {
+    waitDistributedEvent(bucket.reduced);
+    bucket.awaited = true;
+  }
+  dim_t n = parameter.elements();
+  if (n == 0) {
+    return;
+  }
+  dim_t offset = slots_[i].offset;
+  auto grad = af::moddims(
+      bucket.buffer(af::seq(offset, offset + n - 1)), parameter.dims());
+  if (gradScale_ != 1.0) {
+    grad = grad * gradScale_;
+  }
+  if (!pendingNormalizer_.isempty()) {
+    grad = grad / af::tile(pendingNormalizer_.as(grad.type()), grad.dims());
+  }
+  // don't keep references to the buffer, which is reused in place
+  grad = grad.copy();
+
+  // The gradient of the next step may have started to accumulate
+  Variable nextGrad;
+  bool hasNextGrad = parameter.isGradAvailable();
+  if (hasNextGrad) {
+    nextGrad = parameter.grad();
+  }
+  parameter.zeroGrad();
+  parameter.addGrad(Variable(grad, false));
+  optimizers_[i]->setLr(pendingLr_);
+  optimizers_[i]->step();
+  parameter.zeroGrad();
+  if (hasNextGrad) {
+    parameter.addGrad(nextGrad);
+  }
+}
+
+void PipelinedOptimizer::awaitParams(const std::vector<Variable>& params) {
+  for (const auto& param : params) {
+    if (pending_.empty()) {
+      return;
+    }
+    auto it = pending_.find(param.array().get());
+    if (it == pending_.end()) {
+      continue;
+    }
+    // before the update, which replaces the array
+    auto i = it->second;
+    pending_.erase(it);
+    update(i);
+  }
+}
+
+void PipelinedOptimizer::awaitAll() {
+  std::vector<std::size_t> indices;
+  for (const auto& entry : pending_) {
+    indices.push_back(entry.second);
+  }
+  pending_.clear();
+  // in the order of the parameters, e.g. of the layers
+  std::sort(indices.begin(), indices.end());
+  for (auto i : indices) {
+    update(i);
+  }
+}
+
+bool PipelinedOptimizer::hasPendingUpdates() const {
+  return !pending_.empty();
+}
+
+std::vector<af::array*> PipelinedOptimizer::getStateArrays() {
+  std::vector<af::array*> arrays;
+  for (auto& optimizer : optimizers_) {
+    auto states = optimizer->getStateArrays();
+    arrays.insert(arrays.end(), states.begin(), states.end());
+  }
+  return arrays;
+}
+
+std::string PipelinedOptimizer::prettyString() const {
+  std::ostringstream ss;
+  ss << "Pipelined " << optimizers_.front()->prettyString();
+  return ss.str();
+}
+
+ModuleForwardHook awaitModuleParams(PipelinedOptimizer& optimizer) {
+  return [&optimizer](Module& module) {
+    if (optimizer.hasPendingUpdates()) {
+      optimizer.awaitParams(module.params());
+    }
+  };
+}
+
+} // namespace fl
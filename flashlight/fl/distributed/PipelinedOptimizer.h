@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <arrayfire.h>
+
+#include "flashlight/fl/common/Defines.h"
+#include "flashlight/fl/common/Serialization.h"
+#include "flashlight/fl/distributed/DistributedApi.h"
+#include "flashlight/fl/nn/ModuleProfiler.h"
+#include "flashlight/fl/optim/Optimizers.h"
+
+namespace fl {
+
+/**
+ * An optimizer which reduces the gradients over the processes of the
+ * distributed environment in buckets, and defers the update of each parameter
+ * until the next forward pass uses it, so that the forward of the first layers
+ * doesn't wait for the reductions of the last buckets.
+ *
+ * The gradients are grouped in buckets in the order in which the backward
+ * pass computes them (see `BucketedReducer`). Each bucket is reduced
+ * asynchronously as soon as it is full, and an event (see
+ * `recordDistributedEvent`) marks the end of its reduction. `step()` reduces
+ * the last bucket, without waiting: the update of a parameter is pending until
+ * `awaitParams()` (or `awaitAll()`) is called on it. The ArrayFire stream then
+ * waits for the reduction of its bucket only, and the parameter is updated by
+ * its own optimizer. Calling `awaitParams()` before the forward of each layer
+ * (see `setModuleForwardHook` and `awaitModuleParams`) thus updates the first
+ * layers, whose gradients are reduced last, while the forward proceeds. The
+ * updates still pending when the next backward pass computes its first
+ * gradient are applied then.
+ *
+ * Each parameter has its own instance of the wrapped optimizer, which must
+ * update its parameters independently (e.g. SGD or Adam, but not an update
+ * depending on a norm over all the parameters). As the gradients aren't all
+ * reduced before `step()`, they can't be clipped or checked for overflows
+ * beforehand. The gradients can't be accumulated over several backward passes
+ * per step, and sparse gradients aren't supported.
+ *
+ * Example usage:
+ *
+ * \code
+ * PipelinedOptimizer optimizer(
+ *     model.params(),
+ *     [](const std::vector<Variable>& params) {
+ *       return std::make_shared<AdamOptimizer>(params, 1e-3);
+ *     },
+ *     1.0 / getWorldSize());
+ * optimizer.registerGradHooks();
+ * auto hook = awaitModuleParams(optimizer);
+ * setModuleForwardHook(hook);
+ * auto loss = model(data); // the modules are updated as they are used
+ * loss.backward(); // the buckets are reduced as their gradients are computed
+ * optimizer.step();
+ * optimizer.zeroGrad();
+ * \endcode
+ */
+class PipelinedOptimizer : public FirstOrderOptimizer {
+ public:
+  /**
+   * Creates the wrapped optimizer of a parameter.
+   */
+  using OptimizerFactory = std::function<std::shared_ptr<FirstOrderOptimizer>(
+      const std::vector<Variable>&)>;
+
+  /** Constructs a `PipelinedOptimizer`.
+   * @param parameters The parameters from e.g. `model.parameters()`
+   * @param createOptimizer Creates the wrapped optimizer of each parameter,
+   * whose learning rate is the initial learning rate
+   * @param gradScale The factor by which reduced gradients are scaled (e.g.
+   * `1 / getWorldSize()` to average them)
+   * @param bucketBytes The size of the buckets, in bytes
+   */
+  PipelinedOptimizer(
+      const std::vector<Variable>& parameters,
+      const OptimizerFactory& createOptimizer,
+      double gradScale = 1.0,
+      std::size_t bucketBytes = DistributedConstants::kCoalesceCacheSize);
+
+  /**
+   * Registers gradient hooks on the parameters (replacing their previous
+   * hooks, e.g. of `distributeModuleGrads`) which add the gradients to the
+   * buckets during the backward pass. Without them, `step()` reduces all the
+   * gradients at once. The optimizer must outlive the hooks.
+   */
+  void registerGradHooks();
+
+  /**
+   * Divides the reduced gradients of the current step by the sum of `count`
+   * (a one-element array) over the processes, e.g. the number of samples of
+   * each process. The sum is reduced asynchronously before the first bucket:
+   * call it before the backward pass.
+   */
+  void setGradNormalizer(const af::array& count);
+
+  /**
+   * Reduces the last bucket, and makes the updates of the parameters with a
+   * gradient pending. The learning rate of the updates is the current one.
+   */
+  void step() override;
+
+  /**
+   * Applies the pending updates of `params`, once the reductions of their
+   * buckets are done. The other parameters are ignored.
+   */
+  void awaitParams(const std::vector<Variable>& params);
+
+  /** Applies all the pending updates. */
+  void awaitAll();
+
+  /** Whether updates are pending since the last `step()`. */
+  bool hasPendingUpdates() const;
+
+  std::vector<af::array*> getStateArrays() override;
+
+  std::string prettyString() const override;
+
+ private:
+  FL_SAVE_LOAD_WITH_BASE(
+      FirstOrderOptimizer,
+      optimizers_,
+      gradScale_,
+      fl::serializeAs<uint64_t>(bucketBytes_))
+
+  PipelinedOptimizer() = default; // Intentionally private
+
+  struct Bucket {
+    /// Number of parameters in the bucket
+    std::size_t size{0};
+    /// Contiguous buffer in which the gradients are reduced
+    af::array buffer;
+    /// End of the reduction of the buffer
+    DistributedEvent reduced;
+    bool awaited{false};
+  };
+
+  // Where the gradient of a parameter was reduced
+  struct Slot {
+    std::size_t bucket;
+    dim_t offset;
+  };
+
+  // Called once the gradient of the i-th parameter is available
+  void gradReady(std::size_t i);
+  // Copies the gradients of the current bucket to its buffer and reduces it
+  void reduceBucket();
+  // Reduced gradient of the i-th parameter, then its update
+  void update(std::size_t i);
+
+  std::vector<std::shared_ptr<FirstOrderOptimizer>> optimizers_;
+  double gradScale_{1.0};
+  std::size_t bucketBytes_{DistributedConstants::kCoalesceCacheSize};
+
+  /// The buckets, as formed during the first step
+  std::vector<Bucket> buckets_;
+  std::size_t currBucket_{0};
+  /// Parameters added to the current bucket, and their size in bytes
+  std::vector<std::size_t> bucketParams_;
+  std::size_t bucketParamsBytes_{0};
+  /// Whether the backward pass of the current step has started
+  bool reducing_{false};
+  std::vector<bool> added_;
+  std::vector<Slot> slots_;
+  /// Sum of the counts of `setGradNormalizer()` over the processes
+  af::array normalizer_;
+  bool normalizerReduced_{false};
+  /// The parameters with a pending update, by their array, and the
+  /// normalizer and learning rate of the updates
+  std::unordered_map<af_array, std::size_t> pending_;
+  af::array pendingNormalizer_;
+  double pendingLr_{0.0};
+};
+
+/**
+ * Returns a hook for `setModuleForwardHook` which applies the pending updates
+ * of `optimizer` for the parameters of each forwarded module.
+ */
+ModuleForwardHook awaitModuleParams(PipelinedOptimizer& optimizer);
+
+} // namespace fl
+
+CEREAL_REGISTER_TYPE(fl::PipelinedOptimizer)
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/distributed/ShardedOptimizer.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+#include "flashlight/fl/distributed/DistributedApi.h"
+
+namespace fl {
+
+ShardedOptimizer::ShardedOptimizer(
+    const std::vector<Variable>& parameters,
+    const OptimizerFactory& createOptimizer,
+    double gradScale /* = 1.0 */)
+    : FirstOrderOptimizer(parameters, 0.0),
+      worldRank_(getWorldRank()),
+      worldSize_(getWorldSize()),
+      gradScale_(gradScale) {
+  if (parameters_.empty()) {
+    throw std::invalid_argument("ShardedOptimizer: no parameters");
+  }
+  dim_t totalSize = 0;
+  for (const auto& parameter : parameters_) {
+    if (parameter.type() != parameters_.front().type()) {
+      throw std::invalid_argument(
+          "ShardedOptimizer: parameters of different types");
+    }
+    offsets_.push_back(totalSize);
+    totalSize += parameter.elements();
+  }
+  // The concatenation is padded to a multiple of the world size
+  shardSize_ = (totalSize + worldSize_ - 1) / worldSize_;
+  shard_ = Variable(
+      af::constant(0, shardSize_, parameters_.front().type()),
+      /* calcGrad = */ true);
+  copyShard();
+  optimizer_ = createOptimizer({shard_});
+  lr_ = optimizer_->getLr();
+}
+
+void ShardedOptimizer::copyShard() {
+  dim_t begin = worldRank_ * shardSize_;
+  dim_t end = begin + shardSize_;
+  for (size_t i = 0; i < parameters_.size(); ++i) {
+    dim_t lo = std::max(begin, offsets_[i]);
+    dim_t hi = std::min(end, offsets_[i] + parameters_[i].elements());
+    if (lo < hi) {
+      shard_.array()(af::seq(lo - begin, hi - begin - 1)) =
+          af::flat(parameters_[i].array())(
+              af::seq(lo - offsets_[i], hi - offsets_[i] - 1));
+    }
+  }
+}
+
+void ShardedOptimizer::reduceGrads() {
+  auto type = shard_.type();
+  auto grads = af::constant(0, shardSize_ * worldSize_, type);
+  for (size_t i = 0; i < parameters_.size(); ++i) {
+    const auto& parameter = parameters_[i];
+    if (parameter.isGradAvailable() && parameter.elements() > 0) {
+      grads(af::seq(offsets_[i], offsets_[i] + parameter.elements() - 1)) =
+          af::flat(parameter.grad().array()).as(type);
+    }
+  }
+  af::array shardGrad;
+  if (worldSize_ > 1) {
+    reduceScatter(grads, shardGrad);
+  } else {
+    shardGrad = grads;
+  }
+  if (gradScale_ != 1.0) {
+    shardGrad = shardGrad * gradScale_;
+  }
+  // Only the reduced gradients of the owned part are needed from now on
+  FirstOrderOptimizer::zeroGrad();
+  shard_.zeroGrad();
+  shard_.addGrad(Variable(shardGrad, false));
+  gradsReduced_ = true;
+}
+
+af::array ShardedOptimizer::clipGradNormAsync(double maxNorm) {
+  if (!gradsReduced_) {
+    reduceGrads();
+  }
+  auto& grad = shard_.grad().array();
+  auto gradF32 = grad.as(af::dtype::f32);
+  auto gradNorm = af::sum(gradF32 * gradF32);
+  if (worldSize_ > 1) {
+    allReduce(gradNorm);
+  }
+  gradNorm = af::sqrt(gradNorm);
+  auto scale = af::min(maxNorm / gradNorm, 1.0);
+  grad = grad * af::tile(scale.as(grad.type()), grad.dims());
+  return gradNorm;
+}
+
+Variable ShardedOptimizer::getShard() const {
+  return shard_;
+}
+
+std::shared_ptr<FirstOrderOptimizer> ShardedOptimizer::getShardOptimizer()
+    const {
+  return optimizer_;
+}
+
+void ShardedOptimizer::setShard(
+    const Variable& shard,
+    std::shared_ptr<FirstOrderOptimizer> optimizer) {
+  if (!optimizer) {
+    throw std::invalid_argument("ShardedOptimizer::setShard: null optimizer");
+  }
+  if (shard.elements() != shardSize_ || shard.type() != shard_.type()) {
+    throw std::invalid_argument(
+        "ShardedOptimizer::setShard: the shard doesn't match the parameters "
+        "and the world size");
+  }
+  shard_ = shard;
+  optimizer_ = std::move(optimizer);
+  lr_ = optimizer_->getLr();
+  gradsReduced_ = false;
+}
+
+void ShardedOptimizer::step() {
+  if (!gradsReduced_) {
+    reduceGrads();
+  }
+  // The parameters may have been modified since the last step
+  copyShard();
+  optimizer_->setLr(lr_);
+  optimizer_->step();
+
+  af::array updated;
+  if (worldSize_ > 1) {
+    allGather(shard_.array(), updated);
+  } else {
+    updated = shard_.array();
+  }
+  for (size_t i = 0; i < parameters_.size(); ++i) {
+    auto& parameter = parameters_[i];
+    dim_t n = parameter.elements();
+    if (n > 0) {
+      parameter.array() = af::moddims(
+          updated(af::seq(offsets_[i], offsets_[i] + n - 1)), parameter.dims());
+      parameter.array().eval();
+    }
+  }
+  gradsReduced_ = false;
+}
+
+void ShardedOptimizer::zeroGrad() {
+  FirstOrderOptimizer::zeroGrad();
+  optimizer_->zeroGrad();
+  gradsReduced_ = false;
+}
+
+std::string ShardedOptimizer::prettyString() const {
+  std::ostringstream ss;
+  ss << "Sharded (" << worldRank_ << "/" << worldSize_ << ") "
+     << optimizer_->prettyString();
+  return ss.str();
+}
+
+} // namespace fl
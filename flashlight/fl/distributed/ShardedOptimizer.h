@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "flashlight/fl/optim/Optimizers.h"
+
+namespace fl {
+
+/**
+ * An optimizer which partitions the optimizer state and the reduced gradients
+ * across the processes of the distributed environment (as stages 1 and 2 of
+ * ZeRO, https://arxiv.org/abs/1910.02054).
+ *
+ * The parameters are flattened and concatenated, and each process owns an
+ * equal, contiguous part of the concatenation. At each step, the gradients are
+ * summed over processes with `reduceScatter`, so that each process only keeps
+ * the reduced gradients of the part it owns; the wrapped optimizer updates
+ * that part, and the updated parameters are gathered on all processes with
+ * `allGather`. The state of the wrapped optimizer (e.g. the moments of
+ * `AdamOptimizer`) is thus divided by the world size.
+ *
+ * The gradients must not be reduced elsewhere (e.g. by a `Reducer`), and all
+ * the parameters must be of the same type. Optimizers whose update depends on
+ * statistics of whole parameters (e.g. the gradient norms of
+ * `NovogradOptimizer`) compute them over the owned part instead.
+ *
+ * Example usage:
+ *
+ * \code
+ * ShardedOptimizer optimizer(
+ *     model.params(),
+ *     [](const std::vector<Variable>& shard) {
+ *       return std::make_shared<AdamOptimizer>(shard, 1e-3);
+ *     },
+ *     1.0 / getWorldSize());
+ * auto loss = model(data);
+ * loss.backward();
+ * optimizer.step();
+ * optimizer.zeroGrad();
+ * \endcode
+ */
+class ShardedOptimizer : public FirstOrderOptimizer {
+ public:
+  /**
+   * Creates the wrapped optimizer for the given parameters (the part of the
+   * concatenated parameters owned by the process).
+   */
+  using OptimizerFactory = std::function<std::shared_ptr<FirstOrderOptimizer>(
+      const std::vector<Variable>&)>;
+
+  /** Constructs a `ShardedOptimizer`.
+   * @param parameters The parameters from e.g. `model.parameters()`
+   * @param createOptimizer Creates the wrapped optimizer, whose learning rate
+   * is the initial learning rate
+   * @param gradScale The factor by which reduced gradients are scaled (e.g.
+   * `1 / getWorldSize()` to average them)
+   */
+  ShardedOptimizer(
+      const std::vector<Variable>& parameters,
+      const OptimizerFactory& createOptimizer,
+      double gradScale = 1.0);
+
+  /**
+   * Sums the gradients of the parameters over processes, and keeps the part
+   * owned by this process. The gradients of the parameters are released.
+   * Called by `step()` unless it was called since the last step.
+   */
+  void reduceGrads();
+
+  /**
+   * Clips the reduced gradients by their norm over all the parameters (see
+   * `clipGradNorm`), calling `reduceGrads()` first if needed.
+   *
+   * @return the norm of the reduced gradients before clipping, as a
+   * one-element array
+   */
+  af::array clipGradNormAsync(double maxNorm);
+
+  /**
+   * Returns the part of the concatenated parameters owned by this process,
+   * which is the only parameter of the wrapped optimizer.
+   */
+  Variable getShard() const;
+
+  /** Returns the wrapped optimizer, which updates `getShard()`. */
+  std::shared_ptr<FirstOrderOptimizer> getShardOptimizer() const;
+
+  /**
+   * Replaces the owned part and the wrapped optimizer, e.g. with the ones
+   * saved (together, so that the shard remains a parameter of the optimizer)
+   * by this process with the same world size. The learning rate becomes the
+   * one of the given optimizer.
+   */
+  void setShard(
+      const Variable& shard,
+      std::shared_ptr<FirstOrderOptimizer> optimizer);
+
+  void step() override;
+
+  void zeroGrad() override;
+
+  std::string prettyString() const override;
+
+ private:
+  // Copies the owned part of the concatenated parameters to `shard_`
+  void copyShard();
+
+  std::shared_ptr<FirstOrderOptimizer> optimizer_;
+  // Owned part of the concatenated parameters, updated by `optimizer_`
+  Variable shard_;
+  std::vector<dim_t> offsets_;
+  dim_t shardSize_;
+  int worldRank_;
+  int worldSize_;
+  double gradScale_;
+  bool gradsReduced_{false};
+};
+
+} // namespace fl
@@ -0,0 +1,435 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/distributed/TcpStore.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+
+enum class Command : uint8_t { SET = 0, GET = 1, ADD = 2, CHECK = 3, WAIT = 4 };
+
+void sendAll(int fd, const void* data, size_t size) {
+  auto ptr = static_cast<const char*>(data);
+  while (size > 0) {
+    auto n = ::send(fd, ptr, size, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::runtime_error(
+          std::string("TcpStore: send failed: ") + std::strerror(errno));
+    }
+    ptr += n;
+    size -= n;
+  }
+}
+
+// Returns false if the connection was closed before any data was received
+bool recvAll(int fd, void* data, size_t size) {
+  auto ptr = static_cast<char*>(data);
+  size_t received = 0;
+  while (received < size) {
+    auto n = ::recv(fd, ptr + received, size - received, 0);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::runtime_error(
+          std::string("TcpStore: recv failed: ") + std::strerror(errno));
+    }
+    if (n == 0) {
+      if (received == 0) {
+        return false;
+      }
+      throw std::runtime_error("TcpStore: connection closed during recv");
+    }
+    received += n;
+  }
+  return true;
+}
+
+template <typename T>
+void sendValue(int fd, T value) {
+  sendAll(fd, &value, sizeof(value));
+}
+
+template <typename T>
+T recvValue(int fd) {
+  T value;
+  if (!recvAll(fd, &value, sizeof(value))) {
+    throw std::runtime_error("TcpStore: connection closed");
+  }
+  return value;
+}
+
+void sendBytes(int fd, const char* data, size_t size) {
+  sendValue<uint64_t>(fd, size);
+  sendAll(fd, data, size);
+}
+
+std::vector<char> recvBytes(int fd) {
+  auto size = recvValue<uint64_t>(fd);
+  std::vector<char> data(size);
+  if (size > 0 && !recvAll(fd, data.data(), size)) {
+    throw std::runtime_error("TcpStore: connection closed");
+  }
+  return data;
+}
+
+void sendString(int fd, const std::string& s) {
+  sendBytes(fd, s.data(), s.size());
+}
+
+std::string recvString(int fd) {
+  auto data = recvBytes(fd);
+  return std::string(data.begin(), data.end());
+}
+
+} // namespace
+
+namespace fl {
+
+namespace detail {
+
+constexpr std::chrono::milliseconds TcpStore::kDefaultTimeout;
+
+/**
+ * Serves the requests of all the clients in a single thread. Requests are
+ * small, and read as a whole once readable; `GET` and `WAIT` requests of unset
+ * keys are answered once the keys are set.
+ */
+class TcpStore::Server {
+ public:
+  explicit Server(int port) {
+    listenFd_ = ::socket(AF_INET6, SOCK_STREAM, 0);
+    if (listenFd_ < 0) {
+      throw std::runtime_error("TcpStore::Server: socket creation failed");
+    }
+    int on = 1;
+    ::setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    // Accept IPv4 connections as well
+    int off = 0;
+    ::setsockopt(listenFd_, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+    sockaddr_in6 addr{};
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_any;
+    addr.sin6_port = htons(port);
+    if (::bind(listenFd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) <
+            0 ||
+        ::listen(listenFd_, SOMAXCONN) < 0) {
+      auto err = std::string(std::strerror(errno));
+      ::close(listenFd_);
+      throw std::runtime_error(
+          "TcpStore::Server: cannot listen on port " + std::to_string(port) +
+          ": " + err);
+    }
+    if (::pipe(stopFds_) < 0) {
+      ::close(listenFd_);
+      throw std::runtime_error("TcpStore::Server: pipe creation failed");
+    }
+    thread_ = std::thread([this]() { run(); });
+  }
+
+  ~Server() {
+    char c = 0;
+    while (::write(stopFds_[1], &c, 1) < 0 && errno == EINTR) {
+    }
+    thread_.join();
+    for (int fd : clients_) {
+      ::close(fd);
+    }
+    ::close(listenFd_);
+    ::close(stopFds_[0]);
+    ::close(stopFds_[1]);
+  }
+
+ private:
+  struct Waiter {
+    int fd;
+    Command command;
+    std::vector<std::string> keys;
+  };
+
+  void run() {
+    while (true) {
+      std::vector<pollfd> fds = {{stopFds_[0], POLLIN, 0},
+                                 {listenFd_, POLLIN, 0}};
+      for (int fd : clients_) {
+        fds.push_back({fd, POLLIN, 0});
+      }
+      if (::poll(fds.data(), fds.size(), -1) < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return;
+      }
+      if (fds[0].revents) {
+        return;
+      }
+      if (fds[1].revents & POLLIN) {
+        int fd = ::accept(listenFd_, nullptr, nullptr);
+        if (fd >= 0) {
+          int on = 1;
+          ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+          clients_.push_back(fd);
+        }
+      }
+      for (size_t i = 2; i < fds.size(); ++i) {
+        if (fds[i].revents == 0) {
+          continue;
+        }
+        bool open = false;
+        try {
+          open = (fds[i].revents & POLLIN) && serve(fds[i].fd);
+        } catch (const std::exception&) {
+          // A broken client doesn't stop the server
+        }
+        if (!open) {
+          dropClient(fds[i].fd);
+        }
+      }
+    }
+  }
+
+  // Returns false if the client closed the connection
+  bool serve(int fd) {
+    Command command;
+    if (!recvAll(fd, &command, sizeof(command))) {
+      return false;
+    }
+    switch (command) {
+      case Command::SET: {
+        auto key = recvString(fd);
+        data_[key] = recvBytes(fd);
+        sendValue<uint8_t>(fd, 1);
+        notifyWaiters();
+        break;
+      }
+      case Command::ADD: {
+        auto key = recvString(fd);
+        auto delta = recvValue<int64_t>(fd);
+        int64_t value = 0;
+        auto it = data_.find(key);
+        if (it != data_.end() && it->second.size() == sizeof(value)) {
+          std::memcpy(&value, it->second.data(), sizeof(value));
+        }
+        value += delta;
+        std::vector<char> bytes(sizeof(value));
+        std::memcpy(bytes.data(), &value, sizeof(value));
+        data_[key] = std::move(bytes);
+        sendValue<int64_t>(fd, value);
+        notifyWaiters();
+        break;
+      }
+      case Command::CHECK: {
+        auto key = recvString(fd);
+        sendValue<uint8_t>(fd, data_.count(key) ? 1 : 0);
+        break;
+      }
+      case Command::GET: {
+        Waiter waiter{fd, command, {recvString(fd)}};
+        if (!tryAnswer(waiter)) {
+          waiters_.push_back(std::move(waiter));
+        }
+        break;
+      }
+      case Command::WAIT: {
+        Waiter waiter{fd, command, {}};
+        auto numKeys = recvValue<uint64_t>(fd);
+        for (uint64_t k = 0; k < numKeys; ++k) {
+          waiter.keys.push_back(recvString(fd));
+        }
+        if (!tryAnswer(waiter)) {
+          waiters_.push_back(std::move(waiter));
+        }
+        break;
+      }
+      default:
+        throw std::runtime_error("TcpStore::Server: invalid command");
+    }
+    return true;
+  }
+
+  // Answers the waiter if all its keys are set
+  bool tryAnswer(const Waiter& waiter) {
+    for (const auto& key : waiter.keys) {
+      if (data_.find(key) == data_.end()) {
+        return false;
+      }
+    }
+    if (waiter.command == Command::GET) {
+      const auto& value = data_[waiter.keys.front()];
+      sendBytes(waiter.fd, value.data(), value.size());
+    } else {
+      sendValue<uint8_t>(waiter.fd, 1);
+    }
+    return true;
+  }
+
+  void notifyWaiters() {
+    std::vector<Waiter> remaining;
+    for (auto& waiter : waiters_) {
+      bool answered = true;
+      try {
+        answered = tryAnswer(waiter);
+      } catch (const std::exception&) {
+        // The client is dropped once its connection is seen closed
+      }
+      if (!answered) {
+        remaining.push_back(std::move(waiter));
+      }
+    }
+    waiters_ = std::move(remaining);
+  }
+
+  void dropClient(int fd) {
+    ::close(fd);
+    clients_.erase(std::remove(clients_.begin(), clients_.end(), fd));
+    std::vector<Waiter> remaining;
+    for (auto& waiter : waiters_) {
+      if (waiter.fd != fd) {
+        remaining.push_back(std::move(waiter));
+      }
+    }
+    waiters_ = std::move(remaining);
+  }
+
+  int listenFd_{-1};
+  // Written to by the destructor to stop the thread
+  int stopFds_[2];
+  std::vector<int> clients_;
+  std::vector<Waiter> waiters_;
+  std::unordered_map<std::string, std::vector<char>> data_;
+  std::thread thread_;
+};
+
+TcpStore::TcpStore(
+    const std::string& host,
+    int port,
+    bool isServer,
+    std::chrono::milliseconds timeout /* = kDefaultTimeout */)
+    : timeout_(timeout) {
+  if (isServer) {
+    server_ = std::make_unique<Server>(port);
+  }
+  connect(host, port);
+}
+
+TcpStore::~TcpStore() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+  // server_ is destroyed after the client connection is closed
+}
+
+void TcpStore::connect(const std::string& host, int port) {
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  const auto start = std::chrono::steady_clock::now();
+  // The server may not be listening yet
+  while (true) {
+    addrinfo* addrs = nullptr;
+    if (::getaddrinfo(
+            host.c_str(), std::to_string(port).c_str(), &hints, &addrs) == 0) {
+      for (auto addr = addrs; addr != nullptr; addr = addr->ai_next) {
+        int fd = ::socket(addr->ai_family, addr->ai_socktype, 0);
+        if (fd < 0) {
+          continue;
+        }
+        if (::connect(fd, addr->ai_addr, addr->ai_addrlen) == 0) {
+          fd_ = fd;
+          break;
+        }
+        ::close(fd);
+      }
+      ::freeaddrinfo(addrs);
+    }
+    if (fd_ >= 0) {
+      break;
+    }
+    if (std::chrono::steady_clock::now() - start > timeout_) {
+      throw std::runtime_error(
+          "TcpStore: cannot connect to " + host + ":" + std::to_string(port));
+    }
+    /* sleep override */
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  int on = 1;
+  ::setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+}
+
+void TcpStore::waitReply(const std::string& key) {
+  pollfd fd = {fd_, POLLIN, 0};
+  int rv;
+  do {
+    rv = ::poll(&fd, 1, timeout_.count());
+  } while (rv < 0 && errno == EINTR);
+  if (rv == 0) {
+    throw std::runtime_error("TcpStore timed out for key: " + key);
+  }
+  if (rv < 0) {
+    throw std::runtime_error("TcpStore: poll failed for key: " + key);
+  }
+}
+
+std::vector<char> TcpStore::get(const std::string& key) {
+  sendValue(fd_, Command::GET);
+  sendString(fd_, key);
+  waitReply(key);
+  return recvBytes(fd_);
+}
+
+void TcpStore::set(const std::string& key, const std::vector<char>& data) {
+  sendValue(fd_, Command::SET);
+  sendString(fd_, key);
+  sendBytes(fd_, data.data(), data.size());
+  recvValue<uint8_t>(fd_);
+}
+
+int64_t TcpStore::add(const std::string& key, int64_t delta) {
+  sendValue(fd_, Command::ADD);
+  sendString(fd_, key);
+  sendValue(fd_, delta);
+  return recvValue<int64_t>(fd_);
+}
+
+bool TcpStore::check(const std::string& key) {
+  sendValue(fd_, Command::CHECK);
+  sendString(fd_, key);
+  return recvValue<uint8_t>(fd_) != 0;
+}
+
+void TcpStore::wait(const std::vector<std::string>& keys) {
+  if (keys.empty()) {
+    return;
+  }
+  sendValue(fd_, Command::WAIT);
+  sendValue<uint64_t>(fd_, keys.size());
+  for (const auto& key : keys) {
+    sendString(fd_, key);
+  }
+  waitReply(keys.front());
+  recvValue<uint8_t>(fd_);
+}
+
+} // namespace detail
+
+} // namespace fl
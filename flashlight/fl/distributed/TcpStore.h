@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fl {
+
+namespace detail {
+
+/**
+ * A key-value store for rendezvous over TCP. One process (e.g. rank 0) runs
+ * the server in a background thread, and all processes (including the server
+ * process) connect to it as clients.
+ *
+ * Unlike `FileStore`, there is no shared filesystem involved: `get` and `wait`
+ * block on the server until the key is set, so waiting clients don't poll.
+ * Keys are never removed, which makes stale values from a previous job
+ * impossible.
+ */
+class TcpStore {
+ public:
+  static constexpr std::chrono::milliseconds kDefaultTimeout =
+      std::chrono::seconds(60 * 2);
+
+  /**
+   * @param host The host of the server
+   * @param port The port of the server
+   * @param isServer Whether this process runs the server, listening on `port`
+   * @param timeout The timeout of connections and of blocking operations
+   */
+  TcpStore(
+      const std::string& host,
+      int port,
+      bool isServer,
+      std::chrono::milliseconds timeout = kDefaultTimeout);
+  ~TcpStore();
+
+  TcpStore(const TcpStore&) = delete;
+  TcpStore& operator=(const TcpStore&) = delete;
+
+  /** Blocks until the key is set, and returns its value */
+  std::vector<char> get(const std::string& key);
+  void set(const std::string& key, const std::vector<char>& data);
+  /**
+   * Atomically adds `delta` to the integer value of the key (0 if not set),
+   * and returns the result. E.g. to count processes which reached a point.
+   */
+  int64_t add(const std::string& key, int64_t delta);
+  /** Returns whether the key is set, without blocking */
+  bool check(const std::string& key);
+  /** Blocks until all the keys are set */
+  void wait(const std::vector<std::string>& keys);
+
+ private:
+  class Server;
+
+  void connect(const std::string& host, int port);
+  // Waits until the reply of the server is readable, or throws on timeout
+  void waitReply(const std::string& key);
+
+  std::unique_ptr<Server> server_;
+  int fd_{-1};
+  std::chrono::milliseconds timeout_;
+};
+
+} // namespace detail
+
+} // namespace fl
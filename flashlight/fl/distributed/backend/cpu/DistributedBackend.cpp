@@ -7,23 +7,49 @@
 
 #include "flashlight/fl/distributed/DistributedApi.h"
 
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <future>
 #include <iostream>
 #include <list>
 #include <memory>
 #include <mutex>
 #include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
 
+#include <gloo/allgather_ring.h>
 #include <gloo/allreduce_halving_doubling.h>
+#include <gloo/broadcast_one_to_all.h>
 #include <gloo/config.h>
 #include <gloo/mpi/context.h>
+#include <gloo/reduce_scatter.h>
 #include <gloo/transport/tcp/device.h>
+#include <gloo/transport/unbound_buffer.h>
+#include <gloo/types.h>
 #include <mpi.h>
 
+#include "flashlight/fl/common/Defines.h"
 #include "flashlight/fl/common/DevicePtr.h"
+#include "flashlight/fl/common/threadpool/ThreadPool.h"
 #include "flashlight/fl/distributed/LRUCache.h"
 
 namespace {
+std::shared_ptr<gloo::transport::Device> glooDevice_;
 std::shared_ptr<gloo::mpi::Context> glooContext_;
+// With hierarchical collectives, the contexts of the processes of the node,
+// and of the leaders (processes of local rank 0) of all nodes
+std::shared_ptr<gloo::mpi::Context> localContext_;
+std::shared_ptr<gloo::mpi::Context> leaderContext_;
+// With pipeline stages, the context of the processes of the stage
+std::shared_ptr<gloo::mpi::Context> stageContext_;
+// The contexts of the groups created by `createGroup`, by group id
+std::vector<std::shared_ptr<gloo::mpi::Context>> groupContexts_;
+// Slot of the point-to-point transfers, matched in order between two
+// processes
+constexpr uint64_t kSendRecvSlot_ = 0;
 
 // Gloo algorithms are "not meant" to be created an deleted often, for some
 // strange reason. Therefore, we emulate THD by providing a cache of the last
@@ -38,6 +64,25 @@ const int kGlooCacheSize_ = 10;
 using CacheType = fl::detail::LRUCache<std::string, gloo::Algorithm>;
 CacheType glooCache_(kGlooCacheSize_);
 af::array cacheArr_;
+
+// Asynchronous collectives run in staging buffers used round-robin, which
+// their next user waits for. As for `cacheArr_`, the buffers are the same for
+// the same sequence of collectives on all processes, so that their cached
+// algorithms are too.
+const int kNumAsyncBuffers_ = 8;
+struct AsyncBuffer {
+  af::array buffer;
+  std::shared_future<void> done;
+};
+std::vector<AsyncBuffer> asyncBuffers_(kNumAsyncBuffers_);
+size_t nextAsyncBuffer_ = 0;
+// Asynchronous collectives which syncDistributed() waits for
+std::vector<std::shared_future<void>> pending_;
+
+// Collectives (and the algorithms of `glooCache_`) run on a single thread, in
+// the order they are called in, which is then the same on all processes.
+// Declared last to be joined before the rest is destroyed.
+std::unique_ptr<fl::ThreadPool> commThread_;
 } // namespace
 
 namespace fl {
@@ -49,28 +94,379 @@ std::shared_ptr<gloo::mpi::Context> globalContext() {
 }
 
 template <typename T>
-inline void allreduceGloo(T* ptr, size_t s) {
-  auto key = detail::makeHashKey(ptr, s, "allreduceCpu");
+inline void allreduceGloo(
+    const std::shared_ptr<gloo::mpi::Context>& context,
+    T* ptr,
+    size_t s,
+    const char* name) {
+  auto key = detail::makeHashKey(ptr, s, name, context.get());
   auto algorithm = glooCache_.get(key);
   if (algorithm == nullptr) {
     using Allreduce = gloo::AllreduceHalvingDoubling<T>;
     algorithm = glooCache_.put(
         key,
         std::make_unique<Allreduce>(
-            globalContext(),
+            context,
             std::vector<T*>({ptr}),
             s,
             gloo::ReductionFunction<T>::sum));
   }
   algorithm->run();
 }
+
+template <typename T>
+inline void allreduceGloo(T* ptr, size_t s) {
+  if (stageContext_) {
+    allreduceGloo(stageContext_, ptr, s, "allreduceCpuStage");
+    return;
+  }
+  if (!localContext_) {
+    allreduceGloo(globalContext(), ptr, s, "allreduceCpu");
+    return;
+  }
+  // Sum within the node, between the leaders, then broadcast from the leaders
+  // within the node
+  allreduceGloo(localContext_, ptr, s, "allreduceCpuLocal");
+  if (leaderContext_) {
+    allreduceGloo(leaderContext_, ptr, s, "allreduceCpuLeader");
+  }
+  auto key = detail::makeHashKey(ptr, s, "broadcastCpuLocal");
+  auto algorithm = glooCache_.get(key);
+  if (algorithm == nullptr) {
+    using Broadcast = gloo::BroadcastOneToAll<T>;
+    algorithm = glooCache_.put(
+        key,
+        std::make_unique<Broadcast>(
+            localContext_, std::vector<T*>({ptr}), s, /* rootRank = */ 0));
+  }
+  algorithm->run();
+}
+
+bool isAllreduceType(af::dtype type) {
+  switch (type) {
+    case af::dtype::f16:
+    case af::dtype::f32:
+    case af::dtype::f64:
+    case af::dtype::s32:
+    case af::dtype::s64:
+      return true;
+    default:
+      return false;
+  }
+}
+
+void allreduceGloo(
+    const std::shared_ptr<gloo::mpi::Context>& context,
+    af::dtype type,
+    void* ptr,
+    size_t count) {
+  const char* name = "allreduceCpuGroup";
+  switch (type) {
+    case af::dtype::f16:
+      allreduceGloo(context, static_cast<gloo::float16*>(ptr), count, name);
+      break;
+    case af::dtype::f32:
+      allreduceGloo(context, static_cast<float*>(ptr), count, name);
+      break;
+    case af::dtype::f64:
+      allreduceGloo(context, static_cast<double*>(ptr), count, name);
+      break;
+    case af::dtype::s32:
+      allreduceGloo(context, static_cast<int*>(ptr), count, name);
+      break;
+    case af::dtype::s64:
+      allreduceGloo(context, static_cast<int64_t*>(ptr), count, name);
+      break;
+    default:
+      throw std::runtime_error("unsupported data type for allreduce with gloo");
+  }
+}
+
+void allreduceGloo(af::dtype type, void* ptr, size_t count) {
+  switch (type) {
+    case af::dtype::f16:
+      allreduceGloo(static_cast<gloo::float16*>(ptr), count);
+      break;
+    case af::dtype::f32:
+      allreduceGloo(static_cast<float*>(ptr), count);
+      break;
+    case af::dtype::f64:
+      allreduceGloo(static_cast<double*>(ptr), count);
+      break;
+    case af::dtype::s32:
+      allreduceGloo(static_cast<int*>(ptr), count);
+      break;
+    case af::dtype::s64:
+      allreduceGloo(static_cast<int64_t*>(ptr), count);
+      break;
+    default:
+      throw std::runtime_error("unsupported data type for allreduce with gloo");
+  }
+}
+
+// Runs `fn` on the communication thread, after the collectives called before
+std::shared_future<void> runCollective(std::function<void()> fn) {
+  return commThread_->enqueue(std::move(fn)).share();
+}
+
+void mpiCheck(int ec) {
+  if (ec != MPI_SUCCESS) {
+    char buf[MPI_MAX_ERROR_STRING];
+    int resultlen;
+    MPI_Error_string(ec, buf, &resultlen);
+    throw std::runtime_error(buf);
+  }
+}
+
+// Creates the contexts of hierarchical allreduces, if there are several nodes
+void initHierarchy(const std::shared_ptr<gloo::transport::Device>& device) {
+  constexpr int kHostnameSize = 256;
+  std::vector<char> hostname(kHostnameSize, 0);
+  std::strncpy(hostname.data(), getHostname().c_str(), kHostnameSize - 1);
+  std::vector<char> all(kHostnameSize * glooContext_->size);
+  mpiCheck(MPI_Allgather(
+      hostname.data(),
+      kHostnameSize,
+      MPI_CHAR,
+      all.data(),
+      kHostnameSize,
+      MPI_CHAR,
+      MPI_COMM_WORLD));
+  std::vector<std::string> hostnames;
+  for (int r = 0; r < glooContext_->size; ++r) {
+    hostnames.emplace_back(all.data() + r * kHostnameSize);
+  }
+  auto topology = getNodeTopology(hostnames, glooContext_->rank);
+  if (topology.numNodes == 1) {
+    // Nothing to gain
+    return;
+  }
+
+  // Ordered by rank, so that the leaders are the lowest ranks of the nodes
+  MPI_Comm localComm, leaderComm;
+  mpiCheck(MPI_Comm_split(
+      MPI_COMM_WORLD, topology.nodeIndex, glooContext_->rank, &localComm));
+  bool isLeader = topology.localRank == 0;
+  mpiCheck(MPI_Comm_split(
+      MPI_COMM_WORLD,
+      isLeader ? 0 : MPI_UNDEFINED,
+      glooContext_->rank,
+      &leaderComm));
+  localContext_ = std::make_shared<gloo::mpi::Context>(localComm);
+  localContext_->setTimeout(gloo::kNoTimeout);
+  localContext_->connectFullMesh(device);
+  if (isLeader) {
+    leaderContext_ = std::make_shared<gloo::mpi::Context>(leaderComm);
+    leaderContext_->setTimeout(gloo::kNoTimeout);
+    leaderContext_->connectFullMesh(device);
+  }
+}
+
+// Creates the context of the processes of the same color, ordered by rank
+std::shared_ptr<gloo::mpi::Context> createContext(int color) {
+  MPI_Comm comm;
+  mpiCheck(
+      MPI_Comm_split(MPI_COMM_WORLD, color, glooContext_->rank, &comm));
+  auto context = std::make_shared<gloo::mpi::Context>(comm);
+  context->setTimeout(gloo::kNoTimeout);
+  context->connectFullMesh(glooDevice_);
+  return context;
+}
+
+// Reduces `s` elements in place; the part of this process is at offset
+// `rank * s / size`
+template <typename T>
+inline void reduceScatterGloo(T* ptr, size_t s) {
+  auto key = detail::makeHashKey(ptr, s, "reduceScatterCpu");
+  auto algorithm = glooCache_.get(key);
+  if (algorithm == nullptr) {
+    auto context = globalContext();
+    using ReduceScatter = gloo::ReduceScatterHalvingDoubling<T>;
+    algorithm = glooCache_.put(
+        key,
+        std::make_unique<ReduceScatter>(
+            context,
+            std::vector<T*>({ptr}),
+            s,
+            std::vector<int>(context->size, s / context->size),
+            gloo::ReductionFunction<T>::sum));
+  }
+  algorithm->run();
+}
+
+// Gathers the `s` elements at `in` of all processes at `out`
+template <typename T>
+inline void allGatherGloo(
+    const std::shared_ptr<gloo::mpi::Context>& context,
+    const T* in,
+    T* out,
+    size_t s) {
+  auto key = detail::makeHashKey(out, in, s, "allGatherCpu", context.get());
+  auto algorithm = glooCache_.get(key);
+  if (algorithm == nullptr) {
+    using Allgather = gloo::AllgatherRing<T>;
+    algorithm = glooCache_.put(
+        key,
+        std::make_unique<Allgather>(
+            context, std::vector<const T*>({in}), out, s));
+  }
+  algorithm->run();
+}
+
+// Broadcasts the `bytes` at `ptr` from the process of rank `rootRank`
+inline void broadcastGloo(uint8_t* ptr, size_t bytes, int rootRank) {
+  auto key = detail::makeHashKey(ptr, bytes, "broadcastCpu", rootRank);
+  auto algorithm = glooCache_.get(key);
+  if (algorithm == nullptr) {
+    using Broadcast = gloo::BroadcastOneToAll<uint8_t>;
+    algorithm = glooCache_.put(
+        key,
+        std::make_unique<Broadcast>(
+            globalContext(), std::vector<uint8_t*>({ptr}), bytes, rootRank));
+  }
+  algorithm->run();
+}
+
+// Collectives run in `cacheArr_`, so that their algorithms can be cached by
+// address
+void reserveCacheArr(size_t bytes) {
+  if (bytes > cacheArr_.elements()) {
+    cacheArr_ = af::array(bytes, af::dtype::b8);
+  }
+}
+
+// Returns the next staging buffer of asynchronous collectives, of at least
+// `bytes`, once its previous collective is done
+AsyncBuffer& acquireAsyncBuffer(size_t bytes) {
+  auto& slot = asyncBuffers_[nextAsyncBuffer_++ % kNumAsyncBuffers_];
+  if (slot.done.valid()) {
+    slot.done.get();
+  }
+  if (bytes > slot.buffer.elements()) {
+    slot.buffer = af::array(bytes, af::dtype::b8);
+  }
+  return slot;
+}
+
+// Sums the arrays of the same type, copied one after the other in a staging
+// buffer, and copies the sums back. An asynchronous sum is copied back by the
+// communication thread, the arrays must not be used until syncDistributed().
+void allreduceStaged(const std::vector<af::array*>& arrs, bool async) {
+  auto type = arrs.front()->type();
+  size_t typeSize = af::getSizeOf(type);
+  size_t count = 0;
+  for (auto* arr : arrs) {
+    count += arr->elements();
+  }
+  if (count == 0) {
+    return;
+  }
+  AsyncBuffer* slot = nullptr;
+  af::array* staging = &cacheArr_;
+  if (async) {
+    slot = &acquireAsyncBuffer(count * typeSize);
+    staging = &slot->buffer;
+  } else {
+    reserveCacheArr(count * typeSize);
+  }
+  DevicePtr stagingPtr(*staging);
+  auto* buffer = static_cast<char*>(stagingPtr.get());
+
+  // The arrays are kept alive until their sums are copied back
+  std::vector<af::array> outputArrs;
+  std::vector<std::pair<void*, size_t>> outputs;
+  size_t offset = 0;
+  for (auto* arr : arrs) {
+    size_t bytes = arr->elements() * typeSize;
+    if (bytes == 0) {
+      continue;
+    }
+    DevicePtr arrPtr(*arr);
+    std::memcpy(buffer + offset, arrPtr.get(), bytes);
+    outputArrs.push_back(*arr);
+    outputs.emplace_back(arrPtr.get(), bytes);
+    offset += bytes;
+  }
+  auto done = runCollective([type, buffer, count, outputArrs, outputs]() {
+    allreduceGloo(type, buffer, count);
+    size_t offset = 0;
+    for (const auto& output : outputs) {
+      std::memcpy(output.first, buffer + offset, output.second);
+      offset += output.second;
+    }
+  });
+  if (async) {
+    slot->done = done;
+    pending_.push_back(done);
+  } else {
+    done.get();
+  }
+}
+
+// Gathers `input` from the processes of `context` in `cacheArr_`
+void allGatherStaged(
+    const af::array& input,
+    af::array& output,
+    const std::shared_ptr<gloo::mpi::Context>& context) {
+  size_t count = input.elements();
+  size_t size = context->size;
+  size_t typeSize = af::getSizeOf(input.type());
+  // The input, followed by the output
+  reserveCacheArr((size + 1) * count * typeSize);
+  DevicePtr cacheArrPtr(cacheArr_);
+  auto* in = static_cast<char*>(cacheArrPtr.get());
+  auto* out = in + count * typeSize;
+  {
+    DevicePtr inputPtr(input);
+    memcpy(in, inputPtr.get(), count * typeSize);
+  }
+  auto type = input.type();
+  runCollective([&context, type, in, out, count]() {
+    switch (type) {
+      case af::dtype::f32:
+        allGatherGloo(
+            context,
+            reinterpret_cast<float*>(in),
+            reinterpret_cast<float*>(out),
+            count);
+        break;
+      case af::dtype::f64:
+        allGatherGloo(
+            context,
+            reinterpret_cast<double*>(in),
+            reinterpret_cast<double*>(out),
+            count);
+        break;
+      case af::dtype::s32:
+        allGatherGloo(
+            context,
+            reinterpret_cast<int*>(in),
+            reinterpret_cast<int*>(out),
+            count);
+        break;
+      case af::dtype::s64:
+        allGatherGloo(
+            context,
+            reinterpret_cast<int64_t*>(in),
+            reinterpret_cast<int64_t*>(out),
+            count);
+        break;
+      default:
+        throw std::runtime_error(
+            "unsupported data type for allGather with gloo");
+    }
+  }).get();
+  output = af::array(count * size, input.type());
+  DevicePtr outputPtr(output);
+  memcpy(outputPtr.get(), out, count * size * typeSize);
+}
 } // namespace detail
 
 void distributedInit(
     DistributedInit initMethod,
     int /* worldRank */,
     int /* worldSize */,
-    const std::unordered_map<std::string, std::string>& /* params = {} */) {
+    const std::unordered_map<std::string, std::string>& params /* = {} */) {
   if (isDistributedInit()) {
     std::cerr << "warning: fl::distributedInit() called more than once\n";
     return;
@@ -86,14 +482,23 @@ void distributedInit(
     return;
   }
   // TODO: ibverbs support.
-  auto glooDev = gloo::transport::tcp::CreateDevice("");
+  glooDevice_ = gloo::transport::tcp::CreateDevice("");
 
   // Create Gloo context from MPI communicator
   glooContext_ = gloo::mpi::Context::createManaged();
   glooContext_->setTimeout(gloo::kNoTimeout);
-  glooContext_->connectFullMesh(glooDev);
+  glooContext_->connectFullMesh(glooDevice_);
+  int stages = detail::getRequestedPipelineStages(params, glooContext_->size);
+  if (stages > 1) {
+    stageContext_ = detail::createContext(glooContext_->rank % stages);
+  } else if (detail::isHierarchicalRequested(params)) {
+    detail::initHierarchy(glooDevice_);
+  }
+
+  commThread_ = std::make_unique<ThreadPool>(1);
 
   detail::DistributedInfo::getInstance().backend_ = DistributedBackend::GLOO;
+  detail::DistributedInfo::getInstance().pipelineStages_ = stages;
   detail::DistributedInfo::getInstance().isInitialized_ = true;
   if (glooContext_->rank == 0) {
     std::cout << "Initialized Gloo successfully!\n";
@@ -104,59 +509,285 @@ void allReduce(af::array& arr, bool async /* = false */) {
   if (!isDistributedInit()) {
     throw std::runtime_error("distributed environment not initialized");
   }
-  if (async) {
-    throw std::runtime_error(
-        "Asynchronous allReduce not yet supported for Gloo backend");
+  if (!detail::isAllreduceType(arr.type())) {
+    throw std::runtime_error("unsupported data type for allreduce with gloo");
   }
-  size_t arrSize = arr.elements() * af::getSizeOf(arr.type());
-  if (arrSize > cacheArr_.elements()) {
-    cacheArr_ = af::array(arrSize, af::dtype::b8);
+  detail::allreduceStaged({&arr}, async);
+}
+
+void reduceScatter(const af::array& input, af::array& output) {
+  if (!isDistributedInit()) {
+    throw std::runtime_error("distributed environment not initialized");
   }
-  DevicePtr arrPtr(arr);
+  size_t worldSize = getWorldSize();
+  size_t count = input.elements() / worldSize;
+  if (input.elements() % worldSize != 0) {
+    throw std::invalid_argument(
+        "reduceScatter: number of elements not divisible by the world size");
+  }
+  size_t typeSize = af::getSizeOf(input.type());
+  detail::reserveCacheArr(input.elements() * typeSize);
   DevicePtr cacheArrPtr(cacheArr_);
-  memcpy(cacheArrPtr.get(), arrPtr.get(), arrSize);
-  switch (arr.type()) {
-    case af::dtype::f32:
-      detail::allreduceGloo(
-          static_cast<float*>(cacheArrPtr.get()), arr.elements());
-      break;
-    case af::dtype::f64:
-      detail::allreduceGloo(
-          static_cast<double*>(cacheArrPtr.get()), arr.elements());
-      break;
-    case af::dtype::s32:
-      detail::allreduceGloo(
-          static_cast<int*>(cacheArrPtr.get()), arr.elements());
-      break;
-    case af::dtype::s64:
-      detail::allreduceGloo(
-          static_cast<int64_t*>(cacheArrPtr.get()), arr.elements());
-      break;
-    default:
-      throw std::runtime_error("unsupported data type for allreduce with gloo");
+  void* buffer = cacheArrPtr.get();
+  {
+    DevicePtr inputPtr(input);
+    memcpy(buffer, inputPtr.get(), input.elements() * typeSize);
+  }
+  auto type = input.type();
+  size_t elements = input.elements();
+  detail::runCollective([type, buffer, elements]() {
+    switch (type) {
+      case af::dtype::f32:
+        detail::reduceScatterGloo(static_cast<float*>(buffer), elements);
+        break;
+      case af::dtype::f64:
+        detail::reduceScatterGloo(static_cast<double*>(buffer), elements);
+        break;
+      case af::dtype::s32:
+        detail::reduceScatterGloo(static_cast<int*>(buffer), elements);
+        break;
+      case af::dtype::s64:
+        detail::reduceScatterGloo(static_cast<int64_t*>(buffer), elements);
+        break;
+      default:
+        throw std::runtime_error(
+            "unsupported data type for reduceScatter with gloo");
+    }
+  }).get();
+  output = af::array(count, input.type());
+  DevicePtr outputPtr(output);
+  memcpy(
+      outputPtr.get(),
+      static_cast<char*>(buffer) + getWorldRank() * count * typeSize,
+      count * typeSize);
+}
+
+void allGather(const af::array& input, af::array& output) {
+  if (!isDistributedInit()) {
+    throw std::runtime_error("distributed environment not initialized");
+  }
+  detail::allGatherStaged(input, output, detail::globalContext());
+}
+
+void broadcast(af::array& arr, int rootRank /* = 0 */) {
+  broadcastMultiple({&arr}, rootRank);
+}
+
+void broadcastMultiple(
+    const std::vector<af::array*>& arrs,
+    int rootRank /* = 0 */) {
+  if (!isDistributedInit()) {
+    throw std::runtime_error("distributed environment not initialized");
+  }
+  if (rootRank < 0 || rootRank >= getWorldSize()) {
+    throw std::invalid_argument(
+        "broadcastMultiple: invalid root rank " + std::to_string(rootRank));
+  }
+  size_t totalBytes = 0;
+  for (const auto* arr : arrs) {
+    totalBytes += arr->bytes();
+  }
+  if (totalBytes == 0 || getWorldSize() == 1) {
+    return;
+  }
+  // The arrays of the root are copied in `cacheArr_`, broadcast at once, and
+  // copied back on the other processes
+  detail::reserveCacheArr(totalBytes);
+  DevicePtr cacheArrPtr(cacheArr_);
+  auto* buffer = static_cast<uint8_t*>(cacheArrPtr.get());
+  bool isRoot = getWorldRank() == rootRank;
+  if (isRoot) {
+    size_t offset = 0;
+    for (const auto* arr : arrs) {
+      if (arr->bytes() == 0) {
+        continue;
+      }
+      DevicePtr arrPtr(*arr);
+      memcpy(buffer + offset, arrPtr.get(), arr->bytes());
+      offset += arr->bytes();
+    }
+  }
+  detail::runCollective([buffer, totalBytes, rootRank]() {
+    detail::broadcastGloo(buffer, totalBytes, rootRank);
+  }).get();
+  if (!isRoot) {
+    size_t offset = 0;
+    for (auto* arr : arrs) {
+      if (arr->bytes() == 0) {
+        continue;
+      }
+      DevicePtr arrPtr(*arr);
+      memcpy(arrPtr.get(), buffer + offset, arr->bytes());
+      offset += arr->bytes();
+    }
+  }
+}
+
+DistributedGroup createGroup(int color) {
+  if (!isDistributedInit()) {
+    throw std::runtime_error("distributed environment not initialized");
+  }
+  auto context = detail::createContext(color);
+  DistributedGroup group;
+  group.id = groupContexts_.size();
+  group.rank = context->rank;
+  group.size = context->size;
+  groupContexts_.push_back(std::move(context));
+  return group;
+}
+
+void allReduce(af::array& arr, const DistributedGroup& group) {
+  if (!isDistributedInit()) {
+    throw std::runtime_error("distributed environment not initialized");
+  }
+  if (group.size <= 1) {
+    return;
+  }
+  if (!detail::isAllreduceType(arr.type())) {
+    throw std::runtime_error("unsupported data type for allreduce with gloo");
+  }
+  const auto& context = groupContexts_.at(group.id);
+  auto type = arr.type();
+  size_t count = arr.elements();
+  size_t bytes = count * af::getSizeOf(type);
+  detail::reserveCacheArr(bytes);
+  DevicePtr cacheArrPtr(cacheArr_);
+  void* buffer = cacheArrPtr.get();
+  DevicePtr arrPtr(arr);
+  memcpy(buffer, arrPtr.get(), bytes);
+  detail::runCollective([&context, type, buffer, count]() {
+    detail::allreduceGloo(context, type, buffer, count);
+  }).get();
+  memcpy(arrPtr.get(), buffer, bytes);
+}
+
+void allGather(
+    const af::array& input,
+    af::array& output,
+    const DistributedGroup& group) {
+  if (!isDistributedInit()) {
+    throw std::runtime_error("distributed environment not initialized");
+  }
+  if (group.size <= 1) {
+    output = af::flat(input);
+    return;
   }
-  memcpy(arrPtr.get(), cacheArrPtr.get(), arrSize);
+  detail::allGatherStaged(input, output, groupContexts_.at(group.id));
+}
+
+void sendRecv(
+    const std::vector<std::pair<const af::array*, int>>& sends,
+    const std::vector<std::pair<af::array*, int>>& recvs) {
+  if (!isDistributedInit()) {
+    throw std::runtime_error("distributed environment not initialized");
+  }
+  // The arrays are on the host: the transfers use their memory directly
+  std::vector<DevicePtr> ptrs;
+  ptrs.reserve(sends.size() + recvs.size());
+  std::vector<std::pair<void*, size_t>> sendBuffers, recvBuffers;
+  for (const auto& entry : sends) {
+    ptrs.emplace_back(*entry.first);
+    sendBuffers.emplace_back(ptrs.back().get(), entry.first->bytes());
+  }
+  for (const auto& entry : recvs) {
+    ptrs.emplace_back(*entry.first);
+    recvBuffers.emplace_back(ptrs.back().get(), entry.first->bytes());
+  }
+  // After the pending collectives, which use the same pairs of processes
+  detail::runCollective([&]() {
+    auto context = detail::globalContext();
+    std::vector<std::unique_ptr<gloo::transport::UnboundBuffer>> sent,
+        received;
+    for (size_t i = 0; i < sends.size(); ++i) {
+      if (sendBuffers[i].second == 0) {
+        continue;
+      }
+      sent.push_back(context->createUnboundBuffer(
+          sendBuffers[i].first, sendBuffers[i].second));
+      sent.back()->send(sends[i].second, kSendRecvSlot_);
+    }
+    for (size_t i = 0; i < recvs.size(); ++i) {
+      if (recvBuffers[i].second == 0) {
+        continue;
+      }
+      received.push_back(context->createUnboundBuffer(
+          recvBuffers[i].first, recvBuffers[i].second));
+      received.back()->recv(recvs[i].second, kSendRecvSlot_);
+    }
+    for (auto& buffer : sent) {
+      buffer->waitSend();
+    }
+    for (auto& buffer : received) {
+      buffer->waitRecv();
+    }
+  }).get();
 }
 
-// Not yet supported
 void allReduceMultiple(
     std::vector<af::array*> arrs,
     bool async /* = false */,
     bool contiguous /* = false */) {
-  if (contiguous) {
-    throw std::runtime_error(
-        "contiguous allReduceMultiple is not yet supported for Gloo backend");
+  if (!isDistributedInit()) {
+    throw std::runtime_error("distributed environment not initialized");
+  }
+  if (arrs.empty()) {
+    return;
+  }
+  if (!contiguous) {
+    for (auto& arr : arrs) {
+      allReduce(*arr, async);
+    }
+    return;
   }
 
+  // As for NCCL, a contiguous set reduction needs arrays of the same type,
+  // fitting in the coalescing cache
+  auto type = arrs.front()->type();
+  size_t totalBytes = 0;
   for (auto& arr : arrs) {
-    allReduce(*arr, async);
+    if (arr->type() != type) {
+      throw std::runtime_error(
+          "Cannot perform contiguous set allReduce on a set of tensors "
+          "of different types");
+    }
+    totalBytes += arr->elements() * af::getSizeOf(type);
+  }
+  if (!detail::isAllreduceType(type)) {
+    throw std::runtime_error("unsupported data type for allreduce with gloo");
+  }
+  if (totalBytes > DistributedConstants::kCoalesceCacheSize) {
+    throw std::runtime_error(
+        "Total coalesce buffer size is larger than existing buffer size");
   }
+  detail::allreduceStaged(arrs, async);
 }
 
 void syncDistributed() {
-  // NOOP since async distributed operations aren't yet supported with the Gloo
-  // backend
-  return;
+  // Waits for all the asynchronous collectives, then rethrows their first
+  // error, if any
+  std::vector<std::shared_future<void>> pending;
+  pending.swap(pending_);
+  for (auto& done : pending) {
+    done.wait();
+  }
+  for (auto& done : pending) {
+    done.get();
+  }
+}
+
+DistributedEvent recordDistributedEvent() {
+  if (pending_.empty()) {
+    return {};
+  }
+  // The collectives run in order: the last one is done after the others
+  return {std::make_shared<std::shared_future<void>>(pending_.back())};
+}
+
+void waitDistributedEvent(const DistributedEvent& event) {
+  auto done = std::static_pointer_cast<std::shared_future<void>>(event.impl);
+  if (done) {
+    done->get();
+  }
 }
 
 int getWorldRank() {
@@ -7,8 +7,12 @@
 
 #include <algorithm>
 #include <cstring>
+#include <memory>
 #include <mutex>
 #include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include <mpi.h>
 #include <nccl.h>
@@ -18,6 +22,7 @@
 #include "flashlight/fl/common/DevicePtr.h"
 #include "flashlight/fl/distributed/DistributedApi.h"
 #include "flashlight/fl/distributed/FileStore.h"
+#include "flashlight/fl/distributed/TcpStore.h"
 
 #define NCCLCHECK(expr) ::fl::detail::ncclCheck((expr))
 #define MPICHECK(expr) ::fl::detail::mpiCheck((expr))
@@ -44,7 +49,24 @@ class NcclContext {
       int worldRank,
       int worldSize,
       const std::unordered_map<std::string, std::string>& params);
+  void initWithTcp(
+      int worldRank,
+      int worldSize,
+      const std::unordered_map<std::string, std::string>& params);
   ncclComm_t& getComm();
+  // Communicators of the processes of the node, and of the leaders (processes
+  // of local rank 0) of all nodes, with hierarchical collectives
+  bool isHierarchical() const;
+  ncclComm_t& getLocalComm();
+  ncclComm_t& getLeaderComm();
+  bool isLeader() const;
+  // Communicator of the processes of the pipeline stage, with pipeline
+  // stages, else the world communicator
+  ncclComm_t& getStageComm();
+  int getPipelineStages() const;
+  // Communicators of the groups created by `createGroup`, by group id
+  DistributedGroup createGroup(int color);
+  ncclComm_t& getGroupComm(const DistributedGroup& group);
   int getWorldSize() const;
   int getWorldRank() const;
   cudaStream_t getReductionStream() const;
@@ -55,7 +77,23 @@ class NcclContext {
  private:
   // create CUDA resources
   void createCudaResources();
+  // create the communicators of pipeline stages or hierarchical collectives,
+  // if requested
+  void initGroups(const std::unordered_map<std::string, std::string>& params);
+  void initHierarchy();
+  // gathers an entry of the same size from every process, by rank
+  std::vector<char> allGatherEntries(const std::vector<char>& entry);
+  // creates the communicator of the processes of the same color, ordered by
+  // rank
+  ncclComm_t createComm(int color, int& rank, int& size);
   ncclComm_t comm_;
+  bool hierarchical_{false};
+  ncclComm_t localComm_;
+  ncclComm_t leaderComm_;
+  bool isLeader_{false};
+  ncclComm_t stageComm_;
+  int pipelineStages_{1};
+  std::vector<ncclComm_t> groupComms_;
   int worldSize_, worldRank_;
   // CUDA stream in which NCCL calls run if in async mode
   cudaStream_t reductionStream_;
@@ -98,12 +136,20 @@ void ncclCheck(ncclResult_t r);
 
 void mpiCheck(int ec);
 
+// A hierarchical allreduce has three steps: a reduce within the nodes, an
+// allreduce between the nodes, and a broadcast within the nodes. With NCCL
+// groups, each step needs its own group, since the operations of a group may
+// run in any order
+constexpr int kAllReduceSteps = -1;
+constexpr int kNumHierarchicalSteps = 3;
+
 void allreduceCuda(
     void* ptr,
     size_t count,
     ncclDataType_t ncclType,
     bool async,
-    bool contiguous);
+    bool contiguous,
+    int step = kAllReduceSteps);
 } // namespace detail
 
 void allReduce(af::array& arr, bool async /* = false */) {
@@ -130,12 +176,34 @@ void allReduceMultiple(
   }
 
   if (!contiguous) {
-    // Use nccl groups to do everything in a single kernel launch
-    NCCLCHECK(ncclGroupStart());
+    if (!detail::NcclContext::getInstance().isHierarchical()) {
+      // Use nccl groups to do everything in a single kernel launch
+      NCCLCHECK(ncclGroupStart());
+      for (auto& arr : arrs) {
+        allReduce(*arr, async);
+      }
+      NCCLCHECK(ncclGroupEnd());
+      return;
+    }
+    // One group per step of the hierarchical allreduce
+    std::vector<DevicePtr> arrPtrs;
+    arrPtrs.reserve(arrs.size());
     for (auto& arr : arrs) {
-      allReduce(*arr, async);
+      arrPtrs.emplace_back(*arr);
+    }
+    for (int step = 0; step < detail::kNumHierarchicalSteps; ++step) {
+      NCCLCHECK(ncclGroupStart());
+      for (size_t i = 0; i < arrs.size(); ++i) {
+        detail::allreduceCuda(
+            arrPtrs[i].get(),
+            arrs[i]->elements(),
+            detail::getNcclTypeForArray(*arrs[i]),
+            async,
+            /* contiguous = */ false,
+            step);
+      }
+      NCCLCHECK(ncclGroupEnd());
     }
-    NCCLCHECK(ncclGroupEnd());
     return;
   }
 
@@ -187,6 +255,8 @@ void allReduceMultiple(
         entry.second,
         cudaMemcpyDeviceToDevice,
         workerStream));
+    // The arrays may be released before the copies back from the buffer
+    cuda::recordStream(entry.first.get(), workerStream);
     cur += entry.second;
   }
 
@@ -217,6 +287,175 @@ void allReduceMultiple(
   }
 }
 
+void reduceScatter(const af::array& input, af::array& output) {
+  if (!isDistributedInit()) {
+    throw std::runtime_error("distributed environment not initialized");
+  }
+  size_t worldSize = getWorldSize();
+  if (input.elements() % worldSize != 0) {
+    throw std::invalid_argument(
+        "reduceScatter: number of elements not divisible by the world size");
+  }
+  ncclDataType_t type = detail::getNcclTypeForArray(input);
+  size_t count = input.elements() / worldSize;
+  output = af::array(count, input.type());
+  DevicePtr inputPtr(input);
+  DevicePtr outputPtr(output);
+  // In the AF CUDA stream, as for a synchronous allReduce
+  NCCLCHECK(ncclReduceScatter(
+      inputPtr.get(),
+      outputPtr.get(),
+      count,
+      type,
+      ncclSum,
+      detail::NcclContext::getInstance().getComm(),
+      cuda::getActiveStream()));
+}
+
+void allGather(const af::array& input, af::array& output) {
+  if (!isDistributedInit()) {
+    throw std::runtime_error("distributed environment not initialized");
+  }
+  ncclDataType_t type = detail::getNcclTypeForArray(input);
+  size_t count = input.elements();
+  output = af::array(count * getWorldSize(), input.type());
+  DevicePtr inputPtr(input);
+  DevicePtr outputPtr(output);
+  NCCLCHECK(ncclAllGather(
+      inputPtr.get(),
+      outputPtr.get(),
+      count,
+      type,
+      detail::NcclContext::getInstance().getComm(),
+      cuda::getActiveStream()));
+}
+
+void broadcast(af::array& arr, int rootRank /* = 0 */) {
+  broadcastMultiple({&arr}, rootRank);
+}
+
+void broadcastMultiple(
+    const std::vector<af::array*>& arrs,
+    int rootRank /* = 0 */) {
+  if (!isDistributedInit()) {
+    throw std::runtime_error("distributed environment not initialized");
+  }
+  if (rootRank < 0 || rootRank >= getWorldSize()) {
+    throw std::invalid_argument(
+        "broadcastMultiple: invalid root rank " + std::to_string(rootRank));
+  }
+  auto& comm = detail::NcclContext::getInstance().getComm();
+  std::vector<DevicePtr> ptrs;
+  ptrs.reserve(arrs.size());
+  // In the AF CUDA stream, as for allGather; as bytes, whatever the types
+  NCCLCHECK(ncclGroupStart());
+  for (auto* arr : arrs) {
+    if (arr->bytes() == 0) {
+      continue;
+    }
+    ptrs.emplace_back(*arr);
+    NCCLCHECK(ncclBroadcast(
+        ptrs.back().get(),
+        ptrs.back().get(),
+        arr->bytes(),
+        ncclUint8,
+        rootRank,
+        comm,
+        cuda::getActiveStream()));
+  }
+  NCCLCHECK(ncclGroupEnd());
+}
+
+DistributedGroup createGroup(int color) {
+  if (!isDistributedInit()) {
+    throw std::runtime_error("distributed environment not initialized");
+  }
+  return detail::NcclContext::getInstance().createGroup(color);
+}
+
+void allReduce(af::array& arr, const DistributedGroup& group) {
+  if (!isDistributedInit()) {
+    throw std::runtime_error("distributed environment not initialized");
+  }
+  if (group.size <= 1) {
+    return;
+  }
+  ncclDataType_t type = detail::getNcclTypeForArray(arr);
+  DevicePtr arrPtr(arr);
+  NCCLCHECK(ncclAllReduce(
+      arrPtr.get(),
+      arrPtr.get(),
+      arr.elements(),
+      type,
+      ncclSum,
+      detail::NcclContext::getInstance().getGroupComm(group),
+      cuda::getActiveStream()));
+}
+
+void allGather(
+    const af::array& input,
+    af::array& output,
+    const DistributedGroup& group) {
+  if (!isDistributedInit()) {
+    throw std::runtime_error("distributed environment not initialized");
+  }
+  if (group.size <= 1) {
+    output = af::flat(input);
+    return;
+  }
+  ncclDataType_t type = detail::getNcclTypeForArray(input);
+  size_t count = input.elements();
+  output = af::array(count * group.size, input.type());
+  DevicePtr inputPtr(input);
+  DevicePtr outputPtr(output);
+  NCCLCHECK(ncclAllGather(
+      inputPtr.get(),
+      outputPtr.get(),
+      count,
+      type,
+      detail::NcclContext::getInstance().getGroupComm(group),
+      cuda::getActiveStream()));
+}
+
+void sendRecv(
+    const std::vector<std::pair<const af::array*, int>>& sends,
+    const std::vector<std::pair<af::array*, int>>& recvs) {
+  if (!isDistributedInit()) {
+    throw std::runtime_error("distributed environment not initialized");
+  }
+#if NCCL_VERSION_CODE < NCCL_VERSION(2, 7, 0)
+  throw std::runtime_error("sendRecv: point-to-point transfers need NCCL 2.7");
+#else
+  auto& comm = detail::NcclContext::getInstance().getComm();
+  std::vector<DevicePtr> ptrs;
+  ptrs.reserve(sends.size() + recvs.size());
+  // In the AF CUDA stream, as for reduceScatter; the group runs the transfers
+  // concurrently
+  NCCLCHECK(ncclGroupStart());
+  for (const auto& entry : sends) {
+    ptrs.emplace_back(*entry.first);
+    NCCLCHECK(ncclSend(
+        ptrs.back().get(),
+        entry.first->elements(),
+        detail::getNcclTypeForArray(*entry.first),
+        entry.second,
+        comm,
+        cuda::getActiveStream()));
+  }
+  for (const auto& entry : recvs) {
+    ptrs.emplace_back(*entry.first);
+    NCCLCHECK(ncclRecv(
+        ptrs.back().get(),
+        entry.first->elements(),
+        detail::getNcclTypeForArray(*entry.first),
+        entry.second,
+        comm,
+        cuda::getActiveStream()));
+  }
+  NCCLCHECK(ncclGroupEnd());
+#endif
+}
+
 /**
  * Block future operations in the AF Stream on operations currently running in
  * the NCCL CUDA stream.
@@ -235,6 +474,51 @@ void syncDistributed() {
       ncclContext.getEvent());
 }
 
+namespace {
+
+// Events of the worker and reduction streams, in which asynchronous
+// operations run
+struct NcclEvents {
+  cudaEvent_t worker;
+  cudaEvent_t reduction;
+
+  NcclEvents() {
+    FL_CUDA_CHECK(cudaEventCreateWithFlags(
+        &worker, cuda::detail::kCudaEventDefaultFlags));
+    FL_CUDA_CHECK(cudaEventCreateWithFlags(
+        &reduction, cuda::detail::kCudaEventDefaultFlags));
+  }
+
+  ~NcclEvents() {
+    cudaEventDestroy(worker);
+    cudaEventDestroy(reduction);
+  }
+};
+
+} // namespace
+
+DistributedEvent recordDistributedEvent() {
+  if (!isDistributedInit()) {
+    return {};
+  }
+  auto& ncclContext = detail::NcclContext::getInstance();
+  auto events = std::make_shared<NcclEvents>();
+  FL_CUDA_CHECK(cudaEventRecord(events->worker, ncclContext.getWorkerStream()));
+  FL_CUDA_CHECK(
+      cudaEventRecord(events->reduction, ncclContext.getReductionStream()));
+  return {events};
+}
+
+void waitDistributedEvent(const DistributedEvent& event) {
+  auto events = std::static_pointer_cast<NcclEvents>(event.impl);
+  if (!events) {
+    return;
+  }
+  auto stream = cuda::getActiveStream();
+  FL_CUDA_CHECK(cudaStreamWaitEvent(stream, events->worker, 0));
+  FL_CUDA_CHECK(cudaStreamWaitEvent(stream, events->reduction, 0));
+}
+
 int getWorldRank() {
   if (!isDistributedInit()) {
     return 0;
@@ -266,12 +550,18 @@ void distributedInit(
         worldRank, worldSize, params);
     detail::DistributedInfo::getInstance().initMethod_ =
         DistributedInit::FILE_SYSTEM;
+  } else if (initMethod == DistributedInit::TCP) {
+    detail::NcclContext::getInstance().initWithTcp(
+        worldRank, worldSize, params);
+    detail::DistributedInfo::getInstance().initMethod_ = DistributedInit::TCP;
   } else {
     throw std::runtime_error(
         "unsupported distributed init method for NCCL backend");
   }
   detail::DistributedInfo::getInstance().isInitialized_ = true;
   detail::DistributedInfo::getInstance().backend_ = DistributedBackend::NCCL;
+  detail::DistributedInfo::getInstance().pipelineStages_ =
+      detail::NcclContext::getInstance().getPipelineStages();
   if (getWorldRank() == 0) {
     std::cout << "Initialized NCCL " << NCCL_MAJOR << "." << NCCL_MINOR << "."
               << NCCL_PATCH << " successfully!\n";
@@ -310,7 +600,8 @@ void allreduceCuda(
     size_t count,
     ncclDataType_t ncclType,
     bool async,
-    bool contiguous) {
+    bool contiguous,
+    int step /* = kAllReduceSteps */) {
   cudaStream_t syncStream;
   auto& ncclContext = detail::NcclContext::getInstance();
   if (async) {
@@ -340,8 +631,52 @@ void allreduceCuda(
     // stream does everything
   }
 
-  NCCLCHECK(ncclAllReduce(
-      ptr, ptr, count, ncclType, ncclSum, ncclContext.getComm(), syncStream));
+  if (!ncclContext.isHierarchical()) {
+    NCCLCHECK(ncclAllReduce(
+        ptr,
+        ptr,
+        count,
+        ncclType,
+        ncclSum,
+        ncclContext.getStageComm(),
+        syncStream));
+    return;
+  }
+  // Sum within the node to its leader, between the leaders, then broadcast
+  // from the leaders within the nodes
+  int firstStep = step == kAllReduceSteps ? 0 : step;
+  int lastStep = step == kAllReduceSteps ? kNumHierarchicalSteps - 1 : step;
+  for (int s = firstStep; s <= lastStep; ++s) {
+    if (s == 0) {
+      NCCLCHECK(ncclReduce(
+          ptr,
+          ptr,
+          count,
+          ncclType,
+          ncclSum,
+          /* root = */ 0,
+          ncclContext.getLocalComm(),
+          syncStream));
+    } else if (s == 1 && ncclContext.isLeader()) {
+      NCCLCHECK(ncclAllReduce(
+          ptr,
+          ptr,
+          count,
+          ncclType,
+          ncclSum,
+          ncclContext.getLeaderComm(),
+          syncStream));
+    } else if (s == 2) {
+      NCCLCHECK(ncclBroadcast(
+          ptr,
+          ptr,
+          count,
+          ncclType,
+          /* root = */ 0,
+          ncclContext.getLocalComm(),
+          syncStream));
+    }
+  }
 }
 namespace {
 
@@ -349,6 +684,30 @@ ncclComm_t& NcclContext::getComm() {
   return comm_;
 }
 
+bool NcclContext::isHierarchical() const {
+  return hierarchical_;
+}
+
+ncclComm_t& NcclContext::getLocalComm() {
+  return localComm_;
+}
+
+ncclComm_t& NcclContext::getLeaderComm() {
+  return leaderComm_;
+}
+
+ncclComm_t& NcclContext::getStageComm() {
+  return pipelineStages_ > 1 ? stageComm_ : comm_;
+}
+
+int NcclContext::getPipelineStages() const {
+  return pipelineStages_;
+}
+
+bool NcclContext::isLeader() const {
+  return isLeader_;
+}
+
 int NcclContext::getWorldSize() const {
   return worldSize_;
 }
@@ -424,6 +783,7 @@ void NcclContext::initWithMPI(
   NCCLCHECK(ncclCommInitRank(&comm_, worldSize_, id, worldRank_));
 
   createCudaResources();
+  initGroups(params);
 }
 
 void NcclContext::initWithFileSystem(
@@ -473,6 +833,199 @@ void NcclContext::initWithFileSystem(
   }
 
   createCudaResources();
+  initGroups(params);
+}
+
+void NcclContext::initWithTcp(
+    int worldRank,
+    int worldSize,
+    const std::unordered_map<std::string, std::string>& params) {
+  auto address = params.find(DistributedConstants::kTcpAddress);
+  if (address == params.end() || address->second.empty()) {
+    throw std::invalid_argument("invalid TcpAddress for NCCL initWithTcp");
+  }
+  auto maxDevicePerNode = params.find(DistributedConstants::kMaxDevicePerNode);
+  if (maxDevicePerNode == params.end()) {
+    throw std::invalid_argument(
+        "invalid MaxDevicePerNode for NCCL initWithTcp");
+  }
+  auto separator = address->second.rfind(':');
+  if (separator == std::string::npos ||
+      !isNonNegativeInteger(address->second.substr(separator + 1))) {
+    throw std::invalid_argument(
+        "invalid TcpAddress for NCCL initWithTcp, expected host:port: " +
+        address->second);
+  }
+  auto host = address->second.substr(0, separator);
+  auto port = std::stoi(address->second.substr(separator + 1));
+
+  worldRank_ = worldRank;
+  worldSize_ = worldSize;
+
+  ncclUniqueId id;
+
+  af::setDevice(worldRank_ % std::stoi(maxDevicePerNode->second));
+
+  // Rank 0 serves the store: all the other ranks connect to it and block on
+  // the server until the unique ID is set, without polling
+  TcpStore store(host, port, /* isServer = */ worldRank_ == 0);
+  if (worldRank_ == 0) {
+    ncclGetUniqueId(&id);
+    std::vector<char> data(sizeof(id));
+    std::memcpy(data.data(), &id, sizeof(id));
+    store.set(kNcclKey, data);
+  } else {
+    auto data = store.get(kNcclKey);
+    std::memcpy(&id, data.data(), sizeof(id));
+  }
+
+  // ncclCommInitRank synchronizes all ranks, hence all ranks got the unique ID
+  // when it returns, and the store can be closed
+  NCCLCHECK(ncclCommInitRank(&comm_, worldSize_, id, worldRank_));
+
+  createCudaResources();
+  initGroups(params);
+}
+
+void NcclContext::initGroups(
+    const std::unordered_map<std::string, std::string>& params) {
+  int stages = getRequestedPipelineStages(params, worldSize_);
+  if (stages > 1) {
+    int rank, size;
+    stageComm_ = createComm(worldRank_ % stages, rank, size);
+    pipelineStages_ = stages;
+  } else if (isHierarchicalRequested(params)) {
+    initHierarchy();
+  }
+}
+
+std::vector<char> NcclContext::allGatherEntries(
+    const std::vector<char>& entry) {
+  af::array entries(entry.size() * worldSize_, af::dtype::u8);
+  af::array sendEntry(
+      entry.size(), reinterpret_cast<const unsigned char*>(entry.data()));
+  {
+    DevicePtr sendPtr(sendEntry), recvPtr(entries);
+    NCCLCHECK(ncclAllGather(
+        sendPtr.get(),
+        recvPtr.get(),
+        entry.size(),
+        ncclUint8,
+        comm_,
+        cuda::getActiveStream()));
+  }
+  std::vector<char> host(entry.size() * worldSize_);
+  entries.host(host.data());
+  return host;
+}
+
+ncclComm_t NcclContext::createComm(int color, int& rank, int& size) {
+  // Gather the colors, then from the lowest rank of each color the unique ID
+  // of its communicator
+  constexpr size_t kEntrySize = sizeof(int) + sizeof(ncclUniqueId);
+  std::vector<char> entry(kEntrySize, 0);
+  std::memcpy(entry.data(), &color, sizeof(int));
+  auto all = allGatherEntries(entry);
+  int leader = -1;
+  rank = 0;
+  size = 0;
+  for (int r = 0; r < worldSize_; ++r) {
+    int c;
+    std::memcpy(&c, all.data() + r * kEntrySize, sizeof(int));
+    if (c != color) {
+      continue;
+    }
+    if (leader < 0) {
+      leader = r;
+    }
+    if (r < worldRank_) {
+      ++rank;
+    }
+    ++size;
+  }
+
+  ncclUniqueId id;
+  if (leader == worldRank_) {
+    NCCLCHECK(ncclGetUniqueId(&id));
+    std::memcpy(entry.data() + sizeof(int), &id, sizeof(id));
+  }
+  all = allGatherEntries(entry);
+  std::memcpy(
+      &id, all.data() + leader * kEntrySize + sizeof(int), sizeof(id));
+  ncclComm_t comm;
+  NCCLCHECK(ncclCommInitRank(&comm, size, id, rank));
+  return comm;
+}
+
+DistributedGroup NcclContext::createGroup(int color) {
+  DistributedGroup group;
+  ncclComm_t comm = createComm(color, group.rank, group.size);
+  group.id = groupComms_.size();
+  groupComms_.push_back(comm);
+  return group;
+}
+
+ncclComm_t& NcclContext::getGroupComm(const DistributedGroup& group) {
+  return groupComms_.at(group.id);
+}
+
+void NcclContext::initHierarchy() {
+  // Gather the hostnames and, from the leaders, the unique IDs of the node
+  // communicators (and from rank 0, of the leader communicator) with the
+  // world communicator
+  constexpr size_t kHostnameSize = 256;
+  constexpr size_t kEntrySize = kHostnameSize + 2 * sizeof(ncclUniqueId);
+  std::vector<char> entry(kEntrySize, 0);
+  auto hostname = getHostname();
+  std::strncpy(entry.data(), hostname.c_str(), kHostnameSize - 1);
+
+  auto all = allGatherEntries(entry);
+  std::vector<std::string> hostnames;
+  for (int r = 0; r < worldSize_; ++r) {
+    hostnames.emplace_back(all.data() + r * kEntrySize);
+  }
+  auto topology = getNodeTopology(hostnames, worldRank_);
+  if (topology.numNodes == 1) {
+    // Nothing to gain
+    return;
+  }
+  // The leaders are the lowest ranks of the nodes
+  isLeader_ = topology.localRank == 0;
+
+  ncclUniqueId localId, leaderId;
+  if (isLeader_) {
+    NCCLCHECK(ncclGetUniqueId(&localId));
+    std::memcpy(entry.data() + kHostnameSize, &localId, sizeof(localId));
+  }
+  if (worldRank_ == 0) {
+    NCCLCHECK(ncclGetUniqueId(&leaderId));
+    std::memcpy(
+        entry.data() + kHostnameSize + sizeof(localId),
+        &leaderId,
+        sizeof(leaderId));
+  }
+  all = allGatherEntries(entry);
+  int leaderRank =
+      std::find(hostnames.begin(), hostnames.end(), hostnames[worldRank_]) -
+      hostnames.begin();
+  std::memcpy(
+      &localId,
+      all.data() + leaderRank * kEntrySize + kHostnameSize,
+      sizeof(localId));
+  std::memcpy(
+      &leaderId,
+      all.data() + kHostnameSize + sizeof(localId),
+      sizeof(leaderId));
+
+  // All processes create their node communicator before the leaders create
+  // theirs, so that the blocking initializations can't deadlock
+  NCCLCHECK(ncclCommInitRank(
+      &localComm_, topology.localSize, localId, topology.localRank));
+  if (isLeader_) {
+    NCCLCHECK(ncclCommInitRank(
+        &leaderComm_, topology.numNodes, leaderId, topology.nodeIndex));
+  }
+  hierarchical_ = true;
 }
 
 NcclContext::~NcclContext() {
@@ -481,6 +1034,18 @@ NcclContext::~NcclContext() {
 #else
   // finalizing NCCL
   NCCLCHECK(ncclCommDestroy(comm_));
+  if (pipelineStages_ > 1) {
+    NCCLCHECK(ncclCommDestroy(stageComm_));
+  }
+  for (auto& comm : groupComms_) {
+    NCCLCHECK(ncclCommDestroy(comm));
+  }
+  if (hierarchical_) {
+    NCCLCHECK(ncclCommDestroy(localComm_));
+    if (isLeader_) {
+      NCCLCHECK(ncclCommDestroy(leaderComm_));
+    }
+  }
 #endif
 #ifdef CUDA_NCCL_EVENT_DESTROY_ON_SHUTDOWN
   // destroy stream sync event
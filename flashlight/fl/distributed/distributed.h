@@ -8,4 +8,7 @@
 #pragma once
 
 #include "flashlight/fl/distributed/DistributedApi.h"
+#include "flashlight/fl/distributed/ModelAverager.h"
+#include "flashlight/fl/distributed/PipelinedOptimizer.h"
+#include "flashlight/fl/distributed/ShardedOptimizer.h"
 #include "flashlight/fl/distributed/reducers/reducers.h"
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/distributed/reducers/BucketedReducer.h"
+#include "flashlight/fl/distributed/DistributedApi.h"
+#include "flashlight/fl/common/Trace.h"
+
+namespace fl {
+
+BucketedReducer::BucketedReducer(
+    double scale,
+    bool async,
+    std::size_t bucketBytes /* = DistributedConstants::kCoalesceCacheSize */,
+    bool compress /* = false */,
+    bool errorFeedback /* = false */)
+    : scale_(scale),
+      async_(async),
+      bucketBytes_(bucketBytes),
+      compress_(compress),
+      errorFeedback_(errorFeedback) {}
+
+BucketedReducer::~BucketedReducer() {
+  finalize();
+}
+
+void BucketedReducer::add(Variable& var) {
+  // sparse gradients are gathered immediately, outside of the buckets
+  if (var.isSparse()) {
+    allReduce(var, scale_);
+    return;
+  }
+  // buckets hold Variables of a single type
+  if (!bucketVars_.empty() && bucketVars_.front().type() != var.type()) {
+    reduceBucket();
+  }
+  bucketVars_.push_back(var);
+  bucketVarsBytes_ += var.bytes();
+
+  bool full;
+  if (currBucket_ < buckets_.size()) {
+    full = bucketVars_.size() == buckets_[currBucket_].size;
+  } else {
+    // first step: form a new bucket
+    full = bucketVarsBytes_ >= bucketBytes_;
+  }
+  if (full) {
+    reduceBucket();
+  }
+}
+
+void BucketedReducer::finalize() {
+  FL_TRACE(DISTRIBUTED, "BucketedReducer::finalize");
+  reduceBucket();
+  // the remaining buckets were not used during this step
+  buckets_.resize(currBucket_);
+  currBucket_ = 0;
+  if (async_) {
+    syncDistributed();
+  }
+
+  for (auto& entry : inFlight_) {
+    const auto& bucket = buckets_[entry.first];
+    // compressed buckets were scaled down by the world size before reduction
+    double scale = bucket.compressed ? scale_ * getWorldSize() : scale_;
+    dim_t offset = 0;
+    for (auto& var : entry.second) {
+      dim_t n = var.elements();
+      if (n == 0) {
+        continue;
+      }
+      const auto& buffer =
+          bucket.compressed ? bucket.compressedBuffer : bucket.buffer;
+      auto reduced = af::moddims(
+          buffer(af::seq(offset, offset + n - 1)).as(var.type()), var.dims());
+      // don't keep references to the buffer, which is reused in place
+      var.array() = scale != 1.0 ? reduced * scale : reduced.copy();
+      var.eval();
+      offset += n;
+    }
+  }
+  inFlight_.clear();
+}
+
+void BucketedReducer::reduceBucket() {
+  if (bucketVars_.empty()) {
+    return;
+  }
+  FL_TRACE(DISTRIBUTED, "BucketedReducer::reduceBucket");
+  dim_t elements = 0;
+  for (const auto& var : bucketVars_) {
+    elements += var.elements();
+  }
+  auto type = bucketVars_.front().type();
+  if (currBucket_ == buckets_.size()) {
+    buckets_.emplace_back();
+  }
+  auto& bucket = buckets_[currBucket_];
+  // the number of Variables differs from the first step if a Variable of
+  // another type closed the bucket early
+  bucket.size = bucketVars_.size();
+  bucket.compressed =
+      compress_ && (type == af::dtype::f32 || type == af::dtype::f64);
+  if (bucket.buffer.elements() != elements || bucket.buffer.type() != type) {
+    bucket.buffer = af::array(elements, type);
+    bucket.error = af::array();
+  }
+
+  dim_t offset = 0;
+  for (const auto& var : bucketVars_) {
+    dim_t n = var.elements();
+    if (n > 0) {
+      bucket.buffer(af::seq(offset, offset + n - 1)) = af::flat(var.array());
+      offset += n;
+    }
+  }
+  if (bucket.compressed) {
+    compressBucket(bucket);
+  }
+  if (getWorldSize() > 1) {
+    allReduce(
+        bucket.compressed ? bucket.compressedBuffer : bucket.buffer, async_);
+  }
+
+  inFlight_.emplace_back(currBucket_, std::move(bucketVars_));
+  bucketVars_.clear();
+  bucketVarsBytes_ = 0;
+  ++currBucket_;
+}
+
+void BucketedReducer::compressBucket(Bucket& bucket) {
+  // scaled down by the world size so that the sum can't overflow in fp16
+  auto value = bucket.buffer / getWorldSize();
+  if (errorFeedback_ && !bucket.error.isempty()) {
+    value += bucket.error;
+  }
+  bucket.compressedBuffer = value.as(af::dtype::f16);
+  bucket.compressedBuffer.eval();
+  if (errorFeedback_) {
+    bucket.error = value - bucket.compressedBuffer.as(bucket.buffer.type());
+    bucket.error.eval();
+  }
+}
+
+} // namespace fl
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include <arrayfire.h>
+
+#include "flashlight/fl/autograd/Variable.h"
+#include "flashlight/fl/common/Defines.h"
+#include "flashlight/fl/distributed/reducers/Reducer.h"
+
+namespace fl {
+
+/**
+ * A Reducer which groups gradients in buckets, in the order in which they are
+ * added, and reduces each bucket as soon as it is full, so that communication
+ * overlaps with the computation of the remaining gradients in the backward
+ * pass.
+ *
+ * When gradients are added by the hooks of the parameters (see
+ * `distributeModuleGrads`), they are added in reverse topological order. The
+ * buckets are formed during the first step: a bucket is closed once it holds
+ * `bucketBytes` bytes (or before a gradient of another type). During the
+ * following steps, each bucket is reduced once the same number of gradients
+ * has been added to it. Every bucket has its own contiguous buffer, which is
+ * kept across steps.
+ *
+ * The gradients are only synchronized (and scaled) by ``finalize``, which must
+ * be called before using them.
+ *
+ * With compression, f32 and f64 buckets are reduced in fp16, communicating two
+ * or four times fewer bytes. They are scaled down by the world size before
+ * reduction so that the sum doesn't overflow. With error feedback, the error
+ * of the compression of a bucket is added to the bucket at the next step.
+ */
+class BucketedReducer : public Reducer {
+ public:
+  /**
+   * Creates a new bucketed reducer.
+   *
+   * @param[in] scale the factor by which to scale gradients after
+   * synchronization
+   * @param[in] async determines whether or not the reductions run in the
+   * distributed compute stream, asynchronously to the AF stream.
+   * @param[in] bucketBytes the size of the buckets, in bytes
+   * @param[in] compress reduce f32 and f64 buckets in fp16
+   * @param[in] errorFeedback compensate the error of the compression at the
+   * next step
+   */
+  BucketedReducer(
+      double scale,
+      bool async,
+      std::size_t bucketBytes = DistributedConstants::kCoalesceCacheSize,
+      bool compress = false,
+      bool errorFeedback = false);
+
+  /**
+   * Destroy the Reducer. Calls `finalize()` before returning.
+   */
+  ~BucketedReducer() override;
+
+  /**
+   * Add a ``Variable`` to the current bucket, and reduce the bucket if it is
+   * full.
+   */
+  void add(Variable& var) override;
+
+  /**
+   * Reduce the current bucket, wait for the reductions of all the buckets and
+   * write the synchronized values to the added ``Variable``s.
+   */
+  void finalize() override;
+
+ private:
+  struct Bucket {
+    /// Number of Variables in the bucket
+    std::size_t size{0};
+    /// Contiguous buffer in which the Variables are reduced
+    af::array buffer;
+    /// Whether the bucket is reduced in `compressedBuffer`, in fp16
+    bool compressed{false};
+    af::array compressedBuffer;
+    /// Error of the last compression, if error feedback is enabled
+    af::array error;
+  };
+
+  /**
+   * Copy the Variables of the current bucket to its buffer, and start the
+   * reduction of the buffer.
+   */
+  void reduceBucket();
+
+  /**
+   * Compress the buffer of a bucket to its fp16 buffer.
+   */
+  void compressBucket(Bucket& bucket);
+
+  /// A scale by which to scale reduced gradients
+  double scale_;
+  /// Whether or not the distributed synchronization operates in a separate
+  /// compute stream asynchronously to the ArrayFire stream
+  bool async_;
+  /// The size of the buckets formed during the first step, in bytes
+  const std::size_t bucketBytes_;
+  /// Whether f32 and f64 buckets are reduced in fp16, and whether the
+  /// compression error is fed back
+  bool compress_;
+  bool errorFeedback_;
+  /// The buckets, as formed during the first step
+  std::vector<Bucket> buckets_;
+  /// The index of the current bucket in `buckets_`
+  std::size_t currBucket_{0};
+  /// The Variables added to the current bucket, and their size in bytes
+  std::vector<Variable> bucketVars_;
+  std::size_t bucketVarsBytes_{0};
+  /// The buckets being reduced, with their Variables
+  std::vector<std::pair<std::size_t, std::vector<Variable>>> inFlight_;
+};
+
+} // namespace fl
@@ -7,20 +7,30 @@
 
 #include "flashlight/fl/distributed/reducers/CoalescingReducer.h"
 #include "flashlight/fl/distributed/DistributedApi.h"
+#include "flashlight/fl/common/Trace.h"
 
 namespace fl {
 
-CoalescingReducer::CoalescingReducer(double scale, bool async, bool contiguous)
+CoalescingReducer::CoalescingReducer(
+    double scale,
+    bool async,
+    bool contiguous,
+    std::size_t cacheThresholdBytes /* = kCoalesceCacheSize */)
     : scale_(scale),
       async_(async),
       contiguous_(contiguous),
-      cacheThresholdBytes_(DistributedConstants::kCoalesceCacheSize) {}
+      cacheThresholdBytes_(cacheThresholdBytes) {}
 
 CoalescingReducer::~CoalescingReducer() {
   finalize();
 }
 
 void CoalescingReducer::add(Variable& var) {
+  // sparse gradients are gathered, without coalescing
+  if (var.isSparse()) {
+    allReduce(var, scale_);
+    return;
+  }
   // if this tensor would push the cache oversize, flush
   if (currCacheSize_ + var.bytes() > cacheThresholdBytes_) {
     flush();
@@ -50,6 +60,7 @@ void CoalescingReducer::finalize() {
 }
 
 void CoalescingReducer::flush() {
+  FL_TRACE(DISTRIBUTED, "CoalescingReducer::flush");
   allReduceMultiple(cache_, scale_, async_, contiguous_);
   currCacheSize_ = 0;
   cache_.clear();
@@ -57,6 +68,7 @@ void CoalescingReducer::flush() {
 
 void CoalescingReducer::synchronize() {
   if (async_ || contiguous_) {
+    FL_TRACE(DISTRIBUTED, "CoalescingReducer::synchronize");
     syncDistributed();
   }
 }
@@ -9,6 +9,7 @@
 
 #include <vector>
 
+#include "flashlight/fl/common/Defines.h"
 #include "flashlight/fl/distributed/reducers/Reducer.h"
 
 #include <arrayfire.h>
@@ -47,14 +48,21 @@ class CoalescingReducer : public Reducer {
   /**
    * Creates a new coalescing reducer.
    *
-   * @param[in] cache threshold at which the cache will be flushed
-   *  and its contents synchronized, in bytes
+   * @param[in] scale scale by which to scale reduced gradients
    * @param[in] async determines whether or not the distributed compute stream
    * runs asynchronously to the AF stream.
    * @param[in] contiguous forces synchronization of the set of Variables
    * to occur in a contiguous buffer, which may improve performance.
+   * @param[in] cacheThresholdBytes threshold at which the cache will be
+   * flushed and its contents synchronized, in bytes (see the
+   * DistributedBenchmark example to tune it)
    */
-  CoalescingReducer(double scale, bool async, bool contiguous);
+  CoalescingReducer(
+      double scale,
+      bool async,
+      bool contiguous,
+      std::size_t cacheThresholdBytes =
+          DistributedConstants::kCoalesceCacheSize);
 
   /**
    * Destroy the Reducer. Calls `finalize()` before returning.
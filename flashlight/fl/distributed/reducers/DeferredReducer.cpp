@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/distributed/reducers/DeferredReducer.h"
+
+#include <stdexcept>
+#include <utility>
+
+namespace fl {
+
+DeferredReducer::DeferredReducer(std::shared_ptr<Reducer> reducer)
+    : reducer_(std::move(reducer)) {
+  if (!reducer_) {
+    throw std::invalid_argument("DeferredReducer: null reducer");
+  }
+}
+
+void DeferredReducer::setSynchronize(bool synchronize) {
+  synchronize_ = synchronize;
+}
+
+bool DeferredReducer::isSynchronizing() const {
+  return synchronize_;
+}
+
+void DeferredReducer::add(Variable& var) {
+  if (synchronize_) {
+    reducer_->add(var);
+  }
+}
+
+void DeferredReducer::finalize() {
+  if (synchronize_) {
+    reducer_->finalize();
+  }
+}
+
+} // namespace fl
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <memory>
+
+#include "flashlight/fl/distributed/reducers/Reducer.h"
+
+namespace fl {
+
+class Variable;
+
+/**
+ * A Reducer which forwards Variables to another Reducer only when
+ * synchronization is enabled, for gradient accumulation: the gradients of
+ * several backward passes are summed locally, and only reduced after the
+ * last one.
+ *
+ * When gradients are added by the hooks of the parameters (see
+ * `distributeModuleGrads`), each gradient holds the sum over all the backward
+ * passes since the last `zeroGrad` when its hook is called, so the wrapped
+ * Reducer reduces it once:
+ *
+ *   auto reducer = std::make_shared<DeferredReducer>(
+ *       std::make_shared<BucketedReducer>(1.0, true));
+ *   distributeModuleGrads(model, reducer);
+ *   optimizer.zeroGrad();
+ *   for (int i = 0; i < numMicroBatches; ++i) {
+ *     reducer->setSynchronize(i == numMicroBatches - 1);
+ *     loss(i).backward();
+ *     reducer->finalize();
+ *   }
+ *   optimizer.step();
+ */
+class DeferredReducer : public Reducer {
+ public:
+  /**
+   * Creates a new DeferredReducer, with synchronization enabled.
+   *
+   * @param[in] reducer the Reducer to which Variables are forwarded
+   */
+  explicit DeferredReducer(std::shared_ptr<Reducer> reducer);
+
+  /**
+   * Enables or disables the synchronization of the Variables added next.
+   * Must not be called between an `add` and the following `finalize`.
+   */
+  void setSynchronize(bool synchronize);
+
+  bool isSynchronizing() const;
+
+  /**
+   * Forward a Variable to the wrapped Reducer if synchronization is enabled,
+   * else ignore it.
+   */
+  void add(Variable& var) override;
+
+  /**
+   * Finalize the wrapped Reducer if synchronization is enabled, else no-op.
+   */
+  void finalize() override;
+
+ private:
+  std::shared_ptr<Reducer> reducer_;
+  bool synchronize_{true};
+};
+
+} // namespace fl
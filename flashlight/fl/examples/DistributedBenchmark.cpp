@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Measures the bandwidth achieved by the collectives of the distributed
+ * backend (NCCL with CUDA, Gloo otherwise), launched with MPI on each process:
+ *
+ *   mpirun -n 16 DistributedBenchmark [max MB = 256] [iterations = 20]
+ *
+ * `allReduce` is timed on messages of 4KB to `max MB`, of f32 and f16, sync
+ * and async. `allReduceMultiple` is timed on messages split in 64 arrays,
+ * reduced in a contiguous buffer or one by one, and `CoalescingReducer`
+ * with several cache thresholds on the same arrays, to tune them for the
+ * cluster.
+ *
+ * The algorithm bandwidth is the size of the message over the time, the bus
+ * bandwidth the traffic of each link in a ring allreduce, as defined by
+ * nccl-tests, which is comparable across world sizes.
+ */
+
+#include <algorithm>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "flashlight/fl/flashlight.h"
+
+using namespace fl;
+
+namespace {
+
+const int kNumWarmup = 5;
+const int kNumArrays = 64;
+
+int numIters = 20;
+
+double median(std::vector<double> values) {
+  std::sort(values.begin(), values.end());
+  return values[values.size() / 2];
+}
+
+// Median time of `fn` in seconds, synchronizing the processes before each run
+double timeit(const std::function<void()>& fn) {
+  std::vector<double> times;
+  for (int i = 0; i < kNumWarmup + numIters; ++i) {
+    af::sync();
+    barrier();
+    auto start = af::timer::start();
+    fn();
+    syncDistributed();
+    af::sync();
+    if (i >= kNumWarmup) {
+      times.push_back(af::timer::stop(start));
+    }
+  }
+  return median(times);
+}
+
+void report(
+    const std::string& op,
+    af::dtype type,
+    size_t bytes,
+    const std::string& mode,
+    double seconds) {
+  if (getWorldRank() != 0) {
+    return;
+  }
+  int wSize = getWorldSize();
+  double algBandwidth = bytes / seconds / 1e9;
+  double busBandwidth = algBandwidth * 2 * (wSize - 1) / wSize;
+  std::cout << std::left << std::setw(20) << op << std::setw(6)
+            << (type == af::dtype::f16 ? "f16" : "f32") << std::right
+            << std::setw(12) << bytes << "  " << std::left << std::setw(24)
+            << mode << std::right << std::fixed << std::setprecision(3)
+            << std::setw(10) << seconds * 1000 << std::setw(12)
+            << algBandwidth << std::setw(12) << busBandwidth << std::endl;
+}
+
+void benchmark(af::dtype type, size_t maxBytes) {
+  const size_t typeSize = af::getSizeOf(type);
+  for (size_t bytes = 4096; bytes <= maxBytes; bytes *= 4) {
+    dim_t elements = bytes / typeSize;
+    auto arr = af::randu(elements).as(type);
+    arr.eval();
+    for (bool async : {false, true}) {
+      auto seconds = timeit([&]() { allReduce(arr, async); });
+      report("allReduce", type, bytes, async ? "async" : "sync", seconds);
+    }
+
+    // The gradients of a model, reduced together
+    if (elements < kNumArrays) {
+      continue;
+    }
+    std::vector<Variable> vars;
+    for (int i = 0; i < kNumArrays; ++i) {
+      auto part = af::randu(elements / kNumArrays).as(type);
+      part.eval();
+      vars.emplace_back(part, false);
+    }
+    size_t totalBytes = kNumArrays * (elements / kNumArrays) * typeSize;
+    for (bool async : {false, true}) {
+      for (bool contiguous : {true, false}) {
+        auto seconds = timeit(
+            [&]() { allReduceMultiple(vars, 1.0, async, contiguous); });
+        report(
+            "allReduceMultiple",
+            type,
+            totalBytes,
+            std::string(async ? "async" : "sync") +
+                (contiguous ? " contiguous" : " non-contiguous"),
+            seconds);
+      }
+    }
+    for (size_t thresholdMb : {1, 5, 20, 80}) {
+      CoalescingReducer reducer(1.0, true, true, thresholdMb << 20);
+      auto seconds = timeit([&]() {
+        for (auto& var : vars) {
+          reducer.add(var);
+        }
+        reducer.finalize();
+      });
+      report(
+          "CoalescingReducer",
+          type,
+          totalBytes,
+          "threshold " + std::to_string(thresholdMb) + "MB",
+          seconds);
+    }
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  fl::init();
+  distributedInit(
+      DistributedInit::MPI,
+      -1, // worldRank - unused. Automatically derived from `MPI_Comm_Rank`
+      -1, // worldSize - unused. Automatically derived from `MPI_Comm_Size`
+      {{DistributedConstants::kMaxDevicePerNode, "8"}});
+
+  size_t maxMb = argc > 1 ? std::stol(argv[1]) : 256;
+  numIters = argc > 2 ? std::stoi(argv[2]) : 20;
+
+  if (getWorldRank() == 0) {
+    std::cout << "Running on " << getWorldSize() << " processes with "
+              << (distributedBackend() == DistributedBackend::NCCL ? "NCCL"
+                                                                    : "Gloo")
+              << std::endl;
+    std::cout << std::left << std::setw(20) << "op" << std::setw(6) << "type"
+              << std::right << std::setw(12) << "bytes" << "  " << std::left
+              << std::setw(24) << "mode" << std::right << std::setw(10)
+              << "p50 ms" << std::setw(12) << "alg GB/s" << std::setw(12)
+              << "bus GB/s" << std::endl;
+  }
+  benchmark(af::dtype::f32, maxMb << 20);
+  // The type to which BucketedReducer compresses gradients
+  benchmark(af::dtype::f16, maxMb << 20);
+  return 0;
+}
@@ -52,7 +52,7 @@ int main() {
 
   // synchronize parameters of the model so that the parameters in each process
   // is the same
-  fl::allReduceParameters(model);
+  fl::broadcastParameters(model);
 
   // Add a hook to synchronize gradients of model parameters as they are
   // computed
@@ -65,6 +65,15 @@ af_memory_manager MemoryManagerAdapter::getHandle() const {
   return interface_;
 }
 
+void MemoryManagerAdapter::setTimeline(
+    std::shared_ptr<MemoryTimeline> timeline) {
+  timeline_ = std::move(timeline);
+}
+
+std::shared_ptr<MemoryTimeline> MemoryManagerAdapter::getTimeline() const {
+  return timeline_;
+}
+
 size_t MemoryManagerAdapter::getMemStepSize() {
   return -1; //  -1 denotes stepsize is not used by the custom memory manager
 }
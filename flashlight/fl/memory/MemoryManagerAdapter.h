@@ -17,6 +17,7 @@
 #include <string>
 
 #include "flashlight/fl/memory/MemoryManagerDeviceInterface.h"
+#include "flashlight/fl/memory/MemoryTimeline.h"
 
 namespace fl {
 
@@ -134,6 +135,21 @@ class MemoryManagerAdapter {
    */
   af_memory_manager getHandle() const;
 
+  /**
+   * Sets a timeline to record the allocation events of the memory manager
+   * into, for offline analysis (see `MemoryTimeline`). Recording stops if
+   * the timeline is null. Not thread-safe, to be set before the events to
+   * record.
+   *
+   * @param[in] timeline the timeline to record into.
+   */
+  void setTimeline(std::shared_ptr<MemoryTimeline> timeline);
+
+  /**
+   * Returns the timeline events are recorded into, null if none.
+   */
+  std::shared_ptr<MemoryTimeline> getTimeline() const;
+
   // Native and device memory management functions
   const std::shared_ptr<MemoryManagerDeviceInterface> deviceInterface;
 
@@ -141,6 +157,17 @@ class MemoryManagerAdapter {
   // AF memory manager entity containing relevant function pointers
   af_memory_manager interface_;
 
+  // Records an event into the timeline, if any
+  void recordEvent(
+      MemoryEventType type,
+      int device,
+      const void* ptr,
+      size_t size) {
+    if (timeline_) {
+      timeline_->record(type, device, ptr, size);
+    }
+  }
+
  private:
   // Logging components
   bool loggingEnabled_{false};
@@ -148,6 +175,7 @@ class MemoryManagerAdapter {
   std::stringstream logStreamBuffer_;
   size_t logStreamBufferSize_{0}; // in number of lines
   size_t logFlushInterval_{kDefaultLogFlushInterval};
+  std::shared_ptr<MemoryTimeline> timeline_;
 };
 
 template <typename... Values>
@@ -17,6 +17,12 @@ using NativeAllocFn = std::function<void*(size_t)>;
 using NativeFreeFn = std::function<void(void*)>;
 using GetMemoryPressureThresholdFn = std::function<float()>;
 using SetMemoryPressureThresholdFn = std::function<void(float)>;
+using GetActiveStreamFn = std::function<void*(int)>;
+using CreateEventFn = std::function<void*()>;
+using DestroyEventFn = std::function<void(void*)>;
+using RecordEventFn = std::function<void(void*, void*)>;
+using QueryEventFn = std::function<bool(void*)>;
+using SynchronizeEventFn = std::function<void(void*)>;
 
 /**
  * An interface for using native device memory management and JIT-related memory
@@ -45,6 +51,29 @@ struct MemoryManagerDeviceInterface {
   // Memory pressure functions
   GetMemoryPressureThresholdFn getMemoryPressureThreshold;
   SetMemoryPressureThresholdFn setMemoryPressureThreshold;
+  // Stream and event functions, for backends with asynchronous streams
+  // (CUDA). Streams and events are opaque native handles; these functions
+  // remain unset on other backends.
+  GetActiveStreamFn getActiveStream; // ArrayFire stream of a device
+  CreateEventFn createEvent;
+  DestroyEventFn destroyEvent;
+  RecordEventFn recordEvent; // (event, stream)
+  QueryEventFn queryEvent; // whether the recorded work has completed
+  SynchronizeEventFn synchronizeEvent; // blocks the host on the event
+
+  bool hasStreams() const {
+    return static_cast<bool>(getActiveStream);
+  }
 };
 
+namespace detail {
+
+/**
+ * Sets the stream and event functions of `deviceInterface` for the backend
+ * flashlight is built with.
+ */
+void setStreamFunctions(MemoryManagerDeviceInterface& deviceInterface);
+
+} // namespace detail
+
 } // namespace fl
@@ -19,6 +19,8 @@ namespace fl {
 // Statics from MemoryManagerInstaller
 std::shared_ptr<MemoryManagerAdapter>
     MemoryManagerInstaller::currentlyInstalledMemoryManager_;
+std::shared_ptr<MemoryManagerAdapter>
+    MemoryManagerInstaller::currentlyInstalledPinnedMemoryManager_;
 
 MemoryManagerAdapter* MemoryManagerInstaller::getImpl(
     af_memory_manager manager) {
@@ -78,12 +80,12 @@ MemoryManagerInstaller::MemoryManagerInstaller(
       m->log("allocFn: alloc failed with unspecified exception");
       return af_err(AF_ERR_UNKNOWN);
     }
-    // Log
-    m->log(
-        "alloc",
-        /* size */ dims[0], // HACK: dims[0] until af::memAlloc is size-aware
-        userLock,
-        (std::uintptr_t)*ptr);
+    // Log, with the size in bytes for replayMemoryTrace()
+    size_t bytes = elSize;
+    for (unsigned i = 0; i < ndims; ++i) {
+      bytes *= dims[i];
+    }
+    m->log("alloc", bytes, userLock, (std::uintptr_t)*ptr);
     return AF_SUCCESS;
   };
   AF_CHECK(af_memory_manager_set_alloc_fn(itf, allocFn));
@@ -201,6 +203,7 @@ MemoryManagerInstaller::MemoryManagerInstaller(
   };
   impl_->deviceInterface->setMemoryPressureThreshold =
       std::move(setMemoryPressureThresholdFn);
+  detail::setStreamFunctions(*impl_->deviceInterface);
 }
 
 void MemoryManagerInstaller::setAsMemoryManager() {
@@ -210,7 +213,7 @@ void MemoryManagerInstaller::setAsMemoryManager() {
 
 void MemoryManagerInstaller::setAsMemoryManagerPinned() {
   AF_CHECK(af_set_memory_manager_pinned(impl_->getHandle()));
-  currentlyInstalledMemoryManager_ = impl_;
+  currentlyInstalledPinnedMemoryManager_ = impl_;
 }
 
 MemoryManagerAdapter*
@@ -218,6 +221,11 @@ MemoryManagerInstaller::currentlyInstalledMemoryManager() {
   return currentlyInstalledMemoryManager_.get();
 }
 
+MemoryManagerAdapter*
+MemoryManagerInstaller::currentlyInstalledPinnedMemoryManager() {
+  return currentlyInstalledPinnedMemoryManager_.get();
+}
+
 void MemoryManagerInstaller::installDefaultMemoryManager() {
   auto deviceInterface = std::make_shared<MemoryManagerDeviceInterface>();
   auto adapter = std::make_shared<CachingMemoryManager>(
@@ -226,6 +234,23 @@ void MemoryManagerInstaller::installDefaultMemoryManager() {
   installer.setAsMemoryManager();
 }
 
+void MemoryManagerInstaller::installDefaultPinnedMemoryManager() {
+  auto deviceInterface = std::make_shared<MemoryManagerDeviceInterface>();
+  auto adapter = std::make_shared<CachingMemoryManager>(
+      af::getDeviceCount(), deviceInterface);
+  auto installer = MemoryManagerInstaller(adapter);
+  // Host memory: blocks are reused regardless of the streams of the device
+  deviceInterface->getActiveStream = nullptr;
+  installer.setAsMemoryManagerPinned();
+}
+
+void MemoryManagerInstaller::unsetPinnedMemoryManager() {
+  if (currentlyInstalledPinnedMemoryManager_) {
+    AF_CHECK(af_unset_memory_manager_pinned());
+    currentlyInstalledPinnedMemoryManager_ = nullptr;
+  }
+}
+
 void MemoryManagerInstaller::unsetMemoryManager() {
   // Make sure we don't reset the default AF memory manager if it's set
   if (currentlyInstalledMemoryManager_) {
@@ -80,6 +80,12 @@ class MemoryManagerInstaller {
    */
   static MemoryManagerAdapter* currentlyInstalledMemoryManager();
 
+  /**
+   * Returns the currently installed custom pinned memory manager, or null if
+   * none is installed.
+   */
+  static MemoryManagerAdapter* currentlyInstalledPinnedMemoryManager();
+
   /**
    * Initializes and installs the memory manager defaulted to on startup.
    *
@@ -88,6 +94,16 @@ class MemoryManagerInstaller {
    */
   static void installDefaultMemoryManager();
 
+  /**
+   * Initializes and installs a `CachingMemoryManager` as the ArrayFire pinned
+   * memory manager, so that pinned host allocations (`af_alloc_pinned`,
+   * `PinnedHostBuffer`, staging buffers of device copies) are split from
+   * cached blocks instead of being registered with the driver every time.
+   * Pinned blocks are not pooled per stream: their users synchronize with
+   * the copies using them before freeing them.
+   */
+  static void installDefaultPinnedMemoryManager();
+
   /**
    * Unsets the currently-set custom ArrayFire memory manager. If no custom
    * memory manager is set, results in a noop, since the default memory manager
@@ -95,11 +111,19 @@ class MemoryManagerInstaller {
    */
   static void unsetMemoryManager();
 
+  /**
+   * Unsets the currently-set custom ArrayFire pinned memory manager, if any.
+   */
+  static void unsetPinnedMemoryManager();
+
  private:
   // The given memory manager implementation
   std::shared_ptr<MemoryManagerAdapter> impl_;
   // Points to the impl_ of the most recently installed manager.
   static std::shared_ptr<MemoryManagerAdapter> currentlyInstalledMemoryManager_;
+  // Points to the impl_ of the most recently installed pinned manager.
+  static std::shared_ptr<MemoryManagerAdapter>
+      currentlyInstalledPinnedMemoryManager_;
 };
 
 } // namespace fl
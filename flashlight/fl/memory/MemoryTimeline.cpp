@@ -0,0 +1,485 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/memory/MemoryTimeline.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+namespace fl {
+
+namespace {
+
+constexpr const char kTimelineMagic[] = "FLMEMTL1";
+constexpr size_t kTimelineMagicSize = 8;
+
+// Scopes of the thread, joined by '/'
+thread_local std::string threadScope;
+
+const char* eventName(MemoryEventType type) {
+  switch (type) {
+    case MemoryEventType::NativeAlloc:
+      return "nativeAlloc";
+    case MemoryEventType::NativeFree:
+      return "nativeFree";
+    case MemoryEventType::Alloc:
+      return "alloc";
+    case MemoryEventType::Free:
+      return "free";
+    case MemoryEventType::Split:
+      return "split";
+    case MemoryEventType::Merge:
+      return "merge";
+  }
+  return "unknown";
+}
+
+std::string jsonEscape(const std::string& str) {
+  std::string out;
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      out += ' ';
+    } else {
+      out += c;
+    }
+  }
+  return out;
+}
+
+template <typename T>
+void writeValue(std::ofstream& file, const T& value) {
+  file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+void readValue(std::ifstream& file, T& value) {
+  file.read(reinterpret_cast<char*>(&value), sizeof(T));
+}
+
+// Free regions of the natively allocated segments of a device
+class FreeRegions {
+ public:
+  void addSegment(uint64_t ptr, uint64_t size) {
+    segments_[ptr] = size;
+    insert(ptr, size, ptr);
+  }
+
+  void removeSegment(uint64_t ptr) {
+    auto seg = segments_.find(ptr);
+    if (seg == segments_.end()) {
+      return;
+    }
+    auto it = regions_.lower_bound(ptr);
+    while (it != regions_.end() && it->first < ptr + seg->second) {
+      it = erase(it);
+    }
+    segments_.erase(seg);
+  }
+
+  // Carves the block out of the free region containing it
+  void allocate(uint64_t ptr, uint64_t size) {
+    auto it = regions_.upper_bound(ptr);
+    if (it == regions_.begin()) {
+      return;
+    }
+    --it;
+    uint64_t begin = it->first;
+    uint64_t end = begin + it->second.size;
+    uint64_t segment = it->second.segment;
+    if (ptr + size > end) {
+      return;
+    }
+    erase(it);
+    if (ptr > begin) {
+      insert(begin, ptr - begin, segment);
+    }
+    if (ptr + size < end) {
+      insert(ptr + size, end - ptr - size, segment);
+    }
+  }
+
+  // Gives the block back to the free regions of its segment
+  void free(uint64_t ptr, uint64_t size) {
+    auto seg = segments_.upper_bound(ptr);
+    if (seg == segments_.begin()) {
+      return;
+    }
+    --seg;
+    if (ptr + size > seg->first + seg->second) {
+      return;
+    }
+    uint64_t segment = seg->first;
+    auto next = regions_.find(ptr + size);
+    if (next != regions_.end() && next->second.segment == segment) {
+      size += next->second.size;
+      erase(next);
+    }
+    auto prev = regions_.lower_bound(ptr);
+    if (prev != regions_.begin()) {
+      --prev;
+      if (prev->first + prev->second.size == ptr &&
+          prev->second.segment == segment) {
+        ptr = prev->first;
+        size += prev->second.size;
+        erase(prev);
+      }
+    }
+    insert(ptr, size, segment);
+  }
+
+  uint64_t freeBytes() const {
+    return freeBytes_;
+  }
+
+  uint64_t largest() const {
+    return sizes_.empty() ? 0 : *sizes_.rbegin();
+  }
+
+ private:
+  struct Region {
+    uint64_t size;
+    uint64_t segment;
+  };
+
+  std::map<uint64_t, uint64_t> segments_;
+  std::map<uint64_t, Region> regions_;
+  std::multiset<uint64_t> sizes_;
+  uint64_t freeBytes_{0};
+
+  void insert(uint64_t ptr, uint64_t size, uint64_t segment) {
+    regions_[ptr] = {size, segment};
+    sizes_.insert(size);
+    freeBytes_ += size;
+  }
+
+  std::map<uint64_t, Region>::iterator erase(
+      std::map<uint64_t, Region>::iterator it) {
+    sizes_.erase(sizes_.find(it->second.size));
+    freeBytes_ -= it->second.size;
+    return regions_.erase(it);
+  }
+};
+
+std::string formatBytes(size_t bytes) {
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(2) << bytes / double(1 << 20)
+     << " MiB";
+  return ss.str();
+}
+
+} // namespace
+
+MemoryTimeline::MemoryTimeline() : start_(std::chrono::steady_clock::now()) {
+  scopes_.emplace_back();
+  scopeIds_[""] = 0;
+}
+
+void MemoryTimeline::record(
+    MemoryEventType type,
+    int device,
+    const void* ptr,
+    size_t size) {
+  auto timeUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start_)
+                    .count();
+  const std::string& scope = MemoryScope::current();
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint16_t scopeId = 0;
+  auto it = scopeIds_.find(scope);
+  if (it != scopeIds_.end()) {
+    scopeId = it->second;
+  } else if (scopes_.size() <= std::numeric_limits<uint16_t>::max()) {
+    // Events of scopes past the limit are not tagged
+    scopeId = scopes_.size();
+    scopeIds_[scope] = scopeId;
+    scopes_.push_back(scope);
+  }
+  events_.push_back(
+      {static_cast<uint64_t>(timeUs),
+       reinterpret_cast<uint64_t>(ptr),
+       size,
+       device,
+       scopeId,
+       type});
+}
+
+MemoryTimelineData MemoryTimeline::data() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return {scopes_, events_};
+}
+
+void MemoryTimeline::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  events_.clear();
+}
+
+void MemoryTimeline::save(const std::string& filename) const {
+  auto timeline = data();
+  std::ofstream file(filename, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error(
+        "MemoryTimeline::save - can't open file " + filename);
+  }
+  file.write(kTimelineMagic, kTimelineMagicSize);
+  writeValue(file, static_cast<uint64_t>(timeline.scopes.size()));
+  for (const auto& scope : timeline.scopes) {
+    writeValue(file, static_cast<uint32_t>(scope.size()));
+    file.write(scope.data(), scope.size());
+  }
+  writeValue(file, static_cast<uint64_t>(timeline.events.size()));
+  for (const auto& event : timeline.events) {
+    writeValue(file, event.timeUs);
+    writeValue(file, event.ptr);
+    writeValue(file, event.size);
+    writeValue(file, event.device);
+    writeValue(file, event.scope);
+    writeValue(file, event.type);
+  }
+  if (!file) {
+    throw std::runtime_error(
+        "MemoryTimeline::save - failed to write " + filename);
+  }
+}
+
+void MemoryTimeline::writeChromeTrace(std::ostream& out) const {
+  fl::writeChromeTrace(data(), out);
+}
+
+MemoryScope::MemoryScope(const std::string& name)
+    : parentLength_(threadScope.size()) {
+  if (!threadScope.empty()) {
+    threadScope += '/';
+  }
+  threadScope += name;
+}
+
+MemoryScope::~MemoryScope() {
+  threadScope.resize(parentLength_);
+}
+
+const std::string& MemoryScope::current() {
+  return threadScope;
+}
+
+MemoryTimelineData loadMemoryTimeline(const std::string& filename) {
+  std::ifstream file(filename, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error(
+        "loadMemoryTimeline - can't open file " + filename);
+  }
+  char magic[kTimelineMagicSize];
+  file.read(magic, kTimelineMagicSize);
+  if (!file || std::memcmp(magic, kTimelineMagic, kTimelineMagicSize) != 0) {
+    throw std::runtime_error(
+        "loadMemoryTimeline - not a memory timeline: " + filename);
+  }
+  MemoryTimelineData data;
+  uint64_t numScopes;
+  readValue(file, numScopes);
+  for (uint64_t i = 0; i < numScopes && file; ++i) {
+    uint32_t length;
+    readValue(file, length);
+    std::string scope(length, '\0');
+    file.read(&scope[0], length);
+    data.scopes.push_back(std::move(scope));
+  }
+  uint64_t numEvents = 0;
+  readValue(file, numEvents);
+  for (uint64_t i = 0; i < numEvents && file; ++i) {
+    MemoryEvent event;
+    readValue(file, event.timeUs);
+    readValue(file, event.ptr);
+    readValue(file, event.size);
+    readValue(file, event.device);
+    readValue(file, event.scope);
+    readValue(file, event.type);
+    if (event.scope >= data.scopes.size()) {
+      throw std::runtime_error(
+          "loadMemoryTimeline - invalid scope in " + filename);
+    }
+    data.events.push_back(event);
+  }
+  if (!file) {
+    throw std::runtime_error("loadMemoryTimeline - truncated file " + filename);
+  }
+  return data;
+}
+
+void writeChromeTrace(const MemoryTimelineData& timeline, std::ostream& out) {
+  // Allocated and reserved bytes per device
+  std::map<int, std::pair<uint64_t, uint64_t>> usage;
+  out << "{\"traceEvents\":[";
+  bool first = true;
+  for (const auto& event : timeline.events) {
+    auto& counters = usage[event.device];
+    bool changed = true;
+    switch (event.type) {
+      case MemoryEventType::Alloc:
+        counters.first += event.size;
+        break;
+      case MemoryEventType::Free:
+        counters.first -= std::min(counters.first, event.size);
+        break;
+      case MemoryEventType::NativeAlloc:
+        counters.second += event.size;
+        break;
+      case MemoryEventType::NativeFree:
+        counters.second -= std::min(counters.second, event.size);
+        break;
+      default:
+        changed = false;
+    }
+    out << (first ? "" : ",") << "\n{\"name\":\"" << eventName(event.type)
+        << "\",\"ph\":\"i\",\"s\":\"t\",\"ts\":" << event.timeUs
+        << ",\"pid\":" << event.device << ",\"tid\":0,\"args\":{\"ptr\":\"0x"
+        << std::hex << event.ptr << std::dec << "\",\"size\":" << event.size
+        << ",\"scope\":\"" << jsonEscape(timeline.scopes.at(event.scope))
+        << "\"}}";
+    first = false;
+    if (changed) {
+      out << ",\n{\"name\":\"memory\",\"ph\":\"C\",\"ts\":" << event.timeUs
+          << ",\"pid\":" << event.device
+          << ",\"args\":{\"allocated\":" << counters.first
+          << ",\"reserved\":" << counters.second << "}}";
+    }
+  }
+  out << "\n]}\n";
+}
+
+MemoryTimelineReport analyzeMemoryTimeline(
+    const MemoryTimelineData& data,
+    int device /* = 0 */,
+    size_t maxSamples /* = 1000 */,
+    size_t maxScopes /* = 10 */) {
+  MemoryTimelineReport report;
+  size_t numEvents = std::count_if(
+      data.events.begin(), data.events.end(), [device](const MemoryEvent& e) {
+        return e.device == device;
+      });
+  size_t window = std::max<size_t>(
+      1, (numEvents + std::max<size_t>(maxSamples, 1) - 1) /
+          std::max<size_t>(maxSamples, 1));
+
+  FreeRegions regions;
+  std::unordered_map<uint64_t, uint64_t> blocks;
+  std::vector<std::pair<size_t, size_t>> scopeStats(data.scopes.size());
+  uint64_t allocated = 0;
+  uint64_t reserved = 0;
+  size_t eventIdx = 0;
+  MemoryTimelineReport::Sample windowPeak{0, 0, 0, 0};
+  for (const auto& event : data.events) {
+    if (event.device != device) {
+      continue;
+    }
+    switch (event.type) {
+      case MemoryEventType::NativeAlloc:
+        reserved += event.size;
+        regions.addSegment(event.ptr, event.size);
+        ++report.numNativeAllocs;
+        break;
+      case MemoryEventType::NativeFree:
+        reserved -= std::min(reserved, event.size);
+        regions.removeSegment(event.ptr);
+        break;
+      case MemoryEventType::Alloc:
+        allocated += event.size;
+        blocks[event.ptr] = event.size;
+        regions.allocate(event.ptr, event.size);
+        if (event.scope < scopeStats.size()) {
+          ++scopeStats[event.scope].first;
+          scopeStats[event.scope].second += event.size;
+        }
+        break;
+      case MemoryEventType::Free: {
+        // Blocks allocated before the recording started are not known
+        auto it = blocks.find(event.ptr);
+        if (it != blocks.end()) {
+          allocated -= it->second;
+          regions.free(event.ptr, it->second);
+          blocks.erase(it);
+        }
+        break;
+      }
+      case MemoryEventType::Split:
+        ++report.numSplits;
+        break;
+      case MemoryEventType::Merge:
+        ++report.numMerges;
+        break;
+    }
+
+    uint64_t largest = regions.largest();
+    double fragmentation = regions.freeBytes() > 0
+        ? 1.0 - double(largest) / regions.freeBytes()
+        : 0.0;
+    report.maxFragmentation = std::max(report.maxFragmentation, fragmentation);
+    if (allocated > report.peakAllocatedBytes) {
+      report.peakAllocatedBytes = allocated;
+      report.peakAllocatedTimeUs = event.timeUs;
+      report.fragmentationAtPeak = fragmentation;
+    }
+    if (reserved > report.peakReservedBytes) {
+      report.peakReservedBytes = reserved;
+      report.peakReservedTimeUs = event.timeUs;
+    }
+    if (eventIdx % window == 0 || allocated > windowPeak.allocatedBytes) {
+      windowPeak = {event.timeUs, allocated, reserved, largest};
+    }
+    ++eventIdx;
+    if (eventIdx % window == 0 || eventIdx == numEvents) {
+      report.samples.push_back(windowPeak);
+    }
+  }
+
+  for (size_t i = 0; i < scopeStats.size(); ++i) {
+    if (scopeStats[i].first > 0) {
+      report.topScopes.push_back(
+          {data.scopes[i], scopeStats[i].first, scopeStats[i].second});
+    }
+  }
+  std::sort(
+      report.topScopes.begin(),
+      report.topScopes.end(),
+      [](const MemoryTimelineReport::ScopeStats& a,
+         const MemoryTimelineReport::ScopeStats& b) {
+        return a.bytes > b.bytes;
+      });
+  if (report.topScopes.size() > maxScopes) {
+    report.topScopes.resize(maxScopes);
+  }
+  return report;
+}
+
+std::string MemoryTimelineReport::prettyString() const {
+  std::stringstream ss;
+  ss << "Peak allocated: " << formatBytes(peakAllocatedBytes) << " at "
+     << peakAllocatedTimeUs / 1e6 << " s\n";
+  ss << "Peak reserved: " << formatBytes(peakReservedBytes) << " at "
+     << peakReservedTimeUs / 1e6 << " s\n";
+  ss << "Fragmentation: " << fragmentationAtPeak
+     << " at peak allocated, max " << maxFragmentation << "\n";
+  ss << "Native allocations: " << numNativeAllocs << ", splits: " << numSplits
+     << ", merges: " << numMerges << "\n";
+  ss << "Top allocating scopes:\n";
+  for (const auto& stats : topScopes) {
+    ss << "  " << (stats.scope.empty() ? "<none>" : stats.scope) << ": "
+       << formatBytes(stats.bytes) << " in " << stats.allocs << " allocs\n";
+  }
+  return ss.str();
+}
+
+} // namespace fl
@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace fl {
+
+/// Kinds of events of a `MemoryTimeline`.
+enum class MemoryEventType : uint8_t {
+  /// Device memory reserved by the memory manager
+  NativeAlloc = 0,
+  /// Device memory given back by the memory manager
+  NativeFree = 1,
+  /// Block handed out by the memory manager
+  Alloc = 2,
+  /// Block given back to the memory manager
+  Free = 3,
+  /// Part of a cached block split off by an allocation (remaining block)
+  Split = 4,
+  /// Cached blocks merged into one (merged block)
+  Merge = 5,
+};
+
+/// An event of a `MemoryTimeline`.
+struct MemoryEvent {
+  uint64_t timeUs; // since the creation of the timeline
+  uint64_t ptr;
+  uint64_t size; // bytes
+  int32_t device;
+  uint16_t scope; // index in the scopes of the timeline
+  MemoryEventType type;
+};
+
+/// Events of a `MemoryTimeline` with their scope names.
+struct MemoryTimelineData {
+  std::vector<std::string> scopes;
+  std::vector<MemoryEvent> events;
+};
+
+/**
+ * Records the allocation events of a memory manager, for offline analysis of
+ * memory usage and fragmentation (see `analyzeMemoryTimeline()`). A timeline
+ * is attached to a memory manager with `MemoryManagerAdapter::setTimeline()`.
+ *
+ * Each event is tagged with the `MemoryScope`s of the thread causing it, so
+ * that allocations can be attributed to parts of a program:
+ * \code
+ * auto timeline = std::make_shared<fl::MemoryTimeline>();
+ * adapter->setTimeline(timeline);
+ * {
+ *   fl::MemoryScope scope("forward");
+ *   auto output = model->forward(input);
+ * }
+ * timeline->save("memory.fltl");
+ * timeline->writeChromeTrace(traceFile);
+ * \endcode
+ *
+ * Recording is thread-safe.
+ */
+class MemoryTimeline {
+ public:
+  MemoryTimeline();
+
+  /// Records an event with the scope of the calling thread.
+  void record(MemoryEventType type, int device, const void* ptr, size_t size);
+
+  /// Copy of the events recorded so far.
+  MemoryTimelineData data() const;
+
+  /// Removes the events recorded so far.
+  void clear();
+
+  /**
+   * Writes the recorded events to a binary file, read by
+   * `loadMemoryTimeline()`.
+   */
+  void save(const std::string& filename) const;
+
+  /**
+   * Writes the recorded events in the Chrome trace event format
+   * (chrome://tracing, Perfetto), as instant events with counters of the
+   * allocated and reserved bytes of each device.
+   */
+  void writeChromeTrace(std::ostream& out) const;
+
+ private:
+  std::chrono::steady_clock::time_point start_;
+  mutable std::mutex mutex_;
+  std::vector<MemoryEvent> events_;
+  std::vector<std::string> scopes_;
+  std::unordered_map<std::string, uint16_t> scopeIds_;
+};
+
+/**
+ * Tags the memory events of the calling thread made during its lifetime.
+ * Scopes nest: events are tagged with the names of the enclosing scopes
+ * joined by '/'.
+ */
+class MemoryScope {
+ public:
+  explicit MemoryScope(const std::string& name);
+  ~MemoryScope();
+
+  MemoryScope(const MemoryScope&) = delete;
+  MemoryScope& operator=(const MemoryScope&) = delete;
+
+  /// Name of the innermost scopes of the calling thread, empty if none.
+  static const std::string& current();
+
+ private:
+  size_t parentLength_;
+};
+
+/// Reads events written by `MemoryTimeline::save()`.
+MemoryTimelineData loadMemoryTimeline(const std::string& filename);
+
+/// Writes events as `MemoryTimeline::writeChromeTrace()`.
+void writeChromeTrace(const MemoryTimelineData& data, std::ostream& out);
+
+/// Memory usage of a device over a timeline.
+struct MemoryTimelineReport {
+  struct Sample {
+    uint64_t timeUs;
+    size_t allocatedBytes; // in blocks handed out
+    size_t reservedBytes; // natively allocated
+    size_t largestFreeBlock; // largest contiguous free region of a segment
+  };
+
+  struct ScopeStats {
+    std::string scope;
+    size_t allocs;
+    size_t bytes;
+  };
+
+  size_t peakAllocatedBytes{0};
+  uint64_t peakAllocatedTimeUs{0};
+  size_t peakReservedBytes{0};
+  uint64_t peakReservedTimeUs{0};
+  // 1 - largest free block / free bytes of the reserved memory, at the peak
+  // of allocated memory and at most over the timeline
+  double fragmentationAtPeak{0};
+  double maxFragmentation{0};
+  size_t numNativeAllocs{0};
+  size_t numSplits{0};
+  size_t numMerges{0};
+  /// Usage over time, at the peaks of allocated memory of windows of events
+  std::vector<Sample> samples;
+  /// Scopes by decreasing allocated bytes
+  std::vector<ScopeStats> topScopes;
+
+  std::string prettyString() const;
+};
+
+/**
+ * Replays the events of a device to compute its memory usage over time. The
+ * free regions of the reserved memory are the parts of the natively
+ * allocated segments which are not in allocated blocks, which is how both
+ * the `CachingMemoryManager` (blocks split from and merged into segments)
+ * and the `DefaultMemoryManager` (one block per segment) cache memory.
+ *
+ * @param[in] data The events.
+ * @param[in] device Device whose events are analyzed.
+ * @param[in] maxSamples Maximum number of samples of the usage over time.
+ * @param[in] maxScopes Maximum number of top allocating scopes.
+ */
+MemoryTimelineReport analyzeMemoryTimeline(
+    const MemoryTimelineData& data,
+    int device = 0,
+    size_t maxSamples = 1000,
+    size_t maxScopes = 10);
+
+} // namespace fl
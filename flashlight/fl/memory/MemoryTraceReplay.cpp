@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/memory/MemoryTraceReplay.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace fl {
+
+namespace {
+
+// Native memory of the simulated device: addresses without memory
+struct SimulatedDevice {
+  // Away from null, aligned as device allocations
+  static constexpr uint64_t kBase = uint64_t(1) << 40;
+  static constexpr uint64_t kAlignment = 256;
+
+  size_t capacityBytes;
+  uint64_t next{kBase};
+  std::unordered_map<void*, size_t> segments;
+  size_t reservedBytes{0};
+  size_t peakReservedBytes{0};
+  size_t numNativeAllocs{0};
+  size_t numNativeFrees{0};
+  float memoryPressureThreshold{1.0};
+
+  explicit SimulatedDevice(size_t capacity) : capacityBytes(capacity) {}
+
+  void* alloc(size_t size) {
+    if (capacityBytes > 0 && reservedBytes + size > capacityBytes) {
+      throw std::bad_alloc();
+    }
+    void* ptr = reinterpret_cast<void*>(next);
+    next += (size + kAlignment - 1) / kAlignment * kAlignment + kAlignment;
+    segments[ptr] = size;
+    reservedBytes += size;
+    peakReservedBytes = std::max(peakReservedBytes, reservedBytes);
+    ++numNativeAllocs;
+    return ptr;
+  }
+
+  void free(void* ptr) {
+    auto it = segments.find(ptr);
+    if (it == segments.end()) {
+      throw std::invalid_argument(
+          "replayMemoryTrace - native free of an unknown pointer");
+    }
+    reservedBytes -= it->second;
+    segments.erase(it);
+    ++numNativeFrees;
+  }
+};
+
+double percentile(std::vector<double> values, double p) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  return values[std::min<size_t>(p * values.size(), values.size() - 1)];
+}
+
+} // namespace
+
+std::vector<MemoryTraceEvent> memoryTraceFromTimeline(
+    const MemoryTimelineData& data,
+    int device /* = 0 */) {
+  std::vector<MemoryTraceEvent> trace;
+  for (const auto& event : data.events) {
+    if (event.device != device) {
+      continue;
+    }
+    if (event.type == MemoryEventType::Alloc) {
+      trace.push_back({true, event.ptr, event.size, false});
+    } else if (event.type == MemoryEventType::Free) {
+      trace.push_back({false, event.ptr, event.size, false});
+    }
+  }
+  return trace;
+}
+
+std::vector<MemoryTraceEvent> parseMemoryManagerLog(std::istream& log) {
+  std::vector<MemoryTraceEvent> trace;
+  std::string line;
+  while (std::getline(log, line)) {
+    std::istringstream fields(line);
+    std::string fname;
+    fields >> fname;
+    MemoryTraceEvent event{};
+    if (fname == "alloc") {
+      event.alloc = true;
+      fields >> event.bytes >> event.userLock >> event.ptr;
+    } else if (fname == "unlock") {
+      fields >> event.ptr >> event.userLock;
+    } else {
+      continue;
+    }
+    if (!fields) {
+      throw std::invalid_argument(
+          "parseMemoryManagerLog - invalid line: " + line);
+    }
+    trace.push_back(event);
+  }
+  return trace;
+}
+
+MemoryReplayReport replayMemoryTrace(
+    const std::vector<MemoryTraceEvent>& trace,
+    const MemoryManagerFactory& makeManager,
+    size_t capacityBytes /* = 0 */) {
+  auto device = std::make_shared<SimulatedDevice>(capacityBytes);
+  auto deviceInterface = std::make_shared<MemoryManagerDeviceInterface>();
+  deviceInterface->getActiveDeviceId = []() { return 0; };
+  deviceInterface->getMaxMemorySize = [device](int /* id */) {
+    return device->capacityBytes;
+  };
+  deviceInterface->nativeAlloc = [device](size_t size) {
+    return device->alloc(size);
+  };
+  deviceInterface->nativeFree = [device](void* ptr) { device->free(ptr); };
+  deviceInterface->getMemoryPressureThreshold = [device]() {
+    return device->memoryPressureThreshold;
+  };
+  deviceInterface->setMemoryPressureThreshold = [device](float threshold) {
+    device->memoryPressureThreshold = threshold;
+  };
+
+  auto manager = makeManager(deviceInterface);
+  if (!manager) {
+    throw std::invalid_argument("replayMemoryTrace - null memory manager");
+  }
+  auto timeline = std::make_shared<MemoryTimeline>();
+  manager->setTimeline(timeline);
+  manager->initialize();
+
+  using Clock = std::chrono::steady_clock;
+  auto elapsedUs = [](const Clock::time_point& start) {
+    return std::chrono::duration<double, std::micro>(Clock::now() - start)
+        .count();
+  };
+  MemoryReplayReport report;
+  std::vector<double> allocUs;
+  double freeUs = 0;
+  // Recorded pointer -> replayed pointer and requested bytes
+  std::unordered_map<uint64_t, std::pair<void*, size_t>> live;
+  size_t requestedBytes = 0;
+  for (const auto& event : trace) {
+    if (event.alloc) {
+      if (event.bytes == 0) {
+        continue;
+      }
+      dim_t dims = event.bytes;
+      void* ptr = nullptr;
+      auto start = Clock::now();
+      try {
+        ptr = manager->alloc(event.userLock, 1, &dims, 1);
+      } catch (const std::exception&) {
+        ++report.numFailedAllocs;
+        continue;
+      }
+      allocUs.push_back(elapsedUs(start));
+      ++report.numAllocs;
+      live[event.ptr] = {ptr, event.bytes};
+      requestedBytes += event.bytes;
+      report.peakRequestedBytes =
+          std::max(report.peakRequestedBytes, requestedBytes);
+    } else {
+      auto it = live.find(event.ptr);
+      if (it == live.end()) {
+        ++report.numUnmatchedFrees;
+        continue;
+      }
+      auto start = Clock::now();
+      manager->unlock(it->second.first, event.userLock);
+      freeUs += elapsedUs(start);
+      ++report.numFrees;
+      requestedBytes -= it->second.second;
+      live.erase(it);
+    }
+  }
+  // Not counted in the frees of the trace
+  for (const auto& allocation : live) {
+    manager->unlock(allocation.second.first, false);
+  }
+  manager->shutdown();
+  manager->setTimeline(nullptr);
+
+  double totalAllocUs = 0;
+  for (double us : allocUs) {
+    totalAllocUs += us;
+    report.maxAllocUs = std::max(report.maxAllocUs, us);
+  }
+  report.meanAllocUs = allocUs.empty() ? 0 : totalAllocUs / allocUs.size();
+  report.p50AllocUs = percentile(allocUs, 0.5);
+  report.p99AllocUs = percentile(allocUs, 0.99);
+  report.meanFreeUs = report.numFrees > 0 ? freeUs / report.numFrees : 0;
+  report.peakReservedBytes = device->peakReservedBytes;
+  report.numNativeAllocs = device->numNativeAllocs;
+  report.numNativeFrees = device->numNativeFrees;
+  auto timelineReport = analyzeMemoryTimeline(timeline->data(), 0, 1, 0);
+  report.fragmentationAtPeak = timelineReport.fragmentationAtPeak;
+  report.maxFragmentation = timelineReport.maxFragmentation;
+  return report;
+}
+
+std::string MemoryReplayReport::prettyString() const {
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(3);
+  ss << "Allocations: " << numAllocs << " (" << numFailedAllocs
+     << " failed), frees: " << numFrees << " (" << numUnmatchedFrees
+     << " unmatched)\n";
+  ss << "Allocation latency (us): mean " << meanAllocUs << ", p50 "
+     << p50AllocUs << ", p99 " << p99AllocUs << ", max " << maxAllocUs
+     << "\n";
+  ss << "Free latency (us): mean " << meanFreeUs << "\n";
+  ss << std::setprecision(2) << "Peak requested: "
+     << peakRequestedBytes / double(1 << 20) << " MiB, peak reserved: "
+     << peakReservedBytes / double(1 << 20) << " MiB\n";
+  ss << std::setprecision(4) << "Fragmentation: " << fragmentationAtPeak
+     << " at peak allocated, max " << maxFragmentation << "\n";
+  ss << "Native allocations: " << numNativeAllocs
+     << ", native frees: " << numNativeFrees << "\n";
+  return ss.str();
+}
+
+std::string MemoryReplayReport::json() const {
+  std::stringstream ss;
+  ss << "{\"allocs\": " << numAllocs << ", \"failed_allocs\": "
+     << numFailedAllocs << ", \"frees\": " << numFrees
+     << ", \"unmatched_frees\": " << numUnmatchedFrees
+     << ", \"alloc_mean_us\": " << meanAllocUs
+     << ", \"alloc_p50_us\": " << p50AllocUs
+     << ", \"alloc_p99_us\": " << p99AllocUs
+     << ", \"alloc_max_us\": " << maxAllocUs
+     << ", \"free_mean_us\": " << meanFreeUs
+     << ", \"peak_requested_bytes\": " << peakRequestedBytes
+     << ", \"peak_reserved_bytes\": " << peakReservedBytes
+     << ", \"fragmentation_at_peak\": " << fragmentationAtPeak
+     << ", \"max_fragmentation\": " << maxFragmentation
+     << ", \"native_allocs\": " << numNativeAllocs
+     << ", \"native_frees\": " << numNativeFrees << "}";
+  return ss.str();
+}
+
+} // namespace fl
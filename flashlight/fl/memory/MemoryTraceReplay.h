@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "flashlight/fl/memory/MemoryManagerAdapter.h"
+#include "flashlight/fl/memory/MemoryManagerDeviceInterface.h"
+#include "flashlight/fl/memory/MemoryTimeline.h"
+
+namespace fl {
+
+/// An allocation or a free of a trace replayed by `replayMemoryTrace()`.
+struct MemoryTraceEvent {
+  bool alloc;
+  // Pointer of the recording, which pairs the frees with their allocations
+  uint64_t ptr;
+  size_t bytes; // of the allocations
+  bool userLock;
+};
+
+/**
+ * Returns the allocations and frees of a device in a timeline (see
+ * `MemoryTimeline`). Their sizes are the ones of the blocks handed out by the
+ * recording memory manager, which may be rounded up from the requests.
+ */
+std::vector<MemoryTraceEvent> memoryTraceFromTimeline(
+    const MemoryTimelineData& data,
+    int device = 0);
+
+/**
+ * Parses the allocations ("alloc <bytes> <userLock> <ptr>") and frees
+ * ("unlock <ptr> <userLock>") of the log of a `MemoryManagerAdapter` (see
+ * `MemoryManagerAdapter::setLogStream()`). The other lines are ignored.
+ */
+std::vector<MemoryTraceEvent> parseMemoryManagerLog(std::istream& log);
+
+/// Costs of a memory manager on a trace, see `replayMemoryTrace()`.
+struct MemoryReplayReport {
+  size_t numAllocs{0};
+  size_t numFrees{0};
+  // Allocations which threw, e.g. out of the capacity of the device
+  size_t numFailedAllocs{0};
+  // Frees without an allocation in the trace, which are skipped
+  size_t numUnmatchedFrees{0};
+  // Time spent in the memory manager, in microseconds
+  double meanAllocUs{0};
+  double p50AllocUs{0};
+  double p99AllocUs{0};
+  double maxAllocUs{0};
+  double meanFreeUs{0};
+  // Peak of the bytes requested by the live allocations of the trace
+  size_t peakRequestedBytes{0};
+  // Peak of the device memory held by the memory manager
+  size_t peakReservedBytes{0};
+  size_t numNativeAllocs{0};
+  size_t numNativeFrees{0};
+  // Of the reserved memory, see `MemoryTimelineReport`
+  double fragmentationAtPeak{0};
+  double maxFragmentation{0};
+
+  std::string prettyString() const;
+  /// The report as a JSON object on one line.
+  std::string json() const;
+};
+
+/// Creates the memory manager to replay a trace with, on a device interface.
+using MemoryManagerFactory =
+    std::function<std::shared_ptr<MemoryManagerAdapter>(
+        std::shared_ptr<MemoryManagerDeviceInterface>)>;
+
+/**
+ * Replays a trace against a memory manager, to compare managers or their
+ * settings (e.g. `CachingMemoryManager::setSplitSizeLimit()`) offline. The
+ * manager is created by `makeManager` on a simulated device 0, whose native
+ * allocations hand out addresses without memory: the manager isn't installed
+ * and no device is needed. Its initialize() and shutdown() are called before
+ * and after the events, and the allocations still live at the end are freed
+ * before shutdown().
+ *
+ * @param[in] trace The allocations and frees to replay, in order.
+ * @param[in] makeManager Creates the memory manager.
+ * @param[in] capacityBytes Memory of the simulated device, beyond which native
+ * allocations throw (the manager then frees its cache and retries). 0 for no
+ * limit.
+ */
+MemoryReplayReport replayMemoryTrace(
+    const std::vector<MemoryTraceEvent>& trace,
+    const MemoryManagerFactory& makeManager,
+    size_t capacityBytes = 0);
+
+} // namespace fl
@@ -0,0 +1,17 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/memory/MemoryManagerDeviceInterface.h"
+
+namespace fl {
+namespace detail {
+
+// Work is ordered on a single queue per device: no stream functions.
+void setStreamFunctions(MemoryManagerDeviceInterface& /* unused */) {}
+
+} // namespace detail
+} // namespace fl
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/memory/MemoryManagerDeviceInterface.h"
+
+#include "flashlight/fl/common/backend/cuda/CudaUtils.h"
+
+namespace fl {
+namespace detail {
+
+void setStreamFunctions(MemoryManagerDeviceInterface& deviceInterface) {
+  deviceInterface.getActiveStream = [](int device) {
+    return static_cast<void*>(afcu::getStream(device));
+  };
+  deviceInterface.createEvent = []() {
+    cudaEvent_t event;
+    FL_CUDA_CHECK(cudaEventCreateWithFlags(
+        &event, cuda::detail::kCudaEventDefaultFlags));
+    return static_cast<void*>(event);
+  };
+  deviceInterface.destroyEvent = [](void* event) {
+    FL_CUDA_CHECK(cudaEventDestroy(static_cast<cudaEvent_t>(event)));
+  };
+  deviceInterface.recordEvent = [](void* event, void* stream) {
+    FL_CUDA_CHECK(cudaEventRecord(
+        static_cast<cudaEvent_t>(event), static_cast<cudaStream_t>(stream)));
+  };
+  deviceInterface.queryEvent = [](void* event) {
+    cudaError_t err = cudaEventQuery(static_cast<cudaEvent_t>(event));
+    if (err == cudaErrorNotReady) {
+      // Clears the error state of the runtime
+      cudaGetLastError();
+      return false;
+    }
+    FL_CUDA_CHECK(err);
+    return true;
+  };
+  deviceInterface.synchronizeEvent = [](void* event) {
+    FL_CUDA_CHECK(cudaEventSynchronize(static_cast<cudaEvent_t>(event)));
+  };
+}
+
+} // namespace detail
+} // namespace fl
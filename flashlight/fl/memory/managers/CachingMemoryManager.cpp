@@ -9,13 +9,19 @@
 #include <arrayfire.h> // Needed for af exception
 
 #include <algorithm>
+#include <cstdint>
+#include <fstream>
 #include <iostream>
 #include <limits>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <numeric>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include "flashlight/fl/common/Logging.h"
@@ -34,10 +40,28 @@ constexpr size_t kLargeBuffer =
 constexpr size_t kMinLargeAlloc =
     10485760; // allocations between 1 and 10 MiB may use kLargeBuffer
 constexpr size_t kRoundLarge = 2097152; // round up large allocs to 2 MiB
+// cached blocks of another stream whose events are queried per allocation
+constexpr int kMaxEventQueries = 8;
+// large blocks of a warm start are packed in segments of at most 1 GiB
+constexpr size_t kWarmStartSegment = 1073741824;
+constexpr const char* kProfileHeader =
+    "# flashlight CachingMemoryManager allocation profile";
+
+// thread caches hold up to 4 MiB of free blocks per device by default, and
+// are refilled with up to 1 MiB of blocks of a size at once, 16 at most
+constexpr size_t kThreadCacheBytes = 4194304;
+constexpr size_t kThreadCacheRefill = 1048576;
+constexpr size_t kThreadCacheMaxRefillBlocks = 16;
+// the blocks of the thread caches of a device are looked up in a table of
+// 2^16 slots, each block in one of the 8 slots following the hash of its
+// pointer
+constexpr int kThreadCacheSlotsLog2 = 16;
+constexpr size_t kThreadCacheProbes = 8;
 
 // Environment variables names, specifying number of mega bytes as floats.
 constexpr const char* kMemRecyclingSize = "FL_MEM_RECYCLING_SIZE_MB";
 constexpr const char* kMemSplitSize = "FL_MEM_SPLIT_SIZE_MB";
+constexpr const char* kMemThreadCacheSize = "FL_MEM_THREAD_CACHE_MB";
 constexpr double kMB = static_cast<double>(1UL << 20);
 
 size_t roundSize(size_t size) {
@@ -48,6 +72,11 @@ size_t roundSize(size_t size) {
   }
 }
 
+size_t threadCacheRefillBlocks(size_t size) {
+  return std::max<size_t>(
+      1, std::min(kThreadCacheMaxRefillBlocks, kThreadCacheRefill / size));
+}
+
 size_t getAllocationSize(size_t size) {
   if (size <= kSmallSize) {
     return kSmallBuffer;
@@ -61,6 +90,9 @@ size_t getAllocationSize(size_t size) {
 static bool BlockComparator(
     const CachingMemoryManager::Block* a,
     const CachingMemoryManager::Block* b) {
+  if (a->stream_ != b->stream_) {
+    return (uintptr_t)a->stream_ < (uintptr_t)b->stream_;
+  }
   if (a->size_ != b->size_) {
     return a->size_ < b->size_;
   }
@@ -96,12 +128,192 @@ size_t getEnvAsBytesFromFloatMb(const char* name, size_t defaultVal) {
   return defaultVal;
 }
 
+// Pointer of the slots of erased blocks, reused by insertions
+const void* const kErasedSlot = reinterpret_cast<const void*>(1);
+
+struct ThreadBlockCache;
+
+} // namespace
+
+struct CachingMemoryManager::ThreadCacheDepot {
+  // The pointer of a slot is set before its block, which is only looked up
+  // once it has been handed out by the thread inserting it
+  struct Slot {
+    std::atomic<const void*> ptr{nullptr};
+    std::atomic<Block*> block{nullptr};
+  };
+
+  explicit ThreadCacheDepot(size_t maxBytes)
+      : id(nextId()),
+        maxBytes(maxBytes),
+        enabled(maxBytes > 0),
+        slots(new Slot[size_t(1) << kThreadCacheSlotsLog2]) {}
+
+  static uint64_t nextId() {
+    static std::atomic<uint64_t> lastId{0};
+    return ++lastId;
+  }
+
+  Slot& slot(const void* ptr, size_t probe) const {
+    uint64_t key = reinterpret_cast<uintptr_t>(ptr) / kMinBlockSize;
+    size_t hash = (key * 0x9E3779B97F4A7C15ULL) >> (64 - kThreadCacheSlotsLog2);
+    return slots[(hash + probe) & ((size_t(1) << kThreadCacheSlotsLog2) - 1)];
+  }
+
+  // Lock-free; false if the slots of the block are taken
+  bool insert(Block* block) {
+    for (size_t i = 0; i < kThreadCacheProbes; ++i) {
+      auto& s = slot(block->ptr_, i);
+      const void* expected = s.ptr.load(std::memory_order_relaxed);
+      if ((expected == nullptr || expected == kErasedSlot) &&
+          s.ptr.compare_exchange_strong(expected, block->ptr_)) {
+        s.block.store(block, std::memory_order_release);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Lock-free; nullptr if the block of `ptr` isn't cached by a thread
+  Block* find(const void* ptr) const {
+    for (size_t i = 0; i < kThreadCacheProbes; ++i) {
+      auto& s = slot(ptr, i);
+      if (s.ptr.load(std::memory_order_acquire) == ptr) {
+        return s.block.load(std::memory_order_acquire);
+      }
+    }
+    return nullptr;
+  }
+
+  void erase(const void* ptr) {
+    for (size_t i = 0; i < kThreadCacheProbes; ++i) {
+      auto& s = slot(ptr, i);
+      if (s.ptr.load(std::memory_order_relaxed) == ptr) {
+        s.block.store(nullptr, std::memory_order_relaxed);
+        s.ptr.store(kErasedSlot, std::memory_order_release);
+        return;
+      }
+    }
+  }
+
+  // Blocks are given back by the threads without the lock of the device,
+  // and are only merged once they are cached
+  void giveBack(const std::vector<Block*>& blocks) {
+    for (Block* block : blocks) {
+      erase(block->ptr_);
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    returned.insert(returned.end(), blocks.begin(), blocks.end());
+    hasReturned.store(true, std::memory_order_release);
+  }
+
+  std::vector<Block*> takeReturned() {
+    std::vector<Block*> blocks;
+    if (hasReturned.load(std::memory_order_acquire)) {
+      std::lock_guard<std::mutex> lock(mutex);
+      blocks.swap(returned);
+      hasReturned.store(false, std::memory_order_relaxed);
+    }
+    return blocks;
+  }
+
+  const uint64_t id;
+  const size_t maxBytes;
+  // Whether allocations may be served by the thread caches
+  std::atomic<bool> enabled;
+  std::unique_ptr<Slot[]> slots;
+
+  std::mutex mutex;
+  std::vector<Block*> returned;
+  std::atomic<bool> hasReturned{false};
+
+  // The caches of the live threads, drained by `signalMemoryCleanup()` even
+  // if their threads are idle
+  std::mutex cachesMutex;
+  std::unordered_set<ThreadBlockCache*> caches;
+};
+
+namespace {
+
+// The free blocks a thread caches for a device, by stream and size
+struct ThreadBlockCache {
+  using Block = CachingMemoryManager::Block;
+
+  std::shared_ptr<CachingMemoryManager::ThreadCacheDepot> depot;
+  // Taken by the thread, and by the cleanups draining its cache after the
+  // lock of the device
+  std::mutex mutex;
+  std::map<std::pair<void*, size_t>, std::vector<Block*>> bins;
+  size_t bytes{0};
+
+  // Gives back the `count` blocks of `bin` freed first
+  void flush(std::vector<Block*>& bin, size_t count) {
+    std::vector<Block*> blocks(bin.begin(), bin.begin() + count);
+    bin.erase(bin.begin(), bin.begin() + count);
+    for (Block* block : blocks) {
+      bytes -= block->size_;
+    }
+    depot->giveBack(blocks);
+  }
+
+  void flushAll() {
+    std::vector<Block*> blocks;
+    for (auto& bin : bins) {
+      blocks.insert(blocks.end(), bin.second.begin(), bin.second.end());
+      bin.second.clear();
+    }
+    bytes = 0;
+    if (!blocks.empty()) {
+      depot->giveBack(blocks);
+    }
+  }
+
+  ~ThreadBlockCache() {
+    if (depot) {
+      {
+        std::lock_guard<std::mutex> lock(depot->cachesMutex);
+        depot->caches.erase(this);
+      }
+      flushAll();
+    }
+  }
+};
+
+// By depot id, so that the caches of a destroyed manager are not reused
+thread_local std::unordered_map<uint64_t, ThreadBlockCache> tlsBlockCaches;
+
+ThreadBlockCache& threadBlockCache(
+    const std::shared_ptr<CachingMemoryManager::ThreadCacheDepot>& depot) {
+  auto& cache = tlsBlockCaches[depot->id];
+  if (!cache.depot) {
+    cache.depot = depot;
+    std::lock_guard<std::mutex> lock(depot->cachesMutex);
+    depot->caches.insert(&cache);
+  }
+  return cache;
+}
+
+// Gives back the blocks of the caches of all the threads
+void drainThreadBlockCaches(CachingMemoryManager::ThreadCacheDepot& depot) {
+  std::lock_guard<std::mutex> lock(depot.cachesMutex);
+  for (ThreadBlockCache* cache : depot.caches) {
+    std::lock_guard<std::mutex> cacheLock(cache->mutex);
+    cache->flushAll();
+  }
+}
+
 } // namespace
 
-CachingMemoryManager::DeviceMemoryInfo::DeviceMemoryInfo(int id)
+CachingMemoryManager::PrivatePool::PrivatePool()
+    : largeBlocks_(BlockComparator), smallBlocks_(BlockComparator) {}
+
+CachingMemoryManager::DeviceMemoryInfo::DeviceMemoryInfo(
+    int id,
+    size_t threadCacheBytes)
     : deviceId_(id),
       largeBlocks_(BlockComparator),
-      smallBlocks_(BlockComparator) {}
+      smallBlocks_(BlockComparator),
+      threadCaches_(std::make_shared<ThreadCacheDepot>(threadCacheBytes)) {}
 
 CachingMemoryManager::CachingMemoryManager(
     int numDevices,
@@ -110,16 +322,22 @@ CachingMemoryManager::CachingMemoryManager(
   recyclingSizeLimit_ =
       getEnvAsBytesFromFloatMb(kMemRecyclingSize, recyclingSizeLimit_);
   splitSizeLimit_ = getEnvAsBytesFromFloatMb(kMemSplitSize, splitSizeLimit_);
+  threadCacheBytes_ =
+      getEnvAsBytesFromFloatMb(kMemThreadCacheSize, kThreadCacheBytes);
 
   FL_LOG(fl::INFO) << "CachingMemoryManager recyclingSizeLimit_="
                    << recyclingSizeLimit_ << " ("
                    << formatMemory(recyclingSizeLimit_)
                    << ") splitSizeLimit_=" << splitSizeLimit_ << " ("
-                   << formatMemory(splitSizeLimit_) << ')';
+                   << formatMemory(splitSizeLimit_)
+                   << ") threadCacheBytes_=" << threadCacheBytes_ << " ("
+                   << formatMemory(threadCacheBytes_) << ')';
 
   for (int i = 0; i < numDevices; ++i) {
     deviceMemInfos_.emplace(
-        i, std::make_unique<CachingMemoryManager::DeviceMemoryInfo>(i));
+        i,
+        std::make_unique<CachingMemoryManager::DeviceMemoryInfo>(
+            i, threadCacheBytes_));
   }
 }
 
@@ -135,6 +353,12 @@ void CachingMemoryManager::setSplitSizeLimit(size_t limit) {
 
 void CachingMemoryManager::shutdown() {
   signalMemoryCleanup();
+  auto& memoryInfo = getDeviceMemoryInfo();
+  std::lock_guard<std::recursive_mutex> lock(memoryInfo.mutexAll_);
+  for (void* event : memoryInfo.freeEvents_) {
+    this->deviceInterface->destroyEvent(event);
+  }
+  memoryInfo.freeEvents_.clear();
 }
 
 void CachingMemoryManager::addMemoryManagement(int device) {
@@ -142,7 +366,9 @@ void CachingMemoryManager::addMemoryManagement(int device) {
     return;
   }
   deviceMemInfos_.emplace(
-      device, std::make_unique<CachingMemoryManager::DeviceMemoryInfo>(device));
+      device,
+      std::make_unique<CachingMemoryManager::DeviceMemoryInfo>(
+          device, threadCacheBytes_));
 }
 
 void CachingMemoryManager::removeMemoryManagement(int device) {
@@ -157,8 +383,6 @@ void* CachingMemoryManager::alloc(
     const unsigned ndims,
     dim_t* dims,
     const unsigned elementSize) {
-  auto& memoryInfo = getDeviceMemoryInfo();
-  std::lock_guard<std::recursive_mutex> lock(memoryInfo.mutexAll_);
   size_t size = elementSize;
   for (unsigned i = 0; i < ndims; ++i) {
     size *= dims[i];
@@ -167,26 +391,97 @@ void* CachingMemoryManager::alloc(
     return nullptr;
   }
   size = roundSize(size);
+  auto& memoryInfo = getDeviceMemoryInfo();
+  if (auto* cached = allocFromThreadCache(memoryInfo, size)) {
+    cached->managerLock_ = !userLock;
+    cached->userLock_ = userLock;
+    recordEvent(
+        MemoryEventType::Alloc,
+        memoryInfo.deviceId_,
+        cached->ptr_,
+        cached->size_);
+    return cached->ptr_;
+  }
+
+  std::lock_guard<std::recursive_mutex> lock(memoryInfo.mutexAll_);
+  cacheReturnedBlocks();
+  void* stream = this->deviceInterface->hasStreams()
+      ? this->deviceInterface->getActiveStream(memoryInfo.deviceId_)
+      : nullptr;
+  if (!memoryInfo.pendingEvents_.empty()) {
+    processPendingEvents(/* wait = */ false);
+  }
+  CachingMemoryManager::Block* block =
+      takeBlock(size, stream, /* allowMalloc = */ true);
+
+  block->managerLock_ = !userLock;
+  block->userLock_ = userLock;
+  block->privatePool_ = memoryInfo.activePrivatePool_;
+  memoryInfo.allocatedBlocks_[block->ptr_] = block;
+  if (profiling_) {
+    auto& profile = memoryInfo.profile_;
+    size_t& peak = profile.peakBlocks[block->size_];
+    peak = std::max(peak, ++memoryInfo.liveBlocks_[block->size_]);
+    memoryInfo.liveBytes_ += block->size_;
+    profile.peakAllocatedBytes =
+        std::max(profile.peakAllocatedBytes, memoryInfo.liveBytes_);
+  }
+  recordEvent(
+      MemoryEventType::Alloc, memoryInfo.deviceId_, block->ptr_, block->size_);
+  return static_cast<void*>(block->ptr_);
+}
+
+CachingMemoryManager::Block*
+CachingMemoryManager::takeBlock(size_t size, void* stream, bool allowMalloc) {
+  auto& memoryInfo = getDeviceMemoryInfo();
   const bool isSmallAlloc = (size <= kSmallSize);
-  CachingMemoryManager::Block searchKey(size);
+  CachingMemoryManager::Block searchKey(size, nullptr, stream);
   CachingMemoryManager::BlockSet& pool =
       isSmallAlloc ? memoryInfo.smallBlocks_ : memoryInfo.largeBlocks_;
 
   CachingMemoryManager::Block* block = nullptr;
-  auto it = pool.lower_bound(&searchKey);
-  // Recycle blocks if any found, and if small alloc or the block size is not
-  // too large:
-  if (it != pool.end() &&
-      (isSmallAlloc || (*it)->size_ < recyclingSizeLimit_)) {
-    block = *it;
-    pool.erase(it);
-    memoryInfo.stats_.cachedBytes_ -= block->size_;
-  } else {
+  // Pool the block is taken from, where the rest of a split block is cached
+  CachingMemoryManager::BlockSet* blockPool = &pool;
+  if (memoryInfo.activePrivatePool_) {
+    auto& privatePool =
+        memoryInfo.privatePools_.at(memoryInfo.activePrivatePool_);
+    auto& privateBlocks =
+        isSmallAlloc ? privatePool.smallBlocks_ : privatePool.largeBlocks_;
+    auto it = privateBlocks.lower_bound(&searchKey);
+    if (it != privateBlocks.end() && (*it)->stream_ == stream) {
+      block = *it;
+      privateBlocks.erase(it);
+      memoryInfo.stats_.cachedBytes_ -= block->size_;
+      blockPool = &privateBlocks;
+    }
+  }
+  if (!block) {
+    auto it = pool.lower_bound(&searchKey);
+    // Recycle blocks of the stream if any found, and if small alloc or the
+    // block size is not too large:
+    if (it != pool.end() && (*it)->stream_ == stream &&
+        (isSmallAlloc || (*it)->size_ < recyclingSizeLimit_)) {
+      block = *it;
+      pool.erase(it);
+      memoryInfo.stats_.cachedBytes_ -= block->size_;
+    } else {
+      block = takeCompletedBlock(pool, size, stream);
+    }
+  }
+  if (!block) {
+    if (!allowMalloc) {
+      return nullptr;
+    }
     void* ptr = nullptr;
     size_t allocSize = getAllocationSize(size);
     mallocWithRetry(allocSize, &ptr); // could throw
-    block = new Block(allocSize, ptr);
+    block = new Block(allocSize, ptr, stream);
     memoryInfo.stats_.allocatedBytes_ += allocSize;
+    memoryInfo.stats_.peakAllocatedBytes_ = std::max(
+        memoryInfo.stats_.peakAllocatedBytes_,
+        memoryInfo.stats_.allocatedBytes_);
+    recordEvent(
+        MemoryEventType::NativeAlloc, memoryInfo.deviceId_, ptr, allocSize);
   }
 
   // If the block is larger than the requested size to handle another
@@ -199,8 +494,9 @@ void* CachingMemoryManager::alloc(
       (block->size_ < splitSizeLimit_) // possibly dont split large buffers to
                                        // minimize risk of fragmentation
   ) {
+    // The remaining part keeps the event of the cached block
     remaining = block;
-    block = new Block(size, block->ptr_);
+    block = new Block(size, block->ptr_, block->stream_);
     block->prev_ = remaining->prev_;
     if (block->prev_) {
       block->prev_->next_ = block;
@@ -210,14 +506,120 @@ void* CachingMemoryManager::alloc(
     remaining->prev_ = block;
     remaining->ptr_ = static_cast<char*>(remaining->ptr_) + size;
     remaining->size_ -= size;
-    pool.insert(remaining);
+    blockPool->insert(remaining);
     memoryInfo.stats_.cachedBytes_ += remaining->size_;
+    recordEvent(
+        MemoryEventType::Split,
+        memoryInfo.deviceId_,
+        remaining->ptr_,
+        remaining->size_);
   }
+  return block;
+}
 
-  block->managerLock_ = !userLock;
-  block->userLock_ = userLock;
-  memoryInfo.allocatedBlocks_[block->ptr_] = block;
-  return static_cast<void*>(block->ptr_);
+CachingMemoryManager::Block* CachingMemoryManager::allocFromThreadCache(
+    DeviceMemoryInfo& memoryInfo,
+    size_t size) {
+  const auto& depot = memoryInfo.threadCaches_;
+  if (size > kSmallSize || !depot->enabled.load(std::memory_order_acquire)) {
+    return nullptr;
+  }
+  auto& cache = threadBlockCache(depot);
+  void* stream = this->deviceInterface->hasStreams()
+      ? this->deviceInterface->getActiveStream(memoryInfo.deviceId_)
+      : nullptr;
+  std::pair<void*, size_t> key{stream, size};
+  {
+    std::lock_guard<std::mutex> cacheLock(cache.mutex);
+    auto& bin = cache.bins[key];
+    if (!bin.empty()) {
+      Block* block = bin.back();
+      bin.pop_back();
+      cache.bytes -= size;
+      return block;
+    }
+  }
+  // Refilled with several blocks at once, without the lock of the cache
+  // which a cleanup to make room may take
+  std::lock_guard<std::recursive_mutex> lock(memoryInfo.mutexAll_);
+  if (!depot->enabled.load(std::memory_order_relaxed)) {
+    return nullptr;
+  }
+  cacheReturnedBlocks();
+  if (!memoryInfo.pendingEvents_.empty()) {
+    processPendingEvents(/* wait = */ false);
+  }
+  size_t count = std::max<size_t>(
+      1, std::min(threadCacheRefillBlocks(size), depot->maxBytes / size));
+  std::vector<Block*> blocks;
+  for (size_t i = 0; i < count; ++i) {
+    // Only the first block may need a new small buffer
+    Block* block = takeBlock(size, stream, /* allowMalloc = */ i == 0);
+    if (!block) {
+      break;
+    }
+    if (!depot->insert(block)) {
+      cacheBlock(block);
+      break;
+    }
+    // Not merged until the thread caches give it back
+    block->threadCached_ = true;
+    blocks.push_back(block);
+  }
+  if (blocks.empty()) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> cacheLock(cache.mutex);
+  auto& bin = cache.bins[key];
+  // Handed out in the order of the addresses
+  bin.assign(blocks.rbegin(), blocks.rend() - 1);
+  cache.bytes += bin.size() * size;
+  return blocks.front();
+}
+
+bool CachingMemoryManager::freeToThreadCache(
+    DeviceMemoryInfo& memoryInfo,
+    Block* block) {
+  const auto& depot = memoryInfo.threadCaches_;
+  // Blocks used by other streams wait for their work in the device caches
+  if (!block->streamUses_.empty() ||
+      !depot->enabled.load(std::memory_order_acquire)) {
+    return false;
+  }
+  auto& cache = threadBlockCache(depot);
+  std::lock_guard<std::mutex> cacheLock(cache.mutex);
+  recordEvent(
+      MemoryEventType::Free, memoryInfo.deviceId_, block->ptr_, block->size_);
+  auto& bin = cache.bins[{block->stream_, block->size_}];
+  bin.push_back(block);
+  cache.bytes += block->size_;
+  // Given back in batches, e.g. when the blocks of a thread are freed by
+  // another
+  size_t refill = threadCacheRefillBlocks(block->size_);
+  if (cache.bytes > depot->maxBytes) {
+    cache.flushAll();
+  } else if (bin.size() > 2 * refill) {
+    cache.flush(bin, refill);
+  }
+  return true;
+}
+
+void CachingMemoryManager::cacheReturnedBlocks() {
+  auto& memoryInfo = getDeviceMemoryInfo();
+  // Blocks freed before the private pool is active don't join it
+  if (memoryInfo.activePrivatePool_) {
+    return;
+  }
+  for (Block* block : memoryInfo.threadCaches_->takeReturned()) {
+    block->threadCached_ = false;
+    cacheBlock(block);
+  }
+}
+
+void CachingMemoryManager::updateThreadCaches(DeviceMemoryInfo& memoryInfo) {
+  memoryInfo.threadCaches_->enabled.store(
+      threadCacheBytes_ > 0 && !profiling_ && !memoryInfo.activePrivatePool_,
+      std::memory_order_release);
 }
 
 size_t CachingMemoryManager::allocated(void* ptr) {
@@ -225,6 +627,9 @@ size_t CachingMemoryManager::allocated(void* ptr) {
     return 0;
   }
   auto& memoryInfo = getDeviceMemoryInfo();
+  if (auto* cached = memoryInfo.threadCaches_->find(ptr)) {
+    return cached->size_;
+  }
   std::lock_guard<std::recursive_mutex> lock(memoryInfo.mutexAll_);
   auto it = memoryInfo.allocatedBlocks_.find(ptr);
   if (it == memoryInfo.allocatedBlocks_.end()) {
@@ -238,6 +643,21 @@ void CachingMemoryManager::unlock(void* ptr, bool userUnlock) {
     return;
   }
   auto& memoryInfo = getDeviceMemoryInfo();
+  if (auto* cached = memoryInfo.threadCaches_->find(ptr)) {
+    if (userUnlock) {
+      cached->userLock_ = false;
+    } else {
+      cached->managerLock_ = false;
+    }
+    if (cached->inUse() || freeToThreadCache(memoryInfo, cached)) {
+      return;
+    }
+    memoryInfo.threadCaches_->erase(ptr);
+    std::lock_guard<std::recursive_mutex> lock(memoryInfo.mutexAll_);
+    cached->threadCached_ = false;
+    freeBlock(cached);
+    return;
+  }
   std::lock_guard<std::recursive_mutex> lock(memoryInfo.mutexAll_);
   auto it = memoryInfo.allocatedBlocks_.find(ptr);
   if (it == memoryInfo.allocatedBlocks_.end()) {
@@ -259,6 +679,13 @@ void CachingMemoryManager::unlock(void* ptr, bool userUnlock) {
     return;
   }
   memoryInfo.allocatedBlocks_.erase(it);
+  if (profiling_) {
+    auto live = memoryInfo.liveBlocks_.find(block->size_);
+    if (live != memoryInfo.liveBlocks_.end() && live->second > 0) {
+      --live->second;
+      memoryInfo.liveBytes_ -= block->size_;
+    }
+  }
   freeBlock(block);
 }
 
@@ -268,23 +695,448 @@ void CachingMemoryManager::freeBlock(CachingMemoryManager::Block* block) {
   }
   auto& memoryInfo = getDeviceMemoryInfo();
   std::lock_guard<std::recursive_mutex> lock(memoryInfo.mutexAll_);
+  recordEvent(
+      MemoryEventType::Free, memoryInfo.deviceId_, block->ptr_, block->size_);
+
+  if (!block->streamUses_.empty() && this->deviceInterface->hasStreams()) {
+    // Cached once the work enqueued on the other streams has completed
+    for (void* stream : block->streamUses_) {
+      void* event = getEvent();
+      this->deviceInterface->recordEvent(event, stream);
+      memoryInfo.pendingEvents_.emplace_back(event, block);
+      ++block->pendingEvents_;
+    }
+    block->streamUses_.clear();
+    return;
+  }
+  block->streamUses_.clear();
+  cacheBlock(block);
+}
 
+void CachingMemoryManager::cacheBlock(CachingMemoryManager::Block* block) {
+  auto& memoryInfo = getDeviceMemoryInfo();
   const bool isSmallAlloc = (block->size_ <= kSmallSize);
+  if (!block->privatePool_ && memoryInfo.activePrivatePool_) {
+    // The recorded work may use the block, which must not be reused outside
+    // of the pool
+    block->privatePool_ = memoryInfo.activePrivatePool_;
+  }
+  if (block->privatePool_) {
+    // Only reused by the work of the pool, on the same stream
+    auto& privatePool = memoryInfo.privatePools_.at(block->privatePool_);
+    auto& pool =
+        isSmallAlloc ? privatePool.smallBlocks_ : privatePool.largeBlocks_;
+    tryMergeBlocks(block, block->prev_, pool);
+    tryMergeBlocks(block, block->next_, pool);
+    pool.insert(block);
+    memoryInfo.stats_.cachedBytes_ += block->size_;
+    return;
+  }
   CachingMemoryManager::BlockSet& pool =
       isSmallAlloc ? memoryInfo.smallBlocks_ : memoryInfo.largeBlocks_;
   tryMergeBlocks(block, block->prev_, pool);
   tryMergeBlocks(block, block->next_, pool);
 
+  if (this->deviceInterface->hasStreams()) {
+    // Work enqueued so far on the stream may still use the block, other
+    // streams reuse it once this event has completed
+    if (!block->event_) {
+      block->event_ = getEvent();
+    }
+    this->deviceInterface->recordEvent(block->event_, block->stream_);
+  }
   pool.insert(block);
+  memoryInfo.streams_.insert(block->stream_);
   memoryInfo.stats_.cachedBytes_ += block->size_;
 }
 
+void CachingMemoryManager::processPendingEvents(bool wait) {
+  auto& memoryInfo = getDeviceMemoryInfo();
+  auto& pending = memoryInfo.pendingEvents_;
+  // Events complete in about the order they are recorded
+  while (!pending.empty()) {
+    void* event = pending.front().first;
+    Block* block = pending.front().second;
+    if (wait) {
+      this->deviceInterface->synchronizeEvent(event);
+    } else if (!this->deviceInterface->queryEvent(event)) {
+      break;
+    }
+    pending.pop_front();
+    memoryInfo.freeEvents_.push_back(event);
+    if (--block->pendingEvents_ == 0) {
+      cacheBlock(block);
+    }
+  }
+}
+
+CachingMemoryManager::Block* CachingMemoryManager::takeCompletedBlock(
+    BlockSet& pool,
+    size_t size,
+    void* stream) {
+  if (!this->deviceInterface->hasStreams()) {
+    return nullptr;
+  }
+  auto& memoryInfo = getDeviceMemoryInfo();
+  const bool isSmallAlloc = (size <= kSmallSize);
+  CachingMemoryManager::Block searchKey(size);
+  for (void* other : memoryInfo.streams_) {
+    if (other == stream) {
+      continue;
+    }
+    searchKey.stream_ = other;
+    auto it = pool.lower_bound(&searchKey);
+    for (int i = 0; i < kMaxEventQueries && it != pool.end() &&
+         (*it)->stream_ == other;
+         ++i, ++it) {
+      Block* block = *it;
+      if (!isSmallAlloc && block->size_ >= recyclingSizeLimit_) {
+        break;
+      }
+      if (block->event_ &&
+          !this->deviceInterface->queryEvent(block->event_)) {
+        continue;
+      }
+      pool.erase(it);
+      memoryInfo.stats_.cachedBytes_ -= block->size_;
+      releaseEvent(block);
+      block->stream_ = stream;
+      return block;
+    }
+  }
+  return nullptr;
+}
+
+void* CachingMemoryManager::getEvent() {
+  auto& freeEvents = getDeviceMemoryInfo().freeEvents_;
+  if (freeEvents.empty()) {
+    return this->deviceInterface->createEvent();
+  }
+  void* event = freeEvents.back();
+  freeEvents.pop_back();
+  return event;
+}
+
+void CachingMemoryManager::releaseEvent(CachingMemoryManager::Block* block) {
+  if (block->event_) {
+    getDeviceMemoryInfo().freeEvents_.push_back(block->event_);
+    block->event_ = nullptr;
+  }
+}
+
+void CachingMemoryManager::recordStream(const void* ptr, void* stream) {
+  if (!ptr || !this->deviceInterface->hasStreams()) {
+    return;
+  }
+  auto& memoryInfo = getDeviceMemoryInfo();
+  std::lock_guard<std::recursive_mutex> lock(memoryInfo.mutexAll_);
+  Block* block = memoryInfo.threadCaches_->find(ptr);
+  if (!block) {
+    auto it = memoryInfo.allocatedBlocks_.find(const_cast<void*>(ptr));
+    if (it == memoryInfo.allocatedBlocks_.end()) {
+      return;
+    }
+    block = it->second;
+  }
+  if (stream != block->stream_ &&
+      std::find(block->streamUses_.begin(), block->streamUses_.end(), stream) ==
+          block->streamUses_.end()) {
+    block->streamUses_.push_back(stream);
+  }
+}
+
+void CachingMemoryManager::AllocationProfile::save(
+    const std::string& filename) const {
+  std::ofstream file(filename);
+  if (!file) {
+    throw std::runtime_error(
+        "CachingMemoryManager::AllocationProfile::save - can't open file " +
+        filename);
+  }
+  file << kProfileHeader << "\n";
+  file << "peak " << peakAllocatedBytes << "\n";
+  for (const auto& sizeCount : peakBlocks) {
+    file << sizeCount.first << " " << sizeCount.second << "\n";
+  }
+  if (!file) {
+    throw std::runtime_error(
+        "CachingMemoryManager::AllocationProfile::save - failed to write " +
+        filename);
+  }
+}
+
+CachingMemoryManager::AllocationProfile
+CachingMemoryManager::AllocationProfile::load(const std::string& filename) {
+  std::ifstream file(filename);
+  if (!file) {
+    throw std::runtime_error(
+        "CachingMemoryManager::AllocationProfile::load - can't open file " +
+        filename);
+  }
+  AllocationProfile profile;
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream fields(line);
+    std::string key;
+    size_t value = 0;
+    if (!(fields >> key >> value)) {
+      throw std::runtime_error(
+          "CachingMemoryManager::AllocationProfile::load - invalid line '" +
+          line + "' in " + filename);
+    }
+    if (key == "peak") {
+      profile.peakAllocatedBytes = value;
+      continue;
+    }
+    size_t size = 0;
+    try {
+      size = std::stoull(key);
+    } catch (const std::exception&) {
+    }
+    if (size == 0 || size % kMinBlockSize != 0) {
+      throw std::runtime_error(
+          "CachingMemoryManager::AllocationProfile::load - invalid block "
+          "size '" +
+          key + "' in " + filename);
+    }
+    profile.peakBlocks[size] = value;
+  }
+  return profile;
+}
+
+void CachingMemoryManager::setProfilingEnabled(bool enabled) {
+  const bool start = enabled && !profiling_;
+  profiling_ = enabled;
+  for (auto& deviceMemInfo : deviceMemInfos_) {
+    auto& memoryInfo = *deviceMemInfo.second;
+    std::lock_guard<std::recursive_mutex> lock(memoryInfo.mutexAll_);
+    if (start) {
+      memoryInfo.liveBlocks_.clear();
+      memoryInfo.liveBytes_ = 0;
+    }
+    // Allocations are only profiled by the device caches
+    updateThreadCaches(memoryInfo);
+  }
+}
+
+CachingMemoryManager::AllocationProfile
+CachingMemoryManager::getAllocationProfile(int device /* = -1 */) {
+  auto& memoryInfo = getDeviceMemoryInfo(device);
+  std::lock_guard<std::recursive_mutex> lock(memoryInfo.mutexAll_);
+  return memoryInfo.profile_;
+}
+
+CachingMemoryManager::MemoryStats CachingMemoryManager::getMemoryStats(
+    int device /* = -1 */) {
+  auto& memoryInfo = getDeviceMemoryInfo(device);
+  std::lock_guard<std::recursive_mutex> lock(memoryInfo.mutexAll_);
+  MemoryStats stats;
+  stats.allocatedBytes = memoryInfo.stats_.allocatedBytes_;
+  stats.cachedBytes = memoryInfo.stats_.cachedBytes_;
+  stats.numNativeMallocs = memoryInfo.stats_.totalNativeMallocs_;
+  stats.numNativeFrees = memoryInfo.stats_.totalNativeFrees_;
+  stats.peakAllocatedBytes = memoryInfo.stats_.peakAllocatedBytes_;
+  if (this->deviceInterface->getMaxMemorySize) {
+    stats.capacityBytes =
+        this->deviceInterface->getMaxMemorySize(memoryInfo.deviceId_);
+  }
+  return stats;
+}
+
+void CachingMemoryManager::resetPeakMemoryStats(int device /* = -1 */) {
+  auto& memoryInfo = getDeviceMemoryInfo(device);
+  std::lock_guard<std::recursive_mutex> lock(memoryInfo.mutexAll_);
+  memoryInfo.stats_.peakAllocatedBytes_ = memoryInfo.stats_.allocatedBytes_;
+}
+
+size_t CachingMemoryManager::warmStart(const AllocationProfile& profile) {
+  auto& memoryInfo = getDeviceMemoryInfo();
+  std::lock_guard<std::recursive_mutex> lock(memoryInfo.mutexAll_);
+  void* stream = this->deviceInterface->hasStreams()
+      ? this->deviceInterface->getActiveStream(memoryInfo.deviceId_)
+      : nullptr;
+
+  // Peaks of different sizes are reached at different times: their sum is
+  // bounded by the peak of allocated bytes, favoring large blocks
+  std::vector<size_t> smallSizes;
+  std::vector<size_t> largeSizes;
+  size_t budget = profile.peakAllocatedBytes;
+  for (auto it = profile.peakBlocks.rbegin(); it != profile.peakBlocks.rend();
+       ++it) {
+    for (size_t i = 0; i < it->second && it->first <= budget; ++i) {
+      budget -= it->first;
+      (it->first <= kSmallSize ? smallSizes : largeSizes).push_back(it->first);
+    }
+  }
+
+  size_t preallocated = 0;
+  auto carve = [&](const std::vector<size_t>& sizes,
+                   size_t maxSegmentSize,
+                   bool fullSegments,
+                   BlockSet& pool) {
+    std::vector<size_t> segment;
+    size_t segmentSize = 0;
+    for (size_t i = 0; i <= sizes.size(); ++i) {
+      if (!segment.empty() &&
+          (i == sizes.size() || segmentSize + sizes[i] > maxSegmentSize)) {
+        size_t allocSize = fullSegments ? maxSegmentSize : segmentSize;
+        if (!carveSegment(segment, allocSize, pool, stream)) {
+          return false;
+        }
+        preallocated += allocSize;
+        segment.clear();
+        segmentSize = 0;
+      }
+      if (i < sizes.size()) {
+        segment.push_back(sizes[i]);
+        segmentSize += sizes[i];
+      }
+    }
+    return true;
+  };
+  if (carve(largeSizes, kWarmStartSegment, false, memoryInfo.largeBlocks_)) {
+    carve(smallSizes, kSmallBuffer, true, memoryInfo.smallBlocks_);
+  }
+  FL_LOG(fl::INFO) << "CachingMemoryManager warm start preallocated "
+                   << formatMemory(preallocated) << " on device "
+                   << memoryInfo.deviceId_;
+  return preallocated;
+}
+
+size_t CachingMemoryManager::createPrivatePool() {
+  return ++lastPrivatePool_;
+}
+
+void CachingMemoryManager::beginPrivatePool(size_t id) {
+  auto& memoryInfo = getDeviceMemoryInfo();
+  std::lock_guard<std::recursive_mutex> lock(memoryInfo.mutexAll_);
+  if (id == 0 || id > lastPrivatePool_) {
+    throw std::invalid_argument(
+        "CachingMemoryManager::beginPrivatePool - invalid private pool " +
+        std::to_string(id));
+  }
+  if (memoryInfo.activePrivatePool_) {
+    throw std::logic_error(
+        "CachingMemoryManager::beginPrivatePool - private pool " +
+        std::to_string(memoryInfo.activePrivatePool_) +
+        " is already active on device " +
+        std::to_string(memoryInfo.deviceId_));
+  }
+  memoryInfo.privatePools_[id];
+  memoryInfo.activePrivatePool_ = id;
+  // The blocks freed while the pool is active join it
+  updateThreadCaches(memoryInfo);
+}
+
+void CachingMemoryManager::endPrivatePool() {
+  auto& memoryInfo = getDeviceMemoryInfo();
+  std::lock_guard<std::recursive_mutex> lock(memoryInfo.mutexAll_);
+  memoryInfo.activePrivatePool_ = 0;
+  updateThreadCaches(memoryInfo);
+}
+
+void CachingMemoryManager::releasePrivatePool(size_t id) {
+  auto& memoryInfo = getDeviceMemoryInfo();
+  std::lock_guard<std::recursive_mutex> lock(memoryInfo.mutexAll_);
+  if (memoryInfo.activePrivatePool_ == id) {
+    memoryInfo.activePrivatePool_ = 0;
+    updateThreadCaches(memoryInfo);
+  }
+  auto poolIt = memoryInfo.privatePools_.find(id);
+  if (poolIt == memoryInfo.privatePools_.end()) {
+    return;
+  }
+  // Blocks still allocated go back to the caches of the device when freed
+  for (auto& allocated : memoryInfo.allocatedBlocks_) {
+    if (allocated.second->privatePool_ == id) {
+      allocated.second->privatePool_ = 0;
+    }
+  }
+  for (auto* blocks : {&poolIt->second.largeBlocks_,
+                       &poolIt->second.smallBlocks_}) {
+    for (Block* block : *blocks) {
+      block->privatePool_ = 0;
+      // Other streams reuse the block once the work enqueued so far,
+      // including replays, has completed
+      if (this->deviceInterface->hasStreams()) {
+        if (!block->event_) {
+          block->event_ = getEvent();
+        }
+        this->deviceInterface->recordEvent(block->event_, block->stream_);
+      }
+      auto& pool = block->size_ <= kSmallSize ? memoryInfo.smallBlocks_
+                                              : memoryInfo.largeBlocks_;
+      pool.insert(block);
+      memoryInfo.streams_.insert(block->stream_);
+    }
+  }
+  memoryInfo.privatePools_.erase(poolIt);
+}
+
+bool CachingMemoryManager::carveSegment(
+    const std::vector<size_t>& sizes,
+    size_t segmentSize,
+    BlockSet& pool,
+    void* stream) {
+  auto& memoryInfo = getDeviceMemoryInfo();
+  void* ptr = nullptr;
+  try {
+    ++memoryInfo.stats_.totalNativeMallocs_;
+    ptr = this->deviceInterface->nativeAlloc(segmentSize);
+  } catch (std::exception& ex) {
+    FL_LOG(fl::WARNING) << "CachingMemoryManager warm start stopped, failed "
+                        << "to allocate " << formatMemory(segmentSize)
+                        << " with error '" << ex.what() << "'";
+    return false;
+  }
+  memoryInfo.stats_.allocatedBytes_ += segmentSize;
+  memoryInfo.stats_.peakAllocatedBytes_ = std::max(
+      memoryInfo.stats_.peakAllocatedBytes_, memoryInfo.stats_.allocatedBytes_);
+  recordEvent(
+      MemoryEventType::NativeAlloc, memoryInfo.deviceId_, ptr, segmentSize);
+
+  size_t offset = 0;
+  Block* prev = nullptr;
+  auto addBlock = [&](size_t size) {
+    Block* block = new Block(size, static_cast<char*>(ptr) + offset, stream);
+    block->prev_ = prev;
+    if (prev) {
+      prev->next_ = block;
+      recordEvent(
+          MemoryEventType::Split, memoryInfo.deviceId_, block->ptr_, size);
+    }
+    pool.insert(block);
+    memoryInfo.stats_.cachedBytes_ += size;
+    offset += size;
+    prev = block;
+  };
+  for (size_t size : sizes) {
+    addBlock(size);
+  }
+  if (offset < segmentSize) {
+    addBlock(segmentSize - offset);
+  }
+  memoryInfo.streams_.insert(stream);
+  return true;
+}
+
 /** combine previously split blocks */
 void CachingMemoryManager::tryMergeBlocks(
     CachingMemoryManager::Block* dst,
     CachingMemoryManager::Block* src,
     BlockSet& pool) {
-  if (!src || src->inUse()) {
+  // Blocks waiting for other streams or handed out by the thread caches are
+  // not cached yet, and blocks of another stream are merged once its work has
+  // completed
+  if (!src || src->threadCached_ || src->inUse() || src->pendingEvents_ > 0 ||
+      src->privatePool_ != dst->privatePool_) {
+    return;
+  }
+  if (src->stream_ != dst->stream_ && src->event_ &&
+      !this->deviceInterface->queryEvent(src->event_)) {
     return;
   }
   if (dst->prev_ == src) {
@@ -301,7 +1153,12 @@ void CachingMemoryManager::tryMergeBlocks(
   }
   dst->size_ += src->size_;
   pool.erase(src);
-  getDeviceMemoryInfo().stats_.cachedBytes_ -= src->size_;
+  auto& memoryInfo = getDeviceMemoryInfo();
+  memoryInfo.stats_.cachedBytes_ -= src->size_;
+  recordEvent(
+      MemoryEventType::Merge, memoryInfo.deviceId_, dst->ptr_, dst->size_);
+  // The event recorded for dst covers the work of src
+  releaseEvent(src);
   delete src;
 }
 
@@ -314,6 +1171,7 @@ void CachingMemoryManager::mallocWithRetry(size_t size, void** ptr) {
     *ptr = this->deviceInterface->nativeAlloc(size);
   } catch (std::exception& exUnused) {
     try {
+      // Also caches then frees the blocks waiting for other streams
       signalMemoryCleanup();
       ++memInfo.stats_.totalNativeMallocs_;
       *ptr = this->deviceInterface->nativeAlloc(size);
@@ -345,11 +1203,17 @@ void CachingMemoryManager::freeBlocks(
     if (!block->isSplit()) {
       this->deviceInterface->nativeFree(static_cast<void*>(block->ptr_));
       ++memoryInfo.stats_.totalNativeFrees_;
+      recordEvent(
+          MemoryEventType::NativeFree,
+          memoryInfo.deviceId_,
+          block->ptr_,
+          block->size_);
       memoryInfo.stats_.allocatedBytes_ -= block->size_;
       memoryInfo.stats_.cachedBytes_ -= block->size_;
       auto cur = it;
       ++it;
       blocks.erase(cur);
+      releaseEvent(block);
       delete block;
     } else {
       ++it;
@@ -362,6 +1226,15 @@ void CachingMemoryManager::signalMemoryCleanup() {
   auto& memoryInfo = getDeviceMemoryInfo();
   std::lock_guard<std::recursive_mutex> lock(memoryInfo.mutexAll_);
 
+  // Including the caches of the idle threads
+  drainThreadBlockCaches(*memoryInfo.threadCaches_);
+  cacheReturnedBlocks();
+
+  // Waits for the blocks used by other streams, instead of a global sync
+  processPendingEvents(/* wait = */ true);
+  // Also merges the blocks carved by a warm start
+  mergeSplitBlocks(memoryInfo.largeBlocks_);
+  mergeSplitBlocks(memoryInfo.smallBlocks_);
   freeBlocks(
       memoryInfo.largeBlocks_,
       memoryInfo.largeBlocks_.begin(),
@@ -373,6 +1246,47 @@ void CachingMemoryManager::signalMemoryCleanup() {
       memoryInfo.smallBlocks_.end());
 }
 
+void CachingMemoryManager::mergeSplitBlocks(BlockSet& pool) {
+  // Cached parts of a split block may belong to different streams (or be
+  // carved by a warm start): once their work has completed, they merge back
+  // into blocks that can be freed
+  auto& memoryInfo = getDeviceMemoryInfo();
+  std::set<Block*> split;
+  for (Block* block : pool) {
+    if (block->isSplit()) {
+      split.insert(block);
+      if (block->event_) {
+        this->deviceInterface->synchronizeEvent(block->event_);
+      }
+    }
+  }
+  while (!split.empty()) {
+    Block* block = *split.begin();
+    split.erase(split.begin());
+    pool.erase(block);
+    memoryInfo.stats_.cachedBytes_ -= block->size_;
+    // Merges the neighbors of the block as long as they are cached
+    bool merged = true;
+    while (merged) {
+      Block* prev = block->prev_;
+      Block* next = block->next_;
+      tryMergeBlocks(block, prev, pool);
+      tryMergeBlocks(block, next, pool);
+      merged = false;
+      if (block->prev_ != prev) {
+        split.erase(prev);
+        merged = true;
+      }
+      if (block->next_ != next) {
+        split.erase(next);
+        merged = true;
+      }
+    }
+    pool.insert(block);
+    memoryInfo.stats_.cachedBytes_ += block->size_;
+  }
+}
+
 float CachingMemoryManager::getMemoryPressure() {
   return 0.0; // TODO: check if this is optimal
 }
@@ -402,12 +1316,20 @@ void CachingMemoryManager::userLock(const void* ptr) {
     return;
   }
   auto& memoryInfo = getDeviceMemoryInfo();
+  if (auto* cached = memoryInfo.threadCaches_->find(ptr)) {
+    cached->userLock_ = true;
+    return;
+  }
   std::lock_guard<std::recursive_mutex> lock(memoryInfo.mutexAll_);
 
   auto it = memoryInfo.allocatedBlocks_.find(const_cast<void*>(ptr));
   if (it == memoryInfo.allocatedBlocks_.end()) {
     // Follows the behavior of DefaultMemoryManager
     auto block = new Block(kSmallBuffer, const_cast<void*>(ptr));
+    if (this->deviceInterface->hasStreams()) {
+      block->stream_ =
+          this->deviceInterface->getActiveStream(memoryInfo.deviceId_);
+    }
     block->managerLock_ = false;
     block->userLock_ = true;
     memoryInfo.allocatedBlocks_[block->ptr_] = block;
@@ -425,6 +1347,9 @@ bool CachingMemoryManager::isUserLocked(const void* ptr) {
     return false;
   }
   auto& memoryInfo = getDeviceMemoryInfo();
+  if (auto* cached = memoryInfo.threadCaches_->find(ptr)) {
+    return cached->userLock_;
+  }
   std::lock_guard<std::recursive_mutex> lock(memoryInfo.mutexAll_);
   auto it = memoryInfo.allocatedBlocks_.find(const_cast<void*>(ptr));
   if (it == memoryInfo.allocatedBlocks_.end()) {
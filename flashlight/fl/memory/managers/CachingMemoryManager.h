@@ -8,11 +8,14 @@
 #pragma once
 
 #include <atomic>
+#include <deque>
 #include <limits>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <numeric>
 #include <set>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
@@ -26,6 +29,26 @@ namespace fl {
  * Sources :
  * https://github.com/torch/cutorch/blob/master/lib/THC/THCCachingAllocator.h
  * https://github.com/pytorch/pytorch/blob/master/c10/cuda/CUDACachingAllocator.cpp
+ *
+ * On backends with streams (see `MemoryManagerDeviceInterface`), cached blocks
+ * are pooled per stream. A block is allocated on the active ArrayFire stream
+ * of its device and goes back to the pool of that stream when freed, where
+ * work on the same stream can reuse it right away. An event is recorded on the
+ * stream at the time of the free; an allocation on another stream only reuses
+ * the block once this event has completed. Work enqueued on other streams
+ * (copies, collectives) by a block must be declared with `recordStream()`: the
+ * block is cached only once this work has completed.
+ *
+ * Blocks of 1 MB or less are also cached per thread: each thread allocates
+ * and frees them without taking the lock of the device, as long as its cache
+ * has blocks of the size and stream. A thread cache is refilled with several
+ * blocks from the device caches at once, and flushed back in batches when it
+ * holds more than FL_MEM_THREAD_CACHE_MB (4 by default, 0 disables the
+ * thread caches). A block freed by another thread than the one which
+ * allocated it joins the cache of the thread freeing it. The thread caches
+ * are bypassed while profiling or while a private pool is active; the memory
+ * they hold is given back to the device caches by `signalMemoryCleanup()`,
+ * for all the threads including the idle ones.
  */
 class CachingMemoryManager : public MemoryManagerAdapter {
  public:
@@ -55,6 +78,103 @@ class CachingMemoryManager : public MemoryManagerAdapter {
   void setRecyclingSizeLimit(size_t);
   void setSplitSizeLimit(size_t);
 
+  /**
+   * Declares that the allocation at `ptr` is used by work enqueued on
+   * `stream`, another stream than the one it has been allocated on. Its
+   * memory is not reused until the work enqueued on `stream` before it is
+   * freed has completed. Does nothing on backends without streams or for
+   * memory not allocated by this manager.
+   */
+  void recordStream(const void* ptr, void* stream);
+
+  /**
+   * High-water marks of the allocations of a device, recorded while
+   * profiling is enabled (see `setProfilingEnabled()`) and used to warm start
+   * the cache of later runs with `warmStart()`.
+   */
+  struct AllocationProfile {
+    // peak of the bytes in allocated blocks
+    size_t peakAllocatedBytes{0};
+    // peak number of blocks allocated at once, per block size
+    std::map<size_t, size_t> peakBlocks;
+
+    // Writes the profile to a small text file read by `load()`
+    void save(const std::string& filename) const;
+    static AllocationProfile load(const std::string& filename);
+  };
+
+  /**
+   * Records the allocation profile of the devices from now on. Blocks
+   * allocated before profiling is enabled are not counted. Warning: not
+   * thread safe.
+   */
+  void setProfilingEnabled(bool enabled);
+  AllocationProfile getAllocationProfile(int device = -1);
+
+  /**
+   * Usage of the memory of a device, as printed by `printInfo()`.
+   */
+  struct MemoryStats {
+    // native memory held by the manager, used or cached
+    size_t allocatedBytes{0};
+    // native memory held by the manager and not used by the program
+    size_t cachedBytes{0};
+    size_t numNativeMallocs{0};
+    size_t numNativeFrees{0};
+    // peak of `allocatedBytes` since the last `resetPeakMemoryStats()`
+    size_t peakAllocatedBytes{0};
+    // memory of the device, 0 if unknown
+    size_t capacityBytes{0};
+  };
+
+  /**
+   * Returns the memory usage of `device`, the active device by default.
+   * Thread safe.
+   */
+  MemoryStats getMemoryStats(int device = -1);
+
+  /**
+   * Restarts the peak of allocated bytes of `device` from the bytes allocated
+   * now, e.g. to measure the memory needed by a training step after
+   * `signalMemoryCleanup()`. Thread safe.
+   */
+  void resetPeakMemoryStats(int device = -1);
+
+  /**
+   * Preallocates a few segments on the active device and carves them into
+   * cached blocks of the sizes of `profile`, so that the first allocations of
+   * a run reuse them instead of allocating native memory, with the same
+   * layout from run to run. Blocks are carved by decreasing size up to the
+   * peak of allocated bytes of the profile; small blocks are packed into
+   * small buffers as they would be by allocations. Stops at the first failed
+   * native allocation.
+   *
+   * @return the number of bytes preallocated
+   */
+  size_t warmStart(const AllocationProfile& profile);
+
+  /**
+   * Private pools keep memory at stable addresses for work which is recorded
+   * then replayed by the device, like CUDA graphs: while a private pool is
+   * active on a device (between `beginPrivatePool()` and `endPrivatePool()`),
+   * its allocations are served from the pool, or taken from the cached and
+   * native memory of the device, and the blocks freed join the pool. Blocks of
+   * a private pool go back to it when freed, even once it is no longer
+   * active, and are only reused by allocations made while it is active. They
+   * are neither freed by `signalMemoryCleanup()` nor reused by other streams,
+   * until the pool is released with `releasePrivatePool()`.
+   *
+   * @return the id of a new private pool
+   */
+  size_t createPrivatePool();
+  // Activates the private pool `id` on the active device
+  void beginPrivatePool(size_t id);
+  // Deactivates the private pool of the active device
+  void endPrivatePool();
+  // Returns the blocks of the private pool `id` to the caches of the active
+  // device, once the work using them has been enqueued
+  void releasePrivatePool(size_t id);
+
   // Block denotes a single allocated unit of memory.
   struct Block {
     size_t size_; // size of block in bytes
@@ -63,6 +183,14 @@ class CachingMemoryManager : public MemoryManagerAdapter {
     bool userLock_; // whether the memory is locked by the user
     Block* prev_; // prev block if split from a larger allocation
     Block* next_; // next block if split from a larger allocation
+    void* stream_; // stream the block is allocated on and cached for
+    void* event_; // recorded on stream_ when the block was last freed
+    std::vector<void*> streamUses_; // other streams using the block
+    int pendingEvents_; // events to complete before caching the block
+    size_t privatePool_; // private pool of the block, 0 if none
+    // whether the block is handed out by the thread caches, whose threads
+    // lock and unlock it without the lock of the device
+    bool threadCached_;
 
     bool isSplit() const {
       return (prev_ != nullptr) || (next_ != nullptr);
@@ -72,15 +200,27 @@ class CachingMemoryManager : public MemoryManagerAdapter {
       return managerLock_ || userLock_;
     }
 
-    explicit Block(size_t size, void* ptr = nullptr)
+    explicit Block(
+        size_t size,
+        void* ptr = nullptr,
+        void* stream = nullptr)
         : size_(size),
           ptr_(ptr),
           managerLock_(false),
           userLock_(false),
           prev_(nullptr),
-          next_(nullptr) {}
+          next_(nullptr),
+          stream_(stream),
+          event_(nullptr),
+          pendingEvents_(0),
+          privatePool_(0),
+          threadCached_(false) {}
   };
 
+  // The thread caches of a device: blocks cached by the threads, and blocks
+  // they give back to the device caches
+  struct ThreadCacheDepot;
+
   typedef bool (*Comparison)(const Block*, const Block*);
   typedef std::set<Block*, Comparison> BlockSet;
 
@@ -90,12 +230,22 @@ class CachingMemoryManager : public MemoryManagerAdapter {
     size_t totalNativeFrees_;
     size_t allocatedBytes_; // memory allocated by mem manager for the program
     size_t cachedBytes_; // memory held by mem manager & not used by the program
+    size_t peakAllocatedBytes_; // peak of allocatedBytes_ since last reset
 
     MemoryAllocationStats()
         : totalNativeMallocs_(0),
           totalNativeFrees_(0),
           allocatedBytes_(0),
-          cachedBytes_(0) {}
+          cachedBytes_(0),
+          peakAllocatedBytes_(0) {}
+  };
+
+  // Cached blocks of a private pool
+  struct PrivatePool {
+    BlockSet largeBlocks_;
+    BlockSet smallBlocks_;
+
+    PrivatePool();
   };
 
   // Stores the mutex and misc variables per device so that we operate in a
@@ -115,9 +265,30 @@ class CachingMemoryManager : public MemoryManagerAdapter {
     // allocated blocks by device pointer
     std::unordered_map<void*, Block*> allocatedBlocks_;
 
+    // freed blocks waiting on the work of other streams, with their events
+    std::deque<std::pair<void*, Block*>> pendingEvents_;
+
+    // created events which are not recorded for any block
+    std::vector<void*> freeEvents_;
+
+    // streams with cached blocks
+    std::set<void*> streams_;
+
     MemoryAllocationStats stats_;
 
-    explicit DeviceMemoryInfo(int id);
+    // allocated blocks per block size and their bytes, while profiling
+    std::unordered_map<size_t, size_t> liveBlocks_;
+    size_t liveBytes_{0};
+    AllocationProfile profile_;
+
+    // private pools by id, and active one (0 if none)
+    std::unordered_map<size_t, PrivatePool> privatePools_;
+    size_t activePrivatePool_{0};
+
+    // shared with the threads, whose caches outlive the device
+    std::shared_ptr<ThreadCacheDepot> threadCaches_;
+
+    DeviceMemoryInfo(int id, size_t threadCacheBytes);
   };
 
  protected:
@@ -139,6 +310,37 @@ class CachingMemoryManager : public MemoryManagerAdapter {
 
   void tryMergeBlocks(Block* dst, Block* src, BlockSet& freeBlocks);
   void freeBlock(Block* block);
+  void cacheBlock(Block* block);
+
+  // Caches the pending blocks whose events have completed, or all of them
+  // once their events complete if `wait`
+  void processPendingEvents(bool wait);
+  // Removes from `pool` a block of at least `size` bytes cached for another
+  // stream than `stream` and no longer used by it, nullptr if none
+  Block* takeCompletedBlock(BlockSet& pool, size_t size, void* stream);
+  // Merges the split blocks of `pool` cached for different streams, once
+  // their work has completed
+  void mergeSplitBlocks(BlockSet& pool);
+  // Takes a cached block of at least `size` bytes for `stream`, split to
+  // `size` if larger, or allocates one if `allowMalloc`
+  Block* takeBlock(size_t size, void* stream, bool allowMalloc);
+  // Allocates or frees a small block through the cache of the calling thread
+  // without locking the device, nullptr or false if it's bypassed
+  Block* allocFromThreadCache(DeviceMemoryInfo& memoryInfo, size_t size);
+  bool freeToThreadCache(DeviceMemoryInfo& memoryInfo, Block* block);
+  // Caches the blocks given back by the thread caches
+  void cacheReturnedBlocks();
+  // Enables the thread caches unless profiling or in a private pool
+  void updateThreadCaches(DeviceMemoryInfo& memoryInfo);
+  void* getEvent();
+  void releaseEvent(Block* block);
+  // Allocates a segment of `segmentSize` bytes and caches it in `pool` as
+  // blocks of `sizes` followed by the rest of the segment, false on failure
+  bool carveSegment(
+      const std::vector<size_t>& sizes,
+      size_t segmentSize,
+      BlockSet& pool,
+      void* stream);
 
  private:
   // Non-const runtime options in order to fine tune the behavior of this
@@ -148,6 +350,12 @@ class CachingMemoryManager : public MemoryManagerAdapter {
   //size_t recyclingSizeLimit;
   // Prevents to split big buffers, to be set by the user if desired:
   size_t splitSizeLimit_{std::numeric_limits<size_t>::max()};
+  // Whether allocations are recorded in the profiles of the devices
+  bool profiling_{false};
+  // Bytes of free blocks each thread caches per device, 0 if disabled
+  size_t threadCacheBytes_;
+  // Last id given to a private pool
+  std::atomic<size_t> lastPrivatePool_{0};
 };
 
 } // namespace fl
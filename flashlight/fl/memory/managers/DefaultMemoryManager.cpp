@@ -39,6 +39,7 @@ void DefaultMemoryManager::cleanDeviceMemoryManager(int device) {
   // the memory manager. We are using this to avoid calling free while
   // the lock is being held because the CPU backend calls sync.
   std::vector<void*> freePtrs;
+  std::vector<size_t> freeSizes;
   size_t bytesFreed = 0;
   MemoryInfo& current = memory[device];
   {
@@ -53,6 +54,7 @@ void DefaultMemoryManager::cleanDeviceMemoryManager(int device) {
       // Free memory by pushing the last element into the freePtrs
       // vector which will be freed once outside of the lock
       std::move(begin(kv.second), end(kv.second), std::back_inserter(freePtrs));
+      freeSizes.resize(freePtrs.size(), kv.first);
       current.totalBytes -= numPtrs * kv.first;
       bytesFreed += numPtrs * kv.first;
       current.totalBuffers -= numPtrs;
@@ -66,8 +68,10 @@ void DefaultMemoryManager::cleanDeviceMemoryManager(int device) {
   this->log(ss.str());
 
   // Free memory outside of the lock
-  for (auto ptr : freePtrs) {
-    this->deviceInterface->nativeFree(ptr);
+  for (size_t i = 0; i < freePtrs.size(); ++i) {
+    this->deviceInterface->nativeFree(freePtrs[i]);
+    recordEvent(
+        MemoryEventType::NativeFree, device, freePtrs[i], freeSizes[i]);
   }
 }
 
@@ -79,6 +83,8 @@ DefaultMemoryManager::DefaultMemoryManager(
     : MemoryManagerAdapter(deviceInterface),
       memStepSize(1024),
       maxBuffers(maxBuffers),
+      sizeClassDivisions(SIZE_CLASS_DIVISIONS),
+      maxFreeBuffersPerSize(MAX_FREE_BUFFERS_PER_SIZE),
       debugMode(debug),
       memory(numDevices) {
   // Check for environment variables
@@ -94,6 +100,12 @@ DefaultMemoryManager::DefaultMemoryManager(
   if (const char* c = std::getenv("AF_MAX_BUFFERS")) {
     this->maxBuffers = std::max(1, std::stoi(std::string(c)));
   }
+  if (const char* c = std::getenv("FL_MEM_SIZE_CLASS_DIVISIONS")) {
+    this->sizeClassDivisions = std::max(0, std::stoi(std::string(c)));
+  }
+  if (const char* c = std::getenv("FL_MEM_MAX_FREE_BUFFERS_PER_SIZE")) {
+    this->maxFreeBuffersPerSize = std::max(0, std::stoi(std::string(c)));
+  }
 }
 
 void DefaultMemoryManager::initialize() {
@@ -149,8 +161,9 @@ void* DefaultMemoryManager::alloc(
   }
 
   void* ptr = nullptr;
-  size_t allocBytes =
-      this->debugMode ? bytes : (divup(bytes, memStepSize) * memStepSize);
+  size_t allocBytes = this->debugMode
+      ? bytes
+      : sizeClass(bytes, memStepSize, sizeClassDivisions);
 
   if (bytes > 0) {
     MemoryInfo& current = this->getCurrentMemoryInfo();
@@ -193,6 +206,8 @@ void* DefaultMemoryManager::alloc(
         this->signalMemoryCleanup();
         ptr = this->deviceInterface->nativeAlloc(allocBytes);
       }
+      int device = this->deviceInterface->getActiveDeviceId();
+      recordEvent(MemoryEventType::NativeAlloc, device, ptr, allocBytes);
       std::lock_guard<std::mutex> lock(this->memoryMutex);
       // Increment these two only when it succeeds to come here.
       current.totalBytes += allocBytes;
@@ -201,6 +216,11 @@ void* DefaultMemoryManager::alloc(
       current.lockBytes += allocBytes;
       current.lockBuffers++;
     }
+    recordEvent(
+        MemoryEventType::Alloc,
+        this->deviceInterface->getActiveDeviceId(),
+        ptr,
+        allocBytes);
   }
   return ptr;
 }
@@ -251,16 +271,29 @@ void DefaultMemoryManager::unlock(void* ptr, bool userUnlock) {
     size_t bytes = iter->second.bytes;
     current.lockBytes -= iter->second.bytes;
     current.lockBuffers--;
+    int device = this->deviceInterface->getActiveDeviceId();
+    recordEvent(MemoryEventType::Free, device, ptr, bytes);
 
     if (this->debugMode) {
       // Just free memory in debug mode
       if ((iter->second).bytes > 0) {
+        recordEvent(MemoryEventType::NativeFree, device, ptr, bytes);
         freedPtr.reset(iter->first);
         current.totalBuffers--;
         current.totalBytes -= iter->second.bytes;
       }
     } else {
-      current.freeMap.at(bytes).emplace_back(ptr);
+      auto& freePtrs = current.freeMap[bytes];
+      if (maxFreeBuffersPerSize > 0 &&
+          freePtrs.size() >= maxFreeBuffersPerSize) {
+        // The size class has enough free buffers
+        recordEvent(MemoryEventType::NativeFree, device, ptr, bytes);
+        freedPtr.reset(ptr);
+        current.totalBuffers--;
+        current.totalBytes -= bytes;
+      } else {
+        freePtrs.emplace_back(ptr);
+      }
     }
     current.lockedMap.erase(iter);
   }
@@ -395,6 +428,43 @@ unsigned DefaultMemoryManager::getMaxBuffers() {
   return this->maxBuffers;
 }
 
+size_t DefaultMemoryManager::sizeClass(
+    size_t bytes,
+    size_t stepSize,
+    unsigned divisions) {
+  size_t stepped = divup(bytes, stepSize) * stepSize;
+  if (divisions == 0 || stepped <= stepSize) {
+    return stepped;
+  }
+  // The largest power of 2 not above `stepped`
+  size_t power = 1;
+  while (power <= stepped / 2) {
+    power *= 2;
+  }
+  size_t classStep = std::max<size_t>(power / divisions, stepSize);
+  return divup(stepped, classStep) * classStep;
+}
+
+unsigned DefaultMemoryManager::getSizeClassDivisions() {
+  std::lock_guard<std::mutex> lock(this->memoryMutex);
+  return this->sizeClassDivisions;
+}
+
+void DefaultMemoryManager::setSizeClassDivisions(unsigned divisions) {
+  std::lock_guard<std::mutex> lock(this->memoryMutex);
+  this->sizeClassDivisions = divisions;
+}
+
+unsigned DefaultMemoryManager::getMaxFreeBuffersPerSize() {
+  std::lock_guard<std::mutex> lock(this->memoryMutex);
+  return this->maxFreeBuffersPerSize;
+}
+
+void DefaultMemoryManager::setMaxFreeBuffersPerSize(unsigned maxFreeBuffers) {
+  std::lock_guard<std::mutex> lock(this->memoryMutex);
+  this->maxFreeBuffersPerSize = maxFreeBuffers;
+}
+
 bool DefaultMemoryManager::checkMemoryLimit() {
   const MemoryInfo& current = this->getCurrentMemoryInfo();
   return current.lockBytes >= current.maxBytes ||
@@ -23,12 +23,23 @@ namespace fl {
  * facilitate logging and inspection of internal memory manager state during
  * runs.
  *
+ * Unlike ArrayFire's, buffers are allocated in size classes (see
+ * `sizeClass()`), so that freed buffers are reused by arrays of close sizes,
+ * e.g. of variable-length batches, rather than only by arrays of the exact
+ * same size. Buffers are never split. The free buffers cached per size class
+ * are capped; above, freed buffers are released to the device. The
+ * environment variables `FL_MEM_SIZE_CLASS_DIVISIONS` and
+ * `FL_MEM_MAX_FREE_BUFFERS_PER_SIZE` override the defaults.
+ *
  * Additionally provides a simple starting point for other memory manager
  * implementations.
  */
 class DefaultMemoryManager : public MemoryManagerAdapter {
   constexpr static unsigned MAX_BUFFERS = 1000;
   constexpr static size_t ONE_GB = 1 << 30;
+  // At most 12.5% of a buffer is unused
+  constexpr static unsigned SIZE_CLASS_DIVISIONS = 8;
+  constexpr static unsigned MAX_FREE_BUFFERS_PER_SIZE = 64;
 
   struct LockedInfo {
     bool managerLock;
@@ -71,6 +82,8 @@ class DefaultMemoryManager : public MemoryManagerAdapter {
 
   size_t memStepSize;
   unsigned maxBuffers;
+  unsigned sizeClassDivisions;
+  unsigned maxFreeBuffersPerSize;
 
   bool debugMode;
 
@@ -109,6 +122,22 @@ class DefaultMemoryManager : public MemoryManagerAdapter {
   unsigned getMaxBuffers();
   bool checkMemoryLimit();
 
+  /**
+   * Returns the size of the buffer allocated for `bytes`: `bytes` rounded up
+   * to a multiple of `stepSize`, then to one of the `divisions` sizes evenly
+   * spaced between two powers of 2 (the multiples of `stepSize` only if 0).
+   * Less than `1 / divisions` of the buffer is unused, besides the step.
+   */
+  static size_t sizeClass(size_t bytes, size_t stepSize, unsigned divisions);
+  unsigned getSizeClassDivisions();
+  void setSizeClassDivisions(unsigned divisions);
+  /**
+   * Free buffers cached per size class, above which freed buffers are
+   * released to the device. 0 for no cap.
+   */
+  unsigned getMaxFreeBuffersPerSize();
+  void setMaxFreeBuffersPerSize(unsigned maxFreeBuffers);
+
  protected:
   DefaultMemoryManager(const DefaultMemoryManager& other) = delete;
   DefaultMemoryManager(const DefaultMemoryManager&& other) = delete;
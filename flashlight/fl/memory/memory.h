@@ -10,6 +10,8 @@
 #include "flashlight/fl/memory/MemoryManagerAdapter.h"
 #include "flashlight/fl/memory/MemoryManagerDeviceInterface.h"
 #include "flashlight/fl/memory/MemoryManagerInstaller.h"
+#include "flashlight/fl/memory/MemoryTimeline.h"
+#include "flashlight/fl/memory/MemoryTraceReplay.h"
 
 #include "flashlight/fl/memory/managers/CachingMemoryManager.h"
 #include "flashlight/fl/memory/managers/DefaultMemoryManager.h"
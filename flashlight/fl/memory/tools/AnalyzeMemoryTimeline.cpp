@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Reports the memory usage of a device from a timeline written by
+ * `MemoryTimeline::save()`:
+ *   fl_analyze_memory_timeline memory.fltl [device] [--chrome_trace=out.json]
+ * Prints the peaks, the fragmentation of the reserved memory, the top
+ * allocating scopes and the usage over time. With `--chrome_trace`, the
+ * timeline is also converted to a trace for chrome://tracing or Perfetto.
+ */
+
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "flashlight/fl/memory/MemoryTimeline.h"
+
+int main(int argc, char** argv) {
+  const std::string kTraceFlag = "--chrome_trace=";
+  std::string timelinePath;
+  std::string tracePath;
+  int device = 0;
+  int numPositional = 0;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg.compare(0, kTraceFlag.size(), kTraceFlag) == 0) {
+      tracePath = arg.substr(kTraceFlag.size());
+    } else if (numPositional == 0) {
+      timelinePath = arg;
+      ++numPositional;
+    } else if (numPositional == 1) {
+      device = std::stoi(arg);
+      ++numPositional;
+    } else {
+      numPositional = -1;
+      break;
+    }
+  }
+  if (timelinePath.empty() || numPositional < 0) {
+    std::cerr << "Usage: " << argv[0]
+              << " <timeline file> [device] [--chrome_trace=<output file>]"
+              << std::endl;
+    return 1;
+  }
+
+  try {
+    auto timeline = fl::loadMemoryTimeline(timelinePath);
+    auto report = fl::analyzeMemoryTimeline(timeline, device);
+    std::cout << report.prettyString();
+    std::cout << "Usage over time (s, allocated, reserved, largest free):\n";
+    for (const auto& sample : report.samples) {
+      std::cout << "  " << sample.timeUs / 1e6 << " " << sample.allocatedBytes
+                << " " << sample.reservedBytes << " "
+                << sample.largestFreeBlock << "\n";
+    }
+    if (!tracePath.empty()) {
+      std::ofstream trace(tracePath);
+      if (!trace) {
+        std::cerr << "Unable to open file - " << tracePath << std::endl;
+        return 1;
+      }
+      fl::writeChromeTrace(timeline, trace);
+    }
+  } catch (const std::exception& ex) {
+    std::cerr << ex.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
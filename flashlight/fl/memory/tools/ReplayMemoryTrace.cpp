@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Replays the allocations and frees of a trace against a memory manager, to
+ * tune it for a workload offline:
+ *   fl_replay_memory_trace <trace> [device] [--manager=caching|default]
+ *     [--recycling_size_mb=<MB>] [--split_size_mb=<MB>] [--capacity_mb=<MB>]
+ *     [--json]
+ * The trace is a timeline written by `MemoryTimeline::save()` if its name ends
+ * with ".fltl", else the log of a `MemoryManagerAdapter`. The manager runs on a
+ * simulated device (see `replayMemoryTrace()`) of --capacity_mb of memory, no
+ * limit by default. Prints the allocation latency, the peak reserved memory,
+ * the fragmentation and the native allocations of the manager.
+ */
+
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "flashlight/fl/memory/MemoryTimeline.h"
+#include "flashlight/fl/memory/MemoryTraceReplay.h"
+#include "flashlight/fl/memory/managers/CachingMemoryManager.h"
+#include "flashlight/fl/memory/managers/DefaultMemoryManager.h"
+
+namespace {
+
+bool parseFlag(
+    const std::string& arg,
+    const std::string& flag,
+    std::string& value) {
+  if (arg.compare(0, flag.size(), flag) != 0) {
+    return false;
+  }
+  value = arg.substr(flag.size());
+  return true;
+}
+
+size_t megabytes(const std::string& value) {
+  return static_cast<size_t>(std::stod(value) * (1 << 20));
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  std::string tracePath;
+  std::string managerName = "caching";
+  std::string recyclingSize, splitSize, capacity;
+  bool json = false;
+  int device = 0;
+  int numPositional = 0;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (parseFlag(arg, "--manager=", managerName) ||
+        parseFlag(arg, "--recycling_size_mb=", recyclingSize) ||
+        parseFlag(arg, "--split_size_mb=", splitSize) ||
+        parseFlag(arg, "--capacity_mb=", capacity)) {
+      continue;
+    } else if (arg == "--json") {
+      json = true;
+    } else if (numPositional == 0) {
+      tracePath = arg;
+      ++numPositional;
+    } else if (numPositional == 1) {
+      device = std::stoi(arg);
+      ++numPositional;
+    } else {
+      numPositional = -1;
+      break;
+    }
+  }
+  if (tracePath.empty() || numPositional < 0 ||
+      (managerName != "caching" && managerName != "default")) {
+    std::cerr << "Usage: " << argv[0]
+              << " <timeline or log file> [device] [--manager=caching|default]"
+              << " [--recycling_size_mb=<MB>] [--split_size_mb=<MB>]"
+              << " [--capacity_mb=<MB>] [--json]" << std::endl;
+    return 1;
+  }
+
+  try {
+    std::vector<fl::MemoryTraceEvent> trace;
+    const std::string kTimelineExt = ".fltl";
+    if (tracePath.size() >= kTimelineExt.size() &&
+        tracePath.compare(
+            tracePath.size() - kTimelineExt.size(),
+            kTimelineExt.size(),
+            kTimelineExt) == 0) {
+      trace = fl::memoryTraceFromTimeline(
+          fl::loadMemoryTimeline(tracePath), device);
+    } else {
+      std::ifstream log(tracePath);
+      if (!log) {
+        std::cerr << "Unable to open file - " << tracePath << std::endl;
+        return 1;
+      }
+      trace = fl::parseMemoryManagerLog(log);
+    }
+
+    auto makeManager =
+        [&](std::shared_ptr<fl::MemoryManagerDeviceInterface> deviceInterface)
+        -> std::shared_ptr<fl::MemoryManagerAdapter> {
+      if (managerName == "default") {
+        return std::make_shared<fl::DefaultMemoryManager>(
+            1,
+            1000 /* maxBuffers */,
+            false /* debug */,
+            deviceInterface);
+      }
+      auto manager =
+          std::make_shared<fl::CachingMemoryManager>(1, deviceInterface);
+      if (!recyclingSize.empty()) {
+        manager->setRecyclingSizeLimit(megabytes(recyclingSize));
+      }
+      if (!splitSize.empty()) {
+        manager->setSplitSizeLimit(megabytes(splitSize));
+      }
+      return manager;
+    };
+    auto report = fl::replayMemoryTrace(
+        trace, makeManager, capacity.empty() ? 0 : megabytes(capacity));
+    if (json) {
+      std::cout << report.json() << std::endl;
+    } else {
+      std::cout << "Replayed " << trace.size() << " events with the "
+                << managerName << " memory manager\n"
+                << report.prettyString();
+    }
+  } catch (const std::exception& ex) {
+    std::cerr << ex.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
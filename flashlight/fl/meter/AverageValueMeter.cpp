@@ -8,6 +8,7 @@
 #include "flashlight/fl/meter/AverageValueMeter.h"
 
 #include <array>
+#include <stdexcept>
 
 namespace fl {
 
@@ -20,6 +21,7 @@ void AverageValueMeter::reset() {
   curMeanSquaredSum_ = 0;
   curWeightSum_ = 0;
   curWeightSquaredSum_ = 0;
+  deviceSums_ = af::array();
 }
 
 void AverageValueMeter::add(const double val, const double w /* = 1.0 */) {
@@ -36,23 +38,54 @@ void AverageValueMeter::add(const double val, const double w /* = 1.0 */) {
 }
 
 void AverageValueMeter::add(const af::array& vals) {
-  double w = vals.elements();
-  curWeightSum_ += w;
-  curWeightSquaredSum_ += w;
+  auto type = af::isDoubleAvailable(af::getDevice()) ? f64 : f32;
+  auto flatVals = af::flat(vals).as(type);
+  auto n = af::constant(vals.elements(), 1, type);
+  addDeviceSums(af::join(
+      0, n, n, af::sum(flatVals), af::sum(flatVals * flatVals)));
+}
 
-  if (curWeightSum_ == 0) {
-    return;
+void AverageValueMeter::add(const af::array& vals, const af::array& w) {
+  if (vals.elements() != w.elements()) {
+    throw std::invalid_argument(
+        "AverageValueMeter: values and weights must have the same size");
   }
+  auto type = af::isDoubleAvailable(af::getDevice()) ? f64 : f32;
+  auto flatVals = af::flat(vals).as(type);
+  auto flatW = af::flat(w).as(type);
+  auto weightedVals = flatW * flatVals;
+  addDeviceSums(af::join(
+      0,
+      af::sum(flatW),
+      af::sum(flatW * flatW),
+      af::sum(weightedVals),
+      af::sum(weightedVals * flatVals)));
+}
 
-  curMean_ = curMean_ + (af::sum<double>(vals) - w * curMean_) / curWeightSum_;
-  curMeanSquaredSum_ = curMeanSquaredSum_ +
-      (af::sum<double>(vals * vals) - w * curMeanSquaredSum_) / curWeightSum_;
+void AverageValueMeter::addDeviceSums(af::array sums) {
+  deviceSums_ = deviceSums_.isempty() ? sums : deviceSums_ + sums;
+  // Launches the computation, so that the JIT tree does not grow
+  deviceSums_.eval();
 }
 
 std::vector<double> AverageValueMeter::value() const {
   double mean = curMean_;
-  double var = (curMeanSquaredSum_ - curMean_ * curMean_) /
-      (1 - curWeightSquaredSum_ / (curWeightSum_ * curWeightSum_));
-  return {mean, var, curWeightSum_};
+  double meanSquared = curMeanSquaredSum_;
+  double weightSum = curWeightSum_;
+  double weightSquaredSum = curWeightSquaredSum_;
+  if (!deviceSums_.isempty()) {
+    std::array<double, 4> sums;
+    deviceSums_.as(f64).host(sums.data());
+    if (weightSum + sums[0] != 0) {
+      mean = (mean * weightSum + sums[2]) / (weightSum + sums[0]);
+      meanSquared =
+          (meanSquared * weightSum + sums[3]) / (weightSum + sums[0]);
+    }
+    weightSum += sums[0];
+    weightSquaredSum += sums[1];
+  }
+  double var = (meanSquared - mean * mean) /
+      (1 - weightSquaredSum / (weightSum * weightSum));
+  return {mean, var, weightSum};
 }
 } // namespace fl
@@ -42,9 +42,18 @@ class AverageValueMeter {
   /** Updates counters with the given value `val` with weight `w`. */
   void add(const double val, const double w = 1.0);
 
-  /** Updates counters with all values in `vals` with equal weights. */
+  /** Updates counters with all values in `vals` with equal weights. The
+   * values are accumulated on the device without synchronization, and only
+   * copied to the host by `value()`.
+   */
   void add(const af::array& vals);
 
+  /** Updates counters with all values in `vals` with the weights `w` (of the
+   * same number of elements), both on the device, e.g. a loss weighted by its
+   * number of tokens. As above, no synchronization happens until `value()`.
+   */
+  void add(const af::array& vals, const af::array& w);
+
   /** Returns a vector of four values:
    * - `unbiased mean`: \f$ \tilde{mu} \f$
    * - `unbiased variance`: \f$ \tilde{sigma}^2 = \frac{(\tilde{mu}_2 -
@@ -62,5 +71,11 @@ class AverageValueMeter {
   double curMeanSquaredSum_;
   double curWeightSum_;
   double curWeightSquaredSum_;
+  // Sum(W), Sum(W^2), Sum(W X) and Sum(W X^2) of the values added on the
+  // device (f64, or f32 if the device does not support doubles), empty if
+  // none
+  af::array deviceSums_;
+
+  void addDeviceSums(af::array sums);
 };
 } // namespace fl
@@ -21,12 +21,31 @@ void CountMeter::add(int id, int64_t val) {
   counts_[id] += val;
 }
 
+void CountMeter::add(const af::array& counts) {
+  if (counts.elements() != counts_.size()) {
+    throw std::invalid_argument("CountMeter: invalid number of counts");
+  }
+  auto flatCounts = af::flat(counts).as(s64);
+  deviceCounts_ =
+      deviceCounts_.isempty() ? flatCounts : deviceCounts_ + flatCounts;
+  deviceCounts_.eval();
+}
+
 std::vector<int64_t> CountMeter::value() const {
-  return counts_;
+  auto counts = counts_;
+  if (!deviceCounts_.isempty()) {
+    std::vector<int64_t> deviceCounts(counts.size());
+    deviceCounts_.host(deviceCounts.data());
+    for (size_t i = 0; i < counts.size(); ++i) {
+      counts[i] += deviceCounts[i];
+    }
+  }
+  return counts;
 }
 
 void CountMeter::reset() {
   std::fill(counts_.begin(), counts_.end(), 0);
+  deviceCounts_ = af::array();
 }
 
 } // namespace fl
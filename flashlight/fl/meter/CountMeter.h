@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <arrayfire.h>
 #include <cstdint>
 #include <vector>
 
@@ -36,6 +37,12 @@ class CountMeter {
    * `num` - 1].*/
   void add(int id, int64_t val);
 
+  /** Adds `counts[i]` to category i for all the categories, `counts` holding
+   * `num` values on the device. The counts are accumulated on the device,
+   * and only copied to the host by `value()`.
+   */
+  void add(const af::array& counts);
+
   /** Returns a vector of `num` values, representing the total value of each
    * category.
    */
@@ -46,5 +53,7 @@ class CountMeter {
 
  private:
   std::vector<int64_t> counts_;
+  // Counts (s64) added on the device, empty if none
+  af::array deviceCounts_;
 };
 } // namespace fl
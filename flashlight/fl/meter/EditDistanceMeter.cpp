@@ -20,6 +20,7 @@ void EditDistanceMeter::reset() {
   ndel_ = 0;
   nins_ = 0;
   nsub_ = 0;
+  deviceCounts_ = af::array();
 }
 
 void EditDistanceMeter::add(const af::array& output, const af::array& target) {
@@ -42,6 +43,94 @@ void EditDistanceMeter::add(const af::array& output, const af::array& target) {
   add(err_state, target.dims(0));
 }
 
+void EditDistanceMeter::addBatch(
+    const af::array& output,
+    const af::array& target,
+    const af::array& outputSizes,
+    const af::array& targetSizes) {
+  const int B = outputSizes.elements();
+  const int Lo = output.dims(0);
+  const int Lt = target.dims(0);
+  if (B == 0) {
+    return;
+  }
+  if (Lo == 0 || Lt == 0 || targetSizes.elements() != B ||
+      output.elements() % (Lo * B) != 0 ||
+      target.elements() != output.elements() / Lo * Lt) {
+    throw std::invalid_argument("EditDistanceMeter: invalid batch dims");
+  }
+  const int K = output.elements() / (Lo * B);
+
+  // mismatch(y, x, b): unit y of output differs from unit x of target
+  auto outputUnits = af::moddims(output, af::dim4(Lo, 1, K, B));
+  auto targetUnits = af::moddims(target, af::dim4(1, Lt, K, B));
+  auto mismatch = af::anyTrue(
+      af::tile(outputUnits, 1, Lt) != af::tile(targetUnits, Lo), 2);
+  mismatch = af::flat(mismatch.as(s32));
+
+  // Anti-diagonal wavefront: cell y of diagonal d holds the errors between
+  // the first y units of output and the first x = d - y units of target,
+  // which only depend on the diagonals d - 1 and d - 2. The ties are broken
+  // as in `levensteinDistance()`: deletion, insertion, then substitution.
+  auto outputLen = af::moddims(outputSizes.as(s32), af::dim4(1, B));
+  auto totalLen = outputLen + af::moddims(targetSizes.as(s32), af::dim4(1, B));
+  auto y = af::range(af::dim4(Lo + 1, B), 0, s32);
+  auto batch = af::range(af::dim4(Lo + 1, B), 1, s32);
+  auto finalIds = outputLen + af::range(af::dim4(1, B), 1, s32) * (Lo + 1);
+  auto zeros = af::constant(0, Lo + 1, B, s32);
+  af::array del1 = zeros, ins1 = zeros, sub1 = zeros;
+  af::array del2 = zeros, ins2 = zeros, sub2 = zeros;
+  af::array resDel = af::constant(0, 1, B, s32);
+  af::array resIns = resDel, resSub = resDel;
+  for (int d = 0; d <= Lo + Lt; ++d) {
+    af::array del, ins, sub;
+    if (d == 0) {
+      del = ins = sub = zeros;
+    } else {
+      auto del1s = af::shift(del1, 1), ins1s = af::shift(ins1, 1),
+           sub1s = af::shift(sub1, 1);
+      auto del2s = af::shift(del2, 1), ins2s = af::shift(ins2, 1),
+           sub2s = af::shift(sub2, 1);
+      auto x = d - y;
+      auto mismatchIds = af::max(y - 1, 0) +
+          af::clamp(x - 1, 0, Lt - 1) * Lo + batch * (Lo * Lt);
+      auto subCost = af::moddims(mismatch(af::flat(mismatchIds)), Lo + 1, B);
+      auto costDel = del1 + ins1 + sub1 + 1;
+      auto costIns = del1s + ins1s + sub1s + 1;
+      auto costSub = del2s + ins2s + sub2s + subCost;
+      auto isDel = costDel <= costIns && costDel <= costSub;
+      auto isIns = !isDel && costIns <= costSub;
+      del = af::select(isDel, del1 + 1, af::select(isIns, del1s, del2s));
+      ins = af::select(isDel, ins1, af::select(isIns, ins1s + 1, ins2s));
+      sub = af::select(isDel, sub1, af::select(isIns, sub1s, sub2s + subCost));
+      // First row (x = d) and first column (y = d)
+      del = af::select(y == 0, d, af::select(y == d, 0, del));
+      ins = af::select(y == 0, 0, af::select(y == d, d, ins));
+      sub = af::select(y == 0 || y == d, 0, sub);
+    }
+    auto isFinal = totalLen == d;
+    resDel = af::select(isFinal, af::moddims(del(finalIds), 1, B), resDel);
+    resIns = af::select(isFinal, af::moddims(ins(finalIds), 1, B), resIns);
+    resSub = af::select(isFinal, af::moddims(sub(finalIds), 1, B), resSub);
+    af::eval(del, ins, sub);
+    af::eval(resDel, resIns, resSub);
+    del2 = del1;
+    ins2 = ins1;
+    sub2 = sub1;
+    del1 = del;
+    ins1 = ins;
+    sub1 = sub;
+  }
+
+  auto counts = af::join(
+      0,
+      af::sum(af::flat(targetSizes).as(s64)),
+      af::sum(af::flat(resDel).as(s64)),
+      af::sum(af::flat(resIns).as(s64)),
+      af::sum(af::flat(resSub).as(s64)));
+  deviceCounts_ = deviceCounts_.isempty() ? counts : deviceCounts_ + counts;
+}
+
 void EditDistanceMeter::add(
     const int64_t n,
     const int64_t ndel,
@@ -54,23 +143,35 @@ void EditDistanceMeter::add(
 }
 
 std::vector<int64_t> EditDistanceMeter::value() const {
-  return {sumErr(), n_, ndel_, nins_, nsub_};
+  int64_t n = n_, ndel = ndel_, nins = nins_, nsub = nsub_;
+  if (!deviceCounts_.isempty()) {
+    std::array<int64_t, 4> counts;
+    deviceCounts_.host(counts.data());
+    n += counts[0];
+    ndel += counts[1];
+    nins += counts[2];
+    nsub += counts[3];
+  }
+  return {ndel + nins + nsub, n, ndel, nins, nsub};
 }
 
 std::vector<double> EditDistanceMeter::errorRate() const {
+  auto counts = value();
+  int64_t sumErr = counts[0], n = counts[1], ndel = counts[2],
+          nins = counts[3], nsub = counts[4];
   double val, valDel, valIns, valSub;
-  if (n_ > 0) {
-    val = static_cast<double>(sumErr() * 100.0) / n_;
-    valDel = static_cast<double>(ndel_ * 100.0) / n_;
-    valIns = static_cast<double>(nins_ * 100.0) / n_;
-    valSub = static_cast<double>(nsub_ * 100.0) / n_;
+  if (n > 0) {
+    val = static_cast<double>(sumErr * 100.0) / n;
+    valDel = static_cast<double>(ndel * 100.0) / n;
+    valIns = static_cast<double>(nins * 100.0) / n;
+    valSub = static_cast<double>(nsub * 100.0) / n;
   } else {
-    val = (sumErr() > 0) ? std::numeric_limits<double>::infinity() : 0.0;
-    valDel = (ndel_ > 0) ? std::numeric_limits<double>::infinity() : 0.0;
-    valIns = (nins_ > 0) ? std::numeric_limits<double>::infinity() : 0.0;
-    valSub = (nsub_ > 0) ? std::numeric_limits<double>::infinity() : 0.0;
+    val = (sumErr > 0) ? std::numeric_limits<double>::infinity() : 0.0;
+    valDel = (ndel > 0) ? std::numeric_limits<double>::infinity() : 0.0;
+    valIns = (nins > 0) ? std::numeric_limits<double>::infinity() : 0.0;
+    valSub = (nsub > 0) ? std::numeric_limits<double>::infinity() : 0.0;
   }
-  return {val, static_cast<double>(n_), valDel, valIns, valSub};
+  return {val, static_cast<double>(n), valDel, valIns, valSub};
 }
 
 } // namespace fl
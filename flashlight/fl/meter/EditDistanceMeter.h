@@ -56,6 +56,20 @@ class EditDistanceMeter {
    */
   void add(const af::array& output, const af::array& target);
 
+  /** Computes the edit distances of a batch on the device, without copying
+   * it to the host. `output` (Lo x B) and `target` (Lt x B) are padded, with
+   * the lengths of their columns in `outputSizes` and `targetSizes` (B).
+   * Units can also be made of K values compared together (e.g. the padded
+   * letters of words), with `output` of dims Lo x K x B and `target` of dims
+   * Lt x K x B. Lo and Lt must be positive. The counters are accumulated on
+   * the device, and only copied to the host by `value()` and `errorRate()`.
+   */
+  void addBatch(
+      const af::array& output,
+      const af::array& target,
+      const af::array& outputSizes,
+      const af::array& targetSizes);
+
   /** Updates all the counters with inputs sharing the same meaning. */
   void add(
       const int64_t n,
@@ -112,10 +126,8 @@ class EditDistanceMeter {
   int64_t ndel_;
   int64_t nins_;
   int64_t nsub_;
-
-  int64_t sumErr() const {
-    return ndel_ + nins_ + nsub_;
-  }
+  // n, ndel, nins, nsub accumulated by `addBatch()` (s64), empty if none
+  af::array deviceCounts_;
 
   template <typename T>
   ErrorState levensteinDistance(
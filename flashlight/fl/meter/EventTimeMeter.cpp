@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/meter/EventTimeMeter.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace fl {
+
+namespace {
+
+// Periods above which the oldest one is waited for, to bound the number of
+// events. The host never runs that far ahead of the device in practice.
+constexpr size_t kMaxPending = 64;
+
+} // namespace
+
+EventTimeMeter::EventTimeMeter(
+    bool unit /* = false */,
+    size_t window /* = 1000 */)
+    : useUnit_(unit), window_(std::max<size_t>(window, 1)) {
+  reset();
+}
+
+void EventTimeMeter::reset() {
+  for (auto& period : pending_) {
+    pool_.push_back(std::move(period.first));
+    pool_.push_back(std::move(period.second));
+  }
+  pending_.clear();
+  if (start_) {
+    pool_.push_back(std::move(start_));
+  }
+  durations_.clear();
+  next_ = 0;
+  curN_ = 0;
+  curValue_ = 0.;
+  isStopped_ = true;
+}
+
+void EventTimeMeter::set(double val, int64_t num /* = 1 */) {
+  resolve(true);
+  curValue_ = val;
+  curN_ = num;
+}
+
+double EventTimeMeter::value() const {
+  resolve(true);
+  double val = curValue_;
+  if (!isStopped_) {
+    auto now = getEvent();
+    now->record();
+    val += now->elapsedSince(*start_);
+    pool_.push_back(std::move(now));
+  }
+  if (useUnit_) {
+    val = (curN_ > 0) ? (val / curN_) : 0.0;
+  }
+  return val;
+}
+
+double EventTimeMeter::percentile(double p) const {
+  resolve(true);
+  if (durations_.empty()) {
+    return 0;
+  }
+  auto durations = durations_;
+  size_t k = std::min<size_t>(
+      durations.size() - 1, std::floor(p * (durations.size() - 1) + 0.5));
+  std::nth_element(durations.begin(), durations.begin() + k, durations.end());
+  return durations[k];
+}
+
+void EventTimeMeter::stop() {
+  if (isStopped_) {
+    return;
+  }
+  auto stop = getEvent();
+  stop->record();
+  pending_.emplace_back(std::move(start_), std::move(stop));
+  isStopped_ = true;
+  resolve(false);
+}
+
+void EventTimeMeter::resume() {
+  if (!isStopped_) {
+    return;
+  }
+  start_ = getEvent();
+  start_->record();
+  isStopped_ = false;
+}
+
+void EventTimeMeter::incUnit(int64_t num) {
+  curN_ += num;
+}
+
+void EventTimeMeter::stopAndIncUnit(int64_t num) {
+  stop();
+  incUnit(num);
+}
+
+void EventTimeMeter::resolve(bool wait) const {
+  while (!pending_.empty()) {
+    auto& period = pending_.front();
+    if (!wait && pending_.size() <= kMaxPending &&
+        !period.second->isCompleted()) {
+      return;
+    }
+    double duration = period.second->elapsedSince(*period.first);
+    curValue_ += duration;
+    if (durations_.size() < window_) {
+      durations_.push_back(duration);
+    } else {
+      durations_[next_] = duration;
+    }
+    next_ = (next_ + 1) % window_;
+    pool_.push_back(std::move(period.first));
+    pool_.push_back(std::move(period.second));
+    pending_.pop_front();
+  }
+}
+
+EventTimeMeter::Event EventTimeMeter::getEvent() const {
+  if (pool_.empty()) {
+    return std::make_unique<detail::TimingEvent>();
+  }
+  auto event = std::move(pool_.back());
+  pool_.pop_back();
+  return event;
+}
+} // namespace fl
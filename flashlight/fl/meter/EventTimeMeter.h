@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace fl {
+
+namespace detail {
+
+/**
+ * A point in the work enqueued on the ArrayFire stream of the current device.
+ * With CUDA, this is a CUDA event: recording it does not block. Other
+ * backends synchronize the device when recording, and use the wall clock.
+ */
+class TimingEvent {
+ public:
+  TimingEvent();
+  ~TimingEvent();
+  TimingEvent(const TimingEvent&) = delete;
+  TimingEvent& operator=(const TimingEvent&) = delete;
+
+  /** Records the event after the work enqueued so far. */
+  void record();
+
+  /** Returns if the work preceding the event has completed, without
+   * blocking.
+   */
+  bool isCompleted() const;
+
+  /** Returns the time in seconds between `start` and this event, and waits
+   * for this event to complete.
+   */
+  double elapsedSince(const TimingEvent& start) const;
+
+ private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+} // namespace detail
+
+/** A timer of the work done by the device, as a drop-in replacement of
+ * `TimeMeter` which does not need `af::sync()` before `resume()` and
+ * `stop()`: both record an event on the ArrayFire stream, and the elapsed
+ * times are only resolved when the events have completed, or when `value()`
+ * is called. The durations of the last `window` periods are kept, so that
+ * `percentile()` gives e.g. the tail latency of a training phase.
+ * Example usage:
+ *
+ * \code
+ * EventTimeMeter meter(true);
+ * meter.resume();
+ * auto output = model(input);
+ * meter.stopAndIncUnit();
+ * double time = meter.value(); // waits for the forward
+ * \endcode
+ */
+class EventTimeMeter {
+ public:
+  /** Constructor of `EventTimeMeter`. As for `TimeMeter`, the timer is
+   * initialized as stopped, and `unit` indicates if `value()` is the time per
+   * unit.
+   */
+  explicit EventTimeMeter(bool unit = false, size_t window = 1000);
+
+  /** Waits for the recorded events. If `unit` is `True`, returns the average
+   * time spend per unit, otherwise the total time in the current timing
+   * period. Time is measured in seconds.
+   */
+  double value() const;
+
+  /** Waits for the recorded events, and returns the p-th percentile
+   * (0 <= p <= 1) of the durations of the last `window` periods between
+   * `resume()` and `stop()`, in seconds, or 0 if there are none.
+   */
+  double percentile(double p) const;
+
+  /** Refreshes the counters and stops the timer. */
+  void reset();
+
+  /** Increases the number of units by `num`. */
+  void incUnit(int64_t num = 1);
+
+  /** Starts the timer. */
+  void resume();
+
+  /** Stops the timer. */
+  void stop();
+
+  /** Sets the number of units by `num` and the total time spend by `val`. */
+  void set(double val, int64_t num = 1);
+
+  /** Stops the timer and increase the number of units by `num`. */
+  void stopAndIncUnit(int64_t num = 1);
+
+ private:
+  using Event = std::unique_ptr<detail::TimingEvent>;
+
+  // Resolves the completed periods, or all of them if `wait`
+  void resolve(bool wait) const;
+  Event getEvent() const;
+
+  Event start_;
+  // Periods whose duration is not resolved yet, in order
+  mutable std::deque<std::pair<Event, Event>> pending_;
+  // Recorded events which can be reused
+  mutable std::vector<Event> pool_;
+  mutable double curValue_;
+  mutable std::vector<double> durations_;
+  mutable size_t next_;
+  int64_t curN_;
+  bool isStopped_;
+  bool useUnit_;
+  size_t window_;
+};
+} // namespace fl
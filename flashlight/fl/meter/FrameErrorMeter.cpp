@@ -17,7 +17,7 @@ FrameErrorMeter::FrameErrorMeter(bool accuracy /* = false */)
 
 void FrameErrorMeter::reset() {
   n_ = 0;
-  sum_ = 0;
+  sum_ = af::array();
 }
 
 void FrameErrorMeter::add(const af::array& output, const af::array& target) {
@@ -29,12 +29,18 @@ void FrameErrorMeter::add(const af::array& output, const af::array& target) {
         "output/target must be 1-dimensional for FrameErrorMeter");
   }
 
-  sum_ += af::count<int64_t>(output != target);
+  auto mismatches = af::count(output != target).as(s64);
+  sum_ = sum_.isempty() ? mismatches : sum_ + mismatches;
+  sum_.eval();
   n_ += target.dims(0);
 }
 
 double FrameErrorMeter::value() const {
-  double error = (n_ > 0) ? (static_cast<double>(sum_ * 100.0) / n_) : 0.0;
+  int64_t sum = 0;
+  if (!sum_.isempty()) {
+    sum_.host(&sum);
+  }
+  double error = (n_ > 0) ? (static_cast<double>(sum * 100.0) / n_) : 0.0;
   double val = (accuracy_ ? (100.0 - error) : error);
   return val;
 }
@@ -36,7 +36,8 @@ class FrameErrorMeter {
 
   /** Computes frame-level mismatch between two arrayfire arrays `output` and
    * `target` and updates the counters. Note that the shape of the two input
-   * arrays should be identical.
+   * arrays should be identical. The mismatches are counted on the device
+   * without synchronization, and only copied to the host by `value()`.
    */
   void add(const af::array& output, const af::array& target);
 
@@ -50,7 +51,8 @@ class FrameErrorMeter {
 
  private:
   int64_t n_;
-  int64_t sum_;
+  // Number of mismatches (s64) on the device, empty if none
+  af::array sum_;
   bool accuracy_;
 };
 } // namespace fl
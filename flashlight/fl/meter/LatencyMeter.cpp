@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/meter/LatencyMeter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+namespace fl {
+
+namespace {
+
+void atomicAdd(std::atomic<double>& value, double increment) {
+  double current = value.load(std::memory_order_relaxed);
+  while (!value.compare_exchange_weak(
+      current, current + increment, std::memory_order_relaxed)) {
+  }
+}
+
+} // namespace
+
+LatencyMeter::LatencyMeter(
+    double minValue /* = 1e-6 */,
+    double maxValue /* = 1e4 */,
+    int64_t subBuckets /* = 64 */)
+    : minValue_(minValue), maxValue_(maxValue), subBuckets_(subBuckets) {
+  if (!(minValue_ > 0) || !(maxValue_ > minValue_) || subBuckets_ < 1) {
+    throw std::invalid_argument(
+        "[LatencyMeter] needs 0 < minValue < maxValue and subBuckets >= 1");
+  }
+  int64_t numExponents = std::ceil(std::log2(maxValue_ / minValue_));
+  numBuckets_ = std::max<int64_t>(numExponents, 1) * subBuckets_;
+  counts_.reset(new std::atomic<uint64_t>[numBuckets_]);
+  reset();
+}
+
+LatencyMeter::LatencyMeter(const LatencyMeter& other)
+    : minValue_(other.minValue_),
+      maxValue_(other.maxValue_),
+      subBuckets_(other.subBuckets_),
+      numBuckets_(other.numBuckets_),
+      counts_(new std::atomic<uint64_t>[other.numBuckets_]) {
+  reset();
+  merge(other);
+}
+
+LatencyMeter& LatencyMeter::operator=(const LatencyMeter& other) {
+  if (this != &other) {
+    if (numBuckets_ != other.numBuckets_) {
+      counts_.reset(new std::atomic<uint64_t>[other.numBuckets_]);
+    }
+    minValue_ = other.minValue_;
+    maxValue_ = other.maxValue_;
+    subBuckets_ = other.subBuckets_;
+    numBuckets_ = other.numBuckets_;
+    reset();
+    merge(other);
+  }
+  return *this;
+}
+
+int64_t LatencyMeter::bucket(double val) const {
+  double x = val / minValue_;
+  // Also NaNs
+  if (!(x >= 1)) {
+    return 0;
+  }
+  // x = m * 2^e with 0.5 <= m < 1, e >= 1
+  int e;
+  double m = std::frexp(x, &e);
+  int64_t sub = (2 * m - 1) * subBuckets_;
+  return std::min((e - 1) * subBuckets_ + sub, numBuckets_ - 1);
+}
+
+double LatencyMeter::bucketValue(int64_t i) const {
+  double lower = std::ldexp(minValue_, i / subBuckets_);
+  double val =
+      lower * (1 + (static_cast<double>(i % subBuckets_) + 0.5) / subBuckets_);
+  return std::min(val, maxValue_);
+}
+
+void LatencyMeter::add(double val, int64_t num /* = 1 */) {
+  counts_[bucket(val)].fetch_add(num, std::memory_order_relaxed);
+  count_.fetch_add(num, std::memory_order_relaxed);
+  atomicAdd(sum_, val * num);
+}
+
+double LatencyMeter::percentile(double p) const {
+  std::vector<uint64_t> counts(numBuckets_);
+  uint64_t total = 0;
+  for (int64_t i = 0; i < numBuckets_; ++i) {
+    counts[i] = counts_[i].load(std::memory_order_relaxed);
+    total += counts[i];
+  }
+  if (total == 0) {
+    return 0.;
+  }
+  p = std::min(std::max(p, 0.), 1.);
+  uint64_t rank = std::max<uint64_t>(std::ceil(p * total), 1);
+  uint64_t cumulated = 0;
+  for (int64_t i = 0; i < numBuckets_; ++i) {
+    cumulated += counts[i];
+    if (cumulated >= rank) {
+      return bucketValue(i);
+    }
+  }
+  return bucketValue(numBuckets_ - 1);
+}
+
+std::vector<double> LatencyMeter::value() const {
+  return {
+      percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999)};
+}
+
+int64_t LatencyMeter::count() const {
+  return count_.load(std::memory_order_relaxed);
+}
+
+double LatencyMeter::mean() const {
+  auto n = count();
+  return n > 0 ? sum_.load(std::memory_order_relaxed) / n : 0.;
+}
+
+void LatencyMeter::merge(const LatencyMeter& other) {
+  if (minValue_ != other.minValue_ || maxValue_ != other.maxValue_ ||
+      subBuckets_ != other.subBuckets_) {
+    throw std::invalid_argument(
+        "[LatencyMeter::merge] meters have different buckets");
+  }
+  for (int64_t i = 0; i < numBuckets_; ++i) {
+    counts_[i].fetch_add(
+        other.counts_[i].load(std::memory_order_relaxed),
+        std::memory_order_relaxed);
+  }
+  count_.fetch_add(other.count(), std::memory_order_relaxed);
+  atomicAdd(sum_, other.sum_.load(std::memory_order_relaxed));
+}
+
+std::vector<double> LatencyMeter::getState() const {
+  std::vector<double> state(numBuckets_ + 1);
+  for (int64_t i = 0; i < numBuckets_; ++i) {
+    state[i] = counts_[i].load(std::memory_order_relaxed);
+  }
+  state[numBuckets_] = sum_.load(std::memory_order_relaxed);
+  return state;
+}
+
+void LatencyMeter::set(const std::vector<double>& state) {
+  if (static_cast<int64_t>(state.size()) != numBuckets_ + 1) {
+    throw std::invalid_argument(
+        "[LatencyMeter::set] expected " + std::to_string(numBuckets_ + 1) +
+        " values, got " + std::to_string(state.size()));
+  }
+  uint64_t total = 0;
+  for (int64_t i = 0; i < numBuckets_; ++i) {
+    uint64_t n = std::llround(state[i]);
+    counts_[i].store(n, std::memory_order_relaxed);
+    total += n;
+  }
+  count_.store(total, std::memory_order_relaxed);
+  sum_.store(state[numBuckets_], std::memory_order_relaxed);
+}
+
+void LatencyMeter::reset() {
+  for (int64_t i = 0; i < numBuckets_; ++i) {
+    counts_[i].store(0, std::memory_order_relaxed);
+  }
+  count_.store(0, std::memory_order_relaxed);
+  sum_.store(0., std::memory_order_relaxed);
+}
+} // namespace fl
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/meter/EventTimeMeter.h"
+
+#include <chrono>
+
+#include <arrayfire.h>
+
+namespace fl {
+namespace detail {
+
+// The backend does not expose events: the device is synchronized when
+// recording, as with a TimeMeter after af::sync().
+struct TimingEvent::Impl {
+  std::chrono::steady_clock::time_point time;
+};
+
+TimingEvent::TimingEvent() : impl_(std::make_unique<Impl>()) {}
+
+TimingEvent::~TimingEvent() = default;
+
+void TimingEvent::record() {
+  af::sync();
+  impl_->time = std::chrono::steady_clock::now();
+}
+
+bool TimingEvent::isCompleted() const {
+  return true;
+}
+
+double TimingEvent::elapsedSince(const TimingEvent& start) const {
+  return std::chrono::duration<double>(impl_->time - start.impl_->time)
+      .count();
+}
+
+} // namespace detail
+} // namespace fl
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/meter/EventTimeMeter.h"
+
+#include "flashlight/fl/common/backend/cuda/CudaUtils.h"
+
+namespace fl {
+namespace detail {
+
+struct TimingEvent::Impl {
+  cudaEvent_t event;
+};
+
+TimingEvent::TimingEvent() : impl_(std::make_unique<Impl>()) {
+  // Unlike the events synchronizing streams, timing is enabled
+  FL_CUDA_CHECK(cudaEventCreate(&impl_->event));
+}
+
+TimingEvent::~TimingEvent() {
+  cudaEventDestroy(impl_->event);
+}
+
+void TimingEvent::record() {
+  FL_CUDA_CHECK(cudaEventRecord(impl_->event, cuda::getActiveStream()));
+}
+
+bool TimingEvent::isCompleted() const {
+  auto err = cudaEventQuery(impl_->event);
+  if (err == cudaErrorNotReady) {
+    return false;
+  }
+  FL_CUDA_CHECK(err);
+  return true;
+}
+
+double TimingEvent::elapsedSince(const TimingEvent& start) const {
+  FL_CUDA_CHECK(cudaEventSynchronize(impl_->event));
+  float ms;
+  FL_CUDA_CHECK(cudaEventElapsedTime(&ms, start.impl_->event, impl_->event));
+  return ms / 1000.;
+}
+
+} // namespace detail
+} // namespace fl
@@ -10,7 +10,9 @@
 #include "flashlight/fl/meter/AverageValueMeter.h"
 #include "flashlight/fl/meter/CountMeter.h"
 #include "flashlight/fl/meter/EditDistanceMeter.h"
+#include "flashlight/fl/meter/EventTimeMeter.h"
 #include "flashlight/fl/meter/FrameErrorMeter.h"
+#include "flashlight/fl/meter/LatencyMeter.h"
 #include "flashlight/fl/meter/MSEMeter.h"
 #include "flashlight/fl/meter/TimeMeter.h"
 #include "flashlight/fl/meter/TopKMeter.h"
@@ -8,6 +8,7 @@
 #include "flashlight/fl/nn/DistributedUtils.h"
 
 #include <stdexcept>
+#include <vector>
 
 namespace fl {
 
@@ -29,6 +30,24 @@ void allReduceParameters(std::shared_ptr<const Module> module) {
   }
 }
 
+void broadcastParameters(
+    std::shared_ptr<const Module> module,
+    int rootRank /* = 0 */) {
+  if (!module) {
+    throw std::invalid_argument("null module passed to broadcastParameters");
+  }
+  if (getWorldSize() <= 1) {
+    return;
+  }
+  auto params = module->params();
+  std::vector<af::array*> arrs;
+  arrs.reserve(params.size());
+  for (auto& param : params) {
+    arrs.push_back(&param.array());
+  }
+  broadcastMultiple(arrs, rootRank);
+}
+
 void allReduceGradients(
     std::shared_ptr<const Module> module,
     double scale /*= 1.0 */) {
@@ -39,6 +39,19 @@ void distributeModuleGrads(
  */
 void allReduceParameters(std::shared_ptr<const Module> module);
 
+/**
+ * Traverses the network and sets its parameters to the parameters of the
+ * process of rank `rootRank`, with a single coalesced broadcast. Cheaper than
+ * `allReduceParameters` to start training from the same parameters on all
+ * processes, and exact. No-op if there is a single process.
+ *
+ * @param module a module whose parameters will be synchronized
+ * @param rootRank the rank of the process whose parameters are broadcast
+ */
+void broadcastParameters(
+    std::shared_ptr<const Module> module,
+    int rootRank = 0);
+
 /**
  * Traverses the network and synchronizes the gradients of its parameters with
  * allreduce.
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/nn/Fusion.h"
+
+#include <typeinfo>
+#include <vector>
+
+#include "flashlight/fl/nn/modules/BatchNorm.h"
+#include "flashlight/fl/nn/modules/Container.h"
+#include "flashlight/fl/nn/modules/Conv2D.h"
+#include "flashlight/fl/nn/modules/Dropout.h"
+#include "flashlight/fl/nn/modules/Identity.h"
+#include "flashlight/fl/nn/modules/Linear.h"
+
+namespace fl {
+
+namespace {
+
+// Folds `batchNorm` into `module` if it normalizes its output in eval mode
+bool foldBatchNorm(Module& module, const BatchNorm& batchNorm) {
+  if (!batchNorm.trackStats()) {
+    return false;
+  }
+  auto axis = batchNorm.featAxis();
+  if (auto conv = dynamic_cast<Conv2D*>(&module)) {
+    if (conv->int8Quantization() || axis != std::vector<int>{2}) {
+      return false;
+    }
+    auto scaleShift = batchNorm.evalScaleShift();
+    if (scaleShift.first.elements() != conv->param(0).dims(3)) {
+      return false;
+    }
+    conv->foldScaleShift(scaleShift.first, scaleShift.second);
+    return true;
+  }
+  if (auto linear = dynamic_cast<Linear*>(&module)) {
+    if (linear->int8Quantization() || axis != std::vector<int>{0}) {
+      return false;
+    }
+    auto scaleShift = batchNorm.evalScaleShift();
+    if (scaleShift.first.elements() != linear->param(0).dims(0)) {
+      return false;
+    }
+    linear->foldScaleShift(scaleShift.first, scaleShift.second);
+    return true;
+  }
+  return false;
+}
+
+// Folds each `BatchNorm` possible into the preceding module, replacing it by
+// an `Identity`
+void foldBatchNorms(std::vector<ModulePtr>& modules) {
+  for (int i = 0; i + 1 < modules.size(); ++i) {
+    auto batchNorm = std::dynamic_pointer_cast<BatchNorm>(modules[i + 1]);
+    if (batchNorm && foldBatchNorm(*modules[i], *batchNorm)) {
+      modules[i + 1] = std::make_shared<Identity>();
+    }
+  }
+}
+
+bool isPlainSequential(const ModulePtr& module) {
+  return module && typeid(*module) == typeid(Sequential);
+}
+
+ModulePtr fuse(ModulePtr module) {
+  auto container = std::dynamic_pointer_cast<Container>(module);
+  if (!container) {
+    return module;
+  }
+  auto modules = container->modules();
+  for (int i = 0; i < modules.size(); ++i) {
+    container->setModule(i, fuse(modules[i]));
+  }
+  if (!std::dynamic_pointer_cast<Sequential>(module)) {
+    return module;
+  }
+
+  // Subclasses of Sequential may depend on the indices of their modules
+  if (!isPlainSequential(module)) {
+    modules = container->modules();
+    foldBatchNorms(modules);
+    for (int i = 0; i < modules.size(); ++i) {
+      container->setModule(i, modules[i]);
+    }
+    return module;
+  }
+  modules.clear();
+  for (auto& child : container->modules()) {
+    if (isPlainSequential(child)) {
+      auto nested = std::dynamic_pointer_cast<Container>(child)->modules();
+      modules.insert(modules.end(), nested.begin(), nested.end());
+    } else {
+      modules.push_back(child);
+    }
+  }
+  foldBatchNorms(modules);
+  auto fused = std::make_shared<Sequential>();
+  for (auto& child : modules) {
+    if (!dynamic_cast<Identity*>(child.get()) &&
+        !dynamic_cast<Dropout*>(child.get())) {
+      fused->add(child);
+    }
+  }
+  return fused;
+}
+
+} // namespace
+
+std::shared_ptr<Module> fuseForInference(std::shared_ptr<Module> module) {
+  auto fused = fuse(module);
+  fused->eval();
+  return fused;
+}
+
+} // namespace fl
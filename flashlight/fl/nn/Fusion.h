@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <memory>
+
+namespace fl {
+
+class Module;
+
+/**
+ * Optimizes `module` for inference, and returns the optimized module in eval
+ * mode, which computes the same outputs in eval mode and serializes as any
+ * other module:
+ * - a `BatchNorm` with running statistics directly following a `Conv2D`
+ *   (normalizing channels, axis 2) or a `Linear` (axis 0) in a `Sequential` is
+ *   folded into the weights and bias of the module, and replaced by an
+ *   `Identity`;
+ * - `Identity` and `Dropout` modules are dropped from `Sequential`s, and
+ *   `Sequential`s nested in a `Sequential` are merged into it.
+ *
+ * Other containers, whose forward may use their modules in any order, keep
+ * their modules at the same indices and only have their modules optimized.
+ * Modules of `module` are updated in place, so `module` shouldn't be used for
+ * training afterwards.
+ */
+std::shared_ptr<Module> fuseForInference(std::shared_ptr<Module> module);
+
+} // namespace fl
@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/nn/InferenceExecutor.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#include "flashlight/fl/autograd/GradMode.h"
+#include "flashlight/fl/common/Logging.h"
+#include "flashlight/fl/memory/MemoryManagerInstaller.h"
+#include "flashlight/fl/memory/managers/CachingMemoryManager.h"
+#include "flashlight/fl/nn/modules/Container.h"
+
+namespace fl {
+
+namespace {
+
+CachingMemoryManager* cachingMemoryManager() {
+  return dynamic_cast<CachingMemoryManager*>(
+      MemoryManagerInstaller::currentlyInstalledMemoryManager());
+}
+
+void flatten(
+    const std::shared_ptr<Module>& module,
+    std::vector<std::shared_ptr<Module>>& steps) {
+  auto sequential = std::dynamic_pointer_cast<Sequential>(module);
+  if (!sequential) {
+    steps.push_back(module);
+    return;
+  }
+  for (const auto& child : sequential->modules()) {
+    flatten(child, steps);
+  }
+}
+
+size_t bytes(const std::vector<Variable>& vars) {
+  size_t total = 0;
+  for (const auto& var : vars) {
+    total += var.bytes();
+  }
+  return total;
+}
+
+// Serves the allocations of the active device from a private pool while
+// alive
+class PrivatePoolScope {
+ public:
+  PrivatePoolScope(CachingMemoryManager* manager, size_t pool)
+      : manager_(pool != 0 ? manager : nullptr) {
+    if (manager_) {
+      manager_->beginPrivatePool(pool);
+    }
+  }
+
+  ~PrivatePoolScope() {
+    if (manager_) {
+      manager_->endPrivatePool();
+    }
+  }
+
+  PrivatePoolScope(const PrivatePoolScope&) = delete;
+  PrivatePoolScope& operator=(const PrivatePoolScope&) = delete;
+
+ private:
+  CachingMemoryManager* manager_;
+};
+
+} // namespace
+
+InferenceExecutor::InferenceExecutor(std::shared_ptr<Module> module)
+    : module_(std::move(module)) {
+  if (!module_) {
+    throw std::invalid_argument("InferenceExecutor: null module");
+  }
+  module_->eval();
+  flatten(module_, steps_);
+}
+
+InferenceExecutor::~InferenceExecutor() {
+  auto* manager = cachingMemoryManager();
+  if (!manager) {
+    return;
+  }
+  int device = af::getDevice();
+  for (const auto& entry : plans_) {
+    if (entry.second.privatePool == 0) {
+      continue;
+    }
+    try {
+      af::setDevice(std::get<0>(entry.first));
+      manager->releasePrivatePool(entry.second.privatePool);
+    } catch (const std::exception& ex) {
+      FL_LOG(fl::ERROR)
+          << "InferenceExecutor: failed to release a private pool: "
+          << ex.what();
+    }
+  }
+  af::setDevice(device);
+}
+
+InferenceExecutor::ShapeKey InferenceExecutor::shapeKey(
+    const std::vector<Variable>& inputs) {
+  ShapeKey key;
+  std::get<0>(key) = af::getDevice();
+  for (const auto& input : inputs) {
+    for (int i = 0; i < 4; ++i) {
+      std::get<1>(key).push_back(input.dims(i));
+    }
+    std::get<2>(key).push_back(input.type());
+  }
+  return key;
+}
+
+const InferencePlan* InferenceExecutor::plan(
+    const std::vector<Variable>& inputs) const {
+  auto it = plans_.find(shapeKey(inputs));
+  return it == plans_.end() ? nullptr : &it->second;
+}
+
+std::vector<Variable> InferenceExecutor::forward(
+    const std::vector<Variable>& inputs) {
+  NoGradGuard noGrad;
+  auto* manager = cachingMemoryManager();
+  auto key = shapeKey(inputs);
+  auto it = plans_.find(key);
+  bool tracing = it == plans_.end();
+  if (tracing) {
+    InferencePlan plan;
+    if (manager) {
+      plan.privatePool = manager->createPrivatePool();
+    }
+    it = plans_.emplace(std::move(key), std::move(plan)).first;
+  }
+  auto& plan = it->second;
+
+  std::vector<Variable> output;
+  try {
+    PrivatePoolScope scope(manager, plan.privatePool);
+    // The inputs are alive during the first step only, and are not part of
+    // the arena
+    output = inputs;
+    for (const auto& step : steps_) {
+      auto next = step->forward(output);
+      for (const auto& var : next) {
+        var.eval();
+      }
+      if (tracing) {
+        plan.stepBytes.push_back(bytes(next));
+        plan.peakBytes =
+            std::max(plan.peakBytes, bytes(output) + plan.stepBytes.back());
+      }
+      // Releases the activations of the previous step
+      output = std::move(next);
+    }
+  } catch (...) {
+    if (tracing) {
+      output.clear();
+      if (plan.privatePool != 0) {
+        manager->releasePrivatePool(plan.privatePool);
+      }
+      plans_.erase(it);
+    }
+    throw;
+  }
+  return output;
+}
+
+Variable InferenceExecutor::forward(const Variable& input) {
+  auto output = forward(std::vector<Variable>{input});
+  if (output.size() != 1) {
+    throw std::invalid_argument(
+        "InferenceExecutor: module output size is not 1");
+  }
+  return output.front();
+}
+
+} // namespace fl
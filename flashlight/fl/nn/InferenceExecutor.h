@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include "flashlight/fl/autograd/Variable.h"
+
+namespace fl {
+
+class Module;
+
+/**
+ * Memory plan of an `InferenceExecutor` for a shape class (the dimensions and
+ * types of the inputs), recorded by the first forward of the class.
+ */
+struct InferencePlan {
+  // Bytes of the outputs of each step
+  std::vector<size_t> stepBytes;
+  // Bytes of the activations alive at once at the busiest step: the inputs
+  // and the outputs of the step
+  size_t peakBytes = 0;
+  // Private pool of the `CachingMemoryManager` serving the steps, 0 if none
+  size_t privatePool = 0;
+};
+
+/**
+ * Runs a frozen module for inference, e.g. a `Sequential` built from an arch
+ * file by `buildSequentialModule()`:
+ * \code{.cpp}
+ * auto network = fl::ext::buildSequentialModule(archFile, nFeatures, nLabels);
+ * fl::load(modelPath, network);
+ * InferenceExecutor executor(network);
+ * auto output = executor.forward(input);
+ * \endcode
+ *
+ * The module is set to evaluation mode, and nested `Sequential`s are
+ * flattened into steps, run without recording the graph. The output of a
+ * step is evaluated, and the activations are released as soon as the next
+ * step has consumed them, rather than when the JIT trees referencing them go
+ * out of scope.
+ *
+ * The first forward of a shape class traces the steps and records their
+ * memory in an `InferencePlan`. With the `CachingMemoryManager`, all the
+ * forwards of a class are served from a private pool of the class (see
+ * `CachingMemoryManager::createPrivatePool()`), which is the arena of its
+ * activations: the blocks released by a step are reused by the next ones,
+ * and the forwards after the first one reuse the blocks of the first one,
+ * without taking memory from the other allocations. The pools are released
+ * with the executor.
+ *
+ * A private pool is active for the whole device during a forward: the
+ * executor may not be used while other threads allocate on the device.
+ * Outputs kept across forwards hold blocks of the pool of their class.
+ */
+class InferenceExecutor {
+ public:
+  explicit InferenceExecutor(std::shared_ptr<Module> module);
+  ~InferenceExecutor();
+
+  InferenceExecutor(const InferenceExecutor&) = delete;
+  InferenceExecutor& operator=(const InferenceExecutor&) = delete;
+
+  std::vector<Variable> forward(const std::vector<Variable>& inputs);
+
+  Variable forward(const Variable& input);
+
+  size_t numSteps() const {
+    return steps_.size();
+  }
+
+  /**
+   * The plan of the shape class of `inputs`, nullptr if no forward of the
+   * class has been run.
+   */
+  const InferencePlan* plan(const std::vector<Variable>& inputs) const;
+
+ private:
+  // Device, then dimensions and type of each input
+  using ShapeKey = std::tuple<int, std::vector<dim_t>, std::vector<int>>;
+
+  static ShapeKey shapeKey(const std::vector<Variable>& inputs);
+
+  std::shared_ptr<Module> module_;
+  std::vector<std::shared_ptr<Module>> steps_;
+  std::map<ShapeKey, InferencePlan> plans_;
+};
+
+} // namespace fl
@@ -0,0 +1,287 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/nn/ModuleProfiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <unordered_map>
+#include <utility>
+
+#include "flashlight/fl/autograd/Utils.h"
+#include "flashlight/fl/nn/modules/Module.h"
+
+namespace fl {
+
+namespace {
+
+int64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Identifies the Variables sharing the same data
+const void* variableKey(const Variable& var) {
+  return &var.array();
+}
+
+} // namespace
+
+struct ModuleProfiler::State {
+  explicit State(bool synchronize) : synchronize(synchronize) {}
+
+  std::vector<Variable> forward(
+      Module& module,
+      const std::vector<Variable>& inputs,
+      const std::shared_ptr<State>& self);
+
+  void hookGrad(const Variable& var, const std::shared_ptr<State>& self);
+
+  // A module call waiting for the gradients of its output and input
+  struct PendingBackward {
+    size_t profile;
+    const void* output;
+    // nullptr if the input requires no gradient
+    const void* input;
+  };
+
+  const bool synchronize;
+  std::vector<ModuleProfile> profiles;
+  std::unordered_map<const Module*, size_t> indices;
+  int depth{0};
+  std::vector<PendingBackward> pending;
+  // Time at which the gradients of the hooked Variables were available
+  std::unordered_map<const void*, int64_t> gradNs;
+};
+
+namespace {
+thread_local std::shared_ptr<ModuleProfiler::State> tlsProfiler;
+thread_local ModuleForwardHook tlsForwardHook;
+} // namespace
+
+std::vector<Variable> ModuleProfiler::State::forward(
+    Module& module,
+    const std::vector<Variable>& inputs,
+    const std::shared_ptr<State>& self) {
+  size_t idx;
+  auto it = indices.find(&module);
+  if (it == indices.end()) {
+    ModuleProfile profile;
+    auto name = module.prettyString();
+    profile.name = name.substr(0, name.find('\n'));
+    profile.depth = depth;
+    for (const auto& param : module.params()) {
+      profile.numParams += param.elements();
+    }
+    idx = profiles.size();
+    indices.emplace(&module, idx);
+    profiles.push_back(std::move(profile));
+  } else {
+    idx = it->second;
+  }
+
+  double bytes = 0;
+  for (const auto& param : module.params()) {
+    bytes += param.bytes();
+  }
+  for (const auto& input : inputs) {
+    bytes += input.bytes();
+  }
+  if (synchronize) {
+    af::sync();
+  }
+  auto beginNs = nowNs();
+  std::vector<Variable> outputs;
+  double flops;
+  {
+    // Restores the depth if the forward throws
+    struct DepthGuard {
+      int& depth;
+      ~DepthGuard() {
+        --depth;
+      }
+    } guard{++depth};
+    detail::FlopCounter counter;
+    outputs = module.forward(inputs);
+    flops = counter.flops();
+  }
+  if (synchronize) {
+    for (const auto& output : outputs) {
+      output.eval();
+    }
+    af::sync();
+  }
+  auto endNs = nowNs();
+
+  int64_t activationBytes = 0;
+  for (const auto& output : outputs) {
+    activationBytes += output.bytes();
+  }
+  // Nested calls may have added profiles
+  auto& profile = profiles[idx];
+  ++profile.calls;
+  profile.forwardMs += (endNs - beginNs) / 1e6;
+  profile.flops += flops;
+  profile.bytes += bytes + activationBytes;
+  profile.activationBytes = activationBytes;
+
+  if (!outputs.empty() && outputs.front().isCalcGrad()) {
+    bool inputGrad = !inputs.empty() && inputs.front().isCalcGrad();
+    pending.push_back(
+        {idx,
+         variableKey(outputs.front()),
+         inputGrad ? variableKey(inputs.front()) : nullptr});
+    hookGrad(outputs.front(), self);
+    if (inputGrad) {
+      hookGrad(inputs.front(), self);
+    }
+  }
+  return outputs;
+}
+
+void ModuleProfiler::State::hookGrad(
+    const Variable& var,
+    const std::shared_ptr<State>& self) {
+  // The graph doesn't keep the profiler alive
+  std::weak_ptr<State> weak = self;
+  auto key = variableKey(var);
+  Variable(var).registerGradHook([weak, key](Variable& /* grad */) {
+    auto state = weak.lock();
+    if (!state) {
+      return;
+    }
+    if (state->synchronize) {
+      af::sync();
+    }
+    state->gradNs[key] = nowNs();
+  });
+}
+
+ModuleProfiler::ModuleProfiler(bool synchronize /* = true */)
+    : state_(std::make_shared<State>(synchronize)) {}
+
+ModuleProfiler::~ModuleProfiler() {
+  stop();
+}
+
+void ModuleProfiler::start() {
+  tlsProfiler = state_;
+}
+
+void ModuleProfiler::stop() {
+  if (tlsProfiler == state_) {
+    tlsProfiler = nullptr;
+  }
+}
+
+void ModuleProfiler::endBackward() {
+  if (state_->synchronize) {
+    af::sync();
+  }
+  auto endNs = nowNs();
+  for (const auto& call : state_->pending) {
+    auto output = state_->gradNs.find(call.output);
+    if (output == state_->gradNs.end()) {
+      // No gradient reached the module
+      continue;
+    }
+    auto inputNs = endNs;
+    if (call.input) {
+      auto input = state_->gradNs.find(call.input);
+      if (input != state_->gradNs.end()) {
+        inputNs = input->second;
+      }
+    }
+    auto& profile = state_->profiles[call.profile];
+    profile.backwardMs += (inputNs - output->second) / 1e6;
+    ++profile.backwardCalls;
+  }
+  state_->pending.clear();
+  state_->gradNs.clear();
+}
+
+void ModuleProfiler::reset() {
+  state_->profiles.clear();
+  state_->indices.clear();
+  state_->pending.clear();
+  state_->gradNs.clear();
+}
+
+std::vector<ModuleProfile> ModuleProfiler::profiles() const {
+  return state_->profiles;
+}
+
+std::string ModuleProfiler::table(
+    double peakTflops /* = 0 */,
+    double peakGBps /* = 0 */) const {
+  const size_t kNameWidth = 40;
+  bool roofline = peakTflops > 0 && peakGBps > 0;
+  std::ostringstream ss;
+  ss << std::left << std::setw(kNameWidth) << "module" << std::right
+     << std::setw(7) << "calls" << std::setw(10) << "fwd ms" << std::setw(10)
+     << "bwd ms" << std::setw(12) << "params" << std::setw(10) << "act MB"
+     << std::setw(10) << "GFLOP" << std::setw(10) << "fwd TF/s"
+     << std::setw(10) << "bwd TF/s" << std::setw(8) << "FLOP/B";
+  if (roofline) {
+    ss << std::setw(8) << "roof %";
+  }
+  ss << "\n" << std::fixed;
+  for (const auto& profile : state_->profiles) {
+    auto name = std::string(2 * profile.depth, ' ') + profile.name;
+    if (name.size() > kNameWidth - 1) {
+      name = name.substr(0, kNameWidth - 4) + "...";
+    }
+    double calls = std::max<int64_t>(profile.calls, 1);
+    double fwdMs = profile.forwardMs / calls;
+    double bwdMs = profile.backwardCalls > 0
+        ? profile.backwardMs / profile.backwardCalls
+        : 0;
+    double flops = profile.flops / calls;
+    // FLOP/ms / 1e9 = TFLOP/s
+    double fwdTflops = fwdMs > 0 ? flops / fwdMs / 1e9 : 0;
+    double bwdTflops = bwdMs > 0 ? 2 * flops / bwdMs / 1e9 : 0;
+    double intensity = profile.bytes > 0 ? profile.flops / profile.bytes : 0;
+    ss << std::left << std::setw(kNameWidth) << name << std::right
+       << std::setw(7) << profile.calls << std::setprecision(3)
+       << std::setw(10) << fwdMs << std::setw(10) << bwdMs << std::setw(12)
+       << profile.numParams << std::setprecision(2) << std::setw(10)
+       << profile.activationBytes / (1024. * 1024.) << std::setw(10)
+       << flops / 1e9 << std::setw(10) << fwdTflops << std::setw(10)
+       << bwdTflops << std::setw(8) << intensity;
+    if (roofline) {
+      // Bound by the compute or by the memory bandwidth
+      double attainable = std::min(peakTflops, intensity * peakGBps / 1e3);
+      ss << std::setprecision(1) << std::setw(8)
+         << (attainable > 0 ? 100 * fwdTflops / attainable : 0);
+    }
+    ss << "\n";
+  }
+  return ss.str();
+}
+
+std::vector<Variable> forwardModule(
+    Module& module,
+    const std::vector<Variable>& inputs) {
+  if (tlsForwardHook) {
+    tlsForwardHook(module);
+  }
+  auto state = tlsProfiler;
+  if (!state) {
+    return module.forward(inputs);
+  }
+  return state->forward(module, inputs, state);
+}
+
+ModuleForwardHook setModuleForwardHook(ModuleForwardHook hook) {
+  std::swap(hook, tlsForwardHook);
+  return hook;
+}
+
+} // namespace fl
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "flashlight/fl/autograd/Variable.h"
+
+namespace fl {
+
+class Module;
+
+/**
+ * Statistics of a module recorded by `ModuleProfiler`, summed over its calls.
+ */
+struct ModuleProfile {
+  // First line of the `prettyString()` of the module
+  std::string name;
+  // Number of containers recorded around the module
+  int depth = 0;
+  int64_t numParams = 0;
+  int64_t calls = 0;
+  int64_t backwardCalls = 0;
+  double forwardMs = 0;
+  double backwardMs = 0;
+  // Of the matrix multiplications, convolutions and RNNs of the forward (see
+  // `detail::FlopCounter`), the backward is estimated at twice as many
+  double flops = 0;
+  // Parameters, inputs and outputs of the forward
+  double bytes = 0;
+  // Outputs of the last call
+  int64_t activationBytes = 0;
+};
+
+/**
+ * Records the forward and backward time, the FLOPs and the memory of each
+ * module forwarded through `forwardModule()` (the modules of `Sequential`s)
+ * on the calling thread, to find the modules which perform below their
+ * roofline:
+ * \code{.cpp}
+   ModuleProfiler profiler;
+   profiler.start();
+   for (int i = 0; i < 10; ++i) {
+     auto loss = criterion(model->forward(input), target);
+     loss.backward();
+     profiler.endBackward();
+   }
+   profiler.stop();
+   std::cout << profiler.table(125 /* TFLOP/s */, 900 /* GB/s */);
+ * \endcode
+ *
+ * The times include the children of the containers. With `synchronize`, the
+ * device is synchronized around each module and its outputs are evaluated, so
+ * that the times are those of the module only, but the whole network runs
+ * slower. The backward time of a module is measured from the gradient of its
+ * output to the gradient of its input, with gradient hooks which replace
+ * those of the activations.
+ */
+class ModuleProfiler {
+ public:
+  explicit ModuleProfiler(bool synchronize = true);
+  ~ModuleProfiler();
+
+  ModuleProfiler(const ModuleProfiler&) = delete;
+  ModuleProfiler& operator=(const ModuleProfiler&) = delete;
+
+  /**
+   * Starts recording the modules forwarded on the calling thread.
+   */
+  void start();
+
+  void stop();
+
+  /**
+   * Ends the backward pass of the modules recorded since the last call. The
+   * modules whose input doesn't require a gradient end at this time.
+   */
+  void endBackward();
+
+  void reset();
+
+  /**
+   * The modules in the order of their first call.
+   */
+  std::vector<ModuleProfile> profiles() const;
+
+  /**
+   * Formats the profiles as a table, with the achieved TFLOP/s and their
+   * fraction of the roofline of the device if its `peakTflops` and memory
+   * bandwidth `peakGBps` are positive.
+   */
+  std::string table(double peakTflops = 0, double peakGBps = 0) const;
+
+  struct State;
+
+ private:
+  std::shared_ptr<State> state_;
+};
+
+/**
+ * Forwards `module`, recorded by the `ModuleProfiler` of the calling thread
+ * if any, after calling the hook of the thread (see `setModuleForwardHook`).
+ * Containers forward their modules with it.
+ */
+std::vector<Variable> forwardModule(
+    Module& module,
+    const std::vector<Variable>& inputs);
+
+/**
+ * Called by `forwardModule()` before the forward of a module, e.g. to wait for
+ * the pending updates of its parameters (see `PipelinedOptimizer`).
+ */
+using ModuleForwardHook = std::function<void(Module& module)>;
+
+/**
+ * Sets the hook called by `forwardModule()` on the calling thread, none if
+ * null.
+ *
+ * @return the previous hook of the thread
+ */
+ModuleForwardHook setModuleForwardHook(ModuleForwardHook hook);
+
+} // namespace fl
@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/nn/Pipeline.h"
+
+#include <algorithm>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "flashlight/fl/distributed/DistributedApi.h"
+#include "flashlight/fl/distributed/reducers/DeferredReducer.h"
+#include "flashlight/fl/nn/modules/Container.h"
+
+namespace fl {
+
+namespace {
+
+constexpr int kHeaderSize = 5;
+
+// Sends `sent` to the process of rank `dst`, if not null, and receives an
+// array from the process of rank `src`, if not negative. The dimensions and
+// type of the arrays are exchanged first.
+af::array exchange(const af::array* sent, int dst, int src) {
+  if (!sent && src < 0) {
+    return af::array();
+  }
+  std::vector<std::pair<const af::array*, int>> sends;
+  std::vector<std::pair<af::array*, int>> recvs;
+  af::array sentHeader, receivedHeader;
+  if (sent) {
+    std::vector<long long> header(kHeaderSize);
+    for (int i = 0; i < 4; ++i) {
+      header[i] = sent->dims(i);
+    }
+    header[4] = sent->type();
+    sentHeader = af::array(kHeaderSize, header.data());
+    sends.emplace_back(&sentHeader, dst);
+  }
+  if (src >= 0) {
+    receivedHeader = af::array(kHeaderSize, s64);
+    recvs.emplace_back(&receivedHeader, src);
+  }
+  sendRecv(sends, recvs);
+
+  af::array received;
+  recvs.clear();
+  if (src >= 0) {
+    std::vector<long long> header(kHeaderSize);
+    receivedHeader.host(header.data());
+    received = af::array(
+        af::dim4(header[0], header[1], header[2], header[3]),
+        static_cast<af::dtype>(header[4]));
+    recvs.emplace_back(&received, src);
+  }
+  sends.clear();
+  if (sent) {
+    sends.emplace_back(sent, dst);
+  }
+  sendRecv(sends, recvs);
+  return received;
+}
+
+size_t numParams(const Module& module) {
+  size_t count = 0;
+  for (const auto& param : module.params()) {
+    count += param.elements();
+  }
+  return count;
+}
+
+} // namespace
+
+std::vector<std::shared_ptr<Sequential>> Pipeline::partition(
+    const Container& model,
+    int numStages) {
+  auto modules = model.modules();
+  if (numStages < 1 || modules.size() < static_cast<size_t>(numStages)) {
+    throw std::invalid_argument(
+        "Pipeline: can't partition " + std::to_string(modules.size()) +
+        " modules into " + std::to_string(numStages) + " stages");
+  }
+  std::vector<size_t> weights;
+  size_t total = 0;
+  for (const auto& module : modules) {
+    weights.push_back(numParams(*module));
+    total += weights.back();
+  }
+
+  std::vector<std::shared_ptr<Sequential>> stages{
+      std::make_shared<Sequential>()};
+  size_t cumulative = 0;
+  for (size_t i = 0; i < modules.size(); ++i) {
+    size_t remainingStages = numStages - stages.size();
+    // A stage ends before the module which would take it further past its
+    // share of the parameters than it is short of it, or when the remaining
+    // modules are needed for the remaining stages
+    if (remainingStages > 0 && !stages.back()->modules().empty() &&
+        ((2 * cumulative + weights[i]) * numStages >
+             2 * total * stages.size() ||
+         modules.size() - i == remainingStages)) {
+      stages.push_back(std::make_shared<Sequential>());
+    }
+    stages.back()->add(modules[i]);
+    cumulative += weights[i];
+  }
+  return stages;
+}
+
+Pipeline::Pipeline(
+    std::shared_ptr<Module> stage,
+    std::shared_ptr<DeferredReducer> reducer /* = nullptr */)
+    : stage_(std::move(stage)),
+      reducer_(std::move(reducer)),
+      numStages_(getPipelineStages()),
+      stageIndex_(getWorldRank() % numStages_),
+      rank_(getWorldRank()) {
+  if (!stage_) {
+    throw std::invalid_argument("Pipeline: null stage");
+  }
+}
+
+Variable Pipeline::trainStep(
+    int numMicroBatches,
+    const std::function<Variable(int)>& input,
+    const std::function<Variable(const Variable&, int)>& loss) {
+  if (numMicroBatches < 1) {
+    throw std::invalid_argument("Pipeline: no micro-batches");
+  }
+  // The neighbours in the replica, -1 at its ends
+  int prev = isFirstStage() ? -1 : rank_ - 1;
+  int next = isLastStage() ? -1 : rank_ + 1;
+
+  // The input of a micro-batch, and its output (its loss on the last stage),
+  // from its forward pass to its backward pass
+  std::deque<std::pair<Variable, Variable>> inFlight;
+  af::array totalLoss;
+  int numForwards = 0;
+  int numBackwards = 0;
+
+  auto forwardStep = [&](const af::array& received) {
+    int i = numForwards++;
+    auto in = isFirstStage() ? input(i) : Variable(received, true);
+    auto out = stage_->forward({in});
+    if (out.size() != 1) {
+      throw std::invalid_argument("Pipeline: stage output size is not 1");
+    }
+    if (isLastStage()) {
+      auto l = loss(out.front(), i);
+      totalLoss = totalLoss.isempty() ? l.array() : totalLoss + l.array();
+      inFlight.emplace_back(in, l);
+    } else {
+      inFlight.emplace_back(in, out.front());
+    }
+    return inFlight.back().second.array();
+  };
+
+  // Returns the gradient of the input of the oldest micro-batch in flight
+  auto backwardStep = [&](const af::array& gradOutput) {
+    auto micro = std::move(inFlight.front());
+    inFlight.pop_front();
+    if (reducer_) {
+      reducer_->setSynchronize(++numBackwards == numMicroBatches);
+    }
+    if (isLastStage()) {
+      micro.second.backward();
+    } else {
+      micro.second.backward(Variable(gradOutput, false));
+    }
+    if (reducer_) {
+      reducer_->finalize();
+    }
+    if (isFirstStage()) {
+      return af::array();
+    }
+    const auto& in = micro.first;
+    return in.isGradAvailable() ? in.grad().array()
+                                : af::constant(0, in.dims(), in.type());
+  };
+
+  // Each exchange with a neighbour matches the exchange of the neighbour at
+  // the same point of its schedule, so that the pipeline can't deadlock
+  int numWarmup = std::min(numStages_ - stageIndex_ - 1, numMicroBatches);
+  for (int i = 0; i < numWarmup; ++i) {
+    auto received = exchange(nullptr, -1, prev);
+    auto out = forwardStep(received);
+    exchange(isLastStage() ? nullptr : &out, next, -1);
+  }
+  int numSteady = numMicroBatches - numWarmup;
+  af::array received;
+  if (numSteady > 0) {
+    received = exchange(nullptr, -1, prev);
+  }
+  for (int i = 0; i < numSteady; ++i) {
+    auto out = forwardStep(received);
+    auto gradOutput = exchange(isLastStage() ? nullptr : &out, next, next);
+    auto gradInput = backwardStep(gradOutput);
+    bool isLast = i == numSteady - 1;
+    received = exchange(
+        isFirstStage() ? nullptr : &gradInput, prev, isLast ? -1 : prev);
+  }
+  for (int i = 0; i < numWarmup; ++i) {
+    auto gradOutput = exchange(nullptr, -1, next);
+    auto gradInput = backwardStep(gradOutput);
+    exchange(isFirstStage() ? nullptr : &gradInput, prev, -1);
+  }
+  return isLastStage() ? Variable(totalLoss, false) : Variable();
+}
+
+} // namespace fl
@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "flashlight/fl/autograd/Variable.h"
+
+namespace fl {
+
+class Container;
+class DeferredReducer;
+class Module;
+class Sequential;
+
+/**
+ * Pipeline model parallelism: a model is partitioned into stages of
+ * consecutive modules, each run by its own processes, and a batch is split in
+ * micro-batches which flow through the stages. The stages exchange the
+ * activations, and their gradients, with `sendRecv`.
+ *
+ * With `DistributedConstants::kPipelineStages` set to `P` in
+ * `distributedInit`, the process of rank `r` runs the stage `r % P` of the
+ * pipeline replica `r / P`: a replica is `P` consecutive ranks, e.g. the
+ * devices of a node. The gradients are synchronized between the replicas of a
+ * stage by the existing reducers, since allreduces then span the processes of
+ * the same stage (the data-parallel dimension). As the gradients of the
+ * micro-batches are accumulated, the reducer is wrapped in a
+ * `DeferredReducer`, which `trainStep` enables for the last backward pass:
+ * \code{.cpp}
+ * int numStages = getPipelineStages();
+ * auto stages = Pipeline::partition(*model, numStages);
+ * auto stage = stages[getWorldRank() % numStages];
+ * auto reducer = std::make_shared<DeferredReducer>(
+ *     std::make_shared<BucketedReducer>(numStages * 1.0 / getWorldSize()));
+ * distributeModuleGrads(stage, reducer);
+ * Pipeline pipeline(stage, reducer);
+ * SGDOptimizer optimizer(stage->params(), lr);
+ *
+ * optimizer.zeroGrad();
+ * auto loss = pipeline.trainStep(
+ *     numMicroBatches,
+ *     [&](int i) { return inputs[i]; },
+ *     [&](const Variable& output, int i) {
+ *       return categoricalCrossEntropy(output, targets[i]);
+ *     });
+ * optimizer.step();
+ * \endcode
+ *
+ * The micro-batches are scheduled one-forward-one-backward (1F1B): after the
+ * forward passes of the micro-batches in flight downstream, each stage
+ * alternates the forward pass of a micro-batch with the backward pass of the
+ * oldest one, so that at most `P - stage` micro-batches keep their
+ * activations alive on a stage, rather than all of them.
+ *
+ * A stage takes a single Variable and returns a single Variable, whose
+ * dimensions and type are sent ahead of its data: they may change from a
+ * micro-batch to the next.
+ */
+class Pipeline {
+ public:
+  /**
+   * Partitions the modules of `model` into `numStages` stages of consecutive
+   * modules, balanced by number of parameters. The stages share the modules
+   * of `model`: every process may build the whole model (e.g. from the same
+   * seed or checkpoint), then keep its stage only.
+   */
+  static std::vector<std::shared_ptr<Sequential>> partition(
+      const Container& model,
+      int numStages);
+
+  /**
+   * @param[in] stage the stage of the pipeline run by this process, the stage
+   * `getWorldRank() % getPipelineStages()`
+   * @param[in] reducer the reducer to which the parameters of `stage` add
+   * their gradients, if any, enabled for the last backward pass of a step
+   */
+  explicit Pipeline(
+      std::shared_ptr<Module> stage,
+      std::shared_ptr<DeferredReducer> reducer = nullptr);
+
+  /**
+   * Runs the forward and backward passes of `numMicroBatches` micro-batches
+   * through the pipeline, adding the gradients of the micro-batches to those
+   * of the parameters of the stage. All the processes of a pipeline replica
+   * must run the same number of micro-batches.
+   *
+   * @param[in] numMicroBatches the number of micro-batches of the step
+   * @param[in] input returns the input of a micro-batch, called by the first
+   * stage only
+   * @param[in] loss returns the scalar loss of a micro-batch from the output
+   * of the last stage, called by the last stage only
+   * @return the sum of the losses of the micro-batches on the last stage, an
+   * empty Variable on the other stages
+   */
+  Variable trainStep(
+      int numMicroBatches,
+      const std::function<Variable(int)>& input,
+      const std::function<Variable(const Variable&, int)>& loss);
+
+  std::shared_ptr<Module> module() const {
+    return stage_;
+  }
+
+  int stage() const {
+    return stageIndex_;
+  }
+
+  int numStages() const {
+    return numStages_;
+  }
+
+  bool isFirstStage() const {
+    return stageIndex_ == 0;
+  }
+
+  bool isLastStage() const {
+    return stageIndex_ == numStages_ - 1;
+  }
+
+ private:
+  std::shared_ptr<Module> stage_;
+  std::shared_ptr<DeferredReducer> reducer_;
+  int numStages_;
+  int stageIndex_;
+  int rank_;
+};
+
+} // namespace fl
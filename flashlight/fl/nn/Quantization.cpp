@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/nn/Quantization.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "flashlight/fl/autograd/Functions.h"
+#include "flashlight/fl/autograd/Variable.h"
+#include "flashlight/fl/nn/modules/Container.h"
+#include "flashlight/fl/nn/modules/Conv2D.h"
+#include "flashlight/fl/nn/modules/Linear.h"
+
+namespace fl {
+
+namespace {
+
+// Symmetric quantization of `weights` with a scale per index along
+// `outputDim`
+std::shared_ptr<Int8Quantization> quantizeWeights(
+    const af::array& weights,
+    int outputDim) {
+  auto w = weights.as(f32);
+  auto numOutputs = w.dims(outputDim);
+  af::array maxAbs;
+  if (outputDim == 0) {
+    maxAbs = af::max(af::abs(moddims(w, af::dim4(numOutputs, -1))), 1);
+  } else {
+    maxAbs = af::max(af::abs(moddims(w, af::dim4(-1, numOutputs))), 0);
+  }
+  maxAbs = af::flat(maxAbs);
+  // All-zero channels keep a scale of 1
+  auto scales = af::select(maxAbs > 0, maxAbs / 127, 1.0).as(f32);
+
+  af::dim4 scaleDims(1, 1, 1, 1);
+  scaleDims[outputDim] = numOutputs;
+  auto q = af::round(w / detail::tileAs(moddims(scales, scaleDims), w.dims()));
+  auto result = std::make_shared<Int8Quantization>();
+  // Two's complement bytes of the int8 values
+  result->weights = af::select(q < 0, q + 256, q).as(u8);
+  result->weightScales = scales;
+  // Calibration starts
+  result->calibrationMaxAbs = 0;
+  return result;
+}
+
+void collectQuantizable(
+    Module& module,
+    std::vector<Linear*>& linears,
+    std::vector<Conv2D*>& convs) {
+  if (auto linear = dynamic_cast<Linear*>(&module)) {
+    linears.push_back(linear);
+  } else if (auto conv = dynamic_cast<Conv2D*>(&module)) {
+    convs.push_back(conv);
+  } else if (auto container = dynamic_cast<Container*>(&module)) {
+    for (auto& child : container->modules()) {
+      collectQuantizable(*child, linears, convs);
+    }
+  }
+}
+
+void finishCalibration(Int8Quantization& quantization) {
+  auto maxAbs = quantization.calibrationMaxAbs;
+  quantization.inputScale = maxAbs > 0 ? maxAbs / 127 : 1;
+  quantization.calibrationMaxAbs = -1;
+}
+
+} // namespace
+
+bool Int8Quantization::observe(const Variable& input) {
+  if (calibrationMaxAbs < 0) {
+    return true;
+  }
+  calibrationMaxAbs = std::max(
+      calibrationMaxAbs,
+      af::max<float>(af::abs(input.array().as(f32))));
+  return false;
+}
+
+void quantize(Module& module, const std::function<void()>& calibrate) {
+  std::vector<Linear*> linears;
+  std::vector<Conv2D*> convs;
+  collectQuantizable(module, linears, convs);
+  for (auto linear : linears) {
+    linear->setInt8Quantization(
+        quantizeWeights(linear->param(0).array(), 0));
+  }
+  for (auto conv : convs) {
+    conv->setInt8Quantization(quantizeWeights(conv->param(0).array(), 3));
+  }
+
+  module.eval();
+  calibrate();
+
+  for (auto linear : linears) {
+    finishCalibration(*linear->int8Quantization());
+  }
+  for (auto conv : convs) {
+    finishCalibration(*conv->int8Quantization());
+  }
+}
+
+} // namespace fl
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <functional>
+
+#include <arrayfire.h>
+
+#include "flashlight/fl/common/Serialization.h"
+
+namespace fl {
+
+class Module;
+class Variable;
+
+/**
+ * Int8 weights and scales of a quantized `Linear` or `Conv2D` module, set by
+ * `fl::quantize`. The weights are quantized symmetrically per output channel
+ * (\f$w \approx q \cdot weightScales\f$, \f$q\f$ in [-127, 127]), and inputs
+ * with a single scale calibrated on sample data.
+ */
+struct Int8Quantization {
+  /// int8 weights, stored as the bytes of an u8 array
+  af::array weights;
+  /// f32 scale of each output channel
+  af::array weightScales;
+  float inputScale{1};
+  /// Largest absolute input seen during calibration, or -1 outside of it
+  float calibrationMaxAbs{-1};
+
+  /**
+   * Returns whether `input` is to be processed with the int8 weights: they
+   * are not during calibration, which records the range of the input.
+   */
+  bool observe(const Variable& input);
+
+ private:
+  FL_SAVE_LOAD(weights, weightScales, inputScale)
+};
+
+/**
+ * Post-training int8 quantization of the `Linear` and `Conv2D` modules (and
+ * subclasses) contained in `module`: quantizes their weights, then calls
+ * `calibrate`, which should run the module in eval mode on representative
+ * inputs to record the range of the input of each quantized module.
+ *
+ * Quantized modules compute their output in eval mode with int8 kernels where
+ * the backend has them (see `quantizedLinear`), and keep their f32 weights,
+ * used for training. Quantization is serialized with the modules.
+ */
+void quantize(Module& module, const std::function<void()>& calibrate);
+
+} // namespace fl
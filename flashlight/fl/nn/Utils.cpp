@@ -6,9 +6,13 @@
  */
 
 #include <array>
+#include <mutex>
+#include <random>
+#include <stdexcept>
 
 #include "flashlight/fl/nn/Utils.h"
 
+#include "flashlight/fl/autograd/Functions.h"
 #include "flashlight/fl/autograd/Utils.h"
 #include "flashlight/fl/common/Utils.h"
 
@@ -97,6 +101,46 @@ int derivePadding(int inSz, int filterSz, int stride, int pad, int dilation) {
   return pad;
 }
 
+Variable takeStreamFrames(
+    Variable& buffer,
+    const Variable& input,
+    int n,
+    int dim /* = 0 */) {
+  auto frames = buffer.isempty() ? input : concatenate({buffer, input}, dim);
+  int len = frames.dims(dim);
+  if (n > len) {
+    throw std::invalid_argument("takeStreamFrames: not enough frames");
+  }
+  auto slice = [&](int first, int last) {
+    std::array<af::seq, 4> idx = {af::span, af::span, af::span, af::span};
+    idx[dim] = af::seq(first, last);
+    return frames(idx[0], idx[1], idx[2], idx[3]);
+  };
+  buffer = n < len ? Variable(slice(n, len - 1).array(), false) : Variable();
+  return n > 0 ? slice(0, n - 1) : Variable();
+}
+
+namespace {
+
+std::mutex layerDropMutex;
+// Fixed default seed, the same on all the processes
+std::mt19937_64 layerDropEngine;
+
+} // namespace
+
+bool dropLayer(double p) {
+  if (p <= 0) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(layerDropMutex);
+  return std::uniform_real_distribution<double>(0, 1)(layerDropEngine) < p;
+}
+
+void setLayerDropSeed(uint64_t seed) {
+  std::lock_guard<std::mutex> lock(layerDropMutex);
+  layerDropEngine.seed(seed);
+}
+
 af::array join(
     const std::vector<af::array>& inputs,
     double padValue /* = 0.0 */,
@@ -64,6 +64,34 @@ struct IntOrPadMode {
 
 int derivePadding(int inSz, int filterSz, int stride, int pad, int dilation);
 
+/**
+ * Appends `input` to the frames of a stream kept in `buffer` along dimension
+ * `dim`, and returns the first `n` of them, keeping the others in `buffer`.
+ * Aligns the inputs of streaming modules with their delayed outputs, e.g. for
+ * residual connections (see `Module::forwardChunk()`).
+ */
+Variable takeStreamFrames(
+    Variable& buffer,
+    const Variable& input,
+    int n,
+    int dim = 0);
+
+/**
+ * Draws whether a layer is dropped with probability `p` for the current
+ * forward pass (layer drop, or stochastic depth), without launching a kernel
+ * or synchronizing with the device. The draws come from a host generator,
+ * separate from the ArrayFire one, which only advances when `p > 0`: the
+ * processes which run the same layers in the same order (e.g. data-parallel
+ * replicas) drop the same layers, so that the parameters of a dropped layer
+ * have no gradient on any of them and their gradient reduction is skipped,
+ * whatever else the processes draw.
+ */
+bool dropLayer(double p);
+
+/// Reseeds the generator of `dropLayer`, e.g. with the same seed on all the
+/// processes to resume training
+void setLayerDropSeed(uint64_t seed);
+
 /// packs a list of arrays (possibly of different dimensions) to a single array
 /// by padding them to same dimensions
 af::array join(
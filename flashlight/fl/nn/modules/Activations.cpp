@@ -71,6 +71,16 @@ std::string ReLU::prettyString() const {
   return "ReLU";
 }
 
+GELU::GELU() = default;
+
+Variable GELU::forward(const Variable& input) {
+  return gelu(input);
+}
+
+std::string GELU::prettyString() const {
+  return "GELU";
+}
+
 ReLU6::ReLU6() = default;
 
 Variable ReLU6::forward(const Variable& input) {
@@ -110,6 +110,23 @@ class ReLU : public UnaryModule {
   FL_SAVE_LOAD_WITH_BASE(UnaryModule)
 };
 
+/**
+ * Applies the [Gaussian error linear
+ * unit](https://arxiv.org/abs/1606.08415) function element-wise to a
+ * `Variable`, with the tanh approximation of `fl::gelu`.
+ */
+class GELU : public UnaryModule {
+ public:
+  GELU();
+
+  Variable forward(const Variable& input) override;
+
+  std::string prettyString() const override;
+
+ private:
+  FL_SAVE_LOAD_WITH_BASE(UnaryModule)
+};
+
 /**
  * Applies the [rectified linear
  * unit capped at
@@ -362,6 +379,7 @@ class Swish : public UnaryModule {
 CEREAL_REGISTER_TYPE(fl::Sigmoid)
 CEREAL_REGISTER_TYPE(fl::Tanh)
 CEREAL_REGISTER_TYPE(fl::ReLU)
+CEREAL_REGISTER_TYPE(fl::GELU)
 CEREAL_REGISTER_TYPE(fl::ReLU6)
 CEREAL_REGISTER_TYPE(fl::LeakyReLU)
 CEREAL_REGISTER_TYPE(fl::PReLU)
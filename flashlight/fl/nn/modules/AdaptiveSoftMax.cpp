@@ -5,6 +5,8 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <algorithm>
+#include <limits>
 #include <stdexcept>
 #include <vector>
 
@@ -14,6 +16,14 @@
 
 namespace fl {
 
+namespace {
+
+Variable castTo(const Variable& var, af::dtype type) {
+  return var.type() == type ? var : var.as(type);
+}
+
+} // namespace
+
 AdaptiveSoftMax::AdaptiveSoftMax(
     int inputSize,
     const std::vector<int>& cutoff,
@@ -57,13 +67,14 @@ Variable AdaptiveSoftMax::getFullLogProb(
     const Variable& headOutput) const {
   auto outputSize = cutoff_[cutoff_.size() - 1];
   auto batchSize = inputs.dims(1);
-  af::array output(af::dim4(outputSize, batchSize), inputs.type());
+  af::array output(af::dim4(outputSize, batchSize), headOutput.type());
 
   output.rows(0, cutoff_[0] + cutoff_.size() - 2) = headOutput.array();
 
   for (int i = cutoff_.size() - 2; i >= 0; i--) {
     auto tailOutput = matmul(params_[1 + i * 2], inputs);
-    tailOutput = matmul(params_[2 + i * 2], tailOutput);
+    tailOutput =
+        castTo(matmul(params_[2 + i * 2], tailOutput), headOutput.type());
     tailOutput = logSoftmax(tailOutput, 0) +
         tileAs(headOutput.row(i + cutoff_[0]), tailOutput);
     output.rows(cutoff_[i], cutoff_[i + 1] - 1) = tailOutput.array();
@@ -80,8 +91,10 @@ Variable AdaptiveSoftMax::forward(const Variable& inputs) {
     throw std::invalid_argument("invalid input dimension for AdaptiveSoftMax");
   }
 
-  auto inputsFlattened = moddims(inputs, af::dim4(inputSize, -1, 1, 1));
-  auto headOutput = logSoftmax(matmul(params_[0], inputsFlattened), 0);
+  auto inputsFlattened = castTo(
+      moddims(inputs, af::dim4(inputSize, -1, 1, 1)), params_[0].type());
+  auto headOutput = logSoftmax(
+      castTo(matmul(params_[0], inputsFlattened), inputs.type()), 0);
 
   auto ret = getFullLogProb(inputsFlattened, headOutput);
   return moddims(
@@ -92,41 +105,92 @@ Variable AdaptiveSoftMax::forward(const Variable& inputs) {
 Variable AdaptiveSoftMax::predict(const Variable& inputs) const {
   // input -- [C, .. , N]
   // return -- [1, .. , N]
+  return topK(inputs, 1).second;
+}
+
+std::pair<Variable, Variable> AdaptiveSoftMax::topK(
+    const Variable& inputs,
+    int k) const {
+  // input -- [C, .. , N]
+  // return -- [k, .. , N]
   auto inputSize = inputs.dims(0);
   if (inputSize != params_[0].dims(1)) {
     throw std::invalid_argument(
         "invalid input dimension for AdaptiveSoftMaxLoss");
   }
+  if (k <= 0 || k > cutoff_.back()) {
+    throw std::invalid_argument("invalid k for AdaptiveSoftMax::topK");
+  }
 
-  auto inputsFlattened = moddims(inputs, af::dim4(inputSize, -1, 1, 1));
-  auto headOutput = matmul(params_[0], inputsFlattened);
-  af::array maxValue, prediction;
-  af::max(maxValue, prediction, headOutput.array(), 0);
-
-  auto notInShortlist = (prediction >= cutoff_[0]);
-  Variable ret = Variable(prediction, false);
-  if (af::anyTrue<bool>(notInShortlist)) {
-    headOutput = logSoftmax(headOutput, 0);
-    auto logProbTailPositions = getFullLogProb(
-        inputsFlattened(af::span, notInShortlist),
-        headOutput(af::span, notInShortlist));
-    af::array maxValueTailPositions, predictionTailPositions;
-    af::max(
-        maxValueTailPositions,
-        predictionTailPositions,
-        logProbTailPositions.array(),
-        0);
-    ret.array()(notInShortlist) = predictionTailPositions;
+  auto inputsFlattened =
+      af::moddims(inputs.array(), af::dim4(inputSize, -1, 1, 1));
+  auto batchSize = inputsFlattened.dims(1);
+  auto matmulArr = [](const Variable& weight, const af::array& input) {
+    return af::matmul(weight.array(), input.as(weight.type()));
+  };
+  auto headLogProb =
+      logSoftmax(Variable(matmulArr(params_[0], inputsFlattened), false), 0)
+          .array()
+          .as(f32);
+
+  // The best classes of the shortlist, padded to k
+  af::array values = af::constant(
+      -std::numeric_limits<float>::infinity(), af::dim4(k, batchSize));
+  af::array indices = af::constant(0, af::dim4(k, batchSize), u32);
+  int kHead = std::min(k, cutoff_[0]);
+  af::array headValues, headIndices;
+  af::topk(
+      headValues, headIndices, headLogProb.rows(0, cutoff_[0] - 1), kHead, 0);
+  values.rows(0, kHead - 1) = headValues;
+  indices.rows(0, kHead - 1) = headIndices;
+
+  for (int i = 0; i < cutoff_.size() - 1; i++) {
+    auto clusterLogProb = headLogProb.row(cutoff_[0] + i);
+    auto active = af::where(clusterLogProb > values.row(k - 1));
+    if (active.isempty()) {
+      continue;
+    }
+    int numActive = active.elements();
+    auto tailOutput = matmulArr(
+        params_[2 + i * 2],
+        matmulArr(params_[1 + i * 2], inputsFlattened(af::span, active)));
+    auto tailLogProb =
+        logSoftmax(Variable(tailOutput, false), 0).array().as(f32);
+    tailLogProb = tailLogProb +
+        af::tile(clusterLogProb(active).T(), tailLogProb.dims(0));
+    int kTail = std::min<int>(k, tailLogProb.dims(0));
+    af::array tailValues, tailIndices;
+    af::topk(tailValues, tailIndices, tailLogProb, kTail, 0);
+
+    // Merges the k best classes so far with the ones of the cluster
+    auto mergedValues = af::join(0, values(af::span, active), tailValues);
+    auto mergedIndices = af::join(
+        0, indices(af::span, active), tailIndices + cutoff_[i]);
+    af::array bestValues, bestPositions;
+    af::topk(bestValues, bestPositions, mergedValues, k, 0);
+    auto offsets = af::tile(
+        af::range(af::dim4(1, numActive), 1, u32) * (k + kTail), k);
+    values(af::span, active) = bestValues;
+    indices(af::span, active) = af::moddims(
+        mergedIndices(af::flat(bestPositions + offsets)),
+        bestPositions.dims());
   }
-  return moddims(
-      ret,
-      af::dim4(ret.dims(0), inputs.dims(1), inputs.dims(2), inputs.dims(3)));
+
+  af::dim4 outDims(k, inputs.dims(1), inputs.dims(2), inputs.dims(3));
+  return {Variable(af::moddims(values, outDims), false),
+          Variable(af::moddims(indices, outDims), false)};
 }
 
 std::vector<int> AdaptiveSoftMax::getCutoff() const {
   return cutoff_;
 }
 
+void AdaptiveSoftMax::setWeightType(af::dtype type) {
+  for (auto& param : params_) {
+    param.array() = param.array().as(type);
+  }
+}
+
 std::string AdaptiveSoftMax::prettyString() const {
   std::ostringstream ss;
   ss << "Adaptive Softmax (";
@@ -34,7 +34,8 @@ class AdaptiveSoftMax : public UnaryModule {
   /**
    * Compute the output of the entire distribution.
    *
-   * @param inputs values for each class to compute probabilities over
+   * @param inputs values for each class to compute probabilities over, in the
+   * type of the weights
    * @param head_output the output of the first frequency bucket (the 'top'
    * bucket)
    * @returns `Variable` containing the log probabilities over the full
@@ -92,8 +93,33 @@ class AdaptiveSoftMax : public UnaryModule {
    * containing the classes with the highest probabilities, over each sample.
    */
   Variable predict(const Variable& inputs) const;
+
+  /**
+   * Computes the `k` classes with the highest log-probabilities for each
+   * example in a given input. The log-probability of a tail cluster in the
+   * head bounds the ones of its classes: a tail cluster is only evaluated for
+   * the examples where it's above the k-th best log-probability found in the
+   * head and the previous clusters.
+   *
+   * @param inputs a Variable with size [\f$C_{in}\f$, \f$B_1\f$, \f$B_2\f$,
+   * \f$B_3\f$].
+   * @param k the number of classes, at most the number of classes.
+   * @return a pair of Variables with shape [\f$k\f$, \f$B_1\f$, \f$B_2\f$,
+   * \f$B_3\f$]: the log-probabilities in descending order, and the classes.
+   */
+  std::pair<Variable, Variable> topK(const Variable& inputs, int k) const;
+
   std::vector<int> getCutoff() const;
 
+  /**
+   * Stores the weights in `type`, e.g. f16 to halve the memory traffic of the
+   * projections, which are computed in this type; the log-probabilities are
+   * still computed in the type of the input. The weights are cast in place,
+   * so that an `AdaptiveSoftMaxLoss` sharing them uses them too (see
+   * `MasterWeightsOptimizer` to keep f32 weights for the updates).
+   */
+  void setWeightType(af::dtype type);
+
   std::string prettyString() const override;
 };
 
@@ -7,11 +7,20 @@
 
 #include "flashlight/fl/nn/modules/BatchNorm.h"
 
+#include <atomic>
+#include <stdexcept>
+
 #include "flashlight/fl/autograd/Functions.h"
 #include "flashlight/fl/nn/Init.h"
 
 namespace fl {
 
+namespace {
+
+std::atomic<bool> fuseBatchNormActivation{true};
+
+} // namespace
+
 BatchNorm::BatchNorm(
     int featAxis,
     int featSize,
@@ -44,7 +53,7 @@ BatchNorm::BatchNorm(
   initialize();
 }
 
-Variable BatchNorm::forward(const Variable& input) {
+double BatchNorm::updateAverageFactor() {
   double avgFactor = 0.0;
 
   if (train_ && trackStats_) {
@@ -55,6 +64,11 @@ Variable BatchNorm::forward(const Variable& input) {
       avgFactor = momentum_;
     }
   }
+  return avgFactor;
+}
+
+Variable BatchNorm::forward(const Variable& input) {
+  double avgFactor = updateAverageFactor();
 
   auto paramsType =
       (input.type() == af::dtype::f16) ? af::dtype::f32 : input.type();
@@ -70,6 +84,64 @@ Variable BatchNorm::forward(const Variable& input) {
       epsilon_);
 }
 
+Variable BatchNorm::forwardRelu(
+    const Variable& input,
+    const Variable& residual /* = Variable() */) {
+  if (!fuseActivation()) {
+    auto out = forward(input);
+    if (!residual.isempty()) {
+      out = out + residual;
+    }
+    return relu(out);
+  }
+  double avgFactor = updateAverageFactor();
+
+  auto paramsType =
+      (input.type() == af::dtype::f16) ? af::dtype::f32 : input.type();
+  return batchnormRelu(
+      input,
+      residual,
+      params_.empty() ? Variable(af::array(0, paramsType), false) : params_[0],
+      params_.empty() ? Variable(af::array(0, paramsType), false) : params_[1],
+      runningMean_,
+      runningVar_,
+      featAxis_,
+      train_ || (!trackStats_),
+      avgFactor,
+      epsilon_);
+}
+
+void BatchNorm::setFuseActivation(bool fuse) {
+  fuseBatchNormActivation = fuse;
+}
+
+bool BatchNorm::fuseActivation() {
+  return fuseBatchNormActivation;
+}
+
+const std::vector<int>& BatchNorm::featAxis() const {
+  return featAxis_;
+}
+
+bool BatchNorm::trackStats() const {
+  return trackStats_;
+}
+
+std::pair<af::array, af::array> BatchNorm::evalScaleShift() const {
+  if (!trackStats_) {
+    throw std::invalid_argument(
+        "BatchNorm::evalScaleShift - no running statistics are tracked");
+  }
+  auto scale = 1.0 / af::sqrt(runningVar_.array() + epsilon_);
+  auto shift = -runningMean_.array() * scale;
+  if (affine_) {
+    auto weight = af::flat(params_[0].array());
+    scale = weight * scale;
+    shift = weight * shift + af::flat(params_[1].array());
+  }
+  return {scale.as(f32), shift.as(f32)};
+}
+
 void BatchNorm::initialize() {
   if (trackStats_) {
     runningMean_ = constant(0.0, featSize_, af::dtype::f32, false);
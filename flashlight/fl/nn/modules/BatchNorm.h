@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <utility>
+
 #include "flashlight/fl/nn/modules/Module.h"
 
 namespace fl {
@@ -54,6 +56,10 @@ class BatchNorm : public UnaryModule {
    */
   void initialize();
 
+  // Counts the batch if tracking statistics in train mode, and returns the
+  // factor of the running average
+  double updateAverageFactor();
+
  public:
   /**
    * Constructs a BatchNorm module.
@@ -116,6 +122,38 @@ class BatchNorm : public UnaryModule {
 
   Variable forward(const Variable& input) override;
 
+  /**
+   * Computes `relu(forward(input) + residual)` (`residual` may be empty) with
+   * `fl::batchnormRelu`, which fuses the three operators on cuDNN, unless
+   * fusion is disabled with `setFuseActivation()`.
+   */
+  Variable forwardRelu(
+      const Variable& input,
+      const Variable& residual = Variable());
+
+  /**
+   * Whether `forwardRelu()` of all the BatchNorm modules fuses the
+   * normalization with the addition and the activation (the default), e.g.
+   * to compare with the separate operators.
+   */
+  static void setFuseActivation(bool fuse);
+
+  static bool fuseActivation();
+
+  const std::vector<int>& featAxis() const;
+
+  /**
+   * Whether the module normalizes with running statistics in eval mode.
+   */
+  bool trackStats() const;
+
+  /**
+   * Returns the scale and shift of each feature applied in eval mode
+   * (\f$ y = scale \times x + shift \f$), from the running statistics and
+   * \f$\gamma\f$, \f$\beta\f$. Requires `trackStats`.
+   */
+  std::pair<af::array, af::array> evalScaleShift() const;
+
   std::string prettyString() const override;
 };
 
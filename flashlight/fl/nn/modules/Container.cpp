@@ -15,10 +15,32 @@
 
 #include "flashlight/fl/nn/modules/Container.h"
 
+#include <typeinfo>
+
 #include "flashlight/fl/autograd/Variable.h"
+#include "flashlight/fl/nn/ModuleProfiler.h"
+#include "flashlight/fl/nn/modules/Activations.h"
+#include "flashlight/fl/nn/modules/Linear.h"
 
 namespace fl {
 
+namespace {
+
+// Whether `module` is an activation which a preceding `Linear` fuses
+bool isFusedActivation(const Module& module, LinearActivation& activation) {
+  if (typeid(module) == typeid(ReLU)) {
+    activation = LinearActivation::RELU;
+    return true;
+  }
+  if (typeid(module) == typeid(GELU)) {
+    activation = LinearActivation::GELU;
+    return true;
+  }
+  return false;
+}
+
+} // namespace
+
 Container::Container() = default;
 
 ModulePtr Container::module(int id) const {
@@ -29,6 +51,40 @@ std::vector<ModulePtr> Container::modules() const {
   return modules_;
 }
 
+void Container::setModule(int id, ModulePtr module) {
+  if (!module) {
+    throw std::invalid_argument("can't add null Module to Container");
+  }
+  if (id < 0 || id >= modules_.size()) {
+    throw std::out_of_range("Container::setModule - invalid module index");
+  }
+  modules_[id] = module;
+  // Parameters of the container itself keep their position relative to the
+  // parameters of the modules
+  std::vector<Variable> params;
+  std::unordered_map<int, std::tuple<int, int>> childParamIdx;
+  int nextModule = 0;
+  auto addModuleParams = [&](int end) {
+    for (; nextModule < end; ++nextModule) {
+      for (int j = 0; j < modules_[nextModule]->params().size(); ++j) {
+        childParamIdx[params.size()] = std::make_tuple(nextModule, j);
+        params.push_back(modules_[nextModule]->param(j));
+      }
+    }
+  };
+  for (int i = 0; i < params_.size(); ++i) {
+    auto indices = childParamIdx_.find(i);
+    if (indices == childParamIdx_.end()) {
+      params.push_back(params_[i]);
+    } else {
+      addModuleParams(std::get<0>(indices->second) + 1);
+    }
+  }
+  addModuleParams(modules_.size());
+  childParamIdx_ = std::move(childParamIdx);
+  params_ = std::move(params);
+}
+
 void Container::train() {
   train_ = true;
 
@@ -67,27 +123,79 @@ void Container::setParams(const Variable& var, int position) {
   }
 }
 
+void Container::resetStreamingState() {
+  for (auto& module : modules_) {
+    module->resetStreamingState();
+  }
+}
+
+std::vector<Variable> Container::streamingState() const {
+  std::vector<Variable> state;
+  for (const auto& module : modules_) {
+    auto moduleState = module->streamingState();
+    state.insert(state.end(), moduleState.begin(), moduleState.end());
+  }
+  return state;
+}
+
+void Container::setStreamingState(const std::vector<Variable>& state) {
+  auto it = state.begin();
+  for (auto& module : modules_) {
+    // The state of each module has a fixed number of variables
+    size_t size = module->streamingState().size();
+    if (static_cast<size_t>(state.end() - it) < size) {
+      throw std::invalid_argument(
+          "Container::setStreamingState: too few state variables");
+    }
+    module->setStreamingState(std::vector<Variable>(it, it + size));
+    it += size;
+  }
+  if (it != state.end()) {
+    throw std::invalid_argument(
+        "Container::setStreamingState: too many state variables");
+  }
+}
+
 Sequential::Sequential() = default;
 
 std::vector<Variable> Sequential::forward(const std::vector<Variable>& input) {
   auto output = input;
-  for (auto& module : modules_) {
-    output = module->forward(output);
+  for (size_t i = 0; i < modules_.size(); ++i) {
+    // A `Linear` (but not a subclass, whose forward pass may differ) and the
+    // activation which follows it are forwarded as one fused module
+    LinearActivation activation;
+    if (i + 1 < modules_.size() && output.size() == 1 &&
+        typeid(*modules_[i]) == typeid(Linear) &&
+        isFusedActivation(*modules_[i + 1], activation)) {
+      auto& linear = static_cast<Linear&>(*modules_[i++]);
+      output = {linear.forwardActivation(output.front(), activation)};
+      continue;
+    }
+    output = forwardModule(*modules_[i], output);
   }
   return output;
 }
 
 Variable Sequential::forward(const Variable& input) {
-  std::vector<Variable> output = {input};
-  for (auto& module : modules_) {
-    output = module->forward(output);
-  }
+  auto output = Sequential::forward(std::vector<Variable>{input});
   if (output.size() != 1) {
     throw std::invalid_argument("Module output size is not 1");
   }
   return output.front();
 }
 
+std::vector<Variable> Sequential::forwardChunk(
+    const std::vector<Variable>& input) {
+  auto output = input;
+  for (auto& module : modules_) {
+    output = module->forwardChunk(output);
+    if (output.empty() || output.front().isempty()) {
+      break;
+    }
+  }
+  return output;
+}
+
 Variable Sequential::operator()(const Variable& input) {
   return this->forward(input);
 }
@@ -94,6 +94,16 @@ class Container : public Module {
    */
   std::vector<ModulePtr> modules() const;
 
+  /**
+   * Replaces the module at the specified index in the container's
+   * `modules_`, and updates the container's `params_` with the parameters of
+   * the modules, which may have been changed.
+   *
+   * @param id the index of the module to replace
+   * @param module the new module
+   */
+  void setModule(int id, ModulePtr module);
+
   /**
    * Switches all modules in the `Container` into train mode. See `Module`.
    */
@@ -116,6 +126,20 @@ class Container : public Module {
    * `params_`
    */
   void setParams(const Variable& var, int position) override;
+
+  /**
+   * Clears the streaming state of all modules in the `Container`. See
+   * `Module::forwardChunk()`.
+   */
+  void resetStreamingState() override;
+
+  /**
+   * The streaming states of all modules in the `Container`, in order. See
+   * `Module::streamingState()`.
+   */
+  std::vector<Variable> streamingState() const override;
+
+  void setStreamingState(const std::vector<Variable>& state) override;
 };
 
 /**
@@ -159,6 +183,13 @@ class Sequential : public Container {
 
   Variable operator()(const Variable& input);
 
+  /**
+   * Forwards a chunk of a stream through each `Module` in order with
+   * `forwardChunk()`. Stops at the first empty output, which is returned.
+   */
+  std::vector<Variable> forwardChunk(
+      const std::vector<Variable>& input) override;
+
   /**
    * Generates a stringified representation of the `Sequential` by concatenating
    * string representations for each contained `Module`
@@ -103,11 +103,24 @@ Conv2D::Conv2D(
 }
 
 Variable Conv2D::forward(const Variable& input) {
-  auto px = derivePadding(input.dims(0), xFilter_, xStride_, xPad_, xDilation_);
-  auto py = derivePadding(input.dims(1), yFilter_, yStride_, yPad_, yDilation_);
+  int xDim = layout_ == ImageLayout::CWHN ? 1 : 0;
+  auto px = derivePadding(
+      input.dims(xDim), xFilter_, xStride_, xPad_, xDilation_);
+  auto py = derivePadding(
+      input.dims(xDim + 1), yFilter_, yStride_, yPad_, yDilation_);
   if (!(px >= 0 && py >= 0)) {
     throw std::invalid_argument("invalid padding for Conv2D");
   }
+  return convolve(input, px, py);
+}
+
+Variable Conv2D::convolve(const Variable& input, int px, int py) {
+  if (useInt8(input)) {
+    return int8Forward(input, px, py);
+  }
+  if (useDepthwiseConv1d(input, py)) {
+    return depthwiseConvolve(input, px, px);
+  }
 
   if (bias_) {
     return conv2d(
@@ -121,7 +134,8 @@ Variable Conv2D::forward(const Variable& input) {
         xDilation_,
         yDilation_,
         groups_,
-        benchmarks_);
+        benchmarks_,
+        layout_);
   } else {
     return conv2d(
         input,
@@ -133,8 +147,141 @@ Variable Conv2D::forward(const Variable& input) {
         xDilation_,
         yDilation_,
         groups_,
-        benchmarks_);
+        benchmarks_,
+        layout_);
+  }
+}
+
+bool Conv2D::useDepthwiseConv1d(const Variable& input, int py) const {
+  return layout_ == ImageLayout::WHCN && groups_ > 1 &&
+      params_[0].dims(2) == 1 && yFilter_ == 1 && yStride_ == 1 && py == 0;
+}
+
+Variable Conv2D::depthwiseConvolve(
+    const Variable& input,
+    int leftPad,
+    int rightPad) {
+  return depthwiseConv1d(
+      input,
+      params_[0].as(input.type()),
+      bias_ ? params_[1].as(input.type()) : Variable(),
+      leftPad,
+      rightPad,
+      xStride_,
+      xDilation_);
+}
+
+int Conv2D::streamingLeftPadding() const {
+  return derivePadding(xStride_, xFilter_, xStride_, xPad_, xDilation_);
+}
+
+std::vector<Variable> Conv2D::forwardChunk(
+    const std::vector<Variable>& inputs) {
+  if (inputs.size() != 1) {
+    throw std::invalid_argument("UnaryModule expects only one input");
+  }
+  if (layout_ != ImageLayout::WHCN) {
+    throw std::invalid_argument("Conv2D: streaming requires the WHCN layout");
+  }
+  const auto& input = inputs[0];
+  auto py = derivePadding(input.dims(1), yFilter_, yStride_, yPad_, yDilation_);
+  auto px = streamingLeftPadding();
+  if (!(px >= 0 && py >= 0)) {
+    throw std::invalid_argument("invalid padding for Conv2D");
+  }
+  if (!streamStarted_ && px > 0) {
+    auto dims = input.dims();
+    dims[0] = px;
+    streamBuffer_ = Variable(af::constant(0, dims, input.type()), false);
+  }
+  streamStarted_ = true;
+
+  auto x = streamBuffer_.isempty()
+      ? input
+      : concatenate({streamBuffer_, input}, 0);
+  int len = x.dims(0);
+  int span = (xFilter_ - 1) * xDilation_ + 1;
+  int nOut = len < span ? 0 : (len - span) / xStride_ + 1;
+  // The next output starts at frame nOut * xStride_
+  int next = nOut * xStride_;
+  streamBuffer_ = next < len
+      ? Variable(x.array().rows(next, len - 1), false)
+      : Variable();
+  if (nOut == 0) {
+    return {Variable()};
+  }
+  return {convolve(x, 0, py)};
+}
+
+void Conv2D::resetStreamingState() {
+  streamBuffer_ = Variable();
+  streamStarted_ = false;
+}
+
+std::vector<Variable> Conv2D::streamingState() const {
+  return {streamBuffer_};
+}
+
+void Conv2D::setStreamingState(const std::vector<Variable>& state) {
+  if (state.size() != 1) {
+    throw std::invalid_argument("Conv2D: invalid streaming state");
   }
+  streamBuffer_ = state[0];
+  streamStarted_ = true;
+}
+
+void Conv2D::setLayout(ImageLayout layout) {
+  layout_ = layout;
+}
+
+ImageLayout Conv2D::layout() const {
+  return layout_;
+}
+
+std::shared_ptr<Int8Quantization> Conv2D::int8Quantization() const {
+  return int8_;
+}
+
+void Conv2D::setInt8Quantization(
+    std::shared_ptr<Int8Quantization> quantization) {
+  int8_ = quantization;
+}
+
+bool Conv2D::useInt8(const Variable& input) {
+  return int8_ && !train_ && int8_->observe(input);
+}
+
+Variable Conv2D::int8Forward(const Variable& input, int px, int py) {
+  if (layout_ == ImageLayout::CWHN) {
+    // The int8 convolution only supports the default layout
+    auto output = quantizedConv2d(
+        reorder(input, 1, 2, 0, 3),
+        int8_->weights,
+        int8_->weightScales,
+        int8_->inputScale,
+        bias_ ? params_[1] : Variable(),
+        xStride_,
+        yStride_,
+        px,
+        py,
+        xDilation_,
+        yDilation_,
+        groups_);
+    return reorder(output, 2, 0, 1, 3);
+  }
+  return quantizedConv2d(
+      input,
+      int8_->weights,
+      int8_->weightScales,
+      int8_->inputScale,
+      bias_ ? params_[1] : Variable(),
+      xStride_,
+      yStride_,
+      px,
+      py,
+      xDilation_,
+      yDilation_,
+      groups_);
 }
 
 void Conv2D::initialize() {
@@ -156,6 +303,31 @@ void Conv2D::initialize() {
   benchmarks_ = std::make_shared<detail::ConvBenchmarks>();
 }
 
+void Conv2D::foldScaleShift(const af::array& scale, const af::array& shift) {
+  if (scale.elements() != nOut_ || shift.elements() != nOut_) {
+    throw std::invalid_argument(
+        "Conv2D::foldScaleShift - expects a scale and shift per channel");
+  }
+  if (int8_) {
+    throw std::invalid_argument(
+        "Conv2D::foldScaleShift - can't fold into int8 weights");
+  }
+  auto weight = params_[0].array();
+  auto channelScale = af::moddims(scale, af::dim4(1, 1, 1, nOut_));
+  weight = weight *
+      af::tile(channelScale.as(weight.type()),
+               af::dim4(weight.dims(0), weight.dims(1), weight.dims(2)));
+  auto bias = af::moddims(shift, af::dim4(1, 1, nOut_)).as(weight.type());
+  if (bias_) {
+    bias = bias +
+        params_[1].array() *
+            af::moddims(scale, af::dim4(1, 1, nOut_)).as(weight.type());
+  }
+  bool calcGrad = params_[0].isCalcGrad();
+  params_ = {Variable(weight, calcGrad), Variable(bias, calcGrad)};
+  bias_ = true;
+}
+
 std::string Conv2D::prettyString() const {
   std::ostringstream ss;
   ss << "Conv2D";
@@ -174,12 +346,18 @@ std::string Conv2D::prettyString() const {
   }
   ss << ", " << xDilation_ << ", " << yDilation_;
   ss << ")";
+  if (layout_ == ImageLayout::CWHN) {
+    ss << " (channels-last)";
+  }
 
   if (bias_) {
     ss << " (with bias)";
   } else {
     ss << " (without bias)";
   }
+  if (int8_) {
+    ss << " (int8)";
+  }
   return ss.str();
 }
 
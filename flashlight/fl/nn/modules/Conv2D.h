@@ -8,6 +8,7 @@
 #pragma once
 
 #include "flashlight/fl/common/Defines.h"
+#include "flashlight/fl/nn/Quantization.h"
 #include "flashlight/fl/nn/Utils.h"
 #include "flashlight/fl/nn/modules/Module.h"
 
@@ -52,7 +53,9 @@ class Conv2D : public UnaryModule {
       fl::versioned(xDilation_, 1),
       fl::versioned(yDilation_, 1),
       bias_,
-      groups_)
+      groups_,
+      fl::versioned(int8_, 2),
+      fl::versioned(layout_, 3))
 
   void initialize();
 
@@ -65,6 +68,7 @@ class Conv2D : public UnaryModule {
   int xDilation_{1}, yDilation_{1}; // dilation
   bool bias_;
   int groups_;
+  ImageLayout layout_{ImageLayout::WHCN};
 
  public:
   /**
@@ -178,13 +182,88 @@ class Conv2D : public UnaryModule {
 
   Variable forward(const Variable& input) override;
 
+  /**
+   * Convolves the next chunk of a stream along the first (time) dimension:
+   * keeps the input frames still inside the receptive field of the next
+   * outputs, so the output is delayed by the right padding of the
+   * convolution. 'SAME' padding assumes streams of a multiple of the stride.
+   * See `Module::forwardChunk()`.
+   */
+  std::vector<Variable> forwardChunk(
+      const std::vector<Variable>& inputs) override;
+
+  void resetStreamingState() override;
+
+  /// The input frames kept for the next outputs, which may be empty
+  std::vector<Variable> streamingState() const override;
+
+  void setStreamingState(const std::vector<Variable>& state) override;
+
+  /**
+   * Sets the layout of the input and of the output, e.g.
+   * `ImageLayout::CWHN` for channels-last images. The weights keep their
+   * shape. Streaming (`forwardChunk()`) requires the default layout.
+   */
+  void setLayout(ImageLayout layout);
+
+  ImageLayout layout() const;
+
+  /**
+   * Returns the int8 quantization of the module, or null if it isn't
+   * quantized. See `fl::quantize`.
+   */
+  std::shared_ptr<Int8Quantization> int8Quantization() const;
+
+  void setInt8Quantization(std::shared_ptr<Int8Quantization> quantization);
+
+  /**
+   * Folds a scale and a shift of each output channel into the weights and the
+   * bias (e.g. a `BatchNorm` applied to the output in eval mode), adding a
+   * bias if the module has none.
+   */
+  void foldScaleShift(const af::array& scale, const af::array& shift);
+
   std::string prettyString() const override;
 
  protected:
   std::shared_ptr<detail::ConvBenchmarks> benchmarks_;
+  std::shared_ptr<Int8Quantization> int8_;
+
+  /**
+   * Whether `input` is convolved with the int8 weights: once the module is
+   * quantized and calibrated, in eval mode.
+   */
+  bool useInt8(const Variable& input);
+
+  /// Convolution with the int8 weights and the given padding
+  Variable int8Forward(const Variable& input, int px, int py);
+
+  /// Convolution with the given padding
+  Variable convolve(const Variable& input, int px, int py);
+
+  /**
+   * Whether `input` is convolved with the kernels of `depthwiseConv1d`: for
+   * a depthwise convolution (one input channel per group) of height 1, with
+   * no padding in the second dimension.
+   */
+  bool useDepthwiseConv1d(const Variable& input, int py) const;
+
+  /**
+   * Depthwise convolution of `input` with `leftPad` and `rightPad` frames of
+   * padding, see `useDepthwiseConv1d`.
+   */
+  Variable depthwiseConvolve(const Variable& input, int leftPad, int rightPad);
+
+  /// Padding on the left of the first dimension of streams
+  virtual int streamingLeftPadding() const;
+
+ private:
+  // Input frames kept between chunks of a stream
+  Variable streamBuffer_;
+  bool streamStarted_{false};
 };
 
 } // namespace fl
 
 CEREAL_REGISTER_TYPE(fl::Conv2D)
-CEREAL_CLASS_VERSION(fl::Conv2D, 1)
+CEREAL_CLASS_VERSION(fl::Conv2D, 3)
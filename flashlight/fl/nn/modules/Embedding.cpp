@@ -12,13 +12,21 @@
 
 namespace fl {
 
-Embedding::Embedding(int embeddingDim, int numEmbeddings)
-    : embeddingDim_(embeddingDim), numEmbeddings_(numEmbeddings) {
+Embedding::Embedding(
+    int embeddingDim,
+    int numEmbeddings,
+    bool sparseGrad /* = false */)
+    : embeddingDim_(embeddingDim),
+      numEmbeddings_(numEmbeddings),
+      sparseGrad_(sparseGrad) {
   initialize();
 }
 
-Embedding::Embedding(const Variable& w)
-    : UnaryModule({w}), embeddingDim_(w.dims(0)), numEmbeddings_(w.dims(1)) {}
+Embedding::Embedding(const Variable& w, bool sparseGrad /* = false */)
+    : UnaryModule({w}),
+      embeddingDim_(w.dims(0)),
+      numEmbeddings_(w.dims(1)),
+      sparseGrad_(sparseGrad) {}
 
 void Embedding::initialize() {
   double stdv = std::sqrt(1.0 / (double)embeddingDim_);
@@ -28,13 +36,27 @@ void Embedding::initialize() {
 }
 
 Variable Embedding::forward(const Variable& input) {
-  return embedding(input, params_[0]);
+  return embedding(input, params_[0], sparseGrad_);
+}
+
+void Embedding::setSparseGrad(bool sparseGrad) {
+  sparseGrad_ = sparseGrad;
+}
+
+void Embedding::setWeightType(af::dtype type) {
+  params_[0].array() = params_[0].array().as(type);
 }
 
 std::string Embedding::prettyString() const {
   std::ostringstream ss;
   ss << "Embedding (embeddings: " << numEmbeddings_
      << ") (dim: " << embeddingDim_ << ")";
+  if (params_[0].type() == af::dtype::f16) {
+    ss << " (f16)";
+  }
+  if (sparseGrad_) {
+    ss << " (sparse gradient)";
+  }
   return ss.str();
 }
 
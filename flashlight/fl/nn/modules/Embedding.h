@@ -24,8 +24,13 @@ class Embedding : public UnaryModule {
 
   int embeddingDim_;
   int numEmbeddings_;
+  bool sparseGrad_{false};
 
-  FL_SAVE_LOAD_WITH_BASE(UnaryModule, embeddingDim_, numEmbeddings_)
+  FL_SAVE_LOAD_WITH_BASE(
+      UnaryModule,
+      embeddingDim_,
+      numEmbeddings_,
+      fl::versioned(sparseGrad_, 1))
 
   void initialize();
 
@@ -35,16 +40,31 @@ class Embedding : public UnaryModule {
    *
    * @param embeddingDim the size of each embedding vector
    * @param numEmbeddings the size of the dictionary of embeddings
+   * @param sparseGrad if true, the gradient of the embeddings is sparse: it
+   * only holds the embeddings looked up (see `Variable::sparse()`)
    */
-  Embedding(int embeddingDim, int numEmbeddings);
+  Embedding(int embeddingDim, int numEmbeddings, bool sparseGrad = false);
 
   /**
    * Constructs an Embedding module from the weight parameter \f$w\f$.
    *
    * @param w the 2D `Variable` tensor for the weight \f$w\f$.
    *  The shape should be [`embeddingDim`, `numEmbeddings`].
+   * @param sparseGrad if true, the gradient of the embeddings is sparse
    */
-  explicit Embedding(const Variable& w);
+  explicit Embedding(const Variable& w, bool sparseGrad = false);
+
+  /**
+   * Enables or disables sparse gradients, e.g. for a loaded model.
+   */
+  void setSparseGrad(bool sparseGrad);
+
+  /**
+   * Stores the embeddings in `type`, e.g. f16 to halve the memory traffic of
+   * the lookups; the output is in the same type. The embeddings are cast in
+   * place (see `MasterWeightsOptimizer` to keep f32 weights for the updates).
+   */
+  void setWeightType(af::dtype type);
 
   Variable forward(const Variable& input) override;
 
@@ -54,3 +74,4 @@ class Embedding : public UnaryModule {
 } // namespace fl
 
 CEREAL_REGISTER_TYPE(fl::Embedding)
+CEREAL_CLASS_VERSION(fl::Embedding, 1)
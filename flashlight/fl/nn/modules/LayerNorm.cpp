@@ -39,6 +39,9 @@ LayerNorm::LayerNorm(
 }
 
 Variable LayerNorm::forward(const Variable& input) {
+  if (isFusable(input)) {
+    return forwardFused(input, Variable());
+  }
   Variable dummyInMean, dummyInVar;
 
   Variable inputToBn = input;
@@ -115,6 +118,68 @@ Variable LayerNorm::forward(const Variable& input) {
   return output;
 }
 
+Variable LayerNorm::forwardResidual(
+    const Variable& input,
+    const Variable& residual) {
+  if (isFusable(input)) {
+    return forwardFused(input, residual);
+  }
+  return forward(input + residual);
+}
+
+bool LayerNorm::isFusable(const Variable& input) const {
+  if (input.type() != af::dtype::f32 && input.type() != af::dtype::f16) {
+    return false;
+  }
+  // the normalized axes must all come before the other ones, up to axes of
+  // size 1, for the input to be seen as a matrix of columns to normalize
+  bool complementSeen = false;
+  for (int d = 0; d < AF_MAX_DIMS; ++d) {
+    if (input.dims(d) == 1) {
+      continue;
+    }
+    bool isComplement = std::find(
+                            axisComplement_.begin(),
+                            axisComplement_.end(),
+                            d) != axisComplement_.end();
+    if (!isComplement && complementSeen) {
+      return false;
+    }
+    complementSeen = complementSeen || isComplement;
+  }
+  return true;
+}
+
+Variable LayerNorm::forwardFused(
+    const Variable& input,
+    const Variable& residual) {
+  af::dim4 dims = input.dims();
+  int normSize = 1;
+  for (int d = 0; d < AF_MAX_DIMS; ++d) {
+    if (std::find(axisComplement_.begin(), axisComplement_.end(), d) ==
+        axisComplement_.end()) {
+      normSize *= dims[d];
+    }
+  }
+  Variable weight, bias;
+  if (affine_) {
+    if (axisSize_ != kLnVariableAxisSize && normSize != axisSize_) {
+      throw std::invalid_argument(
+          "[LayerNorm] Input size along the norm axis doesn't with axisSize.");
+    }
+    weight = params_[0];
+    bias = params_[1];
+  }
+  auto flatDims = af::dim4(normSize, dims.elements() / normSize);
+  auto output = residualLayerNorm(
+      moddims(input, flatDims),
+      residual.isempty() ? residual : moddims(residual, flatDims),
+      weight,
+      bias,
+      epsilon_);
+  return moddims(output, dims);
+}
+
 void LayerNorm::initialize() {
   if (affine_) {
     auto paramDim = (axisSize_ == kLnVariableAxisSize) ? 1 : axisSize_;
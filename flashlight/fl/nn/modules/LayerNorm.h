@@ -22,6 +22,10 @@ constexpr const int kLnVariableAxisSize = -1;
  * \f$x\f$ calculated along specified axis, \f$\epsilon\f$ is a small value
  * added to the variance to avoid divide-by-zero, and \f$\gamma\f$ and
  * \f$\beta\f$ are learnable parameters for affine transformation.
+ *
+ * When the normalized axes are the leading dimensions of the input (ignoring
+ * singleton dimensions), the normalization and the affine transformation are
+ * computed by the fused kernels of `fl::layerNorm`.
  */
 class LayerNorm : public UnaryModule {
  public:
@@ -69,11 +73,23 @@ class LayerNorm : public UnaryModule {
 
   Variable forward(const Variable& input) override;
 
+  /**
+   * Normalizes `input + residual`, as `forward(input + residual)`, computing
+   * the sum in the normalization kernel when possible.
+   */
+  Variable forwardResidual(const Variable& input, const Variable& residual);
+
   std::string prettyString() const override;
 
  private:
   LayerNorm() = default;
 
+  // Whether the normalization of the input can use the fused kernels of
+  // `fl::layerNorm`, i.e. its normalized axes lead its non-singleton ones
+  bool isFusable(const Variable& input) const;
+
+  Variable forwardFused(const Variable& input, const Variable& residual);
+
   // For legacy reasons, we store the complement of `axis`
   // to not break serialization
   std::vector<int> axisComplement_;
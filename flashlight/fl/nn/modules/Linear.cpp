@@ -40,6 +40,14 @@ Linear::Linear(const Variable& w, const Variable& b)
 }
 
 Variable Linear::forward(const Variable& input) {
+  if (int8_ && !train_ && int8_->observe(input)) {
+    return quantizedLinear(
+        input,
+        int8_->weights,
+        int8_->weightScales,
+        int8_->inputScale,
+        bias_ ? params_[1] : Variable());
+  }
   if (bias_) {
     return linear(
         input, params_[0].as(input.type()), params_[1].as(input.type()));
@@ -47,6 +55,59 @@ Variable Linear::forward(const Variable& input) {
   return linear(input, params_[0].as(input.type()));
 }
 
+Variable Linear::forwardActivation(
+    const Variable& input,
+    LinearActivation activation) {
+  if (activation == LinearActivation::NONE || (int8_ && !train_)) {
+    return activate(Linear::forward(input), activation);
+  }
+  auto bias = bias_ ? params_[1].as(input.type()) : Variable();
+  return linear(input, params_[0].as(input.type()), bias, activation);
+}
+
+Variable Linear::activate(
+    const Variable& output,
+    LinearActivation activation) {
+  switch (activation) {
+    case LinearActivation::RELU:
+      return relu(output);
+    case LinearActivation::GELU:
+      return gelu(output);
+    default:
+      return output;
+  }
+}
+
+std::shared_ptr<Int8Quantization> Linear::int8Quantization() const {
+  return int8_;
+}
+
+void Linear::setInt8Quantization(
+    std::shared_ptr<Int8Quantization> quantization) {
+  int8_ = quantization;
+}
+
+void Linear::foldScaleShift(const af::array& scale, const af::array& shift) {
+  if (scale.elements() != nOut_ || shift.elements() != nOut_) {
+    throw std::invalid_argument(
+        "Linear::foldScaleShift - expects a scale and shift per feature");
+  }
+  if (int8_) {
+    throw std::invalid_argument(
+        "Linear::foldScaleShift - can't fold into int8 weights");
+  }
+  auto weight = params_[0].array();
+  auto featureScale = af::flat(scale).as(weight.type());
+  weight = weight * af::tile(featureScale, af::dim4(1, nIn_));
+  auto bias = af::flat(shift).as(weight.type());
+  if (bias_) {
+    bias = bias + params_[1].array() * featureScale;
+  }
+  bool calcGrad = params_[0].isCalcGrad();
+  params_ = {Variable(weight, calcGrad), Variable(bias, calcGrad)};
+  bias_ = true;
+}
+
 void Linear::initialize() {
   int fanIn = nIn_;
   auto w = Variable(
@@ -69,6 +130,9 @@ std::string Linear::prettyString() const {
   } else {
     ss << " (without bias)";
   }
+  if (int8_) {
+    ss << " (int8)";
+  }
   return ss.str();
 }
 
@@ -15,6 +15,7 @@
 
 #pragma once
 
+#include "flashlight/fl/nn/Quantization.h"
 #include "flashlight/fl/nn/modules/Module.h"
 
 namespace fl {
@@ -25,13 +26,23 @@ namespace fl {
  * it to an output of shape [`output_size`, *, *, *].
  */
 class Linear : public UnaryModule {
- private:
-  Linear() = default; // Intentionally private
+ protected:
+  Linear() = default; // Intentionally not public, for serialization
+
+  /// Applies `activation` to the output of an unfused forward pass
+  static Variable activate(const Variable& output, LinearActivation activation);
 
+ private:
   int nIn_, nOut_;
   bool bias_;
+  std::shared_ptr<Int8Quantization> int8_;
 
-  FL_SAVE_LOAD_WITH_BASE(UnaryModule, nIn_, nOut_, bias_)
+  FL_SAVE_LOAD_WITH_BASE(
+      UnaryModule,
+      nIn_,
+      nOut_,
+      bias_,
+      fl::versioned(int8_, 1))
 
   void initialize();
 
@@ -68,9 +79,35 @@ class Linear : public UnaryModule {
 
   Variable forward(const Variable& input) override;
 
+  /**
+   * Forwards `input`, then applies `activation`, fused with the matrix
+   * product and the bias where the backend supports it (see `fl::linear`).
+   * A `Sequential` forwards a `Linear` followed by a `ReLU` or a `GELU`
+   * with it.
+   */
+  virtual Variable forwardActivation(
+      const Variable& input,
+      LinearActivation activation);
+
+  /**
+   * Returns the int8 quantization of the module, or null if it isn't
+   * quantized. See `fl::quantize`.
+   */
+  std::shared_ptr<Int8Quantization> int8Quantization() const;
+
+  void setInt8Quantization(std::shared_ptr<Int8Quantization> quantization);
+
+  /**
+   * Folds a scale and a shift of each output feature into the weights and the
+   * bias (e.g. a `BatchNorm` applied to the output in eval mode), adding a
+   * bias if the module has none.
+   */
+  void foldScaleShift(const af::array& scale, const af::array& shift);
+
   std::string prettyString() const override;
 };
 
 } // namespace fl
 
 CEREAL_REGISTER_TYPE(fl::Linear)
+CEREAL_CLASS_VERSION(fl::Linear, 1)
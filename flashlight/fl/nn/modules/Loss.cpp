@@ -14,11 +14,26 @@
  ********************************************************/
 
 #include "flashlight/fl/nn/modules/Loss.h"
+#include <algorithm>
+#include <cmath>
 #include <stdexcept>
 #include <vector>
 
 #include "flashlight/fl/autograd/Functions.h"
 
+namespace {
+
+// Subtracted from the logits of the negatives which are the target, large
+// enough to remove them from the softmax and small enough for half precision
+constexpr float kAccidentalHitPenalty = 1e4;
+constexpr double kMinNegativeProb = 1e-12;
+
+fl::Variable castTo(const fl::Variable& var, af::dtype type) {
+  return var.type() == type ? var : var.as(type);
+}
+
+} // namespace
+
 namespace fl {
 
 Variable MeanSquaredError::forward(
@@ -71,6 +86,22 @@ std::string CategoricalCrossEntropy::prettyString() const {
   return "CategoricalCrossEntropy";
 }
 
+Variable SoftmaxCrossEntropy::forward(
+    const Variable& inputs,
+    const Variable& targets) {
+  return softmaxCrossEntropy(
+      inputs, targets, reduction_, ignoreIndex_, labelSmoothing_);
+}
+
+std::string SoftmaxCrossEntropy::prettyString() const {
+  std::ostringstream ss;
+  ss << "SoftmaxCrossEntropy";
+  if (labelSmoothing_ > 0) {
+    ss << " (label smoothing: " << labelSmoothing_ << ")";
+  }
+  return ss.str();
+}
+
 AdaptiveSoftMaxLoss::AdaptiveSoftMaxLoss(
     std::shared_ptr<AdaptiveSoftMax> activation,
     ReduceMode reduction,
@@ -119,10 +150,12 @@ Variable AdaptiveSoftMaxLoss::forward(
   auto B = inputs.dims(2);
   auto cutoff = activation_->getCutoff();
 
-  auto input = moddims(inputs, af::dim4(N, T * B));
+  // The projections are in the type of the weights (see
+  // `AdaptiveSoftMax::setWeightType()`), the losses in the type of the input
+  auto input = castTo(moddims(inputs, af::dim4(N, T * B)), params_[0].type());
   auto target = moddims(targets, af::dim4(T * B));
 
-  auto headOutput = matmul(params_[0], input);
+  auto headOutput = castTo(matmul(params_[0], input), inputs.type());
   auto headTarget = Variable(target.array(), false) * (target < cutoff[0]);
   auto res = Variable(af::constant(0, T * B), true);
 
@@ -138,19 +171,24 @@ Variable AdaptiveSoftMaxLoss::forward(
     auto tailTarget = target(indicesArray) - cutoff[i];
     auto selectedInput = embedding(Variable(indicesArray, false), input);
     auto tailOutput = matmul(params_[1 + i * 2], selectedInput);
-    tailOutput = matmul(params_[2 + i * 2], tailOutput);
-    auto localLoss = categoricalCrossEntropy(
-        logSoftmax(tailOutput, 0), tailTarget, ReduceMode::NONE, ignoreIndex_);
+    Variable localLoss;
+    if (train_ && sampling_ != NegativeSampling::NONE &&
+        numNegatives_ < cutoff[i + 1] - cutoff[i]) {
+      localLoss = castTo(
+          sampledTailLoss(i, tailOutput, tailTarget.array()), inputs.type());
+    } else {
+      tailOutput =
+          castTo(matmul(params_[2 + i * 2], tailOutput), inputs.type());
+      localLoss = softmaxCrossEntropy(
+          tailOutput, tailTarget, ReduceMode::NONE, ignoreIndex_);
+    }
     res = res + cast(localLoss, res.dims(), indicesArray);
   }
 
   // Head forward
   res = res +
-      categoricalCrossEntropy(
-            logSoftmax(headOutput, 0),
-            headTarget,
-            ReduceMode::NONE,
-            ignoreIndex_);
+      softmaxCrossEntropy(
+            headOutput, headTarget, ReduceMode::NONE, ignoreIndex_);
 
   // Reduce
   if (reduction_ == ReduceMode::NONE) {
@@ -164,6 +202,130 @@ Variable AdaptiveSoftMaxLoss::forward(
   return res;
 }
 
+Variable AdaptiveSoftMaxLoss::sampledTailLoss(
+    int cluster,
+    const Variable& hidden,
+    const af::array& localTarget) {
+  // Logits of the classes: p(class) = exp(logit) / sum(exp(logits)) is
+  // estimated from the logits of the target and of the negatives, corrected by
+  // the log of their expected counts among the negatives
+  const auto& weights = params_[2 + cluster * 2];
+  int64_t hiddenSize = hidden.dims(0);
+  int64_t numTargets = hidden.dims(1);
+  int64_t numDraws =
+      sharedNegatives_ ? numNegatives_ : numNegatives_ * numTargets;
+  std::vector<int> negatives(numDraws);
+  for (auto& negative : negatives) {
+    negative = negativeDists_[cluster](rng_);
+  }
+  af::array negativesArr(numDraws, negatives.data());
+  const auto& logProbs = negativeLogProbs_[cluster];
+  float logNumNegatives = std::log(static_cast<float>(numNegatives_));
+  auto target = af::moddims(localTarget, af::dim4(1, numTargets));
+
+  auto targetWeights = weights(localTarget, af::span);
+  auto targetLogits = sum(transpose(targetWeights) * hidden, {0}) -
+      Variable(
+          (af::moddims(af::lookup(logProbs, localTarget), target.dims()) +
+           logNumNegatives)
+              .as(hidden.type()),
+          false);
+
+  auto negativeWeights = weights(negativesArr, af::span);
+  auto negativeLogProbs = af::lookup(logProbs, negativesArr) + logNumNegatives;
+  Variable negativeLogits;
+  af::array hits;
+  if (sharedNegatives_) {
+    negativeLogits = matmul(negativeWeights, hidden);
+    negativeLogProbs = af::tile(negativeLogProbs, 1, numTargets);
+    hits = af::tile(negativesArr, 1, numTargets) ==
+        af::tile(target, numNegatives_);
+  } else {
+    // hidden x negatives x targets
+    auto dims = af::dim4(hiddenSize, numNegatives_, numTargets);
+    auto weights3d = moddims(transpose(negativeWeights), dims);
+    negativeLogits = moddims(
+        sum(weights3d *
+                tileAs(
+                    moddims(hidden, af::dim4(hiddenSize, 1, numTargets)),
+                    weights3d),
+            {0}),
+        af::dim4(numNegatives_, numTargets));
+    negativeLogProbs = af::moddims(negativeLogProbs, negativeLogits.dims());
+    hits = af::moddims(negativesArr, negativeLogits.dims()) ==
+        af::tile(target, numNegatives_);
+  }
+  // Negatives which are the target of their column are removed
+  negativeLogits = negativeLogits -
+      Variable((negativeLogProbs + hits * kAccidentalHitPenalty)
+                   .as(negativeLogits.type()),
+               false);
+
+  auto logits = concatenate({targetLogits, negativeLogits}, 0);
+  return softmaxCrossEntropy(
+      logits,
+      Variable(af::constant(0, numTargets, s32), false),
+      ReduceMode::NONE);
+}
+
+void AdaptiveSoftMaxLoss::setSampledSoftmax(
+    NegativeSampling sampling,
+    int numNegatives,
+    bool sharedNegatives /* = true */,
+    const std::vector<double>& counts /* = {} */,
+    int seed /* = 0 */) {
+  auto cutoff = activation_->getCutoff();
+  if (sampling != NegativeSampling::NONE && numNegatives <= 0) {
+    throw std::invalid_argument(
+        "AdaptiveSoftMaxLoss: the number of negatives must be positive");
+  }
+  if (sampling == NegativeSampling::UNIGRAM && counts.size() < cutoff.back()) {
+    throw std::invalid_argument(
+        "AdaptiveSoftMaxLoss: unigram sampling needs the counts of all "
+        "classes");
+  }
+  sampling_ = sampling;
+  numNegatives_ = numNegatives;
+  sharedNegatives_ = sharedNegatives;
+  rng_.seed(seed);
+  negativeDists_.clear();
+  negativeLogProbs_.clear();
+  if (sampling_ == NegativeSampling::NONE) {
+    return;
+  }
+
+  for (int i = 0; i < cutoff.size() - 1; i++) {
+    int clusterSize = cutoff[i + 1] - cutoff[i];
+    std::vector<double> probs(clusterSize);
+    if (sampling_ == NegativeSampling::LOG_UNIFORM) {
+      for (int k = 0; k < clusterSize; k++) {
+        probs[k] =
+            std::log((k + 2.0) / (k + 1.0)) / std::log(clusterSize + 1.0);
+      }
+    } else {
+      std::copy(
+          counts.begin() + cutoff[i],
+          counts.begin() + cutoff[i + 1],
+          probs.begin());
+      double total = 0;
+      for (auto& prob : probs) {
+        prob = std::max(prob, 0.0);
+        total += prob;
+      }
+      for (auto& prob : probs) {
+        prob = total > 0 ? prob / total : 1.0 / clusterSize;
+      }
+    }
+    std::vector<float> logProbs(clusterSize);
+    for (int k = 0; k < clusterSize; k++) {
+      // Bounded for the classes which are never drawn, but may be targets
+      logProbs[k] = std::log(std::max(probs[k], kMinNegativeProb));
+    }
+    negativeDists_.emplace_back(probs.begin(), probs.end());
+    negativeLogProbs_.push_back(af::array(clusterSize, logProbs.data()));
+  }
+}
+
 std::shared_ptr<AdaptiveSoftMax> AdaptiveSoftMaxLoss::getActivation() const {
   return activation_;
 };
@@ -15,6 +15,8 @@
 
 #pragma once
 
+#include <random>
+
 #include "flashlight/fl/common/Defines.h"
 #include "flashlight/fl/nn/modules/AdaptiveSoftMax.h"
 #include "flashlight/fl/nn/modules/Container.h"
@@ -160,6 +162,59 @@ class CategoricalCrossEntropy : public BinaryModule {
   std::string prettyString() const override;
 };
 
+/**
+ * Computes the categorical cross entropy loss of the softmax of unnormalized
+ * logits with a target tensor, with optional label smoothing. Equivalent to
+ * `LogSoftmax` followed by `CategoricalCrossEntropy`, but computed by the
+ * fused kernels of `softmaxCrossEntropy`, which don't store the
+ * log-probabilities for the backward pass.
+ */
+class SoftmaxCrossEntropy : public BinaryModule {
+ private:
+  ReduceMode reduction_;
+  int ignoreIndex_{-1};
+  double labelSmoothing_{0.0};
+
+  FL_SAVE_LOAD_WITH_BASE(
+      BinaryModule,
+      reduction_,
+      ignoreIndex_,
+      labelSmoothing_)
+
+ public:
+  /**
+   * Creates a `SoftmaxCrossEntropy`.
+   *
+   * @param reduction a reduction with which to compute the loss. See
+   * documentation on `ReduceMode` for available options.
+   * @param ignoreIndex a target value that is ignored and does not contribute
+   * to the loss or the input gradient. If `reduce` is MEAN, the loss is
+   * averaged over non-ignored targets.
+   * @param labelSmoothing the weight of the uniform distribution mixed with
+   * the targets
+   */
+  explicit SoftmaxCrossEntropy(
+      ReduceMode reduction = ReduceMode::MEAN,
+      int ignoreIndex = -1,
+      double labelSmoothing = 0.0)
+      : reduction_(reduction),
+        ignoreIndex_(ignoreIndex),
+        labelSmoothing_(labelSmoothing) {}
+
+  /**
+   * Computes the softmax cross entropy loss for some input and target
+   * tensors.
+   *
+   * @param inputs a `Variable` of logits with shape [\f$C\f$, \f$B_1\f$,
+   * \f$B_2\f$, \f$B_3\f$] where \f$C\f$ is the number of classes.
+   * @param targets an integer `Variable` with shape [\f$B_1\f$, \f$B_2\f$,
+   * \f$B_3\f$]. The values must be in [\f$0\f$, \f$C - 1\f$]
+   */
+  Variable forward(const Variable& inputs, const Variable& targets) override;
+
+  std::string prettyString() const override;
+};
+
 /**
  * An efficient approximation of the softmax function and negative
  * log-likelihood loss. Computes the Adaptive Softmax, as given by [Grave et al
@@ -173,8 +228,23 @@ class CategoricalCrossEntropy : public BinaryModule {
  * for which at least one target is present are evaluated. Forward pass for
  * low-frequency inputs are approximated with lower rank matrices so as to speed
  * up computation.
+ *
+ * In train mode, tail clusters can be trained with a sampled softmax (see
+ * `setSampledSoftmax`), which only projects the targets and a few sampled
+ * negative classes of each cluster ([Jean et al
+ * (2015)](https://arxiv.org/abs/1412.2007)).
  */
 class AdaptiveSoftMaxLoss : public BinaryModule {
+ public:
+  enum class NegativeSampling {
+    NONE = 0,
+    // P(k) = log((k + 2) / (k + 1)) / log(n + 1) for the k-th class of a
+    // cluster of n classes, which are sorted by decreasing frequency
+    LOG_UNIFORM = 1,
+    // Proportional to the counts of the classes
+    UNIGRAM = 2,
+  };
+
  private:
   FL_SAVE_LOAD_WITH_BASE(
       BinaryModule,
@@ -185,11 +255,27 @@ class AdaptiveSoftMaxLoss : public BinaryModule {
   ReduceMode reduction_;
   int ignoreIndex_{-1};
 
+  // Sampled softmax, not serialized: a training option
+  NegativeSampling sampling_{NegativeSampling::NONE};
+  int numNegatives_{0};
+  bool sharedNegatives_{true};
+  std::mt19937 rng_;
+  // For each tail cluster, the distribution of its negatives, and their
+  // log-probabilities
+  std::vector<std::discrete_distribution<int>> negativeDists_;
+  std::vector<af::array> negativeLogProbs_;
+
   Variable cast(
       const Variable& input,
       const af::dim4& outDims,
       const af::array& indices);
 
+  // Loss of the targets of a tail cluster, which belong to `localTarget`
+  Variable sampledTailLoss(
+      int cluster,
+      const Variable& hidden,
+      const af::array& localTarget);
+
  public:
   AdaptiveSoftMaxLoss() = default;
 
@@ -208,6 +294,28 @@ class AdaptiveSoftMaxLoss : public BinaryModule {
       int ignoreIndex = -1);
   std::shared_ptr<AdaptiveSoftMax> getActivation() const;
 
+  /**
+   * Trains the tail clusters with a sampled softmax in train mode. The full
+   * softmax is computed in eval mode, and for clusters of at most
+   * `numNegatives` classes.
+   *
+   * @param sampling the distribution of the negative classes, or NONE to
+   * compute the full softmax.
+   * @param numNegatives the number of negatives drawn in each cluster
+   * (with replacement), for each batch or for each target.
+   * @param sharedNegatives if true, the negatives of a cluster are shared
+   * by all the targets of the batch, and their projections are computed with
+   * a single matrix product.
+   * @param counts the counts of all classes, for UNIGRAM sampling.
+   * @param seed the seed of the sampling.
+   */
+  void setSampledSoftmax(
+      NegativeSampling sampling,
+      int numNegatives,
+      bool sharedNegatives = true,
+      const std::vector<double>& counts = {},
+      int seed = 0);
+
   /**
    * Computes the categorical cross entropy loss for some input and target
    * tensors (uses adaptive softmax function to do this efficiently)
@@ -234,6 +342,7 @@ CEREAL_REGISTER_TYPE(fl::MeanSquaredError)
 CEREAL_REGISTER_TYPE(fl::MeanAbsoluteError)
 CEREAL_REGISTER_TYPE(fl::BinaryCrossEntropy)
 CEREAL_REGISTER_TYPE(fl::CategoricalCrossEntropy)
+CEREAL_REGISTER_TYPE(fl::SoftmaxCrossEntropy)
 CEREAL_REGISTER_TYPE(fl::AdaptiveSoftMaxLoss)
 CEREAL_CLASS_VERSION(fl::CategoricalCrossEntropy, 1)
 CEREAL_CLASS_VERSION(fl::AdaptiveSoftMaxLoss, 1)
@@ -69,6 +69,24 @@ std::vector<Variable> Module::operator()(const std::vector<Variable>& input) {
   return this->forward(input);
 }
 
+std::vector<Variable> Module::forwardChunk(
+    const std::vector<Variable>& inputs) {
+  return forward(inputs);
+}
+
+void Module::resetStreamingState() {}
+
+std::vector<Variable> Module::streamingState() const {
+  return {};
+}
+
+void Module::setStreamingState(const std::vector<Variable>& state) {
+  if (!state.empty()) {
+    throw std::invalid_argument(
+        "Module::setStreamingState: the module keeps no streaming state");
+  }
+}
+
 UnaryModule::UnaryModule() = default;
 
 UnaryModule::UnaryModule(const std::vector<Variable>& params)
@@ -130,6 +130,47 @@ class Module {
    */
   std::vector<Variable> operator()(const std::vector<Variable>& inputs);
 
+  /**
+   * Streaming forward computation: processes `inputs` as the next chunk of a
+   * stream along their first (time) dimension, e.g. for real-time inference.
+   * Modules with a temporal context keep the end of the previous chunks (see
+   * `Conv2D`, `TDSBlock`, `Conformer`), so that the cost of a chunk doesn't
+   * depend on the length of the stream; by default, chunks are forwarded
+   * independently, which is exact for modules computing each frame
+   * independently.
+   *
+   * Modules which need future frames (e.g. convolutions with right padding)
+   * output the frames for which they have the whole context: the output is
+   * delayed, and may be empty (then more input is needed). Streams start after
+   * `resetStreamingState()`. This is meant for inference, in eval mode.
+   *
+   * @param inputs the chunk
+   * @return the chunk of the output of the module available so far
+   */
+  virtual std::vector<Variable> forwardChunk(
+      const std::vector<Variable>& inputs);
+
+  /**
+   * Clears the state kept by `forwardChunk()`, to start a new stream.
+   */
+  virtual void resetStreamingState();
+
+  /**
+   * The state kept by `forwardChunk()` once a stream has started (e.g. the
+   * last input frames of a convolution), to resume the stream later with
+   * `setStreamingState()`, e.g. to switch between the branches of a beam
+   * search. The number of state variables of a module is fixed, and the
+   * streams of a batch are along their last dimension: the states of several
+   * streams can be concatenated along it to resume them as a batch. None by
+   * default, for modules computing each frame independently.
+   */
+  virtual std::vector<Variable> streamingState() const;
+
+  /**
+   * Resumes a started stream from the state returned by `streamingState()`.
+   */
+  virtual void setStreamingState(const std::vector<Variable>& state);
+
   /**
    * Generates a stringified representation of the module.
    *
@@ -36,6 +36,26 @@ Variable Padding::forward(const Variable& input) {
   return padding(input, m_pad, m_val);
 }
 
+std::vector<Variable> Padding::forwardChunk(
+    const std::vector<Variable>& inputs) {
+  if (inputs.size() != 1) {
+    throw std::invalid_argument("UnaryModule expects only one input");
+  }
+  auto pad = m_pad;
+  pad[0] = {streamStarted_ ? 0 : pad[0].first, 0};
+  streamStarted_ = true;
+  return {padding(inputs[0], pad, m_val)};
+}
+
+void Padding::resetStreamingState() {
+  streamStarted_ = false;
+}
+
+void Padding::setStreamingState(const std::vector<Variable>& state) {
+  Module::setStreamingState(state);
+  streamStarted_ = true;
+}
+
 std::string Padding::prettyString() const {
   std::ostringstream ss;
   ss << "Padding (" << m_val << ", { ";
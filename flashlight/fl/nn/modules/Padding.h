@@ -105,7 +105,22 @@ class Padding : public UnaryModule {
 
   Variable forward(const Variable& input) override;
 
+  /**
+   * Pads the next chunk of a stream: the first dimension (time) is padded on
+   * the left of the stream only. See `Module::forwardChunk()`.
+   */
+  std::vector<Variable> forwardChunk(
+      const std::vector<Variable>& inputs) override;
+
+  void resetStreamingState() override;
+
+  /// Resumes a stream: its start was already padded
+  void setStreamingState(const std::vector<Variable>& state) override;
+
   std::string prettyString() const override;
+
+ private:
+  bool streamStarted_{false};
 };
 
 } // namespace fl
@@ -24,24 +24,27 @@ Pool2D::Pool2D(
     int sy,
     IntOrPadMode px,
     IntOrPadMode py,
-    PoolingMode mode)
+    PoolingMode mode,
+    ImageLayout layout)
     : xFilter_(wx),
       yFilter_(wy),
       xStride_(sx),
       yStride_(sy),
       xPad_(px.padVal),
       yPad_(py.padVal),
-      mode_(mode) {}
+      mode_(mode),
+      layout_(layout) {}
 
 Variable Pool2D::forward(const Variable& input) {
+  int xDim = layout_ == ImageLayout::CWHN ? 1 : 0;
   auto px = derivePadding(
-      input.dims(0),
+      input.dims(xDim),
       xFilter_,
       xStride_,
       xPad_,
       /* dilation= */ 1);
   auto py = derivePadding(
-      input.dims(1),
+      input.dims(xDim + 1),
       yFilter_,
       yStride_,
       yPad_,
@@ -51,7 +54,8 @@ Variable Pool2D::forward(const Variable& input) {
     throw std::invalid_argument("invalid padding for Pool2D");
   }
 
-  return pool2d(input, xFilter_, yFilter_, xStride_, yStride_, px, py, mode_);
+  return pool2d(
+      input, xFilter_, yFilter_, xStride_, yStride_, px, py, mode_, layout_);
 }
 
 std::string Pool2D::prettyString() const {
@@ -82,6 +86,9 @@ std::string Pool2D::prettyString() const {
     ss << yPad_;
   }
   ss << ")";
+  if (layout_ == ImageLayout::CWHN) {
+    ss << " (channels-last)";
+  }
   return ss.str();
 }
 
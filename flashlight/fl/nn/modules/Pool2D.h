@@ -27,6 +27,7 @@ class Pool2D : public UnaryModule {
   int xStride_, yStride_; // stride
   int xPad_, yPad_; // padding - used iff padding mode is none
   PoolingMode mode_; // pooling type
+  ImageLayout layout_{ImageLayout::WHCN};
 
   FL_SAVE_LOAD_WITH_BASE(
       UnaryModule,
@@ -36,7 +37,8 @@ class Pool2D : public UnaryModule {
       yStride_,
       xPad_,
       yPad_,
-      mode_)
+      mode_,
+      fl::versioned(layout_, 1))
 
  public:
   /** Construct a Pool2D layer.
@@ -52,6 +54,8 @@ class Pool2D : public UnaryModule {
    * - MAX
    * - AVG_INCLUDE_PADDING
    * - AVG_EXCLUDE_PADDING
+   * @param layout layout of the input and of the output, e.g.
+   * `ImageLayout::CWHN` for channels-last images
    */
   Pool2D(
       int wx,
@@ -60,7 +64,8 @@ class Pool2D : public UnaryModule {
       int sy = 1,
       detail::IntOrPadMode px = 0,
       detail::IntOrPadMode py = 0,
-      PoolingMode mode = PoolingMode::MAX);
+      PoolingMode mode = PoolingMode::MAX,
+      ImageLayout layout = ImageLayout::WHCN);
 
   Variable forward(const Variable& input) override;
 
@@ -70,3 +75,4 @@ class Pool2D : public UnaryModule {
 } // namespace fl
 
 CEREAL_REGISTER_TYPE(fl::Pool2D)
+CEREAL_CLASS_VERSION(fl::Pool2D, 1)
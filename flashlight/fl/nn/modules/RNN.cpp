@@ -49,17 +49,7 @@ std::vector<Variable> RNN::forward(const std::vector<Variable>& inputs) {
   const auto& hiddenState = inputs.size() >= 2 ? inputs[1] : Variable();
   const auto& cellState = inputs.size() == 3 ? inputs[2] : Variable();
 
-  float dropProb = train_ ? dropProb_ : 0.0;
-  auto rnnRes =
-      rnn(input,
-          hiddenState.as(input.type()),
-          cellState.as(input.type()),
-          params_[0].as(input.type()),
-          hiddenSize_,
-          numLayers_,
-          mode_,
-          bidirectional_,
-          dropProb);
+  auto rnnRes = forward(input, hiddenState, cellState, af::array());
 
   std::vector<Variable> output(1, std::get<0>(rnnRes));
   if (inputs.size() >= 2) {
@@ -107,6 +97,25 @@ std::tuple<Variable, Variable, Variable> RNN::operator()(
   return forward(input, hidden_state, cell_state);
 }
 
+std::tuple<Variable, Variable, Variable> RNN::forward(
+    const Variable& input,
+    const Variable& hidden_state,
+    const Variable& cell_state,
+    const af::array& sequenceLengths) {
+  float dropProb = train_ ? dropProb_ : 0.0;
+  return rnn(
+      input,
+      hidden_state.as(input.type()),
+      cell_state.as(input.type()),
+      params_[0].as(input.type()),
+      hiddenSize_,
+      numLayers_,
+      mode_,
+      bidirectional_,
+      dropProb,
+      sequenceLengths);
+}
+
 std::string RNN::prettyString() const {
   std::ostringstream ss;
   switch (mode_) {
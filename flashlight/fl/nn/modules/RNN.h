@@ -139,6 +139,22 @@ class RNN : public Module {
       const Variable& hidden_state,
       const Variable& cell_state);
 
+  /** Forward the RNN Layer on a padded batch of sequences of different
+   * lengths, see `fl::rnn()` with sequence lengths.
+   * @param input Should be of shape [\f$X_{in}\f$, \f$N\f$, \f$T\f$]
+   * @param hidden_state Same as above
+   * @param cell_state Same as above
+   * @param sequenceLengths Number of steps of each sample, of shape
+   * [\f$N\f$], in [1, \f$T\f$]
+   * @returns The same tuple as above; the output is zero at padded steps and
+   * the states are those at the end of each sequence.
+   */
+  std::tuple<Variable, Variable, Variable> forward(
+      const Variable& input,
+      const Variable& hidden_state,
+      const Variable& cell_state,
+      const af::array& sequenceLengths);
+
   std::string prettyString() const override;
 };
 
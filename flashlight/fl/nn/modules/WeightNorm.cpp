@@ -7,12 +7,72 @@
 
 #include <stdexcept>
 
+#include "flashlight/fl/autograd/GradMode.h"
+#include "flashlight/fl/common/Utils.h"
 #include "flashlight/fl/nn/modules/Conv2D.h"
 #include "flashlight/fl/nn/modules/Linear.h"
 #include "flashlight/fl/nn/modules/WeightNorm.h"
 
 namespace fl {
 
+namespace {
+
+// Sums `arr` over all the dimensions but `dim`, to dimensions `sliceDims`
+af::array sumSlices(const af::array& arr, int dim, const af::dim4& sliceDims) {
+  const dim_t n = arr.dims(dim);
+  if (dim == 0) {
+    return af::moddims(af::sum(af::moddims(arr, n, arr.elements() / n), 1),
+        sliceDims);
+  }
+  return af::moddims(
+      af::sum(af::moddims(arr, arr.elements() / n, n), 0), sliceDims);
+}
+
+// The data of an array is identified by the pointer to its buffer, as long as
+// the buffer is kept alive: written arrays are copied on write, and new values
+// get other buffers
+void* bufferPtr(const af::array& arr) {
+  void* ptr = nullptr;
+  AF_CHECK(af_get_raw_ptr(&ptr, arr.get()));
+  return ptr;
+}
+
+} // namespace
+
+Variable weightNormWeight(const Variable& v, const Variable& g, int dim) {
+  if (dim != 0 && dim != 3) {
+    throw std::invalid_argument(
+        "Wrong dimension for Weight Norm: " + std::to_string(dim));
+  }
+  // w = v * g / ||v||, with a single node in the graph
+  const auto& vArr = v.array();
+  af::dim4 sliceDims(1, 1, 1, 1);
+  sliceDims[dim] = vArr.dims(dim);
+  af::dim4 tiles = vArr.dims();
+  tiles[dim] = 1;
+  auto nm = af::sqrt(sumSlices(vArr * vArr, dim, sliceDims));
+  auto scale = g.array() / nm;
+  auto result = vArr * af::tile(scale, tiles);
+
+  auto gradFunc = [dim, sliceDims, tiles, nm, scale](
+                      std::vector<Variable>& inputs,
+                      const Variable& gradOutput) {
+    const auto& vIn = inputs[0].array();
+    const auto& gradW = gradOutput.array();
+    // Projection of the gradient on the normalized v
+    auto proj = sumSlices(gradW * vIn, dim, sliceDims) / nm;
+    if (inputs[1].isCalcGrad()) {
+      inputs[1].addGrad(Variable(proj, false));
+    }
+    if (inputs[0].isCalcGrad()) {
+      auto gradV = af::tile(scale, tiles) *
+          (gradW - vIn * af::tile(proj / nm, tiles));
+      inputs[0].addGrad(Variable(gradV, false));
+    }
+  };
+  return Variable(result, {v, g}, gradFunc);
+}
+
 void WeightNorm::transformDims() {
   normDim_.clear();
   int vNumdims = module_->param(0).array().numdims();
@@ -27,25 +87,23 @@ void WeightNorm::transformDims() {
 }
 
 void WeightNorm::computeWeight() {
-  auto v = params_[0];
-  auto g = params_[1];
-  Variable nm;
-  // speed of norm operation is the best while doing it across {1} dim
-  // tested for convlm model training
-  if (dim_ == 0) {
-    nm = moddims(v, af::dim4{0, -1, 1, 1});
-    nm = norm(nm, {1});
-  } else if (dim_ == 3) {
-    nm = moddims(v, af::dim4{-1, 1, 1, 0});
-    nm = reorder(nm, 3, 0, 1, 2);
-    nm = norm(nm, {1});
-    nm = reorder(nm, 1, 2, 3, 0);
+  const auto& v = params_[0];
+  const auto& g = params_[1];
+  module_->setParams(weightNormWeight(v, g, dim_), 0);
+  // In eval mode, the weight is kept until v or g change
+  if (train_) {
+    weightV_ = af::array();
+    weightG_ = af::array();
   } else {
-    throw std::invalid_argument(
-        "Wrong dimension for Weight Norm: " + std::to_string(dim_));
+    weightV_ = v.array();
+    weightG_ = g.array();
   }
-  auto wt = v * tileAs(g / nm, v);
-  module_->setParams(wt, 0);
+}
+
+bool WeightNorm::isWeightStale() const {
+  return weightV_.isempty() ||
+      bufferPtr(weightV_) != bufferPtr(params_[0].array()) ||
+      bufferPtr(weightG_) != bufferPtr(params_[1].array());
 }
 
 void WeightNorm::setParams(const Variable& var, int position) {
@@ -60,12 +118,33 @@ void WeightNorm::setParams(const Variable& var, int position) {
 }
 
 std::vector<Variable> WeightNorm::forward(const std::vector<Variable>& inputs) {
-  if (train_) {
+  // The weight is part of the graph of each forward in training
+  if (train_ || isWeightStale()) {
     computeWeight();
   }
   return module_->forward(inputs);
 }
 
+std::vector<Variable> WeightNorm::forwardChunk(
+    const std::vector<Variable>& inputs) {
+  if (train_ || isWeightStale()) {
+    computeWeight();
+  }
+  return module_->forwardChunk(inputs);
+}
+
+void WeightNorm::resetStreamingState() {
+  module_->resetStreamingState();
+}
+
+std::vector<Variable> WeightNorm::streamingState() const {
+  return module_->streamingState();
+}
+
+void WeightNorm::setStreamingState(const std::vector<Variable>& state) {
+  module_->setStreamingState(state);
+}
+
 ModulePtr WeightNorm::module() const {
   return module_;
 }
@@ -73,6 +152,8 @@ ModulePtr WeightNorm::module() const {
 void WeightNorm::train() {
   Module::train();
   module_->train();
+  weightV_ = af::array();
+  weightG_ = af::array();
 }
 
 void WeightNorm::eval() {
@@ -88,4 +169,32 @@ std::string WeightNorm::prettyString() const {
   return ss.str();
 }
 
+ModulePtr WeightNorm::fold() {
+  Variable weight;
+  {
+    NoGradGuard noGrad;
+    weight = weightNormWeight(params_[0], params_[1], dim_);
+  }
+  module_->setParams(Variable(weight.array(), true), 0);
+  weightV_ = af::array();
+  weightG_ = af::array();
+  return module_;
+}
+
+ModulePtr foldWeightNorm(const ModulePtr& module) {
+  if (auto weightNorm = std::dynamic_pointer_cast<WeightNorm>(module)) {
+    return weightNorm->fold();
+  }
+  if (auto container = std::dynamic_pointer_cast<Container>(module)) {
+    auto modules = container->modules();
+    for (int i = 0; i < modules.size(); ++i) {
+      auto folded = foldWeightNorm(modules[i]);
+      if (folded != modules[i]) {
+        container->setModule(i, folded);
+      }
+    }
+  }
+  return module;
+}
+
 } // namespace fl
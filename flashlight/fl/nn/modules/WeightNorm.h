@@ -39,10 +39,18 @@ class WeightNorm : public Module {
   int dim_;
   std::vector<int> normDim_;
 
+  // Arrays of v and g the weight of the module was computed from in eval
+  // mode, which keep their buffers alive. Not serialized
+  af::array weightV_;
+  af::array weightG_;
+
   void transformDims();
 
   void computeWeight();
 
+  // Whether v or g changed since the weight was computed in eval mode
+  bool isWeightStale() const;
+
   FL_SAVE_LOAD_DECLARE()
 
  public:
@@ -83,6 +91,15 @@ class WeightNorm : public Module {
    */
   ModulePtr module() const;
 
+  /**
+   * Sets the weight of the inner module to its current normalized value, as
+   * a plain parameter, and returns the inner module, e.g. to deploy a model
+   * without `WeightNorm`. This `WeightNorm` must not be used after.
+   *
+   * @return the inner module.
+   */
+  ModulePtr fold();
+
   void train() override;
 
   void eval() override;
@@ -91,6 +108,16 @@ class WeightNorm : public Module {
 
   std::vector<Variable> forward(const std::vector<Variable>& inputs) override;
 
+  /// Streams through the inner module, see `Module::forwardChunk()`
+  std::vector<Variable> forwardChunk(
+      const std::vector<Variable>& inputs) override;
+
+  void resetStreamingState() override;
+
+  std::vector<Variable> streamingState() const override;
+
+  void setStreamingState(const std::vector<Variable>& state) override;
+
   std::string prettyString() const override;
 };
 
@@ -109,6 +136,21 @@ void WeightNorm::load(Archive& ar, const uint32_t /* version */) {
   computeWeight();
 }
 
+/**
+ * Computes the weight `v * g / ||v||` of a `WeightNorm`, where the norm is
+ * over all the dimensions but `dim` (0 or 3), in a single autograd node.
+ */
+Variable weightNormWeight(const Variable& v, const Variable& g, int dim);
+
+/**
+ * Replaces `module` if it is a `WeightNorm`, or the `WeightNorm` modules of
+ * its containers recursively, by the modules they wrap (see
+ * `WeightNorm::fold()`), for inference.
+ *
+ * @return the module replacing `module`, or `module`
+ */
+ModulePtr foldWeightNorm(const ModulePtr& module);
+
 } // namespace fl
 
 CEREAL_REGISTER_TYPE(fl::WeightNorm)
@@ -16,6 +16,11 @@
 #pragma once
 
 #include "flashlight/fl/nn/DistributedUtils.h"
+#include "flashlight/fl/nn/Fusion.h"
+#include "flashlight/fl/nn/InferenceExecutor.h"
 #include "flashlight/fl/nn/Init.h"
+#include "flashlight/fl/nn/ModuleProfiler.h"
+#include "flashlight/fl/nn/Pipeline.h"
+#include "flashlight/fl/nn/Quantization.h"
 #include "flashlight/fl/nn/Utils.h"
 #include "flashlight/fl/nn/modules/modules.h"
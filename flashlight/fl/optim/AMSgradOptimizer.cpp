@@ -17,6 +17,8 @@
 
 #include <cmath>
 
+#include "flashlight/fl/optim/MultiTensor.h"
+
 using std::vector;
 
 namespace fl {
@@ -27,7 +29,8 @@ AMSgradOptimizer::AMSgradOptimizer(
     float beta1 /* = 0.9 */,
     float beta2 /* = 0.999 */,
     float epsilon /* = 1e-8 */,
-    float weightDecay /* = 0 */)
+    float weightDecay /* = 0 */,
+    bool quantizedStates /* = false */)
     : FirstOrderOptimizer(parameters, learningRate),
       beta1_(beta1),
       beta2_(beta2),
@@ -35,7 +38,16 @@ AMSgradOptimizer::AMSgradOptimizer(
       wd_(weightDecay),
       biasedFirst_(),
       biasedSecond_(),
-      maxExpAvgSq_() {
+      maxExpAvgSq_(),
+      quantizedStates_(quantizedStates) {
+  if (quantizedStates_) {
+    for (const auto& parameter : parameters_) {
+      quantizedFirst_.emplace_back(parameter.dims(), true);
+      quantizedSecond_.emplace_back(parameter.dims(), false);
+      quantizedMaxExpAvgSq_.emplace_back(parameter.dims(), false);
+    }
+    return;
+  }
   biasedFirst_.reserve(parameters.size());
   biasedSecond_.reserve(parameters.size());
   maxExpAvgSq_.reserve(parameters.size());
@@ -55,6 +67,53 @@ AMSgradOptimizer::AMSgradOptimizer(
 }
 
 void AMSgradOptimizer::step() {
+  std::vector<af::array*> grads, data, biasedFirst, biasedSecond, maxExpAvgSq;
+  std::vector<QuantizedState*> quantizedFirst, quantizedSecond,
+      quantizedMaxExpAvgSq;
+  for (size_t i = 0; i < parameters_.size(); i++) {
+    if (parameters_[i].isGradAvailable()) {
+      grads.push_back(&parameters_[i].grad().array());
+      data.push_back(&parameters_[i].array());
+      if (quantizedStates_) {
+        quantizedFirst.push_back(&quantizedFirst_[i]);
+        quantizedSecond.push_back(&quantizedSecond_[i]);
+        quantizedMaxExpAvgSq.push_back(&quantizedMaxExpAvgSq_[i]);
+      } else {
+        biasedFirst.push_back(&biasedFirst_[i]);
+        biasedSecond.push_back(&biasedSecond_[i]);
+        maxExpAvgSq.push_back(&maxExpAvgSq_[i]);
+      }
+    }
+  }
+  if (detail::multiTensorSupported(data) && quantizedStates_) {
+    detail::quantizedAMSgrad(
+        grads,
+        data,
+        quantizedFirst,
+        quantizedSecond,
+        quantizedMaxExpAvgSq,
+        lr_,
+        beta1_,
+        beta2_,
+        eps_,
+        wd_);
+    return;
+  }
+  if (detail::multiTensorSupported(data)) {
+    detail::multiTensorAMSgrad(
+        grads,
+        data,
+        biasedFirst,
+        biasedSecond,
+        maxExpAvgSq,
+        lr_,
+        beta1_,
+        beta2_,
+        eps_,
+        wd_);
+    return;
+  }
+
   for (size_t i = 0; i < parameters_.size(); i++) {
     if (!parameters_[i].isGradAvailable()) {
       continue;
@@ -67,9 +126,15 @@ void AMSgradOptimizer::step() {
       data = data - wd_ * data;
     }
 
-    af::array& biasedFirst = biasedFirst_[i];
-    af::array& biasedSecond = biasedSecond_[i];
-    af::array& maxExpAvgSq = maxExpAvgSq_[i];
+    af::array first, second, maxSecond;
+    if (quantizedStates_) {
+      first = quantizedFirst_[i].dequantize();
+      second = quantizedSecond_[i].dequantize();
+      maxSecond = quantizedMaxExpAvgSq_[i].dequantize();
+    }
+    af::array& biasedFirst = quantizedStates_ ? first : biasedFirst_[i];
+    af::array& biasedSecond = quantizedStates_ ? second : biasedSecond_[i];
+    af::array& maxExpAvgSq = quantizedStates_ ? maxSecond : maxExpAvgSq_[i];
 
     biasedFirst = beta1_ * biasedFirst + (1 - beta1_) * grad;
     biasedSecond = beta2_ * biasedSecond + (1 - beta2_) * grad * grad;
@@ -77,6 +142,11 @@ void AMSgradOptimizer::step() {
     af::eval(biasedFirst);
     af::eval(biasedSecond);
     af::eval(maxExpAvgSq);
+    if (quantizedStates_) {
+      quantizedFirst_[i] = QuantizedState::quantize(biasedFirst, true);
+      quantizedSecond_[i] = QuantizedState::quantize(biasedSecond, false);
+      quantizedMaxExpAvgSq_[i] = QuantizedState::quantize(maxExpAvgSq, false);
+    }
 
     data = data - (lr_ * biasedFirst) / (af::sqrt(maxExpAvgSq) + eps_);
 
@@ -91,8 +161,15 @@ std::string AMSgradOptimizer::prettyString() const {
   if (wd_ != 0) {
     ss << " (weight decay=" << wd_ << ")";
   }
+  if (quantizedStates_) {
+    ss << " (8-bit states)";
+  }
 
   return ss.str();
 }
 
+std::vector<af::array*> AMSgradOptimizer::getStateArrays() {
+  return detail::stateArrays({&biasedFirst_, &biasedSecond_, &maxExpAvgSq_});
+}
+
 } // namespace fl
@@ -21,6 +21,7 @@
 
 #include "flashlight/fl/autograd/Variable.h"
 #include "flashlight/fl/optim/Optimizers.h"
+#include "flashlight/fl/optim/QuantizedState.h"
 
 namespace fl {
 
@@ -28,6 +29,8 @@ namespace fl {
  * For more details see the paper
  * [On the Convergence of Adam and Beyond]
  *    https://openreview.net/pdf?id=ryQu7f-RZ).
+ *
+ * The moments can be stored in 8 bits, as with `AdamOptimizer`.
  */
 class AMSgradOptimizer : public FirstOrderOptimizer {
  private:
@@ -39,7 +42,11 @@ class AMSgradOptimizer : public FirstOrderOptimizer {
       wd_,
       biasedFirst_,
       biasedSecond_,
-      maxExpAvgSq_)
+      maxExpAvgSq_,
+      fl::versioned(quantizedStates_, 1),
+      fl::versioned(quantizedFirst_, 1),
+      fl::versioned(quantizedSecond_, 1),
+      fl::versioned(quantizedMaxExpAvgSq_, 1))
 
   AMSgradOptimizer() = default; // Intentionally private
 
@@ -50,6 +57,10 @@ class AMSgradOptimizer : public FirstOrderOptimizer {
   std::vector<af::array> biasedFirst_;
   std::vector<af::array> biasedSecond_;
   std::vector<af::array> maxExpAvgSq_;
+  bool quantizedStates_{false};
+  std::vector<QuantizedState> quantizedFirst_;
+  std::vector<QuantizedState> quantizedSecond_;
+  std::vector<QuantizedState> quantizedMaxExpAvgSq_;
 
  public:
   /** Construct an AMSgrad optimizer
@@ -60,6 +71,7 @@ class AMSgradOptimizer : public FirstOrderOptimizer {
    * @param epsilon A small value used for numerical stability.
    * @param weightDecay The amount of L2 weight decay to use for all the
    * parameters.
+   * @param quantizedStates Whether the moments are stored in 8 bits.
    */
   AMSgradOptimizer(
       const std::vector<Variable>& parameters,
@@ -67,13 +79,17 @@ class AMSgradOptimizer : public FirstOrderOptimizer {
       float beta1 = 0.9,
       float beta2 = 0.999,
       float epsilon = 1e-8,
-      float weightDecay = 0);
+      float weightDecay = 0,
+      bool quantizedStates = false);
 
   void step() override;
 
   std::string prettyString() const override;
+
+  std::vector<af::array*> getStateArrays() override;
 };
 
 } // namespace fl
 
 CEREAL_REGISTER_TYPE(fl::AMSgradOptimizer)
+CEREAL_CLASS_VERSION(fl::AMSgradOptimizer, 1)
@@ -88,4 +88,8 @@ std::string AdadeltaOptimizer::prettyString() const {
   return ss.str();
 }
 
+std::vector<af::array*> AdadeltaOptimizer::getStateArrays() {
+  return detail::stateArrays({&accGrad_, &accDelta_});
+}
+
 } // namespace fl
@@ -67,6 +67,8 @@ class AdadeltaOptimizer : public FirstOrderOptimizer {
   void step() override;
 
   std::string prettyString() const override;
+
+  std::vector<af::array*> getStateArrays() override;
 };
 
 } // namespace fl
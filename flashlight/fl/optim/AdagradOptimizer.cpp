@@ -67,4 +67,8 @@ std::string AdagradOptimizer::prettyString() const {
   return ss.str();
 }
 
+std::vector<af::array*> AdagradOptimizer::getStateArrays() {
+  return detail::stateArrays({&variance_});
+}
+
 } // namespace fl
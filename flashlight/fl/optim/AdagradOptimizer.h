@@ -56,6 +56,8 @@ class AdagradOptimizer : public FirstOrderOptimizer {
   void step() override;
 
   std::string prettyString() const override;
+
+  std::vector<af::array*> getStateArrays() override;
 };
 } // namespace fl
 
@@ -17,6 +17,9 @@
 
 #include <cmath>
 
+#include "flashlight/fl/optim/MultiTensor.h"
+#include "flashlight/fl/optim/Utils.h"
+
 using std::vector;
 
 namespace fl {
@@ -27,7 +30,8 @@ AdamOptimizer::AdamOptimizer(
     float beta1 /* = 0.9 */,
     float beta2 /* = 0.999 */,
     float epsilon /* = 1e-8 */,
-    float weightDecay /* = 0 */)
+    float weightDecay /* = 0 */,
+    bool quantizedStates /* = false */)
     : FirstOrderOptimizer(parameters, learningRate),
       beta1_(beta1),
       beta2_(beta2),
@@ -35,7 +39,15 @@ AdamOptimizer::AdamOptimizer(
       wd_(weightDecay),
       count_(0),
       biasedFirst_(),
-      biasedSecond_() {
+      biasedSecond_(),
+      quantizedStates_(quantizedStates) {
+  if (quantizedStates_) {
+    for (const auto& parameter : parameters_) {
+      quantizedFirst_.emplace_back(parameter.dims(), true);
+      quantizedSecond_.emplace_back(parameter.dims(), false);
+    }
+    return;
+  }
   biasedFirst_.reserve(parameters.size());
   biasedSecond_.reserve(parameters.size());
 
@@ -56,8 +68,95 @@ void AdamOptimizer::step() {
   float correctedBias2 = 1 - std::pow(beta2_, count_);
   float correctedLr = lr_ * std::sqrt(correctedBias2) / correctedBias1;
 
+  // Lazy updates of the slices held by sparse gradients
   for (size_t i = 0; i < parameters_.size(); i++) {
-    if (!parameters_[i].isGradAvailable()) {
+    if (!parameters_[i].isGradSparse() ||
+        parameters_[i].sparseGrad().sparseIndices().isempty()) {
+      continue;
+    }
+    const auto& sparseGrad = parameters_[i].sparseGrad();
+    auto slices = detail::sparseSlices(sparseGrad);
+    const af::array& grad = sparseGrad.array();
+    af::array& data = parameters_[i].array();
+    af::array sliceData = data(slices.first, slices.second);
+
+    if (wd_ != 0) {
+      // Weight decay term
+      sliceData = sliceData - wd_ * lr_ * sliceData;
+    }
+
+    af::array first, second;
+    if (quantizedStates_) {
+      first = quantizedFirst_[i].dequantize();
+      second = quantizedSecond_[i].dequantize();
+    }
+    af::array& biasedFirst = quantizedStates_ ? first : biasedFirst_[i];
+    af::array& biasedSecond = quantizedStates_ ? second : biasedSecond_[i];
+    af::array sliceFirst = beta1_ * biasedFirst(slices.first, slices.second) +
+        (1 - beta1_) * grad;
+    af::array sliceSecond =
+        beta2_ * biasedSecond(slices.first, slices.second) +
+        (1 - beta2_) * grad * grad;
+    biasedFirst(slices.first, slices.second) = sliceFirst;
+    biasedSecond(slices.first, slices.second) = sliceSecond;
+    af::eval(biasedFirst);
+    af::eval(biasedSecond);
+    if (quantizedStates_) {
+      quantizedFirst_[i] = QuantizedState::quantize(biasedFirst, true);
+      quantizedSecond_[i] = QuantizedState::quantize(biasedSecond, false);
+    }
+
+    data(slices.first, slices.second) = sliceData -
+        (correctedLr * sliceFirst) / (af::sqrt(sliceSecond) + eps_);
+    af::eval(data);
+  }
+
+  std::vector<af::array*> grads, data, biasedFirst, biasedSecond;
+  std::vector<QuantizedState*> quantizedFirst, quantizedSecond;
+  for (size_t i = 0; i < parameters_.size(); i++) {
+    if (parameters_[i].isGradAvailable() && !parameters_[i].isGradSparse()) {
+      grads.push_back(&parameters_[i].grad().array());
+      data.push_back(&parameters_[i].array());
+      if (quantizedStates_) {
+        quantizedFirst.push_back(&quantizedFirst_[i]);
+        quantizedSecond.push_back(&quantizedSecond_[i]);
+      } else {
+        biasedFirst.push_back(&biasedFirst_[i]);
+        biasedSecond.push_back(&biasedSecond_[i]);
+      }
+    }
+  }
+  if (detail::multiTensorSupported(data) && quantizedStates_) {
+    detail::quantizedAdam(
+        grads,
+        data,
+        quantizedFirst,
+        quantizedSecond,
+        lr_,
+        correctedLr,
+        beta1_,
+        beta2_,
+        eps_,
+        wd_);
+    return;
+  }
+  if (detail::multiTensorSupported(data)) {
+    detail::multiTensorAdam(
+        grads,
+        data,
+        biasedFirst,
+        biasedSecond,
+        lr_,
+        correctedLr,
+        beta1_,
+        beta2_,
+        eps_,
+        wd_);
+    return;
+  }
+
+  for (size_t i = 0; i < parameters_.size(); i++) {
+    if (!parameters_[i].isGradAvailable() || parameters_[i].isGradSparse()) {
       continue;
     }
 
@@ -69,14 +168,23 @@ void AdamOptimizer::step() {
       data = data - wd_ * lr_ * data;
     }
 
-    af::array& biasedFirst = biasedFirst_[i];
-    af::array& biasedSecond = biasedSecond_[i];
+    af::array first, second;
+    if (quantizedStates_) {
+      first = quantizedFirst_[i].dequantize();
+      second = quantizedSecond_[i].dequantize();
+    }
+    af::array& biasedFirst = quantizedStates_ ? first : biasedFirst_[i];
+    af::array& biasedSecond = quantizedStates_ ? second : biasedSecond_[i];
 
     biasedFirst = beta1_ * biasedFirst + (1 - beta1_) * grad;
     biasedSecond = beta2_ * biasedSecond + (1 - beta2_) * grad * grad;
 
     af::eval(biasedFirst);
     af::eval(biasedSecond);
+    if (quantizedStates_) {
+      quantizedFirst_[i] = QuantizedState::quantize(biasedFirst, true);
+      quantizedSecond_[i] = QuantizedState::quantize(biasedSecond, false);
+    }
 
     data = data - (correctedLr * biasedFirst) / (af::sqrt(biasedSecond) + eps_);
 
@@ -91,8 +199,15 @@ std::string AdamOptimizer::prettyString() const {
   if (wd_ != 0) {
     ss << " (weight decay=" << wd_ << ")";
   }
+  if (quantizedStates_) {
+    ss << " (8-bit states)";
+  }
 
   return ss.str();
 }
 
+std::vector<af::array*> AdamOptimizer::getStateArrays() {
+  return detail::stateArrays({&biasedFirst_, &biasedSecond_});
+}
+
 } // namespace fl
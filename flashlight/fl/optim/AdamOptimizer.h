@@ -21,6 +21,7 @@
 
 #include "flashlight/fl/autograd/Variable.h"
 #include "flashlight/fl/optim/Optimizers.h"
+#include "flashlight/fl/optim/QuantizedState.h"
 
 namespace fl {
 
@@ -28,6 +29,14 @@ namespace fl {
  * For more details see the paper
  * [Adam: A Method for Stochastic Optimization](
  *    https://arxiv.org/abs/1412.6980).
+ *
+ * Sparse gradients (see `Variable::sparse()`) are handled lazily: only the
+ * moments and weights of the slices they hold are updated (and decayed).
+ *
+ * The moments can be stored in 8 bits (see `QuantizedState`), which divides
+ * the memory of the state by almost 4 at the cost of a small loss of
+ * precision. They are then saved quantized, and not returned by
+ * `getStateArrays()`.
  */
 class AdamOptimizer : public FirstOrderOptimizer {
  private:
@@ -39,7 +48,10 @@ class AdamOptimizer : public FirstOrderOptimizer {
       fl::serializeAs<double>(wd_),
       count_,
       biasedFirst_,
-      biasedSecond_)
+      biasedSecond_,
+      fl::versioned(quantizedStates_, 1),
+      fl::versioned(quantizedFirst_, 1),
+      fl::versioned(quantizedSecond_, 1))
 
   AdamOptimizer() = default; // Intentionally private
 
@@ -50,6 +62,9 @@ class AdamOptimizer : public FirstOrderOptimizer {
   int count_;
   std::vector<af::array> biasedFirst_;
   std::vector<af::array> biasedSecond_;
+  bool quantizedStates_{false};
+  std::vector<QuantizedState> quantizedFirst_;
+  std::vector<QuantizedState> quantizedSecond_;
 
  public:
   /** Construct an Adam optimizer.
@@ -60,6 +75,7 @@ class AdamOptimizer : public FirstOrderOptimizer {
    * @param epsilon A small value used for numerical stability.
    * @param weightDecay The amount of L2 weight decay to use for all the
    * parameters.
+   * @param quantizedStates Whether the moments are stored in 8 bits.
    */
   AdamOptimizer(
       const std::vector<Variable>& parameters,
@@ -67,13 +83,17 @@ class AdamOptimizer : public FirstOrderOptimizer {
       float beta1 = 0.9,
       float beta2 = 0.999,
       float epsilon = 1e-8,
-      float weightDecay = 0);
+      float weightDecay = 0,
+      bool quantizedStates = false);
 
   void step() override;
 
   std::string prettyString() const override;
+
+  std::vector<af::array*> getStateArrays() override;
 };
 
 } // namespace fl
 
 CEREAL_REGISTER_TYPE(fl::AdamOptimizer)
+CEREAL_CLASS_VERSION(fl::AdamOptimizer, 1)
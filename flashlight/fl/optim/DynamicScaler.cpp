@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/optim/DynamicScaler.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "flashlight/fl/optim/MultiTensor.h"
+
+namespace fl {
+
+DynamicScaler::DynamicScaler(
+    double initScaleFactor,
+    double maxScaleFactor,
+    unsigned int updateInterval,
+    double minScaleFactor /* = kAmpMinimumScaleFactorValue */)
+    : scaleFactor_(initScaleFactor),
+      maxScaleFactor_(maxScaleFactor),
+      minScaleFactor_(minScaleFactor),
+      updateInterval_(updateInterval) {
+  if (initScaleFactor <= 0 || maxScaleFactor < initScaleFactor ||
+      updateInterval == 0) {
+    throw std::invalid_argument(
+        "DynamicScaler: invalid scale factors or update interval");
+  }
+}
+
+Variable DynamicScaler::scale(const Variable& loss) const {
+  // An f16 loss would overflow for scale factors above 65504
+  return loss.as(af::dtype::f32) * scaleFactor_;
+}
+
+af::array DynamicScaler::unscaleAsync(
+    const std::vector<Variable>& params,
+    double divisor /* = 1.0 */) const {
+  std::vector<af::array*> grads;
+  for (const auto& p : params) {
+    if (p.isGradSparse()) {
+      grads.push_back(&p.sparseGrad().array());
+    } else if (p.isGradAvailable()) {
+      grads.push_back(&p.grad().array());
+    }
+  }
+  float invScale = 1.0 / (scaleFactor_ * divisor);
+  if (grads.empty()) {
+    return af::constant(0, 1, af::dtype::f32);
+  }
+
+  if (detail::multiTensorSupported(grads)) {
+    // Inf/NaN values propagate to the squared norms, which are computed with
+    // the scaling in two kernels in total
+    detail::multiTensorScale(grads, af::constant(invScale, 1, af::dtype::f32));
+    auto squaredNorm = af::sum(detail::multiTensorSquaredNorm(grads));
+    return (af::isInf(squaredNorm) || af::isNaN(squaredNorm))
+        .as(af::dtype::f32);
+  }
+  auto overflow = af::constant(0, 1, af::dtype::b8);
+  for (auto* grad : grads) {
+    *grad = *grad * invScale;
+    overflow = overflow ||
+        af::anyTrue(af::flat(af::isInf(*grad) || af::isNaN(*grad)));
+    grad->eval();
+  }
+  return overflow.as(af::dtype::f32);
+}
+
+bool DynamicScaler::unscale(
+    const std::vector<Variable>& params,
+    double divisor /* = 1.0 */) {
+  return update(unscaleAsync(params, divisor).scalar<float>() != 0);
+}
+
+bool DynamicScaler::update(bool overflow) {
+  if (overflow) {
+    successCounter_ = 0;
+    scaleFactor_ /= 2;
+    if (scaleFactor_ < minScaleFactor_) {
+      throw std::runtime_error(
+          "DynamicScaler: minimum loss scale " +
+          std::to_string(minScaleFactor_) +
+          " reached with over/underflowing gradients. Lowering the learning "
+          "rate, using gradient clipping, or increasing the batch size can "
+          "help resolve loss explosion.");
+    }
+    return false;
+  }
+  if (++successCounter_ >= updateInterval_) {
+    successCounter_ = 0;
+    scaleFactor_ = std::min(scaleFactor_ * 2, maxScaleFactor_);
+  }
+  return true;
+}
+
+double DynamicScaler::getScaleFactor() const {
+  return scaleFactor_;
+}
+
+void DynamicScaler::setScaleFactor(double scaleFactor) {
+  scaleFactor_ = scaleFactor;
+  successCounter_ = 0;
+}
+
+} // namespace fl
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "flashlight/fl/autograd/Variable.h"
+#include "flashlight/fl/common/Defines.h"
+
+namespace fl {
+
+/**
+ * Dynamic loss scaling for mixed-precision training: the loss is multiplied by
+ * a scale factor before the backward pass so that small f16 gradients don't
+ * underflow, and the gradients are divided by it before the update.
+ *
+ * The factor is halved (and the update skipped) whenever the gradients have
+ * Inf/NaN values, and doubled, up to `maxScaleFactor`, after `updateInterval`
+ * consecutive steps without overflow. See
+ * [Micikevicius et al (2017)](https://arxiv.org/abs/1710.03740).
+ *
+ * Typical use:
+ * \code
+ * loss = scaler.scale(loss);
+ * loss.backward();
+ * if (scaler.unscale(model.params())) {
+ *   optimizer.step();
+ * }
+ * \endcode
+ */
+class DynamicScaler {
+ public:
+  DynamicScaler(
+      double initScaleFactor,
+      double maxScaleFactor,
+      unsigned int updateInterval,
+      double minScaleFactor = kAmpMinimumScaleFactorValue);
+
+  /** Returns the loss multiplied by the scale factor, in f32. */
+  Variable scale(const Variable& loss) const;
+
+  /**
+   * Divides the gradients of `params` in place by the scale factor times
+   * `divisor` (e.g. the batch size), and checks them for Inf/NaN values with
+   * one synchronization, then updates the scale factor (see `update()`).
+   *
+   * @return whether the gradients are finite: the update should be skipped
+   * otherwise
+   */
+  bool unscale(const std::vector<Variable>& params, double divisor = 1.0);
+
+  /**
+   * Same as `unscale`, without checking the result on the host nor updating
+   * the scale factor.
+   *
+   * @return a one-element f32 array, non-zero if the gradients have Inf/NaN
+   * values, which may be summed over processes (e.g. when gradients are
+   * sharded) before calling `update()`
+   */
+  af::array unscaleAsync(
+      const std::vector<Variable>& params,
+      double divisor = 1.0) const;
+
+  /**
+   * Halves the scale factor if `overflow`, else doubles it after
+   * `updateInterval` consecutive steps without overflow. Throws if the factor
+   * decreases below the minimum, which usually means that the loss diverged.
+   *
+   * @return `!overflow`
+   */
+  bool update(bool overflow);
+
+  double getScaleFactor() const;
+
+  void setScaleFactor(double scaleFactor);
+
+ private:
+  double scaleFactor_;
+  double maxScaleFactor_;
+  double minScaleFactor_;
+  unsigned int updateInterval_;
+  unsigned int successCounter_{0};
+};
+
+} // namespace fl
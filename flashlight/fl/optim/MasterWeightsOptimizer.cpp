@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/optim/MasterWeightsOptimizer.h"
+
+#include <sstream>
+#include <stdexcept>
+
+namespace fl {
+
+MasterWeightsOptimizer::MasterWeightsOptimizer(
+    const std::vector<Variable>& parameters,
+    const OptimizerFactory& createOptimizer)
+    : FirstOrderOptimizer(parameters, 0.0) {
+  for (const auto& parameter : parameters_) {
+    if (parameter.type() != af::dtype::f16) {
+      masters_.push_back(parameter);
+    } else {
+      masters_.emplace_back(
+          parameter.array().as(af::dtype::f32), /* calcGrad = */ true);
+    }
+  }
+  optimizer_ = createOptimizer(masters_);
+  if (!optimizer_) {
+    throw std::invalid_argument("MasterWeightsOptimizer: null optimizer");
+  }
+  lr_ = optimizer_->getLr();
+}
+
+bool MasterWeightsOptimizer::hasMaster(size_t i) const {
+  return parameters_[i].type() == af::dtype::f16;
+}
+
+void MasterWeightsOptimizer::syncMasterWeights() {
+  for (size_t i = 0; i < parameters_.size(); ++i) {
+    if (hasMaster(i)) {
+      masters_[i].array() = parameters_[i].array().as(af::dtype::f32);
+    }
+  }
+}
+
+const std::vector<Variable>& MasterWeightsOptimizer::getMasterWeights()
+    const {
+  return masters_;
+}
+
+void MasterWeightsOptimizer::step() {
+  std::vector<size_t> updated;
+  for (size_t i = 0; i < parameters_.size(); ++i) {
+    const auto& parameter = parameters_[i];
+    if (!hasMaster(i) || !parameter.isGradAvailable()) {
+      continue;
+    }
+    auto& master = masters_[i];
+    master.zeroGrad();
+    if (parameter.isGradSparse()) {
+      const auto& grad = parameter.sparseGrad();
+      master.addGrad(Variable::sparse(
+          grad.array().as(af::dtype::f32),
+          grad.sparseIndices(),
+          grad.sparseDim(),
+          grad.denseDims()));
+    } else {
+      master.addGrad(
+          Variable(parameter.grad().array().as(af::dtype::f32), false));
+    }
+    updated.push_back(i);
+  }
+
+  optimizer_->setLr(lr_);
+  optimizer_->step();
+
+  // The casts of all the parameters are evaluated at once
+  std::vector<af::array*> casts;
+  for (auto i : updated) {
+    auto& parameter = parameters_[i];
+    parameter.array() = masters_[i].array().as(parameter.type());
+    casts.push_back(&parameter.array());
+    masters_[i].zeroGrad();
+  }
+  if (!casts.empty()) {
+    af::eval(casts.size(), casts.data());
+  }
+}
+
+void MasterWeightsOptimizer::zeroGrad() {
+  FirstOrderOptimizer::zeroGrad();
+  optimizer_->zeroGrad();
+}
+
+std::vector<af::array*> MasterWeightsOptimizer::getStateArrays() {
+  return optimizer_->getStateArrays();
+}
+
+std::string MasterWeightsOptimizer::prettyString() const {
+  std::ostringstream ss;
+  ss << "Master weights " << optimizer_->prettyString();
+  return ss.str();
+}
+
+} // namespace fl
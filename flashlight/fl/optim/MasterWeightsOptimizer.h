@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "flashlight/fl/common/Serialization.h"
+#include "flashlight/fl/optim/Optimizers.h"
+
+namespace fl {
+
+/** An optimizer which updates f32 master weights of f16 parameters, such as
+ * the tables of `Embedding`, `AdaptiveEmbedding` or `AdaptiveSoftMax` stored
+ * in f16 with `setWeightType()`. The forward and backward passes read the f16
+ * parameters, while the updates accumulate in f32.
+ *
+ * At each step, the gradients of the f16 parameters are cast to f32
+ * (sparse gradients stay sparse) for the wrapped optimizer, which updates the
+ * master weights. The parameters are then replaced by their master weights
+ * cast to f16, evaluated together. The other parameters are their own master
+ * weights, and are updated by the wrapped optimizer directly.
+ *
+ * The master weights are saved with the optimizer, and are the ones of the
+ * parameters saved in the same archive. If the parameters are modified
+ * elsewhere (e.g. loaded separately, or averaged across processes), call
+ * `syncMasterWeights()` to derive the master weights from them.
+ *
+ * Example usage:
+ *
+ * \code
+ * embedding->setWeightType(af::dtype::f16);
+ * MasterWeightsOptimizer optimizer(
+ *     model.params(), [](const std::vector<Variable>& masters) {
+ *       return std::make_shared<AdamOptimizer>(masters, 1e-3);
+ *     });
+ * \endcode
+ */
+class MasterWeightsOptimizer : public FirstOrderOptimizer {
+ public:
+  /**
+   * Creates the wrapped optimizer for the master weights.
+   */
+  using OptimizerFactory = std::function<std::shared_ptr<FirstOrderOptimizer>(
+      const std::vector<Variable>&)>;
+
+  /** Constructs a `MasterWeightsOptimizer`.
+   * @param parameters The parameters from e.g. `model.parameters()`
+   * @param createOptimizer Creates the wrapped optimizer of the master
+   * weights, whose learning rate is the initial learning rate
+   */
+  MasterWeightsOptimizer(
+      const std::vector<Variable>& parameters,
+      const OptimizerFactory& createOptimizer);
+
+  /** Copies the parameters to the master weights, in f32. */
+  void syncMasterWeights();
+
+  /** Returns the master weights, in the order of the parameters. */
+  const std::vector<Variable>& getMasterWeights() const;
+
+  void step() override;
+
+  void zeroGrad() override;
+
+  std::vector<af::array*> getStateArrays() override;
+
+  std::string prettyString() const override;
+
+ private:
+  FL_SAVE_LOAD_WITH_BASE(FirstOrderOptimizer, optimizer_, masters_)
+
+  MasterWeightsOptimizer() = default; // Intentionally private
+
+  // Whether the i-th parameter has a master weight distinct from itself, i.e.
+  // is in f16
+  bool hasMaster(size_t i) const;
+
+  std::shared_ptr<FirstOrderOptimizer> optimizer_;
+  // The parameters themselves for the ones which aren't in f16
+  std::vector<Variable> masters_;
+};
+
+} // namespace fl
+
+CEREAL_REGISTER_TYPE(fl::MasterWeightsOptimizer)
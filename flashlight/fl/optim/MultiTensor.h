@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include <arrayfire.h>
+
+namespace fl {
+
+struct QuantizedState;
+
+namespace detail {
+
+/**
+ * Multi-tensor optimizer updates: each function updates all the given
+ * parameters (and their optimizer states) with a few kernel launches in total,
+ * rather than launching several ArrayFire operations per parameter. The i-th
+ * elements of the lists of tensors belong to the same parameter; the tensors
+ * of the parameters and of their states are updated in place.
+ */
+
+/**
+ * Whether the backend has multi-tensor kernels for these tensors (CUDA, with
+ * f32 tensors). Optimizers fall back to per-tensor operators otherwise.
+ */
+bool multiTensorSupported(const std::vector<af::array*>& tensors);
+
+/**
+ * Adam update (see `AdamOptimizer`), with `correctedLr` the learning rate
+ * corrected for the bias of the moments.
+ */
+void multiTensorAdam(
+    const std::vector<af::array*>& grads,
+    const std::vector<af::array*>& data,
+    const std::vector<af::array*>& biasedFirst,
+    const std::vector<af::array*>& biasedSecond,
+    float lr,
+    float correctedLr,
+    float beta1,
+    float beta2,
+    float eps,
+    float weightDecay);
+
+/**
+ * AMSgrad update (see `AMSgradOptimizer`).
+ */
+void multiTensorAMSgrad(
+    const std::vector<af::array*>& grads,
+    const std::vector<af::array*>& data,
+    const std::vector<af::array*>& biasedFirst,
+    const std::vector<af::array*>& biasedSecond,
+    const std::vector<af::array*>& maxExpAvgSq,
+    float lr,
+    float beta1,
+    float beta2,
+    float eps,
+    float weightDecay);
+
+/**
+ * Adam update with 8-bit moments (see `QuantizedState`). The moments are
+ * dequantized, updated and quantized again by one kernel per parameter, in
+ * which each block of threads updates a block of quantization.
+ */
+void quantizedAdam(
+    const std::vector<af::array*>& grads,
+    const std::vector<af::array*>& data,
+    const std::vector<QuantizedState*>& biasedFirst,
+    const std::vector<QuantizedState*>& biasedSecond,
+    float lr,
+    float correctedLr,
+    float beta1,
+    float beta2,
+    float eps,
+    float weightDecay);
+
+/**
+ * AMSgrad update with 8-bit moments (see `quantizedAdam`).
+ */
+void quantizedAMSgrad(
+    const std::vector<af::array*>& grads,
+    const std::vector<af::array*>& data,
+    const std::vector<QuantizedState*>& biasedFirst,
+    const std::vector<QuantizedState*>& biasedSecond,
+    const std::vector<QuantizedState*>& maxExpAvgSq,
+    float lr,
+    float beta1,
+    float beta2,
+    float eps,
+    float weightDecay);
+
+/**
+ * SGD update (see `SGDOptimizer`); `velocities` is empty without momentum.
+ */
+void multiTensorSGD(
+    const std::vector<af::array*>& grads,
+    const std::vector<af::array*>& data,
+    const std::vector<af::array*>& velocities,
+    float lr,
+    float momentum,
+    float weightDecay,
+    bool useNesterov);
+
+/**
+ * Computes the squared L2 norm of each tensor, as an f32 array of
+ * `tensors.size()` elements, without synchronizing with the host.
+ */
+af::array multiTensorSquaredNorm(const std::vector<af::array*>& tensors);
+
+/**
+ * Scales the tensors in place by `scale`, a one-element f32 array which is
+ * read on the device.
+ */
+void multiTensorScale(
+    const std::vector<af::array*>& tensors,
+    const af::array& scale);
+
+/**
+ * Novograd update (see `NovogradOptimizer`), where the gradient of the i-th
+ * parameter is scaled by `gradScales[i]`.
+ */
+void multiTensorNovograd(
+    const std::vector<af::array*>& grads,
+    const std::vector<af::array*>& data,
+    const std::vector<af::array*>& accGrads,
+    const std::vector<float>& gradScales,
+    float lr,
+    float beta1,
+    float weightDecay);
+
+} // namespace detail
+} // namespace fl
@@ -72,4 +72,8 @@ std::string NAGOptimizer::prettyString() const {
   return ss.str();
 }
 
+std::vector<af::array*> NAGOptimizer::getStateArrays() {
+  return detail::stateArrays({&velocities_});
+}
+
 } // namespace fl
@@ -48,6 +48,8 @@ class NAGOptimizer : public FirstOrderOptimizer {
   void step() override;
 
   std::string prettyString() const override;
+
+  std::vector<af::array*> getStateArrays() override;
 };
 
 } // namespace fl
@@ -17,6 +17,8 @@
 
 #include <cmath>
 
+#include "flashlight/fl/optim/MultiTensor.h"
+
 using std::vector;
 
 namespace fl {
@@ -47,6 +49,34 @@ NovogradOptimizer::NovogradOptimizer(
 }
 
 void NovogradOptimizer::step() {
+  std::vector<size_t> indices;
+  std::vector<af::array*> grads, data, accGrads;
+  for (size_t i = 0; i < parameters_.size(); i++) {
+    if (parameters_[i].isGradAvailable()) {
+      indices.push_back(i);
+      grads.push_back(&parameters_[i].grad().array());
+      data.push_back(&parameters_[i].array());
+      accGrads.push_back(&accGrad_[i]);
+    }
+  }
+  if (detail::multiTensorSupported(data)) {
+    // a single synchronization for the norms of all the gradients
+    std::vector<float> gradNorms(grads.size());
+    if (!grads.empty()) {
+      detail::multiTensorSquaredNorm(grads).host(gradNorms.data());
+    }
+    std::vector<float> gradScales;
+    for (size_t j = 0; j < indices.size(); j++) {
+      double& accGradNorm = accGradNorm_[indices[j]];
+      accGradNorm = beta2_ * accGradNorm + (1 - beta2_) * gradNorms[j];
+      gradScales.push_back(
+          1 / static_cast<float>(std::sqrt(accGradNorm) + eps_));
+    }
+    detail::multiTensorNovograd(
+        grads, data, accGrads, gradScales, lr_, beta1_, wd_);
+    return;
+  }
+
   for (size_t i = 0; i < parameters_.size(); i++) {
     if (!parameters_[i].isGradAvailable()) {
       continue;
@@ -82,4 +112,8 @@ std::string NovogradOptimizer::prettyString() const {
   return ss.str();
 }
 
+std::vector<af::array*> NovogradOptimizer::getStateArrays() {
+  return detail::stateArrays({&accGrad_});
+}
+
 } // namespace fl
@@ -70,6 +70,8 @@ class NovogradOptimizer : public FirstOrderOptimizer {
   void step() override;
 
   std::string prettyString() const override;
+
+  std::vector<af::array*> getStateArrays() override;
 };
 
 } // namespace fl
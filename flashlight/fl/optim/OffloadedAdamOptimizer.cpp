@@ -0,0 +1,290 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/optim/OffloadedAdamOptimizer.h"
+
+#include <cmath>
+#include <sstream>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "flashlight/fl/common/Logging.h"
+
+namespace fl {
+
+namespace {
+
+// Adam update of `n` consecutive elements, 4 at a time with SSE
+void adamUpdate(
+    float* __restrict w,
+    float* __restrict m,
+    float* __restrict v,
+    const float* __restrict g,
+    int64_t n,
+    float lrWd,
+    float correctedLr,
+    float beta1,
+    float beta2,
+    float eps) {
+  int64_t i = 0;
+#if defined(__SSE2__)
+  const __m128 decay = _mm_set1_ps(1 - lrWd);
+  const __m128 b1 = _mm_set1_ps(beta1);
+  const __m128 b1c = _mm_set1_ps(1 - beta1);
+  const __m128 b2 = _mm_set1_ps(beta2);
+  const __m128 b2c = _mm_set1_ps(1 - beta2);
+  const __m128 lr = _mm_set1_ps(correctedLr);
+  const __m128 e = _mm_set1_ps(eps);
+  for (; i + 4 <= n; i += 4) {
+    __m128 gi = _mm_loadu_ps(g + i);
+    __m128 mi = _mm_add_ps(
+        _mm_mul_ps(b1, _mm_loadu_ps(m + i)), _mm_mul_ps(b1c, gi));
+    __m128 vi = _mm_add_ps(
+        _mm_mul_ps(b2, _mm_loadu_ps(v + i)),
+        _mm_mul_ps(b2c, _mm_mul_ps(gi, gi)));
+    __m128 step = _mm_div_ps(
+        _mm_mul_ps(lr, mi), _mm_add_ps(_mm_sqrt_ps(vi), e));
+    _mm_storeu_ps(m + i, mi);
+    _mm_storeu_ps(v + i, vi);
+    _mm_storeu_ps(
+        w + i, _mm_sub_ps(_mm_mul_ps(decay, _mm_loadu_ps(w + i)), step));
+  }
+#endif
+  for (; i < n; ++i) {
+    m[i] = beta1 * m[i] + (1 - beta1) * g[i];
+    v[i] = beta2 * v[i] + (1 - beta2) * g[i] * g[i];
+    w[i] = (1 - lrWd) * w[i] - correctedLr * m[i] / (std::sqrt(v[i]) + eps);
+  }
+}
+
+} // namespace
+
+OffloadedAdamOptimizer::OffloadedAdamOptimizer(
+    const std::vector<Variable>& parameters,
+    float learningRate,
+    float beta1 /* = 0.9 */,
+    float beta2 /* = 0.999 */,
+    float epsilon /* = 1e-8 */,
+    float weightDecay /* = 0 */,
+    int numThreads /* = 4 */,
+    int64_t bucketBytes /* = 1 << 24 */)
+    : FirstOrderOptimizer(parameters, learningRate),
+      beta1_(beta1),
+      beta2_(beta2),
+      eps_(epsilon),
+      wd_(weightDecay),
+      numThreads_(numThreads),
+      bucketBytes_(bucketBytes) {
+  init();
+  syncMasterWeights();
+  std::fill(first_.getAs<float>(), first_.getAs<float>() + totalSize_, 0.f);
+  std::fill(second_.getAs<float>(), second_.getAs<float>() + totalSize_, 0.f);
+}
+
+OffloadedAdamOptimizer::~OffloadedAdamOptimizer() {
+  try {
+    waitBuckets();
+  } catch (const std::exception& ex) {
+    FL_LOG(fl::ERROR) << "OffloadedAdamOptimizer: update failed: "
+                      << ex.what();
+  }
+}
+
+void OffloadedAdamOptimizer::init() {
+  if (numThreads_ < 1 || bucketBytes_ < sizeof(float)) {
+    throw std::invalid_argument(
+        "OffloadedAdamOptimizer: needs numThreads >= 1 and bucketBytes >= 4");
+  }
+  offsets_.clear();
+  totalSize_ = 0;
+  for (const auto& parameter : parameters_) {
+    offsets_.push_back(totalSize_);
+    totalSize_ += parameter.elements();
+  }
+  bucketSize_ = bucketBytes_ / sizeof(float);
+  resetBuckets();
+  size_t bytes = totalSize_ * sizeof(float);
+  master_ = PinnedHostBuffer(bytes);
+  first_ = PinnedHostBuffer(bytes);
+  second_ = PinnedHostBuffer(bytes);
+  grads_ = PinnedHostBuffer(bytes);
+  auto deviceId = af::getDevice();
+  threadPool_ = std::make_unique<ThreadPool>(
+      numThreads_, [deviceId](int /* threadId */) { af::setDevice(deviceId); });
+}
+
+void OffloadedAdamOptimizer::resetBuckets() {
+  size_t numBuckets = (totalSize_ + bucketSize_ - 1) / bucketSize_;
+  waiting_.assign(numBuckets, 0);
+  updates_.clear();
+  updates_.resize(numBuckets);
+  for (size_t i = 0; i < parameters_.size(); ++i) {
+    dim_t n = parameters_[i].elements();
+    for (dim_t b = offsets_[i] / bucketSize_;
+         n > 0 && b * bucketSize_ < offsets_[i] + n;
+         ++b) {
+      ++waiting_[b];
+    }
+  }
+}
+
+void OffloadedAdamOptimizer::registerGradHooks() {
+  for (size_t i = 0; i < parameters_.size(); ++i) {
+    parameters_[i].registerGradHook(
+        [this, i](Variable& /* grad */) { gradReady(i); });
+  }
+}
+
+void OffloadedAdamOptimizer::syncMasterWeights() {
+  waitBuckets();
+  for (size_t i = 0; i < parameters_.size(); ++i) {
+    if (parameters_[i].elements() > 0) {
+      parameters_[i].array().as(f32).host(master_.getAs<float>() + offsets_[i]);
+    }
+  }
+}
+
+void OffloadedAdamOptimizer::gradReady(size_t i) {
+  dim_t n = parameters_[i].elements();
+  for (dim_t b = offsets_[i] / bucketSize_;
+       n > 0 && b * bucketSize_ < offsets_[i] + n;
+       ++b) {
+    if (--waiting_[b] == 0) {
+      sendBucket(b);
+    }
+  }
+}
+
+void OffloadedAdamOptimizer::sendBucket(size_t b) {
+  dim_t begin = b * bucketSize_;
+  dim_t end = std::min(begin + bucketSize_, totalSize_);
+  // Mark the bucket as sent
+  waiting_[b] = -1;
+
+  // Gradients of the bucket, and the ranges of the concatenation with one
+  auto grads = af::constant(0, end - begin, f32);
+  std::vector<std::pair<dim_t, dim_t>> ranges;
+  for (size_t i = 0; i < parameters_.size(); ++i) {
+    const auto& parameter = parameters_[i];
+    dim_t lo = std::max(begin, offsets_[i]);
+    dim_t hi = std::min(end, offsets_[i] + parameter.elements());
+    if (lo >= hi || !parameter.isGradAvailable()) {
+      continue;
+    }
+    if (parameter.isGradSparse()) {
+      throw std::invalid_argument(
+          "OffloadedAdamOptimizer: sparse gradients are not supported");
+    }
+    grads(af::seq(lo - begin, hi - begin - 1)) =
+        af::flat(parameter.grad().array())(
+            af::seq(lo - offsets_[i], hi - offsets_[i] - 1))
+            .as(f32);
+    ranges.emplace_back(lo, hi);
+  }
+  if (ranges.empty()) {
+    return;
+  }
+  grads.eval();
+
+  // The hyperparameters of the next step
+  int count = count_ + 1;
+  float correctedBias1 = 1 - std::pow(beta1_, count);
+  float correctedBias2 = 1 - std::pow(beta2_, count);
+  float correctedLr = lr_ * std::sqrt(correctedBias2) / correctedBias1;
+  float lrWd = wd_ * lr_;
+  updates_[b] =
+      threadPool_->enqueue([this, grads, begin, ranges, lrWd, correctedLr]() {
+        // Waits for the gradients on the device
+        grads.host(grads_.getAs<float>() + begin);
+        for (const auto& range : ranges) {
+          dim_t lo = range.first;
+          adamUpdate(
+              master_.getAs<float>() + lo,
+              first_.getAs<float>() + lo,
+              second_.getAs<float>() + lo,
+              grads_.getAs<float>() + lo,
+              range.second - lo,
+              lrWd,
+              correctedLr,
+              beta1_,
+              beta2_,
+              eps_);
+        }
+      });
+}
+
+void OffloadedAdamOptimizer::waitBuckets() {
+  std::exception_ptr error;
+  for (auto& update : updates_) {
+    if (update.valid()) {
+      try {
+        update.get();
+      } catch (...) {
+        error = std::current_exception();
+      }
+    }
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+void OffloadedAdamOptimizer::step() {
+  for (size_t b = 0; b < waiting_.size(); ++b) {
+    if (waiting_[b] >= 0) {
+      sendBucket(b);
+    }
+  }
+  // From the last bucket, sent first by the hooks of the backward pass: a
+  // parameter is copied back once the bucket of its first element is done
+  std::exception_ptr error;
+  size_t param = parameters_.size();
+  for (size_t b = updates_.size(); b-- > 0;) {
+    if (updates_[b].valid()) {
+      try {
+        updates_[b].get();
+      } catch (...) {
+        error = std::current_exception();
+      }
+    }
+    for (; param > 0 && offsets_[param - 1] >= b * bucketSize_; --param) {
+      auto& parameter = parameters_[param - 1];
+      if (error || !parameter.isGradAvailable() || parameter.elements() == 0) {
+        continue;
+      }
+      af::array updated(
+          parameter.elements(),
+          master_.getAs<float>() + offsets_[param - 1],
+          afHost);
+      parameter.array() =
+          af::moddims(updated, parameter.dims()).as(parameter.type());
+      parameter.array().eval();
+    }
+  }
+  // Ready for the next step
+  resetBuckets();
+  ++count_;
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+std::string OffloadedAdamOptimizer::prettyString() const {
+  std::ostringstream ss;
+  ss << "Offloaded Adam";
+
+  if (wd_ != 0) {
+    ss << " (weight decay=" << wd_ << ")";
+  }
+
+  return ss.str();
+}
+
+} // namespace fl
@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "flashlight/fl/common/PinnedHostBuffer.h"
+#include "flashlight/fl/common/threadpool/ThreadPool.h"
+#include "flashlight/fl/optim/Optimizers.h"
+
+namespace fl {
+
+/** An Adam optimizer (see `AdamOptimizer`) whose state lives in host memory
+ * (as ZeRO-Offload, https://arxiv.org/abs/2101.06840): f32 master weights
+ * and moments are kept in pinned host buffers and updated by a pool of CPU
+ * threads, so that the device only holds the parameters and their gradients.
+ *
+ * The parameters are flattened and concatenated, and the concatenation is
+ * split in buckets of `bucketBytes` bytes of f32. A bucket is updated as soon
+ * as the gradients of all its parameters are available: its gradients are
+ * copied to the host, and the threads run Adam on it while the device carries
+ * on. With `registerGradHooks()`, buckets are sent during the backward pass;
+ * otherwise (or for parameters without a gradient) `step()` sends the rest.
+ * `step()` then waits for the buckets, and copies the updated parameters back
+ * to the device as their buckets are done.
+ *
+ * The hyperparameters (e.g. the learning rate) of a step are read when its
+ * buckets are sent. The master weights are only read from the parameters on
+ * construction: call `syncMasterWeights()` if they are modified elsewhere.
+ * Sparse gradients are not supported. The state is not returned by
+ * `getStateArrays()`.
+ *
+ * The optimizer can update the flattened shard of a `ShardedOptimizer`:
+ *
+ * \code
+ * ShardedOptimizer optimizer(
+ *     model.params(),
+ *     [](const std::vector<Variable>& shard) {
+ *       return std::make_shared<OffloadedAdamOptimizer>(shard, 1e-3);
+ *     });
+ * \endcode
+ */
+class OffloadedAdamOptimizer : public FirstOrderOptimizer {
+ public:
+  /** Construct an offloaded Adam optimizer.
+   * @param parameters The parameters from e.g. `model.parameters()`.
+   * @param learningRate The learning rate.
+   * @param beta1 Adam hyperparameter \f$ \beta_1 \f$.
+   * @param beta2 Adam hyperparameter \f$ \beta_2 \f$.
+   * @param epsilon A small value used for numerical stability.
+   * @param weightDecay The amount of L2 weight decay to use for all the
+   * parameters.
+   * @param numThreads The number of CPU threads updating the buckets.
+   * @param bucketBytes The size of the buckets, in bytes of f32.
+   */
+  OffloadedAdamOptimizer(
+      const std::vector<Variable>& parameters,
+      float learningRate,
+      float beta1 = 0.9,
+      float beta2 = 0.999,
+      float epsilon = 1e-8,
+      float weightDecay = 0,
+      int numThreads = 4,
+      int64_t bucketBytes = 1 << 24);
+
+  ~OffloadedAdamOptimizer() override;
+
+  /**
+   * Registers gradient hooks on the parameters (replacing their previous
+   * hooks, e.g. of `distributeModuleGrads`) which send the buckets to the
+   * host during the backward pass. Each backward pass must then be followed
+   * by `step()`, and the optimizer must outlive the hooks.
+   */
+  void registerGradHooks();
+
+  /** Copies the parameters to the master weights. */
+  void syncMasterWeights();
+
+  void step() override;
+
+  std::string prettyString() const override;
+
+ private:
+  FL_SAVE_LOAD_DECLARE()
+
+  OffloadedAdamOptimizer() = default; // Intentionally private
+
+  // Offsets, buckets, host buffers and threads, from the parameters
+  void init();
+  // No bucket sent, and no gradient available
+  void resetBuckets();
+  // Called once the gradient of the i-th parameter is available
+  void gradReady(size_t i);
+  // Copies the gradients of a bucket to the host and updates it on the CPU
+  void sendBucket(size_t b);
+  // Waits for all the buckets sent
+  void waitBuckets();
+
+  float beta1_;
+  float beta2_;
+  float eps_;
+  float wd_;
+  int count_{0};
+  int numThreads_;
+  int64_t bucketBytes_;
+
+  // Offset of each parameter in the concatenation
+  std::vector<dim_t> offsets_;
+  dim_t totalSize_{0};
+  dim_t bucketSize_{0};
+  // Number of parameters of each bucket whose gradient isn't available yet
+  std::vector<int> waiting_;
+  // Updates of the buckets sent, invalid if not sent
+  std::vector<std::future<void>> updates_;
+  PinnedHostBuffer master_;
+  PinnedHostBuffer first_;
+  PinnedHostBuffer second_;
+  PinnedHostBuffer grads_;
+  std::unique_ptr<ThreadPool> threadPool_;
+};
+
+template <class Archive>
+void OffloadedAdamOptimizer::save(Archive& ar, const uint32_t /* version */)
+    const {
+  const_cast<OffloadedAdamOptimizer*>(this)->waitBuckets();
+  auto hostVector = [this](const PinnedHostBuffer& buffer) {
+    auto* data = buffer.getAs<float>();
+    return std::vector<float>(data, data + totalSize_);
+  };
+  ar(cereal::base_class<FirstOrderOptimizer>(this),
+     beta1_,
+     beta2_,
+     eps_,
+     wd_,
+     count_,
+     numThreads_,
+     bucketBytes_,
+     hostVector(master_),
+     hostVector(first_),
+     hostVector(second_));
+}
+
+template <class Archive>
+void OffloadedAdamOptimizer::load(Archive& ar, const uint32_t /* version */) {
+  std::vector<float> master, first, second;
+  ar(cereal::base_class<FirstOrderOptimizer>(this),
+     beta1_,
+     beta2_,
+     eps_,
+     wd_,
+     count_,
+     numThreads_,
+     bucketBytes_,
+     master,
+     first,
+     second);
+  init();
+  if (master.size() != totalSize_ || first.size() != totalSize_ ||
+      second.size() != totalSize_) {
+    throw std::runtime_error(
+        "OffloadedAdamOptimizer: the saved state doesn't match the parameters");
+  }
+  std::copy(master.begin(), master.end(), master_.getAs<float>());
+  std::copy(first.begin(), first.end(), first_.getAs<float>());
+  std::copy(second.begin(), second.end(), second_.getAs<float>());
+}
+
+} // namespace fl
+
+CEREAL_REGISTER_TYPE(fl::OffloadedAdamOptimizer)
@@ -35,4 +35,23 @@ void FirstOrderOptimizer::zeroGrad() {
   }
 }
 
+vector<af::array*> FirstOrderOptimizer::getStateArrays() {
+  return {};
+}
+
+namespace detail {
+
+vector<af::array*> stateArrays(
+    std::initializer_list<vector<af::array>*> states) {
+  vector<af::array*> arrays;
+  for (auto* state : states) {
+    for (auto& arr : *state) {
+      arrays.push_back(&arr);
+    }
+  }
+  return arrays;
+}
+
+} // namespace detail
+
 } // namespace fl
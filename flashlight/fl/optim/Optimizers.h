@@ -15,6 +15,7 @@
 
 #pragma once
 
+#include <initializer_list>
 #include <vector>
 
 #include <arrayfire.h>
@@ -74,6 +75,13 @@ class FirstOrderOptimizer {
    */
   virtual void zeroGrad();
 
+  /**
+   * Returns the arrays of the state of the optimizer (e.g. the moments of
+   * `AdamOptimizer`), e.g. to average them across processes. Arrays not
+   * used with the current options are empty.
+   */
+  virtual std::vector<af::array*> getStateArrays();
+
   /**
    * Generates a stringified representation of the optimizer.
    *
@@ -84,4 +92,12 @@ class FirstOrderOptimizer {
   virtual ~FirstOrderOptimizer() = default;
 };
 
+namespace detail {
+
+// Pointers to the arrays of the states of an optimizer, for getStateArrays()
+std::vector<af::array*> stateArrays(
+    std::initializer_list<std::vector<af::array>*> states);
+
+} // namespace detail
+
 } // namespace fl
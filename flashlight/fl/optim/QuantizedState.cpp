@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/optim/QuantizedState.h"
+
+#include "flashlight/fl/autograd/Functions.h"
+
+namespace fl {
+
+namespace {
+
+int64_t numBlocks(int64_t elements) {
+  return (elements + QuantizedState::kBlockSize - 1) /
+      QuantizedState::kBlockSize;
+}
+
+} // namespace
+
+QuantizedState::QuantizedState(const af::dim4& dims, bool isSigned)
+    : codes(af::constant(0, dims, u8)),
+      scales(af::constant(0, numBlocks(dims.elements()), f32)),
+      isSigned(isSigned) {}
+
+QuantizedState QuantizedState::quantize(
+    const af::array& values,
+    bool isSigned) {
+  QuantizedState state;
+  state.isSigned = isSigned;
+  int64_t n = values.elements();
+  if (n == 0) {
+    state.codes = af::array(values.dims(), u8);
+    state.scales = af::array(0, f32);
+    return state;
+  }
+  int64_t nBlocks = numBlocks(n);
+  auto x = af::flat(values).as(f32);
+  if (nBlocks * kBlockSize > n) {
+    x = af::join(0, x, af::constant(0, nBlocks * kBlockSize - n, f32));
+  }
+  x = af::moddims(x, af::dim4(kBlockSize, nBlocks));
+  auto maxAbs = af::max(af::abs(x), 0);
+  state.scales = af::flat(maxAbs);
+  // All-zero blocks stay zero
+  auto y = x / detail::tileAs(af::select(maxAbs > 0, maxAbs, 1.0), x.dims());
+  af::array q;
+  if (isSigned) {
+    q = af::round(127 * af::sqrt(af::abs(y)));
+    // Two's complement bytes of the int8 codes
+    q = af::select(y < 0 && q > 0, 256 - q, q);
+  } else {
+    q = af::round(255 * af::sqrt(af::sqrt(af::max(y, 0.0))));
+  }
+  state.codes = af::moddims(af::flat(q)(af::seq(n)), values.dims()).as(u8);
+  af::eval(state.codes, state.scales);
+  return state;
+}
+
+af::array QuantizedState::dequantize() const {
+  int64_t n = codes.elements();
+  if (n == 0) {
+    return af::array(codes.dims(), f32);
+  }
+  auto q = af::flat(codes).as(f32);
+  af::array x;
+  if (isSigned) {
+    auto t = af::select(q > 127, q - 256, q) / 127;
+    x = t * af::abs(t);
+  } else {
+    auto t = q / 255;
+    x = (t * t) * (t * t);
+  }
+  auto block = af::range(af::dim4(n), 0, s32) / static_cast<int>(kBlockSize);
+  x = x * af::lookup(scales, block);
+  return af::moddims(x, codes.dims());
+}
+
+} // namespace fl
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include <arrayfire.h>
+
+#include "flashlight/fl/common/Serialization.h"
+
+namespace fl {
+
+/**
+ * An optimizer state (e.g. a moment of `AdamOptimizer`) stored in 8 bits per
+ * element instead of 32. Consecutive elements are quantized by blocks of
+ * `kBlockSize`, each with its own scale: the largest absolute value of the
+ * block. Codes are spread non-linearly to keep the resolution of values much
+ * smaller than the scale: a signed state (first moment) is stored as
+ * \f$q = 127 \cdot sign(x) \sqrt{|x| / scale}\f$, and a non-negative one
+ * (second moment, of the order of the square of the first) as
+ * \f$q = 255 \cdot (x / scale)^{1/4}\f$.
+ */
+struct QuantizedState {
+  static constexpr int64_t kBlockSize = 2048;
+
+  /// Codes, with the dims of the state: bytes of int8 values if signed
+  af::array codes;
+  /// f32 scale of each block
+  af::array scales;
+  bool isSigned{false};
+
+  QuantizedState() = default;
+
+  /// A state of zeros.
+  QuantizedState(const af::dim4& dims, bool isSigned);
+
+  /// Quantizes `values`.
+  static QuantizedState quantize(const af::array& values, bool isSigned);
+
+  /// Returns the f32 values of the state.
+  af::array dequantize() const;
+
+ private:
+  FL_SAVE_LOAD(codes, scales, isSigned)
+};
+
+} // namespace fl
@@ -100,4 +100,8 @@ std::string RMSPropOptimizer::prettyString() const {
   return ss.str();
 }
 
+std::vector<af::array*> RMSPropOptimizer::getStateArrays() {
+  return detail::stateArrays({&first_, &second_});
+}
+
 } // namespace fl
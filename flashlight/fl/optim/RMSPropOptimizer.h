@@ -72,6 +72,8 @@ class RMSPropOptimizer : public FirstOrderOptimizer {
   void step() override;
 
   std::string prettyString() const override;
+
+  std::vector<af::array*> getStateArrays() override;
 };
 
 } // namespace fl
@@ -17,6 +17,9 @@
 
 #include <cmath>
 
+#include "flashlight/fl/optim/MultiTensor.h"
+#include "flashlight/fl/optim/Utils.h"
+
 using std::vector;
 
 namespace fl {
@@ -43,8 +46,56 @@ SGDOptimizer::SGDOptimizer(
 }
 
 void SGDOptimizer::step() {
+  // Sparse gradients only update the slices they hold, to which weight decay
+  // and momentum are then lazily applied
   for (size_t i = 0; i < parameters_.size(); i++) {
-    if (!parameters_[i].isGradAvailable()) {
+    if (!parameters_[i].isGradSparse() ||
+        parameters_[i].sparseGrad().sparseIndices().isempty()) {
+      continue;
+    }
+    const auto& sparseGrad = parameters_[i].sparseGrad();
+    auto slices = detail::sparseSlices(sparseGrad);
+    af::array& data = parameters_[i].array();
+    af::array grad = sparseGrad.array();
+
+    if (wd_ != 0) {
+      grad = grad + wd_ * data(slices.first, slices.second);
+    }
+
+    if (mu_ != 0) {
+      af::array& velocity = velocities_[i];
+      af::array sliceVelocity =
+          mu_ * velocity(slices.first, slices.second) + grad;
+      velocity(slices.first, slices.second) = sliceVelocity;
+      af::eval(velocity);
+      if (useNesterov_) {
+        grad = grad + sliceVelocity * mu_;
+      } else {
+        grad = sliceVelocity;
+      }
+    }
+    data(slices.first, slices.second) -= lr_ * grad;
+    af::eval(data);
+  }
+
+  std::vector<af::array*> grads, data, velocities;
+  for (size_t i = 0; i < parameters_.size(); i++) {
+    if (parameters_[i].isGradAvailable() && !parameters_[i].isGradSparse()) {
+      grads.push_back(&parameters_[i].grad().array());
+      data.push_back(&parameters_[i].array());
+      if (mu_ != 0) {
+        velocities.push_back(&velocities_[i]);
+      }
+    }
+  }
+  if (detail::multiTensorSupported(data)) {
+    detail::multiTensorSGD(
+        grads, data, velocities, lr_, mu_, wd_, useNesterov_);
+    return;
+  }
+
+  for (size_t i = 0; i < parameters_.size(); i++) {
+    if (!parameters_[i].isGradAvailable() || parameters_[i].isGradSparse()) {
       continue;
     }
 
@@ -90,4 +141,8 @@ std::string SGDOptimizer::prettyString() const {
   return ss.str();
 }
 
+std::vector<af::array*> SGDOptimizer::getStateArrays() {
+  return detail::stateArrays({&velocities_});
+}
+
 } // namespace fl
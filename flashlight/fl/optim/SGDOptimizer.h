@@ -31,6 +31,9 @@ namespace fl {
  *   w &= w - lr * v
  * \f]
  *
+ * Sparse gradients (see `Variable::sparse()`) only update the slices they
+ * hold: weight decay and momentum are lazily applied to these slices.
+ *
  * Reference for SGD and Momentum:
  * http://cs231n.github.io/neural-networks-3/#sgd
  */
@@ -69,6 +72,8 @@ class SGDOptimizer : public FirstOrderOptimizer {
   void step() override;
 
   std::string prettyString() const override;
+
+  std::vector<af::array*> getStateArrays() override;
 };
 
 } // namespace fl
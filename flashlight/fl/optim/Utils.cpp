@@ -7,37 +7,70 @@
 
 #include "flashlight/fl/optim/Utils.h"
 
+#include "flashlight/fl/optim/MultiTensor.h"
+
 namespace fl {
 
-double clipGradNorm(const std::vector<Variable>& parameters, double max_norm) {
-  double grad_norm = 0.0;
+af::array clipGradNormAsync(
+    const std::vector<Variable>& parameters,
+    double max_norm) {
+  std::vector<af::array*> grads;
   for (const auto& p : parameters) {
-    if (!p.isGradAvailable()) {
-      continue;
+    if (p.isGradSparse()) {
+      // the slices of a sparse gradient are unique, and have its norm
+      grads.push_back(&p.sparseGrad().array());
+    } else if (p.isGradAvailable()) {
+      grads.push_back(&p.grad().array());
     }
-    const auto& grad = p.grad().array();
-    // ArrayFire v3.7.1 doesn't support computing the norm of an f16 tensor.
-    // Only if gradients are fp16, compute the norm on grads that are cast to
-    // f32. This cast can be removed when support for fp16 inputs is added.
-    // https://github.com/arrayfire/arrayfire/blob/v3.7.1/src/api/c/norm.cpp#L128
-    grad_norm += std::pow(
-        af::norm(af::flat(
-            (grad.type() == af::dtype::f16 ? grad.as(af::dtype::f32) : grad))),
-        2);
   }
-  grad_norm = std::sqrt(grad_norm);
-  double scale = (max_norm / grad_norm);
-  if (scale < 1.0) {
-    for (auto& p : parameters) {
-      if (!p.isGradAvailable()) {
-        continue;
-      }
-      auto& grad = p.grad().array();
-      grad = scale * grad;
-      p.grad().array() = grad;
+  if (grads.empty()) {
+    return af::constant(0, 1, af::dtype::f32);
+  }
+
+  bool multiTensor = detail::multiTensorSupported(grads);
+  af::array squaredNorm;
+  if (multiTensor) {
+    squaredNorm = af::sum(detail::multiTensorSquaredNorm(grads));
+  } else {
+    squaredNorm = af::constant(0, 1, af::dtype::f32);
+    for (auto* grad : grads) {
+      // Reductions of f16 tensors are computed on gradients cast to f32
+      auto g = grad->type() == af::dtype::f16 ? grad->as(af::dtype::f32)
+                                                : *grad;
+      squaredNorm = squaredNorm + af::sum(af::flat(g * g));
     }
   }
-  return grad_norm;
+  af::array gradNorm = af::sqrt(squaredNorm);
+  // the gradients are scaled by 1 if their norm is small enough, rather than
+  // checking the norm on the host
+  af::array scale = af::min(max_norm / gradNorm, 1.0);
+  af::eval(gradNorm, scale);
+  if (multiTensor) {
+    detail::multiTensorScale(grads, scale);
+  } else {
+    for (auto* grad : grads) {
+      *grad = *grad * af::tile(scale.as(grad->type()), grad->dims());
+      grad->eval();
+    }
+  }
+  return gradNorm;
+}
+
+namespace detail {
+
+std::pair<af::index, af::index> sparseSlices(const Variable& grad) {
+  if (grad.sparseDim() == 0) {
+    return {af::index(grad.sparseIndices()), af::index(af::span)};
+  }
+  return {af::index(af::span), af::index(grad.sparseIndices())};
+}
+
+} // namespace detail
+
+double clipGradNorm(const std::vector<Variable>& parameters, double max_norm) {
+  return clipGradNormAsync(parameters, max_norm)
+      .as(af::dtype::f64)
+      .scalar<double>();
 }
 
 } // namespace fl
@@ -7,11 +7,42 @@
 
 #pragma once
 
+#include <utility>
 #include <vector>
 
 #include "flashlight/fl/autograd/Variable.h"
 
 namespace fl {
 
+/**
+ * Scales the gradients of `parameters` so that their global L2 norm is at
+ * most `max_norm`. Sparse gradients remain sparse.
+ *
+ * @return the global L2 norm of the gradients before clipping
+ */
 double clipGradNorm(const std::vector<Variable>& parameters, double max_norm);
-}
+
+/**
+ * Same as `clipGradNorm`, without synchronizing with the host: the norms of
+ * the gradients and their scale are computed on the device (with a few
+ * multi-tensor kernels for f32 gradients, if supported by the backend).
+ *
+ * @return the global L2 norm of the gradients before clipping, as a
+ * one-element array
+ */
+af::array clipGradNormAsync(
+    const std::vector<Variable>& parameters,
+    double max_norm);
+
+namespace detail {
+
+/**
+ * Returns the indices, along both dimensions, of the slices held by a sparse
+ * gradient (see `Variable::sparse()`): `dense(s.first, s.second)` are the
+ * slices of `grad.array()` in an array `dense` of `grad.denseDims()`.
+ */
+std::pair<af::index, af::index> sparseSlices(const Variable& grad);
+
+} // namespace detail
+
+} // namespace fl
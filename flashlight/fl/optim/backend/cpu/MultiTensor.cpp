@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/optim/MultiTensor.h"
+
+#include <stdexcept>
+#include <string>
+
+// Kernel launches are cheap on the CPU backend, and there are no OpenCL
+// multi-tensor kernels: the optimizers use per-tensor operators
+
+namespace fl {
+namespace detail {
+
+namespace {
+
+void unsupported(const char* func) {
+  throw std::logic_error(
+      std::string(func) + ": multi-tensor kernels unavailable on this backend");
+}
+
+} // namespace
+
+bool multiTensorSupported(const std::vector<af::array*>& /* tensors */) {
+  return false;
+}
+
+void multiTensorAdam(
+    const std::vector<af::array*>& /* grads */,
+    const std::vector<af::array*>& /* data */,
+    const std::vector<af::array*>& /* biasedFirst */,
+    const std::vector<af::array*>& /* biasedSecond */,
+    float /* lr */,
+    float /* correctedLr */,
+    float /* beta1 */,
+    float /* beta2 */,
+    float /* eps */,
+    float /* weightDecay */) {
+  unsupported(__func__);
+}
+
+void multiTensorAMSgrad(
+    const std::vector<af::array*>& /* grads */,
+    const std::vector<af::array*>& /* data */,
+    const std::vector<af::array*>& /* biasedFirst */,
+    const std::vector<af::array*>& /* biasedSecond */,
+    const std::vector<af::array*>& /* maxExpAvgSq */,
+    float /* lr */,
+    float /* beta1 */,
+    float /* beta2 */,
+    float /* eps */,
+    float /* weightDecay */) {
+  unsupported(__func__);
+}
+
+void quantizedAdam(
+    const std::vector<af::array*>& /* grads */,
+    const std::vector<af::array*>& /* data */,
+    const std::vector<QuantizedState*>& /* biasedFirst */,
+    const std::vector<QuantizedState*>& /* biasedSecond */,
+    float /* lr */,
+    float /* correctedLr */,
+    float /* beta1 */,
+    float /* beta2 */,
+    float /* eps */,
+    float /* weightDecay */) {
+  unsupported(__func__);
+}
+
+void quantizedAMSgrad(
+    const std::vector<af::array*>& /* grads */,
+    const std::vector<af::array*>& /* data */,
+    const std::vector<QuantizedState*>& /* biasedFirst */,
+    const std::vector<QuantizedState*>& /* biasedSecond */,
+    const std::vector<QuantizedState*>& /* maxExpAvgSq */,
+    float /* lr */,
+    float /* beta1 */,
+    float /* beta2 */,
+    float /* eps */,
+    float /* weightDecay */) {
+  unsupported(__func__);
+}
+
+void multiTensorSGD(
+    const std::vector<af::array*>& /* grads */,
+    const std::vector<af::array*>& /* data */,
+    const std::vector<af::array*>& /* velocities */,
+    float /* lr */,
+    float /* momentum */,
+    float /* weightDecay */,
+    bool /* useNesterov */) {
+  unsupported(__func__);
+}
+
+af::array multiTensorSquaredNorm(
+    const std::vector<af::array*>& /* tensors */) {
+  unsupported(__func__);
+  return af::array();
+}
+
+void multiTensorScale(
+    const std::vector<af::array*>& /* tensors */,
+    const af::array& /* scale */) {
+  unsupported(__func__);
+}
+
+void multiTensorNovograd(
+    const std::vector<af::array*>& /* grads */,
+    const std::vector<af::array*>& /* data */,
+    const std::vector<af::array*>& /* accGrads */,
+    const std::vector<float>& /* gradScales */,
+    float /* lr */,
+    float /* beta1 */,
+    float /* weightDecay */) {
+  unsupported(__func__);
+}
+
+} // namespace detail
+} // namespace fl
@@ -0,0 +1,565 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/fl/optim/MultiTensor.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "flashlight/fl/common/DevicePtr.h"
+#include "flashlight/fl/common/backend/cuda/CudaUtils.h"
+#include "flashlight/fl/optim/QuantizedState.h"
+
+// Each block updates a chunk of CHUNK_SIZE elements of a tensor. The pointers
+// to the tensors are passed as a kernel parameter, by launches of up to
+// MAX_TENSORS tensors and MAX_BLOCKS chunks (so that they fit in the 4KB of
+// kernel parameters).
+#define THREADS 512
+#define WARP_SIZE 32
+#define CHUNK_SIZE 16384
+#define MAX_TENSORS 36
+#define MAX_BLOCKS 320
+
+namespace {
+
+template <int DEPTH>
+struct TensorListMetadata {
+  float* addresses[DEPTH][MAX_TENSORS];
+  int sizes[MAX_TENSORS];
+  float scales[MAX_TENSORS];
+  int indices[MAX_TENSORS];
+  unsigned char blockToTensor[MAX_BLOCKS];
+  int blockToChunk[MAX_BLOCKS];
+};
+
+template <int DEPTH, typename Op>
+__global__ void multiTensorKernel(TensorListMetadata<DEPTH> meta, Op op) {
+  int t = meta.blockToTensor[blockIdx.x];
+  int start = meta.blockToChunk[blockIdx.x] * CHUNK_SIZE;
+  int end = min(start + CHUNK_SIZE, meta.sizes[t]);
+  float* ptrs[DEPTH];
+  for (int d = 0; d < DEPTH; ++d) {
+    ptrs[d] = meta.addresses[d][t];
+  }
+  for (int i = start + threadIdx.x; i < end; i += blockDim.x) {
+    op(ptrs, i, meta.scales[t]);
+  }
+}
+
+__global__ void multiTensorSquaredNormKernel(
+    TensorListMetadata<1> meta,
+    float* norms) {
+  __shared__ float shared[THREADS / WARP_SIZE];
+  int t = meta.blockToTensor[blockIdx.x];
+  int start = meta.blockToChunk[blockIdx.x] * CHUNK_SIZE;
+  int end = min(start + CHUNK_SIZE, meta.sizes[t]);
+  const float* x = meta.addresses[0][t];
+  float sum = 0;
+  for (int i = start + threadIdx.x; i < end; i += blockDim.x) {
+    sum += x[i] * x[i];
+  }
+  for (int offset = WARP_SIZE / 2; offset > 0; offset /= 2) {
+    sum += __shfl_xor_sync(0xffffffff, sum, offset);
+  }
+  if (threadIdx.x % WARP_SIZE == 0) {
+    shared[threadIdx.x / WARP_SIZE] = sum;
+  }
+  __syncthreads();
+  if (threadIdx.x == 0) {
+    for (int w = 1; w < blockDim.x / WARP_SIZE; ++w) {
+      sum += shared[w];
+    }
+    atomicAdd(norms + meta.indices[t], sum);
+  }
+}
+
+// Lists: grad, data, biasedFirst, biasedSecond
+struct AdamOp {
+  float lrWd, correctedLr, beta1, beta2, eps;
+
+  __device__ void operator()(float** p, int i, float /* scale */) const {
+    float g = p[0][i];
+    float w = p[1][i] - lrWd * p[1][i];
+    float m = beta1 * p[2][i] + (1 - beta1) * g;
+    float v = beta2 * p[3][i] + (1 - beta2) * g * g;
+    p[2][i] = m;
+    p[3][i] = v;
+    p[1][i] = w - correctedLr * m / (sqrtf(v) + eps);
+  }
+};
+
+// Lists: grad, data, biasedFirst, biasedSecond, maxExpAvgSq
+struct AMSgradOp {
+  float lr, beta1, beta2, eps, wd;
+
+  __device__ void operator()(float** p, int i, float /* scale */) const {
+    float g = p[0][i];
+    float w = p[1][i] - wd * p[1][i];
+    float m = beta1 * p[2][i] + (1 - beta1) * g;
+    float v = beta2 * p[3][i] + (1 - beta2) * g * g;
+    float vMax = fmaxf(p[4][i], v);
+    p[2][i] = m;
+    p[3][i] = v;
+    p[4][i] = vMax;
+    p[1][i] = w - lr * m / (sqrtf(vMax) + eps);
+  }
+};
+
+// Lists: grad, data
+struct SGDOp {
+  float lr, wd;
+
+  __device__ void operator()(float** p, int i, float /* scale */) const {
+    p[1][i] -= lr * (p[0][i] + wd * p[1][i]);
+  }
+};
+
+// Lists: grad, data, velocity
+struct SGDMomentumOp {
+  float lr, mu, wd;
+  bool nesterov;
+
+  __device__ void operator()(float** p, int i, float /* scale */) const {
+    float g = p[0][i] + wd * p[1][i];
+    float v = mu * p[2][i] + g;
+    p[2][i] = v;
+    p[1][i] -= lr * (nesterov ? g + mu * v : v);
+  }
+};
+
+// Lists: tensor
+struct ScaleOp {
+  const float* scale;
+
+  __device__ void operator()(float** p, int i, float /* scale */) const {
+    p[0][i] *= *scale;
+  }
+};
+
+// Lists: grad, data, accGrad
+struct NovogradOp {
+  float lr, beta1, wd;
+
+  __device__ void operator()(float** p, int i, float scale) const {
+    float acc =
+        beta1 * p[2][i] + (1 - beta1) * (p[0][i] * scale + wd * p[1][i]);
+    p[2][i] = acc;
+    p[1][i] -= lr * acc;
+  }
+};
+
+// 8-bit states: each block of threads updates a block of quantization of a
+// parameter, and quantizes it again with the largest value of the block
+constexpr int kQuantizedPerThread = fl::QuantizedState::kBlockSize / THREADS;
+static_assert(
+    fl::QuantizedState::kBlockSize % THREADS == 0,
+    "quantization blocks must be a multiple of the blocks of threads");
+
+struct QuantizedPtr {
+  unsigned char* codes;
+  float* scales;
+};
+
+// Largest `x` of the block of threads, given to all the threads
+__device__ float blockMax(float x) {
+  __shared__ float shared[THREADS / WARP_SIZE];
+  for (int offset = WARP_SIZE / 2; offset > 0; offset /= 2) {
+    x = fmaxf(x, __shfl_xor_sync(0xffffffff, x, offset));
+  }
+  // `shared` may still be read by a previous call
+  __syncthreads();
+  if (threadIdx.x % WARP_SIZE == 0) {
+    shared[threadIdx.x / WARP_SIZE] = x;
+  }
+  __syncthreads();
+  x = shared[0];
+  for (int w = 1; w < blockDim.x / WARP_SIZE; ++w) {
+    x = fmaxf(x, shared[w]);
+  }
+  return x;
+}
+
+// Codes of `QuantizedState`
+__device__ float dequantizeSigned(unsigned char code, float scale) {
+  float t = static_cast<signed char>(code) / 127.f;
+  return scale * t * fabsf(t);
+}
+
+__device__ float dequantizeUnsigned(unsigned char code, float scale) {
+  float t = code / 255.f;
+  return scale * (t * t) * (t * t);
+}
+
+__device__ unsigned char quantizeSigned(float x, float scale) {
+  float y = scale > 0 ? fminf(fmaxf(x / scale, -1.f), 1.f) : 0.f;
+  int q = __float2int_rn(127 * sqrtf(fabsf(y)));
+  // Two's complement byte
+  return static_cast<unsigned char>(y < 0 ? -q : q);
+}
+
+__device__ unsigned char quantizeUnsigned(float x, float scale) {
+  float y = scale > 0 ? fminf(fmaxf(x / scale, 0.f), 1.f) : 0.f;
+  return static_cast<unsigned char>(__float2int_rn(255 * sqrtf(sqrtf(y))));
+}
+
+// Adam, or AMSgrad with `maxSecond`
+template <bool AMSGRAD>
+__global__ void quantizedAdamKernel(
+    const float* grad,
+    float* data,
+    QuantizedPtr first,
+    QuantizedPtr second,
+    QuantizedPtr maxSecond,
+    int n,
+    float lrWd,
+    float lr,
+    float beta1,
+    float beta2,
+    float eps) {
+  int b = blockIdx.x;
+  int start = b * fl::QuantizedState::kBlockSize + threadIdx.x;
+  float mScale = first.scales[b];
+  float vScale = second.scales[b];
+  float uScale = AMSGRAD ? maxSecond.scales[b] : 0.f;
+  float m[kQuantizedPerThread], v[kQuantizedPerThread];
+  float u[kQuantizedPerThread];
+  float mMax = 0, vMax = 0, uMax = 0;
+  for (int k = 0; k < kQuantizedPerThread; ++k) {
+    int i = start + k * THREADS;
+    m[k] = v[k] = u[k] = 0;
+    if (i >= n) {
+      continue;
+    }
+    float g = grad[i];
+    float w = data[i] - lrWd * data[i];
+    m[k] = beta1 * dequantizeSigned(first.codes[i], mScale) + (1 - beta1) * g;
+    v[k] = beta2 * dequantizeUnsigned(second.codes[i], vScale) +
+        (1 - beta2) * g * g;
+    float denom = v[k];
+    if (AMSGRAD) {
+      u[k] = fmaxf(dequantizeUnsigned(maxSecond.codes[i], uScale), v[k]);
+      denom = u[k];
+    }
+    data[i] = w - lr * m[k] / (sqrtf(denom) + eps);
+    mMax = fmaxf(mMax, fabsf(m[k]));
+    vMax = fmaxf(vMax, v[k]);
+    uMax = fmaxf(uMax, u[k]);
+  }
+  // The scales were read by all the threads before
+  mScale = blockMax(mMax);
+  vScale = blockMax(vMax);
+  if (AMSGRAD) {
+    uScale = blockMax(uMax);
+  }
+  for (int k = 0; k < kQuantizedPerThread; ++k) {
+    int i = start + k * THREADS;
+    if (i < n) {
+      first.codes[i] = quantizeSigned(m[k], mScale);
+      second.codes[i] = quantizeUnsigned(v[k], vScale);
+      if (AMSGRAD) {
+        maxSecond.codes[i] = quantizeUnsigned(u[k], uScale);
+      }
+    }
+  }
+  if (threadIdx.x == 0) {
+    first.scales[b] = mScale;
+    second.scales[b] = vScale;
+    if (AMSGRAD) {
+      maxSecond.scales[b] = uScale;
+    }
+  }
+}
+
+// One launch per parameter; `maxSecond` is empty for Adam
+template <bool AMSGRAD>
+void quantizedAdamUpdate(
+    const std::vector<af::array*>& grads,
+    const std::vector<af::array*>& data,
+    const std::vector<fl::QuantizedState*>& first,
+    const std::vector<fl::QuantizedState*>& second,
+    const std::vector<fl::QuantizedState*>& maxSecond,
+    float lrWd,
+    float lr,
+    float beta1,
+    float beta2,
+    float eps) {
+  if (grads.size() != data.size() || first.size() != data.size() ||
+      second.size() != data.size() ||
+      (AMSGRAD && maxSecond.size() != data.size())) {
+    throw std::invalid_argument(
+        "quantizedAdamUpdate: tensor lists of different sizes");
+  }
+  cudaStream_t stream = fl::cuda::getActiveStream();
+  for (size_t t = 0; t < data.size(); ++t) {
+    int n = data[t]->elements();
+    if (n == 0) {
+      continue;
+    }
+    if (grads[t]->elements() != n || first[t]->codes.elements() != n ||
+        second[t]->codes.elements() != n ||
+        (AMSGRAD && maxSecond[t]->codes.elements() != n)) {
+      throw std::invalid_argument(
+          "quantizedAdamUpdate: tensors of different sizes");
+    }
+    std::vector<fl::DevicePtr> ptrs;
+    auto quantized = [&ptrs](fl::QuantizedState* state) {
+      ptrs.emplace_back(state->codes);
+      auto* codes = ptrs.back().getAs<unsigned char>();
+      ptrs.emplace_back(state->scales);
+      return QuantizedPtr{codes, ptrs.back().getAs<float>()};
+    };
+    fl::DevicePtr gradRaw(*grads[t]);
+    fl::DevicePtr dataRaw(*data[t]);
+    QuantizedPtr m = quantized(first[t]);
+    QuantizedPtr v = quantized(second[t]);
+    QuantizedPtr u = AMSGRAD ? quantized(maxSecond[t]) : QuantizedPtr{};
+    int nBlocks = (n + fl::QuantizedState::kBlockSize - 1) /
+        fl::QuantizedState::kBlockSize;
+    quantizedAdamKernel<AMSGRAD><<<nBlocks, THREADS, 0, stream>>>(
+        gradRaw.getAs<float>(),
+        dataRaw.getAs<float>(),
+        m,
+        v,
+        u,
+        n,
+        lrWd,
+        lr,
+        beta1,
+        beta2,
+        eps);
+    FL_CUDA_CHECK(cudaPeekAtLastError());
+  }
+}
+
+// Splits the tensors in chunks and calls `launch(meta, numBlocks)` for each
+// batch of chunks
+template <int DEPTH, typename Launch>
+void multiTensorApply(
+    const std::vector<std::vector<af::array*>>& lists,
+    const std::vector<float>& scales,
+    Launch launch) {
+  size_t nTensors = lists[0].size();
+  for (const auto& list : lists) {
+    if (list.size() != nTensors) {
+      throw std::invalid_argument(
+          "multiTensorApply: tensor lists of different sizes");
+    }
+  }
+  std::vector<fl::DevicePtr> ptrs;
+  ptrs.reserve(DEPTH * nTensors);
+  TensorListMetadata<DEPTH> meta;
+  int nt = 0, nb = 0;
+  for (size_t t = 0; t < nTensors; ++t) {
+    int n = lists[0][t]->elements();
+    if (n == 0) {
+      continue;
+    }
+    for (int d = 0; d < DEPTH; ++d) {
+      if (lists[d][t]->elements() != n) {
+        throw std::invalid_argument(
+            "multiTensorApply: tensors of different sizes");
+      }
+      ptrs.emplace_back(*lists[d][t]);
+      meta.addresses[d][nt] = ptrs.back().getAs<float>();
+    }
+    meta.sizes[nt] = n;
+    meta.scales[nt] = scales.empty() ? 1 : scales[t];
+    meta.indices[nt] = t;
+    ++nt;
+    int chunks = (n + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    for (int c = 0; c < chunks; ++c) {
+      meta.blockToTensor[nb] = nt - 1;
+      meta.blockToChunk[nb] = c;
+      ++nb;
+      bool lastChunk = c == chunks - 1;
+      if (nb == MAX_BLOCKS || (nt == MAX_TENSORS && lastChunk)) {
+        launch(meta, nb);
+        nb = 0;
+        if (lastChunk) {
+          nt = 0;
+        } else {
+          // the remaining chunks of the tensor go to the next launch
+          for (int d = 0; d < DEPTH; ++d) {
+            meta.addresses[d][0] = meta.addresses[d][nt - 1];
+          }
+          meta.sizes[0] = meta.sizes[nt - 1];
+          meta.scales[0] = meta.scales[nt - 1];
+          meta.indices[0] = meta.indices[nt - 1];
+          nt = 1;
+        }
+      }
+    }
+  }
+  if (nb > 0) {
+    launch(meta, nb);
+  }
+}
+
+template <int DEPTH, typename Op>
+void multiTensorUpdate(
+    const std::vector<std::vector<af::array*>>& lists,
+    const std::vector<float>& scales,
+    Op op) {
+  cudaStream_t stream = fl::cuda::getActiveStream();
+  multiTensorApply<DEPTH>(
+      lists, scales, [&](const TensorListMetadata<DEPTH>& meta, int nb) {
+        multiTensorKernel<DEPTH, Op><<<nb, THREADS, 0, stream>>>(meta, op);
+        FL_CUDA_CHECK(cudaPeekAtLastError());
+      });
+}
+
+} // namespace
+
+namespace fl {
+namespace detail {
+
+bool multiTensorSupported(const std::vector<af::array*>& tensors) {
+  return std::all_of(tensors.begin(), tensors.end(), [](const af::array* t) {
+    return t->type() == af::dtype::f32;
+  });
+}
+
+void multiTensorAdam(
+    const std::vector<af::array*>& grads,
+    const std::vector<af::array*>& data,
+    const std::vector<af::array*>& biasedFirst,
+    const std::vector<af::array*>& biasedSecond,
+    float lr,
+    float correctedLr,
+    float beta1,
+    float beta2,
+    float eps,
+    float weightDecay) {
+  multiTensorUpdate<4>(
+      {grads, data, biasedFirst, biasedSecond},
+      {},
+      AdamOp{weightDecay * lr, correctedLr, beta1, beta2, eps});
+}
+
+void multiTensorAMSgrad(
+    const std::vector<af::array*>& grads,
+    const std::vector<af::array*>& data,
+    const std::vector<af::array*>& biasedFirst,
+    const std::vector<af::array*>& biasedSecond,
+    const std::vector<af::array*>& maxExpAvgSq,
+    float lr,
+    float beta1,
+    float beta2,
+    float eps,
+    float weightDecay) {
+  multiTensorUpdate<5>(
+      {grads, data, biasedFirst, biasedSecond, maxExpAvgSq},
+      {},
+      AMSgradOp{lr, beta1, beta2, eps, weightDecay});
+}
+
+void quantizedAdam(
+    const std::vector<af::array*>& grads,
+    const std::vector<af::array*>& data,
+    const std::vector<QuantizedState*>& biasedFirst,
+    const std::vector<QuantizedState*>& biasedSecond,
+    float lr,
+    float correctedLr,
+    float beta1,
+    float beta2,
+    float eps,
+    float weightDecay) {
+  quantizedAdamUpdate<false>(
+      grads,
+      data,
+      biasedFirst,
+      biasedSecond,
+      {},
+      weightDecay * lr,
+      correctedLr,
+      beta1,
+      beta2,
+      eps);
+}
+
+void quantizedAMSgrad(
+    const std::vector<af::array*>& grads,
+    const std::vector<af::array*>& data,
+    const std::vector<QuantizedState*>& biasedFirst,
+    const std::vector<QuantizedState*>& biasedSecond,
+    const std::vector<QuantizedState*>& maxExpAvgSq,
+    float lr,
+    float beta1,
+    float beta2,
+    float eps,
+    float weightDecay) {
+  quantizedAdamUpdate<true>(
+      grads,
+      data,
+      biasedFirst,
+      biasedSecond,
+      maxExpAvgSq,
+      weightDecay,
+      lr,
+      beta1,
+      beta2,
+      eps);
+}
+
+void multiTensorSGD(
+    const std::vector<af::array*>& grads,
+    const std::vector<af::array*>& data,
+    const std::vector<af::array*>& velocities,
+    float lr,
+    float momentum,
+    float weightDecay,
+    bool useNesterov) {
+  if (velocities.empty()) {
+    multiTensorUpdate<2>({grads, data}, {}, SGDOp{lr, weightDecay});
+  } else {
+    multiTensorUpdate<3>(
+        {grads, data, velocities},
+        {},
+        SGDMomentumOp{lr, momentum, weightDecay, useNesterov});
+  }
+}
+
+af::array multiTensorSquaredNorm(const std::vector<af::array*>& tensors) {
+  if (tensors.empty()) {
+    return af::array();
+  }
+  // Accumulated with atomics
+  af::array norms = af::constant(0, tensors.size(), af::dtype::f32);
+  {
+    DevicePtr normsRaw(norms);
+    cudaStream_t stream = cuda::getActiveStream();
+    multiTensorApply<1>(
+        {tensors}, {}, [&](const TensorListMetadata<1>& meta, int nb) {
+          multiTensorSquaredNormKernel<<<nb, THREADS, 0, stream>>>(
+              meta, normsRaw.getAs<float>());
+          FL_CUDA_CHECK(cudaPeekAtLastError());
+        });
+  }
+  return norms;
+}
+
+void multiTensorScale(
+    const std::vector<af::array*>& tensors,
+    const af::array& scale) {
+  DevicePtr scaleRaw(scale);
+  multiTensorUpdate<1>({tensors}, {}, ScaleOp{scaleRaw.getAs<float>()});
+}
+
+void multiTensorNovograd(
+    const std::vector<af::array*>& grads,
+    const std::vector<af::array*>& data,
+    const std::vector<af::array*>& accGrads,
+    const std::vector<float>& gradScales,
+    float lr,
+    float beta1,
+    float weightDecay) {
+  multiTensorUpdate<3>(
+      {grads, data, accGrads}, gradScales, NovogradOp{lr, beta1, weightDecay});
+}
+
+} // namespace detail
+} // namespace fl
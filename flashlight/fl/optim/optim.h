@@ -19,9 +19,13 @@
 #include "flashlight/fl/optim/AdadeltaOptimizer.h"
 #include "flashlight/fl/optim/AdagradOptimizer.h"
 #include "flashlight/fl/optim/AdamOptimizer.h"
+#include "flashlight/fl/optim/DynamicScaler.h"
+#include "flashlight/fl/optim/MasterWeightsOptimizer.h"
 #include "flashlight/fl/optim/NAGOptimizer.h"
 #include "flashlight/fl/optim/NovogradOptimizer.h"
+#include "flashlight/fl/optim/OffloadedAdamOptimizer.h"
 #include "flashlight/fl/optim/Optimizers.h"
+#include "flashlight/fl/optim/QuantizedState.h"
 #include "flashlight/fl/optim/RMSPropOptimizer.h"
 #include "flashlight/fl/optim/SGDOptimizer.h"
 #include "flashlight/fl/optim/Utils.h"
@@ -0,0 +1,378 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Times the forward and the forward + backward passes of the autograd
+ * operators on the shapes of the ASR, LM and ResNet recipes:
+ *
+ *   AutogradBenchmark [--filter=conv2d] [--save=baseline.json]
+ *       [--baseline=baseline.json] [--tolerance=0.1]
+ *
+ * With `--baseline`, the times are compared with those saved by a previous
+ * run with `--save` on the same device, and the benchmark exits with a
+ * nonzero status if a case is more than `tolerance` slower.
+ */
+
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "flashlight/fl/autograd/autograd.h"
+#include "flashlight/fl/common/common.h"
+#include "flashlight/fl/nn/nn.h"
+
+using namespace fl;
+
+namespace {
+
+struct BenchmarkCase {
+  std::string name;
+  // Inputs whose gradients are computed by the backward pass
+  std::vector<Variable> inputs;
+  std::function<Variable()> forward;
+};
+
+struct Timing {
+  double forwardMs;
+  double backwardMs;
+};
+
+double timeit(std::function<void()> fn) {
+  // warmup
+  for (int i = 0; i < 10; ++i) {
+    fn();
+  }
+  af::sync();
+
+  int num_iters = 100;
+  auto start = af::timer::start();
+  for (int i = 0; i < num_iters; i++) {
+    fn();
+  }
+  af::sync();
+  return af::timer::stop(start) / num_iters * 1000.0;
+}
+
+Timing run(BenchmarkCase& bench) {
+  double forwardMs = timeit([&]() { bench.forward().array().eval(); });
+  double totalMs = timeit([&]() {
+    auto output = bench.forward();
+    output.backward(Variable(
+        af::constant(1.0, output.dims(), output.type()), false));
+    for (auto& input : bench.inputs) {
+      input.grad().array().eval();
+      input.zeroGrad();
+    }
+  });
+  return {forwardMs, totalMs - forwardMs};
+}
+
+Variable param(const af::dim4& dims) {
+  return Variable(af::randn(dims), true);
+}
+
+std::vector<BenchmarkCase> conv2dCases() {
+  std::vector<BenchmarkCase> cases;
+  // ResNet-34 stages on ImageNet, batch 32
+  for (auto stage : std::vector<std::pair<int, int>>{
+           {56, 64}, {28, 128}, {14, 256}, {7, 512}}) {
+    int size = stage.first, channels = stage.second;
+    auto input = param(af::dim4(size, size, channels, 32));
+    auto weights = param(af::dim4(3, 3, channels, channels));
+    cases.push_back(
+        {"conv2d.resnet." + std::to_string(size) + "x" +
+             std::to_string(size) + "x" + std::to_string(channels),
+         {input, weights},
+         [input, weights]() {
+           return conv2d(input, weights, 1, 1, 1, 1);
+         }});
+  }
+  // Time convolutions of the TDS and conformer encoders, 10s at 100Hz
+  for (auto kernel : {9, 15}) {
+    auto input = param(af::dim4(1000, 1, 768, 8));
+    auto weights = param(af::dim4(kernel, 1, 768, 768 / 8));
+    cases.push_back(
+        {"conv2d.asr.k" + std::to_string(kernel) + ".g8",
+         {input, weights},
+         [input, weights, kernel]() {
+           return conv2d(input, weights, 1, 1, kernel / 2, 0, 1, 1, 8);
+         }});
+  }
+  return cases;
+}
+
+std::vector<BenchmarkCase> rnnCases() {
+  std::vector<BenchmarkCase> cases;
+  struct Shape {
+    std::string name;
+    int inputSize, hiddenSize, numLayers;
+    bool bidirectional;
+    int batch, steps;
+  };
+  for (const auto& shape : std::vector<Shape>{
+           {"asr.blstm", 512, 512, 2, true, 8, 500},
+           {"lm.lstm", 1024, 1024, 2, false, 32, 128}}) {
+    RNN module(
+        shape.inputSize,
+        shape.hiddenSize,
+        shape.numLayers,
+        RnnMode::LSTM,
+        shape.bidirectional);
+    auto weights = module.param(0);
+    auto input = param(af::dim4(shape.inputSize, shape.batch, shape.steps));
+    cases.push_back(
+        {"rnn." + shape.name,
+         {input, weights},
+         [input, weights, shape]() {
+           return std::get<0>(rnn(
+               input,
+               Variable(),
+               Variable(),
+               weights,
+               shape.hiddenSize,
+               shape.numLayers,
+               RnnMode::LSTM,
+               shape.bidirectional,
+               0.0));
+         }});
+  }
+  return cases;
+}
+
+std::vector<BenchmarkCase> attentionCases() {
+  std::vector<BenchmarkCase> cases;
+  struct Shape {
+    std::string name;
+    int steps, channels, heads, batch;
+  };
+  for (const auto& shape : std::vector<Shape>{
+           {"asr", 500, 768, 8, 8}, {"lm", 512, 1024, 16, 4}}) {
+    auto dims = af::dim4(shape.steps, shape.channels, shape.batch);
+    auto query = param(dims), key = param(dims), value = param(dims);
+    cases.push_back(
+        {"multiheadAttention." + shape.name,
+         {query, key, value},
+         [query, key, value, shape]() {
+           return multiheadAttention(
+               query,
+               key,
+               value,
+               Variable(),
+               Variable(),
+               Variable(),
+               shape.heads,
+               0.0);
+         }});
+  }
+  return cases;
+}
+
+std::vector<BenchmarkCase> batchnormCases() {
+  std::vector<BenchmarkCase> cases;
+  for (auto stage : std::vector<std::pair<int, int>>{{56, 64}, {7, 512}}) {
+    int size = stage.first, channels = stage.second;
+    auto input = param(af::dim4(size, size, channels, 32));
+    auto weight = param(af::dim4(channels));
+    auto bias = param(af::dim4(channels));
+    cases.push_back(
+        {"batchnorm.resnet." + std::to_string(size) + "x" +
+             std::to_string(size) + "x" + std::to_string(channels),
+         {input, weight, bias},
+         [input, weight, bias, channels]() {
+           auto runningMean =
+               Variable(af::constant(0.0, channels), false);
+           auto runningVar = Variable(af::constant(1.0, channels), false);
+           return batchnorm(
+               input,
+               weight,
+               bias,
+               runningMean,
+               runningVar,
+               {2},
+               true,
+               0.1,
+               1e-5);
+         }});
+  }
+  return cases;
+}
+
+std::vector<BenchmarkCase> embeddingCases() {
+  // Word-level LM vocabulary, 512 steps of 4 samples
+  auto indices = Variable(
+      (af::randu(512, 4) * 50000).as(af::dtype::s32), false);
+  auto embeddings = param(af::dim4(1024, 50000));
+  return {{"embedding.lm",
+           {embeddings},
+           [indices, embeddings]() { return embedding(indices, embeddings); }}};
+}
+
+std::vector<BenchmarkCase> matmulCases() {
+  std::vector<BenchmarkCase> cases;
+  // Feed-forward layer of the LM transformer, 512 steps of 4 samples
+  auto weight = param(af::dim4(4096, 1024));
+  auto input = param(af::dim4(1024, 2048));
+  cases.push_back(
+      {"matmul.lm.ffn",
+       {weight, input},
+       [weight, input]() { return matmul(weight, input); }});
+  auto weightT = param(af::dim4(1024, 4096));
+  cases.push_back(
+      {"matmulTN.lm.ffn",
+       {weightT, input},
+       [weightT, input]() { return matmulTN(weightT, input); }});
+  auto inputT = param(af::dim4(2048, 1024));
+  cases.push_back(
+      {"matmulNT.lm.ffn",
+       {weight, inputT},
+       [weight, inputT]() { return matmulNT(weight, inputT); }});
+  // Attention scores of 16 heads of size 64, batched
+  auto query = param(af::dim4(512, 64, 16 * 4));
+  auto key = param(af::dim4(512, 64, 16 * 4));
+  cases.push_back(
+      {"matmulNT.lm.scores",
+       {query, key},
+       [query, key]() { return matmulNT(query, key); }});
+  return cases;
+}
+
+// Reads the flat {"name": {"forward": ms, "backward": ms}, ...} objects
+// written by `save()`
+std::map<std::string, Timing> load(const std::string& path) {
+  std::ifstream file(path);
+  if (!file) {
+    throw std::runtime_error("AutogradBenchmark: could not open " + path);
+  }
+  std::stringstream ss;
+  ss << file.rdbuf();
+  auto text = ss.str();
+
+  std::map<std::string, Timing> timings;
+  size_t pos = 0;
+  auto number = [&](const std::string& field) {
+    auto found = text.find("\"" + field + "\":", pos);
+    if (found == std::string::npos) {
+      throw std::runtime_error(
+          "AutogradBenchmark: no " + field + " in " + path);
+    }
+    pos = found + field.size() + 3;
+    return std::stod(text.substr(pos));
+  };
+  // The first quote opens the name of a case, skipping the outer brace
+  while ((pos = text.find('"', pos)) != std::string::npos) {
+    auto end = text.find('"', pos + 1);
+    auto name = text.substr(pos + 1, end - pos - 1);
+    pos = end + 1;
+    Timing timing;
+    timing.forwardMs = number("forward");
+    timing.backwardMs = number("backward");
+    timings[name] = timing;
+    pos = text.find('}', pos);
+  }
+  return timings;
+}
+
+void save(
+    const std::string& path,
+    const std::vector<std::pair<std::string, Timing>>& timings) {
+  std::ofstream file(path);
+  file << std::setprecision(6) << "{\n";
+  for (size_t i = 0; i < timings.size(); ++i) {
+    file << "  \"" << timings[i].first << "\": {\"forward\": "
+         << timings[i].second.forwardMs
+         << ", \"backward\": " << timings[i].second.backwardMs << "}"
+         << (i + 1 < timings.size() ? ",\n" : "\n");
+  }
+  file << "}\n";
+  if (!file) {
+    throw std::runtime_error("AutogradBenchmark: could not write " + path);
+  }
+}
+
+std::string option(int argc, char** argv, const std::string& name) {
+  auto prefix = "--" + name + "=";
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg.compare(0, prefix.size(), prefix) == 0) {
+      return arg.substr(prefix.size());
+    }
+  }
+  return "";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  af::info();
+  fl::init();
+
+  auto filter = option(argc, argv, "filter");
+  auto savePath = option(argc, argv, "save");
+  auto baselinePath = option(argc, argv, "baseline");
+  auto toleranceStr = option(argc, argv, "tolerance");
+  double tolerance = toleranceStr.empty() ? 0.1 : std::stod(toleranceStr);
+  std::map<std::string, Timing> baseline;
+  if (!baselinePath.empty()) {
+    baseline = load(baselinePath);
+  }
+
+  std::vector<BenchmarkCase> cases;
+  for (auto group : std::vector<std::function<std::vector<BenchmarkCase>()>>{
+           conv2dCases,
+           rnnCases,
+           attentionCases,
+           batchnormCases,
+           embeddingCases,
+           matmulCases}) {
+    for (auto& bench : group()) {
+      if (bench.name.find(filter) != std::string::npos) {
+        cases.push_back(std::move(bench));
+      }
+    }
+  }
+
+  std::vector<std::pair<std::string, Timing>> timings;
+  int regressions = 0;
+  std::cout << std::left << std::setw(36) << "case" << std::right
+            << std::setw(12) << "fwd ms" << std::setw(12) << "bwd ms"
+            << std::setw(12) << "vs baseline" << std::endl;
+  for (auto& bench : cases) {
+    auto timing = run(bench);
+    timings.emplace_back(bench.name, timing);
+    std::cout << std::left << std::setw(36) << bench.name << std::right
+              << std::fixed << std::setprecision(3) << std::setw(12)
+              << timing.forwardMs << std::setw(12) << timing.backwardMs;
+    auto it = baseline.find(bench.name);
+    if (it != baseline.end()) {
+      double before = it->second.forwardMs + it->second.backwardMs;
+      double ratio = (timing.forwardMs + timing.backwardMs) / before;
+      std::cout << std::setw(11) << std::setprecision(2) << ratio << "x";
+      if (ratio > 1 + tolerance) {
+        std::cout << "  REGRESSION";
+        ++regressions;
+      }
+    }
+    std::cout << std::endl;
+  }
+
+  if (!savePath.empty()) {
+    save(savePath, timings);
+  }
+  if (regressions > 0) {
+    std::cout << regressions << " case(s) regressed by more than "
+              << tolerance * 100 << "%" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -15,7 +15,9 @@
 
 #include <array>
 #include <functional>
+#include <memory>
 #include <stdexcept>
+#include <thread>
 
 #include <gtest/gtest.h>
 
@@ -169,6 +171,131 @@ TEST(AutogradTest, AfArrBackwardNoMutate) {
   ASSERT_TRUE(allClose(v.grad().array(), v.array()));
 }
 
+TEST(AutogradTest, BackwardReleasesGraph) {
+  auto x = Variable(af::constant(1, {2, 2}), true);
+  auto captured = std::make_shared<int>(0);
+  std::weak_ptr<int> observer = captured;
+  auto gradFunc = [captured](
+                      std::vector<Variable>& inputs,
+                      const Variable& gradOutput) {
+    inputs[0].addGrad(gradOutput);
+  };
+  auto y = Variable(x.array() * 2, {x}, gradFunc);
+  captured.reset();
+  auto z = y * y;
+
+  z.backward(/* retainGraph = */ true);
+  ASSERT_FALSE(observer.expired());
+  x.zeroGrad();
+  y.zeroGrad();
+  z.zeroGrad();
+  z.backward();
+  ASSERT_TRUE(observer.expired());
+  // The data of the Variables held by the user is untouched
+  ASSERT_TRUE(allClose(y.array(), af::constant(2, {2, 2})));
+  ASSERT_TRUE(allClose(x.grad().array(), af::constant(4, {2, 2})));
+}
+
+TEST(AutogradTest, DeepGraphBackward) {
+  // Deep enough to overflow the stack with a recursive graph traversal
+  auto x = Variable(af::constant(1, 1), true);
+  auto y = x;
+  for (int i = 0; i < 100000; ++i) {
+    y = y * 1.0;
+  }
+  y.backward();
+  ASSERT_TRUE(allClose(x.grad().array(), af::constant(1, 1)));
+}
+
+TEST(AutogradTest, NoGradGuard) {
+  auto x = Variable(af::randu(5), true);
+  {
+    NoGradGuard noGrad;
+    ASSERT_FALSE(isGradEnabled());
+    {
+      NoGradGuard nested;
+      ASSERT_FALSE(isGradEnabled());
+    }
+    ASSERT_FALSE(isGradEnabled());
+    auto y = x * x + 1.0;
+    ASSERT_FALSE(y.isCalcGrad());
+    ASSERT_TRUE(allClose(y.array(), x.array() * x.array() + 1.0));
+  }
+  ASSERT_TRUE(isGradEnabled());
+  ASSERT_TRUE((x * x).isCalcGrad());
+}
+
+TEST(AutogradTest, GraphAcrossThreads) {
+  // Graphs built on a thread are used and released on another
+  auto x = Variable(af::randu(5), true);
+  const int numThreads = 4;
+  std::vector<Variable> outputs(numThreads);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < numThreads; ++i) {
+    threads.emplace_back([&x, &outputs, i]() {
+      auto y = x;
+      for (int j = 0; j <= i; ++j) {
+        y = y * 2.0 + 1.0;
+      }
+      outputs[i] = sum(y, {0});
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (auto& output : outputs) {
+    output.backward();
+  }
+  // 2 + 4 + 8 + 16
+  ASSERT_TRUE(allClose(x.grad().array(), af::constant(30, 5)));
+  outputs.clear();
+}
+
+TEST(AutogradTest, OffloadActivations) {
+  auto x = Variable(af::randu(5, 4), true);
+  auto w1 = Variable(af::randu(6, 5), true);
+  auto w2 = Variable(af::randu(3, 6), true);
+  auto forward = [&](bool offload) {
+    auto h1 = tanh(x * 2.0 + 1.0);
+    auto h2 = matmul(w1, h1);
+    if (offload) {
+      h2 = offloadActivations({h2}, {x, w1})[0];
+      // The input of the matmul is back on the host
+      EXPECT_TRUE(h1.isempty());
+    }
+    auto h3 = sigmoid(h2) * 3.0;
+    auto h4 = matmul(w2, h3);
+    if (offload) {
+      h4 = offloadActivations({h4}, {h2, w2})[0];
+      EXPECT_TRUE(h3.isempty());
+    }
+    return sum(flat(h4 * h4), {0});
+  };
+
+  forward(false).backward();
+  std::vector<af::array> expected = {
+      x.grad().array(), w1.grad().array(), w2.grad().array()};
+  x.zeroGrad();
+  w1.zeroGrad();
+  w2.zeroGrad();
+
+  forward(true).backward();
+  ASSERT_TRUE(allClose(x.grad().array(), expected[0]));
+  ASSERT_TRUE(allClose(w1.grad().array(), expected[1]));
+  ASSERT_TRUE(allClose(w2.grad().array(), expected[2]));
+
+  // Activations smaller than the threshold stay on the device
+  auto h1 = x * 2.0;
+  auto h2 = offloadActivations({matmul(w1, h1)}, {x, w1}, h1.bytes() + 1);
+  ASSERT_FALSE(h1.isempty());
+  {
+    NoGradGuard noGrad;
+    auto h3 = x * 2.0;
+    offloadActivations({matmul(w1, h3)}, {x, w1});
+    ASSERT_FALSE(h3.isempty());
+  }
+}
+
 TEST(AutogradTest, Multiply) {
   auto x = Variable(af::randu(5), true);
   auto y = x * x;
@@ -950,6 +1077,135 @@ TEST(AutogradTest, ConvolveDilation) {
   ASSERT_TRUE(jacobianTestImpl(func_conv_bs, bs, 0.02));
 }
 
+TEST(AutogradTest, DepthwiseConv1d) {
+  int channels = 4, multiplier = 2;
+  auto in = Variable(af::randu(12, 1, channels, 3, af::dtype::f32), true);
+  auto wt = Variable(
+      af::randu(3, 1, 1, channels * multiplier, af::dtype::f32), true);
+  auto bs = Variable(af::randu(channels * multiplier, af::dtype::f32), true);
+  // Causal, dilated and strided convolutions
+  for (auto params : std::vector<std::array<int, 4>>{
+           {2, 0, 1, 1}, {1, 3, 1, 2}, {2, 1, 2, 1}}) {
+    int leftPad = params[0], rightPad = params[1];
+    int sx = params[2], dx = params[3];
+    auto output = depthwiseConv1d(in, wt, bs, leftPad, rightPad, sx, dx);
+    auto padded = padding(in, {{leftPad, rightPad}}, 0);
+    auto expected = conv2d(
+        padded,
+        wt,
+        moddims(bs, af::dim4(1, 1, channels * multiplier)),
+        sx,
+        1,
+        0,
+        0,
+        dx,
+        1,
+        channels);
+    ASSERT_TRUE(allClose(output.array(), expected.array(), 1E-5));
+
+    // Linear in each argument: the finite differences are exact
+
+    auto funcIn = [&](Variable& input) {
+      return depthwiseConv1d(input, wt, bs, leftPad, rightPad, sx, dx);
+    };
+    ASSERT_TRUE(jacobianTestImpl(funcIn, in, 1E-3, 1E-2));
+    auto funcWt = [&](Variable& weight) {
+      return depthwiseConv1d(in, weight, bs, leftPad, rightPad, sx, dx);
+    };
+    ASSERT_TRUE(jacobianTestImpl(funcWt, wt, 1E-3, 1E-2));
+    auto funcBs = [&](Variable& bias) {
+      return depthwiseConv1d(in, wt, bias, leftPad, rightPad, sx, dx);
+    };
+    ASSERT_TRUE(jacobianTestImpl(funcBs, bs, 1E-3, 1E-2));
+  }
+}
+
+TEST(AutogradTest, ConvolveInferenceWeightsUpdate) {
+  // Backends may keep constant weights in their own layout across calls
+  auto in = Variable(af::randu(10, 9, 8, 7, af::dtype::f32), false);
+  auto wt = Variable(af::randu(4, 3, 8, 6, af::dtype::f32), false);
+  auto conv = [&](const Variable& weights) {
+    return conv2d(in, weights, 1, 1, 2, 1, 1, 1, /* groups */ 1).array();
+  };
+  auto out = conv(wt);
+  ASSERT_TRUE(allClose(conv(wt), out, 1E-5));
+
+  wt.array() = wt.array() * 2;
+  ASSERT_TRUE(allClose(conv(wt), out * 2, 1E-4));
+
+  wt.array()(0) = 10;
+  auto expected = conv(Variable(wt.array().copy(), false));
+  ASSERT_TRUE(allClose(conv(wt), expected, 1E-5));
+}
+
+TEST(AutogradTest, ConvolveInferenceChain) {
+  // Backends may pass outputs between consecutive ops in their own layout
+  auto in = Variable(af::randu(10, 9, 16, 4, af::dtype::f32), false);
+  auto wt1 = Variable(af::randu(3, 3, 16, 32, af::dtype::f32), false);
+  auto wt2 = Variable(af::randu(3, 3, 32, 32, af::dtype::f32), false);
+  auto conv = [](const Variable& input, const Variable& weights) {
+    return conv2d(input, weights, 1, 1, 1, 1, 1, 1, /* groups */ 1);
+  };
+  auto pool = [](const Variable& input) {
+    return pool2d(input, 2, 2, 2, 2, 0, 0, PoolingMode::MAX);
+  };
+  auto out1 = conv(in, wt1);
+  auto out2 = conv(out1, wt2);
+  auto out3 = pool(out2);
+  // Copies are new arrays, which don't come from a previous op
+  auto copy1 = Variable(out1.array().copy(), false);
+  auto expected2 = conv(copy1, wt2);
+  auto copy2 = Variable(expected2.array().copy(), false);
+  ASSERT_TRUE(allClose(out2.array(), expected2.array(), 1E-4));
+  ASSERT_TRUE(allClose(out3.array(), pool(copy2).array(), 1E-4));
+}
+
+TEST(AutogradTest, ConvolvePoolChannelsLast) {
+  // w x h x c x b, and c x w x h x b
+  auto in = Variable(af::randu(10, 9, 8, 7, af::dtype::f32), true);
+  auto inCwhn = Variable(reorder(in, 2, 0, 1, 3).array(), true);
+  auto wt = Variable(af::randu(4, 3, 8, 6, af::dtype::f32), true);
+  auto bs = Variable(af::randu(1, 1, 6, 1, af::dtype::f32), true);
+  auto out = pool2d(
+      conv2d(in, wt, bs, 2, 1, 2, 1, 1, 1, /* groups */ 1), 2, 2, 2, 2);
+  auto wtCwhn = Variable(wt.array(), true);
+  auto bsCwhn = Variable(bs.array(), true);
+  auto outCwhn = pool2d(
+      conv2d(
+          inCwhn,
+          wtCwhn,
+          bsCwhn,
+          2,
+          1,
+          2,
+          1,
+          1,
+          1,
+          /* groups */ 1,
+          /* benchmarks */ nullptr,
+          ImageLayout::CWHN),
+      2,
+      2,
+      2,
+      2,
+      0,
+      0,
+      PoolingMode::MAX,
+      ImageLayout::CWHN);
+  ASSERT_TRUE(allClose(
+      reorder(outCwhn, 1, 2, 0, 3).array(), out.array(), 1E-4));
+
+  auto grad = af::randu(out.dims(), af::dtype::f32);
+  out.backward(Variable(grad, false));
+  outCwhn.backward(Variable(af::reorder(grad, 2, 0, 1, 3), false));
+  ASSERT_TRUE(allClose(
+      af::reorder(inCwhn.grad().array(), 1, 2, 0, 3),
+      in.grad().array(),
+      1E-4));
+  ASSERT_TRUE(allClose(wtCwhn.grad().array(), wt.grad().array(), 1E-4));
+  ASSERT_TRUE(allClose(bsCwhn.grad().array(), bs.grad().array(), 1E-4));
+}
+
 TEST(AutogradTest, Padding) {
   auto in = Variable(af::randu(3, 3, af::dtype::f32), true);
   auto func_pad = [&](Variable& input) {
@@ -958,6 +1214,25 @@ TEST(AutogradTest, Padding) {
   ASSERT_TRUE(jacobianTestImpl(func_pad, in, 1E-3));
 }
 
+TEST(AutogradTest, Dropout) {
+  auto in = Variable(af::randu(100, 100) + 1, true);
+  af::setSeed(3);
+  auto out = dropout(in, 0.25);
+  af::setSeed(3);
+  ASSERT_TRUE(allClose(dropout(in, 0.25).array(), out.array()));
+  ASSERT_NEAR(
+      af::count<float>(out.array() == 0) / in.elements(), 0.25, 0.05);
+
+  // The backward pass regenerates the mask of the forward pass
+  out.backward(Variable(af::constant(1, in.dims()), false));
+  auto grad = in.grad().array();
+  ASSERT_TRUE(allClose(grad, (out.array() != 0).as(f32) / 0.75, 1e-5));
+  ASSERT_TRUE(allClose(in.array() * grad, out.array(), 1e-5));
+
+  ASSERT_TRUE(allClose(dropout(in, 1).array(), af::constant(0, in.dims())));
+  ASSERT_TRUE(allClose(dropout(in, 0).array(), in.array()));
+}
+
 TEST(AutogradTest, Pooling) {
   auto in = Variable(af::randu(3, 3, 1, 1, af::dtype::f32), true);
   auto func_pool = [&](Variable& input) { return pool2d(input, 2, 2, 1, 1); };
@@ -1053,6 +1328,45 @@ TEST(AutogradTest, CrossEntropy) {
       1e-5);
 }
 
+TEST(AutogradTest, SoftmaxCrossEntropy) {
+  auto x = Variable(af::randn(7, 10, 4), true);
+  auto y = Variable((af::randu(10, 4, af::dtype::u32) % 7).as(s32), false);
+  auto ignoreIdx = y(0, 0).scalar<int>();
+  auto grad = [&](const Variable& loss) {
+    x.zeroGrad();
+    loss.backward();
+    return x.grad().array();
+  };
+
+  std::vector<ReduceMode> modes = {
+      ReduceMode::NONE, ReduceMode::SUM, ReduceMode::MEAN};
+  for (auto mode : modes) {
+    for (int ignore : {-1, ignoreIdx}) {
+      auto expected =
+          categoricalCrossEntropy(logSoftmax(x, 0), y, mode, ignore);
+      auto loss = softmaxCrossEntropy(x, y, mode, ignore);
+      ASSERT_EQ(loss.dims(), expected.dims());
+      ASSERT_TRUE(allClose(loss.array(), expected.array(), 1e-5));
+      auto expectedGrad = grad(expected);
+      ASSERT_TRUE(allClose(grad(loss), expectedGrad, 1e-5));
+    }
+  }
+
+  // with label smoothing, the targets are mixed with a uniform distribution
+  double eps = 0.1;
+  auto logProbs = logSoftmax(x, 0);
+  auto expected =
+      (1 - eps) * categoricalCrossEntropy(logProbs, y, ReduceMode::SUM) -
+      eps * sum(flat(mean(logProbs, {0})), {0});
+  auto loss = softmaxCrossEntropy(x, y, ReduceMode::SUM, -1, eps);
+  ASSERT_TRUE(allClose(loss.array(), expected.array(), 1e-4));
+  auto expectedGrad = grad(expected);
+  ASSERT_TRUE(allClose(grad(loss), expectedGrad, 1e-5));
+
+  ASSERT_THROW(
+      softmaxCrossEntropy(x, y + 7, ReduceMode::SUM), std::invalid_argument);
+}
+
 TEST(AutogradTest, Reorder) {
   auto in = Variable(af::randu(3, 1, 4, 1, af::dtype::f32) * 2, true);
   auto func_reorder = [&](Variable& input) {
@@ -1082,6 +1396,38 @@ TEST(AutogradTest, Linear) {
   }
 }
 
+TEST(AutogradTest, LinearActivation) {
+  auto in = Variable(af::randu(3, 4, 2) * 2 - 1, true);
+  auto wt = Variable(af::randu(6, 3) * 2 - 1, true);
+  auto bs = Variable(af::randu(6) * 2 - 1, true);
+  for (auto activation : {LinearActivation::RELU, LinearActivation::GELU}) {
+    for (bool hasBias : {false, true}) {
+      auto bias = hasBias ? bs : Variable();
+      auto expected = linear(in, wt, bias);
+      expected = activation == LinearActivation::RELU ? relu(expected)
+                                                      : gelu(expected);
+      expected.backward();
+      auto inGrad = in.grad().array(), wtGrad = wt.grad().array();
+      auto bsGrad = hasBias ? bs.grad().array() : af::array();
+      in.zeroGrad();
+      wt.zeroGrad();
+      bs.zeroGrad();
+
+      auto fused = linear(in, wt, bias, activation);
+      ASSERT_TRUE(allClose(fused.array(), expected.array(), 1E-5));
+      fused.backward();
+      ASSERT_TRUE(allClose(in.grad().array(), inGrad, 1E-5));
+      ASSERT_TRUE(allClose(wt.grad().array(), wtGrad, 1E-5));
+      if (hasBias) {
+        ASSERT_TRUE(allClose(bs.grad().array(), bsGrad, 1E-5));
+      }
+      in.zeroGrad();
+      wt.zeroGrad();
+      bs.zeroGrad();
+    }
+  }
+}
+
 TEST_F(AutogradTestF16, LinearF16) {
   if (!fl::f16Supported()) {
     GTEST_SKIP() << "Half-precision not supported on this device";
@@ -1371,6 +1717,33 @@ TEST(AutogradTest, Embedding) {
   ASSERT_TRUE(jacobianTestImpl(func_embed, weights, 1E-5));
 }
 
+TEST(AutogradTest, EmbeddingSparseGrad) {
+  int n_words = 10;
+  auto input = Variable((af::randu(4, 2) * n_words).as(s32), false);
+  auto weights = Variable(af::randn(4, n_words, f64), true);
+  auto func_embed = [&](Variable& w) { return embedding(input, w, true); };
+  ASSERT_TRUE(jacobianTestImpl(func_embed, weights, 1E-5));
+
+  // gradients of two lookups are accumulated in a sparse gradient
+  auto sparseWeights = Variable(weights.array(), true);
+  auto denseWeights = Variable(weights.array(), true);
+  auto gradOutput = Variable(af::randn(4, 4, 2, f64), false);
+  for (int i = 0; i < 2; i++) {
+    embedding(input, sparseWeights, true).backward(gradOutput);
+    embedding(input, denseWeights).backward(gradOutput);
+  }
+  ASSERT_TRUE(sparseWeights.isGradSparse());
+  const auto& sparseGrad = sparseWeights.sparseGrad();
+  ASSERT_EQ(sparseGrad.sparseDim(), 1);
+  ASSERT_EQ(sparseGrad.denseDims(), weights.dims());
+  auto uniqueIndices = af::setUnique(af::flat(input.array()));
+  ASSERT_EQ(sparseGrad.sparseIndices().elements(), uniqueIndices.elements());
+  ASSERT_TRUE(allClose(sparseGrad.sparseIndices(), uniqueIndices));
+  ASSERT_TRUE(
+      allClose(sparseWeights.grad().array(), denseWeights.grad().array()));
+  ASSERT_FALSE(sparseWeights.isGradSparse());
+}
+
 TEST(AutogradTest, BatchNormEvalModeOutputSingleAxis) {
   int feat_dims = 3;
   std::vector<int> featAxes = {2};
@@ -1698,6 +2071,78 @@ TEST_F(AutogradTestF16, BatchNormJacobianMultipleAxesF16) {
   ASSERT_TRUE(jacobianTestImpl(func_bn_bs, bias, 5e-2, 1e-1));
 }
 
+TEST_F(AutogradTestF16, BatchNormReluF16) {
+  if (!fl::f16Supported()) {
+    GTEST_SKIP() << "Half-precision not supported on this device";
+  }
+
+  // Channels-last images, which cuDNN normalizes, adds and activates at once
+  int numFeat = 8;
+  std::vector<int> featAxes = {0};
+  auto input = Variable(af::randn(numFeat, 6, 6, 4, af::dtype::f16), true);
+  auto residual = Variable(af::randn(numFeat, 6, 6, 4, af::dtype::f16), true);
+  auto weight = Variable(af::randu(numFeat, af::dtype::f32), true);
+  auto bias = Variable(af::randn(numFeat, af::dtype::f32), true);
+  auto runningMean = Variable(af::randu(numFeat, af::dtype::f32), false);
+  auto runningVar = Variable(af::randu(numFeat, af::dtype::f32), false);
+  auto runningMean2 = Variable(runningMean.array().copy(), false);
+  auto runningVar2 = Variable(runningVar.array().copy(), false);
+
+  for (auto res : {Variable(), residual}) {
+    auto out = batchnormRelu(
+        input,
+        res,
+        weight,
+        bias,
+        runningMean,
+        runningVar,
+        featAxes,
+        true,
+        0.1,
+        1E-5);
+    auto expected = batchnorm(
+        input,
+        weight,
+        bias,
+        runningMean2,
+        runningVar2,
+        featAxes,
+        true,
+        0.1,
+        1E-5);
+    if (!res.isempty()) {
+      expected = expected + res;
+    }
+    expected = relu(expected);
+    ASSERT_EQ(out.type(), af::dtype::f16);
+    ASSERT_TRUE(allClose(
+        out.array().as(f32), expected.array().as(f32), 5e-2));
+    ASSERT_TRUE(allClose(runningMean.array(), runningMean2.array(), 1e-3));
+    ASSERT_TRUE(allClose(runningVar.array(), runningVar2.array(), 1e-3));
+
+    auto gradOut = Variable(af::randn(out.dims(), af::dtype::f16), false);
+    std::vector<Variable> grads;
+    for (auto* y : {&out, &expected}) {
+      for (auto* v : {&input, &residual, &weight, &bias}) {
+        v->zeroGrad();
+      }
+      y->backward(gradOut);
+      grads.push_back(input.grad());
+      grads.push_back(weight.grad());
+      grads.push_back(bias.grad());
+      if (!res.isempty()) {
+        grads.push_back(residual.grad());
+      }
+    }
+    for (size_t i = 0; i < grads.size() / 2; ++i) {
+      ASSERT_TRUE(allClose(
+          grads[i].array().as(f32),
+          grads[i + grads.size() / 2].array().as(f32),
+          1e-1));
+    }
+  }
+}
+
 TEST(AutogradTest, LayerNormJacobian) {
   std::vector<int> featAxes = {0, 1, 2, 3};
   auto input = Variable(af::randu(7, 7, 3, 10), true);
@@ -1744,11 +2189,226 @@ TEST_F(AutogradTestF16, LayerNormJacobianF16) {
   ASSERT_TRUE(jacobianTestImpl(func_ln_in, input, 1e-4, 1e-2));
 }
 
-TEST(AutogradTest, GetAdvancedIndex) {
-  if (af::getActiveBackend() != AF_BACKEND_CUDA) {
-    GTEST_SKIP()
-        << "Advanced indexing operator unsupported for non-CUDA backends";
+TEST(AutogradTest, FusedMultiheadAttention) {
+  int T = 75, nHeads = 2, headDim = 8, B = 2, nPos = 41;
+  auto query = Variable(af::randu(T, nHeads * headDim, B), true);
+  auto key = Variable(af::randu(T, nHeads * headDim, B), true);
+  auto value = Variable(af::randu(T, nHeads * headDim, B), true);
+  auto posEmb = Variable(af::randn(nPos, headDim), true);
+  auto maskArr = af::log(af::lower(af::constant(1.0, T, T), true));
+  auto padMask = Variable(af::log(0.5 + 0.5 * af::randu(T, B)), false);
+
+  auto attention = [&](bool fused, double pDropout) {
+    for (auto* var : {&query, &key, &value, &posEmb}) {
+      var->zeroGrad();
+    }
+    // Masks requiring gradients are only supported by unfused operators
+    auto mask = Variable(maskArr, !fused);
+    auto pos = tile(posEmb, af::dim4(1, 1, nHeads * B));
+    return multiheadAttention(
+        query, key, value, pos, mask, padMask, nHeads, pDropout, 3);
+  };
+
+  auto grad = Variable(af::randn(T, nHeads * headDim, B), false);
+  auto expected = attention(false, 0.0);
+  expected.backward(grad);
+  std::vector<af::array> expectedGrads;
+  for (auto* var : {&query, &key, &value, &posEmb}) {
+    expectedGrads.push_back(var->grad().array());
+  }
+  auto result = attention(true, 0.0);
+  result.backward(grad);
+  ASSERT_TRUE(allClose(result.array(), expected.array(), 1e-4));
+  int i = 0;
+  for (auto* var : {&query, &key, &value, &posEmb}) {
+    ASSERT_TRUE(allClose(var->grad().array(), expectedGrads[i++], 1e-3));
+  }
+
+  // Dropout masks are drawn from the ArrayFire random engine
+  af::setSeed(7);
+  auto dropped = attention(true, 0.5).array();
+  af::setSeed(7);
+  ASSERT_TRUE(allClose(attention(true, 0.5).array(), dropped));
+  ASSERT_FALSE(allClose(dropped, result.array(), 1e-2));
+}
+
+TEST(AutogradTest, MultiheadAttentionWindow) {
+  // Several blocks of queries and keys
+  int T = 150, nHeads = 2, headDim = 8, B = 2, nPos = 41, offset = 3;
+  AttentionWindow window{20, 7, 2};
+  auto query = Variable(af::randu(T, nHeads * headDim, B), true);
+  auto key = Variable(af::randu(T + offset, nHeads * headDim, B), true);
+  auto value = Variable(af::randu(T + offset, nHeads * headDim, B), true);
+  auto posEmb = Variable(af::randn(nPos, headDim), true);
+  auto pos = af::range(af::dim4(T, T + offset), 0) + offset;
+  auto j = af::range(af::dim4(T, T + offset), 1);
+  auto bandMask = af::log(
+      ((j >= pos - window.left && j <= pos + window.right) ||
+       j < window.numGlobal || pos < window.numGlobal)
+          .as(f32));
+  std::vector<Variable*> vars = {&query, &key, &value, &posEmb};
+
+  // The window of the fused kernels and of the unfused operators (with a
+  // mask requiring gradients), against a dense band mask
+  auto attention = [&](bool fused, bool dense) {
+    for (auto* var : vars) {
+      var->zeroGrad();
+    }
+    auto mask = dense
+        ? Variable(bandMask, true)
+        : Variable(af::constant(0, T, T + offset), !fused);
+    return multiheadAttention(
+        query,
+        key,
+        value,
+        tile(posEmb, af::dim4(1, 1, nHeads * B)),
+        mask,
+        Variable(),
+        nHeads,
+        0.0,
+        offset,
+        dense ? AttentionWindow() : window);
+  };
+
+  auto grad = Variable(af::randn(T, nHeads * headDim, B), false);
+  auto expected = attention(false, true);
+  expected.backward(grad);
+  std::vector<af::array> expectedGrads;
+  for (auto* var : vars) {
+    expectedGrads.push_back(var->grad().array());
   }
+  for (bool fused : {true, false}) {
+    auto result = attention(fused, false);
+    result.backward(grad);
+    ASSERT_TRUE(allClose(result.array(), expected.array(), 1e-4));
+    int i = 0;
+    for (auto* var : vars) {
+      ASSERT_TRUE(allClose(var->grad().array(), expectedGrads[i++], 1e-3));
+    }
+  }
+}
+
+TEST(AutogradTest, MultiheadAttentionBatchMask) {
+  int T = 20, nHeads = 2, headDim = 8, B = 3;
+  auto query = Variable(af::randu(T, nHeads * headDim, B), true);
+  auto key = Variable(af::randu(T, nHeads * headDim, B), true);
+  auto value = Variable(af::randu(T, nHeads * headDim, B), true);
+  // A different block-diagonal mask for each element of the batch
+  auto segments = af::floor(
+      af::iota(af::dim4(T), af::dim4(1, B)) /
+      af::tile(af::range(af::dim4(1, B), 1) + 3, T));
+  auto maskArr = af::log((af::tile(af::moddims(segments, T, 1, B), 1, T) ==
+                          af::tile(af::moddims(segments, 1, T, B), T))
+                             .as(f32));
+
+  auto attention = [&](bool fused) {
+    for (auto* var : {&query, &key, &value}) {
+      var->zeroGrad();
+    }
+    auto mask = Variable(maskArr, !fused);
+    return multiheadAttention(
+        query, key, value, Variable(), mask, Variable(), nHeads, 0.0);
+  };
+
+  auto grad = Variable(af::randn(T, nHeads * headDim, B), false);
+  auto expected = attention(false);
+  expected.backward(grad);
+  std::vector<af::array> expectedGrads;
+  for (auto* var : {&query, &key, &value}) {
+    expectedGrads.push_back(var->grad().array());
+  }
+  auto result = attention(true);
+  result.backward(grad);
+  ASSERT_TRUE(allClose(result.array(), expected.array(), 1e-4));
+  int i = 0;
+  for (auto* var : {&query, &key, &value}) {
+    ASSERT_TRUE(allClose(var->grad().array(), expectedGrads[i++], 1e-3));
+  }
+
+  // Each element of the batch only uses its own mask
+  for (int b = 0; b < B; ++b) {
+    auto single = multiheadAttention(
+        query.slice(b),
+        key.slice(b),
+        value.slice(b),
+        Variable(),
+        Variable(maskArr(af::span, af::span, b), false),
+        Variable(),
+        nHeads,
+        0.0);
+    ASSERT_TRUE(allClose(result.slice(b), single, 1e-5));
+  }
+}
+
+TEST(AutogradTest, FusedLayerNorm) {
+  int F = 40, T = 7, B = 3;
+  double eps = 1e-5;
+  auto input = Variable(af::randn(F, T, B), true);
+  auto residual = Variable(af::randn(F, T, B), true);
+  auto weight = Variable(af::randu(F), true);
+  auto bias = Variable(af::randu(F), true);
+  std::vector<Variable*> vars = {&input, &residual, &weight, &bias};
+  auto grad = Variable(af::randn(F, T, B), false);
+
+  auto checkGrads = [&](const Variable& result, const Variable& expected) {
+    for (auto* var : vars) {
+      var->zeroGrad();
+    }
+    expected.backward(grad);
+    std::vector<af::array> expectedGrads;
+    for (auto* var : vars) {
+      expectedGrads.push_back(var->grad().array());
+      var->zeroGrad();
+    }
+    result.backward(grad);
+    ASSERT_TRUE(allClose(result.array(), expected.array(), 1e-4));
+    for (int i = 0; i < vars.size(); ++i) {
+      ASSERT_TRUE(allClose(vars[i]->grad().array(), expectedGrads[i], 1e-3));
+    }
+  };
+
+  auto reference = [&](const Variable& w, const Variable& b) {
+    auto x = input + residual;
+    auto centered = x - tileAs(mean(x, {0}), x);
+    auto normalized = centered / tileAs(fl::sqrt(var(x, {0}, true) + eps), x);
+    return normalized * tileAs(w, x) + tileAs(b, x);
+  };
+  checkGrads(
+      residualLayerNorm(input, residual, weight, bias, eps),
+      reference(weight, bias));
+  // singleton parameters are broadcast
+  checkGrads(
+      residualLayerNorm(input, residual, weight(0), bias(0), eps),
+      reference(weight(0), bias(0)));
+
+  auto result = layerNorm(input, Variable(), Variable(), eps);
+  auto centered = input - tileAs(mean(input, {0}), input);
+  auto expected =
+      centered / tileAs(fl::sqrt(var(input, {0}, true) + eps), input);
+  ASSERT_TRUE(allClose(result.array(), expected.array(), 1e-4));
+}
+
+TEST(AutogradTest, BiasGelu) {
+  auto input = Variable(af::randn(30, 4, 2), true);
+  auto bias = Variable(af::randn(30), true);
+  auto grad = Variable(af::randn(30, 4, 2), false);
+
+  auto expected = gelu(input + tileAs(bias, input));
+  expected.backward(grad);
+  auto expectedGradInput = input.grad().array();
+  auto expectedGradBias = bias.grad().array();
+  input.zeroGrad();
+  bias.zeroGrad();
+
+  auto result = biasGelu(input, bias);
+  result.backward(grad);
+  ASSERT_TRUE(allClose(result.array(), expected.array(), 1e-5));
+  ASSERT_TRUE(allClose(input.grad().array(), expectedGradInput, 1e-4));
+  ASSERT_TRUE(allClose(bias.grad().array(), expectedGradBias, 1e-4));
+  ASSERT_THROW(biasGelu(input, bias(af::seq(10))), std::invalid_argument);
+}
+
+TEST(AutogradTest, GetAdvancedIndex) {
   std::vector<af::dtype> validIndexTypes{s32, s64, u32, u64};
   for (const auto& dtype : validIndexTypes) {
     auto x = Variable(af::randu(20, 50, 40, 30, f32), true);
@@ -1773,10 +2433,6 @@ TEST(AutogradTest, GetAdvancedIndex) {
 }
 
 TEST(AutogradTest, GetAdvancedIndexF16) {
-  if (af::getActiveBackend() != AF_BACKEND_CUDA) {
-    GTEST_SKIP()
-        << "Advanced indexing operator unsupported for non-CUDA backends";
-  }
   if (!fl::f16Supported()) {
     GTEST_SKIP() << "Half-precision not supported on this device";
   }
@@ -1805,6 +2461,31 @@ TEST(AutogradTest, GetAdvancedIndexF16) {
   }
 }
 
+TEST(AutogradTest, GetAdvancedIndexDuplicates) {
+  // Many repeated indices, as in embedding lookups
+  int numRows = 1000;
+  auto x = Variable(af::randu(numRows, 64, f32), true);
+  auto idx = (af::randu(50000) * 10).as(s32);
+  auto y = sum(x(idx, af::span), {0, 1});
+  y.backward();
+  std::vector<int> hostIdx(idx.elements());
+  idx.host(hostIdx.data());
+  std::vector<float> counts(numRows, 0);
+  for (auto i : hostIdx) {
+    counts[i] += 1;
+  }
+  auto expected = af::tile(af::array(numRows, counts.data()), 1, 64);
+  ASSERT_TRUE(allClose(x.grad().array(), expected, 1e-3));
+
+  // Gradients are accumulated in the same order across runs
+  auto grad = x.grad().array().copy();
+  for (int i = 0; i < 3; ++i) {
+    x.zeroGrad();
+    sum(x(idx, af::span), {0, 1}).backward();
+    ASSERT_EQ(af::sum<float>(af::abs(x.grad().array() - grad)), 0);
+  }
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   fl::init();
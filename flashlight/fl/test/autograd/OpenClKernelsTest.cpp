@@ -0,0 +1,524 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <functional>
+#include <tuple>
+#include <vector>
+
+#include <arrayfire.h>
+#include <gtest/gtest.h>
+
+#include "flashlight/fl/autograd/autograd.h"
+#include "flashlight/fl/common/Init.h"
+#include "flashlight/fl/common/common.h"
+
+using namespace fl;
+
+namespace {
+
+// The native kernels of the OpenCL backend run without gradient, and are
+// compared with the ArrayFire and autograd path run with gradient
+class OpenClKernelsTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    bool hasDevice = false;
+    try {
+      hasDevice = af::getActiveBackend() == AF_BACKEND_OPENCL &&
+          af::getDeviceCount() > 0;
+    } catch (const af::exception&) {
+    }
+    if (!hasDevice) {
+      GTEST_SKIP() << "OpenCL kernel tests require an OpenCL device";
+    }
+  }
+};
+
+struct ConvParams {
+  int wx, wy, sx, sy, px, py, dx, dy, groups, oc;
+  bool bias;
+};
+
+// Covers the kernel blocked over 4 output channels (oc / groups multiple of
+// 4) and the direct one
+const std::vector<ConvParams> kConvParams = {
+    {3, 3, 1, 1, 1, 1, 1, 1, 1, 8, true},
+    {3, 2, 2, 1, 0, 1, 1, 1, 1, 6, false},
+    {3, 3, 1, 2, 2, 1, 2, 1, 2, 8, true},
+    {1, 1, 1, 1, 0, 0, 1, 1, 4, 4, true},
+};
+
+Variable conv(
+    const ConvParams& p,
+    const Variable& input,
+    const Variable& weights,
+    const Variable& bias) {
+  return conv2d(
+      input,
+      weights,
+      p.bias ? bias : Variable(af::array(), false),
+      p.sx,
+      p.sy,
+      p.px,
+      p.py,
+      p.dx,
+      p.dy,
+      p.groups);
+}
+
+using JacobianFunc = std::function<Variable(Variable&)>;
+bool jacobianTestImpl(
+    const JacobianFunc& func,
+    Variable& input,
+    float precision = 1E-5,
+    float perturbation = 1E-4) {
+  auto fwdJacobian =
+      af::array(func(input).elements(), input.elements(), af::dtype::f32);
+
+  for (int i = 0; i < input.elements(); ++i) {
+    af::array orig = input.array()(i);
+    input.array()(i) = orig - perturbation;
+    auto outa = func(input).array();
+
+    input.array()(i) = orig + perturbation;
+    auto outb = func(input).array();
+    input.array()(i) = orig;
+
+    fwdJacobian(af::span, i) =
+        af::moddims((outb - outa), outa.elements()) * 0.5 / perturbation;
+  }
+
+  auto bwdJacobian =
+      af::array(func(input).elements(), input.elements(), af::dtype::f32);
+  auto dout =
+      Variable(af::constant(0, func(input).dims(), func(input).type()), false);
+  for (int i = 0; i < dout.elements(); ++i) {
+    dout.array()(i) = 1; // element in 1D view
+    input.zeroGrad();
+    auto out = func(input);
+    out.backward(dout);
+    bwdJacobian(i, af::span) =
+        af::moddims(input.grad().array(), input.elements());
+    dout.array()(i) = 0;
+  }
+  return allClose(fwdJacobian, bwdJacobian, precision);
+}
+
+const std::vector<RnnMode> kRnnModes = {
+    RnnMode::RELU,
+    RnnMode::TANH,
+    RnnMode::LSTM,
+    RnnMode::GRU};
+
+int numGates(RnnMode mode) {
+  return mode == RnnMode::LSTM ? 4 : mode == RnnMode::GRU ? 3 : 1;
+}
+
+// Size of the weights of an RNN in the cuDNN layout
+int numRnnParams(
+    RnnMode mode,
+    int inputSize,
+    int hiddenSize,
+    int numLayers,
+    bool bidirectional) {
+  int directions = bidirectional ? 2 : 1;
+  int gateSize = numGates(mode) * hiddenSize;
+  int size = 0;
+  for (int l = 0; l < numLayers; ++l) {
+    int layerInputSize = l == 0 ? inputSize : directions * hiddenSize;
+    size += directions * gateSize * (layerInputSize + hiddenSize + 2);
+  }
+  return size;
+}
+
+/**
+ * A single layer unidirectional RNN, computed step by step from the weights
+ * in the cuDNN layout: returns the output, and replaces the hidden state h
+ * (and cell state c for LSTM) by the last ones.
+ */
+af::array referenceRnn(
+    RnnMode mode,
+    const af::array& input,
+    const af::array& weights,
+    int hiddenSize,
+    af::array& h,
+    af::array& c) {
+  int inputSize = input.dims(0);
+  int batchSize = input.dims(1);
+  dim_t offset = 0;
+  auto take = [&](dim_t size) {
+    auto taken = weights(af::seq(offset, offset + size - 1));
+    offset += size;
+    return taken;
+  };
+  // The matrix of a gate is [hidden size, input size] in row major order,
+  // i.e. its transpose in column major order
+  std::vector<af::array> inputWeights, hiddenWeights, inputBias, hiddenBias;
+  for (int g = 0; g < numGates(mode); ++g) {
+    inputWeights.push_back(
+        af::moddims(take(hiddenSize * inputSize), inputSize, hiddenSize));
+  }
+  for (int g = 0; g < numGates(mode); ++g) {
+    hiddenWeights.push_back(
+        af::moddims(take(hiddenSize * hiddenSize), hiddenSize, hiddenSize));
+  }
+  for (int g = 0; g < numGates(mode); ++g) {
+    inputBias.push_back(af::tile(take(hiddenSize), 1, batchSize));
+  }
+  for (int g = 0; g < numGates(mode); ++g) {
+    hiddenBias.push_back(af::tile(take(hiddenSize), 1, batchSize));
+  }
+
+  h = af::moddims(h, hiddenSize, batchSize);
+  c = af::moddims(c, hiddenSize, batchSize);
+  std::vector<af::array> outputs;
+  for (int t = 0; t < input.dims(2); ++t) {
+    auto x = af::moddims(input(af::span, af::span, t), inputSize, batchSize);
+    std::vector<af::array> xg, hg;
+    for (int g = 0; g < numGates(mode); ++g) {
+      xg.push_back(af::matmulTN(inputWeights[g], x) + inputBias[g]);
+      hg.push_back(af::matmulTN(hiddenWeights[g], h) + hiddenBias[g]);
+    }
+    switch (mode) {
+      case RnnMode::LSTM:
+        c = af::sigmoid(xg[1] + hg[1]) * c +
+            af::sigmoid(xg[0] + hg[0]) * af::tanh(xg[2] + hg[2]);
+        h = af::sigmoid(xg[3] + hg[3]) * af::tanh(c);
+        break;
+      case RnnMode::GRU: {
+        auto reset = af::sigmoid(xg[0] + hg[0]);
+        auto update = af::sigmoid(xg[1] + hg[1]);
+        auto n = af::tanh(xg[2] + reset * hg[2]);
+        h = (1.0 - update) * n + update * h;
+        break;
+      }
+      case RnnMode::RELU:
+        h = af::max(xg[0] + hg[0], 0.0);
+        break;
+      default:
+        h = af::tanh(xg[0] + hg[0]);
+    }
+    outputs.push_back(af::moddims(h, hiddenSize, batchSize, 1));
+  }
+  h = af::moddims(h, hiddenSize, batchSize, 1);
+  c = af::moddims(c, hiddenSize, batchSize, 1);
+  auto output = outputs.front();
+  for (size_t t = 1; t < outputs.size(); ++t) {
+    output = af::join(2, output, outputs[t]);
+  }
+  return output;
+}
+
+std::tuple<Variable, Variable, Variable> runRnn(
+    RnnMode mode,
+    const af::array& input,
+    const af::array& hiddenState,
+    const af::array& cellState,
+    const af::array& weights,
+    int hiddenSize,
+    int numLayers,
+    bool bidirectional,
+    bool calcGrad) {
+  return rnn(
+      Variable(input, calcGrad),
+      Variable(hiddenState, calcGrad),
+      mode == RnnMode::LSTM ? Variable(cellState, calcGrad) : Variable(),
+      Variable(weights, calcGrad),
+      hiddenSize,
+      numLayers,
+      mode,
+      bidirectional,
+      0.0);
+}
+
+// The output and the last hidden (and cell) states of rnn()
+std::vector<af::array> rnnOutputs(
+    RnnMode mode,
+    const std::tuple<Variable, Variable, Variable>& out) {
+  std::vector<af::array> outputs = {
+      std::get<0>(out).array(), std::get<1>(out).array()};
+  if (mode == RnnMode::LSTM) {
+    outputs.push_back(std::get<2>(out).array());
+  }
+  return outputs;
+}
+
+} // namespace
+
+TEST_F(OpenClKernelsTest, Conv2D) {
+  auto input = af::randu(9, 11, 4, 2);
+  for (const auto& p : kConvParams) {
+    auto weights = af::randu(p.wx, p.wy, 4 / p.groups, p.oc);
+    auto bias = af::randu(1, 1, p.oc, 1);
+    auto native = conv(
+        p,
+        Variable(input, false),
+        Variable(weights, false),
+        Variable(bias, false));
+    auto reference = conv(
+        p,
+        Variable(input, true),
+        Variable(weights, true),
+        Variable(bias, true));
+    ASSERT_TRUE(allClose(native.array(), reference.array(), 1E-4));
+  }
+}
+
+TEST_F(OpenClKernelsTest, Conv2DF16) {
+  if (!fl::f16Supported()) {
+    GTEST_SKIP() << "Half-precision not supported on this device";
+  }
+  auto input = af::randu(5, 6, 4, 2);
+  for (const auto& p : kConvParams) {
+    auto weights = af::randu(p.wx, p.wy, 4 / p.groups, p.oc);
+    auto bias = af::randu(1, 1, p.oc, 1);
+    auto referenceInput = Variable(input, true);
+    auto referenceWeights = Variable(weights, true);
+    auto reference =
+        conv(p, referenceInput, referenceWeights, Variable(bias, true));
+
+    // Forward of the native kernels, in half
+    auto native = conv(
+        p,
+        Variable(input.as(f16), false),
+        Variable(weights.as(f16), false),
+        Variable(bias.as(f16), false));
+    ASSERT_EQ(native.type(), f16);
+    ASSERT_TRUE(allClose(native.array().as(f32), reference.array(), 5E-2));
+
+    // Training in half, computed in float
+    auto inputF16 = Variable(input.as(f16), true);
+    auto weightsF16 = Variable(weights.as(f16), true);
+    auto biasF16 = Variable(bias.as(f16), true);
+    auto output = conv(p, inputF16, weightsF16, biasF16);
+    ASSERT_EQ(output.type(), f16);
+    ASSERT_TRUE(allClose(output.array().as(f32), reference.array(), 5E-2));
+
+    auto grad = af::randu(reference.dims());
+    reference.backward(Variable(grad, false));
+    output.backward(Variable(grad.as(f16), false));
+    ASSERT_EQ(inputF16.grad().type(), f16);
+    ASSERT_TRUE(allClose(
+        inputF16.grad().array().as(f32),
+        referenceInput.grad().array(),
+        5E-2));
+    ASSERT_TRUE(allClose(
+        weightsF16.grad().array().as(f32),
+        referenceWeights.grad().array(),
+        5E-2));
+  }
+}
+
+TEST_F(OpenClKernelsTest, BatchNormEval) {
+  auto input = af::randu(5, 6, 3, 2);
+  for (const auto& axes : std::vector<std::vector<int>>{{2}, {0, 1, 2}}) {
+    int nFeat = 1;
+    for (int ax : axes) {
+      nFeat *= input.dims(ax);
+    }
+    auto mean = Variable(af::randu(nFeat), false);
+    auto var = Variable(af::randu(nFeat) + 0.5, false);
+    auto weight = af::randu(nFeat);
+    auto bias = af::randu(nFeat);
+    for (bool affine : {true, false}) {
+      auto native = batchnorm(
+          Variable(input, false),
+          affine ? Variable(weight, false) : Variable(),
+          affine ? Variable(bias, false) : Variable(),
+          mean,
+          var,
+          axes,
+          /* train = */ false,
+          0.0,
+          1E-5);
+      auto reference = batchnorm(
+          Variable(input, true),
+          affine ? Variable(weight, true) : Variable(),
+          affine ? Variable(bias, true) : Variable(),
+          mean,
+          var,
+          axes,
+          /* train = */ false,
+          0.0,
+          1E-5);
+      ASSERT_TRUE(allClose(native.array(), reference.array(), 1E-5));
+
+      if (fl::f16Supported()) {
+        auto meanF16 = Variable(mean.array().as(f16), false);
+        auto varF16 = Variable(var.array().as(f16), false);
+        auto nativeF16 = batchnorm(
+            Variable(input.as(f16), false),
+            affine ? Variable(weight.as(f16), false) : Variable(),
+            affine ? Variable(bias.as(f16), false) : Variable(),
+            meanF16,
+            varF16,
+            axes,
+            /* train = */ false,
+            0.0,
+            1E-5);
+        ASSERT_EQ(nativeF16.type(), f16);
+        ASSERT_TRUE(
+            allClose(nativeF16.array().as(f32), reference.array(), 1E-2));
+      }
+    }
+  }
+}
+
+TEST_F(OpenClKernelsTest, Rnn) {
+  int inputSize = 3;
+  int hiddenSize = 5;
+  int batchSize = 2;
+  int seqLength = 4;
+  auto input = af::randu(inputSize, batchSize, seqLength) - 0.5;
+  auto h0 = af::randu(hiddenSize, batchSize, 1) - 0.5;
+  auto c0 = af::randu(hiddenSize, batchSize, 1) - 0.5;
+  for (auto mode : kRnnModes) {
+    auto weights =
+        af::randu(numRnnParams(mode, inputSize, hiddenSize, 1, false)) - 0.5;
+    af::array hy = h0, cy = c0;
+    auto y = referenceRnn(mode, input, weights, hiddenSize, hy, cy);
+
+    // The native kernels, and the autograd path used for training
+    for (bool calcGrad : {false, true}) {
+      auto out = runRnn(
+          mode, input, h0, c0, weights, hiddenSize, 1, false, calcGrad);
+      ASSERT_TRUE(allClose(std::get<0>(out).array(), y, 1E-5));
+      ASSERT_TRUE(allClose(std::get<1>(out).array(), hy, 1E-5));
+      if (mode == RnnMode::LSTM) {
+        ASSERT_TRUE(allClose(std::get<2>(out).array(), cy, 1E-5));
+      }
+    }
+  }
+}
+
+TEST_F(OpenClKernelsTest, RnnBidirectionalLayers) {
+  int inputSize = 3;
+  int hiddenSize = 4;
+  int batchSize = 3;
+  int seqLength = 5;
+  int numLayers = 2;
+  auto input = af::randu(inputSize, batchSize, seqLength) - 0.5;
+  auto h0 = af::randu(hiddenSize, batchSize, numLayers * 2) - 0.5;
+  auto c0 = af::randu(hiddenSize, batchSize, numLayers * 2) - 0.5;
+  for (auto mode : kRnnModes) {
+    auto weights = af::randu(numRnnParams(
+                       mode, inputSize, hiddenSize, numLayers, true)) -
+        0.5;
+    auto native = runRnn(
+        mode, input, h0, c0, weights, hiddenSize, numLayers, true, false);
+    auto reference = runRnn(
+        mode, input, h0, c0, weights, hiddenSize, numLayers, true, true);
+    ASSERT_EQ(
+        std::get<0>(native).dims(),
+        af::dim4(2 * hiddenSize, batchSize, seqLength));
+    auto nativeOutputs = rnnOutputs(mode, native);
+    auto referenceOutputs = rnnOutputs(mode, reference);
+    for (size_t i = 0; i < nativeOutputs.size(); ++i) {
+      ASSERT_TRUE(allClose(nativeOutputs[i], referenceOutputs[i], 1E-5));
+    }
+  }
+}
+
+TEST_F(OpenClKernelsTest, RnnBackward) {
+  int inputSize = 2;
+  int hiddenSize = 2;
+  int batchSize = 2;
+  int seqLength = 3;
+  int numLayers = 2;
+  // Without ReLU, whose kinks the finite differences may cross
+  for (auto mode : {RnnMode::TANH, RnnMode::LSTM, RnnMode::GRU}) {
+    auto in = Variable(af::randu(inputSize, batchSize, seqLength) - 0.5, true);
+    auto w = Variable(
+        af::randu(numRnnParams(mode, inputSize, hiddenSize, numLayers, true)) -
+            0.5,
+        true);
+    auto hx = Variable(
+        af::randu(hiddenSize, batchSize, numLayers * 2) - 0.5, true);
+    auto cx = Variable(
+        af::randu(hiddenSize, batchSize, numLayers * 2) - 0.5, true);
+    auto run = [&](const Variable& input,
+                   const Variable& weights,
+                   const Variable& hiddenState,
+                   const Variable& cellState) {
+      return rnn(
+          input,
+          hiddenState,
+          mode == RnnMode::LSTM ? cellState : Variable(),
+          weights,
+          hiddenSize,
+          numLayers,
+          mode,
+          true,
+          0.0);
+    };
+
+    auto funcIn = [&](Variable& input) {
+      return std::get<0>(run(input, w, hx, cx));
+    };
+    ASSERT_TRUE(jacobianTestImpl(funcIn, in, 1E-3, 1E-2));
+    auto funcW = [&](Variable& weights) {
+      return std::get<0>(run(in, weights, hx, cx));
+    };
+    ASSERT_TRUE(jacobianTestImpl(funcW, w, 1E-3, 1E-2));
+    auto funcHx = [&](Variable& hiddenState) {
+      return std::get<1>(run(in, w, hiddenState, cx));
+    };
+    ASSERT_TRUE(jacobianTestImpl(funcHx, hx, 1E-3, 1E-2));
+    if (mode == RnnMode::LSTM) {
+      auto funcCx = [&](Variable& cellState) {
+        return std::get<2>(run(in, w, hx, cellState));
+      };
+      ASSERT_TRUE(jacobianTestImpl(funcCx, cx, 1E-3, 1E-2));
+    }
+  }
+}
+
+TEST_F(OpenClKernelsTest, RnnF16) {
+  if (!fl::f16Supported()) {
+    GTEST_SKIP() << "Half-precision not supported on this device";
+  }
+  int inputSize = 3;
+  int hiddenSize = 4;
+  int batchSize = 2;
+  int seqLength = 4;
+  int numLayers = 2;
+  auto input = af::randu(inputSize, batchSize, seqLength) - 0.5;
+  auto h0 = af::randu(hiddenSize, batchSize, numLayers * 2) - 0.5;
+  auto c0 = af::randu(hiddenSize, batchSize, numLayers * 2) - 0.5;
+  for (auto mode : kRnnModes) {
+    auto weights = af::randu(numRnnParams(
+                       mode, inputSize, hiddenSize, numLayers, true)) -
+        0.5;
+    auto referenceOutputs = rnnOutputs(
+        mode,
+        runRnn(
+            mode, input, h0, c0, weights, hiddenSize, numLayers, true, false));
+    // The native kernels and the autograd path, in half
+    for (bool calcGrad : {false, true}) {
+      auto out = runRnn(
+          mode,
+          input.as(f16),
+          h0.as(f16),
+          c0.as(f16),
+          weights.as(f16),
+          hiddenSize,
+          numLayers,
+          true,
+          calcGrad);
+      ASSERT_EQ(std::get<0>(out).type(), f16);
+      auto outputs = rnnOutputs(mode, out);
+      for (size_t i = 0; i < outputs.size(); ++i) {
+        ASSERT_TRUE(allClose(outputs[i].as(f32), referenceOutputs[i], 2E-2));
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  fl::init();
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <stdexcept>
+
+#include <arrayfire.h>
+#include <gtest/gtest.h>
+
+#include "flashlight/fl/common/Init.h"
+#include "flashlight/fl/common/backend/cuda/CudaGraph.h"
+
+using namespace fl;
+
+TEST(CudaGraphTest, InvalidArguments) {
+  ASSERT_THROW(cuda::CudaGraphStep(nullptr, {}), std::invalid_argument);
+  ASSERT_THROW(
+      cuda::CudaGraphStep([]() {}, {nullptr}), std::invalid_argument);
+}
+
+TEST(CudaGraphTest, ReplayMatchesEager) {
+  af::array input = af::randu(16, 8);
+  af::array weight = af::constant(1, 16, 8);
+  af::array output;
+  cuda::CudaGraphStep step(
+      [&]() {
+        output = input * weight + 1;
+        weight = weight + 1;
+      },
+      {&input, &weight, &output});
+
+  af::array expectedWeight = weight.copy();
+  for (int i = 0; i < 6; ++i) {
+    input = af::randu(16, 8);
+    af::array expected = input * expectedWeight + 1;
+    expectedWeight = expectedWeight + 1;
+    bool replayed = step.run();
+    ASSERT_EQ(replayed, i >= 2);
+    ASSERT_TRUE(af::allTrue<bool>(af::abs(output - expected) < 1e-5));
+    ASSERT_TRUE(af::allTrue<bool>(weight == expectedWeight));
+  }
+  ASSERT_EQ(step.numGraphs(), 1);
+
+  // New shapes are run eagerly before their own capture
+  input = af::randu(4, 8);
+  weight = af::constant(1, 4, 8);
+  ASSERT_FALSE(step.run());
+  ASSERT_TRUE(af::allTrue<bool>(af::abs(output - (input + 1)) < 1e-5));
+  ASSERT_EQ(step.numGraphs(), 1);
+}
+
+TEST(CudaGraphTest, HostSyncRunsEagerly) {
+  af::array input = af::randu(16);
+  af::array output;
+  cuda::CudaGraphStep step(
+      [&]() { output = input * af::sum<float>(input); }, {&input, &output}, 1);
+  for (int i = 0; i < 3; ++i) {
+    input = af::randu(16);
+    ASSERT_FALSE(step.run());
+    ASSERT_TRUE(af::allTrue<bool>(
+        af::abs(output - input * af::sum<float>(input)) < 1e-4));
+  }
+  ASSERT_EQ(step.numGraphs(), 0);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  fl::init();
+  return RUN_ALL_TESTS();
+}
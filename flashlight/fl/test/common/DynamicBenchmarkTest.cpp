@@ -7,6 +7,7 @@
  */
 
 #include <chrono>
+#include <cstdio>
 #include <memory>
 #include <thread>
 
@@ -14,6 +15,7 @@
 
 #include "flashlight/fl/common/DynamicBenchmark.h"
 #include "flashlight/fl/common/Init.h"
+#include "flashlight/lib/common/System.h"
 
 namespace {
 
@@ -145,6 +147,46 @@ TEST_F(DynamicBenchmark, DynamicBenchmarkMatmul) {
   ASSERT_EQ(ops->currentOption(), 4);
 }
 
+TEST_F(DynamicBenchmark, DynamicBenchmarkCache) {
+  size_t maxCount = 2;
+  std::vector<int> sleepTimes = {4, 1, 6};
+  const std::string path = fl::lib::getTmpPath("DynamicBenchmarkCache.txt");
+  std::remove(path.c_str());
+  fl::DynamicBenchmark::setCacheFile(path);
+
+  auto options =
+      std::make_shared<fl::DynamicBenchmarkOptions<int>>(sleepTimes, maxCount);
+  auto dynamicBench = std::make_shared<fl::DynamicBenchmark>(options, "sleep");
+  for (size_t i = 0; i < maxCount * sleepTimes.size(); ++i) {
+    std::chrono::milliseconds sleepTime(options->currentOption());
+    dynamicBench->audit(
+        [sleepTime]() { std::this_thread::sleep_for(sleepTime); });
+  }
+  ASSERT_TRUE(options->timingsComplete());
+  ASSERT_EQ(options->currentOption(), 1);
+
+  // A new process loads the optimal option without benchmarking
+  fl::DynamicBenchmark::setCacheFile(path);
+  auto cachedOptions =
+      std::make_shared<fl::DynamicBenchmarkOptions<int>>(sleepTimes, maxCount);
+  fl::DynamicBenchmark cachedBench(cachedOptions, "sleep");
+  ASSERT_TRUE(cachedOptions->timingsComplete());
+  ASSERT_EQ(cachedOptions->currentOption(), 1);
+
+  // Other keys are benchmarked
+  auto otherOptions =
+      std::make_shared<fl::DynamicBenchmarkOptions<int>>(sleepTimes, maxCount);
+  fl::DynamicBenchmark otherBench(otherOptions, "other");
+  ASSERT_FALSE(otherOptions->timingsComplete());
+
+  fl::DynamicBenchmark::setCacheFile("");
+  auto uncachedOptions =
+      std::make_shared<fl::DynamicBenchmarkOptions<int>>(sleepTimes, maxCount);
+  fl::DynamicBenchmark uncachedBench(uncachedOptions, "sleep");
+  ASSERT_FALSE(uncachedOptions->timingsComplete());
+  std::remove(path.c_str());
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   fl::init();
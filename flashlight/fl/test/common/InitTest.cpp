@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/fl/common/Init.h"
+
+using namespace fl;
+
+namespace {
+
+TEST(InitTest, PartitionCpus) {
+  std::vector<int> cpus = {0, 1, 2, 3, 4, 5, 6, 7};
+  // The computation takes the CPUs left
+  auto budget = partitionCpus(2, 1, 0, cpus);
+  ASSERT_EQ(budget.computeThreads, 5);
+  ASSERT_EQ(budget.computeCpus, std::vector<int>({0, 1, 2, 3, 4}));
+  ASSERT_EQ(budget.dataCpus, std::vector<int>({5, 6}));
+  ASSERT_EQ(budget.decoderCpus, std::vector<int>({7}));
+
+  budget = partitionCpus(2, 0, 4, cpus);
+  ASSERT_EQ(budget.computeCpus, std::vector<int>({0, 1, 2, 3}));
+  ASSERT_EQ(budget.dataCpus, std::vector<int>({4, 5}));
+  ASSERT_TRUE(budget.decoderCpus.empty());
+
+  // More threads than CPUs: shares in proportion to the threads
+  budget = partitionCpus(8, 4, 4, cpus);
+  ASSERT_EQ(budget.dataThreads, 8);
+  ASSERT_EQ(budget.computeCpus, std::vector<int>({0, 1}));
+  ASSERT_EQ(budget.dataCpus, std::vector<int>({2, 3, 4, 5}));
+  ASSERT_EQ(budget.decoderCpus, std::vector<int>({6, 7}));
+
+  budget = partitionCpus(30, 1, 0, cpus);
+  ASSERT_EQ(budget.computeThreads, 1);
+  ASSERT_EQ(budget.computeCpus.size(), 1u);
+  ASSERT_EQ(budget.decoderCpus.size(), 1u);
+  ASSERT_EQ(budget.dataCpus.size(), 6u);
+
+  // Fewer CPUs than pools: shared
+  budget = partitionCpus(1, 1, 1, {3, 5});
+  ASSERT_EQ(budget.computeCpus, std::vector<int>({3}));
+  ASSERT_EQ(budget.dataCpus, std::vector<int>({5}));
+  ASSERT_EQ(budget.decoderCpus, std::vector<int>({3}));
+
+  // The CPUs of the process
+  budget = partitionCpus(1, 0);
+  ASSERT_GE(budget.computeThreads, 1);
+
+  ASSERT_THROW(partitionCpus(-1, 0, 0, cpus), std::invalid_argument);
+}
+
+TEST(InitTest, SetThreadBudget) {
+  ASSERT_EQ(getThreadBudget().computeThreads, 0);
+  ASSERT_THROW(setThreadBudget(ThreadBudget()), std::invalid_argument);
+
+  ThreadBudget budget;
+  budget.computeThreads = 2;
+  budget.dataThreads = 1;
+  setThreadBudget(budget);
+  ASSERT_EQ(getThreadBudget().computeThreads, 2);
+  ASSERT_EQ(getThreadBudget().dataThreads, 1);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  fl::init();
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/fl/common/Init.h"
+#include "flashlight/fl/common/Metrics.h"
+
+using namespace fl;
+
+namespace {
+
+sockaddr_in localhost(int port) {
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  ::inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+  return addr;
+}
+
+std::string httpGet(int port, const std::string& path) {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  auto addr = localhost(port);
+  if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+    ::close(fd);
+    return "";
+  }
+  std::string request = "GET " + path + " HTTP/1.1\r\nHost: test\r\n\r\n";
+  ::send(fd, request.data(), request.size(), 0);
+  std::string response;
+  char buffer[1024];
+  ssize_t n;
+  while ((n = ::recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+    response.append(buffer, n);
+  }
+  ::close(fd);
+  return response;
+}
+
+} // namespace
+
+TEST(MetricsTest, Registry) {
+  MetricsRegistry registry;
+  auto& counter = registry.counter("samples_total", "Samples");
+  ASSERT_EQ(&registry.counter("samples_total", "Samples"), &counter);
+  ASSERT_THROW(
+      registry.gauge("samples_total", "Samples"), std::invalid_argument);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&counter]() {
+      for (int i = 0; i < 1000; ++i) {
+        counter.add(0.5);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(counter.value(), 2000);
+
+  auto& gauge = registry.gauge("memory_bytes", "Memory", {{"kind", "live"}});
+  registry.gauge("memory_bytes", "Memory", {{"kind", "cached"}}).set(2);
+  registry.addCollector([&gauge]() { gauge.set(7); });
+  auto& histogram = registry.histogram("step_seconds", "Steps", {0.1, 1});
+  histogram.observe(0.05);
+  histogram.observe(0.1);
+  histogram.observe(5);
+  ASSERT_THROW(MetricHistogram({1, 1}), std::invalid_argument);
+
+  auto samples = registry.collect();
+  ASSERT_EQ(samples.size(), 4);
+  ASSERT_EQ(samples[0].name, "memory_bytes");
+  ASSERT_EQ(samples[0].labels[0].second, "cached");
+  ASSERT_EQ(samples[0].value, 2);
+  ASSERT_EQ(samples[1].value, 7);
+  ASSERT_EQ(samples[2].name, "samples_total");
+  ASSERT_EQ(samples[3].type, MetricType::HISTOGRAM);
+  ASSERT_EQ(samples[3].histogram.counts, std::vector<uint64_t>({2, 0, 1}));
+  ASSERT_EQ(samples[3].histogram.count, 3);
+}
+
+TEST(MetricsTest, Prometheus) {
+  MetricsRegistry registry;
+  registry.setConstantLabels({{"rank", "1"}});
+  registry.counter("samples_total", "Samples").add(3);
+  registry.gauge("memory_bytes", "Memory", {{"kind", "a\"b"}}).set(1.5);
+  auto& histogram = registry.histogram("step_seconds", "Steps", {0.1, 1});
+  histogram.observe(0.05);
+  histogram.observe(0.5);
+  auto text = formatPrometheus(registry.collect());
+  ASSERT_EQ(
+      text,
+      "# HELP memory_bytes Memory\n"
+      "# TYPE memory_bytes gauge\n"
+      "memory_bytes{kind=\"a\\\"b\",rank=\"1\"} 1.5\n"
+      "# HELP samples_total Samples\n"
+      "# TYPE samples_total counter\n"
+      "samples_total{rank=\"1\"} 3\n"
+      "# HELP step_seconds Steps\n"
+      "# TYPE step_seconds histogram\n"
+      "step_seconds_bucket{rank=\"1\",le=\"0.1\"} 1\n"
+      "step_seconds_bucket{rank=\"1\",le=\"1\"} 2\n"
+      "step_seconds_bucket{rank=\"1\",le=\"+Inf\"} 2\n"
+      "step_seconds_sum{rank=\"1\"} 0.55\n"
+      "step_seconds_count{rank=\"1\"} 2\n");
+
+  MetricsServer server(0, registry);
+  auto response = httpGet(server.port(), "/metrics");
+  ASSERT_EQ(response.find("HTTP/1.1 200 OK\r\n"), 0);
+  ASSERT_NE(response.find("\r\n\r\n" + text), std::string::npos);
+  ASSERT_EQ(httpGet(server.port(), "/").find("HTTP/1.1 404"), 0);
+}
+
+TEST(MetricsTest, Statsd) {
+  int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+  auto addr = localhost(0);
+  socklen_t addrLen = sizeof(addr);
+  ASSERT_EQ(::bind(fd, reinterpret_cast<sockaddr*>(&addr), addrLen), 0);
+  ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &addrLen);
+  auto receive = [fd]() {
+    char buffer[2048];
+    auto n = ::recv(fd, buffer, sizeof(buffer), 0);
+    return std::string(buffer, std::max<ssize_t>(n, 0));
+  };
+
+  MetricsRegistry registry;
+  registry.setConstantLabels({{"rank", "0"}});
+  auto& counter = registry.counter("samples_total", "Samples");
+  counter.add(3);
+  registry.gauge("memory_bytes", "Memory").set(2);
+  registry.histogram("step_seconds", "Steps").observe(0.5);
+  {
+    StatsdExporter exporter(
+        "127.0.0.1", ntohs(addr.sin_port), "fl.", 60000, registry);
+    exporter.flush();
+    ASSERT_EQ(
+        receive(),
+        "fl.memory_bytes:2|g|#rank:0\n"
+        "fl.samples_total:3|c|#rank:0\n"
+        "fl.step_seconds.count:1|c|#rank:0\n"
+        "fl.step_seconds.sum:0.5|c|#rank:0");
+    // Increments since the last push, on destruction
+    counter.add(2);
+  }
+  ASSERT_EQ(
+      receive(),
+      "fl.memory_bytes:2|g|#rank:0\n"
+      "fl.samples_total:2|c|#rank:0");
+  ::close(fd);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  fl::init();
+  return RUN_ALL_TESTS();
+}
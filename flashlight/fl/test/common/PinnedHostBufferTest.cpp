@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/fl/common/Init.h"
+#include "flashlight/fl/common/PinnedHostBuffer.h"
+
+using namespace fl;
+
+TEST(PinnedHostBufferTest, Empty) {
+  PinnedHostBuffer empty;
+  ASSERT_EQ(empty.get(), nullptr);
+  ASSERT_EQ(empty.bytes(), 0);
+  PinnedHostBuffer zero(0);
+  ASSERT_EQ(zero.get(), nullptr);
+}
+
+TEST(PinnedHostBufferTest, Move) {
+  PinnedHostBuffer buffer(1024);
+  ASSERT_NE(buffer.get(), nullptr);
+  ASSERT_EQ(buffer.bytes(), 1024);
+  void* ptr = buffer.get();
+
+  PinnedHostBuffer moved(std::move(buffer));
+  ASSERT_EQ(moved.get(), ptr);
+  ASSERT_EQ(buffer.get(), nullptr);
+  ASSERT_EQ(buffer.bytes(), 0);
+
+  PinnedHostBuffer other(512);
+  other = std::move(moved);
+  ASSERT_EQ(other.get(), ptr);
+  ASSERT_EQ(other.bytes(), 1024);
+  ASSERT_EQ(moved.get(), nullptr);
+}
+
+TEST(PinnedHostBufferTest, CopyToHost) {
+  auto a = af::randu(17, 33);
+  PinnedHostBuffer buffer(a.bytes());
+  a.host(buffer.get());
+  std::vector<float> expected(a.elements());
+  a.host(expected.data());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    ASSERT_EQ(buffer.getAs<float>()[i], expected[i]);
+  }
+
+  std::vector<float> copied(a.elements());
+  copyToHostPinned(a, copied.data());
+  ASSERT_EQ(copied, expected);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  fl::init();
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <array>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/fl/common/SmallFunction.h"
+
+using namespace fl;
+
+namespace {
+
+int twice(int x) {
+  return 2 * x;
+}
+
+} // namespace
+
+TEST(SmallFunctionTest, Empty) {
+  SmallFunction<int(int)> empty;
+  ASSERT_FALSE(empty);
+  ASSERT_THROW(empty(1), std::bad_function_call);
+  ASSERT_FALSE(SmallFunction<int(int)>(nullptr));
+  int (*null)(int) = nullptr;
+  ASSERT_FALSE(SmallFunction<int(int)>(null));
+  ASSERT_FALSE(SmallFunction<int(int)>(std::function<int(int)>()));
+
+  SmallFunction<int(int)> fn = twice;
+  ASSERT_TRUE(fn);
+  fn = nullptr;
+  ASSERT_FALSE(fn);
+}
+
+TEST(SmallFunctionTest, InlineAndHeap) {
+  std::array<int, 4> small = {1, 2, 3, 4};
+  std::array<int, 64> large;
+  large.fill(1);
+  auto smallFn = [small](int x) { return x + small[3]; };
+  auto largeFn = [large](int x) { return x + large[63]; };
+  using Fn = SmallFunction<int(int), 32>;
+  ASSERT_TRUE(Fn::isInline<decltype(smallFn)>());
+  ASSERT_FALSE(Fn::isInline<decltype(largeFn)>());
+
+  for (auto fn : std::vector<Fn>{smallFn, largeFn, twice}) {
+    ASSERT_TRUE(fn);
+    auto expected = fn(3);
+    Fn copy(fn);
+    ASSERT_EQ(copy(3), expected);
+    Fn moved(std::move(copy));
+    ASSERT_FALSE(copy);
+    ASSERT_EQ(moved(3), expected);
+    Fn assigned;
+    assigned = moved;
+    ASSERT_EQ(assigned(3), expected);
+    assigned = std::move(moved);
+    ASSERT_FALSE(moved);
+    ASSERT_EQ(assigned(3), expected);
+  }
+  ASSERT_EQ(Fn(smallFn)(1), 5);
+  ASSERT_EQ(Fn(largeFn)(1), 2);
+}
+
+TEST(SmallFunctionTest, References) {
+  SmallFunction<void(std::vector<int>&, const int&)> push =
+      [](std::vector<int>& values, const int& value) {
+        values.push_back(value);
+      };
+  std::vector<int> values;
+  push(values, 1);
+  push(values, 2);
+  ASSERT_EQ(values, (std::vector<int>{1, 2}));
+}
+
+TEST(SmallFunctionTest, Lifetime) {
+  auto counter = std::make_shared<int>(0);
+  {
+    SmallFunction<void()> fn = [counter]() { ++*counter; };
+    ASSERT_EQ(counter.use_count(), 2);
+    auto copy = fn;
+    ASSERT_EQ(counter.use_count(), 3);
+    copy();
+    fn = nullptr;
+    ASSERT_EQ(counter.use_count(), 2);
+    // Mutable callables can be called through a const function
+    int calls = 0;
+    const SmallFunction<int()> mutableFn = [calls]() mutable {
+      return ++calls;
+    };
+    mutableFn();
+    ASSERT_EQ(mutableFn(), 2);
+  }
+  ASSERT_EQ(counter.use_count(), 1);
+  ASSERT_EQ(*counter, 1);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/fl/common/Init.h"
+#include "flashlight/fl/common/threadpool/ThreadAffinity.h"
+#include "flashlight/fl/common/threadpool/WorkStealingThreadPool.h"
+
+using namespace fl;
+
+namespace {
+
+TEST(WorkStealingThreadPoolTest, Enqueue) {
+  WorkStealingThreadPool pool(4);
+  std::vector<std::future<int>> results;
+  for (int i = 0; i < 100; ++i) {
+    results.push_back(pool.enqueue([](int x) { return 2 * x; }, i));
+  }
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_EQ(results[i].get(), 2 * i);
+  }
+}
+
+TEST(WorkStealingThreadPoolTest, EnqueueBulk) {
+  WorkStealingThreadPool pool(3);
+  std::atomic<int> calls{0};
+  auto results = pool.enqueueBulk(1000, [&calls](size_t i) {
+    ++calls;
+    return i * i;
+  });
+  ASSERT_EQ(results.size(), 1000u);
+  for (size_t i = 0; i < results.size(); ++i) {
+    ASSERT_EQ(results[i].get(), i * i);
+  }
+  ASSERT_EQ(calls, 1000);
+  ASSERT_TRUE(pool.enqueueBulk(0, [](size_t i) { return i; }).empty());
+}
+
+TEST(WorkStealingThreadPoolTest, EnqueueBulkFromWorker) {
+  WorkStealingThreadPool pool(2);
+  auto sum = pool.enqueue([&pool]() {
+    // Nested tasks are stolen by the other worker, or run after this one
+    auto results = pool.enqueueBulk(10, [](size_t i) { return i; });
+    return results.size();
+  });
+  ASSERT_EQ(sum.get(), 10u);
+}
+
+TEST(WorkStealingThreadPoolTest, Affinity) {
+  for (auto affinity : {ThreadAffinity::Cpu, ThreadAffinity::NumaNode}) {
+    size_t numThreads = 2 * std::thread::hardware_concurrency() + 1;
+    auto placements = detail::placeWorkers(affinity, numThreads);
+    ASSERT_EQ(placements.size(), numThreads);
+
+    WorkStealingThreadPool pool(numThreads, nullptr, affinity);
+    auto results = pool.enqueueBulk(4 * numThreads, [](size_t i) { return i; });
+    for (size_t i = 0; i < results.size(); ++i) {
+      ASSERT_EQ(results[i].get(), i);
+    }
+  }
+  ASSERT_TRUE(detail::placeWorkers(ThreadAffinity::None, 4)[0].cpus.empty());
+
+  // On the CPUs of a pool
+  auto cpus = detail::allowedCpus();
+  if (!cpus.empty()) {
+    std::vector<int> pool = {cpus.back()};
+    auto placements = detail::placeWorkers(ThreadAffinity::None, 2, pool);
+    ASSERT_EQ(placements[1].cpus, pool);
+    placements = detail::placeWorkers(ThreadAffinity::Cpu, 2, pool);
+    ASSERT_EQ(placements[0].cpus, pool);
+    ASSERT_EQ(placements[1].cpus, pool);
+  }
+}
+
+TEST(WorkStealingThreadPoolTest, ThreadAffinityFromString) {
+  ASSERT_EQ(threadAffinityFromString("none"), ThreadAffinity::None);
+  ASSERT_EQ(threadAffinityFromString("cpu"), ThreadAffinity::Cpu);
+  ASSERT_EQ(threadAffinityFromString("numa"), ThreadAffinity::NumaNode);
+  ASSERT_THROW(threadAffinityFromString("socket"), std::invalid_argument);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  fl::init();
+  return RUN_ALL_TESTS();
+}
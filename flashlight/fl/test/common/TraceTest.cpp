@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/fl/common/Init.h"
+#include "flashlight/fl/common/Trace.h"
+#include "flashlight/lib/common/System.h"
+
+using namespace fl;
+
+namespace {
+
+std::string dumpTrace(const std::string& name) {
+  const std::string path = fl::lib::getTmpPath(name);
+  Tracer::dump(path);
+  std::ifstream file(path);
+  std::stringstream ss;
+  ss << file.rdbuf();
+  return ss.str();
+}
+
+int countOf(const std::string& str, const std::string& pattern) {
+  int count = 0;
+  for (auto pos = str.find(pattern); pos != std::string::npos;
+       pos = str.find(pattern, pos + 1)) {
+    ++count;
+  }
+  return count;
+}
+
+} // namespace
+
+TEST(TraceTest, Disabled) {
+  Tracer::start();
+  Tracer::stop();
+  ASSERT_FALSE(Tracer::enabled(TraceCategory::USER));
+  {
+    FL_TRACE(USER, "ignored");
+  }
+  ASSERT_EQ(countOf(dumpTrace("trace_disabled.json"), "ignored"), 0);
+}
+
+TEST(TraceTest, Categories) {
+  TraceOptions options;
+  options.categories = static_cast<uint32_t>(TraceCategory::DATA);
+  Tracer::start(options);
+  ASSERT_TRUE(Tracer::enabled(TraceCategory::DATA));
+  ASSERT_FALSE(Tracer::enabled(TraceCategory::AUTOGRAD));
+  {
+    FL_TRACE(DATA, "recorded");
+    FL_TRACE(AUTOGRAD, "filtered");
+  }
+  Tracer::stop();
+  auto trace = dumpTrace("trace_categories.json");
+  ASSERT_EQ(countOf(trace, "\"recorded\""), 1);
+  ASSERT_EQ(countOf(trace, "\"cat\": \"data\""), 1);
+  ASSERT_EQ(countOf(trace, "filtered"), 0);
+}
+
+TEST(TraceTest, Threads) {
+  Tracer::start();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([t]() {
+      Tracer::setThreadName("worker " + std::to_string(t));
+      for (int i = 0; i < 10; ++i) {
+        FL_TRACE(USER, "work");
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  Tracer::stop();
+  auto trace = dumpTrace("trace_threads.json");
+  ASSERT_EQ(countOf(trace, "\"work\""), 40);
+  for (int t = 0; t < 4; ++t) {
+    ASSERT_EQ(countOf(trace, "\"worker " + std::to_string(t) + "\""), 1);
+  }
+  ASSERT_EQ(trace.find("{\"traceEvents\": ["), 0);
+}
+
+TEST(TraceTest, RingBuffer) {
+  TraceOptions options;
+  options.eventsPerThread = 8;
+  Tracer::start(options);
+  for (int i = 0; i < 20; ++i) {
+    FL_TRACE(USER, i < 12 ? "old" : "new");
+  }
+  Tracer::stop();
+  auto trace = dumpTrace("trace_ring.json");
+  ASSERT_EQ(countOf(trace, "\"old\""), 0);
+  ASSERT_EQ(countOf(trace, "\"new\""), 8);
+
+  // A new recording drops the previous one
+  Tracer::start(options);
+  Tracer::stop();
+  ASSERT_EQ(countOf(dumpTrace("trace_restart.json"), "\"new\""), 0);
+
+  options.eventsPerThread = 0;
+  ASSERT_THROW(Tracer::start(options), std::invalid_argument);
+}
+
+TEST(TraceTest, Intern) {
+  Tracer::start();
+  {
+    std::string name = "dynamic \"name\"";
+    FL_TRACE(USER, Tracer::intern(name));
+  }
+  Tracer::stop();
+  ASSERT_EQ(Tracer::intern("a"), Tracer::intern(std::string("a")));
+  auto trace = dumpTrace("trace_intern.json");
+  ASSERT_EQ(countOf(trace, "\"dynamic \\\"name\\\"\""), 1);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  fl::init();
+  return RUN_ALL_TESTS();
+}
@@ -130,6 +130,24 @@ TEST(ContribModuleTest, AsymmetricConv1DFwd) {
   ASSERT_FALSE(allClose(output, outputFuture));
 }
 
+TEST(ContribModuleTest, AsymmetricConv1DDepthwiseFwd) {
+  int timesteps = 20, c = 6;
+  auto input = Variable(af::randu(timesteps, 1, c, 3), false);
+  for (float futurePart : {0.0, 1.0}) {
+    // Depthwise: padded on a single side by the depthwise kernels
+    auto conv = AsymmetricConv1D(c, 2 * c, 5, 1, -1, futurePart, 1, true, c);
+    auto output = conv.forward(input);
+    ASSERT_EQ(output.dims(), af::dim4(timesteps, 1, 2 * c, 3));
+
+    // The same convolution padded on both sides, and cut
+    auto expected =
+        conv2d(input, conv.param(0), conv.param(1), 1, 1, 4, 0, 1, 1, c);
+    expected = futurePart == 0 ? expected.rows(0, timesteps - 1)
+                               : expected.rows(4, timesteps + 3);
+    ASSERT_TRUE(allClose(output, expected, 1E-5));
+  }
+}
+
 TEST(ContribModuleTest, TransformerPadMaskFwd) {
   int timesteps = 10;
   int c = 4;
@@ -167,6 +185,32 @@ TEST(ContribModuleTest, TransformerPadMaskFwd) {
       output1.array()));
 }
 
+TEST(ContribModuleTest, TransformerSegmentsFwd) {
+  int timesteps = 10;
+  int c = 4;
+  int nheads = 2;
+
+  auto tr = Transformer(c, c / nheads, c, nheads, timesteps, 0, 0, true, false);
+  auto input = Variable(af::randu(c, timesteps, 2, 1), false);
+  // Two segments packed in the first sample, then padding
+  std::vector<int> segmentIds = {1, 1, 1, 1, 2, 2, 2, 2, 2, 0};
+  auto segments = af::constant(1, af::dim4(timesteps, 2), af::dtype::s32);
+  segments.col(0) = af::array(timesteps, segmentIds.data());
+
+  auto output = tr.forward({input, Variable(segments, false)}).front();
+  ASSERT_EQ(output.dims(0), c);
+  ASSERT_EQ(output.dims(1), timesteps);
+  ASSERT_EQ(output.dims(2), 2);
+
+  auto sample = input.slice(0);
+  auto output1 = tr.forward({sample.cols(0, 3), Variable()}).front();
+  auto output2 = tr.forward({sample.cols(4, 8), Variable()}).front();
+  auto output3 = tr.forward({input.slice(1), Variable()}).front();
+  ASSERT_TRUE(allClose(output.slice(0).cols(0, 3), output1, 1e-5));
+  ASSERT_TRUE(allClose(output.slice(0).cols(4, 8), output2, 1e-5));
+  ASSERT_TRUE(allClose(output.slice(1), output3, 1e-5));
+}
+
 TEST_F(ContribModuleTestF16, TransformerPadMaskFwd16) {
   if (!fl::f16Supported()) {
     GTEST_SKIP() << "Half-precision not supported on this device";
@@ -231,6 +275,112 @@ TEST(ContribModuleTest, TransformerFwd) {
   ASSERT_EQ(output[0].dims(2), batchsize);
 }
 
+TEST(ContribModuleTest, TransformerAttentionWindow) {
+  int c = 16, nheads = 2, timesteps = 30, batchsize = 2;
+  auto tr = Transformer(c, c / nheads, c, nheads, timesteps, 0.0, 0.0);
+  tr.eval();
+  auto input = Variable(af::randu(c, timesteps, batchsize), false);
+  auto full = tr.forward({input, Variable()}).front();
+  tr.setAttentionWindow({timesteps, timesteps, 0});
+  ASSERT_TRUE(allClose(tr.forward({input, Variable()}).front(), full, 1e-5));
+
+  // Changing a position only changes the outputs of the positions whose
+  // window contains it, and all of them with a global position
+  auto changed = input.array();
+  changed(af::span, 0, af::span) = 0;
+  changed(af::span, 15, af::span) = 0;
+  auto changes = [&](const AttentionWindow& window) {
+    tr.setAttentionWindow(window);
+    auto delta = af::abs(
+        tr.forward({Variable(changed, false), Variable()}).front().array() -
+        tr.forward({input, Variable()}).front().array());
+    return af::flat(af::anyTrue(af::max(delta, 2) > 1e-5, 0));
+  };
+  auto local = changes({2, 1, 0});
+  auto expected = af::constant(0, timesteps, b8);
+  expected(af::seq(0, 2)) = 1;
+  expected(af::seq(14, 17)) = 1;
+  ASSERT_TRUE(af::allTrue<bool>(local == expected));
+  ASSERT_TRUE(af::allTrue<bool>(changes({2, 1, 1})));
+  ASSERT_EQ(tr.attentionWindow().numGlobal, 1);
+  ASSERT_THROW(tr.setAttentionWindow({2, 1, -1}), std::invalid_argument);
+}
+
+TEST(ContribModuleTest, TransformerLayerDrop) {
+  int c = 16, nheads = 2, timesteps = 10;
+  auto input = Variable(af::randu(c, timesteps, 3), true);
+
+  // A dropped layer skips its branches, whose parameters get no gradient
+  auto preLN = Transformer(
+      c, c / nheads, c, nheads, timesteps, 0, 1, false, /* preLN = */ true);
+  preLN.train();
+  auto output = preLN.forward({input, Variable()}).front();
+  ASSERT_TRUE(allClose(output.array(), input.array()));
+  output.backward();
+  for (const auto& param : preLN.params()) {
+    ASSERT_FALSE(param.isGradAvailable());
+  }
+
+  auto postLN = Transformer(c, c / nheads, c, nheads, timesteps, 0, 1);
+  postLN.train();
+  output = postLN.forward({input, Variable()}).front();
+  output.backward();
+  ASSERT_FALSE(postLN.param(0).isGradAvailable());
+  auto conformer = Conformer(c, c / nheads, c, nheads, timesteps, 3, 0, 1);
+  conformer.train();
+  output = conformer.forward({input, Variable()}).front();
+  output.backward();
+  ASSERT_FALSE(conformer.param(0).isGradAvailable());
+
+  // Layers are kept in evaluation mode
+  postLN.eval();
+  output = postLN.forward({input, Variable()}).front();
+  output.backward();
+  ASSERT_TRUE(postLN.param(0).isGradAvailable());
+}
+
+TEST(ContribModuleTest, TransformerIncremental) {
+  int batchsize = 3;
+  int timesteps = 12;
+  int c = 16;
+  int nheads = 2;
+
+  auto tr = Transformer(c, c / nheads, c, nheads, timesteps, 0.2, 0, true);
+  tr.eval();
+  auto input = Variable(af::randu(c, timesteps, batchsize), false);
+  auto expected = tr.forward({input, Variable()}).front();
+
+  // Position by position
+  TransformerKVCache cache;
+  for (int t = 0; t < timesteps; ++t) {
+    auto output = tr.forwardIncremental(input.cols(t, t), cache);
+    ASSERT_EQ(cache.length(), t + 1);
+    ASSERT_TRUE(allClose(output, expected.cols(t, t), 1e-5));
+  }
+
+  // Chunks of positions
+  TransformerKVCache chunkCache;
+  auto first = tr.forwardIncremental(input.cols(0, 4), chunkCache);
+  auto second =
+      tr.forwardIncremental(input.cols(5, timesteps - 1), chunkCache);
+  ASSERT_TRUE(allClose(first, expected.cols(0, 4), 1e-5));
+  ASSERT_TRUE(allClose(second, expected.cols(5, timesteps - 1), 1e-5));
+
+  // Hypotheses continued from reordered parents
+  std::vector<int> parents = {2, 0, 2};
+  auto reordered = cache.gather(af::array(parents.size(), parents.data()));
+  ASSERT_EQ(reordered.length(), timesteps);
+  auto next = Variable(af::randu(c, 1, batchsize), false);
+  auto output = tr.forwardIncremental(next, reordered);
+  for (int b = 0; b < batchsize; ++b) {
+    auto single = cache.slice(parents[b]);
+    auto singleOutput = tr.forwardIncremental(next.slice(b), single);
+    ASSERT_TRUE(allClose(output.slice(b), singleOutput, 1e-5));
+  }
+  auto joined = TransformerKVCache::batch({&cache, &reordered});
+  ASSERT_EQ(joined.keys.dims(2), 2 * batchsize);
+}
+
 TEST_F(ContribModuleTestF16, TransformerFwdF16) {
   if (!fl::f16Supported()) {
     GTEST_SKIP() << "Half-precision not supported on this device";
@@ -301,6 +451,57 @@ TEST_F(ContribModuleTestF16, ConformerFwdF16) {
   ASSERT_EQ(output[0].dims(2), batchsize);
 }
 
+TEST(ContribModuleTest, ConformerForwardChunk) {
+  int batchsize = 2;
+  int timesteps = 20;
+  int c = 16;
+  int nheads = 2;
+  int kernelSize = 5;
+
+  auto cfr =
+      Conformer(c, c / nheads, c, nheads, timesteps, kernelSize, 0.2, 0.1);
+  cfr.eval();
+  ASSERT_EQ(cfr.streamingLeftContext(), timesteps - 1);
+  auto input = Variable(af::randu(c, timesteps, batchsize), false);
+  auto expected = cfr.forward({input, Variable()}).front();
+
+  // A single chunk attends to the whole input, the output is delayed by the
+  // right padding of the depthwise convolution
+  int delay = kernelSize / 2;
+  auto output = cfr.forwardChunk({input}).front();
+  ASSERT_EQ(output.dims(1), timesteps - delay);
+  ASSERT_TRUE(allClose(output, expected.cols(0, timesteps - 1 - delay), 1e-5));
+
+  // Chunks attend to a limited left context
+  cfr.resetStreamingState();
+  cfr.setStreamingLeftContext(4);
+  ASSERT_TRUE(cfr.forwardChunk({input.cols(0, delay - 1)}).front().isempty());
+  int outputSteps = 0;
+  for (int t = delay; t < timesteps; t += 5) {
+    auto chunk = input.cols(t, std::min(t + 4, timesteps - 1));
+    auto chunkOutput = cfr.forwardChunk({chunk}).front();
+    ASSERT_EQ(chunkOutput.dims(1), chunk.dims(1));
+    outputSteps += chunkOutput.dims(1);
+  }
+  ASSERT_EQ(outputSteps, timesteps - delay);
+  ASSERT_THROW(cfr.setStreamingLeftContext(timesteps), std::invalid_argument);
+}
+
+TEST(ContribModuleTest, ConformerAttentionWindow) {
+  int c = 16, nheads = 2, timesteps = 20, batchsize = 2;
+  auto cfr = Conformer(c, c / nheads, c, nheads, timesteps, 3, 0.0);
+  cfr.eval();
+  auto input = Variable(af::randu(c, timesteps, batchsize), false);
+  auto padMask = Variable(af::constant(1, timesteps, batchsize), false);
+  auto full = cfr.forward({input, padMask}).front();
+  cfr.setAttentionWindow({timesteps, timesteps, 0});
+  ASSERT_TRUE(allClose(cfr.forward({input, padMask}).front(), full, 1e-5));
+  cfr.setAttentionWindow({3, 0, 0});
+  auto local = cfr.forward({input, padMask}).front();
+  ASSERT_EQ(local.dims(), full.dims());
+  ASSERT_FALSE(allClose(local, full, 1e-5));
+}
+
 TEST(ContribModuleTest, PositionEmbeddingFwd) {
   int batchsize = 10;
   int timesteps = 120;
@@ -392,6 +593,22 @@ TEST(ContribModuleTest, AdaptiveEmbedding) {
   ASSERT_EQ(output.dims(0), dim);
   ASSERT_EQ(output.dims(1), T);
   ASSERT_EQ(output.dims(2), B);
+
+  // sparse gradients of the embeddings match the dense ones
+  auto sparseEmb = AdaptiveEmbedding(dim, cutoff, 4, true);
+  for (int i = 0; i < emb.params().size(); i++) {
+    sparseEmb.setParams(Variable(emb.param(i).array(), true), i);
+  }
+  auto sparseOutput = sparseEmb.forward(input);
+  ASSERT_TRUE(allClose(sparseOutput.array(), output.array()));
+  output.backward();
+  sparseOutput.backward();
+  for (int i = 0; i < emb.params().size(); i++) {
+    // embeddings are the even parameters
+    ASSERT_EQ(sparseEmb.param(i).isGradSparse(), i % 2 == 0);
+    ASSERT_TRUE(allClose(
+        sparseEmb.param(i).grad().array(), emb.param(i).grad().array(), 1e-5));
+  }
 }
 
 TEST(ContribModuleTest, TDSFwd) {
@@ -430,6 +647,37 @@ TEST(ContribModuleTest, StreamingTDSFwd) {
   ASSERT_EQ(output.dims(2), c);
 }
 
+TEST(ContribModuleTest, TDSForwardChunk) {
+  int batchsize = 2;
+  int timesteps = 30;
+  int w = 4;
+  int c = 6;
+  int kw = 7;
+
+  for (int rPad : {-1, 2}) {
+    auto tds = TDSBlock(
+        c, kw, w, 0 /* dropout */, 0 /* innerLinearDim */, rPad, false);
+    tds.eval();
+    auto input = Variable(af::randu(timesteps, w, c, batchsize), false);
+    auto expected = tds.forward({input})[0];
+
+    int delay = rPad == -1 ? kw / 2 : rPad;
+    std::vector<Variable> outputs;
+    for (int t = 0; t < timesteps; t += 4) {
+      auto chunk = input.rows(t, std::min(t + 3, timesteps - 1));
+      auto output = tds.forwardChunk({chunk})[0];
+      if (!output.isempty()) {
+        outputs.push_back(output);
+      }
+    }
+    auto streamed = concatenate(outputs, 0);
+    ASSERT_EQ(streamed.dims(0), timesteps - delay);
+    ASSERT_TRUE(
+        allClose(streamed, expected.rows(0, timesteps - 1 - delay), 1e-5));
+    tds.resetStreamingState();
+  }
+}
+
 TEST(ContribModuleTest, SpecAugmentFwd) {
   SpecAugment specAug(0, 27, 2, 100, 0.2, 2);
   int T = 512, F = 80;
@@ -470,6 +718,7 @@ TEST(ContribModuleTest, SpecAugmentFwd) {
 
 TEST(ContribModuleTest, RawWavSpecAugmentFwd) {
   // no time, only freq masking
+  int numFiltered = 0;
   for (int nmask = 1; nmask < 3; nmask++) {
     RawWavSpecAugment specAug(
         0, 1, nmask, 0, 0, 0, 1, 2000, 6000, 16000, 20000);
@@ -484,14 +733,181 @@ TEST(ContribModuleTest, RawWavSpecAugmentFwd) {
     inputWav = af::tile(inputWav, 1, C, B);
     finalWav = af::tile(finalWav, 1, C, B);
 
-    auto filteredWav = specAug(fl::Variable(inputWav, false));
+    auto filteredWav = specAug(fl::Variable(inputWav, false)).array();
     // compare middle of filtered wave to avoid edge artifacts comparison
     int halfKernelWidth = 63;
-    ASSERT_TRUE(fl::allClose(
-        fl::Variable(
-            finalWav.rows(halfKernelWidth, T - halfKernelWidth - 1), false),
-        filteredWav.rows(halfKernelWidth, T - halfKernelWidth - 1),
-        1e-3));
+    auto middle = af::seq(halfKernelWidth, T - halfKernelWidth - 1);
+    // masks are drawn for each sample: its band is either removed or kept
+    for (int b = 0; b < B; ++b) {
+      auto filtered = filteredWav(middle, af::span, b);
+      if (!fl::allClose(filtered, inputWav(middle, af::span, b), 1e-3)) {
+        ASSERT_TRUE(
+            fl::allClose(filtered, finalWav(middle, af::span, b), 1e-3));
+        ++numFiltered;
+      }
+    }
+  }
+  ASSERT_GT(numFiltered, 0);
+}
+
+TEST(ContribModuleTest, SpecAugmentBatchFwd) {
+  // no freq, only time masking
+  SpecAugment specAug(0, 0, 0, 100, 1.0, 2);
+  specAug.train();
+  int T = 200, F = 8, B = 6;
+  auto input = Variable(af::randu(T, F, 1, B) + 1, false);
+  std::vector<float> sizes = {200, 100, 50, 200, 150, 20};
+  auto inputSizes = Variable(af::array(1, B, sizes.data()), false);
+
+  auto output = specAug.forward({input, inputSizes}).front().array();
+  ASSERT_EQ(output.dims(), input.dims());
+  auto masked = af::allTrue(output == 0, 1);
+  auto kept = af::allTrue(output == input.array(), 1);
+  ASSERT_TRUE(af::allTrue<bool>(masked || kept));
+  for (int b = 0; b < B; ++b) {
+    int length = sizes[b];
+    // time masks stay within the length of each sample
+    ASSERT_GT(af::count<int>(masked(af::seq(length), 0, 0, b)), 0);
+    if (length < T) {
+      ASSERT_TRUE(af::allTrue<bool>(kept(af::seq(length, T - 1), 0, 0, b)));
+    }
+  }
+  // masks differ between the samples
+  ASSERT_FALSE(af::allTrue<bool>(
+      masked(af::span, 0, 0, 0) == masked(af::span, 0, 0, 3)));
+
+  // a single input is the same as sizes of the whole batch
+  ASSERT_EQ(specAug.forward({input}).front().dims(), input.dims());
+}
+
+namespace {
+
+// Gradients of the inputs and parameters of a module for sum(output)
+std::vector<af::array> sumGrads(
+    Module& module,
+    const Variable& input,
+    const Variable& padMask) {
+  auto output = module.forward({input, padMask})[0];
+  input.zeroGrad();
+  module.zeroGrad();
+  sum(flat(output), {0}).backward();
+  std::vector<af::array> grads = {input.grad().array()};
+  for (const auto& param : module.params()) {
+    grads.push_back(param.grad().array());
+  }
+  return grads;
+}
+
+} // namespace
+
+TEST(ContribModuleTest, CheckpointGrad) {
+  int batchsize = 2;
+  int timesteps = 20;
+  int c = 16;
+  int nheads = 4;
+
+  auto tr = std::make_shared<Transformer>(
+      c, c / nheads, c, nheads, timesteps, 0, 0, true, false);
+  auto ckpt = Checkpoint(tr);
+  ASSERT_EQ(ckpt.params().size(), tr->params().size());
+  auto input = Variable(af::randu(c, timesteps, batchsize), true);
+
+  auto expected = sumGrads(*tr, input, Variable());
+  auto grads = sumGrads(ckpt, input, Variable());
+  ASSERT_EQ(grads.size(), expected.size());
+  for (size_t i = 0; i < grads.size(); ++i) {
+    ASSERT_TRUE(allClose(grads[i], expected[i], 1e-4));
+  }
+
+  // Evaluation runs the module as is
+  ckpt.eval();
+  auto output = ckpt.forward({input, Variable()})[0];
+  tr->eval();
+  ASSERT_TRUE(allClose(output, tr->forward({input, Variable()})[0]));
+}
+
+TEST(ContribModuleTest, CheckpointTDSGrad) {
+  auto tds = std::make_shared<TDSBlock>(10, 9, 4);
+  auto ckpt = Checkpoint(tds);
+  auto input = Variable(af::randu(20, 4, 10, 2), true);
+
+  auto tdsOutput = tds->forward({input})[0];
+  auto output = ckpt.forward({input})[0];
+  ASSERT_TRUE(allClose(output, tdsOutput));
+
+  input.zeroGrad();
+  tds->zeroGrad();
+  sum(flat(tdsOutput * tdsOutput), {0}).backward();
+  auto expectedInputGrad = input.grad().array();
+  auto expectedParamGrad = tds->param(0).grad().array();
+
+  input.zeroGrad();
+  ckpt.zeroGrad();
+  sum(flat(output * output), {0}).backward();
+  ASSERT_TRUE(allClose(input.grad().array(), expectedInputGrad, 1e-4));
+  ASSERT_TRUE(allClose(ckpt.param(0).grad().array(), expectedParamGrad, 1e-4));
+}
+
+TEST(ContribModuleTest, CheckpointDropout) {
+  // The recomputation must draw the dropout mask of the forward pass
+  auto ckpt = Checkpoint(Dropout(0.5));
+  auto input = Variable(af::constant(1.0, 100, 10), true);
+  auto output = ckpt.forward({input})[0];
+  // Draws from the random state before the backward pass
+  af::randu(100);
+  sum(flat(output), {0}).backward();
+  ASSERT_TRUE(allClose(input.grad().array(), output.array()));
+}
+
+TEST(ContribModuleTest, OffloadGrad) {
+  int batchsize = 2;
+  int timesteps = 20;
+  int c = 16;
+  int nheads = 4;
+
+  auto tr = std::make_shared<Transformer>(
+      c, c / nheads, c, nheads, timesteps, 0, 0, true, false);
+  auto offload = Offload(tr);
+  ASSERT_EQ(offload.params().size(), tr->params().size());
+  auto input = Variable(af::randu(c, timesteps, batchsize), true);
+
+  auto expected = sumGrads(*tr, input, Variable());
+  auto grads = sumGrads(offload, input, Variable());
+  ASSERT_EQ(grads.size(), expected.size());
+  for (size_t i = 0; i < grads.size(); ++i) {
+    ASSERT_TRUE(allClose(grads[i], expected[i], 1e-4));
+  }
+
+  // Stacked modules restore and prefetch each other's activations
+  auto linear1 = std::make_shared<Linear>(c, c);
+  auto linear2 = std::make_shared<Linear>(c, c);
+  Sequential plain;
+  plain.add(linear1);
+  plain.add(Tanh());
+  plain.add(linear2);
+  plain.add(Sigmoid());
+  Sequential offloaded;
+  offloaded.add(Offload(linear1, 1));
+  offloaded.add(Offload(Tanh(), 1));
+  offloaded.add(Offload(linear2, 1));
+  offloaded.add(Offload(Sigmoid(), 1));
+  auto stackInput = Variable(af::randu(c, 8), true);
+  auto stackGrads = [&stackInput](Sequential& stack) {
+    auto output = stack.forward(stackInput);
+    stackInput.zeroGrad();
+    stack.zeroGrad();
+    sum(flat(output * output), {0}).backward();
+    std::vector<af::array> grads = {stackInput.grad().array()};
+    for (const auto& param : stack.params()) {
+      grads.push_back(param.grad().array());
+    }
+    return grads;
+  };
+  expected = stackGrads(plain);
+  grads = stackGrads(offloaded);
+  ASSERT_EQ(grads.size(), expected.size());
+  for (size_t i = 0; i < grads.size(); ++i) {
+    ASSERT_TRUE(allClose(grads[i], expected[i], 1e-5));
   }
 }
 
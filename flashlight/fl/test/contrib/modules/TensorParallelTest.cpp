@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <exception>
+#include <iostream>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/fl/autograd/autograd.h"
+#include "flashlight/fl/common/Init.h"
+#include "flashlight/fl/contrib/modules/TensorParallel.h"
+#include "flashlight/fl/distributed/distributed.h"
+#include "flashlight/fl/nn/nn.h"
+
+using namespace fl;
+
+TEST(TensorParallelTest, ParallelLinear) {
+  if (!isDistributedInit()) {
+    GTEST_SKIP() << "Distributed initialization failed or not enabled.";
+  }
+
+  // The same layers and input on all the processes
+  auto group = createGroup(0);
+  int hidden = 4 * group.size;
+  af::setSeed(1);
+  Linear full1(6, hidden), full2(hidden, 5);
+  auto input = Variable(af::randu(6, 3, 2), true);
+  auto expected = full2(relu(full1(input)));
+  expected.backward();
+  auto expectedGrad = input.grad().array();
+  input.zeroGrad();
+
+  ColumnParallelLinear column(full1, group);
+  RowParallelLinear row(full2, group);
+  ASSERT_EQ(column.param(0).dims(0), 4);
+  ASSERT_EQ(row.param(0).dims(1), 4);
+  auto output = row(relu(column(input)));
+  ASSERT_TRUE(allClose(output.array(), expected.array(), 1e-5));
+  output.backward();
+  ASSERT_TRUE(allClose(input.grad().array(), expectedGrad, 1e-5));
+
+  // Gathered output, and scattered input
+  ColumnParallelLinear gathered(full1, group, /* gatherOutput = */ true);
+  ASSERT_TRUE(allClose(gathered(input).array(), full1(input).array(), 1e-5));
+  RowParallelLinear scattered(full2, group, /* inputIsParallel = */ false);
+  auto hiddenInput = Variable(af::randu(hidden, 3), false);
+  ASSERT_TRUE(allClose(
+      scattered(hiddenInput).array(), full2(hiddenInput).array(), 1e-5));
+
+  if (group.size > 1) {
+    ASSERT_THROW(ColumnParallelLinear(6, hidden + 1, group), std::exception);
+  }
+}
+
+TEST(TensorParallelTest, Transformer) {
+  if (!isDistributedInit()) {
+    GTEST_SKIP() << "Distributed initialization failed or not enabled.";
+  }
+
+  auto group = createGroup(0);
+  int nHeads = 2 * group.size, headDim = 3, modelDim = 8, bptt = 5;
+  int mlpDim = 4 * group.size;
+  af::setSeed(1);
+  Transformer full(modelDim, headDim, mlpDim, nHeads, bptt, 0, 0, true);
+  af::setSeed(1);
+  TensorParallelTransformer parallel(
+      modelDim, headDim, mlpDim, nHeads, bptt, 0, 0, group, true);
+  full.eval();
+  parallel.eval();
+
+  auto input = Variable(af::randu(modelDim, 5, 2), true);
+  auto expected = full.forward({input, Variable()}).front();
+  expected.backward();
+  auto expectedGrad = input.grad().array();
+  input.zeroGrad();
+
+  auto output = parallel.forward({input, Variable()}).front();
+  ASSERT_TRUE(allClose(output.array(), expected.array(), 1e-4));
+  output.backward();
+  ASSERT_TRUE(allClose(input.grad().array(), expectedGrad, 1e-4));
+  // The position embedding is shared by the heads of all the processes
+  ASSERT_TRUE(allClose(
+      parallel.param(0).grad().array(), full.param(0).grad().array(), 1e-4));
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  fl::init();
+
+  try {
+    distributedInit(
+        DistributedInit::MPI,
+        -1,
+        -1,
+        {{DistributedConstants::kMaxDevicePerNode, "8"}});
+  } catch (const std::exception& ex) {
+    // Don't run the test if distributed initialization fails
+    std::cerr
+        << "Distributed initialization failed; tests will be skipped. Reason: "
+        << ex.what() << std::endl;
+  }
+
+  return RUN_ALL_TESTS();
+}
@@ -5,7 +5,14 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstring>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <sstream>
 #include <thread>
 
 #include <arrayfire.h>
@@ -131,6 +138,107 @@ TEST(DatasetTest, ShuffleDataset) {
   ASSERT_FALSE(allClose(ff2[0], ff4[0]));
 }
 
+TEST(DatasetTest, LazyShuffleDataset) {
+  // A bijection for any size
+  for (int64_t n : {1, 2, 7, 300, 1024, 1025}) {
+    auto tensords = std::make_shared<TensorDataset>(
+        std::vector<af::array>{af::randu(1, 1, n)});
+    LazyShuffleDataset shuffleds(tensords, 1);
+    ASSERT_EQ(shuffleds.size(), n);
+    std::vector<int64_t> perm(n);
+    for (int64_t i = 0; i < n; ++i) {
+      perm[i] = shuffleds.permute(i);
+    }
+    std::sort(perm.begin(), perm.end());
+    for (int64_t i = 0; i < n; ++i) {
+      ASSERT_EQ(perm[i], i);
+    }
+  }
+
+  std::vector<af::array> tensormap = {af::randu(100, 200, 300)};
+  auto tensords = std::make_shared<TensorDataset>(tensormap);
+  LazyShuffleDataset shuffleds(tensords, 2);
+  auto ff1 = shuffleds.get(10);
+  ASSERT_EQ(ff1.size(), 1);
+  ASSERT_TRUE(allClose(
+      ff1[0], tensormap[0](af::span, af::span, shuffleds.permute(10))));
+
+  // Same seed produces same order and vice-versa
+  LazyShuffleDataset shuffleds2(tensords, 2);
+  LazyShuffleDataset shuffleds3(tensords, 3);
+  int64_t same2 = 0, same3 = 0;
+  for (int64_t i = 0; i < 300; ++i) {
+    same2 += shuffleds.permute(i) == shuffleds2.permute(i);
+    same3 += shuffleds.permute(i) == shuffleds3.permute(i);
+  }
+  ASSERT_EQ(same2, 300);
+  ASSERT_LT(same3, 30);
+
+  // A new permutation after resample()
+  shuffleds2.resample();
+  int64_t same = 0;
+  for (int64_t i = 0; i < 300; ++i) {
+    same += shuffleds.permute(i) == shuffleds2.permute(i);
+  }
+  ASSERT_LT(same, 30);
+}
+
+TEST(DatasetTest, BlockShuffleDataset) {
+  const int64_t n = 1000, blockSize = 50, bufferSize = 20;
+  auto tensords =
+      std::make_shared<TensorDataset>(std::vector<af::array>{af::range(n)});
+  auto indices = [](const BlockShuffleDataset& ds) {
+    std::vector<int64_t> res;
+    for (int64_t i = 0; i < ds.size(); ++i) {
+      res.push_back(ds.get(i)[0].scalar<float>());
+    }
+    return res;
+  };
+
+  // A single rank reads a permutation, made of shuffled blocks
+  BlockShuffleDataset shuffleds(tensords, blockSize, bufferSize, 1);
+  ASSERT_EQ(shuffleds.size(), n);
+  auto perm = indices(shuffleds);
+  auto sorted = perm;
+  std::sort(sorted.begin(), sorted.end());
+  for (int64_t i = 0; i < n; ++i) {
+    ASSERT_EQ(sorted[i], i);
+  }
+  // Reads mostly stay close, unlike a global shuffle, which jumps at most
+  // steps
+  int64_t jumps = 0;
+  for (int64_t i = 1; i < n; ++i) {
+    jumps += std::abs(perm[i] - perm[i - 1]) > blockSize + bufferSize;
+  }
+  ASSERT_LT(jumps, n / 2);
+  ASSERT_GT(jumps, 0);
+
+  // Same seed produces same order, and a new one after resample()
+  BlockShuffleDataset shuffleds2(tensords, blockSize, bufferSize, 1);
+  ASSERT_EQ(indices(shuffleds2), perm);
+  shuffleds2.resample();
+  ASSERT_NE(indices(shuffleds2), perm);
+
+  // Ranks with the same seed read disjoint samples, as many on each rank
+  const int64_t worldSize = 3;
+  std::vector<bool> seen(n, false);
+  for (int64_t rank = 0; rank < worldSize; ++rank) {
+    BlockShuffleDataset rankds(
+        tensords, blockSize, bufferSize, 1, rank, worldSize);
+    ASSERT_EQ(rankds.size(), (n / blockSize / worldSize) * blockSize);
+    for (auto idx : indices(rankds)) {
+      ASSERT_FALSE(seen[idx]);
+      seen[idx] = true;
+    }
+  }
+
+  ASSERT_THROW(
+      BlockShuffleDataset(tensords, 0, bufferSize), std::invalid_argument);
+  ASSERT_THROW(
+      BlockShuffleDataset(tensords, blockSize, bufferSize, 0, 2, 2),
+      std::invalid_argument);
+}
+
 TEST(DatasetTest, ResampleDataset) {
   std::vector<af::array> tensormap = {af::randu(100, 200, 300)};
   auto tensords = std::make_shared<TensorDataset>(tensormap);
@@ -515,6 +623,232 @@ TEST(DatasetTest, MemoryBlobDataset) {
   }
 }
 
+TEST(DatasetTest, MmapBlobDataset) {
+  std::vector<std::vector<af::array>> data;
+  {
+    FileBlobDataset blob(fl::lib::getTmpPath("data-mmap.blob"), true, true);
+    for (int64_t i = 0; i < 20; i++) {
+      std::vector<af::array> sample;
+      for (int64_t j = 0; j < i % 4; j++) {
+        if (j % 2 == 0) {
+          sample.push_back(af::randu(100, 3, 10));
+        } else {
+          sample.push_back(af::randu(100, 20, s32) * 100);
+        }
+      }
+      data.push_back(sample);
+      blob.add(sample);
+    }
+    blob.writeIndex();
+  }
+
+  auto check = [&data](const MmapBlobDataset& blob) {
+    ASSERT_EQ(data.size(), blob.size());
+    for (int64_t i = 0; i < blob.size(); i++) {
+      auto blobSample = blob.get(i);
+      auto datSample = data.at(i);
+      ASSERT_EQ(datSample.size(), blobSample.size());
+      for (int64_t j = 0; j < blobSample.size(); j++) {
+        ASSERT_EQ(datSample.at(j).type(), blobSample.at(j).type());
+        ASSERT_TRUE(allClose(datSample.at(j), blobSample.at(j)));
+      }
+    }
+  };
+
+  MmapBlobDataset blob(fl::lib::getTmpPath("data-mmap.blob"));
+  check(blob);
+
+  // raw spans match the copied raw data
+  for (int64_t i = 0; i < blob.size(); i++) {
+    auto raw = blob.rawGet(i);
+    auto spans = blob.rawGetSpans(i);
+    ASSERT_EQ(raw.size(), spans.size());
+    for (int64_t j = 0; j < raw.size(); j++) {
+      ASSERT_EQ(raw[j].size(), spans[j].size);
+      ASSERT_EQ(std::memcmp(raw[j].data(), spans[j].data, spans[j].size), 0);
+    }
+  }
+
+  // prefetching along a shuffled order does not change the data
+  std::vector<int64_t> order(blob.size());
+  std::iota(order.rbegin(), order.rend(), 0);
+  blob.setAccessOrder(order, 3);
+  check(blob);
+  blob.prefetch({0, 5, 19});
+  blob.setAccessOrder({}, 0);
+  check(blob);
+  ASSERT_THROW(blob.setAccessOrder({20}, 1), std::out_of_range);
+
+  // read-only
+  ASSERT_THROW(blob.add({af::randu(3)}), std::runtime_error);
+
+  MmapBlobDataset seqBlob(fl::lib::getTmpPath("data-mmap.blob"), true);
+  check(seqBlob);
+}
+
+TEST(DatasetTest, BlobDatasetWriter) {
+  auto path = fl::lib::getTmpPath("data-writer.blob");
+  bool compressed = BlobDataset::compressionSupported(BlobCompression::Zstd);
+  std::vector<std::vector<af::array>> data;
+  {
+    FileBlobDataset blob(path, true, true);
+    if (compressed) {
+      blob.setCompression(BlobCompression::Zstd);
+    } else {
+      ASSERT_THROW(
+          blob.setCompression(BlobCompression::Zstd), std::invalid_argument);
+    }
+    BlobDatasetWriter writer(blob, 4, 3);
+    for (int64_t i = 0; i < 50; i++) {
+      // constants compress, random data doesn't
+      data.push_back(
+          {af::constant(i, 100, 30), af::randu(50, 4, u8),
+           af::range(af::dim4(i + 1), 0, s32)});
+      writer.add(data.back());
+    }
+    writer.close();
+    blob.writeIndex();
+  }
+
+  auto check = [&data](const BlobDataset& blob) {
+    ASSERT_EQ(data.size(), blob.size());
+    for (int64_t i = 0; i < blob.size(); i++) {
+      auto blobSample = blob.get(i);
+      auto datSample = data.at(i);
+      ASSERT_EQ(datSample.size(), blobSample.size());
+      for (int64_t j = 0; j < blobSample.size(); j++) {
+        ASSERT_EQ(datSample.at(j).type(), blobSample.at(j).type());
+        ASSERT_TRUE(allClose(datSample.at(j), blobSample.at(j)));
+      }
+      auto raw = blob.rawGet(i);
+      for (int64_t j = 0; j < raw.size(); j++) {
+        ASSERT_EQ(raw[j].size(), datSample.at(j).bytes());
+      }
+    }
+  };
+
+  FileBlobDataset blob(path);
+  check(blob);
+  auto entries = blob.getEntries(0);
+  ASSERT_EQ(entries.size(), 3);
+  if (compressed) {
+    ASSERT_EQ(entries[0].compression, BlobCompression::Zstd);
+    ASSERT_LT(entries[0].storedBytes, data[0][0].bytes());
+  } else {
+    ASSERT_EQ(entries[0].compression, BlobCompression::None);
+  }
+  ASSERT_EQ(entries[1].compression, BlobCompression::None);
+  ASSERT_EQ(entries[1].storedBytes, data[0][1].bytes());
+
+  MmapBlobDataset mmapBlob(path);
+  check(mmapBlob);
+  if (compressed) {
+    ASSERT_THROW(mmapBlob.rawGetSpans(0), std::invalid_argument);
+  }
+}
+
+TEST(DatasetTest, CacheDataset) {
+  // 10 samples of 10 x f32
+  std::vector<af::array> tensormap = {af::randu(10, 10)};
+  auto tensords = std::make_shared<TensorDataset>(tensormap);
+  std::atomic<int> numTransforms{0};
+  Dataset::TransformFunction count = [&numTransforms](const af::array& a) {
+    ++numTransforms;
+    return a + 1.0;
+  };
+  auto transformDs = std::make_shared<TransformDataset>(
+      tensords, std::vector<Dataset::TransformFunction>{count});
+
+  for (bool device : {false, true}) {
+    numTransforms = 0;
+    CacheDatasetOptions options;
+    options.maxBytes = 4 * 10 * sizeof(float);
+    options.device = device;
+    auto cacheDs = std::make_shared<CacheDataset>(transformDs, options);
+    ASSERT_EQ(cacheDs->size(), 10);
+    for (int epoch = 0; epoch < 2; ++epoch) {
+      for (int i = 0; i < 4; ++i) {
+        ASSERT_TRUE(allClose(cacheDs->get(i)[0], tensormap[0].col(i) + 1.0));
+      }
+    }
+    ASSERT_EQ(numTransforms, 4);
+    // Evicts the least recently used sample, 0
+    cacheDs->get(5);
+    cacheDs->get(0);
+    ASSERT_EQ(numTransforms, 6);
+    auto stats = cacheDs->stats();
+    ASSERT_EQ(stats.hits, 4);
+    ASSERT_EQ(stats.misses, 6);
+    ASSERT_EQ(stats.bytes, options.maxBytes);
+    ASSERT_NEAR(stats.hitRate(), 0.4, 1E-6);
+  }
+
+  // Shuffled indices hit the samples they point to, from memory or from the
+  // spill file
+  numTransforms = 0;
+  CacheDatasetOptions options;
+  options.maxBytes = 4 * 10 * sizeof(float);
+  options.spillPath = fl::lib::getTmpPath("cache.spill");
+  auto cacheDs = std::make_shared<CacheDataset>(transformDs, options);
+  auto shuffleDs = std::make_shared<ShuffleDataset>(cacheDs);
+  for (int epoch = 0; epoch < 3; ++epoch) {
+    shuffleDs->resample();
+    auto sum = af::constant(0, 10);
+    for (auto& sample : *shuffleDs) {
+      sum += sample[0];
+    }
+    ASSERT_TRUE(allClose(sum, af::sum(tensormap[0] + 1.0, 1)));
+  }
+  ASSERT_EQ(numTransforms, 10);
+  auto stats = cacheDs->stats();
+  ASSERT_EQ(stats.misses, 10);
+  ASSERT_EQ(stats.hits + stats.spillHits, 20);
+  ASSERT_GT(stats.spillHits, 0);
+  ASSERT_GE(stats.spillBytes, 6 * 10 * sizeof(float));
+  ASSERT_LE(stats.spillBytes, 10 * 10 * sizeof(float));
+}
+
+TEST(DatasetTest, ParallelMapDataset) {
+  std::vector<af::array> tensormap = {af::randu(5, 100)};
+  auto tensords = std::make_shared<TensorDataset>(tensormap);
+  std::atomic<int> numInstances{0};
+  auto factory = [&numInstances]() {
+    ++numInstances;
+    // Not re-entrant: state of each instance
+    auto engine = std::make_shared<std::mt19937>();
+    return [engine](std::vector<af::array> sample, uint64_t seed) {
+      engine->seed(seed);
+      sample[0] = sample[0] + static_cast<float>((*engine)() % 1000);
+      return sample;
+    };
+  };
+
+  auto getAll = [&](int64_t numThreads, int64_t epoch) {
+    ParallelMapDataset ds(tensords, factory, numThreads, numThreads * 3);
+    ds.setEpoch(epoch);
+    std::vector<af::array> samples;
+    for (auto& sample : ds) {
+      samples.push_back(sample[0]);
+    }
+    return samples;
+  };
+  auto reference = getAll(0, 0);
+  ASSERT_EQ(numInstances, 1);
+  ASSERT_EQ(reference.size(), 100);
+  numInstances = 0;
+  auto parallel = getAll(4, 0);
+  ASSERT_EQ(numInstances, 4);
+  auto nextEpoch = getAll(4, 1);
+  int numChanged = 0;
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_TRUE(allClose(parallel[i], reference[i]));
+    auto offset = reference[i] - tensormap[0].col(i);
+    ASSERT_TRUE(allClose(offset, af::round(offset)));
+    numChanged += !allClose(nextEpoch[i], reference[i]);
+  }
+  ASSERT_GT(numChanged, 90);
+}
+
 TEST(DatasetTest, PrefetchDatasetCorrectness) {
   std::vector<af::array> tensormap = {af::randu(100, 200, 300)};
   auto tensords = std::make_shared<TensorDataset>(tensormap);
@@ -537,6 +871,136 @@ TEST(DatasetTest, PrefetchDatasetCorrectness) {
   }
 }
 
+TEST(DatasetTest, PrefetchDatasetOutOfOrder) {
+  // Every 7th sample is slow
+  class SlowDataset : public Dataset {
+   public:
+    int64_t size() const override {
+      return 100;
+    }
+
+    std::vector<af::array> get(const int64_t idx) const override {
+      if (idx % 7 == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      }
+      return {af::constant(idx, 1, s64)};
+    }
+  };
+  auto ds = std::make_shared<SlowDataset>();
+
+  const int64_t window = 3;
+  auto prefetchDs = std::make_shared<PrefetchDataset>(ds, 4, 6, false, window);
+  for (int pass = 0; pass < 2; ++pass) {
+    std::vector<bool> seen(ds->size(), false);
+    for (int64_t i = 0; i < ds->size(); ++i) {
+      auto sample = prefetchDs->get(i);
+      ASSERT_EQ(sample.size(), 1);
+      auto idx = sample[0].scalar<long long>();
+      ASSERT_FALSE(seen[idx]);
+      seen[idx] = true;
+      // never later than the reorder window
+      ASSERT_LE(i - idx, window);
+    }
+  }
+}
+
+TEST(DatasetTest, PrefetchDatasetState) {
+  // Counts the fetches of each sample
+  class CountingDataset : public Dataset {
+   public:
+    int64_t size() const override {
+      return 50;
+    }
+
+    std::vector<af::array> get(const int64_t idx) const override {
+      std::lock_guard<std::mutex> lock(mutex);
+      ++fetches[idx];
+      return {af::constant(idx, 1, s64)};
+    }
+
+    mutable std::mutex mutex;
+    mutable std::vector<int> fetches = std::vector<int>(50, 0);
+  };
+
+  for (int64_t window : {0, 3}) {
+    auto ds = std::make_shared<CountingDataset>();
+    std::vector<bool> seen(ds->size(), false);
+    auto read = [&](PrefetchDataset& prefetchDs, int64_t from, int64_t to) {
+      for (int64_t i = from; i < to; ++i) {
+        auto idx = prefetchDs.get(i)[0].scalar<long long>();
+        ASSERT_FALSE(seen[idx]);
+        seen[idx] = true;
+      }
+    };
+
+    PrefetchDataset::State state;
+    {
+      PrefetchDataset prefetchDs(ds, 4, 6, false, window);
+      read(prefetchDs, 0, 20);
+      state = prefetchDs.getState();
+    }
+    ASSERT_EQ(state.cursor, 20);
+    // Saved and loaded with a checkpoint
+    std::stringstream ss;
+    fl::save(ss, state);
+    PrefetchDataset::State loaded;
+    fl::load(ss, loaded);
+    ASSERT_EQ(loaded.nextFetch, state.nextFetch);
+    ASSERT_EQ(loaded.inFlight, state.inFlight);
+
+    std::vector<int> fetchesBefore;
+    {
+      std::lock_guard<std::mutex> lock(ds->mutex);
+      fetchesBefore = ds->fetches;
+    }
+    PrefetchDataset resumedDs(ds, 4, 6, false, window);
+    resumedDs.setState(loaded);
+    read(resumedDs, 20, ds->size());
+    for (int64_t i = 0; i < ds->size(); ++i) {
+      ASSERT_TRUE(seen[i]);
+      // Samples returned before aren't fetched again
+      if (std::find(state.inFlight.begin(), state.inFlight.end(), i) ==
+              state.inFlight.end() &&
+          i < state.nextFetch) {
+        std::lock_guard<std::mutex> lock(ds->mutex);
+        ASSERT_EQ(ds->fetches[i], fetchesBefore[i]);
+      }
+    }
+  }
+}
+
+TEST(DatasetTest, PrefetchDatasetDeviceStaging) {
+  // Blob samples are created with hostToDevice(), i.e. through the staging
+  auto blob = std::make_shared<MemoryBlobDataset>();
+  for (int64_t i = 0; i < 50; i++) {
+    blob->add({af::randu(10 + 37 * (i % 7), 3), af::randu(1 + i, s32)});
+  }
+  blob->writeIndex();
+
+  auto prefetchDs = std::make_shared<PrefetchDataset>(blob, 3, 2, true);
+  for (int i = 0; i < blob->size(); ++i) {
+    auto sample1 = blob->get(i);
+    auto sample2 = prefetchDs->get(i);
+    ASSERT_EQ(sample1.size(), sample2.size());
+    for (int j = 0; j < sample1.size(); ++j) {
+      ASSERT_TRUE(allClose(sample1[j], sample2[j]));
+    }
+    ASSERT_GE(prefetchDs->lastWaitTime(), 0.0);
+    ASSERT_GE(prefetchDs->totalWaitTime(), prefetchDs->lastWaitTime());
+  }
+
+  auto staging = std::make_shared<DeviceStaging>(2);
+  std::vector<float> host(1000);
+  std::iota(host.begin(), host.end(), 0);
+  DeviceStaging::setThreadStaging(staging);
+  auto staged = hostToDevice(af::dim4(10, 100), host.data());
+  DeviceStaging::setThreadStaging(nullptr);
+  ASSERT_TRUE(allClose(staged, af::array(10, 100, host.data())));
+  ASSERT_TRUE(allClose(
+      hostToDevice(af::dim4(10, 100), host.data()),
+      af::array(10, 100, host.data())));
+}
+
 TEST(DatasetTest, DISABLED_PrefetchDatasetPerformance) {
   // Flaky test. Disabled for now.
   std::vector<af::array> tensormap = {af::randu(100, 200, 300)};
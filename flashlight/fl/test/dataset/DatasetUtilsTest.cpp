@@ -6,6 +6,7 @@
  */
 
 #include <chrono>
+#include <cmath>
 #include <thread>
 
 #include <arrayfire.h>
@@ -54,6 +55,100 @@ TEST(DatasetTest, DynamicRoundRobinPacker) {
   ASSERT_EQ(samples.second, std::vector<int64_t>({3, 1}));
 }
 
+TEST(DatasetTest, BucketRoundRobinPacker) {
+  // Lengths 1 to 40, in a scrambled order
+  std::vector<float> length(40);
+  for (int i = 0; i < length.size(); ++i) {
+    length[i] = (i * 17) % 40 + 1;
+  }
+  int64_t maxSize = 40, numBuckets = 4;
+  auto rank0 =
+      bucketPartitionByRoundRobin(length, 0, 2, maxSize, numBuckets, 1);
+  auto rank1 =
+      bucketPartitionByRoundRobin(length, 1, 2, maxSize, numBuckets, 1);
+  // Balanced partitions
+  ASSERT_EQ(rank0.second.size(), rank1.second.size());
+  ASSERT_GT(rank0.second.size(), 0);
+
+  std::vector<int> seen(length.size(), 0);
+  size_t offset0 = 0, offset1 = 0;
+  for (size_t b = 0; b < rank0.second.size(); ++b) {
+    float max0 = 0, max1 = 0;
+    for (int64_t i = 0; i < rank0.second[b]; ++i) {
+      auto idx = rank0.first[offset0 + i];
+      max0 = std::max(max0, length[idx]);
+      ++seen[idx];
+    }
+    for (int64_t i = 0; i < rank1.second[b]; ++i) {
+      auto idx = rank1.first[offset1 + i];
+      max1 = std::max(max1, length[idx]);
+      ++seen[idx];
+    }
+    // Padded size fits, and both partitions get samples of similar lengths
+    ASSERT_LE(rank0.second[b] * max0, maxSize);
+    ASSERT_LE(rank1.second[b] * max1, maxSize);
+    ASSERT_LE(std::abs(max0 - max1), 2 * length.size() / numBuckets);
+    offset0 += rank0.second[b];
+    offset1 += rank1.second[b];
+  }
+  ASSERT_EQ(offset0, rank0.first.size());
+  ASSERT_EQ(offset1, rank1.first.size());
+  for (auto count : seen) {
+    ASSERT_LE(count, 1);
+  }
+
+  // Deterministic for a seed, reshuffled with another one
+  ASSERT_EQ(
+      bucketPartitionByRoundRobin(length, 0, 2, maxSize, numBuckets, 1),
+      rank0);
+  ASSERT_NE(
+      bucketPartitionByRoundRobin(length, 0, 2, maxSize, numBuckets, 2),
+      rank0);
+
+  // A single bucket with allowEmpty keeps all the samples
+  auto all = bucketPartitionByRoundRobin(length, 0, 1, maxSize, 1, 1, true);
+  ASSERT_EQ(all.first.size(), length.size());
+
+  ASSERT_THROW(
+      bucketPartitionByRoundRobin(length, 0, 2, 39, numBuckets, 1),
+      std::invalid_argument);
+  ASSERT_THROW(
+      bucketPartitionByRoundRobin(length, 0, 2, maxSize, 0, 1),
+      std::invalid_argument);
+}
+
+TEST(DatasetTest, BucketRoundRobinPackerWeights) {
+  std::vector<float> length(400, 1);
+  int64_t maxSize = 40;
+  std::vector<double> weights = {1, 0.5};
+  auto rank0 = bucketPartitionByRoundRobin(
+      length, 0, 2, maxSize, 1, 1, false, weights);
+  auto rank1 = bucketPartitionByRoundRobin(
+      length, 1, 2, maxSize, 1, 1, false, weights);
+  // As many batches, half as large on the slower partition
+  ASSERT_EQ(rank0.second.size(), rank1.second.size());
+  ASSERT_GT(rank0.second.size(), 0);
+  for (auto size : rank0.second) {
+    ASSERT_EQ(size, 40);
+  }
+  for (auto size : rank1.second) {
+    ASSERT_EQ(size, 20);
+  }
+  // The same weights are the same as none
+  ASSERT_EQ(
+      bucketPartitionByRoundRobin(
+          length, 0, 2, maxSize, 1, 1, false, {0.5, 0.5}),
+      bucketPartitionByRoundRobin(length, 0, 2, maxSize, 1, 1));
+
+  ASSERT_THROW(
+      bucketPartitionByRoundRobin(length, 0, 2, maxSize, 1, 1, false, {1}),
+      std::invalid_argument);
+  ASSERT_THROW(
+      bucketPartitionByRoundRobin(
+          length, 0, 2, maxSize, 1, 1, false, {1, 0}),
+      std::invalid_argument);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   fl::init();
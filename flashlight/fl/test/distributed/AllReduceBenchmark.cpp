@@ -15,21 +15,9 @@
 
 using namespace fl;
 
-int main() {
-  fl::init();
-  distributedInit(
-      DistributedInit::MPI,
-      -1,
-      -1,
-      {{DistributedConstants::kMaxDevicePerNode, "8"}});
-
-  auto wRank = getWorldRank();
-  auto wSize = getWorldSize();
-
-  if (wRank == 0) {
-    std::cout << "Running allreduce on " << wSize << " machines" << std::endl;
-  }
+namespace {
 
+void benchmark(af::dtype type, int wRank, int wSize) {
   const int kNumIters = 10000;
   std::vector<int64_t> sizes = {1, 2, 5};
   int64_t multiplier = 10;
@@ -38,7 +26,7 @@ int main() {
   while (true) {
     for (auto& size : sizes) {
       for (size_t i = 0; i < kNumIters; ++i) {
-        af::array in = af::randu(size);
+        af::array in = af::randu(size).as(type);
         in.eval();
         af::sync();
         auto start = af::timer::start();
@@ -47,10 +35,16 @@ int main() {
         times[i] = af::timer::stop(start);
       }
       auto timesAf = af::array(kNumIters, times.data());
+      double p50 = af::median<double>(timesAf);
+      // Bus bandwidth as defined by nccl-tests, comparable across world sizes
+      double busBandwidth = size * af::getSizeOf(type) / p50 * 2 *
+          (wSize - 1) / wSize / 1e9;
       if (wRank == 0) {
-        std::cout << "Size: " << size
+        std::cout << "Type: " << (type == af::dtype::f16 ? "f16" : "f32")
+                  << " ; size: " << size
                   << " ; avg: " << af::mean<double>(timesAf) * 1000
-                  << "ms ; p50: " << af::median<double>(timesAf) * 1000 << "ms"
+                  << "ms ; p50: " << p50 * 1000
+                  << "ms ; bus bandwidth: " << busBandwidth << "GB/s"
                   << std::endl;
       }
       curMaxSize = std::max(curMaxSize, size);
@@ -60,5 +54,27 @@ int main() {
       break;
     }
   }
+}
+
+} // namespace
+
+int main() {
+  fl::init();
+  distributedInit(
+      DistributedInit::MPI,
+      -1,
+      -1,
+      {{DistributedConstants::kMaxDevicePerNode, "8"}});
+
+  auto wRank = getWorldRank();
+  auto wSize = getWorldSize();
+
+  if (wRank == 0) {
+    std::cout << "Running allreduce on " << wSize << " machines" << std::endl;
+  }
+
+  benchmark(af::dtype::f32, wRank, wSize);
+  // The type to which BucketedReducer compresses gradients
+  benchmark(af::dtype::f16, wRank, wSize);
   return 0;
 }
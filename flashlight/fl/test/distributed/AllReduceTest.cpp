@@ -13,8 +13,12 @@
 
 #include <gtest/gtest.h>
 
+#include "flashlight/fl/autograd/autograd.h"
 #include "flashlight/fl/common/Init.h"
+#include "flashlight/fl/distributed/TcpStore.h"
 #include "flashlight/fl/distributed/distributed.h"
+#include "flashlight/fl/nn/nn.h"
+#include "flashlight/fl/optim/optim.h"
 #include "flashlight/lib/common/String.h"
 #include "flashlight/lib/common/System.h"
 
@@ -63,8 +67,7 @@ TEST(Distributed, AllReduceAsync) {
 
   auto rank = getWorldRank();
   auto size = getWorldSize();
-  // not supported for the CPU backend
-  bool async = true && !FL_BACKEND_CPU;
+  bool async = true;
 
   Variable var(af::constant(rank, 10), false);
 
@@ -75,6 +78,28 @@ TEST(Distributed, AllReduceAsync) {
   ASSERT_TRUE(af::allTrue<bool>(var.array() == expected_val));
 }
 
+TEST(Distributed, AllReduceManyAsync) {
+  if (!isDistributedInit()) {
+    GTEST_SKIP() << "Distributed initialization failed or not enabled.";
+  }
+
+  auto rank = getWorldRank();
+  auto size = getWorldSize();
+
+  // More collectives in flight than the staging buffers of Gloo
+  std::vector<af::array> arrs;
+  for (int i = 0; i < 20; ++i) {
+    arrs.push_back(af::constant(rank + i, 1000 + i));
+    allReduce(arrs.back(), /* async = */ true);
+  }
+  syncDistributed();
+
+  for (int i = 0; i < static_cast<int>(arrs.size()); ++i) {
+    float expected = size * (size - 1.0) / 2 + size * i;
+    ASSERT_TRUE(af::allTrue<bool>(arrs[i] == expected));
+  }
+}
+
 TEST(Distributed, AllReduceSetAsync) {
   if (!isDistributedInit()) {
     GTEST_SKIP() << "Distributed initialization failed or not enabled.";
@@ -82,9 +107,8 @@ TEST(Distributed, AllReduceSetAsync) {
 
   auto rank = getWorldRank();
   auto size = getWorldSize();
-  // not supported for the CPU backend
-  bool async = true && !FL_BACKEND_CPU;
-  bool contiguous = true && !FL_BACKEND_CPU;
+  bool async = true;
+  bool contiguous = true;
 
   size_t vSize = (1 << 20);
   std::vector<Variable> vars;
@@ -112,6 +136,264 @@ TEST(Distributed, AllReduceSetAsync) {
   }
 }
 
+TEST(Distributed, ReduceScatter) {
+  if (!isDistributedInit()) {
+    GTEST_SKIP() << "Distributed initialization failed or not enabled.";
+  }
+
+  auto rank = getWorldRank();
+  auto size = getWorldSize();
+
+  // the same array on all processes, plus the rank
+  auto input = af::range(af::dim4(3 * size, 2)) + rank;
+  af::array output;
+  reduceScatter(input, output);
+
+  auto expected = size * af::flat(input - rank) + size * (size - 1.0) / 2;
+  ASSERT_EQ(output.elements(), 6);
+  ASSERT_TRUE(af::allTrue<bool>(
+      output == expected(af::seq(6 * rank, 6 * rank + 5))));
+}
+
+TEST(Distributed, AllGather) {
+  if (!isDistributedInit()) {
+    GTEST_SKIP() << "Distributed initialization failed or not enabled.";
+  }
+
+  auto rank = getWorldRank();
+  auto size = getWorldSize();
+
+  auto input = af::constant(rank, af::dim4(2, 3));
+  af::array output;
+  allGather(input, output);
+
+  ASSERT_EQ(output.elements(), 6 * size);
+  for (int r = 0; r < size; ++r) {
+    ASSERT_TRUE(af::allTrue<bool>(output(af::seq(6 * r, 6 * r + 5)) == r));
+  }
+}
+
+TEST(Distributed, Broadcast) {
+  if (!isDistributedInit()) {
+    GTEST_SKIP() << "Distributed initialization failed or not enabled.";
+  }
+
+  auto rank = getWorldRank();
+  auto size = getWorldSize();
+  int root = size - 1;
+
+  auto arr = af::constant(rank, af::dim4(2, 3));
+  broadcast(arr, root);
+  ASSERT_TRUE(af::allTrue<bool>(arr == root));
+
+  // Different types and an empty array, coalesced
+  auto ints = af::constant(rank, 5, s64);
+  auto bytes = af::constant(rank, 3, u8);
+  af::array empty;
+  auto floats = af::constant(rank + 0.5, 4, 2);
+  broadcastMultiple({&ints, &bytes, &empty, &floats}, root);
+  ASSERT_TRUE(af::allTrue<bool>(ints == root));
+  ASSERT_TRUE(af::allTrue<bool>(bytes == root));
+  ASSERT_TRUE(af::allTrue<bool>(floats == root + 0.5));
+  ASSERT_EQ(ints.type(), s64);
+  ASSERT_EQ(bytes.type(), u8);
+
+  ASSERT_THROW(broadcast(arr, size), std::invalid_argument);
+
+  // Parameters of the root, exactly
+  auto model = std::make_shared<Linear>(4, 3);
+  auto weight = model->param(0).array().copy();
+  auto rootWeight = weight.copy();
+  broadcast(rootWeight, root);
+  broadcastParameters(model, root);
+  ASSERT_TRUE(af::allTrue<bool>(model->param(0).array() == rootWeight));
+  if (rank == root) {
+    ASSERT_TRUE(af::allTrue<bool>(model->param(0).array() == weight));
+  }
+}
+
+TEST(Distributed, ShardedOptimizer) {
+  if (!isDistributedInit()) {
+    GTEST_SKIP() << "Distributed initialization failed or not enabled.";
+  }
+
+  auto rank = getWorldRank();
+  auto size = getWorldSize();
+
+  // Sizes which are not multiples of the world size
+  std::vector<af::dim4> dims = {af::dim4(7, 3), af::dim4(5), af::dim4(1)};
+  std::vector<Variable> sharded, reference;
+  for (const auto& d : dims) {
+    auto init = af::randu(d);
+    allReduce(init);
+    sharded.emplace_back(init, true);
+    reference.emplace_back(init.copy(), true);
+  }
+  auto createAdam = [](const std::vector<Variable>& params) {
+    return std::make_shared<AdamOptimizer>(params, 1e-2);
+  };
+  ShardedOptimizer shardedOpt(sharded, createAdam, 1.0 / size);
+  AdamOptimizer referenceOpt(reference, 1e-2);
+
+  for (int step = 0; step < 3; ++step) {
+    for (size_t i = 0; i < dims.size(); ++i) {
+      auto grad = af::constant(rank + step, dims[i]) + af::range(dims[i]);
+      sharded[i].addGrad(Variable(grad, false));
+      // The average of the gradients over processes
+      auto mean = af::range(dims[i]) + step + (size - 1.0) / 2;
+      reference[i].addGrad(Variable(mean, false));
+    }
+    shardedOpt.step();
+    referenceOpt.step();
+    shardedOpt.zeroGrad();
+    referenceOpt.zeroGrad();
+  }
+  for (size_t i = 0; i < dims.size(); ++i) {
+    ASSERT_EQ(sharded[i].dims(), dims[i]);
+    ASSERT_TRUE(af::allTrue<bool>(
+        af::abs(sharded[i].array() - reference[i].array()) < 1e-5));
+  }
+}
+
+TEST(Distributed, PipelinedOptimizer) {
+  if (!isDistributedInit()) {
+    GTEST_SKIP() << "Distributed initialization failed or not enabled.";
+  }
+
+  auto rank = getWorldRank();
+  auto size = getWorldSize();
+
+  std::vector<af::dim4> dims = {af::dim4(7, 3), af::dim4(5), af::dim4(1)};
+  std::vector<Variable> pipelined, reference;
+  for (const auto& d : dims) {
+    auto init = af::randu(d);
+    allReduce(init);
+    pipelined.emplace_back(init, true);
+    reference.emplace_back(init.copy(), true);
+  }
+  auto createAdam = [](const std::vector<Variable>& params) {
+    return std::make_shared<AdamOptimizer>(params, 1e-2);
+  };
+  // Small buckets, so that the parameters are in different buckets
+  PipelinedOptimizer pipelinedOpt(
+      pipelined, createAdam, 1.0 / size, /* bucketBytes = */ 64);
+  AdamOptimizer referenceOpt(reference, 1e-2);
+
+  for (int step = 0; step < 3; ++step) {
+    for (size_t i = 0; i < dims.size(); ++i) {
+      auto grad = af::constant(rank + step, dims[i]) + af::range(dims[i]);
+      pipelined[i].addGrad(Variable(grad, false));
+      // The average of the gradients over processes
+      auto mean = af::range(dims[i]) + step + (size - 1.0) / 2;
+      reference[i].addGrad(Variable(mean, false));
+    }
+    pipelinedOpt.step();
+    referenceOpt.step();
+    pipelinedOpt.zeroGrad();
+    referenceOpt.zeroGrad();
+
+    // The updates are deferred until the parameters are awaited
+    ASSERT_TRUE(pipelinedOpt.hasPendingUpdates());
+    pipelinedOpt.awaitParams({pipelined[1]});
+    ASSERT_TRUE(af::allTrue<bool>(
+        af::abs(pipelined[1].array() - reference[1].array()) < 1e-5));
+    pipelinedOpt.awaitAll();
+    ASSERT_FALSE(pipelinedOpt.hasPendingUpdates());
+  }
+  for (size_t i = 0; i < dims.size(); ++i) {
+    ASSERT_EQ(pipelined[i].dims(), dims[i]);
+    ASSERT_TRUE(af::allTrue<bool>(
+        af::abs(pipelined[i].array() - reference[i].array()) < 1e-5));
+  }
+}
+
+TEST(Distributed, ModelAverager) {
+  if (!isDistributedInit()) {
+    GTEST_SKIP() << "Distributed initialization failed or not enabled.";
+  }
+
+  auto rank = getWorldRank();
+  auto size = getWorldSize();
+
+  auto init = af::randu(7, 3);
+  allReduce(init);
+  for (double outerLr : {1.0, 2.0}) {
+    Variable param(init.copy(), true);
+    auto opt = std::make_shared<SGDOptimizer>(
+        std::vector<Variable>{param}, 1.0, 0.5);
+    ModelAverager averager({param}, 2, 1, 0.0, outerLr, {opt});
+    af::array start;
+    for (int64_t update = 1; update <= 3; ++update) {
+      // Processes get different gradients, but for the synchronous update
+      double grad = (averager.isLocal(update) ? rank : 0) + update;
+      param.addGrad(Variable(af::constant(grad, 7, 3), false));
+      opt->step();
+      opt->zeroGrad();
+      if (update == 1) {
+        ASSERT_FALSE(averager.isLocal(update));
+        start = param.array().copy();
+      }
+      af::array mean = param.array().copy();
+      allReduce(mean);
+      mean /= size;
+      ASSERT_EQ(averager.step(update), update == 3);
+      ASSERT_TRUE(averager.isLocal(update + 1));
+      if (update == 3) {
+        // Moved from the parameters after the synchronous update
+        auto expected = start - outerLr * (start - mean);
+        ASSERT_TRUE(af::allTrue<bool>(
+            af::abs(param.array() - expected) < 1e-4));
+      }
+    }
+    // The optimizer state is averaged too
+    auto velocity = *opt->getStateArrays().front();
+    af::array sum = velocity.copy();
+    allReduce(sum);
+    ASSERT_TRUE(af::allTrue<bool>(af::abs(sum - size * velocity) < 1e-4));
+  }
+}
+
+TEST(Distributed, NodeTopology) {
+  std::vector<std::string> hostnames = {"a", "b", "a", "c", "b", "a"};
+  auto topology = detail::getNodeTopology(hostnames, 4);
+  ASSERT_EQ(topology.localRank, 1);
+  ASSERT_EQ(topology.localSize, 2);
+  ASSERT_EQ(topology.nodeIndex, 1);
+  ASSERT_EQ(topology.numNodes, 3);
+
+  topology = detail::getNodeTopology(hostnames, 0);
+  ASSERT_EQ(topology.localRank, 0);
+  ASSERT_EQ(topology.localSize, 3);
+  ASSERT_EQ(topology.nodeIndex, 0);
+}
+
+TEST(Distributed, TcpStore) {
+  // A store per process, so that processes on the same host don't collide
+  int port = 29600 + getWorldRank();
+  detail::TcpStore server("localhost", port, /* isServer = */ true);
+  std::vector<std::thread> clients;
+  for (int i = 0; i < 4; ++i) {
+    clients.emplace_back([port]() {
+      detail::TcpStore client("localhost", port, /* isServer = */ false);
+      auto value = client.get("key");
+      ASSERT_EQ(std::string(value.begin(), value.end()), "value");
+      client.add("count", 1);
+      client.wait({"done"});
+    });
+  }
+  ASSERT_FALSE(server.check("key"));
+  server.set("key", {'v', 'a', 'l', 'u', 'e'});
+  while (server.add("count", 0) < 4) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  server.set("done", {});
+  for (auto& client : clients) {
+    client.join();
+  }
+  ASSERT_TRUE(server.check("done"));
+  ASSERT_EQ(server.add("count", 2), 6);
+}
+
 TEST(Distributed, Barrier) {
   auto rank = getWorldRank();
   auto size = getWorldSize();
@@ -153,8 +435,8 @@ TEST(Distributed, CoalescingReducer) {
 
   auto s = std::make_shared<fl::CoalescingReducer>(
       /* scale = */ 1.0 / size,
-      /*async=*/true && !FL_BACKEND_CPU,
-      /*contiguous=*/true && !FL_BACKEND_CPU);
+      /*async=*/true,
+      /*contiguous=*/true);
 
   size_t vSize = (1 << 20);
   std::vector<Variable> vars;
@@ -177,6 +459,235 @@ TEST(Distributed, CoalescingReducer) {
   }
 }
 
+TEST(Distributed, BucketedReducer) {
+  if (!isDistributedInit()) {
+    GTEST_SKIP() << "Distributed initialization failed or not enabled.";
+  }
+
+  auto rank = getWorldRank();
+  auto size = getWorldSize();
+
+  auto reducer = std::make_shared<fl::BucketedReducer>(
+      /* scale = */ 1.0 / size,
+      /*async=*/true,
+      /* bucketBytes = */ 1 << 12);
+
+  // Buckets are formed during the first step and reused afterwards
+  std::vector<af::dim4> dims;
+  for (size_t i = 0; i < 50; ++i) {
+    dims.emplace_back(1 + (i * 37) % 300, 1 + i % 3);
+  }
+  for (int step = 0; step < 3; ++step) {
+    std::vector<Variable> vars;
+    for (size_t i = 0; i < dims.size(); ++i) {
+      vars.emplace_back(af::constant(rank + step + i, dims[i]), false);
+      reducer->add(vars.back());
+    }
+    reducer->finalize();
+
+    for (size_t i = 0; i < dims.size(); ++i) {
+      ASSERT_EQ(vars[i].dims(), dims[i]);
+      // The reducer scales down by a factor of 1 / size
+      float expected = step + i + (size - 1.0) / 2;
+      ASSERT_TRUE(
+          af::allTrue<bool>(af::abs(vars[i].array() - expected) < 1e-5));
+    }
+  }
+}
+
+TEST(Distributed, BucketedReducerCompressed) {
+  if (!isDistributedInit()) {
+    GTEST_SKIP() << "Distributed initialization failed or not enabled.";
+  }
+
+  auto rank = getWorldRank();
+  auto size = getWorldSize();
+
+  auto reducer = std::make_shared<fl::BucketedReducer>(
+      /* scale = */ 1.0 / size,
+      /*async=*/true,
+      /* bucketBytes = */ 1 << 12,
+      /* compress = */ true,
+      /* errorFeedback = */ true);
+
+  for (int step = 0; step < 3; ++step) {
+    std::vector<Variable> vars;
+    for (size_t i = 0; i < 20; ++i) {
+      vars.emplace_back(af::constant(0.1 * (rank + i), 100, 3), false);
+      reducer->add(vars.back());
+    }
+    reducer->finalize();
+
+    for (size_t i = 0; i < vars.size(); ++i) {
+      ASSERT_EQ(vars[i].type(), af::dtype::f32);
+      float expected = 0.1 * (i + (size - 1.0) / 2);
+      ASSERT_TRUE(
+          af::allTrue<bool>(af::abs(vars[i].array() - expected) < 1e-2));
+    }
+  }
+}
+
+TEST(Distributed, DeferredReducer) {
+  if (!isDistributedInit()) {
+    GTEST_SKIP() << "Distributed initialization failed or not enabled.";
+  }
+
+  auto rank = getWorldRank();
+  auto size = getWorldSize();
+
+  auto reducer = std::make_shared<fl::DeferredReducer>(
+      std::make_shared<fl::BucketedReducer>(
+          /* scale = */ 1.0 / size, /*async=*/true));
+  Variable param(af::constant(1.0, 10), true);
+  param.registerGradHook([reducer](Variable& grad) { reducer->add(grad); });
+
+  // The gradients of the micro-batches are accumulated locally, and reduced
+  // after the last one
+  const int numMicroBatches = 3;
+  for (int i = 0; i < numMicroBatches; ++i) {
+    reducer->setSynchronize(i == numMicroBatches - 1);
+    auto loss = fl::sum(param * (rank + 1.0 + i), {0});
+    loss.backward();
+    reducer->finalize();
+    if (i == 0) {
+      ASSERT_TRUE(af::allTrue<bool>(param.grad().array() == rank + 1.0));
+    }
+  }
+  float expected = numMicroBatches * (size - 1.0) / 2 + 6;
+  ASSERT_TRUE(
+      af::allTrue<bool>(af::abs(param.grad().array() - expected) < 1e-5));
+}
+
+TEST(Distributed, Groups) {
+  if (!isDistributedInit()) {
+    GTEST_SKIP() << "Distributed initialization failed or not enabled.";
+  }
+
+  // The processes of even and odd ranks
+  auto rank = getWorldRank();
+  auto size = getWorldSize();
+  auto group = createGroup(rank % 2);
+  ASSERT_EQ(group.rank, rank / 2);
+  ASSERT_EQ(group.size, (size + 1 - rank % 2) / 2);
+
+  auto arr = af::constant(rank, 10);
+  allReduce(arr, group);
+  float expected = 0;
+  for (int r = rank % 2; r < size; r += 2) {
+    expected += r;
+  }
+  ASSERT_TRUE(af::allTrue<bool>(arr == expected));
+
+  af::array gathered;
+  allGather(af::constant(rank, 3), gathered, group);
+  ASSERT_EQ(gathered.elements(), 3 * group.size);
+  for (int i = 0; i < group.size; ++i) {
+    auto part = gathered(af::seq(3 * i, 3 * i + 2));
+    ASSERT_TRUE(af::allTrue<bool>(part == 2 * i + rank % 2));
+  }
+
+  // Alone
+  DistributedGroup self;
+  allReduce(arr, self);
+  ASSERT_TRUE(af::allTrue<bool>(arr == expected));
+}
+
+TEST(Distributed, SendRecv) {
+  if (!isDistributedInit()) {
+    GTEST_SKIP() << "Distributed initialization failed or not enabled.";
+  }
+
+  // Each process sends to the next one in a ring, and receives from the
+  // previous one, in the same call
+  auto rank = getWorldRank();
+  auto size = getWorldSize();
+  auto sent = af::constant(rank, 10, 3);
+  auto received = af::constant(-1, 10, 3);
+  int prev = (rank + size - 1) % size;
+  sendRecv({{&sent, (rank + 1) % size}}, {{&received, prev}});
+  ASSERT_TRUE(af::allTrue<bool>(received == prev));
+
+  if (size < 2) {
+    return;
+  }
+  auto arr = af::constant(rank, 5);
+  if (rank == 0) {
+    send(arr, 1);
+  } else if (rank == 1) {
+    recv(arr, 0);
+    ASSERT_TRUE(af::allTrue<bool>(arr == 0));
+  }
+}
+
+TEST(Distributed, PipelinePartition) {
+  Sequential model;
+  model.add(Linear(10, 100));
+  model.add(ReLU());
+  model.add(Linear(100, 100));
+  model.add(ReLU());
+  model.add(Linear(100, 10));
+  auto stages = Pipeline::partition(model, 2);
+  ASSERT_EQ(stages.size(), 2);
+  ASSERT_EQ(stages[0]->modules().size(), 2);
+  ASSERT_EQ(stages[1]->modules().size(), 3);
+  ASSERT_EQ(stages[0]->module(0), model.module(0));
+
+  ASSERT_EQ(Pipeline::partition(model, 5).back()->modules().size(), 1);
+  ASSERT_THROW(Pipeline::partition(model, 6), std::invalid_argument);
+}
+
+TEST(Distributed, Pipeline) {
+  if (!isDistributedInit()) {
+    GTEST_SKIP() << "Distributed initialization failed or not enabled.";
+  }
+  if (getPipelineStages() != 1) {
+    GTEST_SKIP() << "Runs without pipeline stages.";
+  }
+
+  // With a single stage, the gradients are those of the micro-batches run
+  // one by one, and the reducer averages them over the processes
+  auto size = getWorldSize();
+  auto model = std::make_shared<Sequential>();
+  model->add(Linear(4, 3));
+  model->add(Tanh());
+  allReduceParameters(model);
+  auto reducer = std::make_shared<DeferredReducer>(
+      std::make_shared<InlineReducer>(1.0 / size));
+  distributeModuleGrads(model, reducer);
+  Pipeline pipeline(model, reducer);
+  ASSERT_TRUE(pipeline.isFirstStage() && pipeline.isLastStage());
+
+  const int numMicroBatches = 3;
+  std::vector<Variable> inputs;
+  for (int i = 0; i < numMicroBatches; ++i) {
+    inputs.emplace_back(af::constant(i + 1.0, 4, 2), false);
+  }
+  auto input = [&](int i) { return inputs[i]; };
+  auto loss = [](const Variable& output, int /* i */) {
+    return sum(output, {0, 1});
+  };
+  auto total = pipeline.trainStep(numMicroBatches, input, loss);
+  std::vector<af::array> grads;
+  for (const auto& param : model->params()) {
+    grads.push_back(param.grad().array());
+  }
+
+  model->zeroGrad();
+  float expectedLoss = 0;
+  for (int i = 0; i < numMicroBatches; ++i) {
+    auto l = loss(model->forward(inputs[i]), i);
+    expectedLoss += l.scalar<float>();
+    reducer->setSynchronize(i == numMicroBatches - 1);
+    l.backward();
+    reducer->finalize();
+  }
+  ASSERT_NEAR(total.scalar<float>(), expectedLoss, 1e-4);
+  auto params = model->params();
+  for (size_t i = 0; i < params.size(); ++i) {
+    ASSERT_TRUE(allClose(params[i].grad().array(), grads[i], 1e-5));
+  }
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   fl::init();
@@ -5,8 +5,16 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <random>
+#include <set>
+#include <thread>
 #include <vector>
 
 #include <af/device.h>
@@ -16,6 +24,7 @@
 
 #include "flashlight/fl/common/Init.h"
 #include "flashlight/fl/memory/memory.h"
+#include "flashlight/lib/common/System.h"
 
 class CachingMemoryManagerTest : public ::testing::Test {
  protected:
@@ -144,6 +153,432 @@ TEST_F(CachingMemoryManagerTest, OOM) {
   }
 }
 
+namespace {
+
+// Host memory with streams and events that complete when told to
+struct FakeStreamDevice {
+  struct Event {
+    bool done = true;
+  };
+  std::vector<std::unique_ptr<Event>> events;
+  void* activeStream = reinterpret_cast<void*>(1);
+
+  std::shared_ptr<fl::MemoryManagerDeviceInterface> deviceInterface() {
+    auto itf = std::make_shared<fl::MemoryManagerDeviceInterface>();
+    itf->getActiveDeviceId = []() { return 0; };
+    itf->nativeAlloc = [](size_t bytes) { return std::malloc(bytes); };
+    itf->nativeFree = [](void* ptr) { std::free(ptr); };
+    itf->getActiveStream = [this](int) { return activeStream; };
+    itf->createEvent = [this]() {
+      events.push_back(std::make_unique<Event>());
+      return static_cast<void*>(events.back().get());
+    };
+    itf->destroyEvent = [](void*) {};
+    itf->recordEvent = [](void* event, void*) {
+      static_cast<Event*>(event)->done = false;
+    };
+    itf->queryEvent = [](void* event) {
+      return static_cast<Event*>(event)->done;
+    };
+    itf->synchronizeEvent = [](void* event) {
+      static_cast<Event*>(event)->done = true;
+    };
+    return itf;
+  }
+
+  void completeAll() {
+    for (auto& event : events) {
+      event->done = true;
+    }
+  }
+};
+
+// Not split nor merged
+constexpr dim_t kStreamTestBytes = 20 * 1048576;
+
+} // namespace
+
+TEST(CachingMemoryManagerStreamTest, CrossStreamReuse) {
+  FakeStreamDevice device;
+  fl::CachingMemoryManager manager(1, device.deviceInterface());
+  dim_t dims[] = {kStreamTestBytes};
+  auto* streamA = reinterpret_cast<void*>(1);
+  auto* streamB = reinterpret_cast<void*>(2);
+
+  device.activeStream = streamA;
+  void* p1 = manager.alloc(false, 1, dims, 1);
+  manager.unlock(p1, false);
+  // Ordered on the same stream
+  void* p2 = manager.alloc(false, 1, dims, 1);
+  ASSERT_EQ(p2, p1);
+  manager.unlock(p2, false);
+
+  // Work of stream A may still use p1
+  device.activeStream = streamB;
+  void* p3 = manager.alloc(false, 1, dims, 1);
+  ASSERT_NE(p3, p1);
+  manager.unlock(p3, false);
+
+  device.completeAll();
+  void* p4 = manager.alloc(false, 1, dims, 1);
+  ASSERT_EQ(p4, p3);
+  void* p5 = manager.alloc(false, 1, dims, 1);
+  ASSERT_EQ(p5, p1);
+  manager.unlock(p4, false);
+  manager.unlock(p5, false);
+  manager.signalMemoryCleanup();
+}
+
+TEST(CachingMemoryManagerStreamTest, MemoryStats) {
+  FakeStreamDevice device;
+  fl::CachingMemoryManager manager(1, device.deviceInterface());
+  dim_t dims[] = {kStreamTestBytes};
+  void* ptr = manager.alloc(false, 1, dims, 1);
+  auto stats = manager.getMemoryStats();
+  ASSERT_GE(stats.allocatedBytes, kStreamTestBytes);
+  ASSERT_EQ(stats.cachedBytes, 0);
+  ASSERT_EQ(stats.numNativeMallocs, 1);
+  manager.unlock(ptr, false);
+  stats = manager.getMemoryStats();
+  ASSERT_EQ(stats.cachedBytes, stats.allocatedBytes);
+  device.completeAll();
+  manager.signalMemoryCleanup();
+  stats = manager.getMemoryStats();
+  ASSERT_EQ(stats.allocatedBytes, 0);
+  ASSERT_EQ(stats.numNativeFrees, 1);
+  ASSERT_GE(stats.peakAllocatedBytes, kStreamTestBytes);
+  manager.resetPeakMemoryStats();
+  ASSERT_EQ(manager.getMemoryStats().peakAllocatedBytes, 0);
+}
+
+TEST(CachingMemoryManagerStreamTest, RecordStream) {
+  FakeStreamDevice device;
+  fl::CachingMemoryManager manager(1, device.deviceInterface());
+  dim_t dims[] = {kStreamTestBytes};
+  auto* sideStream = reinterpret_cast<void*>(2);
+
+  void* p = manager.alloc(false, 1, dims, 1);
+  manager.recordStream(p, sideStream);
+  manager.unlock(p, false);
+  // Not cached until the work of the side stream has completed
+  void* q = manager.alloc(false, 1, dims, 1);
+  ASSERT_NE(q, p);
+  manager.unlock(q, false);
+
+  device.completeAll();
+  std::set<void*> reused = {manager.alloc(false, 1, dims, 1),
+                            manager.alloc(false, 1, dims, 1)};
+  ASSERT_EQ(reused, std::set<void*>({p, q}));
+  for (void* ptr : reused) {
+    manager.unlock(ptr, false);
+  }
+
+  // Freeing the cache waits for the side stream
+  void* r = manager.alloc(false, 1, dims, 1);
+  manager.recordStream(r, sideStream);
+  manager.unlock(r, false);
+  manager.signalMemoryCleanup();
+  ASSERT_EQ(manager.allocated(r), 0);
+}
+
+TEST(CachingMemoryManagerStreamTest, PrivatePool) {
+  FakeStreamDevice device;
+  fl::CachingMemoryManager manager(1, device.deviceInterface());
+  dim_t dims[] = {kStreamTestBytes};
+
+  // Cached memory is taken by the private pool
+  void* cached = manager.alloc(false, 1, dims, 1);
+  manager.unlock(cached, false);
+  auto id = manager.createPrivatePool();
+  manager.beginPrivatePool(id);
+  void* p1 = manager.alloc(false, 1, dims, 1);
+  ASSERT_EQ(p1, cached);
+  void* p2 = manager.alloc(false, 1, dims, 1);
+  manager.unlock(p2, false);
+  ASSERT_THROW(manager.beginPrivatePool(id), std::logic_error);
+  manager.endPrivatePool();
+  manager.unlock(p1, false);
+
+  // Blocks of the pool are neither reused outside of it nor freed
+  device.completeAll();
+  void* other = manager.alloc(false, 1, dims, 1);
+  ASSERT_NE(other, p1);
+  ASSERT_NE(other, p2);
+  manager.unlock(other, false);
+  manager.signalMemoryCleanup();
+  manager.beginPrivatePool(id);
+  std::set<void*> reused = {manager.alloc(false, 1, dims, 1),
+                            manager.alloc(false, 1, dims, 1)};
+  ASSERT_EQ(reused, std::set<void*>({p1, p2}));
+  manager.endPrivatePool();
+  for (void* ptr : reused) {
+    manager.unlock(ptr, false);
+  }
+
+  // Released blocks go back to the cache of the stream
+  manager.releasePrivatePool(id);
+  reused = {manager.alloc(false, 1, dims, 1), manager.alloc(false, 1, dims, 1)};
+  ASSERT_EQ(reused, std::set<void*>({p1, p2}));
+  for (void* ptr : reused) {
+    manager.unlock(ptr, false);
+  }
+  manager.signalMemoryCleanup();
+}
+
+TEST(CachingMemoryManagerProfileTest, WarmStart) {
+  int numMallocs = 0;
+  int numFrees = 0;
+  auto deviceInterface = std::make_shared<fl::MemoryManagerDeviceInterface>();
+  deviceInterface->getActiveDeviceId = []() { return 0; };
+  deviceInterface->nativeAlloc = [&numMallocs](size_t bytes) {
+    ++numMallocs;
+    return std::malloc(bytes);
+  };
+  deviceInterface->nativeFree = [&numFrees](void* ptr) {
+    ++numFrees;
+    std::free(ptr);
+  };
+  const size_t kLarge = 4 * 1048576;
+  const size_t kSmall = 1024;
+  dim_t largeDims[] = {kLarge};
+  dim_t smallDims[] = {kSmall};
+  auto allocAll = [&](fl::CachingMemoryManager& manager) {
+    std::vector<void*> ptrs;
+    for (int i = 0; i < 3; ++i) {
+      ptrs.push_back(manager.alloc(false, 1, largeDims, 1));
+    }
+    for (int i = 0; i < 2; ++i) {
+      ptrs.push_back(manager.alloc(false, 1, smallDims, 1));
+    }
+    for (void* ptr : ptrs) {
+      manager.unlock(ptr, false);
+    }
+    return ptrs;
+  };
+
+  fl::CachingMemoryManager::AllocationProfile profile;
+  {
+    fl::CachingMemoryManager manager(1, deviceInterface);
+    manager.setProfilingEnabled(true);
+    allocAll(manager);
+    // Reused blocks don't raise the peaks
+    allocAll(manager);
+    manager.signalMemoryCleanup();
+    profile = manager.getAllocationProfile();
+  }
+  ASSERT_EQ(profile.peakAllocatedBytes, 3 * kLarge + 2 * kSmall);
+  ASSERT_EQ(
+      profile.peakBlocks,
+      (std::map<size_t, size_t>{{kSmall, 2}, {kLarge, 3}}));
+  const std::string path = fl::lib::getTmpPath("CachingMemoryManager.prof");
+  profile.save(path);
+  auto loaded = fl::CachingMemoryManager::AllocationProfile::load(path);
+  ASSERT_EQ(loaded.peakAllocatedBytes, profile.peakAllocatedBytes);
+  ASSERT_EQ(loaded.peakBlocks, profile.peakBlocks);
+
+  // Allocations only reuse the preallocated blocks, carved in order
+  fl::CachingMemoryManager manager(1, deviceInterface);
+  numMallocs = 0;
+  numFrees = 0;
+  ASSERT_EQ(manager.warmStart(loaded), 3 * kLarge + 2097152);
+  ASSERT_EQ(numMallocs, 2);
+  auto ptrs = allocAll(manager);
+  ASSERT_EQ(numMallocs, 2);
+  ASSERT_EQ(static_cast<char*>(ptrs[1]), static_cast<char*>(ptrs[0]) + kLarge);
+  ASSERT_EQ(static_cast<char*>(ptrs[2]), static_cast<char*>(ptrs[1]) + kLarge);
+  ASSERT_EQ(static_cast<char*>(ptrs[4]), static_cast<char*>(ptrs[3]) + kSmall);
+  // The carved segments are freed with the cache
+  manager.signalMemoryCleanup();
+  ASSERT_EQ(numFrees, 2);
+}
+
+namespace {
+
+// Host memory, counting the native allocations
+std::shared_ptr<fl::MemoryManagerDeviceInterface> countingDeviceInterface(
+    std::atomic<int>& numMallocs,
+    std::atomic<int>& numFrees) {
+  auto itf = std::make_shared<fl::MemoryManagerDeviceInterface>();
+  itf->getActiveDeviceId = []() { return 0; };
+  itf->nativeAlloc = [&numMallocs](size_t bytes) {
+    ++numMallocs;
+    return std::malloc(bytes);
+  };
+  itf->nativeFree = [&numFrees](void* ptr) {
+    ++numFrees;
+    std::free(ptr);
+  };
+  return itf;
+}
+
+} // namespace
+
+TEST(CachingMemoryManagerThreadCacheTest, CrossThreadFree) {
+  std::atomic<int> numMallocs{0};
+  std::atomic<int> numFrees{0};
+  fl::CachingMemoryManager manager(
+      1, countingDeviceInterface(numMallocs, numFrees));
+  const size_t kSize = 1024;
+  dim_t dims[] = {kSize};
+
+  // Refilled from a single small buffer, in the order of the addresses
+  std::vector<void*> ptrs;
+  for (int i = 0; i < 4; ++i) {
+    ptrs.push_back(manager.alloc(false, 1, dims, 1));
+  }
+  ASSERT_EQ(numMallocs, 1);
+  for (int i = 1; i < 4; ++i) {
+    ASSERT_EQ(
+        static_cast<char*>(ptrs[i]), static_cast<char*>(ptrs[0]) + i * kSize);
+  }
+  ASSERT_EQ(manager.allocated(ptrs[0]), kSize);
+  manager.userLock(ptrs[0]);
+  ASSERT_TRUE(manager.isUserLocked(ptrs[0]));
+  manager.userUnlock(ptrs[0]);
+  ASSERT_FALSE(manager.isUserLocked(ptrs[0]));
+  ASSERT_EQ(manager.allocated(ptrs[0]), kSize);
+
+  // Blocks freed by another thread join its cache
+  std::thread([&]() {
+    for (void* ptr : ptrs) {
+      manager.unlock(ptr, false);
+    }
+    std::set<void*> reused;
+    for (int i = 0; i < 4; ++i) {
+      reused.insert(manager.alloc(false, 1, dims, 1));
+    }
+    ASSERT_EQ(reused, std::set<void*>(ptrs.begin(), ptrs.end()));
+    for (void* ptr : reused) {
+      manager.unlock(ptr, false);
+    }
+  }).join();
+  ASSERT_EQ(numMallocs, 1);
+  ASSERT_EQ(manager.allocated(ptrs[0]), 0);
+
+  // The blocks of the exited thread and of this one are freed with the cache
+  manager.signalMemoryCleanup();
+  ASSERT_EQ(numFrees, 1);
+}
+
+TEST(CachingMemoryManagerThreadCacheTest, IdleThread) {
+  std::atomic<int> numMallocs{0};
+  std::atomic<int> numFrees{0};
+  fl::CachingMemoryManager manager(
+      1, countingDeviceInterface(numMallocs, numFrees));
+  dim_t dims[] = {1024};
+
+  // The other thread caches blocks, then waits without allocating or freeing
+  std::mutex mutex;
+  std::condition_variable condition;
+  int step = 0;
+  auto waitFor = [&](int s) {
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [&]() { return step >= s; });
+  };
+  auto advance = [&]() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      ++step;
+    }
+    condition.notify_all();
+  };
+  std::thread idle([&]() {
+    for (int s = 1; s <= 3; s += 2) {
+      std::vector<void*> ptrs;
+      for (int i = 0; i < 4; ++i) {
+        ptrs.push_back(manager.alloc(false, 1, dims, 1));
+      }
+      for (void* ptr : ptrs) {
+        manager.unlock(ptr, false);
+      }
+      advance();
+      waitFor(s + 1);
+    }
+  });
+
+  // Its blocks are freed with the cache while it is idle
+  waitFor(1);
+  EXPECT_EQ(numMallocs, 1);
+  manager.signalMemoryCleanup();
+  EXPECT_EQ(numFrees, 1);
+  advance();
+
+  // And by the shutdown
+  waitFor(3);
+  EXPECT_EQ(numMallocs, 2);
+  manager.shutdown();
+  EXPECT_EQ(numFrees, 2);
+  advance();
+  idle.join();
+}
+
+TEST(CachingMemoryManagerThreadCacheTest, ConcurrentAllocs) {
+  std::atomic<int> numMallocs{0};
+  std::atomic<int> numFrees{0};
+  fl::CachingMemoryManager manager(
+      1, countingDeviceInterface(numMallocs, numFrees));
+  const int kThreads = 4;
+  const int kIters = 2000;
+
+  // Some allocations are freed by the next thread
+  std::mutex mutex;
+  std::vector<std::vector<std::pair<void*, uint32_t>>> handoffs(kThreads);
+  auto check = [](void* ptr, uint32_t tag) {
+    uint32_t stored;
+    std::memcpy(&stored, ptr, sizeof(stored));
+    return stored == tag;
+  };
+  std::atomic<int> corrupted{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      std::mt19937 rng(t);
+      std::vector<std::pair<void*, uint32_t>> live;
+      for (int i = 0; i < kIters; ++i) {
+        dim_t dims[] = {static_cast<dim_t>(1 + rng() % 65536)};
+        void* ptr = manager.alloc(false, 1, dims, 1);
+        uint32_t tag = t * kIters + i;
+        std::memcpy(ptr, &tag, sizeof(tag));
+        live.emplace_back(ptr, tag);
+        if (rng() % 4 == 0) {
+          std::lock_guard<std::mutex> lock(mutex);
+          handoffs[(t + 1) % kThreads].push_back(live.back());
+          live.pop_back();
+        }
+        std::vector<std::pair<void*, uint32_t>> received;
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          received.swap(handoffs[t]);
+        }
+        if (live.size() > 16) {
+          received.push_back(live.front());
+          live.erase(live.begin());
+        }
+        for (auto& alloc : received) {
+          corrupted += !check(alloc.first, alloc.second);
+          manager.unlock(alloc.first, false);
+        }
+      }
+      for (auto& alloc : live) {
+        corrupted += !check(alloc.first, alloc.second);
+        manager.unlock(alloc.first, false);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (auto& handoff : handoffs) {
+    for (auto& alloc : handoff) {
+      corrupted += !check(alloc.first, alloc.second);
+      manager.unlock(alloc.first, false);
+    }
+  }
+  ASSERT_EQ(corrupted, 0);
+  manager.signalMemoryCleanup();
+  ASSERT_EQ(numFrees, numMallocs);
+}
+
 void testFragmentation(
     std::shared_ptr<fl::MemoryManagerDeviceInterface> deviceInterface_,
     std::shared_ptr<fl::CachingMemoryManager> adapter_,
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <memory>
+
+#include <af/device.h>
+#include <arrayfire.h>
+#include <gtest/gtest.h>
+
+#include "flashlight/fl/common/Init.h"
+#include "flashlight/fl/memory/memory.h"
+
+using fl::DefaultMemoryManager;
+
+TEST(DefaultMemoryManagerTest, SizeClass) {
+  // Multiples of the step only
+  ASSERT_EQ(DefaultMemoryManager::sizeClass(1, 1024, 0), 1024u);
+  ASSERT_EQ(DefaultMemoryManager::sizeClass(5000, 1024, 0), 5120u);
+  ASSERT_EQ(DefaultMemoryManager::sizeClass(1, 1024, 8), 1024u);
+  ASSERT_EQ(DefaultMemoryManager::sizeClass(4096, 1024, 8), 4096u);
+  // Between 2^20 and 2^21 the classes are 2^17 apart
+  ASSERT_EQ(
+      DefaultMemoryManager::sizeClass((1 << 20) + 1, 1024, 8),
+      (1u << 20) + (1u << 17));
+  ASSERT_EQ(
+      DefaultMemoryManager::sizeClass((1 << 21) - 1, 1024, 8), 1u << 21);
+  for (size_t bytes = 1; bytes < (1 << 24); bytes = bytes * 3 + 7) {
+    size_t allocBytes = DefaultMemoryManager::sizeClass(bytes, 1024, 8);
+    ASSERT_GE(allocBytes, bytes);
+    ASSERT_EQ(allocBytes % 1024, 0u);
+    ASSERT_LT(allocBytes - bytes, bytes / 8 + 1024);
+  }
+}
+
+TEST(DefaultMemoryManagerTest, ReusesCloseSizes) {
+  auto deviceInterface = std::make_shared<fl::MemoryManagerDeviceInterface>();
+  auto adapter = std::make_shared<DefaultMemoryManager>(
+      af::getDeviceCount(), 1000, false /* debug */, deviceInterface);
+  auto installer = std::make_unique<fl::MemoryManagerInstaller>(adapter);
+  installer->setAsMemoryManager();
+  adapter->setSizeClassDivisions(8);
+  {
+    void* a = af::alloc(1000000, af::dtype::f32);
+    ASSERT_EQ(
+        adapter->allocated(a),
+        DefaultMemoryManager::sizeClass(4000000, 1024, 8));
+    af::free(a);
+    // A different size of the same class reuses the buffer
+    void* b = af::alloc(1010000, af::dtype::f32);
+    ASSERT_EQ(a, b);
+    af::free(b);
+  }
+  af::deviceGC();
+  af_unset_memory_manager();
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  fl::init();
+  return RUN_ALL_TESTS();
+}
@@ -13,6 +13,7 @@
 #include <gtest/gtest.h>
 
 #include "flashlight/fl/common/Init.h"
+#include "flashlight/fl/common/Utils.h"
 #include "flashlight/fl/memory/memory.h"
 
 using namespace fl;
@@ -28,6 +29,27 @@ TEST(MemoryInitTest, DefaultManagerInitializesCorrectType) {
   ASSERT_NE(dynamic_cast<CachingMemoryManager*>(manager), nullptr);
 }
 
+TEST(MemoryInitTest, DefaultPinnedManagerInitializesCorrectType) {
+  if (FL_BACKEND_CPU) {
+    GTEST_SKIP() << "CachingMemoryManager is not used on CPU backend";
+  }
+  auto* manager =
+      MemoryManagerInstaller::currentlyInstalledPinnedMemoryManager();
+  auto* pinnedManager = dynamic_cast<CachingMemoryManager*>(manager);
+  ASSERT_NE(pinnedManager, nullptr);
+  ASSERT_NE(
+      pinnedManager, MemoryManagerInstaller::currentlyInstalledMemoryManager());
+
+  // Freed pinned memory is cached and reused
+  void* ptr;
+  AF_CHECK(af_alloc_pinned(&ptr, 4096));
+  AF_CHECK(af_free_pinned(ptr));
+  void* reused;
+  AF_CHECK(af_alloc_pinned(&reused, 4096));
+  ASSERT_EQ(reused, ptr);
+  AF_CHECK(af_free_pinned(reused));
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   fl::init();
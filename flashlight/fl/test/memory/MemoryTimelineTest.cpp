@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdlib>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <arrayfire.h>
+#include <gtest/gtest.h>
+
+#include "flashlight/fl/common/Init.h"
+#include "flashlight/fl/memory/memory.h"
+#include "flashlight/lib/common/System.h"
+
+using fl::MemoryEventType;
+
+namespace {
+
+fl::MemoryEvent makeEvent(
+    uint64_t timeUs,
+    MemoryEventType type,
+    uint64_t ptr,
+    uint64_t size,
+    uint16_t scope = 0) {
+  return {timeUs, ptr, size, 0, scope, type};
+}
+
+// Three blocks carved out of one segment, then freed
+fl::MemoryTimelineData fragmentedTimeline() {
+  fl::MemoryTimelineData data;
+  data.scopes = {"", "forward", "backward"};
+  const uint64_t base = 4096;
+  data.events = {
+      makeEvent(0, MemoryEventType::NativeAlloc, base, 300),
+      makeEvent(1, MemoryEventType::Alloc, base, 100, 1),
+      makeEvent(2, MemoryEventType::Split, base + 100, 200, 1),
+      makeEvent(3, MemoryEventType::Alloc, base + 100, 100, 1),
+      makeEvent(4, MemoryEventType::Split, base + 200, 100, 2),
+      makeEvent(5, MemoryEventType::Alloc, base + 200, 100, 2),
+      makeEvent(6, MemoryEventType::Free, base, 100),
+      makeEvent(7, MemoryEventType::Free, base + 200, 100),
+      makeEvent(8, MemoryEventType::Free, base + 100, 100),
+      makeEvent(9, MemoryEventType::Merge, base, 300),
+      makeEvent(10, MemoryEventType::NativeFree, base, 300)};
+  return data;
+}
+
+} // namespace
+
+TEST(MemoryTimelineTest, Analyze) {
+  auto report = fl::analyzeMemoryTimeline(fragmentedTimeline());
+  ASSERT_EQ(report.peakAllocatedBytes, 300);
+  ASSERT_EQ(report.peakAllocatedTimeUs, 5);
+  ASSERT_EQ(report.peakReservedBytes, 300);
+  ASSERT_EQ(report.peakReservedTimeUs, 0);
+  // Nothing free at the peak, two 100 bytes holes before the last free
+  ASSERT_DOUBLE_EQ(report.fragmentationAtPeak, 0.0);
+  ASSERT_DOUBLE_EQ(report.maxFragmentation, 0.5);
+  ASSERT_EQ(report.numNativeAllocs, 1);
+  ASSERT_EQ(report.numSplits, 2);
+  ASSERT_EQ(report.numMerges, 1);
+
+  ASSERT_EQ(report.samples.size(), 11);
+  ASSERT_EQ(report.samples[7].allocatedBytes, 100);
+  ASSERT_EQ(report.samples[7].largestFreeBlock, 100);
+  ASSERT_EQ(report.samples[8].largestFreeBlock, 300);
+  ASSERT_EQ(report.samples.back().reservedBytes, 0);
+  ASSERT_EQ(report.samples.back().largestFreeBlock, 0);
+
+  ASSERT_EQ(report.topScopes.size(), 2);
+  ASSERT_EQ(report.topScopes[0].scope, "forward");
+  ASSERT_EQ(report.topScopes[0].allocs, 2);
+  ASSERT_EQ(report.topScopes[0].bytes, 200);
+  ASSERT_EQ(report.topScopes[1].scope, "backward");
+}
+
+TEST(MemoryTimelineTest, AnalyzeSamples) {
+  // Windows of 4 events keep their peak
+  auto report = fl::analyzeMemoryTimeline(fragmentedTimeline(), 0, 3);
+  ASSERT_EQ(report.samples.size(), 3);
+  ASSERT_EQ(report.samples[0].allocatedBytes, 200);
+  ASSERT_EQ(report.samples[1].allocatedBytes, 300);
+  ASSERT_EQ(report.samples[1].timeUs, 5);
+  ASSERT_EQ(report.samples[2].allocatedBytes, 0);
+
+  // Events of other devices are ignored
+  auto other = fl::analyzeMemoryTimeline(fragmentedTimeline(), 1);
+  ASSERT_EQ(other.peakAllocatedBytes, 0);
+  ASSERT_TRUE(other.samples.empty());
+}
+
+TEST(MemoryTimelineTest, Scopes) {
+  fl::MemoryTimeline timeline;
+  int x;
+  timeline.record(MemoryEventType::Alloc, 0, &x, 4);
+  {
+    fl::MemoryScope outer("train");
+    {
+      fl::MemoryScope inner("forward");
+      ASSERT_EQ(fl::MemoryScope::current(), "train/forward");
+      timeline.record(MemoryEventType::Alloc, 0, &x, 4);
+    }
+    timeline.record(MemoryEventType::Free, 0, &x, 4);
+  }
+  ASSERT_EQ(fl::MemoryScope::current(), "");
+
+  auto data = timeline.data();
+  ASSERT_EQ(data.events.size(), 3);
+  ASSERT_EQ(data.scopes[data.events[0].scope], "");
+  ASSERT_EQ(data.scopes[data.events[1].scope], "train/forward");
+  ASSERT_EQ(data.scopes[data.events[2].scope], "train");
+  ASSERT_EQ(data.events[1].ptr, reinterpret_cast<uint64_t>(&x));
+  ASSERT_LE(data.events[0].timeUs, data.events[2].timeUs);
+
+  timeline.clear();
+  ASSERT_TRUE(timeline.data().events.empty());
+}
+
+TEST(MemoryTimelineTest, SaveLoad) {
+  fl::MemoryTimeline timeline;
+  int x;
+  {
+    fl::MemoryScope scope("scope \"quoted\"");
+    timeline.record(MemoryEventType::NativeAlloc, 1, &x, 1 << 20);
+    timeline.record(MemoryEventType::Alloc, 1, &x, 512);
+  }
+  timeline.record(MemoryEventType::Free, 1, &x, 512);
+  const std::string path = fl::lib::getTmpPath("timeline.fltl");
+  timeline.save(path);
+
+  auto expected = timeline.data();
+  auto loaded = fl::loadMemoryTimeline(path);
+  ASSERT_EQ(loaded.scopes, expected.scopes);
+  ASSERT_EQ(loaded.events.size(), expected.events.size());
+  for (size_t i = 0; i < loaded.events.size(); ++i) {
+    ASSERT_EQ(loaded.events[i].timeUs, expected.events[i].timeUs);
+    ASSERT_EQ(loaded.events[i].ptr, expected.events[i].ptr);
+    ASSERT_EQ(loaded.events[i].size, expected.events[i].size);
+    ASSERT_EQ(loaded.events[i].device, 1);
+    ASSERT_EQ(loaded.events[i].scope, expected.events[i].scope);
+    ASSERT_EQ(loaded.events[i].type, expected.events[i].type);
+  }
+  ASSERT_THROW(
+      fl::loadMemoryTimeline(fl::lib::getTmpPath("missing.fltl")),
+      std::runtime_error);
+
+  std::stringstream trace;
+  fl::writeChromeTrace(loaded, trace);
+  ASSERT_EQ(trace.str().find("{\"traceEvents\":["), 0);
+  ASSERT_NE(trace.str().find("scope \\\"quoted\\\""), std::string::npos);
+  ASSERT_NE(trace.str().find("\"allocated\":512"), std::string::npos);
+}
+
+TEST(MemoryTimelineTest, CachingMemoryManager) {
+  auto deviceInterface = std::make_shared<fl::MemoryManagerDeviceInterface>();
+  deviceInterface->getActiveDeviceId = []() { return 0; };
+  deviceInterface->nativeAlloc = [](size_t bytes) {
+    return std::malloc(bytes);
+  };
+  deviceInterface->nativeFree = [](void* ptr) { std::free(ptr); };
+  fl::CachingMemoryManager manager(1, deviceInterface);
+  auto timeline = std::make_shared<fl::MemoryTimeline>();
+  manager.setTimeline(timeline);
+  ASSERT_EQ(manager.getTimeline(), timeline);
+
+  // Small blocks split from one segment
+  dim_t dims[] = {1024};
+  void* p1;
+  void* p2;
+  {
+    fl::MemoryScope scope("small");
+    p1 = manager.alloc(false, 1, dims, 1);
+    p2 = manager.alloc(false, 1, dims, 1);
+  }
+  manager.unlock(p1, false);
+  manager.unlock(p2, false);
+  manager.signalMemoryCleanup();
+
+  auto data = timeline->data();
+  auto report = fl::analyzeMemoryTimeline(data);
+  ASSERT_EQ(report.numNativeAllocs, 1);
+  ASSERT_GE(report.numSplits, 1);
+  ASSERT_GE(report.numMerges, 1);
+  ASSERT_EQ(report.peakAllocatedBytes, 2048);
+  ASSERT_EQ(report.samples.back().allocatedBytes, 0);
+  ASSERT_EQ(report.samples.back().reservedBytes, 0);
+  ASSERT_EQ(report.topScopes.size(), 1);
+  ASSERT_EQ(report.topScopes[0].scope, "small");
+  ASSERT_EQ(report.topScopes[0].allocs, 2);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  fl::init();
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/fl/common/Init.h"
+#include "flashlight/fl/memory/memory.h"
+
+using fl::MemoryEventType;
+using fl::MemoryTraceEvent;
+
+namespace {
+
+const size_t kMB = 1 << 20;
+
+std::shared_ptr<fl::MemoryManagerAdapter> makeCachingManager(
+    std::shared_ptr<fl::MemoryManagerDeviceInterface> deviceInterface) {
+  return std::make_shared<fl::CachingMemoryManager>(1, deviceInterface);
+}
+
+} // namespace
+
+TEST(MemoryTraceReplayTest, ParseLog) {
+  std::stringstream log(
+      "initialize \n"
+      "alloc 4096 1 1000 \n"
+      "allocated 1000 \n"
+      "alloc 512 0 2000 \n"
+      "unlock 1000 1 \n"
+      "signalMemoryCleanup \n");
+  auto trace = fl::parseMemoryManagerLog(log);
+  ASSERT_EQ(trace.size(), 3);
+  ASSERT_TRUE(trace[0].alloc);
+  ASSERT_EQ(trace[0].bytes, 4096);
+  ASSERT_TRUE(trace[0].userLock);
+  ASSERT_EQ(trace[0].ptr, 1000);
+  ASSERT_TRUE(trace[1].alloc);
+  ASSERT_FALSE(trace[1].userLock);
+  ASSERT_FALSE(trace[2].alloc);
+  ASSERT_EQ(trace[2].ptr, 1000);
+
+  std::stringstream invalid("alloc 4096\n");
+  ASSERT_THROW(fl::parseMemoryManagerLog(invalid), std::invalid_argument);
+}
+
+TEST(MemoryTraceReplayTest, FromTimeline) {
+  fl::MemoryTimelineData data;
+  data.scopes = {""};
+  data.events = {
+      {0, 100, 1024, 0, 0, MemoryEventType::NativeAlloc},
+      {1, 100, 512, 0, 0, MemoryEventType::Alloc},
+      {2, 900, 512, 1, 0, MemoryEventType::Alloc},
+      {3, 100, 512, 0, 0, MemoryEventType::Free}};
+  auto trace = fl::memoryTraceFromTimeline(data);
+  ASSERT_EQ(trace.size(), 2);
+  ASSERT_TRUE(trace[0].alloc);
+  ASSERT_EQ(trace[0].bytes, 512);
+  ASSERT_FALSE(trace[1].alloc);
+  ASSERT_EQ(trace[1].ptr, 100);
+  ASSERT_EQ(fl::memoryTraceFromTimeline(data, 1).size(), 1);
+}
+
+TEST(MemoryTraceReplayTest, Replay) {
+  // The second allocation reuses the cached block of the first
+  std::vector<MemoryTraceEvent> trace = {
+      {true, 1, 16 * kMB, false},
+      {false, 1, 0, false},
+      {true, 2, 16 * kMB, false},
+      {false, 2, 0, false},
+      {false, 3, 0, false}};
+  auto report = fl::replayMemoryTrace(trace, makeCachingManager);
+  ASSERT_EQ(report.numAllocs, 2);
+  ASSERT_EQ(report.numFrees, 2);
+  ASSERT_EQ(report.numUnmatchedFrees, 1);
+  ASSERT_EQ(report.numFailedAllocs, 0);
+  ASSERT_EQ(report.peakRequestedBytes, 16 * kMB);
+  ASSERT_EQ(report.peakReservedBytes, 16 * kMB);
+  ASSERT_EQ(report.numNativeAllocs, 1);
+  // Freed by shutdown()
+  ASSERT_EQ(report.numNativeFrees, 1);
+  ASSERT_GE(report.maxAllocUs, report.p50AllocUs);
+  ASSERT_DOUBLE_EQ(report.fragmentationAtPeak, 0.0);
+  ASSERT_FALSE(report.json().empty());
+
+  auto defaultReport = fl::replayMemoryTrace(
+      trace,
+      [](std::shared_ptr<fl::MemoryManagerDeviceInterface> deviceInterface) {
+        return std::make_shared<fl::DefaultMemoryManager>(
+            1, 1000, false /* debug */, deviceInterface);
+      });
+  ASSERT_EQ(defaultReport.numAllocs, 2);
+  ASSERT_EQ(defaultReport.numNativeAllocs, 1);
+  ASSERT_GE(defaultReport.peakReservedBytes, 16 * kMB);
+}
+
+TEST(MemoryTraceReplayTest, Capacity) {
+  // The second allocation doesn't fit next to the first
+  std::vector<MemoryTraceEvent> trace = {
+      {true, 1, 16 * kMB, false},
+      {true, 2, 16 * kMB, false},
+      {false, 1, 0, false},
+      {true, 3, 16 * kMB, false}};
+  auto report = fl::replayMemoryTrace(trace, makeCachingManager, 24 * kMB);
+  ASSERT_EQ(report.numAllocs, 2);
+  ASSERT_EQ(report.numFailedAllocs, 1);
+  ASSERT_EQ(report.numNativeAllocs, 1);
+  ASSERT_EQ(report.peakReservedBytes, 16 * kMB);
+
+  ASSERT_THROW(
+      fl::replayMemoryTrace(
+          trace,
+          [](std::shared_ptr<fl::MemoryManagerDeviceInterface>) {
+            return std::shared_ptr<fl::MemoryManagerAdapter>();
+          }),
+      std::invalid_argument);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  fl::init();
+  return RUN_ALL_TESTS();
+}
@@ -6,6 +6,9 @@
  */
 
 #include <array>
+#include <stdexcept>
+#include <thread>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -34,6 +37,50 @@ TEST(MeterTest, EditDistanceMeter) {
   ASSERT_EQ(meter.value()[0], 6);
 }
 
+TEST(MeterTest, EditDistanceMeterBatch) {
+  // Padded columns with their lengths, including an empty output
+  const int B = 4, Lo = 7, Lt = 6;
+  std::vector<int> output(Lo * B, -1), target(Lt * B, -1);
+  std::vector<int> outputSizes = {5, 7, 0, 3};
+  std::vector<int> targetSizes = {6, 2, 4, 3};
+  EditDistanceMeter hostMeter;
+  for (int b = 0; b < B; ++b) {
+    std::vector<int> o, t;
+    for (int i = 0; i < outputSizes[b]; ++i) {
+      o.push_back((i * 7 + b) % 3);
+      output[b * Lo + i] = o.back();
+    }
+    for (int i = 0; i < targetSizes[b]; ++i) {
+      t.push_back((i * 5 + b) % 4);
+      target[b * Lt + i] = t.back();
+    }
+    hostMeter.add(o, t);
+  }
+  EditDistanceMeter meter;
+  meter.addBatch(
+      af::array(Lo, B, output.data()),
+      af::array(Lt, B, target.data()),
+      af::array(B, outputSizes.data()),
+      af::array(B, targetSizes.data()));
+  ASSERT_EQ(meter.value(), hostMeter.value());
+  meter.add(5, 1, 1, 1);
+  hostMeter.add(5, 1, 1, 1);
+  ASSERT_EQ(meter.value(), hostMeter.value());
+  ASSERT_EQ(meter.errorRate(), hostMeter.errorRate());
+
+  // Units of 2 values: {1, 2} {3, -1} -> {1, 2} {3, 4} {3, -1}
+  std::vector<int> words = {1, 3, 2, -1};
+  std::vector<int> targetWords = {1, 3, 3, 2, 4, -1};
+  int wordSize = 2, targetWordSize = 3;
+  meter.reset();
+  meter.addBatch(
+      af::array(2, 2, 1, words.data()),
+      af::array(3, 2, 1, targetWords.data()),
+      af::array(1, &wordSize),
+      af::array(1, &targetWordSize));
+  ASSERT_EQ(meter.value(), std::vector<int64_t>({1, 3, 1, 0, 0}));
+}
+
 TEST(MeterTest, FrameErrorMeter) {
   FrameErrorMeter meter;
   std::array<int, 5> a{1, 2, 3, 4, 5};
@@ -63,6 +110,51 @@ TEST(MeterTest, AverageValueMeter) {
   ASSERT_EQ(val[2], 6.0);
 }
 
+TEST(MeterTest, AverageValueMeterWeighted) {
+  std::array<float, 4> vals{2.0, 3.0, 5.0, 7.0};
+  std::array<float, 4> weights{1.0, 2.0, 0.5, 0.0};
+  AverageValueMeter hostMeter;
+  for (int i = 0; i < vals.size(); ++i) {
+    hostMeter.add(vals[i], weights[i]);
+  }
+  AverageValueMeter deviceMeter;
+  deviceMeter.add(af::array(2, vals.data()), af::array(2, weights.data()));
+  deviceMeter.add(
+      af::array(2, vals.data() + 2), af::array(2, weights.data() + 2));
+  auto hostVal = hostMeter.value();
+  auto deviceVal = deviceMeter.value();
+  for (int i = 0; i < hostVal.size(); ++i) {
+    ASSERT_NEAR(hostVal[i], deviceVal[i], 1e-5);
+  }
+
+  deviceMeter.reset();
+  deviceMeter.add(1.0, 1.0);
+  ASSERT_EQ(deviceMeter.value()[0], 1.0);
+  ASSERT_EQ(deviceMeter.value()[2], 1.0);
+  ASSERT_THROW(
+      deviceMeter.add(af::array(2, vals.data()), af::array(1, weights.data())),
+      std::invalid_argument);
+}
+
+TEST(MeterTest, EventTimeMeter) {
+  EventTimeMeter meter(true, 2);
+  ASSERT_EQ(meter.value(), 0.0);
+  ASSERT_EQ(meter.percentile(0.5), 0.0);
+  auto a = af::randu(256, 256);
+  for (int i = 0; i < 3; ++i) {
+    meter.resume();
+    a = af::matmul(a, a) / 256;
+    meter.stopAndIncUnit();
+  }
+  ASSERT_GE(meter.value(), 0.0);
+  ASSERT_LE(meter.percentile(0.), meter.percentile(1.));
+  meter.set(6.0, 3);
+  ASSERT_EQ(meter.value(), 2.0);
+  meter.reset();
+  ASSERT_EQ(meter.value(), 0.0);
+  ASSERT_EQ(meter.percentile(1.), 0.0);
+}
+
 TEST(MeterTest, MSEMeter) {
   MSEMeter meter;
   std::array<int, 5> a{1, 2, 3, 4, 5};
@@ -81,6 +173,75 @@ TEST(MeterTest, CountMeter) {
   ASSERT_EQ(val[0], 22);
   ASSERT_EQ(val[1], 11);
   ASSERT_EQ(val[2], 0);
+
+  std::array<int, 3> counts{1, 2, 3};
+  meter.add(af::array(3, counts.data()));
+  meter.add(af::array(3, counts.data()));
+  meter.add(2, 4);
+  val = meter.value();
+  ASSERT_EQ(val[0], 24);
+  ASSERT_EQ(val[1], 15);
+  ASSERT_EQ(val[2], 10);
+  ASSERT_THROW(
+      meter.add(af::array(2, counts.data())), std::invalid_argument);
+
+  meter.reset();
+  val = meter.value();
+  ASSERT_EQ(val[0], 0);
+  ASSERT_EQ(val[2], 0);
+}
+
+TEST(MeterTest, LatencyMeter) {
+  LatencyMeter meter;
+  ASSERT_EQ(meter.percentile(0.5), 0.0);
+  // 1 to 1000 ms, from 4 threads
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&meter, t]() {
+      for (int i = t + 1; i <= 1000; i += 4) {
+        meter.add(i / 1000.);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(meter.count(), 1000);
+  ASSERT_NEAR(meter.mean(), 0.5005, 1e-9);
+  auto val = meter.value();
+  ASSERT_EQ(val.size(), 4);
+  ASSERT_NEAR(val[0], 0.5, 0.5 * 0.008);
+  ASSERT_NEAR(val[1], 0.9, 0.9 * 0.008);
+  ASSERT_NEAR(val[2], 0.99, 0.99 * 0.008);
+  ASSERT_NEAR(val[3], 0.999, 0.999 * 0.008);
+  ASSERT_NEAR(meter.percentile(0.), 0.001, 0.001 * 0.008);
+
+  // Out of range values are clamped
+  LatencyMeter other(meter);
+  other.add(0);
+  other.add(1e9, 2);
+  ASSERT_EQ(other.count(), 1003);
+  ASSERT_EQ(other.percentile(1.), 1e4);
+  ASSERT_NEAR(other.percentile(0.), 1e-6, 1e-6 * 0.008);
+
+  // Summing the states merges the meters, as over processes
+  auto state = meter.getState();
+  auto otherState = other.getState();
+  for (size_t i = 0; i < state.size(); ++i) {
+    state[i] += otherState[i];
+  }
+  LatencyMeter merged;
+  merged.set(state);
+  meter.merge(other);
+  ASSERT_EQ(merged.count(), 2003);
+  ASSERT_EQ(merged.getState(), meter.getState());
+  ASSERT_EQ(merged.value(), meter.value());
+  ASSERT_THROW(merged.set({1, 2}), std::invalid_argument);
+  ASSERT_THROW(meter.merge(LatencyMeter(1e-3)), std::invalid_argument);
+
+  meter.reset();
+  ASSERT_EQ(meter.count(), 0);
+  ASSERT_EQ(meter.percentile(1.), 0.0);
 }
 
 int main(int argc, char** argv) {
@@ -6,6 +6,7 @@
  */
 
 #include <array>
+#include <cmath>
 
 #include <gtest/gtest.h>
 
@@ -66,6 +67,41 @@ TEST(ModuleTest, EmbeddingFwd) {
   ASSERT_TRUE(allClose(emb.forward(inVar), expectedOutVar, 1E-7));
 }
 
+TEST(ModuleTest, HalfPrecisionTables) {
+  if (!fl::f16Supported()) {
+    GTEST_SKIP() << "Half-precision not supported on this device";
+  }
+  auto ids = input((af::randu(4, 3, af::dtype::u32) % 10).as(s32));
+  for (bool sparseGrad : {false, true}) {
+    auto emb = Embedding(6, 10, sparseGrad);
+    auto ref = Embedding(param(emb.param(0).array().copy()), sparseGrad);
+    emb.setWeightType(af::dtype::f16);
+    ASSERT_EQ(emb.param(0).type(), af::dtype::f16);
+    auto out = emb.forward(ids);
+    ASSERT_EQ(out.type(), af::dtype::f16);
+    ASSERT_TRUE(allClose(out.as(f32), ref.forward(ids), 1e-2));
+    out.backward();
+    ASSERT_EQ(emb.param(0).grad().type(), af::dtype::f16);
+  }
+
+  // The loss shares the weights cast by the activation
+  auto x = input(af::randu(5, 10, 2));
+  auto y = Variable((af::randu(10, 2, af::dtype::u32) % 6).as(s32), false);
+  std::vector<int> cutoff = {3, 6};
+  auto activation = std::make_shared<AdaptiveSoftMax>(5, cutoff);
+  auto loss = AdaptiveSoftMaxLoss(activation, ReduceMode::NONE);
+  auto refOut = activation->forward(x);
+  auto refLoss = loss.forward(x, y);
+  activation->setWeightType(af::dtype::f16);
+  ASSERT_EQ(loss.param(0).type(), af::dtype::f16);
+  auto out = activation->forward(x);
+  ASSERT_EQ(out.type(), af::dtype::f32);
+  ASSERT_TRUE(allClose(out, refOut, 1e-2));
+  auto lossOut = loss.forward(x, y);
+  ASSERT_EQ(lossOut.type(), af::dtype::f32);
+  ASSERT_TRUE(allClose(lossOut, refLoss, 1e-2));
+}
+
 TEST(ModuleTest, LinearFwd) {
   int n_in = 2, n_out = 3, x = 4, batchsize = 2;
   std::array<float, 6> wt = {8, 2, 2, 10, 5, 3};
@@ -342,6 +378,199 @@ TEST(ModuleTest, ConvolutionWithGroupFwd) {
   }
 }
 
+TEST(ModuleTest, ConvolutionForwardChunk) {
+  auto conv = Conv2D(6, 4, 5, 3, 2, 1, PaddingMode::SAME, 1, 1, 1, true, 1);
+  conv.eval();
+  auto input = Variable(af::randu(20, 8, 6, 2), false);
+  auto expected = conv(input);
+  ASSERT_EQ(expected.dims(0), 10);
+
+  std::vector<Variable> outputs;
+  int start = 0;
+  for (int size : {3, 7, 10}) {
+    auto output = conv.forwardChunk({input.rows(start, start + size - 1)});
+    if (!output[0].isempty()) {
+      outputs.push_back(output[0]);
+    }
+    start += size;
+  }
+  // the last output needs the right padding
+  auto streamed = concatenate(outputs, 0);
+  ASSERT_EQ(streamed.dims(0), 9);
+  ASSERT_TRUE(allClose(streamed, expected.rows(0, 8), 1E-5));
+
+  conv.resetStreamingState();
+  auto first = conv.forwardChunk({input})[0];
+  ASSERT_TRUE(allClose(first, expected.rows(0, 8), 1E-5));
+}
+
+TEST(ModuleTest, StreamingState) {
+  Sequential model;
+  model.add(Padding(std::pair<int, int>{2, 0}, 0.0));
+  model.add(Conv2D(3, 4, 3, 1));
+  model.add(ReLU());
+  model.add(WeightNorm(Conv2D(4, 2, 3, 1, 1, 1, PaddingMode::SAME), 3));
+  model.eval();
+  auto inputA = Variable(af::randu(12, 1, 3, 1), false);
+  auto inputB = Variable(af::randu(12, 1, 3, 1), false);
+  auto expectedA = model.forward(inputA), expectedB = model.forward(inputB);
+
+  // Two streams started separately, then resumed as a batch
+  std::vector<std::vector<Variable>> states;
+  for (const auto& input : {inputA, inputB}) {
+    model.resetStreamingState();
+    auto output = model.forwardChunk({input.rows(0, 4)})[0];
+    // Delayed by the right padding of the last convolution
+    ASSERT_EQ(output.dims(0), 4);
+    states.push_back(model.streamingState());
+  }
+  ASSERT_EQ(states[0].size(), 2);
+  std::vector<Variable> batchedState;
+  for (size_t i = 0; i < states[0].size(); ++i) {
+    batchedState.push_back(concatenate({states[0][i], states[1][i]}, 3));
+  }
+  model.resetStreamingState();
+  model.setStreamingState(batchedState);
+  auto output = model.forwardChunk(
+      {concatenate({inputA.rows(5, 11), inputB.rows(5, 11)}, 3)})[0];
+  ASSERT_EQ(output.dims(3), 2);
+  ASSERT_TRUE(allClose(
+      output.array()(af::span, af::span, af::span, 0),
+      expectedA.array().rows(4, 10),
+      1E-5));
+  ASSERT_TRUE(allClose(
+      output.array()(af::span, af::span, af::span, 1),
+      expectedB.array().rows(4, 10),
+      1E-5));
+  ASSERT_THROW(model.setStreamingState({}), std::invalid_argument);
+}
+
+TEST(ModuleTest, WeightNormFwd) {
+  // The fused weight against its expression with the autograd functions
+  for (int dim : {0, 3}) {
+    auto v = Variable(af::randn(4, 3, 2, 5), true);
+    af::dim4 gDims(1, 1, 1, 1);
+    gDims[dim] = v.dims(dim);
+    auto g = Variable(af::randu(gDims), true);
+    auto vRef = Variable(v.array(), true), gRef = Variable(g.array(), true);
+    auto nm = dim == 0 ? norm(vRef, {1, 2, 3}) : norm(vRef, {0, 1, 2});
+    auto expected = vRef * tileAs(gRef / nm, vRef);
+    auto weight = weightNormWeight(v, g, dim);
+    ASSERT_TRUE(allClose(weight, expected, 1E-5));
+    auto gradW = Variable(af::randn(v.dims()), false);
+    weight.backward(gradW);
+    expected.backward(gradW);
+    ASSERT_TRUE(allClose(v.grad(), vRef.grad(), 1E-4));
+    ASSERT_TRUE(allClose(g.grad(), gRef.grad(), 1E-4));
+  }
+  ASSERT_THROW(
+      weightNormWeight(Variable(af::randn(3, 3), true),
+          Variable(af::randu(1, 3), true), 1),
+      std::invalid_argument);
+
+  // The weight kept in eval mode follows updates of v and g
+  auto seq = std::make_shared<Sequential>();
+  seq->add(WeightNorm(Linear(6, 4), 0));
+  seq->add(ReLU());
+  seq->eval();
+  auto input = Variable(af::randn(6, 3), false);
+  auto output = seq->forward(input);
+  ASSERT_TRUE(allClose(seq->forward(input), output));
+  auto wn = std::dynamic_pointer_cast<WeightNorm>(seq->module(0));
+  wn->param(0).array() = wn->param(0).array() * 2 + 1;
+  auto updated = seq->forward(input);
+  ASSERT_FALSE(allClose(updated, output, 1E-3));
+  wn->param(1).array() += 1;
+  ASSERT_FALSE(allClose(seq->forward(input), updated, 1E-3));
+  output = seq->forward(input);
+
+  // Folded for export
+  auto folded = foldWeightNorm(seq);
+  ASSERT_EQ(folded, seq);
+  ASSERT_TRUE(std::dynamic_pointer_cast<Linear>(seq->module(0)));
+  ASSERT_EQ(seq->params().size(), 2);
+  ASSERT_TRUE(allClose(seq->forward(input), output, 1E-5));
+}
+
+TEST(ModuleTest, QuantizedFwd) {
+  Sequential model;
+  model.add(Conv2D(3, 8, 3, 3, 1, 1, 1, 1));
+  model.add(ReLU());
+  model.add(View(af::dim4(-1, 4)));
+  model.add(Linear(10 * 10 * 8, 6));
+  auto input = Variable(af::randn(10, 10, 3, 4), false);
+  model.eval();
+  auto expected = model(input).array();
+
+  quantize(model, [&]() { model(input); });
+  auto conv = std::dynamic_pointer_cast<Conv2D>(model.module(0));
+  ASSERT_TRUE(conv->int8Quantization());
+  ASSERT_EQ(conv->int8Quantization()->weights.type(), u8);
+  ASSERT_GT(conv->int8Quantization()->inputScale, 0);
+  auto output = model(input).array();
+  ASSERT_EQ(output.dims(), expected.dims());
+  float maxAbs = af::max<float>(af::abs(expected));
+  ASSERT_LT(af::max<float>(af::abs(output - expected)), 0.05 * maxAbs);
+
+  // Training uses the f32 weights
+  model.train();
+  ASSERT_TRUE(allClose(model(input).array(), expected, 1E-5));
+}
+
+TEST(ModuleTest, FusedFwd) {
+  auto model = std::make_shared<Sequential>();
+  model->add(Conv2D(3, 8, 3, 3, 1, 1, 1, 1, 1, 1, false));
+  model->add(BatchNorm(2, 8));
+  model->add(ReLU());
+  model->add(Dropout(0.2));
+  Sequential head;
+  head.add(View(af::dim4(-1, 4)));
+  head.add(Linear(10 * 10 * 8, 6));
+  head.add(BatchNorm(0, 6));
+  model->add(head);
+  auto input = Variable(af::randn(10, 10, 3, 4), false);
+  // Non-trivial running statistics
+  model->train();
+  for (int i = 0; i < 5; ++i) {
+    model->forward(input);
+  }
+  model->eval();
+  auto expected = model->forward(input).array();
+
+  auto fused = std::dynamic_pointer_cast<Sequential>(fuseForInference(model));
+  ASSERT_TRUE(fused);
+  // Conv2D, ReLU, View, Linear
+  ASSERT_EQ(fused->modules().size(), 4);
+  ASSERT_EQ(fused->params().size(), 4);
+  ASSERT_TRUE(allClose(fused->forward(input).array(), expected, 1E-4));
+}
+
+TEST(ModuleTest, LinearActivationFwd) {
+  auto input = Variable(af::randn(5, 4, 2), true);
+  for (bool useGelu : {false, true}) {
+    Sequential model;
+    model.add(Linear(5, 6));
+    if (useGelu) {
+      model.add(GELU());
+    } else {
+      model.add(ReLU());
+    }
+    model.add(Linear(6, 3));
+    auto hidden = model.module(0)->forward({input}).front();
+    hidden = useGelu ? gelu(hidden) : relu(hidden);
+    auto expected = model.module(2)->forward({hidden}).front();
+    expected.backward();
+    auto expectedGrad = model.param(0).grad().array();
+    model.zeroGrad();
+
+    // The first layer and its activation are fused
+    auto output = model.forward(input);
+    ASSERT_TRUE(allClose(output.array(), expected.array(), 1E-5));
+    output.backward();
+    ASSERT_TRUE(allClose(model.param(0).grad().array(), expectedGrad, 1E-5));
+  }
+}
+
 TEST(ModuleTest, PoolingFwd) {
   // test batching
   auto pool = Pool2D(9, 7, 1, 1, PaddingMode::SAME, PaddingMode::SAME);
@@ -461,6 +690,38 @@ TEST(ModuleTest, LSTMFwd) {
   ASSERT_TRUE(allClose(out, expected_outVar, 1E-4));
 }
 
+TEST(ModuleTest, VariableLengthLSTMFwd) {
+  int inputSize = 3;
+  int hiddenSize = 4;
+  int seqLength = 5;
+  std::vector<int> lengths = {5, 2, 3, 2};
+  int batchSize = lengths.size();
+
+  auto rnn = RNN(inputSize, hiddenSize, 2, RnnMode::LSTM, true);
+  rnn.eval();
+  auto in = Variable(af::randu(inputSize, batchSize, seqLength), false);
+  Variable out, hidden, cell;
+  std::tie(out, hidden, cell) = rnn.forward(
+      in, Variable(), Variable(), af::array(batchSize, lengths.data()));
+  ASSERT_EQ(out.dims(), af::dim4(2 * hiddenSize, batchSize, seqLength));
+
+  // Each sample is processed alone for its length
+  for (int b = 0; b < batchSize; ++b) {
+    Variable expectedOut, expectedHidden, expectedCell;
+    std::tie(expectedOut, expectedHidden, expectedCell) = rnn.forward(
+        in(af::span, b, af::seq(lengths[b])), Variable(), Variable());
+    ASSERT_TRUE(allClose(
+        out(af::span, b, af::seq(lengths[b])), expectedOut, 1E-5));
+    if (lengths[b] < seqLength) {
+      auto padded =
+          out.array()(af::span, b, af::seq(lengths[b], seqLength - 1));
+      ASSERT_EQ(af::max<float>(af::abs(padded)), 0);
+    }
+    ASSERT_TRUE(allClose(hidden(af::span, b), expectedHidden, 1E-5));
+    ASSERT_TRUE(allClose(cell(af::span, b), expectedCell, 1E-5));
+  }
+}
+
 TEST(ModuleTest, GRUFwd) {
   auto mode = RnnMode::GRU;
   int num_layers = 4;
@@ -654,6 +915,56 @@ TEST(ModuleTest, LayerNormFwd) {
   ASSERT_TRUE(allClose(out_train.array(), out3.array(), eps));
 }
 
+TEST(ModuleTest, LayerNormFused) {
+  int F = 16;
+  auto input = Variable(af::randn(F, 5, 3), true);
+  auto residual = Variable(af::randn(F, 5, 3), true);
+  // axes {0, 3} lead the non-singleton dimensions: fused kernels are used
+  auto fused = LayerNorm(std::vector<int>({0, 3}), 1e-5, true, F);
+  fused.setParams(Variable(af::randu(F), true), 0);
+  fused.setParams(Variable(af::randu(F), true), 1);
+  // f64 inputs are normalized by unfused operators
+  auto unfused = LayerNorm(std::vector<int>({0, 3}), 1e-5, true, F);
+  unfused.setParams(fused.param(0).as(af::dtype::f64), 0);
+  unfused.setParams(fused.param(1).as(af::dtype::f64), 1);
+
+  auto expected = unfused.forward((input + residual).as(af::dtype::f64));
+  auto out = fused.forwardResidual(input, residual);
+  ASSERT_EQ(out.type(), input.type());
+  ASSERT_TRUE(allClose(out.array(), expected.array().as(af::dtype::f32), 1e-4));
+  ASSERT_TRUE(allClose(
+      fused.forward(input + residual).array(), out.array(), 1e-5));
+  ASSERT_THROW(
+      fused.forward(Variable(af::randn(F + 1, 5), false)),
+      std::invalid_argument);
+}
+
+TEST(ModuleTest, BatchNormRelu) {
+  int C = 8;
+  auto input = Variable(af::randn(C, 5, 5, 3), true);
+  auto residual = Variable(af::randn(C, 5, 5, 3), true);
+  auto fused = BatchNorm(0, C);
+  auto unfused = BatchNorm(0, C);
+  unfused.setParams(fused.param(0), 0);
+  unfused.setParams(fused.param(1), 1);
+
+  ASSERT_TRUE(BatchNorm::fuseActivation());
+  auto out = fused.forwardRelu(input, residual);
+  BatchNorm::setFuseActivation(false);
+  auto expected = unfused.forwardRelu(input, residual);
+  BatchNorm::setFuseActivation(true);
+  ASSERT_TRUE(allClose(
+      expected.array(), relu(unfused.forward(input) + residual).array()));
+  ASSERT_TRUE(allClose(out.array(), expected.array(), 1e-5));
+
+  fused.eval();
+  unfused.eval();
+  ASSERT_TRUE(allClose(
+      fused.forwardRelu(input).array(),
+      relu(unfused.forward(input)).array(),
+      1e-5));
+}
+
 TEST_F(ModuleTestF16, LayerNormFwdF16) {
   if (!fl::f16Supported()) {
     GTEST_SKIP() << "Half-precision not supported on this device";
@@ -780,6 +1091,69 @@ TEST(ModuleTest, AdaptiveSoftMaxPredict) {
   ASSERT_TRUE(allClose(result1, result2));
 }
 
+TEST(ModuleTest, AdaptiveSoftMaxTopK) {
+  // test topK gives the same as sorting the probs
+  int N = 5;
+  int T = 10;
+  int B = 5;
+  int k = 4;
+
+  auto x = input(af::randu(N, T, B, af::dtype::f32));
+  std::vector<int> cutoff{{3, 10, 20}};
+  auto activation = std::make_shared<AdaptiveSoftMax>(N, cutoff);
+
+  auto probs = activation->forward(x).array();
+  af::array sortedValues, sortedIndices;
+  af::sort(sortedValues, sortedIndices, probs, 0, false);
+  auto result = activation->topK(x, k);
+  ASSERT_EQ(result.first.dims(), af::dim4(k, T, B));
+  ASSERT_TRUE(
+      allClose(result.first.array(), sortedValues.rows(0, k - 1), 1e-5));
+  ASSERT_TRUE(allClose(result.second.array(), sortedIndices.rows(0, k - 1)));
+
+  ASSERT_THROW(activation->topK(x, 0), std::invalid_argument);
+}
+
+TEST(ModuleTest, AdaptiveSoftMaxLossSampled) {
+  int N = 5;
+  int C = 50;
+  int T = 10;
+  int B = 5;
+
+  auto x = input(af::randu(N, T, B, af::dtype::f32));
+  auto y = Variable((af::randu(T, B, af::dtype::u32) % C).as(s32), false);
+  std::vector<int> cutoff{{2, 20, C}};
+  std::vector<double> counts(C);
+  for (int i = 0; i < C; ++i) {
+    counts[i] = C - i;
+  }
+
+  auto activation = std::make_shared<AdaptiveSoftMax>(N, cutoff);
+  auto asml = std::make_shared<AdaptiveSoftMaxLoss>(activation);
+  auto fullLoss = asml->forward(x, y).scalar<float>();
+  using Sampling = AdaptiveSoftMaxLoss::NegativeSampling;
+  for (auto sampling : {Sampling::LOG_UNIFORM, Sampling::UNIGRAM}) {
+    for (bool shared : {true, false}) {
+      asml->setSampledSoftmax(sampling, 8, shared, counts);
+      asml->train();
+      asml->zeroGrad();
+      auto loss = asml->forward(x, y);
+      ASSERT_TRUE(std::isfinite(loss.scalar<float>()));
+      loss.backward();
+      for (const auto& param : asml->params()) {
+        ASSERT_TRUE(param.isGradAvailable());
+      }
+      // the full softmax is computed in eval mode
+      asml->eval();
+      ASSERT_NEAR(asml->forward(x, y).scalar<float>(), fullLoss, 1e-5);
+    }
+  }
+
+  ASSERT_THROW(
+      asml->setSampledSoftmax(Sampling::UNIGRAM, 8, true, {}),
+      std::invalid_argument);
+}
+
 TEST(ModuleTest, AdaptiveSoftMaxLossBatchFwd) {
   // test batching
   int N = 5;
@@ -853,6 +1227,99 @@ TEST(ModuleTest, IdentityFwd) {
   ASSERT_TRUE(allClose(out.at(1), in.at(1), 1e-20));
 }
 
+TEST(ModuleTest, ModuleProfiler) {
+  Sequential seq;
+  seq.add(Linear(4, 3));
+  seq.add(ReLU());
+  seq.add(Linear(3, 2));
+  auto input = Variable(af::randu(4, 5), true);
+
+  ModuleProfiler profiler;
+  profiler.start();
+  for (int i = 0; i < 2; ++i) {
+    auto output = seq.forward(input);
+    output.backward();
+    profiler.endBackward();
+  }
+  profiler.stop();
+  // Not recorded once stopped
+  seq.forward(input);
+
+  auto profiles = profiler.profiles();
+  ASSERT_EQ(profiles.size(), 3);
+  ASSERT_EQ(profiles[0].name, seq.module(0)->prettyString());
+  ASSERT_EQ(profiles[1].name, "ReLU");
+  for (const auto& profile : profiles) {
+    ASSERT_EQ(profile.calls, 2);
+    ASSERT_EQ(profile.backwardCalls, 2);
+    ASSERT_EQ(profile.depth, 0);
+    ASSERT_GE(profile.forwardMs, 0);
+    ASSERT_GE(profile.backwardMs, 0);
+  }
+  ASSERT_EQ(profiles[0].numParams, 4 * 3 + 3);
+  ASSERT_EQ(profiles[1].numParams, 0);
+  // 2 FLOPs per weight and per input column
+  ASSERT_DOUBLE_EQ(profiles[0].flops, 2 * (2.0 * 4 * 3 * 5));
+  ASSERT_DOUBLE_EQ(profiles[1].flops, 0);
+  ASSERT_DOUBLE_EQ(profiles[2].flops, 2 * (2.0 * 3 * 2 * 5));
+  ASSERT_EQ(profiles[2].activationBytes, 2 * 5 * sizeof(float));
+
+  auto table = profiler.table(100, 1000);
+  ASSERT_NE(table.find("roof %"), std::string::npos);
+  ASSERT_NE(table.find("ReLU"), std::string::npos);
+
+  // Nested containers are recorded with their modules
+  auto nested = std::make_shared<Sequential>();
+  nested->add(std::make_shared<Sequential>(seq));
+  profiler.reset();
+  profiler.start();
+  nested->forward(input);
+  profiler.stop();
+  profiles = profiler.profiles();
+  ASSERT_EQ(profiles.size(), 4);
+  ASSERT_EQ(profiles[0].depth, 0);
+  ASSERT_EQ(profiles[1].depth, 1);
+  ASSERT_DOUBLE_EQ(profiles[0].flops, profiles[1].flops + profiles[3].flops);
+}
+
+TEST(ModuleTest, InferenceExecutor) {
+  auto inner = std::make_shared<Sequential>();
+  inner->add(Linear(3, 2));
+  inner->add(Dropout(0.5));
+  auto seq = std::make_shared<Sequential>();
+  seq->add(Linear(4, 3));
+  seq->add(ReLU());
+  seq->add(inner);
+
+  InferenceExecutor executor(seq);
+  // The nested Sequential is flattened, and dropout is disabled
+  ASSERT_EQ(executor.numSteps(), 4);
+  auto input = Variable(af::randu(4, 5), true);
+  ASSERT_EQ(executor.plan({input}), nullptr);
+  auto output = executor.forward(input);
+  ASSERT_FALSE(output.isCalcGrad());
+  ASSERT_TRUE(allClose(output, seq->forward(input)));
+
+  auto plan = executor.plan({input});
+  ASSERT_NE(plan, nullptr);
+  ASSERT_EQ(
+      plan->stepBytes,
+      (std::vector<size_t>{3 * 5 * 4, 3 * 5 * 4, 2 * 5 * 4, 2 * 5 * 4}));
+  // The input and the output of the first Linear
+  ASSERT_EQ(plan->peakBytes, 4 * 5 * 4 + 3 * 5 * 4);
+
+  // The plan is reused for the same shape class
+  ASSERT_TRUE(allClose(executor.forward(input), output));
+  ASSERT_EQ(executor.plan({input}), plan);
+  auto other = Variable(af::randu(4, 7), false);
+  ASSERT_EQ(executor.plan({other}), nullptr);
+  ASSERT_TRUE(allClose(executor.forward(other), seq->forward(other)));
+  ASSERT_NE(executor.plan({other}), nullptr);
+  ASSERT_NE(executor.plan({other}), plan);
+
+  ASSERT_THROW(InferenceExecutor(nullptr), std::invalid_argument);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   fl::init();
@@ -120,6 +120,27 @@ TEST(NNSerializationTest, Conv2D) {
   ASSERT_TRUE(allClose(conv2->forward(in), conv->forward(in)));
 }
 
+TEST(NNSerializationTest, QuantizedModules) {
+  auto model = std::make_shared<Sequential>();
+  model->add(Conv2D(2, 4, 3, 3));
+  model->add(View(af::dim4(-1, 5)));
+  model->add(Linear(6 * 6 * 4, 3));
+  auto in = input(af::randn(8, 8, 2, 5));
+  quantize(*model, [&]() { model->forward(in); });
+
+  const std::string path = fl::lib::getTmpPath("Quantized.mdl");
+  save(path, model);
+
+  std::shared_ptr<Sequential> model2;
+  load(path, model2);
+  ASSERT_TRUE(model2);
+  auto lin = std::dynamic_pointer_cast<Linear>(model2->module(2));
+  ASSERT_TRUE(lin->int8Quantization());
+
+  model2->eval();
+  ASSERT_TRUE(allClose(model2->forward(in), model->forward(in)));
+}
+
 TEST(NNSerializationTest, Pool2D) {
   auto in = input(af::randu(8, 8));
   auto pool = std::make_shared<Pool2D>(2, 3, 1, 1, 1, 1, PoolingMode::MAX);
@@ -54,6 +54,29 @@ TEST(UtilsTest, Join) {
   ASSERT_TRUE(af::allTrue<bool>(o3(af::seq(30), 2, af::seq(300)) == c));
 }
 
+TEST(UtilsTest, DropLayer) {
+  ASSERT_FALSE(dropLayer(0));
+  ASSERT_TRUE(dropLayer(1));
+
+  // The draws only depend on the seed
+  std::vector<bool> draws;
+  setLayerDropSeed(3);
+  for (int i = 0; i < 100; ++i) {
+    draws.push_back(dropLayer(0.5));
+  }
+  setLayerDropSeed(3);
+  af::randu(10);
+  int numDropped = 0;
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_FALSE(dropLayer(0));
+    bool dropped = dropLayer(0.5);
+    ASSERT_EQ(dropped, draws[i]);
+    numDropped += dropped;
+  }
+  ASSERT_GT(numDropped, 20);
+  ASSERT_LT(numDropped, 80);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   fl::init();
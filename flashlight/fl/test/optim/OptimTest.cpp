@@ -5,6 +5,8 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <functional>
+
 #include <gtest/gtest.h>
 
 #include "flashlight/fl/common/common.h"
@@ -33,6 +35,38 @@ TEST(OptimTest, GradNorm) {
   ASSERT_TRUE(allClose(af::constant(max_norm, 1), af::constant(clipped, 1)));
 }
 
+TEST(OptimTest, GradNormF32) {
+  // f32 gradients are clipped by multi-tensor kernels, if supported
+  std::vector<Variable> parameters;
+  for (int i = 0; i < 40; i++) {
+    auto dims = i % 8 == 0 ? af::dim4(300, 100) : af::dim4(10, i + 1);
+    auto v = Variable(af::constant(0, dims), true);
+    v.addGrad(Variable(af::randn(dims), false));
+    parameters.push_back(v);
+  }
+  double norm = 0.0;
+  for (auto& v : parameters) {
+    norm += af::sum<double>(v.grad().array() * v.grad().array());
+  }
+  norm = std::sqrt(norm);
+  double max_norm = 5.0;
+  ASSERT_NEAR(clipGradNorm(parameters, max_norm), norm, norm * 1e-4);
+
+  double clipped = 0.0;
+  for (auto& v : parameters) {
+    auto& g = v.grad().array();
+    clipped += af::sum<double>(g * g);
+  }
+  clipped = std::sqrt(clipped);
+  ASSERT_NEAR(clipped, max_norm, 1e-3);
+
+  // clipping again returns the clipped norm, and doesn't scale the gradients
+  auto clippedNorm = clipGradNormAsync(parameters, max_norm);
+  ASSERT_EQ(clippedNorm.elements(), 1);
+  ASSERT_NEAR(clippedNorm.scalar<float>(), max_norm, 1e-3);
+  ASSERT_NEAR(clipGradNorm(parameters, max_norm), max_norm, 1e-3);
+}
+
 TEST(OptimTest, GradNormF16) {
   if (!fl::f16Supported()) {
     GTEST_SKIP() << "Half-precision not supported on this device";
@@ -58,6 +92,341 @@ TEST(OptimTest, GradNormF16) {
       allClose(af::constant(max_norm, 1), af::constant(clipped, 1), 1e-2));
 }
 
+TEST(OptimTest, MultiTensorStep) {
+  // f32 parameters are updated by multi-tensor kernels (if supported by the
+  // backend) and f64 ones by per-tensor operators. Some parameters span
+  // several chunks and there are more parameters than tensors per launch.
+  std::vector<Variable> params32, params64;
+  for (int i = 0; i < 50; i++) {
+    auto dims = i % 10 == 0 ? af::dim4(200, 150) : af::dim4(i + 1, 3);
+    params32.push_back(Variable(af::randn(dims), true));
+    params64.push_back(params32.back().as(af::dtype::f64));
+  }
+  // no gradient for the last parameter
+  std::vector<af::array> grads;
+  for (int i = 0; i < params32.size() - 1; i++) {
+    grads.push_back(af::randn(params32[i].dims()));
+  }
+
+  using OptimizerFactory =
+      std::function<std::shared_ptr<FirstOrderOptimizer>(
+          const std::vector<Variable>&)>;
+  std::vector<OptimizerFactory> factories = {
+      [](const std::vector<Variable>& p) {
+        return std::make_shared<AdamOptimizer>(p, 0.01, 0.9, 0.999, 1e-8, 0.1);
+      },
+      [](const std::vector<Variable>& p) {
+        return std::make_shared<AMSgradOptimizer>(
+            p, 0.01, 0.9, 0.999, 1e-8, 0.1);
+      },
+      [](const std::vector<Variable>& p) {
+        return std::make_shared<SGDOptimizer>(p, 0.1, 0.0, 0.1);
+      },
+      [](const std::vector<Variable>& p) {
+        return std::make_shared<SGDOptimizer>(p, 0.1, 0.9, 0.1);
+      },
+      [](const std::vector<Variable>& p) {
+        return std::make_shared<SGDOptimizer>(p, 0.1, 0.9, 0.1, true);
+      },
+      [](const std::vector<Variable>& p) {
+        return std::make_shared<NovogradOptimizer>(
+            p, 0.01, 0.9, 0.999, 1e-8, 0.1);
+      }};
+  for (const auto& factory : factories) {
+    std::vector<Variable> p32, p64;
+    for (int i = 0; i < params32.size(); i++) {
+      p32.push_back(Variable(params32[i].array().copy(), true));
+      p64.push_back(Variable(params64[i].array().copy(), true));
+    }
+    auto opt32 = factory(p32);
+    auto opt64 = factory(p64);
+    for (int step = 0; step < 3; step++) {
+      opt32->zeroGrad();
+      opt64->zeroGrad();
+      for (int i = 0; i < grads.size(); i++) {
+        p32[i].addGrad(Variable(grads[i] * (step + 1), false));
+        p64[i].addGrad(Variable((grads[i] * (step + 1)).as(f64), false));
+      }
+      opt32->step();
+      opt64->step();
+    }
+    for (int i = 0; i < params32.size(); i++) {
+      ASSERT_TRUE(allClose(p32[i].array(), p64[i].array().as(f32), 1e-4))
+          << opt32->prettyString() << ", parameter " << i;
+    }
+    ASSERT_TRUE(allClose(p32.back().array(), params32.back().array()));
+  }
+}
+
+TEST(OptimTest, SparseStep) {
+  // A sparse gradient gives the same update as its dense array when the
+  // slices without gradient are not decayed and have no moments yet
+  af::array indices(4, std::vector<int>{7, 2, 7, 0}.data());
+  for (int dim = 0; dim < 2; dim++) {
+    auto dims = dim == 0 ? af::dim4(10, 6) : af::dim4(6, 10);
+    auto valuesDims = dim == 0 ? af::dim4(4, 6) : af::dim4(6, 4);
+    auto values = af::randn(valuesDims);
+    auto init = af::randn(dims);
+
+    std::vector<std::function<std::shared_ptr<FirstOrderOptimizer>(
+        const std::vector<Variable>&)>>
+        factories = {
+            [](const std::vector<Variable>& p) {
+              return std::make_shared<AdamOptimizer>(p, 0.01);
+            },
+            [](const std::vector<Variable>& p) {
+              return std::make_shared<SGDOptimizer>(p, 0.1, 0.9, 0.0, true);
+            }};
+    for (const auto& factory : factories) {
+      std::vector<Variable> sparse = {Variable(init.copy(), true)};
+      std::vector<Variable> dense = {Variable(init.copy(), true)};
+      auto sparseOpt = factory(sparse);
+      auto denseOpt = factory(dense);
+      for (int step = 0; step < 2; step++) {
+        sparseOpt->zeroGrad();
+        denseOpt->zeroGrad();
+        auto grad = Variable::sparse(values, indices, dim, dims);
+        sparse[0].addGrad(grad);
+        dense[0].addGrad(grad.toDense());
+        ASSERT_TRUE(sparse[0].isGradSparse());
+        sparseOpt->step();
+        denseOpt->step();
+      }
+      ASSERT_TRUE(allClose(sparse[0].array(), dense[0].array(), 1e-5))
+          << sparseOpt->prettyString();
+      // slices 1 and 3 are not updated
+      auto& data = sparse[0].array();
+      af::array untouched = dim == 0 ? init(af::seq(1, 3, 2), af::span)
+                                     : init(af::span, af::seq(1, 3, 2));
+      af::array result = dim == 0 ? data(af::seq(1, 3, 2), af::span)
+                                  : data(af::span, af::seq(1, 3, 2));
+      ASSERT_TRUE(allClose(result, untouched));
+    }
+  }
+}
+
+TEST(OptimTest, GradNormSparse) {
+  auto v = Variable(af::constant(0, 6, 10), true);
+  af::array indices(3, std::vector<int>{4, 1, 4}.data());
+  v.addGrad(Variable::sparse(af::constant(1, 6, 3), indices, 1, v.dims()));
+  // the repeated slice is summed
+  double norm = std::sqrt(6 * 4 + 6);
+  ASSERT_NEAR(clipGradNorm({v}, 1.0), norm, norm * 1e-4);
+  ASSERT_TRUE(v.isGradSparse());
+  ASSERT_NEAR(af::sum<double>(v.grad().array() * v.grad().array()), 1, 1e-4);
+}
+
+TEST(OptimTest, DynamicScaler) {
+  DynamicScaler scaler(8, 32, 2);
+  auto v = Variable(af::constant(0, 5, 5), true);
+  auto loss = scaler.scale(sum(v + 1, {0, 1}));
+  ASSERT_FLOAT_EQ(loss.scalar<float>(), 8 * 25);
+  loss.backward();
+  ASSERT_TRUE(scaler.unscale({v}, 2));
+  ASSERT_TRUE(allClose(v.grad().array(), af::constant(0.5, 5, 5)));
+
+  // doubled after 2 steps without overflow, up to the maximum
+  ASSERT_TRUE(scaler.update(false));
+  ASSERT_DOUBLE_EQ(scaler.getScaleFactor(), 16);
+  scaler.update(false);
+  scaler.update(false);
+  ASSERT_DOUBLE_EQ(scaler.getScaleFactor(), 32);
+
+  // halved on overflow
+  v.zeroGrad();
+  v.addGrad(Variable(af::constant(af::Inf, 5, 5), false));
+  ASSERT_FALSE(scaler.unscale({v}));
+  ASSERT_DOUBLE_EQ(scaler.getScaleFactor(), 16);
+
+  scaler.setScaleFactor(kAmpMinimumScaleFactorValue);
+  ASSERT_THROW(scaler.update(true), std::runtime_error);
+}
+
+TEST(OptimTest, QuantizedState) {
+  // 3 blocks, the last one partial, and a block of zeros
+  auto x = af::randn(100, 50);
+  x(af::seq(2048, 4095)) = 0;
+  auto y = x * x;
+  auto signedState = QuantizedState::quantize(x, true);
+  auto unsignedState = QuantizedState::quantize(y, false);
+  ASSERT_EQ(signedState.codes.type(), u8);
+  ASSERT_EQ(signedState.codes.dims(), x.dims());
+  ASSERT_EQ(signedState.scales.elements(), 3);
+  ASSERT_TRUE(allClose(
+      signedState.dequantize(), x, 0.01 * af::max<float>(af::abs(x))));
+  ASSERT_TRUE(
+      allClose(unsignedState.dequantize(), y, 0.01 * af::max<float>(y)));
+  ASSERT_EQ(
+      af::max<float>(af::abs(signedState.dequantize()(af::seq(2048, 4095)))),
+      0);
+  // Small values keep their order of magnitude
+  auto small = QuantizedState::quantize(
+      af::join(0, af::constant(1, 1), af::constant(1e-6, 9)), false);
+  ASSERT_GT(af::min<float>(small.dequantize()), 0.5e-6);
+
+  QuantizedState zeros(af::dim4(3, 4), true);
+  ASSERT_EQ(zeros.dequantize().dims(), af::dim4(3, 4));
+  ASSERT_EQ(af::max<float>(af::abs(zeros.dequantize())), 0);
+}
+
+TEST(OptimTest, QuantizedStatesStep) {
+  // 8-bit moments stay close to the f32 ones, for f32 parameters (updated
+  // by fused kernels, if supported by the backend) and f64 ones
+  std::vector<af::array> weights, grads;
+  for (int i = 0; i < 5; i++) {
+    auto dims = i % 2 == 0 ? af::dim4(200, 150) : af::dim4(i + 1, 3);
+    weights.push_back(af::randn(dims));
+    grads.push_back(af::randn(dims));
+  }
+  const float lr = 0.01;
+  for (auto type : {f32, f64}) {
+    for (bool amsgrad : {false, true}) {
+      std::vector<Variable> p, pq;
+      for (const auto& w : weights) {
+        p.push_back(Variable(w.as(type), true));
+        pq.push_back(Variable(w.as(type), true));
+      }
+      std::shared_ptr<FirstOrderOptimizer> opt, optq;
+      if (amsgrad) {
+        opt = std::make_shared<AMSgradOptimizer>(p, lr, 0.9, 0.999, 1e-8, 0.1);
+        optq = std::make_shared<AMSgradOptimizer>(
+            pq, lr, 0.9, 0.999, 1e-8, 0.1, true);
+      } else {
+        opt = std::make_shared<AdamOptimizer>(p, lr, 0.9, 0.999, 1e-8, 0.1);
+        optq = std::make_shared<AdamOptimizer>(
+            pq, lr, 0.9, 0.999, 1e-8, 0.1, true);
+      }
+      ASSERT_TRUE(optq->getStateArrays().empty());
+      for (int step = 0; step < 3; step++) {
+        opt->zeroGrad();
+        optq->zeroGrad();
+        for (int i = 0; i < grads.size(); i++) {
+          auto g = (grads[i] * (step + 1)).as(type);
+          p[i].addGrad(Variable(g, false));
+          pq[i].addGrad(Variable(g, false));
+        }
+        opt->step();
+        optq->step();
+      }
+      for (int i = 0; i < p.size(); i++) {
+        auto diff = af::abs(p[i].array() - pq[i].array());
+        ASSERT_LT(af::max<double>(diff), 2 * lr) << optq->prettyString();
+        ASSERT_LT(af::mean<double>(diff), 0.1 * lr) << optq->prettyString();
+      }
+    }
+  }
+}
+
+TEST(OptimTest, OffloadedAdam) {
+  // Parameters spanning several buckets of 1000 elements, or sharing one
+  std::vector<af::array> weights, grads;
+  for (int i = 0; i < 6; i++) {
+    auto dims = i % 3 == 0 ? af::dim4(50, 45) : af::dim4(i + 1, 3);
+    weights.push_back(af::randn(dims));
+    grads.push_back(af::randn(dims));
+  }
+  for (bool hooks : {false, true}) {
+    std::vector<Variable> p, po;
+    for (const auto& w : weights) {
+      p.push_back(Variable(w.copy(), true));
+      po.push_back(Variable(w.copy(), true));
+    }
+    AdamOptimizer opt(p, 0.01, 0.9, 0.999, 1e-8, 0.1);
+    OffloadedAdamOptimizer offloaded(
+        po, 0.01, 0.9, 0.999, 1e-8, 0.1, 3, 1000 * sizeof(float));
+    if (hooks) {
+      offloaded.registerGradHooks();
+    }
+    for (int step = 0; step < 3; step++) {
+      opt.zeroGrad();
+      offloaded.zeroGrad();
+      // No gradient for the last parameter at the first step
+      int numGrads = step == 0 ? grads.size() - 1 : grads.size();
+      auto loss = Variable(af::constant(0, 1), false);
+      for (int i = 0; i < numGrads; i++) {
+        auto g = grads[i] * (step + 1);
+        p[i].addGrad(Variable(g, false));
+        loss = loss + sum(po[i] * Variable(g, false), {0, 1});
+      }
+      // The backward pass sets the gradients of `po`, and calls the hooks
+      loss.backward();
+      opt.step();
+      offloaded.step();
+    }
+    for (int i = 0; i < p.size(); i++) {
+      ASSERT_TRUE(allClose(p[i].array(), po[i].array(), 1e-5))
+          << "parameter " << i << (hooks ? " with hooks" : "");
+    }
+  }
+}
+
+TEST(OptimTest, MasterWeights) {
+  if (!fl::f16Supported()) {
+    GTEST_SKIP() << "Half-precision not supported on this device";
+  }
+  // f16 parameters, with dense and sparse gradients, and an f32 parameter
+  std::vector<af::array> weights = {
+      af::randn(4, 6), af::randn(3, 5), af::randn(7)};
+  std::vector<Variable> p, pm;
+  for (size_t i = 0; i < weights.size(); i++) {
+    auto type = i < 2 ? af::dtype::f16 : af::dtype::f32;
+    auto w = weights[i].as(type);
+    p.push_back(Variable(w.as(f32), true));
+    pm.push_back(Variable(w, true));
+  }
+  auto createAdam = [](const std::vector<Variable>& params) {
+    return std::make_shared<AdamOptimizer>(params, 0.01);
+  };
+  AdamOptimizer opt(p, 0.01);
+  MasterWeightsOptimizer masterOpt(pm, createAdam);
+  auto indices = af::array(af::dim4(2), std::vector<int>{1, 3}.data());
+  for (int step = 0; step < 3; step++) {
+    opt.zeroGrad();
+    masterOpt.zeroGrad();
+    for (size_t i = 0; i < weights.size(); i++) {
+      if (i == 1) {
+        auto slices = af::randn(3, 2).as(f16);
+        p[i].addGrad(Variable::sparse(slices.as(f32), indices, 1, p[i].dims()));
+        pm[i].addGrad(Variable::sparse(slices, indices, 1, pm[i].dims()));
+      } else {
+        auto g = af::randn(weights[i].dims()).as(pm[i].type());
+        p[i].addGrad(Variable(g.as(f32), false));
+        pm[i].addGrad(Variable(g, false));
+      }
+    }
+    opt.step();
+    masterOpt.step();
+  }
+  const auto& masters = masterOpt.getMasterWeights();
+  for (size_t i = 0; i < weights.size(); i++) {
+    // The updates accumulate in f32
+    ASSERT_EQ(masters[i].type(), af::dtype::f32);
+    ASSERT_TRUE(allClose(masters[i].array(), p[i].array(), 1e-5));
+    ASSERT_EQ(pm[i].type(), i < 2 ? af::dtype::f16 : af::dtype::f32);
+    ASSERT_TRUE(allClose(pm[i].array().as(f32), p[i].array(), 1e-2));
+  }
+
+  // The master weights of the same archive are the ones of the parameters
+  const std::string path = fl::lib::getTmpPath("masterweights.bin");
+  std::shared_ptr<FirstOrderOptimizer> saved =
+      std::make_shared<MasterWeightsOptimizer>(pm, createAdam);
+  save(path, pm, saved);
+  std::vector<Variable> loadedParams;
+  std::shared_ptr<FirstOrderOptimizer> loaded;
+  load(path, loadedParams, loaded);
+  auto loadedMasters =
+      std::dynamic_pointer_cast<MasterWeightsOptimizer>(loaded);
+  ASSERT_TRUE(loadedMasters);
+  auto before = loadedParams[1].array().as(f32);
+  loadedParams[1].addGrad(Variable(af::constant(1, 3, 5, f16), false));
+  loadedMasters->step();
+  ASSERT_FALSE(allClose(loadedParams[1].array().as(f32), before, 1e-3));
+  ASSERT_TRUE(allClose(
+      loadedParams[1].array().as(f32),
+      loadedMasters->getMasterWeights()[1].array(),
+      1e-2));
+}
+
 TEST(SerializationTest, OptimizerSerialize) {
   char* user = getenv("USER");
   std::string userstr = "unknown";
@@ -95,6 +464,45 @@ TEST(SerializationTest, OptimizerSerialize) {
     ASSERT_TRUE(allClose(parameters[i].array(), parameters2[i].array()));
   }
 
+  // 8-bit states are saved quantized
+  opt = std::make_shared<AdamOptimizer>(
+      parameters, 0.0001, 0.9, 0.999, 1e-8, 0, true);
+  opt->step();
+
+  save(
+      path, parameters, static_cast<std::shared_ptr<FirstOrderOptimizer>>(opt));
+  load(path, parameters2, opt2);
+  ASSERT_EQ(opt2->prettyString(), opt->prettyString());
+
+  for (int i = 0; i < 5; i++) {
+    parameters2[i].addGrad(Variable(parameters[i].grad().array(), false));
+  }
+
+  opt->step();
+  opt2->step();
+
+  for (int i = 0; i < 5; i++) {
+    ASSERT_TRUE(allClose(parameters[i].array(), parameters2[i].array()));
+  }
+
+  opt = std::make_shared<OffloadedAdamOptimizer>(parameters, 0.0001);
+  opt->step();
+
+  save(
+      path, parameters, static_cast<std::shared_ptr<FirstOrderOptimizer>>(opt));
+  load(path, parameters2, opt2);
+
+  for (int i = 0; i < 5; i++) {
+    parameters2[i].addGrad(Variable(parameters[i].grad().array(), false));
+  }
+
+  opt->step();
+  opt2->step();
+
+  for (int i = 0; i < 5; i++) {
+    ASSERT_TRUE(allClose(parameters[i].array(), parameters2[i].array()));
+  }
+
   opt = std::make_shared<NovogradOptimizer>(parameters, 0.01);
   opt->step();
 
@@ -32,6 +32,11 @@ Dct::Dct(int numfilters, int numceps)
 std::vector<float> Dct::apply(const std::vector<float>& input) const {
   return cblasGemm(input, dctMat_, numCeps_, numFilters_);
 }
+
+void Dct::apply(const std::vector<float>& input, std::vector<float>& output)
+    const {
+  cblasGemm(input, dctMat_, numCeps_, numFilters_, output);
+}
 } // namespace audio
 } // namespace lib
 } // namespace fl
@@ -24,6 +24,11 @@ class Dct {
 
   std::vector<float> apply(const std::vector<float>& input) const;
 
+  // Same as above, writes into `output` (resized) so that a buffer can be
+  // reused across calls
+  void apply(const std::vector<float>& input, std::vector<float>& output)
+      const;
+
  private:
   int numFilters_; // Number of filterbank channels
   int numCeps_; // Number of cepstral coefficients
@@ -7,6 +7,7 @@
 
 #include "flashlight/lib/audio/feature/Derivatives.h"
 
+#include <algorithm>
 #include <cstddef>
 #include <stdexcept>
 
@@ -21,23 +22,27 @@ Derivatives::Derivatives(int deltawindow, int accwindow)
 
 std::vector<float> Derivatives::apply(
     const std::vector<float>& input,
-    int numfeat) const {
+    int numfeat,
+    int batchSz /* = 1 */) const {
   if (input.size() % numfeat != 0) {
     throw std::invalid_argument(
         "Derivatives: input size is not divisible by numFeatures");
+  } else if (batchSz <= 0 || input.size() % (numfeat * batchSz) != 0) {
+    throw std::invalid_argument(
+        "Derivatives: input size is not divisible by batchSz");
   }
   // Compute deltas
   if (deltaWindow_ <= 0) {
     return input;
   }
 
-  auto deltas = computeDerivative(input, deltaWindow_, numfeat);
+  auto deltas = computeDerivative(input, deltaWindow_, numfeat, batchSz);
   size_t szMul = 2;
   std::vector<float> doubledeltas;
   if (accWindow_ > 0) {
     // Compute double deltas (only if required)
     szMul = 3;
-    doubledeltas = computeDerivative(deltas, accWindow_, numfeat);
+    doubledeltas = computeDerivative(deltas, accWindow_, numfeat, batchSz);
   }
   std::vector<float> output(input.size() * szMul);
   int numframes = input.size() / numfeat;
@@ -68,19 +73,28 @@ std::vector<float> Derivatives::apply(
 std::vector<float> Derivatives::computeDerivative(
     const std::vector<float>& input,
     int windowlen,
-    int numfeat) const {
-  int numframes = input.size() / numfeat;
+    int numfeat,
+    int batchSz) const {
+  int numframes = input.size() / (numfeat * batchSz);
   std::vector<float> output(input.size(), 0.0);
   float denominator = (windowlen * (windowlen + 1) * (2 * windowlen + 1)) / 3.0;
-  for (size_t i = 0; i < numframes; ++i) {
-    for (size_t j = 0; j < numfeat; ++j) {
-      size_t curIdx = i * numfeat + j;
-      for (size_t d = 1; d <= windowlen; ++d) {
-        output[curIdx] += d *
-            (input[curIdx + std::min((numframes - i - 1), d) * numfeat] -
-             input[curIdx - std::min(i, d) * numfeat]);
+  // Whole frames are accumulated at once, so that the inner loop runs over
+  // contiguous features
+  for (int b = 0; b < batchSz; ++b) {
+    const float* in = input.data() + b * numframes * numfeat;
+    float* out = output.data() + b * numframes * numfeat;
+    for (int i = 0; i < numframes; ++i) {
+      float* curOut = out + i * numfeat;
+      for (int d = 1; d <= windowlen; ++d) {
+        const float* next = in + std::min(i + d, numframes - 1) * numfeat;
+        const float* prev = in + std::max(i - d, 0) * numfeat;
+        for (int j = 0; j < numfeat; ++j) {
+          curOut[j] += d * (next[j] - prev[j]);
+        }
+      }
+      for (int j = 0; j < numfeat; ++j) {
+        curOut[j] /= denominator;
       }
-      output[curIdx] /= denominator;
     }
   }
   return output;
@@ -23,7 +23,14 @@ class Derivatives {
  public:
   Derivatives(int deltawindow, int accwindow);
 
-  std::vector<float> apply(const std::vector<float>& input, int numfeat) const;
+  // input - features (Col Major : FEAT X FRAMESZ X BATCHSZ), the window of a
+  //   frame is clamped to the frames of its own batch item
+  // Returns - features followed by their derivatives for each frame
+  //   (Col Major : (FEAT * (1 + #orders)) X FRAMESZ X BATCHSZ)
+  std::vector<float> apply(
+      const std::vector<float>& input,
+      int numfeat,
+      int batchSz = 1) const;
 
  private:
   int deltaWindow_; // delta derivatives lag size
@@ -33,7 +40,8 @@ class Derivatives {
   std::vector<float> computeDerivative(
       const std::vector<float>& input,
       int windowlen,
-      int numfeat) const;
+      int numfeat,
+      int batchSz) const;
 };
 } // namespace audio
 } // namespace lib
@@ -8,6 +8,7 @@
 #include "flashlight/lib/audio/feature/Mfcc.h"
 
 #include <cstddef>
+#include <stdexcept>
 
 #include "flashlight/lib/audio/feature/SpeechUtils.h"
 
@@ -23,12 +24,9 @@ Mfcc::Mfcc(const FeatureParams& params)
   validateMfccParams();
 }
 
-std::vector<float> Mfcc::apply(const std::vector<float>& input) {
-  auto frames = frameSignal(input, this->featParams_);
-  if (frames.empty()) {
-    return {};
-  }
-
+std::vector<float> Mfcc::applyFrames(
+    std::vector<float>& frames,
+    int batchSz) {
   int nSamples = this->featParams_.numFrameSizeSamples();
   int nFrames = frames.size() / nSamples;
 
@@ -40,8 +38,10 @@ std::vector<float> Mfcc::apply(const std::vector<float>& input) {
           std::log(std::inner_product(begin, begin + nSamples, begin, 0.0));
     }
   }
-  auto mfscfeat = this->mfscImpl(frames);
-  auto cep = dct_.apply(mfscfeat);
+  // Intermediate buffers of the calling thread, reused across calls
+  thread_local std::vector<float> mfscfeat, cep;
+  this->mfscImpl(frames, mfscfeat);
+  dct_.apply(mfscfeat, cep);
   ceplifter_.applyInPlace(cep);
 
   auto nFeat = this->featParams_.numCepstralCoeffs;
@@ -58,7 +58,7 @@ std::vector<float> Mfcc::apply(const std::vector<float>& input) {
       cep[f * nFeat] = energy[f];
     }
   }
-  return derivatives_.apply(cep, nFeat);
+  return derivatives_.apply(cep, nFeat, batchSz);
 }
 
 int Mfcc::outputSize(int inputSz) {
@@ -57,12 +57,15 @@ class Mfcc : public Mfsc {
 
   virtual ~Mfcc() override {}
 
-  // input - input speech signal (T)
-  // Returns - MFCC features (Col Major : FEAT X FRAMESZ)
-  std::vector<float> apply(const std::vector<float>& input) override;
+  // apply() and batchApply() return MFCC features
+  // (Col Major : FEAT X FRAMESZ [X BATCHSZ])
 
   int outputSize(int inputSz) override;
 
+ protected:
+  std::vector<float> applyFrames(std::vector<float>& frames, int batchSz)
+      override;
+
  private:
   // The following classes are defined in the order they are applied
   Dct dct_;
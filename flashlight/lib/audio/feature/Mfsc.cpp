@@ -10,6 +10,7 @@
 #include <algorithm>
 #include <cstddef>
 #include <numeric>
+#include <stdexcept>
 
 #include "flashlight/lib/audio/feature/SpeechUtils.h"
 
@@ -30,12 +31,9 @@ Mfsc::Mfsc(const FeatureParams& params)
   validateMfscParams();
 }
 
-std::vector<float> Mfsc::apply(const std::vector<float>& input) {
-  auto frames = frameSignal(input, this->featParams_);
-  if (frames.empty()) {
-    return {};
-  }
-
+std::vector<float> Mfsc::applyFrames(
+    std::vector<float>& frames,
+    int batchSz) {
   int nSamples = this->featParams_.numFrameSizeSamples();
   int nFrames = frames.size() / nSamples;
 
@@ -74,11 +72,19 @@ std::vector<float> Mfsc::apply(const std::vector<float>& input) {
     ++numFeat;
   }
   // Derivatives will not be computed if windowsize < 0
-  return derivatives_.apply(mfscFeat, numFeat);
+  return derivatives_.apply(mfscFeat, numFeat, batchSz);
 }
 
 std::vector<float> Mfsc::mfscImpl(std::vector<float>& frames) {
-  auto powspectrum = this->powSpectrumImpl(frames);
+  std::vector<float> triflt;
+  mfscImpl(frames, triflt);
+  return triflt;
+}
+
+void Mfsc::mfscImpl(std::vector<float>& frames, std::vector<float>& output) {
+  // Intermediate buffer of the calling thread, reused across calls
+  thread_local std::vector<float> powspectrum;
+  this->powSpectrumImpl(frames, powspectrum);
   if (this->featParams_.usePower) {
     std::transform(
         powspectrum.begin(),
@@ -86,11 +92,10 @@ std::vector<float> Mfsc::mfscImpl(std::vector<float>& frames) {
         powspectrum.begin(),
         [](float x) { return x * x; });
   }
-  auto triflt = triFltBank_.apply(powspectrum, this->featParams_.melFloor);
-  std::transform(triflt.begin(), triflt.end(), triflt.begin(), [](float x) {
+  triFltBank_.apply(powspectrum, output, this->featParams_.melFloor);
+  std::transform(output.begin(), output.end(), output.begin(), [](float x) {
     return std::log(x);
   });
-  return triflt;
 }
 
 int Mfsc::outputSize(int inputSz) {
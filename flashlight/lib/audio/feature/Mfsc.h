@@ -25,16 +25,22 @@ class Mfsc : public PowerSpectrum {
 
   virtual ~Mfsc() override {}
 
-  // input - input speech signal (T)
-  // Returns - MFSC feature (Col Major : FEAT X FRAMESZ)
-  std::vector<float> apply(const std::vector<float>& input) override;
+  // apply() and batchApply() return MFSC features
+  // (Col Major : FEAT X FRAMESZ [X BATCHSZ])
 
   int outputSize(int inputSz) override;
 
  protected:
+  std::vector<float> applyFrames(std::vector<float>& frames, int batchSz)
+      override;
+
   // Helper function which takes input as signal after dividing the signal into
   // frames. Main purpose of this function is to reuse it in MFCC code
   std::vector<float> mfscImpl(std::vector<float>& frames);
+
+  // Same as above, writes into `output` (resized) so that a buffer can be
+  // reused across calls
+  void mfscImpl(std::vector<float>& frames, std::vector<float>& output);
   void validateMfscParams() const;
 
  private:
@@ -11,7 +11,9 @@
 
 #include <algorithm>
 #include <cstddef>
-#include <unordered_map>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
 
 #include "flashlight/lib/audio/feature/SpeechUtils.h"
 
@@ -19,17 +21,71 @@ namespace fl {
 namespace lib {
 namespace audio {
 
+namespace {
+
+// Number of frames transformed by a single execution of the batched plan
+constexpr int kFftBatchSize = 32;
+
+// Creating a plan is not thread-safe in FFTW, while executing one is
+std::mutex& fftwPlannerMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+// FFT buffers of a thread, grown on demand and reused by every featurizer
+// running on that thread
+struct FftArena {
+  double* in{nullptr};
+  fftw_complex* out{nullptr};
+  size_t inSize{0};
+  size_t outSize{0};
+
+  ~FftArena() {
+    fftw_free(in);
+    fftw_free(out);
+  }
+
+  void reserve(size_t nIn, size_t nOut) {
+    if (nIn > inSize) {
+      fftw_free(in);
+      in = fftw_alloc_real(nIn);
+      inSize = nIn;
+    }
+    if (nOut > outSize) {
+      fftw_free(out);
+      out = fftw_alloc_complex(nOut);
+      outSize = nOut;
+    }
+  }
+};
+
+thread_local FftArena fftArena;
+
+} // namespace
+
 PowerSpectrum::PowerSpectrum(const FeatureParams& params)
     : featParams_(params),
       dither_(params.ditherVal),
       preEmphasis_(params.preemCoef, params.numFrameSizeSamples()),
       windowing_(params.numFrameSizeSamples(), params.windowType) {
   validatePowSpecParams();
-  auto nFFt = featParams_.nFft();
-  inFftBuf_.resize(nFFt, 0.0);
-  outFftBuf_.resize(2 * nFFt);
-  fftPlan_ = std::make_unique<fftw_plan>(fftw_plan_dft_r2c_1d(
-      nFFt, inFftBuf_.data(), (fftw_complex*)outFftBuf_.data(), FFTW_MEASURE));
+  int nFft = featParams_.nFft();
+  int K = featParams_.filterFreqResponseLen();
+  // FFTW_MEASURE overwrites the buffers, which are only used for planning:
+  // plans are executed on the arena of the calling thread, whose buffers are
+  // allocated by FFTW as well and have the same alignment.
+  auto in = fftw_alloc_real(kFftBatchSize * nFft);
+  auto out = fftw_alloc_complex(kFftBatchSize * K);
+  {
+    std::lock_guard<std::mutex> lock(fftwPlannerMutex());
+    fftPlan_ = std::make_unique<fftw_plan>(
+        fftw_plan_dft_r2c_1d(nFft, in, out, FFTW_MEASURE));
+    fftBatchPlan_ = std::make_unique<fftw_plan>(fftw_plan_many_dft_r2c(
+        1, &nFft, kFftBatchSize, in, nullptr, 1, nFft, out, nullptr, 1, K,
+        FFTW_MEASURE));
+  }
+  fftw_free(in);
+  fftw_free(out);
 }
 
 std::vector<float> PowerSpectrum::apply(const std::vector<float>& input) {
@@ -37,10 +93,24 @@ std::vector<float> PowerSpectrum::apply(const std::vector<float>& input) {
   if (frames.empty()) {
     return {};
   }
+  return applyFrames(frames, 1);
+}
+
+std::vector<float> PowerSpectrum::applyFrames(
+    std::vector<float>& frames,
+    int /* batchSz */) {
   return powSpectrumImpl(frames);
 }
 
 std::vector<float> PowerSpectrum::powSpectrumImpl(std::vector<float>& frames) {
+  std::vector<float> dft;
+  powSpectrumImpl(frames, dft);
+  return dft;
+}
+
+void PowerSpectrum::powSpectrumImpl(
+    std::vector<float>& frames,
+    std::vector<float>& output) {
   int nSamples = featParams_.numFrameSizeSamples();
   int nFrames = frames.size() / nSamples;
   int nFft = featParams_.nFft();
@@ -62,29 +132,40 @@ std::vector<float> PowerSpectrum::powSpectrumImpl(std::vector<float>& frames) {
     preEmphasis_.applyInPlace(frames);
   }
   windowing_.applyInPlace(frames);
-  std::vector<float> dft(K * nFrames);
-  for (size_t f = 0; f < nFrames; ++f) {
-    auto begin = frames.data() + f * nSamples;
-    {
-      std::lock_guard<std::mutex> lock(fftMutex_);
-      std::copy(begin, begin + nSamples, inFftBuf_.data());
-      std::fill(outFftBuf_.begin(), outFftBuf_.end(), 0.0);
-      fftw_execute(*fftPlan_);
-
-      // Copy stuff to the redundant part
-      for (size_t i = K; i < nFft; ++i) {
-        outFftBuf_[2 * i] = outFftBuf_[2 * nFft - 2 * i];
-        outFftBuf_[2 * i + 1] = -outFftBuf_[2 * nFft - 2 * i + 1];
-      }
-
-      for (size_t i = 0; i < K; ++i) {
-        dft[f * K + i] = std::sqrt(
-            outFftBuf_[2 * i] * outFftBuf_[2 * i] +
-            outFftBuf_[2 * i + 1] * outFftBuf_[2 * i + 1]);
-      }
+
+  output.resize(K * nFrames);
+  fftArena.reserve(kFftBatchSize * nFft, kFftBatchSize * K);
+  double* in = fftArena.in;
+  fftw_complex* out = fftArena.out;
+  auto magnitude = [K, out](int f, float* dft) {
+    auto spectrum = out + f * K;
+    for (size_t i = 0; i < K; ++i) {
+      dft[i] = std::sqrt(
+          spectrum[i][0] * spectrum[i][0] + spectrum[i][1] * spectrum[i][1]);
+    }
+  };
+
+  int f = 0;
+  // Full batches of frames go through the batched plan, the remaining ones
+  // one at a time, in the first slot of the buffers
+  for (; f + kFftBatchSize <= nFrames; f += kFftBatchSize) {
+    for (int i = 0; i < kFftBatchSize; ++i) {
+      auto begin = frames.data() + (f + i) * nSamples;
+      std::copy(begin, begin + nSamples, in + i * nFft);
+      std::fill(in + i * nFft + nSamples, in + (i + 1) * nFft, 0.0);
+    }
+    fftw_execute_dft_r2c(*fftBatchPlan_, in, out);
+    for (int i = 0; i < kFftBatchSize; ++i) {
+      magnitude(i, output.data() + (f + i) * K);
     }
   }
-  return dft;
+  for (; f < nFrames; ++f) {
+    auto begin = frames.data() + f * nSamples;
+    std::copy(begin, begin + nSamples, in);
+    std::fill(in + nSamples, in + nFft, 0.0);
+    fftw_execute_dft_r2c(*fftPlan_, in, out);
+    magnitude(0, output.data() + f * K);
+  }
 }
 
 std::vector<float> PowerSpectrum::batchApply(
@@ -98,18 +179,23 @@ std::vector<float> PowerSpectrum::batchApply(
   }
   int N = input.size() / batchSz;
   int outputSz = outputSize(N);
-  std::vector<float> feat(outputSz * batchSz);
+  if (outputSz == 0) {
+    return {};
+  }
 
-#pragma omp parallel for num_threads(batchSz)
+  // The frames of every signal go through the stages at once
+  std::vector<float> frames;
+  frames.reserve(
+      batchSz * featParams_.numFrames(N) * featParams_.numFrameSizeSamples());
   for (int b = 0; b < batchSz; ++b) {
     auto start = input.begin() + b * N;
-    std::vector<float> inputBuf(start, start + N);
-    auto curFeat = apply(inputBuf);
-    if (outputSz != curFeat.size()) {
-      throw std::logic_error("PowerSpectrum: apply() returned wrong size");
-    }
-    std::copy(
-        curFeat.begin(), curFeat.end(), feat.begin() + b * curFeat.size());
+    auto curFrames =
+        frameSignal(std::vector<float>(start, start + N), featParams_);
+    frames.insert(frames.end(), curFrames.begin(), curFrames.end());
+  }
+  auto feat = applyFrames(frames, batchSz);
+  if (outputSz * batchSz != feat.size()) {
+    throw std::logic_error("PowerSpectrum: applyFrames() returned wrong size");
   }
   return feat;
 }
@@ -137,7 +223,9 @@ void PowerSpectrum::validatePowSpecParams() const {
 }
 
 PowerSpectrum::~PowerSpectrum() {
+  std::lock_guard<std::mutex> lock(fftwPlannerMutex());
   fftw_destroy_plan(*fftPlan_);
+  fftw_destroy_plan(*fftBatchPlan_);
 }
 } // namespace audio
 } // namespace lib
@@ -8,7 +8,6 @@
 #pragma once
 
 #include <memory>
-#include <mutex>
 
 #include "flashlight/lib/audio/feature/Dither.h"
 #include "flashlight/lib/audio/feature/FeatureParams.h"
@@ -50,6 +49,19 @@ class PowerSpectrum {
   // frames. Main purpose of this function is to reuse it in MFSC, MFCC code
   std::vector<float> powSpectrumImpl(std::vector<float>& frames);
 
+  // Same as above, writes the power spectrum into `output` (resized) so that
+  // a buffer can be reused across calls
+  void powSpectrumImpl(std::vector<float>& frames, std::vector<float>& output);
+
+  // frames - frames of `batchSz` signals of the same number of frames
+  //   (Col Major : FRAMELEN X FRAMESZ X BATCHSZ)
+  // Returns - Output features (Col Major : FEAT X FRAMESZ X BATCHSZ)
+  // Featurizers override it so that every stage processes all the frames of
+  // a batch at once.
+  virtual std::vector<float> applyFrames(
+      std::vector<float>& frames,
+      int batchSz);
+
   void validatePowSpecParams() const;
 
  private:
@@ -58,9 +70,10 @@ class PowerSpectrum {
   PreEmphasis preEmphasis_;
   Windowing windowing_;
 
-  std::unique_ptr<fftw_plan> fftPlan_; // fftw_plan is an opque pointer type
-  std::vector<double> inFftBuf_, outFftBuf_;
-  std::mutex fftMutex_;
+  // fftw_plan is an opque pointer type. Plans are created once and executed
+  // on buffers of the calling thread, so that no lock is needed.
+  std::unique_ptr<fftw_plan> fftPlan_; // a single frame
+  std::unique_ptr<fftw_plan> fftBatchPlan_; // a batch of frames at once
 };
 } // namespace audio
 } // namespace lib
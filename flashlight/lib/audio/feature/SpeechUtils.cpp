@@ -7,8 +7,15 @@
 
 #include "flashlight/lib/audio/feature/SpeechUtils.h"
 
+#include <fftw3.h>
+
+#include <algorithm>
+#include <cmath>
 #include <cstddef>
+#include <mutex>
 #include <stdexcept>
+#include <unordered_map>
+#include <utility>
 
 extern "C" {
 #if FL_LIBRARIES_USE_MKL
@@ -23,6 +30,62 @@ namespace fl {
 namespace lib {
 namespace audio {
 
+namespace {
+
+// Forward and inverse real FFT plans of a size. They are created once for the
+// process, as planning is not thread-safe in FFTW, and executed on the
+// buffers of the calling thread.
+std::pair<fftw_plan, fftw_plan> realFftPlans(int fftSize) {
+  static std::mutex mutex;
+  static std::unordered_map<int, std::pair<fftw_plan, fftw_plan>> plans;
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = plans.find(fftSize);
+  if (it != plans.end()) {
+    return it->second;
+  }
+  // FFTW_ESTIMATE does not touch the buffers
+  auto time = fftw_alloc_real(fftSize);
+  auto freq = fftw_alloc_complex(fftSize / 2 + 1);
+  auto& plan = plans[fftSize];
+  plan.first = fftw_plan_dft_r2c_1d(fftSize, time, freq, FFTW_ESTIMATE);
+  plan.second = fftw_plan_dft_c2r_1d(fftSize, freq, time, FFTW_ESTIMATE);
+  fftw_free(time);
+  fftw_free(freq);
+  return plan;
+}
+
+// Buffers of a thread for overlapAddConvolve(), allocated by FFTW so that
+// they have the alignment the plans are created with
+struct ConvolutionArena {
+  int fftSize{0};
+  double* time{nullptr};
+  fftw_complex* irFreq{nullptr};
+  fftw_complex* freq{nullptr};
+
+  ~ConvolutionArena() {
+    fftw_free(time);
+    fftw_free(irFreq);
+    fftw_free(freq);
+  }
+
+  void reserve(int size) {
+    if (size <= fftSize) {
+      return;
+    }
+    fftw_free(time);
+    fftw_free(irFreq);
+    fftw_free(freq);
+    time = fftw_alloc_real(size);
+    irFreq = fftw_alloc_complex(size / 2 + 1);
+    freq = fftw_alloc_complex(size / 2 + 1);
+    fftSize = size;
+  }
+};
+
+thread_local ConvolutionArena convolutionArena;
+
+} // namespace
+
 std::vector<float> frameSignal(
     const std::vector<float>& input,
     const FeatureParams& params) {
@@ -46,6 +109,17 @@ std::vector<float> cblasGemm(
     const std::vector<float>& matB,
     int n,
     int k) {
+  std::vector<float> matC;
+  cblasGemm(matA, matB, n, k, matC);
+  return matC;
+}
+
+void cblasGemm(
+    const std::vector<float>& matA,
+    const std::vector<float>& matB,
+    int n,
+    int k,
+    std::vector<float>& matC) {
   if (n <= 0 || k <= 0 || matA.empty() || (matA.size() % k != 0) ||
       (matB.size() != n * k)) {
     throw std::invalid_argument("cblasGemm: invalid arguments");
@@ -53,7 +127,7 @@ std::vector<float> cblasGemm(
 
   int m = matA.size() / k;
 
-  std::vector<float> matC(m * n);
+  matC.resize(m * n);
 
 #if FL_LIBRARIES_USE_MKL
   auto prevMaxThreads = mkl_get_max_threads();
@@ -83,9 +157,52 @@ std::vector<float> cblasGemm(
 #else
 // TODO: to be tested
 #endif
+}
 
-  return matC;
-};
+std::vector<float> overlapAddConvolve(
+    const std::vector<float>& input,
+    const std::vector<float>& ir) {
+  int64_t N = input.size();
+  std::vector<float> output(N, 0.0);
+  if (N == 0 || ir.empty()) {
+    return output;
+  }
+  int irLen = std::min<int64_t>(ir.size(), N);
+  // Blocks of fftSize - irLen + 1 samples, at least half of the FFT
+  int fftSize = 1 << static_cast<int>(std::ceil(std::log2(2 * irLen)));
+  fftSize = std::max(fftSize, 64);
+  int blockSz = fftSize - irLen + 1;
+  int K = fftSize / 2 + 1;
+  auto plans = realFftPlans(fftSize);
+  auto& arena = convolutionArena;
+  arena.reserve(fftSize);
+
+  std::fill(arena.time, arena.time + fftSize, 0.0);
+  std::copy(ir.begin(), ir.begin() + irLen, arena.time);
+  fftw_execute_dft_r2c(plans.first, arena.time, arena.irFreq);
+  for (int64_t start = 0; start < N; start += blockSz) {
+    auto len = std::min<int64_t>(blockSz, N - start);
+    std::copy(
+        input.begin() + start, input.begin() + start + len, arena.time);
+    std::fill(arena.time + len, arena.time + fftSize, 0.0);
+    fftw_execute_dft_r2c(plans.first, arena.time, arena.freq);
+    for (int i = 0; i < K; ++i) {
+      double re = arena.freq[i][0] * arena.irFreq[i][0] -
+          arena.freq[i][1] * arena.irFreq[i][1];
+      double im = arena.freq[i][0] * arena.irFreq[i][1] +
+          arena.freq[i][1] * arena.irFreq[i][0];
+      arena.freq[i][0] = re;
+      arena.freq[i][1] = im;
+    }
+    // The inverse FFT is not normalized
+    fftw_execute_dft_c2r(plans.second, arena.freq, arena.time);
+    auto outLen = std::min<int64_t>(fftSize, N - start);
+    for (int64_t i = 0; i < outLen; ++i) {
+      output[start + i] += arena.time[i] / fftSize;
+    }
+  }
+  return output;
+}
 } // namespace audio
 } // namespace lib
 } // namespace fl
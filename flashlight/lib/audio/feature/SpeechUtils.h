@@ -28,6 +28,24 @@ std::vector<float> cblasGemm(
     const std::vector<float>& matB,
     int n,
     int k);
+
+// Same as above, matC (m x n) is resized so that a buffer can be reused across
+// calls
+
+void cblasGemm(
+    const std::vector<float>& matA,
+    const std::vector<float>& matB,
+    int n,
+    int k,
+    std::vector<float>& matC);
+
+// Convolution of input with the impulse response ir, computed by FFT with the
+// overlap-add method
+//    output(n) = SUM_k ir(k) * input(n - k), n in [0, input.size())
+
+std::vector<float> overlapAddConvolve(
+    const std::vector<float>& input,
+    const std::vector<float>& ir);
 } // namespace audio
 } // namespace lib
 } // namespace fl
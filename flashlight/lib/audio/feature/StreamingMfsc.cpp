@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/lib/audio/feature/StreamingMfsc.h"
+
+#include <algorithm>
+#include <cstddef>
+
+namespace fl {
+namespace lib {
+namespace audio {
+
+namespace {
+
+FeatureParams withoutDerivatives(FeatureParams params) {
+  params.deltaWindow = 0;
+  params.accWindow = 0;
+  return params;
+}
+
+// Derivative of a frame, as `Derivatives` computes it. `input` holds the
+// features of the frames from `begin`, the window is clamped to the frames
+// [0, numFrames).
+void derivative(
+    const float* input,
+    int64_t begin,
+    int64_t frame,
+    int64_t numFrames,
+    int windowlen,
+    int numfeat,
+    float* output) {
+  std::fill(output, output + numfeat, 0.0);
+  float denominator = (windowlen * (windowlen + 1) * (2 * windowlen + 1)) / 3.0;
+  for (int64_t d = 1; d <= windowlen; ++d) {
+    const float* next =
+        input + (std::min(frame + d, numFrames - 1) - begin) * numfeat;
+    const float* prev =
+        input + (std::max<int64_t>(frame - d, 0) - begin) * numfeat;
+    for (int j = 0; j < numfeat; ++j) {
+      output[j] += d * (next[j] - prev[j]);
+    }
+  }
+  for (int j = 0; j < numfeat; ++j) {
+    output[j] /= denominator;
+  }
+}
+
+} // namespace
+
+StreamingMfsc::StreamingMfsc(const FeatureParams& params)
+    : featParams_(params),
+      mfsc_(withoutDerivatives(params)),
+      numStaticFeat_(
+          params.numFilterbankChans + (params.useEnergy ? 1 : 0)) {
+  reset();
+}
+
+std::vector<float> StreamingMfsc::apply(const std::vector<float>& chunk) {
+  samples_.insert(samples_.end(), chunk.begin(), chunk.end());
+  auto numFrames = featParams_.numFrames(samples_.size());
+  if (numFrames > 0) {
+    // Frames of the buffer, without the samples of the incomplete next frame
+    auto feats = mfsc_.apply(samples_);
+    feats_.insert(feats_.end(), feats.begin(), feats.end());
+    numFeats_ += numFrames;
+    samples_.erase(
+        samples_.begin(),
+        samples_.begin() + numFrames * featParams_.numFrameStrideSamples());
+  }
+  return process(false);
+}
+
+std::vector<float> StreamingMfsc::flush() {
+  auto output = process(true);
+  reset();
+  return output;
+}
+
+void StreamingMfsc::reset() {
+  samples_.clear();
+  feats_.clear();
+  deltas_.clear();
+  featsBegin_ = 0;
+  deltasBegin_ = 0;
+  numFeats_ = 0;
+  numDeltas_ = 0;
+  numEmitted_ = 0;
+}
+
+FeatureParams StreamingMfsc::getFeatureParams() const {
+  return featParams_;
+}
+
+const float* StreamingMfsc::feat(int64_t frame) const {
+  return feats_.data() + (frame - featsBegin_) * numStaticFeat_;
+}
+
+const float* StreamingMfsc::delta(int64_t frame) const {
+  return deltas_.data() + (frame - deltasBegin_) * numStaticFeat_;
+}
+
+std::vector<float> StreamingMfsc::process(bool last) {
+  int deltaWindow = featParams_.deltaWindow;
+  int accWindow = featParams_.accWindow;
+  int numFeat = numStaticFeat_;
+
+  // Deltas of the frames whose window is computed
+  int64_t numReady = numFeats_;
+  if (deltaWindow > 0) {
+    int64_t end = last ? numFeats_ : numFeats_ - deltaWindow;
+    for (; numDeltas_ < end; ++numDeltas_) {
+      deltas_.resize(deltas_.size() + numFeat);
+      derivative(
+          feats_.data(),
+          featsBegin_,
+          numDeltas_,
+          numFeats_,
+          deltaWindow,
+          numFeat,
+          deltas_.data() + deltas_.size() - numFeat);
+    }
+    numReady = numDeltas_;
+    if (accWindow > 0 && !last) {
+      numReady = std::max(numDeltas_ - accWindow, numEmitted_);
+    }
+  }
+
+  int numOrders = 1 + (deltaWindow > 0 ? 1 : 0) +
+      (deltaWindow > 0 && accWindow > 0 ? 1 : 0);
+  std::vector<float> output((numReady - numEmitted_) * numFeat * numOrders);
+  for (auto out = output.data(); numEmitted_ < numReady; ++numEmitted_) {
+    std::copy(feat(numEmitted_), feat(numEmitted_) + numFeat, out);
+    out += numFeat;
+    if (numOrders > 1) {
+      std::copy(delta(numEmitted_), delta(numEmitted_) + numFeat, out);
+      out += numFeat;
+    }
+    if (numOrders > 2) {
+      derivative(
+          deltas_.data(),
+          deltasBegin_,
+          numEmitted_,
+          numDeltas_,
+          accWindow,
+          numFeat,
+          out);
+      out += numFeat;
+    }
+  }
+
+  // Drop what the next deltas and frames do not need
+  int64_t keepFeats = numEmitted_;
+  if (deltaWindow > 0) {
+    keepFeats = std::min(keepFeats, numDeltas_ - deltaWindow);
+  }
+  keepFeats = std::max<int64_t>(keepFeats, featsBegin_);
+  feats_.erase(
+      feats_.begin(), feats_.begin() + (keepFeats - featsBegin_) * numFeat);
+  featsBegin_ = keepFeats;
+  int64_t keepDeltas = std::max<int64_t>(
+      numEmitted_ - std::max(accWindow, 0), deltasBegin_);
+  keepDeltas = std::min(keepDeltas, numDeltas_);
+  deltas_.erase(
+      deltas_.begin(),
+      deltas_.begin() + (keepDeltas - deltasBegin_) * numFeat);
+  deltasBegin_ = keepDeltas;
+  return output;
+}
+} // namespace audio
+} // namespace lib
+} // namespace fl
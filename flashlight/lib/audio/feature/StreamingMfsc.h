@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "flashlight/lib/audio/feature/FeatureParams.h"
+#include "flashlight/lib/audio/feature/Mfsc.h"
+
+namespace fl {
+namespace lib {
+namespace audio {
+
+// Computes MFSC features of a signal fed chunk by chunk, as `Mfsc` computes
+// them on the whole signal.
+// Frames are computed as soon as their samples are available, keeping the
+// samples of the overlap with the next frames. Pre-emphasis is applied per
+// frame, so it needs no state across chunks. The features of a frame are
+// returned once its derivatives are final: when the frames and deltas of the
+// derivatives windows are computed, that is `deltaWindow + accWindow` frames
+// later, or when the signal ends.
+// Example usage:
+//   StreamingMfsc mfsc(params);
+//   while (...) { auto feat = mfsc.apply(chunk); ... }
+//   auto feat = mfsc.flush();
+
+class StreamingMfsc {
+ public:
+  explicit StreamingMfsc(const FeatureParams& params);
+
+  // chunk - next samples of the signal
+  // Returns - MFSC features of the frames which became final, possibly none
+  //   (Col Major : FEAT X FRAMESZ)
+  std::vector<float> apply(const std::vector<float>& chunk);
+
+  // Ends the signal, the next chunk starts a new one.
+  // Returns - MFSC features of the remaining frames (Col Major : FEAT X FRAMESZ)
+  std::vector<float> flush();
+
+  // Drops the state of the current signal
+  void reset();
+
+  FeatureParams getFeatureParams() const;
+
+ private:
+  FeatureParams featParams_;
+  Mfsc mfsc_; // without derivatives
+  int numStaticFeat_; // features before derivatives
+
+  // Samples not consumed by the frames computed so far
+  std::vector<float> samples_;
+  // Features and deltas of the frames still needed, from frame feat(s)Begin_
+  std::vector<float> feats_, deltas_;
+  int64_t featsBegin_, deltasBegin_;
+  // Number of frames of the signal whose features, deltas were computed and
+  // which were returned
+  int64_t numFeats_, numDeltas_, numEmitted_;
+
+  const float* feat(int64_t frame) const;
+  const float* delta(int64_t frame) const;
+
+  // Computes the deltas and returns the features which are final. With
+  // `last`, the signal ends at the last frame computed.
+  std::vector<float> process(bool last);
+};
+} // namespace audio
+} // namespace lib
+} // namespace fl
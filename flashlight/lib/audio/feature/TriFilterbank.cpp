@@ -56,13 +56,21 @@ TriFilterbank::TriFilterbank(
 std::vector<float> TriFilterbank::apply(
     const std::vector<float>& input,
     float melfloor /* = 0.0 */) const {
-  std::vector<float> output = cblasGemm(input, H_, numFilters_, filterLen_);
+  std::vector<float> output;
+  apply(input, output, melfloor);
+  return output;
+}
+
+void TriFilterbank::apply(
+    const std::vector<float>& input,
+    std::vector<float>& output,
+    float melfloor /* = 0.0 */) const {
+  cblasGemm(input, H_, numFilters_, filterLen_, output);
   std::transform(
       output.begin(),
       output.end(),
       output.begin(),
       [melfloor](float n) -> float { return std::max(n, melfloor); });
-  return output;
 }
 
 std::vector<float> TriFilterbank::filterbank() const {
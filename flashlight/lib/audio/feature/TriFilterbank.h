@@ -30,6 +30,13 @@ class TriFilterbank {
       const std::vector<float>& input,
       float melfloor = 0.0) const;
 
+  // Same as above, writes into `output` (resized) so that a buffer can be
+  // reused across calls
+  void apply(
+      const std::vector<float>& input,
+      std::vector<float>& output,
+      float melfloor = 0.0) const;
+
   // Returns triangular filterbank matrix
   std::vector<float> filterbank() const;
 
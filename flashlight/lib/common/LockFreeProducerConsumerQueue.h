@@ -0,0 +1,333 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fl {
+namespace lib {
+
+/**
+ * A bounded multi-producer multi-consumer queue with the API of
+ * ProducerConsumerQueue, on a lock-free ring buffer (the sequence-numbered
+ * cells of D. Vyukov's bounded MPMC queue): producers and consumers only
+ * contend on an atomic position each, instead of a mutex.
+ *
+ * A thread which can't add (the queue is full) or get (the queue is empty)
+ * spins for a short while, and then parks on a condition variable, until a
+ * thread of the other side wakes it. Threads are only woken if some are
+ * parked, so that a busy queue takes no lock at all.
+ *
+ * `addMany()` and `getMany()` claim several cells at once, e.g. for a
+ * consumer to drain the available elements after a single wakeup:
+ *
+ *   LockFreeProducerConsumerQueue<T> queue(1024);
+ *
+ *   // Consumer threads
+ *   std::vector<T> objs;
+ *   while (queue.getMany(objs, 16)) {
+ *     for (auto& obj : objs) {
+ *       ...
+ *     }
+ *   }
+ *
+ * As for ProducerConsumerQueue, `finishAdding()` is called once the
+ * producers are done: elements added concurrently with it may be dropped.
+ */
+template <typename T>
+class LockFreeProducerConsumerQueue {
+ public:
+  /**
+   * The capacity is `maxSize` rounded up to a power of 2.
+   */
+  explicit LockFreeProducerConsumerQueue(int maxSize = 3000)
+      : capacity_(roundUpToPowerOf2(maxSize)),
+        mask_(capacity_ - 1),
+        cells_(new Cell[capacity_]) {
+    for (size_t i = 0; i < capacity_; ++i) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  LockFreeProducerConsumerQueue(const LockFreeProducerConsumerQueue&) = delete;
+  LockFreeProducerConsumerQueue& operator=(
+      const LockFreeProducerConsumerQueue&) = delete;
+
+  /*
+   * - Adds an element to the queue, waiting while it is full.
+   * - Ignores the current one if adding is finished.
+   * - Wakes a parked consumer.
+   */
+  void add(T unit) {
+    while (!isFinished()) {
+      size_t pos;
+      if (claim(enqueuePos_, 0, 1, pos) > 0) {
+        publish(pos, 1, &unit);
+        wake(consumersParked_, consumerCondition_, 1);
+        return;
+      }
+      waitUntil(producersParked_, producerCondition_, [this]() {
+        return isFinished() || canClaim(enqueuePos_, 0);
+      });
+    }
+  }
+
+  /*
+   * - Adds the elements of `units` in order, as many at once as there are
+   *   free cells.
+   * - Ignores them if adding is finished.
+   * - Wakes as many parked consumers as elements added at once.
+   */
+  void addMany(std::vector<T> units) {
+    size_t added = 0;
+    while (added < units.size() && !isFinished()) {
+      size_t pos;
+      size_t n = claim(enqueuePos_, 0, units.size() - added, pos);
+      if (n == 0) {
+        waitUntil(producersParked_, producerCondition_, [this]() {
+          return isFinished() || canClaim(enqueuePos_, 0);
+        });
+        continue;
+      }
+      publish(pos, n, units.data() + added);
+      added += n;
+      wake(consumersParked_, consumerCondition_, n);
+    }
+  }
+
+  /*
+   * - Pops an element from the queue, waiting while it is empty.
+   * - Returns false when adding is finished and queue is empty.
+   * - Wakes a parked producer.
+   */
+  bool get(T& unit) {
+    return pop(1, [&unit](T&& popped) { unit = std::move(popped); });
+  }
+
+  /*
+   * - Replaces `units` by the (up to `maxUnits`) elements at the front of the
+   *   queue, waiting while it is empty.
+   * - Returns false when adding is finished and queue is empty.
+   * - Wakes as many parked producers as elements popped.
+   */
+  bool getMany(std::vector<T>& units, size_t maxUnits) {
+    units.clear();
+    return pop(std::max<size_t>(maxUnits, 1), [&units](T&& popped) {
+      units.push_back(std::move(popped));
+    });
+  }
+
+  /*
+   * - Sets the status of the queue to be adding-finished.
+   * - Wakes all the consumers to consume the remaining elements.
+   */
+  void finishAdding() {
+    isAddingFinished_.store(true);
+    std::lock_guard<std::mutex> lock(mutex_);
+    producerCondition_.notify_all();
+    consumerCondition_.notify_all();
+  }
+
+  /*
+   * - Clears the queue.
+   * - Resets the status of the queue to be adding-unfinished.
+   * - Wakes all the producers to work.
+   */
+  void clear() {
+    size_t pos, n;
+    while ((n = claim(dequeuePos_, 1, capacity_, pos)) > 0) {
+      consume(pos, n, [](T&& /* unit */) {});
+    }
+    isAddingFinished_.store(false);
+    std::lock_guard<std::mutex> lock(mutex_);
+    producerCondition_.notify_all();
+    consumerCondition_.notify_all();
+  }
+
+ private:
+  // Attempts before parking: the other side usually catches up quickly
+  static constexpr int kSpinCount = 64;
+  static constexpr int kBusySpinCount = 16;
+  static constexpr size_t kCacheLineSize = 64;
+
+  // Free for the producer of position p if sequence == p, ready for the
+  // consumer of position p if sequence == p + 1
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T unit;
+  };
+
+  const size_t capacity_;
+  const size_t mask_;
+  std::unique_ptr<Cell[]> cells_;
+
+  // On their own cache lines, being written by all the producers or all the
+  // consumers
+  char pad0_[kCacheLineSize];
+  std::atomic<size_t> enqueuePos_{0};
+  char pad1_[kCacheLineSize - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> dequeuePos_{0};
+  char pad2_[kCacheLineSize - sizeof(std::atomic<size_t>)];
+
+  std::atomic<bool> isAddingFinished_{false};
+  std::atomic<int> producersParked_{0};
+  std::atomic<int> consumersParked_{0};
+  std::mutex mutex_;
+  std::condition_variable producerCondition_;
+  std::condition_variable consumerCondition_;
+
+  static size_t roundUpToPowerOf2(int size) {
+    size_t capacity = 1;
+    while (capacity < static_cast<size_t>(std::max(size, 1))) {
+      capacity <<= 1;
+    }
+    return capacity;
+  }
+
+  bool isFinished() const {
+    return isAddingFinished_.load(std::memory_order_acquire);
+  }
+
+  // Whether the cell at `position` is free (offset 0) or ready (offset 1)
+  bool canClaim(const std::atomic<size_t>& position, size_t offset) const {
+    size_t pos = position.load(std::memory_order_relaxed);
+    auto seq = cells_[pos & mask_].sequence.load(std::memory_order_acquire);
+    return static_cast<intptr_t>(seq - (pos + offset)) >= 0;
+  }
+
+  // Claims up to `n` consecutive free (offset 0) or ready (offset 1) cells
+  // from `position`, returns their number and the first one in `first`. A
+  // cell stays free or ready until its position is claimed, so the cells
+  // checked before the CAS are still claimable after it.
+  size_t claim(
+      std::atomic<size_t>& position,
+      size_t offset,
+      size_t n,
+      size_t& first) {
+    size_t pos = position.load(std::memory_order_relaxed);
+    for (;;) {
+      size_t k = 0;
+      while (k < n && k < capacity_) {
+        auto seq = cells_[(pos + k) & mask_].sequence.load(
+            std::memory_order_acquire);
+        if (seq != pos + k + offset) {
+          break;
+        }
+        ++k;
+      }
+      if (k == 0) {
+        auto seq =
+            cells_[pos & mask_].sequence.load(std::memory_order_acquire);
+        if (static_cast<intptr_t>(seq - (pos + offset)) < 0) {
+          // Full or empty
+          return 0;
+        }
+        // Claimed by another thread
+        pos = position.load(std::memory_order_relaxed);
+        continue;
+      }
+      if (position.compare_exchange_weak(
+              pos, pos + k, std::memory_order_relaxed)) {
+        first = pos;
+        return k;
+      }
+    }
+  }
+
+  // Moves the elements of the claimed ready cells to `sink`, and frees them
+  template <typename Sink>
+  void consume(size_t pos, size_t n, const Sink& sink) {
+    for (size_t i = 0; i < n; ++i) {
+      auto& cell = cells_[(pos + i) & mask_];
+      sink(std::move(cell.unit));
+      cell.sequence.store(pos + i + capacity_, std::memory_order_release);
+    }
+  }
+
+  template <typename Sink>
+  bool pop(size_t maxUnits, const Sink& sink) {
+    for (;;) {
+      size_t pos;
+      size_t n = claim(dequeuePos_, 1, maxUnits, pos);
+      if (n > 0) {
+        consume(pos, n, sink);
+        wake(producersParked_, producerCondition_, n);
+        return true;
+      }
+      // The elements added before finishAdding() are visible after it
+      if (isFinished() && !canClaim(dequeuePos_, 1)) {
+        return false;
+      }
+      waitUntil(consumersParked_, consumerCondition_, [this]() {
+        return isFinished() || canClaim(dequeuePos_, 1);
+      });
+    }
+  }
+
+  void publish(size_t pos, size_t n, T* units) {
+    for (size_t i = 0; i < n; ++i) {
+      auto& cell = cells_[(pos + i) & mask_];
+      cell.unit = std::move(units[i]);
+      cell.sequence.store(pos + i + 1, std::memory_order_release);
+    }
+  }
+
+  template <typename Ready>
+  void waitUntil(
+      std::atomic<int>& parked,
+      std::condition_variable& condition,
+      const Ready& ready) {
+    for (int i = 0; i < kSpinCount; ++i) {
+      if (ready()) {
+        return;
+      }
+      if (i >= kBusySpinCount) {
+        std::this_thread::yield();
+      }
+    }
+    parked.fetch_add(1);
+    // Either wake() sees this thread parked, or this thread sees the cells
+    // published before wake()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      condition.wait(lock, ready);
+    }
+    parked.fetch_sub(1);
+  }
+
+  void wake(
+      std::atomic<int>& parked,
+      std::condition_variable& condition,
+      size_t n) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (parked.load(std::memory_order_relaxed) == 0) {
+      return;
+    }
+    // A thread parking after the check of its condition waits for the lock
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+    }
+    if (n > 1) {
+      condition.notify_all();
+    } else {
+      condition.notify_one();
+    }
+  }
+};
+
+} // namespace lib
+} // namespace fl
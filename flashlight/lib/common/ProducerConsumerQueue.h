@@ -10,6 +10,7 @@
 #include <condition_variable>
 #include <mutex>
 #include <queue>
+#include <vector>
 
 namespace fl {
 namespace lib {
@@ -49,6 +50,8 @@ namespace lib {
  *       // it means the queue is empty and adding is also finshed.
  *   }
  *
+ * See LockFreeProducerConsumerQueue for a lock-free variant, with the same
+ * API, for many producers and consumers.
  */
 
 template <typename T>
@@ -79,6 +82,36 @@ class ProducerConsumerQueue {
     consumerCondition_.notify_one();
   }
 
+  /*
+   * - Adds the elements of `units` in order, as many at once as fit.
+   * - Ignores them if adding is finished.
+   * - Notifies as many consumers as elements added at once.
+   */
+  void addMany(std::vector<T> units) {
+    size_t added = 0;
+    while (added < units.size()) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      producerCondition_.wait(
+          lock, [this]() { return !isFull() || isAddingFinished_; });
+      if (isAddingFinished_) {
+        return;
+      }
+      size_t start = added;
+      while (added < units.size() && !isFull()) {
+        queue_.push(std::move(units[added++]));
+      }
+
+      if (!isFull()) {
+        producerCondition_.notify_one();
+      }
+      if (added - start > 1) {
+        consumerCondition_.notify_all();
+      } else {
+        consumerCondition_.notify_one();
+      }
+    }
+  }
+
   /*
    * - Pops an element from the queue.
    * - Returns false when adding is finished and queue is empty.
@@ -103,6 +136,37 @@ class ProducerConsumerQueue {
     return true;
   }
 
+  /*
+   * - Replaces `units` by the (up to `maxUnits`) elements at the front of the
+   *   queue.
+   * - Returns false when adding is finished and queue is empty.
+   * - Notifies another consumer when queue is not empty.
+   * - Notifies as many producers as elements popped.
+   */
+  bool getMany(std::vector<T>& units, size_t maxUnits) {
+    units.clear();
+    std::unique_lock<std::mutex> lock(mutex_);
+    consumerCondition_.wait(
+        lock, [this]() { return !isEmpty() || isAddingFinished_; });
+    if (isEmpty()) {
+      return false;
+    }
+    while (!isEmpty() && (units.empty() || units.size() < maxUnits)) {
+      units.push_back(std::move(queue_.front()));
+      queue_.pop();
+    }
+
+    if (!isEmpty()) {
+      consumerCondition_.notify_one();
+    }
+    if (units.size() > 1) {
+      producerCondition_.notify_all();
+    } else {
+      producerCondition_.notify_one();
+    }
+    return true;
+  }
+
   /*
    * - Sets the status of the queue to be adding-finished.
    * - Notifies all the consumers to consume the remaining elements.
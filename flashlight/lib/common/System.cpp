@@ -18,6 +18,8 @@
 #ifdef _WIN32
 #include <windows.h>
 #else
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #endif
 
@@ -246,5 +248,49 @@ std::ofstream createOutputStream(
   return file;
 }
 
+#ifdef _WIN32
+const int MemoryMappedFile::kShared = 0;
+const int MemoryMappedFile::kPrivate = 0;
+#else
+const int MemoryMappedFile::kShared = MAP_SHARED;
+const int MemoryMappedFile::kPrivate = MAP_PRIVATE;
+#endif
+
+MemoryMappedFile::MemoryMappedFile(const std::string& path, int flags) {
+#ifdef _WIN32
+  throw std::runtime_error(
+      "MemoryMappedFile is not supported on Windows: " + path);
+#else
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Failed to open file for mapping: " + path);
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    ::close(fd);
+    throw std::runtime_error("Failed to stat file for mapping: " + path);
+  }
+  size_ = st.st_size;
+  if (size_ > 0) {
+    void* addr = ::mmap(nullptr, size_, PROT_READ, flags, fd, 0);
+    if (addr == MAP_FAILED) {
+      ::close(fd);
+      throw std::runtime_error("Failed to map file: " + path);
+    }
+    data_ = static_cast<const char*>(addr);
+  }
+  // The mapping stays valid after closing the descriptor
+  ::close(fd);
+#endif
+}
+
+MemoryMappedFile::~MemoryMappedFile() {
+#ifndef _WIN32
+  if (data_) {
+    ::munmap(const_cast<char*>(data_), size_);
+  }
+#endif
+}
+
 } // namespace lib
 } // namespace fl
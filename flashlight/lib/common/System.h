@@ -55,6 +55,36 @@ std::ofstream createOutputStream(
     const std::string& filename,
     std::ios_base::openmode mode = std::ios_base::out);
 
+/**
+ * MemoryMappedFile maps a whole file read-only into memory. Pages are loaded
+ * lazily by the OS and, with `kShared` flags, shared by all the processes
+ * mapping the same file.
+ */
+class MemoryMappedFile {
+ public:
+  /** The `mmap()` flags `MAP_SHARED` and `MAP_PRIVATE`. */
+  static const int kShared;
+  static const int kPrivate;
+
+  explicit MemoryMappedFile(const std::string& path, int flags = kShared);
+  ~MemoryMappedFile();
+
+  MemoryMappedFile(const MemoryMappedFile&) = delete;
+  MemoryMappedFile& operator=(const MemoryMappedFile&) = delete;
+
+  const char* data() const {
+    return data_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  const char* data_{nullptr};
+  size_t size_{0};
+};
+
 /**
  * Calls `f(args...)` repeatedly, retrying if an exception is thrown.
  * Supports sleeps between retries, with duration starting at `initial` and
@@ -11,6 +11,7 @@
 #include <limits>
 
 #include "flashlight/lib/sequence/criterion/Workspace.h"
+#include "flashlight/lib/sequence/criterion/cpu/CriterionUtils.h"
 
 namespace {
 
@@ -194,7 +195,8 @@ void ConnectionistTemporalClassificationCriterion<Float>::viterbi(
   const int _S = (2 * _L) + 1;
   const int blank_label = N - 1;
   WorkspacePtrs<Float> ws(workspace, B, T, N, _L);
-  for (auto b = 0; b < B; b++) {
+#pragma omp parallel for num_threads(criterionNumThreads(B)) schedule(dynamic)
+  for (int b = 0; b < B; b++) {
     auto L = targetSize[b];
     auto S = (2 * L) + 1;
     int repeats = setup_labels(
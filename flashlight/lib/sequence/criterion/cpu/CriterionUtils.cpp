@@ -8,13 +8,43 @@
 #include "flashlight/lib/sequence/criterion/cpu/CriterionUtils.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <stdexcept>
 #include <vector>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+std::atomic<int> maxCriterionThreads{0};
+
+} // namespace
+
 namespace fl {
 namespace lib {
 namespace cpu {
 
+void setCriterionNumThreads(int numThreads) {
+  if (numThreads < 0) {
+    throw std::invalid_argument(
+        "[setCriterionNumThreads] number of threads must be non-negative");
+  }
+  maxCriterionThreads = numThreads;
+}
+
+int criterionNumThreads(int B) {
+  int numThreads = maxCriterionThreads;
+#ifdef _OPENMP
+  if (numThreads == 0) {
+    numThreads = omp_get_max_threads();
+  }
+#endif
+  return std::max(1, std::min(B, numThreads));
+}
+
 template <class Float>
 void CriterionUtils<Float>::batchTargetSize(
     int B,
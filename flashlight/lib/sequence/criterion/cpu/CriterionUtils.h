@@ -36,6 +36,16 @@ struct CriterionUtils {
       Float* scale);
 };
 
+/**
+ * Sets the maximum number of threads the CPU criterions shard the batch
+ * dimension over. 0 (the default) uses the OpenMP maximum, usually the number
+ * of cores.
+ */
+void setCriterionNumThreads(int numThreads);
+
+/// Number of threads to process a batch of B sequences with.
+int criterionNumThreads(int B);
+
 /// Zeroes `count * sizeof(T)` device bytes
 template <typename T>
 void setZero(T* ptr, size_t count) {
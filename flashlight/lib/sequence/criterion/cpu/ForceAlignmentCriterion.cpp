@@ -70,7 +70,7 @@ void ForceAlignmentCriterion<Float>::forward(
   WorkspacePtrs<Float> ws(workspace, B, T, N, _L);
   CriterionUtils<Float>::computeScale(B, T, N, scaleMode, targetSize, ws.scale);
 
-#pragma omp parallel for num_threads(B)
+#pragma omp parallel for num_threads(criterionNumThreads(B)) schedule(dynamic)
   for (int b = 0; b < B; ++b) {
     auto* alpha = &ws.alpha[b * T * _L];
     auto* input = &_input[b * T * N];
@@ -137,7 +137,7 @@ void ForceAlignmentCriterion<Float>::backward(
   setZero(ws.transBufGrad1, B * _L);
   setZero(ws.transBufGrad2, B * _L);
 
-#pragma omp parallel for num_threads(B)
+#pragma omp parallel for num_threads(criterionNumThreads(B)) schedule(dynamic)
   for (int b = 0; b < B; ++b) {
     auto* alpha = &ws.alpha[b * T * _L];
     auto* alphaGrad = &ws.alphaGrad[b * T * _L];
@@ -234,7 +234,7 @@ void ForceAlignmentCriterion<Float>::viterbi(
     void* workspace) {
   WorkspacePtrs<Float> ws(workspace, B, T, N, _L);
 
-#pragma omp parallel for num_threads(B)
+#pragma omp parallel for num_threads(criterionNumThreads(B)) schedule(dynamic)
   for (int b = 0; b < B; ++b) {
     double* alpha = &ws.alpha[b * T * _L];
     const Float* input = &_input[b * T * N];
@@ -11,6 +11,7 @@
 
 #include "flashlight/lib/sequence/criterion/Workspace.h"
 #include "flashlight/lib/sequence/criterion/cpu/CriterionUtils.h"
+#include "flashlight/lib/sequence/criterion/cpu/SimdReduce.h"
 
 namespace {
 
@@ -59,7 +60,7 @@ void FullConnectionCriterion<Float>::forward(
   WorkspacePtrs<Float> ws(workspace, B, T, N);
   CriterionUtils<Float>::computeScale(B, T, N, scaleMode, targetSize, ws.scale);
 
-#pragma omp parallel for num_threads(B)
+#pragma omp parallel for num_threads(criterionNumThreads(B)) schedule(dynamic)
   for (int b = 0; b < B; ++b) {
     for (int n = 0; n < N; ++n) {
       int k = b * T * N + n;
@@ -73,17 +74,9 @@ void FullConnectionCriterion<Float>::forward(
         auto* transBuf = &ws.transBuf[b * N * N + m * N];
         auto* alphaCur = &ws.alpha[b * T * N + t * N];
 
-        double maxValue = -INFINITY;
-        for (int n = 0; n < N; ++n) {
-          double val = transBuf[n] =
-              alphaPrev[n] + (t == T ? 0 : trans[m * N + n]);
-          maxValue = val > maxValue ? val : maxValue;
-        }
-
-        double sumValue = 0;
-        for (int n = 0; n < N; ++n) {
-          sumValue += exp(transBuf[n] - maxValue);
-        }
+        double maxValue = SimdReduce<Float>::addMax(
+            N, alphaPrev, t == T ? nullptr : &trans[m * N], transBuf);
+        double sumValue = expShiftSum(N, maxValue, transBuf);
 
         if (t == T) {
           loss[b] = ws.scale[b] * (log(sumValue) + maxValue);
@@ -112,7 +105,7 @@ void FullConnectionCriterion<Float>::backward(
   setZero(ws.alphaGrad, B * T * N);
   setZero(ws.transBatchGrad, B * N * N);
 
-#pragma omp parallel for num_threads(B)
+#pragma omp parallel for num_threads(criterionNumThreads(B)) schedule(dynamic)
   for (int b = 0; b < B; ++b) {
     for (int t = T; t > 0; --t) {
       for (int m = 0; m < N; ++m) {
@@ -122,18 +115,9 @@ void FullConnectionCriterion<Float>::backward(
         auto* transBuf = &ws.transBuf[b * N * N + m * N];
         auto* transBatchGrad = &ws.transBatchGrad[b * N * N + m * N];
 
-        double maxValue = -INFINITY;
-        for (int n = 0; n < N; ++n) {
-          double val = transBuf[n] =
-              alphaPrev[n] + (t == T ? 0 : trans[m * N + n]);
-          maxValue = val > maxValue ? val : maxValue;
-        }
-
-        double sumValue = 0;
-        for (int n = 0; n < N; ++n) {
-          transBuf[n] = exp(transBuf[n] - maxValue);
-          sumValue += transBuf[n];
-        }
+        double maxValue = SimdReduce<Float>::addMax(
+            N, alphaPrev, t == T ? nullptr : &trans[m * N], transBuf);
+        double sumValue = expShiftSum(N, maxValue, transBuf);
 
         if (t == T) {
           for (int n = 0; n < N; ++n) {
@@ -152,11 +136,12 @@ void FullConnectionCriterion<Float>::backward(
         continue;
       }
 
-      for (int m = 0; m < N; ++m) {
-        auto* alphaPrevGrad = &ws.alphaGrad[b * T * N + (t - 1) * N];
-
-        for (int n = 0; n < N; ++n) {
-          alphaPrevGrad[m] += ws.transBuf[b * N * N + n * N + m];
+      // Sum the columns of transBuf, row by row for contiguous accesses
+      auto* alphaPrevGrad = &ws.alphaGrad[b * T * N + (t - 1) * N];
+      for (int n = 0; n < N; ++n) {
+        const auto* transBuf = &ws.transBuf[b * N * N + n * N];
+        for (int m = 0; m < N; ++m) {
+          alphaPrevGrad[m] += transBuf[m];
         }
       }
     }
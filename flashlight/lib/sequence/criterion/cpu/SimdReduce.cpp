@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/lib/sequence/criterion/cpu/SimdReduce.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Kernels are written with GCC vector extensions (64 bytes vectors, lowered
+// to the widest registers of each target), and compiled for several targets
+// dispatched at load time through an ifunc.
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && \
+    defined(__linux__)
+#define FL_SIMD_CLONES \
+  __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define FL_SIMD_CLONES
+#endif
+
+#define FL_ALWAYS_INLINE inline __attribute__((always_inline))
+
+#if defined(__GNUC__) && !defined(__clang__)
+// Vectors never go through a function call, all the helpers are inlined
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+namespace {
+
+typedef float Vec16f __attribute__((vector_size(64)));
+typedef float Vec8f __attribute__((vector_size(32)));
+typedef double Vec8d __attribute__((vector_size(64)));
+typedef int32_t Vec16i __attribute__((vector_size(64)));
+typedef int32_t Vec8i __attribute__((vector_size(32)));
+typedef int64_t Vec8l __attribute__((vector_size(64)));
+
+template <class Float>
+struct VecTraits;
+
+template <>
+struct VecTraits<float> {
+  using Vec = Vec16f;
+  using Index = Vec16i;
+  static constexpr int kWidth = 16;
+};
+
+template <>
+struct VecTraits<double> {
+  using Vec = Vec8d;
+  using Index = Vec8l;
+  static constexpr int kWidth = 8;
+};
+
+template <class Vec, class T>
+FL_ALWAYS_INLINE Vec load(const T* ptr) {
+  Vec v;
+  std::memcpy(&v, ptr, sizeof(Vec));
+  return v;
+}
+
+template <class Vec, class T>
+FL_ALWAYS_INLINE void store(T* ptr, const Vec& v) {
+  std::memcpy(ptr, &v, sizeof(Vec));
+}
+
+FL_ALWAYS_INLINE Vec8d loadDouble(const float* ptr) {
+  return __builtin_convertvector(load<Vec8f>(ptr), Vec8d);
+}
+
+FL_ALWAYS_INLINE Vec8d loadDouble(const double* ptr) {
+  return load<Vec8d>(ptr);
+}
+
+/* exp() of 8 doubles, with the rational approximation of Cephes */
+FL_ALWAYS_INLINE Vec8d exp8(Vec8d x) {
+  const Vec8l underflow = x < -708.3964185322641;
+  x = x > 709.0 ? Vec8d{} + 709.0 : x;
+  x = x < -708.3964185322641 ? Vec8d{} - 708.3964185322641 : x;
+
+  // x = n * ln(2) + r, |r| <= ln(2) / 2
+  const Vec8d fx = x * 1.4426950408889634073599 + 0.5;
+  const Vec8i truncated = __builtin_convertvector(fx, Vec8i);
+  Vec8d n = __builtin_convertvector(truncated, Vec8d);
+  const Vec8l floorFix = n > fx; // -1 where truncation rounded up
+  n += __builtin_convertvector(floorFix, Vec8d);
+  x -= n * 6.93145751953125E-1;
+  x -= n * 1.42860682030941723212E-6;
+
+  const Vec8d xx = x * x;
+  const Vec8d px =
+      x * ((1.26177193074810590878E-4 * xx + 3.02994407707441961300E-2) * xx +
+           9.99999999999999999910E-1);
+  const Vec8d qx = ((3.00198505138664455042E-6 * xx +
+                     2.52448340349684104192E-3) *
+                        xx +
+                    2.27265548208155028766E-1) *
+          xx +
+      2.00000000000000000009E0;
+  x = 1.0 + 2.0 * (px / (qx - px));
+
+  // Multiply by 2^n, built from the exponent bits
+  const Vec8l exponent =
+      (__builtin_convertvector(truncated, Vec8l) + floorFix + 1023) << 52;
+  Vec8d scale;
+  std::memcpy(&scale, &exponent, sizeof(scale));
+  x *= scale;
+  return underflow ? Vec8d{} : x;
+}
+
+template <class Float>
+FL_ALWAYS_INLINE int
+argmaxSumImpl(int N, const Float* a, const Float* b, Float& maxValue) {
+  using Vec = typename VecTraits<Float>::Vec;
+  using Index = typename VecTraits<Float>::Index;
+  constexpr int W = VecTraits<Float>::kWidth;
+
+  int maxIndex = -1;
+  maxValue = -INFINITY;
+  int n = 0;
+  if (N >= W) {
+    Vec best = Vec{} - INFINITY;
+    Index bestIndex = Index{} - 1;
+    Index index;
+    for (int l = 0; l < W; ++l) {
+      index[l] = l;
+    }
+    for (; n + W <= N; n += W) {
+      Vec val = load<Vec>(a + n);
+      if (b) {
+        val += load<Vec>(b + n);
+      }
+      Index greater = val > best;
+      best = greater ? val : best;
+      bestIndex = greater ? index : bestIndex;
+      index += W;
+    }
+    // Each lane holds its first argmax, keep the first one of the maxima
+    for (int l = 0; l < W; ++l) {
+      if (best[l] > maxValue ||
+          (best[l] == maxValue && bestIndex[l] < maxIndex)) {
+        maxValue = best[l];
+        maxIndex = bestIndex[l];
+      }
+    }
+  }
+  for (; n < N; ++n) {
+    Float val = b ? a[n] + b[n] : a[n];
+    if (val > maxValue) {
+      maxIndex = n;
+      maxValue = val;
+    }
+  }
+  return maxIndex;
+}
+
+template <class Float>
+FL_ALWAYS_INLINE double
+addMaxImpl(int N, const double* a, const Float* b, double* out) {
+  double maxValue = -INFINITY;
+  int n = 0;
+  if (N >= 8) {
+    Vec8d best = Vec8d{} - INFINITY;
+    for (; n + 8 <= N; n += 8) {
+      Vec8d val = load<Vec8d>(a + n);
+      if (b) {
+        val += loadDouble(b + n);
+      }
+      store(out + n, val);
+      best = val > best ? val : best;
+    }
+    for (int l = 0; l < 8; ++l) {
+      maxValue = best[l] > maxValue ? best[l] : maxValue;
+    }
+  }
+  for (; n < N; ++n) {
+    double val = out[n] = b ? a[n] + b[n] : a[n];
+    maxValue = val > maxValue ? val : maxValue;
+  }
+  return maxValue;
+}
+
+FL_SIMD_CLONES int
+argmaxSumFloat(int N, const float* a, const float* b, float& maxValue) {
+  return argmaxSumImpl(N, a, b, maxValue);
+}
+
+FL_SIMD_CLONES int
+argmaxSumDouble(int N, const double* a, const double* b, double& maxValue) {
+  return argmaxSumImpl(N, a, b, maxValue);
+}
+
+FL_SIMD_CLONES double
+addMaxFloat(int N, const double* a, const float* b, double* out) {
+  return addMaxImpl(N, a, b, out);
+}
+
+FL_SIMD_CLONES double
+addMaxDouble(int N, const double* a, const double* b, double* out) {
+  return addMaxImpl(N, a, b, out);
+}
+
+} // namespace
+
+namespace fl {
+namespace lib {
+namespace cpu {
+
+template <>
+int SimdReduce<float>::argmaxSum(
+    int N,
+    const float* a,
+    const float* b,
+    float& maxValue) {
+  return argmaxSumFloat(N, a, b, maxValue);
+}
+
+template <>
+int SimdReduce<double>::argmaxSum(
+    int N,
+    const double* a,
+    const double* b,
+    double& maxValue) {
+  return argmaxSumDouble(N, a, b, maxValue);
+}
+
+template <>
+double
+SimdReduce<float>::addMax(int N, const double* a, const float* b, double* out) {
+  return addMaxFloat(N, a, b, out);
+}
+
+template <>
+double SimdReduce<double>::addMax(
+    int N,
+    const double* a,
+    const double* b,
+    double* out) {
+  return addMaxDouble(N, a, b, out);
+}
+
+FL_SIMD_CLONES double expShiftSum(int N, double shift, double* x) {
+  double sumValue = 0;
+  int n = 0;
+  if (N >= 8) {
+    Vec8d sum = Vec8d{};
+    for (; n + 8 <= N; n += 8) {
+      Vec8d val = exp8(load<Vec8d>(x + n) - shift);
+      store(x + n, val);
+      sum += val;
+    }
+    for (int l = 0; l < 8; ++l) {
+      sumValue += sum[l];
+    }
+  }
+  for (; n < N; ++n) {
+    x[n] = std::exp(x[n] - shift);
+    sumValue += x[n];
+  }
+  return sumValue;
+}
+
+} // namespace cpu
+} // namespace lib
+} // namespace fl
@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+namespace fl {
+namespace lib {
+namespace cpu {
+
+/**
+ * Vectorized reductions over the N tokens of a frame, used by the transition
+ * loops of the ASG criterions. On x86-64 Linux with GCC, each function is
+ * compiled for AVX-512, AVX2 and the baseline ISA, and the best version for
+ * the running CPU is picked when the library is loaded.
+ */
+template <class Float>
+struct SimdReduce {
+  /**
+   * Returns the first n maximizing a[n] + b[n] (a[n] if `b` is null) and sets
+   * `maxValue` to the maximum. Returns -1 if all the values are -inf.
+   */
+  static int argmaxSum(int N, const Float* a, const Float* b, Float& maxValue);
+
+  /**
+   * Sets out[n] = a[n] + b[n] (a[n] if `b` is null) and returns the maximum.
+   */
+  static double addMax(int N, const double* a, const Float* b, double* out);
+};
+
+/// Sets x[n] = exp(x[n] - shift) and returns the sum, with x[n] <= shift.
+double expShiftSum(int N, double shift, double* x);
+
+} // namespace cpu
+} // namespace lib
+} // namespace fl
@@ -10,6 +10,8 @@
 #include <cmath>
 
 #include "flashlight/lib/sequence/criterion/Workspace.h"
+#include "flashlight/lib/sequence/criterion/cpu/CriterionUtils.h"
+#include "flashlight/lib/sequence/criterion/cpu/SimdReduce.h"
 
 namespace {
 
@@ -49,7 +51,7 @@ void ViterbiPath<Float>::compute(
     void* workspace) {
   WorkspacePtrs<Float> ws(workspace, B, T, N);
 
-#pragma omp parallel for num_threads(B)
+#pragma omp parallel for num_threads(criterionNumThreads(B)) schedule(dynamic)
   for (int b = 0; b < B; ++b) {
     for (int n = 0; n < N; ++n) {
       ws.alpha[b * 2 * N + n] = input[b * T * N + n];
@@ -62,15 +64,9 @@ void ViterbiPath<Float>::compute(
       auto* betaCur = &ws.beta[b * T * N + t * N];
 
       for (int m = 0; m < N; ++m) {
-        int maxIndex = -1;
-        Float maxValue = -INFINITY;
-        for (int n = 0; n < N; ++n) {
-          Float val = alphaPrev[n] + (t == T ? 0 : trans[m * N + n]);
-          if (val > maxValue) {
-            maxIndex = n;
-            maxValue = val;
-          }
-        }
+        Float maxValue;
+        int maxIndex = SimdReduce<Float>::argmaxSum(
+            N, alphaPrev, t == T ? nullptr : &trans[m * N], maxValue);
 
         if (t == T) {
           auto* path = &_path[b * T];
@@ -0,0 +1,440 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/lib/sequence/criterion/cuda/ConnectionistTemporalClassificationCriterion.cuh"
+
+#include <algorithm>
+#include <cmath>
+
+#include "flashlight/lib/sequence/criterion/Workspace.h"
+#include "flashlight/lib/sequence/criterion/cuda/CriterionUtils.cuh"
+using fl::lib::seq::CriterionScaleMode;
+
+namespace {
+
+constexpr int kWarpSize = 32;
+constexpr int kRowBlockSize = 128;
+
+template <class Accum>
+struct WorkspacePtrs {
+  explicit WorkspacePtrs(void* workspace, int B, int T, int N, int L) {
+    const int S = 2 * L + 1;
+    fl::lib::seq::Workspace<> ws(workspace);
+    ws.request(&scale, B);
+    ws.request(&logZ, B);
+    ws.request(&logNorm, B, T);
+    ws.request(&alpha, B, T, S);
+    ws.request(&beta, B, T, S);
+    ws.request(&labels, B, S);
+    ws.request(&nextSame, B, L);
+    ws.request(&firstSame, B, L);
+    requiredSize = ws.requiredSize();
+  }
+
+  Accum* scale;
+  // log of the probability of the target
+  Accum* logZ;
+  // log of the softmax normalization of each frame
+  Accum* logNorm;
+  Accum* alpha;
+  Accum* beta;
+  // Target with a blank before and after each label
+  int* labels;
+  // Next position of the same label in the target, or -1
+  int* nextSame;
+  // Whether a label doesn't appear earlier in the target
+  int* firstSame;
+  size_t requiredSize;
+};
+
+template <class Accum>
+__device__ Accum logAdd(Accum a, Accum b) {
+  if (a < b) {
+    Accum tmp = a;
+    a = b;
+    b = tmp;
+  }
+  if (b == -CUDART_INF) {
+    return a;
+  }
+  return a + log1p(exp(b - a));
+}
+
+template <class Accum>
+struct LogAddOp {
+  __device__ Accum operator()(Accum a, Accum b) const {
+    return logAdd(a, b);
+  }
+};
+
+template <class Accum>
+struct MaxOp {
+  __device__ Accum operator()(Accum a, Accum b) const {
+    return a < b ? b : a;
+  }
+};
+
+template <class Accum>
+struct SumOp {
+  __device__ Accum operator()(Accum a, Accum b) const {
+    return a + b;
+  }
+};
+
+template <class Accum, class Op>
+__device__ Accum warpReduce(Accum value, Op op) {
+  for (int offset = kWarpSize / 2; offset > 0; offset /= 2) {
+    value = op(value, __shfl_down_sync(0xffffffff, value, offset));
+  }
+  return value;
+}
+
+/*
+ * Reduces `value` over the threads of the block with warp shuffles, and
+ * returns the result to all threads. Block size must be a multiple of the
+ * warp size.
+ */
+template <class Accum, class Op>
+__device__ Accum blockReduce(Accum value, Op op, Accum identity) {
+  __shared__ Accum partial[kWarpSize];
+  int lane = threadIdx.x % kWarpSize;
+  int warp = threadIdx.x / kWarpSize;
+  value = warpReduce(value, op);
+  // `partial` may still be read by a previous reduction
+  __syncthreads();
+  if (lane == 0) {
+    partial[warp] = value;
+  }
+  __syncthreads();
+  if (warp == 0) {
+    value = lane < blockDim.x / kWarpSize ? partial[lane] : identity;
+    value = warpReduce(value, op);
+    if (lane == 0) {
+      partial[0] = value;
+    }
+  }
+  __syncthreads();
+  return partial[0];
+}
+
+/*
+ * B * T thread blocks
+ * kRowBlockSize threads/block
+ */
+template <class Float, class Accum>
+__global__ void logNormKernel(int N, const Float* input, Accum* logNorm) {
+  auto* frame = &input[blockIdx.x * N];
+  Accum maxValue = -CUDART_INF;
+  for (int i = threadIdx.x; i < N; i += blockDim.x) {
+    maxValue = max(maxValue, static_cast<Accum>(frame[i]));
+  }
+  maxValue = blockReduce(maxValue, MaxOp<Accum>(), Accum(-CUDART_INF));
+  Accum sum = 0;
+  for (int i = threadIdx.x; i < N; i += blockDim.x) {
+    sum += exp(static_cast<Accum>(frame[i]) - maxValue);
+  }
+  sum = blockReduce(sum, SumOp<Accum>(), Accum(0));
+  if (threadIdx.x == 0) {
+    logNorm[blockIdx.x] = maxValue + log(sum);
+  }
+}
+
+/*
+ * B thread blocks
+ * S threads/block (ideally)
+ */
+template <class Accum>
+__global__ void setupKernel(
+    int N,
+    int _L,
+    const int* _target,
+    const int* targetSize,
+    WorkspacePtrs<Accum> ws) {
+  int b = blockIdx.x;
+  int _S = 2 * _L + 1;
+  auto* target = &_target[b * _L];
+  auto* labels = &ws.labels[b * _S];
+  auto* nextSame = &ws.nextSame[b * _L];
+  auto* firstSame = &ws.firstSame[b * _L];
+  int L = targetSize[b];
+
+  for (int s = threadIdx.x; s < 2 * L + 1; s += blockDim.x) {
+    labels[s] = s % 2 == 1 ? target[s / 2] : N - 1;
+  }
+  for (int l = threadIdx.x; l < L; l += blockDim.x) {
+    nextSame[l] = -1;
+    for (int k = l + 1; k < L; ++k) {
+      if (target[k] == target[l]) {
+        nextSame[l] = k;
+        break;
+      }
+    }
+    firstSame[l] = 1;
+    for (int k = 0; k < l; ++k) {
+      if (target[k] == target[l]) {
+        firstSame[l] = 0;
+        break;
+      }
+    }
+  }
+}
+
+/*
+ * B thread blocks
+ * S threads/block (ideally)
+ */
+template <class Float, class Accum>
+__global__ void alphaKernel(
+    int T,
+    int N,
+    int _L,
+    const Float* _input,
+    const int* targetSize,
+    Accum* loss,
+    WorkspacePtrs<Accum> ws) {
+  int b = blockIdx.x;
+  int _S = 2 * _L + 1;
+  auto* input = &_input[b * T * N];
+  auto* logNorm = &ws.logNorm[b * T];
+  auto* alpha = &ws.alpha[b * T * _S];
+  auto* labels = &ws.labels[b * _S];
+  int S = 2 * targetSize[b] + 1;
+  int blank = N - 1;
+
+  for (int s = threadIdx.x; s < S; s += blockDim.x) {
+    alpha[s] = s < 2 ? static_cast<Accum>(input[labels[s]]) - logNorm[0]
+                     : -CUDART_INF;
+  }
+
+  for (int t = 1; t < T; ++t) {
+    auto* inputCur = &input[t * N];
+    auto* alphaPrev = &alpha[(t - 1) * _S];
+    auto* alphaCur = &alpha[t * _S];
+
+    // Ensure that all previous alphas have been computed
+    __syncthreads();
+
+    for (int s = threadIdx.x; s < S; s += blockDim.x) {
+      Accum a = alphaPrev[s];
+      if (s > 0) {
+        a = logAdd(a, alphaPrev[s - 1]);
+      }
+      // Blanks can be skipped between different labels
+      if (s > 1 && labels[s] != blank && labels[s] != labels[s - 2]) {
+        a = logAdd(a, alphaPrev[s - 2]);
+      }
+      alphaCur[s] = a + static_cast<Accum>(inputCur[labels[s]]) - logNorm[t];
+    }
+  }
+
+  __syncthreads();
+
+  if (threadIdx.x == 0) {
+    auto* alphaLast = &alpha[(T - 1) * _S];
+    Accum logZ =
+        S > 1 ? logAdd(alphaLast[S - 1], alphaLast[S - 2]) : alphaLast[0];
+    ws.logZ[b] = logZ;
+    loss[b] = -logZ * ws.scale[b];
+  }
+}
+
+/*
+ * B thread blocks
+ * S threads/block (ideally)
+ */
+template <class Float, class Accum>
+__global__ void betaKernel(
+    int T,
+    int N,
+    int _L,
+    const Float* _input,
+    const int* targetSize,
+    WorkspacePtrs<Accum> ws) {
+  int b = blockIdx.x;
+  int _S = 2 * _L + 1;
+  auto* input = &_input[b * T * N];
+  auto* logNorm = &ws.logNorm[b * T];
+  auto* beta = &ws.beta[b * T * _S];
+  auto* labels = &ws.labels[b * _S];
+  int S = 2 * targetSize[b] + 1;
+  int blank = N - 1;
+
+  // Excludes the frame at t
+  for (int s = threadIdx.x; s < S; s += blockDim.x) {
+    beta[(T - 1) * _S + s] = s >= S - 2 ? 0 : -CUDART_INF;
+  }
+
+  for (int t = T - 2; t >= 0; --t) {
+    auto* inputNext = &input[(t + 1) * N];
+    auto* betaNext = &beta[(t + 1) * _S];
+    auto* betaCur = &beta[t * _S];
+
+    __syncthreads();
+
+    for (int s = threadIdx.x; s < S; s += blockDim.x) {
+      Accum value = betaNext[s] + static_cast<Accum>(inputNext[labels[s]]);
+      if (s + 1 < S) {
+        value = logAdd(
+            value,
+            betaNext[s + 1] + static_cast<Accum>(inputNext[labels[s + 1]]));
+      }
+      if (s + 2 < S && labels[s + 2] != blank &&
+          labels[s + 2] != labels[s]) {
+        value = logAdd(
+            value,
+            betaNext[s + 2] + static_cast<Accum>(inputNext[labels[s + 2]]));
+      }
+      betaCur[s] = value - logNorm[t + 1];
+    }
+  }
+}
+
+/*
+ * B * T thread blocks
+ * kRowBlockSize threads/block
+ */
+template <class Float, class Accum>
+__global__ void gradKernel(
+    int T,
+    int N,
+    int _L,
+    const Float* input,
+    const int* _target,
+    const int* targetSize,
+    const Accum* grad,
+    Float* inputGrad,
+    WorkspacePtrs<Accum> ws) {
+  int b = blockIdx.x / T;
+  int t = blockIdx.x % T;
+  int _S = 2 * _L + 1;
+  auto* frame = &input[blockIdx.x * N];
+  auto* frameGrad = &inputGrad[blockIdx.x * N];
+  auto* alpha = &ws.alpha[(b * T + t) * _S];
+  auto* beta = &ws.beta[(b * T + t) * _S];
+  auto* target = &_target[b * _L];
+  auto* nextSame = &ws.nextSame[b * _L];
+  auto* firstSame = &ws.firstSame[b * _L];
+  Accum logNorm = ws.logNorm[blockIdx.x];
+  Accum logZ = ws.logZ[b];
+  Accum gradScale = grad[b] * ws.scale[b];
+  int L = targetSize[b];
+  int blank = N - 1;
+
+  // Targets which can't be aligned give no gradient
+  if (logZ == -CUDART_INF) {
+    for (int i = threadIdx.x; i < N; i += blockDim.x) {
+      frameGrad[i] = static_cast<Float>(Accum(0));
+    }
+    return;
+  }
+
+  // Gradient of the softmax: probability - posterior of the token
+  for (int i = threadIdx.x; i < N; i += blockDim.x) {
+    frameGrad[i] = static_cast<Float>(
+        gradScale * exp(static_cast<Accum>(frame[i]) - logNorm));
+  }
+
+  Accum blankPosterior = -CUDART_INF;
+  for (int s = 2 * threadIdx.x; s < 2 * L + 1; s += 2 * blockDim.x) {
+    blankPosterior = logAdd(blankPosterior, alpha[s] + beta[s]);
+  }
+  // Also orders the writes above before the ones below
+  blankPosterior =
+      blockReduce(blankPosterior, LogAddOp<Accum>(), Accum(-CUDART_INF));
+
+  // Positions of the same label are summed by the thread of the first one
+  for (int l = threadIdx.x; l < L; l += blockDim.x) {
+    if (!firstSame[l]) {
+      continue;
+    }
+    Accum posterior = -CUDART_INF;
+    for (int k = l; k >= 0; k = nextSame[k]) {
+      posterior = logAdd(posterior, alpha[2 * k + 1] + beta[2 * k + 1]);
+    }
+    int token = target[l];
+    frameGrad[token] = static_cast<Float>(
+        gradScale *
+        (exp(static_cast<Accum>(frame[token]) - logNorm) -
+         exp(posterior - logZ)));
+  }
+  if (threadIdx.x == 0) {
+    frameGrad[blank] = static_cast<Float>(
+        gradScale *
+        (exp(static_cast<Accum>(frame[blank]) - logNorm) -
+         exp(blankPosterior - logZ)));
+  }
+}
+
+int stateBlockSize(int L) {
+  return std::min(1024, (2 * L + 1 + kWarpSize - 1) / kWarpSize * kWarpSize);
+}
+
+} // namespace
+
+namespace fl {
+namespace lib {
+namespace cuda {
+
+template <class Float>
+size_t ConnectionistTemporalClassificationCriterion<Float>::getWorkspaceSize(
+    int B,
+    int T,
+    int N,
+    int L) {
+  return WorkspacePtrs<Accum>(nullptr, B, T, N, L).requiredSize;
+}
+
+template <class Float>
+void ConnectionistTemporalClassificationCriterion<Float>::forward(
+    int B,
+    int T,
+    int N,
+    int L,
+    CriterionScaleMode scaleMode,
+    const Float* input,
+    const int* target,
+    const int* targetSize,
+    Accum* loss,
+    void* workspace,
+    cudaStream_t stream) {
+  int blockSize = stateBlockSize(L);
+  WorkspacePtrs<Accum> ws(workspace, B, T, N, L);
+  CriterionUtils<Accum>::computeScale(
+      B, T, N, scaleMode, targetSize, ws.scale, stream);
+  logNormKernel<<<B * T, kRowBlockSize, 0, stream>>>(N, input, ws.logNorm);
+  setupKernel<<<B, blockSize, 0, stream>>>(N, L, target, targetSize, ws);
+  alphaKernel<<<B, blockSize, 0, stream>>>(
+      T, N, L, input, targetSize, loss, ws);
+}
+
+template <class Float>
+void ConnectionistTemporalClassificationCriterion<Float>::backward(
+    int B,
+    int T,
+    int N,
+    int L,
+    const Float* input,
+    const int* target,
+    const int* targetSize,
+    const Accum* grad,
+    Float* inputGrad,
+    void* workspace,
+    cudaStream_t stream) {
+  int blockSize = stateBlockSize(L);
+  WorkspacePtrs<Accum> ws(workspace, B, T, N, L);
+  betaKernel<<<B, blockSize, 0, stream>>>(T, N, L, input, targetSize, ws);
+  gradKernel<<<B * T, kRowBlockSize, 0, stream>>>(
+      T, N, L, input, target, targetSize, grad, inputGrad, ws);
+}
+
+template struct ConnectionistTemporalClassificationCriterion<float>;
+template struct ConnectionistTemporalClassificationCriterion<double>;
+template struct ConnectionistTemporalClassificationCriterion<__half>;
+
+} // namespace cuda
+} // namespace lib
+} // namespace fl
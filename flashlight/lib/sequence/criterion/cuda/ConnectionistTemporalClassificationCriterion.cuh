@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cuda_fp16.h>
+#include <cuda_runtime.h>
+
+#include <type_traits>
+
+#include "flashlight/lib/sequence/criterion/Defines.h"
+using fl::lib::seq::CriterionScaleMode;
+
+namespace fl {
+namespace lib {
+namespace cuda {
+
+/**
+ * CTC loss. Reference: https://www.cs.toronto.edu/~graves/icml_2006.pdf
+ *
+ * Inputs are unnormalized scores, to which a softmax is applied over the
+ * dictionary, and the last token of the dictionary is the blank. `Float` can
+ * be float, double or __half, whose computations are done in float.
+ */
+template <class Float>
+struct ConnectionistTemporalClassificationCriterion {
+  /// Type of the loss and of the computations
+  using Accum = typename std::
+      conditional<std::is_same<Float, double>::value, double, float>::type;
+
+  /**
+   * B: batch size
+   * T: input length
+   * N: dictionary size
+   * L: target size
+   */
+  static size_t getWorkspaceSize(int B, int T, int N, int L);
+
+  /**
+   * B: batch size
+   * T: input length
+   * N: dictionary size
+   * L: target size
+   * scaleMode: type of size scaling
+   * input: [B][T][N] input frames from network
+   * target: [B][L] target labels
+   * targetSize: [B] target sizes, at most T minus the number of repeated
+   *   labels
+   * loss: [B] (out) loss value
+   * workspace: (in/out) internal workspace
+   * stream: CUDA stream
+   */
+  static void forward(
+      int B,
+      int T,
+      int N,
+      int L,
+      CriterionScaleMode scaleMode,
+      const Float* input,
+      const int* target,
+      const int* targetSize,
+      Accum* loss,
+      void* workspace,
+      cudaStream_t stream);
+
+  /**
+   * B: batch size
+   * T: input length
+   * N: dictionary size
+   * L: target size
+   * input: [B][T][N] input frames from network
+   * target: [B][L] target labels
+   * targetSize: [B] target sizes
+   * grad: [B] gradient w.r.t. loss
+   * inputGrad: [B][T][N] (out) gradient w.r.t. input
+   * workspace: (in/out) internal workspace from forward
+   * stream: CUDA stream
+   */
+  static void backward(
+      int B,
+      int T,
+      int N,
+      int L,
+      const Float* input,
+      const int* target,
+      const int* targetSize,
+      const Accum* grad,
+      Float* inputGrad,
+      void* workspace,
+      cudaStream_t stream);
+};
+
+} // namespace cuda
+} // namespace lib
+} // namespace fl
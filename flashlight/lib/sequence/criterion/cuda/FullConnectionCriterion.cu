@@ -8,7 +8,12 @@
 #include "flashlight/lib/sequence/criterion/cuda/FullConnectionCriterion.cuh"
 
 #include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
 
+#include <cublas_v2.h>
 #include <cub/cub.cuh>
 
 #include "flashlight/lib/sequence/criterion/Workspace.h"
@@ -19,6 +24,16 @@ namespace {
 
 constexpr int kBlockSize = 32;
 
+// Smallest N for which the forward runs its steps as GEMMs
+constexpr int kGemmMinN = 128;
+
+// Below, the sum of a GEMM step is recomputed exactly
+constexpr double kGemmMinSum = 1e-30;
+
+bool useGemm(int N) {
+  return N >= kGemmMinN;
+}
+
 template <class Float>
 struct WorkspacePtrs {
   explicit WorkspacePtrs(void* workspace, int B, int T, int N) {
@@ -28,6 +43,13 @@ struct WorkspacePtrs {
     ws.request(&alphaGrad, B, T, N);
     ws.request(&transBatchGrad, B, N, N);
     ws.request(&transBuf, B, N, N);
+    if (useGemm(N)) {
+      ws.request(&transExp, N, N);
+      ws.request(&transShift, N);
+      ws.request(&alphaExp, B, N);
+      ws.request(&alphaShift, B);
+      ws.request(&alphaExpSum, B, N);
+    }
     requiredSize = ws.requiredSize();
   }
 
@@ -36,9 +58,87 @@ struct WorkspacePtrs {
   double* alphaGrad;
   double* transBatchGrad;
   double* transBuf;
+  // GEMM forward only
+  Float* transExp{nullptr};
+  double* transShift{nullptr};
+  Float* alphaExp{nullptr};
+  double* alphaShift{nullptr};
+  Float* alphaExpSum{nullptr};
   size_t requiredSize;
 };
 
+void check(cublasStatus_t status, const char* call) {
+  if (status != CUBLAS_STATUS_SUCCESS) {
+    throw std::runtime_error(
+        std::string("FullConnectionCriterion: ") + call +
+        " failed with status " + std::to_string(static_cast<int>(status)));
+  }
+}
+
+void check(cudaError_t err, const char* call) {
+  if (err != cudaSuccess) {
+    throw std::runtime_error(
+        std::string("FullConnectionCriterion: ") + call +
+        " failed: " + cudaGetErrorString(err));
+  }
+}
+
+// cuBLAS handle of the calling thread on the current device, with tensor
+// cores enabled
+cublasHandle_t getCublasHandle() {
+  struct Handle {
+    Handle() {
+      check(cublasCreate(&handle), "cublasCreate");
+#if CUDART_VERSION >= 11000
+      // TF32 inputs, fp32 accumulation
+      check(
+          cublasSetMathMode(handle, CUBLAS_TF32_TENSOR_OP_MATH),
+          "cublasSetMathMode");
+#endif
+    }
+    ~Handle() {
+      cublasDestroy(handle);
+    }
+    cublasHandle_t handle;
+  };
+  // A handle is bound to the device current when it is created
+  thread_local std::unordered_map<int, std::unique_ptr<Handle>> handles;
+  int device;
+  check(cudaGetDevice(&device), "cudaGetDevice");
+  auto& handle = handles[device];
+  if (!handle) {
+    handle = std::make_unique<Handle>();
+  }
+  return handle->handle;
+}
+
+// C[n][m] = sum_k A[m][k] * B[n][k] (row major)
+cublasStatus_t gemm(
+    cublasHandle_t handle,
+    int m,
+    int n,
+    int k,
+    const float* A,
+    const float* B,
+    float* C) {
+  float one = 1, zero = 0;
+  return cublasSgemm(
+      handle, CUBLAS_OP_T, CUBLAS_OP_N, m, n, k, &one, A, k, B, k, &zero, C, m);
+}
+
+cublasStatus_t gemm(
+    cublasHandle_t handle,
+    int m,
+    int n,
+    int k,
+    const double* A,
+    const double* B,
+    double* C) {
+  double one = 1, zero = 0;
+  return cublasDgemm(
+      handle, CUBLAS_OP_T, CUBLAS_OP_N, m, n, k, &one, A, k, B, k, &zero, C, m);
+}
+
 /*
  * B thread blocks
  * kBlockSize threads/block
@@ -111,6 +211,109 @@ __global__ void forwardStep(
   }
 }
 
+/*
+ * N thread blocks
+ * kBlockSize threads/block
+ */
+template <class Float>
+__global__ void
+gemmTransExp(int N, const Float* trans, WorkspacePtrs<Float> ws) {
+  int m = blockIdx.x;
+
+  using BlockReduce = cub::BlockReduce<double, kBlockSize>;
+  __shared__ typename BlockReduce::TempStorage tempStorage;
+  __shared__ double maxValue;
+
+  double threadMax = -INFINITY;
+  for (int n = threadIdx.x; n < N; n += blockDim.x) {
+    double val = trans[m * N + n];
+    threadMax = val > threadMax ? val : threadMax;
+  }
+
+  double maxResult = BlockReduce(tempStorage).Reduce(threadMax, cub::Max());
+  if (threadIdx.x == 0) {
+    maxValue = ws.transShift[m] = maxResult;
+  }
+
+  __syncthreads();
+
+  for (int n = threadIdx.x; n < N; n += blockDim.x) {
+    ws.transExp[m * N + n] = exp(trans[m * N + n] - maxValue);
+  }
+}
+
+/*
+ * B thread blocks
+ * kBlockSize threads/block
+ */
+template <class Float>
+__global__ void gemmAlphaExp(int T, int N, int t, WorkspacePtrs<Float> ws) {
+  int b = blockIdx.x;
+
+  const auto* alphaPrev = &ws.alpha[b * T * N + (t - 1) * N];
+
+  using BlockReduce = cub::BlockReduce<double, kBlockSize>;
+  __shared__ typename BlockReduce::TempStorage tempStorage;
+  __shared__ double maxValue;
+
+  double threadMax = -INFINITY;
+  for (int n = threadIdx.x; n < N; n += blockDim.x) {
+    threadMax = alphaPrev[n] > threadMax ? alphaPrev[n] : threadMax;
+  }
+
+  double maxResult = BlockReduce(tempStorage).Reduce(threadMax, cub::Max());
+  if (threadIdx.x == 0) {
+    maxValue = ws.alphaShift[b] = maxResult;
+  }
+
+  __syncthreads();
+
+  for (int n = threadIdx.x; n < N; n += blockDim.x) {
+    ws.alphaExp[b * N + n] = exp(alphaPrev[n] - maxValue);
+  }
+}
+
+/*
+ * ceil(B * N / 128) thread blocks
+ * 128 threads/block
+ */
+template <class Float>
+__global__ void gemmForwardStep(
+    int B,
+    int T,
+    int N,
+    int t,
+    const Float* input,
+    const Float* trans,
+    WorkspacePtrs<Float> ws) {
+  int i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i >= B * N) {
+    return;
+  }
+  int b = i / N;
+  int m = i % N;
+
+  const auto* alphaPrev = &ws.alpha[b * T * N + (t - 1) * N];
+  double sum = ws.alphaExpSum[i];
+  double value;
+  if (sum >= kGemmMinSum) {
+    value = log(sum) + ws.alphaShift[b] + ws.transShift[m];
+  } else {
+    // The products underflowed: exact logsumexp
+    double maxValue = -INFINITY;
+    for (int n = 0; n < N; ++n) {
+      double val = alphaPrev[n] + trans[m * N + n];
+      maxValue = val > maxValue ? val : maxValue;
+    }
+    sum = 0;
+    for (int n = 0; n < N; ++n) {
+      sum += exp(alphaPrev[n] + trans[m * N + n] - maxValue);
+    }
+    value = log(sum) + maxValue;
+  }
+  ws.alpha[b * T * N + t * N + m] = value + input[b * T * N + t * N + m];
+}
+
 /*
  * B * N thread blocks (B if Initial)
  * kBlockSize threads/block
@@ -262,9 +465,27 @@ void FullConnectionCriterion<Float>::forward(
   CriterionUtils<Float>::computeScale(
       B, T, N, scaleMode, targetSize, ws.scale, stream);
   forwardInitial<<<B, kBlockSize, 0, stream>>>(T, N, input, ws);
-  for (int t = 1; t < T; ++t) {
-    forwardStep<false>
-        <<<B * N, kBlockSize, 0, stream>>>(T, N, t, input, trans, loss, ws);
+  if (useGemm(N)) {
+    // logsumexp_n(alpha[n] + trans[m][n]) =
+    //   log(sum_n exp(alpha[n] - a) * exp(trans[m][n] - c[m])) + a + c[m]
+    // where the sums of all the (b, m) of a step are a GEMM
+    auto handle = getCublasHandle();
+    check(cublasSetStream(handle, stream), "cublasSetStream");
+    gemmTransExp<<<N, kBlockSize, 0, stream>>>(N, trans, ws);
+    int nBlocks = (B * N + 127) / 128;
+    for (int t = 1; t < T; ++t) {
+      gemmAlphaExp<<<B, kBlockSize, 0, stream>>>(T, N, t, ws);
+      check(
+          gemm(handle, N, B, N, ws.transExp, ws.alphaExp, ws.alphaExpSum),
+          "gemm");
+      gemmForwardStep<<<nBlocks, 128, 0, stream>>>(
+          B, T, N, t, input, trans, ws);
+    }
+  } else {
+    for (int t = 1; t < T; ++t) {
+      forwardStep<false>
+          <<<B * N, kBlockSize, 0, stream>>>(T, N, t, input, trans, loss, ws);
+    }
   }
   forwardStep<true>
       <<<B, kBlockSize, 0, stream>>>(T, N, T, input, trans, loss, ws);
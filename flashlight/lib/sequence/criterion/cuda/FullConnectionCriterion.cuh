@@ -16,7 +16,14 @@ namespace fl {
 namespace lib {
 namespace cuda {
 
-/// The denominator of ASG loss. Reference: https://arxiv.org/abs/1609.03193
+/**
+ * The denominator of ASG loss. Reference: https://arxiv.org/abs/1609.03193
+ *
+ * For large dictionaries (N >= 128), the forward computes the logsumexp over
+ * the transitions of all the (b, m) of a frame as a GEMM of the shifted
+ * exponentials of alpha and of the transitions, run on tensor cores (TF32
+ * inputs, fp32 accumulation) with float.
+ */
 template <class Float>
 struct FullConnectionCriterion {
   /**
@@ -17,6 +17,10 @@ namespace {
 
 constexpr int kBlockSize = 32;
 
+// Tile of the batched max-plus steps, used from N = kTiledMinN
+constexpr int kTileSize = 16;
+constexpr int kTiledMinN = 128;
+
 template <class Float>
 struct WorkspacePtrs {
   explicit WorkspacePtrs(void* workspace, int B, int T, int N) {
@@ -99,6 +103,54 @@ __global__ void computeStep(
   }
 }
 
+/*
+ * ceil(B / kTileSize) x ceil(N / kTileSize) thread blocks
+ * kTileSize x kTileSize threads/block
+ */
+template <class Float>
+__global__ void computeStepTiled(
+    int B,
+    int T,
+    int N,
+    int t,
+    const Float* input,
+    const Float* trans,
+    WorkspacePtrs<Float> ws) {
+  int b = blockIdx.x * kTileSize + threadIdx.y;
+  int m = blockIdx.y * kTileSize + threadIdx.x;
+  // Row of the transitions loaded by the thread
+  int mLoad = blockIdx.y * kTileSize + threadIdx.y;
+
+  __shared__ Float alphaTile[kTileSize][kTileSize]; // [b][n]
+  __shared__ Float transTile[kTileSize][kTileSize + 1]; // [m][n]
+
+  Float best = -INFINITY;
+  int bestN = 0;
+  for (int n0 = 0; n0 < N; n0 += kTileSize) {
+    int n = n0 + threadIdx.x;
+    alphaTile[threadIdx.y][threadIdx.x] = b < B && n < N
+        ? ws.alpha[b * 2 * N + ((t - 1) % 2) * N + n]
+        : -INFINITY;
+    transTile[threadIdx.y][threadIdx.x] =
+        mLoad < N && n < N ? trans[mLoad * N + n] : -INFINITY;
+    __syncthreads();
+
+    for (int k = 0; k < kTileSize; ++k) {
+      Float val = alphaTile[threadIdx.y][k] + transTile[threadIdx.x][k];
+      if (val > best) {
+        best = val;
+        bestN = n0 + k;
+      }
+    }
+    __syncthreads();
+  }
+
+  if (b < B && m < N) {
+    ws.alpha[b * 2 * N + (t % 2) * N + m] = best + input[b * T * N + t * N + m];
+    ws.beta[b * T * N + t * N + m] = bestN;
+  }
+}
+
 } // namespace
 
 namespace fl {
@@ -122,9 +174,19 @@ void ViterbiPath<Float>::compute(
     cudaStream_t stream) {
   WorkspacePtrs<Float> ws(workspace, B, T, N);
   computeInitial<<<B, kBlockSize, 0, stream>>>(T, N, input, ws);
-  for (int t = 1; t < T; ++t) {
-    computeStep<false>
-        <<<B * N, kBlockSize, 0, stream>>>(T, N, t, input, trans, path, ws);
+  if (N >= kTiledMinN) {
+    dim3 blocks(
+        (B + kTileSize - 1) / kTileSize, (N + kTileSize - 1) / kTileSize);
+    dim3 threads(kTileSize, kTileSize);
+    for (int t = 1; t < T; ++t) {
+      computeStepTiled<<<blocks, threads, 0, stream>>>(
+          B, T, N, t, input, trans, ws);
+    }
+  } else {
+    for (int t = 1; t < T; ++t) {
+      computeStep<false>
+          <<<B * N, kBlockSize, 0, stream>>>(T, N, t, input, trans, path, ws);
+    }
   }
   computeStep<true>
       <<<B, kBlockSize, 0, stream>>>(T, N, T, input, trans, path, ws);
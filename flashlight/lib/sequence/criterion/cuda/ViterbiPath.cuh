@@ -13,7 +13,13 @@ namespace fl {
 namespace lib {
 namespace cuda {
 
-/// Computes max likelihood path using Viterbi algorithm.
+/**
+ * Computes max likelihood path using Viterbi algorithm.
+ *
+ * For large dictionaries (N >= 128), the max-plus products of the frames are
+ * computed by tiles of utterances and tokens, the tiles of transitions being
+ * shared in shared memory by the whole batch.
+ */
 template <class Float>
 struct ViterbiPath {
   /**
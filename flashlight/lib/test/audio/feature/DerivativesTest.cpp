@@ -110,6 +110,25 @@ TEST(DerivativesTest, batchingTest) {
   }
 }
 
+TEST(DerivativesTest, batchApplyTest) {
+  int numFeat = 13, frameSz = 17, batchSz = 4;
+  auto input = randVec<float>(numFeat * frameSz * batchSz);
+  Derivatives dev(3, 2);
+  auto output = dev.apply(input, numFeat, batchSz);
+  ASSERT_EQ(output.size(), input.size() * 3);
+  // Windows do not cross the frames of another batch item
+  auto perBatchSz = numFeat * frameSz;
+  for (int b = 0; b < batchSz; ++b) {
+    std::vector<float> curInput(
+        input.begin() + b * perBatchSz, input.begin() + (b + 1) * perBatchSz);
+    std::vector<float> curOutput(
+        output.begin() + b * perBatchSz * 3,
+        output.begin() + (b + 1) * perBatchSz * 3);
+    ASSERT_TRUE(compareVec<float>(curOutput, dev.apply(curInput, numFeat)));
+  }
+  ASSERT_THROW(dev.apply(input, numFeat, 5), std::invalid_argument);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -174,6 +174,35 @@ TEST(MfccTest, BatchingTest2) {
   }
 }
 
+TEST(MfccTest, BatchApplyTest) {
+  // Enough frames for several batches of FFTs and a remainder
+  int N = 16000, batchSz = 3;
+  auto input = randVec<float>(N * batchSz);
+  FeatureParams featparams;
+  featparams.useEnergy = true;
+  featparams.zeroMeanFrame = true;
+
+  PowerSpectrum powspec(featparams);
+  Mfsc mfsc(featparams);
+  Mfcc mfcc(featparams);
+  std::vector<PowerSpectrum*> featurizers = {&powspec, &mfsc, &mfcc};
+  for (auto featurizer : featurizers) {
+    auto output = featurizer->batchApply(input, batchSz);
+    auto perBatchOutSz = featurizer->outputSize(N);
+    ASSERT_GT(perBatchOutSz, 0);
+    ASSERT_EQ(output.size(), perBatchOutSz * batchSz);
+    for (int i = 0; i < batchSz; ++i) {
+      std::vector<float> curInput(
+          input.begin() + i * N, input.begin() + (i + 1) * N);
+      auto curOutput = featurizer->apply(curInput);
+      ASSERT_EQ(curOutput.size(), perBatchOutSz);
+      for (int j = 0; j < curOutput.size(); ++j) {
+        ASSERT_NEAR(curOutput[j], output[j + i * perBatchOutSz], 1E-3);
+      }
+    }
+  }
+}
+
 TEST(MfccTest, EmptyTest) {
   std::vector<float> input;
   FeatureParams featparams;
@@ -27,6 +27,22 @@ TEST(SpeechUtilsTest, SimpleMatmul) {
   EXPECT_TRUE(compareVec(op, expectedOp, 1E-10));
 }
 
+TEST(SpeechUtilsTest, OverlapAddConvolve) {
+  for (int irLen : {1, 7, 100, 3000}) {
+    auto input = randVec<float>(2345);
+    auto ir = randVec<float>(irLen);
+    auto output = overlapAddConvolve(input, ir);
+    std::vector<float> expectedOp(input.size(), 0.0);
+    for (int n = 0; n < input.size(); ++n) {
+      for (int k = 0; k < ir.size() && k <= n; ++k) {
+        expectedOp[n] += ir[k] * input[n - k];
+      }
+    }
+    EXPECT_TRUE(compareVec(output, expectedOp, 1E-3));
+  }
+  EXPECT_TRUE(overlapAddConvolve({}, {1.0}).empty());
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
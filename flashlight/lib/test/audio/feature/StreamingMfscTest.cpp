@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+
+#include "flashlight/lib/audio/feature/FeatureParams.h"
+#include "flashlight/lib/audio/feature/Mfsc.h"
+#include "flashlight/lib/audio/feature/StreamingMfsc.h"
+
+#include "flashlight/lib/test/audio/feature/TestUtils.h"
+
+using namespace fl::lib::audio;
+
+namespace {
+// Feeds `input` by chunks of `chunkSz` samples
+std::vector<float> streamApply(
+    StreamingMfsc& mfsc,
+    const std::vector<float>& input,
+    int chunkSz) {
+  std::vector<float> output;
+  for (size_t start = 0; start < input.size(); start += chunkSz) {
+    auto end = std::min(start + chunkSz, input.size());
+    auto feat = mfsc.apply(
+        std::vector<float>(input.begin() + start, input.begin() + end));
+    output.insert(output.end(), feat.begin(), feat.end());
+  }
+  auto feat = mfsc.flush();
+  output.insert(output.end(), feat.begin(), feat.end());
+  return output;
+}
+} // namespace
+
+TEST(StreamingMfscTest, OfflineCompareTest) {
+  auto input = randVec<float>(12345);
+  std::vector<std::pair<int, int>> windows = {{0, 0}, {2, 0}, {2, 2}, {9, 7}};
+  for (auto window : windows) {
+    for (auto useEnergy : {true, false}) {
+      FeatureParams featparams;
+      featparams.deltaWindow = window.first;
+      featparams.accWindow = window.second;
+      featparams.useEnergy = useEnergy;
+      Mfsc mfsc(featparams);
+      auto expected = mfsc.apply(input);
+      ASSERT_GT(expected.size(), 0);
+
+      StreamingMfsc streamingMfsc(featparams);
+      for (int chunkSz : {1, 100, 160, 400, 1234, 20000}) {
+        auto output = streamApply(streamingMfsc, input, chunkSz);
+        ASSERT_TRUE(compareVec<float>(output, expected, 1E-4));
+      }
+    }
+  }
+}
+
+TEST(StreamingMfscTest, LatencyTest) {
+  FeatureParams featparams;
+  featparams.deltaWindow = 2;
+  featparams.accWindow = 3;
+  StreamingMfsc mfsc(featparams);
+  int frameSz = featparams.numFrameSizeSamples();
+  int frameStride = featparams.numFrameStrideSamples();
+  int featSz = featparams.mfscFeatSz();
+
+  // Not a full frame yet
+  auto output = mfsc.apply(randVec<float>(frameSz - 1));
+  ASSERT_TRUE(output.empty());
+  // 20 frames, the last 5 need the next frames for their derivatives
+  output = mfsc.apply(randVec<float>(1 + 19 * frameStride));
+  ASSERT_EQ(output.size(), 15 * featSz);
+  output = mfsc.apply(randVec<float>(frameStride));
+  ASSERT_EQ(output.size(), featSz);
+  output = mfsc.flush();
+  ASSERT_EQ(output.size(), 5 * featSz);
+  ASSERT_TRUE(mfsc.flush().empty());
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -5,6 +5,7 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <algorithm>
 #include <future>
 #include <mutex>
 #include <string>
@@ -13,12 +14,20 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include "flashlight/lib/common/LockFreeProducerConsumerQueue.h"
 #include "flashlight/lib/common/ProducerConsumerQueue.h"
 
 using namespace fl::lib;
 
-TEST(ProducerConsumerQueueTest, SingleThread) {
-  ProducerConsumerQueue<int> queue(10);
+template <typename Queue>
+class ProducerConsumerQueueTest : public ::testing::Test {};
+
+using Queues = ::testing::
+    Types<ProducerConsumerQueue<int>, LockFreeProducerConsumerQueue<int>>;
+TYPED_TEST_CASE(ProducerConsumerQueueTest, Queues);
+
+TYPED_TEST(ProducerConsumerQueueTest, SingleThread) {
+  TypeParam queue(10);
 
   // Producing
   for (int i = 1; i <= 5; i++) {
@@ -37,13 +46,13 @@ TEST(ProducerConsumerQueueTest, SingleThread) {
   ASSERT_THAT(output, testing::ElementsAre(1, 2, 3, 4, 5));
 }
 
-TEST(ProducerConsumerQueueTest, MultiThreads) {
+TYPED_TEST(ProducerConsumerQueueTest, MultiThreads) {
   const int nElements = 1000, targetSum = 499500;
-  const int nProducer = std::thread::hardware_concurrency() / 2,
-            nConsumer = std::thread::hardware_concurrency() / 2;
+  const int nProducer = std::max(1u, std::thread::hardware_concurrency() / 2),
+            nConsumer = nProducer;
   std::vector<int> consumerResults(nConsumer, 0);
 
-  ProducerConsumerQueue<int> queue(nElements);
+  TypeParam queue(nElements);
 
   // Define producer and consumers
   auto produce = [nElements, nProducer, &queue](int tid) {
@@ -87,6 +96,83 @@ TEST(ProducerConsumerQueueTest, MultiThreads) {
   ASSERT_EQ(predictSum, targetSum);
 }
 
+TYPED_TEST(ProducerConsumerQueueTest, Many) {
+  TypeParam queue(4);
+
+  // Adding waits for the consumer to free some room
+  auto producer = std::async(std::launch::async, [&queue]() {
+    queue.addMany({1, 2, 3, 4, 5, 6, 7, 8, 9, 10});
+    queue.finishAdding();
+  });
+
+  std::vector<int> output, units;
+  while (queue.getMany(units, 3)) {
+    ASSERT_GE(units.size(), 1u);
+    ASSERT_LE(units.size(), 3u);
+    output.insert(output.end(), units.begin(), units.end());
+  }
+  producer.wait();
+  ASSERT_TRUE(units.empty());
+  ASSERT_THAT(output, testing::ElementsAre(1, 2, 3, 4, 5, 6, 7, 8, 9, 10));
+
+  // Ignored once adding is finished
+  queue.add(11);
+  queue.addMany({12, 13});
+  ASSERT_FALSE(queue.getMany(units, 3));
+
+  queue.clear();
+  queue.add(14);
+  queue.finishAdding();
+  int element;
+  ASSERT_TRUE(queue.get(element));
+  ASSERT_EQ(element, 14);
+  ASSERT_FALSE(queue.get(element));
+}
+
+TYPED_TEST(ProducerConsumerQueueTest, MultiThreadsMany) {
+  const int nElements = 10000, nThreads = 4;
+  TypeParam queue(64);
+
+  std::vector<std::future<void>> producers;
+  for (int t = 0; t < nThreads; t++) {
+    producers.push_back(std::async(std::launch::async, [&queue, t]() {
+      std::vector<int> units;
+      for (int i = t; i < nElements; i += nThreads) {
+        units.push_back(i);
+        if (units.size() == 7) {
+          queue.addMany(std::move(units));
+          units.clear();
+        }
+      }
+      queue.addMany(std::move(units));
+    }));
+  }
+
+  std::vector<std::future<int64_t>> consumers;
+  for (int t = 0; t < nThreads; t++) {
+    consumers.push_back(std::async(std::launch::async, [&queue]() {
+      int64_t sum = 0;
+      std::vector<int> units;
+      while (queue.getMany(units, 5)) {
+        for (auto unit : units) {
+          sum += unit;
+        }
+      }
+      return sum;
+    }));
+  }
+
+  for (auto& producer : producers) {
+    producer.wait();
+  }
+  queue.finishAdding();
+  int64_t sum = 0;
+  for (auto& consumer : consumers) {
+    sum += consumer.get();
+  }
+  ASSERT_EQ(sum, int64_t(nElements) * (nElements - 1) / 2);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -111,6 +111,22 @@ TEST(SystemTest, RetryWithBackoff) {
       retryAsync(ms0, 1.0, 5, alwaysFailsVoid).get(), std::runtime_error);
 }
 
+TEST(SystemTest, MemoryMappedFile) {
+  auto path = getTmpPath("MemoryMappedFile.bin");
+  std::string content = "flashlight mapped content";
+  {
+    auto stream = createOutputStream(path, std::ios::out | std::ios::binary);
+    stream << content;
+  }
+  MemoryMappedFile mapping(path);
+  ASSERT_EQ(mapping.size(), content.size());
+  ASSERT_EQ(std::string(mapping.data(), mapping.size()), content);
+
+  ASSERT_THROW(
+      MemoryMappedFile(getTmpPath("MemoryMappedFile.missing")),
+      std::runtime_error);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
 
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/lib/sequence/criterion/cpu/ConnectionistTemporalClassificationCriterion.h"
+#include "flashlight/lib/sequence/criterion/cpu/CriterionUtils.h"
+#include "flashlight/lib/sequence/criterion/cpu/ForceAlignmentCriterion.h"
+
+using namespace fl::lib::cpu;
+
+namespace {
+
+const int B = 7, T = 30, N = 6, L = 8;
+
+struct Batch {
+  std::vector<float> input, trans;
+  std::vector<int> target, targetSize;
+};
+
+Batch randomBatch() {
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<float> value(-3, 0);
+  std::uniform_int_distribution<int> token(0, N - 2);
+  Batch batch;
+  batch.input.resize(B * T * N);
+  batch.trans.resize(N * N);
+  batch.target.resize(B * L);
+  batch.targetSize.resize(B);
+  for (auto& x : batch.input) {
+    x = value(gen);
+  }
+  for (auto& x : batch.trans) {
+    x = value(gen);
+  }
+  for (auto& x : batch.target) {
+    x = token(gen);
+  }
+  for (int b = 0; b < B; ++b) {
+    batch.targetSize[b] = 1 + b % L;
+  }
+  return batch;
+}
+
+struct Results {
+  std::vector<float> loss, inputGrad, transGrad;
+  std::vector<int> paths, ctcPaths;
+};
+
+Results run(const Batch& batch) {
+  using FAC = ForceAlignmentCriterion<float>;
+  using CTC = ConnectionistTemporalClassificationCriterion<float>;
+  Results res;
+  res.loss.resize(B);
+  res.inputGrad.resize(B * T * N);
+  res.transGrad.resize(N * N);
+  res.paths.resize(B * T);
+  res.ctcPaths.resize(B * T);
+  std::vector<float> grad(B, 1);
+
+  std::vector<char> ws(FAC::getWorkspaceSize(B, T, N, L));
+  FAC::forward(
+      B,
+      T,
+      N,
+      L,
+      CriterionScaleMode::TARGET_SZ,
+      batch.input.data(),
+      batch.target.data(),
+      batch.targetSize.data(),
+      batch.trans.data(),
+      res.loss.data(),
+      ws.data());
+  FAC::backward(
+      B,
+      T,
+      N,
+      L,
+      batch.target.data(),
+      batch.targetSize.data(),
+      grad.data(),
+      res.inputGrad.data(),
+      res.transGrad.data(),
+      ws.data());
+  FAC::viterbi(
+      B,
+      T,
+      N,
+      L,
+      batch.input.data(),
+      batch.target.data(),
+      batch.targetSize.data(),
+      batch.trans.data(),
+      res.paths.data(),
+      ws.data());
+
+  std::vector<char> ctcWs(CTC::getWorkspaceSize(B, T, N, L));
+  CTC::viterbi(
+      B,
+      T,
+      N,
+      L,
+      batch.input.data(),
+      batch.target.data(),
+      batch.targetSize.data(),
+      res.ctcPaths.data(),
+      ctcWs.data());
+  return res;
+}
+
+} // namespace
+
+TEST(BatchParallelTest, NumThreads) {
+  setCriterionNumThreads(3);
+  ASSERT_EQ(criterionNumThreads(8), 3);
+  ASSERT_EQ(criterionNumThreads(2), 2);
+  setCriterionNumThreads(0);
+  ASSERT_GE(criterionNumThreads(8), 1);
+  ASSERT_LE(criterionNumThreads(8), 8);
+  ASSERT_THROW(setCriterionNumThreads(-1), std::invalid_argument);
+}
+
+TEST(BatchParallelTest, SameResults) {
+  auto batch = randomBatch();
+  setCriterionNumThreads(1);
+  auto expected = run(batch);
+  for (int numThreads : {0, 2, B}) {
+    setCriterionNumThreads(numThreads);
+    auto res = run(batch);
+    ASSERT_EQ(res.loss, expected.loss);
+    ASSERT_EQ(res.inputGrad, expected.inputGrad);
+    ASSERT_EQ(res.transGrad, expected.transGrad);
+    ASSERT_EQ(res.paths, expected.paths);
+    ASSERT_EQ(res.ctcPaths, expected.ctcPaths);
+  }
+  setCriterionNumThreads(0);
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/lib/sequence/criterion/cpu/SimdReduce.h"
+
+using namespace fl::lib::cpu;
+
+namespace {
+
+template <class Float>
+std::vector<Float> randomVector(int N, int seed) {
+  std::mt19937 gen(seed);
+  std::uniform_int_distribution<int> dist(-20, 20);
+  std::vector<Float> v(N);
+  for (auto& x : v) {
+    // Few distinct values, so that there are ties
+    x = dist(gen) / 4.0;
+  }
+  return v;
+}
+
+template <class Float>
+void testArgmaxSum() {
+  for (int N : {1, 7, 16, 33, 100}) {
+    auto a = randomVector<Float>(N, N);
+    auto b = randomVector<Float>(N, N + 1);
+    for (bool withB : {false, true}) {
+      int expectedIndex = -1;
+      Float expectedValue = -INFINITY;
+      for (int n = 0; n < N; n++) {
+        Float val = withB ? a[n] + b[n] : a[n];
+        if (val > expectedValue) {
+          expectedIndex = n;
+          expectedValue = val;
+        }
+      }
+      Float maxValue;
+      int maxIndex = SimdReduce<Float>::argmaxSum(
+          N, a.data(), withB ? b.data() : nullptr, maxValue);
+      ASSERT_EQ(maxIndex, expectedIndex);
+      ASSERT_EQ(maxValue, expectedValue);
+    }
+  }
+
+  std::vector<Float> allInf(40, -INFINITY);
+  Float maxValue;
+  ASSERT_EQ(
+      SimdReduce<Float>::argmaxSum(40, allInf.data(), nullptr, maxValue), -1);
+  ASSERT_EQ(maxValue, -INFINITY);
+}
+
+} // namespace
+
+TEST(SimdReduceTest, ArgmaxSum) {
+  testArgmaxSum<float>();
+  testArgmaxSum<double>();
+}
+
+TEST(SimdReduceTest, AddMax) {
+  for (int N : {1, 7, 16, 33, 100}) {
+    auto a = randomVector<double>(N, N);
+    auto b = randomVector<float>(N, N + 1);
+    std::vector<double> out(N);
+    double maxValue =
+        SimdReduce<float>::addMax(N, a.data(), b.data(), out.data());
+    double expectedMax = -INFINITY;
+    for (int n = 0; n < N; n++) {
+      ASSERT_EQ(out[n], a[n] + b[n]);
+      expectedMax = std::max(expectedMax, out[n]);
+    }
+    ASSERT_EQ(maxValue, expectedMax);
+  }
+}
+
+TEST(SimdReduceTest, ExpShiftSum) {
+  const int N = 1001;
+  std::vector<double> x(N), expected(N);
+  double expectedSum = 0;
+  for (int n = 0; n < N; n++) {
+    x[n] = -0.7 * n + 3;
+    expected[n] = std::exp(x[n] - 3);
+    expectedSum += expected[n];
+  }
+  x[5] = -INFINITY;
+  expectedSum -= expected[5];
+  expected[5] = 0;
+
+  double sum = expShiftSum(N, 3, x.data());
+  ASSERT_NEAR(sum, expectedSum, 1e-12 * expectedSum);
+  for (int n = 0; n < N; n++) {
+    ASSERT_NEAR(x[n], expected[n], 1e-15 * expected[n]) << n;
+  }
+}
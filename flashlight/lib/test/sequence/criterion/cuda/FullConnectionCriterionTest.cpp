@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <cuda_runtime.h>
+#include <gtest/gtest.h>
+
+#include "flashlight/lib/sequence/criterion/cpu/FullConnectionCriterion.h"
+#include "flashlight/lib/sequence/criterion/cuda/FullConnectionCriterion.cuh"
+
+namespace {
+
+const int B = 3, T = 20;
+
+void check(cudaError_t err) {
+  if (err != cudaSuccess) {
+    throw std::runtime_error(
+        std::string("CUDA error: ") + cudaGetErrorString(err));
+  }
+}
+
+// Device memory, freed when out of scope
+template <class T>
+class DeviceBuffer {
+ public:
+  explicit DeviceBuffer(size_t size) {
+    check(cudaMalloc(&ptr_, std::max<size_t>(size, 1) * sizeof(T)));
+  }
+
+  explicit DeviceBuffer(const std::vector<T>& host)
+      : DeviceBuffer(host.size()) {
+    check(cudaMemcpy(
+        ptr_, host.data(), host.size() * sizeof(T), cudaMemcpyHostToDevice));
+  }
+
+  ~DeviceBuffer() {
+    cudaFree(ptr_);
+  }
+
+  std::vector<T> toHost(size_t size) const {
+    std::vector<T> host(size);
+    check(cudaMemcpy(
+        host.data(), ptr_, size * sizeof(T), cudaMemcpyDeviceToHost));
+    return host;
+  }
+
+  T* get() const {
+    return ptr_;
+  }
+
+ private:
+  T* ptr_;
+};
+
+template <class Float>
+struct Results {
+  std::vector<Float> loss, inputGrad, transGrad;
+};
+
+template <class Float>
+struct Batch {
+  std::vector<Float> input, trans, grad;
+};
+
+template <class Float>
+Batch<Float> randomBatch(int N) {
+  std::mt19937 gen(N);
+  std::uniform_real_distribution<Float> value(-3, 0);
+  std::uniform_real_distribution<Float> grad(0.5, 1.5);
+  Batch<Float> batch;
+  batch.input.resize(B * T * N);
+  batch.trans.resize(N * N);
+  batch.grad.resize(B);
+  for (auto& x : batch.input) {
+    x = value(gen);
+  }
+  for (auto& x : batch.trans) {
+    x = value(gen);
+  }
+  for (auto& x : batch.grad) {
+    x = grad(gen);
+  }
+  return batch;
+}
+
+template <class Float>
+Results<Float> runCpu(int N, const Batch<Float>& batch) {
+  using FCC = fl::lib::cpu::FullConnectionCriterion<Float>;
+  Results<Float> res;
+  res.loss.resize(B);
+  res.inputGrad.resize(B * T * N);
+  res.transGrad.resize(N * N);
+  std::vector<char> workspace(FCC::getWorkspaceSize(B, T, N));
+  FCC::forward(
+      B,
+      T,
+      N,
+      CriterionScaleMode::NONE,
+      batch.input.data(),
+      nullptr,
+      batch.trans.data(),
+      res.loss.data(),
+      workspace.data());
+  FCC::backward(
+      B,
+      T,
+      N,
+      batch.trans.data(),
+      batch.grad.data(),
+      res.inputGrad.data(),
+      res.transGrad.data(),
+      workspace.data());
+  return res;
+}
+
+template <class Float>
+Results<Float> runCuda(int N, const Batch<Float>& batch) {
+  using FCC = fl::lib::cuda::FullConnectionCriterion<Float>;
+  DeviceBuffer<Float> input(batch.input);
+  DeviceBuffer<Float> trans(batch.trans);
+  DeviceBuffer<Float> grad(batch.grad);
+  DeviceBuffer<Float> loss(B);
+  DeviceBuffer<Float> inputGrad(B * T * N);
+  DeviceBuffer<Float> transGrad(N * N);
+  DeviceBuffer<char> workspace(FCC::getWorkspaceSize(B, T, N));
+  FCC::forward(
+      B,
+      T,
+      N,
+      CriterionScaleMode::NONE,
+      input.get(),
+      nullptr,
+      trans.get(),
+      loss.get(),
+      workspace.get(),
+      0);
+  FCC::backward(
+      B,
+      T,
+      N,
+      trans.get(),
+      grad.get(),
+      inputGrad.get(),
+      transGrad.get(),
+      workspace.get(),
+      0);
+  check(cudaDeviceSynchronize());
+  return {loss.toHost(B), inputGrad.toHost(B * T * N), transGrad.toHost(N * N)};
+}
+
+template <class Float>
+void expectNear(
+    const std::vector<Float>& actual,
+    const std::vector<Float>& expected,
+    double relTolerance) {
+  ASSERT_EQ(actual.size(), expected.size());
+  for (size_t i = 0; i < actual.size(); ++i) {
+    ASSERT_NEAR(
+        actual[i],
+        expected[i],
+        relTolerance * std::max<double>(1, std::abs(expected[i])))
+        << "at " << i;
+  }
+}
+
+// The forward runs as GEMMs from N = 128 on, with TF32 inputs in float
+template <class Float>
+void testMatchesCpu(double relTolerance) {
+  for (int N : {40, 128, 150}) {
+    auto batch = randomBatch<Float>(N);
+    auto expected = runCpu(N, batch);
+    auto actual = runCuda(N, batch);
+    expectNear(actual.loss, expected.loss, relTolerance);
+    expectNear(actual.inputGrad, expected.inputGrad, relTolerance);
+    expectNear(actual.transGrad, expected.transGrad, relTolerance);
+  }
+}
+
+class FullConnectionCriterionCudaTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    int count = 0;
+    if (cudaGetDeviceCount(&count) != cudaSuccess || count == 0) {
+      GTEST_SKIP() << "FullConnectionCriterion CUDA tests require a GPU";
+    }
+  }
+};
+
+} // namespace
+
+TEST_F(FullConnectionCriterionCudaTest, MatchesCpuFloat) {
+  testMatchesCpu<float>(2E-3);
+}
+
+TEST_F(FullConnectionCriterionCudaTest, MatchesCpuDouble) {
+  testMatchesCpu<double>(1E-9);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/lib/common/System.h"
+#include "flashlight/lib/text/decoder/CompiledLexicon.h"
+#include "flashlight/lib/text/dictionary/Defines.h"
+
+using namespace fl::lib;
+using namespace fl::lib::text;
+
+namespace {
+
+CompiledLexicon compileLexicon() {
+  CompiledLexicon compiled;
+  compiled.lexicon = {
+      {"ab", {{"a", "b"}}},
+      {"ba", {{"b", "a"}, {"b", "a", "a"}}},
+      {kUnkToken, {}}};
+  compiled.wordDict = createWordDict(compiled.lexicon);
+
+  Trie trie(3, 0);
+  trie.insert({1, 2}, compiled.wordDict.getIndex("ab"), -1);
+  trie.insert({2, 1}, compiled.wordDict.getIndex("ba"), -2);
+  trie.insert({2, 1, 1}, compiled.wordDict.getIndex("ba"), -2);
+  trie.smear(SmearingMode::MAX);
+  compiled.trie = std::make_shared<FlatTrie>(trie);
+  return compiled;
+}
+
+} // namespace
+
+TEST(CompiledLexiconTest, SaveLoad) {
+  auto compiled = compileLexicon();
+  auto path = getTmpPath("CompiledLexiconTest.bin");
+  uint64_t inputHash = hashString("lexicon inputs");
+  compiled.save(path, inputHash);
+
+  CompiledLexicon loaded;
+  ASSERT_TRUE(loaded.load(path, inputHash));
+  ASSERT_EQ(loaded.wordDict.indexSize(), compiled.wordDict.indexSize());
+  for (int i = 0; i < compiled.wordDict.indexSize(); i++) {
+    ASSERT_EQ(loaded.wordDict.getEntry(i), compiled.wordDict.getEntry(i));
+  }
+  ASSERT_EQ(
+      loaded.wordDict.getIndex("unknown word"),
+      compiled.wordDict.getIndex(kUnkToken));
+  ASSERT_EQ(loaded.lexicon, compiled.lexicon);
+  ASSERT_NE(loaded.trie, nullptr);
+  ASSERT_EQ(loaded.trie->nNodes(), compiled.trie->nNodes());
+  auto node = loaded.trie->getChild(loaded.trie->getRoot(), 2);
+  node = loaded.trie->getChild(node, 1);
+  ASSERT_EQ(node->nLabels, 1);
+  ASSERT_EQ(loaded.trie->getLabels(node)[0], loaded.wordDict.getIndex("ba"));
+
+  // Stale or missing artifacts aren't loaded
+  ASSERT_FALSE(loaded.load(path, inputHash + 1));
+  ASSERT_FALSE(loaded.load(path + ".missing", inputHash));
+
+  // Without trie
+  compiled.trie = nullptr;
+  compiled.save(path, inputHash);
+  ASSERT_TRUE(loaded.load(path, inputHash));
+  ASSERT_EQ(loaded.trie, nullptr);
+  ASSERT_EQ(loaded.lexicon, compiled.lexicon);
+}
+
+TEST(CompiledLexiconTest, Hash) {
+  ASSERT_EQ(hashString("abc"), hashString("abc"));
+  ASSERT_NE(hashString("abc"), hashString("abd"));
+  // Strings are delimited
+  ASSERT_NE(
+      hashString("b", hashString("a")), hashString("", hashString("ab")));
+
+  auto path = getTmpPath("CompiledLexiconTest.txt");
+  {
+    auto stream = createOutputStream(path);
+    stream << "abc";
+  }
+  ASSERT_EQ(hashFile(path), hashBytes("abc", 3));
+
+  Dictionary dict;
+  dict.addEntry("a");
+  dict.addEntry("b");
+  Dictionary otherDict;
+  otherDict.addEntry("b");
+  otherDict.addEntry("a");
+  ASSERT_NE(hashDictionary(dict), hashDictionary(otherDict));
+}
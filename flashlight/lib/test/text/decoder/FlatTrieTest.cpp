@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/lib/common/System.h"
+#include "flashlight/lib/text/decoder/FlatTrie.h"
+#include "flashlight/lib/text/decoder/Trie.h"
+
+using namespace fl::lib;
+using namespace fl::lib::text;
+
+namespace {
+
+const std::vector<std::vector<int>> kSpellings = {
+    {1, 2}, {1, 2, 3}, {2, 4}, {3}, {4, 1, 1}, {3, 3, 2}, {3}};
+
+TriePtr buildTrie() {
+  auto trie = std::make_shared<Trie>(5, 0);
+  for (int i = 0; i < kSpellings.size(); i++) {
+    trie->insert(kSpellings[i], i, -1.0f * (i + 1));
+  }
+  trie->smear(SmearingMode::MAX);
+  return trie;
+}
+
+const FlatTrieNode* search(
+    const FlatTrie& trie,
+    const std::vector<int>& indices) {
+  const FlatTrieNode* node = trie.getRoot();
+  for (auto idx : indices) {
+    node = trie.getChild(node, idx);
+    if (!node) {
+      return nullptr;
+    }
+  }
+  return node;
+}
+
+void checkSameTrie(Trie& trie, const FlatTrie& flatTrie) {
+  for (const auto& spelling : kSpellings) {
+    for (int len = 1; len <= spelling.size(); len++) {
+      std::vector<int> prefix(spelling.begin(), spelling.begin() + len);
+      auto node = trie.search(prefix);
+      auto flatNode = search(flatTrie, prefix);
+      ASSERT_NE(flatNode, nullptr);
+      ASSERT_EQ(flatNode->idx, node->idx);
+      ASSERT_EQ(flatNode->maxScore, node->maxScore);
+      ASSERT_EQ(flatNode->nChildren, node->children.size());
+      ASSERT_EQ(flatNode->nLabels, node->labels.size());
+      for (int i = 0; i < node->labels.size(); i++) {
+        ASSERT_EQ(flatTrie.getLabels(flatNode)[i], node->labels[i]);
+        ASSERT_EQ(flatTrie.getScores(flatNode)[i], node->scores[i]);
+      }
+    }
+  }
+  ASSERT_EQ(search(flatTrie, {2, 2}), nullptr);
+  ASSERT_EQ(search(flatTrie, {4, 1, 1, 1}), nullptr);
+}
+
+} // namespace
+
+TEST(FlatTrieTest, Freeze) {
+  auto trie = buildTrie();
+  FlatTrie flatTrie(*trie);
+  // root + 1 -> 12 -> 123, 2 -> 24, 3 -> 33 -> 332, 4 -> 41 -> 411
+  ASSERT_EQ(flatTrie.nNodes(), 12);
+  ASSERT_EQ(flatTrie.nLabels(), kSpellings.size());
+  ASSERT_EQ(flatTrie.getRoot()->idx, 0);
+  checkSameTrie(*trie, flatTrie);
+}
+
+TEST(FlatTrieTest, SaveLoad) {
+  auto trie = buildTrie();
+  auto path = getTmpPath("FlatTrieTest.bin");
+  FlatTrie(*trie).save(path);
+
+  auto flatTrie = FlatTrie::load(path);
+  ASSERT_EQ(flatTrie->nNodes(), 12);
+  ASSERT_EQ(flatTrie->nLabels(), kSpellings.size());
+  checkSameTrie(*trie, *flatTrie);
+
+  // Truncated files are rejected
+  {
+    auto stream = createOutputStream(path, std::ios::out | std::ios::binary);
+    stream << "FLTRIE";
+  }
+  ASSERT_THROW(FlatTrie::load(path), std::runtime_error);
+}
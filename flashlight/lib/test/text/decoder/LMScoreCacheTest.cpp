@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/lib/text/decoder/lm/LMScoreCache.h"
+
+using namespace fl::lib::text;
+
+TEST(LMScoreCacheTest, FindInsert) {
+  LMScoreCache cache(8, sizeof(int), 2);
+  float score;
+  int state;
+  ASSERT_FALSE(cache.find(42, 3, score, &state));
+
+  int outState = 7;
+  cache.insert(42, 3, -1.5, &outState);
+  ASSERT_TRUE(cache.find(42, 3, score, &state));
+  ASSERT_EQ(score, -1.5);
+  ASSERT_EQ(state, 7);
+  ASSERT_FALSE(cache.find(42, 4, score, &state));
+  ASSERT_FALSE(cache.find(43, 3, score, &state));
+
+  ASSERT_EQ(cache.nHits(), 1);
+  ASSERT_EQ(cache.nMisses(), 3);
+  cache.resetCounters();
+  ASSERT_EQ(cache.nHits(), 0);
+  ASSERT_EQ(cache.nMisses(), 0);
+}
+
+TEST(LMScoreCacheTest, BoundedSize) {
+  LMScoreCache cache(16, sizeof(int), 1);
+  float score;
+  int state;
+  for (int i = 0; i < 100; i++) {
+    cache.insert(i, 0, -i, &i);
+    // Keep using the first entry, so that CLOCK never evicts it
+    ASSERT_TRUE(cache.find(0, 0, score, &state));
+    ASSERT_LE(cache.size(), cache.capacity());
+  }
+  ASSERT_EQ(cache.size(), 16);
+  ASSERT_TRUE(cache.find(99, 0, score, &state));
+  ASSERT_EQ(state, 99);
+  ASSERT_FALSE(cache.find(1, 0, score, &state));
+}
+
+TEST(LMScoreCacheTest, Concurrent) {
+  LMScoreCache cache(1000, sizeof(int));
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&cache]() {
+      float score;
+      int state;
+      for (int i = 0; i < 5000; i++) {
+        int context = i % 2000;
+        if (cache.find(context, 1, score, &state)) {
+          ASSERT_EQ(state, context);
+          ASSERT_EQ(score, -context);
+        } else {
+          cache.insert(context, 1, -context, &context);
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_LE(cache.size(), cache.capacity());
+  ASSERT_EQ(cache.nHits() + cache.nMisses(), 4 * 5000);
+}
@@ -0,0 +1,682 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/lib/text/decoder/LMLookahead.h"
+#include "flashlight/lib/text/decoder/LexiconDecoder.h"
+#include "flashlight/lib/text/decoder/LexiconFreeDecoder.h"
+#include "flashlight/lib/text/decoder/MultiConfigLexiconDecoder.h"
+#include "flashlight/lib/text/decoder/Trie.h"
+#include "flashlight/lib/text/decoder/lm/ZeroLM.h"
+
+using namespace fl::lib::text;
+
+namespace {
+
+// Tokens: 0 = <sil>, 1 = <blank>, 2..5 = letters
+constexpr int kNTokens = 6;
+constexpr int kSil = 0;
+constexpr int kBlank = 1;
+
+std::vector<float> randomEmissions(int T, int N, int seed) {
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<float> dist(-5.0, 0.0);
+  std::vector<float> emissions(T * N);
+  for (auto& e : emissions) {
+    e = dist(gen);
+  }
+  return emissions;
+}
+
+TriePtr buildTrie() {
+  std::vector<std::vector<int>> spellings = {
+      {2, 3}, {2, 3, 4}, {3, 5}, {4}, {5, 2, 2}, {4, 4, 3}};
+  auto trie = std::make_shared<Trie>(kNTokens, kSil);
+  for (int i = 0; i < spellings.size(); i++) {
+    trie->insert(spellings[i], i, -1.0f * (i + 1));
+  }
+  trie->smear(SmearingMode::MAX);
+  return trie;
+}
+
+LexiconDecoderOptions lexiconOptions() {
+  return LexiconDecoderOptions{
+      .beamSize = 50,
+      .beamSizeToken = kNTokens,
+      .beamThreshold = 100.0,
+      .lmWeight = 1.0,
+      .wordScore = 0.5,
+      .unkScore = -std::numeric_limits<float>::infinity(),
+      .silScore = 0.0,
+      .logAdd = false,
+      .criterionType = CriterionType::CTC};
+}
+
+// An LM with arbitrary scores, depending on the whole history
+struct HistoryLMState : LMState {
+  int history = 0;
+};
+
+class HistoryLM : public LM {
+ public:
+  LMStatePtr start(bool /* startWithNothing */) override {
+    return std::make_shared<HistoryLMState>();
+  }
+
+  std::pair<LMStatePtr, float> score(
+      const LMStatePtr& state,
+      const int usrTokenIdx) override {
+    int history = std::static_pointer_cast<HistoryLMState>(state)->history;
+    auto outState = state->child<HistoryLMState>(usrTokenIdx);
+    outState->history = (history * 31 + usrTokenIdx + 1) % 1009;
+    return {outState, -0.5f * ((history + 7 * usrTokenIdx) % 5)};
+  }
+
+  std::pair<LMStatePtr, float> finish(const LMStatePtr& state) override {
+    return score(state, 0);
+  }
+};
+
+// Same as HistoryLM, counting the calls to `scoreBatch()`
+class BatchHistoryLM : public HistoryLM {
+ public:
+  std::vector<std::pair<LMStatePtr, float>> scoreBatch(
+      const std::vector<LMQuery>& queries) override {
+    nBatches++;
+    nQueries += queries.size();
+    return HistoryLM::scoreBatch(queries);
+  }
+
+  int nBatches = 0;
+  int nQueries = 0;
+};
+
+void expectSameResults(
+    const std::vector<DecodeResult>& lhs,
+    const std::vector<DecodeResult>& rhs) {
+  ASSERT_EQ(lhs.size(), rhs.size());
+  for (int i = 0; i < lhs.size(); i++) {
+    EXPECT_DOUBLE_EQ(lhs[i].score, rhs[i].score);
+    EXPECT_EQ(lhs[i].words, rhs[i].words);
+    EXPECT_EQ(lhs[i].tokens, rhs[i].tokens);
+  }
+}
+
+// The best score of the paths of `lattice` with the words `words`
+double bestPathScore(const Lattice& lattice, const std::vector<int>& words) {
+  int n = words.size();
+  std::vector<std::vector<double>> best(
+      lattice.nNodes(), std::vector<double>(n + 1, kNegativeInfinity));
+  best[0][0] = 0;
+  // Arcs are sorted by their origin, which is sorted topologically
+  for (const auto& arc : lattice.arcs) {
+    for (int k = 0; k <= n; k++) {
+      if (best[arc.from][k] == kNegativeInfinity) {
+        continue;
+      }
+      int next = arc.word < 0 ? k : k + 1;
+      if (next > n || (arc.word >= 0 && words[k] != arc.word)) {
+        continue;
+      }
+      best[arc.to][next] =
+          std::max(best[arc.to][next], best[arc.from][k] + arc.score);
+    }
+  }
+  return best.back()[n];
+}
+
+} // namespace
+
+TEST(HypothesisArenaTest, RecycleFrames) {
+  HypothesisArena<LexiconFreeDecoderState> arena;
+  arena.extend(3);
+  ASSERT_EQ(arena.size(), 3);
+  for (int i = 0; i < 16; i++) {
+    arena[1].emplace_back(i, nullptr, nullptr, i);
+  }
+  const auto* slab = arena[1].data();
+  // Growing the arena doesn't move the states of existing frames
+  arena.extend(100);
+  ASSERT_EQ(arena.size(), 100);
+  ASSERT_EQ(arena[1].data(), slab);
+  ASSERT_EQ(arena[1][15].token, 15);
+
+  auto capacity = arena.capacity();
+  arena.reset();
+  ASSERT_EQ(arena.size(), 0);
+  ASSERT_TRUE(arena[1].empty());
+  ASSERT_EQ(arena.capacity(), capacity);
+
+  arena.release();
+  ASSERT_EQ(arena.capacity(), 0);
+}
+
+TEST(LexiconDecoderTest, ReuseAcrossUtterances) {
+  int T = 40;
+  auto emissions = randomEmissions(T, kNTokens, 1);
+  auto otherEmissions = randomEmissions(T, kNTokens, 2);
+
+  auto lm = std::make_shared<ZeroLM>();
+  auto trie = buildTrie();
+  LexiconDecoder decoder(
+      lexiconOptions(), trie, lm, kSil, kBlank, -1, {}, false);
+
+  auto results = decoder.decode(emissions.data(), T, kNTokens);
+  ASSERT_FALSE(results.empty());
+
+  // A fresh decoder and a recycled one should give the same results
+  decoder.decode(otherEmissions.data(), T, kNTokens);
+  auto recycledResults = decoder.decode(emissions.data(), T, kNTokens);
+  expectSameResults(results, recycledResults);
+}
+
+TEST(LexiconDecoderTest, HashMerge) {
+  int T = 40;
+  auto emissions = randomEmissions(T, kNTokens, 4);
+
+  auto lm = std::make_shared<ZeroLM>();
+  auto trie = buildTrie();
+  auto opt = lexiconOptions();
+  LexiconDecoder sortDecoder(opt, trie, lm, kSil, kBlank, -1, {}, false);
+  opt.hashMerge = true;
+  LexiconDecoder hashDecoder(opt, trie, lm, kSil, kBlank, -1, {}, false);
+
+  auto sortResults = sortDecoder.decode(emissions.data(), T, kNTokens);
+  auto hashResults = hashDecoder.decode(emissions.data(), T, kNTokens);
+  ASSERT_EQ(sortResults.size(), hashResults.size());
+  for (int i = 0; i < sortResults.size(); i++) {
+    EXPECT_NEAR(sortResults[i].score, hashResults[i].score, 1e-6);
+  }
+  EXPECT_EQ(sortResults[0].words, hashResults[0].words);
+}
+
+TEST(LexiconDecoderTest, DecodeBatch) {
+  std::vector<int> T = {30, 45, 10};
+  std::vector<std::vector<float>> emissions;
+  std::vector<const float*> emissionPtrs;
+  for (int b = 0; b < T.size(); b++) {
+    emissions.push_back(randomEmissions(T[b], kNTokens, 10 + b));
+    emissionPtrs.push_back(emissions.back().data());
+  }
+
+  auto lm = std::make_shared<ZeroLM>();
+  LexiconDecoder decoder(
+      lexiconOptions(), buildTrie(), lm, kSil, kBlank, -1, {}, false);
+  auto batchResults = decoder.decodeBatch(emissionPtrs, T, kNTokens);
+  ASSERT_EQ(batchResults.size(), T.size());
+  for (int b = 0; b < T.size(); b++) {
+    expectSameResults(
+        decoder.decode(emissionPtrs[b], T[b], kNTokens), batchResults[b]);
+  }
+
+  LexiconFreeDecoder lexFreeDecoder(
+      {.beamSize = 50,
+       .beamSizeToken = kNTokens,
+       .beamThreshold = 100.0,
+       .lmWeight = 1.0,
+       .silScore = 0.0,
+       .logAdd = false,
+       .criterionType = CriterionType::CTC},
+      lm,
+      kSil,
+      kBlank,
+      {});
+  batchResults = lexFreeDecoder.decodeBatch(emissionPtrs, T, kNTokens);
+  ASSERT_EQ(batchResults.size(), T.size());
+  for (int b = 0; b < T.size(); b++) {
+    expectSameResults(
+        lexFreeDecoder.decode(emissionPtrs[b], T[b], kNTokens),
+        batchResults[b]);
+  }
+}
+
+TEST(LexiconDecoderTest, MultiConfig) {
+  std::vector<int> T = {30, 45, 10};
+  std::vector<std::vector<float>> emissions;
+  std::vector<const float*> emissionPtrs;
+  for (int b = 0; b < T.size(); b++) {
+    emissions.push_back(randomEmissions(T[b], kNTokens, 20 + b));
+    emissionPtrs.push_back(emissions.back().data());
+  }
+  std::vector<LexiconDecoderOptions> configs;
+  for (double lmWeight : {0.0, 1.0, 2.5}) {
+    for (double wordScore : {-1.0, 0.5}) {
+      auto options = lexiconOptions();
+      options.lmWeight = lmWeight;
+      options.wordScore = wordScore;
+      options.silScore = -wordScore;
+      configs.push_back(options);
+    }
+  }
+
+  auto trie = std::make_shared<FlatTrie>(*buildTrie());
+  auto lm = std::make_shared<HistoryLM>();
+  MultiConfigLexiconDecoder multiDecoder(
+      configs, trie, lm, kSil, kBlank, -1, {}, false, 4);
+  auto results = multiDecoder.decodeBatch(emissionPtrs, T, kNTokens);
+  ASSERT_EQ(results.size(), configs.size());
+  // Same best hypothesis as a decoder per configuration, with an LM of its
+  // own. Other hypotheses can differ: ties between LM states are broken by
+  // address.
+  for (int c = 0; c < configs.size(); c++) {
+    LexiconDecoder decoder(
+        configs[c],
+        trie,
+        std::make_shared<HistoryLM>(),
+        kSil,
+        kBlank,
+        -1,
+        {},
+        false);
+    ASSERT_EQ(results[c].size(), T.size());
+    for (int b = 0; b < T.size(); b++) {
+      auto expected = decoder.decode(emissionPtrs[b], T[b], kNTokens);
+      ASSERT_FALSE(results[c][b].empty());
+      EXPECT_DOUBLE_EQ(results[c][b][0].score, expected[0].score);
+      EXPECT_EQ(results[c][b][0].words, expected[0].words);
+      EXPECT_EQ(results[c][b][0].tokens, expected[0].tokens);
+    }
+  }
+}
+
+TEST(LexiconDecoderTest, OnlinePruning) {
+  int T = 60, chunk = 10;
+  auto emissions = randomEmissions(T, kNTokens, 3);
+
+  auto lm = std::make_shared<ZeroLM>();
+  LexiconDecoder decoder(
+      lexiconOptions(), buildTrie(), lm, kSil, kBlank, -1, {}, false);
+
+  decoder.decodeBegin();
+  for (int t = 0; t < T; t += chunk) {
+    decoder.decodeStep(emissions.data() + t * kNTokens, chunk, kNTokens);
+    decoder.prune(chunk / 2);
+    ASSERT_LE(decoder.nDecodedFramesInBuffer(), 2 * chunk);
+  }
+  decoder.decodeEnd();
+  auto best = decoder.getBestHypothesis();
+  ASSERT_FALSE(best.tokens.empty());
+}
+
+TEST(LexiconDecoderTest, ScoreBatch) {
+  int T = 40;
+  auto emissions = randomEmissions(T, kNTokens, 5);
+  auto trie = buildTrie();
+
+  auto lm = std::make_shared<HistoryLM>();
+  auto batchLm = std::make_shared<BatchHistoryLM>();
+  LexiconDecoder decoder(
+      lexiconOptions(), trie, lm, kSil, kBlank, -1, {}, false);
+  LexiconDecoder batchDecoder(
+      lexiconOptions(), trie, batchLm, kSil, kBlank, -1, {}, false);
+
+  // All the LM queries of a frame are scored at once
+  auto results = decoder.decode(emissions.data(), T, kNTokens);
+  auto batchResults = batchDecoder.decode(emissions.data(), T, kNTokens);
+  expectSameResults(results, batchResults);
+  ASSERT_EQ(batchLm->nBatches, T);
+  ASSERT_GT(batchLm->nQueries, T);
+
+  auto future = batchLm->scoreBatchAsync({{batchLm->start(0), 2}});
+  auto scores = future.get();
+  ASSERT_EQ(scores.size(), 1);
+  ASSERT_EQ(scores[0].second, lm->score(lm->start(0), 2).second);
+}
+
+TEST(LexiconDecoderTest, Streaming) {
+  int T = 200, chunk = 7;
+  auto emissions = randomEmissions(T, kNTokens, 6);
+  auto lm = std::make_shared<ZeroLM>();
+  LexiconDecoder decoder(
+      lexiconOptions(), buildTrie(), lm, kSil, kBlank, -1, {}, false);
+  auto offlineResult = decoder.decode(emissions.data(), T, kNTokens)[0];
+
+  for (int maxDelay : {-1, 20}) {
+    std::vector<int> words, tokens;
+    auto append = [&words, &tokens](const DecodeResult& result) {
+      ASSERT_EQ(result.words.size(), result.tokens.size());
+      words.insert(words.end(), result.words.begin(), result.words.end());
+      tokens.insert(tokens.end(), result.tokens.begin(), result.tokens.end());
+    };
+
+    decoder.decodeBegin();
+    for (int t = 0; t < T; t += chunk) {
+      append(decoder.decodeChunk(
+          emissions.data() + t * kNTokens,
+          std::min(chunk, T - t),
+          kNTokens,
+          maxDelay));
+      if (maxDelay >= 0) {
+        ASSERT_LE(decoder.nDecodedFramesInBuffer(), maxDelay + 1);
+      }
+    }
+    append(decoder.decodeStreamEnd());
+
+    // Each frame is returned once, the first one being the start state
+    ASSERT_EQ(tokens.size(), T + 1);
+    if (maxDelay < 0) {
+      // Releasing the shared history doesn't change the results
+      EXPECT_EQ(
+          words,
+          std::vector<int>(
+              offlineResult.words.begin() + 1, offlineResult.words.end()));
+      EXPECT_EQ(
+          tokens,
+          std::vector<int>(
+              offlineResult.tokens.begin() + 1, offlineResult.tokens.end()));
+    }
+  }
+}
+
+TEST(LexiconDecoderTest, Lattice) {
+  int T = 60;
+  auto emissions = randomEmissions(T, kNTokens, 8);
+  auto lm = std::make_shared<HistoryLM>();
+  LexiconDecoder decoder(
+      lexiconOptions(), buildTrie(), lm, kSil, kBlank, -1, {}, false);
+  auto results = decoder.decode(emissions.data(), T, kNTokens);
+  ASSERT_FALSE(results.empty());
+  auto lattice = decoder.getLattice();
+
+  ASSERT_GE(lattice.nNodes(), 2);
+  EXPECT_EQ(lattice.nodeFrames.front(), 0);
+  EXPECT_EQ(lattice.nodeFrames.back(), T + 1);
+  for (int i = 1; i < lattice.nNodes(); i++) {
+    EXPECT_LE(lattice.nodeFrames[i - 1], lattice.nodeFrames[i]);
+  }
+  for (const auto& arc : lattice.arcs) {
+    ASSERT_LT(arc.from, arc.to);
+    EXPECT_LT(lattice.nodeFrames[arc.from], lattice.nodeFrames[arc.to]);
+    EXPECT_EQ(arc.word < 0, arc.to == lattice.nNodes() - 1);
+  }
+
+  // Every hypothesis is a path, and no path scores more than merged ones
+  // would have allowed
+  for (const auto& result : results) {
+    std::vector<int> words;
+    for (int word : result.words) {
+      if (word >= 0) {
+        words.push_back(word);
+      }
+    }
+    EXPECT_GE(bestPathScore(lattice, words), result.score - 1e-3);
+  }
+
+  std::stringstream buffer;
+  lattice.save(buffer);
+  auto loaded = Lattice::load(buffer);
+  EXPECT_EQ(loaded.nodeFrames, lattice.nodeFrames);
+  ASSERT_EQ(loaded.arcs.size(), lattice.arcs.size());
+  for (int i = 0; i < lattice.arcs.size(); i++) {
+    EXPECT_EQ(loaded.arcs[i].from, lattice.arcs[i].from);
+    EXPECT_EQ(loaded.arcs[i].to, lattice.arcs[i].to);
+    EXPECT_EQ(loaded.arcs[i].word, lattice.arcs[i].word);
+    EXPECT_EQ(loaded.arcs[i].score, lattice.arcs[i].score);
+    EXPECT_EQ(loaded.arcs[i].amScore, lattice.arcs[i].amScore);
+    EXPECT_EQ(loaded.arcs[i].lmScore, lattice.arcs[i].lmScore);
+  }
+
+  // Same lattice from a batch
+  std::vector<const float*> batch = {emissions.data(), emissions.data()};
+  decoder.decodeBatch(batch, {T, T}, kNTokens);
+  auto batchLattice = decoder.getBatchLattice(1);
+  EXPECT_EQ(batchLattice.nodeFrames, lattice.nodeFrames);
+  EXPECT_EQ(batchLattice.arcs.size(), lattice.arcs.size());
+}
+
+TEST(LexiconDecoderTest, BlankSkip) {
+  // Peaky emissions: blanks everywhere but a few frames
+  int T = 120;
+  auto emissions = randomEmissions(T, kNTokens, 9);
+  std::mt19937 gen(9);
+  for (int t = 0; t < T; t++) {
+    if (gen() % 4 != 0) {
+      emissions[t * kNTokens + kBlank] = 10.0;
+    }
+  }
+
+  auto lm = std::make_shared<BatchHistoryLM>();
+  auto skipLm = std::make_shared<BatchHistoryLM>();
+  auto trie = buildTrie();
+  auto opt = lexiconOptions();
+  LexiconDecoder decoder(opt, trie, lm, kSil, kBlank, -1, {}, false);
+  opt.blankSkipThreshold = 0.99;
+  LexiconDecoder skipDecoder(opt, trie, skipLm, kSil, kBlank, -1, {}, false);
+
+  auto results = decoder.decode(emissions.data(), T, kNTokens);
+  auto skipResults = skipDecoder.decode(emissions.data(), T, kNTokens);
+  ASSERT_FALSE(results.empty());
+  ASSERT_FALSE(skipResults.empty());
+  EXPECT_EQ(results[0].words, skipResults[0].words);
+  EXPECT_EQ(results[0].tokens, skipResults[0].tokens);
+  EXPECT_NEAR(results[0].score, skipResults[0].score, 1e-6);
+  // The LM isn't queried on the blank frames
+  EXPECT_EQ(lm->nBatches, T);
+  EXPECT_LT(skipLm->nBatches, T / 2);
+}
+
+TEST(LMLookaheadTest, BestWordScore) {
+  auto trie = std::make_shared<FlatTrie>(*buildTrie());
+  auto lm = std::make_shared<HistoryLM>();
+  LMLookahead lookahead(lm, trie, 2, 4);
+
+  auto state = lm->score(lm->start(0), 3).first;
+  const FlatTrieNode* root = trie->getRoot();
+  EXPECT_EQ(lookahead.score(state, root), 0);
+  EXPECT_EQ(lookahead.nWords(root), 6);
+  // Words 0 ({2, 3}) and 1 ({2, 3, 4}) are below token 2
+  const FlatTrieNode* node = trie->getChild(root, 2);
+  ASSERT_NE(node, nullptr);
+  EXPECT_EQ(lookahead.nWords(node), 2);
+  float expected =
+      std::max(lm->score(state, 0).second, lm->score(state, 1).second);
+  EXPECT_EQ(lookahead.score(state, node), expected);
+  EXPECT_EQ(lookahead.score(state, node), expected);
+  EXPECT_EQ(lookahead.nMisses(), 1);
+  EXPECT_EQ(lookahead.nHits(), 1);
+
+  // Too many words below: the smeared lexicon score
+  lookahead = LMLookahead(lm, trie, 1, 4);
+  EXPECT_EQ(lookahead.score(state, node), node->maxScore);
+
+  // The cache is bounded
+  for (int word = 0; word < 10; word++) {
+    lookahead.score(lm->score(state, word).first, trie->getChild(root, 3));
+  }
+  EXPECT_EQ(lookahead.size(), 4);
+}
+
+TEST(LexiconDecoderTest, LMLookahead) {
+  int T = 20;
+  auto emissions = randomEmissions(T, kNTokens, 11);
+  auto lm = std::make_shared<HistoryLM>();
+  auto trie = buildTrie();
+  auto opt = lexiconOptions();
+  opt.beamSize = 5000;
+  LexiconDecoder decoder(opt, trie, lm, kSil, kBlank, -1, {}, false);
+  opt.lmLookaheadWords = 100;
+  LexiconDecoder lookaheadDecoder(opt, trie, lm, kSil, kBlank, -1, {}, false);
+
+  // The look-ahead only changes the scores of partial words: with a wide
+  // beam, the best hypothesis is the same
+  auto results = decoder.decode(emissions.data(), T, kNTokens);
+  auto lookaheadResults =
+      lookaheadDecoder.decode(emissions.data(), T, kNTokens);
+  ASSERT_FALSE(results.empty());
+  ASSERT_FALSE(lookaheadResults.empty());
+  EXPECT_EQ(results[0].words, lookaheadResults[0].words);
+  EXPECT_NEAR(results[0].score, lookaheadResults[0].score, 1e-4);
+  EXPECT_NEAR(results[0].lmScore, lookaheadResults[0].lmScore, 1e-4);
+
+  // No look-ahead score is left in the LM score of a complete hypothesis
+  auto state = lm->start(0);
+  double lmScore = 0;
+  for (int word : lookaheadResults[0].words) {
+    if (word >= 0) {
+      auto next = lm->score(state, word);
+      state = next.first;
+      lmScore += next.second;
+    }
+  }
+  lmScore += lm->finish(state).second;
+  EXPECT_NEAR(lookaheadResults[0].lmScore, lmScore, 1e-4);
+}
+
+TEST(LexiconDecoderTest, AdaptiveBeam) {
+  int T = 80;
+  auto emissions = randomEmissions(T, kNTokens, 12);
+  auto lm = std::make_shared<HistoryLM>();
+  auto trie = buildTrie();
+  auto opt = lexiconOptions();
+  opt.beamSize = 500;
+  LexiconDecoder decoder(opt, trie, lm, kSil, kBlank, -1, {}, false);
+  opt.adaptiveBeam.targetCandidates = 30;
+  LexiconDecoder adaptiveDecoder(opt, trie, lm, kSil, kBlank, -1, {}, false);
+
+  ASSERT_FALSE(decoder.decode(emissions.data(), T, kNTokens).empty());
+  ASSERT_FALSE(adaptiveDecoder.decode(emissions.data(), T, kNTokens).empty());
+  const auto& fixed = decoder.getBeamTelemetry();
+  const auto& adaptive = adaptiveDecoder.getBeamTelemetry();
+  EXPECT_EQ(fixed.nFrames, T);
+  EXPECT_EQ(adaptive.nFrames, T);
+  EXPECT_EQ(fixed.minThreshold, opt.beamThreshold);
+  EXPECT_EQ(fixed.maxThreshold, opt.beamThreshold);
+  // The threshold is tightened to get closer to the target
+  EXPECT_LT(adaptive.minThreshold, opt.beamThreshold);
+  EXPECT_GE(adaptive.minThreshold, opt.adaptiveBeam.minThreshold);
+  EXPECT_LT(adaptive.meanCandidates, fixed.meanCandidates);
+  EXPECT_GT(adaptive.decodeTime, 0);
+
+  // Each utterance of a batch has its own threshold
+  std::vector<const float*> batch = {emissions.data(), emissions.data()};
+  adaptiveDecoder.decodeBatch(batch, {T, T / 2}, kNTokens);
+  EXPECT_EQ(adaptiveDecoder.getBatchBeamTelemetry(0).nFrames, T);
+  EXPECT_EQ(adaptiveDecoder.getBatchBeamTelemetry(1).nFrames, T / 2);
+  EXPECT_DOUBLE_EQ(
+      adaptiveDecoder.getBatchBeamTelemetry(0).meanThreshold,
+      adaptive.meanThreshold);
+}
+
+TEST(LexiconDecoderTest, SparseEmissions) {
+  int T = 30;
+  auto emissions = randomEmissions(T, kNTokens, 60);
+
+  // The K best tokens of each frame
+  std::vector<int> indices;
+  std::vector<float> scores;
+  auto topK = [&](int K) {
+    indices.clear();
+    scores.clear();
+    std::vector<int> idx(kNTokens);
+    for (int t = 0; t < T; t++) {
+      const float* frame = emissions.data() + t * kNTokens;
+      std::iota(idx.begin(), idx.end(), 0);
+      std::sort(idx.begin(), idx.end(), [frame](int l, int r) {
+        return frame[l] > frame[r];
+      });
+      for (int k = 0; k < K; k++) {
+        indices.push_back(idx[k]);
+        scores.push_back(frame[idx[k]]);
+      }
+    }
+  };
+
+  auto lm = std::make_shared<HistoryLM>();
+  LexiconDecoder decoder(
+      lexiconOptions(), buildTrie(), lm, kSil, kBlank, -1, {}, false);
+  LexiconFreeDecoder lexFreeDecoder(
+      {.beamSize = 50,
+       .beamSizeToken = kNTokens,
+       .beamThreshold = 100.0,
+       .lmWeight = 1.0,
+       .silScore = 0.0,
+       .logAdd = false,
+       .criterionType = CriterionType::CTC},
+      lm,
+      kSil,
+      kBlank,
+      {});
+
+  // All the tokens: same as dense emissions
+  topK(kNTokens);
+  SparseEmissions sparse{indices.data(), scores.data(), T, kNTokens, kNTokens};
+  for (Decoder* d : std::vector<Decoder*>{&decoder, &lexFreeDecoder}) {
+    auto dense = d->decode(emissions.data(), T, kNTokens);
+    auto results = d->decodeSparse(sparse);
+    ASSERT_EQ(dense.size(), results.size());
+    for (int i = 0; i < dense.size(); i++) {
+      EXPECT_NEAR(dense[i].score, results[i].score, 1e-4);
+      EXPECT_EQ(dense[i].words, results[i].words);
+    }
+  }
+
+  // Fewer tokens: only those are emitted, apart from the silence, the blank
+  // and the repetitions, which are always tried
+  int K = 3;
+  topK(K);
+  sparse = {indices.data(), scores.data(), T, kNTokens, K};
+  for (Decoder* d : std::vector<Decoder*>{&decoder, &lexFreeDecoder}) {
+    auto results = d->decodeSparse(sparse);
+    ASSERT_FALSE(results.empty());
+    const auto& tokens = results[0].tokens;
+    for (int t = 0; t < T; t++) {
+      int token = tokens[t + 1];
+      auto begin = indices.begin() + t * K;
+      EXPECT_TRUE(
+          std::find(begin, begin + K, token) != begin + K || token == kSil ||
+          token == kBlank || token == tokens[t]);
+    }
+  }
+}
+
+TEST(LexiconDecoderTest, HalfEmissions) {
+  EXPECT_EQ(halfToFloat(0x0000), 0.0f);
+  EXPECT_EQ(halfToFloat(0x3c00), 1.0f);
+  EXPECT_EQ(halfToFloat(0xc000), -2.0f);
+  EXPECT_EQ(halfToFloat(0x3555), 0.333251953125f);
+  EXPECT_EQ(halfToFloat(0x0001), std::ldexp(1.0f, -24));
+  EXPECT_EQ(halfToFloat(0x7c00), std::numeric_limits<float>::infinity());
+  EXPECT_TRUE(std::isnan(halfToFloat(0x7e00)));
+
+  // Emissions that are exact in half precision: their mantissa is truncated
+  // to 10 bits
+  int T = 30;
+  auto emissions = randomEmissions(T, kNTokens, 61);
+  std::vector<uint16_t> halfEmissions(T * kNTokens);
+  for (int i = 0; i < emissions.size(); i++) {
+    uint32_t bits;
+    std::memcpy(&bits, &emissions[i], sizeof(bits));
+    uint32_t exponent = (bits >> 23) & 0xff;
+    if (exponent < 113) {
+      // Too small to be normalized in half precision
+      emissions[i] = 0;
+      halfEmissions[i] = 0;
+      continue;
+    }
+    bits &= 0xffffe000;
+    std::memcpy(&emissions[i], &bits, sizeof(bits));
+    halfEmissions[i] = ((bits >> 16) & 0x8000) | ((exponent - 112) << 10) |
+        ((bits >> 13) & 0x3ff);
+    ASSERT_EQ(halfToFloat(halfEmissions[i]), emissions[i]);
+  }
+
+  auto lm = std::make_shared<HistoryLM>();
+  LexiconDecoder decoder(
+      lexiconOptions(), buildTrie(), lm, kSil, kBlank, -1, {}, false);
+  expectSameResults(
+      decoder.decode(emissions.data(), T, kNTokens),
+      decoder.decodeHalf(halfEmissions.data(), T, kNTokens));
+}
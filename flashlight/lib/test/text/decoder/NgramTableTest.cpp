@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <fstream>
+
+#include <gtest/gtest.h>
+
+#include "flashlight/lib/common/System.h"
+#include "flashlight/lib/text/decoder/lm/NgramTable.h"
+
+using namespace fl::lib;
+using namespace fl::lib::text;
+
+namespace {
+
+const char* kArpa = R"(
+\data\
+ngram 1=6
+ngram 2=3
+ngram 3=1
+
+\1-grams:
+-1.0	<unk>
+-99	<s>	-0.5
+-1.2	</s>
+-0.7	a	-0.3
+-0.9	b	-0.2
+-1.5	c	-0.1
+
+\2-grams:
+-0.4	<s> a	-0.25
+-0.6	a b	-0.15
+-0.8	b </s>
+
+\3-grams:
+-0.1	<s> a b
+
+\end\
+)";
+
+NgramTablePtr loadTable() {
+  auto path = getTmpPath("NgramTableTest.arpa");
+  {
+    std::ofstream file(path);
+    file << kArpa;
+  }
+  Dictionary dict;
+  dict.addEntry("a");
+  dict.addEntry("b");
+  dict.addEntry("<unk>");
+  return std::make_shared<NgramTable>(path, dict);
+}
+
+} // namespace
+
+TEST(NgramTableTest, Score) {
+  auto lm = loadTable();
+  ASSERT_EQ(lm->order(), 3);
+  ASSERT_EQ(lm->bos(), 3);
+  ASSERT_EQ(lm->eos(), 4);
+
+  NgramContext start = lm->start(), ctx1, ctx2, ctx3;
+  ASSERT_EQ(start.length, 1);
+  ASSERT_EQ(start.words[0], lm->bos());
+
+  // Bigram and trigram found in the table
+  ASSERT_NEAR(lm->score(start, 0, ctx1), -0.4, 1e-6);
+  ASSERT_EQ(ctx1.length, 2);
+  ASSERT_NEAR(lm->score(ctx1, 1, ctx2), -0.1, 1e-6);
+  ASSERT_EQ(ctx2.length, 2);
+  ASSERT_EQ(ctx2.words[0], 0);
+  ASSERT_EQ(ctx2.words[1], 1);
+
+  // Back off twice: backoff(a b) + backoff(b) + p(a)
+  ASSERT_NEAR(lm->score(ctx2, 0, ctx3), -0.15 - 0.2 - 0.7, 1e-6);
+  // Back off once: backoff(a b) + p(</s> | b)
+  ASSERT_NEAR(lm->finish(ctx2, ctx3), -0.15 - 0.8, 1e-6);
+}
+
+TEST(NgramTableTest, UnknownWords) {
+  auto lm = loadTable();
+  NgramContext start = lm->start(), ctx;
+  // <unk> is in the dictionary
+  ASSERT_NEAR(lm->score(start, 2, ctx), -0.5 - 1.0, 1e-6);
+  // Word absent from the table, scored as <unk>
+  ASSERT_NEAR(lm->score(start, 7, ctx), -0.5 - 1.0, 1e-6);
+  // `c` is not in the dictionary, so its n-grams are dropped
+  int c = 5;
+  ASSERT_EQ(lm->view().find(&c, 1), nullptr);
+}
@@ -11,6 +11,7 @@
 #include <gtest/gtest.h>
 
 #include "flashlight/lib/common/System.h"
+#include "flashlight/lib/text/dictionary/FrozenDictionary.h"
 #include "flashlight/lib/text/dictionary/Utils.h"
 
 using fl::lib::pathsConcat;
@@ -80,6 +81,47 @@ TEST(DictionaryTest, Dictionary) {
   ASSERT_EQ(dict.indexSize(), 5);
 }
 
+TEST(DictionaryTest, FrozenDictionary) {
+  Dictionary dict(pathsConcat(loadPath, "test.dict"));
+  dict.addEntry("sparse", 10);
+  for (int i = 0; i < 1000; ++i) {
+    dict.addEntry("w" + std::to_string(i));
+  }
+
+  FrozenDictionary frozen(dict);
+  auto filename = fl::lib::getTmpPath("FrozenDictionary.bin");
+  frozen.save(filename);
+  FrozenDictionary mapped(filename);
+
+  for (const auto* checked : {&frozen, &mapped}) {
+    ASSERT_EQ(checked->entrySize(), dict.entrySize());
+    ASSERT_EQ(checked->indexSize(), dict.indexSize());
+    for (const auto& entry : {"a", "ä", "e", "è", "g", "sparse", "w999"}) {
+      ASSERT_EQ(checked->getIndex(entry), dict.getIndex(entry));
+    }
+    for (int i : {0, 3, 4, 10, 11, 1008}) {
+      ASSERT_EQ(checked->getEntry(i), dict.getEntry(i));
+    }
+    // Lookups of a range in a larger buffer
+    std::string text = "w12 d";
+    ASSERT_EQ(checked->getIndex(text.data(), 3), dict.getIndex("w12"));
+    ASSERT_EQ(checked->getIndex(text.data() + 4, 1), dict.getIndex("d"));
+    ASSERT_FALSE(checked->contains(text.data() + 1, 2));
+    ASSERT_FALSE(checked->contains("q"));
+    ASSERT_THROW(checked->getIndex("q"), std::invalid_argument);
+    ASSERT_THROW(checked->getEntry(7), std::invalid_argument);
+  }
+
+  dict.setDefaultIndex(dict.getIndex("b"));
+  FrozenDictionary withDefault(dict);
+  ASSERT_EQ(withDefault.getIndex("q"), 1);
+  ASSERT_EQ(
+      withDefault.mapEntriesToIndices({"c", "q", "d"}),
+      std::vector<int>({2, 1, 3}));
+
+  ASSERT_THROW(FrozenDictionary("not_a_real_file"), std::runtime_error);
+}
+
 TEST(DictionaryTest, PackReplabels) {
   Dictionary dict;
   dict.addEntry("<1>", 1);
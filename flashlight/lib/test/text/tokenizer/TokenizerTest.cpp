@@ -65,6 +65,41 @@ TEST(TokenizerTest, Counting) {
   ASSERT_EQ(dict.size(), 2);
 }
 
+TEST(TokenizerTest, CountingWorkers) {
+  auto reference = fl::lib::text::Tokenizer();
+  reference.countTokens(fl::lib::pathsConcat(loadPath, "test.txt"), 1, true);
+  auto referenceMetaData = reference.getTextFileMetaData();
+  ASSERT_EQ(referenceMetaData.size(), 4);
+  ASSERT_EQ(referenceMetaData[0].first, 15);
+  ASSERT_EQ(referenceMetaData[0].second, 4);
+
+  // More workers than lines
+  for (int nWorkers : {2, 3, 16}) {
+    auto tokenizer = fl::lib::text::Tokenizer();
+    tokenizer.countTokens(
+        fl::lib::pathsConcat(loadPath, "test.txt"), nWorkers, true);
+    ASSERT_EQ(tokenizer.totalTokens(), 13);
+    ASSERT_EQ(tokenizer.totalSentences(), 4);
+    ASSERT_EQ(tokenizer.getDictionary(), reference.getDictionary());
+    ASSERT_EQ(tokenizer.getTextFileMetaData(), referenceMetaData);
+  }
+}
+
+TEST(TokenizerTest, CountingFiles) {
+  auto tokenizer = fl::lib::text::Tokenizer();
+  tokenizer.countTokens(fl::lib::pathsConcat(loadPath, "test.txt"), 2);
+  tokenizer.countTokens(fl::lib::pathsConcat(loadPath, "test.txt"), 3);
+  ASSERT_EQ(tokenizer.totalTokens(), 26);
+  ASSERT_EQ(tokenizer.totalSentences(), 8);
+
+  // Counts add up over files
+  auto dict = tokenizer.getDictionary();
+  ASSERT_EQ(dict.size(), 11);
+  ASSERT_EQ(dict[0], fl::lib::text::TokenCountPair("a", 4));
+  ASSERT_EQ(dict[1], fl::lib::text::TokenCountPair("test", 4));
+  ASSERT_EQ(dict[2], fl::lib::text::TokenCountPair("and", 2));
+}
+
 
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/lib/text/decoder/AdaptiveBeam.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace fl {
+namespace lib {
+namespace text {
+
+AdaptiveBeam::AdaptiveBeam(const AdaptiveBeamOptions& opt, double maxThreshold)
+    : opt_(opt), maxThreshold_(maxThreshold) {
+  reset();
+}
+
+void AdaptiveBeam::reset() {
+  threshold_ = maxThreshold_;
+  telemetry_ = BeamTelemetry();
+  telemetry_.minThreshold = maxThreshold_;
+  telemetry_.maxThreshold = maxThreshold_;
+}
+
+void AdaptiveBeam::update(
+    int nCandidates,
+    int nHypothesis,
+    double scoreSpread,
+    double seconds) {
+  // Running means over the frames
+  auto& t = telemetry_;
+  t.nFrames++;
+  auto addToMean = [&t](double& mean, double value) {
+    mean += (value - mean) / t.nFrames;
+  };
+  addToMean(t.meanCandidates, nCandidates);
+  addToMean(t.meanHypothesis, nHypothesis);
+  addToMean(t.meanScoreSpread, scoreSpread);
+  addToMean(t.meanThreshold, threshold_);
+  t.maxCandidates = std::max(t.maxCandidates, nCandidates);
+  t.minThreshold = std::min(t.minThreshold, threshold_);
+  t.maxThreshold = std::max(t.maxThreshold, threshold_);
+  t.decodeTime += seconds;
+
+  if (!opt_.enabled()) {
+    return;
+  }
+  double ratio = std::numeric_limits<double>::infinity();
+  if (opt_.targetCandidates > 0) {
+    double candidates = std::max(1, nCandidates);
+    ratio = std::min(ratio, opt_.targetCandidates / candidates);
+  }
+  if (opt_.frameTimeBudget > 0 && seconds > 0) {
+    ratio = std::min(ratio, opt_.frameTimeBudget / seconds);
+  }
+  if (std::isinf(ratio)) {
+    return;
+  }
+  if (ratio < 1 && scoreSpread > 0) {
+    threshold_ = std::min(threshold_, scoreSpread);
+  }
+  threshold_ *= std::pow(ratio, opt_.adaptRate);
+  threshold_ = std::max(opt_.minThreshold, std::min(maxThreshold_, threshold_));
+}
+
+} // namespace text
+} // namespace lib
+} // namespace fl
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+namespace fl {
+namespace lib {
+namespace text {
+
+struct AdaptiveBeamOptions {
+  int targetCandidates = 0; // Target number of candidates per frame (0: none)
+  double frameTimeBudget = 0; // Target decoding time per frame, in seconds
+  double minThreshold = 1.0; // Lowest beam threshold
+  double adaptRate = 0.2; // Exponent of the correction applied at each frame
+
+  bool enabled() const {
+    return targetCandidates > 0 || frameTimeBudget > 0;
+  }
+};
+
+/**
+ * BeamTelemetry summarizes the beam of the frames of an utterance.
+ */
+struct BeamTelemetry {
+  int nFrames = 0;
+  double meanCandidates = 0; // Candidates above the threshold, before pruning
+  int maxCandidates = 0;
+  double meanHypothesis = 0; // Hypothesis kept after pruning
+  double meanScoreSpread = 0; // Best minus worst score of the hypothesis kept
+  double meanThreshold = 0;
+  double minThreshold = 0;
+  double maxThreshold = 0;
+  double decodeTime = 0; // Seconds spent stepping the frames
+};
+
+/**
+ * AdaptiveBeam controls the beam threshold of a decoder from frame to frame,
+ * to keep either the number of candidates of a frame or its decoding time
+ * close to a target (the tightest of the two if both are set).
+ *
+ * After each frame, the threshold is multiplied by (target / measured) ^
+ * adaptRate and clamped to [minThreshold, maxThreshold]. When tightening, the
+ * threshold is first lowered to the score spread of the frame, so that the
+ * correction doesn't only eat the slack above its worst hypothesis.
+ * Without a target, the threshold stays at `maxThreshold`.
+ */
+class AdaptiveBeam {
+ public:
+  AdaptiveBeam() = default;
+
+  AdaptiveBeam(const AdaptiveBeamOptions& opt, double maxThreshold);
+
+  /* Start an utterance, at the maximum threshold */
+  void reset();
+
+  double threshold() const {
+    return threshold_;
+  }
+
+  /**
+   * Update the threshold after a frame with `nCandidates` candidates above
+   * the threshold, of which `nHypothesis` were kept with a score spread of
+   * `scoreSpread`, decoded in `seconds`.
+   */
+  void
+  update(int nCandidates, int nHypothesis, double scoreSpread, double seconds);
+
+  const BeamTelemetry& telemetry() const {
+    return telemetry_;
+  }
+
+ private:
+  AdaptiveBeamOptions opt_;
+  double maxThreshold_{0};
+  double threshold_{0};
+  BeamTelemetry telemetry_;
+};
+} // namespace text
+} // namespace lib
+} // namespace fl
@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/lib/text/decoder/CompiledLexicon.h"
+
+#include <sys/stat.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include "flashlight/lib/common/System.h"
+#include "flashlight/lib/text/dictionary/Defines.h"
+
+namespace fl {
+namespace lib {
+namespace text {
+
+namespace {
+
+constexpr char kCompiledLexiconMagic[8] = {'F', 'L', 'L', 'E', 'X', 'C', 0, 1};
+
+struct CompiledLexiconHeader {
+  char magic[8];
+  uint64_t inputHash;
+  int64_t nWords;
+  // Size of the trie, -1 without trie
+  int64_t nTrieNodes;
+  int64_t nTrieLabels;
+};
+
+template <typename T>
+void write(std::ostream& out, const T& value) {
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void writeString(std::ostream& out, const std::string& str) {
+  write(out, static_cast<uint32_t>(str.size()));
+  out.write(str.data(), str.size());
+}
+
+template <typename T>
+T read(std::istream& in) {
+  T value;
+  if (!in.read(reinterpret_cast<char*>(&value), sizeof(T))) {
+    throw std::runtime_error("[CompiledLexicon] Unexpected end of the file");
+  }
+  return value;
+}
+
+std::string readString(std::istream& in) {
+  std::string str(read<uint32_t>(in), '\0');
+  if (!in.read(&str[0], str.size())) {
+    throw std::runtime_error("[CompiledLexicon] Unexpected end of the file");
+  }
+  return str;
+}
+
+std::string triePath(const std::string& path) {
+  return path + ".trie";
+}
+
+} // namespace
+
+void CompiledLexicon::save(const std::string& path, uint64_t inputHash) const {
+  // Files are written aside and renamed, so that processes compiling the same
+  // lexicon concurrently never see a partial one. The trie comes first: the
+  // main file marks a complete artifact.
+  std::string tmpSuffix = ".tmp" + std::to_string(getProcessId());
+  if (trie) {
+    trie->save(triePath(path) + tmpSuffix);
+  }
+
+  std::string tmpPath = path + tmpSuffix;
+  {
+    auto stream = createOutputStream(tmpPath, std::ios::out | std::ios::binary);
+    CompiledLexiconHeader header;
+    std::memcpy(
+        header.magic, kCompiledLexiconMagic, sizeof(kCompiledLexiconMagic));
+    header.inputHash = inputHash;
+    header.nWords = wordDict.indexSize();
+    header.nTrieNodes = trie ? trie->nNodes() : -1;
+    header.nTrieLabels = trie ? trie->nLabels() : -1;
+    write(stream, header);
+    for (int i = 0; i < wordDict.indexSize(); i++) {
+      std::string word = wordDict.getEntry(i);
+      writeString(stream, word);
+      auto it = lexicon.find(word);
+      if (it == lexicon.end()) {
+        write(stream, static_cast<uint32_t>(0));
+        continue;
+      }
+      write(stream, static_cast<uint32_t>(it->second.size()));
+      for (const auto& spelling : it->second) {
+        write(stream, static_cast<uint32_t>(spelling.size()));
+        for (const auto& token : spelling) {
+          writeString(stream, token);
+        }
+      }
+    }
+    if (!stream) {
+      throw std::runtime_error(
+          "[CompiledLexicon] Failed to write file: " + tmpPath);
+    }
+  }
+
+  if ((trie &&
+       std::rename((triePath(path) + tmpSuffix).c_str(),
+                   triePath(path).c_str()) != 0) ||
+      std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+    throw std::runtime_error("[CompiledLexicon] Failed to write file: " + path);
+  }
+}
+
+bool CompiledLexicon::load(const std::string& path, uint64_t inputHash) {
+  if (!fileExists(path)) {
+    return false;
+  }
+  auto stream = createInputStream(path);
+  auto header = read<CompiledLexiconHeader>(stream);
+  if (std::memcmp(
+          header.magic, kCompiledLexiconMagic, sizeof(kCompiledLexiconMagic)) !=
+      0) {
+    throw std::runtime_error("[CompiledLexicon] Invalid file: " + path);
+  }
+  if (header.inputHash != inputHash) {
+    return false;
+  }
+
+  Dictionary dict;
+  LexiconMap spellings;
+  spellings.reserve(header.nWords);
+  for (int64_t i = 0; i < header.nWords; i++) {
+    std::string word = readString(stream);
+    auto& wordSpellings = spellings[word];
+    wordSpellings.resize(read<uint32_t>(stream));
+    for (auto& spelling : wordSpellings) {
+      spelling.resize(read<uint32_t>(stream));
+      for (auto& token : spelling) {
+        token = readString(stream);
+      }
+    }
+    dict.addEntry(word);
+  }
+  dict.setDefaultIndex(dict.getIndex(kUnkToken));
+
+  FlatTriePtr flatTrie;
+  if (header.nTrieNodes >= 0) {
+    flatTrie = FlatTrie::load(triePath(path));
+    if (flatTrie->nNodes() != header.nTrieNodes ||
+        flatTrie->nLabels() != header.nTrieLabels) {
+      throw std::runtime_error(
+          "[CompiledLexicon] The trie doesn't match: " + triePath(path));
+    }
+  }
+
+  wordDict = std::move(dict);
+  lexicon = std::move(spellings);
+  trie = std::move(flatTrie);
+  return true;
+}
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed) {
+  const auto* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < size; i++) {
+    seed ^= bytes[i];
+    seed *= 0x100000001b3ULL;
+  }
+  return seed;
+}
+
+uint64_t hashString(const std::string& str, uint64_t seed) {
+  uint64_t size = str.size();
+  seed = hashBytes(&size, sizeof(size), seed);
+  return hashBytes(str.data(), str.size(), seed);
+}
+
+uint64_t hashFile(const std::string& path, uint64_t seed) {
+  auto stream = createInputStream(path);
+  std::vector<char> buffer(1 << 20);
+  while (stream) {
+    stream.read(buffer.data(), buffer.size());
+    seed = hashBytes(buffer.data(), stream.gcount(), seed);
+  }
+  return seed;
+}
+
+uint64_t hashFileStat(const std::string& path, uint64_t seed) {
+  struct stat info;
+  if (stat(path.c_str(), &info) != 0) {
+    throw std::runtime_error("[hashFileStat] Can't stat file: " + path);
+  }
+  int64_t size = info.st_size;
+  int64_t modificationTime = info.st_mtime;
+  seed = hashBytes(&size, sizeof(size), seed);
+  return hashBytes(&modificationTime, sizeof(modificationTime), seed);
+}
+
+uint64_t hashDictionary(const Dictionary& dict, uint64_t seed) {
+  for (int i = 0; i < dict.indexSize(); i++) {
+    seed = hashString(dict.getEntry(i), seed);
+  }
+  return seed;
+}
+} // namespace text
+} // namespace lib
+} // namespace fl
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "flashlight/lib/text/decoder/FlatTrie.h"
+#include "flashlight/lib/text/dictionary/Dictionary.h"
+#include "flashlight/lib/text/dictionary/Utils.h"
+
+namespace fl {
+namespace lib {
+namespace text {
+
+/**
+ * CompiledLexicon holds everything a decoder process derives from a text
+ * lexicon at startup: the word dictionary, the spellings of the words and the
+ * smeared trie, frozen (nullptr for lexicon-free decoding).
+ *
+ * It is saved once into a binary artifact, `<path>` for the dictionary and the
+ * spellings and `<path>.trie` for the trie, along with a hash of all the
+ * inputs it was built from. Loading it back doesn't parse, tokenize or smear
+ * anything, and the trie is memory mapped (see `FlatTrie::load()`).
+ */
+struct CompiledLexicon {
+  Dictionary wordDict;
+  LexiconMap lexicon;
+  FlatTriePtr trie;
+
+  /* Save the lexicon, built from inputs of hash `inputHash` */
+  void save(const std::string& path, uint64_t inputHash) const;
+
+  /**
+   * Load a lexicon saved with `save()`. Returns false if there is none at
+   * `path` or if it was built from inputs of another hash than `inputHash`.
+   */
+  bool load(const std::string& path, uint64_t inputHash);
+};
+
+constexpr uint64_t kInputHashSeed = 0xcbf29ce484222325ULL;
+
+/* FNV-1a hash of `size` bytes, continuing `seed` */
+uint64_t
+hashBytes(const void* data, size_t size, uint64_t seed = kInputHashSeed);
+
+/* Hash of a string, including its length */
+uint64_t hashString(const std::string& str, uint64_t seed = kInputHashSeed);
+
+/* Hash of the content of a file */
+uint64_t hashFile(const std::string& path, uint64_t seed = kInputHashSeed);
+
+/**
+ * Hash of the size and modification time of a file, for inputs too large to
+ * be read at startup (e.g. a LM)
+ */
+uint64_t hashFileStat(const std::string& path, uint64_t seed = kInputHashSeed);
+
+/* Hash of the entries of a dictionary, in index order */
+uint64_t hashDictionary(
+    const Dictionary& dict,
+    uint64_t seed = kInputHashSeed);
+} // namespace text
+} // namespace lib
+} // namespace fl
@@ -7,6 +7,9 @@
 
 #pragma once
 
+#include <cstdint>
+#include <vector>
+
 #include "flashlight/lib/text/decoder/Utils.h"
 
 namespace fl {
@@ -15,10 +18,26 @@ namespace text {
 
 enum class CriterionType { ASG = 0, CTC = 1, S2S = 2 };
 
+/**
+ * SparseEmissions holds the `K` best tokens of each of the `T` frames of
+ * T x N emissions, e.g. selected on the device with af::topk() before the copy
+ * to the host: `indices` and `scores` are T x K, frame after frame, and the
+ * tokens of a frame are sorted by decreasing score. The tokens of a frame that
+ * aren't given score as its worst given token.
+ */
+struct SparseEmissions {
+  const int* indices;
+  const float* scores;
+  int T;
+  int N;
+  int K;
+};
+
 /**
  * Decoder support two typical use cases:
  * Offline manner:
  *  decoder.decode(someData) [returns all hypothesis (transcription)]
+ *  decoder.decodeBatch(someBatch) [same, for several utterances at once]
  *
  * Online manner:
  *  decoder.decodeBegin() [called only at the beginning of the stream]
@@ -28,6 +47,12 @@ enum class CriterionType { ASG = 0, CTC = 1, S2S = 2 };
  *    decoder.prune() [prunes the hypothesis space]
  *  decoder.decodeEnd() [called only at the end of the stream]
  *
+ * Streaming manner (LexiconDecoder and LexiconFreeDecoder):
+ *  decoder.decodeBegin()
+ *  while (stream)
+ *    decoder.decodeChunk(someData) [returns the newly finalized transcription]
+ *  decoder.decodeStreamEnd() [returns the rest of the best transcription]
+ *
  * Note: function decoder.prune() deletes hypothesis up until time when called
  * to supports online decoding. It will also add a offset to the scores in beam
  * to avoid underflow/overflow.
@@ -44,6 +69,38 @@ class Decoder {
   /* Consume emissions in T x N chunks and increase the hypothesis space */
   virtual void decodeStep(const float* emissions, int T, int N) = 0;
 
+  /**
+   * Same as decodeStep() with sparse emissions. By default, each frame is
+   * densified and stepped; decoders may only expand the given tokens instead.
+   */
+  virtual void decodeStepSparse(const SparseEmissions& emissions) {
+    std::vector<float> frame;
+    for (int t = 0; t < emissions.T; t++) {
+      const int* tokens = emissions.indices + t * emissions.K;
+      const float* scores = emissions.scores + t * emissions.K;
+      frame.assign(emissions.N, scores[emissions.K - 1]);
+      for (int k = 0; k < emissions.K; k++) {
+        frame[tokens[k]] = scores[k];
+      }
+      decodeStep(frame.data(), 1, emissions.N);
+    }
+  }
+
+  /**
+   * Same as decodeStep() with T x N half-precision emissions, given by their
+   * bits, which halves the size of the copy from the device. They are
+   * converted frame by frame.
+   */
+  virtual void decodeStepHalf(const uint16_t* emissions, int T, int N) {
+    std::vector<float> frame(N);
+    for (int t = 0; t < T; t++) {
+      for (int n = 0; n < N; n++) {
+        frame[n] = halfToFloat(emissions[t * N + n]);
+      }
+      decodeStep(frame.data(), 1, N);
+    }
+  }
+
   /* Finish up decoding after consuming all emissions */
   virtual void decodeEnd() {}
 
@@ -56,6 +113,41 @@ class Decoder {
     return getAllFinalHypothesis();
   }
 
+  /* Offline decode function for sparse emissions */
+  std::vector<DecodeResult> decodeSparse(const SparseEmissions& emissions) {
+    decodeBegin();
+    decodeStepSparse(emissions);
+    decodeEnd();
+    return getAllFinalHypothesis();
+  }
+
+  /* Offline decode function for half-precision emissions */
+  std::vector<DecodeResult>
+  decodeHalf(const uint16_t* emissions, int T, int N) {
+    decodeBegin();
+    decodeStepHalf(emissions, T, N);
+    decodeEnd();
+    return getAllFinalHypothesis();
+  }
+
+  /**
+   * Offline decode function for a batch of utterances, `emissions[b]` being
+   * the `T[b] x N` emissions of the b-th utterance. Returns all the final
+   * hypothesis of each utterance. Decoders may override it to step all the
+   * utterances frame-synchronously, for example to query the LM for all of
+   * them at once. By default, utterances are decoded one after the other.
+   */
+  virtual std::vector<std::vector<DecodeResult>> decodeBatch(
+      const std::vector<const float*>& emissions,
+      const std::vector<int>& T,
+      int N) {
+    std::vector<std::vector<DecodeResult>> results;
+    for (int b = 0; b < emissions.size(); b++) {
+      results.push_back(decode(emissions[b], T[b], N));
+    }
+    return results;
+  }
+
   /* Prune the hypothesis space */
   virtual void prune(int lookBack = 0) = 0;
 
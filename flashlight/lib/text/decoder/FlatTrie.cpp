@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/lib/text/decoder/FlatTrie.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace fl {
+namespace lib {
+namespace text {
+
+namespace {
+
+constexpr char kFlatTrieMagic[8] = {'F', 'L', 'T', 'R', 'I', 'E', 0, 1};
+
+struct FlatTrieHeader {
+  char magic[8];
+  int64_t nNodes;
+  int64_t nLabels;
+};
+
+} // namespace
+
+FlatTrie::FlatTrie(const Trie& trie) {
+  // Breadth-first traversal: the children of the i-th visited node are pushed
+  // contiguously at the end of the node array.
+  std::vector<const TrieNode*> queue{trie.getRoot()};
+  auto addNode = [this](const TrieNode* node) {
+    nodeStorage_.push_back(
+        {node->idx,
+         0,
+         0,
+         static_cast<int>(labelStorage_.size()),
+         static_cast<int>(node->labels.size()),
+         node->maxScore});
+    labelStorage_.insert(
+        labelStorage_.end(), node->labels.begin(), node->labels.end());
+    scoreStorage_.insert(
+        scoreStorage_.end(), node->scores.begin(), node->scores.end());
+  };
+  addNode(queue.front());
+
+  std::vector<const TrieNode*> children;
+  for (size_t i = 0; i < queue.size(); i++) {
+    children.clear();
+    for (const auto& child : queue[i]->children) {
+      children.push_back(child.second.get());
+    }
+    std::sort(
+        children.begin(),
+        children.end(),
+        [](const TrieNode* lhs, const TrieNode* rhs) {
+          return lhs->idx < rhs->idx;
+        });
+
+    if (queue.size() + children.size() >
+        std::numeric_limits<int>::max()) {
+      throw std::overflow_error("[FlatTrie] Too many nodes in the trie");
+    }
+    nodeStorage_[i].firstChild = queue.size();
+    nodeStorage_[i].nChildren = children.size();
+    for (const auto* child : children) {
+      queue.push_back(child);
+      addNode(child);
+    }
+  }
+
+  nodes_ = nodeStorage_.data();
+  labels_ = labelStorage_.data();
+  scores_ = scoreStorage_.data();
+  nNodes_ = nodeStorage_.size();
+  nLabels_ = labelStorage_.size();
+}
+
+std::shared_ptr<FlatTrie> FlatTrie::load(const std::string& path) {
+  std::shared_ptr<FlatTrie> trie(new FlatTrie());
+  trie->mapping_ = std::make_unique<MemoryMappedFile>(path);
+  const char* data = trie->mapping_->data();
+  size_t size = trie->mapping_->size();
+
+  FlatTrieHeader header;
+  if (size < sizeof(header)) {
+    throw std::runtime_error("[FlatTrie] Invalid file: " + path);
+  }
+  std::memcpy(&header, data, sizeof(header));
+  if (std::memcmp(header.magic, kFlatTrieMagic, sizeof(kFlatTrieMagic)) !=
+          0 ||
+      header.nNodes < 1 || header.nLabels < 0 ||
+      size !=
+          sizeof(header) + header.nNodes * sizeof(FlatTrieNode) +
+              header.nLabels * (sizeof(int) + sizeof(float))) {
+    throw std::runtime_error("[FlatTrie] Invalid file: " + path);
+  }
+
+  trie->nNodes_ = header.nNodes;
+  trie->nLabels_ = header.nLabels;
+  data += sizeof(header);
+  trie->nodes_ = reinterpret_cast<const FlatTrieNode*>(data);
+  data += trie->nNodes_ * sizeof(FlatTrieNode);
+  trie->labels_ = reinterpret_cast<const int*>(data);
+  data += trie->nLabels_ * sizeof(int);
+  trie->scores_ = reinterpret_cast<const float*>(data);
+  return trie;
+}
+
+void FlatTrie::save(const std::string& path) const {
+  auto stream = createOutputStream(path, std::ios::out | std::ios::binary);
+  FlatTrieHeader header;
+  std::memcpy(header.magic, kFlatTrieMagic, sizeof(kFlatTrieMagic));
+  header.nNodes = nNodes_;
+  header.nLabels = nLabels_;
+  stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  stream.write(
+      reinterpret_cast<const char*>(nodes_), nNodes_ * sizeof(FlatTrieNode));
+  stream.write(reinterpret_cast<const char*>(labels_), nLabels_ * sizeof(int));
+  stream.write(
+      reinterpret_cast<const char*>(scores_), nLabels_ * sizeof(float));
+  if (!stream) {
+    throw std::runtime_error("[FlatTrie] Failed to write file: " + path);
+  }
+}
+
+const FlatTrieNode* FlatTrie::getChild(const FlatTrieNode* node, int idx)
+    const {
+  const FlatTrieNode* begin = nodes_ + node->firstChild;
+  const FlatTrieNode* end = begin + node->nChildren;
+  const FlatTrieNode* child = std::lower_bound(
+      begin, end, idx, [](const FlatTrieNode& child, int idx) {
+        return child.idx < idx;
+      });
+  return (child != end && child->idx == idx) ? child : nullptr;
+}
+} // namespace text
+} // namespace lib
+} // namespace fl
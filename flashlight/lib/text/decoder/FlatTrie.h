@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "flashlight/lib/common/System.h"
+#include "flashlight/lib/text/decoder/Trie.h"
+
+namespace fl {
+namespace lib {
+namespace text {
+
+/**
+ * FlatTrieNode is the node structure in FlatTrie. Nodes only store indices
+ * into the flat arrays of the trie, so that they can be stored in a file.
+ */
+struct FlatTrieNode {
+  // Token index of the node
+  int idx;
+
+  // Position of the first child in the node array. Children of a node are
+  // contiguous and sorted by token index.
+  int firstChild;
+
+  // Number of children
+  int nChildren;
+
+  // Position of the first label in the label and score arrays
+  int firstLabel;
+
+  // Number of labels
+  int nLabels;
+
+  // Same as TrieNode::maxScore
+  float maxScore;
+};
+
+/**
+ * FlatTrie is a read-only version of Trie stored in contiguous arrays (CSR
+ * layout): nodes are laid out in breadth-first order and the children of a
+ * node are searched with a binary search over a contiguous span. This is much
+ * more compact and cache friendly than Trie, which helps when looking up
+ * children in the inner loop of the decoders.
+ *
+ * A FlatTrie should be created from a trie already smeared. It can be saved to
+ * a binary file and loaded back with `load()`, which memory maps the file so
+ * that several decoder processes can share the same physical pages.
+ */
+class FlatTrie {
+ public:
+  /* Freeze `trie` into a flat trie */
+  explicit FlatTrie(const Trie& trie);
+
+  /* Load a flat trie saved with `save()`, the file is memory mapped */
+  static std::shared_ptr<FlatTrie> load(const std::string& path);
+
+  /* Save the flat trie into a binary file */
+  void save(const std::string& path) const;
+
+  /* Return the root node pointer */
+  const FlatTrieNode* getRoot() const {
+    return nodes_;
+  }
+
+  /* Return the child of `node` with token index `idx`, nullptr if none */
+  const FlatTrieNode* getChild(const FlatTrieNode* node, int idx) const;
+
+  /* Labels of the words ending at `node` (`node->nLabels` of them) */
+  const int* getLabels(const FlatTrieNode* node) const {
+    return labels_ + node->firstLabel;
+  }
+
+  /* Scores of the words ending at `node` (`node->nLabels` of them) */
+  const float* getScores(const FlatTrieNode* node) const {
+    return scores_ + node->firstLabel;
+  }
+
+  /* The whole node array, in breadth-first order (the root comes first) */
+  const FlatTrieNode* getNodes() const {
+    return nodes_;
+  }
+
+  /* The whole label array, indexed by FlatTrieNode::firstLabel */
+  const int* getLabels() const {
+    return labels_;
+  }
+
+  size_t nNodes() const {
+    return nNodes_;
+  }
+
+  size_t nLabels() const {
+    return nLabels_;
+  }
+
+ private:
+  FlatTrie() = default;
+
+  // Storage used when the trie is built in memory
+  std::vector<FlatTrieNode> nodeStorage_;
+  std::vector<int> labelStorage_;
+  std::vector<float> scoreStorage_;
+
+  // Storage used when the trie is loaded from a file
+  std::unique_ptr<MemoryMappedFile> mapping_;
+
+  const FlatTrieNode* nodes_{nullptr};
+  const int* labels_{nullptr};
+  const float* scores_{nullptr};
+  size_t nNodes_{0};
+  size_t nLabels_{0};
+};
+
+using FlatTriePtr = std::shared_ptr<FlatTrie>;
+} // namespace text
+} // namespace lib
+} // namespace fl
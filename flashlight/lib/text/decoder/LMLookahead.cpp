@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/lib/text/decoder/LMLookahead.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace fl {
+namespace lib {
+namespace text {
+
+LMLookahead::LMLookahead(
+    const LMPtr& lm,
+    const FlatTriePtr& lexicon,
+    int maxWords,
+    size_t cacheSize)
+    : lm_(lm), lexicon_(lexicon), maxWords_(maxWords), cacheSize_(cacheSize) {
+  if (!lm_ || !lexicon_) {
+    throw std::invalid_argument("[LMLookahead] the LM and lexicon are needed");
+  }
+  if (cacheSize_ == 0) {
+    throw std::invalid_argument("[LMLookahead] cacheSize should be positive");
+  }
+  // Nodes are in breadth-first order: children come after their parent
+  const FlatTrieNode* nodes = lexicon_->getNodes();
+  nWords_.resize(lexicon_->nNodes());
+  for (int i = lexicon_->nNodes() - 1; i >= 0; i--) {
+    nWords_[i] = nodes[i].nLabels;
+    for (int c = 0; c < nodes[i].nChildren; c++) {
+      nWords_[i] += nWords_[nodes[i].firstChild + c];
+    }
+  }
+  index_.reserve(cacheSize_);
+}
+
+float LMLookahead::score(const LMStatePtr& state, const FlatTrieNode* node) {
+  if (node == lexicon_->getRoot()) {
+    return 0;
+  }
+  if (nWords(node) == 0 || nWords(node) > maxWords_) {
+    return node->maxScore;
+  }
+
+  Key key(state.get(), node);
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    nHits_++;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return it->second->score;
+  }
+  nMisses_++;
+
+  float best = -std::numeric_limits<float>::infinity();
+  stack_.assign(1, node);
+  while (!stack_.empty()) {
+    const FlatTrieNode* current = stack_.back();
+    stack_.pop_back();
+    const int* labels = lexicon_->getLabels(current);
+    for (int i = 0; i < current->nLabels; i++) {
+      best = std::max(best, lm_->score(state, labels[i]).second);
+    }
+    const FlatTrieNode* children = lexicon_->getNodes() + current->firstChild;
+    for (int c = 0; c < current->nChildren; c++) {
+      stack_.push_back(children + c);
+    }
+  }
+
+  if (entries_.size() >= cacheSize_) {
+    index_.erase(entries_.back().key);
+    entries_.pop_back();
+  }
+  entries_.push_front({key, state, best});
+  index_.emplace(key, entries_.begin());
+  return best;
+}
+
+void LMLookahead::clear() {
+  index_.clear();
+  entries_.clear();
+}
+
+} // namespace text
+} // namespace lib
+} // namespace fl
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "flashlight/lib/text/decoder/FlatTrie.h"
+#include "flashlight/lib/text/decoder/Utils.h"
+#include "flashlight/lib/text/decoder/lm/LM.h"
+
+namespace fl {
+namespace lib {
+namespace text {
+
+/**
+ * LMLookahead gives the context-dependent LM look-ahead score of a lexicon
+ * node: the best LM score, after an LM state, of the words spelled below the
+ * node. Used instead of the smeared lexicon score of partial words, it lets
+ * the beam prune the words the LM rules out before they are complete.
+ *
+ * Scores are computed lazily, by scoring all the words below the node, and
+ * cached for at most `cacheSize` (state, node) pairs, evicting the least
+ * recently used one. Nodes with more than `maxWords` words below them (near
+ * the root) keep their smeared lexicon score, which is much cheaper.
+ *
+ * The LM must score states directly (e.g. an n-gram LM): scores must not
+ * depend on `updateCache()`. A look-ahead isn't thread-safe.
+ */
+class LMLookahead {
+ public:
+  LMLookahead(
+      const LMPtr& lm,
+      const FlatTriePtr& lexicon,
+      int maxWords,
+      size_t cacheSize);
+
+  /* The look-ahead score of `node` after `state`, 0 for the root */
+  float score(const LMStatePtr& state, const FlatTrieNode* node);
+
+  /* Number of words spelled below `node`, including `node` itself */
+  int nWords(const FlatTrieNode* node) const {
+    return nWords_[node - lexicon_->getNodes()];
+  }
+
+  /* Drop all the cached scores */
+  void clear();
+
+  size_t size() const {
+    return entries_.size();
+  }
+
+  uint64_t nHits() const {
+    return nHits_;
+  }
+
+  uint64_t nMisses() const {
+    return nMisses_;
+  }
+
+ private:
+  using Key = std::pair<const LMState*, const FlatTrieNode*>;
+
+  struct KeyHash {
+    size_t operator()(const Key& key) const {
+      size_t hash = std::hash<const LMState*>()(key.first);
+      hashCombine(hash, std::hash<const FlatTrieNode*>()(key.second));
+      return hash;
+    }
+  };
+
+  struct Entry {
+    Key key;
+    // Keeps the state alive, so that its address isn't reused by another one
+    // while it is a key
+    LMStatePtr state;
+    float score;
+  };
+
+  LMPtr lm_;
+  FlatTriePtr lexicon_;
+  int maxWords_;
+  size_t cacheSize_;
+  std::vector<int> nWords_;
+
+  // Most recently used first
+  std::list<Entry> entries_;
+  std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index_;
+
+  // Workspace of the traversal of the words below a node
+  std::vector<const FlatTrieNode*> stack_;
+
+  uint64_t nHits_{0};
+  uint64_t nMisses_{0};
+};
+
+using LMLookaheadPtr = std::shared_ptr<LMLookahead>;
+} // namespace text
+} // namespace lib
+} // namespace fl
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/lib/text/decoder/Lattice.h"
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace fl {
+namespace lib {
+namespace text {
+
+namespace {
+
+constexpr char kMagic[8] = {'F', 'L', 'L', 'A', 'T', '\0', '\0', '\0'};
+constexpr uint32_t kFormatVersion = 1;
+
+template <typename T>
+void write(std::ostream& out, const T& value) {
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+T read(std::istream& in) {
+  T value;
+  if (!in.read(reinterpret_cast<char*>(&value), sizeof(T))) {
+    throw std::runtime_error("Lattice: unexpected end of the input");
+  }
+  return value;
+}
+
+} // namespace
+
+void Lattice::save(std::ostream& out) const {
+  out.write(kMagic, sizeof(kMagic));
+  write(out, kFormatVersion);
+  write(out, static_cast<uint32_t>(nodeFrames.size()));
+  write(out, static_cast<uint32_t>(arcs.size()));
+  for (int frame : nodeFrames) {
+    write(out, static_cast<int32_t>(frame));
+  }
+  for (const auto& arc : arcs) {
+    write(out, static_cast<int32_t>(arc.from));
+    write(out, static_cast<int32_t>(arc.to));
+    write(out, static_cast<int32_t>(arc.word));
+    write(out, arc.score);
+    write(out, arc.amScore);
+    write(out, arc.lmScore);
+  }
+  if (!out) {
+    throw std::runtime_error("Lattice: failed to write the lattice");
+  }
+}
+
+Lattice Lattice::load(std::istream& in) {
+  char magic[sizeof(kMagic)];
+  if (!in.read(magic, sizeof(magic)) ||
+      std::memcmp(magic, kMagic, sizeof(kMagic)) != 0) {
+    throw std::runtime_error("Lattice: not a lattice");
+  }
+  auto version = read<uint32_t>(in);
+  if (version != kFormatVersion) {
+    throw std::runtime_error(
+        "Lattice: unsupported format version " + std::to_string(version));
+  }
+  Lattice lattice;
+  lattice.nodeFrames.resize(read<uint32_t>(in));
+  lattice.arcs.resize(read<uint32_t>(in));
+  for (auto& frame : lattice.nodeFrames) {
+    frame = read<int32_t>(in);
+  }
+  for (auto& arc : lattice.arcs) {
+    arc.from = read<int32_t>(in);
+    arc.to = read<int32_t>(in);
+    arc.word = read<int32_t>(in);
+    arc.score = read<float>(in);
+    arc.amScore = read<float>(in);
+    arc.lmScore = read<float>(in);
+    if (arc.from < 0 || arc.from >= arc.to ||
+        arc.to >= lattice.nodeFrames.size()) {
+      throw std::runtime_error("Lattice: invalid arc");
+    }
+  }
+  return lattice;
+}
+
+} // namespace text
+} // namespace lib
+} // namespace fl
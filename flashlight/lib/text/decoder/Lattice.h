@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "flashlight/lib/text/decoder/Utils.h"
+
+namespace fl {
+namespace lib {
+namespace text {
+
+/**
+ * LatticeArc is a word of a lattice, between the word boundaries `from` and
+ * `to` (indices of nodes). Its scores are the increments of the scores of the
+ * decoder over the word: `score` includes the weighted LM score and the
+ * insertion scores, `lmScore` is unweighted. The arcs to the final node have
+ * the word -1 and hold the trailing frames of an utterance and the LM score
+ * of its end.
+ */
+struct LatticeArc {
+  int from;
+  int to;
+  int word;
+  float score;
+  float amScore;
+  float lmScore;
+};
+
+/**
+ * Lattice is a compact word graph of the hypothesis kept by a decoder, e.g.
+ * for the rescoring of its paths or for word confidences. Its nodes are the
+ * word boundaries of the hypothesis, with the same LM state at the same frame
+ * merged, sorted by frame: node 0 is the start and the last node the end of
+ * the utterance, and every arc goes from a node to a later one.
+ */
+struct Lattice {
+  // Frame of each node
+  std::vector<int> nodeFrames;
+  // Sorted by `from`, `to` and `word`
+  std::vector<LatticeArc> arcs;
+
+  int nNodes() const {
+    return nodeFrames.size();
+  }
+
+  /* Binary serialization, in native byte order */
+  void save(std::ostream& out) const;
+
+  static Lattice load(std::istream& in);
+};
+
+/**
+ * Build the lattice of the paths of `hyp` ending in the final states of
+ * `finalFrame`, whose frames are numbered from `firstFrame`. The history left
+ * out of the beam or merged into other hypothesis isn't in `hyp`, and isn't
+ * in the lattice either. For a state of a completed word, `word` is the word
+ * and `lmState` the LM state after it.
+ */
+template <class DecoderState>
+Lattice buildLattice(
+    const HypothesisArena<DecoderState>& hyp,
+    int finalFrame,
+    int firstFrame = 0) {
+  Lattice lattice;
+  if (finalFrame < 1 || hyp[finalFrame].empty()) {
+    return lattice;
+  }
+
+  // Word boundaries, by (frame, LM state), in the order they are reached
+  // from the final states. The start is node 0 and the end node 1.
+  std::map<std::pair<int, const LMState*>, int> boundaries;
+  std::vector<int> frames = {firstFrame, firstFrame + finalFrame};
+  auto boundary = [&](const DecoderState* state, int frame) {
+    if (!state->parent) {
+      return 0;
+    }
+    auto key = std::make_pair(frame, state->lmState.get());
+    auto it = boundaries.find(key);
+    if (it != boundaries.end()) {
+      return it->second;
+    }
+    boundaries.emplace(key, frames.size());
+    frames.push_back(firstFrame + frame);
+    return static_cast<int>(frames.size()) - 1;
+  };
+
+  // Arcs by (from, to, word), keeping the best path of the decoder
+  std::map<std::tuple<int, int, int>, LatticeArc> arcs;
+  std::unordered_map<const DecoderState*, bool> visited;
+  std::vector<std::pair<const DecoderState*, int>> pending;
+  for (const auto& state : hyp[finalFrame]) {
+    pending.emplace_back(&state, finalFrame);
+  }
+  while (!pending.empty()) {
+    const DecoderState* end = pending.back().first;
+    int endFrame = pending.back().second;
+    pending.pop_back();
+    int to = endFrame == finalFrame ? 1 : boundary(end, endFrame);
+
+    // The previous word boundary
+    const DecoderState* start = end->parent;
+    int startFrame = endFrame - 1;
+    while (start->parent && start->word < 0) {
+      start = start->parent;
+      startFrame--;
+    }
+    int from = boundary(start, startFrame);
+
+    LatticeArc arc{from,
+                   to,
+                   end->getWord(),
+                   static_cast<float>(end->score - start->score),
+                   static_cast<float>(end->amScore - start->amScore),
+                   static_cast<float>(end->lmScore - start->lmScore)};
+    auto it = arcs.emplace(std::make_tuple(from, to, arc.word), arc).first;
+    if (arc.score > it->second.score) {
+      it->second = arc;
+    }
+    if (start->parent && !visited[start]) {
+      visited[start] = true;
+      pending.emplace_back(start, startFrame);
+    }
+  }
+
+  // Word boundaries are strictly between the start and the end, and every
+  // arc goes forward in time: sorting the nodes by frame sorts them
+  // topologically
+  std::vector<int> order(frames.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+    return frames[a] < frames[b];
+  });
+  std::vector<int> rank(frames.size());
+  lattice.nodeFrames.resize(frames.size());
+  for (int i = 0; i < order.size(); i++) {
+    rank[order[i]] = i;
+    lattice.nodeFrames[i] = frames[order[i]];
+  }
+  for (const auto& item : arcs) {
+    LatticeArc arc = item.second;
+    arc.from = rank[arc.from];
+    arc.to = rank[arc.to];
+    lattice.arcs.push_back(arc);
+  }
+  std::sort(
+      lattice.arcs.begin(),
+      lattice.arcs.end(),
+      [](const LatticeArc& a, const LatticeArc& b) {
+        return std::tie(a.from, a.to, a.word) < std::tie(b.from, b.to, b.word);
+      });
+  return lattice;
+}
+
+} // namespace text
+} // namespace lib
+} // namespace fl
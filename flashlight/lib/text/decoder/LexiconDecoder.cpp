@@ -7,9 +7,12 @@
 
 #include <stdlib.h>
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <functional>
 #include <numeric>
+#include <stdexcept>
+#include <string>
 #include <unordered_map>
 
 #include "flashlight/lib/text/decoder/LexiconDecoder.h"
@@ -19,213 +22,281 @@ namespace lib {
 namespace text {
 
 void LexiconDecoder::decodeBegin() {
-  hyp_.clear();
-  hyp_.emplace(0, std::vector<LexiconDecoderState>());
+  hyp_.reset();
+  hyp_.extend(1);
 
   /* note: the lm reset itself with :start() */
   hyp_[0].emplace_back(
       0.0, lm_->start(0), lexicon_->getRoot(), nullptr, sil_, -1);
   nDecodedFrames_ = 0;
   nPrunedFrames_ = 0;
+  beam_.reset();
 }
 
 void LexiconDecoder::decodeStep(const float* emissions, int T, int N) {
-  int startFrame = nDecodedFrames_ - nPrunedFrames_;
   // Extend hyp_ buffer
-  if (hyp_.size() < startFrame + T + 2) {
-    for (int i = hyp_.size(); i < startFrame + T + 2; i++) {
-      hyp_.emplace(i, std::vector<LexiconDecoderState>());
-    }
-  }
+  hyp_.extend(nDecodedFrames_ - nPrunedFrames_ + T + 2);
 
-  std::vector<size_t> idx(N);
+  std::vector<int>& idx = tokenIdx_;
+  idx.resize(N);
   for (int t = 0; t < T; t++) {
+    const float* frame = emissions + t * N;
+    // Only the blank and the repeated tokens are expanded on a blank frame,
+    // without any lexicon or LM lookup
+    bool blankFrame = isBlankFrame(frame, N);
     std::iota(idx.begin(), idx.end(), 0);
-    if (N > opt_.beamSizeToken) {
+    if (N > opt_.beamSizeToken && !blankFrame) {
       std::partial_sort(
           idx.begin(),
           idx.begin() + opt_.beamSizeToken,
           idx.end(),
-          [&t, &N, &emissions](const size_t& l, const size_t& r) {
-            return emissions[t * N + l] > emissions[t * N + r];
-          });
+          [frame](int l, int r) { return frame[l] > frame[r]; });
     }
+    int nTokens = blankFrame ? 0 : std::min(opt_.beamSizeToken, N);
+    decodeFrame({frame, 0, idx.data(), nTokens}, N);
+  }
+}
 
-    candidatesReset(candidatesBestScore_, candidates_, candidatePtrs_);
-    for (const LexiconDecoderState& prevHyp : hyp_[startFrame + t]) {
-      const TrieNode* prevLex = prevHyp.lex;
-      const int prevIdx = prevHyp.token;
-      const float lexMaxScore =
-          prevLex == lexicon_->getRoot() ? 0 : prevLex->maxScore;
-
-      /* (1) Try children */
-      for (int r = 0; r < std::min(opt_.beamSizeToken, N); ++r) {
-        int n = idx[r];
-        auto iter = prevLex->children.find(n);
-        if (iter == prevLex->children.end()) {
-          continue;
-        }
-        const TrieNodePtr& lex = iter->second;
-        double amScore = emissions[t * N + n];
-        if (nDecodedFrames_ + t > 0 &&
-            opt_.criterionType == CriterionType::ASG) {
-          amScore += transitions_[n * N + prevIdx];
-        }
-        double score = prevHyp.score + amScore;
-        if (n == sil_) {
-          score += opt_.silScore;
-        }
-
-        LMStatePtr lmState;
-        double lmScore = 0.;
-
-        if (isLmToken_) {
-          auto lmStateScorePair = lm_->score(prevHyp.lmState, n);
-          lmState = lmStateScorePair.first;
-          lmScore = lmStateScorePair.second;
-        }
-
-        // We eat-up a new token
-        if (opt_.criterionType != CriterionType::CTC || prevHyp.prevBlank ||
-            n != prevIdx) {
-          if (!lex->children.empty()) {
-            if (!isLmToken_) {
-              lmState = prevHyp.lmState;
-              lmScore = lex->maxScore - lexMaxScore;
-            }
-            candidatesAdd(
-                candidates_,
-                candidatesBestScore_,
-                opt_.beamThreshold,
-                score + opt_.lmWeight * lmScore,
-                lmState,
-                lex.get(),
-                &prevHyp,
-                n,
-                -1,
-                false, // prevBlank
-                prevHyp.amScore + amScore,
-                prevHyp.lmScore + lmScore);
-          }
-        }
+void LexiconDecoder::decodeStepSparse(const SparseEmissions& emissions) {
+  int N = emissions.N, K = emissions.K;
+  hyp_.extend(nDecodedFrames_ - nPrunedFrames_ + emissions.T + 2);
+
+  // Scores relative to the worst given token of the frame, the other tokens
+  // being at 0
+  sparseFrame_.resize(N, 0);
+  for (int t = 0; t < emissions.T; t++) {
+    const int* tokens = emissions.indices + t * K;
+    const float* scores = emissions.scores + t * K;
+    float floor = scores[K - 1];
+    for (int k = 0; k < K; k++) {
+      sparseFrame_[tokens[k]] = scores[k] - floor;
+    }
+    bool blankFrame = isBlankFrame(sparseFrame_.data(), N);
+    int nTokens = blankFrame ? 0 : std::min(opt_.beamSizeToken, K);
+    decodeFrame({sparseFrame_.data(), floor, tokens, nTokens}, N);
+    for (int k = 0; k < K; k++) {
+      sparseFrame_[tokens[k]] = 0;
+    }
+  }
+}
 
-        // If we got a true word
-        for (auto label : lex->labels) {
-          if (prevLex == lexicon_->getRoot() && prevHyp.token == n) {
-            // This is to avoid an situation that, when there is word with
-            // single token spelling (e.g. X -> x) in the lexicon and token `x`
-            // is predicted in several consecutive frames, multiple word `X`
-            // will be emitted. This violates the property of CTC, where
-            // there must be an blank token in between to predict 2 identical
-            // tokens consecutively.
-            continue;
-          }
+void LexiconDecoder::decodeFrame(const EmissionFrame& frame, int N) {
+  auto frameStart = std::chrono::steady_clock::now();
+  const double beamThreshold = beam_.threshold();
+  const int startFrame = nDecodedFrames_ - nPrunedFrames_;
+  candidatesReset(candidatesBestScore_, candidates_, candidatePtrs_);
+  lmQueries_.clear();
+  for (const LexiconDecoderState& prevHyp : hyp_[startFrame]) {
+    const FlatTrieNode* prevLex = prevHyp.lex;
+    const int prevIdx = prevHyp.token;
+    const float lexMaxScore = partialWordScore(prevHyp.lmState, prevLex);
+
+    /* (1) Try children */
+    for (int r = 0; r < frame.nTokens; ++r) {
+      int n = frame.tokens[r];
+      const FlatTrieNode* lex = lexicon_->getChild(prevLex, n);
+      if (!lex) {
+        continue;
+      }
+      double amScore = frame.scores[n] + frame.offset;
+      if (nDecodedFrames_ > 0 && opt_.criterionType == CriterionType::ASG) {
+        amScore += transitions_[n * N + prevIdx];
+      }
+      double score = prevHyp.score + amScore;
+      if (n == sil_) {
+        score += opt_.silScore;
+      }
 
-          if (!isLmToken_) {
-            auto lmStateScorePair = lm_->score(prevHyp.lmState, label);
-            lmState = lmStateScorePair.first;
-            lmScore = lmStateScorePair.second - lexMaxScore;
-          }
-          candidatesAdd(
-              candidates_,
-              candidatesBestScore_,
-              opt_.beamThreshold,
-              score + opt_.lmWeight * lmScore + opt_.wordScore,
-              lmState,
-              lexicon_->getRoot(),
-              &prevHyp,
-              n,
-              label,
-              false, // prevBlank
-              prevHyp.amScore + amScore,
-              prevHyp.lmScore + lmScore);
-        }
+      int tokenQuery = -1;
+      if (isLmToken_) {
+        tokenQuery = lmQueries_.size();
+        lmQueries_.emplace_back(prevHyp.lmState, n);
+      }
 
-        // If we got an unknown word
-        if (lex->labels.empty() && (opt_.unkScore > kNegativeInfinity)) {
+      // We eat-up a new token
+      if (opt_.criterionType != CriterionType::CTC || prevHyp.prevBlank ||
+          n != prevIdx) {
+        if (lex->nChildren > 0) {
+          LMStatePtr lmState;
+          double lmScore = 0.;
           if (!isLmToken_) {
-            auto lmStateScorePair = lm_->score(prevHyp.lmState, unk_);
-            lmState = lmStateScorePair.first;
-            lmScore = lmStateScorePair.second - lexMaxScore;
+            lmState = prevHyp.lmState;
+            lmScore = partialWordScore(prevHyp.lmState, lex) - lexMaxScore;
           }
-          candidatesAdd(
-              candidates_,
-              candidatesBestScore_,
-              opt_.beamThreshold,
-              score + opt_.lmWeight * lmScore + opt_.unkScore,
+          candidatesDefer(
+              deferred_,
+              tokenQuery,
+              0.0f,
+              0.0,
+              score + opt_.lmWeight * lmScore,
               lmState,
-              lexicon_->getRoot(),
+              lex,
               &prevHyp,
               n,
-              unk_,
+              -1,
               false, // prevBlank
               prevHyp.amScore + amScore,
               prevHyp.lmScore + lmScore);
         }
       }
 
-      /* (2) Try same lexicon node */
-      if (opt_.criterionType != CriterionType::CTC || !prevHyp.prevBlank ||
-          prevLex == lexicon_->getRoot()) {
-        int n = prevLex == lexicon_->getRoot() ? sil_ : prevIdx;
-        double amScore = emissions[t * N + n];
-        if (nDecodedFrames_ + t > 0 &&
-            opt_.criterionType == CriterionType::ASG) {
-          amScore += transitions_[n * N + prevIdx];
-        }
-        double score = prevHyp.score + amScore;
-        if (n == sil_) {
-          score += opt_.silScore;
+      // If we got a true word
+      const int* labels = lexicon_->getLabels(lex);
+      for (int i = 0; i < lex->nLabels; i++) {
+        int label = labels[i];
+        if (prevLex == lexicon_->getRoot() && prevHyp.token == n) {
+          // This is to avoid an situation that, when there is word with
+          // single token spelling (e.g. X -> x) in the lexicon and token `x`
+          // is predicted in several consecutive frames, multiple word `X`
+          // will be emitted. This violates the property of CTC, where
+          // there must be an blank token in between to predict 2 identical
+          // tokens consecutively.
+          continue;
         }
 
-        candidatesAdd(
-            candidates_,
-            candidatesBestScore_,
-            opt_.beamThreshold,
+        int query = tokenQuery;
+        float lmOffset = 0;
+        if (!isLmToken_) {
+          query = lmQueries_.size();
+          lmQueries_.emplace_back(prevHyp.lmState, label);
+          lmOffset = lexMaxScore;
+        }
+        candidatesDefer(
+            deferred_,
+            query,
+            lmOffset,
+            opt_.wordScore,
             score,
-            prevHyp.lmState,
-            prevLex,
+            nullptr,
+            lexicon_->getRoot(),
             &prevHyp,
             n,
-            -1,
+            label,
             false, // prevBlank
             prevHyp.amScore + amScore,
             prevHyp.lmScore);
       }
 
-      /* (3) CTC only, try blank */
-      if (opt_.criterionType == CriterionType::CTC) {
-        int n = blank_;
-        double amScore = emissions[t * N + n];
-        candidatesAdd(
-            candidates_,
-            candidatesBestScore_,
-            opt_.beamThreshold,
-            prevHyp.score + amScore,
-            prevHyp.lmState,
-            prevLex,
+      // If we got an unknown word
+      if (lex->nLabels == 0 && (opt_.unkScore > kNegativeInfinity)) {
+        int query = tokenQuery;
+        float lmOffset = 0;
+        if (!isLmToken_) {
+          query = lmQueries_.size();
+          lmQueries_.emplace_back(prevHyp.lmState, unk_);
+          lmOffset = lexMaxScore;
+        }
+        candidatesDefer(
+            deferred_,
+            query,
+            lmOffset,
+            opt_.unkScore,
+            score,
+            nullptr,
+            lexicon_->getRoot(),
             &prevHyp,
             n,
-            -1,
-            true, // prevBlank
+            unk_,
+            false, // prevBlank
             prevHyp.amScore + amScore,
             prevHyp.lmScore);
       }
-      // finish proposing
     }
 
-    candidatesStore(
-        candidates_,
-        candidatePtrs_,
-        hyp_[startFrame + t + 1],
-        opt_.beamSize,
-        candidatesBestScore_ - opt_.beamThreshold,
-        opt_.logAdd,
-        false);
-    updateLMCache(lm_, hyp_[startFrame + t + 1]);
+    /* (2) Try same lexicon node */
+    if (opt_.criterionType != CriterionType::CTC || !prevHyp.prevBlank ||
+        prevLex == lexicon_->getRoot()) {
+      int n = prevLex == lexicon_->getRoot() ? sil_ : prevIdx;
+      double amScore = frame.scores[n] + frame.offset;
+      if (nDecodedFrames_ > 0 && opt_.criterionType == CriterionType::ASG) {
+        amScore += transitions_[n * N + prevIdx];
+      }
+      double score = prevHyp.score + amScore;
+      if (n == sil_) {
+        score += opt_.silScore;
+      }
+
+      candidatesDefer(
+          deferred_,
+          -1,
+          0.0f,
+          0.0,
+          score,
+          prevHyp.lmState,
+          prevLex,
+          &prevHyp,
+          n,
+          -1,
+          false, // prevBlank
+          prevHyp.amScore + amScore,
+          prevHyp.lmScore);
+    }
+
+    /* (3) CTC only, try blank */
+    if (opt_.criterionType == CriterionType::CTC) {
+      int n = blank_;
+      double amScore = frame.scores[n] + frame.offset;
+      candidatesDefer(
+          deferred_,
+          -1,
+          0.0f,
+          0.0,
+          prevHyp.score + amScore,
+          prevHyp.lmState,
+          prevLex,
+          &prevHyp,
+          n,
+          -1,
+          true, // prevBlank
+          prevHyp.amScore + amScore,
+          prevHyp.lmScore);
+    }
+    // finish proposing
+  }
+
+  // Score all the LM queries of the frame at once
+  lmScores_.clear();
+  if (frame.nTokens > 0) {
+    lmScores_ = lm_->scoreBatch(lmQueries_);
+  }
+  candidatesAddDeferred(
+      candidates_,
+      candidatesBestScore_,
+      beamThreshold,
+      opt_.lmWeight,
+      deferred_,
+      lmScores_);
+
+  // Candidates are filtered against the best score so far when they are
+  // added: count them against the best score of the frame instead, which
+  // doesn't depend on their order
+  int nCandidates = 0;
+  for (const auto& candidate : candidates_) {
+    nCandidates += candidate.score >= candidatesBestScore_ - beamThreshold;
+  }
+  auto& frameHyps = hyp_[startFrame + 1];
+  candidatesStore(
+      candidates_,
+      candidatePtrs_,
+      frameHyps,
+      opt_.beamSize,
+      candidatesBestScore_ - beamThreshold,
+      opt_.logAdd,
+      false,
+      opt_.hashMerge ? &mergeTable_ : nullptr);
+  if (!deferLMCacheUpdate_) {
+    updateLMCache(lm_, frameHyps);
+  }
+
+  double scoreSpread = 0;
+  for (const auto& hyp : frameHyps) {
+    scoreSpread = std::max(scoreSpread, candidatesBestScore_ - hyp.score);
   }
+  std::chrono::duration<double> frameTime =
+      std::chrono::steady_clock::now() - frameStart;
+  beam_.update(nCandidates, frameHyps.size(), scoreSpread, frameTime.count());
 
-  nDecodedFrames_ += T;
+  nDecodedFrames_++;
 }
 
 void LexiconDecoder::decodeEnd() {
@@ -240,7 +311,7 @@ void LexiconDecoder::decodeEnd() {
   }
   for (const LexiconDecoderState& prevHyp :
        hyp_[nDecodedFrames_ - nPrunedFrames_]) {
-    const TrieNode* prevLex = prevHyp.lex;
+    const FlatTrieNode* prevLex = prevHyp.lex;
     const LMStatePtr& prevLmState = prevHyp.lmState;
 
     if (!hasNiceEnding || prevHyp.lex == lexicon_->getRoot()) {
@@ -249,7 +320,7 @@ void LexiconDecoder::decodeEnd() {
       candidatesAdd(
           candidates_,
           candidatesBestScore_,
-          opt_.beamThreshold,
+          beam_.threshold(),
           prevHyp.score + opt_.lmWeight * lmScore,
           lmStateScorePair.first,
           prevLex,
@@ -267,19 +338,160 @@ void LexiconDecoder::decodeEnd() {
       candidatePtrs_,
       hyp_[nDecodedFrames_ - nPrunedFrames_ + 1],
       opt_.beamSize,
-      candidatesBestScore_ - opt_.beamThreshold,
+      candidatesBestScore_ - beam_.threshold(),
       opt_.logAdd,
-      true);
+      true,
+      opt_.hashMerge ? &mergeTable_ : nullptr);
   ++nDecodedFrames_;
 }
 
+float LexiconDecoder::partialWordScore(
+    const LMStatePtr& lmState,
+    const FlatTrieNode* lex) {
+  if (lex == lexicon_->getRoot()) {
+    return 0;
+  }
+  return lookahead_ ? lookahead_->score(lmState, lex) : lex->maxScore;
+}
+
+bool LexiconDecoder::isBlankFrame(const float* emissions, int N) const {
+  if (opt_.criterionType != CriterionType::CTC ||
+      opt_.blankSkipThreshold >= 1.0 || blank_ < 0) {
+    return false;
+  }
+  // Emissions are unnormalized: p(blank) = 1 / sum_n exp(e_n - e_blank)
+  double sum = 0;
+  for (int n = 0; n < N; n++) {
+    sum += std::exp(emissions[n] - emissions[blank_]);
+  }
+  return 1.0 / sum > opt_.blankSkipThreshold;
+}
+
+void LexiconDecoder::swapStream(int b) {
+  auto& stream = streams_[b];
+  std::swap(hyp_, stream.hyp);
+  std::swap(beam_, streamBeams_[b]);
+  std::swap(nDecodedFrames_, stream.nDecodedFrames);
+  std::swap(nPrunedFrames_, stream.nPrunedFrames);
+}
+
+std::vector<std::vector<DecodeResult>> LexiconDecoder::decodeBatch(
+    const std::vector<const float*>& emissions,
+    const std::vector<int>& T,
+    int N) {
+  int batchSize = emissions.size();
+  if (T.size() != batchSize) {
+    throw std::invalid_argument(
+        "[LexiconDecoder] emissions and T should have the same size");
+  }
+  if (streams_.size() < batchSize) {
+    streams_.resize(batchSize);
+    streamBeams_.resize(batchSize, beam_);
+  }
+  int maxT = batchSize > 0 ? *std::max_element(T.begin(), T.end()) : 0;
+
+  for (int b = 0; b < batchSize; b++) {
+    swapStream(b);
+    decodeBegin();
+    swapStream(b);
+  }
+
+  // Step all the utterances frame by frame so that the LM cache is updated
+  // once per frame with the new states of the whole batch
+  deferLMCacheUpdate_ = true;
+  for (int t = 0; t < maxT; t++) {
+    lmStates_.clear();
+    for (int b = 0; b < batchSize; b++) {
+      if (t >= T[b]) {
+        continue;
+      }
+      swapStream(b);
+      decodeStep(emissions[b] + t * N, 1, N);
+      for (const auto& hyp : hyp_[nDecodedFrames_ - nPrunedFrames_]) {
+        lmStates_.emplace_back(hyp.lmState);
+      }
+      swapStream(b);
+    }
+    lm_->updateCache(lmStates_);
+  }
+  deferLMCacheUpdate_ = false;
+  lmStates_.clear();
+
+  std::vector<std::vector<DecodeResult>> results(batchSize);
+  for (int b = 0; b < batchSize; b++) {
+    swapStream(b);
+    decodeEnd();
+    results[b] = getAllFinalHypothesis();
+    swapStream(b);
+  }
+  return results;
+}
+
+DecodeResult LexiconDecoder::decodeChunk(
+    const float* emissions,
+    int T,
+    int N,
+    int maxDelay) {
+  decodeStep(emissions, T, N);
+
+  DecodeResult result;
+  int lookBack = releaseCommonHistory(
+      hyp_,
+      nDecodedFrames_ - nPrunedFrames_,
+      maxDelay,
+      ancestorNodes_,
+      result);
+  if (lookBack >= 0) {
+    nPrunedFrames_ = nDecodedFrames_ - lookBack;
+  }
+  return result;
+}
+
+DecodeResult LexiconDecoder::decodeStreamEnd() {
+  decodeEnd();
+
+  // Final hypothesis are sorted by decodeEnd()
+  int finalFrame = nDecodedFrames_ - nPrunedFrames_;
+  if (hyp_[finalFrame].empty()) {
+    return DecodeResult();
+  }
+  DecodeResult result = getHypothesis(&hyp_[finalFrame].front(), finalFrame);
+  result.words.erase(result.words.begin());
+  result.tokens.erase(result.tokens.begin());
+  return result;
+}
+
 std::vector<DecodeResult> LexiconDecoder::getAllFinalHypothesis() const {
   int finalFrame = nDecodedFrames_ - nPrunedFrames_;
   if (finalFrame < 1) {
     return std::vector<DecodeResult>{};
   }
 
-  return getAllHypothesis(hyp_.find(finalFrame)->second, finalFrame);
+  return getAllHypothesis(hyp_[finalFrame], finalFrame);
+}
+
+Lattice LexiconDecoder::getLattice() const {
+  return buildLattice(hyp_, nDecodedFrames_ - nPrunedFrames_, nPrunedFrames_);
+}
+
+const BeamTelemetry& LexiconDecoder::getBatchBeamTelemetry(int b) const {
+  if (b < 0 || b >= streamBeams_.size()) {
+    throw std::out_of_range(
+        "[LexiconDecoder] no utterance " + std::to_string(b) + " in the batch");
+  }
+  return streamBeams_[b].telemetry();
+}
+
+Lattice LexiconDecoder::getBatchLattice(int b) const {
+  if (b < 0 || b >= streams_.size()) {
+    throw std::out_of_range(
+        "[LexiconDecoder] no utterance " + std::to_string(b) + " in the batch");
+  }
+  const auto& stream = streams_[b];
+  return buildLattice(
+      stream.hyp,
+      stream.nDecodedFrames - stream.nPrunedFrames,
+      stream.nPrunedFrames);
 }
 
 DecodeResult LexiconDecoder::getBestHypothesis(int lookBack) const {
@@ -288,13 +500,13 @@ DecodeResult LexiconDecoder::getBestHypothesis(int lookBack) const {
   }
 
   const LexiconDecoderState* bestNode = findBestAncestor(
-      hyp_.find(nDecodedFrames_ - nPrunedFrames_)->second, lookBack);
+      hyp_[nDecodedFrames_ - nPrunedFrames_], lookBack);
   return getHypothesis(bestNode, nDecodedFrames_ - nPrunedFrames_ - lookBack);
 }
 
 int LexiconDecoder::nHypothesis() const {
   int finalFrame = nDecodedFrames_ - nPrunedFrames_;
-  return hyp_.find(finalFrame)->second.size();
+  return hyp_[finalFrame].size();
 }
 
 int LexiconDecoder::nDecodedFramesInBuffer() const {
@@ -308,7 +520,7 @@ void LexiconDecoder::prune(int lookBack) {
 
   /* (1) Find the last emitted word in the best path */
   const LexiconDecoderState* bestNode = findBestAncestor(
-      hyp_.find(nDecodedFrames_ - nPrunedFrames_)->second, lookBack);
+      hyp_[nDecodedFrames_ - nPrunedFrames_], lookBack);
   if (!bestNode) {
     return; // Not enough decoded frames to prune
   }
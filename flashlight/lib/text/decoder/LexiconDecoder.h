@@ -9,7 +9,11 @@
 
 #include <unordered_map>
 
+#include "flashlight/lib/text/decoder/AdaptiveBeam.h"
 #include "flashlight/lib/text/decoder/Decoder.h"
+#include "flashlight/lib/text/decoder/FlatTrie.h"
+#include "flashlight/lib/text/decoder/LMLookahead.h"
+#include "flashlight/lib/text/decoder/Lattice.h"
 #include "flashlight/lib/text/decoder/Trie.h"
 #include "flashlight/lib/text/decoder/lm/LM.h"
 
@@ -27,6 +31,18 @@ struct LexiconDecoderOptions {
   double silScore; // Silence insertion score
   bool logAdd; // If or not use logadd when merging hypothesis
   CriterionType criterionType; // CTC or ASG
+  bool hashMerge = false; // If or not use hashing when merging hypothesis
+  // CTC only: frames whose blank posterior exceeds it only extend the blank
+  // and repeated tokens of the hypothesis (1 to disable)
+  double blankSkipThreshold = 1.0;
+  // Word LM only: if positive, partial words are scored with the LM
+  // look-ahead of their lexicon node (see LMLookahead) when at most that many
+  // words are spelled below it, instead of the smeared lexicon score
+  int lmLookaheadWords = 0;
+  // Maximum number of look-ahead scores cached
+  int lmLookaheadCacheSize = 100000;
+  // Adapts the beam threshold to each frame, beamThreshold being its maximum
+  AdaptiveBeamOptions adaptiveBeam = {};
 };
 
 /**
@@ -35,7 +51,7 @@ struct LexiconDecoderOptions {
 struct LexiconDecoderState {
   double score; // Accumulated total score so far
   LMStatePtr lmState; // Language model state
-  const TrieNode* lex; // Trie node in the lexicon
+  const FlatTrieNode* lex; // Trie node in the lexicon
   const LexiconDecoderState* parent; // Parent hypothesis
   int token; // Label of token
   int word; // Label of word (-1 if incomplete)
@@ -47,7 +63,7 @@ struct LexiconDecoderState {
   LexiconDecoderState(
       const double score,
       const LMStatePtr& lmState,
-      const TrieNode* lex,
+      const FlatTrieNode* lex,
       const LexiconDecoderState* parent,
       const int token,
       const int word,
@@ -89,6 +105,14 @@ struct LexiconDecoderState {
     return 0;
   }
 
+  size_t hashNoScoreStates() const {
+    size_t hash = std::hash<const LMState*>()(lmState.get());
+    hashCombine(hash, std::hash<const FlatTrieNode*>()(lex));
+    hashCombine(hash, std::hash<int>()(token));
+    hashCombine(hash, std::hash<bool>()(prevBlank));
+    return hash;
+  }
+
   int getWord() const {
     return word;
   }
@@ -122,6 +146,26 @@ class LexiconDecoder : public Decoder {
       const int unk,
       const std::vector<float>& transitions,
       const bool isLmToken)
+      : LexiconDecoder(
+            std::move(opt),
+            std::make_shared<FlatTrie>(*lexicon),
+            lm,
+            sil,
+            blank,
+            unk,
+            transitions,
+            isLmToken) {}
+
+  /* A frozen lexicon can be shared by several decoders */
+  LexiconDecoder(
+      LexiconDecoderOptions opt,
+      const FlatTriePtr& lexicon,
+      const LMPtr& lm,
+      const int sil,
+      const int blank,
+      const int unk,
+      const std::vector<float>& transitions,
+      const bool isLmToken)
       : opt_(std::move(opt)),
         lexicon_(lexicon),
         lm_(lm),
@@ -129,14 +173,44 @@ class LexiconDecoder : public Decoder {
         blank_(blank),
         unk_(unk),
         transitions_(transitions),
-        isLmToken_(isLmToken) {}
+        isLmToken_(isLmToken),
+        beam_(opt_.adaptiveBeam, opt_.beamThreshold) {
+    if (opt_.lmLookaheadWords > 0 && !isLmToken_) {
+      lookahead_ = std::make_shared<LMLookahead>(
+          lm_, lexicon_, opt_.lmLookaheadWords, opt_.lmLookaheadCacheSize);
+    }
+  }
 
   void decodeBegin() override;
 
   void decodeStep(const float* emissions, int T, int N) override;
 
+  /* Only the given tokens of each frame are expanded */
+  void decodeStepSparse(const SparseEmissions& emissions) override;
+
   void decodeEnd() override;
 
+  std::vector<std::vector<DecodeResult>> decodeBatch(
+      const std::vector<const float*>& emissions,
+      const std::vector<int>& T,
+      int N) override;
+
+  /**
+   * Streaming decoding: consume a T x N chunk of emissions and return the
+   * newly finalized part of the transcription, i.e. the part shared by all the
+   * surviving hypothesis. The history before it is released, so that memory
+   * stays bounded on long streams. If `maxDelay` is non-negative, the
+   * hypothesis leaving the best path more than `maxDelay` frames ago are
+   * discarded so that results are never delayed by more than `maxDelay`
+   * frames. Call decodeBegin() before the first chunk and decodeStreamEnd()
+   * after the last one.
+   */
+  DecodeResult
+  decodeChunk(const float* emissions, int T, int N, int maxDelay = -1);
+
+  /* Finish streaming decoding and return the rest of the best hypothesis */
+  DecodeResult decodeStreamEnd();
+
   int nHypothesis() const;
 
   void prune(int lookBack = 0) override;
@@ -147,10 +221,29 @@ class LexiconDecoder : public Decoder {
 
   std::vector<DecodeResult> getAllFinalHypothesis() const override;
 
+  /**
+   * The word lattice of the hypothesis of the utterance, after decodeEnd().
+   * Words are indices in the lexicon. Only the history still in the beam is
+   * in the lattice: what was pruned, or released by prune() or decodeChunk(),
+   * isn't.
+   */
+  Lattice getLattice() const;
+
+  /* The word lattice of the utterance `b` of the last decodeBatch() */
+  Lattice getBatchLattice(int b) const;
+
+  /* Beam statistics of the utterance, see opt_.adaptiveBeam */
+  const BeamTelemetry& getBeamTelemetry() const {
+    return beam_.telemetry();
+  }
+
+  /* Beam statistics of the utterance `b` of the last decodeBatch() */
+  const BeamTelemetry& getBatchBeamTelemetry(int b) const;
+
  protected:
   LexiconDecoderOptions opt_;
   // Lexicon trie to restrict beam-search decoder
-  TriePtr lexicon_;
+  FlatTriePtr lexicon_;
   LMPtr lm_;
   // Index of silence label
   int sil_;
@@ -163,6 +256,10 @@ class LexiconDecoder : public Decoder {
   // if LM is token-level (operates on the same level as acoustic model)
   // or it is word-level (in case of false)
   bool isLmToken_;
+  // LM look-ahead of partial words, if opt_.lmLookaheadWords > 0
+  LMLookaheadPtr lookahead_;
+  // Beam threshold of the current utterance
+  AdaptiveBeam beam_;
 
   // All the hypothesis new candidates (can be larger than beamsize) proposed
   // based on the ones from previous frame
@@ -172,15 +269,65 @@ class LexiconDecoder : public Decoder {
   // so instead of moving around objects, we only need to sort pointers
   std::vector<LexiconDecoderState*> candidatePtrs_;
 
+  // Workspace of the hash table used to merge candidates if opt_.hashMerge
+  std::vector<int> mergeTable_;
+
   // Best candidate score of current frame
   double candidatesBestScore_;
 
   // Vector of hypothesis for all the frames so far
-  std::unordered_map<int, std::vector<LexiconDecoderState>> hyp_;
+  HypothesisArena<LexiconDecoderState> hyp_;
 
   // These 2 variables are used for online decoding, for hypothesis pruning
   int nDecodedFrames_; // Total number of decoded frames.
   int nPrunedFrames_; // Total number of pruned frames from hyp_.
+
+  // Utterances decoded by decodeBatch(), swapped in and out of hyp_,
+  // nDecodedFrames_, nPrunedFrames_ and beam_ while being stepped
+  std::vector<DecoderStream<LexiconDecoderState>> streams_;
+  std::vector<AdaptiveBeam> streamBeams_;
+
+  // If true, decodeStep() doesn't update the LM cache, this is done once
+  // for all the utterances of the batch instead
+  bool deferLMCacheUpdate_{false};
+
+  // Scratch buffers shared by all the decoding steps
+  std::vector<int> tokenIdx_;
+  // Scores of a frame of sparse emissions, relative to its worst token
+  std::vector<float> sparseFrame_;
+  std::vector<LMStatePtr> lmStates_;
+
+  // Candidates and LM queries gathered over a frame, see `LM::scoreBatch()`
+  std::vector<DeferredCandidate<LexiconDecoderState>> deferred_;
+  std::vector<LMQuery> lmQueries_;
+
+  // Scores of the LM queries of a frame
+  std::vector<std::pair<LMStatePtr, float>> lmScores_;
+
+  // Workspace to find the history shared by all the hypothesis
+  std::vector<const LexiconDecoderState*> ancestorNodes_;
+
+  void swapStream(int b);
+
+  // A frame of emissions: token n scores `scores[n] + offset`, and the
+  // `nTokens` tokens `tokens` are expanded (none on a blank frame)
+  struct EmissionFrame {
+    const float* scores;
+    float offset;
+    const int* tokens;
+    int nTokens;
+  };
+
+  // Step a frame of the N tokens
+  void decodeFrame(const EmissionFrame& frame, int N);
+
+  // If the blank posterior of the frame `emissions` exceeds
+  // opt_.blankSkipThreshold
+  bool isBlankFrame(const float* emissions, int N) const;
+
+  // Score of the partial words at `lex` after `lmState`, applied until the
+  // word is complete
+  float partialWordScore(const LMStatePtr& lmState, const FlatTrieNode* lex);
 };
 } // namespace text
 } // namespace lib
@@ -10,6 +10,7 @@
 #include <cmath>
 #include <functional>
 #include <numeric>
+#include <stdexcept>
 
 #include "flashlight/lib/text/decoder/LexiconFreeDecoder.h"
 
@@ -18,8 +19,8 @@ namespace lib {
 namespace text {
 
 void LexiconFreeDecoder::decodeBegin() {
-  hyp_.clear();
-  hyp_.emplace(0, std::vector<LexiconFreeDecoderState>());
+  hyp_.reset();
+  hyp_.extend(1);
 
   /* note: the lm reset itself with :start() */
   hyp_[0].emplace_back(0.0, lm_->start(0), nullptr, sil_);
@@ -28,100 +29,134 @@ void LexiconFreeDecoder::decodeBegin() {
 }
 
 void LexiconFreeDecoder::decodeStep(const float* emissions, int T, int N) {
-  int startFrame = nDecodedFrames_ - nPrunedFrames_;
   // Extend hyp_ buffer
-  if (hyp_.size() < startFrame + T + 2) {
-    for (int i = hyp_.size(); i < startFrame + T + 2; i++) {
-      hyp_.emplace(i, std::vector<LexiconFreeDecoderState>());
-    }
-  }
+  hyp_.extend(nDecodedFrames_ - nPrunedFrames_ + T + 2);
 
-  std::vector<size_t> idx(N);
+  std::vector<int>& idx = tokenIdx_;
+  idx.resize(N);
+  int nTokens = std::min(opt_.beamSizeToken, N);
+  tokenScores_.resize(nTokens);
   // Looping over all the frames
   for (int t = 0; t < T; t++) {
+    const float* frame = emissions + t * N;
     std::iota(idx.begin(), idx.end(), 0);
     if (N > opt_.beamSizeToken) {
       std::partial_sort(
           idx.begin(),
           idx.begin() + opt_.beamSizeToken,
           idx.end(),
-          [&t, &N, &emissions](const size_t& l, const size_t& r) {
-            return emissions[t * N + l] > emissions[t * N + r];
-          });
+          [frame](int l, int r) { return frame[l] > frame[r]; });
+    }
+    for (int r = 0; r < nTokens; r++) {
+      tokenScores_[r] = frame[idx[r]];
     }
+    decodeFrame(idx.data(), tokenScores_.data(), nTokens, N);
+  }
+}
+
+void LexiconFreeDecoder::decodeStepSparse(const SparseEmissions& emissions) {
+  int K = emissions.K;
+  hyp_.extend(nDecodedFrames_ - nPrunedFrames_ + emissions.T + 2);
+  for (int t = 0; t < emissions.T; t++) {
+    decodeFrame(
+        emissions.indices + t * K,
+        emissions.scores + t * K,
+        std::min(opt_.beamSizeToken, K),
+        emissions.N);
+  }
+}
+
+void LexiconFreeDecoder::decodeFrame(
+    const int* tokens,
+    const float* tokenScores,
+    int nTokens,
+    int N) {
+  const int startFrame = nDecodedFrames_ - nPrunedFrames_;
+  candidatesReset(candidatesBestScore_, candidates_, candidatePtrs_);
+  lmQueries_.clear();
+  for (const LexiconFreeDecoderState& prevHyp : hyp_[startFrame]) {
+    const int prevIdx = prevHyp.token;
+
+    for (int r = 0; r < nTokens; ++r) {
+      int n = tokens[r];
+      double amScore = tokenScores[r];
+      if (nDecodedFrames_ > 0 && opt_.criterionType == CriterionType::ASG) {
+        amScore += transitions_[n * N + prevIdx];
+      }
+      double score = prevHyp.score + tokenScores[r];
+      if (n == sil_) {
+        score += opt_.silScore;
+      }
 
-    candidatesReset(candidatesBestScore_, candidates_, candidatePtrs_);
-    for (const LexiconFreeDecoderState& prevHyp : hyp_[startFrame + t]) {
-      const int prevIdx = prevHyp.token;
-
-      for (int r = 0; r < std::min(opt_.beamSizeToken, N); ++r) {
-        int n = idx[r];
-        double amScore = emissions[t * N + n];
-        if (nDecodedFrames_ + t > 0 &&
-            opt_.criterionType == CriterionType::ASG) {
-          amScore += transitions_[n * N + prevIdx];
-        }
-        double score = prevHyp.score + emissions[t * N + n];
-        if (n == sil_) {
-          score += opt_.silScore;
-        }
-
-        if ((opt_.criterionType == CriterionType::ASG && n != prevIdx) ||
-            (opt_.criterionType == CriterionType::CTC && n != blank_ &&
-             (n != prevIdx || prevHyp.prevBlank))) {
-          auto lmStateScorePair = lm_->score(prevHyp.lmState, n);
-          auto lmScore = lmStateScorePair.second;
-
-          candidatesAdd(
-              candidates_,
-              candidatesBestScore_,
-              opt_.beamThreshold,
-              score + opt_.lmWeight * lmScore,
-              lmStateScorePair.first,
-              &prevHyp,
-              n,
-              false, // prevBlank
-              prevHyp.amScore + amScore,
-              prevHyp.lmScore + lmScore);
-        } else if (opt_.criterionType == CriterionType::CTC && n == blank_) {
-          candidatesAdd(
-              candidates_,
-              candidatesBestScore_,
-              opt_.beamThreshold,
-              score,
-              prevHyp.lmState,
-              &prevHyp,
-              n,
-              true, // prevBlank
-              prevHyp.amScore + amScore,
-              prevHyp.lmScore);
-        } else {
-          candidatesAdd(
-              candidates_,
-              candidatesBestScore_,
-              opt_.beamThreshold,
-              score,
-              prevHyp.lmState,
-              &prevHyp,
-              n,
-              false, // prevBlank
-              prevHyp.amScore + amScore,
-              prevHyp.lmScore);
-        }
+      if ((opt_.criterionType == CriterionType::ASG && n != prevIdx) ||
+          (opt_.criterionType == CriterionType::CTC && n != blank_ &&
+           (n != prevIdx || prevHyp.prevBlank))) {
+        candidatesDefer(
+            deferred_,
+            static_cast<int>(lmQueries_.size()),
+            0.0f,
+            0.0,
+            score,
+            nullptr,
+            &prevHyp,
+            n,
+            false, // prevBlank
+            prevHyp.amScore + amScore,
+            prevHyp.lmScore);
+        lmQueries_.emplace_back(prevHyp.lmState, n);
+      } else if (opt_.criterionType == CriterionType::CTC && n == blank_) {
+        candidatesDefer(
+            deferred_,
+            -1,
+            0.0f,
+            0.0,
+            score,
+            prevHyp.lmState,
+            &prevHyp,
+            n,
+            true, // prevBlank
+            prevHyp.amScore + amScore,
+            prevHyp.lmScore);
+      } else {
+        candidatesDefer(
+            deferred_,
+            -1,
+            0.0f,
+            0.0,
+            score,
+            prevHyp.lmState,
+            &prevHyp,
+            n,
+            false, // prevBlank
+            prevHyp.amScore + amScore,
+            prevHyp.lmScore);
       }
     }
+  }
 
-    candidatesStore(
-        candidates_,
-        candidatePtrs_,
-        hyp_[startFrame + t + 1],
-        opt_.beamSize,
-        candidatesBestScore_ - opt_.beamThreshold,
-        opt_.logAdd,
-        false);
-    updateLMCache(lm_, hyp_[startFrame + t + 1]);
+  // Score all the LM queries of the frame at once
+  candidatesAddDeferred(
+      candidates_,
+      candidatesBestScore_,
+      opt_.beamThreshold,
+      opt_.lmWeight,
+      deferred_,
+      lm_->scoreBatch(lmQueries_));
+
+  candidatesStore(
+      candidates_,
+      candidatePtrs_,
+      hyp_[startFrame + 1],
+      opt_.beamSize,
+      candidatesBestScore_ - opt_.beamThreshold,
+      opt_.logAdd,
+      false,
+      opt_.hashMerge ? &mergeTable_ : nullptr);
+  if (!deferLMCacheUpdate_) {
+    updateLMCache(lm_, hyp_[startFrame + 1]);
   }
-  nDecodedFrames_ += T;
+
+  nDecodedFrames_++;
 }
 
 void LexiconFreeDecoder::decodeEnd() {
@@ -153,26 +188,119 @@ void LexiconFreeDecoder::decodeEnd() {
       opt_.beamSize,
       candidatesBestScore_ - opt_.beamThreshold,
       opt_.logAdd,
-      true);
+      true,
+      opt_.hashMerge ? &mergeTable_ : nullptr);
   ++nDecodedFrames_;
 }
 
+void LexiconFreeDecoder::swapStream(
+    DecoderStream<LexiconFreeDecoderState>& stream) {
+  std::swap(hyp_, stream.hyp);
+  std::swap(nDecodedFrames_, stream.nDecodedFrames);
+  std::swap(nPrunedFrames_, stream.nPrunedFrames);
+}
+
+std::vector<std::vector<DecodeResult>> LexiconFreeDecoder::decodeBatch(
+    const std::vector<const float*>& emissions,
+    const std::vector<int>& T,
+    int N) {
+  int batchSize = emissions.size();
+  if (T.size() != batchSize) {
+    throw std::invalid_argument(
+        "[LexiconFreeDecoder] emissions and T should have the same size");
+  }
+  if (streams_.size() < batchSize) {
+    streams_.resize(batchSize);
+  }
+  int maxT = batchSize > 0 ? *std::max_element(T.begin(), T.end()) : 0;
+
+  for (int b = 0; b < batchSize; b++) {
+    swapStream(streams_[b]);
+    decodeBegin();
+    swapStream(streams_[b]);
+  }
+
+  // Step all the utterances frame by frame so that the LM cache is updated
+  // once per frame with the new states of the whole batch
+  deferLMCacheUpdate_ = true;
+  for (int t = 0; t < maxT; t++) {
+    lmStates_.clear();
+    for (int b = 0; b < batchSize; b++) {
+      if (t >= T[b]) {
+        continue;
+      }
+      swapStream(streams_[b]);
+      decodeStep(emissions[b] + t * N, 1, N);
+      for (const auto& hyp : hyp_[nDecodedFrames_ - nPrunedFrames_]) {
+        lmStates_.emplace_back(hyp.lmState);
+      }
+      swapStream(streams_[b]);
+    }
+    lm_->updateCache(lmStates_);
+  }
+  deferLMCacheUpdate_ = false;
+  lmStates_.clear();
+
+  std::vector<std::vector<DecodeResult>> results(batchSize);
+  for (int b = 0; b < batchSize; b++) {
+    swapStream(streams_[b]);
+    decodeEnd();
+    results[b] = getAllFinalHypothesis();
+    swapStream(streams_[b]);
+  }
+  return results;
+}
+
+DecodeResult LexiconFreeDecoder::decodeChunk(
+    const float* emissions,
+    int T,
+    int N,
+    int maxDelay) {
+  decodeStep(emissions, T, N);
+
+  DecodeResult result;
+  int lookBack = releaseCommonHistory(
+      hyp_,
+      nDecodedFrames_ - nPrunedFrames_,
+      maxDelay,
+      ancestorNodes_,
+      result);
+  if (lookBack >= 0) {
+    nPrunedFrames_ = nDecodedFrames_ - lookBack;
+  }
+  return result;
+}
+
+DecodeResult LexiconFreeDecoder::decodeStreamEnd() {
+  decodeEnd();
+
+  // Final hypothesis are sorted by decodeEnd()
+  int finalFrame = nDecodedFrames_ - nPrunedFrames_;
+  if (hyp_[finalFrame].empty()) {
+    return DecodeResult();
+  }
+  DecodeResult result = getHypothesis(&hyp_[finalFrame].front(), finalFrame);
+  result.words.erase(result.words.begin());
+  result.tokens.erase(result.tokens.begin());
+  return result;
+}
+
 std::vector<DecodeResult> LexiconFreeDecoder::getAllFinalHypothesis() const {
   int finalFrame = nDecodedFrames_ - nPrunedFrames_;
-  return getAllHypothesis(hyp_.find(finalFrame)->second, finalFrame);
+  return getAllHypothesis(hyp_[finalFrame], finalFrame);
 }
 
 DecodeResult LexiconFreeDecoder::getBestHypothesis(int lookBack) const {
   int finalFrame = nDecodedFrames_ - nPrunedFrames_;
   const LexiconFreeDecoderState* bestNode =
-      findBestAncestor(hyp_.find(finalFrame)->second, lookBack);
+      findBestAncestor(hyp_[finalFrame], lookBack);
 
   return getHypothesis(bestNode, nDecodedFrames_ - nPrunedFrames_ - lookBack);
 }
 
 int LexiconFreeDecoder::nHypothesis() const {
   int finalFrame = nDecodedFrames_ - nPrunedFrames_;
-  return hyp_.find(finalFrame)->second.size();
+  return hyp_[finalFrame].size();
 }
 
 int LexiconFreeDecoder::nDecodedFramesInBuffer() const {
@@ -187,7 +315,7 @@ void LexiconFreeDecoder::prune(int lookBack) {
   /* (1) Find the last emitted word in the best path */
   int finalFrame = nDecodedFrames_ - nPrunedFrames_;
   const LexiconFreeDecoderState* bestNode =
-      findBestAncestor(hyp_.find(finalFrame)->second, lookBack);
+      findBestAncestor(hyp_[finalFrame], lookBack);
   if (!bestNode) {
     return; // Not enough decoded frames to prune
   }
@@ -24,6 +24,7 @@ struct LexiconFreeDecoderOptions {
   double silScore; // Silence insertion score
   bool logAdd;
   CriterionType criterionType; // CTC or ASG
+  bool hashMerge = false; // If or not use hashing when merging hypothesis
 };
 
 /**
@@ -76,6 +77,13 @@ struct LexiconFreeDecoderState {
     return 0;
   }
 
+  size_t hashNoScoreStates() const {
+    size_t hash = std::hash<const LMState*>()(lmState.get());
+    hashCombine(hash, std::hash<int>()(token));
+    hashCombine(hash, std::hash<bool>()(prevBlank));
+    return hash;
+  }
+
   int getWord() const {
     return -1;
   }
@@ -114,8 +122,32 @@ class LexiconFreeDecoder : public Decoder {
 
   void decodeStep(const float* emissions, int T, int N) override;
 
+  /* Only the given tokens of each frame are expanded */
+  void decodeStepSparse(const SparseEmissions& emissions) override;
+
   void decodeEnd() override;
 
+  std::vector<std::vector<DecodeResult>> decodeBatch(
+      const std::vector<const float*>& emissions,
+      const std::vector<int>& T,
+      int N) override;
+
+  /**
+   * Streaming decoding: consume a T x N chunk of emissions and return the
+   * newly finalized part of the transcription, i.e. the part shared by all the
+   * surviving hypothesis. The history before it is released, so that memory
+   * stays bounded on long streams. If `maxDelay` is non-negative, the
+   * hypothesis leaving the best path more than `maxDelay` frames ago are
+   * discarded so that results are never delayed by more than `maxDelay`
+   * frames. Call decodeBegin() before the first chunk and decodeStreamEnd()
+   * after the last one.
+   */
+  DecodeResult
+  decodeChunk(const float* emissions, int T, int N, int maxDelay = -1);
+
+  /* Finish streaming decoding and return the rest of the best hypothesis */
+  DecodeResult decodeStreamEnd();
+
   int nHypothesis() const;
 
   void prune(int lookBack = 0) override;
@@ -139,6 +171,9 @@ class LexiconFreeDecoder : public Decoder {
   // so instead of moving around objects, we only need to sort pointers
   std::vector<LexiconFreeDecoderState*> candidatePtrs_;
 
+  // Workspace of the hash table used to merge candidates if opt_.hashMerge
+  std::vector<int> mergeTable_;
+
   // Best candidate score of current frame
   double candidatesBestScore_;
 
@@ -149,11 +184,41 @@ class LexiconFreeDecoder : public Decoder {
   int blank_;
 
   // Vector of hypothesis for all the frames so far
-  std::unordered_map<int, std::vector<LexiconFreeDecoderState>> hyp_;
+  HypothesisArena<LexiconFreeDecoderState> hyp_;
 
   // These 2 variables are used for online decoding, for hypothesis pruning
   int nDecodedFrames_; // Total number of decoded frames.
   int nPrunedFrames_; // Total number of pruned frames from hyp_.
+
+  // Utterances decoded by decodeBatch(), swapped in and out of hyp_,
+  // nDecodedFrames_ and nPrunedFrames_ while being stepped
+  std::vector<DecoderStream<LexiconFreeDecoderState>> streams_;
+
+  // If true, decodeStep() doesn't update the LM cache, this is done once
+  // for all the utterances of the batch instead
+  bool deferLMCacheUpdate_{false};
+
+  // Scratch buffers shared by all the decoding steps
+  std::vector<int> tokenIdx_;
+  std::vector<float> tokenScores_;
+  std::vector<LMStatePtr> lmStates_;
+
+  // Candidates and LM queries gathered over a frame, see `LM::scoreBatch()`
+  std::vector<DeferredCandidate<LexiconFreeDecoderState>> deferred_;
+  std::vector<LMQuery> lmQueries_;
+
+  // Workspace to find the history shared by all the hypothesis
+  std::vector<const LexiconFreeDecoderState*> ancestorNodes_;
+
+  void swapStream(DecoderStream<LexiconFreeDecoderState>& stream);
+
+  // Step a frame of the N tokens, expanding the `nTokens` tokens `tokens` of
+  // scores `tokenScores`
+  void decodeFrame(
+      const int* tokens,
+      const float* tokenScores,
+      int nTokens,
+      int N);
 };
 } // namespace text
 } // namespace lib
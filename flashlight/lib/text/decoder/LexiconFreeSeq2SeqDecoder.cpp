@@ -21,15 +21,11 @@ void LexiconFreeSeq2SeqDecoder::decodeStep(
     const float* emissions,
     int T,
     int N) {
-  // Extend hyp_ buffer
-  if (hyp_.size() < maxOutputLength_ + 2) {
-    for (int i = hyp_.size(); i < maxOutputLength_ + 2; i++) {
-      hyp_.emplace(i, std::vector<LexiconFreeSeq2SeqDecoderState>());
-    }
-  }
+  // Recycle hypothesis of the previous call and extend hyp_ buffer
+  hyp_.reset();
+  hyp_.extend(maxOutputLength_ + 2);
 
   // Start from here.
-  hyp_[0].clear();
   hyp_[0].emplace_back(0.0, lm_->start(0), nullptr, -1, nullptr);
 
   // Decode frame by frame
@@ -60,15 +56,17 @@ void LexiconFreeSeq2SeqDecoder::decodeStep(
 
     std::vector<size_t> idx(amScores.back().size());
 
+    lmQueries_.clear();
     // Generate new hypothesis
     for (int hypo = 0, validHypo = 0; hypo < hyp_[t].size(); hypo++) {
       const LexiconFreeSeq2SeqDecoderState& prevHyp = hyp_[t][hypo];
       // Change nothing for completed hypothesis
       if (prevHyp.token == eos_) {
-        candidatesAdd(
-            candidates_,
-            candidatesBestScore_,
-            opt_.beamThreshold,
+        candidatesDefer(
+            deferred_,
+            -1,
+            0.0f,
+            0.0,
             prevHyp.score,
             prevHyp.lmState,
             &prevHyp,
@@ -106,10 +104,11 @@ void LexiconFreeSeq2SeqDecoder::decodeStep(
           auto lmStateScorePair = lm_->finish(prevHyp.lmState);
           auto lmScore = lmStateScorePair.second;
 
-          candidatesAdd(
-              candidates_,
-              candidatesBestScore_,
-              opt_.beamThreshold,
+          candidatesDefer(
+              deferred_,
+              -1,
+              0.0f,
+              0.0,
               prevHyp.score + amScore + opt_.eosScore + opt_.lmWeight * lmScore,
               lmStateScorePair.first,
               &prevHyp,
@@ -118,23 +117,32 @@ void LexiconFreeSeq2SeqDecoder::decodeStep(
               prevHyp.amScore + amScore,
               prevHyp.lmScore + lmScore);
         } else { /* (2) Try normal token */
-          auto lmStateScorePair = lm_->score(prevHyp.lmState, n);
-          auto lmScore = lmStateScorePair.second;
-          candidatesAdd(
-              candidates_,
-              candidatesBestScore_,
-              opt_.beamThreshold,
-              prevHyp.score + amScore + opt_.lmWeight * lmScore,
-              lmStateScorePair.first,
+          candidatesDefer(
+              deferred_,
+              static_cast<int>(lmQueries_.size()),
+              0.0f,
+              0.0,
+              prevHyp.score + amScore,
+              nullptr,
               &prevHyp,
               n,
               outState,
               prevHyp.amScore + amScore,
-              prevHyp.lmScore + lmScore);
+              prevHyp.lmScore);
+          lmQueries_.emplace_back(prevHyp.lmState, n);
         }
       }
       validHypo++;
     }
+    // Score all the LM queries of the step at once
+    candidatesAddDeferred(
+        candidates_,
+        candidatesBestScore_,
+        opt_.beamThreshold,
+        opt_.lmWeight,
+        deferred_,
+        lm_->scoreBatch(lmQueries_));
+
     candidatesStore(
         candidates_,
         candidatePtrs_,
@@ -142,7 +150,8 @@ void LexiconFreeSeq2SeqDecoder::decodeStep(
         opt_.beamSize,
         candidatesBestScore_ - opt_.beamThreshold,
         opt_.logAdd,
-        true);
+        true,
+        opt_.hashMerge ? &mergeTable_ : nullptr);
     updateLMCache(lm_, hyp_[t + 1]);
   } // End of decoding
 
@@ -157,13 +166,13 @@ void LexiconFreeSeq2SeqDecoder::decodeStep(
 
 std::vector<DecodeResult> LexiconFreeSeq2SeqDecoder::getAllFinalHypothesis()
     const {
-  return getAllHypothesis(hyp_.find(maxOutputLength_ + 1)->second, hyp_.size());
+  return getAllHypothesis(hyp_[maxOutputLength_ + 1], hyp_.size());
 }
 
 DecodeResult LexiconFreeSeq2SeqDecoder::getBestHypothesis(
     int /* unused */) const {
   return getHypothesis(
-      hyp_.find(maxOutputLength_ + 1)->second.data(), hyp_.size());
+      hyp_[maxOutputLength_ + 1].data(), hyp_.size());
 }
 
 void LexiconFreeSeq2SeqDecoder::prune(int /* unused */) {
@@ -34,6 +34,7 @@ struct LexiconFreeSeq2SeqDecoderOptions {
   double lmWeight; // Weight of lm
   double eosScore; // Score for inserting an EOS
   bool logAdd; // If or not use logadd when merging hypothesis
+  bool hashMerge = false; // If or not use hashing when merging hypothesis
 };
 
 /**
@@ -79,6 +80,10 @@ struct LexiconFreeSeq2SeqDecoderState {
     return lmState->compare(node->lmState);
   }
 
+  size_t hashNoScoreStates() const {
+    return std::hash<const LMState*>()(lmState.get());
+  }
+
   int getWord() const {
     return -1;
   }
@@ -132,9 +137,17 @@ class LexiconFreeSeq2SeqDecoder : public Decoder {
 
   std::vector<LexiconFreeSeq2SeqDecoderState> candidates_;
   std::vector<LexiconFreeSeq2SeqDecoderState*> candidatePtrs_;
+
+  // Workspace of the hash table used to merge candidates if opt_.hashMerge
+  std::vector<int> mergeTable_;
+
+  // Candidates and LM queries gathered over a step, see `LM::scoreBatch()`
+  std::vector<DeferredCandidate<LexiconFreeSeq2SeqDecoderState>> deferred_;
+  std::vector<LMQuery> lmQueries_;
+
   double candidatesBestScore_;
 
-  std::unordered_map<int, std::vector<LexiconFreeSeq2SeqDecoderState>> hyp_;
+  HypothesisArena<LexiconFreeSeq2SeqDecoderState> hyp_;
 };
 } // namespace text
 } // namespace lib
@@ -20,15 +20,11 @@ namespace lib {
 namespace text {
 
 void LexiconSeq2SeqDecoder::decodeStep(const float* emissions, int T, int N) {
-  // Extend hyp_ buffer
-  if (hyp_.size() < maxOutputLength_ + 2) {
-    for (int i = hyp_.size(); i < maxOutputLength_ + 2; i++) {
-      hyp_.emplace(i, std::vector<LexiconSeq2SeqDecoderState>());
-    }
-  }
+  // Recycle hypothesis of the previous call and extend hyp_ buffer
+  hyp_.reset();
+  hyp_.extend(maxOutputLength_ + 2);
 
   // Start from here.
-  hyp_[0].clear();
   hyp_[0].emplace_back(
       0.0, lm_->start(0), lexicon_->getRoot(), nullptr, -1, -1, nullptr);
 
@@ -65,15 +61,17 @@ void LexiconSeq2SeqDecoder::decodeStep(const float* emissions, int T, int N) {
 
     std::vector<size_t> idx(amScores.back().size());
 
+    lmQueries_.clear();
     // Generate new hypothesis
     for (int hypo = 0, validHypo = 0; hypo < hyp_[t].size(); hypo++) {
       const LexiconSeq2SeqDecoderState& prevHyp = hyp_[t][hypo];
       // Change nothing for completed hypothesis
       if (prevHyp.token == eos_) {
-        candidatesAdd(
-            candidates_,
-            candidatesBestScore_,
-            opt_.beamThreshold,
+        candidatesDefer(
+            deferred_,
+            -1,
+            0.0f,
+            0.0,
             prevHyp.score,
             prevHyp.lmState,
             prevHyp.lex,
@@ -92,7 +90,7 @@ void LexiconSeq2SeqDecoder::decodeStep(const float* emissions, int T, int N) {
         continue;
       }
 
-      const TrieNode* prevLex = prevHyp.lex;
+      const FlatTrieNode* prevLex = prevHyp.lex;
       const float lexMaxScore =
           prevLex == lexicon_->getRoot() ? 0 : prevLex->maxScore;
 
@@ -124,10 +122,11 @@ void LexiconSeq2SeqDecoder::decodeStep(const float* emissions, int T, int N) {
             lmScore = lmStateScorePair.second - lexMaxScore;
           }
 
-          candidatesAdd(
-              candidates_,
-              candidatesBestScore_,
-              opt_.beamThreshold,
+          candidatesDefer(
+              deferred_,
+              -1,
+              0.0f,
+              0.0,
               prevHyp.score + amScore + opt_.eosScore + opt_.lmWeight * lmScore,
               lmState,
               lexicon_->getRoot(),
@@ -141,27 +140,27 @@ void LexiconSeq2SeqDecoder::decodeStep(const float* emissions, int T, int N) {
 
         /* (2) Try normal token */
         if (n != eos_) {
-          auto searchLex = prevLex->children.find(n);
-          if (searchLex != prevLex->children.end()) {
-            auto lex = searchLex->second;
+          const FlatTrieNode* lex = lexicon_->getChild(prevLex, n);
+          if (lex) {
             LMStatePtr lmState;
-            double lmScore;
+            double lmScore = 0.;
+            int tokenQuery = -1;
             if (isLmToken_) {
-              auto lmStateScorePair = lm_->score(prevHyp.lmState, n);
-              lmState = lmStateScorePair.first;
-              lmScore = lmStateScorePair.second;
+              tokenQuery = lmQueries_.size();
+              lmQueries_.emplace_back(prevHyp.lmState, n);
             } else {
               // smearing
               lmState = prevHyp.lmState;
               lmScore = lex->maxScore - lexMaxScore;
             }
-            candidatesAdd(
-                candidates_,
-                candidatesBestScore_,
-                opt_.beamThreshold,
+            candidatesDefer(
+                deferred_,
+                tokenQuery,
+                0.0f,
+                0.0,
                 prevHyp.score + amScore + opt_.lmWeight * lmScore,
                 lmState,
-                lex.get(),
+                lex,
                 &prevHyp,
                 n,
                 -1,
@@ -170,27 +169,31 @@ void LexiconSeq2SeqDecoder::decodeStep(const float* emissions, int T, int N) {
                 prevHyp.lmScore + lmScore);
 
             // If we got a true word
-            if (lex->labels.size() > 0) {
-              for (auto word : lex->labels) {
+            if (lex->nLabels > 0) {
+              const int* labels = lexicon_->getLabels(lex);
+              for (int i = 0; i < lex->nLabels; i++) {
+                int word = labels[i];
+                int query = tokenQuery;
+                float lmOffset = 0;
                 if (!isLmToken_) {
-                  auto lmStateScorePair = lm_->score(prevHyp.lmState, word);
-                  lmState = lmStateScorePair.first;
-                  lmScore = lmStateScorePair.second - lexMaxScore;
+                  query = lmQueries_.size();
+                  lmQueries_.emplace_back(prevHyp.lmState, word);
+                  lmOffset = lexMaxScore;
                 }
-                candidatesAdd(
-                    candidates_,
-                    candidatesBestScore_,
-                    opt_.beamThreshold,
-                    prevHyp.score + amScore + opt_.wordScore +
-                        opt_.lmWeight * lmScore,
-                    lmState,
+                candidatesDefer(
+                    deferred_,
+                    query,
+                    lmOffset,
+                    0.0,
+                    prevHyp.score + amScore + opt_.wordScore,
+                    nullptr,
                     lexicon_->getRoot(),
                     &prevHyp,
                     n,
                     word,
                     outState,
                     prevHyp.amScore + amScore,
-                    prevHyp.lmScore + lmScore);
+                    prevHyp.lmScore);
                 if (isLmToken_) {
                   break;
                 }
@@ -201,6 +204,15 @@ void LexiconSeq2SeqDecoder::decodeStep(const float* emissions, int T, int N) {
       }
       validHypo++;
     }
+    // Score all the LM queries of the step at once
+    candidatesAddDeferred(
+        candidates_,
+        candidatesBestScore_,
+        opt_.beamThreshold,
+        opt_.lmWeight,
+        deferred_,
+        lm_->scoreBatch(lmQueries_));
+
     candidatesStore(
         candidates_,
         candidatePtrs_,
@@ -208,7 +220,8 @@ void LexiconSeq2SeqDecoder::decodeStep(const float* emissions, int T, int N) {
         opt_.beamSize,
         candidatesBestScore_ - opt_.beamThreshold,
         opt_.logAdd,
-        true);
+        true,
+        opt_.hashMerge ? &mergeTable_ : nullptr);
     updateLMCache(lm_, hyp_[t + 1]);
   } // End of decoding
 
@@ -222,12 +235,12 @@ void LexiconSeq2SeqDecoder::decodeStep(const float* emissions, int T, int N) {
 }
 
 std::vector<DecodeResult> LexiconSeq2SeqDecoder::getAllFinalHypothesis() const {
-  return getAllHypothesis(hyp_.find(maxOutputLength_ + 1)->second, hyp_.size());
+  return getAllHypothesis(hyp_[maxOutputLength_ + 1], hyp_.size());
 }
 
 DecodeResult LexiconSeq2SeqDecoder::getBestHypothesis(int /* unused */) const {
   return getHypothesis(
-      hyp_.find(maxOutputLength_ + 1)->second.data(), hyp_.size());
+      hyp_[maxOutputLength_ + 1].data(), hyp_.size());
 }
 
 void LexiconSeq2SeqDecoder::prune(int /* unused */) {
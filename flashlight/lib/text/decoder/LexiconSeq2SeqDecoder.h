@@ -11,6 +11,7 @@
 #include <unordered_map>
 
 #include "flashlight/lib/text/decoder/Decoder.h"
+#include "flashlight/lib/text/decoder/FlatTrie.h"
 #include "flashlight/lib/text/decoder/Trie.h"
 #include "flashlight/lib/text/decoder/lm/LM.h"
 
@@ -36,6 +37,7 @@ struct LexiconSeq2SeqDecoderOptions {
   double wordScore; // Word insertion score
   double eosScore; // Score for inserting an EOS
   bool logAdd; // If or not use logadd when merging hypothesis
+  bool hashMerge = false; // If or not use hashing when merging hypothesis
 };
 
 /**
@@ -45,7 +47,7 @@ struct LexiconSeq2SeqDecoderOptions {
 struct LexiconSeq2SeqDecoderState {
   double score; // Accumulated total score so far
   LMStatePtr lmState; // Language model state
-  const TrieNode* lex;
+  const FlatTrieNode* lex;
   const LexiconSeq2SeqDecoderState* parent; // Parent hypothesis
   int token; // Label of token
   int word;
@@ -57,7 +59,7 @@ struct LexiconSeq2SeqDecoderState {
   LexiconSeq2SeqDecoderState(
       const double score,
       const LMStatePtr& lmState,
-      const TrieNode* lex,
+      const FlatTrieNode* lex,
       const LexiconSeq2SeqDecoderState* parent,
       const int token,
       const int word,
@@ -97,6 +99,13 @@ struct LexiconSeq2SeqDecoderState {
     return 0;
   }
 
+  size_t hashNoScoreStates() const {
+    size_t hash = std::hash<const LMState*>()(lmState.get());
+    hashCombine(hash, std::hash<const FlatTrieNode*>()(lex));
+    hashCombine(hash, std::hash<int>()(token));
+    return hash;
+  }
+
   int getWord() const {
     return word;
   }
@@ -125,6 +134,24 @@ class LexiconSeq2SeqDecoder : public Decoder {
       AMUpdateFunc amUpdateFunc,
       const int maxOutputLength,
       const bool isLmToken)
+      : LexiconSeq2SeqDecoder(
+            std::move(opt),
+            std::make_shared<FlatTrie>(*lexicon),
+            lm,
+            eos,
+            std::move(amUpdateFunc),
+            maxOutputLength,
+            isLmToken) {}
+
+  /* A frozen lexicon can be shared by several decoders */
+  LexiconSeq2SeqDecoder(
+      LexiconSeq2SeqDecoderOptions opt,
+      const FlatTriePtr& lexicon,
+      const LMPtr& lm,
+      const int eos,
+      AMUpdateFunc amUpdateFunc,
+      const int maxOutputLength,
+      const bool isLmToken)
       : opt_(std::move(opt)),
         lm_(lm),
         lexicon_(lexicon),
@@ -146,7 +173,7 @@ class LexiconSeq2SeqDecoder : public Decoder {
  protected:
   LexiconSeq2SeqDecoderOptions opt_;
   LMPtr lm_;
-  TriePtr lexicon_;
+  FlatTriePtr lexicon_;
   int eos_;
   AMUpdateFunc amUpdateFunc_;
   std::vector<int> rawY_;
@@ -156,9 +183,17 @@ class LexiconSeq2SeqDecoder : public Decoder {
 
   std::vector<LexiconSeq2SeqDecoderState> candidates_;
   std::vector<LexiconSeq2SeqDecoderState*> candidatePtrs_;
+
+  // Workspace of the hash table used to merge candidates if opt_.hashMerge
+  std::vector<int> mergeTable_;
+
+  // Candidates and LM queries gathered over a step, see `LM::scoreBatch()`
+  std::vector<DeferredCandidate<LexiconSeq2SeqDecoderState>> deferred_;
+  std::vector<LMQuery> lmQueries_;
+
   double candidatesBestScore_;
 
-  std::unordered_map<int, std::vector<LexiconSeq2SeqDecoderState>> hyp_;
+  HypothesisArena<LexiconSeq2SeqDecoderState> hyp_;
 };
 } // namespace text
 } // namespace lib
@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/lib/text/decoder/MultiConfigLexiconDecoder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace fl {
+namespace lib {
+namespace text {
+
+namespace {
+
+// Serializes the calls to an LM shared by several decoding threads
+class SynchronizedLM : public LM {
+ public:
+  explicit SynchronizedLM(LMPtr lm) : lm_(std::move(lm)) {}
+
+  LMStatePtr start(bool startWithNothing) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lm_->start(startWithNothing);
+  }
+
+  std::pair<LMStatePtr, float> score(
+      const LMStatePtr& state,
+      const int usrTokenIdx) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lm_->score(state, usrTokenIdx);
+  }
+
+  std::vector<std::pair<LMStatePtr, float>> scoreBatch(
+      const std::vector<LMQuery>& queries) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lm_->scoreBatch(queries);
+  }
+
+  std::pair<LMStatePtr, float> finish(const LMStatePtr& state) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lm_->finish(state);
+  }
+
+  void updateCache(std::vector<LMStatePtr> states) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    lm_->updateCache(std::move(states));
+  }
+
+ private:
+  LMPtr lm_;
+  std::mutex mutex_;
+};
+
+} // namespace
+
+MultiConfigLexiconDecoder::MultiConfigLexiconDecoder(
+    std::vector<LexiconDecoderOptions> configs,
+    const FlatTriePtr& lexicon,
+    const LMPtr& lm,
+    const int sil,
+    const int blank,
+    const int unk,
+    const std::vector<float>& transitions,
+    const bool isLmToken,
+    const int nThreads /* = 0 */)
+    : configs_(std::move(configs)),
+      lexicon_(lexicon),
+      lm_(std::make_shared<SynchronizedLM>(lm)),
+      sil_(sil),
+      blank_(blank),
+      unk_(unk),
+      transitions_(transitions),
+      isLmToken_(isLmToken),
+      nThreads_(nThreads) {
+  if (nThreads_ <= 0) {
+    nThreads_ = std::max(1u, std::thread::hardware_concurrency());
+  }
+  if (configs_.empty()) {
+    throw std::invalid_argument(
+        "[MultiConfigLexiconDecoder] at least one configuration is needed");
+  }
+}
+
+std::vector<std::vector<std::vector<DecodeResult>>>
+MultiConfigLexiconDecoder::decodeBatch(
+    const std::vector<const float*>& emissions,
+    const std::vector<int>& T,
+    int N) {
+  int batchSize = emissions.size();
+  if (T.size() != batchSize) {
+    throw std::invalid_argument(
+        "[MultiConfigLexiconDecoder] emissions and T should have the same "
+        "size");
+  }
+  int nConfigs = configs_.size();
+  std::vector<std::vector<std::vector<DecodeResult>>> results(
+      nConfigs, std::vector<std::vector<DecodeResult>>(batchSize));
+  int nTasks = nConfigs * batchSize;
+
+  // Tasks are taken utterance by utterance, so that the configurations
+  // decoding an utterance at the same time look up the same LM states
+  std::atomic<int> nextTask{0};
+  std::mutex errorMutex;
+  std::exception_ptr error;
+  auto work = [&]() {
+    try {
+      // Decoders of the thread, created on first use
+      std::vector<std::unique_ptr<LexiconDecoder>> decoders(nConfigs);
+      for (int task = nextTask++; task < nTasks; task = nextTask++) {
+        int b = task / nConfigs, c = task % nConfigs;
+        if (!decoders[c]) {
+          decoders[c] = std::make_unique<LexiconDecoder>(
+              configs_[c],
+              lexicon_,
+              lm_,
+              sil_,
+              blank_,
+              unk_,
+              transitions_,
+              isLmToken_);
+        }
+        results[c][b] = decoders[c]->decode(emissions[b], T[b], N);
+      }
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(errorMutex);
+      error = std::current_exception();
+      nextTask = nTasks;
+    }
+  };
+
+  int nWorkers = std::min(nThreads_, nTasks);
+  std::vector<std::thread> workers;
+  for (int i = 1; i < nWorkers; i++) {
+    workers.emplace_back(work);
+  }
+  work();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  return results;
+}
+
+} // namespace text
+} // namespace lib
+} // namespace fl
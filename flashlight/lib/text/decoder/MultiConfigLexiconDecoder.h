@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "flashlight/lib/text/decoder/LexiconDecoder.h"
+
+namespace fl {
+namespace lib {
+namespace text {
+
+/**
+ * MultiConfigLexiconDecoder decodes the same emissions with several
+ * LexiconDecoder configurations, e.g. for a grid search of lmWeight, wordScore
+ * and silScore.
+ *
+ * All the configurations share the frozen lexicon and the LM: LM states are
+ * created once for all the configurations, so that lookups in the LM state
+ * tree (and in the score cache of the LM, if any, see `KenLM::setScoreCache`)
+ * made by a configuration are reused by the others. LM calls are serialized,
+ * because LMs are not thread-safe. The LM should not reset shared state in
+ * `start()` (as ConvLM does), unless `nThreads` is 1.
+ *
+ * The (configuration, utterance) decodings are spread over `nThreads` worker
+ * threads, the number of hardware threads if `nThreads` is not positive.
+ */
+class MultiConfigLexiconDecoder {
+ public:
+  MultiConfigLexiconDecoder(
+      std::vector<LexiconDecoderOptions> configs,
+      const FlatTriePtr& lexicon,
+      const LMPtr& lm,
+      const int sil,
+      const int blank,
+      const int unk,
+      const std::vector<float>& transitions,
+      const bool isLmToken,
+      const int nThreads = 0);
+
+  size_t nConfigs() const {
+    return configs_.size();
+  }
+
+  /**
+   * Decodes the `T[b] x N` emissions `emissions[b]` of each utterance with
+   * each configuration. Returns all the final hypothesis of utterance b with
+   * configuration c in `results[c][b]`.
+   */
+  std::vector<std::vector<std::vector<DecodeResult>>> decodeBatch(
+      const std::vector<const float*>& emissions,
+      const std::vector<int>& T,
+      int N);
+
+ private:
+  std::vector<LexiconDecoderOptions> configs_;
+  FlatTriePtr lexicon_;
+  LMPtr lm_;
+  int sil_;
+  int blank_;
+  int unk_;
+  std::vector<float> transitions_;
+  bool isLmToken_;
+  int nThreads_;
+};
+
+} // namespace text
+} // namespace lib
+} // namespace fl
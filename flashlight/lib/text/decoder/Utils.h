@@ -9,6 +9,9 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
 #include <unordered_map>
 #include <vector>
 
@@ -34,6 +37,134 @@ struct DecodeResult {
       : score(0), words(length, -1), tokens(length, -1) {}
 };
 
+/* Convert an IEEE 754 half-precision float, given by its bits, to a float */
+inline float halfToFloat(uint16_t half) {
+  uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+  uint32_t exponent = (half >> 10) & 0x1f;
+  uint32_t mantissa = half & 0x3ff;
+  uint32_t bits;
+  if (exponent == 0x1f) {
+    // Infinity or NaN
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  } else if (exponent != 0) {
+    bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  } else if (mantissa == 0) {
+    bits = sign;
+  } else {
+    // Subnormal: normalize the mantissa
+    exponent = 113;
+    while ((mantissa & 0x400) == 0) {
+      mantissa <<= 1;
+      exponent--;
+    }
+    bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+  }
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+/* Mix `value` into `seed`, same as boost::hash_combine */
+inline void hashCombine(size_t& seed, size_t value) {
+  seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+/* ===================== Hypothesis storage ===================== */
+
+/**
+ * HypothesisArena stores the beam of every frame kept by a decoder. Each frame
+ * owns a slab of states, and slabs are recycled instead of being freed: once
+ * a frame is no longer reachable (after `prune()` or at the beginning of a new
+ * utterance) its states are destroyed but its capacity is kept for the next
+ * frames. Slabs are never reallocated while the frame is referenced as a
+ * parent, since only the storage of the frame being filled can grow.
+ *
+ * As a result, after decoding one utterance at least as long as the current
+ * one, a decoder does not allocate any memory for hypothesis storage.
+ */
+template <class DecoderState>
+class HypothesisArena {
+ public:
+  /* Make sure that frames [0, nFrames) are available */
+  void extend(int nFrames) {
+    while (frames_.size() < nFrames) {
+      frames_.emplace_back();
+    }
+    nActiveFrames_ = std::max(nActiveFrames_, nFrames);
+  }
+
+  /* Drop all the hypothesis while keeping the capacity of the slabs */
+  void reset() {
+    for (int i = 0; i < nActiveFrames_; i++) {
+      frames_[i].clear();
+    }
+    nActiveFrames_ = 0;
+  }
+
+  /* Drop all the hypothesis and free all the slabs */
+  void release() {
+    frames_.clear();
+    frames_.shrink_to_fit();
+    nActiveFrames_ = 0;
+  }
+
+  /* Number of frames currently in use */
+  int size() const {
+    return nActiveFrames_;
+  }
+
+  /* Total number of states that can be stored without allocating */
+  size_t capacity() const {
+    size_t res = 0;
+    for (const auto& frame : frames_) {
+      res += frame.capacity();
+    }
+    return res;
+  }
+
+  std::vector<DecoderState>& operator[](int frame) {
+    return frames_[frame];
+  }
+
+  const std::vector<DecoderState>& operator[](int frame) const {
+    return frames_[frame];
+  }
+
+ private:
+  // Moving a slab (e.g. when `frames_` grows or frames are swapped) doesn't
+  // move the states it holds, so that parent pointers remain valid.
+  std::vector<std::vector<DecoderState>> frames_;
+  int nActiveFrames_{0};
+};
+
+/**
+ * DecoderStream holds the decoding progress of one utterance, so that a
+ * decoder can step several utterances at once in `decodeBatch()` while
+ * sharing its scratch buffers between them.
+ */
+template <class DecoderState>
+struct DecoderStream {
+  HypothesisArena<DecoderState> hyp;
+  int nDecodedFrames{0};
+  int nPrunedFrames{0};
+};
+
+/**
+ * DeferredCandidate is a candidate waiting for the LM score of `query` (an
+ * index in the queries of the frame, -1 if it doesn't need one). Its `state`
+ * holds the scores without the LM contribution, which is added in
+ * `candidatesAddDeferred()`.
+ */
+template <class DecoderState>
+struct DeferredCandidate {
+  DecoderState state;
+  int query;
+  // Subtracted from the LM score (e.g. the smeared score already applied)
+  float lmOffset;
+  // Added to the total score after the LM score
+  double scoreOffset;
+};
+
 /* ===================== Candidate-related operations ===================== */
 
 template <class DecoderState>
@@ -61,28 +192,58 @@ void candidatesAdd(
   }
 }
 
+template <class DecoderState, class... Args>
+void candidatesDefer(
+    std::vector<DeferredCandidate<DecoderState>>& deferred,
+    const int query,
+    const float lmOffset,
+    const double scoreOffset,
+    const double score,
+    const Args&... args) {
+  deferred.push_back(
+      {DecoderState(score, args...), query, lmOffset, scoreOffset});
+}
+
+/**
+ * Complete the deferred candidates of a frame with the LM scores of the
+ * queries of the frame and add them to `candidates`, in their proposal order.
+ */
 template <class DecoderState>
-void candidatesStore(
+void candidatesAddDeferred(
     std::vector<DecoderState>& candidates,
-    std::vector<DecoderState*>& candidatePtrs,
-    std::vector<DecoderState>& outputs,
-    const int beamSize,
-    const double threshold,
-    const bool logAdd,
-    const bool returnSorted) {
-  outputs.clear();
-  if (candidates.empty()) {
-    return;
-  }
-
-  /* 1. Select valid candidates */
-  for (auto& candidate : candidates) {
-    if (candidate.score >= threshold) {
-      candidatePtrs.emplace_back(&candidate);
+    double& candidatesBestScore,
+    const double beamThreshold,
+    const double lmWeight,
+    std::vector<DeferredCandidate<DecoderState>>& deferred,
+    const std::vector<std::pair<LMStatePtr, float>>& lmScores) {
+  for (auto& candidate : deferred) {
+    DecoderState& state = candidate.state;
+    if (candidate.query >= 0) {
+      const auto& lmStateScorePair = lmScores[candidate.query];
+      double lmScore = lmStateScorePair.second - candidate.lmOffset;
+      state.score = state.score + lmWeight * lmScore + candidate.scoreOffset;
+      state.lmScore += lmScore;
+      state.lmState = lmStateScorePair.first;
+    }
+    if (state.score >= candidatesBestScore) {
+      candidatesBestScore = state.score;
+    }
+    if (state.score >= candidatesBestScore - beamThreshold) {
+      candidates.emplace_back(std::move(state));
     }
   }
+  deferred.clear();
+}
 
-  /* 2. Merge candidates */
+/**
+ * Merge candidates with the same state (as defined by `compareNoScoreStates`)
+ * by sorting them: O(n log n). The candidate with the best score of each
+ * group is kept and carries the merged score.
+ */
+template <class DecoderState>
+void candidatesMergeSorted(
+    std::vector<DecoderState*>& candidatePtrs,
+    const bool logAdd) {
   std::sort(
       candidatePtrs.begin(),
       candidatePtrs.end(),
@@ -114,6 +275,96 @@ void candidatesStore(
     }
   }
   candidatePtrs.resize(nHypAfterMerging);
+}
+
+/**
+ * Merge candidates with the same state in a single linear pass, using an
+ * open-addressing hash table keyed by `hashNoScoreStates`. `table` is a
+ * workspace which is resized as needed and can be reused across calls.
+ * As with sorting, the candidate with the best score of each group is kept
+ * and carries the merged score; with `logAdd`, scores are accumulated in
+ * arrival order, so results may differ from the sorted merge by rounding.
+ */
+template <class DecoderState>
+void candidatesMergeHashed(
+    std::vector<DecoderState*>& candidatePtrs,
+    const bool logAdd,
+    std::vector<int>& table) {
+  // Keep the load factor below 0.5
+  size_t tableSize = 16;
+  while (tableSize < 2 * candidatePtrs.size()) {
+    tableSize <<= 1;
+  }
+  const size_t mask = tableSize - 1;
+  table.assign(tableSize, -1);
+
+  int nHypAfterMerging = 0;
+  for (int i = 0; i < candidatePtrs.size(); i++) {
+    DecoderState* candidate = candidatePtrs[i];
+    size_t slot = candidate->hashNoScoreStates() & mask;
+    while (table[slot] >= 0 &&
+           candidatePtrs[table[slot]]->compareNoScoreStates(candidate) != 0) {
+      slot = (slot + 1) & mask;
+    }
+
+    if (table[slot] < 0) {
+      // Distinct candidate
+      table[slot] = nHypAfterMerging;
+      candidatePtrs[nHypAfterMerging] = candidate;
+      nHypAfterMerging++;
+      continue;
+    }
+
+    // Same candidate
+    DecoderState*& merged = candidatePtrs[table[slot]];
+    double maxScore = std::max(merged->score, candidate->score);
+    double minScore = std::min(merged->score, candidate->score);
+    if (candidate->score > merged->score) {
+      merged = candidate;
+    }
+    if (logAdd) {
+      merged->score = maxScore + std::log1p(std::exp(minScore - maxScore));
+    } else {
+      merged->score = maxScore;
+    }
+  }
+  candidatePtrs.resize(nHypAfterMerging);
+}
+
+/**
+ * Select the candidates above `threshold`, merge the ones with identical
+ * states and move the `beamSize` best ones into `outputs`. If `mergeTable` is
+ * given, merging is done with `candidatesMergeHashed` and `mergeTable` is used
+ * as its workspace, otherwise with `candidatesMergeSorted`.
+ */
+template <class DecoderState>
+void candidatesStore(
+    std::vector<DecoderState>& candidates,
+    std::vector<DecoderState*>& candidatePtrs,
+    std::vector<DecoderState>& outputs,
+    const int beamSize,
+    const double threshold,
+    const bool logAdd,
+    const bool returnSorted,
+    std::vector<int>* mergeTable = nullptr) {
+  outputs.clear();
+  if (candidates.empty()) {
+    return;
+  }
+
+  /* 1. Select valid candidates */
+  for (auto& candidate : candidates) {
+    if (candidate.score >= threshold) {
+      candidatePtrs.emplace_back(&candidate);
+    }
+  }
+
+  /* 2. Merge candidates */
+  if (mergeTable) {
+    candidatesMergeHashed(candidatePtrs, logAdd, *mergeTable);
+  } else {
+    candidatesMergeSorted(candidatePtrs, logAdd);
+  }
 
   /* 3. Sort and prune */
   auto compareNodeScore = [](const DecoderState* node1,
@@ -229,10 +480,10 @@ const DecoderState* findBestAncestor(
 
 template <class DecoderState>
 void pruneAndNormalize(
-    std::unordered_map<int, std::vector<DecoderState>>& hypothesis,
+    HypothesisArena<DecoderState>& hypothesis,
     const int startFrame,
     const int lookBack) {
-  /* 1. Move things from back of hypothesis to front. */
+  /* 1. Move things from back of hypothesis to front, recycle the others. */
   for (int i = 0; i < hypothesis.size(); i++) {
     if (i <= lookBack) {
       hypothesis[i].swap(hypothesis[i + startFrame]);
@@ -259,6 +510,120 @@ void pruneAndNormalize(
   }
 }
 
+/**
+ * Find the most recent state shared by the paths of all the hypothesis in
+ * `finalHyps` (the hypothesis of frame `frame` in the buffer), ignoring the
+ * discarded ones with a score of -inf. Return nullptr if the paths only meet
+ * before the first frame in the buffer, otherwise update `frame` to the frame
+ * of the returned state. `nodes` is a workspace.
+ */
+template <class DecoderState>
+const DecoderState* findCommonAncestor(
+    const std::vector<DecoderState>& finalHyps,
+    int& frame,
+    std::vector<const DecoderState*>& nodes) {
+  nodes.clear();
+  for (const DecoderState& hyp : finalHyps) {
+    if (hyp.score > kNegativeInfinity) {
+      nodes.push_back(&hyp);
+    }
+  }
+  if (nodes.empty()) {
+    return nullptr;
+  }
+
+  int n = frame;
+  while (nodes.size() > 1) {
+    for (auto& node : nodes) {
+      node = node->parent;
+      if (!node) {
+        return nullptr;
+      }
+    }
+    std::sort(nodes.begin(), nodes.end());
+    nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+    n--;
+  }
+  frame = n;
+  return nodes.front();
+}
+
+/**
+ * Make the state `lookBack` frames before the best hypothesis of `finalHyps`
+ * a common ancestor of all the hypothesis, by discarding (i.e. setting a
+ * score of -inf to) the ones not descending from it. Return nullptr if the
+ * best path is shorter than `lookBack` frames.
+ */
+template <class DecoderState>
+const DecoderState* forceCommonAncestor(
+    std::vector<DecoderState>& finalHyps,
+    const int lookBack) {
+  if (finalHyps.empty()) {
+    return nullptr;
+  }
+  auto ancestor = [lookBack](const DecoderState* node) {
+    for (int i = 0; node && i < lookBack; i++) {
+      node = node->parent;
+    }
+    return node;
+  };
+
+  const DecoderState* bestNode = &*std::max_element(
+      finalHyps.begin(),
+      finalHyps.end(),
+      [](const DecoderState& lhs, const DecoderState& rhs) {
+        return lhs.score < rhs.score;
+      });
+  const DecoderState* commonAncestor = ancestor(bestNode);
+  if (!commonAncestor) {
+    return nullptr;
+  }
+  for (DecoderState& hyp : finalHyps) {
+    if (ancestor(&hyp) != commonAncestor) {
+      hyp.score = kNegativeInfinity;
+    }
+  }
+  return commonAncestor;
+}
+
+/**
+ * Streaming decoding: release the history shared by all the hypothesis of
+ * `lastFrame`, making their paths start from their common ancestor. If the
+ * paths didn't meet within the `maxDelay` last frames (if non-negative), the
+ * hypothesis not sharing the best path up to `maxDelay` frames ago are
+ * discarded. The newly finalized part of the transcription (after the state
+ * in the first frame, which was returned before) is written into `result`.
+ * Return the number of frames kept after the common ancestor, -1 if nothing
+ * was released.
+ */
+template <class DecoderState>
+int releaseCommonHistory(
+    HypothesisArena<DecoderState>& hypothesis,
+    const int lastFrame,
+    const int maxDelay,
+    std::vector<const DecoderState*>& nodes,
+    DecodeResult& result) {
+  result = DecodeResult();
+  int frame = lastFrame;
+  const DecoderState* commonAncestor =
+      findCommonAncestor(hypothesis[lastFrame], frame, nodes);
+  if (maxDelay >= 0 && (!commonAncestor || frame < lastFrame - maxDelay)) {
+    commonAncestor = forceCommonAncestor(hypothesis[lastFrame], maxDelay);
+    frame = lastFrame - maxDelay;
+  }
+  if (!commonAncestor || frame < 1) {
+    return -1;
+  }
+
+  result = getHypothesis(commonAncestor, frame);
+  result.words.erase(result.words.begin());
+  result.tokens.erase(result.tokens.begin());
+
+  int lookBack = lastFrame - frame;
+  pruneAndNormalize(hypothesis, frame, lookBack);
+  return lookBack;
+}
+
 /* ===================== LM-related operations ===================== */
 
 template <class DecoderState>
@@ -0,0 +1,1051 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/lib/text/decoder/cuda/CudaLexiconDecoder.cuh"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#include <cub/cub.cuh>
+
+#include "flashlight/lib/sequence/criterion/Workspace.h"
+
+using fl::lib::text::FlatTrieNode;
+using fl::lib::text::NgramContext;
+using fl::lib::text::NgramTableView;
+
+namespace {
+
+constexpr int kBlockSize = 128;
+constexpr int kHypBlockSize = 32;
+
+void cudaCheck(cudaError_t err, const char* what) {
+  if (err != cudaSuccess) {
+    throw std::runtime_error(
+        std::string("[CudaLexiconDecoder] ") + what +
+        " failed: " + cudaGetErrorString(err));
+  }
+}
+
+/* A hypothesis of the beam */
+struct Hyp {
+  float score;
+  float amScore;
+  float lmScore;
+  int lex; // Node index in the flat trie, 0 is the root
+  int token;
+  int prevBlank;
+  NgramContext lmContext;
+};
+
+/* A hypothesis proposed for the next frame */
+struct Candidate {
+  Hyp hyp;
+  uint64_t key; // Hash of (LM state, lexicon node, token, prevBlank)
+  int parent; // Index of the parent in the beam
+  int word;
+};
+
+/* What we keep of every hypothesis of every frame, to build DecodeResult */
+struct HistoryEntry {
+  int parent;
+  int token;
+  int word;
+  float score;
+  float amScore;
+  float lmScore;
+};
+
+struct Params {
+  int B; // Batch size
+  int N; // Number of tokens
+  int K; // Beam size
+  int R; // Number of tokens considered at each frame
+  int perToken; // Candidate slots per token (eat token, labels, unk)
+  int perHyp; // Candidate slots per hypothesis
+  int C; // Candidate slots per utterance
+  int H; // Merge table slots per utterance, a power of 2
+  float beamThreshold;
+  float lmWeight;
+  float wordScore;
+  float unkScore;
+  float silScore;
+  int sil;
+  int blank;
+  int unk;
+  int eos;
+  const FlatTrieNode* nodes;
+  const int* labels;
+  NgramTableView lm;
+};
+
+struct WorkspacePtrs {
+  WorkspacePtrs(void* workspace, const Params& p, size_t sortBytes) {
+    fl::lib::seq::Workspace<> ws(workspace);
+    ws.request(&emissions, p.B);
+    ws.request(&T, p.B);
+    ws.request(&tokenOffsets, p.B + 1);
+    ws.request(&candidateOffsets, p.B + 1);
+    ws.request(&frame, p.B, p.N);
+    ws.request(&sortedFrame, p.B, p.N);
+    ws.request(&tokenIds, p.B, p.N);
+    ws.request(&sortedTokens, p.B, p.N);
+    ws.request(&hyps[0], p.B, p.K);
+    ws.request(&hyps[1], p.B, p.K);
+    ws.request(&nHyps, p.B);
+    ws.request(&hasRoot, p.B);
+    ws.request(&candidates, p.B, p.C);
+    ws.request(&candidateScores, p.B, p.C);
+    ws.request(&candidateIds, p.B, p.C);
+    ws.request(&sortedScores, p.B, p.C);
+    ws.request(&sortedIds, p.B, p.C);
+    ws.request(&tableKeys, p.B, p.H);
+    ws.request(&tableValues, p.B, p.H);
+    ws.request(&sortStorage, sortBytes);
+    this->sortBytes = sortBytes;
+    requiredSize = ws.requiredSize();
+  }
+
+  const float** emissions;
+  int* T;
+  int* tokenOffsets;
+  int* candidateOffsets;
+  float* frame;
+  float* sortedFrame;
+  int* tokenIds;
+  int* sortedTokens;
+  Hyp* hyps[2];
+  int* nHyps;
+  int* hasRoot;
+  Candidate* candidates;
+  float* candidateScores;
+  int* candidateIds;
+  float* sortedScores;
+  int* sortedIds;
+  unsigned long long* tableKeys;
+  unsigned long long* tableValues;
+  char* sortStorage;
+  size_t sortBytes;
+  size_t requiredSize;
+};
+
+/* Temporary storage needed by the segmented sorts of tokens and candidates */
+size_t getSortBytes(const Params& p) {
+  size_t tokenBytes = 0, candidateBytes = 0;
+  const int* offsets = nullptr;
+  cub::DeviceSegmentedRadixSort::SortPairsDescending(
+      nullptr,
+      tokenBytes,
+      static_cast<const float*>(nullptr),
+      static_cast<float*>(nullptr),
+      static_cast<const int*>(nullptr),
+      static_cast<int*>(nullptr),
+      p.B * p.N,
+      p.B,
+      offsets,
+      offsets);
+  cub::DeviceSegmentedRadixSort::SortPairsDescending(
+      nullptr,
+      candidateBytes,
+      static_cast<const float*>(nullptr),
+      static_cast<float*>(nullptr),
+      static_cast<const int*>(nullptr),
+      static_cast<int*>(nullptr),
+      p.B * p.C,
+      p.B,
+      offsets,
+      offsets);
+  return std::max(tokenBytes, candidateBytes);
+}
+
+__device__ uint64_t stateKey(const Hyp& hyp) {
+  uint64_t key =
+      fl::lib::text::ngramHash(hyp.lmContext.words, hyp.lmContext.length);
+  key ^= hyp.lmContext.length;
+  uint64_t node = static_cast<uint32_t>(hyp.lex);
+  node = (node << 32) | static_cast<uint32_t>(hyp.token);
+  key ^= node * 0x9e3779b97f4a7c15ULL + (key << 6) + (key >> 2);
+  key ^= (hyp.prevBlank + 1) * 0xc2b2ae3d27d4eb4fULL + (key << 6) + (key >> 2);
+  return key == 0 ? 1 : key;
+}
+
+/* Pack a score and a candidate index so that atomicMax keeps the best score */
+__device__ unsigned long long packScore(float score, int index) {
+  unsigned int bits = __float_as_uint(score);
+  bits = (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+  return (static_cast<unsigned long long>(bits) << 32) |
+      static_cast<unsigned int>(index);
+}
+
+__device__ int findChild(const FlatTrieNode* nodes, int node, int idx) {
+  int lo = nodes[node].firstChild;
+  int hi = lo + nodes[node].nChildren;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (nodes[mid].idx < idx) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return (lo < nodes[node].firstChild + nodes[node].nChildren &&
+          nodes[lo].idx == idx)
+      ? lo
+      : -1;
+}
+
+__device__ void invalidate(const WorkspacePtrs& ws, int i) {
+  ws.candidateScores[i] = -INFINITY;
+  ws.candidateIds[i] = i;
+}
+
+__device__ void propose(
+    const WorkspacePtrs& ws,
+    int i,
+    const Hyp& hyp,
+    int parent,
+    int word) {
+  Candidate& candidate = ws.candidates[i];
+  candidate.hyp = hyp;
+  candidate.key = stateKey(hyp);
+  candidate.parent = parent;
+  candidate.word = word;
+  ws.candidateScores[i] = hyp.score;
+  ws.candidateIds[i] = i;
+}
+
+/*
+ * B thread blocks
+ * 1 thread/block
+ */
+__global__ void initHypothesis(
+    Params p,
+    NgramContext start,
+    Hyp* hyps,
+    WorkspacePtrs ws,
+    HistoryEntry* history) {
+  int b = blockIdx.x;
+  Hyp& hyp = hyps[b * p.K];
+  hyp.score = hyp.amScore = hyp.lmScore = 0;
+  hyp.lex = 0;
+  hyp.token = p.sil;
+  hyp.prevBlank = 0;
+  hyp.lmContext = start;
+  ws.nHyps[b] = 1;
+  ws.hasRoot[b] = 1;
+  history[b * p.K] = {-1, p.sil, -1, 0, 0, 0};
+}
+
+/*
+ * B thread blocks
+ * kBlockSize threads/block
+ */
+__global__ void gatherFrame(Params p, int t, int tEmission, WorkspacePtrs ws) {
+  int b = blockIdx.x;
+  bool active = t < ws.T[b];
+  for (int n = threadIdx.x; n < p.N; n += blockDim.x) {
+    ws.frame[b * p.N + n] =
+        active ? ws.emissions[b][tEmission * p.N + n] : -INFINITY;
+    ws.tokenIds[b * p.N + n] = n;
+  }
+}
+
+/*
+ * B * K thread blocks, one per hypothesis
+ * kHypBlockSize threads/block
+ */
+__global__ void
+proposeCandidates(Params p, int t, const Hyp* hyps, WorkspacePtrs ws) {
+  int b = blockIdx.x / p.K;
+  int k = blockIdx.x % p.K;
+  int base = b * p.C + k * p.perHyp;
+  bool step = t < ws.T[b];
+  bool finish = t == ws.T[b];
+
+  if (k >= ws.nHyps[b] || !(step || finish)) {
+    for (int s = threadIdx.x; s < p.perHyp; s += blockDim.x) {
+      invalidate(ws, base + s);
+    }
+    return;
+  }
+
+  const Hyp& prevHyp = hyps[b * p.K + k];
+  if (finish) {
+    for (int s = threadIdx.x; s < p.perHyp; s += blockDim.x) {
+      if (s == 0 && (!ws.hasRoot[b] || prevHyp.lex == 0)) {
+        Hyp hyp = prevHyp;
+        float lmScore = p.lm.score(prevHyp.lmContext, p.eos, hyp.lmContext);
+        hyp.score += p.lmWeight * lmScore;
+        hyp.lmScore += lmScore;
+        hyp.token = p.sil;
+        hyp.prevBlank = 0;
+        propose(ws, base, hyp, k, -1);
+      } else {
+        invalidate(ws, base + s);
+      }
+    }
+    return;
+  }
+
+  const float* frame = ws.frame + b * p.N;
+  const FlatTrieNode& prevLex = p.nodes[prevHyp.lex];
+  const float lexMaxScore = prevHyp.lex == 0 ? 0 : prevLex.maxScore;
+
+  /* (1) Try children */
+  for (int r = threadIdx.x; r < p.R; r += blockDim.x) {
+    int slot = base + r * p.perToken;
+    int n = ws.sortedTokens[b * p.N + r];
+    int lexIdx = findChild(p.nodes, prevHyp.lex, n);
+    if (lexIdx < 0) {
+      for (int s = 0; s < p.perToken; s++) {
+        invalidate(ws, slot + s);
+      }
+      continue;
+    }
+    const FlatTrieNode& lex = p.nodes[lexIdx];
+    float amScore = frame[n];
+    float score = prevHyp.score + amScore;
+    if (n == p.sil) {
+      score += p.silScore;
+    }
+
+    Hyp hyp;
+    hyp.amScore = prevHyp.amScore + amScore;
+    hyp.token = n;
+    hyp.prevBlank = 0;
+
+    // We eat-up a new token
+    if ((prevHyp.prevBlank || n != prevHyp.token) && lex.nChildren > 0) {
+      float lmScore = lex.maxScore - lexMaxScore;
+      hyp.score = score + p.lmWeight * lmScore;
+      hyp.lmScore = prevHyp.lmScore + lmScore;
+      hyp.lex = lexIdx;
+      hyp.lmContext = prevHyp.lmContext;
+      propose(ws, slot, hyp, k, -1);
+    } else {
+      invalidate(ws, slot);
+    }
+
+    // If we got a true word
+    hyp.lex = 0;
+    for (int i = 0; i < p.perToken - 2; i++) {
+      // Same as in LexiconDecoder, avoid emitting a single token word twice
+      // without a blank in between
+      if (i >= lex.nLabels || (prevHyp.lex == 0 && prevHyp.token == n)) {
+        invalidate(ws, slot + 1 + i);
+        continue;
+      }
+      int label = p.labels[lex.firstLabel + i];
+      float lmScore =
+          p.lm.score(prevHyp.lmContext, label, hyp.lmContext) - lexMaxScore;
+      hyp.score = score + p.lmWeight * lmScore + p.wordScore;
+      hyp.lmScore = prevHyp.lmScore + lmScore;
+      propose(ws, slot + 1 + i, hyp, k, label);
+    }
+
+    // If we got an unknown word
+    if (lex.nLabels == 0 && p.unkScore > -INFINITY) {
+      float lmScore =
+          p.lm.score(prevHyp.lmContext, p.unk, hyp.lmContext) - lexMaxScore;
+      hyp.score = score + p.lmWeight * lmScore + p.unkScore;
+      hyp.lmScore = prevHyp.lmScore + lmScore;
+      propose(ws, slot + p.perToken - 1, hyp, k, p.unk);
+    } else {
+      invalidate(ws, slot + p.perToken - 1);
+    }
+  }
+
+  if (threadIdx.x != 0) {
+    return;
+  }
+  int slot = base + p.R * p.perToken;
+
+  /* (2) Try same lexicon node */
+  if (!prevHyp.prevBlank || prevHyp.lex == 0) {
+    int n = prevHyp.lex == 0 ? p.sil : prevHyp.token;
+    Hyp hyp = prevHyp;
+    hyp.score += frame[n];
+    if (n == p.sil) {
+      hyp.score += p.silScore;
+    }
+    hyp.amScore += frame[n];
+    hyp.token = n;
+    hyp.prevBlank = 0;
+    propose(ws, slot, hyp, k, -1);
+  } else {
+    invalidate(ws, slot);
+  }
+
+  /* (3) Try blank */
+  Hyp hyp = prevHyp;
+  hyp.score += frame[p.blank];
+  hyp.amScore += frame[p.blank];
+  hyp.token = p.blank;
+  hyp.prevBlank = 1;
+  propose(ws, slot + 1, hyp, k, -1);
+}
+
+/*
+ * ceil(B * C / kBlockSize) thread blocks
+ * kBlockSize threads/block
+ */
+__global__ void mergeCandidates(Params p, WorkspacePtrs ws) {
+  int i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i >= p.B * p.C || ws.candidateScores[i] == -INFINITY) {
+    return;
+  }
+  int b = i / p.C;
+  unsigned long long key = ws.candidates[i].key;
+  unsigned long long* keys = ws.tableKeys + b * p.H;
+  for (int h = key & (p.H - 1);; h = (h + 1) & (p.H - 1)) {
+    unsigned long long prev = atomicCAS(&keys[h], 0ULL, key);
+    if (prev == 0 || prev == key) {
+      atomicMax(
+          &ws.tableValues[b * p.H + h],
+          packScore(ws.candidateScores[i], i - b * p.C));
+      return;
+    }
+  }
+}
+
+/*
+ * ceil(B * C / kBlockSize) thread blocks
+ * kBlockSize threads/block
+ */
+__global__ void dropMergedCandidates(Params p, WorkspacePtrs ws) {
+  int i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i >= p.B * p.C || ws.candidateScores[i] == -INFINITY) {
+    return;
+  }
+  int b = i / p.C;
+  unsigned long long key = ws.candidates[i].key;
+  const unsigned long long* keys = ws.tableKeys + b * p.H;
+  for (int h = key & (p.H - 1);; h = (h + 1) & (p.H - 1)) {
+    if (keys[h] == key) {
+      int winner = ws.tableValues[b * p.H + h] & 0xffffffffu;
+      if (winner != i - b * p.C) {
+        ws.candidateScores[i] = -INFINITY;
+      }
+      return;
+    }
+  }
+}
+
+/*
+ * B thread blocks
+ * kBlockSize threads/block
+ */
+__global__ void updateBeam(
+    Params p,
+    int t,
+    const Hyp* hyps,
+    Hyp* nextHyps,
+    WorkspacePtrs ws,
+    HistoryEntry* history) {
+  int b = blockIdx.x;
+  if (t > ws.T[b]) {
+    // Already finished, keep the beam as is
+    for (int k = threadIdx.x; k < ws.nHyps[b]; k += blockDim.x) {
+      nextHyps[b * p.K + k] = hyps[b * p.K + k];
+    }
+    return;
+  }
+
+  const float* scores = ws.sortedScores + b * p.C;
+  const float threshold = scores[0] - p.beamThreshold;
+  auto isKept = [&](int k) {
+    return k < p.K && scores[k] > -INFINITY && scores[k] >= threshold;
+  };
+
+  int hasRoot = 0;
+  for (int k = threadIdx.x; k < p.K; k += blockDim.x) {
+    if (!isKept(k)) {
+      if (k == 0) {
+        ws.nHyps[b] = 0;
+      }
+      continue;
+    }
+    const Candidate& candidate = ws.candidates[ws.sortedIds[b * p.C + k]];
+    const Hyp& hyp = candidate.hyp;
+    nextHyps[b * p.K + k] = hyp;
+    history[b * p.K + k] = {
+        candidate.parent,
+        hyp.token,
+        candidate.word,
+        hyp.score,
+        hyp.amScore,
+        hyp.lmScore};
+    hasRoot |= hyp.lex == 0;
+    if (!isKept(k + 1)) {
+      ws.nHyps[b] = k + 1;
+    }
+  }
+  hasRoot = __syncthreads_or(hasRoot);
+  if (threadIdx.x == 0) {
+    ws.hasRoot[b] = hasRoot;
+  }
+}
+
+} // namespace
+
+namespace fl {
+namespace lib {
+namespace text {
+
+namespace {
+
+Params getParams(
+    const LexiconDecoderOptions& opt,
+    int B,
+    int N,
+    int maxLabels,
+    int sil,
+    int blank,
+    int unk,
+    const FlatTrieNode* nodes,
+    const int* labels,
+    const NgramTable& lm,
+    const NgramTableEntry* ngrams) {
+  Params p;
+  p.B = B;
+  p.N = N;
+  p.K = opt.beamSize;
+  p.R = std::min(opt.beamSizeToken, N);
+  p.perToken = maxLabels + 2;
+  p.perHyp = p.R * p.perToken + 2;
+  p.C = p.K * p.perHyp;
+  p.H = 1;
+  while (p.H < 2 * p.C) {
+    p.H *= 2;
+  }
+  p.beamThreshold = opt.beamThreshold;
+  p.lmWeight = opt.lmWeight;
+  p.wordScore = opt.wordScore;
+  p.unkScore = opt.unkScore;
+  p.silScore = opt.silScore;
+  p.sil = sil;
+  p.blank = blank;
+  p.unk = unk;
+  p.eos = lm.eos();
+  p.nodes = nodes;
+  p.labels = labels;
+  p.lm = lm.view(ngrams);
+  return p;
+}
+
+} // namespace
+
+CudaLexiconDecoder::CudaLexiconDecoder(
+    LexiconDecoderOptions opt,
+    const FlatTriePtr& lexicon,
+    const NgramTablePtr& lm,
+    const int sil,
+    const int blank,
+    const int unk,
+    cudaStream_t stream)
+    : opt_(std::move(opt)),
+      lexicon_(lexicon),
+      lm_(lm),
+      sil_(sil),
+      blank_(blank),
+      unk_(unk),
+      stream_(stream) {
+  if (opt_.criterionType != CriterionType::CTC) {
+    throw std::invalid_argument(
+        "[CudaLexiconDecoder] Only CTC criterion is supported");
+  }
+  if (opt_.logAdd) {
+    throw std::invalid_argument(
+        "[CudaLexiconDecoder] logAdd merging is not supported");
+  }
+  if (opt_.beamSize <= 0 || opt_.beamSizeToken <= 0) {
+    throw std::invalid_argument(
+        "[CudaLexiconDecoder] beamSize and beamSizeToken should be positive");
+  }
+
+  const FlatTrieNode* nodes = lexicon_->getNodes();
+  for (size_t i = 0; i < lexicon_->nNodes(); i++) {
+    maxLabels_ = std::max(maxLabels_, nodes[i].nLabels);
+  }
+  const auto& ngrams = lm_->entries();
+  cudaCheck(
+      cudaMalloc(&nodes_, lexicon_->nNodes() * sizeof(FlatTrieNode)),
+      "cudaMalloc");
+  cudaCheck(
+      cudaMalloc(
+          &labels_, std::max<size_t>(lexicon_->nLabels(), 1) * sizeof(int)),
+      "cudaMalloc");
+  cudaCheck(
+      cudaMalloc(&ngrams_, ngrams.size() * sizeof(NgramTableEntry)),
+      "cudaMalloc");
+  cudaCheck(
+      cudaMemcpy(
+          nodes_,
+          nodes,
+          lexicon_->nNodes() * sizeof(FlatTrieNode),
+          cudaMemcpyHostToDevice),
+      "cudaMemcpy");
+  cudaCheck(
+      cudaMemcpy(
+          labels_,
+          lexicon_->getLabels(),
+          lexicon_->nLabels() * sizeof(int),
+          cudaMemcpyHostToDevice),
+      "cudaMemcpy");
+  cudaCheck(
+      cudaMemcpy(
+          ngrams_,
+          ngrams.data(),
+          ngrams.size() * sizeof(NgramTableEntry),
+          cudaMemcpyHostToDevice),
+      "cudaMemcpy");
+}
+
+CudaLexiconDecoder::~CudaLexiconDecoder() {
+  cudaStreamSynchronize(stream_);
+  cudaFree(nodes_);
+  cudaFree(labels_);
+  cudaFree(ngrams_);
+  cudaFree(workspace_);
+  cudaFree(history_);
+}
+
+void CudaLexiconDecoder::initialize(int batchSize, int N, int nFrames) {
+  Params p = getParams(
+      opt_,
+      batchSize,
+      N,
+      maxLabels_,
+      sil_,
+      blank_,
+      unk_,
+      nodes_,
+      labels_,
+      *lm_,
+      ngrams_);
+  size_t sortBytes = getSortBytes(p);
+  size_t requiredSize = WorkspacePtrs(nullptr, p, sortBytes).requiredSize;
+
+  cudaCheck(cudaStreamSynchronize(stream_), "cudaStreamSynchronize");
+  if (requiredSize > workspaceSize_) {
+    cudaCheck(cudaFree(workspace_), "cudaFree");
+    workspace_ = nullptr;
+    workspaceSize_ = 0;
+    cudaCheck(cudaMalloc(&workspace_, requiredSize), "cudaMalloc");
+    workspaceSize_ = requiredSize;
+  }
+  if (batchSize != batchSize_) {
+    // The layout of the history depends on the batch size
+    cudaCheck(cudaFree(history_), "cudaFree");
+    history_ = nullptr;
+    historyFrames_ = 0;
+  }
+  batchSize_ = batchSize;
+  nTokens_ = N;
+  nFrames_ = 0;
+  swapped_ = false;
+  reserveHistory(nFrames);
+
+  WorkspacePtrs ws(workspace_, p, sortBytes);
+  std::vector<int> tokenOffsets(batchSize + 1);
+  std::vector<int> candidateOffsets(batchSize + 1);
+  for (int b = 0; b <= batchSize; b++) {
+    tokenOffsets[b] = b * p.N;
+    candidateOffsets[b] = b * p.C;
+  }
+  cudaCheck(
+      cudaMemcpyAsync(
+          ws.tokenOffsets,
+          tokenOffsets.data(),
+          tokenOffsets.size() * sizeof(int),
+          cudaMemcpyHostToDevice,
+          stream_),
+      "cudaMemcpyAsync");
+  cudaCheck(
+      cudaMemcpyAsync(
+          ws.candidateOffsets,
+          candidateOffsets.data(),
+          candidateOffsets.size() * sizeof(int),
+          cudaMemcpyHostToDevice,
+          stream_),
+      "cudaMemcpyAsync");
+  initHypothesis<<<batchSize, 1, 0, stream_>>>(
+      p,
+      lm_->start(),
+      ws.hyps[0],
+      ws,
+      static_cast<HistoryEntry*>(history_));
+  cudaCheck(cudaGetLastError(), "initHypothesis");
+  // Wait for the copy of the offsets before releasing them
+  cudaCheck(cudaStreamSynchronize(stream_), "cudaStreamSynchronize");
+  nFrames_ = 1;
+}
+
+void CudaLexiconDecoder::reserveHistory(int nFrames) {
+  if (nFrames <= historyFrames_) {
+    return;
+  }
+  int newFrames = std::max(nFrames, 2 * historyFrames_);
+  size_t frameSize = batchSize_ * opt_.beamSize * sizeof(HistoryEntry);
+  void* history = nullptr;
+  cudaCheck(cudaMalloc(&history, newFrames * frameSize), "cudaMalloc");
+  if (nFrames_ > 0) {
+    cudaCheck(
+        cudaMemcpyAsync(
+            history,
+            history_,
+            nFrames_ * frameSize,
+            cudaMemcpyDeviceToDevice,
+            stream_),
+        "cudaMemcpyAsync");
+  }
+  cudaCheck(cudaStreamSynchronize(stream_), "cudaStreamSynchronize");
+  cudaCheck(cudaFree(history_), "cudaFree");
+  history_ = history;
+  historyFrames_ = newFrames;
+}
+
+void CudaLexiconDecoder::step(int t, int tEmission) {
+  Params p = getParams(
+      opt_,
+      batchSize_,
+      nTokens_,
+      maxLabels_,
+      sil_,
+      blank_,
+      unk_,
+      nodes_,
+      labels_,
+      *lm_,
+      ngrams_);
+  WorkspacePtrs ws(workspace_, p, getSortBytes(p));
+  const Hyp* hyps = ws.hyps[swapped_];
+  Hyp* nextHyps = ws.hyps[!swapped_];
+  HistoryEntry* history = static_cast<HistoryEntry*>(history_) +
+      static_cast<size_t>(t + 1) * p.B * p.K;
+
+  gatherFrame<<<p.B, kBlockSize, 0, stream_>>>(p, t, tEmission, ws);
+  if (p.R < p.N) {
+    cudaCheck(
+        cub::DeviceSegmentedRadixSort::SortPairsDescending(
+            ws.sortStorage,
+            ws.sortBytes,
+            ws.frame,
+            ws.sortedFrame,
+            ws.tokenIds,
+            ws.sortedTokens,
+            p.B * p.N,
+            p.B,
+            ws.tokenOffsets,
+            ws.tokenOffsets + 1,
+            0,
+            sizeof(float) * 8,
+            stream_),
+        "SortPairsDescending");
+  } else {
+    ws.sortedTokens = ws.tokenIds;
+  }
+
+  proposeCandidates<<<p.B * p.K, kHypBlockSize, 0, stream_>>>(p, t, hyps, ws);
+
+  cudaCheck(
+      cudaMemsetAsync(
+          ws.tableKeys,
+          0,
+          static_cast<size_t>(p.B) * p.H * sizeof(unsigned long long),
+          stream_),
+      "cudaMemsetAsync");
+  cudaCheck(
+      cudaMemsetAsync(
+          ws.tableValues,
+          0,
+          static_cast<size_t>(p.B) * p.H * sizeof(unsigned long long),
+          stream_),
+      "cudaMemsetAsync");
+  int nBlocks = (p.B * p.C + kBlockSize - 1) / kBlockSize;
+  mergeCandidates<<<nBlocks, kBlockSize, 0, stream_>>>(p, ws);
+  dropMergedCandidates<<<nBlocks, kBlockSize, 0, stream_>>>(p, ws);
+
+  cudaCheck(
+      cub::DeviceSegmentedRadixSort::SortPairsDescending(
+          ws.sortStorage,
+          ws.sortBytes,
+          ws.candidateScores,
+          ws.sortedScores,
+          ws.candidateIds,
+          ws.sortedIds,
+          p.B * p.C,
+          p.B,
+          ws.candidateOffsets,
+          ws.candidateOffsets + 1,
+          0,
+          sizeof(float) * 8,
+          stream_),
+      "SortPairsDescending");
+
+  updateBeam<<<p.B, kBlockSize, 0, stream_>>>(
+      p, t, hyps, nextHyps, ws, history);
+  cudaCheck(cudaGetLastError(), "step");
+
+  swapped_ = !swapped_;
+  nFrames_ = std::max(nFrames_, t + 2);
+}
+
+void CudaLexiconDecoder::decodeBegin() {
+  nFrames_ = 0;
+  nDecodedFrames_ = 0;
+}
+
+void CudaLexiconDecoder::decodeStep(const float* emissions, int T, int N) {
+  if (nFrames_ == 0) {
+    initialize(1, N, T + 2);
+  } else if (N != nTokens_ || batchSize_ != 1) {
+    throw std::invalid_argument(
+        "[CudaLexiconDecoder] decodeStep called with a different number of "
+        "tokens, or without calling decodeBegin after decodeBatch");
+  }
+  reserveHistory(nDecodedFrames_ + T + 2);
+
+  Params p = getParams(
+      opt_,
+      1,
+      N,
+      maxLabels_,
+      sil_,
+      blank_,
+      unk_,
+      nodes_,
+      labels_,
+      *lm_,
+      ngrams_);
+  WorkspacePtrs ws(workspace_, p, getSortBytes(p));
+  const int maxT = INT_MAX;
+  cudaCheck(
+      cudaMemcpyAsync(
+          ws.emissions,
+          &emissions,
+          sizeof(const float*),
+          cudaMemcpyHostToDevice,
+          stream_),
+      "cudaMemcpyAsync");
+  cudaCheck(
+      cudaMemcpyAsync(
+          ws.T, &maxT, sizeof(int), cudaMemcpyHostToDevice, stream_),
+      "cudaMemcpyAsync");
+  for (int t = 0; t < T; t++) {
+    step(nDecodedFrames_ + t, t);
+  }
+  nDecodedFrames_ += T;
+  // `emissions` and `maxT` are copied from the stack
+  cudaCheck(cudaStreamSynchronize(stream_), "cudaStreamSynchronize");
+}
+
+void CudaLexiconDecoder::decodeEnd() {
+  if (nFrames_ == 0) {
+    throw std::logic_error(
+        "[CudaLexiconDecoder] decodeStep should be called before decodeEnd");
+  }
+  reserveHistory(nDecodedFrames_ + 2);
+  Params p = getParams(
+      opt_,
+      1,
+      nTokens_,
+      maxLabels_,
+      sil_,
+      blank_,
+      unk_,
+      nodes_,
+      labels_,
+      *lm_,
+      ngrams_);
+  WorkspacePtrs ws(workspace_, p, getSortBytes(p));
+  cudaCheck(
+      cudaMemcpyAsync(
+          ws.T,
+          &nDecodedFrames_,
+          sizeof(int),
+          cudaMemcpyHostToDevice,
+          stream_),
+      "cudaMemcpyAsync");
+  step(nDecodedFrames_, 0);
+  cudaCheck(cudaStreamSynchronize(stream_), "cudaStreamSynchronize");
+}
+
+std::vector<std::vector<DecodeResult>> CudaLexiconDecoder::decodeBatch(
+    const std::vector<const float*>& emissions,
+    const std::vector<int>& T,
+    int N) {
+  const int batchSize = emissions.size();
+  if (batchSize == 0) {
+    return {};
+  }
+  const int maxT = *std::max_element(T.begin(), T.end());
+  initialize(batchSize, N, maxT + 2);
+
+  Params p = getParams(
+      opt_,
+      batchSize,
+      N,
+      maxLabels_,
+      sil_,
+      blank_,
+      unk_,
+      nodes_,
+      labels_,
+      *lm_,
+      ngrams_);
+  WorkspacePtrs ws(workspace_, p, getSortBytes(p));
+  cudaCheck(
+      cudaMemcpyAsync(
+          ws.emissions,
+          emissions.data(),
+          batchSize * sizeof(const float*),
+          cudaMemcpyHostToDevice,
+          stream_),
+      "cudaMemcpyAsync");
+  cudaCheck(
+      cudaMemcpyAsync(
+          ws.T,
+          T.data(),
+          batchSize * sizeof(int),
+          cudaMemcpyHostToDevice,
+          stream_),
+      "cudaMemcpyAsync");
+  // The last step scores the end of sentence of the longest utterances
+  for (int t = 0; t <= maxT; t++) {
+    step(t, t);
+  }
+
+  std::vector<int> finalFrames(batchSize);
+  for (int b = 0; b < batchSize; b++) {
+    finalFrames[b] = T[b] + 1;
+  }
+  auto results = getHypothesis(finalFrames);
+  // The stream state can't be resumed after a batch
+  nFrames_ = 0;
+  nDecodedFrames_ = 0;
+  return results;
+}
+
+void CudaLexiconDecoder::prune(int /* lookBack */) {}
+
+int CudaLexiconDecoder::nDecodedFramesInBuffer() const {
+  return nFrames_;
+}
+
+DecodeResult CudaLexiconDecoder::getBestHypothesis(int lookBack) const {
+  if (nFrames_ - 1 - lookBack < 1) {
+    return DecodeResult();
+  }
+  auto results = getHypothesis({nFrames_ - 1}, lookBack, true)[0];
+  return results.empty() ? DecodeResult() : results[0];
+}
+
+std::vector<DecodeResult> CudaLexiconDecoder::getAllFinalHypothesis() const {
+  if (nFrames_ < 2) {
+    return {};
+  }
+  return getHypothesis({nFrames_ - 1})[0];
+}
+
+std::vector<std::vector<DecodeResult>> CudaLexiconDecoder::getHypothesis(
+    const std::vector<int>& finalFrames,
+    int lookBack,
+    bool bestOnly) const {
+  const int B = batchSize_, K = opt_.beamSize;
+  const int nFrames =
+      *std::max_element(finalFrames.begin(), finalFrames.end()) + 1;
+  Params p = getParams(
+      opt_,
+      B,
+      nTokens_,
+      maxLabels_,
+      sil_,
+      blank_,
+      unk_,
+      nodes_,
+      labels_,
+      *lm_,
+      ngrams_);
+  WorkspacePtrs ws(workspace_, p, getSortBytes(p));
+
+  std::vector<int> nHyps(B);
+  std::vector<HistoryEntry> history(static_cast<size_t>(nFrames) * B * K);
+  cudaCheck(
+      cudaMemcpyAsync(
+          nHyps.data(),
+          ws.nHyps,
+          B * sizeof(int),
+          cudaMemcpyDeviceToHost,
+          stream_),
+      "cudaMemcpyAsync");
+  cudaCheck(
+      cudaMemcpyAsync(
+          history.data(),
+          history_,
+          history.size() * sizeof(HistoryEntry),
+          cudaMemcpyDeviceToHost,
+          stream_),
+      "cudaMemcpyAsync");
+  cudaCheck(cudaStreamSynchronize(stream_), "cudaStreamSynchronize");
+
+  auto entry = [&](int frame, int b, int k) -> const HistoryEntry& {
+    return history[(static_cast<size_t>(frame) * B + b) * K + k];
+  };
+
+  std::vector<std::vector<DecodeResult>> results(B);
+  for (int b = 0; b < B; b++) {
+    std::vector<int> ks;
+    for (int k = 0; k < nHyps[b]; k++) {
+      if (!bestOnly) {
+        ks.push_back(k);
+      } else if (
+          ks.empty() ||
+          entry(finalFrames[b], b, k).score >
+              entry(finalFrames[b], b, ks[0]).score) {
+        ks.assign(1, k);
+      }
+    }
+
+    for (int k : ks) {
+      int frame = finalFrames[b];
+      if (bestOnly) {
+        // Same as findBestAncestor(): walk back `lookBack` frames, then until
+        // the hypothesis doesn't end with a partial word
+        const int maxLookBack = lookBack + kLookBackLimit;
+        for (int n = 0; frame > 0 && n < maxLookBack; n++) {
+          int parent = entry(frame, b, k).parent;
+          bool isComplete = entry(frame - 1, b, parent).word >= 0;
+          if (n >= lookBack && isComplete) {
+            break;
+          }
+          k = parent;
+          frame--;
+        }
+      }
+
+      DecodeResult result(frame + 1);
+      result.score = entry(frame, b, k).score;
+      result.amScore = entry(frame, b, k).amScore;
+      result.lmScore = entry(frame, b, k).lmScore;
+      for (int f = frame; f >= 0; f--) {
+        const HistoryEntry& e = entry(f, b, k);
+        result.words[f] = e.word;
+        result.tokens[f] = e.token;
+        k = e.parent;
+      }
+      results[b].push_back(std::move(result));
+    }
+  }
+  return results;
+}
+} // namespace text
+} // namespace lib
+} // namespace fl
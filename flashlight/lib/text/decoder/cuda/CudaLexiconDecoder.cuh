@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cuda_runtime.h>
+
+#include "flashlight/lib/text/decoder/Decoder.h"
+#include "flashlight/lib/text/decoder/FlatTrie.h"
+#include "flashlight/lib/text/decoder/LexiconDecoder.h"
+#include "flashlight/lib/text/decoder/lm/NgramTable.h"
+
+namespace fl {
+namespace lib {
+namespace text {
+
+/**
+ * CudaLexiconDecoder is the GPU counterpart of LexiconDecoder for CTC
+ * emissions: the beam search runs entirely on the device, constrained by a
+ * FlatTrie and fused with a word n-gram LM stored as an NgramTable. Both are
+ * copied to the device once, in the constructor. All the `emissions` pointers
+ * given to the decoder are device pointers, and the work is queued on
+ * `stream`.
+ *
+ * At each frame, every hypothesis of the beam proposes its candidates in a
+ * fixed set of slots (one thread block per hypothesis), candidates with the
+ * same (LM state, lexicon node, token, prevBlank) are merged with a device
+ * hash table keeping the best one, and the `beamSize` best candidates are
+ * selected with a segmented radix sort. `decodeBatch()` steps all the
+ * utterances of the batch at once, one segment per utterance.
+ *
+ * Differences with LexiconDecoder:
+ *  - only CTC is supported, and merged hypothesis keep the max score (no
+ *    `logAdd`);
+ *  - the LM is a word LM, queried once a word is complete;
+ *  - scores are accumulated in single precision;
+ *  - hypothesis history is kept on the device for the whole utterance, so
+ *    `prune()` does nothing.
+ *
+ * The candidate buffers take roughly
+ * `beamSize * beamSizeToken * (maximum number of labels of a trie node + 2)`
+ * slots per utterance.
+ */
+class CudaLexiconDecoder : public Decoder {
+ public:
+  CudaLexiconDecoder(
+      LexiconDecoderOptions opt,
+      const FlatTriePtr& lexicon,
+      const NgramTablePtr& lm,
+      const int sil,
+      const int blank,
+      const int unk,
+      cudaStream_t stream = 0);
+
+  ~CudaLexiconDecoder() override;
+
+  CudaLexiconDecoder(const CudaLexiconDecoder&) = delete;
+  CudaLexiconDecoder& operator=(const CudaLexiconDecoder&) = delete;
+
+  void decodeBegin() override;
+
+  void decodeStep(const float* emissions, int T, int N) override;
+
+  void decodeEnd() override;
+
+  std::vector<std::vector<DecodeResult>> decodeBatch(
+      const std::vector<const float*>& emissions,
+      const std::vector<int>& T,
+      int N) override;
+
+  void prune(int lookBack = 0) override;
+
+  int nDecodedFramesInBuffer() const override;
+
+  DecodeResult getBestHypothesis(int lookBack = 0) const override;
+
+  std::vector<DecodeResult> getAllFinalHypothesis() const override;
+
+ protected:
+  LexiconDecoderOptions opt_;
+  FlatTriePtr lexicon_;
+  NgramTablePtr lm_;
+  int sil_;
+  int blank_;
+  int unk_;
+  cudaStream_t stream_;
+
+  // Device copies of the lexicon and of the LM
+  FlatTrieNode* nodes_{nullptr};
+  int* labels_{nullptr};
+  NgramTableEntry* ngrams_{nullptr};
+  int maxLabels_{0};
+
+  // Device buffers, see `WorkspacePtrs` in CudaLexiconDecoder.cu
+  void* workspace_{nullptr};
+  size_t workspaceSize_{0};
+  int batchSize_{0};
+  int nTokens_{0};
+  bool swapped_{false};
+
+  // Device history of the hypothesis: the parent, token, word and scores of
+  // each hypothesis of each frame
+  void* history_{nullptr};
+  int historyFrames_{0};
+
+  // Number of frames stepped so far (including the final LM scoring)
+  int nFrames_{0};
+
+  // Number of frames decoded so far in the online manner
+  int nDecodedFrames_{0};
+
+  /* Allocate the buffers and set the initial hypothesis of each utterance */
+  void initialize(int batchSize, int N, int nFrames);
+
+  /* Make sure the history can store `nFrames` frames, keeping its content */
+  void reserveHistory(int nFrames);
+
+  /**
+   * Step all the utterances of the batch over frame `t`: utterance b reads
+   * the `tEmission`-th frame of its emissions if `t < T[b]`, is scored with
+   * the end of sentence if `t == T[b]` and is left unchanged otherwise.
+   */
+  void step(int t, int tEmission);
+
+  /* Read back the hypothesis of each utterance, `finalFrames[b]` frames */
+  std::vector<std::vector<DecodeResult>> getHypothesis(
+      const std::vector<int>& finalFrames,
+      int lookBack = 0,
+      bool bestOnly = false) const;
+};
+} // namespace text
+} // namespace lib
+} // namespace fl
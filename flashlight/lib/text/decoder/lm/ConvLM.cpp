@@ -55,6 +55,23 @@ ConvLM::ConvLM(
   batchedTokens_.resize(beamSize_ * maxHistorySize_);
 }
 
+ConvLM::ConvLM(
+    const ConvLmIncrementalScoreFunc& incrementalScoreFunc,
+    const std::string& tokenVocabPath,
+    const Dictionary& usrTknDict,
+    int lmMemory,
+    int beamSize)
+    // The states keep their last token only
+    : ConvLM(
+          GetConvLmScoreFunc(),
+          tokenVocabPath,
+          usrTknDict,
+          lmMemory,
+          beamSize,
+          1) {
+  incrementalScoreFunc_ = incrementalScoreFunc;
+}
+
 LMStatePtr ConvLM::start(bool startWithNothing) {
   cacheIndices_.clear();
   auto outState = std::make_shared<ConvLMState>(1);
@@ -115,11 +132,16 @@ std::pair<LMStatePtr, float> ConvLM::scoreWithLmIdx(
     int newIdx = cacheIndices_.size();
     cacheIndices_[rawInState] = newIdx;
 
-    std::vector<int> lastTokenPositions = {rawInState->length - 1};
-    cache_[newIdx] =
-        getConvLmScoreFunc_(rawInState->tokens, lastTokenPositions, -1, 1);
+    if (incrementalScoreFunc_) {
+      cache_[newIdx] = scoreIncremental({rawInState});
+    } else {
+      std::vector<int> lastTokenPositions = {rawInState->length - 1};
+      cache_[newIdx] =
+          getConvLmScoreFunc_(rawInState->tokens, lastTokenPositions, -1, 1);
+    }
     score = cache_[newIdx][tokenIdx];
   }
+  outState->networkStateIn = rawInState->networkState;
   if (std::isnan(score) || !std::isfinite(score)) {
     throw std::runtime_error(
         "[ConvLM] Bad scoring from ConvLM: " + std::to_string(score));
@@ -127,6 +149,24 @@ std::pair<LMStatePtr, float> ConvLM::scoreWithLmIdx(
   return std::make_pair(std::move(outState), score);
 }
 
+std::vector<float> ConvLM::scoreIncremental(
+    const std::vector<ConvLMState*>& states) {
+  std::vector<int> tokens;
+  std::vector<std::shared_ptr<void>> networkStates;
+  for (auto state : states) {
+    tokens.push_back(state->tokens[state->length - 1]);
+    networkStates.push_back(state->networkStateIn);
+  }
+  auto scores = incrementalScoreFunc_(tokens, networkStates);
+  if (networkStates.size() != states.size()) {
+    throw std::logic_error("[ConvLM] Incorrect number of network states");
+  }
+  for (size_t i = 0; i < states.size(); ++i) {
+    states[i]->networkState = networkStates[i];
+  }
+  return scores;
+}
+
 std::pair<LMStatePtr, float> ConvLM::score(
     const LMStatePtr& state,
     const int usrTokenIdx) {
@@ -187,6 +227,7 @@ void ConvLM::updateCache(std::vector<LMStatePtr> states) {
     // Select batch
     int nBatchStates = 0;
     std::vector<int> lastTokenPositions;
+    std::vector<ConvLMState*> batchStates;
     for (int i = batchStart; (nBatchStates < maxBatchSize) && (i < nStates);
          i++, batchStart++) {
       auto rawState = std::static_pointer_cast<ConvLMState>(states[i]).get();
@@ -204,6 +245,7 @@ void ConvLM::updateCache(std::vector<LMStatePtr> states) {
         batchedTokens_[start + j] = vocab_.getIndex(kPadToken);
       }
       lastTokenPositions.push_back(rawState->length - 1);
+      batchStates.push_back(rawState);
       ++nBatchStates;
     }
     if (nBatchStates == 0 && batchStart >= nStates) {
@@ -217,8 +259,10 @@ void ConvLM::updateCache(std::vector<LMStatePtr> states) {
           "[ConvLM] Invalid batch: [" + std::to_string(nBatchStates) + " x " +
           std::to_string(longestHistory) + "]");
     }
-    auto batchedProb = getConvLmScoreFunc_(
-        batchedTokens_, lastTokenPositions, longestHistory, nBatchStates);
+    auto batchedProb = incrementalScoreFunc_
+        ? scoreIncremental(batchStates)
+        : getConvLmScoreFunc_(
+              batchedTokens_, lastTokenPositions, longestHistory, nBatchStates);
 
     if (batchedProb.size() != vocabSize_ * nBatchStates) {
       throw std::logic_error(
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <functional>
+#include <memory>
 
 #include "flashlight/lib/text/decoder/lm/LM.h"
 #include "flashlight/lib/text/dictionary/Defines.h"
@@ -20,9 +21,23 @@ namespace text {
 using GetConvLmScoreFunc = std::function<std::vector<
     float>(const std::vector<int>&, const std::vector<int>&, int, int)>;
 
+/**
+ * Incremental scoring of a batch of states: forwards the last token of each
+ * state (first argument) from the cached state of the network after its
+ * previous tokens (second argument, null at the start of a sentence), which
+ * it replaces with the state after the token. Returns the scores of the next
+ * token (batch x vocabulary).
+ */
+using ConvLmIncrementalScoreFunc = std::function<std::vector<float>(
+    const std::vector<int>&,
+    std::vector<std::shared_ptr<void>>&)>;
+
 struct ConvLMState : LMState {
   std::vector<int> tokens;
   int length;
+  // Incremental mode: the network state before the last token, and after it
+  // once the state is scored
+  std::shared_ptr<void> networkStateIn, networkState;
 
   ConvLMState() : length(0) {}
   explicit ConvLMState(int size)
@@ -39,6 +54,19 @@ class ConvLM : public LM {
       int beamSize = 2500,
       int historySize = 49);
 
+  /**
+   * Incremental mode: the network is forwarded on the new token of each state
+   * only, from the cached state of its convolutions, so that the cost doesn't
+   * depend on the history. The context of the scores is the receptive field
+   * of the network rather than a window of tokens.
+   */
+  ConvLM(
+      const ConvLmIncrementalScoreFunc& incrementalScoreFunc,
+      const std::string& tokenVocabPath,
+      const Dictionary& usrTknDict,
+      int lmMemory = 10000,
+      int beamSize = 2500);
+
   LMStatePtr start(bool startWithNothing) override;
 
   std::pair<LMStatePtr, float> score(
@@ -60,6 +88,7 @@ class ConvLM : public LM {
 
   Dictionary vocab_;
   GetConvLmScoreFunc getConvLmScoreFunc_;
+  ConvLmIncrementalScoreFunc incrementalScoreFunc_;
 
   int vocabSize_;
   int maxHistorySize_;
@@ -67,6 +96,9 @@ class ConvLM : public LM {
   std::pair<LMStatePtr, float> scoreWithLmIdx(
       const LMStatePtr& state,
       const int tokenIdx);
+
+  // Scores states in incremental mode, and sets their network states
+  std::vector<float> scoreIncremental(const std::vector<ConvLMState*>& states);
 };
 } // namespace text
 } // namespace lib
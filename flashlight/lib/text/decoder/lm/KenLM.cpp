@@ -7,7 +7,15 @@
 
 #include "flashlight/lib/text/decoder/lm/KenLM.h"
 
+#include <map>
+#include <mutex>
 #include <stdexcept>
+#include <utility>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #include <kenlm/lm/model.hh>
 
@@ -15,13 +23,55 @@ namespace fl {
 namespace lib {
 namespace text {
 
+namespace {
+
+using ModelKey = std::pair<std::string, KenLMLoadMethod>;
+
+// The models loaded in the process, held by their KenLM instances
+std::mutex modelsMutex;
+std::map<ModelKey, std::weak_ptr<lm::base::Model>> models;
+
+util::LoadMethod toKenLoadMethod(KenLMLoadMethod loadMethod) {
+  switch (loadMethod) {
+    case KenLMLoadMethod::Lazy:
+      return util::LAZY;
+    case KenLMLoadMethod::PopulateOrLazy:
+      return util::POPULATE_OR_LAZY;
+    case KenLMLoadMethod::PopulateOrRead:
+      return util::POPULATE_OR_READ;
+    case KenLMLoadMethod::Read:
+      return util::READ;
+    case KenLMLoadMethod::ParallelRead:
+      return util::PARALLEL_READ;
+  }
+  throw std::invalid_argument("[KenLM] Invalid load method");
+}
+
+// Ask the kernel to read ahead the first `nBytes` of the file into the page
+// cache, without waiting for it
+void prefetch(const std::string& path, size_t nBytes) {
+#ifndef _WIN32
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("[KenLM] Can't open " + path + " to prefetch it");
+  }
+  posix_fadvise(fd, 0, nBytes, POSIX_FADV_WILLNEED);
+  close(fd);
+#endif
+}
+
+} // namespace
+
 KenLMState::KenLMState() : ken_(std::make_unique<lm::ngram::State>()) {}
 
-KenLM::KenLM(const std::string& path, const Dictionary& usrTknDict) {
+KenLM::KenLM(
+    const std::string& path,
+    const Dictionary& usrTknDict,
+    const KenLMOptions& opt) {
   // Load LM
-  model_.reset(lm::ngram::LoadVirtual(path.c_str()));
-  if (!model_) {
-    throw std::runtime_error("[KenLM] LM loading failed.");
+  model_ = loadModel(path, opt.loadMethod);
+  if (opt.prefetchBytes > 0) {
+    prefetch(path, opt.prefetchBytes);
   }
   vocab_ = &model_->BaseVocabulary();
   if (!vocab_) {
@@ -57,18 +107,74 @@ std::pair<LMStatePtr, float> KenLM::score(
   }
   auto inState = std::static_pointer_cast<KenLMState>(state);
   auto outState = inState->child<KenLMState>(usrTokenIdx);
-  float score = model_->BaseScore(
-      inState->ken(), usrToLmIdxMap_[usrTokenIdx], outState->ken());
+  float score =
+      baseScore(inState.get(), usrToLmIdxMap_[usrTokenIdx], outState.get());
   return std::make_pair(std::move(outState), score);
 }
 
 std::pair<LMStatePtr, float> KenLM::finish(const LMStatePtr& state) {
   auto inState = std::static_pointer_cast<KenLMState>(state);
   auto outState = inState->child<KenLMState>(-1);
-  float score =
-      model_->BaseScore(inState->ken(), vocab_->EndSentence(), outState->ken());
+  float score = baseScore(inState.get(), vocab_->EndSentence(), outState.get());
   return std::make_pair(std::move(outState), score);
 }
+
+LMScoreCachePtr KenLM::createScoreCache(size_t capacity) {
+  return std::make_shared<LMScoreCache>(capacity, sizeof(lm::ngram::State));
+}
+
+void KenLM::setScoreCache(LMScoreCachePtr cache) {
+  if (cache && cache->stateSize() != sizeof(lm::ngram::State)) {
+    throw std::invalid_argument(
+        "[KenLM] Invalid score cache, use KenLM::createScoreCache()");
+  }
+  cache_ = std::move(cache);
+}
+
+size_t KenLM::nSharedModels() {
+  std::lock_guard<std::mutex> lock(modelsMutex);
+  size_t nModels = 0;
+  for (const auto& model : models) {
+    nModels += model.second.expired() ? 0 : 1;
+  }
+  return nModels;
+}
+
+std::shared_ptr<lm::base::Model> KenLM::loadModel(
+    const std::string& path,
+    KenLMLoadMethod loadMethod) {
+  std::lock_guard<std::mutex> lock(modelsMutex);
+  auto& sharedModel = models[ModelKey(path, loadMethod)];
+  auto model = sharedModel.lock();
+  if (model) {
+    return model;
+  }
+  lm::ngram::Config config;
+  config.load_method = toKenLoadMethod(loadMethod);
+  model.reset(lm::ngram::LoadVirtual(path.c_str(), config));
+  if (!model) {
+    throw std::runtime_error("[KenLM] LM loading failed.");
+  }
+  sharedModel = model;
+  return model;
+}
+
+float KenLM::baseScore(
+    KenLMState* inState,
+    int lmTokenIdx,
+    KenLMState* outState) {
+  if (!cache_) {
+    return model_->BaseScore(inState->ken(), lmTokenIdx, outState->ken());
+  }
+
+  float score;
+  uint64_t contextHash = lm::ngram::hash_value(*inState->ken());
+  if (!cache_->find(contextHash, lmTokenIdx, score, outState->ken())) {
+    score = model_->BaseScore(inState->ken(), lmTokenIdx, outState->ken());
+    cache_->insert(contextHash, lmTokenIdx, score, outState->ken());
+  }
+  return score;
+}
 } // namespace text
 } // namespace lib
 } // namespace fl
@@ -8,8 +8,10 @@
 #pragma once
 
 #include <memory>
+#include <string>
 
 #include "flashlight/lib/text/decoder/lm/LM.h"
+#include "flashlight/lib/text/decoder/lm/LMScoreCache.h"
 #include "flashlight/lib/text/dictionary/Dictionary.h"
 
 // Forward declarations to avoid including KenLM headers
@@ -44,12 +46,42 @@ struct KenLMState : LMState {
   }
 };
 
+/**
+ * How the model file is loaded, same as util::LoadMethod of KenLM. Binary
+ * models loaded with mmap (all but `Read` and `ParallelRead`) are served from
+ * the page cache, which all the processes of a host share, while ARPA models
+ * are always built in the memory of the process.
+ */
+enum class KenLMLoadMethod {
+  Lazy, // mmap, pages are read from the file when first hit
+  PopulateOrLazy, // mmap and read the whole file upfront if possible
+  PopulateOrRead, // same, copying the file to memory if mmap can't populate
+  Read, // copy the file to memory
+  ParallelRead, // same, with several threads
+};
+
+struct KenLMOptions {
+  KenLMLoadMethod loadMethod = KenLMLoadMethod::PopulateOrRead;
+  // Bytes of the head of the file to read ahead after loading. The vocabulary
+  // and the lowest order tables, the hottest ones, come first in binary
+  // models: with `Lazy`, prefetching them avoids faulting on every new page
+  // of the first queries without reading the whole file.
+  size_t prefetchBytes = 0;
+};
+
 /**
  * KenLM extends LM by using the toolkit https://kheafield.com/code/kenlm/.
+ *
+ * Models are shared: all the KenLM instances of a process loaded from the
+ * same path with the same load method serve from a single model, which is
+ * released with the last of them.
  */
 class KenLM : public LM {
  public:
-  KenLM(const std::string& path, const Dictionary& usrTknDict);
+  KenLM(
+      const std::string& path,
+      const Dictionary& usrTknDict,
+      const KenLMOptions& opt = KenLMOptions());
 
   LMStatePtr start(bool startWithNothing) override;
 
@@ -59,9 +91,33 @@ class KenLM : public LM {
 
   std::pair<LMStatePtr, float> finish(const LMStatePtr& state) override;
 
+  /**
+   * Create a score cache holding up to `capacity` scores, which can be set to
+   * several KenLM instances loaded from the same model file.
+   */
+  static LMScoreCachePtr createScoreCache(size_t capacity);
+
+  /* Look up scores in `cache` before querying the model, nullptr to disable */
+  void setScoreCache(LMScoreCachePtr cache);
+
+  LMScoreCachePtr getScoreCache() const {
+    return cache_;
+  }
+
+  /* Number of distinct models currently loaded in the process */
+  static size_t nSharedModels();
+
  private:
   std::shared_ptr<lm::base::Model> model_;
   const lm::base::Vocabulary* vocab_;
+  LMScoreCachePtr cache_;
+
+  float baseScore(KenLMState* inState, int lmTokenIdx, KenLMState* outState);
+
+  /* The model of `path`, loaded unless another instance holds it */
+  static std::shared_ptr<lm::base::Model> loadModel(
+      const std::string& path,
+      KenLMLoadMethod loadMethod);
 };
 
 using KenLMPtr = std::shared_ptr<KenLM>;
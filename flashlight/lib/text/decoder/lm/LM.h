@@ -8,6 +8,7 @@
 #pragma once
 
 #include <cstring>
+#include <future>
 #include <memory>
 #include <stdexcept>
 #include <unordered_map>
@@ -54,6 +55,11 @@ struct LMState {
  */
 using LMStatePtr = std::shared_ptr<LMState>;
 
+/**
+ * LMQuery is a (language model state, user token index) pair to be scored.
+ */
+using LMQuery = std::pair<LMStatePtr, int>;
+
 /**
  * LM is a thin wrapper for laguage models. We abstrct several common methods
  * here which can be shared for KenLM, ConvLM, RNNLM, etc.
@@ -71,6 +77,35 @@ class LM {
       const LMStatePtr& state,
       const int usrTokenIdx) = 0;
 
+  /**
+   * Query the language model for a batch of (state, token) pairs, return the
+   * new states and scores in the same order. Decoders gather all the queries
+   * of a frame before calling it, so that LMs running a neural network can
+   * score them in a single forward pass. Default to calling `score()` on each
+   * query.
+   */
+  virtual std::vector<std::pair<LMStatePtr, float>> scoreBatch(
+      const std::vector<LMQuery>& queries) {
+    std::vector<std::pair<LMStatePtr, float>> results;
+    results.reserve(queries.size());
+    for (const auto& query : queries) {
+      results.emplace_back(score(query.first, query.second));
+    }
+    return results;
+  }
+
+  /**
+   * Asynchronous version of `scoreBatch()`. LMs are not thread-safe: no other
+   * method of the LM should be called until the future is resolved.
+   */
+  virtual std::future<std::vector<std::pair<LMStatePtr, float>>>
+  scoreBatchAsync(std::vector<LMQuery> queries) {
+    return std::async(
+        std::launch::async, [this, queries = std::move(queries)]() {
+          return scoreBatch(queries);
+        });
+  }
+
   /* Query the language model and finish decoding. */
   virtual std::pair<LMStatePtr, float> finish(const LMStatePtr& state) = 0;
 
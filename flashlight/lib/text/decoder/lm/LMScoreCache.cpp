@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/lib/text/decoder/lm/LMScoreCache.h"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace fl {
+namespace lib {
+namespace text {
+
+LMScoreCache::LMScoreCache(size_t capacity, size_t stateSize, int nShards)
+    : capacity_(capacity), stateSize_(stateSize) {
+  if (capacity == 0 || nShards <= 0) {
+    throw std::invalid_argument(
+        "[LMScoreCache] capacity and nShards should be positive");
+  }
+  if (nShards > capacity) {
+    nShards = capacity;
+  }
+  shardCapacity_ = capacity / nShards;
+  capacity_ = shardCapacity_ * nShards;
+  for (int i = 0; i < nShards; i++) {
+    shards_.emplace_back(std::make_unique<Shard>());
+    shards_.back()->index.reserve(shardCapacity_);
+  }
+}
+
+LMScoreCache::Shard& LMScoreCache::shard(const Key& key) {
+  // The low bits of the hash are used by the shard's hash table
+  return *shards_[(KeyHash()(key) >> 32) % shards_.size()];
+}
+
+bool LMScoreCache::find(
+    uint64_t contextHash,
+    int token,
+    float& score,
+    void* outState) {
+  Key key(contextHash, token);
+  Shard& s = shard(key);
+  {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto it = s.index.find(key);
+    if (it != s.index.end()) {
+      size_t slot = it->second;
+      s.referenced[slot] = true;
+      score = s.scores[slot];
+      std::memcpy(outState, s.states.data() + slot * stateSize_, stateSize_);
+      nHits_++;
+      return true;
+    }
+  }
+  nMisses_++;
+  return false;
+}
+
+void LMScoreCache::insert(
+    uint64_t contextHash,
+    int token,
+    float score,
+    const void* outState) {
+  Key key(contextHash, token);
+  Shard& s = shard(key);
+  std::lock_guard<std::mutex> lock(s.mutex);
+  if (s.index.find(key) != s.index.end()) {
+    // Inserted by another thread in the meantime
+    return;
+  }
+
+  size_t slot;
+  if (s.keys.size() < shardCapacity_) {
+    slot = s.keys.size();
+    s.keys.push_back(key);
+    s.scores.push_back(score);
+    s.states.resize(s.states.size() + stateSize_);
+    s.referenced.push_back(false);
+  } else {
+    // CLOCK: give a second chance to the entries used since the last sweep
+    while (s.referenced[s.hand]) {
+      s.referenced[s.hand] = false;
+      s.hand = (s.hand + 1) % shardCapacity_;
+    }
+    slot = s.hand;
+    s.hand = (s.hand + 1) % shardCapacity_;
+    s.index.erase(s.keys[slot]);
+    s.keys[slot] = key;
+    s.scores[slot] = score;
+  }
+  std::memcpy(s.states.data() + slot * stateSize_, outState, stateSize_);
+  s.index[key] = slot;
+}
+
+size_t LMScoreCache::size() const {
+  size_t size = 0;
+  for (const auto& s : shards_) {
+    std::lock_guard<std::mutex> lock(s->mutex);
+    size += s->keys.size();
+  }
+  return size;
+}
+
+void LMScoreCache::resetCounters() {
+  nHits_ = 0;
+  nMisses_ = 0;
+}
+} // namespace text
+} // namespace lib
+} // namespace fl
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace fl {
+namespace lib {
+namespace text {
+
+/**
+ * LMScoreCache is a thread-safe n-gram score cache of bounded size, which can
+ * be shared by all the decoder threads of a process. An entry maps a (context
+ * hash, LM token) pair to the score of the token and to the state following
+ * it, stored as `stateSize` raw bytes so that any LM with a fixed size POD
+ * state (e.g. KenLM) can use it. Two different contexts with the same 64-bit
+ * hash are considered identical.
+ *
+ * The cache holds at most `capacity` entries, evicted with the CLOCK
+ * algorithm (an approximation of LRU). It is split in shards, each with its
+ * own lock, to limit contention between threads.
+ */
+class LMScoreCache {
+ public:
+  LMScoreCache(size_t capacity, size_t stateSize, int nShards = 16);
+
+  /**
+   * Look up (contextHash, token). On a hit, return true and copy the cached
+   * score and state into `score` and `outState`.
+   */
+  bool find(uint64_t contextHash, int token, float& score, void* outState);
+
+  /* Insert an entry, possibly evicting another one */
+  void insert(
+      uint64_t contextHash,
+      int token,
+      float score,
+      const void* outState);
+
+  size_t capacity() const {
+    return capacity_;
+  }
+
+  size_t stateSize() const {
+    return stateSize_;
+  }
+
+  /* Number of entries currently in the cache */
+  size_t size() const;
+
+  uint64_t nHits() const {
+    return nHits_;
+  }
+
+  uint64_t nMisses() const {
+    return nMisses_;
+  }
+
+  void resetCounters();
+
+ private:
+  using Key = std::pair<uint64_t, int>;
+
+  struct KeyHash {
+    size_t operator()(const Key& key) const {
+      return key.first ^
+          (static_cast<uint64_t>(key.second) * 0x9e3779b97f4a7c15);
+    }
+  };
+
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_map<Key, size_t, KeyHash> index;
+    std::vector<Key> keys;
+    std::vector<float> scores;
+    std::vector<char> states;
+    std::vector<bool> referenced;
+    size_t hand{0};
+  };
+
+  size_t capacity_;
+  size_t stateSize_;
+  size_t shardCapacity_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+
+  std::atomic<uint64_t> nHits_{0};
+  std::atomic<uint64_t> nMisses_{0};
+
+  Shard& shard(const Key& key);
+};
+
+using LMScoreCachePtr = std::shared_ptr<LMScoreCache>;
+} // namespace text
+} // namespace lib
+} // namespace fl
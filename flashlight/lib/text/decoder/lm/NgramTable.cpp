@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/lib/text/decoder/lm/NgramTable.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "flashlight/lib/common/String.h"
+#include "flashlight/lib/common/System.h"
+
+namespace fl {
+namespace lib {
+namespace text {
+
+NgramTable::NgramTable(
+    const std::string& path,
+    const Dictionary& usrTknDict) {
+  bos_ = usrTknDict.contains("<s>") ? usrTknDict.getIndex("<s>")
+                                    : usrTknDict.indexSize();
+  eos_ = usrTknDict.contains("</s>") ? usrTknDict.getIndex("</s>")
+                                     : usrTknDict.indexSize() + 1;
+  auto wordIndex = [&](const std::string& word) {
+    if (usrTknDict.contains(word)) {
+      return usrTknDict.getIndex(word);
+    } else if (word == "<s>") {
+      return bos_;
+    } else if (word == "</s>") {
+      return eos_;
+    }
+    return -1;
+  };
+
+  auto stream = createInputStream(path);
+  std::vector<NgramTableEntry> ngrams;
+  std::string line;
+  int order = -1; // Order of the current section, 0 in the header
+  int ngram[kNgramTableMaxOrder];
+  while (std::getline(stream, line)) {
+    line = trim(line);
+    if (line.empty()) {
+      continue;
+    }
+    if (line == "\\data\\") {
+      order = 0;
+      continue;
+    }
+    if (line == "\\end\\") {
+      break;
+    }
+    if (line[0] == '\\') {
+      // Section header: \N-grams:
+      order = std::stoi(line.substr(1));
+      if (order < 1 || order > kNgramTableMaxOrder) {
+        throw std::invalid_argument(
+            "[NgramTable] Unsupported n-gram order in " + path + ": " + line);
+      }
+      order_ = std::max(order_, order);
+      continue;
+    }
+    if (order <= 0) {
+      // Header lines (ngram N=count) or text before the data section
+      continue;
+    }
+
+    auto fields = splitOnWhitespace(line, true);
+    if (fields.size() != order + 1 && fields.size() != order + 2) {
+      throw std::runtime_error(
+          "[NgramTable] Invalid line in " + path + ": " + line);
+    }
+    float logProb = std::stof(fields[0]);
+    float backoff = fields.size() == order + 2 ? std::stof(fields.back()) : 0;
+    if (order == 1 && fields[1] == "<unk>") {
+      unkLogProb_ = logProb;
+    }
+    bool known = true;
+    for (int i = 0; i < order; i++) {
+      ngram[i] = wordIndex(fields[i + 1]);
+      known = known && ngram[i] >= 0;
+    }
+    if (known) {
+      ngrams.push_back({ngramHash(ngram, order), logProb, backoff});
+    }
+  }
+  if (order_ == 0) {
+    throw std::runtime_error("[NgramTable] No n-gram found in " + path);
+  }
+
+  // Keep the load factor below 0.5 so that probing sequences stay short
+  size_t nSlots = 2;
+  while (nSlots < 2 * ngrams.size()) {
+    nSlots *= 2;
+  }
+  entries_.assign(nSlots, {0, 0, 0});
+  for (const auto& entry : ngrams) {
+    for (size_t i = entry.key & (nSlots - 1);; i = (i + 1) & (nSlots - 1)) {
+      if (entries_[i].key == 0 || entries_[i].key == entry.key) {
+        entries_[i] = entry;
+        break;
+      }
+    }
+  }
+}
+
+NgramContext NgramTable::start() const {
+  NgramContext context;
+  context.length = order_ > 1 ? 1 : 0;
+  context.words[0] = bos_;
+  return context;
+}
+} // namespace text
+} // namespace lib
+} // namespace fl
@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "flashlight/lib/text/dictionary/Dictionary.h"
+
+#ifdef __CUDACC__
+#define FL_NGRAM_HOST_DEVICE __host__ __device__
+#else
+#define FL_NGRAM_HOST_DEVICE
+#endif
+
+namespace fl {
+namespace lib {
+namespace text {
+
+constexpr int kNgramTableMaxOrder = 6;
+
+/**
+ * An n-gram of the table. `key` is the hash of the word indices of the n-gram
+ * (0 marks an empty slot), `logProb` and `backoff` are in log10 as in the
+ * ARPA file.
+ */
+struct NgramTableEntry {
+  uint64_t key;
+  float logProb;
+  float backoff;
+};
+
+/* Fixed size LM state: the last (order - 1) words, oldest first */
+struct NgramContext {
+  int words[kNgramTableMaxOrder - 1];
+  int length;
+};
+
+/* Hash of the word sequence `words[0..n)`, never 0 */
+FL_NGRAM_HOST_DEVICE inline uint64_t ngramHash(const int* words, int n) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (int i = 0; i < n; i++) {
+    hash ^= static_cast<uint32_t>(words[i]) + 1;
+    hash *= 0x100000001b3ULL;
+  }
+  // splitmix64 finalizer, spreads the FNV-1a hash over the low bits
+  hash ^= hash >> 30;
+  hash *= 0xbf58476d1ce4e5b9ULL;
+  hash ^= hash >> 27;
+  hash *= 0x94d049bb133111ebULL;
+  hash ^= hash >> 31;
+  return hash == 0 ? 1 : hash;
+}
+
+/**
+ * NgramTableView is a non-owning view of the open addressing (linear probing)
+ * table of an NgramTable. It only holds a pointer and a few scalars, so that
+ * it can be passed by value to CUDA kernels once the entries are copied to the
+ * device: the same lookup code runs on the host and on the device.
+ */
+struct NgramTableView {
+  const NgramTableEntry* entries;
+  uint64_t mask; // Number of slots - 1, a power of 2 minus 1
+  int order;
+  float unkLogProb; // Log probability of the words absent from the table
+
+  FL_NGRAM_HOST_DEVICE const NgramTableEntry* find(const int* words, int n)
+      const {
+    uint64_t key = ngramHash(words, n);
+    for (uint64_t i = key & mask;; i = (i + 1) & mask) {
+      if (entries[i].key == key) {
+        return &entries[i];
+      }
+      if (entries[i].key == 0) {
+        return nullptr;
+      }
+    }
+  }
+
+  /**
+   * Score `word` following `context` with the ARPA back-off rule, and write
+   * the context following it into `outContext`.
+   */
+  FL_NGRAM_HOST_DEVICE float
+  score(const NgramContext& context, int word, NgramContext& outContext) const {
+    int ngram[kNgramTableMaxOrder];
+    const int n = context.length;
+    for (int i = 0; i < n; i++) {
+      ngram[i] = context.words[i];
+    }
+    ngram[n] = word;
+
+    float backoff = 0, logProb = unkLogProb;
+    for (int start = 0; start <= n; start++) {
+      const NgramTableEntry* entry = find(ngram + start, n + 1 - start);
+      if (entry) {
+        logProb = entry->logProb;
+        break;
+      }
+      if (start < n) {
+        const NgramTableEntry* history = find(ngram + start, n - start);
+        if (history) {
+          backoff += history->backoff;
+        }
+      }
+    }
+
+    const int keep = n + 1 < order - 1 ? n + 1 : order - 1;
+    for (int i = 0; i < keep; i++) {
+      outContext.words[i] = ngram[n + 1 - keep + i];
+    }
+    outContext.length = keep;
+    return backoff + logProb;
+  }
+};
+
+/**
+ * NgramTable loads an n-gram LM from an ARPA file into a flat hash table,
+ * which can be copied as is to a GPU (see CudaLexiconDecoder) and queried
+ * there through an NgramTableView. Words are mapped to their index in
+ * `usrTknDict`, n-grams containing words outside of it are dropped since a
+ * decoder can never query them. `<s>` and `</s>` get their own indices when not
+ * in the dictionary.
+ *
+ * Unlike KenLM, the state of the LM is always the last (order - 1) words, and
+ * two n-grams with the same 64-bit hash are considered identical.
+ */
+class NgramTable {
+ public:
+  NgramTable(const std::string& path, const Dictionary& usrTknDict);
+
+  /* LM context at the beginning of a sentence */
+  NgramContext start() const;
+
+  /* Score `word` following `context`, see NgramTableView::score() */
+  float score(const NgramContext& context, int word, NgramContext& outContext)
+      const {
+    return view().score(context, word, outContext);
+  }
+
+  /* Score the end of sentence following `context` */
+  float finish(const NgramContext& context, NgramContext& outContext) const {
+    return score(context, eos_, outContext);
+  }
+
+  /* View of the table stored in host memory */
+  NgramTableView view() const {
+    return view(entries_.data());
+  }
+
+  /* View of a copy of the table, e.g. stored in device memory */
+  NgramTableView view(const NgramTableEntry* entries) const {
+    return {entries, entries_.size() - 1, order_, unkLogProb_};
+  }
+
+  const std::vector<NgramTableEntry>& entries() const {
+    return entries_;
+  }
+
+  int order() const {
+    return order_;
+  }
+
+  int bos() const {
+    return bos_;
+  }
+
+  int eos() const {
+    return eos_;
+  }
+
+ private:
+  std::vector<NgramTableEntry> entries_;
+  int order_{0};
+  int bos_;
+  int eos_;
+  float unkLogProb_{-100};
+};
+
+using NgramTablePtr = std::shared_ptr<NgramTable>;
+} // namespace text
+} // namespace lib
+} // namespace fl
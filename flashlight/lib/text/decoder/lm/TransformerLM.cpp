@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <unordered_set>
+
+#include "flashlight/lib/text/decoder/lm/TransformerLM.h"
+
+namespace fl {
+namespace lib {
+namespace text {
+
+TransformerLM::TransformerLM(
+    const TransformerLmScoreFunc& scoreFunc,
+    const std::string& tokenVocabPath,
+    const Dictionary& usrTknDict,
+    int batchSize)
+    : scoreFunc_(scoreFunc), batchSize_(batchSize) {
+  if (batchSize < 1) {
+    throw std::invalid_argument("[TransformerLM] Batch size is too small.");
+  }
+
+  /* Load token vocabulary */
+  std::cerr << "[TransformerLM]: Loading vocabulary from " << tokenVocabPath
+            << "\n";
+  vocab_ = Dictionary(tokenVocabPath);
+  vocab_.setDefaultIndex(vocab_.getIndex(kUnkToken));
+  vocabSize_ = vocab_.indexSize();
+  std::cerr << "[TransformerLM]: vocabulary size " << vocabSize_ << "\n";
+
+  /* Create index map */
+  usrToLmIdxMap_.resize(usrTknDict.indexSize());
+  for (int i = 0; i < usrTknDict.indexSize(); i++) {
+    auto token = usrTknDict.getEntry(i);
+    usrToLmIdxMap_[i] = vocab_.getIndex(token.c_str());
+  }
+}
+
+LMStatePtr TransformerLM::start(bool startWithNothing) {
+  if (startWithNothing) {
+    throw std::invalid_argument(
+        "[TransformerLM] Only support using EOS to start the sentence");
+  }
+  auto outState = std::make_shared<TransformerLMState>();
+  outState->token = vocab_.getIndex(kEosToken);
+  outState->length = 1;
+  return outState;
+}
+
+std::pair<LMStatePtr, float> TransformerLM::scoreWithLmIdx(
+    const LMStatePtr& state,
+    const int tokenIdx) {
+  if (tokenIdx < 0 || tokenIdx >= vocabSize_) {
+    throw std::out_of_range(
+        "[TransformerLM] Invalid query word: " + std::to_string(tokenIdx));
+  }
+  auto rawInState = std::static_pointer_cast<TransformerLMState>(state).get();
+  if (!rawInState->scores) {
+    scoreStates({rawInState});
+  }
+  auto outState = std::make_shared<TransformerLMState>();
+  outState->token = tokenIdx;
+  outState->length = rawInState->length + 1;
+  outState->cacheIn = rawInState->cache;
+
+  float score = (*rawInState->scores)[tokenIdx];
+  if (std::isnan(score) || !std::isfinite(score)) {
+    throw std::runtime_error(
+        "[TransformerLM] Bad scoring from TransformerLM: " +
+        std::to_string(score));
+  }
+  return std::make_pair(std::move(outState), score);
+}
+
+void TransformerLM::scoreStates(
+    const std::vector<TransformerLMState*>& states) {
+  std::vector<TransformerLMState*> toScore;
+  std::unordered_set<TransformerLMState*> seen;
+  for (auto state : states) {
+    if (!state->scores && seen.insert(state).second) {
+      toScore.push_back(state);
+    }
+  }
+  for (size_t start = 0; start < toScore.size(); start += batchSize_) {
+    size_t end = std::min(toScore.size(), start + batchSize_);
+    std::vector<int> tokens;
+    std::vector<std::shared_ptr<void>> caches;
+    for (size_t i = start; i < end; ++i) {
+      tokens.push_back(toScore[i]->token);
+      caches.push_back(toScore[i]->cacheIn);
+    }
+    auto scores = scoreFunc_(tokens, caches);
+    int nBatchStates = end - start;
+    if (scores.size() != static_cast<size_t>(vocabSize_) * nBatchStates ||
+        caches.size() != static_cast<size_t>(nBatchStates)) {
+      throw std::logic_error(
+          "[TransformerLM] Batch X Vocab size " +
+          std::to_string(scores.size()) + " mismatch with " +
+          std::to_string(vocabSize_ * nBatchStates));
+    }
+    for (int i = 0; i < nBatchStates; ++i) {
+      auto state = toScore[start + i];
+      auto first = scores.begin() + static_cast<size_t>(vocabSize_) * i;
+      state->scores =
+          std::make_shared<std::vector<float>>(first, first + vocabSize_);
+      state->cache = caches[i];
+      // The cache of the parent is kept by the children of the state
+      state->cacheIn.reset();
+    }
+  }
+}
+
+std::pair<LMStatePtr, float> TransformerLM::score(
+    const LMStatePtr& state,
+    const int usrTokenIdx) {
+  if (usrTokenIdx < 0 || usrTokenIdx >= usrToLmIdxMap_.size()) {
+    throw std::out_of_range(
+        "[TransformerLM] Invalid user token index: " +
+        std::to_string(usrTokenIdx));
+  }
+  return scoreWithLmIdx(state, usrToLmIdxMap_[usrTokenIdx]);
+}
+
+std::vector<std::pair<LMStatePtr, float>> TransformerLM::scoreBatch(
+    const std::vector<LMQuery>& queries) {
+  // The states of the queries are scored in a single pass, each query then
+  // reads its score
+  std::vector<TransformerLMState*> states;
+  states.reserve(queries.size());
+  for (const auto& query : queries) {
+    states.push_back(
+        std::static_pointer_cast<TransformerLMState>(query.first).get());
+  }
+  scoreStates(states);
+  return LM::scoreBatch(queries);
+}
+
+std::pair<LMStatePtr, float> TransformerLM::finish(const LMStatePtr& state) {
+  return scoreWithLmIdx(state, vocab_.getIndex(kEosToken));
+}
+
+void TransformerLM::updateCache(std::vector<LMStatePtr> states) {
+  std::vector<TransformerLMState*> rawStates;
+  rawStates.reserve(states.size());
+  for (const auto& state : states) {
+    rawStates.push_back(
+        std::static_pointer_cast<TransformerLMState>(state).get());
+  }
+  scoreStates(rawStates);
+}
+} // namespace text
+} // namespace lib
+} // namespace fl
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <functional>
+#include <memory>
+
+#include "flashlight/lib/text/decoder/lm/LM.h"
+#include "flashlight/lib/text/dictionary/Defines.h"
+#include "flashlight/lib/text/dictionary/Dictionary.h"
+
+namespace fl {
+namespace lib {
+namespace text {
+
+/**
+ * Scoring of a batch of states: forwards the last token of each state (first
+ * argument) attending to the cached keys and values of its previous tokens
+ * (second argument, null at the start of a sentence), which it replaces with
+ * the cache after the token. Returns the scores of the next token (batch x
+ * vocabulary).
+ */
+using TransformerLmScoreFunc = std::function<std::vector<float>(
+    const std::vector<int>&,
+    std::vector<std::shared_ptr<void>>&)>;
+
+struct TransformerLMState : LMState {
+  int token;
+  int length;
+  // The cache of the network before the last token, and after it once the
+  // state is scored; the caches of sibling states share the one of their
+  // parent
+  std::shared_ptr<void> cacheIn, cache;
+  // Scores of the next token, once the state is scored
+  std::shared_ptr<std::vector<float>> scores;
+
+  TransformerLMState() : token(-1), length(0) {}
+};
+
+/**
+ * Language model running a transformer decoder (e.g. trained with
+ * `fl/app/lm`) incrementally: the last token of each state attends to the
+ * cached keys and values of its prefix, so that scoring a state costs O(T)
+ * rather than O(T^2) in its length. The states of a frame are scored
+ * together by `scoreBatch()` and `updateCache()`, in batches of `batchSize`
+ * states.
+ */
+class TransformerLM : public LM {
+ public:
+  TransformerLM(
+      const TransformerLmScoreFunc& scoreFunc,
+      const std::string& tokenVocabPath,
+      const Dictionary& usrTknDict,
+      int batchSize = 256);
+
+  LMStatePtr start(bool startWithNothing) override;
+
+  std::pair<LMStatePtr, float> score(
+      const LMStatePtr& state,
+      const int usrTokenIdx) override;
+
+  std::vector<std::pair<LMStatePtr, float>> scoreBatch(
+      const std::vector<LMQuery>& queries) override;
+
+  std::pair<LMStatePtr, float> finish(const LMStatePtr& state) override;
+
+  void updateCache(std::vector<LMStatePtr> states) override;
+
+ private:
+  Dictionary vocab_;
+  TransformerLmScoreFunc scoreFunc_;
+  int vocabSize_;
+  int batchSize_;
+
+  std::pair<LMStatePtr, float> scoreWithLmIdx(
+      const LMStatePtr& state,
+      const int tokenIdx);
+
+  // Scores the states which aren't scored yet, in batches
+  void scoreStates(const std::vector<TransformerLMState*>& states);
+};
+} // namespace text
+} // namespace lib
+} // namespace fl
@@ -52,6 +52,8 @@ class Dictionary {
       const std::vector<int>& indices) const;
 
  private:
+  friend class FrozenDictionary;
+
   // Creates a dictionary from an input stream
   void createFromStream(std::istream& stream);
 
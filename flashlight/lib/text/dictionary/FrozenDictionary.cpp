@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "flashlight/lib/text/dictionary/FrozenDictionary.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+namespace fl {
+namespace lib {
+namespace text {
+
+namespace {
+
+constexpr char kMagic[8] = {'F', 'L', 'D', 'I', 'C', 'T', '\0', '\0'};
+constexpr uint32_t kFormatVersion = 1;
+
+// FNV-1a
+uint64_t hashEntry(const char* data, size_t size) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+} // namespace
+
+struct FrozenDictionary::Header {
+  char magic[8];
+  uint32_t version;
+  int32_t defaultIndex;
+  uint64_t entrySize;
+  uint64_t indexSize;
+  // Size of the table from indices to entries, i.e. the max index + 1
+  uint64_t numIndices;
+  uint64_t numSlots;
+  uint64_t charsSize;
+  uint64_t reserved;
+};
+
+struct FrozenDictionary::Slot {
+  uint64_t hash;
+  uint64_t offset;
+  uint32_t size;
+  int32_t index; // -1 for an empty slot
+};
+
+FrozenDictionary::FrozenDictionary(const Dictionary& dictionary) {
+  // Entries are sorted so that the buffer does not depend on hashing order
+  std::vector<std::pair<int, std::string>> entries;
+  entries.reserve(dictionary.entry2idx_.size());
+  for (const auto& item : dictionary.entry2idx_) {
+    if (item.second < 0) {
+      throw std::invalid_argument(
+          "FrozenDictionary: negative index for entry '" + item.first + "'");
+    }
+    entries.emplace_back(item.second, item.first);
+  }
+  std::sort(entries.begin(), entries.end());
+
+  Header header{};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kFormatVersion;
+  header.defaultIndex = dictionary.defaultIndex_;
+  header.entrySize = entries.size();
+  header.indexSize = dictionary.idx2entry_.size();
+  header.numIndices = entries.empty() ? 0 : entries.back().first + 1;
+  // A load factor of at most 1/2 keeps the probe sequences short
+  header.numSlots = 8;
+  while (header.numSlots < 2 * entries.size()) {
+    header.numSlots *= 2;
+  }
+
+  std::vector<Slot> slots(header.numSlots, Slot{0, 0, 0, -1});
+  std::string chars;
+  auto mask = header.numSlots - 1;
+  for (const auto& entry : entries) {
+    Slot item{hashEntry(entry.second.data(), entry.second.size()),
+              chars.size(),
+              static_cast<uint32_t>(entry.second.size()),
+              entry.first};
+    chars += entry.second;
+    // Robin-hood insertion: an entry further from its ideal slot than the
+    // one in place takes the slot, and the displaced entry moves on
+    uint64_t distance = 0;
+    for (auto pos = item.hash & mask;; pos = (pos + 1) & mask, ++distance) {
+      auto& slot = slots[pos];
+      if (slot.index < 0) {
+        slot = item;
+        break;
+      }
+      auto slotDistance = (pos - (slot.hash & mask)) & mask;
+      if (slotDistance < distance) {
+        std::swap(slot, item);
+        distance = slotDistance;
+      }
+    }
+  }
+  header.charsSize = chars.size();
+
+  std::vector<int64_t> entrySlots(header.numIndices, -1);
+  for (size_t pos = 0; pos < slots.size(); ++pos) {
+    if (slots[pos].index < 0) {
+      continue;
+    }
+    // getEntry() returns the first entry added for an index, as Dictionary
+    const auto& entry = dictionary.idx2entry_.at(slots[pos].index);
+    if (chars.compare(slots[pos].offset, slots[pos].size, entry) == 0) {
+      entrySlots[slots[pos].index] = pos;
+    }
+  }
+
+  size_t size = sizeof(Header) + slots.size() * sizeof(Slot) +
+      entrySlots.size() * sizeof(int64_t) + chars.size();
+  storage_.resize(size);
+  auto out = storage_.data();
+  std::memcpy(out, &header, sizeof(Header));
+  out += sizeof(Header);
+  std::memcpy(out, slots.data(), slots.size() * sizeof(Slot));
+  out += slots.size() * sizeof(Slot);
+  std::memcpy(out, entrySlots.data(), entrySlots.size() * sizeof(int64_t));
+  out += entrySlots.size() * sizeof(int64_t);
+  std::memcpy(out, chars.data(), chars.size());
+  setBuffer(storage_.data(), storage_.size());
+}
+
+FrozenDictionary::FrozenDictionary(const std::string& filename) {
+  mapping_ = std::make_unique<MemoryMappedFile>(filename);
+  if (mapping_->size() < sizeof(Header)) {
+    throw std::runtime_error("FrozenDictionary: invalid file: " + filename);
+  }
+  try {
+    setBuffer(mapping_->data(), mapping_->size());
+  } catch (const std::exception& ex) {
+    throw std::runtime_error(std::string(ex.what()) + ": " + filename);
+  }
+}
+
+void FrozenDictionary::setBuffer(const char* data, size_t size) {
+  static_assert(sizeof(Header) == 64, "unexpected padding in Header");
+  static_assert(sizeof(Slot) == 24, "unexpected padding in Slot");
+  header_ = reinterpret_cast<const Header*>(data);
+  if (std::memcmp(header_->magic, kMagic, sizeof(kMagic)) != 0 ||
+      header_->version != kFormatVersion) {
+    throw std::runtime_error("FrozenDictionary: invalid header");
+  }
+  auto numSlots = header_->numSlots;
+  if (numSlots == 0 || (numSlots & (numSlots - 1)) != 0 ||
+      size !=
+          sizeof(Header) + numSlots * sizeof(Slot) +
+              header_->numIndices * sizeof(int64_t) + header_->charsSize) {
+    throw std::runtime_error("FrozenDictionary: invalid layout");
+  }
+  data_ = data;
+  size_ = size;
+  slots_ = reinterpret_cast<const Slot*>(data + sizeof(Header));
+  entrySlots_ = reinterpret_cast<const int64_t*>(slots_ + numSlots);
+  chars_ = reinterpret_cast<const char*>(entrySlots_ + header_->numIndices);
+}
+
+void FrozenDictionary::save(const std::string& filename) const {
+  auto tmpPath = filename + ".tmp";
+  {
+    std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+      throw std::runtime_error(
+          "FrozenDictionary: failed to open file for writing: " + tmpPath);
+    }
+    file.write(data_, size_);
+    if (!file) {
+      throw std::runtime_error(
+          "FrozenDictionary: failed to write file: " + tmpPath);
+    }
+  }
+  if (std::rename(tmpPath.c_str(), filename.c_str()) != 0) {
+    throw std::runtime_error(
+        "FrozenDictionary: failed to rename " + tmpPath + " to " + filename);
+  }
+}
+
+size_t FrozenDictionary::entrySize() const {
+  return header_->entrySize;
+}
+
+size_t FrozenDictionary::indexSize() const {
+  return header_->indexSize;
+}
+
+int FrozenDictionary::find(const char* entry, size_t size) const {
+  auto hash = hashEntry(entry, size);
+  auto mask = header_->numSlots - 1;
+  uint64_t distance = 0;
+  for (auto pos = hash & mask;; pos = (pos + 1) & mask, ++distance) {
+    const auto& slot = slots_[pos];
+    // With robin-hood ordering, an entry is never past a slot closer to its
+    // own ideal position
+    if (slot.index < 0 || ((pos - (slot.hash & mask)) & mask) < distance) {
+      return -1;
+    }
+    if (slot.hash == hash && slot.size == size &&
+        std::memcmp(chars_ + slot.offset, entry, size) == 0) {
+      return slot.index;
+    }
+  }
+}
+
+const FrozenDictionary::Slot& FrozenDictionary::entrySlot(int idx) const {
+  if (idx < 0 || static_cast<uint64_t>(idx) >= header_->numIndices ||
+      entrySlots_[idx] < 0) {
+    throw std::invalid_argument(
+        "Unknown index in dictionary '" + std::to_string(idx) + "'");
+  }
+  return slots_[entrySlots_[idx]];
+}
+
+std::string FrozenDictionary::getEntry(int idx) const {
+  const auto& slot = entrySlot(idx);
+  return std::string(chars_ + slot.offset, slot.size);
+}
+
+int FrozenDictionary::getIndex(const char* entry, size_t size) const {
+  auto idx = find(entry, size);
+  if (idx < 0) {
+    if (header_->defaultIndex < 0) {
+      throw std::invalid_argument(
+          "Unknown entry in dictionary: '" + std::string(entry, size) + "'");
+    }
+    return header_->defaultIndex;
+  }
+  return idx;
+}
+
+int FrozenDictionary::getIndex(const std::string& entry) const {
+  return getIndex(entry.data(), entry.size());
+}
+
+bool FrozenDictionary::contains(const char* entry, size_t size) const {
+  return find(entry, size) >= 0;
+}
+
+bool FrozenDictionary::contains(const std::string& entry) const {
+  return find(entry.data(), entry.size()) >= 0;
+}
+
+std::vector<int> FrozenDictionary::mapEntriesToIndices(
+    const std::vector<std::string>& entries) const {
+  std::vector<int> indices;
+  indices.reserve(entries.size());
+  for (const auto& tkn : entries) {
+    indices.emplace_back(getIndex(tkn));
+  }
+  return indices;
+}
+
+std::vector<std::string> FrozenDictionary::mapIndicesToEntries(
+    const std::vector<int>& indices) const {
+  std::vector<std::string> entries;
+  entries.reserve(indices.size());
+  for (const auto& idx : indices) {
+    entries.emplace_back(getEntry(idx));
+  }
+  return entries;
+}
+
+} // namespace text
+} // namespace lib
+} // namespace fl
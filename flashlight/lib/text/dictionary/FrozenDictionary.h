@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "flashlight/lib/common/System.h"
+#include "flashlight/lib/text/dictionary/Dictionary.h"
+
+namespace fl {
+namespace lib {
+namespace text {
+
+/**
+ * An immutable copy of a `Dictionary`, laid out in a single flat buffer: the
+ * entries are stored contiguously, and looked up with a robin-hood hash table
+ * using open addressing, without allocating. Lookups accept any range of
+ * characters, e.g. a token in a larger text buffer.
+ *
+ * Since it is never modified, a `FrozenDictionary` can be read concurrently
+ * by any number of threads. It can also be saved, and memory-mapped by
+ * several processes which then share the same pages.
+ *
+ * Usage:
+ *
+ * Dictionary dict(filename);
+ * FrozenDictionary frozen(dict);
+ * frozen.save(filename + ".frozen");
+ * ...
+ * FrozenDictionary mapped(filename + ".frozen");
+ * int idx = mapped.getIndex(token.data(), token.size());
+ */
+class FrozenDictionary {
+ public:
+  /** Copies a dictionary, including its default index. */
+  explicit FrozenDictionary(const Dictionary& dictionary);
+
+  /** Maps a file written by `save()`. */
+  explicit FrozenDictionary(const std::string& filename);
+
+  FrozenDictionary(const FrozenDictionary&) = delete;
+  FrozenDictionary& operator=(const FrozenDictionary&) = delete;
+
+  void save(const std::string& filename) const;
+
+  size_t entrySize() const;
+
+  size_t indexSize() const;
+
+  std::string getEntry(int idx) const;
+
+  int getIndex(const char* entry, size_t size) const;
+
+  int getIndex(const std::string& entry) const;
+
+  bool contains(const char* entry, size_t size) const;
+
+  bool contains(const std::string& entry) const;
+
+  std::vector<int> mapEntriesToIndices(
+      const std::vector<std::string>& entries) const;
+
+  std::vector<std::string> mapIndicesToEntries(
+      const std::vector<int>& indices) const;
+
+ private:
+  struct Header;
+  struct Slot;
+
+  // Sets the pointers into the buffer, checking its layout
+  void setBuffer(const char* data, size_t size);
+
+  // Returns the index of an entry, or -1 if it is missing
+  int find(const char* entry, size_t size) const;
+
+  const Slot& entrySlot(int idx) const;
+
+  std::vector<char> storage_;
+  std::unique_ptr<MemoryMappedFile> mapping_;
+
+  const char* data_{nullptr};
+  size_t size_{0};
+  const Header* header_{nullptr};
+  const Slot* slots_{nullptr};
+  const int64_t* entrySlots_{nullptr};
+  const char* chars_{nullptr};
+};
+
+} // namespace text
+} // namespace lib
+} // namespace fl
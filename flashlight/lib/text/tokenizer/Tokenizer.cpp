@@ -8,7 +8,10 @@
 #include "flashlight/lib/text/tokenizer/Tokenizer.h"
 
 #include <algorithm>
+#include <cstring>
+#include <fstream>
 #include <future>
+#include <stdexcept>
 
 #include "flashlight/lib/text/tokenizer/PartialFileReader.h"
 
@@ -16,7 +19,222 @@ namespace fl {
 namespace lib {
 namespace text {
 
-using TokenCountMap = std::unordered_map<std::string, size_t>;
+namespace {
+
+constexpr size_t kReadBufferSize = 1 << 24;
+constexpr size_t kInitialTableSize = 1 << 16;
+constexpr size_t kNumShards = 256;
+
+bool isSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' ||
+      c == '\r';
+}
+
+// FNV-1a
+uint64_t hashToken(const char* data, size_t size) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// The low bits of the hash select the slot, the high bits the shard
+size_t shardOf(uint64_t hash) {
+  return (hash >> 40) % kNumShards;
+}
+
+/**
+ * An open-addressing hash table counting tokens, with linear probing. The
+ * bytes of the tokens are stored contiguously in the table, so that counting a
+ * token already seen neither allocates nor copies it.
+ */
+class TokenCountTable {
+ public:
+  struct Slot {
+    uint64_t hash;
+    size_t offset;
+    size_t size;
+    size_t count; // 0 for an empty slot
+  };
+
+  TokenCountTable() : slots_(kInitialTableSize) {}
+
+  void add(const char* data, size_t size) {
+    auto hash = hashToken(data, size);
+    auto mask = slots_.size() - 1;
+    for (auto i = hash & mask;; i = (i + 1) & mask) {
+      auto& slot = slots_[i];
+      if (slot.count == 0) {
+        slot.hash = hash;
+        slot.offset = chars_.size();
+        slot.size = size;
+        slot.count = 1;
+        chars_.insert(chars_.end(), data, data + size);
+        if (++numTokens_ * 2 > slots_.size()) {
+          grow();
+        }
+        return;
+      }
+      if (slot.hash == hash && slot.size == size &&
+          std::memcmp(chars_.data() + slot.offset, data, size) == 0) {
+        ++slot.count;
+        return;
+      }
+    }
+  }
+
+  const std::vector<Slot>& slots() const {
+    return slots_;
+  }
+
+  std::string token(const Slot& slot) const {
+    return std::string(chars_.data() + slot.offset, slot.size);
+  }
+
+ private:
+  void grow() {
+    std::vector<Slot> slots(slots_.size() * 2);
+    auto mask = slots.size() - 1;
+    for (const auto& slot : slots_) {
+      if (slot.count == 0) {
+        continue;
+      }
+      auto i = slot.hash & mask;
+      while (slots[i].count != 0) {
+        i = (i + 1) & mask;
+      }
+      slots[i] = slot;
+    }
+    slots_.swap(slots);
+  }
+
+  std::vector<Slot> slots_;
+  std::vector<char> chars_;
+  size_t numTokens_{0};
+};
+
+struct PartialCount {
+  size_t numSentences{0};
+  size_t numTokens{0};
+  TokenCountTable table;
+  // Indices of the slots of the table, by shard
+  std::vector<std::vector<size_t>> shards;
+  TextFileMetaData fileMetaData;
+};
+
+// Returns the position following the first end of line at or after `pos`
+size_t nextLineStart(std::ifstream& stream, size_t pos, size_t fileSize) {
+  std::vector<char> buffer(4096);
+  stream.seekg(pos, std::ios::beg);
+  while (pos < fileSize) {
+    auto n = std::min(buffer.size(), fileSize - pos);
+    stream.read(buffer.data(), n);
+    auto it = std::find(buffer.begin(), buffer.begin() + n, '\n');
+    if (it != buffer.begin() + n) {
+      return pos + (it - buffer.begin()) + 1;
+    }
+    pos += n;
+  }
+  return fileSize;
+}
+
+// Counts the tokens of the lines in [begin, end) of the file. The same lines
+// form a sentence as with `PartialFileReader::getLine()`, and the positions
+// in the meta data are the ones following each sentence.
+void countPartialFile(
+    const std::string& filename,
+    size_t begin,
+    size_t end,
+    bool generateMetaData,
+    PartialCount& result) {
+  std::ifstream stream(filename, std::ios::binary);
+  if (!stream.is_open()) {
+    throw std::runtime_error(
+        "Tokenizer::countTokens: failed to open file: " + filename);
+  }
+  stream.seekg(begin, std::ios::beg);
+
+  std::vector<char> buffer(std::min(kReadBufferSize, end - begin));
+  size_t pos = begin; // position in the file of the buffer
+  size_t carry = 0; // bytes of an incomplete token at the buffer start
+  bool lineOpen = false;
+  int lineTokens = 0;
+  while (pos + carry < end) {
+    if (carry == buffer.size()) {
+      // A token longer than the buffer
+      buffer.resize(buffer.size() * 2);
+    }
+    auto n = std::min(buffer.size() - carry, end - pos - carry);
+    stream.read(buffer.data() + carry, n);
+    if (static_cast<size_t>(stream.gcount()) != n) {
+      throw std::runtime_error(
+          "Tokenizer::countTokens: failed to read file: " + filename);
+    }
+    auto filled = carry + n;
+    const char* data = buffer.data();
+    bool inToken = carry > 0;
+    size_t tokenStart = 0;
+    for (size_t i = carry; i < filled; ++i) {
+      char c = data[i];
+      if (!isSpace(c)) {
+        if (!inToken) {
+          inToken = true;
+          tokenStart = i;
+        }
+        lineOpen = true;
+        continue;
+      }
+      if (inToken) {
+        result.table.add(data + tokenStart, i - tokenStart);
+        inToken = false;
+        ++lineTokens;
+      }
+      if (c == '\n') {
+        if (generateMetaData) {
+          result.fileMetaData.push_back({pos + i + 1, lineTokens});
+        }
+        result.numTokens += lineTokens;
+        ++result.numSentences;
+        lineOpen = false;
+        lineTokens = 0;
+      } else {
+        lineOpen = true;
+      }
+    }
+    if (inToken && pos + filled < end) {
+      carry = filled - tokenStart;
+      std::memmove(buffer.data(), data + tokenStart, carry);
+      pos += tokenStart;
+    } else {
+      if (inToken) {
+        result.table.add(data + tokenStart, filled - tokenStart);
+        ++lineTokens;
+      }
+      carry = 0;
+      pos += filled;
+    }
+  }
+  if (lineOpen) {
+    // The last line of the file, without end of line
+    if (generateMetaData) {
+      result.fileMetaData.push_back({end, lineTokens});
+    }
+    result.numTokens += lineTokens;
+    ++result.numSentences;
+  }
+
+  result.shards.resize(kNumShards);
+  const auto& slots = result.table.slots();
+  for (size_t i = 0; i < slots.size(); ++i) {
+    if (slots[i].count > 0) {
+      result.shards[shardOf(slots[i].hash)].push_back(i);
+    }
+  }
+}
+
+} // namespace
 
 std::vector<std::string> Tokenizer::tokenize(
     const std::string& sentence) const {
@@ -27,74 +245,85 @@ void Tokenizer::countTokens(
     const std::string& filename,
     int numWorkers,
     bool generateMetaData) {
-  std::vector<TokenCountMap> subTokenCountMaps(numWorkers);
-  std::vector<TextFileMetaData> subTextFileMetaDatas(numWorkers);
-  std::vector<std::future<int>> futures(numWorkers);
-
-  auto countPartialFile = [this, numWorkers](
-                              const std::string& filename,
-                              int rank,
-                              TokenCountMap& tokenCountMap,
-                              TextFileMetaData& fileMetaData,
-                              bool generateMetaData) -> int {
-    PartialFileReader reader(rank, numWorkers);
-    reader.loadFile(filename);
-    int nSentences = 0;
-    while (reader.hasNextLine()) {
-      auto tokens = tokenize(reader.getLine());
-      for (const auto& token : tokens) {
-        if (tokenCountMap.find(token) == tokenCountMap.end()) {
-          tokenCountMap[token] = 0;
-        }
-        tokenCountMap[token]++;
-      }
-      if (generateMetaData) {
-        fileMetaData.push_back({reader.getPosition(), tokens.size()});
-      }
-      nSentences++;
-    }
+  if (numWorkers < 1) {
+    throw std::invalid_argument(
+        "Tokenizer::countTokens: invalid number of workers: " +
+        std::to_string(numWorkers));
+  }
+  if (tokenCounts_.empty()) {
+    tokenCounts_.resize(kNumShards);
+  }
 
-    return nSentences;
-  };
+  /* 1. Split the file on line boundaries */
+  std::vector<size_t> bounds(numWorkers + 1);
+  {
+    std::ifstream stream(filename, std::ios::binary);
+    if (!stream.is_open()) {
+      throw std::runtime_error(
+          "Tokenizer::countTokens: failed to open file: " + filename);
+    }
+    stream.seekg(0, std::ios::end);
+    const size_t fileSize = stream.tellg();
+    const size_t chunkSize = fileSize / numWorkers;
+    bounds[numWorkers] = fileSize;
+    for (int i = 1; i < numWorkers; ++i) {
+      bounds[i] = nextLineStart(stream, chunkSize * i, fileSize);
+    }
+  }
 
-  /* 1. Launch threads */
+  /* 2. Count tokens in each part */
+  std::vector<PartialCount> partialCounts(numWorkers);
+  std::vector<std::future<void>> futures(numWorkers);
   for (int i = 0; i < numWorkers; ++i) {
     futures[i] = std::async(
         std::launch::async,
         countPartialFile,
         filename,
-        i,
-        std::ref(subTokenCountMaps[i]),
-        std::ref(subTextFileMetaDatas[i]),
-        generateMetaData);
+        bounds[i],
+        bounds[i + 1],
+        generateMetaData,
+        std::ref(partialCounts[i]));
+  }
+  for (auto& future : futures) {
+    future.get();
   }
 
-  /* 2. Gather results */
-  fileMetaData_.clear();
-  TokenCountMap tokenCountMap;
-  for (int i = 0; i < numWorkers; ++i) {
-    totalSentences_ += futures[i].get();
-    // Token counter
-    for (const auto& item : subTokenCountMaps[i]) {
-      if (tokenCountMap.find(item.first) == tokenCountMap.end()) {
-        tokenCountMap[item.first] = 0;
+  /* 3. Merge the counts, shard by shard */
+  auto mergeShards = [this, &partialCounts, numWorkers](int rank) {
+    for (size_t shard = rank; shard < kNumShards; shard += numWorkers) {
+      auto& tokenCount = tokenCounts_[shard];
+      for (const auto& partialCount : partialCounts) {
+        const auto& slots = partialCount.table.slots();
+        for (auto i : partialCount.shards[shard]) {
+          tokenCount[partialCount.table.token(slots[i])] += slots[i].count;
+        }
       }
-      tokenCountMap[item.first] += item.second;
-      totalTokens_ += item.second;
     }
-    // File MetaDatas
+  };
+  for (int i = 0; i < numWorkers; ++i) {
+    futures[i] = std::async(std::launch::async, mergeShards, i);
+  }
+  for (auto& future : futures) {
+    future.get();
+  }
+
+  fileMetaData_.clear();
+  for (const auto& partialCount : partialCounts) {
+    totalSentences_ += partialCount.numSentences;
+    totalTokens_ += partialCount.numTokens;
     if (generateMetaData) {
       fileMetaData_.insert(
           fileMetaData_.end(),
-          subTextFileMetaDatas[i].begin(),
-          subTextFileMetaDatas[i].end());
+          partialCount.fileMetaData.begin(),
+          partialCount.fileMetaData.end());
     }
   }
 
-  /* 3. Sort tokens */
+  /* 4. Sort tokens */
   tokenCountPairs_.clear();
-  for (const auto& item : tokenCountMap) {
-    tokenCountPairs_.push_back(item);
+  for (const auto& tokenCount : tokenCounts_) {
+    tokenCountPairs_.insert(
+        tokenCountPairs_.end(), tokenCount.begin(), tokenCount.end());
   }
   std::sort(
       tokenCountPairs_.begin(),
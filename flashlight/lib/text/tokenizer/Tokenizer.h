@@ -55,6 +55,14 @@ class Tokenizer {
 
   std::vector<std::string> tokenize(const std::string& sentence) const;
 
+  /**
+   * Counts the tokens of a text file, adding them to the counts of the files
+   * previously counted. The file is split into `numWorkers` parts ending on
+   * line boundaries, as with `PartialFileReader`, which are read in large
+   * buffers and counted into per-worker hash tables, which only copy the
+   * first occurrence of each token; the tables are then merged in parallel,
+   * each worker reducing a disjoint set of hash shards.
+   */
   void countTokens(
       const std::string& filename,
       int numWorkers = 1,
@@ -73,6 +81,9 @@ class Tokenizer {
 
   TextFileMetaData fileMetaData_;
   std::vector<TokenCountPair> tokenCountPairs_;
+
+  // Counts of all the files, sharded by hash for the parallel merge
+  std::vector<std::unordered_map<std::string, size_t>> tokenCounts_;
 };
 
 } // namespace text